@@ -110,6 +110,7 @@
 #include "auth/pool_passwd.h"
 #include "auth/scram.h"
 #include "auth/pool_auth.h"
+#include "auth/pool_scram_cache.h"
 #include "utils/base64.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
@@ -122,6 +123,40 @@
 
 #define MOCK_AUTH_NONCE_LEN		32
 
+/*
+ * Per-process cache of PBKDF2 results.  Computing SaltedPassword costs
+ * SCRAM_DEFAULT_ITERATIONS rounds of HMAC-SHA-256, and a child process
+ * repeats it for the same user with the same salt on every connection.
+ * Entries are keyed by a SHA-256 digest of the inputs, so the plain text
+ * password itself is never kept in the cache, and a changed password
+ * simply misses.  Evicted entries are wiped.  Entries missing here are
+ * looked up in the cache shared among children, if enabled (see
+ * pool_scram_cache.c), before being computed.
+ */
+#define SCRAM_KEY_CACHE_SIZE	64
+#define SCRAM_VERIFIER_MAXLEN	256
+
+typedef struct
+{
+	bool		valid;
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];	/* hash of password, salt
+													 * and iterations */
+	uint8		SaltedPassword[SCRAM_KEY_LEN];
+} scram_key_cache_entry;
+
+typedef struct
+{
+	bool		valid;
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];	/* hash of user name and
+													 * password */
+	char		verifier[SCRAM_VERIFIER_MAXLEN];
+} scram_verifier_cache_entry;
+
+static scram_key_cache_entry scram_key_cache[SCRAM_KEY_CACHE_SIZE];
+static int	scram_key_cache_next = 0;
+static scram_verifier_cache_entry scram_verifier_cache[SCRAM_KEY_CACHE_SIZE];
+static int	scram_verifier_cache_next = 0;
+
 typedef enum
 {
 	FE_SCRAM_INIT,
@@ -227,6 +262,8 @@ static void mock_scram_verifier(const char *username, int *iterations,
 					char **salt, uint8 *stored_key, uint8 *server_key);
 static bool is_scram_printable(char *p);
 static char *sanitize_char(char c);
+static void scram_cached_SaltedPassword(const char *password, const char *salt,
+							int saltlen, int iterations, uint8 *result);
 static char *GetMockAuthenticationNonce(void);
 static char *scram_mock_salt(const char *username);
 
@@ -468,6 +505,117 @@ pg_be_scram_build_verifier(const char *password)
 	return result;
 }
 
+/*
+ * Like pg_be_scram_build_verifier, but remember the verifier built for the
+ * given user and password in this process.  A subsequent call with the same
+ * user and password returns the same verifier, i.e. the same salt, much like
+ * PostgreSQL hands out the verifier stored in pg_authid.  This lets the
+ * salted password derived by the client be recognized by the key cache
+ * below instead of being recomputed from a fresh random salt each time.
+ *
+ * The result is palloc'd, so caller is responsible for freeing it.
+ */
+char *
+pg_be_scram_build_cached_verifier(const char *username, const char *password)
+{
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];
+	pg_sha256_ctx ctx;
+	char	   *result;
+	char		verifier[SCRAM_VERIFIER_MAXLEN];
+	int			len;
+	int			i;
+
+	len = strlen(username);
+	pg_sha256_init(&ctx);
+	pg_sha256_update(&ctx, (uint8 *) &len, sizeof(len));
+	pg_sha256_update(&ctx, (uint8 *) username, len);
+	pg_sha256_update(&ctx, (uint8 *) password, strlen(password));
+	pg_sha256_final(&ctx, digest);
+
+	for (i = 0; i < SCRAM_KEY_CACHE_SIZE; i++)
+	{
+		if (scram_verifier_cache[i].valid &&
+			memcmp(scram_verifier_cache[i].digest, digest, sizeof(digest)) == 0)
+			return pstrdup(scram_verifier_cache[i].verifier);
+	}
+
+	/* all the children must hand out the same verifier */
+	if (pool_scram_cache_get(SCRAM_CACHE_VERIFIER, digest, verifier, sizeof(verifier)))
+		result = pstrdup(verifier);
+	else
+	{
+		result = pg_be_scram_build_verifier(password);
+		if (result)
+			pool_scram_cache_put(SCRAM_CACHE_VERIFIER, digest, result, strlen(result) + 1);
+		else
+			pool_scram_cache_put(SCRAM_CACHE_VERIFIER, digest, NULL, 0);
+	}
+
+	if (result && strlen(result) < SCRAM_VERIFIER_MAXLEN)
+	{
+		scram_verifier_cache_entry *entry;
+
+		entry = &scram_verifier_cache[scram_verifier_cache_next];
+		scram_verifier_cache_next = (scram_verifier_cache_next + 1) % SCRAM_KEY_CACHE_SIZE;
+
+		memset(entry, 0, sizeof(*entry));
+		memcpy(entry->digest, digest, sizeof(digest));
+		strlcpy(entry->verifier, result, sizeof(entry->verifier));
+		entry->valid = true;
+	}
+
+	return result;
+}
+
+/*
+ * Compute SaltedPassword, using the per-process cache if the same password,
+ * salt and iteration count were seen before.
+ */
+static void
+scram_cached_SaltedPassword(const char *password, const char *salt,
+							int saltlen, int iterations, uint8 *result)
+{
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];
+	pg_sha256_ctx ctx;
+	scram_key_cache_entry *entry;
+	int			len;
+	int			i;
+
+	len = strlen(password);
+	pg_sha256_init(&ctx);
+	pg_sha256_update(&ctx, (uint8 *) &len, sizeof(len));
+	pg_sha256_update(&ctx, (uint8 *) password, len);
+	pg_sha256_update(&ctx, (uint8 *) &saltlen, sizeof(saltlen));
+	pg_sha256_update(&ctx, (uint8 *) salt, saltlen);
+	pg_sha256_update(&ctx, (uint8 *) &iterations, sizeof(iterations));
+	pg_sha256_final(&ctx, digest);
+
+	for (i = 0; i < SCRAM_KEY_CACHE_SIZE; i++)
+	{
+		if (scram_key_cache[i].valid &&
+			memcmp(scram_key_cache[i].digest, digest, sizeof(digest)) == 0)
+		{
+			memcpy(result, scram_key_cache[i].SaltedPassword, SCRAM_KEY_LEN);
+			return;
+		}
+	}
+
+	if (!pool_scram_cache_get(SCRAM_CACHE_SALTED_PASSWORD, digest, result, SCRAM_KEY_LEN))
+	{
+		scram_SaltedPassword(password, salt, saltlen, iterations, result);
+		pool_scram_cache_put(SCRAM_CACHE_SALTED_PASSWORD, digest, result, SCRAM_KEY_LEN);
+	}
+
+	entry = &scram_key_cache[scram_key_cache_next];
+	scram_key_cache_next = (scram_key_cache_next + 1) % SCRAM_KEY_CACHE_SIZE;
+
+	/* wipe whatever was there before reusing the slot */
+	memset(entry, 0, sizeof(*entry));
+	memcpy(entry->digest, digest, sizeof(digest));
+	memcpy(entry->SaltedPassword, result, SCRAM_KEY_LEN);
+	entry->valid = true;
+}
+
 /*
  * Verify a plaintext password against a SCRAM verifier.  This is used when
  * performing plaintext password authentication for a user that has a SCRAM
@@ -510,7 +658,7 @@ scram_verify_plain_password(const char *username, const char *password,
 	}
 
 	/* Compute Server Key based on the user-supplied plaintext password */
-	scram_SaltedPassword(password, salt, saltlen, iterations, salted_password);
+	scram_cached_SaltedPassword(password, salt, saltlen, iterations, salted_password);
 	scram_ServerKey(salted_password, computed_key);
 
 	/*
@@ -1583,8 +1731,8 @@ calculate_client_proof(fe_scram_state *state,
 	 * Calculate SaltedPassword, and store it in 'state' so that we can reuse
 	 * it later in verify_server_signature.
 	 */
-	scram_SaltedPassword(state->password, state->salt, state->saltlen,
-						 state->iterations, state->SaltedPassword);
+	scram_cached_SaltedPassword(state->password, state->salt, state->saltlen,
+								state->iterations, state->SaltedPassword);
 
 	scram_ClientKey(state->SaltedPassword, ClientKey);
 	scram_H(ClientKey, SCRAM_KEY_LEN, StoredKey);
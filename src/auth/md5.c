@@ -372,6 +372,21 @@ pool_md5_hash(const void *buff, size_t len, char *hexsum)
 	return 1;					/* success */
 }
 
+/*
+ *	pool_md5_binary
+ *
+ *	Same as pool_md5_hash() but returns the 16 bytes MD5 sum in binary
+ *	form.  "sum" must have room for 16 bytes.
+ */
+int
+pool_md5_binary(const void *buff, size_t len, char *sum)
+{
+	if (!calculateDigestFromBuffer((uint8 *) buff, len, (uint8 *) sum))
+		return 0;				/* failed */
+
+	return 1;					/* success */
+}
+
 /*
  * Computes MD5 checksum of "passwd" (a null-terminated string) followed
  * by "salt" (which need not be null-terminated).
@@ -23,6 +23,7 @@
 #include "pool.h"
 #include <unistd.h>
 #include "context/pool_session_context.h"
+#include "context/pool_process_context.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_proto_modules.h"
 #include "utils/pool_stream.h"
@@ -61,7 +62,7 @@
 #define MAX_SASL_PAYLOAD_LEN 1024
 
 
-static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pid, int key, int protoMajor);
+static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pid, int key, int protoMajor, bool flush);
 static int	do_clear_text_password(POOL_CONNECTION * backend, POOL_CONNECTION * frontend, int reauth, int protoMajor);
 static void pool_send_auth_fail(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp);
 static int	do_crypt(POOL_CONNECTION * backend, POOL_CONNECTION * frontend, int reauth, int protoMajor);
@@ -85,6 +86,7 @@ static void authenticate_frontend_SCRAM(POOL_CONNECTION * backend, POOL_CONNECTI
 static void authenticate_frontend_clear_text(POOL_CONNECTION * frontend);
 static bool get_auth_password(POOL_CONNECTION * backend, POOL_CONNECTION * frontend, int reauth,
 				  char **password, PasswordType *passwordType);
+static void do_auth_with_password(POOL_CONNECTION_POOL_SLOT * cp, char *password, bool remember);
 
 /*
  * Do authentication. Assuming the only caller is
@@ -92,6 +94,25 @@ static bool get_auth_password(POOL_CONNECTION * backend, POOL_CONNECTION * front
  */
 void
 connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
+{
+	do_auth_with_password(cp, password, false);
+}
+
+/*
+ * Do authentication for a connection opened by pool_prewarm_connections().
+ * Unlike connection_do_auth(), the authentication method and the
+ * credentials are remembered the way pool_do_auth() does, so that
+ * pool_do_reauth() can authenticate the frontend which reuses the
+ * connection later.  ParameterStatus messages are saved as well.
+ */
+void
+prewarm_connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
+{
+	do_auth_with_password(cp, password, true);
+}
+
+static void
+do_auth_with_password(POOL_CONNECTION_POOL_SLOT * cp, char *password, bool remember)
 {
 	char		kind;
 	int			length;
@@ -157,6 +178,18 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 					 errdetail("backend replied with invalid kind")));
 
 		cp->con->auth_kind = AUTH_REQ_OK;
+
+		if (remember)
+		{
+			/* see do_clear_text_password() */
+			if (strlen(password) > MAX_PASSWORD_SIZE)
+				ereport(ERROR,
+						(errmsg("password authentication failed for user:%s", cp->sp->user),
+						 errdetail("password is too long")));
+			cp->con->pwd_size = strlen(password);
+			memcpy(cp->con->password, password, cp->con->pwd_size);
+			cp->con->passwordType = PASSWORD_TYPE_PLAINTEXT;
+		}
 	}
 	else if (auth_kind == AUTH_REQ_CRYPT)	/* crypt password? */
 	{
@@ -180,6 +213,14 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 					 errdetail("backend replied with invalid kind")));
 
 		cp->con->auth_kind = AUTH_REQ_OK;
+
+		if (remember)
+		{
+			/* see do_crypt() */
+			cp->con->pwd_size = strlen(crypt_password) + 1;
+			memcpy(cp->con->password, crypt_password, cp->con->pwd_size);
+			memcpy(cp->con->salt, salt, 2);
+		}
 	}
 	else if (auth_kind == AUTH_REQ_MD5) /* md5 password? */
 	{
@@ -208,6 +249,17 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 
 		/* Send password packet to backend and receive auth response */
 		kind = send_password_packet(cp->con, PROTO_MAJOR_V3, buf);
+		if (remember)
+		{
+			/*
+			 * Save the password packet in the same way as
+			 * do_md5_single_backend() does.
+			 */
+			cp->con->passwordType = PASSWORD_TYPE_MD5;
+			cp->con->pwd_size = strlen(buf) + 1;
+			memcpy(cp->con->password, buf, cp->con->pwd_size);
+			memcpy(cp->con->salt, salt, sizeof(salt));
+		}
 		pfree(buf);
 		if (kind != AUTH_REQ_OK)
 			ereport(ERROR,
@@ -235,6 +287,13 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 				 errdetail("auth kind %d is not yet supported", auth_kind)));
 	}
 
+	/*
+	 * Remember the authentication method requested by the backend so that
+	 * pool_do_reauth() authenticates the frontend in the same way.
+	 */
+	if (remember)
+		cp->con->auth_kind = auth_kind;
+
 	/*
 	 * Read backend key data and wait until Ready for query arriving or error
 	 * happens.
@@ -314,6 +373,10 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 							(errmsg("failed to authenticate"),
 							 errdetail("unable to read data from socket")));
 
+				/* keep parameter status to be sent to the frontend later */
+				if (remember && kind == 'S')
+					pool_add_param(&cp->con->params, p, p + strlen(p) + 1);
+
 				break;
 
 			default:
@@ -787,6 +850,7 @@ pool_do_auth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 						 errdetail("failed to read key in slot %d", i)));
 			}
 			CONNECTION_SLOT(cp, i)->key = cp->info[i].key = key;
+			pool_coninfo_register_cancel_key(&cp->info[i]);
 
 			cp->info[i].major = sp->major;
 			cp->info[i].minor = sp->minor;
@@ -804,7 +868,7 @@ pool_do_auth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 				(errmsg("authentication failed"),
 				 errdetail("pool_do_auth: all backends are down")));
 	}
-	if (pool_send_backend_key_data(frontend, pid, key, protoMajor))
+	if (pool_send_backend_key_data(frontend, pid, key, protoMajor, true))
 		ereport(ERROR,
 				(errmsg("authentication failed"),
 				 errdetail("failed to send backend data to frontend")));
@@ -858,6 +922,11 @@ pool_do_reauth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 		}
 	}
 
+	/*
+	 * AuthenticationOk and BackendKeyData are left in the write buffer, so
+	 * that the caller sends them together with ParameterStatus and
+	 * ReadyForQuery.
+	 */
 	pool_write(frontend, "R", 1);
 
 	if (protoMajor == PROTO_MAJOR_V3)
@@ -867,8 +936,8 @@ pool_do_reauth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 	}
 
 	msglen = htonl(0);
-	pool_write_and_flush(frontend, &msglen, sizeof(msglen));
-	pool_send_backend_key_data(frontend, MAIN_CONNECTION(cp)->pid, MAIN_CONNECTION(cp)->key, protoMajor);
+	pool_write(frontend, &msglen, sizeof(msglen));
+	pool_send_backend_key_data(frontend, MAIN_CONNECTION(cp)->pid, MAIN_CONNECTION(cp)->key, protoMajor, false);
 	return 0;
 }
 
@@ -899,8 +968,9 @@ pool_send_auth_fail(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp)
 
 /*
  * Send backend key data to frontend. if success return 0 otherwise non 0.
+ * If flush is false, the data is left in the write buffer.
  */
-static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pid, int key, int protoMajor)
+static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pid, int key, int protoMajor, bool flush)
 {
 	char		kind;
 	int			len;
@@ -918,7 +988,10 @@ static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION * frontend, int pi
 			 errdetail("send pid %d to frontend", ntohl(pid))));
 
 	pool_write(frontend, &pid, sizeof(pid));
-	pool_write_and_flush(frontend, &key, sizeof(key));
+	if (flush)
+		pool_write_and_flush(frontend, &key, sizeof(key));
+	else
+		pool_write(frontend, &key, sizeof(key));
 
 	return 0;
 }
@@ -1315,7 +1388,7 @@ authenticate_frontend_SCRAM(POOL_CONNECTION * backend, POOL_CONNECTION * fronten
 				 errdetail("username \"%s\" has invalid password type", frontend->username)));
 	}
 
-	shadow_pass = pg_be_scram_build_verifier(storedPassword);
+	shadow_pass = pg_be_scram_build_cached_verifier(frontend->username, storedPassword);
 	if (!shadow_pass)
 		ereport(ERROR,
 				(errmsg("authentication failed"),
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <netdb.h>
 
 #ifdef __FreeBSD__
@@ -40,6 +41,8 @@
 #include "protocol/pool_connection_pool.h"
 #include "utils/pool_path.h"
 #include "utils/pool_ip.h"
+#include "utils/pool_dns_cache.h"
+#include "utils/sha2.h"
 #include "utils/pool_stream.h"
 #include "utils/pool_signal.h"
 #include "pool_config.h"
@@ -65,6 +68,54 @@ static MemoryContext parsed_hba_context = NULL;
 static List *parsed_hba_lines = NIL;
 static char *HbaFileName;
 
+/*
+ * Index over parsed_hba_lines built by load_hba().  Every rule is filed
+ * under one key: a database name, else a user name, else the masked
+ * address of its CIDR, else a "generic" list of rules to be checked
+ * always.  A lookup collects the candidate lists for the connection,
+ * each sorted by line order, and merges them, so the first rule that
+ * passes the full check is the same one a linear scan would find.
+ */
+#define HBA_INDEX_NBUCKETS	1024
+#define HBA_INDEX_MAXKEY	(2 + sizeof(struct in6_addr))
+
+typedef enum HbaIndexKind
+{
+	HBA_KEY_DATABASE,
+	HBA_KEY_USER,
+	HBA_KEY_ADDR
+} HbaIndexKind;
+
+typedef struct HbaRuleList
+{
+	int		   *rules;			/* positions in HbaIndex.lines, ascending */
+	int			nrules;
+	int			maxrules;
+} HbaRuleList;
+
+typedef struct HbaIndexEntry
+{
+	bool		local;			/* rule for "local" connections? */
+	HbaIndexKind kind;
+	int			keylen;
+	char	   *key;
+	HbaRuleList list;
+	struct HbaIndexEntry *next;
+} HbaIndexEntry;
+
+typedef struct HbaIndex
+{
+	int			nlines;
+	HbaLine   **lines;
+	HbaIndexEntry *buckets[HBA_INDEX_NBUCKETS];
+	HbaRuleList generic[2];		/* [0]: host rules, [1]: local rules */
+	int			nmasks;			/* distinct (family, mask length) pairs */
+	int		   *mask_family;
+	int		   *mask_bits;
+} HbaIndex;
+
+static HbaIndex *parsed_hba_index = NULL;
+
 
 #define token_is_keyword(t, k)	(!t->quoted && strcmp(t->string, k) == 0)
 #define token_matches(t, k)  (strcmp(t->string, k) == 0)
@@ -117,6 +168,16 @@ static void sendAuthRequest(POOL_CONNECTION * frontend, AuthRequest areq);
 static void auth_failed(POOL_CONNECTION * frontend);
 static bool hba_getauthmethod(POOL_CONNECTION * frontend);
 static bool check_hba(POOL_CONNECTION * frontend);
+static bool check_hba_line(POOL_CONNECTION * frontend, HbaLine *hba);
+static bool load_hba_from_stream(FILE *file);
+static HbaIndex *build_hba_index(List *lines);
+static void hba_index_add(HbaIndex *index, bool local, HbaIndexKind kind,
+			  const char *key, int keylen, int rule);
+static HbaRuleList *hba_index_lookup(HbaIndex *index, bool local,
+				 HbaIndexKind kind, const char *key, int keylen);
+static int	hba_addr_key(const struct sockaddr_storage *addr, int bits, char *key);
+static int	hba_mask_bits(const struct sockaddr_storage *mask);
+static bool hba_tokens_are_names(List *tokens, bool users);
 static bool check_user(char *user, List *tokens);
 static bool check_db(const char *dbname, const char *user, List *tokens);
 static List *tokenize_inc_file(List *tokens,
@@ -174,6 +235,37 @@ static POOL_CONNECTION * pam_frontend_kludge;	/* Workaround for passing
 
 static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION *frontend);
 
+/*
+ * Connection to the LDAP server kept by the child process across
+ * authentications, so that a storm of clients does not make a TCP
+ * connection and TLS handshake each.  ldap_conn_key identifies the
+ * pool_hba.conf options it was made with, and ldap_conn_search_bound tells
+ * whether it is still bound as ldapbinddn.
+ */
+static LDAP *ldap_conn = NULL;
+static char *ldap_conn_key = NULL;
+static bool ldap_conn_search_bound = false;
+
+/*
+ * Successful authentications remembered for ldap_auth_cache_ttl seconds.
+ * Only a SHA-256 digest of the credentials salted with a random value
+ * private to the process is kept.
+ */
+#define LDAP_AUTH_CACHE_SIZE	16
+
+typedef struct
+{
+	time_t		expire;			/* expiration absolute time, 0 if unused */
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];
+}			LDAPAuthCacheEntry;
+
+static LDAPAuthCacheEntry ldap_auth_cache[LDAP_AUTH_CACHE_SIZE];
+static uint8 ldap_auth_cache_salt[16];
+static bool ldap_auth_cache_salt_set = false;
+
+static int	GetLDAPConnection(POOL_CONNECTION *frontend, LDAP **ldap, bool *reused);
+static void CloseLDAPConnection(void);
+
 /* LDAP_OPT_DIAGNOSTIC_MESSAGE is the newer spelling */
 #ifndef LDAP_OPT_DIAGNOSTIC_MESSAGE
 #define LDAP_OPT_DIAGNOSTIC_MESSAGE LDAP_OPT_ERROR_STRING
@@ -207,13 +299,6 @@ bool
 load_hba(char *hbapath)
 {
 	FILE	   *file;
-	List	   *hba_lines = NIL;
-	ListCell   *line;
-	List	   *new_parsed_lines = NIL;
-	bool		ok = true;
-	MemoryContext linecxt;
-	MemoryContext oldcxt;
-	MemoryContext hbacxt;
 
 	HbaFileName = pstrdup(hbapath);
 
@@ -226,6 +311,52 @@ load_hba(char *hbapath)
 		return false;
 	}
 
+	return load_hba_from_stream(file);
+}
+
+/*
+ * Same as load_hba(), but parse the given text instead of reading the
+ * file.  Used by child processes to apply the copy of pool_hba.conf
+ * published by the main process.  hbapath is only used for messages.
+ */
+bool
+load_hba_text(char *hbapath, const char *text, size_t len)
+{
+	FILE	   *file;
+
+	HbaFileName = pstrdup(hbapath);
+
+	if (len == 0)
+		file = fopen("/dev/null", "r");
+	else
+		file = fmemopen((void *) text, len, "r");
+	if (file == NULL)
+	{
+		ereport(LOG,
+				(errmsg("could not read configuration file \"%s\": %m",
+						HbaFileName)));
+		return false;
+	}
+
+	return load_hba_from_stream(file);
+}
+
+/*
+ * Tokenize and parse pool_hba.conf from an open stream, which is closed
+ * before returning.
+ */
+static bool
+load_hba_from_stream(FILE *file)
+{
+	List	   *hba_lines = NIL;
+	ListCell   *line;
+	List	   *new_parsed_lines = NIL;
+	HbaIndex   *new_index;
+	bool		ok = true;
+	MemoryContext linecxt;
+	MemoryContext oldcxt;
+	MemoryContext hbacxt;
+
 	linecxt = tokenize_file(HbaFileName, file, &hba_lines, LOG);
 	fclose(file);
 
@@ -287,11 +418,17 @@ load_hba(char *hbapath)
 		return false;
 	}
 
+	/* Build the lookup index in the same context as the lines */
+	oldcxt = MemoryContextSwitchTo(hbacxt);
+	new_index = build_hba_index(new_parsed_lines);
+	MemoryContextSwitchTo(oldcxt);
+
 	/* Loaded new file successfully, replace the one we use */
 	if (parsed_hba_context != NULL)
 		MemoryContextDelete(parsed_hba_context);
 	parsed_hba_context = hbacxt;
 	parsed_hba_lines = new_parsed_lines;
+	parsed_hba_index = new_index;
 
 	return true;
 }
@@ -1537,95 +1674,444 @@ hba_getauthmethod(POOL_CONNECTION * frontend)
 static bool
 check_hba(POOL_CONNECTION * frontend)
 {
-	ListCell   *line;
 	HbaLine    *hba;
+	HbaIndex   *index = parsed_hba_index;
+	HbaRuleList *lists[3];
+	int		   *pos;
+	int			nlists = 0;
+	bool		local;
 	MemoryContext oldcxt;
+	int			i;
 
-	if (parsed_hba_lines == NULL)
+	if (parsed_hba_lines == NULL || index == NULL)
 		return false;
 
-	foreach(line, parsed_hba_lines)
+	local = IS_AF_UNIX(frontend->raddr.addr.ss_family);
+
+	/* Collect the candidate lists for this connection */
+	lists[nlists++] = &index->generic[local ? 1 : 0];
+	if (frontend->database &&
+		(lists[nlists] = hba_index_lookup(index, local, HBA_KEY_DATABASE,
+										  frontend->database,
+										  strlen(frontend->database))) != NULL)
+		nlists++;
+	if (frontend->username &&
+		(lists[nlists] = hba_index_lookup(index, local, HBA_KEY_USER,
+										  frontend->username,
+										  strlen(frontend->username))) != NULL)
+		nlists++;
+
+	oldcxt = MemoryContextSwitchTo(ProcessLoopContext);
 	{
-		hba = (HbaLine *) lfirst(line);
+		HbaRuleList **all;
+		int			nall = nlists;
+
+		all = palloc(sizeof(HbaRuleList *) * (nlists + index->nmasks));
+		memcpy(all, lists, sizeof(HbaRuleList *) * nlists);
 
-		/* Check connection type */
-		if (hba->conntype == ctLocal)
+		if (!local)
 		{
-			if (!IS_AF_UNIX(frontend->raddr.addr.ss_family))
-				continue;
+			for (i = 0; i < index->nmasks; i++)
+			{
+				char		key[HBA_INDEX_MAXKEY];
+				int			keylen;
+				HbaRuleList *l;
+
+				if (frontend->raddr.addr.ss_family != index->mask_family[i])
+					continue;
+				keylen = hba_addr_key(&frontend->raddr.addr, index->mask_bits[i], key);
+				if (keylen <= 0)
+					continue;
+				l = hba_index_lookup(index, false, HBA_KEY_ADDR, key, keylen);
+				if (l)
+					all[nall++] = l;
+			}
 		}
-		else
+
+		pos = palloc0(sizeof(int) * nall);
+
+		/* Merge the candidate lists in line order, first match wins */
+		for (;;)
 		{
-			if (IS_AF_UNIX(frontend->raddr.addr.ss_family))
-				continue;
+			int			best = -1;
+			int			rule = -1;
 
-			/* Check SSL state */
-#ifdef USE_SSL
-			if (frontend->ssl)
+			for (i = 0; i < nall; i++)
 			{
-				/* Connection is SSL, match both "host" and "hostssl" */
-				if (hba->conntype == ctHostNoSSL)
-					continue;
+				if (pos[i] < all[i]->nrules &&
+					(rule < 0 || all[i]->rules[pos[i]] < rule))
+				{
+					best = i;
+					rule = all[i]->rules[pos[i]];
+				}
 			}
-			else
+			if (best < 0)
+				break;
+			pos[best]++;
+
+			hba = index->lines[rule];
+			if (check_hba_line(frontend, hba))
+			{
+				pfree(pos);
+				pfree(all);
+				MemoryContextSwitchTo(oldcxt);
+
+				/* Found a record that matched! */
+				frontend->pool_hba = hba;
+				return true;
+			}
+		}
+		pfree(pos);
+		pfree(all);
+	}
+
+	/* If no matching entry was found, then implicitly reject. */
+	hba = palloc0(sizeof(HbaLine));
+	MemoryContextSwitchTo(oldcxt);
+	hba->auth_method = uaImplicitReject;
+	frontend->pool_hba = hba;
+	return true;
+}
+
+/*
+ * Check whether one HBA record matches the connection.
+ */
+static bool
+check_hba_line(POOL_CONNECTION * frontend, HbaLine *hba)
+{
+	/* Check connection type */
+	if (hba->conntype == ctLocal)
+	{
+		if (!IS_AF_UNIX(frontend->raddr.addr.ss_family))
+			return false;
+	}
+	else
+	{
+		if (IS_AF_UNIX(frontend->raddr.addr.ss_family))
+			return false;
+
+		/* Check SSL state */
+#ifdef USE_SSL
+		if (frontend->ssl)
+		{
+			/* Connection is SSL, match both "host" and "hostssl" */
+			if (hba->conntype == ctHostNoSSL)
+				return false;
+		}
+		else
 #endif
+		{
+			/* Connection is not SSL, match both "host" and "hostnossl" */
+			if (hba->conntype == ctHostSSL)
+				return false;
+		}
+
+		/* Check IP address */
+		switch (hba->ip_cmp_method)
+		{
+			case ipCmpMask:
+				if (hba->hostname)
+				{
+					if (!check_hostname(frontend,
+										hba->hostname))
+						return false;
+				}
+				else
+				{
+					if (!check_ip(&frontend->raddr,
+								  (struct sockaddr *) &hba->addr,
+								  (struct sockaddr *) &hba->mask))
+						return false;
+				}
+				break;
+			case ipCmpAll:
+				break;
+			case ipCmpSameHost:
+			case ipCmpSameNet:
+				if (!check_same_host_or_net(&frontend->raddr,
+											hba->ip_cmp_method))
+					return false;
+				break;
+			default:
+				/* shouldn't get here, but deem it no-match if so */
+				return false;
+		}
+	}
+
+	/* Check database and role */
+	if (!check_db(frontend->database, frontend->username, hba->databases))
+		return false;
+
+	if (!check_user(frontend->username, hba->users))
+		return false;
+
+	return true;
+}
+
+/*
+ * Can every token of a database (or user) list only match by name?
+ * Keywords and the unsupported group forms must go through check_db() and
+ * check_user() for every connection.
+ */
+static bool
+hba_tokens_are_names(List *tokens, bool users)
+{
+	ListCell   *cell;
+	HbaToken   *tok;
+
+	if (tokens == NIL)
+		return false;
+
+	foreach(cell, tokens)
+	{
+		tok = lfirst(cell);
+		if (token_is_keyword(tok, "all"))
+			return false;
+		if (users)
+		{
+			if (!tok->quoted && tok->string[0] == '+')
+				return false;
+		}
+		else if (token_is_keyword(tok, "sameuser") ||
+				 token_is_keyword(tok, "samegroup") ||
+				 token_is_keyword(tok, "samerole"))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Build the lookup index for check_hba().  Allocated in the current memory
+ * context, which is the one holding the parsed lines.
+ */
+static HbaIndex *
+build_hba_index(List *lines)
+{
+	HbaIndex   *index;
+	ListCell   *cell;
+	int			rule = 0;
+
+	index = palloc0(sizeof(HbaIndex));
+	index->nlines = list_length(lines);
+	index->lines = palloc(sizeof(HbaLine *) * index->nlines);
+	index->mask_family = palloc(sizeof(int) * index->nlines);
+	index->mask_bits = palloc(sizeof(int) * index->nlines);
+
+	foreach(cell, lines)
+	{
+		HbaLine    *hba = (HbaLine *) lfirst(cell);
+		bool		local = (hba->conntype == ctLocal);
+		ListCell   *tc;
+
+		index->lines[rule] = hba;
+
+		if (hba_tokens_are_names(hba->databases, false))
+		{
+			foreach(tc, hba->databases)
 			{
-				/* Connection is not SSL, match both "host" and "hostnossl" */
-				if (hba->conntype == ctHostSSL)
-					continue;
+				HbaToken   *tok = lfirst(tc);
+
+				hba_index_add(index, local, HBA_KEY_DATABASE,
+							  tok->string, strlen(tok->string), rule);
 			}
+		}
+		else if (hba_tokens_are_names(hba->users, true))
+		{
+			foreach(tc, hba->users)
+			{
+				HbaToken   *tok = lfirst(tc);
 
-			/* Check IP address */
-			switch (hba->ip_cmp_method)
+				hba_index_add(index, local, HBA_KEY_USER,
+							  tok->string, strlen(tok->string), rule);
+			}
+		}
+		else if (!local && hba->ip_cmp_method == ipCmpMask &&
+				 hba->hostname == NULL &&
+				 hba_mask_bits(&hba->mask) >= 0)
+		{
+			char		key[HBA_INDEX_MAXKEY];
+			int			bits = hba_mask_bits(&hba->mask);
+			int			keylen;
+			int			i;
+
+			keylen = hba_addr_key(&hba->addr, bits, key);
+			hba_index_add(index, false, HBA_KEY_ADDR, key, keylen, rule);
+
+			for (i = 0; i < index->nmasks; i++)
 			{
-				case ipCmpMask:
-					if (hba->hostname)
-					{
-						if (!check_hostname(frontend,
-											hba->hostname))
-							continue;
-					}
-					else
-					{
-						if (!check_ip(&frontend->raddr,
-									  (struct sockaddr *) &hba->addr,
-									  (struct sockaddr *) &hba->mask))
-							continue;
-					}
+				if (index->mask_family[i] == hba->addr.ss_family &&
+					index->mask_bits[i] == bits)
 					break;
-				case ipCmpAll:
-					break;
-				case ipCmpSameHost:
-				case ipCmpSameNet:
-					if (!check_same_host_or_net(&frontend->raddr,
-												hba->ip_cmp_method))
-						continue;
-					break;
-				default:
-					/* shouldn't get here, but deem it no-match if so */
-					continue;
+			}
+			if (i == index->nmasks)
+			{
+				index->mask_family[i] = hba->addr.ss_family;
+				index->mask_bits[i] = bits;
+				index->nmasks++;
 			}
 		}
+		else
+		{
+			HbaRuleList *l = &index->generic[local ? 1 : 0];
 
-		/* Check database and role */
-		if (!check_db(frontend->database, frontend->username, hba->databases))
-			continue;
+			if (l->nrules >= l->maxrules)
+			{
+				l->maxrules = l->maxrules ? l->maxrules * 2 : 16;
+				l->rules = l->rules ? repalloc(l->rules, sizeof(int) * l->maxrules) :
+					palloc(sizeof(int) * l->maxrules);
+			}
+			l->rules[l->nrules++] = rule;
+		}
+		rule++;
+	}
 
-		if (!check_user(frontend->username, hba->users))
-			continue;
+	return index;
+}
 
-		/* Found a record that matched! */
-		frontend->pool_hba = hba;
-		return true;
+static uint32
+hba_index_hash(bool local, HbaIndexKind kind, const char *key, int keylen)
+{
+	uint32		h = 2166136261u;
+	int			i;
+
+	h = (h ^ (local ? 1 : 0)) * 16777619u;
+	h = (h ^ (uint32) kind) * 16777619u;
+	for (i = 0; i < keylen; i++)
+		h = (h ^ (unsigned char) key[i]) * 16777619u;
+	return h % HBA_INDEX_NBUCKETS;
+}
+
+static HbaRuleList *
+hba_index_lookup(HbaIndex *index, bool local, HbaIndexKind kind,
+				 const char *key, int keylen)
+{
+	HbaIndexEntry *e;
+
+	for (e = index->buckets[hba_index_hash(local, kind, key, keylen)]; e; e = e->next)
+	{
+		if (e->local == local && e->kind == kind && e->keylen == keylen &&
+			memcmp(e->key, key, keylen) == 0)
+			return &e->list;
 	}
+	return NULL;
+}
 
-	/* If no matching entry was found, then implicitly reject. */
-	oldcxt = MemoryContextSwitchTo(ProcessLoopContext);
-	hba = palloc0(sizeof(HbaLine));
-	MemoryContextSwitchTo(oldcxt);
-	hba->auth_method = uaImplicitReject;
-	frontend->pool_hba = hba;
-	return true;
+static void
+hba_index_add(HbaIndex *index, bool local, HbaIndexKind kind,
+			  const char *key, int keylen, int rule)
+{
+	HbaRuleList *l;
+
+	l = hba_index_lookup(index, local, kind, key, keylen);
+	if (l == NULL)
+	{
+		uint32		h = hba_index_hash(local, kind, key, keylen);
+		HbaIndexEntry *e = palloc0(sizeof(HbaIndexEntry));
+
+		e->local = local;
+		e->kind = kind;
+		e->keylen = keylen;
+		e->key = palloc(keylen);
+		memcpy(e->key, key, keylen);
+		e->next = index->buckets[h];
+		index->buckets[h] = e;
+		l = &e->list;
+	}
+
+	/* the same name may be listed twice on a line */
+	if (l->nrules > 0 && l->rules[l->nrules - 1] == rule)
+		return;
+
+	if (l->nrules >= l->maxrules)
+	{
+		l->maxrules = l->maxrules ? l->maxrules * 2 : 4;
+		l->rules = l->rules ? repalloc(l->rules, sizeof(int) * l->maxrules) :
+			palloc(sizeof(int) * l->maxrules);
+	}
+	l->rules[l->nrules++] = rule;
+}
+
+/*
+ * Return the prefix length of a netmask, or -1 if the mask is not
+ * contiguous (such a rule cannot be indexed by prefix).
+ */
+static int
+hba_mask_bits(const struct sockaddr_storage *mask)
+{
+	const unsigned char *b;
+	int			len;
+	int			bits = 0;
+	int			i;
+	bool		seen_zero = false;
+
+	if (mask->ss_family == AF_INET)
+	{
+		b = (const unsigned char *) &((const struct sockaddr_in *) mask)->sin_addr;
+		len = sizeof(struct in_addr);
+	}
+	else if (mask->ss_family == AF_INET6)
+	{
+		b = (const unsigned char *) &((const struct sockaddr_in6 *) mask)->sin6_addr;
+		len = sizeof(struct in6_addr);
+	}
+	else
+		return -1;
+
+	for (i = 0; i < len * 8; i++)
+	{
+		if (b[i / 8] & (0x80 >> (i % 8)))
+		{
+			if (seen_zero)
+				return -1;
+			bits++;
+		}
+		else
+			seen_zero = true;
+	}
+	return bits;
+}
+
+/*
+ * Build the index key of an address truncated to "bits" bits: the family,
+ * the prefix length and the masked address bytes.  Returns the key length,
+ * or 0 for families that are not indexed.
+ */
+static int
+hba_addr_key(const struct sockaddr_storage *addr, int bits, char *key)
+{
+	const unsigned char *b;
+	int			len;
+	int			i;
+
+	if (addr->ss_family == AF_INET)
+	{
+		b = (const unsigned char *) &((const struct sockaddr_in *) addr)->sin_addr;
+		len = sizeof(struct in_addr);
+	}
+	else if (addr->ss_family == AF_INET6)
+	{
+		b = (const unsigned char *) &((const struct sockaddr_in6 *) addr)->sin6_addr;
+		len = sizeof(struct in6_addr);
+	}
+	else
+		return 0;
+
+	key[0] = (char) addr->ss_family;
+	key[1] = (char) bits;
+	for (i = 0; i < len; i++)
+	{
+		int			keep = bits - i * 8;
+		unsigned char m;
+
+		if (keep >= 8)
+			m = 0xff;
+		else if (keep <= 0)
+			m = 0;
+		else
+			m = (unsigned char) (0xff << (8 - keep));
+		key[2 + i] = (char) (b[i] & m);
+	}
+	return 2 + len;
 }
 
 static bool
@@ -1687,20 +2173,37 @@ check_hostname(POOL_CONNECTION * frontend, const char *hostname)
 	if (!frontend->remote_hostname)
 	{
 		char		remote_hostname[NI_MAXHOST];
+		int			resolv;
 
-		ret = getnameinfo_all(&frontend->raddr.addr, frontend->raddr.salen,
-							  remote_hostname, sizeof(remote_hostname),
-							  NULL, 0,
-							  NI_NAMEREQD);
-		if (ret != 0)
+		/* another child may have looked it up recently */
+		if (pool_dns_cache_lookup(&frontend->raddr, remote_hostname,
+								  sizeof(remote_hostname), &resolv))
 		{
-			/* remember failure; don't complain in the Pgpool-II log yet */
-			frontend->remote_hostname_resolv = -2;
-			/* frontend->remote_hostname_errcode = ret; */
-			return false;
+			frontend->remote_hostname_resolv = resolv;
+			if (resolv == -2)
+				return false;
+			frontend->remote_hostname = pstrdup(remote_hostname);
+			if (resolv < 0)
+				return false;
 		}
+		else
+		{
+			ret = getnameinfo_all(&frontend->raddr.addr, frontend->raddr.salen,
+								  remote_hostname, sizeof(remote_hostname),
+								  NULL, 0,
+								  NI_NAMEREQD);
+			if (ret != 0)
+			{
+				/* remember failure; don't complain in the Pgpool-II log yet */
+				frontend->remote_hostname_resolv = -2;
+				/* frontend->remote_hostname_errcode = ret; */
+				pool_dns_cache_store(&frontend->raddr, NULL, -2);
+				return false;
+			}
 
-		frontend->remote_hostname = pstrdup(remote_hostname);
+			frontend->remote_hostname = pstrdup(remote_hostname);
+			pool_dns_cache_store(&frontend->raddr, remote_hostname, 0);
+		}
 	}
 
 	/* Now see if remote host name matches this pg_hba line */
@@ -1718,6 +2221,7 @@ check_hostname(POOL_CONNECTION * frontend, const char *hostname)
 		/* remember failure; don't complain in the postmaster log yet */
 		frontend->remote_hostname_resolv = -2;
 		/* frontend->remote_hostname_errcode = ret; */
+		pool_dns_cache_store(&frontend->raddr, NULL, -2);
 		return false;
 	}
 
@@ -1756,6 +2260,8 @@ check_hostname(POOL_CONNECTION * frontend, const char *hostname)
 						hostname)));
 
 	frontend->remote_hostname_resolv = found ? +1 : -1;
+	pool_dns_cache_store(&frontend->raddr, frontend->remote_hostname,
+						 frontend->remote_hostname_resolv);
 
 	return found;
 }
@@ -2671,71 +3177,182 @@ FormatSearchFilter(const char *pattern, const char *user_name)
 
 
 /*
- * Check authentication against LDAP.
+ * Get the LDAP connection of the process, or make a new one if there is none
+ * or it was made for other LDAP server options.  *reused is set to true if an
+ * existing connection is returned, which may have been closed by the server
+ * in the meantime.
  */
-static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
+static int
+GetLDAPConnection(POOL_CONNECTION * frontend, LDAP **ldap, bool *reused)
 {
-	char	   *passwd;
-	LDAP	   *ldap;
-	int			r;
-	char	   *fulluser;
-	const char *server_name;
+	char	   *key;
 
-#ifdef HAVE_LDAP_INITIALIZE
+	key = psprintf("%s\n%d\n%s\n%d\n%s\n%s",
+				   frontend->pool_hba->ldapserver ? frontend->pool_hba->ldapserver : "",
+				   frontend->pool_hba->ldapport,
+				   frontend->pool_hba->ldapscheme ? frontend->pool_hba->ldapscheme : "",
+				   frontend->pool_hba->ldaptls,
+				   frontend->pool_hba->ldapbinddn ? frontend->pool_hba->ldapbinddn : "",
+				   frontend->pool_hba->ldapbindpasswd ? frontend->pool_hba->ldapbindpasswd : "");
 
-	/*
-	 * For OpenLDAP, allow empty hostname if we have a basedn.  We'll look for
-	 * servers with DNS SRV records via OpenLDAP library facilities.
-	 */
-	if ((!frontend->pool_hba->ldapserver || frontend->pool_hba->ldapserver[0] == '\0') &&
-		(!frontend->pool_hba->ldapbasedn || frontend->pool_hba->ldapbasedn[0] == '\0'))
+	if (ldap_conn && strcmp(ldap_conn_key, key) == 0)
 	{
-		ereport(LOG,
-				(errmsg("LDAP server not specified, and no ldapbasedn")));
-		return -1;
+		pfree(key);
+		*ldap = ldap_conn;
+		*reused = true;
+		return 0;
 	}
-#else
-	if (!frontend->pool_hba->ldapserver || frontend->pool_hba->ldapserver[0] == '\0')
+
+	CloseLDAPConnection();
+	*reused = false;
+
+	if (InitializeLDAPConnection(frontend, ldap) == -1)
 	{
-		ereport(LOG,
-				(errmsg("LDAP server not specified")));
+		pfree(key);
 		return -1;
 	}
-#endif
 
-	/*
-	 * If we're using SRV records, we don't have a server name so we'll just
-	 * show an empty string in error messages.
-	 */
-	server_name = frontend->pool_hba->ldapserver ? frontend->pool_hba->ldapserver : "";
+	ldap_conn = *ldap;
+	ldap_conn_key = MemoryContextStrdup(TopMemoryContext, key);
+	pfree(key);
 
-	if (frontend->pool_hba->ldapport == 0)
+	return 0;
+}
+
+/*
+ * Disconnect from the LDAP server, if connected.
+ */
+static void
+CloseLDAPConnection(void)
+{
+	if (ldap_conn == NULL)
+		return;
+
+	ldap_unbind(ldap_conn);
+	ldap_conn = NULL;
+	pfree(ldap_conn_key);
+	ldap_conn_key = NULL;
+	ldap_conn_search_bound = false;
+}
+
+/*
+ * Is the LDAP error caused by a broken connection, rather than by the
+ * request?
+ */
+static bool
+LDAPConnectionLost(int r)
+{
+	return r == LDAP_SERVER_DOWN || r == LDAP_CONNECT_ERROR ||
+		r == LDAP_UNAVAILABLE || r == LDAP_TIMEOUT;
+}
+
+static void
+LDAPAuthCacheDigestString(pg_sha256_ctx *ctx, const char *str)
+{
+	if (str == NULL)
+		str = "";
+
+	/* include the terminator so that concatenations do not collide */
+	pg_sha256_update(ctx, (const uint8 *) str, strlen(str) + 1);
+}
+
+/*
+ * Compute the key of the authentication cache: a salted digest of the
+ * pool_hba.conf options deciding which LDAP entry the user name maps to,
+ * the user name and the password.
+ */
+static void
+LDAPAuthCacheDigest(POOL_CONNECTION * frontend, const char *passwd, uint8 *digest)
+{
+	pg_sha256_ctx ctx;
+	char		port[16];
+
+	if (!ldap_auth_cache_salt_set)
 	{
-		if (frontend->pool_hba->ldapscheme != NULL &&
-			strcmp(frontend->pool_hba->ldapscheme, "ldaps") == 0)
-			frontend->pool_hba->ldapport = LDAPS_PORT;
-		else
-			frontend->pool_hba->ldapport = LDAP_PORT;
+		pool_random(ldap_auth_cache_salt, sizeof(ldap_auth_cache_salt));
+		ldap_auth_cache_salt_set = true;
 	}
 
-	sendAuthRequest(frontend, AUTH_REQ_PASSWORD);
+	snprintf(port, sizeof(port), "%d", frontend->pool_hba->ldapport);
 
-	passwd = recv_password_packet(frontend);
-	if (passwd == NULL)
-		return -2;		/* client wouldn't send password */
+	pg_sha256_init(&ctx);
+	pg_sha256_update(&ctx, ldap_auth_cache_salt, sizeof(ldap_auth_cache_salt));
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapserver);
+	LDAPAuthCacheDigestString(&ctx, port);
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapbasedn);
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapsearchattribute);
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapsearchfilter);
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapprefix);
+	LDAPAuthCacheDigestString(&ctx, frontend->pool_hba->ldapsuffix);
+	LDAPAuthCacheDigestString(&ctx, frontend->username);
+	LDAPAuthCacheDigestString(&ctx, passwd);
+	pg_sha256_final(&ctx, digest);
+}
 
-	if (InitializeLDAPConnection(frontend, &ldap) == -1)
+/*
+ * Returns true if the credentials with the digest successfully authenticated
+ * within ldap_auth_cache_ttl seconds.
+ */
+static bool
+LDAPAuthCacheLookup(uint8 *digest)
+{
+	time_t		now = time(NULL);
+	int			i;
+
+	for (i = 0; i < LDAP_AUTH_CACHE_SIZE; i++)
 	{
-		/* Error message already sent */
-		pfree(passwd);
-		return -1;
+		if (ldap_auth_cache[i].expire > now &&
+			memcmp(ldap_auth_cache[i].digest, digest, PG_SHA256_DIGEST_LENGTH) == 0)
+			return true;
 	}
+	return false;
+}
 
-	if (frontend->pool_hba->backend_use_passwd)
+/*
+ * Remember the credentials with the digest, replacing the entry expiring
+ * first.
+ */
+static void
+LDAPAuthCacheStore(uint8 *digest)
+{
+	LDAPAuthCacheEntry *victim = &ldap_auth_cache[0];
+	int			i;
+
+	for (i = 0; i < LDAP_AUTH_CACHE_SIZE; i++)
 	{
-		frontend->pwd_size = strlen(passwd);
-		memcpy(frontend->password, passwd, frontend->pwd_size);
-		frontend->passwordType = PASSWORD_TYPE_PLAINTEXT;
+		if (memcmp(ldap_auth_cache[i].digest, digest, PG_SHA256_DIGEST_LENGTH) == 0)
+		{
+			victim = &ldap_auth_cache[i];
+			break;
+		}
+		if (ldap_auth_cache[i].expire < victim->expire)
+			victim = &ldap_auth_cache[i];
+	}
+
+	victim->expire = time(NULL) + pool_config->ldap_auth_cache_ttl;
+	memcpy(victim->digest, digest, PG_SHA256_DIGEST_LENGTH);
+}
+
+/*
+ * Verify the password of the user against the LDAP server.  On failure,
+ * *retry is set to true if the failure was caused by the connection kept
+ * from a previous authentication being broken, in which case it has been
+ * closed and the caller may try again with a new one.
+ */
+static int
+LDAPAuthenticate(POOL_CONNECTION * frontend, char *passwd, const char *server_name, bool *retry)
+{
+	LDAP	   *ldap;
+	int			r;
+	char	   *fulluser;
+	bool		reused;
+
+	*retry = false;
+
+	if (GetLDAPConnection(frontend, &ldap, &reused) == -1)
+	{
+		/* Error message already sent */
+		return -1;
 	}
 
 	if (frontend->pool_hba->ldapbasedn)
@@ -2768,8 +3385,6 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 			{
 				ereport(LOG,
 						(errmsg("invalid character in user name for LDAP authentication")));
-				ldap_unbind(ldap);
-				pfree(passwd);
 				return -1;
 			}
 		}
@@ -2777,21 +3392,27 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 		/*
 		 * Bind with a pre-defined username/password (if available) for
 		 * searching. If none is specified, this turns into an anonymous bind.
+		 * The bind is kept for the next search unless the connection has been
+		 * bound as a user since.
 		 */
-		r = ldap_simple_bind_s(ldap,
-							   frontend->pool_hba->ldapbinddn ? frontend->pool_hba->ldapbinddn : "",
-							   frontend->pool_hba->ldapbindpasswd ? frontend->pool_hba->ldapbindpasswd : "");
-		if (r != LDAP_SUCCESS)
+		if (!ldap_conn_search_bound)
 		{
-			ereport(LOG,
-					(errmsg("could not perform initial LDAP bind for ldapbinddn \"%s\" on server \"%s\": %s",
-							frontend->pool_hba->ldapbinddn ? frontend->pool_hba->ldapbinddn : "",
-							server_name,
-							ldap_err2string(r)),
-					 errdetail_for_ldap(ldap)));
-			ldap_unbind(ldap);
-			pfree(passwd);
-			return -1;
+			r = ldap_simple_bind_s(ldap,
+								   frontend->pool_hba->ldapbinddn ? frontend->pool_hba->ldapbinddn : "",
+								   frontend->pool_hba->ldapbindpasswd ? frontend->pool_hba->ldapbindpasswd : "");
+			if (r != LDAP_SUCCESS)
+			{
+				ereport(LOG,
+						(errmsg("could not perform initial LDAP bind for ldapbinddn \"%s\" on server \"%s\": %s",
+								frontend->pool_hba->ldapbinddn ? frontend->pool_hba->ldapbinddn : "",
+								server_name,
+								ldap_err2string(r)),
+						 errdetail_for_ldap(ldap)));
+				*retry = reused && LDAPConnectionLost(r);
+				CloseLDAPConnection();
+				return -1;
+			}
+			ldap_conn_search_bound = true;
 		}
 
 		/* Build a custom filter or a single attribute filter? */
@@ -2816,8 +3437,8 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 					(errmsg("could not search LDAP for filter \"%s\" on server \"%s\": %s",
 							filter, server_name, ldap_err2string(r)),
 					 errdetail_for_ldap(ldap)));
-			ldap_unbind(ldap);
-			pfree(passwd);
+			*retry = reused && LDAPConnectionLost(r);
+			CloseLDAPConnection();
 			pfree(filter);
 			return -1;
 		}
@@ -2838,8 +3459,6 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 										  count,
 										  filter, server_name, count)));
 
-			ldap_unbind(ldap);
-			pfree(passwd);
 			pfree(filter);
 			ldap_msgfree(search_message);
 			return -1;
@@ -2857,8 +3476,7 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 							filter, server_name,
 							ldap_err2string(error)),
 					 errdetail_for_ldap(ldap)));
-			ldap_unbind(ldap);
-			pfree(passwd);
+			CloseLDAPConnection();
 			pfree(filter);
 			ldap_msgfree(search_message);
 			return -1;
@@ -2868,31 +3486,6 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 		pfree(filter);
 		ldap_memfree(dn);
 		ldap_msgfree(search_message);
-
-		/* Unbind and disconnect from the LDAP server */
-		r = ldap_unbind_s(ldap);
-		if (r != LDAP_SUCCESS)
-		{
-			ereport(LOG,
-					(errmsg("could not unbind after searching for user \"%s\" on server \"%s\"",
-							fulluser, server_name)));
-			pfree(passwd);
-			pfree(fulluser);
-			return -1;
-		}
-
-		/*
-		 * Need to re-initialize the LDAP connection, so that we can bind to
-		 * it with a different username.
-		 */
-		if (InitializeLDAPConnection(frontend, &ldap) == -1)
-		{
-			pfree(passwd);
-			pfree(fulluser);
-
-			/* Error message already sent */
-			return -1;
-		}
 	}
 	else
 		fulluser = psprintf("%s%s%s",
@@ -2900,6 +3493,11 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 							frontend->username,
 							frontend->pool_hba->ldapsuffix ? frontend->pool_hba->ldapsuffix : "");
 
+	/*
+	 * Bind as the user on the same connection.  This replaces the search
+	 * bind, which is redone by the next search.
+	 */
+	ldap_conn_search_bound = false;
 	r = ldap_simple_bind_s(ldap, fulluser, passwd);
 
 	if (r != LDAP_SUCCESS)
@@ -2908,19 +3506,108 @@ static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
 				(errmsg("LDAP login failed for user \"%s\" on server \"%s\": %s",
 						fulluser, server_name, ldap_err2string(r)),
 				 errdetail_for_ldap(ldap)));
-		ldap_unbind(ldap);
-		pfree(passwd);
+		*retry = reused && LDAPConnectionLost(r);
+		if (r != LDAP_INVALID_CREDENTIALS)
+			CloseLDAPConnection();
 		pfree(fulluser);
 		return -1;
 	}
 
-	ldap_unbind(ldap);
-	pfree(passwd);
 	pfree(fulluser);
 
 	return 0;
 }
 
+/*
+ * Check authentication against LDAP.
+ */
+static POOL_STATUS CheckLDAPAuth(POOL_CONNECTION * frontend)
+{
+	char	   *passwd;
+	int			r;
+	bool		retry;
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];
+	const char *server_name;
+
+#ifdef HAVE_LDAP_INITIALIZE
+
+	/*
+	 * For OpenLDAP, allow empty hostname if we have a basedn.  We'll look for
+	 * servers with DNS SRV records via OpenLDAP library facilities.
+	 */
+	if ((!frontend->pool_hba->ldapserver || frontend->pool_hba->ldapserver[0] == '\0') &&
+		(!frontend->pool_hba->ldapbasedn || frontend->pool_hba->ldapbasedn[0] == '\0'))
+	{
+		ereport(LOG,
+				(errmsg("LDAP server not specified, and no ldapbasedn")));
+		return -1;
+	}
+#else
+	if (!frontend->pool_hba->ldapserver || frontend->pool_hba->ldapserver[0] == '\0')
+	{
+		ereport(LOG,
+				(errmsg("LDAP server not specified")));
+		return -1;
+	}
+#endif
+
+	/*
+	 * If we're using SRV records, we don't have a server name so we'll just
+	 * show an empty string in error messages.
+	 */
+	server_name = frontend->pool_hba->ldapserver ? frontend->pool_hba->ldapserver : "";
+
+	if (frontend->pool_hba->ldapport == 0)
+	{
+		if (frontend->pool_hba->ldapscheme != NULL &&
+			strcmp(frontend->pool_hba->ldapscheme, "ldaps") == 0)
+			frontend->pool_hba->ldapport = LDAPS_PORT;
+		else
+			frontend->pool_hba->ldapport = LDAP_PORT;
+	}
+
+	sendAuthRequest(frontend, AUTH_REQ_PASSWORD);
+
+	passwd = recv_password_packet(frontend);
+	if (passwd == NULL)
+		return -2;		/* client wouldn't send password */
+
+	if (frontend->pool_hba->backend_use_passwd)
+	{
+		frontend->pwd_size = strlen(passwd);
+		memcpy(frontend->password, passwd, frontend->pwd_size);
+		frontend->passwordType = PASSWORD_TYPE_PLAINTEXT;
+	}
+
+	if (pool_config->ldap_auth_cache_ttl > 0)
+	{
+		LDAPAuthCacheDigest(frontend, passwd, digest);
+		if (LDAPAuthCacheLookup(digest))
+		{
+			ereport(DEBUG1,
+					(errmsg("LDAP authentication of user \"%s\" found in cache",
+							frontend->username)));
+			pfree(passwd);
+			return 0;
+		}
+	}
+
+	r = LDAPAuthenticate(frontend, passwd, server_name, &retry);
+	if (r == -1 && retry)
+	{
+		ereport(LOG,
+				(errmsg("reconnecting to LDAP server \"%s\"", server_name)));
+		r = LDAPAuthenticate(frontend, passwd, server_name, &retry);
+	}
+
+	if (r == 0 && pool_config->ldap_auth_cache_ttl > 0)
+		LDAPAuthCacheStore(digest);
+
+	pfree(passwd);
+
+	return r;
+}
+
 
 #endif							/* USE_LDAP */
 
@@ -43,6 +43,48 @@ static char saved_passwd_filename[POOLMAXPATHLEN + 1];
 static char *userMatchesString(char *buf, char *user);
 static POOL_PASSWD_MODE pool_passwd_mode;
 
+/*
+ * In memory index of pool_passwd, used when pool_passwd is opened in read
+ * only mode.  The whole file is loaded and its entries are put into a hash
+ * table keyed by user name, so that looking up a user does not need to
+ * scan the file.  The index is built by the main process at startup and
+ * inherited by child processes on fork.  Before each lookup the file is
+ * stat()ed, and the index is rebuilt if the file has been changed.
+ */
+typedef struct
+{
+	char	   *name;			/* user name, backslash escapes removed */
+	char	   *rest;			/* the line after name and ':' */
+	char	   *raw_name;		/* user name as written, up to the first ':' */
+	char	   *raw_rest;		/* the line after raw_name and ':' */
+}			PasswdEntry;
+
+typedef struct
+{
+	bool		loaded;			/* true if the index is valid */
+	dev_t		dev;			/* identity of the loaded file */
+	ino_t		ino;
+	off_t		size;
+	struct timespec mtime;
+	struct timespec ctime;
+	char	   *buf;			/* file contents */
+	char	   *namebuf;		/* unescaped user names */
+	int			nentries;		/* number of entries */
+	PasswdEntry *entries;		/* entries in file order */
+	int			nbuckets;		/* size of buckets (power of 2) */
+	int		   *buckets;		/* entry index + 1, or 0 if empty */
+	bool		has_escaped_name;	/* true if any user name has backslash */
+}			PasswdIndex;
+
+static PasswdIndex passwd_index;
+
+static bool passwd_index_is_current(struct stat *st);
+static void passwd_index_refresh(void);
+static void passwd_index_free(void);
+static PasswdEntry *passwd_index_find(char *username);
+static PasswdEntry *passwd_index_find_raw(char *username);
+static PasswordMapping *parse_user_credentials(char *t, char *username);
+
 /*
  * Initialize this module.
  * If pool_passwd does not exist yet, create it.
@@ -91,6 +133,9 @@ pool_init_pool_passwd(char *pool_passwd_filename, POOL_PASSWD_MODE mode)
 				(errmsg("initializing pool password, failed to open file:\"%s\"", pool_passwd_filename),
 				 errdetail("file open failed with error:\"%m\"")));
 	}
+
+	if (mode == POOL_PASSWD_R)
+		passwd_index_refresh();
 }
 
 /*
@@ -176,6 +221,7 @@ pool_create_passwdent(char *username, char *passwd)
 	/* write pool_passwd file.  */
 	fwrite(writebuf, 1, strlen(writebuf), passwd_fd);
 	pfree(writebuf);
+	passwd_index_free();
 	return 0;
 
 #undef LINE_LEN
@@ -208,6 +254,21 @@ pool_get_passwd(char *username)
 			return NULL;
 	}
 
+	if (pool_passwd_mode == POOL_PASSWD_R)
+	{
+		PasswdEntry *entry;
+
+		passwd_index_refresh();
+		if (passwd_index.loaded)
+		{
+			entry = passwd_index_find_raw(username);
+			if (entry == NULL)
+				return NULL;
+			strlcpy(passwd, entry->raw_rest, sizeof(passwd));
+			return passwd;
+		}
+	}
+
 	rewind(passwd_fd);
 	name[0] = '\0';
 
@@ -339,6 +400,48 @@ userMatchesString(char *buf, char *user)
 	return NULL;
 }
 
+/*
+ * Parse "password[:user:password]" following the user name in a
+ * pool_passwd line.  Returns NULL if the password is empty.
+ */
+static PasswordMapping *
+parse_user_credentials(char *t, char *username)
+{
+	PasswordMapping *pwdMapping;
+	char	   *tok;
+
+	/* Get the password */
+	t = getNextToken(t, &tok);
+	if (tok == NULL)
+		return NULL;
+
+	pwdMapping = palloc0(sizeof(PasswordMapping));
+	pwdMapping->pgpoolUser.password = tok;
+	pwdMapping->pgpoolUser.passwordType = get_password_type(pwdMapping->pgpoolUser.password);
+	pwdMapping->pgpoolUser.userName = (char *) pstrdup(username);
+	pwdMapping->mappedUser = false;
+
+	/* Get backend user */
+	t = getNextToken(t, &tok);
+	if (tok)
+	{
+		/* check if we also have the password */
+		char	   *pwd;
+
+		t = getNextToken(t, &pwd);
+		if (pwd)
+		{
+			pwdMapping->backendUser.password = pwd;
+			pwdMapping->backendUser.userName = tok;
+			pwdMapping->backendUser.passwordType = get_password_type(pwdMapping->backendUser.password);
+			pwdMapping->mappedUser = true;
+		}
+		else
+			pfree(tok);
+	}
+	return pwdMapping;
+}
+
 /*
  * user:password[:user:password]
  */
@@ -359,12 +462,24 @@ pool_get_user_credentials(char *username)
 		return NULL;
 	}
 
+	if (pool_passwd_mode == POOL_PASSWD_R)
+	{
+		passwd_index_refresh();
+		if (passwd_index.loaded)
+		{
+			PasswdEntry *entry = passwd_index_find(username);
+
+			if (entry == NULL)
+				return NULL;
+			return parse_user_credentials(entry->rest, username);
+		}
+	}
+
 	rewind(passwd_fd);
 
 	while (!feof(passwd_fd) && !ferror(passwd_fd))
 	{
 		char	   *t = buf;
-		char	   *tok;
 		int			len;
 
 		if (fgets(buf, sizeof(buf), passwd_fd) == NULL)
@@ -380,36 +495,10 @@ pool_get_user_credentials(char *username)
 
 		if ((t = userMatchesString(t, username)) == NULL)
 			continue;
-		/* Get the password */
-		t = getNextToken(t, &tok);
-		if (tok)
-		{
-			pwdMapping = palloc0(sizeof(PasswordMapping));
-			pwdMapping->pgpoolUser.password = tok;
-			pwdMapping->pgpoolUser.passwordType = get_password_type(pwdMapping->pgpoolUser.password);
-			pwdMapping->pgpoolUser.userName = (char *) pstrdup(username);
-			pwdMapping->mappedUser = false;
-		}
-		else
-			continue;
-		/* Get backend user */
-		t = getNextToken(t, &tok);
-		if (tok)
-		{
-			/* check if we also have the password */
-			char	   *pwd;
 
-			t = getNextToken(t, &pwd);
-			if (pwd)
-			{
-				pwdMapping->backendUser.password = pwd;
-				pwdMapping->backendUser.userName = tok;
-				pwdMapping->backendUser.passwordType = get_password_type(pwdMapping->backendUser.password);
-				pwdMapping->mappedUser = true;
-			}
-			else
-				pfree(tok);
-		}
+		pwdMapping = parse_user_credentials(t, username);
+		if (pwdMapping == NULL)
+			continue;
 		break;
 	}
 	return pwdMapping;
@@ -462,6 +551,229 @@ pool_reopen_passwd_file(void)
 	pool_init_pool_passwd(saved_passwd_filename, pool_passwd_mode);
 }
 
+/*
+ * Returns true if the index was built from the file described by st.
+ */
+static bool
+passwd_index_is_current(struct stat *st)
+{
+	return passwd_index.loaded &&
+		passwd_index.dev == st->st_dev &&
+		passwd_index.ino == st->st_ino &&
+		passwd_index.size == st->st_size &&
+		passwd_index.mtime.tv_sec == st->st_mtim.tv_sec &&
+		passwd_index.mtime.tv_nsec == st->st_mtim.tv_nsec &&
+		passwd_index.ctime.tv_sec == st->st_ctim.tv_sec &&
+		passwd_index.ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static uint32
+passwd_index_hash(const char *name)
+{
+	uint32		hash = 5381;
+
+	while (*name)
+		hash = hash * 33 + (unsigned char) *name++;
+	return hash;
+}
+
+static void
+passwd_index_free(void)
+{
+	free(passwd_index.buf);
+	free(passwd_index.namebuf);
+	free(passwd_index.entries);
+	free(passwd_index.buckets);
+	memset(&passwd_index, 0, sizeof(passwd_index));
+}
+
+/*
+ * (Re)build the index if pool_passwd has been changed since it was built.
+ * If the file cannot be read, the current index is left as it is.
+ */
+static void
+passwd_index_refresh(void)
+{
+	struct stat st;
+	FILE	   *fp;
+	char	   *buf;
+	char	   *namebuf;
+	char	   *line;
+	char	   *n;
+	PasswdEntry *entries;
+	int			nlines;
+	int			i;
+
+	if (stat(saved_passwd_filename, &st) != 0 || passwd_index_is_current(&st))
+		return;
+
+	fp = fopen(saved_passwd_filename, "r");
+	if (fp == NULL)
+		return;
+
+	if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		fclose(fp);
+		return;
+	}
+
+	buf = malloc(st.st_size + 1);
+	namebuf = malloc(st.st_size + 1);
+	if (buf == NULL || namebuf == NULL ||
+		fread(buf, 1, st.st_size, fp) != st.st_size)
+	{
+		free(buf);
+		free(namebuf);
+		fclose(fp);
+		return;
+	}
+	fclose(fp);
+	buf[st.st_size] = '\0';
+
+	nlines = 1;
+	for (i = 0; i < st.st_size; i++)
+	{
+		if (buf[i] == '\n')
+			nlines++;
+	}
+	entries = malloc(sizeof(PasswdEntry) * nlines);
+	if (entries == NULL)
+	{
+		free(buf);
+		free(namebuf);
+		return;
+	}
+
+	passwd_index_free();
+	passwd_index.buf = buf;
+	passwd_index.namebuf = namebuf;
+	passwd_index.entries = entries;
+
+	/*
+	 * Split the file into entries.  The user name ends at the first ':' not
+	 * escaped by a backslash, as userMatchesString() does.
+	 */
+	n = namebuf;
+	line = buf;
+	while (line != NULL && *line != '\0')
+	{
+		char	   *next = strchr(line, '\n');
+		char	   *t;
+		char	   *colon;
+		PasswdEntry *entry = &entries[passwd_index.nentries];
+
+		if (next)
+			*next++ = '\0';
+
+		entry->name = n;
+		entry->rest = NULL;
+		for (t = line; *t != '\0'; t++)
+		{
+			if (*t == '\\' && t[1] != '\0')
+				t++;
+			else if (*t == ':')
+			{
+				entry->rest = t + 1;
+				break;
+			}
+			*n++ = *t;
+		}
+		*n++ = '\0';
+
+		colon = strchr(line, ':');
+		if (entry->rest != NULL && colon != NULL)
+		{
+			*colon = '\0';
+			entry->raw_name = line;
+			entry->raw_rest = colon + 1;
+			if (strcmp(entry->raw_name, entry->name) != 0)
+				passwd_index.has_escaped_name = true;
+			passwd_index.nentries++;
+		}
+		line = next;
+	}
+
+	/* Build the hash table. The first entry wins if a user appears twice. */
+	passwd_index.nbuckets = 16;
+	while (passwd_index.nbuckets < passwd_index.nentries * 2)
+		passwd_index.nbuckets *= 2;
+	passwd_index.buckets = calloc(passwd_index.nbuckets, sizeof(int));
+	if (passwd_index.buckets == NULL)
+	{
+		passwd_index_free();
+		return;
+	}
+
+	for (i = 0; i < passwd_index.nentries; i++)
+	{
+		uint32		h = passwd_index_hash(entries[i].name) & (passwd_index.nbuckets - 1);
+
+		while (passwd_index.buckets[h] != 0)
+		{
+			if (strcmp(entries[passwd_index.buckets[h] - 1].name, entries[i].name) == 0)
+				break;
+			h = (h + 1) & (passwd_index.nbuckets - 1);
+		}
+		if (passwd_index.buckets[h] == 0)
+			passwd_index.buckets[h] = i + 1;
+	}
+
+	passwd_index.dev = st.st_dev;
+	passwd_index.ino = st.st_ino;
+	passwd_index.size = st.st_size;
+	passwd_index.mtime = st.st_mtim;
+	passwd_index.ctime = st.st_ctim;
+	passwd_index.loaded = true;
+
+	ereport(DEBUG1,
+			(errmsg("loaded %d entries from pool_passwd \"%s\"",
+					passwd_index.nentries, saved_passwd_filename)));
+}
+
+/*
+ * Look up the entry for the user with the user name rules of
+ * pool_get_user_credentials().
+ */
+static PasswdEntry *
+passwd_index_find(char *username)
+{
+	uint32		h;
+
+	if (passwd_index.nbuckets == 0)
+		return NULL;
+
+	h = passwd_index_hash(username) & (passwd_index.nbuckets - 1);
+	while (passwd_index.buckets[h] != 0)
+	{
+		PasswdEntry *entry = &passwd_index.entries[passwd_index.buckets[h] - 1];
+
+		if (strcmp(entry->name, username) == 0)
+			return entry;
+		h = (h + 1) & (passwd_index.nbuckets - 1);
+	}
+	return NULL;
+}
+
+/*
+ * Look up the entry for the user with the user name rules of
+ * pool_get_passwd(), which does not handle backslash escapes.
+ */
+static PasswdEntry *
+passwd_index_find_raw(char *username)
+{
+	int			i;
+
+	if (!passwd_index.has_escaped_name)
+		return passwd_index_find(username);
+
+	for (i = 0; i < passwd_index.nentries; i++)
+	{
+		if (strcmp(passwd_index.entries[i].raw_name, username) == 0)
+			return &passwd_index.entries[i];
+	}
+	return NULL;
+}
+
 /*
  * function first uses the password in the argument, if the argument is empty
  * string or NULL, it looks for the password for user in pool_passwd file.
@@ -0,0 +1,282 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ *
+ * pool_scram_cache.c: SCRAM keys and verifiers shared among child
+ * processes.
+ *
+ * Each child process remembers the SaltedPassword values it computed and
+ * the verifiers it built (see auth-scram.c), but after a failover every
+ * child reconnects at once and each of them runs the same PBKDF2
+ * computations for the same users, saturating the CPU until
+ * authentication_timeout fires.  With scram_key_cache_size set, the
+ * results are also kept in shared memory, so that one computation serves
+ * all the children.  A child about to compute marks the entry as being
+ * computed, and the children needing the same entry meanwhile wait for
+ * the result instead of computing it as well.
+ *
+ * Entries are keyed by the kind of data and a SHA-256 digest of the
+ * inputs, never by the password itself.  The cache is a set associative
+ * table of scram_key_cache_size entries protected by SCRAM_CACHE_SEM.  An
+ * entry can only be stored in the SCRAM_CACHE_WAYS entries of its set, and
+ * replaces the least recently used one.  Replaced entries are wiped.
+ */
+#include "config.h"
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "auth/pool_scram_cache.h"
+#include "utils/elog.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_ipc.h"
+
+/* number of entries a key can be stored in */
+#define SCRAM_CACHE_WAYS	4
+
+/*
+ * How long to wait for another process computing the same entry.  PBKDF2
+ * with the default iteration count takes a few milliseconds, but many of
+ * them may be running at once.
+ */
+#define SCRAM_CACHE_WAIT_USEC	1000
+#define SCRAM_CACHE_MAX_WAITS	2000
+
+typedef enum
+{
+	SCRAM_CACHE_EMPTY = 0,
+	SCRAM_CACHE_COMPUTING,		/* being computed by owner */
+	SCRAM_CACHE_VALID
+}			ScramCacheState;
+
+typedef struct
+{
+	ScramCacheState state;
+	char		kind;			/* SCRAM_CACHE_SALTED_PASSWORD etc. */
+	uint8		digest[PG_SHA256_DIGEST_LENGTH];	/* hash of the inputs */
+	pid_t		owner;			/* process computing the entry */
+	time_t		last_used;
+	int			len;			/* length of data */
+	uint8		data[SCRAM_CACHE_DATA_LEN];
+}			ScramCacheEntry;
+
+static ScramCacheEntry *scram_cache;
+static int	scram_cache_num_sets;
+
+static ScramCacheEntry *scram_cache_set(char kind, const uint8 *digest);
+static ScramCacheEntry *scram_cache_slot(ScramCacheEntry * set, char kind, const uint8 *digest);
+static bool scram_cache_match(ScramCacheEntry * entry, char kind, const uint8 *digest);
+
+/*
+ * Size of shared memory needed by the SCRAM cache.
+ */
+size_t
+pool_scram_cache_shmem_size(void)
+{
+	int			num_sets = (pool_config->scram_key_cache_size + SCRAM_CACHE_WAYS - 1) / SCRAM_CACHE_WAYS;
+
+	return MAXALIGN(sizeof(ScramCacheEntry) * num_sets * SCRAM_CACHE_WAYS);
+}
+
+/*
+ * Allocate and initialize the SCRAM cache.  This should be called only
+ * once from pgpool main process at the process starting up time.
+ */
+void
+pool_init_scram_cache(void)
+{
+	scram_cache = pool_shared_memory_segment_get_chunk(pool_scram_cache_shmem_size());
+	scram_cache_num_sets = (pool_config->scram_key_cache_size + SCRAM_CACHE_WAYS - 1) / SCRAM_CACHE_WAYS;
+	memset(scram_cache, 0, pool_scram_cache_shmem_size());
+}
+
+/*
+ * Look up the entry of kind and digest.  If found, copy its data, which
+ * must fit in size bytes, into data and return true.  If another process
+ * is computing the entry, wait for it first.  Otherwise mark the entry as
+ * being computed by this process and return false; the caller is expected
+ * to compute the data and hand it to pool_scram_cache_put().
+ */
+bool
+pool_scram_cache_get(char kind, const uint8 *digest, void *data, int size)
+{
+	pool_sigset_t oldmask;
+	ScramCacheEntry *set;
+	ScramCacheEntry *entry;
+	pid_t		mypid = getpid();
+	int			waits = 0;
+	bool		match;
+	bool		found;
+	bool		wait;
+
+	if (scram_cache == NULL || scram_cache_num_sets <= 0)
+		return false;
+
+	set = scram_cache_set(kind, digest);
+
+	for (;;)
+	{
+		found = wait = false;
+
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_semaphore_lock(SCRAM_CACHE_SEM);
+
+		entry = scram_cache_slot(set, kind, digest);
+		match = entry && scram_cache_match(entry, kind, digest);
+
+		if (match && entry->state == SCRAM_CACHE_VALID && entry->len <= size)
+		{
+			memcpy(data, entry->data, entry->len);
+			entry->last_used = time(NULL);
+			found = true;
+		}
+		else if (match && entry->state == SCRAM_CACHE_COMPUTING &&
+				 entry->owner != mypid && waits < SCRAM_CACHE_MAX_WAITS &&
+				 kill(entry->owner, 0) == 0)
+		{
+			wait = true;
+		}
+		else if (entry)
+		{
+			/* claim the entry */
+			memset(entry, 0, sizeof(*entry));
+			entry->state = SCRAM_CACHE_COMPUTING;
+			entry->kind = kind;
+			memcpy(entry->digest, digest, PG_SHA256_DIGEST_LENGTH);
+			entry->owner = mypid;
+			entry->last_used = time(NULL);
+		}
+
+		pool_semaphore_unlock(SCRAM_CACHE_SEM);
+		POOL_SETMASK(&oldmask);
+
+		if (!wait)
+			break;
+
+		usleep(SCRAM_CACHE_WAIT_USEC);
+		waits++;
+	}
+
+	ereport(DEBUG2,
+			(errmsg("SCRAM cache %s for kind %c after %d waits", found ? "hit" : "miss", kind, waits)));
+
+	return found;
+}
+
+/*
+ * Store the data of kind and digest, normally computed after
+ * pool_scram_cache_get() returned false.  If data is NULL, the entry
+ * claimed by pool_scram_cache_get() is released instead, so that others
+ * stop waiting for it.
+ */
+void
+pool_scram_cache_put(char kind, const uint8 *digest, const void *data, int len)
+{
+	pool_sigset_t oldmask;
+	ScramCacheEntry *entry;
+
+	if (scram_cache == NULL || scram_cache_num_sets <= 0)
+		return;
+
+	/* too large to be cached, just release the claim */
+	if (len > SCRAM_CACHE_DATA_LEN)
+		data = NULL;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SCRAM_CACHE_SEM);
+
+	entry = scram_cache_slot(scram_cache_set(kind, digest), kind, digest);
+	if (entry && data)
+	{
+		memset(entry, 0, sizeof(*entry));
+		entry->state = SCRAM_CACHE_VALID;
+		entry->kind = kind;
+		memcpy(entry->digest, digest, PG_SHA256_DIGEST_LENGTH);
+		entry->last_used = time(NULL);
+		entry->len = len;
+		memcpy(entry->data, data, len);
+	}
+	else if (entry && entry->state == SCRAM_CACHE_COMPUTING &&
+			 entry->owner == getpid() && scram_cache_match(entry, kind, digest))
+	{
+		memset(entry, 0, sizeof(*entry));
+	}
+
+	pool_semaphore_unlock(SCRAM_CACHE_SEM);
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Returns the first entry of the set the key belongs to.
+ */
+static ScramCacheEntry *
+scram_cache_set(char kind, const uint8 *digest)
+{
+	uint32		h;
+
+	/* the digest is a SHA-256 hash already */
+	memcpy(&h, digest, sizeof(h));
+	h ^= (unsigned char) kind;
+
+	return &scram_cache[(h % scram_cache_num_sets) * SCRAM_CACHE_WAYS];
+}
+
+/*
+ * Returns the entry of the key in the set if any, or else an empty entry,
+ * or else the least recently used entry not being computed.  Returns NULL
+ * if all the entries are being computed.  Must be called with
+ * SCRAM_CACHE_SEM held.
+ */
+static ScramCacheEntry *
+scram_cache_slot(ScramCacheEntry * set, char kind, const uint8 *digest)
+{
+	ScramCacheEntry *victim = NULL;
+	int			i;
+
+	for (i = 0; i < SCRAM_CACHE_WAYS; i++)
+	{
+		ScramCacheEntry *entry = &set[i];
+
+		if (scram_cache_match(entry, kind, digest))
+			return entry;
+
+		if (entry->state == SCRAM_CACHE_COMPUTING)
+			continue;
+
+		if (victim == NULL ||
+			(victim->state != SCRAM_CACHE_EMPTY &&
+			 (entry->state == SCRAM_CACHE_EMPTY || entry->last_used < victim->last_used)))
+			victim = entry;
+	}
+	return victim;
+}
+
+/*
+ * Returns true if the entry is in use for the key.
+ */
+static bool
+scram_cache_match(ScramCacheEntry * entry, char kind, const uint8 *digest)
+{
+	return entry->state != SCRAM_CACHE_EMPTY && entry->kind == kind &&
+		memcmp(entry->digest, digest, PG_SHA256_DIGEST_LENGTH) == 0;
+}
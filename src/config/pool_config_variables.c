@@ -51,6 +51,7 @@
 #define default_reset_query_list	"ABORT;DISCARD ALL"
 #define default_listen_addresses_list	"localhost"
 #define default_pcp_listen_addresses_list	"localhost"
+#define default_metrics_listen_addresses_list	"localhost"
 #define default_unix_socket_directories_list	"/tmp"
 #define default_read_only_function_list ""
 #define default_write_function_list ""
@@ -100,6 +101,9 @@ static bool MakeUserRedirectListRegex(char *newval, int elevel);
 static bool MakeDBRedirectListRegex(char *newval, int elevel);
 static bool MakeAppRedirectListRegex(char *newval, int elevel);
 static bool MakeDMLAdaptiveObjectRelationList(char *newval, int elevel);
+static bool MakeShardKeyList(char *newval, int elevel);
+static bool MakeMemqcacheDatabaseQuota(char *newval, int elevel);
+static bool MakeHeavyQueryNodes(char *newval, int elevel);
 static char* getParsedToken(char *token, DBObjectTypes *object_type);
 
 static bool check_redirect_node_spec(char *node_spec);
@@ -248,6 +252,7 @@ static const struct config_enum_entry process_management_strategy_options[] = {
 	{"aggressive", PM_STRATEGY_AGGRESSIVE, false},
 	{"gentle", PM_STRATEGY_GENTLE, false},
 	{"lazy", PM_STRATEGY_LAZY, false},
+	{"adaptive", PM_STRATEGY_ADAPTIVE, false},
 
 	{NULL, 0, false}
 };
@@ -259,9 +264,56 @@ static const struct config_enum_entry log_standby_delay_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry insert_lock_method_options[] = {
+	{"row_lock", ILM_ROW_LOCK, false},
+	{"advisory_lock", ILM_ADVISORY_LOCK, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry query_limit_action_options[] = {
+	{"wait", QLA_WAIT, false},
+	{"reject", QLA_REJECT, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry memqcache_method_options[] = {
 	{"shmem", SHMEM_CACHE, false},
 	{"memcached", MEMCACHED_CACHE, false},
+	{"redis", REDIS_CACHE, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry memqcache_compression_options[] = {
+	{"none", MEMQCACHE_COMPRESSION_NONE, false},
+#ifdef USE_LZ4
+	{"lz4", MEMQCACHE_COMPRESSION_LZ4, false},
+#endif
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry memqcache_invalidation_mode_options[] = {
+	{"sync", MEMQCACHE_INVALIDATION_SYNC, false},
+	{"async", MEMQCACHE_INVALIDATION_ASYNC, false},
+	{"strict", MEMQCACHE_INVALIDATION_STRICT, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry memqcache_hash_method_options[] = {
+	{"xxhash", MEMQCACHE_HASH_XXHASH, false},
+	{"md5", MEMQCACHE_HASH_MD5, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry huge_pages_options[] = {
+	{"off", HUGE_PAGES_OFF, false},
+	{"on", HUGE_PAGES_ON, false},
+	{"try", HUGE_PAGES_TRY, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry log_ring_overflow_options[] = {
+	{"drop", LOG_RING_OVERFLOW_DROP, false},
+	{"block", LOG_RING_OVERFLOW_BLOCK, false},
 	{NULL, 0, false}
 };
 
@@ -293,6 +345,12 @@ static const struct config_enum_entry disable_load_balance_on_write_options[] =
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry load_balance_algorithm_options[] = {
+	{"weight", LB_ALGORITHM_WEIGHT, false},
+	{"least_loaded", LB_ALGORITHM_LEAST_LOADED, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry relcache_query_target_options[] = {
 	{"primary", RELQTARGET_PRIMARY, false},
 	{"load_balance_node", RELQTARGET_LOAD_BALANCE_NODE, false},
@@ -399,6 +457,15 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL,					/* check func */
 		NULL					/* show hook */
 	},
+	{
+		{"numa_child_affinity", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Bind child processes to NUMA nodes.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.numa_child_affinity,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"failover_when_quorum_exists", CFGCXT_INIT, FAILOVER_CONFIG,
 			"Do failover only when cluster has the quorum.",
@@ -554,6 +621,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"causal_reads", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
+			"After a write, load balance read queries only to standbys which have replayed the write.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.causal_reads,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"connection_cache", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
 			"Caches connections to backends.",
@@ -564,6 +641,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"skip_reset_on_clean_session", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Skip reset_query_list if the session did not change the session state.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.skip_reset_on_clean_session,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"fail_over_on_backend_error", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Old config parameter for failover_on_backend_error.",
@@ -594,6 +681,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"failover_keep_sessions", CFGCXT_RELOAD, FAILOVER_CONFIG,
+			"Keeps sessions not using the failed standby node alive during failover.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.failover_keep_sessions,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"detach_false_primary", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Automatically detaches false primary node.",
@@ -614,6 +711,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"replication_concurrent_dispatch", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Sends statements which cannot deadlock to all nodes at once in native replication mode.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.replication_concurrent_dispatch,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"ignore_leading_white_space", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Ignores leading white spaces of each query string.",
@@ -684,6 +791,46 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wd_heartbeat_single_process", CFGCXT_INIT, WATCHDOG_CONFIG,
+			"Sends and receives heartbeat signals of all destinations in one process.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.wd_heartbeat_single_process,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"wd_lifecheck_persistent_connection", CFGCXT_INIT, WATCHDOG_CONFIG,
+			"Keeps the connections used by the watchdog lifecheck query open between checks.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.wd_lifecheck_persistent_connection,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"trusted_server_use_icmp", CFGCXT_INIT, WATCHDOG_CONFIG,
+			"Checks trusted servers with ICMP echo requests sent by pgpool itself.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.trusted_server_use_icmp,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"wd_parallel_escalation", CFGCXT_INIT, WATCHDOG_CONFIG,
+			"Runs the escalation commands and the delegate IP commands at the same time.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.wd_parallel_escalation,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"ssl", CFGCXT_INIT, SSL_CONFIG,
 			"Enables SSL support for frontend and backend connections",
@@ -704,6 +851,26 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"ssl_session_tickets", CFGCXT_INIT, SSL_CONFIG,
+			"Allow frontends to resume SSL sessions using session tickets.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.ssl_session_tickets,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"ssl_ktls", CFGCXT_INIT, SSL_CONFIG,
+			"Offload SSL encryption of established connections to the kernel.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.ssl_ktls,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"check_unlogged_table", CFGCXT_SESSION, GENERAL_CONFIG,
 			"Enables unlogged table check.",
@@ -726,7 +893,7 @@ static struct config_bool ConfigureNamesBool[] =
 
 	{
 		{"enable_shared_relcache", CFGCXT_INIT, CACHE_CONFIG,
-			"relation cache stored in memory cache.",
+			"relation cache is shared among child processes.",
 			CONFIG_VAR_TYPE_BOOL, false, 0
 		},
 		&g_pool_config.enable_shared_relcache,
@@ -734,6 +901,26 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"relcache_background_refresh", CFGCXT_INIT, CACHE_CONFIG,
+			"Refreshes expired shared relation cache entries in background.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.relcache_background_refresh,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"relcache_prefetch", CFGCXT_INIT, CACHE_CONFIG,
+			"Fetches session independent catalog information in background.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.relcache_prefetch,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_auto_cache_invalidation", CFGCXT_RELOAD, CACHE_CONFIG,
 			"Automatically deletes the cache related to the updated tables.",
@@ -744,6 +931,36 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_invalidation_coalesce", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Applies invalidation of the same table only once in a batch.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_invalidation_coalesce,
+		true,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_admission_filter", CFGCXT_INIT, CACHE_CONFIG,
+			"Admits new shmem query cache items by their access frequency.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_admission_filter,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_watchdog_invalidation", CFGCXT_INIT, CACHE_CONFIG,
+			"Sends query cache invalidation to the other pgpool nodes through watchdog.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_watchdog_invalidation,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"allow_sql_comments", CFGCXT_SESSION, LOAD_BALANCE_CONFIG,
 			"Ignore SQL comments, while judging if load balance or query cache is possible.",
@@ -773,6 +990,36 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"adaptive_weight", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Adjusts backend weights by measured node latency.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.adaptive_weight,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"hedged_reads", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Resends slow load balanced SELECTs to another standby.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.hedged_reads,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"retry_reads_on_standby_failure", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Resends load balanced SELECTs whose standby fails before answering.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.retry_reads_on_standby_failure,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"auto_failback", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Enables nodes automatically reattach, when detached node continue streaming replication.",
@@ -782,6 +1029,15 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"auto_attach_new_backends", CFGCXT_RELOAD, FAILOVER_CONFIG,
+			"Attach backend nodes added to the configuration file upon reload.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.auto_attach_new_backends,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"logging_collector", CFGCXT_INIT, LOGGING_CONFIG,
 			"Enable capturing of stderr into log files.",
@@ -811,6 +1067,25 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"health_check_multiplexed", CFGCXT_INIT, HEALTH_CHECK_CONFIG,
+		 "If on, one process performs health check of all backends concurrently.",
+		 CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.health_check_multiplexed,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"sr_check_by_health_check", CFGCXT_INIT, HEALTH_CHECK_CONFIG,
+			"If on, the multiplexed health check also samples the role and WAL location of backends for streaming replication check.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.sr_check_by_health_check,
+		false,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	EMPTY_CONFIG_BOOL
 
@@ -866,6 +1141,17 @@ static struct config_string ConfigureNamesString[] =
 		MakeDMLAdaptiveObjectRelationList, NULL
 	},
 
+	{
+		{"shard_key_list", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"list of table:column of the tables sharded by the column.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.shard_key_list,
+		NULL,
+		NULL, NULL,
+		MakeShardKeyList, NULL
+	},
+
 	{
 		{"unix_socket_group", CFGCXT_INIT, CONNECTION_CONFIG,
 			"The owning user of the sockets that always starts the server.",
@@ -876,6 +1162,16 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"backend_local_socket_dir", CFGCXT_RELOAD, CONNECTION_CONFIG,
+			"The UNIX domain socket directory used to connect to backends running on this host.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.backend_local_socket_dir,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"wd_ipc_socket_dir", CFGCXT_INIT, CONNECTION_CONFIG,
 			"The directory to create the UNIX domain socket for accepting pgpool-II watchdog IPC connections.",
@@ -1040,6 +1336,16 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"recovery_catchup_command", CFGCXT_RELOAD, RECOVERY_CONFIG,
+			"Command to execute between first and second stage recovery while accepting clients.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.recovery_catchup_command,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"lobj_lock_table", CFGCXT_RELOAD, REPLICATION_CONFIG,
 			"Table name used for large object replication control.",
@@ -1321,9 +1627,79 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_logical_slot", CFGCXT_INIT, CACHE_CONFIG,
+			"Logical replication slot to read table changes for query cache invalidation from.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_logical_slot,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_database_quota", CFGCXT_INIT, CACHE_CONFIG,
+			"Limits the shmem query cache used by each database.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_database_quota,
+		"",
+		NULL, NULL, MakeMemqcacheDatabaseQuota, NULL
+	},
+
+	{
+		{"heavy_query_nodes", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Comma separated list of node ids heavy queries are sent to.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.heavy_query_nodes,
+		"",
+		NULL, NULL, MakeHeavyQueryNodes, NULL
+	},
+
+	{
+		{"memqcache_logical_database", CFGCXT_INIT, CACHE_CONFIG,
+			"Database of the logical replication slot for query cache invalidation.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_logical_database,
+		"postgres",
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_redis_host", CFGCXT_INIT, CACHE_CONFIG,
+			"Hostname or IP address of Redis.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_redis_host,
+		"localhost",
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_redis_password", CFGCXT_INIT, CACHE_CONFIG,
+			"Password of Redis.",
+			CONFIG_VAR_TYPE_STRING, false, VAR_HIDDEN_VALUE
+		},
+		&g_pool_config.memqcache_redis_password,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_snapshot_file", CFGCXT_INIT, CACHE_CONFIG,
+			"File to save the shmem query cache at shutdown and to load it at startup.",
+			CONFIG_VAR_TYPE_STRING, false, 0
+		},
+		&g_pool_config.memqcache_snapshot_file,
+		"",
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_memcached_host", CFGCXT_INIT, CACHE_CONFIG,
-			"Hostname or IP address of memcached.",
+			"Comma separated list of hostname or IP address (and port) of memcached.",
 			CONFIG_VAR_TYPE_STRING, false, 0
 		},
 		&g_pool_config.memqcache_memcached_host,
@@ -1379,6 +1755,19 @@ static struct config_string_list ConfigureNamesStringList[] =
 		NULL, NULL, NULL		/* assign, check, show funcs */
 	},
 
+	{
+		{"prewarm_connections", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"list of user:database:count entries whose connections are opened in advance.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.prewarm_connections,
+		&g_pool_config.num_prewarm_connections,
+		NULL,
+		",",
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"listen_addresses", CFGCXT_INIT, CONNECTION_CONFIG,
 			"hostname(s) or IP address(es) on which pgpool will listen on.",
@@ -1406,11 +1795,24 @@ static struct config_string_list ConfigureNamesStringList[] =
 	},
 
 	{
-		{"unix_socket_directories", CFGCXT_INIT, CONNECTION_CONFIG,
-			"The directories to create the UNIX domain sockets for accepting pgpool-II client connections.",
+		{"metrics_listen_addresses", CFGCXT_INIT, CONNECTION_CONFIG,
+			"hostname(s) or IP address(es) on which the metrics process will listen on.",
 			CONFIG_VAR_TYPE_STRING_LIST, false, 0
 		},
-		&g_pool_config.unix_socket_directories,
+		&g_pool_config.metrics_listen_addresses,
+		&g_pool_config.num_metrics_listen_addresses,
+		(const char *) default_metrics_listen_addresses_list,
+		",",
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"unix_socket_directories", CFGCXT_INIT, CONNECTION_CONFIG,
+			"The directories to create the UNIX domain sockets for accepting pgpool-II client connections.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.unix_socket_directories,
 		&g_pool_config.num_unix_socket_directories,
 		(const char *) default_unix_socket_directories_list,
 		",",
@@ -1935,6 +2337,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"metrics_port", CFGCXT_INIT, CONNECTION_CONFIG,
+			"tcp/IP port number on which the metrics process will listen on. 0 disables it.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.metrics_port,
+		0,
+		0, 65535,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"unix_socket_permissions", CFGCXT_INIT, CONNECTION_CONFIG,
 			"The access permissions of the Unix domain sockets.",
@@ -1990,6 +2403,83 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_connections_per_user", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of concurrent connections from clients of a user.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_connections_per_user,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_connections_per_database", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of concurrent connections from clients to a database.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_connections_per_database,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_active_queries_per_user", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of concurrently running queries of a user.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_active_queries_per_user,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_active_queries_per_database", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of concurrently running queries on a database.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_active_queries_per_database,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_active_queries_per_node", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of concurrently running queries on a backend node.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_active_queries_per_node,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_queries_per_second_per_user", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of queries a user can start per second.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_queries_per_second_per_user,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_queries_per_second_per_database", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of queries which can be started per second on a database.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_queries_per_second_per_database,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"listen_backlog_multiplier", CFGCXT_INIT, CONNECTION_CONFIG,
 			"length of connection queue from frontend to pgpool-II",
@@ -2034,6 +2524,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"connection_life_time_jitter", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Percentage of connection_life_time randomly taken off the expiration time of each cached connection.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.connection_life_time_jitter,
+		0,
+		0, 100,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_connection_recycles_per_second", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of expired cached connections closed per second by all child processes.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_connection_recycles_per_second,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"child_max_connections", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
 			"A pgpool-II child process will be terminated after this many connections from clients.",
@@ -2045,6 +2557,39 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_pooled_prepared_statements", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of prepared statements shared by Parse messages on a backend connection.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_pooled_prepared_statements,
+		0,
+		0, 10000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"listen_multiplexing_max_subscriptions", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Maximum number of LISTENs of client sessions served by the notification hub.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.listen_multiplexing_max_subscriptions,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"child_memory_limit", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"A pgpool-II child process will be terminated after a session if its memory exceeds this.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_KB
+		},
+		&g_pool_config.child_memory_limit,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"authentication_timeout", CFGCXT_INIT, CONNECTION_CONFIG,
 			"Time out value in seconds for client authentication.",
@@ -2056,6 +2601,61 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"dns_cache_size", CFGCXT_INIT, CONNECTION_CONFIG,
+			"Number of client host names cached in shared memory.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.dns_cache_size,
+		0,
+		0, 1048576,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"dns_cache_ttl", CFGCXT_RELOAD, CONNECTION_CONFIG,
+			"Time in seconds a client host name is cached.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.dns_cache_ttl,
+		60,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"dns_cache_negative_ttl", CFGCXT_RELOAD, CONNECTION_CONFIG,
+			"Time in seconds a failed client host name lookup is cached.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.dns_cache_negative_ttl,
+		10,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"ldap_auth_cache_ttl", CFGCXT_RELOAD, CONNECTION_CONFIG,
+			"Time in seconds a successful LDAP authentication is cached.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.ldap_auth_cache_ttl,
+		0,
+		0, 3600,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"scram_key_cache_size", CFGCXT_INIT, CONNECTION_CONFIG,
+			"Number of SCRAM keys and verifiers shared among child processes.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.scram_key_cache_size,
+		0,
+		0, 65536,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_pool", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
 			"Maximum number of connection pools per child process.",
@@ -2067,6 +2667,50 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"read_buffer_size", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Maximum number of bytes read from a socket at once.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_BYTE
+		},
+		&g_pool_config.read_buffer_size,
+		16384,
+		1024, 1048576,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"write_buffer_size", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Number of bytes buffered before writing to a socket.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_BYTE
+		},
+		&g_pool_config.write_buffer_size,
+		16384,
+		8192, 1048576,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"backend_busy_poll", CFGCXT_RELOAD, CONNECTION_CONFIG,
+			"Microseconds to busy poll for data on TCP connections to backends.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.backend_busy_poll,
+		0,
+		0, 1000000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"result_spool_size", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of bytes of a result buffered for a slow client.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_BYTE
+		},
+		&g_pool_config.result_spool_size,
+		0,
+		0, 1073741824,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"sr_check_period", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
 			"Time interval in seconds between the streaming replication delay checks.",
@@ -2078,6 +2722,50 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"sr_lag_check_interval", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
+			"Time interval in milliseconds between the replication lag samplings in between sr_check_period.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.sr_lag_check_interval,
+		0,
+		0, 1000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"follow_primary_command_parallelism", CFGCXT_RELOAD, FAILOVER_CONFIG,
+			"Maximum number of follow_primary_command to execute concurrently.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.follow_primary_command_parallelism,
+		1,
+		1, MAX_NUM_BACKENDS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"health_check_error_threshold", CFGCXT_RELOAD, HEALTH_CHECK_CONFIG,
+			"Backend errors per second seen by child processes that trigger an immediate health check.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.health_check_error_threshold,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"health_check_probe_interval", CFGCXT_RELOAD, HEALTH_CHECK_CONFIG,
+			"Time interval in milliseconds between lightweight probes in between health_check_period.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.health_check_probe_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"recovery_timeout", CFGCXT_RELOAD, RECOVERY_CONFIG,
 			"Maximum time in seconds to wait for the recovering PostgreSQL node.",
@@ -2089,6 +2777,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"recovery_catchup_rounds", CFGCXT_RELOAD, RECOVERY_CONFIG,
+			"Number of times to execute recovery_catchup_command.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.recovery_catchup_rounds,
+		1,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"client_idle_limit_in_recovery", CFGCXT_SESSION, RECOVERY_CONFIG,
 			"Time limit is seconds for the child connection, before it is terminated during the 2nd stage recovery.",
@@ -2100,6 +2799,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"failover_reattach_timeout", CFGCXT_RELOAD, FAILOVER_CONFIG,
+			"Max time in seconds an idle session waits to be reattached to the new primary after failover.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.failover_reattach_timeout,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"search_primary_node_timeout", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Max time in seconds to search for primary node after failover.",
@@ -2180,19 +2890,118 @@ static struct config_int ConfigureNamesInt[] =
 			"Deadtime interval in seconds for heartbeat signal.",
 			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
 		},
-		&g_pool_config.wd_heartbeat_deadtime,
-		30,
-		1, INT_MAX,
+		&g_pool_config.wd_heartbeat_deadtime,
+		30,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"ssl_session_ticket_lifetime", CFGCXT_INIT, SSL_CONFIG,
+			"Interval in seconds to rotate the keys protecting SSL session tickets.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.ssl_session_ticket_lifetime,
+		3600,
+		60, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"lobj_oid_batch_size", CFGCXT_INIT, REPLICATION_CONFIG,
+			"Number of large object ids reserved at once when rewriting lo_creat.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.lobj_oid_batch_size,
+		1,
+		1, 1000000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"timestamp_sync_interval", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Interval in seconds to synchronize the clock for rewriting timestamps with main node.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.timestamp_sync_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"relcache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of relation cache entry.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.relcache_size,
+		256,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"log_statement_sample_interval", CFGCXT_SESSION, LOGGING_CONFIG,
+			"log_statement and log_per_node_statement log one in this many statements.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.log_statement_sample_interval,
+		1,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"log_statement_rate_limit", CFGCXT_SESSION, LOGGING_CONFIG,
+			"Maximum number of statements logged per second by a child process.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.log_statement_rate_limit,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"log_min_duration_statement", CFGCXT_SESSION, LOGGING_CONFIG,
+			"Logs statements which take longer than this.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.log_min_duration_statement,
+		-1,
+		-1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"statement_stats_max", CFGCXT_INIT, LOGGING_CONFIG,
+			"Maximum number of statements tracked by SHOW pool_statements.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.statement_stats_max,
+		0,
+		0, INT_MAX / 2,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_relcache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of shared relation cache entry.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.shared_relcache_size,
+		8192,
+		1, INT_MAX / 256,
 		NULL, NULL, NULL
 	},
 
 	{
-		{"relcache_size", CFGCXT_INIT, CACHE_CONFIG,
-			"Number of relation cache entry.",
+		{"parse_cache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of parse tree cache entry.",
 			CONFIG_VAR_TYPE_INT, false, 0
 		},
-		&g_pool_config.relcache_size,
-		256,
+		&g_pool_config.parse_cache_size,
+		0,
 		0, INT_MAX,
 		NULL, NULL, NULL
 	},
@@ -2208,6 +3017,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_redis_port", CFGCXT_INIT, CACHE_CONFIG,
+			"Port number of Redis server.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_redis_port,
+		6379,
+		1, 65535,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_max_num_cache", CFGCXT_INIT, CACHE_CONFIG,
 			"Total number of cache entries.",
@@ -2230,6 +3050,50 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_stale_while_revalidate", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Seconds before expiry in which a cache entry is refreshed.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_S
+		},
+		&g_pool_config.memqcache_stale_while_revalidate,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_paginated_cache_rows", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Maximum number of rows of an ORDER BY query cached to serve its LIMIT/OFFSET variants.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_paginated_cache_rows,
+		0,
+		0, INT_MAX - 1,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_coalesce_timeout", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Time to wait for the same query running in another child to be cached.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.memqcache_coalesce_timeout,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_logical_interval", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Time between reads of the logical replication slot for query cache invalidation.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.memqcache_logical_interval,
+		1000,
+		10, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_maxcache", CFGCXT_INIT, CACHE_CONFIG,
 			"Maximum SELECT result size in bytes.",
@@ -2241,6 +3105,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_local_cache_size", CFGCXT_INIT, CACHE_CONFIG,
+			"Size of the per child local query cache in bytes.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_BYTE
+		},
+		&g_pool_config.memqcache_local_cache_size,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_cache_block_size", CFGCXT_INIT, CACHE_CONFIG,
 			"Cache block size in bytes.",
@@ -2292,6 +3167,16 @@ static struct config_int ConfigureNamesInt[] =
 		0, INT_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"log_ring_size", CFGCXT_INIT, LOGGING_CONFIG,
+			"Size of the log ring of each child process (kilobytes). 0 writes log messages to the logger pipe directly.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_KB
+		},
+		&g_pool_config.log_ring_size,
+		0,
+		0, INT_MAX / 1024,
+		NULL, NULL, NULL
+	},
 	{
 		{"delay_threshold_by_time", CFGCXT_RELOAD, STREAMING_REPLICATION_CONFIG,
 			"standby delay threshold by time.",
@@ -2303,6 +3188,83 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"dml_adaptive_write_window", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Time in milliseconds reads on tables written in the session are not load balanced.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS,
+		},
+		&g_pool_config.dml_adaptive_write_window,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"adaptive_weight_floor", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Lower limit of the effective weight in percent of backend_weight.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.adaptive_weight_floor,
+		50,
+		1, 100,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"adaptive_weight_ceiling", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Upper limit of the effective weight in percent of backend_weight.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.adaptive_weight_ceiling,
+		200,
+		100, 10000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"hedged_read_percentile", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Latency percentile of the node after which a SELECT is resent to another standby.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.hedged_read_percentile,
+		95,
+		50, 99,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"hedged_read_min_delay", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Minimum time to wait before resending a SELECT to another standby.",
+			CONFIG_VAR_TYPE_INT, false, GUC_UNIT_MS
+		},
+		&g_pool_config.hedged_read_min_delay,
+		20,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"heavy_query_min_weight", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Estimated weight from which a SELECT is sent to heavy_query_nodes.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.heavy_query_min_weight,
+		8,
+		1, 10000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_heavy_queries", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Maximum number of heavy queries running at the same time.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_heavy_queries,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	EMPTY_CONFIG_INT
 };
@@ -2399,6 +3361,28 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"insert_lock_method", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"How insert_lock serializes INSERTs into tables with SERIAL columns.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.insert_lock_method,
+		ILM_ROW_LOCK,
+		insert_lock_method_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"query_limit_action", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"What to do with a query exceeding the per user or per database query limits.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.query_limit_action,
+		QLA_WAIT,
+		query_limit_action_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"wd_lifecheck_method", CFGCXT_INIT, WATCHDOG_CONFIG,
 			"method for watchdog lifecheck.",
@@ -2421,6 +3405,61 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_hash_method", CFGCXT_INIT, CACHE_CONFIG,
+			"Hash function used to build query cache keys. either xxhash or md5. xxhash by default.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.memqcache_hash_method,
+		MEMQCACHE_HASH_XXHASH,
+		memqcache_hash_method_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_compression", CFGCXT_INIT, CACHE_CONFIG,
+			"Compression method of shmem query cache items. either none or lz4. none by default.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.memqcache_compression,
+		MEMQCACHE_COMPRESSION_NONE,
+		memqcache_compression_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_invalidation_mode", CFGCXT_INIT, CACHE_CONFIG,
+			"How query cache invalidation is performed. either sync, async or strict. sync by default.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.memqcache_invalidation_mode,
+		MEMQCACHE_INVALIDATION_SYNC,
+		memqcache_invalidation_mode_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"huge_pages", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"Use huge pages for the shared memory. either off, on or try. try by default.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.huge_pages,
+		HUGE_PAGES_TRY,
+		huge_pages_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"log_ring_overflow", CFGCXT_INIT, LOGGING_CONFIG,
+			"What a child process does when its log ring is full. either drop or block. drop by default.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.log_ring_overflow,
+		LOG_RING_OVERFLOW_DROP,
+		log_ring_overflow_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"disable_load_balance_on_write", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Load balance behavior when write query is received.",
@@ -2432,6 +3471,17 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"load_balance_algorithm", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"How to choose the load balancing node.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.load_balance_algorithm,
+		LB_ALGORITHM_WEIGHT,
+		load_balance_algorithm_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"relcache_query_target", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Target node to send relache queries.",
@@ -4405,6 +5455,10 @@ LogDestinationProcessFunc(char *newval, int elevel)
 		{
 			log_destination |= LOG_DESTINATION_STDERR;
 		}
+		else if (!strcmp(destinations[i], "jsonlog"))
+		{
+			log_destination |= LOG_DESTINATION_JSONLOG;
+		}
 		else
 		{
 			int			k;
@@ -4886,6 +5940,37 @@ config_post_processor(ConfigContext context, int elevel)
 		}
 	}
 
+	/*
+	 * Rows of sharded tables are placed by hash modulo the number of
+	 * backends.  Pin that number when shard_key_list is first set and
+	 * refuse to add backends afterwards, otherwise every key would silently
+	 * map to another node.
+	 */
+	if (pool_config->parsed_shard_key_list != NULL &&
+		pool_config->backend_desc->shard_count == 0)
+		pool_config->backend_desc->shard_count = local_num_backends;
+
+	if (pool_config->backend_desc->shard_count > 0 &&
+		local_num_backends > pool_config->backend_desc->shard_count)
+	{
+		ereport(elevel,
+				(errmsg("invalid configuration, backend nodes cannot be added once shard_key_list is set"),
+				 errdetail("ignoring backend nodes %d and later. restart pgpool to change the number of shards",
+						   pool_config->backend_desc->shard_count)));
+
+		for (i = pool_config->backend_desc->shard_count; i < local_num_backends; i++)
+		{
+			BackendInfo *backend_info = &g_pool_config.backend_desc->backend_info[i];
+
+			total_weight -= backend_info->unnormalized_weight;
+			backend_info->backend_port = 0;
+			*backend_info->backend_hostname = '\0';
+			backend_info->backend_status = CON_UNUSED;
+			backend_info->backend_weight = 0.0;
+		}
+		local_num_backends = pool_config->backend_desc->shard_count;
+	}
+
 	if (local_num_backends != pool_config->backend_desc->num_backends)
 		pool_config->backend_desc->num_backends = local_num_backends;
 
@@ -4994,6 +6079,20 @@ config_post_processor(ConfigContext context, int elevel)
 			return false;
 		}
 	}
+
+	/*
+	 * The slot name is embedded in the queries of the query cache logical
+	 * decoding worker.  Allow only what PostgreSQL allows.
+	 */
+	if (pool_config->memqcache_logical_slot &&
+		strspn(pool_config->memqcache_logical_slot, "abcdefghijklmnopqrstuvwxyz0123456789_") !=
+		strlen(pool_config->memqcache_logical_slot))
+	{
+		ereport(elevel,
+				(errmsg("invalid configuration, memqcache_logical_slot:\"%s\" may contain only lower case letters, numbers and underscores",
+						pool_config->memqcache_logical_slot)));
+		return false;
+	}
 	return true;
 }
 
@@ -5040,6 +6139,53 @@ MakeDMLAdaptiveObjectRelationList(char *newval, int elevel)
 	return true;
 }
 
+static bool
+MakeShardKeyList(char *newval, int elevel)
+{
+	int			i;
+	int			elements_count = 0;
+	char	  **rawList = get_list_from_string(newval, ",", &elements_count);
+
+	if (rawList == NULL || elements_count == 0)
+	{
+		pool_config->parsed_shard_key_list = NULL;
+		return true;
+	}
+
+	for (i = 0; i < elements_count; i++)
+	{
+		char	   *colon = strchr(rawList[i], ':');
+
+		if (colon == NULL || colon == rawList[i] || colon[1] == '\0' ||
+			strchr(colon + 1, ':'))
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration, shard_key_list entry \"%s\" is not table:column",
+							rawList[i])));
+			for (i = 0; i < elements_count; i++)
+				pfree(rawList[i]);
+			pfree(rawList);
+			return false;
+		}
+	}
+
+	pool_config->parsed_shard_key_list = palloc(sizeof(ShardKey) * (elements_count + 1));
+
+	for (i = 0; i < elements_count; i++)
+	{
+		char	   *colon = strchr(rawList[i], ':');
+
+		*colon = '\0';
+		pool_config->parsed_shard_key_list[i].table = rawList[i];
+		pool_config->parsed_shard_key_list[i].column = colon + 1;
+	}
+	pool_config->parsed_shard_key_list[i].table = NULL;
+	pool_config->parsed_shard_key_list[i].column = NULL;
+
+	pfree(rawList);
+	return true;
+}
+
 /*
  * Identify the object type for dml adaptive object
  * the function is very primitive and just looks for token
@@ -5166,6 +6312,100 @@ MakeDBRedirectListRegex(char *newval, int elevel)
 	return true;
 }
 
+/*
+ * Parse memqcache_database_quota.  Each element is "database:percent",
+ * where database may be "*" to apply to the databases not listed.
+ */
+static bool
+MakeMemqcacheDatabaseQuota(char *newval, int elevel)
+{
+	int			i;
+	Left_right_tokens *lrtokens;
+
+	if (newval == NULL || *newval == '\0')
+	{
+		pool_config->memqcache_quota_tokens = NULL;
+		return true;
+	}
+
+	lrtokens = create_lrtoken_array();
+	extract_string_tokens2(newval, ",", ':', lrtokens);
+
+	for (i = 0; i < lrtokens->pos; i++)
+	{
+		char	   *right = lrtokens->token[i].right_token;
+		char	   *endptr;
+		long		percent;
+
+		if (*(lrtokens->token[i].left_token) == '\0' || right == NULL)
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"memqcache_database_quota\""),
+					 errdetail("wrong quota spec: \"%s\"", lrtokens->token[i].left_token)));
+			return false;
+		}
+
+		percent = strtol(right, &endptr, 10);
+		if (*right == '\0' || *endptr != '\0' || percent < 1 || percent > 100)
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"memqcache_database_quota\""),
+					 errdetail("quota must be a percentage between 1 and 100: \"%s\"", right)));
+			return false;
+		}
+	}
+
+	pool_config->memqcache_quota_tokens = lrtokens;
+	return true;
+}
+
+/*
+ * Parse heavy_query_nodes, a comma separated list of node ids.
+ */
+static bool
+MakeHeavyQueryNodes(char *newval, int elevel)
+{
+	char	  **nodes;
+	bool		heavy_query_node[MAX_NUM_BACKENDS];
+	int			num_nodes = 0;
+	int			n,
+				i;
+	bool		ok = true;
+
+	memset(heavy_query_node, 0, sizeof(heavy_query_node));
+
+	nodes = get_list_from_string(newval, ",", &n);
+	for (i = 0; nodes && i < n; i++)
+	{
+		char	   *endptr;
+		long		node_id = strtol(nodes[i], &endptr, 10);
+
+		if (ok && (*nodes[i] == '\0' || *endptr != '\0' ||
+				   node_id < 0 || node_id >= MAX_NUM_BACKENDS))
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"heavy_query_nodes\""),
+					 errdetail("invalid node id: \"%s\"", nodes[i])));
+			ok = false;
+		}
+		else if (ok && !heavy_query_node[node_id])
+		{
+			heavy_query_node[node_id] = true;
+			num_nodes++;
+		}
+		pfree(nodes[i]);
+	}
+	if (nodes)
+		pfree(nodes);
+
+	if (!ok)
+		return false;
+
+	memcpy(g_pool_config.heavy_query_node, heavy_query_node, sizeof(heavy_query_node));
+	g_pool_config.num_heavy_query_nodes = num_nodes;
+	return true;
+}
+
 static bool
 MakeUserRedirectListRegex(char *newval, int elevel)
 {
@@ -22,16 +22,42 @@
  */
 
 #include <unistd.h>
+#include <string.h>
 #include <arpa/inet.h>
 #include <time.h>
 #include "pool.h"
 #include "utils/elog.h"
 #include "context/pool_process_context.h"
+#include "utils/pool_atomic.h"
 #include "pool_config.h"		/* remove me afterwards */
 
 static POOL_PROCESS_CONTEXT process_context_d;
 static POOL_PROCESS_CONTEXT * process_context;
 
+/*
+ * Index of the connection info by cancel key, placed on shmem right after
+ * the connection info table.  It is an open addressing hash table keyed
+ * by the backend pid and cancel key.  Each bucket holds the position of a
+ * ConnectionInfo in the table plus one, or 0 if the bucket is empty.
+ *
+ * Buckets are not removed when a connection is closed.  Instead a lookup
+ * always verifies the pid and key of the ConnectionInfo a bucket points
+ * to, and a registration may take over a bucket whose ConnectionInfo no
+ * longer hashes to it.  Since a registration can fail when all the
+ * buckets it may use are taken, a failed lookup does not prove that the
+ * cancel key is invalid.
+ */
+#define CANCEL_KEY_MAX_PROBES	8
+
+static pool_atomic_uint32 *cancel_key_index;
+static uint32 cancel_key_index_mask;
+
+static uint32 cancel_key_index_num(void);
+static uint32 cancel_key_hash(int pid, int key);
+static ConnectionInfo *pool_coninfo_child(int child);
+static int	coninfo_position(ConnectionInfo * info);
+static ConnectionInfo *coninfo_at(int position);
+
 /*
  * Initialize per process context
  */
@@ -103,17 +129,31 @@ pool_increment_local_session_id(void)
 }
 
 /*
- * Return byte size of connection info(ConnectionInfo) on shmem.
+ * Return byte size of connection info(ConnectionInfo) of a child on shmem.
+ * It is rounded up to a multiple of the cache line size so that children,
+ * each of which writes only its own connection info, do not share cache
+ * lines.
+ */
+static size_t
+pool_coninfo_child_size(void)
+{
+	return TYPEALIGN(POOL_CACHE_LINE_SIZE,
+					 pool_config->max_pool * MAX_NUM_BACKENDS * sizeof(ConnectionInfo));
+}
+
+/*
+ * Return byte size of connection info(ConnectionInfo) on shmem, including
+ * the room to align the start of the table to a cache line.  The table
+ * must be placed with pool_coninfo_init().
  */
 size_t
 pool_coninfo_size(void)
 {
 	size_t			size;
 
-	size = pool_config->num_init_children *
-		pool_config->max_pool *
-		MAX_NUM_BACKENDS *
-		sizeof(ConnectionInfo);
+	size = pool_config->num_init_children * pool_coninfo_child_size() +
+		POOL_CACHE_LINE_SIZE;
+	size += cancel_key_index_num() * sizeof(pool_atomic_uint32);
 
 	ereport(DEBUG1,
 			(errmsg("pool_coninfo_size: num_init_children (%d) * max_pool (%d) * MAX_NUM_BACKENDS (%d) * sizeof(ConnectionInfo) (%zu) = %zu bytes requested for shared memory",
@@ -125,6 +165,145 @@ pool_coninfo_size(void)
 	return size;
 }
 
+/*
+ * Set up connection info table in the shmem area of pool_coninfo_size()
+ * bytes.
+ */
+void
+pool_coninfo_init(void *area)
+{
+	StaticAssertStmt(PROCESS_INFO_ALIGNMENT == POOL_CACHE_LINE_SIZE,
+					 "PROCESS_INFO_ALIGNMENT must match POOL_CACHE_LINE_SIZE");
+
+	con_info = (ConnectionInfo *) TYPEALIGN(POOL_CACHE_LINE_SIZE, area);
+
+	cancel_key_index = (pool_atomic_uint32 *)
+		((char *) con_info + pool_config->num_init_children * pool_coninfo_child_size());
+	cancel_key_index_mask = cancel_key_index_num() - 1;
+	memset(cancel_key_index, 0, cancel_key_index_num() * sizeof(pool_atomic_uint32));
+}
+
+/*
+ * Register the pid and cancel key of a connection info so that
+ * pool_coninfo_cancel_key() can find it.  Must be called after the pid and
+ * key are set.
+ */
+void
+pool_coninfo_register_cancel_key(ConnectionInfo * info)
+{
+	uint32		value = coninfo_position(info) + 1;
+	uint32		hash = cancel_key_hash(info->pid, info->key);
+	int			i;
+
+	for (i = 0; i < CANCEL_KEY_MAX_PROBES; i++)
+	{
+		pool_atomic_uint32 *bucket = &cancel_key_index[(hash + i) & cancel_key_index_mask];
+		uint32		current = pool_atomic_read_u32(bucket);
+
+		if (current == value)
+			return;
+
+		if (current != 0)
+		{
+			ConnectionInfo *c = coninfo_at(current - 1);
+			uint32		c_hash = cancel_key_hash(c->pid, c->key);
+
+			/* keep the bucket if it is still used by a live connection */
+			if (c->pid != 0 &&
+				((hash + i - c_hash) & cancel_key_index_mask) < CANCEL_KEY_MAX_PROBES)
+				continue;
+		}
+
+		if (pool_atomic_compare_exchange_u32(bucket, &current, value))
+			return;
+	}
+
+	ereport(DEBUG1,
+			(errmsg("no room in cancel key index for backend pid:%d", ntohl(info->pid))));
+}
+
+/*
+ * Look up the connection info having the pid and cancel key sent to a
+ * frontend, and return the connection info of the first backend of the
+ * same connection pool.  Returns NULL if it is not found in the index.
+ */
+ConnectionInfo *
+pool_coninfo_cancel_key(int pid, int key)
+{
+	uint32		hash = cancel_key_hash(pid, key);
+	int			i;
+
+	for (i = 0; i < CANCEL_KEY_MAX_PROBES; i++)
+	{
+		uint32		value = pool_atomic_read_u32(&cancel_key_index[(hash + i) & cancel_key_index_mask]);
+		ConnectionInfo *c;
+
+		if (value == 0)
+			continue;
+
+		c = coninfo_at(value - 1);
+		if (c->pid == pid && c->key == key)
+			return coninfo_at((value - 1) / MAX_NUM_BACKENDS * MAX_NUM_BACKENDS);
+	}
+	return NULL;
+}
+
+/*
+ * Return number of buckets of the cancel key index: a power of 2 which is
+ * at least twice the number of connection info entries.
+ */
+static uint32
+cancel_key_index_num(void)
+{
+	uint32		num = 1;
+
+	while (num < 2 * (uint32) pool_coninfo_num())
+		num <<= 1;
+	return num;
+}
+
+static uint32
+cancel_key_hash(int pid, int key)
+{
+	uint32		h = (uint32) pid * 0x9e3779b1 ^ (uint32) key;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+/*
+ * Convert a connection info to its position in the table counted in
+ * ConnectionInfo entries, ignoring the padding between children, and back.
+ */
+static int
+coninfo_position(ConnectionInfo * info)
+{
+	size_t		offset = (char *) info - (char *) con_info;
+	int			child = offset / pool_coninfo_child_size();
+
+	return child * pool_config->max_pool * MAX_NUM_BACKENDS +
+		(offset - child * pool_coninfo_child_size()) / sizeof(ConnectionInfo);
+}
+
+static ConnectionInfo *
+coninfo_at(int position)
+{
+	int			per_child = pool_config->max_pool * MAX_NUM_BACKENDS;
+
+	return &pool_coninfo_child(position / per_child)[position % per_child];
+}
+
+/*
+ * Return the connection info of a child.
+ */
+static ConnectionInfo *
+pool_coninfo_child(int child)
+{
+	return (ConnectionInfo *) ((char *) con_info + child * pool_coninfo_child_size());
+}
+
 /*
  * Return number of elements of connection info(ConnectionInfo) on shmem.
  */
@@ -168,9 +347,7 @@ pool_coninfo(int child, int connection_pool, int backend)
 		return NULL;
 	}
 
-	return &con_info[child * pool_config->max_pool * MAX_NUM_BACKENDS +
-					 connection_pool * MAX_NUM_BACKENDS +
-					 backend];
+	return &pool_coninfo_child(child)[connection_pool * MAX_NUM_BACKENDS + backend];
 }
 
 /*
@@ -204,9 +381,7 @@ pool_coninfo_pid(int pid, int connection_pool, int backend)
 	if (backend < 0 || backend >= MAX_NUM_BACKENDS)
 		elog(ERROR, "failed to get child pid, invalid backend no:%d", backend);
 
-	return &con_info[child * pool_config->max_pool * MAX_NUM_BACKENDS +
-					 connection_pool * MAX_NUM_BACKENDS +
-					 backend];
+	return &pool_coninfo_child(child)[connection_pool * MAX_NUM_BACKENDS + backend];
 }
 
 /*
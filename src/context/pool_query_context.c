@@ -23,12 +23,19 @@
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_connection_pool.h"
+#include "protocol/pool_client_limit.h"
+#include "main/health_check.h"
+#include "main/pool_internal_comms.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/elog.h"
 #include "utils/statistics.h"
 #include "utils/pool_select_walker.h"
+#include "utils/pool_shard_routing.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_stage.h"
+#include "utils/pool_trace.h"
 #include "context/pool_session_context.h"
 #include "context/pool_query_context.h"
 #include "parser/nodes.h"
@@ -37,6 +44,7 @@
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 /*
@@ -61,18 +69,35 @@ static POOL_DEST send_to_where(Node *node);
 static void where_to_send_deallocate(POOL_QUERY_CONTEXT * query_context, Node *node);
 static void where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node *node);
 static void where_to_send_native_replication(POOL_QUERY_CONTEXT * query_context, char *query, Node *node);
+static void where_to_send_shard(POOL_QUERY_CONTEXT * query_context, Node *node);
 
 static char *remove_read_write(int len, const char *contents, int *rewritten_len);
 static void set_virtual_main_node(POOL_QUERY_CONTEXT *query_context);
 static void set_load_balance_info(POOL_QUERY_CONTEXT *query_context);
+static int	choose_heavy_query_node(POOL_CONNECTION_POOL * backend, Node *node);
 
 static bool is_in_list(char *name, List *list);
 static bool is_select_object_in_temp_write_list(Node *node, void *context);
 static bool add_object_into_temp_write_list(Node *node, void *context);
 static void dml_adaptive(Node *node, char *query);
+static bool is_in_session_write_list(char *relname);
+static void add_object_into_session_write_list(char *relname, uint64 now);
+static void move_temp_write_list_to_session_write_list(void);
 static char* get_associated_object_from_dml_adaptive_relations
 							(char *left_token, DBObjectTypes object_type);
 
+static POOL_QUERY_CONTEXT * init_query_context(MemoryContext memory_context);
+static bool is_load_balanced_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend, int node_id);
+static int	hedged_read_delay(int node_id);
+static int	choose_other_standby(POOL_CONNECTION_POOL * backend, int node_id);
+static void send_read_to_node(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+							  int node_id, char *string, int len);
+static void move_read_to_node(POOL_QUERY_CONTEXT * query_context, int old_node_id, int node_id);
+static int	hedge_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+					   int node_id, char *string, int len);
+static int	retry_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+					   int node_id, char *string, int len);
+
 /*
  * Create and initialize per query session context
  */
@@ -85,11 +110,39 @@ pool_init_query_context(void)
 														 ALLOCSET_SMALL_INITSIZE,
 														 ALLOCSET_SMALL_MAXSIZE);
 
+	return init_query_context(memory_context);
+}
+
+/*
+ * Same as pool_init_query_context() but the memory of the query context is
+ * managed by a bump allocator.  Parse trees and rewritten queries are
+ * allocated piece by piece and released all at once when the query context
+ * is destroyed, which is exactly what a bump context is good at.  Since
+ * pfree() does not give memory back to such a context, this must not be
+ * used for query contexts which keep allocating memory over a long life,
+ * e.g. ones of extended query protocol statements that are executed many
+ * times.
+ */
+POOL_QUERY_CONTEXT *
+pool_init_simple_query_context(void)
+{
+	MemoryContext memory_context = BumpContextCreate(QueryContext,
+													 "SimpleQueryContextMemoryContext",
+													 ALLOCSET_SMALL_INITSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE);
+
+	return init_query_context(memory_context);
+}
+
+static POOL_QUERY_CONTEXT *
+init_query_context(MemoryContext memory_context)
+{
 	MemoryContext oldcontext = MemoryContextSwitchTo(memory_context);
 	POOL_QUERY_CONTEXT *qc;
 
 	qc = palloc0(sizeof(*qc));
 	qc->memory_context = memory_context;
+	qc->statement_stats_slot = -1;
 	MemoryContextSwitchTo(oldcontext);
 	return qc;
 }
@@ -164,6 +217,7 @@ pool_start_query(POOL_QUERY_CONTEXT * query_context, char *query, int len, Node
 		query_context->virtual_main_node_id = my_main_node_id;
 		query_context->load_balance_node_id = my_main_node_id;
 		query_context->is_cache_safe = false;
+		query_context->likely_select = 0;
 		query_context->num_original_params = -1;
 		if (pool_config->memory_cache_enabled)
 			query_context->temp_cache = pool_create_temp_query_cache(query);
@@ -460,13 +514,25 @@ pool_force_query_node_to_backend(POOL_QUERY_CONTEXT * query_context, int backend
 void
 pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 {
+	PoolStage	stage;
+
 	CHECK_QUERY_CONTEXT_IS_VALID;
 
+	TRACE_PGPOOL_ROUTE_START(query);
+	stage = pool_stage_enter(POOL_STAGE_ROUTE);
+
 	/*
 	 * Zap out DB node map
 	 */
 	pool_clear_node_to_be_sent(query_context);
 
+	/*
+	 * Look up the tables of a SELECT at once, before the checks below and
+	 * the query cache look them up one by one.
+	 */
+	if (!RAW_MODE && !query_context->is_multi_statement)
+		pool_prefetch_relcache(node);
+
 	/*
 	 * In raw mode, we send only to main node. Simple enough.
 	 */
@@ -476,7 +542,8 @@ pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 	}
 	else if (MAIN_REPLICA)
 	{
-		if (query_context->is_multi_statement)
+		if (query_context->is_multi_statement &&
+			!query_context->is_read_only_multi_statement)
 		{
 			/*
 			 * If we are in streaming replication mode and we have multi statement query,
@@ -493,7 +560,13 @@ pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 			pool_set_node_to_be_sent(query_context, PRIMARY_NODE_ID);
 		}
 		else
+		{
+			/*
+			 * A multi statement query of load balanceable SELECTs only is
+			 * routed as its first SELECT is.
+			 */
 			where_to_send_main_replica(query_context, query, node);
+		}
 	}
 	else if (REPLICATION)
 	{
@@ -502,12 +575,18 @@ pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 			pool_setall_node_to_be_sent(query_context);
 		}
 		else
+		{
 			where_to_send_native_replication(query_context, query, node);
+			if (pool_config->backend_clustering_mode == CM_NATIVE_REPLICATION &&
+				pool_config->parsed_shard_key_list)
+				where_to_send_shard(query_context, node);
+		}
 	}
 	else
 	{
 		ereport(WARNING,
 				(errmsg("unknown pgpool-II mode while deciding for where to send query")));
+		pool_stage_leave(stage);
 		return;
 	}
 
@@ -522,9 +601,46 @@ pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node)
 	/* Set virtual main node according to the where_to_send map. */
 	set_virtual_main_node(query_context);
 
+	pool_stage_leave(stage);
+	TRACE_PGPOOL_ROUTE_DONE(query_context->virtual_main_node_id,
+							query_context->load_balance_node_id);
+
 	return;
 }
 
+/*
+ * Return true if every statement of a multi statement query is a SELECT
+ * which could be load balanced on its own: no write function calls, system
+ * catalogs, temporary or unlogged tables or tables written in the session
+ * are involved.  Such a query can be sent to a standby as a whole, since
+ * the statements of a simple query run in one implicit transaction on the
+ * node it is sent to.
+ */
+bool
+pool_multi_statement_is_read_only(List *parse_tree_list, char *query)
+{
+	ListCell   *cell;
+
+	if (!MAIN_REPLICA || !pool_config->load_balance_mode)
+		return false;
+
+	foreach(cell, parse_tree_list)
+	{
+		Node	   *node = ((RawStmt *) lfirst(cell))->stmt;
+
+		if (!IsA(node, SelectStmt) || !is_select_query(node, query) ||
+			send_to_where(node) != POOL_EITHER ||
+			pool_has_function_call(node) ||
+			pool_has_system_catalog(node) ||
+			(pool_config->check_temp_table && pool_has_temp_table(node)) ||
+			(pool_config->check_unlogged_table && pool_has_unlogged_table(node)) ||
+			is_select_object_in_temp_write_list(node, query))
+			return false;
+	}
+
+	return true;
+}
+
 /*
  * Send simple query and wait for response
  * send_type:
@@ -541,6 +657,7 @@ pool_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 	POOL_CONNECTION_POOL *backend;
 	bool		is_commit;
 	bool		is_begin_read_write;
+	bool		answered;
 	int			i;
 	int			len;
 	char	   *string;
@@ -553,6 +670,8 @@ pool_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 	len = 0;
 	string = NULL;
 
+	pool_finish_hedged_read(backend);
+
 	/*
 	 * If the query is BEGIN READ WRITE or BEGIN ... SERIALIZABLE in
 	 * streaming replication mode, we send BEGIN to standbys instead.
@@ -621,9 +740,12 @@ pool_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 			}
 		}
 
+		pool_client_limit_begin_node_query(backend, i);
 		per_node_statement_log(backend, i, string);
 		per_node_statement_notice(backend, i, string);
 		stat_count_up(i, query_context->parse_tree);
+		stat_query_start(i, query_context->parse_tree,
+						 query_context->statement_stats_slot);
 		send_simplequery_message(CONNECTION(backend, i), len, string, MAJOR(backend));
 	}
 
@@ -657,11 +779,30 @@ pool_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 				string = query_context->rewritten_query;
 		}
 
-		wait_for_query_response_with_trans_cleanup(frontend,
-												   CONNECTION(backend, i),
-												   MAJOR(backend),
-												   MAIN_CONNECTION(backend)->pid,
-												   MAIN_CONNECTION(backend)->key);
+		/*
+		 * If a load balanced SELECT is slow to answer, send it to another
+		 * standby as well and go on with whichever answers first.  If the
+		 * node fails before answering, send it to another node instead.
+		 */
+		answered = false;
+		if (send_type > 0 && is_load_balanced_read(query_context, backend, i))
+		{
+			if (pool_config->hedged_reads && pool_config->statement_level_load_balance &&
+				!query_context->is_heavy_query)
+				i = hedge_read(query_context, backend, i, string, len);
+			if (pool_config->retry_reads_on_standby_failure)
+			{
+				i = retry_read(query_context, backend, i, string, len);
+				answered = true;
+			}
+		}
+
+		if (!answered)
+			wait_for_query_response_with_trans_cleanup(frontend,
+													   CONNECTION(backend, i),
+													   MAJOR(backend),
+													   MAIN_CONNECTION(backend)->pid,
+													   MAIN_CONNECTION(backend)->key);
 
 		/*
 		 * Check if some error detected.  If so, emit log. This is useful when
@@ -681,6 +822,311 @@ pool_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 	return POOL_CONTINUE;
 }
 
+/*
+ * Check whether the simple query just sent to the node is a SELECT which
+ * load balancing sent to a standby while no transaction is in progress.
+ * Such a query may be sent to another node again, by hedged_reads if the
+ * node is slow to answer or by retry_reads_on_standby_failure if the node
+ * fails before answering.
+ */
+static bool
+is_load_balanced_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend, int node_id)
+{
+	Node	   *node = query_context->parse_tree;
+
+	if (!STREAM || MAJOR(backend) != PROTO_MAJOR_V3)
+		return false;
+
+	if (node == NULL || !IsA(node, SelectStmt) ||
+		((SelectStmt *) node)->intoClause != NULL ||
+		((SelectStmt *) node)->lockingClause != NIL)
+		return false;
+
+	if (node_id == PRIMARY_NODE_ID || node_id != query_context->load_balance_node_id)
+		return false;
+
+	if (TSTATE(backend, node_id) != 'I' ||
+		(VALID_BACKEND_RAW(PRIMARY_NODE_ID) && TSTATE(backend, PRIMARY_NODE_ID) != 'I'))
+		return false;
+
+	return true;
+}
+
+/*
+ * Returns how long to wait for the node to answer a SELECT before hedging
+ * it, in milliseconds: hedged_read_percentile of the node's SELECT latency,
+ * but not less than hedged_read_min_delay.  Walking the latency histogram
+ * for every query would be wasteful, so the delay of each node is kept for
+ * a second.
+ */
+static int
+hedged_read_delay(int node_id)
+{
+	static int	delay[MAX_NUM_BACKENDS];
+	static time_t delay_time[MAX_NUM_BACKENDS];
+	time_t		now = time(NULL);
+
+	if (delay_time[node_id] != now)
+	{
+		delay[node_id] = stat_get_latency_percentile(node_id, STAT_QUERY_SELECT,
+													 pool_config->hedged_read_percentile) / 1000;
+		delay_time[node_id] = now;
+	}
+
+	return Max(delay[node_id], pool_config->hedged_read_min_delay);
+}
+
+/*
+ * Choose another standby to send a SELECT sent to the node to: the one
+ * with the lowest average latency among the standbys load balancing could
+ * send the query to.  Returns -1 if there is none.
+ */
+static int
+choose_other_standby(POOL_CONNECTION_POOL * backend, int node_id)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	int			selected = -1;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i == node_id || i == PRIMARY_NODE_ID || !VALID_BACKEND_RAW(i) ||
+			CONNECTION_SLOT(backend, i) == NULL)
+			continue;
+
+		/* its answer to a hedged read is still pending */
+		if (i == session_context->hedged_read_node)
+			continue;
+
+		if (BACKEND_INFO(i).backend_weight <= 0.0 || check_replication_delay(i) < 0 ||
+			!check_causal_read(i))
+			continue;
+
+		if (TSTATE(backend, i) != 'I' || !pool_read_buffer_is_empty(CONNECTION(backend, i)))
+			continue;
+
+		if (selected < 0 || stat_get_latency(i) < stat_get_latency(selected))
+			selected = i;
+	}
+
+	return selected;
+}
+
+/*
+ * Send the SELECT to another node than it was sent to first.
+ */
+static void
+send_read_to_node(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+				  int node_id, char *string, int len)
+{
+	per_node_statement_log(backend, node_id, string);
+	stat_count_up(node_id, query_context->parse_tree);
+	stat_query_start(node_id, query_context->parse_tree,
+					 query_context->statement_stats_slot);
+	send_simplequery_message(CONNECTION(backend, node_id), len, string, MAJOR(backend));
+}
+
+/*
+ * Make the node the one whose answer to the SELECT is read, and the load
+ * balance node of the session, instead of old_node_id.
+ */
+static void
+move_read_to_node(POOL_QUERY_CONTEXT * query_context, int old_node_id, int node_id)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+
+	pool_unset_node_to_be_sent(query_context, old_node_id);
+	pool_set_node_to_be_sent(query_context, node_id);
+	query_context->virtual_main_node_id = node_id;
+	query_context->load_balance_node_id = node_id;
+	session_context->load_balance_node_id = node_id;
+}
+
+/*
+ * Wait for the node to answer the SELECT for hedged_read_delay().  If it
+ * does not, send the query to another standby and wait for either of them.
+ * The node which answers first becomes the node to send the query to, the
+ * query on the other one is canceled and its answer is discarded later by
+ * pool_finish_hedged_read().  Returns the node which answered first.
+ *
+ * The race is decided by the first message of the answer rather than the
+ * whole answer, since we start forwarding the answer to the frontend as
+ * soon as it arrives.
+ */
+static int
+hedge_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+		   int node_id, char *string, int len)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_CONNECTION *cons[2];
+	CancelPacket cancel_packet;
+	int			delay;
+	int			hedged_node_id;
+	int			winner;
+	int			loser;
+
+	delay = hedged_read_delay(node_id);
+	cons[0] = CONNECTION(backend, node_id);
+	if (pool_check_fds(cons, 1, delay) >= 0)
+		return node_id;
+
+	hedged_node_id = choose_other_standby(backend, node_id);
+	if (hedged_node_id < 0 || !pool_client_limit_try_node_query(hedged_node_id))
+		return node_id;
+
+	ereport(DEBUG1,
+			(errmsg("hedging read"),
+			 errdetail("node %d did not answer within %d ms, sending the query to node %d as well",
+					   node_id, delay, hedged_node_id)));
+
+	send_read_to_node(query_context, backend, hedged_node_id, string, len);
+
+	cons[1] = CONNECTION(backend, hedged_node_id);
+	if (pool_check_fds(cons, 2, -1) == 0)
+	{
+		winner = node_id;
+		loser = hedged_node_id;
+	}
+	else
+	{
+		winner = hedged_node_id;
+		loser = node_id;
+		move_read_to_node(query_context, node_id, hedged_node_id);
+	}
+
+	ereport(DEBUG1,
+			(errmsg("hedging read"),
+			 errdetail("node %d answered first, canceling the query on node %d",
+					   winner, loser)));
+
+	/*
+	 * No need to cancel the query if the loser has already started to
+	 * answer.  Otherwise there's a chance the cancel request arrives after
+	 * the query is done, which PostgreSQL ignores.
+	 */
+	if (pool_check_fds(&cons[loser == node_id ? 0 : 1], 1, 0) < 0)
+	{
+		cancel_packet.protoVersion = htonl(PROTO_CANCEL);
+		cancel_packet.pid = CONNECTION_SLOT(backend, loser)->pid;
+		cancel_packet.key = CONNECTION_SLOT(backend, loser)->key;
+		pool_send_cancel_request(loser, &cancel_packet);
+	}
+
+	session_context = pool_get_session_context(false);
+	session_context->hedged_read_node = loser;
+
+	return winner;
+}
+
+/*
+ * Wait for the node to start answering the SELECT, and read the first part
+ * of the answer into the read buffer.  If the node fails before that,
+ * nothing has been sent to the frontend yet, so the query is sent to
+ * another standby, or to the primary if there is none, and the failed node
+ * is not used by this process any more.  Returns the node whose answer is
+ * in the read buffer.  If there is no node left to send the query to, the
+ * failed node is returned and reading from it reports the error as usual.
+ */
+static int
+retry_read(POOL_QUERY_CONTEXT * query_context, POOL_CONNECTION_POOL * backend,
+		   int node_id, char *string, int len)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	POOL_CONNECTION *con;
+	int			retry_node_id;
+	int			i;
+
+	for (;;)
+	{
+		con = CONNECTION(backend, node_id);
+		pool_check_fds(&con, 1, -1);
+		if (pool_read_ahead_noerror(con) > 0)
+			return node_id;
+
+		retry_node_id = choose_other_standby(backend, node_id);
+		if (retry_node_id < 0)
+		{
+			if (node_id == PRIMARY_NODE_ID || !VALID_BACKEND_RAW(PRIMARY_NODE_ID))
+				return node_id;
+			retry_node_id = PRIMARY_NODE_ID;
+		}
+
+		ereport(LOG,
+				(errmsg("retrying query on DB node %d", retry_node_id),
+				 errdetail("DB node %d failed before answering", node_id)));
+
+		stat_query_abandon(node_id);
+		health_check_count_backend_error(node_id, false);
+		private_backend_status[node_id] = CON_DOWN;
+		move_read_to_node(query_context, node_id, retry_node_id);
+
+		/*
+		 * The main process restarts the processes whose load balance node
+		 * goes down, so tell it we do not use the node any more before
+		 * asking for failover.
+		 */
+		for (i = 0; i < NUM_BACKENDS; i++)
+			pool_coninfo(session_context->process_context->proc_id,
+						 pool_pool_index(), i)->load_balancing_node = retry_node_id;
+
+		if (pool_config->failover_on_backend_error)
+			notice_backend_error(node_id, REQ_DETAIL_SWITCHOVER);
+
+		pool_client_limit_begin_node_query(backend, retry_node_id);
+		send_read_to_node(query_context, backend, retry_node_id, string, len);
+		node_id = retry_node_id;
+	}
+}
+
+/*
+ * Discard the answer of the node which lost a hedged read, up to its
+ * ReadyForQuery.  Called once the answer of the winner has been forwarded
+ * to the frontend, and before sending the next query.
+ */
+void
+pool_finish_hedged_read(POOL_CONNECTION_POOL * backend)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_CONNECTION *con;
+	int			node_id;
+	char		kind;
+	int			len;
+	char	   *p;
+
+	session_context = pool_get_session_context(true);
+	if (!session_context || session_context->hedged_read_node < 0)
+		return;
+
+	node_id = session_context->hedged_read_node;
+	session_context->hedged_read_node = -1;
+	con = CONNECTION(backend, node_id);
+
+	for (;;)
+	{
+		pool_read(con, &kind, sizeof(kind));
+		pool_read(con, &len, sizeof(len));
+		len = ntohl(len) - sizeof(len);
+		if (len < 0)
+			ereport(ERROR,
+					(errmsg("unable to discard the answer of a hedged read"),
+					 errdetail("invalid message length from node %d", node_id)));
+
+		p = len > 0 ? pool_read2(con, len) : NULL;
+		if (kind == 'Z')
+		{
+			if (p)
+				TSTATE(backend, node_id) = *p;
+			break;
+		}
+	}
+
+	stat_query_abandon(node_id);
+
+	ereport(DEBUG1,
+			(errmsg("hedging read"),
+			 errdetail("discarded the answer of node %d", node_id)));
+}
+
 /*
  * Send extended query and wait for response
  * send_type:
@@ -708,6 +1154,8 @@ pool_extended_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 	frontend = session_context->frontend;
 	backend = session_context->backend;
 	is_commit = is_commit_or_rollback_query(query_context->parse_tree);
+
+	pool_finish_hedged_read(backend);
 	is_begin_read_write = false;
 	str_len = 0;
 	rewritten_len = 0;
@@ -768,7 +1216,7 @@ pool_extended_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 			}
 		}
 
-		if (pool_config->log_per_node_statement)
+		if (pool_log_per_node_statement_enabled())
 		{
 			char		msgbuf[QUERY_STRING_BUFFER_LEN];
 			char	   *stmt;
@@ -813,7 +1261,10 @@ pool_extended_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 		/* if Execute message, count up stats count */
 		if (*kind == 'E')
 		{
+			pool_client_limit_begin_node_query(backend, i);
 			stat_count_up(i, query_context->parse_tree);
+			stat_query_start(i, query_context->parse_tree,
+							 query_context->statement_stats_slot);
 		}
 
 		send_extended_protocol_message(backend, i, kind, str_len, str);
@@ -830,7 +1281,10 @@ pool_extended_send_and_wait(POOL_QUERY_CONTEXT * query_context,
 
 			pool_write(cp, "H", 1);
 			len = htonl(sizeof(len));
-			pool_write_and_flush(cp, &len, sizeof(len));
+			if (pool_backend_flush_deferrable())
+				pool_write(cp, &len, sizeof(len));
+			else
+				pool_write_and_flush(cp, &len, sizeof(len));
 
 			ereport(DEBUG5,
 					(errmsg("pool_send_and_wait: send flush message to %d", i)));
@@ -1554,6 +2008,21 @@ remove_read_write(int len, const char *contents, int *rewritten_len)
 	return rewritten_contents;
 }
 
+/*
+ * Return pool_is_likely_select() of the original query.  The result is
+ * remembered in the query context so that a prepared statement executed
+ * many times does not need to scan the query string on every Execute.
+ */
+bool
+pool_query_context_is_likely_select(POOL_QUERY_CONTEXT * query_context)
+{
+	if (query_context->likely_select == 0)
+		query_context->likely_select =
+			pool_is_likely_select(query_context->original_query) ? 1 : -1;
+
+	return query_context->likely_select > 0;
+}
+
 /*
  * Return true if current query is safe to cache.
  */
@@ -1781,6 +2250,47 @@ set_load_balance_info(POOL_QUERY_CONTEXT *query_context)
 							 query_context->load_balance_node_id);
 }
 
+/*
+ * If the SELECT is a heavy query, that is its pool_select_query_weight()
+ * reaches heavy_query_min_weight, return the node of heavy_query_nodes to
+ * send it to: the one with the fewest queries in flight.  Only queries
+ * outside of explicit transactions are heavy queries, since a transaction
+ * has to stay on its load balance node.  Returns -1 if the query is not a
+ * heavy query or no node of heavy_query_nodes can take it.
+ */
+static int
+choose_heavy_query_node(POOL_CONNECTION_POOL * backend, Node *node)
+{
+	int			selected = -1;
+	int			i;
+
+	if (pool_config->num_heavy_query_nodes == 0 ||
+		TSTATE(backend, PRIMARY_NODE_ID) != 'I')
+		return -1;
+
+	if (pool_select_query_weight(node) < pool_config->heavy_query_min_weight)
+		return -1;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!pool_config->heavy_query_node[i] || !VALID_BACKEND_RAW(i) ||
+			CONNECTION_SLOT(backend, i) == NULL)
+			continue;
+
+		if (i != PRIMARY_NODE_ID &&
+			(check_replication_delay(i) < 0 || !check_causal_read(i)))
+			continue;
+
+		if (selected < 0 ||
+			stat_get_inflight_count(i) < stat_get_inflight_count(selected) ||
+			(stat_get_inflight_count(i) == stat_get_inflight_count(selected) &&
+			 stat_get_latency(i) < stat_get_latency(selected)))
+			selected = i;
+	}
+
+	return selected;
+}
+
 /*
  * Check if the name is in the list.
  */
@@ -1808,6 +2318,117 @@ is_in_list(char *name, List *list)
 /*
  * Check if the relname of SelectStmt is in the temp write list.
  */
+static uint64
+current_time_in_ms(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (uint64) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/*
+ * Check if the table was written in this session within the last
+ * dml_adaptive_write_window milliseconds.  Expired entries are removed
+ * along the way.
+ */
+static bool
+is_in_session_write_list(char *relname)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	ListCell   *cell;
+	uint64		now;
+	bool		found = false;
+
+	if (session_context->session_write_list == NIL)
+		return false;
+
+	now = current_time_in_ms();
+
+	foreach(cell, session_context->session_write_list)
+	{
+		POOL_WRITTEN_TABLE *table = (POOL_WRITTEN_TABLE *) lfirst(cell);
+
+		if (now - table->written_at >= pool_config->dml_adaptive_write_window)
+		{
+			session_context->session_write_list =
+				foreach_delete_current(session_context->session_write_list, cell);
+			pfree(table);
+			continue;
+		}
+
+		if (strcasecmp(relname, table->tablename) == 0)
+		{
+			ereport(DEBUG1,
+					(errmsg("[%s] was written %lu ms ago", relname,
+							(unsigned long) (now - table->written_at))));
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Remember the table as written now in the session write list.
+ */
+static void
+add_object_into_session_write_list(char *relname, uint64 now)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	POOL_WRITTEN_TABLE *table;
+	MemoryContext old_context;
+	ListCell   *cell;
+
+	foreach(cell, session_context->session_write_list)
+	{
+		table = (POOL_WRITTEN_TABLE *) lfirst(cell);
+		if (strcasecmp(relname, table->tablename) == 0)
+		{
+			table->written_at = now;
+			return;
+		}
+	}
+
+	old_context = MemoryContextSwitchTo(session_context->memory_context);
+	table = palloc(sizeof(POOL_WRITTEN_TABLE));
+	strlcpy(table->tablename, relname, sizeof(table->tablename));
+	table->written_at = now;
+	session_context->session_write_list = lappend(session_context->session_write_list, table);
+	MemoryContextSwitchTo(old_context);
+}
+
+/*
+ * The writes in the transaction temp write list became visible to other
+ * sessions (i.e. the statement was committed).  Move them to the session
+ * write list so that reads on them keep going to the primary for
+ * dml_adaptive_write_window milliseconds.
+ */
+static void
+move_temp_write_list_to_session_write_list(void)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	ListCell   *cell;
+	uint64		now;
+
+	if (pool_config->dml_adaptive_write_window <= 0)
+		return;
+
+	now = current_time_in_ms();
+
+	foreach(cell, session_context->transaction_temp_write_list)
+	{
+		char	   *relname = (char *) lfirst(cell);
+		char	   *right_token;
+
+		add_object_into_session_write_list(relname, now);
+
+		right_token = get_associated_object_from_dml_adaptive_relations(relname, OBJECT_TYPE_RELATION);
+		if (right_token)
+			add_object_into_session_write_list(right_token, now);
+	}
+}
+
 static bool
 is_select_object_in_temp_write_list(Node *node, void *context)
 {
@@ -1824,8 +2445,11 @@ is_select_object_in_temp_write_list(Node *node, void *context)
 			ereport(DEBUG1,
 					(errmsg("is_select_object_in_temp_write_list: \"%s\", found relation \"%s\"", (char*)context, rgv->relname)));
 
-			return is_in_list(rgv->relname, session_context->transaction_temp_write_list);
+			if (is_in_list(rgv->relname, session_context->transaction_temp_write_list))
+				return true;
 		}
+
+		return is_in_session_write_list(rgv->relname);
 	}
 
 	return raw_expression_tree_walker(node, is_select_object_in_temp_write_list, context);
@@ -1947,6 +2571,9 @@ dml_adaptive(Node *node, char *query)
 			{
 				session_context->is_in_transaction = false;
 
+				if (is_commit_query(node))
+					move_temp_write_list_to_session_write_list();
+
 				if (session_context->transaction_temp_write_list != NIL)
 					list_free_deep(session_context->transaction_temp_write_list);
 
@@ -1959,8 +2586,24 @@ dml_adaptive(Node *node, char *query)
 
 		/* If non-selectStmt, find the relname and add it to the transaction temp write list. */
 		if (!is_select_query(node, query))
+		{
 			add_object_into_temp_write_list(node, query);
 
+			/*
+			 * Outside of an explicit transaction the write is committed right
+			 * away.
+			 */
+			POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+
+			if (!session_context->is_in_transaction &&
+				pool_config->dml_adaptive_write_window > 0)
+			{
+				move_temp_write_list_to_session_write_list();
+				list_free_deep(session_context->transaction_temp_write_list);
+				session_context->transaction_temp_write_list = NIL;
+			}
+		}
+
 	}
 }
 
@@ -1974,6 +2617,10 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 	POOL_DEST	dest;
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_CONNECTION_POOL *backend;
+	SelectProperties props;
+	int			heavy_node_id;
+
+	pool_init_select_properties(&props, node);
 
 	dest = send_to_where(node);
 	session_context = pool_get_session_context(false);
@@ -2058,7 +2705,7 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 				 * primary system catalog. Please note that this test must
 				 * be done *before* test using pool_has_temp_table.
 				 */
-				if (pool_has_system_catalog(node))
+				if (pool_select_has_property(&props, SELECT_PROP_SYSTEM_CATALOG))
 				{
 					ereport(DEBUG1,
 							(errmsg("could not load balance because systems catalogs are used"),
@@ -2071,7 +2718,7 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 				 * If temporary table is used in the SELECT, we prefer to
 				 * send to the primary.
 				 */
-				else if (pool_config->check_temp_table && pool_has_temp_table(node))
+				else if (pool_config->check_temp_table && pool_select_has_property(&props, SELECT_PROP_TEMP_TABLE))
 				{
 					ereport(DEBUG1,
 							(errmsg("could not load balance because temporary tables are used"),
@@ -2084,7 +2731,7 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 				 * If unlogged table is used in the SELECT, we prefer to
 				 * send to the primary.
 				 */
-				else if (pool_config->check_unlogged_table && pool_has_unlogged_table(node))
+				else if (pool_config->check_unlogged_table && pool_select_has_property(&props, SELECT_PROP_UNLOGGED_TABLE))
 				{
 					ereport(DEBUG1,
 							(errmsg("could not load balance because unlogged tables are used"),
@@ -2104,7 +2751,7 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 				 * If a writing function call is used, we prefer to send
 				 * to the primary.
 				 */
-				else if (pool_has_function_call(node))
+				else if (pool_select_has_property(&props, SELECT_PROP_FUNCTION_CALL))
 				{
 					ereport(DEBUG1,
 							(errmsg("could not load balance because writing functions are used"),
@@ -2116,6 +2763,24 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 				{
 					pool_set_node_to_be_sent(query_context, PRIMARY_NODE_ID);
 				}
+
+				/*
+				 * Heavy analytic queries go to heavy_query_nodes, so that
+				 * they do not slow down the other queries.
+				 */
+				else if ((heavy_node_id = choose_heavy_query_node(backend, node)) >= 0)
+				{
+					ereport(DEBUG1,
+							(errmsg("sending heavy query to node %d", heavy_node_id),
+							 errdetail("destination = %d for query= \"%s\"", dest, query)));
+
+					query_context->is_heavy_query = true;
+					query_context->load_balance_node_id = heavy_node_id;
+					pool_set_node_to_be_sent(query_context, heavy_node_id);
+
+					if (!pool_is_doing_extended_query_message())
+						pool_client_limit_begin_heavy_query();
+				}
 				else
 				{
 					if (pool_config->statement_level_load_balance)
@@ -2140,14 +2805,33 @@ where_to_send_main_replica(POOL_QUERY_CONTEXT * query_context, char *query, Node
 							int new_load_balancing_node = select_load_balancing_node();
 
 							session_context->load_balance_node_id = new_load_balancing_node;
-							session_context->query_context->load_balance_node_id = session_context->load_balance_node_id;
-							pool_set_node_to_be_sent(query_context, session_context->query_context->load_balance_node_id);
+							if (check_causal_read(new_load_balancing_node))
+							{
+								session_context->query_context->load_balance_node_id = session_context->load_balance_node_id;
+								pool_set_node_to_be_sent(query_context, session_context->query_context->load_balance_node_id);
+							}
+							else
+								pool_set_node_to_be_sent(query_context, PRIMARY_NODE_ID);
 						}
 						else
 						{
 							pool_set_node_to_be_sent(query_context, PRIMARY_NODE_ID);
 						}
 					}
+
+					/*
+					 * If causal_reads is on and the load balance node has not
+					 * replayed the last write of this session yet, send to
+					 * the primary.
+					 */
+					else if (STREAM && !check_causal_read(session_context->load_balance_node_id))
+					{
+						ereport(DEBUG1,
+								(errmsg("could not load balance because the standby has not caught up with the last write"),
+								 errdetail("destination = %d for query= \"%s\"", dest, query)));
+
+						pool_set_node_to_be_sent(query_context, PRIMARY_NODE_ID);
+					}
 					else
 					{
 						session_context->query_context->load_balance_node_id = session_context->load_balance_node_id;
@@ -2180,6 +2864,9 @@ where_to_send_native_replication(POOL_QUERY_CONTEXT * query_context, char *query
 {
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_CONNECTION_POOL *backend;
+	SelectProperties props;
+
+	pool_init_select_properties(&props, node);
 
 	session_context = pool_get_session_context(false);
 	backend = session_context->backend;
@@ -2253,8 +2940,8 @@ where_to_send_native_replication(POOL_QUERY_CONTEXT * query_context, char *query
 		 * have to send to all nodes since the function may modify database.
 		 */
 		elog(DEBUG1, "Maybe sent to all node: pool_has_function_call: %d pool_config->replicate_select: %d",
-			 pool_has_function_call(node), pool_config->replicate_select);
-		if (pool_has_function_call(node) || pool_config->replicate_select)
+			 pool_select_has_property(&props, SELECT_PROP_FUNCTION_CALL), pool_config->replicate_select);
+		if (pool_select_has_property(&props, SELECT_PROP_FUNCTION_CALL) || pool_config->replicate_select)
 		{
 			pool_setall_node_to_be_sent(query_context);
 		}
@@ -2287,7 +2974,7 @@ where_to_send_native_replication(POOL_QUERY_CONTEXT * query_context, char *query
 	else
 	{
 		if (is_select_query(node, query) && !pool_config->replicate_select &&
-			!pool_has_function_call(node))
+			!pool_select_has_property(&props, SELECT_PROP_FUNCTION_CALL))
 		{
 			/* only send to main node */
 			pool_set_node_to_be_sent(query_context, REAL_MAIN_NODE_ID);
@@ -2300,6 +2987,50 @@ where_to_send_native_replication(POOL_QUERY_CONTEXT * query_context, char *query
 	}
 }
 
+/*
+ * Send a statement on sharded tables to the node holding the shard.  If it
+ * cannot be routed, query_context->shard_error is set and the caller has
+ * to reject the statement.
+ */
+static void
+where_to_send_shard(POOL_QUERY_CONTEXT * query_context, Node *node)
+{
+	const char *reason = NULL;
+	int			node_id;
+
+	query_context->shard_error = NULL;
+	query_context->is_shard_broadcast = false;
+	node_id = pool_shard_route(node, &reason);
+
+	if (node_id == SHARD_ROUTE_NONE)
+		return;
+
+	if (node_id == SHARD_ROUTE_ALL)
+	{
+		pool_setall_node_to_be_sent(query_context);
+		query_context->is_shard_broadcast = true;
+		return;
+	}
+
+	if (node_id == SHARD_ROUTE_REJECT)
+	{
+		query_context->shard_error = reason;
+		return;
+	}
+
+	if (!VALID_BACKEND_RAW(node_id))
+	{
+		query_context->shard_error = "the node holding the shard is down";
+		return;
+	}
+
+	ereport(DEBUG1,
+			(errmsg("sending statement on sharded table to node %d", node_id)));
+
+	pool_clear_node_to_be_sent(query_context);
+	pool_set_node_to_be_sent(query_context, node_id);
+}
+
 /*
  * Wait for failover/failback to finish.
  * Return values:
@@ -26,11 +26,14 @@
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/elog.h"
+#include "utils/xxhash.h"
+#include "utils/statistics.h"
 #include "pool_config.h"
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_connection_pool.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_notify_hub.h"
 #include "context/pool_session_context.h"
 
 static POOL_SESSION_CONTEXT session_context_d;
@@ -41,6 +44,21 @@ static POOL_PENDING_MESSAGE * copy_pending_message(POOL_PENDING_MESSAGE * messag
 static void dump_sent_message(char *caller, POOL_SENT_MESSAGE * m);
 static void dml_adaptive_init(void);
 static void dml_adaptive_destroy(void);
+static uint32 sent_message_hash(char kind, const char *name);
+static uint32 temp_table_hash(const char *tablename);
+static void temp_table_hash_insert(POOL_TEMP_TABLE * table);
+static void temp_table_hash_delete(POOL_TEMP_TABLE * table);
+static void sent_message_hash_insert(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message);
+static void sent_message_hash_delete(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message, uint32 hashval);
+static void remove_sent_message(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message);
+
+#define SENT_MESSAGE_BUCKET(msglist, hashval) \
+	((msglist)->buckets[(hashval) & ((msglist)->nbuckets - 1)])
+
+#define TEMP_TABLE_BUCKET(hashval) \
+	(session_context->temp_table_buckets[(hashval) & (session_context->temp_table_nbuckets - 1)])
+#define PENDING_MESSAGE_NTH(queue, n) \
+	((queue)->messages[((queue)->head + (n)) & ((queue)->capacity - 1)])
 
 #ifdef PENDING_MESSAGE_DEBUG
 static int	Elevel = LOG;
@@ -86,6 +104,20 @@ pool_init_session_context(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * bac
 															ALLOCSET_SMALL_INITSIZE,
 															ALLOCSET_SMALL_MAXSIZE);
 
+	/*
+	 * Sent and pending messages are created and destroyed one by one during
+	 * the whole session, so they get slab contexts of their own.  Their
+	 * contents stay in the session memory context.
+	 */
+	session_context->sent_message_context = SlabContextCreate(session_context->memory_context,
+															  "SentMessageContext",
+															  SLAB_DEFAULT_BLOCK_SIZE,
+															  sizeof(POOL_SENT_MESSAGE));
+	session_context->pending_message_context = SlabContextCreate(session_context->memory_context,
+																 "PendingMessageContext",
+																 SLAB_DEFAULT_BLOCK_SIZE * 4,
+																 sizeof(POOL_PENDING_MESSAGE));
+
 	/* Initialize sent message list */
 	init_sent_message_list();
 
@@ -106,6 +138,7 @@ pool_init_session_context(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * bac
 	}
 
 	session_context->load_balance_node_id = node_id;
+	session_context->hedged_read_node = -1;
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
@@ -192,8 +225,11 @@ pool_session_context_destroy(void)
 {
 	if (session_context)
 	{
+		/* queries still in flight are not going to be answered */
+		stat_query_end_all();
 		pool_clear_sent_message_list();
 		pfree(session_context->message_list.sent_messages);
+		pfree(session_context->message_list.buckets);
 		if (pool_config->memory_cache_enabled)
 		{
 			pool_discard_query_cache_array(session_context->query_cache_array);
@@ -205,6 +241,7 @@ pool_session_context_destroy(void)
 		MemoryContextDelete(session_context->memory_context);
 
 		dml_adaptive_destroy();
+		pool_notify_hub_unlisten_all();
 	}
 	/* XXX For now, just zap memory */
 	memset(&session_context_d, 0, sizeof(session_context_d));
@@ -383,37 +420,29 @@ pool_unset_ignore_till_sync(void)
 bool
 pool_remove_sent_message(char kind, const char *name)
 {
-	int			i;
 	POOL_SENT_MESSAGE_LIST *msglist;
+	POOL_SENT_MESSAGE *msg;
+	uint32		hashval;
 
 	if (kind == 0 || name == NULL)
 		return false;
 
 	msglist = &pool_get_session_context(false)->message_list;
 
-	for (i = 0; i < msglist->size; i++)
+	hashval = sent_message_hash(kind, name);
+
+	for (msg = SENT_MESSAGE_BUCKET(msglist, hashval); msg; msg = msg->hash_next)
 	{
-		if (msglist->sent_messages[i]->kind == kind &&
-			!strcmp(msglist->sent_messages[i]->name, name))
+		if (msg->hashval == hashval && msg->kind == kind &&
+			!strcmp(msg->name, name))
 		{
-			pool_sent_message_destroy(msglist->sent_messages[i]);
-			break;
+			remove_sent_message(msglist, msg);
+			return true;
 		}
 	}
 
 	/* sent message not found */
-	if (i == msglist->size)
-		return false;
-
-	if (i != msglist->size - 1)
-	{
-		memmove(&msglist->sent_messages[i], &msglist->sent_messages[i + 1],
-				sizeof(POOL_SENT_MESSAGE *) * (msglist->size - i - 1));
-	}
-
-	msglist->size--;
-
-	return true;
+	return false;
 }
 
 /*
@@ -427,16 +456,52 @@ pool_remove_sent_messages(char kind)
 
 	msglist = &pool_get_session_context(false)->message_list;
 
-	for (i = 0; i < msglist->size; i++)
+	i = 0;
+	while (i < msglist->size)
 	{
+		/*
+		 * remove_sent_message() shifts the following elements down, so
+		 * examine the same slot again.
+		 */
 		if (msglist->sent_messages[i]->kind == kind)
-		{
-			if (pool_remove_sent_message(kind, msglist->sent_messages[i]->name))
-				i--;			/* for relocation by removing */
-		}
+			remove_sent_message(msglist, msglist->sent_messages[i]);
+		else
+			i++;
 	}
 }
 
+/*
+ * Destroy a sent message and remove it from the sent message list.
+ */
+static void
+remove_sent_message(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message)
+{
+	int			i;
+	uint32		hashval;
+
+	/*
+	 * The message has to be in the list while it is destroyed, since
+	 * can_query_context_destroy() counts it.  Remember where it is because
+	 * the message itself may be freed.
+	 */
+	i = message->index;
+	hashval = message->hashval;
+
+	pool_sent_message_destroy(message);
+
+	sent_message_hash_delete(msglist, message, hashval);
+
+	/*
+	 * Keep the order of the list: pool_get_sent_message_by_query_context()
+	 * returns the first match.
+	 */
+	msglist->size--;
+	memmove(&msglist->sent_messages[i], &msglist->sent_messages[i + 1],
+			(msglist->size - i) * sizeof(POOL_SENT_MESSAGE *));
+	for (; i < msglist->size; i++)
+		msglist->sent_messages[i]->index = i;
+}
+
 /*
  * Destroy sent message
  */
@@ -543,6 +608,7 @@ dml_adaptive_init(void)
 	{
 		session_context->is_in_transaction = false;
 		session_context->transaction_temp_write_list = NIL;
+		session_context->session_write_list = NIL;
 	}
 }
 
@@ -553,6 +619,8 @@ dml_adaptive_destroy(void)
 	{
 		if (session_context->transaction_temp_write_list != NIL)
 			list_free_deep(session_context->transaction_temp_write_list);
+		if (session_context->session_write_list != NIL)
+			list_free_deep(session_context->session_write_list);
 	}
 }
 
@@ -578,7 +646,8 @@ pool_create_sent_message(char kind, int len, char *contents,
 
 	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
 
-	msg = palloc(sizeof(POOL_SENT_MESSAGE));
+	msg = MemoryContextAlloc(session_context->sent_message_context,
+							 sizeof(POOL_SENT_MESSAGE));
 	msg->kind = kind;
 	msg->len = len;
 	msg->contents = palloc(len);
@@ -586,7 +655,11 @@ pool_create_sent_message(char kind, int len, char *contents,
 	msg->state = POOL_SENT_MESSAGE_CREATED;
 	msg->num_tsparams = num_tsparams;
 	msg->name = pstrdup(name);
+	msg->server_statement[0] = '\0';
 	msg->query_context = query_context;
+	msg->index = -1;
+	msg->hashval = sent_message_hash(kind, name);
+	msg->hash_next = NULL;
 	MemoryContextSwitchTo(old_context);
 
 	return msg;
@@ -613,7 +686,7 @@ pool_add_sent_message(POOL_SENT_MESSAGE * message)
 
 	old_msg = pool_get_sent_message(message->kind, message->name, POOL_SENT_MESSAGE_CREATED);
 
-	if (old_msg == message)
+	if (old_msg == message || message->index >= 0)
 	{
 		/*
 		 * It is likely caller tries to add the exact same message previously
@@ -657,7 +730,87 @@ pool_add_sent_message(POOL_SENT_MESSAGE * message)
 		MemoryContextSwitchTo(oldContext);
 	}
 
+	message->index = msglist->size;
 	msglist->sent_messages[msglist->size++] = message;
+	sent_message_hash_insert(msglist, message);
+}
+
+/*
+ * Compute hash value of a sent message from its kind and name.
+ */
+static uint32
+sent_message_hash(char kind, const char *name)
+{
+	uint64		h;
+
+	h = pool_xxh64(name, strlen(name), (uint64) (unsigned char) kind);
+	return (uint32) (h ^ (h >> 32));
+}
+
+/*
+ * Append a message to the tail of its hash chain.  The hash table is
+ * doubled when it gets more entries than buckets.
+ */
+static void
+sent_message_hash_insert(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message)
+{
+	POOL_SENT_MESSAGE **p;
+
+	if (msglist->size > msglist->nbuckets)
+	{
+		POOL_SENT_MESSAGE **old_buckets = msglist->buckets;
+		int			old_nbuckets = msglist->nbuckets;
+		int			i;
+
+		msglist->nbuckets *= 2;
+		msglist->buckets = MemoryContextAllocZero(session_context->memory_context,
+												  sizeof(POOL_SENT_MESSAGE *) * msglist->nbuckets);
+
+		/*
+		 * Walk the old chains in order so that messages with the same key
+		 * keep their order.  The new message is not linked yet.
+		 */
+		for (i = 0; i < old_nbuckets; i++)
+		{
+			POOL_SENT_MESSAGE *msg = old_buckets[i];
+
+			while (msg)
+			{
+				POOL_SENT_MESSAGE *next = msg->hash_next;
+
+				for (p = &SENT_MESSAGE_BUCKET(msglist, msg->hashval); *p; p = &(*p)->hash_next)
+					;
+				msg->hash_next = NULL;
+				*p = msg;
+				msg = next;
+			}
+		}
+		pfree(old_buckets);
+	}
+
+	for (p = &SENT_MESSAGE_BUCKET(msglist, message->hashval); *p; p = &(*p)->hash_next)
+		;
+	message->hash_next = NULL;
+	*p = message;
+}
+
+/*
+ * Unlink a message from its hash chain.  Only the pointer value of
+ * "message" is used, it may have been freed already.
+ */
+static void
+sent_message_hash_delete(POOL_SENT_MESSAGE_LIST * msglist, POOL_SENT_MESSAGE * message, uint32 hashval)
+{
+	POOL_SENT_MESSAGE **p;
+
+	for (p = &SENT_MESSAGE_BUCKET(msglist, hashval); *p; p = &(*p)->hash_next)
+	{
+		if (*p == message)
+		{
+			*p = (*p)->hash_next;
+			return;
+		}
+	}
 }
 
 /*
@@ -666,20 +819,22 @@ pool_add_sent_message(POOL_SENT_MESSAGE * message)
 POOL_SENT_MESSAGE *
 pool_get_sent_message(char kind, const char *name, POOL_SENT_MESSAGE_STATE state)
 {
-	int			i;
 	POOL_SENT_MESSAGE_LIST *msglist;
+	POOL_SENT_MESSAGE *msg;
+	uint32		hashval;
 
 	msglist = &pool_get_session_context(false)->message_list;
 
 	if (kind == 0 || name == NULL)
 		return NULL;
 
-	for (i = 0; i < msglist->size; i++)
+	hashval = sent_message_hash(kind, name);
+
+	for (msg = SENT_MESSAGE_BUCKET(msglist, hashval); msg; msg = msg->hash_next)
 	{
-		if (msglist->sent_messages[i]->kind == kind &&
-			!strcmp(msglist->sent_messages[i]->name, name) &&
-			msglist->sent_messages[i]->state == state)
-			return msglist->sent_messages[i];
+		if (msg->hashval == hashval && msg->kind == kind &&
+			msg->state == state && !strcmp(msg->name, name))
+			return msg;
 	}
 
 	return NULL;
@@ -1040,6 +1195,8 @@ init_sent_message_list(void)
 	MemoryContext oldContext = MemoryContextSwitchTo(session_context->memory_context);
 
 	msglist->sent_messages = palloc(sizeof(POOL_SENT_MESSAGE *) * INIT_LIST_SIZE);
+	msglist->nbuckets = INIT_LIST_SIZE;
+	msglist->buckets = palloc0(sizeof(POOL_SENT_MESSAGE *) * INIT_LIST_SIZE);
 
 	MemoryContextSwitchTo(oldContext);
 }
@@ -1054,8 +1211,6 @@ can_query_context_destroy(POOL_QUERY_CONTEXT * qc)
 	int			i;
 	int			count = 0;
 	POOL_SENT_MESSAGE_LIST *msglist;
-	ListCell   *cell;
-	ListCell   *next;
 
 	msglist = &session_context->message_list;
 
@@ -1075,15 +1230,14 @@ can_query_context_destroy(POOL_QUERY_CONTEXT * qc)
 
 	count = 0;
 
-	for (cell = list_head(session_context->pending_messages); cell; cell = next)
+	for (i = 0; i < session_context->pending_messages.count; i++)
 	{
-		POOL_PENDING_MESSAGE *message = (POOL_PENDING_MESSAGE *) lfirst(cell);
+		POOL_PENDING_MESSAGE *message = PENDING_MESSAGE_NTH(&session_context->pending_messages, i);
 
 		if (message->query_context == qc)
 		{
 			count++;
 		}
-		next = lnext(session_context->pending_messages, cell);
 	}
 
 	if (count >= 1)
@@ -1107,7 +1261,12 @@ pool_pending_messages_init(void)
 		ereport(ERROR,
 				(errmsg("pool_pending_message_init: session context is not initialized")));
 
-	session_context->pending_messages = NIL;
+	session_context->pending_messages.capacity = INIT_LIST_SIZE;
+	session_context->pending_messages.head = 0;
+	session_context->pending_messages.count = 0;
+	session_context->pending_messages.messages =
+		MemoryContextAlloc(session_context->memory_context,
+						   sizeof(POOL_PENDING_MESSAGE *) * INIT_LIST_SIZE);
 }
 
 /*
@@ -1116,19 +1275,24 @@ pool_pending_messages_init(void)
 void
 pool_pending_messages_destroy(void)
 {
-	ListCell   *cell;
+	POOL_PENDING_MESSAGE_QUEUE *queue;
 	POOL_PENDING_MESSAGE *msg;
+	int			i;
 
 	if (!session_context)
 		ereport(ERROR,
 				(errmsg("pool_pending_message_destroy: session context is not initialized")));
 
-	foreach(cell, session_context->pending_messages)
+	queue = &session_context->pending_messages;
+
+	for (i = 0; i < queue->count; i++)
 	{
-		msg = (POOL_PENDING_MESSAGE *) lfirst(cell);
+		msg = PENDING_MESSAGE_NTH(queue, i);
 		pfree(msg->contents);
 	}
-	list_free(session_context->pending_messages);
+	pfree(queue->messages);
+	queue->messages = NULL;
+	queue->capacity = queue->head = queue->count = 0;
 }
 
 /*
@@ -1145,7 +1309,8 @@ pool_pending_message_create(char kind, int len, char *contents)
 				(errmsg("pool_pending_message_create: session context is not initialized")));
 
 	old_context = MemoryContextSwitchTo(session_context->memory_context);
-	msg = palloc(sizeof(POOL_PENDING_MESSAGE));
+	msg = MemoryContextAlloc(session_context->pending_message_context,
+							 sizeof(POOL_PENDING_MESSAGE));
 
 	switch (kind)
 	{
@@ -1191,6 +1356,7 @@ pool_pending_message_create(char kind, int len, char *contents)
 	msg->query[0] = '\0';
 	msg->statement[0] = '\0';
 	msg->portal[0] = '\0';
+	msg->server_statement[0] = '\0';
 	msg->is_rows_returned = false;
 	msg->not_forward_to_frontend = false;
 	memset(msg->node_ids, false, sizeof(msg->node_ids));
@@ -1260,7 +1426,7 @@ pool_pending_message_query_set(POOL_PENDING_MESSAGE * message, POOL_QUERY_CONTEX
 void
 pool_pending_message_add(POOL_PENDING_MESSAGE * message)
 {
-	MemoryContext old_context;
+	POOL_PENDING_MESSAGE_QUEUE *queue;
 
 	if (!session_context)
 		ereport(ERROR,
@@ -1310,9 +1476,27 @@ pool_pending_message_add(POOL_PENDING_MESSAGE * message)
 		ereport(Elevel,
 				(errmsg("pool_pending_message_add: message type: sync")));
 
-	old_context = MemoryContextSwitchTo(session_context->memory_context);
-	session_context->pending_messages = lappend(session_context->pending_messages, message);
-	MemoryContextSwitchTo(old_context);
+	queue = &session_context->pending_messages;
+
+	if (queue->count == queue->capacity)
+	{
+		POOL_PENDING_MESSAGE **messages;
+		int			i;
+
+		/* Enlarge the ring, moving the messages to the start of it */
+		messages = MemoryContextAlloc(session_context->memory_context,
+									  sizeof(POOL_PENDING_MESSAGE *) * queue->capacity * 2);
+		for (i = 0; i < queue->count; i++)
+			messages[i] = PENDING_MESSAGE_NTH(queue, i);
+
+		pfree(queue->messages);
+		queue->messages = messages;
+		queue->capacity *= 2;
+		queue->head = 0;
+	}
+
+	PENDING_MESSAGE_NTH(queue, queue->count) = message;
+	queue->count++;
 }
 
 /*
@@ -1322,7 +1506,6 @@ pool_pending_message_add(POOL_PENDING_MESSAGE * message)
 POOL_PENDING_MESSAGE *
 pool_pending_message_head_message(void)
 {
-	ListCell   *cell;
 	POOL_PENDING_MESSAGE *message;
 	POOL_PENDING_MESSAGE *m;
 	MemoryContext old_context;
@@ -1331,15 +1514,14 @@ pool_pending_message_head_message(void)
 		ereport(ERROR,
 				(errmsg("pool_pending_message_head_message: session context is not initialized")));
 
-	if (list_length(session_context->pending_messages) == 0)
+	if (session_context->pending_messages.count == 0)
 	{
 		return NULL;
 	}
 
 	old_context = MemoryContextSwitchTo(session_context->memory_context);
 
-	cell = list_head(session_context->pending_messages);
-	m = (POOL_PENDING_MESSAGE *) lfirst(cell);
+	m = PENDING_MESSAGE_NTH(&session_context->pending_messages, 0);
 	message = copy_pending_message(m);
 	ereport(Elevel,
 			(errmsg("pool_pending_message_head_message: message type:%s message len:%d query:%s statement:%s portal:%s node_ids[0]:%d node_ids[1]:%d",
@@ -1360,7 +1542,7 @@ pool_pending_message_head_message(void)
 POOL_PENDING_MESSAGE *
 pool_pending_message_pull_out(void)
 {
-	ListCell   *cell;
+	POOL_PENDING_MESSAGE_QUEUE *queue;
 	POOL_PENDING_MESSAGE *message;
 	POOL_PENDING_MESSAGE *m;
 	MemoryContext old_context;
@@ -1369,15 +1551,14 @@ pool_pending_message_pull_out(void)
 		ereport(ERROR,
 				(errmsg("pool_pending_message_pull_out: session context is not initialized")));
 
-	if (list_length(session_context->pending_messages) == 0)
+	if (session_context->pending_messages.count == 0)
 	{
 		return NULL;
 	}
 
 	old_context = MemoryContextSwitchTo(session_context->memory_context);
 
-	cell = list_head(session_context->pending_messages);
-	m = (POOL_PENDING_MESSAGE *) lfirst(cell);
+	m = PENDING_MESSAGE_NTH(&session_context->pending_messages, 0);
 	message = copy_pending_message(m);
 	ereport(Elevel,
 			(errmsg("pool_pending_message_pull_out: message type:%s message len:%d query:%s statement:%s portal:%s node_ids[0]:%d node_ids[1]:%d",
@@ -1386,8 +1567,9 @@ pool_pending_message_pull_out(void)
 					message->node_ids[0], message->node_ids[1])));
 
 	pool_pending_message_free_pending_message(m);
-	session_context->pending_messages =
-		list_delete_cell(session_context->pending_messages, cell);
+	queue = &session_context->pending_messages;
+	queue->head = (queue->head + 1) & (queue->capacity - 1);
+	queue->count--;
 
 	MemoryContextSwitchTo(old_context);
 	return message;
@@ -1400,10 +1582,9 @@ pool_pending_message_pull_out(void)
 POOL_PENDING_MESSAGE *
 pool_pending_message_get(POOL_MESSAGE_TYPE type)
 {
-	ListCell   *cell;
-	ListCell   *next;
 	POOL_PENDING_MESSAGE *msg;
 	MemoryContext old_context;
+	int			i;
 
 	if (!session_context)
 		ereport(ERROR,
@@ -1413,11 +1594,9 @@ pool_pending_message_get(POOL_MESSAGE_TYPE type)
 
 	msg = NULL;
 
-	for (cell = list_head(session_context->pending_messages); cell; cell = next)
+	for (i = 0; i < session_context->pending_messages.count; i++)
 	{
-		POOL_PENDING_MESSAGE *m = (POOL_PENDING_MESSAGE *) lfirst(cell);
-
-		next = lnext(session_context->pending_messages, cell);
+		POOL_PENDING_MESSAGE *m = PENDING_MESSAGE_NTH(&session_context->pending_messages, i);
 
 		if (m->type == type)
 		{
@@ -1538,7 +1717,7 @@ pool_pending_message_get_previous_message(void)
 bool
 pool_pending_message_exists(void)
 {
-	return list_length(session_context->pending_messages) > 0;
+	return session_context->pending_messages.count > 0;
 }
 
 /*
@@ -1604,10 +1783,9 @@ pool_check_pending_message_and_reply(POOL_MESSAGE_TYPE type, char kind)
 POOL_PENDING_MESSAGE *
 pool_pending_message_find_lastest_by_query_context(POOL_QUERY_CONTEXT * qc)
 {
-	List	   *msgs;
+	POOL_PENDING_MESSAGE_QUEUE *msgs;
 	POOL_PENDING_MESSAGE *msg;
 	int			len;
-	ListCell   *cell;
 
 	if (!session_context)
 	{
@@ -1615,12 +1793,9 @@ pool_pending_message_find_lastest_by_query_context(POOL_QUERY_CONTEXT * qc)
 				(errmsg("pool_pending_message_find_lastest_by_query_context: session context is not initialized")));
 	}
 
-	if (!session_context->pending_messages)
-		return NULL;
+	msgs = &session_context->pending_messages;
 
-	msgs = session_context->pending_messages;
-
-	len = list_length(msgs);
+	len = msgs->count;
 	if (len <= 0)
 		return NULL;
 
@@ -1630,21 +1805,17 @@ pool_pending_message_find_lastest_by_query_context(POOL_QUERY_CONTEXT * qc)
 
 	while (len--)
 	{
-		cell = list_nth_cell(msgs, len);
-		if (cell)
+		msg = PENDING_MESSAGE_NTH(msgs, len);
+		if (msg->query_context == qc)
 		{
-			msg = (POOL_PENDING_MESSAGE *) lfirst(cell);
-			if (msg->query_context == qc)
-			{
-				ereport(DEBUG5,
-						(errmsg("pool_pending_message_find_lastest_by_query_context: msg found. type: %s",
-								pool_pending_message_type_to_string(msg->type))));
-				return msg;
-			}
 			ereport(DEBUG5,
-					(errmsg("pool_pending_message_find_lastest_by_query_context: type: %s",
+					(errmsg("pool_pending_message_find_lastest_by_query_context: msg found. type: %s",
 							pool_pending_message_type_to_string(msg->type))));
+			return msg;
 		}
+		ereport(DEBUG5,
+				(errmsg("pool_pending_message_find_lastest_by_query_context: type: %s",
+						pool_pending_message_type_to_string(msg->type))));
 	}
 	return NULL;
 }
@@ -1681,10 +1852,8 @@ pool_pending_message_get_target_backend_id(POOL_PENDING_MESSAGE * msg)
 int
 pool_pending_message_get_message_num_by_backend_id(int backend_id)
 {
-	ListCell   *cell;
-	ListCell   *next;
-	int        cnt = 0;
-	int        i;
+	int			cnt = 0;
+	int			n;
 
 	if (!session_context)
 	{
@@ -1693,20 +1862,15 @@ pool_pending_message_get_message_num_by_backend_id(int backend_id)
 		return 0;
 	}
 
-	for (cell = list_head(session_context->pending_messages); cell; cell = next)
-	{
-		POOL_PENDING_MESSAGE *msg = (POOL_PENDING_MESSAGE *) lfirst(cell);
+	if (backend_id < 0 || backend_id >= MAX_NUM_BACKENDS)
+		return 0;
 
-		for (i = 0; i < MAX_NUM_BACKENDS; i++)
-		{
-			if (msg->node_ids[i] && i == backend_id)
-			{
-				cnt++;
-				break;
-			}
-		}
+	for (n = 0; n < session_context->pending_messages.count; n++)
+	{
+		POOL_PENDING_MESSAGE *msg = PENDING_MESSAGE_NTH(&session_context->pending_messages, n);
 
-		next = lnext(session_context->pending_messages, cell);
+		if (msg->node_ids[backend_id])
+			cnt++;
 	}
 	return cnt;
 }
@@ -1717,11 +1881,11 @@ pool_pending_message_get_message_num_by_backend_id(int backend_id)
 void
 pool_pending_message_set_flush_request(void)
 {
-	ListCell   *msg_item;
+	int			i;
 
-	foreach(msg_item, session_context->pending_messages)
+	for (i = 0; i < session_context->pending_messages.count; i++)
 	{
-		POOL_PENDING_MESSAGE *msg = (POOL_PENDING_MESSAGE *) lfirst(msg_item);
+		POOL_PENDING_MESSAGE *msg = PENDING_MESSAGE_NTH(&session_context->pending_messages, i);
 		msg->flush_pending = true;
 		ereport(DEBUG5,
 				(errmsg("pool_pending_message_set_flush_request: msg: %s",
@@ -1735,8 +1899,7 @@ pool_pending_message_set_flush_request(void)
 void
 dump_pending_message(void)
 {
-	ListCell   *cell;
-	ListCell   *next;
+	int			i;
 
 	if (!session_context)
 	{
@@ -1751,16 +1914,14 @@ dump_pending_message(void)
 	ereport(DEBUG5,
 			(errmsg("start dumping pending message list")));
 
-	for (cell = list_head(session_context->pending_messages); cell; cell = next)
+	for (i = 0; i < session_context->pending_messages.count; i++)
 	{
-		POOL_PENDING_MESSAGE *message = (POOL_PENDING_MESSAGE *) lfirst(cell);
+		POOL_PENDING_MESSAGE *message = PENDING_MESSAGE_NTH(&session_context->pending_messages, i);
 
 		ereport(DEBUG5,
 				(errmsg("pool_pending_message_dump: message type:%d message len:%d query:%s statement:%s portal:%s node_ids[0]:%d node_ids[1]:%d",
 						message->type, message->contents_len, message->query, message->statement, message->portal,
 						message->node_ids[0], message->node_ids[1])));
-
-		next = lnext(session_context->pending_messages, cell);
 	}
 
 	ereport(DEBUG5,
@@ -1892,6 +2053,8 @@ pool_temp_tables_init(void)
 				(errmsg("pool_temp_tables_init: session context is not initialized")));
 
 	session_context->temp_tables = NIL;
+	session_context->temp_table_nbuckets = 0;
+	session_context->temp_table_buckets = NULL;
 }
 
 /*
@@ -1905,6 +2068,11 @@ pool_temp_tables_destroy(void)
 				(errmsg("pool_temp_tables_destroy: session context is not initialized")));
 
 	list_free(session_context->temp_tables);
+	session_context->temp_tables = NIL;
+	if (session_context->temp_table_buckets)
+		pfree(session_context->temp_table_buckets);
+	session_context->temp_table_nbuckets = 0;
+	session_context->temp_table_buckets = NULL;
 }
 
 /*
@@ -1935,6 +2103,7 @@ pool_temp_tables_add(char * tablename, POOL_TEMP_TABLE_STATE state)
 		StrNCpy(table->tablename, tablename, sizeof(table->tablename));
 		table->state = state;
 		session_context->temp_tables = lappend(session_context->temp_tables, table);
+		temp_table_hash_insert(table);
 	}
 
 	MemoryContextSwitchTo(old_context);
@@ -1947,16 +2116,21 @@ pool_temp_tables_add(char * tablename, POOL_TEMP_TABLE_STATE state)
 POOL_TEMP_TABLE *
 pool_temp_tables_find(char * tablename)
 {
-	ListCell   *cell;
+	POOL_TEMP_TABLE *table;
+	uint32		hashval;
 
 	if (!session_context)
 		ereport(ERROR,
 				(errmsg("pool_temp_tables_find: session context is not initialized")));
 
-	foreach(cell, session_context->temp_tables)
+	/* Most sessions never create temp tables */
+	if (session_context->temp_tables == NIL)
+		return NULL;
+
+	hashval = temp_table_hash(tablename);
+	for (table = TEMP_TABLE_BUCKET(hashval); table; table = table->hash_next)
 	{
-		POOL_TEMP_TABLE * table = (POOL_TEMP_TABLE *)lfirst(cell);
-		if (strcmp(tablename, table->tablename) == 0)
+		if (table->hashval == hashval && strcmp(tablename, table->tablename) == 0)
 			return table;
 	}
 	return NULL;
@@ -1992,6 +2166,7 @@ pool_temp_tables_delete(char * tablename, POOL_TEMP_TABLE_STATE state)
 					(errmsg("pool_temp_tables_delete: remove %s. previous state: %d requested state: %d",
 							table->tablename, table->state, state)));
 
+			temp_table_hash_delete(table);
 			session_context->temp_tables = list_delete_ptr(session_context->temp_tables, table);
 		}
 		else
@@ -2040,6 +2215,7 @@ Retry:
 		{
 			ereport(DEBUG1,
 					(errmsg("pool_temp_tables_commit_pending: remove: %s", table->tablename)));
+			temp_table_hash_delete(table);
 			session_context->temp_tables = list_delete_cell(session_context->temp_tables, cell);
 			pool_temp_tables_dump();
 			goto Retry;
@@ -2077,6 +2253,7 @@ Retry:
 			ereport(DEBUG1,
 					(errmsg("pool_temp_tables_remove_pending: remove: %s", table->tablename)));
 
+			temp_table_hash_delete(table);
 			session_context->temp_tables = list_delete_cell(session_context->temp_tables, cell);
 			pool_temp_tables_dump();
 			goto Retry;
@@ -2086,6 +2263,89 @@ Retry:
 	MemoryContextSwitchTo(old_context);
 }
 
+/*
+ * Compute hash value of a temp table name.
+ */
+static uint32
+temp_table_hash(const char *tablename)
+{
+	uint64		h;
+
+	h = pool_xxh64(tablename, strlen(tablename), 0);
+	return (uint32) (h ^ (h >> 32));
+}
+
+/*
+ * Link a temp table into its hash chain.  The hash table is allocated on
+ * the first call, and doubled when it gets more tables than buckets.  The
+ * caller has already appended the table to the list.
+ */
+static void
+temp_table_hash_insert(POOL_TEMP_TABLE * table)
+{
+	POOL_TEMP_TABLE **bucket;
+
+	if (session_context->temp_table_buckets == NULL)
+	{
+		session_context->temp_table_nbuckets = INIT_LIST_SIZE;
+		session_context->temp_table_buckets =
+			MemoryContextAllocZero(session_context->memory_context,
+								   sizeof(POOL_TEMP_TABLE *) * INIT_LIST_SIZE);
+	}
+	else if (list_length(session_context->temp_tables) > session_context->temp_table_nbuckets)
+	{
+		POOL_TEMP_TABLE **old_buckets = session_context->temp_table_buckets;
+		int			old_nbuckets = session_context->temp_table_nbuckets;
+		int			i;
+
+		session_context->temp_table_nbuckets *= 2;
+		session_context->temp_table_buckets =
+			MemoryContextAllocZero(session_context->memory_context,
+								   sizeof(POOL_TEMP_TABLE *) * session_context->temp_table_nbuckets);
+
+		/* Table names are unique, so the order in a chain does not matter */
+		for (i = 0; i < old_nbuckets; i++)
+		{
+			POOL_TEMP_TABLE *t = old_buckets[i];
+
+			while (t)
+			{
+				POOL_TEMP_TABLE *next = t->hash_next;
+
+				bucket = &TEMP_TABLE_BUCKET(t->hashval);
+				t->hash_next = *bucket;
+				*bucket = t;
+				t = next;
+			}
+		}
+		pfree(old_buckets);
+	}
+
+	table->hashval = temp_table_hash(table->tablename);
+	bucket = &TEMP_TABLE_BUCKET(table->hashval);
+	table->hash_next = *bucket;
+	*bucket = table;
+}
+
+/*
+ * Unlink a temp table from its hash chain.  Must be called before the table
+ * is removed from the list.
+ */
+static void
+temp_table_hash_delete(POOL_TEMP_TABLE * table)
+{
+	POOL_TEMP_TABLE **p;
+
+	for (p = &TEMP_TABLE_BUCKET(table->hashval); *p; p = &(*p)->hash_next)
+	{
+		if (*p == table)
+		{
+			*p = table->hash_next;
+			return;
+		}
+	}
+}
+
 void
 pool_temp_tables_dump(void)
 {
@@ -2148,3 +2408,31 @@ unset_tx_started_by_multi_statement_query(void)
 
 	session_context->is_tx_started_by_multi_statement = false;
 }
+
+/*
+ * Remember that the client may have changed the state of the backend
+ * sessions.
+ */
+void
+pool_set_session_state_changed(void)
+{
+	if (!session_context)
+		ereport(ERROR,
+				(errmsg("pool_set_session_state_changed: session context is not initialized")));
+
+	session_context->session_state_changed = true;
+}
+
+/*
+ * Return true if the client may have changed the state of the backend
+ * sessions.  If there's no session context, we cannot tell, so assume
+ * it did.
+ */
+bool
+pool_is_session_state_changed(void)
+{
+	if (!session_context)
+		return true;
+
+	return session_context->session_state_changed;
+}
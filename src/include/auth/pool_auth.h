@@ -23,6 +23,7 @@
 #define pool_auth_h
 
 extern void connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password);
+extern void prewarm_connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password);
 extern int	pool_do_auth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern int	pool_do_reauth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp);
 extern void authenticate_frontend(POOL_CONNECTION * frontend);
@@ -105,6 +105,7 @@ struct HbaLine
 };
 
 extern bool load_hba(char *hbapath);
+extern bool load_hba_text(char *hbapath, const char *text, size_t len);
 extern void ClientAuthentication(POOL_CONNECTION * frontend);
 
 #endif							/* POOL_HBA_H */
@@ -0,0 +1,44 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ *
+ * pool_scram_cache.h: SCRAM keys and verifiers shared among child
+ * processes.
+ *
+ */
+
+#ifndef POOL_SCRAM_CACHE_H
+#define POOL_SCRAM_CACHE_H
+
+#include "pool.h"
+#include "utils/sha2.h"
+
+/* kinds of cached data */
+#define SCRAM_CACHE_SALTED_PASSWORD	'K'
+#define SCRAM_CACHE_VERIFIER		'V'
+
+/* largest data an entry can hold */
+#define SCRAM_CACHE_DATA_LEN		256
+
+extern size_t pool_scram_cache_shmem_size(void);
+extern void pool_init_scram_cache(void);
+extern bool pool_scram_cache_get(char kind, const uint8 *digest, void *data, int size);
+extern void pool_scram_cache_put(char kind, const uint8 *digest, const void *data, int len);
+
+#endif							/* POOL_SCRAM_CACHE_H */
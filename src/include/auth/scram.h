@@ -53,6 +53,8 @@ extern int pg_be_scram_exchange(void *opaq, char *input, int inputlen,
 
 /* Routines to handle and check SCRAM-SHA-256 verifier */
 extern char *pg_be_scram_build_verifier(const char *password);
+extern char *pg_be_scram_build_cached_verifier(const char *username,
+								  const char *password);
 extern bool scram_verify_plain_password(const char *username,
 							const char *password, const char *verifier);
 extern void *pg_fe_scram_init(const char *username, const char *password);
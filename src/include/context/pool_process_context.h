@@ -64,6 +64,9 @@ extern POOL_PROCESS_CONTEXT * pool_get_process_context(void);
 extern ProcessInfo * pool_get_my_process_info(void);
 extern void pool_increment_local_session_id(void);
 extern size_t	pool_coninfo_size(void);
+extern void pool_coninfo_init(void *area);
+extern void pool_coninfo_register_cancel_key(ConnectionInfo * info);
+extern ConnectionInfo * pool_coninfo_cancel_key(int pid, int key);
 extern int	pool_coninfo_num(void);
 extern ConnectionInfo * pool_coninfo(int child, int connection_pool, int backend);
 extern ConnectionInfo * pool_coninfo_pid(int pid, int connection_pool, int backend);
@@ -64,11 +64,22 @@ typedef struct
 													 * query */
 	int         load_balance_node_id;	/* load balance node id per statement */
 	int			virtual_main_node_id; /* the 1st DB node to send query */
+	bool		is_heavy_query;	/* true if sent to heavy_query_nodes */
+	const char *shard_error;	/* why the statement could not be routed to
+								 * a shard, or NULL */
+	bool		is_shard_broadcast; /* true if sent to all shards, whose
+									 * results differ by design */
 	POOL_QUERY_STATE query_state[MAX_NUM_BACKENDS]; /* for extended query
 													 * protocol */
 	bool		is_cache_safe;	/* true if SELECT is safe to cache */
+	int			likely_select;	/* pool_is_likely_select() result for
+								 * original_query. 0: not checked yet, 1:
+								 * true, -1: false */
 	POOL_TEMP_QUERY_CACHE *temp_cache;	/* temporary cache */
 	bool		is_multi_statement; /* true if multi statement query */
+	bool		is_read_only_multi_statement;	/* true if all statements of
+												 * the multi statement query
+												 * can be load balanced */
 	int			dboid;			/* DB oid which is used at DROP DATABASE */
 	char	   *query_w_hex;	/* original_query with bind message hex which
 								 * used for committing cache of extended query */
@@ -90,10 +101,15 @@ typedef struct
 									 * extended query, do not commit cache if
 									 * this flag is true. */
 
+	int			statement_stats_slot;	/* slot of the statement in the
+										 * statement statistics, -1 if not
+										 * counted */
+
 	MemoryContext memory_context;	/* memory context for query context */
 }			POOL_QUERY_CONTEXT;
 
 extern POOL_QUERY_CONTEXT * pool_init_query_context(void);
+extern POOL_QUERY_CONTEXT * pool_init_simple_query_context(void);
 extern void pool_query_context_destroy(POOL_QUERY_CONTEXT * query_context);
 extern POOL_QUERY_CONTEXT * pool_query_context_shallow_copy(POOL_QUERY_CONTEXT * query_context);
 extern void pool_start_query(POOL_QUERY_CONTEXT * query_context, char *query, int len, Node *node);
@@ -105,6 +121,7 @@ extern void pool_clear_node_to_be_sent(POOL_QUERY_CONTEXT * query_context);
 extern void pool_setall_node_to_be_sent(POOL_QUERY_CONTEXT * query_context);
 extern bool pool_multi_node_to_be_sent(POOL_QUERY_CONTEXT * query_context);
 extern void pool_where_to_send(POOL_QUERY_CONTEXT * query_context, char *query, Node *node);
+extern bool pool_multi_statement_is_read_only(List *parse_tree_list, char *query);
 extern POOL_STATUS pool_send_and_wait(POOL_QUERY_CONTEXT * query_context, int send_type, int node_id);
 extern POOL_STATUS pool_extended_send_and_wait(POOL_QUERY_CONTEXT * query_context, char *kind, int len, char *contents, int send_type, int node_id, bool nowait);
 extern Node *pool_get_parse_tree(void);
@@ -119,6 +136,7 @@ extern bool is_2pc_transaction_query(Node *node);
 extern void pool_set_query_state(POOL_QUERY_CONTEXT * query_context, POOL_QUERY_STATE state);
 extern int	statecmp(POOL_QUERY_STATE s1, POOL_QUERY_STATE s2);
 extern bool pool_is_cache_safe(void);
+extern bool pool_query_context_is_likely_select(POOL_QUERY_CONTEXT * query_context);
 extern void pool_set_cache_safe(void);
 extern void pool_unset_cache_safe(void);
 extern bool pool_is_cache_exceeded(void);
@@ -128,5 +146,6 @@ extern bool pool_is_transaction_read_only(Node *node);
 extern void pool_force_query_node_to_backend(POOL_QUERY_CONTEXT * query_context, int backend_id);
 extern void check_object_relationship_list(char *name, bool is_func_name);
 extern int wait_for_failover_to_finish(void);
+extern void pool_finish_hedged_read(POOL_CONNECTION_POOL * backend);
 
 #endif							/* POOL_QUERY_CONTEXT_H */
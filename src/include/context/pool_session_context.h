@@ -68,7 +68,7 @@ typedef enum
 /*
  * Message content of extended query
  */
-typedef struct
+typedef struct POOL_SENT_MESSAGE
 {
 	/*
 	 * One of 'P':Parse, 'B':Bind or 'Q':Query (PREPARE).  If kind = 'B', it
@@ -81,6 +81,11 @@ typedef struct
 	POOL_SENT_MESSAGE_STATE state;	/* message state */
 	int			num_tsparams;
 	char	   *name;			/* object name of prepared statement or portal */
+	char		server_statement[MAX_IDENTIFIER_LEN];	/* name of the statement
+														 * on backends if it is
+														 * a pooled prepared
+														 * statement, otherwise
+														 * empty */
 	POOL_QUERY_CONTEXT *query_context;
 
 	/*
@@ -90,17 +95,32 @@ typedef struct
 	int			param_offset;	/* Offset from contents where actual bind
 								 * parameters are stored. This is meaningful
 								 * only when is_cache_safe is true. */
+
+	/*
+	 * Following members are maintained by POOL_SENT_MESSAGE_LIST.
+	 */
+	int			index;			/* position in sent_messages */
+	uint32		hashval;		/* hash value of kind and name */
+	struct POOL_SENT_MESSAGE *hash_next;	/* next message in the same hash
+											 * bucket */
 }			POOL_SENT_MESSAGE;
 
 /*
  * List of POOL_SENT_MESSAGE (XXX this should have been implemented using a
  * list, rather than an array)
+ *
+ * Messages are also linked into a hash table keyed by kind and name so that
+ * looking up a prepared statement or portal does not need to scan the whole
+ * array.  Messages having the same kind and name are kept in each hash
+ * chain in the order they were added.
  */
 typedef struct
 {
 	int			capacity;		/* capacity of list */
 	int			size;			/* number of elements */
 	POOL_SENT_MESSAGE **sent_messages;
+	int			nbuckets;		/* number of hash buckets, power of 2 */
+	POOL_SENT_MESSAGE **buckets;	/* hash buckets */
 }			POOL_SENT_MESSAGE_LIST;
 
 /*
@@ -135,6 +155,9 @@ typedef struct
 	char		statement[MAX_IDENTIFIER_LEN];	/* prepared statement name if
 												 * any */
 	char		portal[MAX_IDENTIFIER_LEN]; /* portal name if any */
+	char		server_statement[MAX_IDENTIFIER_LEN];	/* pooled prepared
+														 * statement created by
+														 * this Parse if any */
 	bool		is_rows_returned;	/* true if the message could produce row
 									 * data */
 	bool		not_forward_to_frontend;	/* Do not forward response from
@@ -152,6 +175,18 @@ typedef struct
 													 multi statement query */
 }			POOL_PENDING_MESSAGE;
 
+/*
+ * Queue of POOL_PENDING_MESSAGE.  This is a ring buffer so that adding a
+ * message to the tail and removing one from the head are O(1).
+ */
+typedef struct
+{
+	POOL_PENDING_MESSAGE **messages;
+	int			capacity;		/* allocated slots, power of 2 */
+	int			head;			/* slot of the oldest message */
+	int			count;			/* number of queued messages */
+}			POOL_PENDING_MESSAGE_QUEUE;
+
 typedef enum {
 	TEMP_TABLE_CREATING = 1,		/* temp table creating, not committed yet. */
 	TEMP_TABLE_DROPPING,			/* temp table dropping, not committed yet. */
@@ -159,11 +194,19 @@ typedef enum {
 	TEMP_TABLE_DROP_COMMITTED,		/* temp table dropped and committed. */
 }		POOL_TEMP_TABLE_STATE;
 
-typedef struct {
+typedef struct POOL_TEMP_TABLE {
 	char		tablename[MAX_IDENTIFIER_LEN];	/* temporary table name */
 	POOL_TEMP_TABLE_STATE	state;	/* see above */
+	uint32		hashval;		/* hash value of tablename */
+	struct POOL_TEMP_TABLE *hash_next;	/* next table in the same hash
+										 * bucket */
 }			POOL_TEMP_TABLE;
 
+typedef struct {
+	char		tablename[MAX_IDENTIFIER_LEN];	/* written table name */
+	uint64		written_at;	/* time of the write in milliseconds */
+}			POOL_WRITTEN_TABLE;
+
 
 typedef enum
 {
@@ -205,6 +248,22 @@ typedef struct
 	/* If true, write query has been appeared in this transaction */
 	bool		writing_transaction;
 
+	/*
+	 * For causal_reads.  causal_lsn_needed is set when a write succeeds and
+	 * cleared once causal_lsn has been updated to the primary's WAL insert
+	 * location after it.  Standbys which have not replayed causal_lsn are
+	 * not used for load balancing.
+	 */
+	bool		causal_lsn_needed;
+	uint64		causal_lsn;
+
+	/*
+	 * True if DDL has been executed in the current transaction.  The shared
+	 * relcache is invalidated again at the end of the transaction, since
+	 * other sessions see the change only after commit.
+	 */
+	bool		shared_relcache_invalidation_pending;
+
 	/* If true, error occurred in this transaction */
 	bool		failed_transaction;
 
@@ -230,6 +289,8 @@ typedef struct
 	POOL_PREPARED_SEND_MAP prep_where;
 #endif							/* NOT_USED */
 	MemoryContext memory_context;	/* memory context for session */
+	MemoryContext sent_message_context; /* slab of POOL_SENT_MESSAGE */
+	MemoryContext pending_message_context;	/* slab of POOL_PENDING_MESSAGE */
 
 	/* message which doesn't receive complete message */
 	POOL_SENT_MESSAGE *uncompleted_message;
@@ -238,6 +299,12 @@ typedef struct
 
 	int			load_balance_node_id;	/* selected load balance node id */
 
+	/*
+	 * Node whose answer to a hedged read lost and has yet to be discarded,
+	 * or -1.
+	 */
+	int			hedged_read_node;
+
 	/*
 	 * If true, UPDATE/DELETE caused difference in number of affected tuples
 	 * in backends.
@@ -265,7 +332,7 @@ typedef struct
 	/*
 	 * Parse/Bind/Describe/Execute/Close message queue.
 	 */
-	List	   *pending_messages;
+	POOL_PENDING_MESSAGE_QUEUE pending_messages;
 
 	/*
 	 * The last pending message. Reset at Ready for query.  Note that this is
@@ -289,9 +356,13 @@ typedef struct
 	bool		suspend_reading_from_frontend;
 
 	/*
-	 * Temp tables list
+	 * Temp tables list.  The tables are also linked into a hash table keyed
+	 * by name, which is allocated when the first table is added, so that
+	 * pool_temp_tables_find() does not scan the list.
 	 */
 	List	   *temp_tables;
+	int			temp_table_nbuckets;	/* number of hash buckets, power of 2 */
+	POOL_TEMP_TABLE **temp_table_buckets;	/* hash buckets */
 
 	bool		is_in_transaction;
 
@@ -300,6 +371,12 @@ typedef struct
 	 */
 	List	   *transaction_temp_write_list;
 
+	/*
+	 * Tables written in this session within the last
+	 * dml_adaptive_write_window milliseconds.  List of POOL_WRITTEN_TABLE.
+	 */
+	List	   *session_write_list;
+
 #ifdef NOT_USED
 	/* Preferred "main" node id. Only used for SimpleForwardToFrontend. */
 	int			preferred_main_node_id;
@@ -320,6 +397,13 @@ typedef struct
 													 * transaction has been
 													 * started by a
 													 * multi-statement-query */
+
+	/*
+	 * True if the client may have changed the state of the backend
+	 * sessions (SET, PREPARE, LISTEN, temporary tables etc.), so that
+	 * reset_query_list must be run before the connections are reused.
+	 */
+	bool		session_state_changed;
 }			POOL_SESSION_CONTEXT;
 
 extern void pool_init_session_context(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
@@ -408,6 +492,9 @@ extern bool is_tx_started_by_multi_statement_query(void);
 extern void set_tx_started_by_multi_statement_query(void);
 extern void unset_tx_started_by_multi_statement_query(void);
 
+extern void pool_set_session_state_changed(void);
+extern bool pool_is_session_state_changed(void);
+
 #ifdef NOT_USED
 extern void pool_set_preferred_main_node_id(int node_id);
 extern int	pool_get_preferred_main_node_id(void);
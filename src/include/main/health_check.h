@@ -22,6 +22,11 @@
 #ifndef health_check_h
 #define health_check_h
 
+#include "utils/pool_atomic.h"
+
+/* number of recent health checks kept per node */
+#define HEALTH_CHECK_HISTORY_SIZE	64
+
 /*
  * Health check statistics per node
 */
@@ -39,12 +44,43 @@ typedef struct {
 	time_t	last_successful_health_check;	/* last successful health check timestamp */
 	time_t	last_skip_health_check;			/* last skipped health check timestamp */
 	time_t	last_failed_health_check;		/* last failed health check timestamp */
+	time_t	last_sample;		/* timestamp of the last role and WAL location
+								 * sample taken with sr_check_by_health_check,
+								 * 0 if none.  The WAL location is stored in
+								 * BackendInfo. */
+	bool	sample_in_recovery;	/* pg_is_in_recovery() of the last sample */
+	/*
+	 * Ring of the most recent health checks, not counting skipped ones.
+	 * Only the health check process of the node writes it.
+	 */
+	int32	history_duration[HEALTH_CHECK_HISTORY_SIZE];	/* milli seconds */
+	bool	history_failed[HEALTH_CHECK_HISTORY_SIZE];
+	uint32	history_count;	/* number of health checks ever recorded */
 } POOL_HEALTH_CHECK_STATISTICS;
 
 extern volatile POOL_HEALTH_CHECK_STATISTICS	*health_check_stats;	/* health check stats area in shared memory */
 
+/*
+ * Backend errors observed by child processes while serving clients, per
+ * node.  The main process watches the rate of these and asks the health
+ * check process to check the node at once if it spikes.
+ */
+typedef struct {
+	pool_atomic_uint32	error_count;	/* read errors, EOF and shutdown errors */
+	pool_atomic_uint32	connect_error_count;	/* failed or timed out connects */
+	pool_atomic_uint32	check_requested;	/* set by main, cleared by health check */
+} POOL_BACKEND_ERROR_COUNTERS;
+
+extern volatile POOL_BACKEND_ERROR_COUNTERS *backend_error_counters;
+
 extern void do_health_check_child(int *node_id);
+extern void do_health_check_multiplexed(void *arg);
 extern size_t	health_check_stats_shared_memory_size(void);
 extern void		health_check_stats_init(POOL_HEALTH_CHECK_STATISTICS *addr);
+extern size_t	backend_error_counters_shared_memory_size(void);
+extern void		backend_error_counters_init(POOL_BACKEND_ERROR_COUNTERS *addr);
+extern void		health_check_count_backend_error(int node, bool connect);
+extern void		health_check_request(int node);
+extern bool		health_check_requested(int node);
 
 #endif /* health_check_h */
@@ -469,3 +469,4 @@
 	T_SlabContext = 452,
 	T_TIDBitmap = 453,
 	T_WindowObjectData = 454,
+	T_BumpContext = 455,
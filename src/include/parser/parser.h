@@ -61,6 +61,7 @@ extern PGDLLIMPORT bool standard_conforming_strings;
 /* Primary entry point for the raw parsing functions */
 extern List *raw_parser(const char *str, RawParseMode mode, int len, bool *error, bool use_minimal);
 extern Node *raw_parser2(List *parse_tree_list);
+extern char *raw_normalize_query(const char *str, int len);
 
 /* from src/backend/commands/define.c */
 extern int32 defGetInt32(DefElem *def);
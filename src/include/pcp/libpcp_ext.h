@@ -110,6 +110,10 @@ typedef struct
 	char		pg_role[NAMEDATALEN];	/* backend role examined by show pool_nodes and pcp_node_info*/
 	char		replication_state [NAMEDATALEN];	/* "state" from pg_stat_replication */
 	char		replication_sync_state [NAMEDATALEN];	/* "sync_state" from pg_stat_replication */
+	uint64		wal_location;	/* WAL location replayed by the standby, or
+								 * the current WAL location of the primary,
+								 * as of the last streaming replication
+								 * check */
 }			BackendInfo;
 
 typedef struct
@@ -118,6 +122,9 @@ typedef struct
 								 * needs to be a sig_atomic_t type since it is
 								 * replaced by a local variable while
 								 * reloading pgpool.conf. */
+	int			shard_count;	/* number of backends the rows of sharded
+								 * tables are distributed to.  Fixed when
+								 * shard_key_list is first set, 0 before. */
 
 	BackendInfo backend_info[MAX_NUM_BACKENDS];
 }			BackendDesc;
@@ -131,24 +138,31 @@ typedef enum
 	CONNECTING
 }			ProcessStatus;
 
+/*
+ * What a child process is doing, or waiting for.  See utils/pool_stage.c.
+ */
+typedef enum
+{
+	POOL_STAGE_NONE = 0,
+	POOL_STAGE_CLIENT_READ,		/* waiting for the client */
+	POOL_STAGE_PARSE,			/* parsing a query */
+	POOL_STAGE_ROUTE,			/* deciding where to send a query */
+	POOL_STAGE_RELCACHE,		/* querying system catalogs for relcache */
+	POOL_STAGE_CACHE_LOCK,		/* acquiring the query cache lock */
+	POOL_STAGE_BACKEND_WAIT,	/* waiting for a backend */
+	POOL_STAGE_CLIENT_WRITE,	/* sending data to the client */
+	POOL_NUM_STAGES
+}			PoolStage;
+
 /*
  * Connection pool information. Placed on shared memory area.
+ *
+ * The fields updated while a session goes on come first and the names,
+ * which change only when a new connection is made, last, so that reading
+ * or writing the former touches as few cache lines as possible.
  */
 typedef struct
 {
-	int			backend_id;		/* backend id */
-	char		database[SM_DATABASE];	/* Database name */
-	char		user[SM_USER];	/* User name */
-	int			major;			/* protocol major version */
-	int			minor;			/* protocol minor version */
-	int			pid;			/* backend process id */
-	int			key;			/* cancel key */
-	int			counter;		/* used counter */
-	time_t		create_time;	/* connection creation time */
-	time_t		client_connection_time;	/* client connection time */
-	time_t		client_disconnection_time;	/* client last disconnection time */
-	int			client_idle_duration;	/* client idle duration time (s) */
-	int			load_balancing_node;	/* load balancing node */
 	char		connected;		/* True if frontend connected. Please note
 								 * that we use "char" instead of "bool". Since
 								 * 3.1, we need to export this structure so
@@ -157,18 +171,39 @@ typedef struct
 								 * and if we use bool, the size of the
 								 * structure might be out of control of
 								 * pgpool-II. So we use "char" here. */
-	volatile char swallow_termination;
 
 	/*
 	 * Flag to mark that if the connection will be terminated by the backend.
 	 * it should not be treated as a backend node failure. This flag is used
 	 * to handle pg_terminate_backend()
 	 */
+	volatile char swallow_termination;
+	int			load_balancing_node;	/* load balancing node */
+	int			counter;		/* used counter */
+	int			client_idle_duration;	/* client idle duration time (s) */
+	time_t		client_connection_time;	/* client connection time */
+	time_t		client_disconnection_time;	/* client last disconnection time */
+	int			pid;			/* backend process id */
+	int			key;			/* cancel key */
+	time_t		create_time;	/* connection creation time */
+	int			backend_id;		/* backend id */
+	int			major;			/* protocol major version */
+	int			minor;			/* protocol minor version */
+	char		database[SM_DATABASE];	/* Database name */
+	char		user[SM_USER];	/* User name */
 }			ConnectionInfo;
 
+/*
+ * Assumed size of a CPU cache line.  Must be the same as
+ * POOL_CACHE_LINE_SIZE.
+ */
+#define PROCESS_INFO_ALIGNMENT	64
+
 /*
  * process information
- * This object put on shared memory.
+ * This object put on shared memory.  Each child updates its own entry
+ * frequently, so entries are aligned to cache lines not to share a cache
+ * line with the entries of other children.
  */
 typedef struct
 {
@@ -187,7 +222,32 @@ typedef struct
 	bool		exit_if_idle;
 	int		pooled_connections; /* Total number of pooled connections
 									  * by this child */
-}			ProcessInfo;
+	int			pool_evictions;	/* how many times a connection pool was
+								 * discarded to make room for another one */
+	int			buffer_memory;	/* bytes allocated for the buffers of
+								 * client and backend connections */
+	size_t		memory_allocated;	/* bytes allocated by all memory
+									 * contexts of this process */
+	size_t		session_memory;	/* bytes allocated by the session context */
+	size_t		query_memory;	/* bytes allocated by the query context */
+	size_t		peak_memory;	/* highest memory_allocated so far */
+	volatile int stage;			/* PoolStage the process is in */
+	uint64		stage_time[POOL_NUM_STAGES];	/* microseconds spent in each
+												 * stage */
+
+	/*
+	 * What this process is counted in by pool_client_limit.c, so that the
+	 * counts can be taken back if the process dies without doing it.
+	 */
+	int			limit_user_slot;	/* user slot of the client, or -1 */
+	int			limit_database_slot;	/* database slot of the client, or
+										 * -1 */
+	bool		limit_query_active; /* counted as running a query */
+	bool		limit_heavy_query_active;	/* counted in heavy queries */
+	bool		limit_node_query_active[MAX_NUM_BACKENDS];	/* counted in the
+															 * queries of the
+															 * node */
+}			__attribute__((aligned(PROCESS_INFO_ALIGNMENT))) ProcessInfo;
 
 /*
  * reporting types
@@ -205,6 +265,7 @@ typedef struct
 #define POOLCONFIG_MAXCOUNTLEN 16
 #define POOLCONFIG_MAXLONGCOUNTLEN 20
 #define POOLCONFIG_MAXPROCESSSTATUSLEN 20
+#define POOLCONFIG_MAXSTATEMENTLEN 1024
 /* config report struct*/
 typedef struct
 {
@@ -230,6 +291,7 @@ typedef struct
 	char		rep_state[POOLCONFIG_MAXWEIGHTLEN + 1];
 	char		rep_sync_state[POOLCONFIG_MAXWEIGHTLEN + 1];
 	char		last_status_change[POOLCONFIG_MAXDATELEN];
+	char		effective_weight[POOLCONFIG_MAXWEIGHTLEN + 1];
 }			POOL_REPORT_NODES;
 
 /* processes report struct */
@@ -243,8 +305,29 @@ typedef struct
 	char		backend_connection_time[POOLCONFIG_MAXDATELEN + 1];
 	char		pool_counter[POOLCONFIG_MAXCOUNTLEN + 1];
 	char		status[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
+	char		buffer_memory[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		wait_state[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
+	char		client_read_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		parse_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		route_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		relcache_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		cache_lock_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		backend_wait_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		client_write_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
 }			POOL_REPORT_PROCESSES;
 
+/* memory usage report struct */
+typedef struct
+{
+	char		pool_pid[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		status[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
+	char		allocated[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		session[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		query[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		buffers[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		peak[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+}			POOL_REPORT_MEMORY;
+
 /* pools reporting struct */
 typedef struct
 {
@@ -266,6 +349,15 @@ typedef struct
 	char		pool_connected[POOLCONFIG_MAXCOUNTLEN + 1];
 	char		status[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
 	char		load_balance_node[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
+	char		pool_evictions[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		wait_state[POOLCONFIG_MAXPROCESSSTATUSLEN + 1];
+	char		client_read_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		parse_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		route_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		relcache_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		cache_lock_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		backend_wait_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		client_write_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
 }			POOL_REPORT_POOLS;
 
 /* version struct */
@@ -297,6 +389,10 @@ typedef struct
 	char		last_successful_health_check[POOLCONFIG_MAXDATELEN];
 	char		last_skip_health_check[POOLCONFIG_MAXDATELEN];
 	char		last_failed_health_check[POOLCONFIG_MAXDATELEN];
+	char		p50_health_check_duration[POOLCONFIG_MAXCOUNTLEN+1];
+	char		p99_health_check_duration[POOLCONFIG_MAXCOUNTLEN+1];
+	char		health_check_duration_trend[POOLCONFIG_MAXCOUNTLEN+1];
+	char		recent_fail_count[POOLCONFIG_MAXCOUNTLEN+1];
 }			POOL_HEALTH_CHECK_STATS;
 
 /* show backend statistics report struct */
@@ -316,8 +412,90 @@ typedef struct
 	char		panic_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
 	char		fatal_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
 	char		error_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];	
+	char		latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		select_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		select_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		select_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		insert_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		insert_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		insert_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		update_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		update_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		update_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		delete_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		delete_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		delete_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		ddl_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		ddl_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		ddl_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		other_latency_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		other_latency_p95[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		other_latency_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
 }			POOL_BACKEND_STATS;
 
+/* show process management statistics report struct */
+typedef struct
+{
+	char		current_children[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		connected_children[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		idle_children[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		busy_ratio[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		listen_queue_length[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		listen_queue_peak[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		accept_rate[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		estimated_queue_wait[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		total_accepted[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		children_spawned[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		children_retired[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		last_scale_up[POOLCONFIG_MAXDATELEN];
+	char		last_scale_down[POOLCONFIG_MAXDATELEN];
+}			POOL_PROCESS_MANAGEMENT_STATS;
+
+/* show statement statistics report struct */
+typedef struct
+{
+	char		queryid[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		query[POOLCONFIG_MAXSTATEMENTLEN + 1];
+	char		calls[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		total_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		mean_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		max_time[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		rows[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		cache_hits[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		cache_misses[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		nodes[POOLCONFIG_MAXVALLEN + 1];
+}			POOL_STATEMENT_STATS;
+
+/* event sent to a client subscribed by pcp_subscribe */
+typedef struct
+{
+	char		event_type[POOLCONFIG_MAXNAMELEN + 1];	/* "node", "health_check",
+														 * "failover" or "children" */
+	char		node_id[POOLCONFIG_MAXIDLEN + 1];	/* empty if not about a node */
+	char		timestamp[POOLCONFIG_MAXDATELEN + 1];
+	char		detail[POOLCONFIG_MAXVALLEN + 1];
+}			POOL_EVENT_INFO;
+
+/* progress of online recovery reported by pcp_recovery_status */
+typedef struct
+{
+	char		node_id[POOLCONFIG_MAXIDLEN + 1];	/* empty if no recovery
+													 * has run */
+	char		stage[POOLCONFIG_MAXNAMELEN + 1];
+	char		start_time[POOLCONFIG_MAXDATELEN + 1];
+	char		stage_start_time[POOLCONFIG_MAXDATELEN + 1];
+	char		end_time[POOLCONFIG_MAXDATELEN + 1];	/* empty while running */
+	char		backup_streams[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		backup_streamed[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		backup_total[POOLCONFIG_MAXLONGCOUNTLEN + 1];
+	char		start_lsn[POOLCONFIG_MAXNAMELEN + 1];
+	char		current_lsn[POOLCONFIG_MAXNAMELEN + 1];
+	char		pause_time[POOLCONFIG_MAXCOUNTLEN + 1];	/* milliseconds */
+	char		message[POOLCONFIG_MAXVALLEN + 1];
+}			POOL_RECOVERY_STATUS;
+
 typedef enum
 {
 	PCP_CONNECTION_OK,
@@ -378,15 +556,23 @@ extern PCPResultInfo * pcp_terminate_pgpool(PCPConnInfo * pcpConn, char mode, ch
 extern PCPResultInfo * pcp_node_count(PCPConnInfo * pcpCon);
 extern PCPResultInfo * pcp_node_info(PCPConnInfo * pcpCon, int nid);
 extern PCPResultInfo * pcp_health_check_stats(PCPConnInfo * pcpCon, int nid);
+extern PCPResultInfo * pcp_backend_stats(PCPConnInfo * pcpCon, int nid);
 extern PCPResultInfo * pcp_process_count(PCPConnInfo * pcpConn);
 extern PCPResultInfo * pcp_process_info(PCPConnInfo * pcpConn, int pid);
 extern PCPResultInfo * pcp_reload_config(PCPConnInfo * pcpConn,char command_scope);
+extern PCPResultInfo * pcp_snapshot_query_cache(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_reset_statement_stats(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_subscribe(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_memory_info(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_next_event(PCPConnInfo * pcpConn);
 
 extern PCPResultInfo * pcp_detach_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_detach_node_gracefully(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_attach_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_pool_status(PCPConnInfo * pcpConn);
 extern PCPResultInfo * pcp_recovery_node(PCPConnInfo * pcpConn, int nid);
+extern PCPResultInfo * pcp_recovery_node_async(PCPConnInfo * pcpConn, int nid);
+extern PCPResultInfo * pcp_recovery_status(PCPConnInfo * pcpConn);
 extern PCPResultInfo * pcp_promote_node(PCPConnInfo * pcpConn, int nid, bool promote);
 extern PCPResultInfo * pcp_promote_node_gracefully(PCPConnInfo * pcpConn, int nid, bool promote);
 extern PCPResultInfo * pcp_watchdog_info(PCPConnInfo * pcpConn, int nid);
@@ -409,6 +595,8 @@ extern char *role_to_str(SERVER_ROLE role);
 
 extern	int * pool_health_check_stats_offsets(int *n);
 extern	int * pool_report_pools_offsets(int *n);
+extern	int * pool_backend_stats_offsets(int *n);
+extern	int * pool_report_memory_offsets(int *n);
 
 /* ------------------------------
  * pcp_error.c
@@ -22,7 +22,55 @@
 #ifndef recovery_h
 #define recovery_h
 
+#include <time.h>
+#include "pool_type.h"
+
+/*
+ * Stage of the online recovery, reported by pcp_recovery_status.
+ */
+typedef enum
+{
+	RECOVERY_STAGE_NONE = 0,	/* no recovery has run */
+	RECOVERY_STAGE_CONNECTING,
+	RECOVERY_STAGE_FIRST_STAGE,
+	RECOVERY_STAGE_CATCHUP,
+	RECOVERY_STAGE_WAITING_CLIENTS,
+	RECOVERY_STAGE_SECOND_STAGE,
+	RECOVERY_STAGE_REMOTE_START,
+	RECOVERY_STAGE_FAILBACK,
+	RECOVERY_STAGE_DONE,
+	RECOVERY_STAGE_FAILED
+}			RecoveryStage;
+
+/*
+ * Progress of the current or the last online recovery on shmem.  Only the
+ * PCP worker running the recovery writes it, so readers may see a torn
+ * update, which is harmless for a progress report.
+ */
+typedef struct
+{
+	int			node_id;		/* node being recovered */
+	RecoveryStage stage;
+	time_t		start_time;		/* when the recovery started */
+	time_t		stage_start_time;	/* when the current stage started */
+	time_t		end_time;		/* 0 while running */
+	int			backup_streams; /* # of base backups running on the main
+								 * node */
+	int64		backup_streamed;	/* bytes streamed by the base backups */
+	int64		backup_total;	/* estimated total bytes, 0 if unknown */
+	char		start_lsn[64];	/* WAL position when the stage command
+								 * started */
+	char		current_lsn[64];	/* latest WAL position of the main node */
+	int			pause_time;		/* milliseconds new clients were paused for
+								 * the 2nd stage */
+	char		message[256];	/* error of a failed recovery */
+}			RecoveryProgress;
+
+extern volatile RecoveryProgress *pcp_recovery_progress;
+
 extern void start_recovery(int recovery_node);
+extern void fail_recovery(void);
+extern const char *recovery_stage_to_str(RecoveryStage stage);
 extern void finish_recovery(void);
 extern int wait_connection_closed(void);
 extern int ensure_conn_counter_validity(void);
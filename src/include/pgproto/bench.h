@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/* defined in main.c */
+extern FILE *openfile(char *filename);
+extern PGconn *connect_db(char *host, char *port, char *user, char *database);
+extern void read_and_process(FILE *fd, PGconn *conn);
+
+extern void run_benchmark(char *data_file, char *host, char *port, char *user, char *database,
+						  int clients, int duration, int reconnect, int debug);
+#endif
@@ -21,5 +21,8 @@ extern void send_int(int intval, PGconn *conn);
 extern void send_int16(short shortval, PGconn *conn);
 extern void send_string(char *buf, PGconn *conn);
 extern void send_byte(char *buf, int len, PGconn *conn);
+extern void send_flush(PGconn *conn);
+
+extern int	send_buffering;
 
 #endif
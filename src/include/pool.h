@@ -29,6 +29,7 @@
 #include "pcp/libpcp_ext.h"
 #include "auth/pool_passwd.h"
 #include "utils/pool_params.h"
+#include "utils/pool_atomic.h"
 #include "parser/nodes.h"
 
 #ifdef USE_SSL
@@ -70,9 +71,6 @@
 /* status file name */
 #define STATUS_FILE_NAME "pgpool_status"
 
-/* query cache lock file name */
-#define QUERY_CACHE_LOCK_FILE "memq_lock_file"
-
 /* default string used to identify pgpool on syslog output */
 #define DEFAULT_SYSLOG_IDENT "pgpool"
 
@@ -248,6 +246,12 @@ typedef struct
 	PasswordMapping *passwordMapping;
 	ConnectionInfo *con_info;	/* shared memory coninfo used for handling the
 								 * query containing pg_terminate_backend */
+
+	/*
+	 * prepared statements created by pgpool on this backend connection (see
+	 * pool_prepared_statement.c)
+	 */
+	struct POOL_PS_REGISTRY *ps_registry;
 }			POOL_CONNECTION;
 
 /*
@@ -268,6 +272,11 @@ typedef struct
 {
 	ConnectionInfo *info;		/* connection info on shmem */
 	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+	bool		prewarmed;		/* opened by pool_prewarm_connections() and
+								 * not used by any client yet */
+	uint32		hashkey;		/* hash of user, database and protocol major
+								 * version to speed up pool_get_cp().  0 if
+								 * not computed yet. */
 }			POOL_CONNECTION_POOL;
 
 
@@ -368,15 +377,21 @@ typedef enum
 #define Min(x, y)		((x) < (y) ? (x) : (y))
 
 
-#define MAX_NUM_SEMAPHORES		8
+#define MAX_NUM_SEMAPHORES		14
 #define CONN_COUNTER_SEM		0
 #define REQUEST_INFO_SEM		1
 #define QUERY_CACHE_STATS_SEM	2
 #define PCP_REQUEST_SEM			3
 #define ACCEPT_FD_SEM			4
-#define SI_CRITICAL_REGION_SEM	5
-#define FOLLOW_PRIMARY_SEM		6
-#define MAIN_EXIT_HANDLER_SEM	7	/* used in exit_hander in pgpool main process */
+#define FOLLOW_PRIMARY_SEM		5
+#define MAIN_EXIT_HANDLER_SEM	6	/* used in exit_hander in pgpool main process */
+#define SHARED_RELCACHE_SEM		7
+#define STATEMENT_STATS_SEM		8
+#define WD_QCACHE_INVALIDATION_SEM	9
+#define DNS_CACHE_SEM			10
+#define NOTIFY_HUB_SEM			11
+#define SCRAM_CACHE_SEM			12
+#define LOBJ_OID_SEM			13
 #define MAX_REQUEST_QUEUE_SIZE	10
 
 #define MAX_SEC_WAIT_FOR_CLUSTER_TRANSACTION 10	/* time in seconds to keep
@@ -428,6 +443,32 @@ typedef struct
 	int			count;			/* request node ids count */
 }			POOL_REQUEST_NODE;
 
+/*
+ * Statistics used by dynamic process management.  Sampled by the main
+ * process in service_child_processes() and shown by SHOW
+ * POOL_PROCESS_MANAGEMENT_STATS.
+ */
+typedef struct
+{
+	uint64		total_accepted;	/* client connections accepted by children.
+								 * Protected by CONN_COUNTER_SEM. */
+	int			current_children;	/* number of child processes alive */
+	int			connected_children; /* children serving a client */
+	double		busy_ratio;		/* moving average of connected/current */
+	int			listen_queue_length;	/* connections waiting in the listen
+										 * backlog at the last sample */
+	int			listen_queue_peak;	/* decaying maximum of the above */
+	double		accept_rate;	/* moving average of accepted connections
+								 * per second */
+	double		estimated_queue_wait;	/* estimated time in milliseconds a
+										 * connection waits in the backlog */
+	uint64		children_spawned;	/* children forked by scaling up */
+	uint64		children_retired;	/* children asked to exit by scaling
+									 * down */
+	time_t		last_scale_up;
+	time_t		last_scale_down;
+}			POOL_PROCESS_MANAGEMENT_INFO;
+
 typedef struct
 {
 	POOL_REQUEST_NODE request[MAX_REQUEST_QUEUE_SIZE];
@@ -454,6 +495,8 @@ typedef struct
 	bool		follow_primary_lock_held_remotely; /* true when lock is held by
 													watchdog coordinator*/
 	bool		follow_primary_ongoing;	/* true if follow primary command is ongoing */
+	POOL_PROCESS_MANAGEMENT_INFO pm_info;	/* dynamic process management
+											 * statistics */
 }			POOL_REQUEST_INFO;
 
 /* description of row. corresponding to RowDescription message */
@@ -515,6 +558,11 @@ typedef enum
 	PT_PCP_WORKER,
 	PT_HEALTH_CHECK,
 	PT_LOGGER,
+	PT_MEMQCACHE_INVALIDATOR,
+	PT_RELCACHE_REFRESHER,
+	PT_METRICS,
+	PT_MEMQCACHE_DECODER,
+	PT_NOTIFY_HUB,
 	PT_LAST_PTYPE	/* last ptype marker. any ptype must be above this. */
 }			ProcessType;
 
@@ -535,8 +583,12 @@ typedef enum
  */
 typedef struct
 {
-	uint32		commit_counter;		/* number of committing children */
-	uint32		snapshot_counter;	/* number of snapshot acquiring children */
+	/*
+	 * Number of committing children in the upper 16 bits and number of
+	 * snapshot acquiring children in the lower 16 bits, updated together
+	 * by compare and exchange.
+	 */
+	pool_atomic_uint32 state;
 	pid_t		*snapshot_waiting_children;		/* array size is num_init_children */
 	pid_t		*commit_waiting_children;		/* array size is num_init_children */
 } SI_ManageInfo;
@@ -561,8 +613,6 @@ void SetProcessGlobalVariables(ProcessType pType);
 extern volatile SI_ManageInfo *si_manage_info;
 extern volatile sig_atomic_t sigusr2_received;
 
-extern volatile sig_atomic_t backend_timer_expired; /* flag for connection
-													 * closed timer is expired */
 extern volatile sig_atomic_t health_check_timer_expired;	/* non 0 if health check
 															 * timer expired */
 extern int	my_proc_id;			/* process table id (!= UNIX's PID) */
@@ -604,7 +654,9 @@ extern void do_child(int *fds);
 extern void child_exit(int code);
 
 extern void cancel_request(CancelPacket * sp);
+extern bool pool_send_cancel_request(int node_id, CancelPacket * cp);
 extern void check_stop_request(void);
+extern void check_config_reload(void);
 extern void pool_initialize_private_backend_status(void);
 extern int	send_to_pg_frontend(char *data, int len, bool flush);
 extern int	pg_frontend_exists(void);
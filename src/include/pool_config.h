@@ -54,9 +54,28 @@ typedef struct
 	char	   *pattern;
 	int			type;
 	int			flag;
+	int			ttl;			/* cache life time in seconds given by
+								 * "table:ttl" in
+								 * cache_safe_memqcache_table_list, 0 if
+								 * none */
 	regex_t		regexv;
 }			RegPattern;
 
+/*
+ * All patterns of one type (WRITELIST or READONLYLIST) of a pattern list
+ * folded together, so that a string can be classified with one binary
+ * search plus at most one regexec() regardless of the number of patterns.
+ * Built by compile_regex_pattern_sets() at configuration load time.
+ */
+typedef struct
+{
+	bool		compiled;		/* false if patterns must be tried one by one */
+	int			nliterals;		/* number of literal patterns */
+	char	  **literals;		/* sorted, lower cased literal patterns */
+	bool		has_regex;		/* true if regexv is valid */
+	regex_t		regexv;			/* alternation of all non literal patterns */
+}			RegPatternSet;
+
 typedef enum ProcessManagementModes
 {
 	PM_STATIC = 1,
@@ -67,7 +86,8 @@ typedef enum ProcessManagementSstrategies
 {
 	PM_STRATEGY_AGGRESSIVE = 1,
 	PM_STRATEGY_GENTLE,
-	PM_STRATEGY_LAZY
+	PM_STRATEGY_LAZY,
+	PM_STRATEGY_ADAPTIVE
 }			ProcessManagementSstrategies;
 
 typedef enum NativeReplicationSubModes
@@ -94,13 +114,58 @@ typedef enum LogStandbyDelayModes
 	LSD_NONE
 }			LogStandbyDelayModes;
 
+typedef enum InsertLockMethods
+{
+	ILM_ROW_LOCK = 1,
+	ILM_ADVISORY_LOCK
+}			InsertLockMethods;
+
+typedef enum QueryLimitActions
+{
+	QLA_WAIT = 1,
+	QLA_REJECT
+}			QueryLimitActions;
+
 
 typedef enum MemCacheMethod
 {
 	SHMEM_CACHE = 1,
-	MEMCACHED_CACHE
+	MEMCACHED_CACHE,
+	REDIS_CACHE
 }			MemCacheMethod;
 
+typedef enum MemqcacheHashMethod
+{
+	MEMQCACHE_HASH_XXHASH = 1,
+	MEMQCACHE_HASH_MD5
+}			MemqcacheHashMethod;
+
+typedef enum MemqcacheCompression
+{
+	MEMQCACHE_COMPRESSION_NONE = 1,
+	MEMQCACHE_COMPRESSION_LZ4
+}			MemqcacheCompression;
+
+typedef enum MemqcacheInvalidationMode
+{
+	MEMQCACHE_INVALIDATION_SYNC = 1,
+	MEMQCACHE_INVALIDATION_ASYNC,
+	MEMQCACHE_INVALIDATION_STRICT
+}			MemqcacheInvalidationMode;
+
+typedef enum HugePages
+{
+	HUGE_PAGES_OFF = 1,
+	HUGE_PAGES_ON,
+	HUGE_PAGES_TRY
+}			HugePages;
+
+typedef enum LogRingOverflow
+{
+	LOG_RING_OVERFLOW_DROP = 1,
+	LOG_RING_OVERFLOW_BLOCK
+}			LogRingOverflow;
+
 typedef enum WdLifeCheckMethod
 {
 	LIFECHECK_BY_QUERY = 1,
@@ -117,6 +182,12 @@ typedef enum DLBOW_OPTION
 	DLBOW_DML_ADAPTIVE
 }			DLBOW_OPTION;
 
+typedef enum LB_ALGORITHM_OPTION
+{
+	LB_ALGORITHM_WEIGHT = 1,
+	LB_ALGORITHM_LEAST_LOADED
+}			LB_ALGORITHM_OPTION;
+
 typedef enum RELQTARGET_OPTION
 {
 	RELQTARGET_PRIMARY = 1,
@@ -210,6 +281,12 @@ typedef struct
 	DBObject	right_token;
 }		DBObjectRelation;
 
+typedef struct
+{
+	char	   *table;			/* table name, optionally schema qualified */
+	char	   *column;			/* shard key column */
+}			ShardKey;
+
 /*
  * configuration parameters
  */
@@ -222,6 +299,10 @@ typedef struct
 	int			port;			/* port # to bind */
 	char	   **pcp_listen_addresses;	/* PCP listen address to listen on */
 	int			pcp_port;		/* PCP port # to bind */
+	char	   **metrics_listen_addresses;	/* metrics listen address to
+											 * listen on */
+	int			metrics_port;	/* metrics port # to bind. 0 disables the
+								 * metrics process */
 	char	   **unix_socket_directories;		/* pgpool socket directories */
 	char		*unix_socket_group;			/* owner group of pgpool sockets */
 	int			unix_socket_permissions;	/* pgpool sockets permissions */
@@ -234,13 +315,39 @@ typedef struct
 	int			listen_backlog_multiplier;	/* determines the size of the
 											 * connection queue */
 	int			reserved_connections;	/* # of reserved connections */
+	int			max_connections_per_user;	/* max # of connections from
+											 * clients of a user. 0 means no
+											 * limit */
+	int			max_connections_per_database;	/* max # of connections from
+												 * clients to a database */
+	int			max_active_queries_per_user;	/* max # of running queries
+												 * of a user */
+	int			max_active_queries_per_database;	/* max # of running
+													 * queries on a database */
+	int			max_active_queries_per_node;	/* max # of running queries
+												 * on a backend node */
+	int			max_queries_per_second_per_user;	/* max # of queries a
+													 * user starts per second */
+	int			max_queries_per_second_per_database;	/* max # of queries
+														 * started per second
+														 * on a database */
+	QueryLimitActions query_limit_action;	/* what to do with a query over
+											 * the limits */
 	bool		serialize_accept;	/* if non 0, serialize call to accept() to
 									 * avoid thundering herd problem */
 	int			child_life_time;	/* if idle for this seconds, child exits */
 	int			connection_life_time;	/* if idle for this seconds,
 										 * connection closes */
+	int			connection_life_time_jitter;	/* % of connection_life_time
+												 * randomly taken off */
+	int			max_connection_recycles_per_second;	/* # of expired
+														 * connections closed per
+														 * second by all children */
 	int			child_max_connections;	/* if max_connections received, child
 										 * exits */
+	int			child_memory_limit; /* if memory of a child exceeds this
+									 * many kilobytes, it exits after the
+									 * session */
 	int			client_idle_limit;	/* If client_idle_limit is n (n > 0), the
 									 * client is forced to be disconnected
 									 * after n seconds idle */
@@ -254,6 +361,18 @@ typedef struct
 	int			authentication_timeout; /* maximum time in seconds to complete
 										 * client authentication */
 	int			max_pool;		/* max # of connection pool per child */
+	int			read_buffer_size;	/* max bytes read from a socket at once */
+	int			write_buffer_size;	/* bytes buffered before writing to a
+									 * socket */
+	int			result_spool_size;	/* max bytes of a result buffered for
+									 * a slow client */
+	char	   *backend_local_socket_dir;	/* UNIX domain socket directory
+											 * of backends on this host */
+	int			backend_busy_poll;	/* SO_BUSY_POLL microseconds of
+									 * backend sockets */
+	HugePages	huge_pages;		/* use huge pages for the main shared
+								 * memory segment */
+	bool		numa_child_affinity;	/* bind children to NUMA nodes */
 	char	   *logdir;			/* logging directory */
 	char	   *log_destination_str;	/* log destination: stderr and/or
 										 * syslog */
@@ -268,6 +387,16 @@ typedef struct
 	bool		log_hostname;	/* resolve hostname */
 	bool		enable_pool_hba;	/* enables pool_hba.conf file
 									 * authentication */
+	int			dns_cache_size;	/* # of client host names cached. 0
+								 * disables the cache */
+	int			dns_cache_ttl;	/* seconds a host name is cached */
+	int			dns_cache_negative_ttl;	/* seconds a failed lookup is
+										 * cached */
+	int			ldap_auth_cache_ttl;	/* seconds a successful LDAP bind is
+										 * cached. 0 disables the cache */
+	int			scram_key_cache_size;	/* # of SCRAM keys and verifiers
+										 * shared among children. 0
+										 * disables the cache */
 	char	   *pool_passwd;	/* pool_passwd file name. "" disables
 								 * pool_passwd */
 	bool		load_balance_mode;	/* load balance mode */
@@ -292,10 +421,18 @@ typedef struct
 								 * when backend node detached and
 								 * replication_status is 'stream' */
 	int			auto_failback_interval;	/* min interval of executing auto_failback */
+	bool		auto_attach_new_backends;	/* If true, backend nodes added
+											 * by reload are attached at
+											 * once */
 	bool		replicate_select;	/* replicate SELECT statement when load
 									 * balancing is disabled. */
+	char	   *shard_key_list;	/* list of table:column of sharded tables */
+	ShardKey   *parsed_shard_key_list;	/* shard_key_list terminated by an
+										 * entry with NULL table */
 	char	  **reset_query_list;	/* comma separated list of queries to be
 									 * issued at the end of session */
+	char	  **prewarm_connections;	/* list of user:database:count whose
+										 * connections are opened in advance */
 	char	  **read_only_function_list;	/* list of functions with no side
 										 * effects */
 	char	  **write_function_list;	/* list of functions with side effects */
@@ -317,6 +454,9 @@ typedef struct
 	char		*log_filename;
 	bool		log_truncate_on_rotation;
 	int			log_file_mode;
+	int			log_ring_size;	/* size of the log ring of each child in
+								 * kilobytes. 0 disables log rings */
+	LogRingOverflow log_ring_overflow;	/* what to do if a log ring is full */
 
 	int64		delay_threshold;	/* If the standby server delays more than
 									 * delay_threshold, any query goes to the
@@ -337,9 +477,20 @@ typedef struct
 										* functionality. */
 
 	bool		prefer_lower_delay_standby;
+	bool		causal_reads;	/* if on, read queries after a write go
+								 * only to standbys which have replayed it */
 
 	LogStandbyDelayModes log_standby_delay; /* how to log standby lag */
 	bool		connection_cache;	/* cache connection pool? */
+	bool		skip_reset_on_clean_session;	/* skip reset_query_list if
+												 * the session did not change
+												 * backend session state */
+	int			max_pooled_prepared_statements;	/* max number of prepared
+												 * statements shared on a
+												 * backend connection */
+	int			listen_multiplexing_max_subscriptions;	/* max number of LISTENs
+														 * served by the
+														 * notification hub */
 	int			health_check_timeout;	/* health check timeout */
 	int			health_check_period;	/* health check period */
 	char	   *health_check_user;	/* PostgreSQL user name for health check */
@@ -354,6 +505,8 @@ typedef struct
 	HealthCheckParams *health_check_params; /* per node health check
 											 * parameters */
 	int			sr_check_period;	/* streaming replication check period */
+	int			sr_lag_check_interval;	/* interval of replication lag
+										 * sampling in milliseconds */
 	char	   *sr_check_user;	/* PostgreSQL user name for streaming
 								 * replication check */
 	char	   *sr_check_password;	/* password for sr_check_user */
@@ -362,6 +515,9 @@ typedef struct
 	char	   *failover_command;	/* execute command when failover happens */
 	char	   *follow_primary_command;	/* execute command when failover is
 										 * ended */
+	int			follow_primary_command_parallelism; /* max number of
+												 * follow_primary_command run
+												 * at the same time */
 	char	   *failback_command;	/* execute command when failback happens */
 
 	bool		failover_on_backend_error; /* If true, trigger fail over when
@@ -374,6 +530,12 @@ typedef struct
 											 * the session. */
 	bool		failover_on_backend_shutdown; /* If true, trigger fail over
 												 when backend is going down */
+	bool		failover_keep_sessions; /* If true, do not restart children
+										 * not using the failed standby */
+	int			failover_reattach_timeout;	/* Max time in seconds an idle
+											 * session waits to be reattached
+											 * to the new primary. 0 disables
+											 * reattaching */
 	bool		detach_false_primary;	/* If true, detach false primary */
 	char	   *recovery_user;	/* PostgreSQL user name for online recovery */
 	char	   *recovery_password;	/* PostgreSQL user password for online
@@ -382,6 +544,11 @@ typedef struct
 											 * stage */
 	char	   *recovery_2nd_stage_command; /* Online recovery command in 2nd
 											 * stage */
+	char	   *recovery_catchup_command;	/* Online recovery command
+											 * replaying changes since the
+											 * 1st stage before the 2nd */
+	int			recovery_catchup_rounds;	/* # of times to run
+											 * recovery_catchup_command */
 	int			recovery_timeout;	/* maximum time in seconds to wait for
 									 * remote start-up */
 	int			search_primary_node_timeout;	/* maximum time in seconds to
@@ -394,6 +561,10 @@ typedef struct
 												 * while in recovery 2nd stage */
 	bool		insert_lock;	/* automatically locking of table with INSERT
 								 * to keep SERIAL data consistency? */
+	InsertLockMethods insert_lock_method;	/* how insert_lock locks */
+	bool		replication_concurrent_dispatch;	/* send statements which
+													 * cannot deadlock to all
+													 * nodes at once */
 	bool		ignore_leading_white_space; /* ignore leading white spaces of
 											 * each query */
 	bool		log_statement;	/* logs all SQL statements */
@@ -402,8 +573,28 @@ typedef struct
 	bool		notice_per_node_statement; /* logs notice message for per node detailed SQL
 										 * statements */
 	bool		log_client_messages;	/* If true, logs any client messages */
+	int			log_statement_sample_interval;	/* log_statement and
+												 * log_per_node_statement log
+												 * one in this many statements,
+												 * chosen at random */
+	int			log_statement_rate_limit;	/* maximum number of statements
+											 * logged per second by a child
+											 * process. 0 means no limit */
+	int			log_min_duration_statement;	/* log statements which take
+											 * longer than this (msec). -1
+											 * disables it */
+	int			statement_stats_max;	/* maximum number of statements
+										 * tracked by SHOW pool_statements.
+										 * 0 disables it */
 	char	   *lobj_lock_table;	/* table name to lock for rewriting
 									 * lo_creat */
+	int			lobj_oid_batch_size;	/* # of large object ids reserved
+										 * at once for lo_creat */
+	int			timestamp_sync_interval;	/* interval in seconds to
+											 * synchronize the clock used to
+											 * rewrite timestamps with main
+											 * node. 0 means ask the main
+											 * node every time */
 
 	BackendDesc *backend_desc;	/* PostgreSQL Server description. Placed on
 								 * shared memory */
@@ -414,8 +605,12 @@ typedef struct
 
 	/* followings till syslog, does not exist in the configuration file */
 	int			num_reset_queries;	/* number of queries in reset_query_list */
+	int			num_prewarm_connections;	/* number of entries in
+											 * prewarm_connections */
 	int			num_listen_addresses;	/* number of entries in listen_addresses */
 	int			num_pcp_listen_addresses;	/* number of entries in pcp_listen_addresses */
+	int			num_metrics_listen_addresses;	/* number of entries in
+												 * metrics_listen_addresses */
 	int			num_unix_socket_directories;	/* number of entries in unix_socket_directories */
 	int			num_pcp_socket_directories;	/* number of entries in pcp_socket_dir */
 	int			num_read_only_function_list;	/* number of functions in
@@ -441,14 +636,26 @@ typedef struct
 	char	   *ssl_crl_file;	/* path to the SSL certificate revocation list file */
 	char	   *ssl_ciphers;	/* allowed ssl ciphers */
 	bool		ssl_prefer_server_ciphers; /*Use SSL cipher preferences, rather than the client's*/
+	bool		ssl_session_tickets;	/* allow frontends to resume sessions
+										 * with session tickets */
+	int			ssl_session_ticket_lifetime;	/* rotation interval of session
+												 * ticket keys in seconds */
+	bool		ssl_ktls;		/* use kernel TLS if available */
 	char	   *ssl_ecdh_curve; /* the curve to use in ECDH key exchange */
 	char	   *ssl_dh_params_file; /* path to the Diffie-Hellman parameters contained file */
 	char	   *ssl_passphrase_command; /* path to the Diffie-Hellman parameters contained file */
 	int64		relcache_expire;	/* relation cache life time in seconds */
 	int			relcache_size;	/* number of relation cache life entry */
+	int			parse_cache_size;	/* number of parse tree cache entries */
 	CHECK_TEMP_TABLE_OPTION		check_temp_table;	/* how to check temporary table */
 	bool		check_unlogged_table;	/* enable unlogged table check */
-	bool		enable_shared_relcache;	/* If true, relation cache stored in memory cache */
+	bool		enable_shared_relcache;	/* If true, relation cache is shared among child processes */
+	int			shared_relcache_size;	/* number of shared relation cache entries */
+	bool		relcache_background_refresh;	/* if true, expired shared
+												 * relcache entries are
+												 * refreshed in background */
+	bool		relcache_prefetch;	/* if true, session independent catalog
+									 * information is fetched in background */
 	RELQTARGET_OPTION	relcache_query_target;	/* target node to send relcache queries */
 
 	/*
@@ -468,13 +675,28 @@ typedef struct
 	bool		memory_cache_enabled;	/* if true, use the memory cache
 										 * functionality, false by default */
 	MemCacheMethod memqcache_method;	/* Cache store method. Either
-										 * 'shmem'(shared memory) or
-										 * 'memcached'. 'shmem' by default */
+										 * 'shmem'(shared memory),
+										 * 'memcached' or 'redis'. 'shmem' by
+										 * default */
+	MemqcacheHashMethod memqcache_hash_method;	/* Hash function used to
+												 * build query cache keys.
+												 * Either 'xxhash' or 'md5'.
+												 * 'xxhash' by default */
+	MemqcacheCompression memqcache_compression;	/* Compression method of
+												 * shmem query cache items.
+												 * Either 'none' or 'lz4'.
+												 * 'none' by default */
 	char	   *memqcache_memcached_host;	/* Memcached host name. Mandatory
 											 * if memqcache_method=memcached. */
 	int			memqcache_memcached_port;	/* Memcached port number.
 											 * Mandatory if
 											 * memqcache_method=memcached. */
+	char	   *memqcache_redis_host;	/* Redis host name. Used if
+										 * memqcache_method=redis. */
+	int			memqcache_redis_port;	/* Redis port number. Used if
+										 * memqcache_method=redis. */
+	char	   *memqcache_redis_password;	/* Redis password. Empty
+											 * disables AUTH */
 	int64		memqcache_total_size;	/* Total memory size in bytes for
 										 * storing memory cache. Mandatory if
 										 * memqcache_method=shmem. */
@@ -483,17 +705,65 @@ typedef struct
 											 * memqcache_method=shmem. */
 	int			memqcache_expire;	/* Memory cache entry life time specified
 									 * in seconds. 60 by default. */
+	int			memqcache_stale_while_revalidate;	/* Seconds before expiry
+													 * in which one child
+													 * refreshes a cache entry
+													 * while the others keep
+													 * using it. 0 disables */
+	int			memqcache_paginated_cache_rows; /* Maximum number of rows
+												 * of an ORDER BY query cached
+												 * to serve its LIMIT/OFFSET
+												 * variants. 0 disables */
+	int			memqcache_coalesce_timeout; /* Milliseconds to wait for the
+											 * same SELECT running in another
+											 * child to be cached. 0 disables */
 	bool		memqcache_auto_cache_invalidation;	/* If true, invalidation
 													 * of query cache is
 													 * triggered by
 													 * corresponding */
 	/* DDL/DML/DCL(and memqcache_expire).  If false, it is only triggered */
 	/* by memqcache_expire.  True by default. */
+	MemqcacheInvalidationMode memqcache_invalidation_mode;	/* How cache
+															 * invalidation is
+															 * performed.
+															 * Either 'sync',
+															 * 'async' or
+															 * 'strict'.
+															 * 'sync' by
+															 * default */
+	bool		memqcache_invalidation_coalesce;	/* If true, the
+													 * invalidation worker
+													 * applies the same table
+													 * only once in a batch */
+	bool		memqcache_admission_filter;	/* If true, admit new shmem
+											 * cache items by their
+											 * frequency (TinyLFU) */
+	bool		memqcache_watchdog_invalidation;	/* If true, send query
+													 * cache invalidation to
+													 * the other pgpool nodes
+													 * through watchdog */
+	char	   *memqcache_logical_slot;	/* Logical replication slot to
+										 * read table changes from. Empty
+										 * disables */
+	char	   *memqcache_logical_database;	/* Database of
+											 * memqcache_logical_slot */
+	int			memqcache_logical_interval;	/* Milliseconds between reads
+											 * of memqcache_logical_slot */
 	int			memqcache_maxcache; /* Maximum SELECT result size in bytes. */
+	int			memqcache_local_cache_size; /* Size of the per child local
+											 * cache in bytes. 0 disables it */
+	char	   *memqcache_database_quota;	/* Comma separated list of
+											 * "database:percent" of
+											 * memqcache_total_size */
+	Left_right_tokens *memqcache_quota_tokens;	/* parsed
+												 * memqcache_database_quota */
 	int			memqcache_cache_block_size; /* Cache block size in bytes. 8192
 											 * by default */
 	char	   *memqcache_oiddir;	/* Temporary work directory to record
 									 * table oids */
+	char	   *memqcache_snapshot_file;	/* File to save the shmem query
+											 * cache at shutdown and to load
+											 * it at startup */
 	char	  **cache_safe_memqcache_table_list; /* list of tables to memqcache */
 	char	  **cache_unsafe_memqcache_table_list; /* list of tables not to memqcache */
 
@@ -503,6 +773,14 @@ typedef struct
 	int			current_memqcache_table_pattern_size;	/* size of the regex
 														 * pattern array */
 
+	/*
+	 * Combined matchers built from the pattern arrays above, indexed by
+	 * WRITELIST/READONLYLIST.
+	 */
+	RegPatternSet function_pattern_sets[2];
+	RegPatternSet memqcache_table_pattern_sets[2];
+	RegPatternSet query_pattern_sets[2];
+
 	/*
 	 * user_redirect_preference_list =
 	 * 'postgres:primary,user[0-4]:1,user[5-9]:2'
@@ -565,8 +843,39 @@ typedef struct
 
 	char	   *dml_adaptive_object_relationship_list;	/* objects relationship list*/
 	DBObjectRelation *parsed_dml_adaptive_object_relationship_list;
+	int			dml_adaptive_write_window;	/* time in milliseconds tables
+											 * written in the session are
+											 * not load balanced */
 
 	bool		statement_level_load_balance; /* if on, select load balancing node per statement */
+	LB_ALGORITHM_OPTION load_balance_algorithm;	/* how to choose load
+												 * balancing node among
+												 * candidates */
+	bool		adaptive_weight;	/* if on, adjust backend weights by
+									 * measured latency */
+	int			adaptive_weight_floor;	/* lower limit of effective weight in
+										 * percent of backend_weight */
+	int			adaptive_weight_ceiling;	/* upper limit of effective weight
+											 * in percent of backend_weight */
+	bool		hedged_reads;	/* if on, resend slow SELECTs to another
+								 * standby */
+	int			hedged_read_percentile;	/* latency percentile after which
+										 * a SELECT is resent */
+	int			hedged_read_min_delay;	/* lower limit of the delay in
+										 * milliseconds */
+	bool		retry_reads_on_standby_failure;	/* if on, resend SELECTs
+												 * whose standby fails before
+												 * answering */
+	char	   *heavy_query_nodes;	/* comma separated list of node ids
+									 * heavy queries are sent to */
+	bool		heavy_query_node[MAX_NUM_BACKENDS];	/* parsed
+													 * heavy_query_nodes */
+	int			num_heavy_query_nodes;	/* number of nodes in
+										 * heavy_query_nodes */
+	int			heavy_query_min_weight;	/* estimated weight from which a
+										 * SELECT is a heavy query */
+	int			max_heavy_queries;	/* max number of heavy queries running
+									 * at the same time */
 
 	/*
 	 * add for watchdog
@@ -607,12 +916,16 @@ typedef struct
 										 * on new active pgpool. */
 	char	   *wd_de_escalation_command;	/* Executes this command when
 											 * leader pgpool goes down. */
+	bool		wd_parallel_escalation;	/* run (de-)escalation command and
+										 * delegate IP commands concurrently */
 	int			wd_priority;	/* watchdog node priority, during leader
 								 * election */
 	int			pgpool_node_id;	/* pgpool (watchdog) node id */
 	WdNodesConfig wd_nodes;		/* watchdog lists */
 	char	   *trusted_servers;	/* icmp reachable server list (A,B,C) */
 	char	   *trusted_server_command;	/* Executes this command when upper servers are observed */
+	bool		trusted_server_use_icmp;	/* ping trusted servers without
+											 * trusted_server_command */
 	char	   *delegate_ip;	/* delegate IP address */
 	int			wd_interval;	/* lifecheck interval (sec) */
 	char	   *wd_authkey;		/* Authentication key for watchdog
@@ -625,6 +938,8 @@ typedef struct
 	char	   *arping_cmd;		/* arping command */
 	int			wd_life_point;	/* life point (retry times at lifecheck) */
 	char	   *wd_lifecheck_query; /* lifecheck query */
+	bool		wd_lifecheck_persistent_connection;	/* keep lifecheck
+														 * connections open */
 	char	   *wd_lifecheck_dbname;	/* Database name connected for
 										 * lifecheck */
 	char	   *wd_lifecheck_user;	/* PostgreSQL user name for watchdog */
@@ -632,6 +947,8 @@ typedef struct
 	int			wd_heartbeat_port;	/* Port number for heartbeat lifecheck */
 	int			wd_heartbeat_keepalive; /* Interval time of sending heartbeat
 										 * signal (sec) */
+	bool		wd_heartbeat_single_process;	/* Use one heartbeat process
+												 * for all destinations */
 	int			wd_heartbeat_deadtime;	/* Deadtime interval for heartbeat
 										 * signal (sec) */
 	WdHbIf		hb_ifs[WD_MAX_IF_NUM];		/* heartbeat interfaces of all watchdog nodes */
@@ -640,6 +957,17 @@ typedef struct
 	char	  **wd_monitoring_interfaces_list;	/* network interface name list
 												 * to be monitored by watchdog */
 	bool		health_check_test;			/* if on, enable health check testing */
+	bool		health_check_multiplexed;	/* if on, one process checks all
+											 * backends */
+	bool		sr_check_by_health_check;	/* if on, streaming replication
+											 * check uses the samples taken by
+											 * the multiplexed health check */
+	int			health_check_error_threshold;	/* errors per second on a
+												 * node that trigger an
+												 * immediate health check */
+	int			health_check_probe_interval;	/* interval in milliseconds of
+												 * probes on the health check
+												 * connection */
 
 }			POOL_CONFIG;
 
@@ -670,10 +998,25 @@ extern int	eval_logical(const char *str);
 extern char *pool_flag_to_str(unsigned short flag);
 extern char *backend_status_to_str(BackendInfo * bi);
 
+/* shared snapshot of the parsed configuration */
+typedef enum
+{
+	CONFIG_SNAPSHOT_NONE,		/* no usable snapshot, read the files */
+	CONFIG_SNAPSHOT_UNCHANGED,	/* already applied by this process */
+	CONFIG_SNAPSHOT_APPLIED		/* new configuration has been applied */
+}			ConfigSnapshotResult;
+
+extern size_t pool_config_snapshot_size(void);
+extern void pool_config_snapshot_init(void *area, const char *config_file,
+									  const char *hba_file);
+extern bool pool_config_snapshot_reload(const char *config_file, const char *hba_file);
+extern ConfigSnapshotResult pool_config_snapshot_apply(char **hba_text, size_t *hba_len);
+
 /* methods used for regexp support */
 extern int	add_regex_pattern(const char *type, char *s);
 extern int	growFunctionPatternArray(RegPattern item);
 extern int	growMemqcacheTablePatternArray(RegPattern item);
 extern int	growQueryPatternArray(RegPattern item);
+extern void compile_regex_pattern_sets(void);
 
 #endif							/* POOL_CONFIG_H */
@@ -0,0 +1,56 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ */
+
+#ifndef pool_client_limit_h
+#define pool_client_limit_h
+
+#include "pool.h"
+#include "utils/pool_atomic.h"
+
+/*
+ * Usage of a user or a database by the clients currently connected.  There
+ * are num_init_children slots for users and as many for databases on shmem,
+ * since each child serves one client at a time.
+ */
+typedef struct
+{
+	char		name[SM_DATABASE];	/* user or database name */
+	int			sessions;		/* # of connected clients. A slot with no
+								 * sessions is free. Protected by
+								 * CONN_COUNTER_SEM */
+	pool_atomic_uint32 active;	/* # of clients running a query */
+	pool_atomic_uint64 rate;	/* second in the upper 32 bits, # of queries
+								 * started in the second in the lower 32 */
+}			ClientLimitSlot;
+
+extern size_t pool_client_limit_shmem_size(void);
+extern void pool_client_limit_shmem_init(void *area);
+extern void pool_client_limit_init_process(ProcessInfo * pi);
+extern void pool_client_limit_release_dead_process(ProcessInfo * pi);
+extern void pool_client_limit_admit(POOL_CONNECTION * frontend);
+extern void pool_client_limit_release(void);
+extern bool pool_client_limit_begin_query(POOL_CONNECTION_POOL * backend, bool can_reject);
+extern void pool_client_limit_end_query(void);
+extern void pool_client_limit_begin_heavy_query(void);
+extern void pool_client_limit_begin_node_query(POOL_CONNECTION_POOL * backend, int node_id);
+extern bool pool_client_limit_try_node_query(int node_id);
+extern bool pool_client_limit_try_recycle(void);
+
+#endif							/* pool_client_limit_h */
@@ -30,14 +30,20 @@ extern POOL_CONNECTION_POOL * pool_get_cp(char *user, char *database, int protoM
 extern void pool_discard_cp(char *user, char *database, int protoMajor);
 extern void pool_backend_timer(void);
 extern void pool_connection_pool_timer(POOL_CONNECTION_POOL * backend);
-extern RETSIGTYPE pool_backend_timer_handler(int sig);
 extern int	connect_inet_domain_socket(int slot, bool retry);
+extern bool pool_backend_is_local(int slot);
 extern int	connect_unix_domain_socket(int slot, bool retry);
 extern int	connect_inet_domain_socket_by_port(char *host, int port, bool retry);
 extern int	connect_unix_domain_socket_by_port(int port, char *socket_dir, bool retry);
+extern void pool_connect_backends_in_parallel(int *fds, bool *tried);
 extern int	pool_pool_index(void);
 extern void close_all_backend_connections(void);
+extern bool pool_discard_down_node_connections(POOL_CONNECTION_POOL * active);
+extern bool pool_session_reattachable(POOL_CONNECTION_POOL * backend, const char **reason);
 extern void update_pooled_connection_count(void);
+extern void update_buffer_memory(POOL_CONNECTION * frontend);
+extern void update_memory_usage(void);
 extern int	in_use_backend_id(POOL_CONNECTION_POOL *pool);
+extern void pool_prewarm_connections(void);
 
 #endif /* pool_connection_pool_h */
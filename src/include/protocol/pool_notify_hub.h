@@ -0,0 +1,41 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_notify_hub.h: LISTEN/NOTIFY multiplexing through a notification hub
+ * process.
+ *
+ */
+
+#ifndef POOL_NOTIFY_HUB_H
+#define POOL_NOTIFY_HUB_H
+
+#include "pool.h"
+#include "parser/nodes.h"
+
+extern size_t pool_notify_hub_shmem_size(void);
+extern void pool_init_notify_hub(void);
+extern bool pool_notify_hub_statement(POOL_CONNECTION * frontend,
+									  POOL_CONNECTION_POOL * backend,
+									  Node *node, bool is_multi_statement);
+extern bool pool_notify_hub_listening(void);
+extern void pool_notify_hub_deliver(POOL_CONNECTION * frontend,
+									POOL_CONNECTION_POOL * backend);
+extern void pool_notify_hub_unlisten_all(void);
+extern void do_notify_hub_child(void);
+
+#endif							/* POOL_NOTIFY_HUB_H */
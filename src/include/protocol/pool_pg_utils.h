@@ -26,6 +26,9 @@
 
 #define MAX_PG_VERSION_STRING	512
 
+/* query to get the version string of PostgreSQL */
+#define PGVERSION_QUERY	"SELECT pg_catalog.version()"
+
 /*
  * PostgreSQL version descriptor
  */
@@ -48,8 +51,11 @@ extern POOL_CONNECTION_POOL_SLOT * make_persistent_db_connection(
 																 int db_node_id, char *hostname, int port, char *dbname, char *user, char *password, bool retry);
 extern POOL_CONNECTION_POOL_SLOT * make_persistent_db_connection_noerror(
 																		 int db_node_id, char *hostname, int port, char *dbname, char *user, char *password, bool retry);
+extern void make_persistent_db_connections_noerror(POOL_CONNECTION_POOL_SLOT * *slots,
+												   char *dbname, char *user, char *password);
 extern void discard_persistent_db_connection(POOL_CONNECTION_POOL_SLOT * cp);
 extern int	select_load_balancing_node(void);
+extern void pool_get_effective_weights(double *weights);
 
 extern PGVersion *Pgversion(POOL_CONNECTION_POOL * backend);
 
@@ -61,5 +67,7 @@ extern void si_snapshot_acquired(void);
 extern void si_commit_request(void);
 extern void si_commit_done(void);
 extern int	check_replication_delay(int node_id);
+extern uint64 pool_parse_wal_location(const char *text);
+extern bool check_causal_read(int node_id);
 
 #endif /* pool_pg_utils_h */
@@ -0,0 +1,70 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ */
+
+#ifndef pool_prepared_statement_h
+#define pool_prepared_statement_h
+
+#include "pool.h"
+#include "context/pool_query_context.h"
+
+/*
+ * Server side name of a pooled prepared statement: the prefix followed by
+ * the md5 of the query text and parameter types.  The bare prefix is never
+ * used as a statement name, see pool_ps_rewrite_message().
+ */
+#define POOL_PS_NAME_PREFIX	"pgpool_ps_"
+#define POOL_PS_NAME_LEN	(sizeof(POOL_PS_NAME_PREFIX) - 1 + 32 + 1)
+
+typedef struct
+{
+	char		name[POOL_PS_NAME_LEN];
+	bool		prepared;		/* false until ParseComplete is received */
+}			POOL_PS_ENTRY;
+
+/*
+ * Prepared statements created by pgpool on one backend connection.  Lives
+ * as long as the connection and is freed by pool_close().
+ */
+typedef struct POOL_PS_REGISTRY
+{
+	int			size;			/* number of entries in use */
+	int			capacity;		/* number of entries allocated */
+	POOL_PS_ENTRY entries[FLEXIBLE_ARRAY_MEMBER];
+}			POOL_PS_REGISTRY;
+
+/* state of a statement on a set of nodes */
+typedef enum
+{
+	POOL_PS_ABSENT,				/* not known on any of the nodes */
+	POOL_PS_PREPARED,			/* prepared on all of the nodes */
+	POOL_PS_UNKNOWN				/* anything else */
+}			POOL_PS_STATE;
+
+extern bool pool_ps_is_reusable(POOL_QUERY_CONTEXT * query_context);
+extern void pool_ps_statement_name(int len, char *contents, char *server_name);
+extern POOL_PS_STATE pool_ps_lookup(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name);
+extern bool pool_ps_register(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name, bool force);
+extern void pool_ps_confirm(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name);
+extern void pool_ps_forget_unconfirmed(POOL_CONNECTION_POOL * backend);
+extern void pool_ps_clear(POOL_CONNECTION_POOL * backend);
+extern char *pool_ps_rewrite_message(char kind, int len, char *contents, const char *server_name, int *new_len);
+extern bool pool_ps_query_drops_statements(const char *query);
+
+#endif							/* pool_prepared_statement_h */
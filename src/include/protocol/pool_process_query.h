@@ -73,6 +73,7 @@ extern void pool_send_severity_message(POOL_CONNECTION * frontend, int protoMajo
 						   int line);
 
 extern POOL_STATUS SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void forward_buffered_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern POOL_STATUS SimpleForwardToBackend(char kind, POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int len, char *contents);
 
 extern POOL_STATUS pool_process_query(POOL_CONNECTION * frontend,
@@ -45,6 +45,18 @@ extern int	is_select_pgcatalog;
 extern int	is_select_for_update;	/* also for SELECT ... INTO */
 extern char *parsed_query;
 
+/*
+ * Whether the statements of the frontend message being processed are
+ * logged by log_statement and log_per_node_statement.  Set by
+ * sample_statement_log() before anything is formatted.
+ */
+extern bool statement_log_sampled;
+
+#define pool_log_statement_enabled() \
+	(pool_config->log_statement && statement_log_sampled)
+#define pool_log_per_node_statement_enabled() \
+	(pool_config->log_per_node_statement && statement_log_sampled)
+
 /*
  * modules defined in pool_proto_modules.c
  */
@@ -182,6 +194,7 @@ extern void send_simplequery_message(POOL_CONNECTION * backend, int len, char *s
 extern POOL_STATUS send_extended_protocol_message(POOL_CONNECTION_POOL * backend,
 												  int node_id, char *kind,
 												  int len, char *string);
+extern bool pool_backend_flush_deferrable(void);
 
 extern int	synchronize(POOL_CONNECTION * cp);
 extern void read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *decided_kind);
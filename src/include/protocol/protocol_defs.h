@@ -36,6 +36,19 @@
 
 #define ROWLOCKQUERY3 "SELECT 1 FROM pgpool_catalog.insert_lock WHERE reloid = pg_catalog.to_regclass('%s') FOR UPDATE"
 
+/*
+ * queries to take an advisory lock on the table oid for insert_lock_method =
+ * advisory_lock.  The first key keeps the locks apart from the advisory
+ * locks of applications using a single bigint key or other first keys.
+ */
+#define INSERT_LOCK_ADVISORY_KEY 1346850892	/* "PGPL" */
+
+#define ADVISORYLOCKQUERY "SELECT pg_catalog.pg_advisory_xact_lock(%d, (SELECT oid FROM pg_catalog.pg_class WHERE relname = '%s' ORDER BY oid LIMIT 1)::pg_catalog.int4)"
+
+#define ADVISORYLOCKQUERY2 "SELECT pg_catalog.pg_advisory_xact_lock(%d, pgpool_regclass('%s')::pg_catalog.int4)"
+
+#define ADVISORYLOCKQUERY3 "SELECT pg_catalog.pg_advisory_xact_lock(%d, pg_catalog.to_regclass('%s')::pg_catalog.oid::pg_catalog.int4)"
+
 #define MAX_NAME_LEN 128
 
 
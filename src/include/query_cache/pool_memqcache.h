@@ -27,12 +27,14 @@
 #define POOL_MEMQCACHE_H
 
 #include "pool.h"
+#include "utils/pool_atomic.h"
 #include <sys/time.h>
 
 #define NO_QUERY_CACHE "/*NO QUERY CACHE*/"
 #define NO_QUERY_CACHE_COMMENT_SZ (sizeof(NO_QUERY_CACHE)-1)
 
 #define POOL_MD5_HASHKEYLEN		32	/* MD5 hash key length */
+#define POOL_QUERY_HASH_LEN		16	/* binary query hash length */
 
 /*
  * On memory query cache on shmem is divided into fixed length "cache
@@ -60,31 +62,43 @@ typedef struct
 #define POOL_BLOCK_USED	0x0001	/* is this block used? */
 
 /*
- * Cache block header (12 bytes)
+ * Cache block header (16 bytes)
+ *
+ * "version" is odd while item bodies in the block are being moved by
+ * compaction, so that lock-free readers can detect it.
  */
 typedef struct
 {
 	unsigned char flags;		/* flags. see above */
 	unsigned int num_items;		/* number of items */
 	unsigned int free_bytes;	/* total free space in bytes */
+	pool_atomic_uint32 version; /* block version */
 }			POOL_CACHE_BLOCK_HEADER;
 
+/*
+ * Binary query signature.  With memqcache_hash_method = 'md5' this is the
+ * MD5 digest of the cache key.  With 'xxhash' the first 8 bytes are the
+ * XXH64 hash value of the cache key and the rest is the key length.
+ */
 typedef struct
 {
-	char		query_hash[POOL_MD5_HASHKEYLEN];
+	char		query_hash[POOL_QUERY_HASH_LEN];
 }			POOL_QUERY_HASH;
 
 #define POOL_ITEM_USED	0x0001	/* is this item used? */
 #define POOL_ITEM_HAS_NEXT	0x0002	/* is this item has "next" item? */
 #define POOL_ITEM_DELETED	0x0004	/* is this item deleted? */
+#define POOL_ITEM_PACKED	0x0008	/* deleted item whose body has been
+									 * removed by compaction */
 
 /*
- * Cache item pointer (48 bytes)
+ * Cache item pointer (28 bytes)
  */
 typedef struct
 {
-	POOL_QUERY_HASH query_hash; /* md5 hashed query signature */
-	POOL_CACHEID next;			/* next cache item if any */
+	POOL_QUERY_HASH query_hash; /* hashed query signature */
+	int32		oid_map;		/* first table oid map entry of this item, -1
+								 * if none */
 	unsigned int offset;		/* item offset in this block */
 	unsigned char flags;		/* flags. see above */
 }			POOL_CACHE_ITEM_POINTER;
@@ -102,13 +116,27 @@ typedef struct
  * memcached.
  */
 
+/*
+ * Codec of cache item data.  If the data is compressed, it begins with the
+ * uncompressed length (uint32) followed by the compressed data.
+ */
+#define POOL_CACHE_CODEC_NONE	0	/* not compressed */
+#define POOL_CACHE_CODEC_LZ4	1	/* compressed by LZ4 */
+
 /*
  * "Cache Item header" structure is used to manage each cache item.
- *  (16 bytes)
+ *  (32 bytes)
  */
 typedef struct
 {
 	unsigned int total_length;	/* total length in bytes including myself */
+	unsigned char codec;		/* codec of the data. see above */
+	unsigned char partition;	/* index of the database in the cache
+								 * partition table plus 1, 0 if none */
+	pool_atomic_uint32 refresh_claimed; /* time when a child started to
+										 * refresh the item within
+										 * memqcache_stale_while_revalidate,
+										 * 0 if none */
 	time_t		timestamp;		/* cache creation time */
 	int64		expire;			/* cache expire	duration in seconds */
 }			POOL_CACHE_ITEM_HEADER;
@@ -129,9 +157,10 @@ typedef struct
 #define MAX_VALUE 8192
 #define MAX_KEY 256
 
-extern int	memcached_connect(void);
-extern void memcached_disconnect(void);
+extern int	pool_cache_storage_connect(void);
+extern void pool_cache_storage_disconnect(void);
 extern void memqcache_register(char kind, POOL_CONNECTION * frontend, char *data, int data_len);
+extern void memqcache_register_messages(char *data, int data_len);
 
 /*
  * Cache key
@@ -162,6 +191,7 @@ typedef struct
 								 * memqcache_maxcache */
 	bool		is_discarded;	/* true if this cache entry is discarded */
 	char	   *query;			/* SELECT query */
+	int			expire;			/* cache expire duration in seconds */
 	POOL_INTERNAL_BUFFER *buffer;
 	int			num_oids;
 	POOL_INTERNAL_BUFFER *oids;
@@ -186,8 +216,36 @@ typedef struct
 	time_t		start_time;		/* start time when the statistics begins */
 	long long int num_selects;	/* number of successful SELECTs */
 	long long int num_cache_hits;	/* number of SELECTs extracted from cache */
+	long long int num_evicted_entries;	/* number of cache entries evicted
+										 * to make room for new ones */
 }			POOL_QUERY_CACHE_STATS;
 
+/*
+ * Query cache usage and statistics of each database (cache partition).  An
+ * entry is added when a database is first seen and is never removed.  The
+ * entries are added and the counters are updated holding
+ * QUERY_CACHE_STATS_SEM.  The usage is protected by the query cache lock.
+ */
+#define POOL_CACHE_MAX_PARTITIONS	128
+
+typedef struct
+{
+	char		database[SM_DATABASE];	/* database name */
+	long		quota;			/* max bytes of shmem cache. 0: no limit */
+	long		used_size;		/* bytes used in shmem cache */
+	int			num_cache_entries;	/* number of entries in shmem cache */
+	int			clock_hand;		/* next block to look for entries to evict
+								 * within the quota */
+	long long int num_selects;	/* number of SELECTs not found in cache */
+	long long int num_cache_hits;	/* number of SELECTs found in cache */
+}			POOL_CACHE_PARTITION;
+
+typedef struct
+{
+	int			num_partitions; /* number of used entries */
+	POOL_CACHE_PARTITION partitions[POOL_CACHE_MAX_PARTITIONS];
+}			POOL_CACHE_PARTITION_TABLE;
+
 /*
  * Shared memory cache stats interface.
  */
@@ -203,6 +261,10 @@ typedef struct
 	long		fragment_cache_entries_size;	/* total size of
 												 * fragment(unusable) cache
 												 * entries */
+	long		raw_cache_data_size;	/* total size of cached data before
+										 * compression */
+	long		stored_cache_data_size; /* total size of cached data as
+										 * stored */
 	POOL_QUERY_CACHE_STATS cache_stats;
 }			POOL_SHMEM_STATS;
 
@@ -211,20 +273,28 @@ typedef struct
  *--------------------------------------------------------------------------------
  */
 
-/* Hash element (48 bytes) */
+/* Hash element (32 bytes) */
 typedef struct POOL_HASH_ELEMENT
 {
 	struct POOL_HASH_ELEMENT *next; /* link to next entry */
-	POOL_QUERY_HASH hashkey;	/* MD5 hash key */
+	POOL_QUERY_HASH hashkey;	/* binary hash key */
 	POOL_CACHEID cacheid;		/* logical location of this cache element */
 }			POOL_HASH_ELEMENT;
 
 typedef uint32 POOL_HASH_KEY;
 
-/* Hash header element (16 bytes) */
+/*
+ * Hash header element (16 bytes)
+ *
+ * "version" works as a sequence lock for the hash chain and the cache
+ * items linked from it: it is odd while the chain or any of its items is
+ * being modified and is advanced whenever the modification is done.  This
+ * allows readers to look up and copy cache items without locking, by
+ * checking that the version has not changed while reading.
+ */
 typedef struct
 {
-	POOL_HASH_KEY hashkey;		/* hash key */
+	pool_atomic_uint32 version; /* chain version */
 	POOL_HASH_ELEMENT *element; /* hash element */
 }			POOL_HEADER_ELEMENT;
 
@@ -233,6 +303,8 @@ typedef struct
 {
 	long		nhash;			/* number of hash keys (power of 2) */
 	uint32		mask;			/* mask for hash function */
+	pool_atomic_uint32 epoch;	/* advanced on every invalidation, used to
+								 * validate the local caches of children */
 	POOL_HEADER_ELEMENT elements[1];	/* actual hash elements follows */
 }			POOL_HASH_HEADER;
 
@@ -242,6 +314,162 @@ typedef enum
 	POOL_MEMQ_EXCLUSIVE_LOCK,
 } POOL_MEMQ_LOCK_TYPE;
 
+/*
+ * Query cache lock on shared memory.  Shared lockers are counted in per
+ * process stripes, each occupying its own cache line.  The first
+ * POOL_MEMQ_LOCK_AUX_STRIPES stripes are taken by processes other than
+ * child processes on demand, the others belong to the child processes.
+ */
+#define POOL_MEMQ_LOCK_AUX_STRIPES	16
+
+typedef struct
+{
+	pool_atomic_uint32 nreaders;	/* number of shared lock holders */
+	pool_atomic_uint32 owner;	/* pid of the process using the stripe or 0.
+								 * only used for the auxiliary stripes */
+	char		pad[POOL_CACHE_LINE_SIZE - sizeof(pool_atomic_uint32) * 2];
+}			POOL_MEMQ_LOCK_STRIPE;
+
+typedef struct
+{
+	pool_atomic_uint32 writer;	/* pid of exclusive lock holder or 0 */
+	int			nstripes;		/* number of stripes */
+	char		pad[POOL_CACHE_LINE_SIZE - sizeof(pool_atomic_uint32) - sizeof(int)];
+	POOL_MEMQ_LOCK_STRIPE stripes[1];	/* actual stripes follow */
+}			POOL_MEMQ_LOCK;
+
+/*--------------------------------------------------------------------------------
+ * On shared memory table oid map implementation
+ *--------------------------------------------------------------------------------
+ */
+
+/*
+ * Table oid map entry (24 bytes).  Records that the cache item specified by
+ * "cacheid" uses the table.  Entries of the same table are doubly linked by
+ * "prev" and "next".  Entries of the same cache item are linked by
+ * "item_next", starting from oid_map of the cache item pointer.  Unused
+ * entries are linked by "next" in the free list.
+ */
+typedef struct
+{
+	int32		table;			/* index of the table */
+	int32		prev;			/* previous entry of the table */
+	int32		next;			/* next entry of the table */
+	int32		item_next;		/* next entry of the cache item */
+	POOL_CACHEID cacheid;		/* cache item using the table */
+}			POOL_OID_MAP_ENTRY;
+
+/*
+ * Table oid map table (16 bytes).  Tables are hashed by (dboid, tableoid)
+ * and linked by "next" in the hash bucket (or in the free list).
+ */
+typedef struct
+{
+	int			dboid;			/* database oid */
+	int			tableoid;		/* table oid */
+	int32		head;			/* first entry of the table */
+	int32		next;			/* next table in the same bucket */
+}			POOL_OID_MAP_TABLE;
+
+/* Table oid map header */
+typedef struct
+{
+	int32		nentries;		/* number of entries */
+	int32		ntables;		/* number of tables */
+	uint32		mask;			/* (number of buckets) - 1 */
+	int32		free_entry;		/* free list of entries */
+	int32		free_table;		/* free list of tables */
+	int32		buckets[1];		/* hash buckets follow */
+}			POOL_OID_MAP_HEADER;
+
+extern size_t pool_oid_map_size(void);
+extern void pool_init_oid_map(void);
+
+/*--------------------------------------------------------------------------------
+ * Asynchronous query cache invalidation
+ *--------------------------------------------------------------------------------
+ */
+
+#define POOL_INVALIDATION_QUEUE_SIZE	8192	/* must be power of 2 */
+#define POOL_INVALIDATION_BATCH_SIZE	256 /* max requests applied at once */
+
+/*
+ * Invalidation request (16 bytes).  A request for the ticket number "n"
+ * lives in requests[n % POOL_INVALIDATION_QUEUE_SIZE] and is published by
+ * setting seq to n + 1.
+ */
+typedef struct
+{
+	pool_atomic_uint64 seq;		/* ticket number + 1 once published */
+	int			dboid;			/* database oid */
+	int			tableoid;		/* table oid */
+}			POOL_INVALIDATION_REQUEST;
+
+/*
+ * Ring buffer of invalidation requests.  Child processes claim tickets by
+ * advancing "tail" and the query cache invalidation worker consumes them by
+ * advancing "head".  "applied" is advanced after the requests are actually
+ * applied to the cache.
+ */
+typedef struct
+{
+	pool_atomic_uint64 tail;	/* next ticket to be claimed */
+	pool_atomic_uint64 head;	/* next ticket to be consumed */
+	pool_atomic_uint64 applied; /* tickets below this have been applied */
+	pool_atomic_uint32 worker_pid;	/* pid of the invalidation worker */
+	pool_atomic_uint32 sleeping;	/* true if the worker is sleeping */
+	POOL_INVALIDATION_REQUEST requests[POOL_INVALIDATION_QUEUE_SIZE];
+}			POOL_INVALIDATION_QUEUE;
+
+#define POOL_REMOTE_INVALIDATION_QUEUE_SIZE	4096
+
+/*
+ * Invalidation requests to be sent to the other pgpool nodes by the
+ * watchdog.  Protected by WD_QCACHE_INVALIDATION_SEM.
+ */
+typedef struct
+{
+	bool		overflow;		/* true if requests have been dropped */
+	int			num_requests;
+	int			dboids[POOL_REMOTE_INVALIDATION_QUEUE_SIZE];
+	int			tableoids[POOL_REMOTE_INVALIDATION_QUEUE_SIZE];
+}			POOL_REMOTE_INVALIDATION_QUEUE;
+
+/*
+ * SELECT which missed the shmem cache and is running on backend, so that
+ * other children missing the cache for the same query wait for its result
+ * to be cached instead of running the same query.  One entry per child.
+ */
+typedef struct
+{
+	pool_atomic_uint32 active;	/* true while the query is running */
+	time_t		started;		/* time when the query started */
+	POOL_QUERY_HASH query_hash; /* cache key of the query */
+}			POOL_CACHE_INFLIGHT;
+
+extern size_t pool_cache_inflight_size(void);
+extern void pool_init_cache_inflight(void);
+extern void pool_release_cache_inflight(void);
+
+extern bool pool_is_async_invalidation(void);
+extern size_t pool_invalidation_queue_size(void);
+extern void pool_init_invalidation_queue(void);
+extern bool pool_enqueue_query_cache_invalidation(int dboid, int num_table_oids, int *table_oids);
+extern bool pool_wait_for_query_cache_invalidation(void);
+extern void pool_invalidation_worker_exited(void);
+extern bool pool_apply_pending_query_cache_invalidation(void);
+extern void do_memqcache_invalidator_child(void);
+extern bool pool_is_remote_invalidation(void);
+extern size_t pool_remote_invalidation_queue_size(void);
+extern void pool_init_remote_invalidation_queue(void);
+extern void pool_enqueue_remote_invalidation(int dboid, int num_table_oids, int *table_oids);
+extern int	pool_dequeue_remote_invalidation(int *dboids, int *tableoids, int max, bool *overflow);
+extern void pool_apply_remote_invalidation(int num, int *dboids, int *tableoids);
+extern void pool_invalidate_query_cache_by_table(int dboid, int tableoid);
+
+extern bool pool_is_logical_invalidation(void);
+extern void do_memqcache_decoder_child(void);
+
 extern int	pool_hash_init(int nelements);
 extern size_t pool_hash_size(int nelements);
 extern POOL_CACHEID * pool_hash_search(POOL_QUERY_HASH * key);
@@ -251,8 +479,13 @@ extern uint32 hash_any(unsigned char *k, int keylen);
 extern POOL_STATUS pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 												POOL_CONNECTION_POOL * backend,
 												char *contents, bool *foundp);
+extern POOL_STATUS pool_fetch_paginated_from_memory_cache(POOL_CONNECTION * frontend,
+														  POOL_CONNECTION_POOL * backend,
+														  Node *node, int node_id,
+														  bool *foundp);
 
 extern int pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len);
+extern int pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int expire);
 extern int pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen);
 
 extern bool pool_is_likely_select(char *query);
@@ -288,18 +521,27 @@ extern long long int pool_tmp_stats_count_up_num_selects(void);
 extern long long int pool_tmp_stats_get_num_selects(void);
 extern void pool_tmp_stats_reset_num_selects(void);
 extern POOL_SHMEM_STATS * pool_get_shmem_storage_stats(void);
+extern size_t pool_memqcache_stats_size(void);
+extern POOL_CACHE_PARTITION * pool_get_cache_partitions(int *num_partitions);
 
 extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern void pool_discard_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache);
 extern void pool_discard_current_temp_query_cache(void);
 
+extern size_t pool_shmem_lock_size(void);
+extern void pool_init_shmem_lock(void);
 extern void pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type);
 extern void pool_shmem_unlock(void);
 extern bool pool_is_shmem_lock(void);
+extern void pool_shmem_lock_release_dead_process(int child_id, pid_t pid);
 
 extern void InvalidateQueryCache(int tableoid, int dboid);
 
 extern void pool_init_whole_cache_blocks(void);
 
+extern bool pool_is_memory_cache_snapshot(void);
+extern bool pool_save_memory_cache_snapshot(bool at_shutdown);
+extern void pool_load_memory_cache_snapshot(void);
+
 #endif							/* POOL_MEMQCACHE_H */
@@ -0,0 +1,77 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_memqcache_storage.h: external query cache storage.
+ *
+ */
+
+#ifndef POOL_MEMQCACHE_STORAGE_H
+#define POOL_MEMQCACHE_STORAGE_H
+
+#include "pool_type.h"
+
+/*
+ * Query cache storage other than shmem.  Keys are the 32 byte hash keys
+ * made by encode_key().  Each child process keeps its own connection to
+ * the storage.
+ */
+typedef struct
+{
+	const char *name;
+
+	/* Connect to the storage.  Returns 0 on success, -1 on failure. */
+	int			(*connect) (void);
+	void		(*disconnect) (void);
+
+	/*
+	 * Look up a cache entry.  Returns palloc'd data or NULL if not found.
+	 * *error is set to true if the storage failed.
+	 */
+	char	   *(*get) (const char *key, size_t *len, bool *error);
+
+	/*
+	 * Store a cache entry which expires in "expire" seconds, or never if it
+	 * is 0.  If the storage keeps tags, the entry is tagged with the tables
+	 * of num_oids oids in database dboid.
+	 */
+	bool		(*put) (const char *key, const char *data, size_t len, int expire,
+						int dboid, int num_oids, int *oids);
+
+	/* Delete a cache entry. */
+	void		(*delete) (const char *key);
+
+	/*
+	 * Optional.  Deletes issued between them may be sent at once without
+	 * waiting for each reply.
+	 */
+	void		(*begin_batch) (void);
+	void		(*end_batch) (void);
+
+	/*
+	 * Optional.  Delete the entries tagged with the tables, or with any
+	 * table of the database if num_oids is -1.  If NULL, the entries of
+	 * each table are remembered in the files under memqcache_oiddir.
+	 */
+	void		(*delete_by_tag) (int dboid, int num_oids, int *oids);
+}			POOL_CACHE_STORAGE;
+
+extern POOL_CACHE_STORAGE pool_memcached_storage;
+extern POOL_CACHE_STORAGE pool_redis_storage;
+
+#endif							/* POOL_MEMQCACHE_STORAGE_H */
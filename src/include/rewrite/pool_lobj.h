@@ -27,6 +27,8 @@
 #define POOL_LOBJ_H
 #include "pool.h"
 
+extern size_t pool_lobj_shmem_size(void);
+extern void pool_init_lobj_oid_range(void);
 extern char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len, POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int *len);
 
 #endif							/* POOL_LOBJ_H */
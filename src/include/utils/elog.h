@@ -183,10 +183,35 @@ typedef enum
  * prevents gcc from making the unreachability deduction at optlevel -O0.
  *----------
  */
+/*----------
+ * Debug messages below POOL_LOG_FLOOR, which is set by configure option
+ * --with-log-floor, are never output.  ereport() and elog() of such a
+ * constant level are optimized away by the compiler, arguments included.
+ *
+ * elog() of a debug level first asks message_level_is_interesting() before
+ * setting up the error data and formatting the message, which is mostly
+ * unnecessary since debug messages are usually disabled.  ereport() gets
+ * this from errstart() already, as the arguments are evaluated only after
+ * errstart() returns true.
+ *----------
+ */
+#ifndef POOL_LOG_FLOOR
+#define POOL_LOG_FLOOR DEBUG5
+#endif
+
+#define pool_log_level_compiled(elevel) ((elevel) >= POOL_LOG_FLOOR)
+
+#ifdef __GNUC__
+#define pool_log_unlikely(x) __builtin_expect((x) != 0, 0)
+#else
+#define pool_log_unlikely(x) ((x) != 0)
+#endif
+
 #ifdef HAVE__BUILTIN_CONSTANT_P
 #define ereport_domain(elevel, domain, rest)	\
 	do { \
-		if (errstart(elevel, __FILE__, __LINE__, PG_FUNCNAME_MACRO, domain)) \
+		if (pool_log_level_compiled(elevel) && \
+			errstart(elevel, __FILE__, __LINE__, PG_FUNCNAME_MACRO, domain)) \
 			errfinish rest; \
 		if (__builtin_constant_p(elevel) && (elevel) >= ERROR && (elevel) != FRONTEND_ONLY_ERROR) \
 			pg_unreachable(); \
@@ -195,7 +220,8 @@ typedef enum
 #define ereport_domain(elevel, domain, rest)	\
 	do { \
 		const int elevel_ = (elevel); \
-		if (errstart(elevel_, __FILE__, __LINE__, PG_FUNCNAME_MACRO, domain)) \
+		if (pool_log_level_compiled(elevel_) && \
+			errstart(elevel_, __FILE__, __LINE__, PG_FUNCNAME_MACRO, domain)) \
 			errfinish rest; \
 		if (elevel_ >= ERROR  && elevel_ != FRONTEND_ONLY_ERROR) \
 			pg_unreachable(); \
@@ -308,28 +334,36 @@ extern int	getinternalerrposition(void);
  *		elog(ERROR, "portal \"%s\" not found", stmt->portalname);
  *----------
  */
-#ifdef HAVE__VA_ARGS
+#if defined(HAVE__VA_ARGS) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
 /*
  * If we have variadic macros, we can give the compiler a hint about the
  * call not returning when elevel >= ERROR.  See comments for ereport().
- * Note that historically elog() has called elog_start (which saves errno)
- * before evaluating "elevel", so we preserve that behavior here.
+ * configure does not check for them, but any C99 compiler has them.
  */
 #ifdef HAVE__BUILTIN_CONSTANT_P
 #define elog(elevel, ...)  \
 	do { \
-		elog_start(__FILE__, __LINE__, PG_FUNCNAME_MACRO); \
-		elog_finish(elevel, __VA_ARGS__); \
+		if (pool_log_level_compiled(elevel) && \
+			((elevel) > DEBUG1 || \
+			 pool_log_unlikely(message_level_is_interesting(elevel)))) \
+		{ \
+			elog_start(__FILE__, __LINE__, PG_FUNCNAME_MACRO); \
+			elog_finish(elevel, __VA_ARGS__); \
+		} \
 		if (__builtin_constant_p(elevel) && (elevel) >= ERROR  && (elevel) != FRONTEND_ONLY_ERROR) \
 			pg_unreachable(); \
 	} while(0)
 #else							/* !HAVE__BUILTIN_CONSTANT_P */
 #define elog(elevel, ...)  \
 	do { \
-		int		elevel_; \
-		elog_start(__FILE__, __LINE__, PG_FUNCNAME_MACRO); \
-		elevel_ = (elevel); \
-		elog_finish(elevel_, __VA_ARGS__); \
+		int		elevel_ = (elevel); \
+		if (pool_log_level_compiled(elevel_) && \
+			(elevel_ > DEBUG1 || \
+			 pool_log_unlikely(message_level_is_interesting(elevel_)))) \
+		{ \
+			elog_start(__FILE__, __LINE__, PG_FUNCNAME_MACRO); \
+			elog_finish(elevel_, __VA_ARGS__); \
+		} \
 		if (elevel_ >= ERROR  && (elevel) != FRONTEND_ONLY_ERROR) \
 			pg_unreachable(); \
 	} while(0)
@@ -503,6 +537,7 @@ typedef enum
 #define LOG_DESTINATION_SYSLOG	 2
 #define LOG_DESTINATION_EVENTLOG 4
 #define LOG_DESTINATION_CSVLOG	 8
+#define LOG_DESTINATION_JSONLOG	16
 
 extern bool in_error_recursion_trouble(void);
 
@@ -0,0 +1,153 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_atomic.h: atomic operations on shared memory variables.
+ *
+ * This is a tiny subset of PostgreSQL's port/atomics.h built on top of
+ * the GCC __atomic builtins (also provided by clang).  All operations
+ * are sequentially consistent unless noted otherwise, which is what
+ * the callers in pgpool expect.
+ */
+
+#ifndef POOL_ATOMIC_H
+#define POOL_ATOMIC_H
+
+#include "pool_type.h"
+
+/* Size of a CPU cache line.  Used to avoid false sharing. */
+#define POOL_CACHE_LINE_SIZE	64
+
+typedef struct
+{
+	volatile uint32 value;
+}			pool_atomic_uint32;
+
+typedef struct
+{
+	volatile uint64 value __attribute__((aligned(8)));
+}			pool_atomic_uint64;
+
+#define pool_memory_barrier()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define pool_read_barrier()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define pool_write_barrier()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+/*
+ * Hint to the CPU that we are in a spin loop.
+ */
+static inline void
+pool_spin_delay(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__(" rep; nop			\n");
+#elif defined(__aarch64__)
+	__asm__ __volatile__(" isb;				\n");
+#endif
+}
+
+static inline void
+pool_atomic_init_u32(volatile pool_atomic_uint32 * ptr, uint32 val)
+{
+	__atomic_store_n(&ptr->value, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32
+pool_atomic_read_u32(volatile pool_atomic_uint32 * ptr)
+{
+	return __atomic_load_n(&ptr->value, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+pool_atomic_write_u32(volatile pool_atomic_uint32 * ptr, uint32 val)
+{
+	__atomic_store_n(&ptr->value, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32
+pool_atomic_fetch_add_u32(volatile pool_atomic_uint32 * ptr, int32 add)
+{
+	return __atomic_fetch_add(&ptr->value, add, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32
+pool_atomic_fetch_sub_u32(volatile pool_atomic_uint32 * ptr, int32 sub)
+{
+	return __atomic_fetch_sub(&ptr->value, sub, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Atomically set *ptr to newval and return the old value.
+ */
+static inline uint32
+pool_atomic_exchange_u32(volatile pool_atomic_uint32 * ptr, uint32 newval)
+{
+	return __atomic_exchange_n(&ptr->value, newval, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Atomically compare *ptr with *expected and, if equal, set *ptr to
+ * newval.  Returns true on success.  On failure the current value is
+ * stored into *expected.
+ */
+static inline bool
+pool_atomic_compare_exchange_u32(volatile pool_atomic_uint32 * ptr,
+								 uint32 *expected, uint32 newval)
+{
+	return __atomic_compare_exchange_n(&ptr->value, expected, newval, false,
+									   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+pool_atomic_init_u64(volatile pool_atomic_uint64 * ptr, uint64 val)
+{
+	__atomic_store_n(&ptr->value, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64
+pool_atomic_read_u64(volatile pool_atomic_uint64 * ptr)
+{
+	return __atomic_load_n(&ptr->value, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+pool_atomic_write_u64(volatile pool_atomic_uint64 * ptr, uint64 val)
+{
+	__atomic_store_n(&ptr->value, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64
+pool_atomic_fetch_add_u64(volatile pool_atomic_uint64 * ptr, int64 add)
+{
+	return __atomic_fetch_add(&ptr->value, add, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64
+pool_atomic_fetch_sub_u64(volatile pool_atomic_uint64 * ptr, int64 sub)
+{
+	return __atomic_fetch_sub(&ptr->value, sub, __ATOMIC_SEQ_CST);
+}
+
+static inline bool
+pool_atomic_compare_exchange_u64(volatile pool_atomic_uint64 * ptr,
+								 uint64 *expected, uint64 newval)
+{
+	return __atomic_compare_exchange_n(&ptr->value, expected, newval, false,
+									   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif							/* POOL_ATOMIC_H */
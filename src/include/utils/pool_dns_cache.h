@@ -0,0 +1,34 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_dns_cache.h: host names of client addresses shared among child
+ * processes.
+ *
+ */
+
+#ifndef POOL_DNS_CACHE_H
+#define POOL_DNS_CACHE_H
+
+#include "pool.h"
+
+extern size_t pool_dns_cache_shmem_size(void);
+extern void pool_init_dns_cache(void);
+extern bool pool_dns_cache_lookup(SockAddr *raddr, char *hostname, int size, int *resolv);
+extern void pool_dns_cache_store(SockAddr *raddr, const char *hostname, int resolv);
+
+#endif							/* POOL_DNS_CACHE_H */
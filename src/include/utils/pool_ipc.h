@@ -32,7 +32,7 @@ extern void on_exit_reset(void);
 /*pool_sema.c*/
 extern void pool_semaphore_create(int numSems);
 extern void pool_semaphore_lock(int semNum);
-extern int	pool_semaphore_lock_allow_interrupt(int semNum);
+extern int	pool_semaphore_lock_timeout(int semNum, int msec);
 extern void pool_semaphore_unlock(int semNum);
 
 #endif							/* IPC_H */
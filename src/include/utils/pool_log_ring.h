@@ -0,0 +1,42 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_log_ring.h: per child log rings drained by the logger process.
+ *
+ */
+
+#ifndef POOL_LOG_RING_H
+#define POOL_LOG_RING_H
+
+#include "pool.h"
+#include "pool_config.h"
+
+/* How often the logger process drains the rings, in milliseconds */
+#define LOG_RING_DRAIN_INTERVAL	100
+
+#define pool_log_ring_enabled() \
+	(pool_config->logging_collector && pool_config->log_ring_size > 0)
+
+extern void pool_init_log_rings(void);
+extern void pool_log_ring_attach(int child_id);
+extern bool pool_log_ring_write(const char *data, int len);
+extern void pool_log_ring_drain(void);
+extern uint64 pool_log_ring_dropped(void);
+
+#endif							/* POOL_LOG_RING_H */
@@ -0,0 +1,123 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_msgbuf.h: builder of protocol messages sent to frontend
+ *
+ */
+
+#ifndef POOL_MSGBUF_H
+#define POOL_MSGBUF_H
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "pool.h"
+
+/*
+ * Size of the buffer embedded in POOL_MSGBUF.  Messages built by pgpool
+ * itself rarely exceed it, so that usually nothing is allocated.
+ */
+#define POOL_MSGBUF_INLINE_SIZE 1024
+
+/* Enough for the text of any int64, including the sign and NUL */
+#define POOL_INT64_TEXT_SIZE 21
+
+/*
+ * Buffer in which one or more protocol messages are assembled before being
+ * given to pool_write() in one call.  Usage:
+ *
+ *		POOL_MSGBUF buf;
+ *
+ *		pool_msgbuf_init(&buf);
+ *		pool_msgbuf_begin(&buf, 'C');
+ *		pool_msgbuf_string(&buf, "SELECT 1");
+ *		pool_msgbuf_end(&buf);
+ *		pool_msgbuf_write(frontend, &buf);
+ *		pool_msgbuf_free(&buf);
+ *
+ * pool_msgbuf_begin() puts the message kind and a place holder of the
+ * length, which pool_msgbuf_end() fills in.  Protocol V2 messages, which
+ * have no length, are built with pool_msgbuf_byte() instead.
+ */
+typedef struct
+{
+	char	   *data;			/* contents, inline_data unless enlarged */
+	int			len;			/* number of bytes used */
+	int			maxlen;			/* allocated size of data */
+	int			msgstart;		/* offset of the length of the message
+								 * being built, or -1 */
+	char		inline_data[POOL_MSGBUF_INLINE_SIZE];
+}			POOL_MSGBUF;
+
+extern void pool_msgbuf_init(POOL_MSGBUF * buf);
+extern void pool_msgbuf_free(POOL_MSGBUF * buf);
+extern void pool_msgbuf_enlarge(POOL_MSGBUF * buf, int needed);
+extern void pool_msgbuf_begin(POOL_MSGBUF * buf, char kind);
+extern void pool_msgbuf_end(POOL_MSGBUF * buf);
+extern void pool_msgbuf_string(POOL_MSGBUF * buf, const char *str);
+extern void pool_msgbuf_string_max(POOL_MSGBUF * buf, const char *str, int maxlen);
+extern void pool_msgbuf_field(POOL_MSGBUF * buf, const char *str);
+extern void pool_msgbuf_int_text(POOL_MSGBUF * buf, int64 value);
+extern void pool_msgbuf_write(POOL_CONNECTION * cp, POOL_MSGBUF * buf);
+extern int	pool_int64_to_text(int64 value, char *out);
+
+/*
+ * Make room for needed more bytes.
+ */
+static inline void
+pool_msgbuf_reserve(POOL_MSGBUF * buf, int needed)
+{
+	if (buf->len + needed > buf->maxlen)
+		pool_msgbuf_enlarge(buf, needed);
+}
+
+static inline void
+pool_msgbuf_byte(POOL_MSGBUF * buf, char c)
+{
+	pool_msgbuf_reserve(buf, 1);
+	buf->data[buf->len++] = c;
+}
+
+static inline void
+pool_msgbuf_bytes(POOL_MSGBUF * buf, const void *data, int len)
+{
+	pool_msgbuf_reserve(buf, len);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+/* Put a 16 bit integer in network byte order */
+static inline void
+pool_msgbuf_int16(POOL_MSGBUF * buf, int16 value)
+{
+	uint16		n = htons((uint16) value);
+
+	pool_msgbuf_bytes(buf, &n, sizeof(n));
+}
+
+/* Put a 32 bit integer in network byte order */
+static inline void
+pool_msgbuf_int32(POOL_MSGBUF * buf, int32 value)
+{
+	uint32		n = htonl((uint32) value);
+
+	pool_msgbuf_bytes(buf, &n, sizeof(n));
+}
+
+#endif							/* POOL_MSGBUF_H */
@@ -26,6 +26,9 @@ typedef struct
 	int			num;			/* number of entries */
 	char	  **names;			/* parameter names */
 	char	  **values;			/* values */
+	char	   *messages;		/* all the entries as ParameterStatus
+								 * messages, NULL if not built yet */
+	int			messages_len;	/* length of messages */
 }			ParamStatus;
 
 extern int	pool_init_params(ParamStatus * params);
@@ -34,6 +37,7 @@ extern char *pool_find_name(ParamStatus * params, char *name, int *pos);
 extern int	pool_get_param(ParamStatus * params, int index, char **name, char **value);
 extern int	pool_add_param(ParamStatus * params, char *name, char *value);
 extern void pool_param_debug_print(ParamStatus * params);
+extern char *pool_get_param_messages(ParamStatus * params, int *len);
 
 
 #endif /* pool_params_h */
@@ -0,0 +1,31 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_parse_cache.h: per process parse tree cache.
+ *
+ */
+
+#ifndef POOL_PARSE_CACHE_H
+#define POOL_PARSE_CACHE_H
+
+#include "parser/pg_list.h"
+
+extern List *pool_parse_cache_raw_parser(const char *str, int len, bool *error, bool use_minimal);
+
+#endif							/* POOL_PARSE_CACHE_H */
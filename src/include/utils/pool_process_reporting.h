@@ -36,15 +36,21 @@ extern POOL_REPORT_NODES * get_nodes(int *nrows, int node_id);
 extern POOL_REPORT_VERSION * get_version(void);
 extern POOL_HEALTH_CHECK_STATS *get_health_check_stats(int *nrows);
 extern POOL_BACKEND_STATS *get_backend_stats(int *nrows);
+extern POOL_PROCESS_MANAGEMENT_STATS *get_process_management_stats(int *nrows);
+extern POOL_REPORT_MEMORY *get_memory_usage(int *nrows);
 
 extern void config_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
-extern void pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool active_only);
+extern void pools_summary_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void processes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void nodes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void version_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void show_process_management_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void show_statement_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void show_memory_usage(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 
 
 extern void send_config_var_detail_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *name, const char *value, const char *description);
@@ -36,14 +36,22 @@
 
 typedef void *(*func_ptr) ();
 
+/*
+ * Every child has its own relcaches, so an entry is kept small.  The names
+ * are allocated in one chunk pointed to by dbname when the entry is stored,
+ * rather than reserving MAX_ITEM_LENGTH bytes for each in every entry.
+ */
 typedef struct
 {
-	char		dbname[MAX_ITEM_LENGTH];	/* database name */
-	char		relname[MAX_ITEM_LENGTH];	/* table name */
+	char	   *dbname;			/* database name, NULL if never used */
+	char	   *relname;		/* table name, in the chunk of dbname */
 	void	   *data;			/* user data */
-	int			refcnt;			/* reference count */
+	bool		valid;			/* true if in use */
+	uint32		hashval;		/* hash of dbname, relname and session_id */
 	int			session_id;		/* LocalSessionId */
 	time_t		expire;			/* cache expiration absolute time in seconds */
+	int			lru_prev;		/* more recently used entry or -1 */
+	int			lru_next;		/* less recently used entry or -1 */
 }			PoolRelCache;
 
 #define	MAX_QUERY_LENGTH	1500
@@ -69,6 +77,18 @@ typedef struct
 	bool		no_cache_if_zero;	/* if register func returns 0, do not
 									 * cache the data */
 	PoolRelCache *cache;		/* cache data */
+
+	/*
+	 * Open addressing hash index over cache.  Each element is an index into
+	 * cache or -1 if empty.  index_size is a power of 2 at least twice as
+	 * large as num so that probe sequences stay short.
+	 */
+	int		   *index;
+	int			index_size;
+	int			lru_head;		/* most recently used entry */
+	int			lru_tail;		/* least recently used entry, replaced first */
+	uint32		generation;		/* shared relcache generation the entries
+								 * belong to */
 }			POOL_RELCACHE;
 
 extern POOL_RELCACHE * pool_create_relcache(int cachesize, char *sql,
@@ -76,6 +96,9 @@ extern POOL_RELCACHE * pool_create_relcache(int cachesize, char *sql,
 											bool issessionlocal);
 extern void pool_discard_relcache(POOL_RELCACHE * relcache);
 extern void *pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table);
+extern bool pool_relcache_lookup(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table, void **data);
+extern void pool_relcache_add(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table, void *data);
+extern bool pool_relcache_query(POOL_CONNECTION_POOL * backend, char *query, POOL_SELECT_RESULT * *res);
 extern char *remove_quotes_and_schema_from_relname(char *table);
 extern void *int_register_func(POOL_SELECT_RESULT * res);
 extern void *int_unregister_func(void *data);
@@ -53,6 +53,37 @@ typedef struct
 	char		table_names[POOL_MAX_SELECT_OIDS][NAMEDATALEN];	/* table names */
 }			SelectContext;
 
+/*
+ * Properties of a SELECT statement computed by pool_select_has_property()
+ */
+#define SELECT_PROP_FUNCTION_CALL			0x01	/* write function call */
+#define SELECT_PROP_SYSTEM_CATALOG			0x02	/* system catalog */
+#define SELECT_PROP_TEMP_TABLE				0x04	/* temporary table */
+#define SELECT_PROP_UNLOGGED_TABLE			0x08	/* unlogged table */
+#define SELECT_PROP_VIEW					0x10	/* view */
+#define SELECT_PROP_INSERTINTO_OR_LOCKING	0x20	/* SELECT INTO or FOR
+													 * SHARE/UPDATE */
+#define SELECT_PROP_NON_IMMUTABLE_FUNCTION	0x40	/* non immutable function
+													 * call */
+
+typedef struct
+{
+	Node	   *node;			/* SELECT (or PREPARE of it) */
+	bool		walked;			/* true if node has been walked */
+	bool		is_select;		/* true if node is (or prepares) SELECT */
+	bool		is_prepare;		/* true if node is PrepareStmt */
+	int			evaluated;		/* bitmap of evaluated SELECT_PROP_* */
+	int			found;			/* bitmap of SELECT_PROP_* the query has */
+	List	   *rangevars;		/* RangeVars referenced by the query */
+	List	   *funccalls;		/* FuncCalls in the query */
+	bool		has_insertinto_or_locking_clause;	/* IntoClause or
+													 * LockingClause found */
+	bool		has_non_immutable_expr; /* timestamptz/timetz cast or
+										 * SQLValueFunction found */
+}			SelectProperties;
+
+extern void pool_init_select_properties(SelectProperties * props, Node *node);
+extern bool pool_select_has_property(SelectProperties * props, int property);
 extern int	pool_get_terminate_backend_pid(Node *node);
 extern bool pool_has_function_call(Node *node);
 extern bool pool_has_non_immutable_function_call(Node *node);
@@ -66,12 +97,16 @@ extern bool pool_has_pgpool_regclass(void);
 extern bool pool_has_to_regclass(void);
 extern bool raw_expression_tree_walker(Node *node, bool (*walker) (), void *context);
 extern int	pool_table_name_to_oid(char *table_name);
+extern void pool_prefetch_relcache(Node *node);
 extern int	pool_extract_table_oids_from_select_stmt(Node *node, SelectContext * ctx);
 extern RangeVar *makeRangeVarFromNameList(List *names);
 extern char *make_table_name_from_rangevar(RangeVar *rangevar);
 extern char *make_function_name_from_funccall(FuncCall *fcall);
 extern int	pattern_compare(char *str, const int type, const char *param_name);
+extern int	memqcache_table_ttl(char *table_name);
 extern bool is_unlogged_table(char *table_name);
 extern bool is_view(char *table_name);
+extern bool pool_changes_session_state(Node *node);
+extern int	pool_select_query_weight(Node *node);
 
 #endif							/* POOL_SELECT_WALKER_H */
@@ -0,0 +1,35 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_shard_routing.h: routing statements on sharded tables by key.
+ *
+ */
+
+#ifndef POOL_SHARD_ROUTING_H
+#define POOL_SHARD_ROUTING_H
+
+#include "parser/nodes.h"
+
+/* results of pool_shard_route() other than a node id */
+#define SHARD_ROUTE_NONE	-1	/* no sharded table involved */
+#define SHARD_ROUTE_ALL		-2	/* send to all shards */
+#define SHARD_ROUTE_REJECT	-3	/* cannot be routed */
+
+extern int	pool_shard_route(Node *node, const char **reason);
+
+#endif							/* POOL_SHARD_ROUTING_H */
@@ -0,0 +1,42 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_shared_relcache.h: relation cache shared among child processes.
+ *
+ */
+
+#ifndef POOL_SHARED_RELCACHE_H
+#define POOL_SHARED_RELCACHE_H
+
+#include "pool.h"
+
+extern size_t pool_shared_relcache_shmem_size(void);
+extern void pool_init_shared_relcache(void);
+extern bool pool_is_shared_relcache(void);
+extern bool pool_is_relcache_background_refresh(void);
+extern bool pool_need_relcache_refresh_worker(void);
+extern bool pool_shared_relcache_server_version(int node_id, char *buf, int size);
+extern uint32 pool_shared_relcache_generation(void);
+extern POOL_SELECT_RESULT * pool_shared_relcache_search(char *dbname, char *query);
+extern void pool_shared_relcache_add(char *dbname, char *query, POOL_SELECT_RESULT * res, uint32 generation);
+extern void pool_shared_relcache_invalidate(void);
+extern void pool_relcache_refresh_worker_exited(void);
+extern void do_relcache_refresh_child(void);
+
+#endif							/* POOL_SHARED_RELCACHE_H */
@@ -0,0 +1,38 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_stage.h: what a child process is doing and the time spent on it.
+ *
+ */
+
+#ifndef POOL_STAGE_H
+#define POOL_STAGE_H
+
+#include "pcp/libpcp_ext.h"
+
+/* stage of waiting for data from, or sending data to, a connection */
+#define POOL_STAGE_READ(cp)		((cp)->isbackend ? POOL_STAGE_BACKEND_WAIT : POOL_STAGE_CLIENT_READ)
+#define POOL_STAGE_WRITE(cp)	((cp)->isbackend ? POOL_STAGE_BACKEND_WAIT : POOL_STAGE_CLIENT_WRITE)
+
+extern void pool_stage_init(void);
+extern PoolStage pool_stage_enter(PoolStage stage);
+extern void pool_stage_leave(PoolStage prev);
+extern void pool_stage_reset(void);
+extern const char *pool_stage_name(PoolStage stage);
+
+#endif							/* POOL_STAGE_H */
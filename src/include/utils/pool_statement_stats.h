@@ -0,0 +1,38 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_statement_stats.h: per statement statistics.
+ *
+ */
+
+#ifndef POOL_STATEMENT_STATS_H
+#define POOL_STATEMENT_STATS_H
+
+#include "pool.h"
+
+extern size_t pool_statement_stats_shmem_size(void);
+extern void pool_init_statement_stats(void);
+extern int	pool_statement_stats_slot(const char *query);
+extern void pool_statement_stats_record(int slot, int backend_node_id, uint64 elapsed);
+extern void pool_statement_stats_add_rows(int slot, uint64 rows);
+extern void pool_statement_stats_count_cache(int slot, bool hit);
+extern void pool_statement_stats_reset(void);
+extern POOL_STATEMENT_STATS *pool_get_statement_stats(int *nrows);
+
+#endif							/* POOL_STATEMENT_STATS_H */
@@ -26,11 +26,27 @@
 #ifndef POOL_STREAM_H
 #define POOL_STREAM_H
 
+#include <poll.h>
+
 #include "utils/socket_stream.h"
 
 #define READBUFSZ 1024
+
+/*
+ * poll(2) events corresponding to the "readable" and "exceptional"
+ * conditions of select(2).  Errors and hang ups are reported as readable so
+ * that the following read(2) finds them, like select(2) does.
+ */
+#define POOL_POLL_READ_EVENTS	(POLLIN | POLLHUP | POLLERR)
+#define POOL_POLL_EXCEPT_EVENTS	(POLLPRI | POLLNVAL)
 #define WRITEBUFSZ 8192
 
+/*
+ * Connection buffers grown beyond this by a large message are given back
+ * by pool_shrink_buffers().
+ */
+#define POOL_BUFFER_SHRINK_THRESHOLD	(64 * 1024)
+
 /*
  * Return true if read buffer is empty. Argument is POOL_CONNECTION.
  */
@@ -51,6 +67,11 @@ extern void pool_read_with_error(POOL_CONNECTION * cp, void *buf, int len,
 					 const char *err_context);
 
 extern char *pool_read2(POOL_CONNECTION * cp, int len);
+extern int	pool_read_ahead_noerror(POOL_CONNECTION * cp);
+extern int	pool_count_buffered_messages(POOL_CONNECTION * cp, char kind, int maxcount);
+extern char *pool_read_buffered_messages(POOL_CONNECTION * cp, char kind, int maxcount,
+										 int *count, int *len);
+extern char pool_next_buffered_kind(POOL_CONNECTION * cp);
 extern int	pool_write(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_flush(POOL_CONNECTION * cp);
@@ -63,11 +84,14 @@ extern int	pool_unread(POOL_CONNECTION * cp, void *data, int len);
 extern int	pool_push(POOL_CONNECTION * cp, void *data, int len);
 extern void pool_pop(POOL_CONNECTION * cp, int *len);
 extern int	pool_stacklen(POOL_CONNECTION * cp);
+extern void pool_shrink_buffers(POOL_CONNECTION * cp);
+extern int	pool_buffer_memory(POOL_CONNECTION * cp);
 
 extern void pool_set_db_node_id(POOL_CONNECTION * con, int db_node_id);
 
 extern void pool_set_timeout(int timeoutval);
 extern int	pool_get_timeout(void);
 extern int	pool_check_fd(POOL_CONNECTION * cp);
+extern int	pool_check_fds(POOL_CONNECTION * *cps, int num, int msec);
 
 #endif							/* POOL_STREAM_H */
@@ -0,0 +1,44 @@
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_timer.h: timers of a process run from its wait loop.
+ *
+ */
+
+#ifndef POOL_TIMER_H
+#define POOL_TIMER_H
+
+#include "pool_type.h"
+
+typedef enum
+{
+	POOL_TIMER_CONNECTION_LIFE_TIME = 0,	/* expiration of cached
+											 * connections */
+	POOL_TIMER_NUM
+}			PoolTimerId;
+
+typedef void (*pool_timer_callback) (void);
+
+extern uint64 pool_timer_now(void);
+extern void pool_timer_set(PoolTimerId id, int64 msec, pool_timer_callback callback);
+extern void pool_timer_cancel(PoolTimerId id);
+extern int64 pool_timer_remaining(PoolTimerId id);
+extern int	pool_timer_next_timeout(int timeout);
+extern void pool_timer_run_expired(void);
+
+#endif							/* POOL_TIMER_H */
@@ -0,0 +1,101 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_trace.h: static trace points (USDT probes).
+ *
+ * If pgpool is configured with --enable-dtrace, each TRACE_PGPOOL_ macro
+ * below becomes a probe of provider "pgpool" which tools such as bpftrace,
+ * perf and SystemTap can attach to in a running process, e.g.
+ * usdt:/usr/local/bin/pgpool:pgpool:route__start.  An unattached probe is
+ * a single nop instruction.  Otherwise the macros are empty.
+ *
+ * Probes come in start/done pairs, so that the time spent between them can
+ * be measured.  A start probe may not be followed by its done probe if an
+ * error is raised in between.
+ */
+
+#ifndef POOL_TRACE_H
+#define POOL_TRACE_H
+
+#ifdef ENABLE_DTRACE
+
+#include <sys/sdt.h>
+
+/* a message from the frontend is processed by ProcessFrontendResponse() */
+#define TRACE_PGPOOL_FRONTEND_MESSAGE_START(kind, len) \
+	DTRACE_PROBE2(pgpool, frontend__message__start, kind, len)
+#define TRACE_PGPOOL_FRONTEND_MESSAGE_DONE(kind, status) \
+	DTRACE_PROBE2(pgpool, frontend__message__done, kind, status)
+
+/* read_kind_from_backend() waits for the next message kind from backends */
+#define TRACE_PGPOOL_BACKEND_READ_START() \
+	DTRACE_PROBE(pgpool, backend__read__start)
+#define TRACE_PGPOOL_BACKEND_READ_DONE(kind) \
+	DTRACE_PROBE1(pgpool, backend__read__done, kind)
+
+/* pool_where_to_send() decides the nodes to send a query to */
+#define TRACE_PGPOOL_ROUTE_START(query) \
+	DTRACE_PROBE1(pgpool, route__start, query)
+#define TRACE_PGPOOL_ROUTE_DONE(main_node_id, load_balance_node_id) \
+	DTRACE_PROBE2(pgpool, route__done, main_node_id, load_balance_node_id)
+
+/* pool_fetch_from_memory_cache() looks up the query cache */
+#define TRACE_PGPOOL_CACHE_FETCH_START(query) \
+	DTRACE_PROBE1(pgpool, cache__fetch__start, query)
+#define TRACE_PGPOOL_CACHE_FETCH_DONE(found) \
+	DTRACE_PROBE1(pgpool, cache__fetch__done, found)
+
+/* pool_get_cp() looks for a pooled connection */
+#define TRACE_PGPOOL_POOL_GET_START(user, database) \
+	DTRACE_PROBE2(pgpool, pool__get__start, user, database)
+#define TRACE_PGPOOL_POOL_GET_DONE(found) \
+	DTRACE_PROBE1(pgpool, pool__get__done, found)
+
+/* new_connection() connects to backends */
+#define TRACE_PGPOOL_CONNECTION_NEW_START() \
+	DTRACE_PROBE(pgpool, connection__new__start)
+#define TRACE_PGPOOL_CONNECTION_NEW_DONE(num_connected) \
+	DTRACE_PROBE1(pgpool, connection__new__done, num_connected)
+
+/* failover() processes failover, failback and promote requests */
+#define TRACE_PGPOOL_FAILOVER_START() \
+	DTRACE_PROBE(pgpool, failover__start)
+#define TRACE_PGPOOL_FAILOVER_DONE(main_node_id, primary_node_id) \
+	DTRACE_PROBE2(pgpool, failover__done, main_node_id, primary_node_id)
+
+#else							/* !ENABLE_DTRACE */
+
+#define TRACE_PGPOOL_FRONTEND_MESSAGE_START(kind, len)	do {} while (0)
+#define TRACE_PGPOOL_FRONTEND_MESSAGE_DONE(kind, status)	do {} while (0)
+#define TRACE_PGPOOL_BACKEND_READ_START()	do {} while (0)
+#define TRACE_PGPOOL_BACKEND_READ_DONE(kind)	do {} while (0)
+#define TRACE_PGPOOL_ROUTE_START(query)	do {} while (0)
+#define TRACE_PGPOOL_ROUTE_DONE(main_node_id, load_balance_node_id)	do {} while (0)
+#define TRACE_PGPOOL_CACHE_FETCH_START(query)	do {} while (0)
+#define TRACE_PGPOOL_CACHE_FETCH_DONE(found)	do {} while (0)
+#define TRACE_PGPOOL_POOL_GET_START(user, database)	do {} while (0)
+#define TRACE_PGPOOL_POOL_GET_DONE(found)	do {} while (0)
+#define TRACE_PGPOOL_CONNECTION_NEW_START()	do {} while (0)
+#define TRACE_PGPOOL_CONNECTION_NEW_DONE(num_connected)	do {} while (0)
+#define TRACE_PGPOOL_FAILOVER_START()	do {} while (0)
+#define TRACE_PGPOOL_FAILOVER_DONE(main_node_id, primary_node_id)	do {} while (0)
+
+#endif							/* ENABLE_DTRACE */
+
+#endif							/* POOL_TRACE_H */
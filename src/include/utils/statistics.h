@@ -21,11 +21,34 @@
 #ifndef statistics_h
 #define statistics_h
 
+/*
+ * Statement types query latency is recorded for.  STAT_QUERY_ALL asks for
+ * the latency of all types together.
+ */
+typedef enum
+{
+	STAT_QUERY_SELECT,
+	STAT_QUERY_INSERT,
+	STAT_QUERY_UPDATE,
+	STAT_QUERY_DELETE,
+	STAT_QUERY_DDL,
+	STAT_QUERY_OTHER,
+	STAT_NUM_QUERY_TYPES,
+	STAT_QUERY_ALL = STAT_NUM_QUERY_TYPES
+}			STAT_QUERY_TYPE;
+
 extern size_t	stat_shared_memory_size(void);
 extern void		stat_set_stat_area(void *address);
 extern void		stat_init_stat_area(void);
 extern void		stat_count_up(int backend_node_id, Node *parsetree);
+extern bool		stat_is_ddl(Node *parsetree);
 extern void		error_stat_count_up(int backend_node_id, char *str);
+extern void		stat_query_start(int backend_node_id, Node *parsetree, int statement_slot);
+extern int64	stat_query_end(int backend_node_id);
+extern void		stat_query_abandon(int backend_node_id);
+extern void		stat_query_end_all(void);
+extern void		stat_probe_latency(int backend_node_id, uint64 elapsed);
+extern void		stat_queue_wait(int backend_node_id, uint64 elapsed);
 extern uint64	stat_get_select_count(int backend_node_id);
 extern uint64	stat_get_insert_count(int backend_node_id);
 extern uint64	stat_get_update_count(int backend_node_id);
@@ -35,5 +58,14 @@ extern uint64	stat_get_other_count(int backend_node_id);
 extern uint64	stat_get_panic_count(int backend_node_id);
 extern uint64	stat_get_fatal_count(int backend_node_id);
 extern uint64	stat_get_error_count(int backend_node_id);
+extern uint32	stat_get_inflight_count(int backend_node_id);
+extern uint64	stat_get_latency(int backend_node_id);
+extern uint64	stat_get_probe_latency(int backend_node_id);
+extern void		stat_get_latency_percentiles(int backend_node_id, STAT_QUERY_TYPE type,
+											 uint64 *p50, uint64 *p95, uint64 *p99);
+extern uint64	stat_get_latency_percentile(int backend_node_id, STAT_QUERY_TYPE type,
+											int percentile);
+extern void		stat_get_queue_wait_percentiles(int backend_node_id,
+												uint64 *p50, uint64 *p95, uint64 *p99);
 
 #endif /* statistics_h */
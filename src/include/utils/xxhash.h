@@ -0,0 +1,31 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * xxhash.h: XXH64 non-cryptographic hash function.
+ *
+ */
+
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#include "pool_type.h"
+
+extern uint64 pool_xxh64(const void *input, size_t len, uint64 seed);
+
+#endif							/* XXHASH_H */
@@ -57,7 +57,7 @@
  */
 
 #define WD_MESSAGE_DATA_VERSION_MAJOR	"1"
-#define WD_MESSAGE_DATA_VERSION_MINOR	"2"
+#define WD_MESSAGE_DATA_VERSION_MINOR	"3"
 #define WD_MESSAGE_DATA_VERSION	WD_MESSAGE_DATA_VERSION_MAJOR "." WD_MESSAGE_DATA_VERSION_MINOR
 #define MAX_VERSION_STR_LEN		10
 
@@ -28,6 +28,7 @@
 
 #include "watchdog/wd_ipc_defines.h"
 #include "watchdog/wd_json_data.h"
+#include "utils/pool_atomic.h"
 #include "watchdog/wd_ipc_conn.h"
 #include "watchdog/wd_commands.h"
 #include "parser/pg_list.h"
@@ -44,6 +45,32 @@ typedef enum WD_LOCK_STANDBY_TYPE
 	WD_FOLLOW_PRIMARY_LOCK
 }WD_LOCK_STANDBY_TYPE;
 
+/*
+ * Snapshot of the watchdog cluster state published by the watchdog process
+ * in shared memory, so that other processes can read it without an IPC
+ * round trip.  The snapshot is written under a sequence counter: the
+ * counter is odd while an update is in progress and readers retry until
+ * they see the same even value before and after copying the data.
+ */
+#define WD_SHARED_STATE_MAX_AGE_SEC	3	/* snapshot older than this is
+										 * considered stale */
+
+typedef struct WDSharedClusterState
+{
+	pool_atomic_uint32 seq;		/* odd while the snapshot is being updated */
+	bool		valid;			/* false until the watchdog publishes, and
+								 * after it dies */
+	time_t		publish_time;	/* when the snapshot was last published */
+	WD_STATES	local_state;	/* state of the local watchdog node */
+	int			quorum_status;	/* quorum status as seen by the leader, -2
+								 * if there is no leader */
+	int			leader_node_id; /* pgpool_node_id of the leader, -1 if none */
+	bool		escalated;		/* local node holds the delegate IP */
+	int			node_count;		/* number of entries in node_states */
+	WD_STATES	node_states[MAX_WATCHDOG_NUM];	/* local node first, then
+												 * remote nodes */
+}			WDSharedClusterState;
+
 
 extern WdCommandResult wd_start_recovery(void);
 extern WdCommandResult wd_end_recovery(void);
@@ -74,6 +101,10 @@ extern void reset_watchdog_node_escalated(void);
 extern bool get_watchdog_node_escalation_state(void);
 extern size_t wd_ipc_get_shared_mem_size(void);
 
+extern void wd_publish_shared_cluster_state(WDSharedClusterState * state);
+extern void wd_invalidate_shared_cluster_state(void);
+extern bool wd_get_shared_cluster_state(WDSharedClusterState * state);
+
 extern WdCommandResult wd_lock_standby(WD_LOCK_STANDBY_TYPE lock_type);
 extern WdCommandResult wd_unlock_standby(WD_LOCK_STANDBY_TYPE lock_type);
 
@@ -40,6 +40,10 @@ typedef struct WDPGBackendStatus
 	BACKEND_STATUS backend_status[MAX_NUM_BACKENDS];
 	char		nodeName[WD_MAX_HOST_NAMELEN];	/* name of the watchdog node
 												 * that sent the data */
+	long		status_epoch;	/* startup time of the sending watchdog node,
+								 * 0 if not sent by the leader */
+	int			status_seq;		/* incremented by the sender every time the
+								 * status it reports changes */
 }			WDPGBackendStatus;
 
 extern WatchdogNode * get_watchdog_node_from_json(char *json_data, int data_len, char **authkey);
@@ -58,6 +62,28 @@ extern bool parse_beacon_message_json(char *json_data, int data_len, int *state,
 						  bool *escalated);
 extern char *get_beacon_message_json(WatchdogNode * wdNode);
 
+/*
+ * Compact binary encoding of the beacon message, used since watchdog data
+ * version 1.3.  The first byte can never start a JSON document, so the
+ * receiver tells the two formats apart by looking at it.
+ */
+#define WD_BINARY_BEACON_MAGIC		0xB1
+#define WD_BINARY_BEACON_VERSION	1
+#define WD_BINARY_BEACON_LEN		31
+#define WD_IS_BINARY_BEACON(data, len) \
+	((len) > 0 && ((unsigned char *) (data))[0] == WD_BINARY_BEACON_MAGIC)
+
+extern char *get_beacon_message_binary(WatchdogNode * wdNode, int *len);
+extern bool parse_beacon_message_binary(char *data, int data_len, int *state,
+										long *seconds_since_node_startup,
+										long *seconds_since_current_state,
+										int *quorumStatus,
+										int *standbyNodesCount,
+										bool *escalated);
+extern char *get_query_cache_invalidation_binary(bool clear_all, int num, int *dboids, int *tableoids, int *len);
+extern bool parse_query_cache_invalidation_binary(char *data, int data_len, bool *clear_all,
+												  int *num, int **dboids, int **tableoids);
+
 extern char *get_wd_node_function_json(char *func_name, int *node_id_set, int count, unsigned char flags, unsigned int sharedKey, char *authKey);
 extern bool parse_wd_node_function_json(char *json_data, int data_len, char **func_name, int **node_id_set, int *count, unsigned char *flags);
 extern char *get_wd_simple_message_json(char *message);
@@ -67,6 +67,7 @@ extern pid_t initialize_watchdog_lifecheck(void);
 /* wd_heartbeat.c */
 extern pid_t wd_hb_receiver(int fork_wait_time, WdHbIf * hb_if);
 extern pid_t wd_hb_sender(int fork_wait_time, WdHbIf * hb_if);
+extern pid_t wd_hb_worker(int fork_wait_time);
 
 
 #endif
@@ -53,6 +53,7 @@ extern bool wd_is_ip_exists(char *ip);
 extern bool wd_get_ping_result(char *hostname, int exit_status, int outfd);
 extern pid_t wd_issue_ping_command(char *hostname, int *outfd);
 extern pid_t wd_trusted_server_command(char *hostname);
+extern int	wd_icmp_ping_hosts(char **hosts, int count, bool *reachable, bool stop_at_first);
 
 /* wd_if.c */
 extern List *get_all_local_ips(void);
@@ -66,13 +66,18 @@ static void setResultIntData(PCPResultInfo * res, unsigned int slotno, int value
 
 static void process_node_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void	process_health_check_stats_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void process_recovery_status_response(PCPConnInfo * pcpConn, char *buf, int len);
+static PCPResultInfo * _pcp_recovery_node(PCPConnInfo * pcpConn, int nid, bool async);
+static void	process_backend_stats_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_command_complete_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_watchdog_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_process_info_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void process_memory_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_pool_status_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_pcp_node_count_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_process_count_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_salt_info_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void process_event_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_error_response(PCPConnInfo * pcpConn, char toc, char *buff);
 
 
@@ -441,6 +446,20 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_health_check_stats_response(pcpConn, buf, rsize);
 				break;
 
+			case 'v':
+				if (sentMsg != 'V')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_recovery_status_response(pcpConn, buf, rsize);
+				break;
+
+			case 'g':
+				if (sentMsg != 'G')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_backend_stats_response(pcpConn, buf, rsize);
+				break;
+
 			case 'l':
 				if (sentMsg != 'L')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -476,6 +495,34 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_command_complete_response(pcpConn, buf, rsize);
 				break;
 
+			case 'q':
+				if (sentMsg != 'Q')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_command_complete_response(pcpConn, buf, rsize);
+				break;
+
+			case 's':
+				if (sentMsg != 'S')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_command_complete_response(pcpConn, buf, rsize);
+				break;
+
+			case 'u':
+				if (sentMsg != 'U')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_command_complete_response(pcpConn, buf, rsize);
+				break;
+
+			case 'e':
+				if (sentMsg != 'U')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_event_response(pcpConn, buf, rsize);
+				break;
+
 			case 'w':
 				if (sentMsg != 'W')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -490,6 +537,13 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_process_info_response(pcpConn, buf, rsize);
 				break;
 
+			case 'y':
+				if (sentMsg != 'Y')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_memory_info_response(pcpConn, buf, rsize);
+				break;
+
 			case 'n':
 				if (sentMsg != 'N')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -900,6 +954,68 @@ pcp_health_check_stats(PCPConnInfo * pcpConn, int nid)
 	return process_pcp_response(pcpConn, 'H');
 }
 
+/* --------------------------------
+ * pcp_recovery_status - get progress of the current or the last online
+ * recovery
+ *
+ * return structure of recovery status on success, NULL otherwise
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_recovery_status(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "V", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"V\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'V');
+}
+
+/* --------------------------------
+ * pcp_backend_stats - get query statistics of the backend node pointed by given argument
+ *
+ * return structure of backend stats on success, -1 otherwise
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_backend_stats(PCPConnInfo * pcpConn, int nid)
+{
+	int			wsize;
+	char		node_id[16];
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn,
+						   "invalid PCP connection");
+		return NULL;
+	}
+
+	snprintf(node_id, sizeof(node_id), "%d", nid);
+
+	pcp_write(pcpConn->pcpConn, "G", 1);
+	wsize = htonl(strlen(node_id) + 1 + sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	pcp_write(pcpConn->pcpConn, node_id, strlen(node_id) + 1);
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"G\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'G');
+}
+
 PCPResultInfo *
 pcp_reload_config(PCPConnInfo * pcpConn,char command_scope)
 {
@@ -926,6 +1042,165 @@ pcp_reload_config(PCPConnInfo * pcpConn,char command_scope)
 	return process_pcp_response(pcpConn, 'Z');
 }
 
+PCPResultInfo *
+pcp_snapshot_query_cache(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+/*
+ * pcp packet format for pcp_snapshot_query_cache
+ * Q[size]
+ */
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "Q", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"Q\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'Q');
+}
+
+PCPResultInfo *
+pcp_reset_statement_stats(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+/*
+ * pcp packet format for pcp_reset_statement_stats
+ * S[size]
+ */
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "S", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"S\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'S');
+}
+
+
+/* --------------------------------
+ * pcp_subscribe - subscribe to events about state changes of pgpool
+ *
+ * After this succeeds, the connection can be used only to receive events
+ * with pcp_next_event(), and to disconnect.
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_subscribe(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+/*
+ * pcp packet format for pcp_subscribe
+ * U[size]
+ */
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "U", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"U\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'U');
+}
+
+/* --------------------------------
+ * pcp_next_event - wait for the next event on a subscribed connection
+ *
+ * return POOL_EVENT_INFO in the first slot of the result on success
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_next_event(PCPConnInfo * pcpConn)
+{
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	/* forget the previous event */
+	if (pcpConn->pcpResInfo)
+		pcp_free_result(pcpConn);
+
+	return process_pcp_response(pcpConn, 'U');
+}
+
+/*
+ * Process an event from PCP server.
+ * pcpConn: connection to the server
+ * buf:		returned data from server
+ * len:		length of the data
+ */
+static void
+process_event_response(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	POOL_EVENT_INFO *event;
+	char	   *fields[4];
+	int			sizes[4];
+	char	   *index = buf;
+	int			i;
+
+	event = palloc0(sizeof(POOL_EVENT_INFO));
+	fields[0] = event->event_type;
+	sizes[0] = sizeof(event->event_type);
+	fields[1] = event->node_id;
+	sizes[1] = sizeof(event->node_id);
+	fields[2] = event->timestamp;
+	sizes[2] = sizeof(event->timestamp);
+	fields[3] = event->detail;
+	sizes[3] = sizeof(event->detail);
+
+	for (i = 0; i < 4; i++)
+	{
+		char	   *end = (char *) memchr(index, '\0', len - (index - buf));
+
+		if (end == NULL)
+		{
+			pfree(event);
+			pcp_internal_error(pcpConn,
+							   "command failed. invalid response");
+			setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+			return;
+		}
+		StrNCpy(fields[i], index, sizes[i]);
+		index = end + 1;
+	}
+
+	if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) event, sizeof(POOL_EVENT_INFO), NULL) < 0)
+	{
+		pfree(event);
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+	}
+	else
+		setCommandSuccessful(pcpConn);
+}
 
 /*
  * Process health check response from PCP server.
@@ -985,6 +1260,140 @@ process_health_check_stats_response
 
 }
 
+/*
+ * Process recovery status response from PCP server.
+ * pcpConn: connection to the server
+ * buf:		returned data from server
+ * len:		length of the data
+ */
+static void
+process_recovery_status_response(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	POOL_RECOVERY_STATUS *status;
+	char	   *fields[12];
+	int			sizes[12];
+	char	   *index = buf;
+	int			i;
+	char		c[] = "CommandComplete";
+
+	if (strcmp(buf, c) != 0)
+	{
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+		return;
+	}
+	index += sizeof(c);
+
+	status = palloc0(sizeof(POOL_RECOVERY_STATUS));
+	fields[0] = status->node_id;
+	sizes[0] = sizeof(status->node_id);
+	fields[1] = status->stage;
+	sizes[1] = sizeof(status->stage);
+	fields[2] = status->start_time;
+	sizes[2] = sizeof(status->start_time);
+	fields[3] = status->stage_start_time;
+	sizes[3] = sizeof(status->stage_start_time);
+	fields[4] = status->end_time;
+	sizes[4] = sizeof(status->end_time);
+	fields[5] = status->backup_streams;
+	sizes[5] = sizeof(status->backup_streams);
+	fields[6] = status->backup_streamed;
+	sizes[6] = sizeof(status->backup_streamed);
+	fields[7] = status->backup_total;
+	sizes[7] = sizeof(status->backup_total);
+	fields[8] = status->start_lsn;
+	sizes[8] = sizeof(status->start_lsn);
+	fields[9] = status->current_lsn;
+	sizes[9] = sizeof(status->current_lsn);
+	fields[10] = status->pause_time;
+	sizes[10] = sizeof(status->pause_time);
+	fields[11] = status->message;
+	sizes[11] = sizeof(status->message);
+
+	for (i = 0; i < 12; i++)
+	{
+		char	   *end = (char *) memchr(index, '\0', len - (index - buf));
+
+		if (end == NULL)
+		{
+			pfree(status);
+			pcp_internal_error(pcpConn,
+							   "command failed. invalid response");
+			setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+			return;
+		}
+		StrNCpy(fields[i], index, sizes[i]);
+		index = end + 1;
+	}
+
+	if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) status, sizeof(POOL_RECOVERY_STATUS), NULL) < 0)
+	{
+		pfree(status);
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+	}
+	else
+		setCommandSuccessful(pcpConn);
+}
+
+/*
+ * Process backend stats response from PCP server.
+ * pcpConn: connection to the server
+ * buf:		returned data from server
+ * len:		length of the data
+ */
+static void
+process_backend_stats_response
+(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	POOL_BACKEND_STATS *stats;
+	int		*offsets;
+	int		n;
+	int		i;
+	char	*p;
+	int		maxstr;
+	char	c[] = "CommandComplete";
+
+	if (strcmp(buf, c) != 0)
+	{
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+		return;
+	}
+	buf += sizeof(c);
+
+	stats = palloc0(sizeof(POOL_BACKEND_STATS));
+	p = (char *)stats;
+
+	offsets = pool_backend_stats_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		if (i == n -1)
+			maxstr = sizeof(POOL_BACKEND_STATS) - offsets[i];
+		else
+			maxstr = offsets[i + 1] - offsets[i];
+
+		StrNCpy(p + offsets[i], buf, maxstr -1);
+		buf += strlen(buf) + 1;
+	}
+
+	if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) stats, sizeof(POOL_BACKEND_STATS), NULL) < 0)
+	{
+		if (stats)
+			pfree(stats);
+		pcp_internal_error(pcpConn,
+						   "command failed. invalid response");
+		setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+	}
+	else
+		setCommandSuccessful(pcpConn);
+
+}
+
 static void
 process_process_count_response(PCPConnInfo * pcpConn, char *buf, int len)
 {
@@ -1173,6 +1582,106 @@ pcp_process_info(PCPConnInfo * pcpConn, int pid)
 	return process_pcp_response(pcpConn, 'P');
 }
 
+static void
+process_memory_info_response(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	char	   *index;
+	int		   *offsets;
+	int			i,
+				n;
+	int			maxstr;
+	char	   *p;
+	POOL_REPORT_MEMORY *memory = NULL;
+
+	offsets = pool_report_memory_offsets(&n);
+
+	if (strcmp(buf, "ArraySize") == 0)
+	{
+		int			nrows;
+
+		index = (char *) memchr(buf, '\0', len);
+		if (index == NULL)
+			goto INVALID_RESPONSE;
+		index += 1;
+		nrows = atoi(index);
+
+		setResultStatus(pcpConn, PCP_RES_INCOMPLETE);
+		setResultSlotCount(pcpConn, nrows);
+		pcpConn->pcpResInfo->nextFillSlot = 0;
+		return;
+	}
+	else if (strcmp(buf, "MemoryInfo") == 0)
+	{
+		if (PCPResultStatus(pcpConn->pcpResInfo) != PCP_RES_INCOMPLETE)
+			goto INVALID_RESPONSE;
+
+		memory = palloc0(sizeof(POOL_REPORT_MEMORY));
+		p = (char *) memory;
+		buf += strlen(buf) + 1;
+
+		for (i = 0; i < n; i++)
+		{
+			if (i == n - 1)
+				maxstr = sizeof(POOL_REPORT_MEMORY) - offsets[i];
+			else
+				maxstr = offsets[i + 1] - offsets[i];
+
+			StrNCpy(p + offsets[i], buf, maxstr - 1);
+			buf += strlen(buf) + 1;
+		}
+
+		if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) memory, sizeof(POOL_REPORT_MEMORY), NULL) < 0)
+			goto INVALID_RESPONSE;
+
+		return;
+	}
+	else if (strcmp(buf, "CommandComplete") == 0)
+	{
+		setResultStatus(pcpConn, PCP_RES_COMMAND_OK);
+		return;
+	}
+
+INVALID_RESPONSE:
+
+	if (memory)
+		pfree(memory);
+	pcp_internal_error(pcpConn,
+					   "command failed. invalid response");
+	setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+}
+
+/* --------------------------------
+ * pcp_memory_info - get memory usage of all child processes
+ *
+ * return structure of memory usage information on success, -1 otherwise
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_memory_info(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+/*
+ * pcp packet format for pcp_memory_info
+ * Y[size]
+ */
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "Y", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"Y\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'Y');
+}
+
 /* --------------------------------
  * pcp_detach_node - detach a node given by the argument from pgpool's control
  *
@@ -1370,6 +1879,24 @@ pcp_pool_status(PCPConnInfo * pcpConn)
 
 PCPResultInfo *
 pcp_recovery_node(PCPConnInfo * pcpConn, int nid)
+{
+	return _pcp_recovery_node(pcpConn, nid, false);
+}
+
+/* --------------------------------
+ * pcp_recovery_node_async - start online recovery of the node and return
+ * without waiting for it to finish.  The progress is seen with
+ * pcp_recovery_status().
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_recovery_node_async(PCPConnInfo * pcpConn, int nid)
+{
+	return _pcp_recovery_node(pcpConn, nid, true);
+}
+
+static PCPResultInfo *
+_pcp_recovery_node(PCPConnInfo * pcpConn, int nid, bool async)
 {
 	int			wsize;
 	char		node_id[16];
@@ -1380,7 +1907,7 @@ pcp_recovery_node(PCPConnInfo * pcpConn, int nid)
 		return NULL;
 	}
 
-	snprintf(node_id, sizeof(node_id), "%d", nid);
+	snprintf(node_id, sizeof(node_id), async ? "%d a" : "%d", nid);
 
 	pcp_write(pcpConn->pcpConn, "O", 1);
 	wsize = htonl(strlen(node_id) + 1 + sizeof(int));
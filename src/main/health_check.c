@@ -35,6 +35,7 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#include <poll.h>
 
 #include <signal.h>
 
@@ -60,6 +61,7 @@
 #include "utils/pool_ip.h"
 #include "utils/ps_status.h"
 #include "utils/pool_stream.h"
+#include "utils/statistics.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
@@ -67,12 +69,19 @@
 #include "pool_config.h"
 #include "auth/md5.h"
 #include "auth/pool_hba.h"
+#include "auth/pool_passwd.h"
+
+#include "libpq-fe.h"
 
 volatile POOL_HEALTH_CHECK_STATISTICS	*health_check_stats;	/* health check stats area in shared memory */
+volatile POOL_BACKEND_ERROR_COUNTERS *backend_error_counters = NULL;	/* backend error
+																		 * counters in shared
+																		 * memory */
 
 static POOL_CONNECTION_POOL_SLOT * slot;
 static volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t restart_request = 0;
+static volatile sig_atomic_t check_now_request = 0;
 volatile POOL_HEALTH_CHECK_STATISTICS *stats;
 
 static bool establish_persistent_connection(int node);
@@ -81,8 +90,59 @@ static RETSIGTYPE my_signal_handler(int sig);
 static RETSIGTYPE reload_config_handler(int sig);
 static void reload_config(void);
 static RETSIGTYPE health_check_timer_handler(int sig);
+static RETSIGTYPE check_now_handler(int sig);
+static bool health_check_take_request(int node);
 
 static bool check_backend_down_request(int node, bool done_requests);
+static bool health_check_node_eligible(int node, bool *check_failback);
+static void health_check_request_failback(int node);
+static char *health_check_dbname(int node);
+static void health_check_record_result(int node, bool done, bool connected,
+						   bool timed_out, struct timeval *start_time);
+static void setup_health_check_process(char *psname);
+static void health_check_probe_period(int node);
+static bool health_check_probe(POOL_CONNECTION_POOL_SLOT * s, int timeout);
+
+/* resume time of auto_failback for each node */
+static time_t auto_failback_resume[MAX_NUM_BACKENDS];
+
+/*
+ * State of one node in the multiplexed health check process.
+ */
+typedef enum
+{
+	HC_IDLE,					/* waiting for the next health check */
+	HC_CONNECTING,				/* connection attempt in progress */
+	HC_SAMPLING,				/* sampling role and WAL location, see
+								 * sr_check_by_health_check */
+	HC_RETRY_WAIT				/* waiting for health_check_retry_delay */
+} HealthCheckProbeState;
+
+typedef struct
+{
+	HealthCheckProbeState state;
+	PGconn	   *conn;
+	int			events;			/* poll() events libpq waits for */
+	int			retries_left;
+	bool		fresh;			/* conn was made by the current attempt */
+	bool		check_failback;
+	bool		timed_out;		/* last attempt timed out */
+	int64		next_check;		/* all times are milliseconds of
+								 * CLOCK_MONOTONIC */
+	int64		deadline;		/* 0 if no health_check_timeout */
+	int64		retry_at;
+	struct timeval start_time;
+} HealthCheckProbe;
+
+static HealthCheckProbe probes[MAX_NUM_BACKENDS];
+
+static int64 hc_now(void);
+static void hc_start_probe(int node, int64 now);
+static void hc_attempt_done(int node, bool ok, bool timed_out, int64 now);
+static void hc_close(int node);
+static void hc_start_sample(int node, int64 now);
+static void hc_poll_sample(int node, int64 now);
+static void hc_sample_failed(int node, int64 now);
 
 #undef CHECK_REQUEST
 #define CHECK_REQUEST \
@@ -114,10 +174,7 @@ do_health_check_child(int *node_id)
 	MemoryContext HealthCheckMemoryContext;
 	char		psbuffer[NI_MAXHOST];
 	static struct timeval	start_time;
-	static struct timeval	end_time;
-	long	diff_t;
 
-	POOL_HEALTH_CHECK_STATISTICS	mystat;
 	stats = &health_check_stats[*node_id];
 
 	/* Set application name */
@@ -126,21 +183,7 @@ do_health_check_child(int *node_id)
 	ereport(DEBUG1,
 			(errmsg("I am health check process pid:%d DB node id:%d", getpid(), *node_id)));
 
-	/* Identify myself via ps */
-	init_ps_display("", "", "", "");
 	snprintf(psbuffer, sizeof(psbuffer), "health check process(%d)", *node_id);
-	set_ps_display(psbuffer, false);
-
-	/* set up signal handlers */
-	signal(SIGALRM, SIG_DFL);
-	signal(SIGTERM, my_signal_handler);
-	signal(SIGINT, my_signal_handler);
-	signal(SIGHUP, reload_config_handler);
-	signal(SIGQUIT, my_signal_handler);
-	signal(SIGCHLD, SIG_IGN);
-	signal(SIGUSR1, my_signal_handler);
-	signal(SIGUSR2, SIG_IGN);
-	signal(SIGPIPE, SIG_IGN);
 
 	/* Create per loop iteration memory context */
 	HealthCheckMemoryContext = AllocSetContextCreate(TopMemoryContext,
@@ -149,10 +192,7 @@ do_health_check_child(int *node_id)
 													 ALLOCSET_DEFAULT_INITSIZE,
 													 ALLOCSET_DEFAULT_MAXSIZE);
 
-	MemoryContextSwitchTo(TopMemoryContext);
-
-	/* Initialize per process context */
-	pool_init_process_context();
+	setup_health_check_process(psbuffer);
 
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
 	{
@@ -178,8 +218,6 @@ do_health_check_child(int *node_id)
 		 */
 		slot = NULL;
 
-		bool	skipped = false;
-
 		CHECK_REQUEST;
 
 		if (pool_config->health_check_params[*node_id].health_check_period <= 0)
@@ -195,153 +233,865 @@ do_health_check_child(int *node_id)
 		else if (pool_config->health_check_params[*node_id].health_check_period > 0)
 		{
 			bool		result;
-			BackendInfo *bkinfo = pool_get_node_info(*node_id);
+			bool		connected;
+			bool		keep;
 
 			stats->total_count++;
 			gettimeofday(&start_time, NULL);
 
 			stats->last_health_check = time(NULL);
 
+			(void) health_check_take_request(*node_id);
+			check_now_request = 0;
+
 			result = establish_persistent_connection(*node_id);
+			connected = (slot != NULL);
+
+			/*
+			 * Discard persistent connections, unless they are kept for
+			 * probing until the next health check.
+			 */
+			keep = result && connected &&
+				pool_config->health_check_probe_interval > 0;
+			if (!keep)
+				discard_persistent_connection(*node_id);
 
-			if (result && slot == NULL)
+			health_check_record_result(*node_id, result, connected,
+									   health_check_timer_expired, &start_time);
+
+			if (keep)
+			{
+				/* returns early if a probe fails */
+				health_check_probe_period(*node_id);
+				discard_persistent_connection(*node_id);
+			}
+			else if (!check_now_request)
 			{
-				stats->last_failed_health_check = time(NULL);
+				/* returns early if an immediate health check is requested */
+				sleep(pool_config->health_check_params[*node_id].health_check_period);
+			}
+		}
+	}
+	exit(0);
+}
+
+/*
+ * Probe the persistent connection every health_check_probe_interval
+ * milliseconds until health_check_period has passed.  Returns early if a
+ * probe fails, so that the full health check is done at once.
+ */
+static void
+health_check_probe_period(int node)
+{
+	int64		end;
+
+	end = hc_now() + pool_config->health_check_params[node].health_check_period * 1000L;
+
+	for (;;)
+	{
+		int			interval;
+		int64		now;
+
+		CHECK_REQUEST;
+
+		interval = pool_config->health_check_probe_interval;
+		now = hc_now();
+
+		if (interval <= 0 || now + interval >= end)
+		{
+			if (end > now)
+				usleep((end - now) * 1000);
+			return;
+		}
+
+		usleep(interval * 1000L);
+
+		if (check_now_request)
+			return;
+
+		if (check_now_request)
+			return;
 
-				if (POOL_DISALLOW_TO_FAILOVER(BACKEND_INFO(*node_id).flag))
+		if (!health_check_probe(slot, interval))
+		{
+			ereport(LOG,
+					(errmsg("health check probe failed on node %d", node),
+					 errdetail("performing health check now")));
+			return;
+		}
+	}
+}
+
+/*
+ * Lightweight liveness check of a persistent connection: send an empty
+ * query and wait at most "timeout" milliseconds for ReadyForQuery.  This
+ * talks to the socket directly, so that a failure does not go through the
+ * error handling of pool_read().  For SSL connections only the socket
+ * state is checked.  Returns true if the backend is alive.
+ */
+static bool
+health_check_probe(POOL_CONNECTION_POOL_SLOT * s, int timeout)
+{
+	static const char empty_query[] = {'Q', 0, 0, 0, 5, 0};
+	POOL_CONNECTION *con;
+	struct pollfd pfd;
+	unsigned char hdr[5];
+	int			hdr_have = 0;
+	int			body_left = 0;
+	bool		failed = false;
+	int64		deadline;
+	int			n;
+
+	if (s == NULL || s->con == NULL)
+		return false;
+	con = s->con;
+
+	/* nothing should have arrived since the last ReadyForQuery */
+	if (!pool_read_buffer_is_empty(con))
+		return false;
+
+	pfd.fd = con->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+#ifdef USE_SSL
+	if (con->ssl_active > 0)
+	{
+		/* a readable, hung up or failed socket means the server went away */
+		if (poll(&pfd, 1, 0) != 0)
+			return false;
+		return true;
+	}
+#endif
+
+	do
+		n = write(con->fd, empty_query, sizeof(empty_query));
+	while (n < 0 && errno == EINTR);
+	if (n != sizeof(empty_query))
+		return false;
+
+	deadline = hc_now() + timeout;
+
+	for (;;)
+	{
+		unsigned char buf[1024];
+		int64		now = hc_now();
+		int			i;
+
+		if (now >= deadline)
+			return false;
+
+		pfd.revents = 0;
+		n = poll(&pfd, 1, (int) (deadline - now));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+
+		n = read(con->fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+
+		/* walk through the messages until ReadyForQuery */
+		for (i = 0; i < n;)
+		{
+			if (hdr_have < 5)
+			{
+				hdr[hdr_have++] = buf[i++];
+				if (hdr_have < 5)
+					continue;
+
+				body_left = ((hdr[1] << 24) | (hdr[2] << 16) | (hdr[3] << 8) | hdr[4]) - 4;
+				if (body_left < 0)
+					return false;
+				if (hdr[0] == 'E')
+					failed = true;
+			}
+			else
+			{
+				int			len = Min(body_left, n - i);
+
+				i += len;
+				body_left -= len;
+			}
+
+			if (hdr_have == 5 && body_left == 0)
+			{
+				if (hdr[0] == 'Z')
+					return !failed && i == n;
+				hdr_have = 0;
+			}
+		}
+	}
+}
+
+/*
+ * Health check process checking all the backends.  Used when
+ * health_check_multiplexed is on.  Connections to all the nodes due for a
+ * check are driven concurrently with non-blocking libpq connections, each
+ * node with its own timeout and retry timers.  The result of each check is
+ * handled exactly like in do_health_check_child().
+ */
+void
+do_health_check_multiplexed(void *arg)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext HealthCheckMemoryContext;
+	struct pollfd fds[MAX_NUM_BACKENDS];
+	int			fd_node[MAX_NUM_BACKENDS];
+	int			i;
+
+	set_application_name_with_suffix(PT_HEALTH_CHECK, 0);
+
+	ereport(DEBUG1,
+			(errmsg("I am multiplexed health check process pid:%d", getpid())));
+
+	HealthCheckMemoryContext = AllocSetContextCreate(TopMemoryContext,
+													 "health_check_main_loop",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+	setup_health_check_process("health check process(all)");
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	/*
+	 * After an error, abandon all connections in progress and start over
+	 * with the next period.
+	 */
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		hc_close(i);
+		probes[i].state = HC_IDLE;
+	}
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+		health_check_stats[i].min_health_check_duration = INT_MAX;
+
+	for (;;)
+	{
+		int			nfds = 0;
+		int64		now;
+		int64		wakeup;
+		int			rc;
+
+		MemoryContextSwitchTo(HealthCheckMemoryContext);
+		MemoryContextResetAndDeleteChildren(HealthCheckMemoryContext);
+
+		CHECK_REQUEST;
+		check_now_request = 0;
+
+		now = hc_now();
+		wakeup = now + 1000;	/* look at config and signals once a second */
+
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			HealthCheckProbe *p = &probes[i];
+			int			period = pool_config->health_check_params[i].health_check_period;
+
+			if (health_check_take_request(i) && p->state == HC_IDLE)
+				p->next_check = now;
+
+			if (p->state == HC_IDLE)
+			{
+				if (period <= 0)
 				{
-					ereport(LOG,
-							(errmsg("health check failed on node %d but failover is disallowed for the node",
-									*node_id)));
+					health_check_stats[i].min_health_check_duration = 0;
+					p->next_check = 0;
+					continue;
 				}
-				else
-				{
-					bool		partial;
 
-					stats->fail_count++;
-
-					ereport(LOG, (errmsg("health check failed on node %d (timeout:%d)",
-										 *node_id, health_check_timer_expired)));
+				if (now >= p->next_check)
+				{
+					stats = &health_check_stats[i];
+					stats->total_count++;
+					gettimeofday(&p->start_time, NULL);
+					stats->last_health_check = time(NULL);
 
-					if (bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true)
+					if (!health_check_node_eligible(i, &p->check_failback))
 					{
-						ereport(LOG, (errmsg("health check failed on quarantine node %d (timeout:%d)",
-											 *node_id, health_check_timer_expired),
-									  errdetail("ignoring..")));
+						hc_close(i);
+						health_check_record_result(i, false, false, false, &p->start_time);
+						p->next_check = now + period * 1000L;
 					}
 					else
 					{
-						/* trigger failover */
-						partial = health_check_timer_expired ? false : true;
-						degenerate_backend_set(node_id, 1, partial ? REQ_DETAIL_SWITCHOVER : 0);
+						p->retries_left = pool_config->health_check_params[i].health_check_max_retries;
+						if (p->conn)
+							hc_start_sample(i, now);
+						else
+							hc_start_probe(i, now);
 					}
 				}
 			}
-			else if (slot && bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true)
-			{
-				stats->success_count++;
-				stats->last_successful_health_check = time(NULL);
+			else if (p->state == HC_RETRY_WAIT && now >= p->retry_at)
+				hc_start_probe(i, now);
 
-				/* The node has become reachable again. Reset
-				 * the quarantine state
-				 */
-				send_failback_request(*node_id, false, REQ_DETAIL_UPDATE | REQ_DETAIL_WATCHDOG);
+			switch (p->state)
+			{
+				case HC_IDLE:
+					if (period > 0 && p->next_check < wakeup)
+						wakeup = p->next_check;
+					break;
+				case HC_RETRY_WAIT:
+					if (p->retry_at < wakeup)
+						wakeup = p->retry_at;
+					break;
+				case HC_CONNECTING:
+				case HC_SAMPLING:
+					if (p->deadline > 0 && p->deadline < wakeup)
+						wakeup = p->deadline;
+					fds[nfds].fd = PQsocket(p->conn);
+					fds[nfds].events = p->events;
+					fds[nfds].revents = 0;
+					fd_node[nfds] = i;
+					nfds++;
+					break;
 			}
-			else if (result && slot)
+		}
+
+		rc = poll(fds, nfds, wakeup > now ? (int) (wakeup - now) : 0);
+		if (rc < 0 && errno != EINTR)
+			ereport(ERROR,
+					(errmsg("health check: poll() failed"),
+					 errdetail("%m")));
+
+		now = hc_now();
+
+		for (i = 0; i < nfds; i++)
+		{
+			int			node = fd_node[i];
+			HealthCheckProbe *p = &probes[node];
+
+			if (rc > 0 && fds[i].revents && p->state == HC_SAMPLING)
+				hc_poll_sample(node, now);
+			else if (rc > 0 && fds[i].revents)
 			{
-				/* Health check succeeded */
-				stats->success_count++;
-				stats->last_successful_health_check = time(NULL);
+				switch (PQconnectPoll(p->conn))
+				{
+					case PGRES_POLLING_OK:
+						if (pool_config->sr_check_by_health_check)
+						{
+							/* keep the connection and take the first sample */
+							p->fresh = true;
+							PQsetnonblocking(p->conn, 1);
+							hc_start_sample(node, now);
+						}
+						else
+							hc_attempt_done(node, true, false, now);
+						break;
+					case PGRES_POLLING_FAILED:
+						ereport(LOG,
+								(errmsg("health check: failed to connect to DB node %d", node),
+								 errdetail("%s", PQerrorMessage(p->conn))));
+						hc_attempt_done(node, false, false, now);
+						break;
+					case PGRES_POLLING_READING:
+						p->events = POLLIN;
+						break;
+					default:
+						p->events = POLLOUT;
+						break;
+				}
 			}
-			else if (!result)
+			else if (p->deadline > 0 && now >= p->deadline)
 			{
-				/* Health check skipped */
-				stats->skip_count++;
-				stats->last_skip_health_check = time(NULL);
-				skipped = true;
+				if (p->state == HC_SAMPLING)
+					ereport(LOG,
+							(errmsg("health check: timed out while sampling DB node %d", node)));
+				else
+					ereport(LOG,
+							(errmsg("health check: timed out while connecting to DB node %d", node)));
+				hc_attempt_done(node, false, true, now);
 			}
+		}
+	}
+	exit(0);
+}
+
+/*
+ * Common setup of ps display and signal handlers for the health check
+ * processes.
+ */
+static void
+setup_health_check_process(char *psname)
+{
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display(psname, false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, my_signal_handler);
+	signal(SIGUSR2, check_now_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	/* Initialize per process context */
+	pool_init_process_context();
+}
+
+static int64
+hc_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Start a non-blocking connection attempt to the node.
+ */
+static void
+hc_start_probe(int node, int64 now)
+{
+	HealthCheckProbe *p = &probes[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+	const char *keywords[8];
+	const char *values[8];
+	char		port[16];
+	char	   *password;
+	int			timeout = pool_config->health_check_params[node].health_check_timeout;
+
+	password = get_pgpool_config_user_password(pool_config->health_check_params[node].health_check_user,
+											   pool_config->health_check_params[node].health_check_password);
+	snprintf(port, sizeof(port), "%d", bkinfo->backend_port);
+
+	keywords[0] = "host";
+	values[0] = bkinfo->backend_hostname;
+	keywords[1] = "port";
+	values[1] = port;
+	keywords[2] = "dbname";
+	values[2] = health_check_dbname(node);
+	keywords[3] = "user";
+	values[3] = pool_config->health_check_params[node].health_check_user;
+	keywords[4] = "password";
+	values[4] = password ? password : "";
+	keywords[5] = "sslmode";
+	values[5] = pool_config->ssl ? "prefer" : "disable";
+	keywords[6] = "fallback_application_name";
+	values[6] = get_application_name();
+	keywords[7] = NULL;
+	values[7] = NULL;
+
+	p->timed_out = false;
+	p->deadline = timeout > 0 ? now + timeout * 1000L : 0;
+	p->events = POLLOUT;
+	p->conn = PQconnectStartParams(keywords, values, 0);
+
+	if (password)
+		pfree(password);
+
+	if (p->conn == NULL || PQstatus(p->conn) == CONNECTION_BAD)
+	{
+		ereport(LOG,
+				(errmsg("health check: failed to connect to DB node %d", node),
+				 errdetail("%s", p->conn ? PQerrorMessage(p->conn) : "out of memory")));
+		hc_attempt_done(node, false, false, now);
+		return;
+	}
+
+	p->state = HC_CONNECTING;
+}
+
+/*
+ * A connection attempt to the node has finished.  Retry it or handle the
+ * result of the health check, like establish_persistent_connection() and
+ * do_health_check_child() do.
+ */
+static void
+hc_attempt_done(int node, bool ok, bool timed_out, int64 now)
+{
+	HealthCheckProbe *p = &probes[node];
+	int			max_retries = pool_config->health_check_params[node].health_check_max_retries;
+
+	stats = &health_check_stats[node];
+
+	p->timed_out = timed_out;
+	p->fresh = false;
+
+	/* simulated connection failure, see establish_persistent_connection() */
+	if (ok && pool_config->health_check_test &&
+		check_backend_down_request(node, false) == true)
+		ok = false;
+
+	/* with sr_check_by_health_check, a good connection is kept */
+	if (!ok || !pool_config->sr_check_by_health_check)
+		hc_close(node);
+
+	if (ok)
+	{
+		if (p->retries_left != max_retries)
+			ereport(LOG,
+					(errmsg("health check retrying on DB node: %d succeeded",
+							node)));
+	}
+	else
+	{
+		p->retries_left--;
+
+		if (p->retries_left >= 0)
+		{
+			stats->retry_count++;
 
-			/* Discard persistent connections */
-			discard_persistent_connection(*node_id);
+			ereport(LOG,
+					(errmsg("health check retrying on DB node: %d (round:%d)",
+							node, max_retries - p->retries_left)));
+
+			p->state = HC_RETRY_WAIT;
+			p->retry_at = now + pool_config->health_check_params[node].health_check_retry_delay * 1000L;
+			return;
+		}
+	}
+
+	/* Check if we need to refresh max retry count */
+	if (p->retries_left != max_retries)
+	{
+		int			ret_cnt = max_retries - (p->retries_left + 1);
+
+		if (ret_cnt > stats->max_retry_count)
+			stats->max_retry_count = ret_cnt;
+	}
+
+	if (p->check_failback && !Req_info->switching && ok)
+		health_check_request_failback(node);
+
+	health_check_record_result(node, !p->check_failback, ok, p->timed_out, &p->start_time);
+
+	p->state = HC_IDLE;
+	p->next_check = now + pool_config->health_check_params[node].health_check_period * 1000L;
+}
+
+static void
+hc_close(int node)
+{
+	HealthCheckProbe *p = &probes[node];
+
+	if (p->conn)
+		PQfinish(p->conn);
+	p->conn = NULL;
+	p->fresh = false;
+}
+
+/*
+ * Ask the node on the kept connection whether it is in recovery and what
+ * its WAL location is.  Getting the answer also tells that the node is
+ * alive, so this replaces the connection attempt of the health check with
+ * sr_check_by_health_check.
+ */
+static void
+hc_start_sample(int node, int64 now)
+{
+	HealthCheckProbe *p = &probes[node];
+	int			timeout = pool_config->health_check_params[node].health_check_timeout;
+
+	/* a fresh connection is still within the deadline of its attempt */
+	if (!p->fresh)
+	{
+		p->timed_out = false;
+		p->deadline = timeout > 0 ? now + timeout * 1000L : 0;
+	}
+
+	if (PQsendQuery(p->conn,
+					"SELECT pg_catalog.pg_is_in_recovery(), "
+					"CASE WHEN pg_catalog.pg_is_in_recovery() "
+					"THEN pg_catalog.pg_last_wal_replay_lsn() "
+					"ELSE pg_catalog.pg_current_wal_lsn() END") == 0)
+	{
+		hc_sample_failed(node, now);
+		return;
+	}
+
+	p->events = PQflush(p->conn) == 1 ? POLLIN | POLLOUT : POLLIN;
+	p->state = HC_SAMPLING;
+}
+
+/*
+ * The kept connection of the node is readable or writable: read the sample
+ * and publish it for the streaming replication check.
+ */
+static void
+hc_poll_sample(int node, int64 now)
+{
+	HealthCheckProbe *p = &probes[node];
+	PGresult   *res;
+	int			flush;
+
+	flush = PQflush(p->conn);
+	if (flush < 0 || PQconsumeInput(p->conn) == 0)
+	{
+		hc_sample_failed(node, now);
+		return;
+	}
+	p->events = flush == 1 ? POLLIN | POLLOUT : POLLIN;
+
+	while (!PQisBusy(p->conn))
+	{
+		res = PQgetResult(p->conn);
+		if (res == NULL)
+		{
+			if (PQstatus(p->conn) == CONNECTION_BAD)
+				hc_sample_failed(node, now);
+			else
+				hc_attempt_done(node, true, false, now);
+			return;
+		}
+
+		if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1)
+		{
+			volatile POOL_HEALTH_CHECK_STATISTICS *st = &health_check_stats[node];
+
+			pool_get_node_info(node)->wal_location =
+				pool_parse_wal_location(PQgetisnull(res, 0, 1) ? NULL : PQgetvalue(res, 0, 1));
+			st->sample_in_recovery = *PQgetvalue(res, 0, 0) == 't';
+			st->last_sample = time(NULL);
 
 			/*
-			 Update health check duration only if health check was not skipped
-			 since the duration could be very small (probably 0) if health
-			 check is skipped.
+			 * On a kept connection this is a plain round trip, so let the
+			 * latency aware load balancing know how responsive the node is.
 			 */
-
-			if (!skipped)
+			if (!p->fresh)
 			{
+				struct timeval end_time;
+
 				gettimeofday(&end_time, NULL);
+				stat_probe_latency(node, (uint64) ((end_time.tv_sec - p->start_time.tv_sec) * 1000000 +
+												   (end_time.tv_usec - p->start_time.tv_usec)));
+			}
+		}
+		else if (PQstatus(p->conn) != CONNECTION_BAD)
+		{
+			/* the node is alive even if it cannot answer the query */
+			ereport(LOG,
+					(errmsg("health check: could not sample DB node %d", node),
+					 errdetail("%s", PQresultErrorMessage(res))));
+		}
+		PQclear(res);
+	}
+}
 
-				if (end_time.tv_sec > start_time.tv_sec)
-					diff_t = end_time.tv_usec - start_time.tv_usec + 1000000 * (end_time.tv_sec - start_time.tv_sec);
-				else
-					diff_t = end_time.tv_usec - start_time.tv_usec;
+/*
+ * Sampling failed because the connection is broken.  If it was a kept
+ * connection the node may have just been restarted, so try to connect
+ * again within the same attempt.  Otherwise the attempt has failed.
+ */
+static void
+hc_sample_failed(int node, int64 now)
+{
+	HealthCheckProbe *p = &probes[node];
 
-				diff_t /= 1000;
-				stats->total_health_check_duration += diff_t;
+	ereport(LOG,
+			(errmsg("health check: lost connection to DB node %d", node),
+			 errdetail("%s", PQerrorMessage(p->conn))));
 
-				if (diff_t > stats->max_health_check_duration)
-					stats->max_health_check_duration = diff_t;
-				if (diff_t < stats->min_health_check_duration)
-					stats->min_health_check_duration = diff_t;
-			}
+	if (p->fresh)
+	{
+		hc_attempt_done(node, false, false, now);
+		return;
+	}
+
+	hc_close(node);
+	hc_start_probe(node, now);
+}
+
+/*
+ * Process the result of one health check of the node: update the
+ * statistics, and request failover or failback if needed.  "done" is false
+ * if the check was skipped, "connected" tells whether the node could be
+ * connected and "timed_out" whether the last attempt hit
+ * health_check_timeout.
+ */
+static void
+health_check_record_result(int node, bool done, bool connected,
+						   bool timed_out, struct timeval *start_time)
+{
+	volatile POOL_HEALTH_CHECK_STATISTICS *st = &health_check_stats[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+	struct timeval end_time;
+	long		diff_t;
+	int			slot;
 
-			memcpy(&mystat, (void *)stats, sizeof(mystat));
+	if (done && !connected)
+	{
+		st->last_failed_health_check = time(NULL);
 
-			sleep(pool_config->health_check_params[*node_id].health_check_period);
+		if (POOL_DISALLOW_TO_FAILOVER(BACKEND_INFO(node).flag))
+		{
+			ereport(LOG,
+					(errmsg("health check failed on node %d but failover is disallowed for the node",
+							node)));
+		}
+		else
+		{
+			bool		partial;
+
+			st->fail_count++;
+
+			ereport(LOG, (errmsg("health check failed on node %d (timeout:%d)",
+								 node, timed_out)));
+
+			if (bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true)
+			{
+				ereport(LOG, (errmsg("health check failed on quarantine node %d (timeout:%d)",
+									 node, timed_out),
+							  errdetail("ignoring..")));
+			}
+			else
+			{
+				/* trigger failover */
+				partial = timed_out ? false : true;
+				degenerate_backend_set(&node, 1, partial ? REQ_DETAIL_SWITCHOVER : 0);
+			}
 		}
 	}
-	exit(0);
+	else if (connected && bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true)
+	{
+		st->success_count++;
+		st->last_successful_health_check = time(NULL);
+
+		/* The node has become reachable again. Reset
+		 * the quarantine state
+		 */
+		send_failback_request(node, false, REQ_DETAIL_UPDATE | REQ_DETAIL_WATCHDOG);
+	}
+	else if (done && connected)
+	{
+		/* Health check succeeded */
+		st->success_count++;
+		st->last_successful_health_check = time(NULL);
+	}
+	else if (!done)
+	{
+		/* Health check skipped */
+		st->skip_count++;
+		st->last_skip_health_check = time(NULL);
+
+		/*
+		 * Do not update health check duration since the duration could be
+		 * very small (probably 0) if health check is skipped.
+		 */
+		return;
+	}
+
+	gettimeofday(&end_time, NULL);
+
+	if (end_time.tv_sec > start_time->tv_sec)
+		diff_t = end_time.tv_usec - start_time->tv_usec + 1000000 * (end_time.tv_sec - start_time->tv_sec);
+	else
+		diff_t = end_time.tv_usec - start_time->tv_usec;
+
+	diff_t /= 1000;
+	st->total_health_check_duration += diff_t;
+
+	if (diff_t > st->max_health_check_duration)
+		st->max_health_check_duration = diff_t;
+	if (diff_t < st->min_health_check_duration)
+		st->min_health_check_duration = diff_t;
+
+	slot = st->history_count % HEALTH_CHECK_HISTORY_SIZE;
+	st->history_duration[slot] = diff_t;
+	st->history_failed[slot] = !connected;
+	st->history_count++;
 }
 
 /*
- * Establish persistent connection to backend.
- * Return true if connection test is done.
+ * Returns the database name used for health check of the node.  If it is
+ * not specified, "postgres" database is assumed.
+ */
+static char *
+health_check_dbname(int node)
+{
+	if (*pool_config->health_check_params[node].health_check_database == '\0')
+		return "postgres";
+	return pool_config->health_check_params[node].health_check_database;
+}
+
+/*
+ * Should the node be checked?  If the node is already in down status or
+ * unused, it is not, except when the node state is down because of
+ * quarantine operation since we want to detect when the node comes back to
+ * life again to remove it from the quarantine state, or when the node is a
+ * candidate for auto_failback, in which case *check_failback is set.
  */
 static bool
-establish_persistent_connection(int node)
+health_check_node_eligible(int node, bool *check_failback)
 {
-	BackendInfo *bkinfo;
-	int			retry_cnt;
-	static time_t auto_failback_interval = 0; /* resume time of auto_failback */
-	bool		check_failback = false;
+	BackendInfo *bkinfo = pool_get_node_info(node);
 	time_t		now;
-	char		*dbname;
 
-	bkinfo = pool_get_node_info(node);
+	*check_failback = false;
 
-	/*
-	 * If the node is already in down status or unused, do nothing.
-	 * except when the node state is down because of quarantine operation
-	 * since we want to detect when the node comes back to life again to
-	 * remove it from the quarantine state
-	 */
 	if (bkinfo->backend_status == CON_UNUSED ||
 		(bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == false))
 	{
 		/* get current time to use auto_failback_interval */
 		now = time(NULL);
 
-		if (pool_config->auto_failback && auto_failback_interval < now &&
+		if (pool_config->auto_failback && auto_failback_resume[node] < now &&
 			STREAM && !strcmp(bkinfo->replication_state, "streaming") && !Req_info->switching)
 		{
 				ereport(DEBUG1,
 						(errmsg("health check DB node: %d (status:%d) for auto_failback", node, bkinfo->backend_status)));
-				check_failback = true;
+				*check_failback = true;
 		}
 		else
 			return false;
 	}
+	return true;
+}
 
-	/*
-	 * If database is not specified, "postgres" database is assumed.
-	 */
-	if (*pool_config->health_check_params[node].health_check_database == '\0')
-		dbname = "postgres";
-	else
-		dbname = pool_config->health_check_params[node].health_check_database;
+/*
+ * The node that was down responded to health check: request auto failback.
+ */
+static void
+health_check_request_failback(int node)
+{
+	ereport(LOG,
+			(errmsg("request auto failback, node id:%d", node)));
+	/* get current time to use auto_failback_interval */
+	auto_failback_resume[node] = time(NULL) + pool_config->auto_failback_interval;
+
+	send_failback_request(node, true, REQ_DETAIL_CONFIRMED);
+}
+
+/*
+ * Establish persistent connection to backend.
+ * Return true if connection test is done.
+ */
+static bool
+establish_persistent_connection(int node)
+{
+	BackendInfo *bkinfo;
+	int			retry_cnt;
+	bool		check_failback = false;
+	char		*dbname;
+
+	bkinfo = pool_get_node_info(node);
+
+	if (!health_check_node_eligible(node, &check_failback))
+		return false;
+
+	dbname = health_check_dbname(node);
 
 	/*
 	 * Try to connect to the database.
@@ -437,15 +1187,7 @@ establish_persistent_connection(int node)
 			pfree(password);
 
 		if (check_failback && !Req_info->switching && slot)
-		{
-				ereport(LOG,
-					(errmsg("request auto failback, node id:%d", node)));
-				/* get current time to use auto_failback_interval */
-				now = time(NULL);
-				auto_failback_interval = now + pool_config->auto_failback_interval;
-
-				send_failback_request(node, true, REQ_DETAIL_CONFIRMED);
-		}
+			health_check_request_failback(node);
 	}
 
 	/* if check_failback is true, backend_status is DOWN or UNUSED. */
@@ -535,6 +1277,89 @@ static RETSIGTYPE health_check_timer_handler(int sig)
 	errno = save_errno;
 }
 
+/*
+ * SIGUSR2: the main process asks for an immediate health check.  Receiving
+ * the signal interrupts sleep(), poll() and usleep().
+ */
+static RETSIGTYPE check_now_handler(int sig)
+{
+	int			save_errno = errno;
+
+	check_now_request = 1;
+	errno = save_errno;
+}
+
+/*
+ * Returns true, and clears the request, if an immediate health check of the
+ * node was requested by health_check_request().
+ */
+static bool
+health_check_take_request(int node)
+{
+	if (backend_error_counters == NULL)
+		return false;
+	return pool_atomic_exchange_u32(&backend_error_counters[node].check_requested, 0) != 0;
+}
+
+/*
+ * Called by the main or watchdog process: ask for an immediate health check
+ * of the node.  The main process signals the health check process
+ * afterwards.
+ */
+void
+health_check_request(int node)
+{
+	if (backend_error_counters)
+		pool_atomic_write_u32(&backend_error_counters[node].check_requested, 1);
+}
+
+/*
+ * Returns true if an immediate health check of the node has been requested
+ * and the health check process has not picked it up yet.
+ */
+bool
+health_check_requested(int node)
+{
+	if (backend_error_counters == NULL)
+		return false;
+	return pool_atomic_read_u32(&backend_error_counters[node].check_requested) != 0;
+}
+
+/*
+ * Called by child processes when a backend connection fails.  "connect" is
+ * true if the connection could not be established at all.
+ */
+void
+health_check_count_backend_error(int node, bool connect)
+{
+	if (backend_error_counters == NULL || node < 0 || node >= MAX_NUM_BACKENDS)
+		return;
+
+	if (connect)
+		pool_atomic_fetch_add_u32(&backend_error_counters[node].connect_error_count, 1);
+	else
+		pool_atomic_fetch_add_u32(&backend_error_counters[node].error_count, 1);
+}
+
+/*
+ * Returns the byte size of backend error counters area
+ */
+size_t
+backend_error_counters_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(POOL_BACKEND_ERROR_COUNTERS) * MAX_NUM_BACKENDS);
+}
+
+/*
+ * Initialize backend error counters area
+ */
+void
+backend_error_counters_init(POOL_BACKEND_ERROR_COUNTERS *addr)
+{
+	backend_error_counters = addr;
+	memset((void *) backend_error_counters, 0, backend_error_counters_shared_memory_size());
+}
+
 /*
  * Returns the byte size of health check statistics area
  */
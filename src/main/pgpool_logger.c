@@ -48,6 +48,7 @@
 #include "utils/timestamp.h"
 #include "utils/pool_signal.h"
 #include "main/pgpool_logger.h"
+#include "utils/pool_log_ring.h"
 
 #define DEVNULL "/dev/null"
 typedef int64 pg_time_t;
@@ -78,9 +79,11 @@ static bool pipe_eof_seen = false;
 static bool rotation_disabled = false;
 static FILE *syslogFile = NULL;
 static FILE *csvlogFile = NULL;
+static FILE *jsonlogFile = NULL;
 static pg_time_t first_syslogger_file_time = 0;
 static char *last_file_name = NULL;
 static char *last_csv_file_name = NULL;
+static char *last_json_file_name = NULL;
 
 /*
  * Buffers for saving partial messages from different backends.
@@ -221,6 +224,8 @@ SysLoggerMain(int argc, char *argv[])
 	last_file_name = logfile_getname(first_syslogger_file_time, NULL);
 	if (csvlogFile != NULL)
 		last_csv_file_name = logfile_getname(first_syslogger_file_time, ".csv");
+	if (jsonlogFile != NULL)
+		last_json_file_name = logfile_getname(first_syslogger_file_time, ".json");
 
 	/* remember active logfile parameters */
 	currentLogDir = pstrdup(pool_config->log_directory);
@@ -249,6 +254,11 @@ SysLoggerMain(int argc, char *argv[])
 		fd_set		rfds;
 		int			rc;
 
+		/*
+		 * Write out what child processes have put in their log rings.
+		 */
+		pool_log_ring_drain();
+
 		/*
 		 * Process any requests or signals received recently.
 		 */
@@ -295,6 +305,11 @@ SysLoggerMain(int argc, char *argv[])
 				(csvlogFile != NULL))
 				rotation_requested = true;
 
+			/* Likewise for JSONLOG output */
+			if (((pool_config->log_destination & LOG_DESTINATION_JSONLOG) != 0) !=
+				(jsonlogFile != NULL))
+				rotation_requested = true;
+
 			/*
 			 * If rotation time parameter changed, reset next rotation time,
 			 * but don't immediately force a rotation.
@@ -339,6 +354,12 @@ SysLoggerMain(int argc, char *argv[])
 				rotation_requested = true;
 				size_rotation_for |= LOG_DESTINATION_CSVLOG;
 			}
+			if (jsonlogFile != NULL &&
+				ftell(jsonlogFile) >= pool_config->log_rotation_size * 1024L)
+			{
+				rotation_requested = true;
+				size_rotation_for |= LOG_DESTINATION_JSONLOG;
+			}
 		}
 
 		if (rotation_requested)
@@ -348,7 +369,8 @@ SysLoggerMain(int argc, char *argv[])
 			 * was sent by pg_rotate_logfile() or "pg_ctl logrotate".
 			 */
 			if (!time_based_rotation && size_rotation_for == 0)
-				size_rotation_for = LOG_DESTINATION_STDERR | LOG_DESTINATION_CSVLOG;
+				size_rotation_for = LOG_DESTINATION_STDERR | LOG_DESTINATION_CSVLOG |
+					LOG_DESTINATION_JSONLOG;
 			logfile_rotate(time_based_rotation, size_rotation_for);
 		}
 
@@ -381,13 +403,23 @@ SysLoggerMain(int argc, char *argv[])
 			}
 		}
 
+		/*
+		 * Wake up in time to drain the log rings of child processes.
+		 */
+		if (pool_log_ring_enabled())
+		{
+			timeout.tv_sec = LOG_RING_DRAIN_INTERVAL / 1000;
+			timeout.tv_usec = (LOG_RING_DRAIN_INTERVAL % 1000) * 1000;
+		}
+
 		/*
 		 * Sleep until there's something to do
 		 */
 		
 		FD_ZERO(&rfds);
 		FD_SET(syslogPipe[0], &rfds);
-		rc = select(syslogPipe[0] + 1, &rfds, NULL, NULL, timeout.tv_sec?&timeout:NULL);
+		rc = select(syslogPipe[0] + 1, &rfds, NULL, NULL,
+					(timeout.tv_sec || timeout.tv_usec) ? &timeout : NULL);
 		if (rc == 1)
 		{
 			int			bytesRead;
@@ -419,6 +451,7 @@ SysLoggerMain(int argc, char *argv[])
 
 				/* if there's any data left then force it out now */
 				flush_pipe_input(logbuffer, &bytes_in_logbuffer);
+				pool_log_ring_drain();
 			}
 		}
 
@@ -519,6 +552,16 @@ SysLogger_Start(void)
 		pfree(filename);
 	}
 
+	/* Likewise for the initial JSON log file, if that's enabled */
+	if (pool_config->log_destination & LOG_DESTINATION_JSONLOG)
+	{
+		filename = logfile_getname(first_syslogger_file_time, ".json");
+
+		jsonlogFile = logfile_open(filename, "a", false);
+
+		pfree(filename);
+	}
+
 	switch ((sysloggerPid = fork()))
 	{
 		case -1:
@@ -596,6 +639,11 @@ SysLogger_Start(void)
 				fclose(csvlogFile);
 				csvlogFile = NULL;
 			}
+			if (jsonlogFile != NULL)
+			{
+				fclose(jsonlogFile);
+				jsonlogFile = NULL;
+			}
 			return (int) sysloggerPid;
 	}
 
@@ -651,7 +699,8 @@ process_pipe_input(char *logbuffer, int *bytes_in_logbuffer)
 			p.len > 0 && p.len <= PIPE_MAX_PAYLOAD &&
 			p.pid != 0 &&
 			(p.is_last == 't' || p.is_last == 'f' ||
-			 p.is_last == 'T' || p.is_last == 'F'))
+			 p.is_last == 'T' || p.is_last == 'F' ||
+			 p.is_last == 'J' || p.is_last == 'j'))
 		{
 			List	   *buffer_list;
 			ListCell   *cell;
@@ -665,8 +714,12 @@ process_pipe_input(char *logbuffer, int *bytes_in_logbuffer)
 			if (count < chunklen)
 				break;
 
-			dest = (p.is_last == 'T' || p.is_last == 'F') ?
-				LOG_DESTINATION_CSVLOG : LOG_DESTINATION_STDERR;
+			if (p.is_last == 'T' || p.is_last == 'F')
+				dest = LOG_DESTINATION_CSVLOG;
+			else if (p.is_last == 'J' || p.is_last == 'j')
+				dest = LOG_DESTINATION_JSONLOG;
+			else
+				dest = LOG_DESTINATION_STDERR;
 
 			/* Locate any existing buffer for this source pid */
 			buffer_list = buffer_lists[p.pid % NBUFFER_LISTS];
@@ -683,7 +736,7 @@ process_pipe_input(char *logbuffer, int *bytes_in_logbuffer)
 					free_slot = buf;
 			}
 
-			if (p.is_last == 'f' || p.is_last == 'F')
+			if (p.is_last == 'f' || p.is_last == 'F' || p.is_last == 'j')
 			{
 				/*
 				 * Save a complete non-final chunk in a per-pid buffer
@@ -842,8 +895,8 @@ write_syslogger_file(const char *buffer, int count, int destination)
 	FILE	   *logfile;
 
 	/*
-	 * If we're told to write to csvlogFile, but it's not open, dump the data
-	 * to syslogFile (which is always open) instead.  This can happen if CSV
+	 * If we're told to write to csvlogFile or jsonlogFile, but it's not open,
+	 * dump the data to syslogFile (which is always open) instead.  This can happen if CSV
 	 * output is enabled after postmaster start and we've been unable to open
 	 * csvlogFile.  There are also race conditions during a parameter change
 	 * whereby backends might send us CSV output before we open csvlogFile or
@@ -853,8 +906,12 @@ write_syslogger_file(const char *buffer, int count, int destination)
 	 * Think not to improve this by trying to open csvlogFile on-the-fly.  Any
 	 * failure in that would lead to recursion.
 	 */
-	logfile = (destination == LOG_DESTINATION_CSVLOG &&
-			   csvlogFile != NULL) ? csvlogFile : syslogFile;
+	if (destination == LOG_DESTINATION_CSVLOG && csvlogFile != NULL)
+		logfile = csvlogFile;
+	else if (destination == LOG_DESTINATION_JSONLOG && jsonlogFile != NULL)
+		logfile = jsonlogFile;
+	else
+		logfile = syslogFile;
 
 	rc = fwrite(buffer, 1, count, logfile);
 
@@ -920,6 +977,7 @@ logfile_rotate(bool time_based_rotation, int size_rotation_for)
 {
 	char	   *filename;
 	char	   *csvfilename = NULL;
+	char	   *jsonfilename = NULL;
 	pg_time_t	fntime;
 	FILE	   *fh;
 
@@ -937,6 +995,8 @@ logfile_rotate(bool time_based_rotation, int size_rotation_for)
 	filename = logfile_getname(fntime, NULL);
 	if (pool_config->log_destination & LOG_DESTINATION_CSVLOG)
 		csvfilename = logfile_getname(fntime, ".csv");
+	if (pool_config->log_destination & LOG_DESTINATION_JSONLOG)
+		jsonfilename = logfile_getname(fntime, ".json");
 
 	/*
 	 * Decide whether to overwrite or append.  We can overwrite if (a)
@@ -974,6 +1034,8 @@ logfile_rotate(bool time_based_rotation, int size_rotation_for)
 				pfree(filename);
 			if (csvfilename)
 				pfree(csvfilename);
+			if (jsonfilename)
+				pfree(jsonfilename);
 			return;
 		}
 
@@ -1024,6 +1086,8 @@ logfile_rotate(bool time_based_rotation, int size_rotation_for)
 				pfree(filename);
 			if (csvfilename)
 				pfree(csvfilename);
+			if (jsonfilename)
+				pfree(jsonfilename);
 			return;
 		}
 
@@ -1048,10 +1112,64 @@ logfile_rotate(bool time_based_rotation, int size_rotation_for)
 		last_csv_file_name = NULL;
 	}
 
+	/* Same as above, but for json file */
+	if ((pool_config->log_destination & LOG_DESTINATION_JSONLOG) &&
+		(jsonlogFile == NULL ||
+		 time_based_rotation || (size_rotation_for & LOG_DESTINATION_JSONLOG)))
+	{
+		if (pool_config->log_truncate_on_rotation && time_based_rotation &&
+			last_json_file_name != NULL &&
+			strcmp(jsonfilename, last_json_file_name) != 0)
+			fh = logfile_open(jsonfilename, "w", true);
+		else
+			fh = logfile_open(jsonfilename, "a", true);
+
+		if (!fh)
+		{
+			/* see above */
+			if (errno != ENFILE && errno != EMFILE)
+			{
+				ereport(LOG,
+						(errmsg("disabling automatic rotation (use SIGHUP to re-enable)")));
+				rotation_disabled = true;
+			}
+
+			if (filename)
+				pfree(filename);
+			if (csvfilename)
+				pfree(csvfilename);
+			if (jsonfilename)
+				pfree(jsonfilename);
+			return;
+		}
+
+		if (jsonlogFile != NULL)
+			fclose(jsonlogFile);
+		jsonlogFile = fh;
+
+		/* instead of pfree'ing filename, remember it for next time */
+		if (last_json_file_name != NULL)
+			pfree(last_json_file_name);
+		last_json_file_name = jsonfilename;
+		jsonfilename = NULL;
+	}
+	else if (!(pool_config->log_destination & LOG_DESTINATION_JSONLOG) &&
+			 jsonlogFile != NULL)
+	{
+		/* JSONLOG was just turned off, so close the old file */
+		fclose(jsonlogFile);
+		jsonlogFile = NULL;
+		if (last_json_file_name != NULL)
+			pfree(last_json_file_name);
+		last_json_file_name = NULL;
+	}
+
 	if (filename)
 		pfree(filename);
 	if (csvfilename)
 		pfree(csvfilename);
+	if (jsonfilename)
+		pfree(jsonfilename);
 
 	set_next_rotation_time();
 }
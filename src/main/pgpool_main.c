@@ -33,12 +33,14 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 
 #ifdef  __FreeBSD__
 #include <netinet/in.h>
 #endif
+#include <netinet/tcp.h>
 
 #include "pool.h"
 #include "version.h"
@@ -46,14 +48,25 @@
 #include "main/health_check.h"
 #include "main/pool_internal_comms.h"
 #include "main/pgpool_logger.h"
+#include "main/pool_metrics.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/statistics.h"
 #include "utils/pool_ipc.h"
+#include "utils/pool_shared_relcache.h"
+#include "utils/pool_dns_cache.h"
+#include "auth/pool_scram_cache.h"
+#include "rewrite/pool_lobj.h"
+#include "utils/pool_statement_stats.h"
+#include "utils/pool_log_ring.h"
+#include "utils/pool_numa.h"
+#include "utils/pool_trace.h"
 #include "context/pool_process_context.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_client_limit.h"
+#include "protocol/pool_notify_hub.h"
 #include "auth/pool_passwd.h"
 #include "auth/pool_hba.h"
 #include "query_cache/pool_memqcache.h"
@@ -119,9 +132,26 @@ typedef struct User1SignalSlot
 #define PGPOOLMAXLITSENQUEUELENGTH 10000
 #define MAX_ONE_SHOT_KILLS 8
 
+/*
+ * Tunables of the adaptive process management strategy.  Times are in
+ * seconds.
+ */
+#define ADAPTIVE_SCALE_DOWN_DELAY		60	/* low load needed before
+											 * retiring children */
+#define ADAPTIVE_SCALE_DOWN_INTERVAL	5	/* between two retire steps */
+#define ADAPTIVE_ONE_SHOT_KILLS			2
+#define ADAPTIVE_BUSY_RATIO				0.8 /* spawn ahead of demand if
+											 * busier than this */
+#define PM_INFO_SMOOTHING				0.3 /* weight of a new sample in
+											 * moving averages */
+
 
 #define UNIXSOCK_PATH_BUFLEN sizeof(((struct sockaddr_un *) NULL)->sun_path)
 
+/* true if the child is executing a query, inside a transaction or connecting */
+#define CHILD_SESSION_IS_BUSY(i) \
+	(process_info[(i)].status != WAIT_FOR_CONNECT && process_info[(i)].status != IDLE)
+
 /*
  * Context data while exectuing failover()
  */
@@ -132,6 +162,10 @@ typedef struct
 	bool		need_to_restart_children;	/* true if we need to restart child process */
 	bool		need_to_restart_pcp;	/* true if we need to restart pc process */
 	bool		partial_restart;	/* true if partial restart is needed */
+	bool		keep_sessions;		/* true if surviving children drop the
+									 * failed node by themselves */
+	bool		reattach_sessions;	/* true if idle sessions are reattached
+									 * to the new primary */
 	bool		sync_required;		/* true if watchdog synchronization is necessary */
 
 	POOL_REQUEST_KIND reqkind;
@@ -152,6 +186,8 @@ static void FileUnlink(int code, Datum path);
 static pid_t pcp_fork_a_child(int *fds, char *pcp_conf_file);
 static pid_t fork_a_child(int *fds, int id);
 static pid_t worker_fork_a_child(ProcessType type, void (*func) (), void *params);
+static pid_t start_health_check_process(int node);
+static void check_backend_error_rates(void);
 static int	create_unix_domain_socket(struct sockaddr_un un_addr_tmp, const char *group, const int permissions);
 static int *create_unix_domain_sockets_by_list(struct sockaddr_un *un_addrs, char *group, int permissions, int n_sockets);
 static int *create_inet_domain_sockets(const char *hostname, const int port);
@@ -164,6 +200,7 @@ static void reload_config(void);
 static int	pool_pause(struct timeval *timeout);
 static void kill_all_children(int sig);
 static pid_t fork_follow_child(int old_main_node, int new_primary, int old_primary);
+static void exec_follow_primary_command_parallel(int old_main_node, int new_primary, int old_primary);
 static int	read_status_file(bool discard_status);
 static RETSIGTYPE exit_handler(int sig);
 static RETSIGTYPE reap_handler(int sig);
@@ -174,7 +211,9 @@ static RETSIGTYPE wakeup_handler(int sig);
 
 static void initialize_shared_mem_objects(bool clear_memcache_oidmaps);
 static int trigger_failover_command(int node, const char *command_line,
-						 int old_main_node, int new_main_node, int old_primary);
+						 int old_main_node, int new_main_node, int old_primary,
+						 int candidate);
+static int	find_most_advanced_standby(void);
 static int	find_primary_node(void);
 static int	find_primary_node_repeatedly(void);
 static void terminate_all_childrens(int sig);
@@ -201,6 +240,11 @@ static void exec_notice_pcp_child(FAILOVER_CONTEXT *failover_context);
 static void check_requests(void);
 static void print_signal_member(sigset_t *sig);
 static void service_child_processes(void);
+static void service_child_processes_adaptive(int connected_children, int idle_children);
+static int	spawn_child_processes(int count);
+static void retire_child_processes(int count, int one_shot_kill_count);
+static void update_process_management_info(void);
+static int	get_listen_queue_length(void);
 static int select_victim_processes(int *process_info_idxs, int count);
 
 static struct sockaddr_un *un_addrs;	/* unix domain socket path */
@@ -256,6 +300,15 @@ int			my_proc_id;
 static BackendStatusRecord backend_rec; /* Backend status record */
 
 static pid_t worker_pid = 0;	/* pid of worker process */
+static pid_t memqcache_invalidator_pid = 0;	/* pid of query cache
+												 * invalidation worker */
+static pid_t relcache_refresher_pid = 0;	/* pid of relcache refresh
+											 * worker */
+static pid_t memqcache_decoder_pid = 0;	/* pid of query cache logical
+										 * decoding worker */
+static pid_t notify_hub_pid = 0;	/* pid of notification hub */
+static pid_t metrics_pid = 0;	/* pid of metrics process */
+static int *metrics_fds = NULL;	/* listening sockets of metrics process */
 static pid_t follow_pid = 0;	/* pid for child process handling follow
 								 * command */
 static pid_t pcp_pid = 0;		/* pid for child process handling PCP */
@@ -377,6 +430,13 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	/* set up signal handlers */
 	pool_signal(SIGPIPE, SIG_IGN);
 
+	/*
+	 * Allocate the log rings of child processes before forking the log
+	 * collector, which drains them.
+	 */
+	if (pool_log_ring_enabled())
+		pool_init_log_rings();
+
 	/* start the log collector if enabled */
 	pgpool_logger_pid = SysLogger_Start();
     /*
@@ -509,26 +569,6 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 		free(inet_fds);
 	}
 
-	/* For query cache concurrency control */
-	if (pool_config->memory_cache_enabled)
-	{
-		char path[1024];
-		int		lfd;
-
-		snprintf(path, sizeof(path), "%s/QUERY_CACHE_LOCK_FILE", pool_config->logdir);
-		lfd = open(path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-		if (lfd == -1)
-		{
-			ereport(FATAL,
-					(errmsg("Failed to open lock file for query cache \"%s\"", path),
-					 errdetail("%m")));
-		}
-		close(lfd);
-
-		/* Register file unlink at exit */
-		on_proc_exit(FileUnlink, (Datum) path);
-	}
-
 	/*
 	 * We need to block signal here. Otherwise child might send some signals,
 	 * for example SIGUSR1(fail over).  Children will inherit signal blocking
@@ -537,6 +577,9 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	 */
 	POOL_SETMASK(&BlockSig);
 
+	if (pool_config->numa_child_affinity)
+		pool_numa_init();
+
 	if (pool_config->process_management == PM_DYNAMIC)
 	{
 		if (pool_config->process_management_strategy == PM_STRATEGY_AGGRESSIVE)
@@ -552,6 +595,12 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	{
 		process_info[i].start_time = time(NULL);
 		process_info[i].client_connection_count = 0;
+		process_info[i].pool_evictions = 0;
+		process_info[i].buffer_memory = 0;
+		process_info[i].memory_allocated = 0;
+		process_info[i].session_memory = 0;
+		process_info[i].query_memory = 0;
+		process_info[i].peak_memory = 0;
 		process_info[i].status = WAIT_FOR_CONNECT;
 		process_info[i].connected = 0;
 		process_info[i].wait_for_connect = 0;
@@ -618,11 +667,47 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	/* Fork worker process */
 	worker_pid = worker_fork_a_child(PT_WORKER, do_worker_child, NULL);
 
+	/* Fork query cache invalidation worker process */
+	if (pool_is_async_invalidation())
+		memqcache_invalidator_pid = worker_fork_a_child(PT_MEMQCACHE_INVALIDATOR,
+														do_memqcache_invalidator_child, NULL);
+
+	/* Fork relcache refresh worker process */
+	if (pool_need_relcache_refresh_worker())
+		relcache_refresher_pid = worker_fork_a_child(PT_RELCACHE_REFRESHER,
+													 do_relcache_refresh_child, NULL);
+
+	/* Fork query cache logical decoding worker process */
+	if (pool_is_logical_invalidation())
+		memqcache_decoder_pid = worker_fork_a_child(PT_MEMQCACHE_DECODER,
+													do_memqcache_decoder_child, NULL);
+
+	/* Fork notification hub process */
+	if (pool_config->listen_multiplexing_max_subscriptions > 0)
+		notify_hub_pid = worker_fork_a_child(PT_NOTIFY_HUB,
+											 do_notify_hub_child, NULL);
+
+	/* Fork metrics process */
+	if (pool_config->metrics_port > 0)
+	{
+		int			num_metrics_fds = 0;
+
+		metrics_fds = create_inet_domain_sockets_by_list(pool_config->metrics_listen_addresses,
+														 pool_config->num_metrics_listen_addresses,
+														 pool_config->metrics_port, &num_metrics_fds);
+		if (num_metrics_fds > 0)
+			metrics_pid = worker_fork_a_child(PT_METRICS, do_metrics_child, metrics_fds);
+		else
+			ereport(WARNING,
+					(errmsg("metrics process is not started"),
+					 errdetail("could not listen on any of metrics_listen_addresses")));
+	}
+
 	/* Fork health check process */
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		if (VALID_BACKEND(i))
-			health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+			health_check_pids[i] = start_health_check_process(i);
 	}
 
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
@@ -699,9 +784,12 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 			r = pool_pause(&t);
 			POOL_SETMASK(&BlockSig);
 
+			update_process_management_info();
 			if (pool_config->process_management == PM_DYNAMIC)
 				service_child_processes();
 
+			check_backend_error_rates();
+
 			if (r > 0)
 				break;
 		}
@@ -860,6 +948,9 @@ fork_a_child(int *fds, int id)
 		health_check_timer_expired = 0;
 		reload_config_request = 0;
 		my_proc_id = id;
+		pool_log_ring_attach(id);
+		if (pool_config->numa_child_affinity)
+			pool_numa_bind_child(id);
 		do_child(fds);
 	}
 	else if (pid == -1)
@@ -875,6 +966,81 @@ fork_a_child(int *fds, int id)
 /*
 * fork worker child process
 */
+/*
+ * Passive failure detection.  Child processes count the errors they see on
+ * backend connections.  If the errors reported for a node within a second
+ * reach health_check_error_threshold, ask the health check process to check
+ * the node right away instead of waiting for health_check_period.
+ */
+static void
+check_backend_error_rates(void)
+{
+	static uint32 last_errors[MAX_NUM_BACKENDS];
+	static struct timeval last_time;
+	struct timeval now;
+	double		elapsed;
+	int			i;
+
+	if (backend_error_counters == NULL)
+		return;
+
+	gettimeofday(&now, NULL);
+	elapsed = (now.tv_sec - last_time.tv_sec) + (now.tv_usec - last_time.tv_usec) / 1000000.0;
+
+	/* sample at most once a second */
+	if (last_time.tv_sec != 0 && elapsed < 1.0)
+		return;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		uint32		errors;
+		uint32		delta;
+
+		errors = pool_atomic_read_u32(&backend_error_counters[i].error_count) +
+			pool_atomic_read_u32(&backend_error_counters[i].connect_error_count);
+		delta = errors - last_errors[i];
+		last_errors[i] = errors;
+
+		if (last_time.tv_sec == 0 || pool_config->health_check_error_threshold <= 0 ||
+			delta == 0 || delta / elapsed < pool_config->health_check_error_threshold)
+			continue;
+
+		if (!VALID_BACKEND(i) || health_check_pids[i] <= 0 ||
+			pool_config->health_check_params[i].health_check_period <= 0)
+			continue;
+
+		ereport(LOG,
+				(errmsg("%u errors on DB node %d reported by child processes in %.1f seconds", delta, i, elapsed),
+				 errdetail("requesting immediate health check")));
+
+		health_check_request(i);
+		kill(health_check_pids[i], SIGUSR2);
+	}
+
+	last_time = now;
+}
+
+/*
+ * Start the health check process for the node, or with
+ * health_check_multiplexed, return the process already checking all the
+ * nodes if there is one.
+ */
+static pid_t
+start_health_check_process(int node)
+{
+	int			i;
+
+	if (!pool_config->health_check_multiplexed)
+		return worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &node);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i != node && health_check_pids[i] > 0)
+			return health_check_pids[i];
+	}
+	return worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_multiplexed, NULL);
+}
+
 static pid_t
 worker_fork_a_child(ProcessType type, void (*func) (), void *params)
 {
@@ -1213,6 +1379,41 @@ terminate_all_childrens(int sig)
 	}
 	worker_pid = 0;
 
+	if (memqcache_invalidator_pid != 0)
+	{
+		kill(memqcache_invalidator_pid, sig);
+		killed_count++;
+	}
+	memqcache_invalidator_pid = 0;
+
+	if (relcache_refresher_pid != 0)
+	{
+		kill(relcache_refresher_pid, sig);
+		killed_count++;
+	}
+	relcache_refresher_pid = 0;
+
+	if (memqcache_decoder_pid != 0)
+	{
+		kill(memqcache_decoder_pid, sig);
+		killed_count++;
+	}
+	memqcache_decoder_pid = 0;
+
+	if (notify_hub_pid != 0)
+	{
+		kill(notify_hub_pid, sig);
+		killed_count++;
+	}
+	notify_hub_pid = 0;
+
+	if (metrics_pid != 0)
+	{
+		kill(metrics_pid, sig);
+		killed_count++;
+	}
+	metrics_pid = 0;
+
 	if (pool_config->use_watchdog)
 	{
 		if (pool_config->use_watchdog)
@@ -1237,9 +1438,18 @@ terminate_all_childrens(int sig)
 	{
 		if (health_check_pids[i] != 0)
 		{
-			kill(health_check_pids[i], sig);
-			health_check_pids[i] = 0;
+			pid_t		hc_pid = health_check_pids[i];
+			int			j;
+
+			kill(hc_pid, sig);
 			killed_count++;
+
+			/* the multiplexed health check process appears more than once */
+			for (j = i; j < MAX_NUM_BACKENDS; j++)
+			{
+				if (health_check_pids[j] == hc_pid)
+					health_check_pids[j] = 0;
+			}
 		}
 	}
 	/* wait for all killed children to exit */
@@ -1335,6 +1545,14 @@ static RETSIGTYPE exit_handler(int sig)
 			(errmsg("terminating all child processes")));
 	terminate_all_childrens(sig);
 
+	/*
+	 * Save the query cache so that it can be reused after restart.  In
+	 * immediate shutdown mode the cache may be in the middle of being
+	 * modified, so we do not save it.
+	 */
+	if (sig != SIGQUIT && pool_is_memory_cache_snapshot())
+		pool_save_memory_cache_snapshot(true);
+
 	/*
 	 * Send signal to follow child process and it's children.
 	 */
@@ -1429,6 +1647,8 @@ static RETSIGTYPE sigusr1_handler(int sig)
 static void
 sigusr1_interrupt_processor(void)
 {
+	int			i;
+
 	ereport(LOG,
 			(errmsg("Pgpool-II parent process received SIGUSR1")));
 
@@ -1454,6 +1674,18 @@ sigusr1_interrupt_processor(void)
 
 		user1SignalSlot->signalFlags[SIG_INFORM_QUARANTINE_NODES] = false;
 		degenerate_all_quarantine_nodes();
+
+		/*
+		 * Watchdog may have asked for immediate health checks of the
+		 * backend nodes a pending failover is about.  Wake the health check
+		 * processes up so that our vote does not wait for the next
+		 * health_check_period.
+		 */
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (health_check_requested(i) && health_check_pids[i] > 0)
+				kill(health_check_pids[i], SIGUSR2);
+		}
 	}
 
 	if (user1SignalSlot->signalFlags[SIG_BACKEND_SYNC_REQUIRED])
@@ -1582,6 +1814,8 @@ failover(void)
 		return;
 	}
 
+	TRACE_PGPOOL_FAILOVER_START();
+
 	/* initialize failover context */
 	memset(&failover_context, 0, sizeof(failover_context));
 	failover_context.search_primary = true;
@@ -1752,6 +1986,8 @@ failover(void)
 	 * kick wakeup_handler in pcp_child to notice that failover/failback done.
 	 */
 	exec_notice_pcp_child(&failover_context);
+
+	TRACE_PGPOOL_FAILOVER_DONE(Req_info->main_node_id, Req_info->primary_node_id);
 }
 
 /*
@@ -1807,6 +2043,16 @@ process_name_from_pid(pid_t pid)
 		return "PCP child";
 	if (pid == worker_pid)
 		return "worker child";
+	if (pid == memqcache_invalidator_pid)
+		return "query cache invalidation worker";
+	if (pid == relcache_refresher_pid)
+		return "relcache refresh worker";
+	if (pid == memqcache_decoder_pid)
+		return "query cache logical decoding worker";
+	if (pid == notify_hub_pid)
+		return "notification hub";
+	if (pid == metrics_pid)
+		return "metrics process";
 	if (pool_config->use_watchdog)
 	{
 		if (pid == watchdog_pid)
@@ -1942,6 +2188,87 @@ reaper(void)
 			else
 				worker_pid = 0;
 		}
+
+		/* exiting process was query cache invalidation worker */
+		else if (pid == memqcache_invalidator_pid)
+		{
+			found = true;
+
+			/* release query cache lock the worker might have held */
+			pool_shmem_lock_release_dead_process(-1, pid);
+			pool_invalidation_worker_exited();
+
+			if (restart_child)
+			{
+				memqcache_invalidator_pid = worker_fork_a_child(PT_MEMQCACHE_INVALIDATOR,
+																do_memqcache_invalidator_child, NULL);
+				new_pid = memqcache_invalidator_pid;
+			}
+			else
+				memqcache_invalidator_pid = 0;
+		}
+
+		/* exiting process was relcache refresh worker */
+		else if (pid == relcache_refresher_pid)
+		{
+			found = true;
+
+			pool_relcache_refresh_worker_exited();
+
+			if (restart_child)
+			{
+				relcache_refresher_pid = worker_fork_a_child(PT_RELCACHE_REFRESHER,
+															 do_relcache_refresh_child, NULL);
+				new_pid = relcache_refresher_pid;
+			}
+			else
+				relcache_refresher_pid = 0;
+		}
+
+		/* exiting process was query cache logical decoding worker */
+		else if (pid == memqcache_decoder_pid)
+		{
+			found = true;
+
+			/* release query cache lock the worker might have held */
+			pool_shmem_lock_release_dead_process(-1, pid);
+
+			if (restart_child)
+			{
+				memqcache_decoder_pid = worker_fork_a_child(PT_MEMQCACHE_DECODER,
+															do_memqcache_decoder_child, NULL);
+				new_pid = memqcache_decoder_pid;
+			}
+			else
+				memqcache_decoder_pid = 0;
+		}
+
+		/* exiting process was notification hub */
+		else if (pid == notify_hub_pid)
+		{
+			found = true;
+			if (restart_child)
+			{
+				notify_hub_pid = worker_fork_a_child(PT_NOTIFY_HUB,
+													 do_notify_hub_child, NULL);
+				new_pid = notify_hub_pid;
+			}
+			else
+				notify_hub_pid = 0;
+		}
+
+		/* exiting process was metrics process */
+		else if (pid == metrics_pid)
+		{
+			found = true;
+			if (restart_child)
+			{
+				metrics_pid = worker_fork_a_child(PT_METRICS, do_metrics_child, metrics_fds);
+				new_pid = metrics_pid;
+			}
+			else
+				metrics_pid = 0;
+		}
 		else if (pid == pgpool_logger_pid)
 		{
 			if (restart_child)
@@ -1964,6 +2291,7 @@ reaper(void)
 			if (watchdog_pid == pid)
 			{
 				found = true;
+				wd_invalidate_shared_cluster_state();
 				if (restart_child)
 				{
 					watchdog_pid = initialize_watchdog();
@@ -1997,6 +2325,13 @@ reaper(void)
 				if (pid == process_info[i].pid)
 				{
 					found = true;
+
+					/* release query cache lock the child might have held */
+					pool_shmem_lock_release_dead_process(i, pid);
+
+					/* take back the client limit counts of the child */
+					pool_client_limit_release_dead_process(&process_info[i]);
+
 					/* if found, fork a new child */
 					if (!switching && !exiting && restart_child &&
 						pool_config->process_management != PM_DYNAMIC)
@@ -2005,6 +2340,12 @@ reaper(void)
 						process_info[i].start_time = time(NULL);
 						new_pid = process_info[i].pid;
 						process_info[i].client_connection_count = 0;
+						process_info[i].pool_evictions = 0;
+						process_info[i].buffer_memory = 0;
+						process_info[i].memory_allocated = 0;
+						process_info[i].session_memory = 0;
+						process_info[i].query_memory = 0;
+						process_info[i].peak_memory = 0;
 						process_info[i].status = WAIT_FOR_CONNECT;
 						process_info[i].connected = 0;
 						process_info[i].wait_for_connect = 0;
@@ -2024,21 +2365,28 @@ reaper(void)
 		{
 			process_health_check = true;
 
+			bool		exited[MAX_NUM_BACKENDS];
+
+			/*
+			 * With health_check_multiplexed, one process serves several
+			 * nodes, so forget it for all of them before forking a new one.
+			 */
 			for (i = 0; i < NUM_BACKENDS; i++)
 			{
-				if (pid == health_check_pids[i])
+				exited[i] = (pid == health_check_pids[i]);
+				if (exited[i])
 				{
 					found = true;
-
-					/* Fork new health check worker */
-					if (!switching && !exiting && VALID_BACKEND(i))
-					{
-						health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
-					}
-					else
-						health_check_pids[i] = 0;
+					health_check_pids[i] = 0;
 				}
 			}
+
+			for (i = 0; i < NUM_BACKENDS; i++)
+			{
+				/* Fork new health check worker */
+				if (exited[i] && !switching && !exiting && VALID_BACKEND(i))
+					health_check_pids[i] = start_health_check_process(i);
+			}
 		}
 
 		if (shutdown_system)
@@ -2296,7 +2644,8 @@ pool_sleep(unsigned int second)
  */
 static int
 trigger_failover_command(int node, const char *command_line,
-						 int old_main_node, int new_main_node, int old_primary)
+						 int old_main_node, int new_main_node, int old_primary,
+						 int candidate)
 {
 	int			r = 0;
 	StringInfoData	   exec_cmd_data;
@@ -2401,6 +2750,10 @@ trigger_failover_command(int node, const char *command_line,
 							appendStringInfoString(exec_cmd, "\"\"");
 						break;
 
+					case 'B':	/* most advanced standby node id */
+						appendStringInfo(exec_cmd, "%d", candidate);
+						break;
+
 					case '%':	/* escape */
 						appendStringInfoString(exec_cmd, "%");
 						break;
@@ -2726,7 +3079,6 @@ pool_get_node_status(void)
 static int
 find_primary_node(void)
 {
-	BackendInfo *bkinfo;
 	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
 	int			i;
 	POOL_NODE_STATUS *status;
@@ -2763,23 +3115,16 @@ find_primary_node(void)
 											   pool_config->sr_check_password);
 
 	/*
-	 * Establish connections to backend
+	 * Establish connections to backend.  This is done for all backends at
+	 * once so that unreachable backends do not delay the detection of the
+	 * primary by connect_timeout each.
 	 */
+	make_persistent_db_connections_noerror(slots, pool_config->sr_check_database,
+										   pool_config->sr_check_user,
+										   password ? password : "");
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
-		slots[i] = NULL;
-
-		if (!VALID_BACKEND(i))
-			continue;
-
-		bkinfo = pool_get_node_info(i);
-
-		slots[i] = make_persistent_db_connection_noerror(i, bkinfo->backend_hostname,
-														 bkinfo->backend_port,
-														 pool_config->sr_check_database,
-														 pool_config->sr_check_user,
-														 password ? password : "", false);
-		if (!slots[i])
+		if (VALID_BACKEND(i) && !slots[i])
 		{
 			ereport(LOG,
 					(errmsg("find_primary_node: make_persistent_db_connection_noerror failed on node %d", i)));
@@ -2909,6 +3254,109 @@ find_primary_node_repeatedly(void)
 	return node_id;
 }
 
+/*
+ * Execute follow_primary_command for all down nodes, running up to
+ * follow_primary_command_parallelism commands at the same time.  Each
+ * command runs in its own process forked from the follow child, so a slow
+ * pg_basebackup for one node does not hold up the recovery of the others.
+ * Returns after all commands have finished.
+ */
+static void
+exec_follow_primary_command_parallel(int old_main_node, int new_primary, int old_primary)
+{
+	pid_t		pids[MAX_NUM_BACKENDS];
+	int			running = 0;
+	int			i;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+		pids[i] = 0;
+
+	for (i = 0; i < pool_config->backend_desc->num_backends || running > 0;)
+	{
+		pid_t		pid;
+		int			status;
+		int			node;
+
+		/* launch as many commands as allowed */
+		if (i < pool_config->backend_desc->num_backends &&
+			running < pool_config->follow_primary_command_parallelism)
+		{
+			BackendInfo *bkinfo = pool_get_node_info(i);
+
+			if (bkinfo->backend_status != CON_DOWN)
+			{
+				i++;
+				continue;
+			}
+
+			ereport(LOG,
+					(errmsg("=== Starting follow primary command for node %d ===", i)));
+
+			pid = fork();
+			if (pid == 0)
+			{
+				int			r;
+
+				r = trigger_failover_command(i, pool_config->follow_primary_command,
+											 old_main_node, new_primary, old_primary, -1);
+				if (r == -1)
+					exit(1);
+				exit(WIFEXITED(r) ? WEXITSTATUS(r) : 1);
+			}
+			else if (pid == -1)
+			{
+				/* fall back to running the command ourselves */
+				ereport(WARNING,
+						(errmsg("could not fork a process for follow primary command for node %d", i),
+						 errdetail("%m")));
+				trigger_failover_command(i, pool_config->follow_primary_command,
+										 old_main_node, new_primary, old_primary, -1);
+				ereport(LOG,
+						(errmsg("=== Follow primary command for node %d ended ===", i)));
+			}
+			else
+			{
+				pids[i] = pid;
+				running++;
+			}
+			i++;
+			continue;
+		}
+
+		/* wait for one of the running commands to finish */
+		pid = waitpid(-1, &status, 0);
+		if (pid == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(WARNING,
+					(errmsg("waitpid() failed while waiting for follow primary commands"),
+					 errdetail("%m")));
+			break;
+		}
+
+		for (node = 0; node < MAX_NUM_BACKENDS; node++)
+		{
+			if (pids[node] == pid)
+				break;
+		}
+		if (node >= MAX_NUM_BACKENDS)
+			continue;
+
+		pids[node] = 0;
+		running--;
+
+		if (WIFEXITED(status))
+			ereport(LOG,
+					(errmsg("=== Follow primary command for node %d ended ===", node),
+					 errdetail("exit status: %d", WEXITSTATUS(status))));
+		else
+			ereport(LOG,
+					(errmsg("=== Follow primary command for node %d ended ===", node),
+					 errdetail("terminated abnormally with status: %d", status)));
+	}
+}
+
 /*
 * fork a follow child
 */
@@ -2958,19 +3406,24 @@ fork_follow_child(int old_main_node, int new_primary, int old_primary)
 		wd_lock_standby(WD_FOLLOW_PRIMARY_LOCK);
 		pool_acquire_follow_primary_lock(true, false);
 		Req_info->follow_primary_ongoing = true;
-		for (i = 0; i < pool_config->backend_desc->num_backends; i++)
+		if (pool_config->follow_primary_command_parallelism > 1)
+			exec_follow_primary_command_parallel(old_main_node, new_primary, old_primary);
+		else
 		{
-			BackendInfo *bkinfo;
-
-			bkinfo = pool_get_node_info(i);
-			if (bkinfo->backend_status == CON_DOWN)
+			for (i = 0; i < pool_config->backend_desc->num_backends; i++)
 			{
-				ereport(LOG,
-						(errmsg("=== Starting follow primary command for node %d ===", i)));
-				trigger_failover_command(i, pool_config->follow_primary_command,
-										 old_main_node, new_primary, old_primary);
-				ereport(LOG,
-						(errmsg("=== Follow primary command for node %d ended ===", i)));
+				BackendInfo *bkinfo;
+
+				bkinfo = pool_get_node_info(i);
+				if (bkinfo->backend_status == CON_DOWN)
+				{
+					ereport(LOG,
+							(errmsg("=== Starting follow primary command for node %d ===", i)));
+					trigger_failover_command(i, pool_config->follow_primary_command,
+											 old_main_node, new_primary, old_primary, -1);
+					ereport(LOG,
+							(errmsg("=== Follow primary command for node %d ended ===", i)));
+				}
 			}
 		}
 		Req_info->follow_primary_ongoing = false;
@@ -3004,7 +3457,7 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	size += MAXALIGN(sizeof(BackendDesc));
 	elog(DEBUG1, "BackendDesc: %zu bytes requested for shared memory", MAXALIGN(sizeof(BackendDesc)));
 	size += MAXALIGN(pool_coninfo_size());
-	size += MAXALIGN(pool_config->num_init_children * (sizeof(ProcessInfo)));
+	size += MAXALIGN(pool_config->num_init_children * (sizeof(ProcessInfo)) + POOL_CACHE_LINE_SIZE);
 	elog(DEBUG1, "ProcessInfo: num_init_children (%d) * sizeof(ProcessInfo) (%zu) = %zu bytes requested for shared memory",
 		 pool_config->num_init_children, sizeof(ProcessInfo), pool_config->num_init_children* sizeof(ProcessInfo));
 	size += MAXALIGN(sizeof(User1SignalSlot));
@@ -3015,22 +3468,63 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	size += MAXALIGN(stat_shared_memory_size());
 	elog(DEBUG1, "stat_shared_memory_size: %zu bytes requested for shared memory", MAXALIGN(stat_shared_memory_size()));
 	size += MAXALIGN(health_check_stats_shared_memory_size());
+	size += MAXALIGN(backend_error_counters_shared_memory_size());
 	/* Snapshot Isolation manage area */
 	size += MAXALIGN(sizeof(SI_ManageInfo));
 	elog(DEBUG1, "SI_ManageInfo: %zu bytes requested for shared memory", MAXALIGN(sizeof(SI_ManageInfo)));
 	size += MAXALIGN(pool_config->num_init_children * sizeof(pid_t));
 	size += MAXALIGN(pool_config->num_init_children * sizeof(pid_t));
+	size += MAXALIGN(pool_client_limit_shmem_size());
+	/* parsed configuration shared with children */
+	size += MAXALIGN(pool_config_snapshot_size());
 
-	if (pool_is_shmem_cache())
+	if (pool_config->memory_cache_enabled && pool_is_shmem_cache())
 	{
 		size += MAXALIGN(pool_shared_memory_cache_size());
 		size += MAXALIGN(pool_shared_memory_fsmm_size());
 		size += MAXALIGN(pool_hash_size(pool_config->memqcache_max_num_cache));
+		size += MAXALIGN(pool_oid_map_size());
+		if (pool_is_async_invalidation())
+			size += MAXALIGN(pool_invalidation_queue_size());
+		if (pool_is_remote_invalidation())
+			size += MAXALIGN(pool_remote_invalidation_queue_size());
+		size += MAXALIGN(pool_shmem_lock_size());
+		size += MAXALIGN(pool_cache_inflight_size());
+	}
+	if (pool_config->memory_cache_enabled)
+	{
+		size += MAXALIGN(pool_memqcache_stats_size());
+		elog(DEBUG1, "POOL_QUERY_CACHE_STATS: %zu bytes requested for shared memory", MAXALIGN(pool_memqcache_stats_size()));
+	}
+	if (pool_config->enable_shared_relcache)
+	{
+		size += MAXALIGN(pool_shared_relcache_shmem_size());
+		elog(DEBUG1, "shared relcache: %zu bytes requested for shared memory", MAXALIGN(pool_shared_relcache_shmem_size()));
+	}
+	if (pool_config->dns_cache_size > 0)
+	{
+		size += MAXALIGN(pool_dns_cache_shmem_size());
+		elog(DEBUG1, "DNS cache: %zu bytes requested for shared memory", MAXALIGN(pool_dns_cache_shmem_size()));
+	}
+	if (pool_config->scram_key_cache_size > 0)
+	{
+		size += MAXALIGN(pool_scram_cache_shmem_size());
+		elog(DEBUG1, "SCRAM cache: %zu bytes requested for shared memory", MAXALIGN(pool_scram_cache_shmem_size()));
 	}
-	if (pool_config->memory_cache_enabled || pool_config->enable_shared_relcache)
+	if (pool_config->lobj_oid_batch_size > 1)
 	{
-		size += MAXALIGN(sizeof(POOL_QUERY_CACHE_STATS));
-		elog(DEBUG1, "POOL_QUERY_CACHE_STATS: %zu bytes requested for shared memory", MAXALIGN(sizeof(POOL_QUERY_CACHE_STATS)));
+		size += MAXALIGN(pool_lobj_shmem_size());
+		elog(DEBUG1, "large object id range: %zu bytes requested for shared memory", MAXALIGN(pool_lobj_shmem_size()));
+	}
+	if (pool_config->listen_multiplexing_max_subscriptions > 0)
+	{
+		size += MAXALIGN(pool_notify_hub_shmem_size());
+		elog(DEBUG1, "notification hub: %zu bytes requested for shared memory", MAXALIGN(pool_notify_hub_shmem_size()));
+	}
+	if (pool_config->statement_stats_max > 0)
+	{
+		size += MAXALIGN(pool_statement_stats_shmem_size());
+		elog(DEBUG1, "statement stats: %zu bytes requested for shared memory", MAXALIGN(pool_statement_stats_shmem_size()));
 	}
 
 	if (pool_config->use_watchdog)
@@ -3050,13 +3544,16 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	pool_config->backend_desc = backend_desc;
 
 	/* get the shared memory from main segment*/
-	con_info = (ConnectionInfo *)pool_shared_memory_segment_get_chunk(pool_coninfo_size());
+	pool_coninfo_init(pool_shared_memory_segment_get_chunk(pool_coninfo_size()));
 
-	process_info = (ProcessInfo *)pool_shared_memory_segment_get_chunk(pool_config->num_init_children * (sizeof(ProcessInfo)));
+	/* align the process table to cache lines, see ProcessInfo */
+	process_info = (ProcessInfo *) TYPEALIGN(POOL_CACHE_LINE_SIZE,
+											 pool_shared_memory_segment_get_chunk(pool_config->num_init_children * (sizeof(ProcessInfo)) + POOL_CACHE_LINE_SIZE));
 	for (i = 0; i < pool_config->num_init_children; i++)
 	{
 		process_info[i].connection_info = pool_coninfo(i, 0, 0);
 		process_info[i].pid = 0;
+		pool_client_limit_init_process(&process_info[i]);
 	}
 
 	user1SignalSlot = (User1SignalSlot *)pool_shared_memory_segment_get_chunk(sizeof(User1SignalSlot));
@@ -3072,6 +3569,9 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	/* Initialize health check statistics area */
 	health_check_stats_init(pool_shared_memory_segment_get_chunk(health_check_stats_shared_memory_size()));
 
+	/* Initialize backend error counters area */
+	backend_error_counters_init(pool_shared_memory_segment_get_chunk(backend_error_counters_shared_memory_size()));
+
 	/* Initialize Snapshot Isolation manage area */
 	si_manage_info = (SI_ManageInfo*)pool_shared_memory_segment_get_chunk(sizeof(SI_ManageInfo));
 
@@ -3081,6 +3581,13 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	si_manage_info->commit_waiting_children =
 		(pid_t*)pool_shared_memory_segment_get_chunk(pool_config->num_init_children * sizeof(pid_t));
 
+	/* Initialize per user and per database client limits area */
+	pool_client_limit_shmem_init(pool_shared_memory_segment_get_chunk(pool_client_limit_shmem_size()));
+
+	/* Publish the parsed configuration for children */
+	pool_config_snapshot_init(pool_shared_memory_segment_get_chunk(pool_config_snapshot_size()),
+							  conf_file, hba_file);
+
 	/*
 	 * Initialize backend status area. From now on, VALID_BACKEND macro can be
 	 * used. (get_next_main_node() uses VALID_BACKEND)
@@ -3094,15 +3601,53 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 	/* initialize Req_info */
 	Req_info->main_node_id = get_next_main_node();
 	Req_info->conn_counter = 0;
+	memset(&Req_info->pm_info, 0, sizeof(Req_info->pm_info));
 	Req_info->switching = false;
 	Req_info->request_queue_head = Req_info->request_queue_tail = -1;
 	Req_info->primary_node_id = -2;
 	*InRecovery = RECOVERY_INIT;
 
 	/*
-	 * Initialize shared memory cache
+	 * Initialize shared relation cache
 	 */
-	if (pool_config->memory_cache_enabled || pool_config->enable_shared_relcache)
+	if (pool_config->enable_shared_relcache)
+		pool_init_shared_relcache();
+
+	/*
+	 * Initialize statement statistics
+	 */
+	if (pool_config->statement_stats_max > 0)
+		pool_init_statement_stats();
+
+	/*
+	 * Initialize the cache of client host names.
+	 */
+	if (pool_config->dns_cache_size > 0)
+		pool_init_dns_cache();
+
+	/*
+	 * Initialize the SCRAM keys and verifiers shared among children.
+	 */
+	if (pool_config->scram_key_cache_size > 0)
+		pool_init_scram_cache();
+
+	/*
+	 * Initialize the range of large object ids reserved for lo_creat.
+	 */
+	if (pool_config->lobj_oid_batch_size > 1)
+		pool_init_lobj_oid_range();
+
+	/*
+	 * Initialize the subscriptions and notifications of the notification
+	 * hub.
+	 */
+	if (pool_config->listen_multiplexing_max_subscriptions > 0)
+		pool_init_notify_hub();
+
+	/*
+	 * Initialize shared memory cache
+	 */
+	if (pool_config->memory_cache_enabled)
 	{
 		if (pool_is_shmem_cache())
 		{
@@ -3121,14 +3666,26 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 
 			pool_allocate_fsmm_clock_hand();
 
-			pool_discard_oid_maps();
-
-			ereport(LOG,
-					(errmsg("pool_discard_oid_maps: discarded memqcache oid maps")));
+			pool_init_oid_map();
 
 			pool_hash_init(pool_config->memqcache_max_num_cache);
 
-			pool_init_whole_cache_blocks();
+			/*
+			 * Cache blocks are initialized on first use by pool_get_block(),
+			 * so that startup does not have to touch the whole cache.
+			 */
+
+			pool_init_shmem_lock();
+
+			pool_init_cache_inflight();
+
+			if (pool_is_async_invalidation())
+				pool_init_invalidation_queue();
+
+			if (pool_is_remote_invalidation())
+				pool_init_remote_invalidation_queue();
+
+			pool_load_memory_cache_snapshot();
 		}
 
 #ifdef USE_MEMCACHED
@@ -3322,16 +3879,34 @@ read_status_file(bool discard_status)
 	return 0;
 }
 
+/*
+ * The status file is kept mapped into memory.  It has one fixed width
+ * line per backend ("up    ", "down  " or "unused"), which
+ * read_status_file() reads as before.  A status change just rewrites the
+ * lines in the mapping and leaves the write back to the kernel, so
+ * failover handling never waits for the disk.
+ */
+#define STATUS_LINE_LEN	7		/* strlen("unused\n") */
+
+static char *status_map = NULL;
+static size_t status_map_size = 0;
+static dev_t status_map_dev;
+static ino_t status_map_ino;
+static bool status_map_sync_registered = false;
+
+static bool status_file_is_mapped(const char *path, size_t size);
+static bool map_status_file(const char *path, size_t size);
+static void sync_status_file(int code, Datum arg);
+
 /*
 * Write the status file
 */
 int
 write_status_file(void)
 {
-	FILE	   *fd;
-	int			fdnum;
 	char		fnamebuf[POOLMAXPATHLEN];
-	char		buf[10];
+	char		buf[STATUS_LINE_LEN + 1];
+	size_t		size;
 	int			i;
 
 	if (!pool_config)
@@ -3367,18 +3942,14 @@ write_status_file(void)
 	}
 
 	snprintf(fnamebuf, sizeof(fnamebuf), "%s/%s", pool_config->logdir, STATUS_FILE_NAME);
-	fd = fopen(fnamebuf, "w");
-	if (!fd)
-	{
-		ereport(WARNING,
-				(errmsg("failed to open status file at: \"%s\"", fnamebuf),
-				 errdetail("%m")));
+	size = pool_config->backend_desc->num_backends * STATUS_LINE_LEN;
+	if (!status_file_is_mapped(fnamebuf, size) && !map_status_file(fnamebuf, size))
 		return -1;
-	}
 
 	for (i = 0; i < pool_config->backend_desc->num_backends; i++)
 	{
 		char	   *status;
+		char	   *p = status_map + i * STATUS_LINE_LEN;
 
 		if (BACKEND_INFO(i).backend_status == CON_UP ||
 			BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT)
@@ -3388,56 +3959,131 @@ write_status_file(void)
 		else
 			status = "unused";
 
-		sprintf(buf, "%s\n", status);
-		if (fwrite(buf, 1, strlen(buf), fd) != strlen(buf))
-		{
-			ereport(WARNING,
-					(errmsg("failed to write status file at: \"%s\"", fnamebuf),
-					 errdetail("%m")));
-			fclose(fd);
-			return -1;
-		}
+		/* only touch the lines of the nodes whose status changed */
+		snprintf(buf, sizeof(buf), "%-*s\n", STATUS_LINE_LEN - 1, status);
+		if (memcmp(p, buf, STATUS_LINE_LEN) != 0)
+			memcpy(p, buf, STATUS_LINE_LEN);
 	}
 
-	if (fflush(fd) != 0)
+	/* schedule the write back but do not wait for it */
+	if (msync(status_map, status_map_size, MS_ASYNC) != 0)
 	{
 		ereport(WARNING,
 				(errmsg("failed to write status file at: \"%s\"", fnamebuf),
 				 errdetail("%m")));
-		fclose(fd);
 		return -1;
 	}
-	fdnum = fileno(fd);
-	if (fdnum < 0)
+
+	return 0;
+}
+
+/*
+ * Return true if the status file is mapped with the given size and the
+ * mapping still refers to the file at path, which may have been removed
+ * or replaced while we were running.
+ */
+static bool
+status_file_is_mapped(const char *path, size_t size)
+{
+	struct stat st;
+
+	if (status_map == NULL || status_map_size != size)
+		return false;
+	if (stat(path, &st) != 0)
+		return false;
+	return st.st_dev == status_map_dev && st.st_ino == status_map_ino;
+}
+
+/*
+ * Map the status file into memory, creating it if necessary.  Only the
+ * main process shrinks the file, so that a child having it mapped with
+ * a larger size never touches a page beyond the end of the file.  This
+ * also gets rid of the old binary format file at startup.
+ */
+static bool
+map_status_file(const char *path, size_t size)
+{
+	struct stat st;
+	int			fd;
+	void	   *map;
+
+	if (status_map)
+	{
+		munmap(status_map, status_map_size);
+		status_map = NULL;
+		status_map_size = 0;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	if (fd < 0)
 	{
 		ereport(WARNING,
-				(errmsg("failed to get file number. fsync() will not be performed: \"%s\"", fnamebuf),
+				(errmsg("failed to open status file at: \"%s\"", path),
 				 errdetail("%m")));
-		fclose(fd);
-		return -1;
+		return false;
 	}
-	if (fsync(fdnum) != 0)
+
+	if (fstat(fd, &st) != 0 ||
+		((st.st_size < (off_t) size ||
+		  (st.st_size > (off_t) size && processType == PT_MAIN)) &&
+		 ftruncate(fd, size) != 0))
 	{
 		ereport(WARNING,
-				(errmsg("failed to fsync(): \"%s\"", fnamebuf),
+				(errmsg("failed to resize status file at: \"%s\"", path),
 				 errdetail("%m")));
-		fclose(fd);
-		return -1;
+		close(fd);
+		return false;
 	}
 
-	fclose(fd);
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		ereport(WARNING,
+				(errmsg("failed to map status file at: \"%s\"", path),
+				 errdetail("%m")));
+		return false;
+	}
 
-	return 0;
+	status_map = map;
+	status_map_size = size;
+	status_map_dev = st.st_dev;
+	status_map_ino = st.st_ino;
+
+	/* make sure the file is on disk when pgpool shuts down */
+	if (processType == PT_MAIN && !status_map_sync_registered)
+	{
+		on_proc_exit(sync_status_file, (Datum) 0);
+		status_map_sync_registered = true;
+	}
+
+	return true;
+}
+
+static void
+sync_status_file(int code, Datum arg)
+{
+	if (status_map && msync(status_map, status_map_size, MS_SYNC) != 0)
+		ereport(WARNING,
+				(errmsg("failed to sync status file"),
+				 errdetail("%m")));
 }
 
 static void
 reload_config(void)
 {
+	bool		was_unused[MAX_NUM_BACKENDS];
+	int			i;
+
 	ereport(LOG,
 			(errmsg("reload config files.")));
 	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
-	pool_get_config(conf_file, CFGCXT_RELOAD);
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+		was_unused[i] = BACKEND_INFO(i).backend_status == CON_UNUSED;
+
+	/* parse once and publish the result to the children */
+	pool_config_snapshot_reload(conf_file, hba_file);
 
 	/* Reloading config file could change backend status */
 	(void) write_status_file();
@@ -3449,6 +4095,38 @@ reload_config(void)
 
 	if (worker_pid)
 		kill(worker_pid, SIGHUP);
+
+	if (memqcache_invalidator_pid)
+		kill(memqcache_invalidator_pid, SIGHUP);
+
+	if (relcache_refresher_pid)
+		kill(relcache_refresher_pid, SIGHUP);
+
+	if (memqcache_decoder_pid)
+		kill(memqcache_decoder_pid, SIGHUP);
+
+	if (notify_hub_pid)
+		kill(notify_hub_pid, SIGHUP);
+
+	if (metrics_pid)
+		kill(metrics_pid, SIGHUP);
+
+	/*
+	 * Nodes added to the configuration file come up in down status.  Attach
+	 * them if requested, just like pcp_attach_node does.
+	 */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!was_unused[i] || BACKEND_INFO(i).backend_status != CON_DOWN)
+			continue;
+
+		ereport(LOG,
+				(errmsg("backend node %d host: %s port: %d was added",
+						i, BACKEND_INFO(i).backend_hostname, BACKEND_INFO(i).backend_port)));
+
+		if (pool_config->auto_attach_new_backends)
+			send_failback_request(i, false, REQ_DETAIL_CONFIRMED);
+	}
 }
 
 /* Call back function to unlink the file */
@@ -3564,10 +4242,22 @@ update_backend_quarantine_status(void)
  * do a partial or full restart of Pgpool-II children depending upon the
  * Pgpool-II mode and type of node status change
  *
+ * The leader numbers the status it reports (see get_backend_node_status_json).
+ * When the status comes from the same leader incarnation as the previous sync
+ * and nothing was changed locally since then, only the nodes whose status
+ * changed on the leader are applied. Otherwise the whole status is resynced.
  */
 static void
 sync_backend_from_watchdog(void)
 {
+	/* state of the previous sync */
+	static WDPGBackendStatus last_leader_status;
+	static bool last_leader_status_valid = false;
+	static BACKEND_STATUS last_local_status[MAX_NUM_BACKENDS];
+	static int	last_local_primary_node_id = -1;
+
+	bool		full_sync;
+	char		leader_name[WD_MAX_HOST_NAMELEN];
 	bool		primary_changed = false;
 	bool		node_status_was_changed_to_down = false;
 	bool		node_status_was_changed_to_up = false;
@@ -3613,12 +4303,49 @@ sync_backend_from_watchdog(void)
 	ereport(DEBUG1,
 			(errmsg("primary node on leader watchdog node \"%s\" is %d", backendStatus->nodeName, backendStatus->primary_node_id)));
 
+	strlcpy(leader_name, backendStatus->nodeName, sizeof(leader_name));
+
+	/*
+	 * Decide whether we can apply only the changes since the previous sync.
+	 * That requires a sequence from the same leader incarnation, no gap in
+	 * our view of it, and no local change of the backend status since then.
+	 */
+	full_sync = true;
+	if (last_leader_status_valid &&
+		backendStatus->status_epoch != 0 &&
+		backendStatus->status_epoch == last_leader_status.status_epoch &&
+		backendStatus->status_seq >= last_leader_status.status_seq &&
+		backendStatus->node_count == last_leader_status.node_count &&
+		strcmp(backendStatus->nodeName, last_leader_status.nodeName) == 0 &&
+		Req_info->primary_node_id == last_local_primary_node_id)
+	{
+		full_sync = false;
+		for (i = 0; i < backendStatus->node_count; i++)
+		{
+			if (BACKEND_INFO(i).quarantine ||
+				BACKEND_INFO(i).backend_status != last_local_status[i])
+			{
+				full_sync = true;
+				break;
+			}
+		}
+	}
+
+	if (!full_sync)
+		ereport(DEBUG1,
+				(errmsg("applying backend status changes from sequence %d to %d of leader watchdog node \"%s\"",
+						last_leader_status.status_seq, backendStatus->status_seq, leader_name)));
 
 	/*
 	 * update the local backend status Also remove quarantine flags
 	 */
 	for (i = 0; i < backendStatus->node_count; i++)
 	{
+		/* unchanged on the leader since the last sync */
+		if (!full_sync &&
+			backendStatus->backend_status[i] == last_leader_status.backend_status[i])
+			continue;
+
 		BACKEND_INFO(i).quarantine = false;
 		if (backendStatus->backend_status[i] == CON_DOWN)
 		{
@@ -3661,7 +4388,8 @@ sync_backend_from_watchdog(void)
 	 * from the one on leader watchdog node. This should be done only in streaming
 	 * or logical replication mode.
 	 */
-	if (SL_MODE && Req_info->primary_node_id != backendStatus->primary_node_id)
+	if (SL_MODE && Req_info->primary_node_id != backendStatus->primary_node_id &&
+		(full_sync || backendStatus->primary_node_id != last_leader_status.primary_node_id))
 	{
 		/* Do not produce this log message if we are starting up the Pgpool-II */
 		if (processState != INITIALIZING)
@@ -3694,6 +4422,13 @@ sync_backend_from_watchdog(void)
 		}
 	}
 
+	/* remember what we have synced for the next time */
+	memcpy(&last_leader_status, backendStatus, sizeof(WDPGBackendStatus));
+	last_leader_status_valid = true;
+	for (i = 0; i < backendStatus->node_count; i++)
+		last_local_status[i] = BACKEND_INFO(i).backend_status;
+	last_local_primary_node_id = Req_info->primary_node_id;
+
 	pfree(backendStatus);
 
 	if (reload_master_node_id)
@@ -3716,7 +4451,7 @@ sync_backend_from_watchdog(void)
 		primary_changed == false)
 	{
 		ereport(LOG,
-				(errmsg("backend nodes status remains same after the sync from \"%s\"", backendStatus->nodeName)));
+				(errmsg("backend nodes status remains same after the sync from \"%s\"", leader_name)));
 		return;
 	}
 	if (!STREAM)
@@ -3726,7 +4461,7 @@ sync_backend_from_watchdog(void)
 		 * processes
 		 */
 		ereport(LOG,
-				(errmsg("node status was changed after the sync from \"%s\"", backendStatus->nodeName),
+				(errmsg("node status was changed after the sync from \"%s\"", leader_name),
 				 errdetail("all children needs to be restarted as we are not in streaming replication mode")));
 		need_to_restart_children = true;
 		partial_restart = false;
@@ -3739,7 +4474,7 @@ sync_backend_from_watchdog(void)
 		need_to_restart_children = true;
 		partial_restart = false;
 		ereport(LOG,
-				(errmsg("primary node was changed after the sync from \"%s\"", backendStatus->nodeName),
+				(errmsg("primary node was changed after the sync from \"%s\"", leader_name),
 				 errdetail("all children needs to be restarted")));
 
 	}
@@ -3753,13 +4488,13 @@ sync_backend_from_watchdog(void)
 			need_to_restart_children = false;
 			partial_restart = false;
 			ereport(LOG,
-					(errmsg("No backend node was detached because of backend status sync from \"%s\"", backendStatus->nodeName),
+					(errmsg("No backend node was detached because of backend status sync from \"%s\"", leader_name),
 					 errdetail("no need to restart children")));
 		}
 		else
 		{
 			ereport(LOG,
-					(errmsg("%d backend node(s) were detached because of backend status sync from \"%s\"", down_node_ids_index, backendStatus->nodeName),
+					(errmsg("%d backend node(s) were detached because of backend status sync from \"%s\"", down_node_ids_index, leader_name),
 					 errdetail("restarting the children processes")));
 
 			need_to_restart_children = true;
@@ -3818,6 +4553,12 @@ sync_backend_from_watchdog(void)
 					process_info[i].pid = fork_a_child(fds, i);
 					process_info[i].start_time = time(NULL);
 					process_info[i].client_connection_count = 0;
+					process_info[i].pool_evictions = 0;
+					process_info[i].buffer_memory = 0;
+					process_info[i].memory_allocated = 0;
+					process_info[i].session_memory = 0;
+					process_info[i].query_memory = 0;
+					process_info[i].peak_memory = 0;
 					process_info[i].status = WAIT_FOR_CONNECT;
 					process_info[i].connected = 0;
 					process_info[i].wait_for_connect = 0;
@@ -3857,7 +4598,7 @@ sync_backend_from_watchdog(void)
 							BACKEND_INFO(i).backend_hostname,
 							BACKEND_INFO(i).backend_port)));
 
-			health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+			health_check_pids[i] = start_health_check_process(i);
 		}
 	}
 }
@@ -4198,7 +4939,7 @@ handle_failback_request(FAILOVER_CONTEXT *failover_context, int node_id)
 		(void) write_status_file();
 
 		trigger_failover_command(node_id, pool_config->failback_command,
-								 MAIN_NODE_ID, get_next_main_node(), PRIMARY_NODE_ID);
+								 MAIN_NODE_ID, get_next_main_node(), PRIMARY_NODE_ID, -1);
 	}
 
 	failover_context->sync_required = true;
@@ -4338,18 +5079,31 @@ kill_failover_children(FAILOVER_CONTEXT *failover_context, int node_id)
 	/*
 	 * If the mode is streaming replication and the request is
 	 * NODE_DOWN_REQUEST and it's actually a switch over request, we don't
-	 * need to restart all children, except the node is primary.
+	 * need to restart all children, except the node is primary.  The same
+	 * applies to any standby failure if failover_keep_sessions is on.  In
+	 * this case the surviving children close their connections to the
+	 * failed node by themselves and are not restarted after the session
+	 * ends.
 	 */
 	else if (STREAM && (failover_context->reqkind == NODE_DOWN_REQUEST || failover_context->reqkind == NODE_QUARANTINE_REQUEST) &&
-			 failover_context->request_details & REQ_DETAIL_SWITCHOVER && node_id != PRIMARY_NODE_ID)
+			 (failover_context->request_details & REQ_DETAIL_SWITCHOVER || pool_config->failover_keep_sessions) &&
+			 node_id != PRIMARY_NODE_ID)
 	{
-		ereport(LOG,
-				(errmsg("Do not restart children because we are switching over node id %d host: %s port: %d and we are in streaming replication mode", node_id,
-						BACKEND_INFO(node_id).backend_hostname,
-						BACKEND_INFO(node_id).backend_port)));
+		if (failover_context->request_details & REQ_DETAIL_SWITCHOVER)
+			ereport(LOG,
+					(errmsg("Do not restart children because we are switching over node id %d host: %s port: %d and we are in streaming replication mode", node_id,
+							BACKEND_INFO(node_id).backend_hostname,
+							BACKEND_INFO(node_id).backend_port)));
+		else
+			ereport(LOG,
+					(errmsg("Do not restart children because standby node id %d host: %s port: %d went down and failover_keep_sessions is on", node_id,
+							BACKEND_INFO(node_id).backend_hostname,
+							BACKEND_INFO(node_id).backend_port)));
 
 		failover_context->need_to_restart_children = true;
 		failover_context->partial_restart = true;
+		failover_context->keep_sessions = pool_config->failover_keep_sessions;
+		failover_context->reattach_sessions = false;
 
 		for (i = 0; i < pool_config->num_init_children; i++)
 		{
@@ -4386,6 +5140,39 @@ kill_failover_children(FAILOVER_CONTEXT *failover_context, int node_id)
 			}
 		}
 	}
+	/*
+	 * If the primary went down and failover_reattach_timeout is set, the
+	 * children whose session is idle reattach it to the new primary by
+	 * themselves.  Only the children executing a query or inside a
+	 * transaction are restarted.
+	 */
+	else if (STREAM && failover_context->reqkind == NODE_DOWN_REQUEST &&
+			 pool_config->failover_keep_sessions &&
+			 pool_config->failover_reattach_timeout > 0)
+	{
+		ereport(LOG,
+				(errmsg("Restart only busy children because primary node id %d host: %s port: %d went down and failover_reattach_timeout is set", node_id,
+						BACKEND_INFO(node_id).backend_hostname,
+						BACKEND_INFO(node_id).backend_port)));
+
+		failover_context->need_to_restart_children = true;
+		failover_context->partial_restart = true;
+		failover_context->keep_sessions = true;
+		failover_context->reattach_sessions = true;
+
+		for (i = 0; i < pool_config->num_init_children; i++)
+		{
+			pid_t		pid = process_info[i].pid;
+
+			if (pid && CHILD_SESSION_IS_BUSY(i))
+			{
+				kill(pid, SIGQUIT);
+				ereport(DEBUG1,
+						(errmsg("failover handler"),
+						 errdetail("kill process with PID:%d", pid)));
+			}
+		}
+	}
 	else
 	{
 		ereport(LOG,
@@ -4419,9 +5206,18 @@ static void
 exec_failover_command(FAILOVER_CONTEXT *failover_context, int new_main_node_id, int promote_node_id)
 {
 	int		i;
+	int		candidate = -1;
 
 	if (failover_context->reqkind == NODE_DOWN_REQUEST)
 	{
+		/*
+		 * Look for the most advanced standby only if failover_command asks
+		 * for it, since this requires connecting to all the standbys.
+		 */
+		if (pool_config->failover_command &&
+			strstr(pool_config->failover_command, "%B"))
+			candidate = find_most_advanced_standby();
+
 		for (i = 0; i < pool_config->backend_desc->num_backends; i++)
 		{
 			if (failover_context->nodes[i])
@@ -4433,12 +5229,14 @@ exec_failover_command(FAILOVER_CONTEXT *failover_context, int new_main_node_id,
 				if (failover_context->request_details & REQ_DETAIL_PROMOTE)
 				{
 					trigger_failover_command(i, pool_config->failover_command,
-											 MAIN_NODE_ID, promote_node_id, REAL_PRIMARY_NODE_ID);
+											 MAIN_NODE_ID, promote_node_id, REAL_PRIMARY_NODE_ID,
+											 candidate);
 				}
 				else
 				{
 					trigger_failover_command(i, pool_config->failover_command,
-											 MAIN_NODE_ID, new_main_node_id, REAL_PRIMARY_NODE_ID);
+											 MAIN_NODE_ID, new_main_node_id, REAL_PRIMARY_NODE_ID,
+											 candidate);
 				}
 				failover_context->sync_required = true;
 			}
@@ -4446,6 +5244,85 @@ exec_failover_command(FAILOVER_CONTEXT *failover_context, int new_main_node_id,
 	}
 }
 
+/*
+ * Find the standby which has received the most WAL, to be passed to
+ * failover_command as the promotion candidate.  Ties are broken by the
+ * replayed WAL location.  The connections to the standbys are established
+ * in parallel so that an unreachable standby costs connect_timeout only
+ * once.  Returns -1 if there is no such standby.
+ */
+static int
+find_most_advanced_standby(void)
+{
+	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+	POOL_SELECT_RESULT *res;
+	uint64		best_receive = 0;
+	uint64		best_replay = 0;
+	int			candidate = -1;
+	int			i;
+	char	   *password;
+
+	if (!STREAM)
+		return -1;
+
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+	make_persistent_db_connections_noerror(slots, pool_config->sr_check_database,
+										   pool_config->sr_check_user,
+										   password ? password : "");
+	if (password)
+		pfree(password);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		uint64		receive;
+		uint64		replay;
+
+		if (!slots[i])
+			continue;
+
+		if (i == REAL_PRIMARY_NODE_ID ||
+			get_query_result(slots, i,
+							 "SELECT pg_catalog.pg_last_wal_receive_lsn(), pg_catalog.pg_last_wal_replay_lsn()",
+							 &res) != 0)
+		{
+			discard_persistent_db_connection(slots[i]);
+			continue;
+		}
+
+		/* both are NULL on a primary */
+		if (res->data[0] || res->data[1])
+		{
+			receive = pool_parse_wal_location(res->data[0]);
+			replay = pool_parse_wal_location(res->data[1]);
+
+			ereport(DEBUG1,
+					(errmsg("find_most_advanced_standby: node %d receive lsn: %s replay lsn: %s",
+							i, res->data[0] ? res->data[0] : "",
+							res->data[1] ? res->data[1] : "")));
+
+			if (candidate < 0 || receive > best_receive ||
+				(receive == best_receive && replay > best_replay))
+			{
+				candidate = i;
+				best_receive = receive;
+				best_replay = replay;
+			}
+		}
+		free_select_result(res);
+		discard_persistent_db_connection(slots[i]);
+	}
+
+	if (candidate >= 0)
+		ereport(LOG,
+				(errmsg("failover: most advanced standby is node %d", candidate)));
+	else
+		ereport(LOG,
+				(errmsg("failover: could not find any standby to promote")));
+
+	return candidate;
+}
+
 /*
  * Determine new primary node id. Possibly call find_primary_node_repeatedly().
  */
@@ -4652,7 +5529,17 @@ exec_child_restart(FAILOVER_CONTEXT *failover_context, int node_id)
 
 			bool		restart = false;
 
-			if (failover_context->partial_restart)
+			if (failover_context->partial_restart && failover_context->reattach_sessions)
+			{
+				if (CHILD_SESSION_IS_BUSY(i))
+				{
+					ereport(LOG,
+							(errmsg("child pid %d needs to restart because its session is busy",
+									process_info[i].pid)));
+					restart = true;
+				}
+			}
+			else if (failover_context->partial_restart)
 			{
 				for (j = 0; j < pool_config->max_pool; j++)
 				{
@@ -4684,6 +5571,12 @@ exec_child_restart(FAILOVER_CONTEXT *failover_context, int node_id)
 					process_info[i].pid = fork_a_child(fds, i);
 					process_info[i].start_time = time(NULL);
 					process_info[i].client_connection_count = 0;
+					process_info[i].pool_evictions = 0;
+					process_info[i].buffer_memory = 0;
+					process_info[i].memory_allocated = 0;
+					process_info[i].session_memory = 0;
+					process_info[i].query_memory = 0;
+					process_info[i].peak_memory = 0;
 					process_info[i].status = WAIT_FOR_CONNECT;
 					process_info[i].connected = 0;
 					process_info[i].wait_for_connect = 0;
@@ -4691,7 +5584,7 @@ exec_child_restart(FAILOVER_CONTEXT *failover_context, int node_id)
 
 				}
 			}
-			else
+			else if (!failover_context->keep_sessions)
 				process_info[i].need_to_restart = 1;
 		}
 	}
@@ -4733,7 +5626,7 @@ exec_child_restart(FAILOVER_CONTEXT *failover_context, int node_id)
 								BACKEND_INFO(i).backend_hostname,
 								BACKEND_INFO(i).backend_port)));
 
-				health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+				health_check_pids[i] = start_health_check_process(i);
 			}
 		}
 	}
@@ -4994,11 +5887,15 @@ service_child_processes(void)
 	ereport(DEBUG2,
 		(errmsg("current_children_count = %d idle_children = %d connected_children = %d high_load_counter = %d",
 						current_child_process_count, idle_children, connected_children, high_load_counter)));
+
+	if (pool_config->process_management_strategy == PM_STRATEGY_ADAPTIVE)
+	{
+		service_child_processes_adaptive(connected_children, idle_children);
+		return;
+	}
+
 	if (idle_children > pool_config->max_spare_children)
 	{
-		int ki;
-		int victim_count;
-		int kill_process_info_idxs[MAX_ONE_SHOT_KILLS];
 		int kill_count = idle_children - pool_config->max_spare_children;
 		int cycle_skip_count_before_scale_down;
 		int cycle_skip_between_scale_down;
@@ -5036,29 +5933,7 @@ service_child_processes(void)
 		if (++high_load_counter < cycle_skip_count_before_scale_down || high_load_counter % cycle_skip_between_scale_down)
 			return;
 
-		memset(kill_process_info_idxs, -1 ,sizeof(kill_process_info_idxs));
-
-		if (kill_count > one_shot_kill_count)
-			kill_count = one_shot_kill_count;
-
-		victim_count = select_victim_processes(kill_process_info_idxs, kill_count);
-
-		for (ki = 0; ki < victim_count; ki++)
-		{
-			int index = kill_process_info_idxs[ki];
-			if (index >=0)
-			{
-				if (process_info[index].pid && process_info[index].status == WAIT_FOR_CONNECT)
-				{
-					ereport(DEBUG1,
-					(errmsg("asking child process with pid:%d to kill itself to satisfy max_spare_children",
-							process_info[index].pid),
-							errdetail("child process has %d pooled connections",process_info[index].pooled_connections)));
-					process_info[index].exit_if_idle = true;
-					kill(process_info[index].pid, SIGUSR2);
-				}
-			}
-		}
+		retire_child_processes(kill_count, one_shot_kill_count);
 	}
 	else
 	{
@@ -5067,43 +5942,258 @@ service_child_processes(void)
 		/*See if we need to spawn new children */
 		if (idle_children < pool_config->min_spare_children)
 		{
-			int i;
-			int spawned = 0;
 			int new_spawn_no = pool_config->min_spare_children - idle_children;
 			/* Add 25% of max_spare_children */
 			new_spawn_no += pool_config->max_spare_children / 4;
-			if (new_spawn_no + current_child_process_count > pool_config->num_init_children)
-			{
-				ereport(DEBUG5,
-					(errmsg("we have hit the ceiling, spawning %d child(ren)",
-									pool_config->num_init_children - current_child_process_count)));
-				new_spawn_no = pool_config->num_init_children - current_child_process_count;
-			}
-			if (new_spawn_no <= 0)
-				return;
-			for (i = 0; i < pool_config->num_init_children; i++)
-			{
-				if (process_info[i].pid == 0)
-				{
-					process_info[i].start_time = time(NULL);
-					process_info[i].client_connection_count = 0;
-					process_info[i].status = WAIT_FOR_CONNECT;
-					process_info[i].connected = 0;
-					process_info[i].wait_for_connect = 0;
-					process_info[i].pooled_connections = 0;
-					process_info[i].need_to_restart = 0;
-					process_info[i].exit_if_idle = false;
-					process_info[i].pid = fork_a_child(fds, i);
+			spawn_child_processes(new_spawn_no);
+		}
+	}
+}
 
-					current_child_process_count++;
-					if (++spawned >= new_spawn_no)
-						break;
-				}
+/*
+ * House keeping of spare child processes for the adaptive strategy.
+ *
+ * Unlike the other strategies this one looks at how many connections are
+ * waiting in the listen backlog and how busy the children are, as sampled
+ * by update_process_management_info().  Children are spawned as soon as
+ * clients start queuing, ahead of the idle count dropping below
+ * min_spare_children, and retired only after the load has stayed low for
+ * ADAPTIVE_SCALE_DOWN_DELAY seconds so that a bursty workload does not
+ * make the number of children oscillate.
+ */
+static void
+service_child_processes_adaptive(int connected_children, int idle_children)
+{
+	static time_t low_load_since = 0;
+	static time_t last_scale_down = 0;
+	volatile POOL_PROCESS_MANAGEMENT_INFO *pm_info = &Req_info->pm_info;
+	time_t		now = time(NULL);
+	int			wanted_idle_children;
+
+	/*
+	 * Keep min_spare_children idle children plus one for each connection
+	 * waiting in the backlog.  If most children are busy, add a quarter of
+	 * max_spare_children so that the next burst finds children ready.
+	 */
+	wanted_idle_children = pool_config->min_spare_children + pm_info->listen_queue_length;
+	if (pm_info->busy_ratio >= ADAPTIVE_BUSY_RATIO)
+		wanted_idle_children += pool_config->max_spare_children / 4;
+
+	if (idle_children < wanted_idle_children)
+	{
+		low_load_since = 0;
+		ereport(DEBUG1,
+				(errmsg("scaling up child processes"),
+				 errdetail("idle children: %d listen queue length: %d busy ratio: %.2f",
+						   idle_children, pm_info->listen_queue_length, pm_info->busy_ratio)));
+		spawn_child_processes(wanted_idle_children - idle_children);
+		return;
+	}
+
+	if (idle_children <= pool_config->max_spare_children ||
+		pm_info->listen_queue_peak > 0 ||
+		pm_info->busy_ratio >= ADAPTIVE_BUSY_RATIO)
+	{
+		low_load_since = 0;
+		return;
+	}
+
+	/* Do not scale down too quickly */
+	if (low_load_since == 0)
+		low_load_since = now;
+	if (now - low_load_since < ADAPTIVE_SCALE_DOWN_DELAY ||
+		now - last_scale_down < ADAPTIVE_SCALE_DOWN_INTERVAL)
+		return;
+
+	last_scale_down = now;
+	retire_child_processes(idle_children - pool_config->max_spare_children,
+						   ADAPTIVE_ONE_SHOT_KILLS);
+}
+
+/*
+ * Spawn up to count new child processes without exceeding
+ * num_init_children.  Returns the number of children spawned.
+ */
+static int
+spawn_child_processes(int count)
+{
+	int			i;
+	int			spawned = 0;
+
+	if (count + current_child_process_count > pool_config->num_init_children)
+	{
+		ereport(DEBUG5,
+			(errmsg("we have hit the ceiling, spawning %d child(ren)",
+							pool_config->num_init_children - current_child_process_count)));
+		count = pool_config->num_init_children - current_child_process_count;
+	}
+	if (count <= 0)
+		return 0;
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (process_info[i].pid == 0)
+		{
+			process_info[i].start_time = time(NULL);
+			process_info[i].client_connection_count = 0;
+			process_info[i].pool_evictions = 0;
+			process_info[i].buffer_memory = 0;
+			process_info[i].memory_allocated = 0;
+			process_info[i].session_memory = 0;
+			process_info[i].query_memory = 0;
+			process_info[i].peak_memory = 0;
+			process_info[i].status = WAIT_FOR_CONNECT;
+			process_info[i].connected = 0;
+			process_info[i].wait_for_connect = 0;
+			process_info[i].pooled_connections = 0;
+			process_info[i].need_to_restart = 0;
+			process_info[i].exit_if_idle = false;
+			process_info[i].pid = fork_a_child(fds, i);
+
+			current_child_process_count++;
+			if (++spawned >= count)
+				break;
+		}
+	}
+
+	Req_info->pm_info.children_spawned += spawned;
+	Req_info->pm_info.last_scale_up = time(NULL);
+	return spawned;
+}
+
+/*
+ * Ask up to count idle child processes, but no more than
+ * one_shot_kill_count, to exit.
+ */
+static void
+retire_child_processes(int count, int one_shot_kill_count)
+{
+	int ki;
+	int victim_count;
+	int kill_process_info_idxs[MAX_ONE_SHOT_KILLS];
+
+	memset(kill_process_info_idxs, -1 ,sizeof(kill_process_info_idxs));
+
+	if (one_shot_kill_count > MAX_ONE_SHOT_KILLS)
+		one_shot_kill_count = MAX_ONE_SHOT_KILLS;
+	if (count > one_shot_kill_count)
+		count = one_shot_kill_count;
+
+	victim_count = select_victim_processes(kill_process_info_idxs, count);
+
+	for (ki = 0; ki < victim_count; ki++)
+	{
+		int index = kill_process_info_idxs[ki];
+		if (index >=0)
+		{
+			if (process_info[index].pid && process_info[index].status == WAIT_FOR_CONNECT)
+			{
+				ereport(DEBUG1,
+				(errmsg("asking child process with pid:%d to kill itself to satisfy max_spare_children",
+						process_info[index].pid),
+						errdetail("child process has %d pooled connections",process_info[index].pooled_connections)));
+				process_info[index].exit_if_idle = true;
+				kill(process_info[index].pid, SIGUSR2);
+				Req_info->pm_info.children_retired++;
+				Req_info->pm_info.last_scale_down = time(NULL);
 			}
 		}
 	}
 }
 
+/*
+ * Sample the load signals used by process management and shown by SHOW
+ * POOL_PROCESS_MANAGEMENT_STATS: the number of connections waiting in the
+ * listen backlog, the accept rate, and the ratio of busy children.  The
+ * time a connection waits in the backlog is estimated by Little's law as
+ * queue length divided by accept rate.
+ */
+static void
+update_process_management_info(void)
+{
+	static struct timeval last_sample = {0, 0};
+	static uint64 last_accepted = 0;
+	volatile POOL_PROCESS_MANAGEMENT_INFO *pm_info = &Req_info->pm_info;
+	struct timeval now;
+	double		elapsed;
+	double		busy_ratio;
+	uint64		accepted;
+	int			connected_children;
+	int			queue;
+
+	gettimeofday(&now, NULL);
+	elapsed = (now.tv_sec - last_sample.tv_sec) +
+		(now.tv_usec - last_sample.tv_usec) / 1000000.0;
+
+	/* pool_pause() may return early on signals; avoid noisy samples */
+	if (last_sample.tv_sec != 0 && elapsed < 0.5)
+		return;
+
+	pool_semaphore_lock(CONN_COUNTER_SEM);
+	connected_children = Req_info->conn_counter;
+	accepted = pm_info->total_accepted;
+	pool_semaphore_unlock(CONN_COUNTER_SEM);
+
+	queue = get_listen_queue_length();
+	busy_ratio = current_child_process_count > 0 ?
+		(double) connected_children / current_child_process_count : 0.0;
+
+	pm_info->current_children = current_child_process_count;
+	pm_info->connected_children = connected_children;
+	pm_info->listen_queue_length = queue;
+	if (queue >= pm_info->listen_queue_peak)
+		pm_info->listen_queue_peak = queue;
+	else
+		pm_info->listen_queue_peak /= 2;
+
+	if (last_sample.tv_sec == 0)
+	{
+		pm_info->busy_ratio = busy_ratio;
+		pm_info->accept_rate = 0.0;
+	}
+	else
+	{
+		pm_info->busy_ratio += PM_INFO_SMOOTHING * (busy_ratio - pm_info->busy_ratio);
+		pm_info->accept_rate += PM_INFO_SMOOTHING *
+			((accepted - last_accepted) / elapsed - pm_info->accept_rate);
+	}
+
+	if (queue == 0)
+		pm_info->estimated_queue_wait = 0.0;
+	else if (pm_info->accept_rate > 0.0)
+		pm_info->estimated_queue_wait = queue / pm_info->accept_rate * 1000.0;
+	else
+		/* nothing accepted lately: they waited at least the whole interval */
+		pm_info->estimated_queue_wait = elapsed * 1000.0;
+
+	last_sample = now;
+	last_accepted = accepted;
+}
+
+/*
+ * Returns the number of connections established by the kernel but not
+ * accepted by any child yet, summed over the TCP listen sockets.  Linux
+ * reports the current accept queue length of a listening socket in
+ * tcpi_unacked.  Always 0 on other platforms and for UNIX domain sockets.
+ */
+static int
+get_listen_queue_length(void)
+{
+	int			total = 0;
+#if defined(__linux__) && defined(TCP_INFO)
+	int		   *walk;
+
+	for (walk = fds; walk && *walk != -1; walk++)
+	{
+		struct tcp_info info;
+		socklen_t	len = sizeof(info);
+
+		if (getsockopt(*walk, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+			total += info.tcpi_unacked;
+	}
+#endif
+	return total;
+}
+
 /*
  * Function selects the child processes that can be killed based.
  * selection criteria is to select the processes with minimum number of
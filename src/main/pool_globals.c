@@ -51,7 +51,12 @@ char	*application_names[] = {"main",
 								"pcp_main",
 								"pcp_child",
 								"health_check",
-								"logger"
+								"logger",
+								"memqcache_invalidator",
+								"relcache_refresher",
+								"metrics",
+								"memqcache_decoder",
+								"notify_hub"
 };
 
 char *
@@ -0,0 +1,633 @@
+/* -*-pgsql-c-*- */
+/*
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_metrics.c: metrics exporter process
+ *
+ * When metrics_port is set, the metrics process answers HTTP GET requests
+ * for /metrics with the statistics pgpool keeps in shared memory, in the
+ * OpenMetrics text format which Prometheus scrapes.  Everything is read
+ * straight from shared memory, so a scrape neither takes a child process
+ * nor talks to the backends.  Requests are served one at a time.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "main/health_check.h"
+#include "main/pool_metrics.h"
+#include "query_cache/pool_memqcache.h"
+#include "parser/stringinfo.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/ps_status.h"
+#include "utils/pool_signal.h"
+#include "utils/socket_stream.h"
+#include "utils/statistics.h"
+#include "utils/pool_log_ring.h"
+
+/* How long a client may take to send its request or read the response */
+#define METRICS_IO_TIMEOUT		5
+
+/* Longest request header we read */
+#define METRICS_MAX_REQUEST		8192
+
+#define METRICS_CONTENT_TYPE	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static volatile sig_atomic_t reload_config_request = 0;
+
+static void serve_request(int fd);
+static bool read_request(int fd, char *buf, int bufsize);
+static void send_response(int fd, const char *status, const char *content_type, StringInfo body);
+static void build_metrics(StringInfo buf);
+static void append_backend_metrics(StringInfo buf);
+static void append_health_check_metrics(StringInfo buf);
+static void append_process_metrics(StringInfo buf);
+static void append_query_cache_metrics(StringInfo buf);
+static void append_log_ring_metrics(StringInfo buf);
+static void append_label_value(StringInfo buf, const char *value);
+static RETSIGTYPE my_signal_handler(int sig);
+static RETSIGTYPE reload_config_handler(int sig);
+static void reload_config(void);
+
+#define CHECK_REQUEST \
+	do { \
+		if (reload_config_request) \
+		{ \
+			reload_config(); \
+			reload_config_request = 0; \
+		} \
+	} while (0)
+
+/* Statement types in the order of STAT_QUERY_TYPE */
+static const char *query_type_names[STAT_NUM_QUERY_TYPES] = {
+	"select", "insert", "update", "delete", "ddl", "other"
+};
+
+/*
+ * metrics process main loop.  fds is the -1 terminated array of listening
+ * sockets created by the main process.
+ */
+void
+do_metrics_child(void *fds)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext MetricsMemoryContext;
+	int		   *listen_fds = (int *) fds;
+	struct pollfd *pfds;
+	int			nfds;
+	int			i;
+
+	ereport(DEBUG1,
+			(errmsg("I am metrics process pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("metrics", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Create per request memory context */
+	MetricsMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "metrics_main_loop",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	for (nfds = 0; listen_fds[nfds] != -1; nfds++)
+		;
+	pfds = palloc(sizeof(struct pollfd) * nfds);
+	for (i = 0; i < nfds; i++)
+	{
+		/* a client which went away before accept() must not block us */
+		socket_set_nonblock(listen_fds[i]);
+		pfds[i].fd = listen_fds[i];
+		pfds[i].events = POLLIN;
+	}
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	for (;;)
+	{
+		int			n;
+
+		MemoryContextSwitchTo(MetricsMemoryContext);
+		MemoryContextResetAndDeleteChildren(MetricsMemoryContext);
+
+		CHECK_REQUEST;
+
+		n = poll(pfds, nfds, 1000);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(ERROR,
+					(errmsg("metrics process failed to wait for connections"),
+					 errdetail("poll() failed with error \"%m\"")));
+		}
+
+		for (i = 0; i < nfds && n > 0; i++)
+		{
+			int			fd;
+
+			if (pfds[i].revents == 0)
+				continue;
+			n--;
+
+			fd = accept(pfds[i].fd, NULL, NULL);
+			if (fd < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+					errno != ECONNABORTED)
+					ereport(LOG,
+							(errmsg("metrics process failed to accept connection"),
+							 errdetail("accept() failed with error \"%m\"")));
+				continue;
+			}
+
+			PG_TRY();
+			{
+				serve_request(fd);
+			}
+			PG_CATCH();
+			{
+				close(fd);
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			close(fd);
+		}
+	}
+}
+
+/*
+ * Read a request from the client and answer it.
+ */
+static void
+serve_request(int fd)
+{
+	char		request[METRICS_MAX_REQUEST];
+	char	   *path;
+	char	   *end;
+	StringInfoData body;
+	struct timeval timeout;
+
+	socket_unset_nonblock(fd);
+	timeout.tv_sec = METRICS_IO_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	if (!read_request(fd, request, sizeof(request)))
+		return;
+
+	initStringInfo(&body);
+
+	if (strncmp(request, "GET ", 4) != 0)
+	{
+		appendStringInfoString(&body, "method not allowed\n");
+		send_response(fd, "405 Method Not Allowed", "text/plain; charset=utf-8", &body);
+		return;
+	}
+
+	/* the path ends at a query string or at the protocol version */
+	path = request + 4;
+	end = path + strcspn(path, "? \r\n");
+	*end = '\0';
+
+	if (strcmp(path, "/metrics") != 0)
+	{
+		appendStringInfoString(&body, "not found\n");
+		send_response(fd, "404 Not Found", "text/plain; charset=utf-8", &body);
+		return;
+	}
+
+	build_metrics(&body);
+	send_response(fd, "200 OK", METRICS_CONTENT_TYPE, &body);
+}
+
+/*
+ * Read the request header into buf as a null terminated string.  Returns
+ * false if the client went away, timed out or sent too much.
+ */
+static bool
+read_request(int fd, char *buf, int bufsize)
+{
+	int			len = 0;
+
+	for (;;)
+	{
+		ssize_t		n;
+
+		n = read(fd, buf + len, bufsize - len - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			if (n < 0)
+				ereport(DEBUG1,
+						(errmsg("metrics process failed to read request"),
+						 errdetail("read() failed with error \"%m\"")));
+			return false;
+		}
+
+		len += n;
+		buf[len] = '\0';
+		if (strstr(buf, "\r\n\r\n") || strstr(buf, "\n\n"))
+			return true;
+		if (len >= bufsize - 1)
+		{
+			ereport(DEBUG1,
+					(errmsg("metrics process received too long request")));
+			return false;
+		}
+	}
+}
+
+static void
+send_response(int fd, const char *status, const char *content_type, StringInfo body)
+{
+	StringInfoData buf;
+	int			sent = 0;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "HTTP/1.1 %s\r\n"
+					 "Content-Type: %s\r\n"
+					 "Content-Length: %d\r\n"
+					 "Connection: close\r\n"
+					 "\r\n",
+					 status, content_type, body->len);
+	appendBinaryStringInfo(&buf, body->data, body->len);
+
+	while (sent < buf.len)
+	{
+		ssize_t		n;
+
+		n = write(fd, buf.data + sent, buf.len - sent);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			ereport(DEBUG1,
+					(errmsg("metrics process failed to send response"),
+					 errdetail("write() failed with error \"%m\"")));
+			return;
+		}
+		sent += n;
+	}
+}
+
+/*
+ * Build the OpenMetrics exposition.
+ */
+static void
+build_metrics(StringInfo buf)
+{
+	append_backend_metrics(buf);
+	append_health_check_metrics(buf);
+	append_process_metrics(buf);
+	if (pool_config->memory_cache_enabled)
+		append_query_cache_metrics(buf);
+	if (pool_log_ring_enabled())
+		append_log_ring_metrics(buf);
+	appendStringInfoString(buf, "# EOF\n");
+}
+
+/*
+ * Node status, query and error counters and latency percentiles of each
+ * backend node.
+ */
+static void
+append_backend_metrics(StringInfo buf)
+{
+	int			i;
+	int			t;
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_up gauge\n"
+						   "# HELP pgpool_backend_up Whether the backend node is up.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		BackendInfo *bi = &BACKEND_INFO(i);
+		const char *role;
+
+		if (STREAM)
+			role = (i == REAL_PRIMARY_NODE_ID) ? "primary" : "standby";
+		else
+			role = (i == REAL_MAIN_NODE_ID) ? "main" : "replica";
+
+		appendStringInfo(buf, "pgpool_backend_up{node=\"%d\",hostname=", i);
+		append_label_value(buf, bi->backend_hostname);
+		appendStringInfo(buf, ",port=\"%d\",role=\"%s\"} %d\n",
+						 bi->backend_port, role, VALID_BACKEND_RAW(i) ? 1 : 0);
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_queries counter\n"
+						   "# HELP pgpool_backend_queries Queries sent to the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		uint64		counts[STAT_NUM_QUERY_TYPES];
+
+		counts[STAT_QUERY_SELECT] = stat_get_select_count(i);
+		counts[STAT_QUERY_INSERT] = stat_get_insert_count(i);
+		counts[STAT_QUERY_UPDATE] = stat_get_update_count(i);
+		counts[STAT_QUERY_DELETE] = stat_get_delete_count(i);
+		counts[STAT_QUERY_DDL] = stat_get_ddl_count(i);
+		counts[STAT_QUERY_OTHER] = stat_get_other_count(i);
+		for (t = 0; t < STAT_NUM_QUERY_TYPES; t++)
+			appendStringInfo(buf, "pgpool_backend_queries_total{node=\"%d\",type=\"%s\"} " UINT64_FORMAT "\n",
+							 i, query_type_names[t], counts[t]);
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_errors counter\n"
+						   "# HELP pgpool_backend_errors Error messages returned by the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		appendStringInfo(buf, "pgpool_backend_errors_total{node=\"%d\",severity=\"panic\"} " UINT64_FORMAT "\n",
+						 i, stat_get_panic_count(i));
+		appendStringInfo(buf, "pgpool_backend_errors_total{node=\"%d\",severity=\"fatal\"} " UINT64_FORMAT "\n",
+						 i, stat_get_fatal_count(i));
+		appendStringInfo(buf, "pgpool_backend_errors_total{node=\"%d\",severity=\"error\"} " UINT64_FORMAT "\n",
+						 i, stat_get_error_count(i));
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_inflight_queries gauge\n"
+						   "# HELP pgpool_backend_inflight_queries Queries waiting for the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+		appendStringInfo(buf, "pgpool_backend_inflight_queries{node=\"%d\"} %u\n",
+						 i, stat_get_inflight_count(i));
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_query_latency_seconds summary\n"
+						   "# UNIT pgpool_backend_query_latency_seconds seconds\n"
+						   "# HELP pgpool_backend_query_latency_seconds Query latency on the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		for (t = 0; t < STAT_NUM_QUERY_TYPES; t++)
+		{
+			uint64		p50,
+						p95,
+						p99;
+
+			stat_get_latency_percentiles(i, t, &p50, &p95, &p99);
+			appendStringInfo(buf, "pgpool_backend_query_latency_seconds{node=\"%d\",type=\"%s\",quantile=\"0.5\"} %.6f\n",
+							 i, query_type_names[t], p50 / 1000000.0);
+			appendStringInfo(buf, "pgpool_backend_query_latency_seconds{node=\"%d\",type=\"%s\",quantile=\"0.95\"} %.6f\n",
+							 i, query_type_names[t], p95 / 1000000.0);
+			appendStringInfo(buf, "pgpool_backend_query_latency_seconds{node=\"%d\",type=\"%s\",quantile=\"0.99\"} %.6f\n",
+							 i, query_type_names[t], p99 / 1000000.0);
+		}
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_backend_queue_wait_seconds summary\n"
+						   "# UNIT pgpool_backend_queue_wait_seconds seconds\n"
+						   "# HELP pgpool_backend_queue_wait_seconds Time queries waited for max_active_queries_per_node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		uint64		p50,
+					p95,
+					p99;
+
+		stat_get_queue_wait_percentiles(i, &p50, &p95, &p99);
+		appendStringInfo(buf, "pgpool_backend_queue_wait_seconds{node=\"%d\",quantile=\"0.5\"} %.6f\n",
+						 i, p50 / 1000000.0);
+		appendStringInfo(buf, "pgpool_backend_queue_wait_seconds{node=\"%d\",quantile=\"0.95\"} %.6f\n",
+						 i, p95 / 1000000.0);
+		appendStringInfo(buf, "pgpool_backend_queue_wait_seconds{node=\"%d\",quantile=\"0.99\"} %.6f\n",
+						 i, p99 / 1000000.0);
+	}
+}
+
+/*
+ * Health check counters.  Like SHOW POOL_HEALTH_CHECK_STATS, these are read
+ * without a lock.
+ */
+static void
+append_health_check_metrics(StringInfo buf)
+{
+	int			i;
+
+	if (health_check_stats == NULL)
+		return;
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_health_checks counter\n"
+						   "# HELP pgpool_health_checks Health checks of the backend node by result.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		volatile POOL_HEALTH_CHECK_STATISTICS *st = &health_check_stats[i];
+
+		appendStringInfo(buf, "pgpool_health_checks_total{node=\"%d\",result=\"success\"} " UINT64_FORMAT "\n",
+						 i, st->success_count);
+		appendStringInfo(buf, "pgpool_health_checks_total{node=\"%d\",result=\"fail\"} " UINT64_FORMAT "\n",
+						 i, st->fail_count);
+		appendStringInfo(buf, "pgpool_health_checks_total{node=\"%d\",result=\"skip\"} " UINT64_FORMAT "\n",
+						 i, st->skip_count);
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_health_check_retries counter\n"
+						   "# HELP pgpool_health_check_retries Health check retries of the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+		appendStringInfo(buf, "pgpool_health_check_retries_total{node=\"%d\"} " UINT64_FORMAT "\n",
+						 i, health_check_stats[i].retry_count);
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_health_check_last_success_timestamp_seconds gauge\n"
+						   "# UNIT pgpool_health_check_last_success_timestamp_seconds seconds\n"
+						   "# HELP pgpool_health_check_last_success_timestamp_seconds Time of the last successful health check.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+		appendStringInfo(buf, "pgpool_health_check_last_success_timestamp_seconds{node=\"%d\"} %ld\n",
+						 i, (long) health_check_stats[i].last_successful_health_check);
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_health_check_max_duration_seconds gauge\n"
+						   "# UNIT pgpool_health_check_max_duration_seconds seconds\n"
+						   "# HELP pgpool_health_check_max_duration_seconds Longest health check of the backend node.\n");
+	for (i = 0; i < NUM_BACKENDS; i++)
+		appendStringInfo(buf, "pgpool_health_check_max_duration_seconds{node=\"%d\"} %.3f\n",
+						 i, health_check_stats[i].max_health_check_duration / 1000.0);
+}
+
+/*
+ * Child processes by state, and the connections they keep in their pools.
+ */
+static void
+append_process_metrics(StringInfo buf)
+{
+	int			counts[CONNECTING + 1];
+	int			pooled = 0;
+	int			i;
+
+	memset(counts, 0, sizeof(counts));
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		ProcessInfo *pi = &process_info[i];
+
+		if (pi->pid == 0)
+			continue;
+		if (pi->status >= WAIT_FOR_CONNECT && pi->status <= CONNECTING)
+			counts[pi->status]++;
+		pooled += pi->pooled_connections;
+	}
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_child_processes gauge\n"
+						   "# HELP pgpool_child_processes Child processes by state.\n");
+	appendStringInfo(buf, "pgpool_child_processes{state=\"wait_for_connection\"} %d\n", counts[WAIT_FOR_CONNECT]);
+	appendStringInfo(buf, "pgpool_child_processes{state=\"connecting\"} %d\n", counts[CONNECTING]);
+	appendStringInfo(buf, "pgpool_child_processes{state=\"idle\"} %d\n", counts[IDLE]);
+	appendStringInfo(buf, "pgpool_child_processes{state=\"idle_in_transaction\"} %d\n", counts[IDLE_IN_TRANS]);
+	appendStringInfo(buf, "pgpool_child_processes{state=\"executing\"} %d\n", counts[COMMAND_EXECUTE]);
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_pooled_connections gauge\n"
+						   "# HELP pgpool_pooled_connections Connection pools kept by child processes.\n");
+	appendStringInfo(buf, "pgpool_pooled_connections %d\n", pooled);
+}
+
+/*
+ * Query cache hit counters.  These take the query cache stats semaphore
+ * briefly but not the query cache lock.
+ */
+static void
+append_query_cache_metrics(StringInfo buf)
+{
+	POOL_QUERY_CACHE_STATS *stats = pool_get_memqcache_stats();
+
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_query_cache_hits counter\n"
+						   "# HELP pgpool_query_cache_hits SELECTs answered from the query cache.\n");
+	appendStringInfo(buf, "pgpool_query_cache_hits_total %lld\n", stats->num_cache_hits);
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_query_cache_misses counter\n"
+						   "# HELP pgpool_query_cache_misses SELECTs sent to the backend with the query cache enabled.\n");
+	appendStringInfo(buf, "pgpool_query_cache_misses_total %lld\n", stats->num_selects);
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_query_cache_evictions counter\n"
+						   "# HELP pgpool_query_cache_evictions Cache entries evicted to make room for new ones.\n");
+	appendStringInfo(buf, "pgpool_query_cache_evictions_total %lld\n", stats->num_evicted_entries);
+}
+
+/*
+ * Log messages dropped because the log ring of a child process was full.
+ */
+static void
+append_log_ring_metrics(StringInfo buf)
+{
+	appendStringInfoString(buf,
+						   "# TYPE pgpool_log_messages_dropped counter\n"
+						   "# HELP pgpool_log_messages_dropped Log messages dropped because a log ring was full.\n");
+	appendStringInfo(buf, "pgpool_log_messages_dropped_total " UINT64_FORMAT "\n", pool_log_ring_dropped());
+}
+
+/*
+ * Append a quoted label value, escaping as the exposition format requires.
+ */
+static void
+append_label_value(StringInfo buf, const char *value)
+{
+	const char *p;
+
+	appendStringInfoChar(buf, '"');
+	for (p = value; *p; p++)
+	{
+		if (*p == '\\' || *p == '"')
+		{
+			appendStringInfoChar(buf, '\\');
+			appendStringInfoChar(buf, *p);
+		}
+		else if (*p == '\n')
+			appendStringInfoString(buf, "\\n");
+		else
+			appendStringInfoChar(buf, *p);
+	}
+	appendStringInfoChar(buf, '"');
+}
+
+static RETSIGTYPE my_signal_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+
+	switch (sig)
+	{
+		case SIGTERM:
+		case SIGINT:
+		case SIGQUIT:
+			exit(0);
+			break;
+
+		default:
+			exit(1);
+			break;
+	}
+}
+
+static RETSIGTYPE reload_config_handler(int sig)
+{
+	reload_config_request = 1;
+}
+
+static void
+reload_config(void)
+{
+	ereport(LOG,
+			(errmsg("reloading config file")));
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
+	MemoryContextSwitchTo(oldContext);
+	reload_config_request = 0;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include "pool_parser.h"
 #include "utils/palloc.h"
@@ -42,6 +43,11 @@ static int
 static bool check_uescapechar(unsigned char escape);
 static char *str_udeescape(const char *str, char escape,
 						   int position, core_yyscan_t yyscanner);
+static List *parse_simple_transaction_stmt(const char *str, int len);
+static const char *skip_spaces(const char *p, const char *end);
+static int	keyword_length(const char *p, const char *end);
+static bool keyword_is(const char *p, int keylen, const char *keyword);
+static void append_normalized_token(StringInfo buf, const char *token, int len);
 
 
 /*
@@ -64,6 +70,15 @@ raw_parser(const char *str, RawParseMode mode, int len, bool *error, bool use_mi
 	/* initialize error flag */
 	*error = false;
 
+	/* transaction control statements do not need the full parser */
+	if (mode == RAW_PARSE_DEFAULT)
+	{
+		List	   *parsetree = parse_simple_transaction_stmt(str, len);
+
+		if (parsetree != NIL)
+			return parsetree;
+	}
+
 	/* initialize the flex scanner */
 	yyscanner = scanner_init(str, len, &yyextra.core_yy_extra,
 							 &ScanKeywords, ScanKeywordTokens);
@@ -130,6 +145,217 @@ raw_parser(const char *str, RawParseMode mode, int len, bool *error, bool use_mi
 	return yyextra.parsetree;
 }
 
+/*
+ * Fast path of raw_parser() for the transaction control statements sent
+ * most often by applications and drivers: BEGIN, START TRANSACTION,
+ * COMMIT, END, ROLLBACK and ABORT, optionally followed by WORK or
+ * TRANSACTION and a semicolon.  The parse tree, identical to what the
+ * grammar produces, is built without running the scanner and bison.
+ *
+ * Anything else, including comments, options such as ISOLATION LEVEL or
+ * AND CHAIN, and multiple statements returns NIL, in which case the caller
+ * must use the real parser.
+ */
+static List *
+parse_simple_transaction_stmt(const char *str, int len)
+{
+	static const struct
+	{
+		const char *keyword;
+		TransactionStmtKind kind;
+	}			verbs[] = {
+		{"begin", TRANS_STMT_BEGIN},
+		{"start", TRANS_STMT_START},
+		{"commit", TRANS_STMT_COMMIT},
+		{"end", TRANS_STMT_COMMIT},
+		{"rollback", TRANS_STMT_ROLLBACK},
+		{"abort", TRANS_STMT_ROLLBACK},
+	};
+	const char *end;
+	const char *p;
+	int			keylen;
+	int			stmt_len = 0;
+	int			i;
+	TransactionStmt *n;
+	RawStmt    *rs;
+
+	end = memchr(str, '\0', len);
+	if (end == NULL)
+		end = str + len;
+
+	p = skip_spaces(str, end);
+	keylen = keyword_length(p, end);
+	if (keylen == 0)
+		return NIL;
+
+	for (i = 0; i < lengthof(verbs); i++)
+	{
+		if (keyword_is(p, keylen, verbs[i].keyword))
+			break;
+	}
+	if (i >= lengthof(verbs))
+		return NIL;
+	p = skip_spaces(p + keylen, end);
+
+	/* START requires TRANSACTION, the others take optional WORK/TRANSACTION */
+	keylen = keyword_length(p, end);
+	if (keyword_is(p, keylen, "transaction") ||
+		(verbs[i].kind != TRANS_STMT_START && keyword_is(p, keylen, "work")))
+		p = skip_spaces(p + keylen, end);
+	else if (verbs[i].kind == TRANS_STMT_START)
+		return NIL;
+
+	if (p < end && *p == ';')
+	{
+		stmt_len = p - str;
+		p = skip_spaces(p + 1, end);
+	}
+	if (p != end)
+		return NIL;
+
+	n = makeNode(TransactionStmt);
+	n->kind = verbs[i].kind;
+	n->options = NIL;
+	n->chain = false;
+
+	rs = makeNode(RawStmt);
+	rs->stmt = (Node *) n;
+	rs->stmt_location = 0;
+	rs->stmt_len = stmt_len;
+
+	return list_make1(rs);
+}
+
+static const char *
+skip_spaces(const char *p, const char *end)
+{
+	while (p < end && scanner_isspace(*p))
+		p++;
+	return p;
+}
+
+/*
+ * Return the length of the keyword starting at p, or 0 if p does not point
+ * to a keyword followed by a white space, a semicolon or the end of the
+ * query.
+ */
+static int
+keyword_length(const char *p, const char *end)
+{
+	const char *q = p;
+
+	while (q < end && ((*q >= 'a' && *q <= 'z') || (*q >= 'A' && *q <= 'Z')))
+		q++;
+
+	if (q < end && !scanner_isspace(*q) && *q != ';')
+		return 0;
+
+	return q - p;
+}
+
+static bool
+keyword_is(const char *p, int keylen, const char *keyword)
+{
+	return keylen == strlen(keyword) && strncasecmp(p, keyword, keylen) == 0;
+}
+
+/*
+ * Returns the query with its constants replaced by '?', keywords and
+ * unquoted identifiers folded to lower case, and comments and white space
+ * between tokens reduced to a single space.  Queries which differ only in
+ * the values of their literals give the same string, which makes it usable
+ * as the key of per-statement statistics.  Returns NULL if the query cannot
+ * be scanned, e.g. it has an unterminated quoted string.
+ */
+char *
+raw_normalize_query(const char *str, int len)
+{
+	core_yyscan_t yyscanner;
+	core_yy_extra_type yyextra;
+	core_YYSTYPE yylval;
+	YYLTYPE		yylloc;
+	StringInfoData buf;
+	MemoryContext oldContext = CurrentMemoryContext;
+	bool		error = false;
+
+	initStringInfo(&buf);
+	yyscanner = scanner_init(str, len, &yyextra, &ScanKeywords, ScanKeywordTokens);
+
+	PG_TRY();
+	{
+		for (;;)
+		{
+			int			token = core_yylex(&yylval, &yylloc, yyscanner);
+
+			if (token == 0)
+				break;
+
+			if (buf.len > 0)
+				appendStringInfoChar(&buf, ' ');
+
+			switch (token)
+			{
+				case ICONST:
+				case FCONST:
+				case SCONST:
+				case USCONST:
+				case BCONST:
+				case XCONST:
+					appendStringInfoChar(&buf, '?');
+					break;
+
+				default:
+
+					/*
+					 * core_yylex() has terminated the token text in the
+					 * scan buffer.
+					 */
+					append_normalized_token(&buf, yyextra.scanbuf + yylloc,
+											strlen(yyextra.scanbuf + yylloc));
+					break;
+			}
+		}
+		scanner_finish(yyscanner);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldContext);
+		scanner_finish(yyscanner);
+		FlushErrorState();
+		error = true;
+	}
+	PG_END_TRY();
+
+	if (error)
+	{
+		pfree(buf.data);
+		return NULL;
+	}
+	return buf.data;
+}
+
+static void
+append_normalized_token(StringInfo buf, const char *token, int len)
+{
+	int			i;
+
+	/* quoted identifiers are case sensitive */
+	if (memchr(token, '"', len) != NULL)
+	{
+		appendBinaryStringInfo(buf, token, len);
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+	{
+		char		ch = token[i];
+
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
+		appendStringInfoChar(buf, ch);
+	}
+}
+
 /*
  * XXX: Currently we only process the first element of the parse tree.
  * rest of multiple statements are silently discarded.
@@ -33,6 +33,7 @@
 #include "context/pool_session_context.h"
 
 #include "pcp/pcp_worker.h"
+#include "pcp/recovery.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -45,9 +46,7 @@
 #ifdef HAVE_NETINET_TCP_H
 #include <netinet/tcp.h>
 #endif
-#ifdef HAVE_SYS_SELECT_H
-#include <sys/select.h>
-#endif
+#include <poll.h>
 
 #include <signal.h>
 
@@ -70,6 +69,7 @@
 static int	pcp_unix_fd,
 			pcp_inet_fd;
 volatile bool *pcp_recovery_in_progress;
+volatile RecoveryProgress *pcp_recovery_progress;
 static volatile sig_atomic_t pcp_got_sighup = 0;
 static volatile sig_atomic_t pcp_restart_request = 0;
 List	   *pcp_worker_children = NULL;
@@ -86,7 +86,7 @@ static void start_pcp_command_processor_process(int port, int *fds);
 static void pcp_child_will_die(int code, Datum arg);
 static void pcp_kill_all_children(int sig);
 static void reaper(void);
-static bool pcp_unix_fds_not_isset(int *fds, int num_pcp_fds, fd_set* opt);
+static bool pcp_is_unix_fd(int *fds, int num_pcp_fds, int fd);
 
 
 #define CHECK_RESTART_REQUEST \
@@ -120,6 +120,10 @@ pcp_main(int *fds)
 	pcp_recovery_in_progress = pool_shared_memory_create(sizeof(bool));
 	*pcp_recovery_in_progress = false;
 
+	pcp_recovery_progress = pool_shared_memory_create(sizeof(RecoveryProgress));
+	memset((void *) pcp_recovery_progress, 0, sizeof(RecoveryProgress));
+	pcp_recovery_progress->node_id = -1;
+
 	/*
 	 * install the call back for preparation of exit
 	 */
@@ -186,45 +190,52 @@ pcp_main(int *fds)
 static int
 pcp_do_accept(int *fds)
 {
-	fd_set		readmask;
-	fd_set		rmask;
+	static struct pollfd *pfds = NULL;
+	static int	nsocks = 0;
 	int			rfds;
-	int			fd = 0;
+	int			fd = -1;
 	int			afd;
-	int			*walk;
-	int			nsocks = 0;
+	int			i;
 	SockAddr	saddr;
 
 	set_ps_display("PCP: wait for connection request", false);
 
-	for (walk = fds; *walk != -1; walk++)
+	/* The listening sockets never change, so build the poll set only once */
+	if (pfds == NULL)
 	{
-		if (*walk > nsocks)
-			nsocks = *walk;
+		while (fds[nsocks] != -1)
+			nsocks++;
+		pfds = MemoryContextAlloc(TopMemoryContext,
+								  sizeof(struct pollfd) * nsocks);
+		for (i = 0; i < nsocks; i++)
+		{
+			pfds[i].fd = fds[i];
+			pfds[i].events = POLLIN;
+		}
 	}
-	nsocks++;
-	FD_ZERO(&readmask);
-	for (walk = fds; *walk != -1; walk++)
-		FD_SET(*walk, &readmask);
 
-	memcpy((char *) &rmask, (char *) &readmask, sizeof(fd_set));
-	rfds = select(nsocks, &rmask, NULL, NULL, NULL);
+	for (i = 0; i < nsocks; i++)
+		pfds[i].revents = 0;
+
+	rfds = poll(pfds, nsocks, -1);
 	if (rfds == -1)
 	{
 		if (errno == EAGAIN || errno == EINTR)
 			return -1;
 		ereport(ERROR,
 				(errmsg("unable to accept new pcp connection"),
-				 errdetail("select system call failed with error : \"%m\"")));
+				 errdetail("poll system call failed with error : \"%m\"")));
 	}
-	for (walk = fds; *walk != -1; walk++)
+	for (i = 0; i < nsocks; i++)
 	{
-		if (FD_ISSET(*walk, &rmask))
+		if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
 		{
-			fd = *walk;
+			fd = pfds[i].fd;
 			break;
 		}
 	}
+	if (fd < 0)
+		return -1;
 
 	memset(&saddr, 0, sizeof(saddr));
 	saddr.salen = sizeof(saddr.addr);
@@ -256,7 +267,7 @@ pcp_do_accept(int *fds)
 	 * Set no delay if AF_INET socket. Not sure if this is really necessary
 	 * but PostgreSQL does this.
 	 */
-	if (pcp_unix_fds_not_isset(fds, pool_config->num_pcp_socket_directories, &rmask))	/* fds are UNIX domain socket for pcp process */
+	if (!pcp_is_unix_fd(fds, pool_config->num_pcp_socket_directories, fd))	/* fds are UNIX domain socket for pcp process */
 	{
 		int	on;
 
@@ -276,17 +287,16 @@ pcp_do_accept(int *fds)
 }
 
 static bool
-pcp_unix_fds_not_isset(int* fds, int num_pcp_fds, fd_set* opt)
+pcp_is_unix_fd(int *fds, int num_pcp_fds, int fd)
 {
-        int             i;
-        for (i = 0; i < num_pcp_fds; i++)
-        {
-                if (!FD_ISSET(fds[i], opt))
-                        continue;
-
-                return false;
-        }
-        return true;
+	int			i;
+
+	for (i = 0; i < num_pcp_fds; i++)
+	{
+		if (fds[i] == fd)
+			return true;
+	}
+	return false;
 }
 
 /*
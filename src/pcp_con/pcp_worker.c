@@ -33,6 +33,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <sys/select.h>
+#include <time.h>
 
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
@@ -49,7 +51,9 @@
 #include "auth/pool_auth.h"
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
+#include "query_cache/pool_memqcache.h"
 #include "utils/pool_process_reporting.h"
+#include "utils/pool_statement_stats.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/ps_status.h"
@@ -57,15 +61,42 @@
 #include "watchdog/wd_json_data.h"
 #include "watchdog/wd_internal_commands.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
 
 
 #define MAX_FILE_LINE_LEN    512
 
+/* How often a subscribed worker looks for state changes, in milliseconds */
+#define PCP_EVENT_POLL_INTERVAL	100
+
+/* Minimum interval between two "children" events, in seconds */
+#define PCP_EVENT_CHILDREN_INTERVAL	1
+
+/*
+ * State of pgpool as seen by a subscribed PCP worker.  Events are sent for
+ * the differences between two of these.
+ */
+typedef struct
+{
+	BACKEND_STATUS backend_status[MAX_NUM_BACKENDS];
+	bool		quarantine[MAX_NUM_BACKENDS];
+	SERVER_ROLE role[MAX_NUM_BACKENDS];
+	uint64		health_check_count[MAX_NUM_BACKENDS];
+	bool		switching;		/* failover/failback in progress */
+	int			main_node_id;
+	int			primary_node_id;
+	int			children;		/* live child processes */
+	int			connected;		/* child processes serving a client */
+}			PCP_EVENT_STATE;
+
 extern char *pcp_conf_file;		/* global variable defined in main.c holds the
 								 * path for pcp.conf */
 volatile sig_atomic_t pcp_worker_wakeup_request = 0;
 PCP_CONNECTION *volatile pcp_frontend = NULL;
 
+/* true once the client has subscribed to events */
+static volatile sig_atomic_t subscribed_to_events = 0;
+
 static RETSIGTYPE die(int sig);
 static RETSIGTYPE wakeup_handler_child(int sig);
 
@@ -85,6 +116,10 @@ static void inform_node_info(PCP_CONNECTION * frontend, char *buf);
 static void inform_node_count(PCP_CONNECTION * frontend);
 static void process_reload_config(PCP_CONNECTION * frontend,char scope);
 static void inform_health_check_stats(PCP_CONNECTION *frontend, char *buf);
+static void inform_memory_info(PCP_CONNECTION *frontend);
+static void inform_recovery_status(PCP_CONNECTION * frontend);
+static void format_recovery_time(char *buf, size_t size, time_t t);
+static void inform_backend_stats(PCP_CONNECTION *frontend, char *buf);
 static void process_detach_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_attach_node(PCP_CONNECTION * frontend, char *buf);
 static void process_recovery_request(PCP_CONNECTION * frontend, char *buf);
@@ -92,10 +127,18 @@ static void process_status_request(PCP_CONNECTION * frontend);
 static void process_promote_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_shutdown_request(PCP_CONNECTION * frontend, char mode, char tos);
 static void process_set_configuration_parameter(PCP_CONNECTION * frontend, char *buf, int len);
+static void process_snapshot_query_cache(PCP_CONNECTION * frontend);
+static void process_reset_statement_stats(PCP_CONNECTION * frontend);
+static void process_subscribe(PCP_CONNECTION * frontend);
+static void get_event_state(PCP_EVENT_STATE * state);
+static void send_state_events(PCP_CONNECTION * frontend, PCP_EVENT_STATE * prev, PCP_EVENT_STATE * cur, bool children);
+static void send_event(PCP_CONNECTION * frontend, char *event_type, int node_id, char *detail);
+static bool wait_for_pcp_client(PCP_CONNECTION * frontend, int timeout_ms);
 
 static void pcp_worker_will_go_down(int code, Datum arg);
 
 static void do_pcp_flush(PCP_CONNECTION * frontend);
+static void finish_pcp_reply(PCP_CONNECTION * frontend);
 static void do_pcp_read(PCP_CONNECTION * pc, void *buf, int len);
 
 /*
@@ -277,6 +320,11 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			inform_health_check_stats(pcp_frontend, buf);
 			break;
 
+		case 'G':				/* backend stats */
+			set_ps_display("PCP: processing backend stats request", false);
+			inform_backend_stats(pcp_frontend, buf);
+			break;
+
 		case 'I':				/* node info */
 			set_ps_display("PCP: processing node info request", false);
 			inform_node_info(pcp_frontend, buf);
@@ -292,6 +340,16 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			inform_process_info(pcp_frontend, buf);
 			break;
 
+		case 'Y':				/* memory info */
+			set_ps_display("PCP: processing memory info request", false);
+			inform_memory_info(pcp_frontend);
+			break;
+
+		case 'V':				/* recovery status */
+			set_ps_display("PCP: processing recovery status request", false);
+			inform_recovery_status(pcp_frontend);
+			break;
+
 		case 'W':				/* watchdog info */
 			set_ps_display("PCP: processing watchdog info request", false);
 			inform_watchdog_info(pcp_frontend, buf);
@@ -335,6 +393,21 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			process_promote_node(pcp_frontend, buf, tos);
 			break;
 
+		case 'Q':				/* snapshot query cache */
+			set_ps_display("PCP: processing snapshot query cache request", false);
+			process_snapshot_query_cache(pcp_frontend);
+			break;
+
+		case 'S':				/* reset statement statistics */
+			set_ps_display("PCP: processing reset statement stats request", false);
+			process_reset_statement_stats(pcp_frontend);
+			break;
+
+		case 'U':				/* subscribe to events */
+			set_ps_display("PCP: subscribed to events", false);
+			process_subscribe(pcp_frontend);
+			break;
+
 		case 'F':
 			ereport(DEBUG1,
 					(errmsg("PCP processing request, stop online recovery")));
@@ -367,6 +440,10 @@ die(int sig)
 		ereport(DEBUG1,
 				(errmsg("PCP worker child receives smart shutdown request."),
 				 errdetail("waiting for the child to die its natural death")));
+
+		/* a subscribed client never ends its session by itself */
+		if (subscribed_to_events)
+			exit(0);
 	}
 	else if (sig == SIGINT)
 	{
@@ -668,7 +745,7 @@ inform_process_count(PCP_CONNECTION * frontend)
 	pcp_write(frontend, code, sizeof(code));
 	pcp_write(frontend, process_count_str, strlen(process_count_str) + 1);
 	pcp_write(frontend, mesg, total_port_len);
-	do_pcp_flush(frontend);
+	finish_pcp_reply(frontend);
 
 	pfree(process_list);
 	pfree(mesg);
@@ -727,7 +804,6 @@ inform_process_info(PCP_CONNECTION * frontend, char *buf)
 		pcp_write(frontend, &wsize, sizeof(int));
 		pcp_write(frontend, arr_code, sizeof(arr_code));
 		pcp_write(frontend, con_info_size, strlen(con_info_size) + 1);
-		do_pcp_flush(frontend);
 
 		offsets = pool_report_pools_offsets(&n);
 
@@ -763,8 +839,6 @@ inform_process_info(PCP_CONNECTION * frontend, char *buf)
 			{
 				pcp_write(frontend, (char *)&pools[i] + offsets[j], strlen((char *)&pools[i] + offsets[j]) + 1);
 			}
-
-			do_pcp_flush(frontend);
 		}
 
 		pcp_write(frontend, "p", 1);
@@ -772,7 +846,7 @@ inform_process_info(PCP_CONNECTION * frontend, char *buf)
 					  sizeof(int));
 		pcp_write(frontend, &wsize, sizeof(int));
 		pcp_write(frontend, fin_code, sizeof(fin_code));
-		do_pcp_flush(frontend);
+		finish_pcp_reply(frontend);
 		ereport(DEBUG1,
 				(errmsg("PCP informing process info"),
 				 errdetail("retrieved process information from shared memory")));
@@ -781,6 +855,155 @@ inform_process_info(PCP_CONNECTION * frontend, char *buf)
 	}
 }
 
+/*
+ * pcp_memory_info
+ */
+static void
+inform_memory_info(PCP_CONNECTION *frontend)
+{
+	int			wsize;
+	int			nrows;
+	int			i;
+	int		   *offsets;
+	int			n;
+	char		arr_code[] = "ArraySize";
+	char		rec_code[] = "MemoryInfo";
+	char		fin_code[] = "CommandComplete";
+	char		nrows_str[16];
+	POOL_REPORT_MEMORY *memory;
+
+	memory = get_memory_usage(&nrows);
+	offsets = pool_report_memory_offsets(&n);
+
+	/* First, send the number of processes */
+	snprintf(nrows_str, sizeof(nrows_str), "%d", nrows);
+	pcp_write(frontend, "y", 1);
+	wsize = htonl(sizeof(arr_code) + strlen(nrows_str) + 1 + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, arr_code, sizeof(arr_code));
+	pcp_write(frontend, nrows_str, strlen(nrows_str) + 1);
+
+	/* Second, send the memory usage of each process */
+	for (i = 0; i < nrows; i++)
+	{
+		int			j;
+
+		pcp_write(frontend, "y", 1);
+
+		wsize = sizeof(rec_code) + sizeof(int);
+		for (j = 0; j < n; j++)
+			wsize += strlen((char *) &memory[i] + offsets[j]) + 1;
+		wsize = htonl(wsize);
+
+		pcp_write(frontend, &wsize, sizeof(int));
+		pcp_write(frontend, rec_code, sizeof(rec_code));
+		for (j = 0; j < n; j++)
+			pcp_write(frontend, (char *) &memory[i] + offsets[j],
+					  strlen((char *) &memory[i] + offsets[j]) + 1);
+	}
+
+	/* Finally, indicate that all data is sent */
+	pcp_write(frontend, "y", 1);
+	wsize = htonl(sizeof(fin_code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, fin_code, sizeof(fin_code));
+	finish_pcp_reply(frontend);
+
+	pfree(memory);
+}
+
+/*
+ * Send out the progress of the current or the last online recovery.
+ *
+ * The protocol starts with 'v', followed by 4-byte packet length integer in
+ * network byte order including self, and "CommandComplete".  Each data is
+ * represented as a null terminated string.  The order of each data is
+ * defined in POOL_RECOVERY_STATUS struct.
+ */
+static void
+inform_recovery_status(PCP_CONNECTION * frontend)
+{
+	POOL_RECOVERY_STATUS status;
+	char	   *fields[12];
+	int			wsize;
+	int			i;
+	char		code[] = "CommandComplete";
+
+	memset(&status, 0, sizeof(status));
+
+	if (pcp_recovery_progress->node_id >= 0)
+	{
+		snprintf(status.node_id, sizeof(status.node_id), "%d",
+				 pcp_recovery_progress->node_id);
+		format_recovery_time(status.start_time, sizeof(status.start_time),
+							 pcp_recovery_progress->start_time);
+		format_recovery_time(status.stage_start_time, sizeof(status.stage_start_time),
+							 pcp_recovery_progress->stage_start_time);
+		format_recovery_time(status.end_time, sizeof(status.end_time),
+							 pcp_recovery_progress->end_time);
+	}
+	StrNCpy(status.stage, recovery_stage_to_str(pcp_recovery_progress->stage),
+			sizeof(status.stage));
+	snprintf(status.backup_streams, sizeof(status.backup_streams), "%d",
+			 pcp_recovery_progress->backup_streams);
+	snprintf(status.backup_streamed, sizeof(status.backup_streamed), INT64_FORMAT,
+			 pcp_recovery_progress->backup_streamed);
+	snprintf(status.backup_total, sizeof(status.backup_total), INT64_FORMAT,
+			 pcp_recovery_progress->backup_total);
+	StrNCpy(status.start_lsn, (char *) pcp_recovery_progress->start_lsn,
+			sizeof(status.start_lsn));
+	StrNCpy(status.current_lsn, (char *) pcp_recovery_progress->current_lsn,
+			sizeof(status.current_lsn));
+	snprintf(status.pause_time, sizeof(status.pause_time), "%d",
+			 pcp_recovery_progress->pause_time);
+	StrNCpy(status.message, (char *) pcp_recovery_progress->message,
+			sizeof(status.message));
+
+	fields[0] = status.node_id;
+	fields[1] = status.stage;
+	fields[2] = status.start_time;
+	fields[3] = status.stage_start_time;
+	fields[4] = status.end_time;
+	fields[5] = status.backup_streams;
+	fields[6] = status.backup_streamed;
+	fields[7] = status.backup_total;
+	fields[8] = status.start_lsn;
+	fields[9] = status.current_lsn;
+	fields[10] = status.pause_time;
+	fields[11] = status.message;
+
+	pcp_write(frontend, "v", 1);
+
+	wsize = sizeof(code) + sizeof(int);
+	for (i = 0; i < lengthof(fields); i++)
+		wsize += strlen(fields[i]) + 1;
+	wsize = htonl(wsize);
+
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+	for (i = 0; i < lengthof(fields); i++)
+		pcp_write(frontend, fields[i], strlen(fields[i]) + 1);
+
+	finish_pcp_reply(frontend);
+}
+
+/*
+ * Format a time of recovery progress, or an empty string if it is not set.
+ */
+static void
+format_recovery_time(char *buf, size_t size, time_t t)
+{
+	struct tm	tm;
+
+	if (t == 0)
+	{
+		*buf = '\0';
+		return;
+	}
+	localtime_r(&t, &tm);
+	strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
 static void
 inform_watchdog_info(PCP_CONNECTION * frontend, char *buf)
 {
@@ -821,7 +1044,7 @@ inform_watchdog_info(PCP_CONNECTION * frontend, char *buf)
 	pcp_write(frontend, code, sizeof(code));
 
 	pcp_write(frontend, json_data, json_data_len + 1);
-	do_pcp_flush(frontend);
+	finish_pcp_reply(frontend);
 
 	pfree(json_data);
 }
@@ -871,7 +1094,6 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 		pcp_write(frontend, &wsize, sizeof(int));
 		pcp_write(frontend, arr_code, sizeof(arr_code));
 		pcp_write(frontend, node_info_size, strlen(node_info_size) + 1);
-		do_pcp_flush(frontend);
 
 		/* Second, send process information for all connection_info */
 		for (i = 0; i < NUM_BACKENDS ; i++)
@@ -956,7 +1178,6 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 			pcp_write(frontend, bi->replication_state, strlen(bi->replication_state) + 1);
 			pcp_write(frontend, bi->replication_sync_state, strlen(bi->replication_sync_state) + 1);
 			pcp_write(frontend, status_changed_time_str, strlen(status_changed_time_str) + 1);
-			do_pcp_flush(frontend);
 		}
 
 		pcp_write(frontend, "i", 1);
@@ -964,7 +1185,7 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 					  sizeof(int));
 		pcp_write(frontend, &wsize, sizeof(int));
 		pcp_write(frontend, fin_code, sizeof(fin_code));
-		do_pcp_flush(frontend);
+		finish_pcp_reply(frontend);
 		ereport(DEBUG1,
 				(errmsg("PCP informing node info"),
 				 errdetail("retrieved node information from shared memory")));
@@ -1048,7 +1269,69 @@ inform_health_check_stats(PCP_CONNECTION *frontend, char *buf)
 		pcp_write(frontend, (char *)s + offsets[i], strlen((char *)s + offsets[i]) + 1);
 	}
 	pfree(stats);
-	do_pcp_flush(frontend);
+	finish_pcp_reply(frontend);
+}
+
+/*
+ * Send out backend stats data to pcp client.  node id is provided as a
+ * string in buf parameter.
+ *
+ * The protocol starts with 'g', followed by 4-byte packet length integer in
+ * network byte order including self.  Each data is represented as a null
+ * terminated string. The order of each data is defined in
+ * POOL_BACKEND_STATS struct.
+ */
+static void
+inform_backend_stats(PCP_CONNECTION *frontend, char *buf)
+{
+	POOL_BACKEND_STATS *stats;
+	POOL_BACKEND_STATS *s;
+	int		*offsets;
+	int		n;
+	int		nrows;
+	int		i;
+	int		node_id;
+	int		wsize;
+	char	code[] = "CommandComplete";
+
+	node_id = atoi(buf);
+
+	stats = get_backend_stats(&nrows);
+
+	if (node_id < 0 || node_id >= nrows)
+	{
+		pfree(stats);
+		ereport(ERROR,
+				(errmsg("informing backend stats info failed"),
+				 errdetail("invalid node ID %d", node_id)));
+	}
+	s = &stats[node_id];
+
+	pcp_write(frontend, "g", 1);	/* indicate that this is a reply to backend stats request */
+
+	wsize = sizeof(code) + sizeof(int);
+
+	/* Calculate total packet length */
+	offsets = pool_backend_stats_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		wsize += strlen((char *)s + offsets[i]) + 1;
+	}
+	wsize = htonl(wsize);	/* convert to network byte order */
+
+	/* send packet length to frontend */
+	pcp_write(frontend, &wsize, sizeof(int));
+	/* send "Command Complete" to frontend */
+	pcp_write(frontend, code, sizeof(code));
+
+	/* send each backend stats data to frontend */
+	for (i = 0; i < n; i++)
+	{
+		pcp_write(frontend, (char *)s + offsets[i], strlen((char *)s + offsets[i]) + 1);
+	}
+	pfree(stats);
+	finish_pcp_reply(frontend);
 }
 
 static void
@@ -1068,7 +1351,7 @@ inform_node_count(PCP_CONNECTION * frontend)
 	pcp_write(frontend, &wsize, sizeof(int));
 	pcp_write(frontend, code, sizeof(code));
 	pcp_write(frontend, mesg, strlen(mesg) + 1);
-	do_pcp_flush(frontend);
+	finish_pcp_reply(frontend);
 
 	ereport(DEBUG1,
 			(errmsg("PCP: informing node count"),
@@ -1105,6 +1388,319 @@ process_reload_config(PCP_CONNECTION * frontend, char scope)
 	do_pcp_flush(frontend);
 }
 
+static void
+process_snapshot_query_cache(PCP_CONNECTION * frontend)
+{
+	char		code[] = "CommandComplete";
+	int			wsize;
+
+	if (!pool_is_memory_cache_snapshot())
+		ereport(ERROR,
+				(errmsg("process snapshot query cache request failed"),
+				 errdetail("query cache snapshot is not enabled"),
+				 errhint("set memqcache_snapshot_file and use memqcache_method = 'shmem'")));
+
+	if (!pool_save_memory_cache_snapshot(false))
+		ereport(ERROR,
+				(errmsg("process snapshot query cache request failed"),
+				 errdetail("failed to save query cache snapshot. see pgpool log for details")));
+
+	pcp_write(frontend, "q", 1);
+	wsize = htonl(sizeof(code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+	do_pcp_flush(frontend);
+}
+
+static void
+process_reset_statement_stats(PCP_CONNECTION * frontend)
+{
+	char		code[] = "CommandComplete";
+	int			wsize;
+
+	pool_statement_stats_reset();
+
+	pcp_write(frontend, "s", 1);
+	wsize = htonl(sizeof(code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+	do_pcp_flush(frontend);
+}
+
+/*
+ * Subscribe the client to events about state changes of pgpool, so that
+ * monitoring tools need not poll node info, process info and health check
+ * stats over a new connection each time.
+ *
+ * After acknowledging the request with 'u', the current state of every node,
+ * of failover and of the child processes is sent as events.  Then the shared
+ * memory is examined every PCP_EVENT_POLL_INTERVAL milliseconds and an event
+ * is sent for each change found, until the client sends 'X' or goes away.
+ * Changes of the child process counts are sent at most once every
+ * PCP_EVENT_CHILDREN_INTERVAL seconds, since they change with every client
+ * connection.  A change which is undone before the next look is not seen.
+ *
+ * Each event starts with 'e', followed by 4-byte packet length integer in
+ * network byte order including self.  The event type, node id, timestamp and
+ * detail follow as null terminated strings, in the order of POOL_EVENT_INFO
+ * struct.  This function never returns.
+ */
+static void
+process_subscribe(PCP_CONNECTION * frontend)
+{
+	PCP_EVENT_STATE *prev;
+	PCP_EVENT_STATE *cur;
+	PCP_EVENT_STATE *tmp;
+	time_t		last_children_event;
+	char		code[] = "CommandComplete";
+	int			wsize;
+
+	prev = palloc(sizeof(PCP_EVENT_STATE));
+	cur = palloc(sizeof(PCP_EVENT_STATE));
+
+	subscribed_to_events = 1;
+
+	pcp_write(frontend, "u", 1);
+	wsize = htonl(sizeof(code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+
+	get_event_state(prev);
+	send_state_events(frontend, NULL, prev, true);
+	do_pcp_flush(frontend);
+	last_children_event = time(NULL);
+
+	ereport(DEBUG1,
+			(errmsg("PCP: client subscribed to events")));
+
+	for (;;)
+	{
+		bool		children;
+
+		if (wait_for_pcp_client(frontend, PCP_EVENT_POLL_INTERVAL))
+		{
+			char		tos;
+			int			rsize;
+
+			do_pcp_read(frontend, &tos, 1);
+			do_pcp_read(frontend, &rsize, sizeof(int));
+			if (tos != 'X')
+				ereport(FATAL,
+						(errmsg("PCP processing request"),
+						 errdetail("unexpected PCP packet type \"%c\" while subscribed to events", tos)));
+
+			ereport(DEBUG1,
+					(errmsg("PCP processing request, client disconnecting"),
+					 errdetail("closing PCP connection, and exiting child")));
+			pcp_close(frontend);
+			pcp_frontend = NULL;
+			exit(0);
+		}
+
+		get_event_state(cur);
+
+		children = time(NULL) - last_children_event >= PCP_EVENT_CHILDREN_INTERVAL;
+		if (children)
+			last_children_event = time(NULL);
+		else
+		{
+			/* keep the last sent counts to compare against later */
+			cur->children = prev->children;
+			cur->connected = prev->connected;
+		}
+
+		send_state_events(frontend, prev, cur, children);
+
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+}
+
+/*
+ * Take a look at the state of nodes, failover and child processes.
+ */
+static void
+get_event_state(PCP_EVENT_STATE * state)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		BackendInfo *bi = pool_get_node_info(i);
+
+		state->backend_status[i] = bi->backend_status;
+		state->quarantine[i] = bi->quarantine;
+
+		if (STREAM)
+			state->role[i] = (i == REAL_PRIMARY_NODE_ID) ? ROLE_PRIMARY : ROLE_STANDBY;
+		else
+			state->role[i] = (i == REAL_MAIN_NODE_ID) ? ROLE_MAIN : ROLE_REPLICA;
+
+		state->health_check_count[i] = health_check_stats[i].total_count;
+	}
+
+	state->switching = Req_info->switching;
+	state->main_node_id = Req_info->main_node_id;
+	state->primary_node_id = Req_info->primary_node_id;
+
+	state->children = 0;
+	state->connected = 0;
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (process_info[i].pid == 0)
+			continue;
+		state->children++;
+		if (process_info[i].connected)
+			state->connected++;
+	}
+}
+
+/*
+ * Send an event for each difference between prev and cur.  If prev is NULL,
+ * the whole of cur is sent.  Child process counts are looked at only if
+ * children is true.
+ */
+static void
+send_state_events(PCP_CONNECTION * frontend, PCP_EVENT_STATE * prev, PCP_EVENT_STATE * cur, bool children)
+{
+	char		detail[POOLCONFIG_MAXVALLEN + 1];
+	static char *role_str[] = {"main", "replica", "primary", "standby"};
+	bool		sent = false;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (prev == NULL ||
+			prev->backend_status[i] != cur->backend_status[i] ||
+			prev->quarantine[i] != cur->quarantine[i] ||
+			prev->role[i] != cur->role[i])
+		{
+			snprintf(detail, sizeof(detail), "status=%s role=%s",
+					 backend_status_to_str(pool_get_node_info(i)),
+					 role_str[cur->role[i]]);
+			send_event(frontend, "node", i, detail);
+			sent = true;
+		}
+
+		if ((prev == NULL && cur->health_check_count[i] > 0) ||
+			(prev != NULL && prev->health_check_count[i] != cur->health_check_count[i]))
+		{
+			volatile POOL_HEALTH_CHECK_STATISTICS *stats = &health_check_stats[i];
+			char	   *result;
+
+			/* the latest of the last success, failure and skip is the result */
+			if (stats->last_failed_health_check >= stats->last_successful_health_check &&
+				stats->last_failed_health_check >= stats->last_skip_health_check)
+				result = "failed";
+			else if (stats->last_skip_health_check >= stats->last_successful_health_check)
+				result = "skipped";
+			else
+				result = "succeeded";
+
+			snprintf(detail, sizeof(detail),
+					 "result=%s total_count=" UINT64_FORMAT " success_count=" UINT64_FORMAT " fail_count=" UINT64_FORMAT " skip_count=" UINT64_FORMAT,
+					 result, stats->total_count, stats->success_count,
+					 stats->fail_count, stats->skip_count);
+			send_event(frontend, "health_check", i, detail);
+			sent = true;
+		}
+	}
+
+	if (prev == NULL ||
+		prev->switching != cur->switching ||
+		prev->main_node_id != cur->main_node_id ||
+		prev->primary_node_id != cur->primary_node_id)
+	{
+		snprintf(detail, sizeof(detail), "state=%s main_node_id=%d primary_node_id=%d",
+				 cur->switching ? "in_progress" : "idle",
+				 cur->main_node_id, cur->primary_node_id);
+		send_event(frontend, "failover", -1, detail);
+		sent = true;
+	}
+
+	if (children &&
+		(prev == NULL ||
+		 prev->children != cur->children ||
+		 prev->connected != cur->connected))
+	{
+		snprintf(detail, sizeof(detail), "total=%d connected=%d idle=%d",
+				 cur->children, cur->connected, cur->children - cur->connected);
+		send_event(frontend, "children", -1, detail);
+		sent = true;
+	}
+
+	if (sent)
+		do_pcp_flush(frontend);
+}
+
+/*
+ * Write an event to the client, without flushing.  node_id is -1 if the
+ * event is not about a node.
+ */
+static void
+send_event(PCP_CONNECTION * frontend, char *event_type, int node_id, char *detail)
+{
+	char		node_id_str[POOLCONFIG_MAXIDLEN + 1];
+	char		timestamp[POOLCONFIG_MAXDATELEN + 1];
+	time_t		now = time(NULL);
+	struct tm	tm;
+	int			wsize;
+
+	if (node_id >= 0)
+		snprintf(node_id_str, sizeof(node_id_str), "%d", node_id);
+	else
+		node_id_str[0] = '\0';
+
+	localtime_r(&now, &tm);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+
+	pcp_write(frontend, "e", 1);
+	wsize = htonl(strlen(event_type) + 1 +
+				  strlen(node_id_str) + 1 +
+				  strlen(timestamp) + 1 +
+				  strlen(detail) + 1 +
+				  sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, event_type, strlen(event_type) + 1);
+	pcp_write(frontend, node_id_str, strlen(node_id_str) + 1);
+	pcp_write(frontend, timestamp, strlen(timestamp) + 1);
+	pcp_write(frontend, detail, strlen(detail) + 1);
+}
+
+/*
+ * Wait at most timeout_ms milliseconds for data from the client.  Returns
+ * true if there is something to read, which includes the end of the
+ * connection.
+ */
+static bool
+wait_for_pcp_client(PCP_CONNECTION * frontend, int timeout_ms)
+{
+	fd_set		rmask;
+	struct timeval timeout;
+	int			rtn;
+
+	/* data may be buffered already */
+	if (frontend->len > 0)
+		return true;
+
+	FD_ZERO(&rmask);
+	FD_SET(frontend->fd, &rmask);
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+	rtn = select(frontend->fd + 1, &rmask, NULL, NULL, &timeout);
+	if (rtn < 0)
+	{
+		if (errno == EINTR)
+			return false;
+		ereport(FATAL,
+				(errmsg("unable to read from client"),
+				 errdetail("select system call failed with error : \"%m\"")));
+	}
+	return rtn > 0;
+}
+
 static void
 process_detach_node(PCP_CONNECTION * frontend, char *buf, char tos)
 {
@@ -1154,12 +1750,20 @@ process_attach_node(PCP_CONNECTION * frontend, char *buf)
 }
 
 
+/*
+ * Process recovery request.  buf is the node id, optionally followed by " a"
+ * to run the recovery asynchronously: the request is replied as soon as the
+ * recovery starts, and the recovery goes on after the client disconnects.
+ * Its progress is seen with the recovery status request.
+ */
 static void
 process_recovery_request(PCP_CONNECTION * frontend, char *buf)
 {
 	int			wsize;
 	char		code[] = "CommandComplete";
 	int			node_id = atoi(buf);
+	char	   *option = strchr(buf, ' ');
+	bool		async = (option != NULL && option[1] == 'a');
 
 	if ((node_id < 0) || (node_id >= pool_config->backend_desc->num_backends))
 		ereport(ERROR,
@@ -1191,19 +1795,32 @@ process_recovery_request(PCP_CONNECTION * frontend, char *buf)
 				(errmsg("PCP: processing recovery request"),
 				 errdetail("start online recovery")));
 
-		PG_TRY();
+		if (async)
 		{
-			start_recovery(node_id);
-			finish_recovery();
 			pcp_write(frontend, "c", 1);
 			wsize = htonl(sizeof(code) + sizeof(int));
 			pcp_write(frontend, &wsize, sizeof(int));
 			pcp_write(frontend, code, sizeof(code));
 			do_pcp_flush(frontend);
+		}
+
+		PG_TRY();
+		{
+			start_recovery(node_id);
+			finish_recovery();
+			if (!async)
+			{
+				pcp_write(frontend, "c", 1);
+				wsize = htonl(sizeof(code) + sizeof(int));
+				pcp_write(frontend, &wsize, sizeof(int));
+				pcp_write(frontend, code, sizeof(code));
+				do_pcp_flush(frontend);
+			}
 			pcp_mark_recovery_finished();
 		}
 		PG_CATCH();
 		{
+			fail_recovery();
 			finish_recovery();
 			pcp_mark_recovery_finished();
 			PG_RE_THROW();
@@ -1235,8 +1852,6 @@ process_status_request(PCP_CONNECTION * frontend)
 	len = htonl(nrows);
 	pcp_write(frontend, &len, sizeof(int));
 
-	do_pcp_flush(frontend);
-
 	for (i = 0; i < nrows; i++)
 	{
 		pcp_write(frontend, "b", 1);
@@ -1258,7 +1873,7 @@ process_status_request(PCP_CONNECTION * frontend)
 	len = htonl(sizeof(fin_code) + sizeof(int));
 	pcp_write(frontend, &len, sizeof(int));
 	pcp_write(frontend, fin_code, sizeof(fin_code));
-	do_pcp_flush(frontend);
+	finish_pcp_reply(frontend);
 
 	pfree(status);
 	ereport(DEBUG1,
@@ -1517,6 +2132,23 @@ do_pcp_flush(PCP_CONNECTION * frontend)
 				 errdetail("pcp_flush failed with error : \"%m\"")));
 }
 
+/*
+ * Flush the reply to an informational request, unless the client has sent
+ * more requests already.  Then the reply goes out together with the replies
+ * to those requests, so that a client sending a batch of requests at once
+ * gets all the replies with few writes.  Replies are built in the write
+ * buffer as a whole, whatever their number of records, and the reply to the
+ * last request of a batch is always flushed since no request follows it in
+ * the read buffer.
+ */
+static void
+finish_pcp_reply(PCP_CONNECTION * frontend)
+{
+	if (frontend->len > 0)
+		return;
+	do_pcp_flush(frontend);
+}
+
 /*
  * Wrapper around pcp_read which throws FATAL error when read fails
  */
@@ -30,6 +30,9 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/select.h>
 #include "pcp/recovery.h"
 #include "utils/elog.h"
 #include "utils/pool_signal.h"
@@ -43,15 +46,27 @@
 
 #define FIRST_STAGE 0
 #define SECOND_STAGE 1
+#define CATCHUP_STAGE 2
+
+static const char *const stage_names[] = {"1st stage", "2nd stage", "catch-up stage"};
+
+/* interval of updating the progress while a stage command runs, in seconds */
+#define RECOVERY_PROGRESS_INTERVAL 1
 
 static void exec_checkpoint(PGconn *conn);
 static void exec_recovery(PGconn *conn, BackendInfo * main_backend, BackendInfo * recovery_backend, char stage, int recovery_node);
 static void exec_remote_start(PGconn *conn, BackendInfo * backend);
 static PGconn *connect_backend_libpq(BackendInfo * backend);
 static void check_postmaster_started(BackendInfo * backend);
+static void set_recovery_stage(RecoveryStage stage);
+static void get_wal_lsn(PGconn *conn, volatile char *lsn, size_t size);
+static bool update_backup_progress(PGconn *monitor);
 
 static char recovery_command[1024];
 
+/* when new clients started to be paused for the 2nd stage */
+static struct timeval pause_start;
+
 extern volatile sig_atomic_t pcp_worker_wakeup_request;
 
 /*
@@ -73,6 +88,11 @@ start_recovery(int recovery_node)
 	ereport(LOG,
 			(errmsg("starting recovering node %d", recovery_node)));
 
+	memset((void *) pcp_recovery_progress, 0, sizeof(RecoveryProgress));
+	pcp_recovery_progress->node_id = recovery_node;
+	pcp_recovery_progress->start_time = time(NULL);
+	set_recovery_stage(RECOVERY_STAGE_CONNECTING);
+
 	if ((recovery_node < 0) || (recovery_node >= pool_config->backend_desc->num_backends))
 		ereport(ERROR,
 				(errmsg("node recovery failed, node id: %d is not valid", recovery_node)));
@@ -85,6 +105,11 @@ start_recovery(int recovery_node)
 		ereport(ERROR,
 				(errmsg("node recovery failed, node id: %d is alive", recovery_node)));
 
+	/* recovery would overwrite the rows of the shard with the main node's */
+	if (pool_config->parsed_shard_key_list != NULL)
+		ereport(ERROR,
+				(errmsg("node recovery failed, online recovery is not supported when shard_key_list is set")));
+
 	/* select main/primary node */
 	node_id = MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID;
 	backend = &pool_config->backend_desc->backend_info[node_id];
@@ -110,6 +135,7 @@ start_recovery(int recovery_node)
 	PG_TRY();
 	{
 		/* 1st stage */
+		set_recovery_stage(RECOVERY_STAGE_FIRST_STAGE);
 		if (REPLICATION)
 		{
 			exec_checkpoint(conn);
@@ -122,12 +148,42 @@ start_recovery(int recovery_node)
 		ereport(LOG,
 				(errmsg("node recovery, 1st stage is done")));
 
+		/*
+		 * Replay the changes made since the 1st stage while clients are
+		 * still served, so that the 2nd stage, during which they are not,
+		 * has only the changes made during the last round to replay.
+		 */
+		if (REPLICATION && strlen(pool_config->recovery_catchup_command) > 0)
+		{
+			int			round;
+
+			set_recovery_stage(RECOVERY_STAGE_CATCHUP);
+
+			for (round = 1; round <= pool_config->recovery_catchup_rounds; round++)
+			{
+				struct timeval round_start;
+				struct timeval round_end;
+
+				gettimeofday(&round_start, NULL);
+				exec_recovery(conn, backend, recovery_backend, CATCHUP_STAGE, recovery_node);
+				gettimeofday(&round_end, NULL);
+
+				ereport(LOG,
+						(errmsg("node recovery, catch-up round %d is done", round),
+						 errdetail("took %ld ms",
+								   (round_end.tv_sec - round_start.tv_sec) * 1000 +
+								   (round_end.tv_usec - round_start.tv_usec) / 1000)));
+			}
+		}
+
 		if (REPLICATION)
 		{
 			ereport(LOG,
 					(errmsg("node recovery, starting 2nd stage")));
 
 			/* 2nd stage */
+			set_recovery_stage(RECOVERY_STAGE_WAITING_CLIENTS);
+			gettimeofday(&pause_start, NULL);
 			*InRecovery = RECOVERY_ONLINE;
 			if (pool_config->use_watchdog)
 			{
@@ -144,6 +200,7 @@ start_recovery(int recovery_node)
 			ereport(LOG,
 					(errmsg("node recovery, all connections from clients have been closed")));
 
+			set_recovery_stage(RECOVERY_STAGE_SECOND_STAGE);
 			exec_checkpoint(conn);
 
 			ereport(LOG,
@@ -153,6 +210,7 @@ start_recovery(int recovery_node)
 			exec_recovery(conn, backend, recovery_backend, SECOND_STAGE, recovery_node);
 		}
 
+		set_recovery_stage(RECOVERY_STAGE_REMOTE_START);
 		exec_remote_start(conn, recovery_backend);
 
 		check_postmaster_started(recovery_backend);
@@ -167,6 +225,7 @@ start_recovery(int recovery_node)
 		pcp_worker_wakeup_request = 0;
 
 		/* send failback request to pgpool parent */
+		set_recovery_stage(RECOVERY_STAGE_FAILBACK);
 		send_failback_request(recovery_node, false, REQ_DETAIL_CONFIRMED);
 
 		/* wait for failback */
@@ -199,10 +258,67 @@ start_recovery(int recovery_node)
 
 	PQfinish(conn);
 
+	pcp_recovery_progress->end_time = time(NULL);
+	set_recovery_stage(RECOVERY_STAGE_DONE);
+
 	ereport(LOG,
 			(errmsg("recovery done")));
 }
 
+/*
+ * Record the error being thrown in the recovery progress.  Called in the
+ * error handler of start_recovery() caller.
+ */
+void
+fail_recovery(void)
+{
+	ErrorData  *edata = CopyErrorData();
+
+	strlcpy((char *) pcp_recovery_progress->message,
+			edata->message ? edata->message : "",
+			sizeof(pcp_recovery_progress->message));
+	FreeErrorData(edata);
+
+	pcp_recovery_progress->end_time = time(NULL);
+	set_recovery_stage(RECOVERY_STAGE_FAILED);
+}
+
+const char *
+recovery_stage_to_str(RecoveryStage stage)
+{
+	switch (stage)
+	{
+		case RECOVERY_STAGE_NONE:
+			return "none";
+		case RECOVERY_STAGE_CONNECTING:
+			return "connecting";
+		case RECOVERY_STAGE_FIRST_STAGE:
+			return "1st stage";
+		case RECOVERY_STAGE_CATCHUP:
+			return "catch-up";
+		case RECOVERY_STAGE_WAITING_CLIENTS:
+			return "waiting for clients";
+		case RECOVERY_STAGE_SECOND_STAGE:
+			return "2nd stage";
+		case RECOVERY_STAGE_REMOTE_START:
+			return "remote start";
+		case RECOVERY_STAGE_FAILBACK:
+			return "failback";
+		case RECOVERY_STAGE_DONE:
+			return "done";
+		case RECOVERY_STAGE_FAILED:
+			return "failed";
+	}
+	return "unknown";
+}
+
+static void
+set_recovery_stage(RecoveryStage stage)
+{
+	pcp_recovery_progress->stage_start_time = time(NULL);
+	pcp_recovery_progress->stage = stage;
+}
+
 /*
  * Notice all children finishing recovery.
  */
@@ -215,6 +331,20 @@ finish_recovery(void)
 		wd_end_recovery();
 	}
 
+	if (*InRecovery != RECOVERY_INIT && pause_start.tv_sec != 0)
+	{
+		struct timeval now;
+
+		gettimeofday(&now, NULL);
+		pcp_recovery_progress->pause_time = (now.tv_sec - pause_start.tv_sec) * 1000 +
+			(now.tv_usec - pause_start.tv_usec) / 1000;
+		pause_start.tv_sec = 0;
+
+		ereport(LOG,
+				(errmsg("node recovery, new clients were paused for %d ms",
+						pcp_recovery_progress->pause_time)));
+	}
+
 	*InRecovery = RECOVERY_INIT;
 	pool_signal_parent(SIGUSR2);
 }
@@ -253,6 +383,7 @@ exec_recovery(PGconn *conn, BackendInfo * main_backend, BackendInfo * recovery_b
 	char	   *hostname;
 	char	   *script;
 	char	   *main_hostname;
+	PGconn	   *monitor;
 
 	if (strlen(recovery_backend->backend_hostname) == 0 || *(recovery_backend->backend_hostname) == '/')
 		hostname = "localhost";
@@ -264,8 +395,12 @@ exec_recovery(PGconn *conn, BackendInfo * main_backend, BackendInfo * recovery_b
 	else
 		main_hostname = main_backend->backend_hostname;
 
-	script = (stage == FIRST_STAGE) ?
-		pool_config->recovery_1st_stage_command : pool_config->recovery_2nd_stage_command;
+	if (stage == FIRST_STAGE)
+		script = pool_config->recovery_1st_stage_command;
+	else if (stage == SECOND_STAGE)
+		script = pool_config->recovery_2nd_stage_command;
+	else
+		script = pool_config->recovery_catchup_command;
 
 	if (script == NULL || strlen(script) == 0)
 	{
@@ -300,26 +435,129 @@ exec_recovery(PGconn *conn, BackendInfo * main_backend, BackendInfo * recovery_b
 	if (PQresultStatus(result) != PGRES_COMMAND_OK)
 		ereport(ERROR,
 				(errmsg("executing recovery, SET STATEMENT_TIMEOUT failed at \"%s\"",
-						(stage == FIRST_STAGE) ? "1st stage" : "2nd stage")));
+						stage_names[(int) stage])));
 
 	PQclear(result);
 
 	ereport(DEBUG1,
 			(errmsg("executing recovery, start recovery")));
 
-	result = PQexec(conn, recovery_command);
+	get_wal_lsn(conn, pcp_recovery_progress->start_lsn,
+				sizeof(pcp_recovery_progress->start_lsn));
+
+	/*
+	 * Run the command asynchronously so that the base backups it takes,
+	 * possibly as several parallel streams, can be watched on another
+	 * connection while it runs.
+	 */
+	if (PQsendQuery(conn, recovery_command) == 0)
+		ereport(ERROR,
+				(errmsg("executing recovery, execution of command failed at \"%s\"",
+						stage_names[(int) stage]),
+				 errdetail("%s", PQerrorMessage(conn))));
+
+	monitor = connect_backend_libpq(main_backend);
+
+	while (PQisBusy(conn))
+	{
+		fd_set		rfds;
+		struct timeval t = {RECOVERY_PROGRESS_INTERVAL, 0};
+		int			sock = PQsocket(conn);
+
+		FD_ZERO(&rfds);
+		FD_SET(sock, &rfds);
+
+		if (select(sock + 1, &rfds, NULL, NULL, &t) < 0 && errno != EINTR)
+			break;
+
+		if (PQconsumeInput(conn) == 0)
+			break;
+
+		if (monitor && !update_backup_progress(monitor))
+		{
+			PQfinish(monitor);
+			monitor = NULL;
+		}
+	}
+
+	if (monitor)
+	{
+		update_backup_progress(monitor);
+		PQfinish(monitor);
+	}
+
+	result = PQgetResult(conn);
 	if (PQresultStatus(result) != PGRES_TUPLES_OK)
 		ereport(ERROR,
 				(errmsg("executing recovery, execution of command failed at \"%s\"",
-						(stage == FIRST_STAGE) ? "1st stage" : "2nd stage"),
+						stage_names[(int) stage]),
 				 errdetail("command:\"%s\"", script)));
 
 	PQclear(result);
+	while ((result = PQgetResult(conn)) != NULL)
+		PQclear(result);
 
 	ereport(DEBUG1,
 			(errmsg("executing recovery, finish recovery")));
 }
 
+/*
+ * Store the current WAL position of the node in "lsn".  Leave it empty if
+ * the node does not tell it, e.g. if it is older than PostgreSQL 10.
+ */
+static void
+get_wal_lsn(PGconn *conn, volatile char *lsn, size_t size)
+{
+	PGresult   *result;
+
+	result = PQexec(conn, "SELECT pg_current_wal_lsn()");
+	if (PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) == 1)
+		strlcpy((char *) lsn, PQgetvalue(result, 0, 0), size);
+	else
+		*lsn = '\0';
+	PQclear(result);
+}
+
+/*
+ * Update the base backup progress from pg_stat_progress_basebackup of the
+ * node on "monitor".  The bytes of all the base backups running are summed
+ * up since the recovery command may stream the backup in parallel.  Return
+ * false if the node cannot tell, e.g. if it is older than PostgreSQL 13.
+ */
+static bool
+update_backup_progress(PGconn *monitor)
+{
+	PGresult   *result;
+	int			streams;
+
+	result = PQexec(monitor,
+					"SELECT count(*), coalesce(sum(backup_streamed), 0), "
+					"coalesce(sum(backup_total), 0), pg_current_wal_lsn() "
+					"FROM pg_stat_progress_basebackup");
+	if (PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1)
+	{
+		ereport(DEBUG1,
+				(errmsg("executing recovery, unable to get base backup progress"),
+				 errdetail("%s", PQresultErrorMessage(result))));
+		PQclear(result);
+		return false;
+	}
+
+	/* keep the last numbers once the base backups have finished */
+	streams = atoi(PQgetvalue(result, 0, 0));
+	if (streams > 0)
+	{
+		pcp_recovery_progress->backup_streamed = strtoll(PQgetvalue(result, 0, 1), NULL, 10);
+		pcp_recovery_progress->backup_total = strtoll(PQgetvalue(result, 0, 2), NULL, 10);
+	}
+	pcp_recovery_progress->backup_streams = streams;
+	strlcpy((char *) pcp_recovery_progress->current_lsn, PQgetvalue(result, 0, 3),
+			sizeof(pcp_recovery_progress->current_lsn));
+
+	PQclear(result);
+	return true;
+}
+
 /*
  * Call pgpool_remote_start() function.
  */
@@ -262,12 +262,18 @@ fi
 %{_bindir}/pcp_pool_status
 %{_bindir}/pcp_proc_count
 %{_bindir}/pcp_proc_info
+%{_bindir}/pcp_memory_info
 %{_bindir}/pcp_promote_node
 %{_bindir}/pcp_stop_pgpool
 %{_bindir}/pcp_recovery_node
 %{_bindir}/pcp_watchdog_info
 %{_bindir}/pcp_reload_config
+%{_bindir}/pcp_snapshot_query_cache
 %{_bindir}/pcp_health_check_stats
+%{_bindir}/pcp_backend_stats
+%{_bindir}/pcp_reset_statement_stats
+%{_bindir}/pcp_subscribe
+%{_bindir}/pcp_recovery_status
 %{_bindir}/pg_md5
 %{_bindir}/pg_enc
 %{_bindir}/pgpool_setup
@@ -338,6 +344,8 @@ fi
 %{pghome}/share/extension/pgpool_adm--1.3--1.4.sql
 %{pghome}/share/extension/pgpool_adm--1.5.sql
 %{pghome}/share/extension/pgpool_adm--1.4--1.5.sql
+%{pghome}/share/extension/pgpool_adm--1.6.sql
+%{pghome}/share/extension/pgpool_adm--1.5--1.6.sql
 %{pghome}/share/extension/pgpool_adm.control
 %{pghome}/lib/pgpool_adm.so
 # From PostgreSQL 9.4 pgpool-regclass.so is not needed anymore
@@ -24,12 +24,15 @@
  * "CommandComplete".
  *---------------------------------------------------------------------
  */
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
 
 #include "pool.h"
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
+#include "protocol/pool_prepared_statement.h"
 #include "parser/pg_config_manual.h"
 #include "pool_config.h"
 #include "context/pool_session_context.h"
@@ -38,8 +41,12 @@
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_statement_stats.h"
 
-static int	extract_ntuples(char *message);
+static char *read_command_complete(POOL_CONNECTION * con, int *len, bool command_complete);
+static int	extract_ntuples(char *tag);
+static int64 extract_ntuples64(char *tag);
+static uint64 command_tag_rows(char *tag);
 static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *packet, int packetlen, bool command_complete);
 static int	forward_command_complete(POOL_CONNECTION * frontend, char *packet, int packetlen);
 static int	forward_empty_query(POOL_CONNECTION * frontend, char *packet, int packetlen);
@@ -48,10 +55,8 @@ static int	forward_packet_to_frontend(POOL_CONNECTION * frontend, char kind, cha
 POOL_STATUS
 CommandComplete(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool command_complete)
 {
-	int			len,
-				len1;
-	char	   *p,
-			   *p1;
+	int			len1;
+	char	   *p1;
 	int			i;
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_CONNECTION *con;
@@ -83,28 +88,9 @@ CommandComplete(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool
 			{
 				con = CONNECTION(backend, i);
 
-				if (pool_read(con, &len, sizeof(len)) < 0)
-				{
-					if (p1 != NULL)
-						pfree(p1);
+				p1 = read_command_complete(con, &len1, command_complete);
+				if (p1 == NULL)
 					return POOL_END;
-				}
-
-				len = ntohl(len);
-				len -= 4;
-				len1 = len;
-
-				p = pool_read2(con, len);
-				if (p == NULL)
-				{
-					if (p1 != NULL)
-						pfree(p1);
-					return POOL_END;
-				}
-				if (p1 != NULL)
-					pfree(p1);
-				p1 = palloc(len);
-				memcpy(p1, p, len);
 
 				if (session_context->query_context &&
 					session_context->query_context->parse_tree &&
@@ -126,18 +112,9 @@ CommandComplete(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool
 	{
 		con = MAIN(backend);
 
-		if (pool_read(con, &len, sizeof(len)) < 0)
-			return POOL_END;
-
-		len = ntohl(len);
-		len -= 4;
-		len1 = len;
-
-		p = pool_read2(con, len);
-		if (p == NULL)
+		p1 = read_command_complete(con, &len1, command_complete);
+		if (p1 == NULL)
 			return POOL_END;
-		p1 = palloc(len);
-		memcpy(p1, p, len);
 	}
 
 	/*
@@ -170,6 +147,11 @@ CommandComplete(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool
 		}
 	}
 
+	/* count rows of the statement, e.g. 42 of "SELECT 42" */
+	if (command_complete && p1 != NULL && session_context->query_context)
+		pool_statement_stats_add_rows(session_context->query_context->statement_stats_slot,
+									  command_tag_rows(p1));
+
 	/*
 	 * If operated in streaming replication mode and extended query mode, just
 	 * forward the packet to frontend and we are done. Otherwise, we need to
@@ -230,8 +212,6 @@ CommandComplete(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool
 		}
 	}
 
-	pfree(p1);
-
 	if (pool_is_doing_extended_query_message() && pool_is_query_in_progress())
 	{
 		pool_set_query_state(session_context->query_context, POOL_EXECUTE_COMPLETE);
@@ -307,6 +287,7 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 		{
 			pool_remove_sent_messages('Q');
 			pool_remove_sent_messages('P');
+			pool_ps_clear(backend);
 		}
 		else
 		{
@@ -326,6 +307,7 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 		else if (stmt->target == DISCARD_ALL)
 		{
 			pool_clear_sent_message_list();
+			pool_ps_clear(backend);
 		}
 	}
 
@@ -436,20 +418,58 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 }
 
 /*
- * Extract the number of tuples from CommandComplete message
+ * Read the body of a CommandComplete or EmptyQueryResponse message, whose
+ * kind has been read already, from con.  The returned body is not copied:
+ * it stays in the read buffer of con until the next pool_read2() on con.
+ * The command tag of CommandComplete is checked to be null terminated, so
+ * that it can be used as a string.  Returns NULL if reading fails.
+ */
+static char *
+read_command_complete(POOL_CONNECTION * con, int *len, bool command_complete)
+{
+	int			msglen;
+	char	   *p;
+
+	if (pool_read(con, &msglen, sizeof(msglen)) < 0)
+		return NULL;
+
+	msglen = ntohl(msglen) - 4;
+	if (msglen < 0 || (command_complete && msglen == 0))
+		ereport(ERROR,
+				(errmsg("processing command complete"),
+				 errdetail("invalid message length %d from DB node %d", msglen + 4, con->db_node_id)));
+
+	p = pool_read2(con, msglen);
+	if (p == NULL)
+		return NULL;
+
+	if (command_complete && p[msglen - 1] != '\0')
+		ereport(ERROR,
+				(errmsg("processing command complete"),
+				 errdetail("command tag from DB node %d is not null terminated", con->db_node_id)));
+
+	*len = msglen;
+	return p;
+}
+
+/*
+ * Extract the number of tuples from the command tag of UPDATE, DELETE and
+ * INSERT, e.g. 3 of "UPDATE 3" or "INSERT 0 3".  Returns 0 for other tags.
  */
 static int
-extract_ntuples(char *message)
+extract_ntuples(char *tag)
 {
 	char	   *rows;
 
-	if ((rows = strstr(message, "UPDATE")) || (rows = strstr(message, "DELETE")))
-		rows += 7;
-	else if ((rows = strstr(message, "INSERT")))
+	if (strncmp(tag, "UPDATE ", 7) == 0 || strncmp(tag, "DELETE ", 7) == 0)
+		rows = tag + 7;
+	else if (strncmp(tag, "INSERT ", 7) == 0)
 	{
-		rows += 7;
-		while (*rows && *rows != ' ')
-			rows++;
+		/* skip the oid */
+		rows = strchr(tag + 7, ' ');
+		if (rows == NULL)
+			return 0;
+		rows++;
 	}
 	else
 		return 0;
@@ -457,28 +477,67 @@ extract_ntuples(char *message)
 	return atoi(rows);
 }
 
+/*
+ * Returns the number of rows of a command tag, which is the last word of
+ * the tag if it is a number, e.g. "SELECT 42", "INSERT 0 1" or "COPY 5".
+ * Returns 0 for other tags.
+ */
+static uint64
+command_tag_rows(char *tag)
+{
+	char	   *p = strrchr(tag, ' ');
+
+	if (p == NULL || !isdigit((unsigned char) p[1]))
+		return 0;
+
+	return strtoull(p + 1, NULL, 10);
+}
+
 /*
  * Handle mismatch tuples
+ *
+ * The message of the main node is in packet.  Those of the other nodes are
+ * read and discarded.  Numbers of affected tuples are compared only in
+ * native replication and snapshot isolation mode, in which the same write
+ * query runs on all nodes.
+ *
+ * An UPDATE or DELETE sent to all shards (see pool_shard_routing.c) affects
+ * different rows on each node, so the numbers are not compared but added
+ * up, and the frontend gets the total.
  */
 static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *packet, int packetlen, bool command_complete)
 {
 	POOL_SESSION_CONTEXT *session_context;
 
-	int			rows;
+	int			rows = 0;
 	int			i;
 	int			len;
 	char	   *p;
+	bool		compare = (REPLICATION && command_complete);
+	bool		broadcast = false;
+	int64		total_rows = 0;
+	char		tag[64];
 
 	/* Get session context */
 	session_context = pool_get_session_context(false);
 
-	rows = extract_ntuples(packet);
+	if (command_complete && session_context->query_context &&
+		session_context->query_context->is_shard_broadcast)
+	{
+		broadcast = true;
+		compare = false;
+		total_rows = extract_ntuples64(packet);
+	}
 
-	/*
-	 * Save number of affected tuples of main node.
-	 */
-	session_context->ntuples[MAIN_NODE_ID] = rows;
+	if (compare)
+	{
+		rows = extract_ntuples(packet);
 
+		/*
+		 * Save number of affected tuples of main node.
+		 */
+		session_context->ntuples[MAIN_NODE_ID] = rows;
+	}
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
@@ -490,12 +549,7 @@ static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNE
 				continue;
 			}
 
-			pool_read(CONNECTION(backend, i), &len, sizeof(len));
-
-			len = ntohl(len);
-			len -= 4;
-
-			p = pool_read2(CONNECTION(backend, i), len);
+			p = read_command_complete(CONNECTION(backend, i), &len, command_complete);
 			if (p == NULL)
 				return POOL_END;
 
@@ -507,20 +561,26 @@ static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNE
 								   len, i, packetlen)));
 			}
 
-			int			n = extract_ntuples(p);
-
-			/*
-			 * Save number of affected tuples.
-			 */
-			session_context->ntuples[i] = n;
+			if (broadcast)
+				total_rows += extract_ntuples64(p);
 
-			if (rows != n)
+			if (compare)
 			{
+				int			n = extract_ntuples(p);
+
 				/*
-				 * Remember that we have different number of UPDATE/DELETE
-				 * affected tuples in backends.
+				 * Save number of affected tuples.
 				 */
-				session_context->mismatch_ntuples = true;
+				session_context->ntuples[i] = n;
+
+				if (rows != n)
+				{
+					/*
+					 * Remember that we have different number of UPDATE/DELETE
+					 * affected tuples in backends.
+					 */
+					session_context->mismatch_ntuples = true;
+				}
 			}
 		}
 	}
@@ -555,7 +615,15 @@ static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNE
 	}
 	else
 	{
-		if (command_complete)
+		if (broadcast && (strncmp(packet, "UPDATE ", 7) == 0 ||
+						  strncmp(packet, "DELETE ", 7) == 0))
+		{
+			/* send "UPDATE <total>" instead of the count of the main node */
+			snprintf(tag, sizeof(tag), "%.6s " INT64_FORMAT, packet, total_rows);
+			if (forward_command_complete(frontend, tag, strlen(tag) + 1) < 0)
+				return POOL_END;
+		}
+		else if (command_complete)
 		{
 			if (forward_command_complete(frontend, packet, packetlen) < 0)
 				return POOL_END;
@@ -570,6 +638,17 @@ static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNE
 	return POOL_CONTINUE;
 }
 
+/*
+ * Number of rows of an UPDATE or DELETE command tag, or 0.
+ */
+static int64
+extract_ntuples64(char *tag)
+{
+	if (strncmp(tag, "UPDATE ", 7) == 0 || strncmp(tag, "DELETE ", 7) == 0)
+		return strtoll(tag + 7, NULL, 10);
+	return 0;
+}
+
 /*
  * Forward Command complete packet to frontend
  */
@@ -589,18 +668,18 @@ forward_empty_query(POOL_CONNECTION * frontend, char *packet, int packetlen)
 }
 
 /*
- * Forward packet to frontend
+ * Forward packet to frontend.  The body received from backend is written as
+ * it is, after the kind and length.
  */
 static int
 forward_packet_to_frontend(POOL_CONNECTION * frontend, char kind, char *packet, int packetlen)
 {
-	int			sendlen;
-
-	if (pool_write(frontend, &kind, 1) < 0)
-		return -1;
+	char		header[1 + sizeof(int32)];
+	int32		sendlen = htonl(packetlen + 4);
 
-	sendlen = htonl(packetlen + 4);
-	if (pool_write(frontend, &sendlen, sizeof(sendlen)) < 0)
+	header[0] = kind;
+	memcpy(header + 1, &sendlen, sizeof(sendlen));
+	if (pool_write(frontend, header, sizeof(header)) < 0)
 		return -1;
 
 	pool_write_and_flush(frontend, packet, packetlen);
@@ -35,6 +35,9 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <signal.h>
 #include <stdio.h>
@@ -57,12 +60,16 @@
 #include "utils/elog.h"
 #include "utils/ps_status.h"
 #include "utils/timestamp.h"
+#include "utils/statistics.h"
+#include "utils/pool_timer.h"
+#include "utils/pool_stage.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
 #include "protocol/pool_connection_pool.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_client_limit.h"
 #include "auth/pool_auth.h"
 #include "auth/md5.h"
 #include "auth/pool_passwd.h"
@@ -83,23 +90,36 @@ static bool connect_using_existing_connection(POOL_CONNECTION * frontend,
 								  StartupPacket *sp);
 static void check_restart_request(void);
 static void check_exit_request(void);
+static void check_memory_limit(void);
 static void enable_authentication_timeout(void);
 static void disable_authentication_timeout(void);
 static int	wait_for_new_connections(int *fds, SockAddr *saddr);
-static void check_config_reload(void);
 static void get_backends_status(unsigned int *valid_backends, unsigned int *down_backends);
 static void validate_backend_connectivity(int front_end_fd);
 static POOL_CONNECTION * get_connection(int front_end_fd, SockAddr *saddr);
 static POOL_CONNECTION_POOL * get_backend_connection(POOL_CONNECTION * frontend);
 static StartupPacket *StartupPacketCopy(StartupPacket *sp);
+static bool startup_packet_matches_prewarmed(StartupPacket *sp, StartupPacket *prewarmed_sp);
 static void log_disconnections(char *database, char *username);
+static bool application_name_is_set(POOL_CONNECTION_POOL * backend, char *application_name);
 static void print_process_status(char *remote_host, char *remote_port);
 static bool backend_cleanup(POOL_CONNECTION * volatile *frontend, POOL_CONNECTION_POOL * volatile backend, bool frontend_invalid);
 
 static void child_will_go_down(int code, Datum arg);
 static int opt_sort(const void *a, const void *b);
 
-static bool unix_fds_not_isset(int* fds, int num_unix_fds, fd_set* opt);
+/*
+ * On Linux, serialize_accept is implemented by EPOLLEXCLUSIVE, which lets
+ * the kernel wake up only one of the processes waiting on the listening
+ * sockets, instead of by the accept semaphore.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && defined(EPOLLEXCLUSIVE)
+#define USE_EXCLUSIVE_ACCEPT
+static int	accept_epfd = -1;
+static int	create_accept_epoll(int *fds);
+#endif
+
+static bool is_unix_fd(int *fds, int num_unix_fds, int fd);
 
 /*
  * Non 0 means SIGTERM (smart shutdown) or SIGINT (fast shutdown) has arrived
@@ -120,8 +140,9 @@ volatile sig_atomic_t sigusr2_received = 0;
 static int	idle;				/* non 0 means this child is in idle state */
 static int	accepted = 0;
 
-fd_set		readmask;
-int			nsocks;
+/* listening sockets passed to poll(2) in wait_for_new_connections() */
+static struct pollfd *accept_pfds = NULL;
+static int	num_accept_fds = 0;
 static int	child_inet_fd = 0;
 static int	child_unix_fd = 0;
 
@@ -179,20 +200,26 @@ do_child(int *fds)
 	on_system_exit(child_will_go_down, (Datum) NULL);
 
 	int		   *walk;
+	int			i;
 #ifdef NONE_BLOCK
 	/* set listen fds to none-blocking */
 	for (walk = fds; *walk != -1; walk++)
 		socket_set_nonblock(*walk);
 #endif
 	for (walk = fds; *walk != -1; walk++)
+		num_accept_fds++;
+	accept_pfds = MemoryContextAlloc(TopMemoryContext,
+									 sizeof(struct pollfd) * num_accept_fds);
+	for (i = 0; i < num_accept_fds; i++)
 	{
-		if (*walk > nsocks)
-			nsocks = *walk;
+		accept_pfds[i].fd = fds[i];
+		accept_pfds[i].events = POLLIN;
 	}
-	nsocks++;
-	FD_ZERO(&readmask);
-	for (walk = fds; *walk != -1; walk++)
-		FD_SET(*walk, &readmask);
+
+#ifdef USE_EXCLUSIVE_ACCEPT
+	if (pool_config->serialize_accept)
+		accept_epfd = create_accept_epoll(fds);
+#endif
 
 	/* Create per loop iteration memory context */
 	ProcessLoopContext = AllocSetContextCreate(TopMemoryContext,
@@ -208,6 +235,7 @@ do_child(int *fds)
 
 	/* Initialize per process context */
 	pool_init_process_context();
+	pool_stage_init();
 
 	/* initialize random seed */
 	gettimeofday(&now, &tz);
@@ -240,6 +268,7 @@ do_child(int *fds)
 		bool		frontend_invalid = getfrontendinvalid();
 
 		disable_authentication_timeout();
+		pool_stage_reset();
 		/* Since not using PG_TRY, must reset error stack by hand */
 		error_context_stack = NULL;
 
@@ -260,6 +289,8 @@ do_child(int *fds)
 		 */
 		MemoryContextSwitchTo(ProcessLoopContext);
 
+		pool_release_cache_inflight();
+
 		if (accepted)
 		{
 			accepted = 0;
@@ -302,6 +333,10 @@ do_child(int *fds)
 			child_frontend = NULL;
 		}
 		update_pooled_connection_count();
+		update_buffer_memory(NULL);
+		update_memory_usage();
+		if (session)
+			check_memory_limit();
 		MemoryContextSwitchTo(TopMemoryContext);
 		FlushErrorState();
 	}
@@ -319,6 +354,8 @@ do_child(int *fds)
 		/* reset per iteration memory context */
 		MemoryContextSwitchTo(ProcessLoopContext);
 		MemoryContextResetAndDeleteChildren(ProcessLoopContext);
+		/* QueryContext was a child of ProcessLoopContext */
+		QueryContext = NULL;
 
 		backend = NULL;
 		idle = 1;
@@ -331,6 +368,9 @@ do_child(int *fds)
 		/* Destroy session context for just in case... */
 		pool_session_context_destroy();
 
+		/* open connections listed in prewarm_connections if not yet */
+		pool_prewarm_connections();
+
 		front_end_fd = wait_for_new_connections(fds, &saddr);
 		pool_get_my_process_info()->wait_for_connect = 0;
 		if (front_end_fd == OPERATION_TIMEOUT)
@@ -394,12 +434,8 @@ do_child(int *fds)
 		/* reset busy flag */
 		idle = 0;
 
-		/* check backend timer is expired */
-		if (backend_timer_expired)
-		{
-			pool_backend_timer();
-			backend_timer_expired = 0;
-		}
+		/* run expired timers */
+		pool_timer_run_expired();
 
 		/*
 		 * Check whether failover/failback is ongoing and wait for it to
@@ -482,6 +518,8 @@ do_child(int *fds)
 		 * Update number of established connections in the connection pool.
 		 */
 		update_pooled_connection_count();
+		update_buffer_memory(NULL);
+		update_memory_usage();
 
 		accepted = 0;
 		connection_count_down();
@@ -502,6 +540,8 @@ do_child(int *fds)
 					(errmsg("child exiting, %d connections reached", pool_config->child_max_connections)));
 			child_exit(POOL_EXIT_AND_RESTART);
 		}
+
+		check_memory_limit();
 	}
 	child_exit(POOL_EXIT_NO_RESTART);
 }
@@ -825,6 +865,9 @@ connect_using_existing_connection(POOL_CONNECTION * frontend,
 		}
 	}
 
+	/* The connection is no longer a prewarmed one */
+	backend->prewarmed = false;
+
 	/* Reuse existing connection to backend */
 	frontend_auth_cxt = AllocSetContextCreate(CurrentMemoryContext,
 															"frontend_auth",
@@ -843,9 +886,16 @@ connect_using_existing_connection(POOL_CONNECTION * frontend,
 		/*
 		 * If we have received application_name in the start up packet, we
 		 * send SET command to backend. Also we add or replace existing
-		 * application_name data.
+		 * application_name data.  The command is not needed if the backend
+		 * already reported the same value, which is the usual case as the
+		 * startup packet of a reused connection is identical and the reset
+		 * queries restore the value given in it.
 		 */
-		if (sp->application_name)
+		if (sp->application_name && application_name_is_set(backend, sp->application_name))
+		{
+			set_application_name_with_string(sp->application_name);
+		}
+		else if (sp->application_name)
 		{
 			snprintf(command_buf, sizeof(command_buf), "SET application_name TO '%s'", sp->application_name);
 
@@ -903,15 +953,26 @@ connect_using_existing_connection(POOL_CONNECTION * frontend,
 	return true;
 }
 
+/*
+ * Returns true if the main node reported application_name with the given
+ * value in the last ParameterStatus message.
+ */
+static bool
+application_name_is_set(POOL_CONNECTION_POOL * backend, char *application_name)
+{
+	char	   *value;
+	int			pos;
+
+	value = pool_find_name(&MAIN(backend)->params, "application_name", &pos);
+	return value != NULL && strcmp(value, application_name) == 0;
+}
+
 /*
  * process cancel request
  */
 void
 cancel_request(CancelPacket * sp)
 {
-	int			len;
-	int			fd;
-	POOL_CONNECTION *con;
 	int			i,
 				j,
 				k;
@@ -926,7 +987,21 @@ cancel_request(CancelPacket * sp)
 	ereport(DEBUG1,
 			(errmsg("Cancel request received")));
 
-	/* look for cancel key from shmem info */
+	/* look for cancel key from the index first */
+	c = pool_coninfo_cancel_key(sp->pid, sp->key);
+	if (c)
+	{
+		ereport(DEBUG1,
+				(errmsg("processing cancel request"),
+				 errdetail("found pid:%d key:%d in cancel key index", ntohl(sp->pid), ntohl(sp->key))));
+		found = true;
+		goto found;
+	}
+
+	/*
+	 * The index may miss a connection if it had no room for it, so fall back
+	 * to searching the whole shmem info.
+	 */
 	for (i = 0; i < pool_config->num_init_children; i++)
 	{
 		for (j = 0; j < pool_config->max_pool; j++)
@@ -965,40 +1040,12 @@ found:
 		if (!VALID_BACKEND(i))
 			continue;
 
-		if (*(BACKEND_INFO(i).backend_hostname) == '/')
-			fd = connect_unix_domain_socket(i, TRUE);
-		else
-			fd = connect_inet_domain_socket(i, TRUE);
-
-		if (fd < 0)
-		{
-			ereport(LOG,
-					(errmsg("Could not create socket for sending cancel request for backend %d", i)));
-			return;
-		}
-
-		con = pool_open(fd, true);
-		if (con == NULL)
-			return;
-
-		pool_set_db_node_id(con, i);
-
-		len = htonl(sizeof(len) + sizeof(CancelPacket));
-		pool_write(con, &len, sizeof(len));
-
 		cp.protoVersion = sp->protoVersion;
 		cp.pid = c->pid;
 		cp.key = c->key;
 
-		ereport(LOG,
-				(errmsg("forwarding cancel request to backend"),
-				 errdetail("canceling backend pid:%d key: %d", ntohl(cp.pid), ntohl(cp.key))));
-
-		if (pool_write_and_flush_noerror(con, &cp, sizeof(CancelPacket)) < 0)
-			ereport(WARNING,
-					(errmsg("failed to send cancel request to backend %d", i)));
-
-		pool_close(con);
+		if (!pool_send_cancel_request(i, &cp))
+			return;
 
 		/*
 		 * this is needed to ensure that the next DB node executes the query
@@ -1008,6 +1055,51 @@ found:
 	}
 }
 
+/*
+ * Send a cancel request to a backend node.  The pid and the key in the
+ * packet are the ones of the backend.  Returns false if the node could not
+ * be connected to.
+ */
+bool
+pool_send_cancel_request(int node_id, CancelPacket * cp)
+{
+	int			len;
+	int			fd;
+	POOL_CONNECTION *con;
+
+	if (*(BACKEND_INFO(node_id).backend_hostname) == '/')
+		fd = connect_unix_domain_socket(node_id, TRUE);
+	else
+		fd = connect_inet_domain_socket(node_id, TRUE);
+
+	if (fd < 0)
+	{
+		ereport(LOG,
+				(errmsg("Could not create socket for sending cancel request for backend %d", node_id)));
+		return false;
+	}
+
+	con = pool_open(fd, true);
+	if (con == NULL)
+		return false;
+
+	pool_set_db_node_id(con, node_id);
+
+	len = htonl(sizeof(len) + sizeof(CancelPacket));
+	pool_write(con, &len, sizeof(len));
+
+	ereport(LOG,
+			(errmsg("forwarding cancel request to backend"),
+			 errdetail("canceling backend pid:%d key: %d", ntohl(cp->pid), ntohl(cp->key))));
+
+	if (pool_write_and_flush_noerror(con, cp, sizeof(CancelPacket)) < 0)
+		ereport(WARNING,
+				(errmsg("failed to send cancel request to backend %d", node_id)));
+
+	pool_close(con);
+	return true;
+}
+
 /*
  * Copy startup packet and return it.
  * palloc is used.
@@ -1287,34 +1379,19 @@ disable_authentication_timeout(void)
 }
 
 /*
- * Send parameter status message to frontend.
+ * Send parameter status message to frontend.  The messages are only put
+ * into the write buffer, so that the caller sends them together with
+ * ReadyForQuery.
  */
 static void
 send_params(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	int			index;
-	char	   *name,
-			   *value;
-	int			len,
-				sendlen;
-
-	index = 0;
-	while (pool_get_param(&MAIN(backend)->params, index++, &name, &value) == 0)
-	{
-		pool_write(frontend, "S", 1);
-		len = sizeof(sendlen) + strlen(name) + 1 + strlen(value) + 1;
-		sendlen = htonl(len);
-		pool_write(frontend, &sendlen, sizeof(sendlen));
-		pool_write(frontend, name, strlen(name) + 1);
-		pool_write(frontend, value, strlen(value) + 1);
-	}
+	char	   *messages;
+	int			len;
 
-	if (pool_flush(frontend))
-	{
-		ereport(ERROR,
-				(errmsg("unable to send params to frontend"),
-				 errdetail("pool_flush failed")));
-	}
+	messages = pool_get_param_messages(&MAIN(backend)->params, &len);
+	if (len > 0)
+		pool_write(frontend, messages, len);
 }
 
 /*
@@ -1335,6 +1412,7 @@ child_will_go_down(int code, Datum arg)
 	if (accepted)
 	{
 		connection_count_down();
+		stat_query_end_all();
 		if (pool_config->log_disconnections)
 		{
 			if (child_frontend)
@@ -1344,10 +1422,9 @@ child_will_go_down(int code, Datum arg)
 		}
 	}
 
-	if ((pool_config->memory_cache_enabled || pool_config->enable_shared_relcache)
-		&& !pool_is_shmem_cache())
+	if (pool_config->memory_cache_enabled && !pool_is_shmem_cache())
 	{
-		memcached_disconnect();
+		pool_cache_storage_disconnect();
 	}
 
 	/* let backend know now we are exiting */
@@ -1393,6 +1470,7 @@ connection_count_up(void)
 	POOL_SETMASK2(&BlockSig, &oldmask);
 	pool_semaphore_lock(CONN_COUNTER_SEM);
 	Req_info->conn_counter++;
+	Req_info->pm_info.total_accepted++;
 	elog(DEBUG5, "connection_count_up: number of connected children: %d", Req_info->conn_counter);
 	pool_semaphore_unlock(CONN_COUNTER_SEM);
 	POOL_SETMASK(&oldmask);
@@ -1420,6 +1498,7 @@ connection_count_down(void)
 	 */
 	if (Req_info->conn_counter > 0)
 		Req_info->conn_counter--;
+	pool_client_limit_release();
 	elog(DEBUG5, "connection_count_down: number of connected children: %d", Req_info->conn_counter);
 	pool_semaphore_unlock(CONN_COUNTER_SEM);
 	POOL_SETMASK(&oldmask);
@@ -1503,6 +1582,26 @@ check_exit_request(void)
 	}
 }
 
+/*
+ * Exit to be replaced by a new child if the memory of this child exceeds
+ * child_memory_limit.  Called after a session ends, once
+ * update_memory_usage() has recorded the memory.
+ */
+static void
+check_memory_limit(void)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+
+	if (pool_config->child_memory_limit > 0 &&
+		pi->memory_allocated > (size_t) pool_config->child_memory_limit * 1024)
+	{
+		ereport(LOG,
+				(errmsg("child exiting, memory usage %zu kB exceeds child_memory_limit %d kB",
+						pi->memory_allocated / 1024, pool_config->child_memory_limit)));
+		child_exit(POOL_EXIT_AND_RESTART);
+	}
+}
+
 static void
 check_restart_request(void)
 {
@@ -1523,18 +1622,17 @@ check_restart_request(void)
 
 /*
  * wait_for_new_connections()
- * functions calls select on sockets and wait for new client
+ * functions calls poll (or epoll_wait) on sockets and wait for new client
  * to connect, on successful connection returns the socket descriptor
  * and returns -1 if timeout has occurred
  */
 static int
 wait_for_new_connections(int *fds, SockAddr *saddr)
 {
-	fd_set		rmask;
 	int			numfds;
 	int			save_errno;
 
-	int			fd = 0;
+	int			fd = -1;
 	int			afd;
 	int		   *walk;
 	int			on;
@@ -1546,13 +1644,20 @@ wait_for_new_connections(int *fds, SockAddr *saddr)
 	static int	cnt;
 #endif
 
-	struct timeval *timeout;
-	struct timeval timeoutdata;
+	int			timeout;
+	int			i;
+	bool		serialize = SERIALIZE_ACCEPT;
+
+#ifdef USE_EXCLUSIVE_ACCEPT
+	/* The kernel serializes wakeups for us */
+	if (accept_epfd >= 0)
+		serialize = false;
+#endif
 
 	for (walk = fds; *walk != -1; walk++)
 		socket_set_nonblock(*walk);
 
-	if (SERIALIZE_ACCEPT)
+	if (serialize)
 		set_ps_display("wait for accept lock", false);
 	else
 		set_ps_display("wait for connection request", false);
@@ -1563,50 +1668,18 @@ wait_for_new_connections(int *fds, SockAddr *saddr)
 	 * If child life time is disabled and serialize_accept is on, we serialize
 	 * select() and accept() to avoid the "Thundering herd" problem.
 	 */
-	if (SERIALIZE_ACCEPT)
+	if (serialize)
 	{
-		if (pool_config->connection_life_time == 0)
-		{
-			pool_semaphore_lock(ACCEPT_FD_SEM);
-		}
-		else
+		/*
+		 * Wait for the lock no longer than until the first timer expires, so
+		 * that cached connections are closed in time.
+		 */
+		for (;;)
 		{
-			int sts;
+			if (pool_semaphore_lock_timeout(ACCEPT_FD_SEM, pool_timer_next_timeout(-1)) != -2)
+				break;	/* success or other error */
 
-			for (;;)
-			{
-				sts = pool_semaphore_lock_allow_interrupt(ACCEPT_FD_SEM);
-
-				/* Interrupted by alarm */
-				if (sts == -2)
-				{
-					/*
-					 * Check if there are expired connection_life_time.
-					 */
-					if (backend_timer_expired)
-					{
-						/*
-						 * We add 10 seconds to connection_life_time so that there's
-						 * enough margin.
-						 */
-						int	seconds = pool_config->connection_life_time + 10;
-
-						while (seconds-- > 0)
-						{
-							/* check backend timer is expired */
-							if (backend_timer_expired)
-							{
-								pool_backend_timer();
-								backend_timer_expired = 0;
-								break;
-							}
-							sleep(1);
-						}
-					}
-				}
-				else	/* success or other error */
-					break;
-			}
+			pool_timer_run_expired();
 		}
 
 		set_ps_display("wait for connection request", false);
@@ -1616,55 +1689,69 @@ wait_for_new_connections(int *fds, SockAddr *saddr)
 
 	for (;;)
 	{
-		/* check backend timer is expired */
-		if (backend_timer_expired)
-		{
-			pool_backend_timer();
-			backend_timer_expired = 0;
-		}
+		/* run expired timers */
+		pool_timer_run_expired();
 
-		/* prepare select */
-		memcpy((char *) &rmask, (char *) &readmask, sizeof(fd_set));
+		/* prepare poll */
+		for (i = 0; i < num_accept_fds; i++)
+			accept_pfds[i].revents = 0;
 		if (pool_config->child_life_time > 0)
-		{
-			timeoutdata.tv_sec = 1;
-			timeoutdata.tv_usec = 0;
-			timeout = &timeoutdata;
-		}
+			timeout = 1000;
 		else
+			timeout = -1;
+		timeout = pool_timer_next_timeout(timeout);
+		fd = -1;
+
+#ifdef USE_EXCLUSIVE_ACCEPT
+		if (accept_epfd >= 0)
 		{
-			timeout = NULL;
-		}
+			struct epoll_event event;
 
-		numfds = select(nsocks, &rmask, NULL, NULL, timeout);
+			/*
+			 * We always wake up at least once a second.  If the process
+			 * woken up for a connection exited before accepting it, nobody
+			 * else would be woken up for it, so look at the listening
+			 * sockets by ourselves on timeout.
+			 */
+			numfds = epoll_wait(accept_epfd, &event, 1, pool_timer_next_timeout(1000));
+			if (numfds > 0)
+				fd = event.data.fd;
+			else if (numfds == 0)
+				numfds = poll(accept_pfds, num_accept_fds, 0);
+		}
+		else
+#endif
+			numfds = poll(accept_pfds, num_accept_fds, timeout);
 
 		/* not timeout*/
 		if (numfds != 0)
 			break;
 
-		/* timeout */
-		pool_get_my_process_info()->wait_for_connect++;
+		/* woken up for a timer, which is run at the top of the loop */
+		if (pool_timer_next_timeout(-1) == 0)
+			continue;
 
-		if (pool_get_my_process_info()->wait_for_connect > pool_config->child_life_time)
-			return OPERATION_TIMEOUT;
+		/* timeout */
+		if (pool_config->child_life_time > 0)
+		{
+			pool_get_my_process_info()->wait_for_connect++;
 
+			if (pool_get_my_process_info()->wait_for_connect > pool_config->child_life_time)
+				return OPERATION_TIMEOUT;
+		}
 	}
 
 	save_errno = errno;
 
-	if (SERIALIZE_ACCEPT)
+	if (serialize)
 	{
 		pool_semaphore_unlock(ACCEPT_FD_SEM);
 		ereport(DEBUG1,
 				(errmsg("UNLOCKING select()")));
 	}
 
-	/* check backend timer is expired */
-	if (backend_timer_expired)
-	{
-		pool_backend_timer();
-		backend_timer_expired = 0;
-	}
+	/* run expired timers */
+	pool_timer_run_expired();
 
 	errno = save_errno;
 
@@ -1674,17 +1761,16 @@ wait_for_new_connections(int *fds, SockAddr *saddr)
 			return RETRY;
 		ereport(ERROR,
 				(errmsg("failed to accept user connection"),
-				 errdetail("select on socket failed with error : \"%m\"")));
+				 errdetail("waiting on socket failed with error : \"%m\"")));
 	}
 
-	for (walk = fds; *walk != -1; walk++)
+	for (i = 0; fd < 0 && i < num_accept_fds; i++)
 	{
-		if (FD_ISSET(*walk, &rmask))
-		{
-			fd = *walk;
-			break;
-		}
+		if (accept_pfds[i].revents & POOL_POLL_READ_EVENTS)
+			fd = accept_pfds[i].fd;
 	}
+	if (fd < 0)
+		return RETRY;
 
 	/*
 	 * Note that some SysV systems do not work here. For those systems, we
@@ -1713,12 +1799,8 @@ retry_accept:
 	afd = accept(fd, (struct sockaddr *) &saddr->addr, &saddr->salen);
 
 	save_errno = errno;
-	/* check backend timer is expired */
-	if (backend_timer_expired)
-	{
-		pool_backend_timer();
-		backend_timer_expired = 0;
-	}
+	/* run expired timers */
+	pool_timer_run_expired();
 	errno = save_errno;
 	if (afd < 0)
 	{
@@ -1741,7 +1823,7 @@ retry_accept:
 	 * Set no delay if AF_INET socket. Not sure if this is really necessary
 	 * but PostgreSQL does this.
 	 */
-	if (unix_fds_not_isset(fds, pool_config->num_unix_socket_directories, &rmask))
+	if (!is_unix_fd(fds, pool_config->num_unix_socket_directories, fd))
 	{
 		on = 1;
 		if (setsockopt(afd, IPPROTO_TCP, TCP_NODELAY,
@@ -1772,37 +1854,103 @@ retry_accept:
 	return afd;
 }
 
+#ifdef USE_EXCLUSIVE_ACCEPT
+/*
+ * Create an epoll instance watching the listening sockets with
+ * EPOLLEXCLUSIVE.  This must be done in each child process since the wait
+ * queue entries belong to the epoll instance.  Returns the epoll file
+ * descriptor, or -1 if EPOLLEXCLUSIVE is not available (Linux older than
+ * 4.5), in which case the accept semaphore is used instead.
+ */
+static int
+create_accept_epoll(int *fds)
+{
+	int			epfd;
+	int		   *walk;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+	{
+		ereport(LOG,
+				(errmsg("could not create epoll instance for accepting connections"),
+				 errdetail("epoll_create1() failed: \"%m\"")));
+		return -1;
+	}
+
+	for (walk = fds; *walk != -1; walk++)
+	{
+		struct epoll_event event;
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLEXCLUSIVE;
+		event.data.fd = *walk;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, *walk, &event) < 0)
+		{
+			ereport(DEBUG1,
+					(errmsg("EPOLLEXCLUSIVE is not available, using accept semaphore"),
+					 errdetail("epoll_ctl() failed: \"%m\"")));
+			close(epfd);
+			return -1;
+		}
+	}
+
+	return epfd;
+}
+#endif
+
+/*
+ * Return true if fd is one of the UNIX domain listening sockets, which are
+ * placed at the head of fds.
+ */
 static bool
-unix_fds_not_isset(int* fds, int num_unix_fds, fd_set* opt)
+is_unix_fd(int *fds, int num_unix_fds, int fd)
 {
-	int		i;
+	int			i;
+
 	for (i = 0; i < num_unix_fds; i++)
 	{
-		if (!FD_ISSET(fds[i], opt))
-			continue;
-
-		return false;
+		if (fds[i] == fd)
+			return true;
 	}
-	return true;
+	return false;
 }
 
-static void
+/*
+ * Reload the configuration after SIGHUP.  The main process has already
+ * parsed the files and published the result in shared memory; we only
+ * read the files ourselves if that snapshot is not usable.
+ */
+void
 check_config_reload(void)
 {
 	/* reload config file */
 	if (got_sighup)
 	{
 		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+		ConfigSnapshotResult result;
+		char	   *hba_text;
+		size_t		hba_len;
+
+		got_sighup = 0;
+
+		result = pool_config_snapshot_apply(&hba_text, &hba_len);
+		if (result == CONFIG_SNAPSHOT_NONE)
+			pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
 
-		pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
-		MemoryContextSwitchTo(oldContext);
 		if (pool_config->enable_pool_hba)
 		{
-			load_hba(get_hba_file_name());
+			if (result == CONFIG_SNAPSHOT_NONE ||
+				(result == CONFIG_SNAPSHOT_APPLIED && hba_text == NULL))
+				load_hba(get_hba_file_name());
+			else if (result == CONFIG_SNAPSHOT_APPLIED)
+				load_hba_text(get_hba_file_name(), hba_text, hba_len);
 			if (strcmp("", pool_config->pool_passwd))
 				pool_reopen_passwd_file();
 		}
-		got_sighup = 0;
+		if (hba_text)
+			pfree(hba_text);
+		MemoryContextSwitchTo(oldContext);
 	}
 }
 
@@ -2031,6 +2179,8 @@ retry_startup:
 		MemoryContextDelete(frontend_auth_cxt);
 	}
 
+	pool_client_limit_admit(frontend);
+
 	/*
 	 * Ok, negotiation with frontend has been done. Let's go to the next step.
 	 * Connect to backend if there's no existing connection which can be
@@ -2053,6 +2203,12 @@ retry_startup:
 		pool_initialize_private_backend_status();
 	}
 
+	/*
+	 * Close pooled connections to backends which went down while this
+	 * process was kept alive by failover_keep_sessions.
+	 */
+	pool_discard_down_node_connections(NULL);
+
 	/*
 	 * if there's no connection associated with user and database, we need to
 	 * connect to the backend and send the startup packet.
@@ -2072,7 +2228,17 @@ retry_startup:
 		 * however we should make sure that the startup packet contents are
 		 * identical. OPTION data and others might be different.
 		 */
-		if (sp->len != MAIN_CONNECTION(backend)->sp->len)
+		if (backend->prewarmed)
+		{
+			if (!startup_packet_matches_prewarmed(sp, MAIN_CONNECTION(backend)->sp))
+			{
+				ereport(DEBUG1,
+						(errmsg("selecting backend connection"),
+						 errdetail("prewarmed connection exists but startup packet contents is not compatible")));
+				found = 0;
+			}
+		}
+		else if (sp->len != MAIN_CONNECTION(backend)->sp->len)
 		{
 			ereport(DEBUG1,
 					(errmsg("selecting backend connection"),
@@ -2118,6 +2284,47 @@ retry_startup:
 	return backend;
 }
 
+/*
+ * Return true if the startup packet sent by the client is the same as the
+ * one of a prewarmed connection, except for application_name which
+ * connect_using_existing_connection() sets by itself.  Both packets have
+ * their options sorted by read_startup_packet() and
+ * pool_prewarm_connections().
+ */
+static bool
+startup_packet_matches_prewarmed(StartupPacket *sp, StartupPacket *prewarmed_sp)
+{
+	char	   *p;
+	char	   *q;
+
+	/* protocol version */
+	if (memcmp(sp->startup_packet, prewarmed_sp->startup_packet, sizeof(int)) != 0)
+		return false;
+
+	p = sp->startup_packet + sizeof(int);
+	q = prewarmed_sp->startup_packet + sizeof(int);
+
+	while (*p)
+	{
+		char	   *name = p;
+		char	   *value = p + strlen(p) + 1;
+
+		p = value + strlen(value) + 1;
+
+		if (!strcmp(name, "application_name"))
+			continue;
+
+		if (*q == '\0' || strcmp(name, q) != 0)
+			return false;
+		q += strlen(q) + 1;
+		if (strcmp(value, q) != 0)
+			return false;
+		q += strlen(q) + 1;
+	}
+
+	return *q == '\0';
+}
+
 static void
 log_disconnections(char *database, char *username)
 {
@@ -0,0 +1,529 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_client_limit.c: limits on the clients of each user and database.
+ *
+ * The number of connected clients is counted when a client connects, under
+ * CONN_COUNTER_SEM like the total connection counter.  The number of
+ * running queries and the number of queries started in the current second
+ * are counted with atomic operations on the slot of the user and of the
+ * database, which the child looks up once per session, so starting a
+ * query takes no lock.  Heavy queries sent to heavy_query_nodes are counted
+ * the same way against max_heavy_queries, and the queries sent to each
+ * backend node against max_active_queries_per_node.  Cached connections
+ * closed by connection_life_time are counted per second against
+ * max_connection_recycles_per_second.
+ *
+ * What a child is counted in is recorded in its process_info entry, and
+ * taken back by the main process if the child dies without doing it
+ * itself, e.g. killed by SIGKILL or crashed.
+ */
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "protocol/pool_client_limit.h"
+#include "protocol/pool_process_query.h"
+#include "context/pool_process_context.h"
+#include "utils/pool_ipc.h"
+#include "utils/pool_signal.h"
+#include "utils/statistics.h"
+#include "utils/elog.h"
+
+/* interval of checking the limits while waiting, in microseconds */
+#define QUERY_LIMIT_WAIT_INTERVAL	10000
+
+static ClientLimitSlot *user_slots;
+static ClientLimitSlot *database_slots;
+static pool_atomic_uint32 *heavy_queries;	/* # of heavy queries running */
+static pool_atomic_uint32 *node_queries;	/* # of queries running on each
+											 * backend node */
+static pool_atomic_uint64 *recycle_rate;	/* second in the upper 32 bits, #
+											 * of connections recycled in the
+											 * second in the lower 32 */
+
+static ClientLimitSlot *get_slot(ClientLimitSlot * slots, char *name);
+static void release_counts(ProcessInfo * pi);
+static bool acquire_active(ClientLimitSlot * slot, int limit);
+static bool acquire_count(pool_atomic_uint32 * count, int limit);
+static bool acquire_rate(ClientLimitSlot * slot, int limit, uint32 now);
+static bool acquire_rate_count(pool_atomic_uint64 * count, int limit, uint32 now);
+
+/*
+ * Return byte size of the limit slots on shmem.
+ */
+size_t
+pool_client_limit_shmem_size(void)
+{
+	return MAXALIGN(sizeof(ClientLimitSlot) * pool_config->num_init_children * 2) +
+		MAXALIGN(sizeof(pool_atomic_uint32)) +
+		MAXALIGN(sizeof(pool_atomic_uint32) * MAX_NUM_BACKENDS) +
+		MAXALIGN(sizeof(pool_atomic_uint64));
+}
+
+/*
+ * Set up the limit slots in the shmem area of pool_client_limit_shmem_size()
+ * bytes.
+ */
+void
+pool_client_limit_shmem_init(void *area)
+{
+	user_slots = (ClientLimitSlot *) area;
+	database_slots = user_slots + pool_config->num_init_children;
+	heavy_queries = (pool_atomic_uint32 *) ((char *) area +
+											MAXALIGN(sizeof(ClientLimitSlot) * pool_config->num_init_children * 2));
+	node_queries = (pool_atomic_uint32 *) ((char *) heavy_queries +
+										   MAXALIGN(sizeof(pool_atomic_uint32)));
+	recycle_rate = (pool_atomic_uint64 *) ((char *) node_queries +
+										   MAXALIGN(sizeof(pool_atomic_uint32) * MAX_NUM_BACKENDS));
+	memset(area, 0, pool_client_limit_shmem_size());
+}
+
+/*
+ * Initialize the record of the counts of a child in its process_info
+ * entry.
+ */
+void
+pool_client_limit_init_process(ProcessInfo * pi)
+{
+	pi->limit_user_slot = -1;
+	pi->limit_database_slot = -1;
+	pi->limit_query_active = false;
+	pi->limit_heavy_query_active = false;
+	memset(pi->limit_node_query_active, 0, sizeof(pi->limit_node_query_active));
+}
+
+/*
+ * Called by the main process when the child of the process_info entry has
+ * exited.  Take back what the child was still counted in.
+ */
+void
+pool_client_limit_release_dead_process(ProcessInfo * pi)
+{
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(CONN_COUNTER_SEM);
+	release_counts(pi);
+	pool_semaphore_unlock(CONN_COUNTER_SEM);
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Count a new client in the slots of its user and database.  If the
+ * client would exceed max_connections_per_user or
+ * max_connections_per_database, refuse it instead so that the child is
+ * freed for other clients.
+ */
+void
+pool_client_limit_admit(POOL_CONNECTION * frontend)
+{
+	pool_sigset_t oldmask;
+	ProcessInfo *pi = pool_get_my_process_info();
+	ClientLimitSlot *user_slot;
+	ClientLimitSlot *database_slot;
+	char	   *limit_name = NULL;
+	int			limit = 0;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(CONN_COUNTER_SEM);
+
+	user_slot = get_slot(user_slots, frontend->username);
+	database_slot = get_slot(database_slots, frontend->database);
+
+	if (pool_config->max_connections_per_user > 0 &&
+		user_slot->sessions >= pool_config->max_connections_per_user)
+	{
+		limit_name = "max_connections_per_user";
+		limit = pool_config->max_connections_per_user;
+	}
+	else if (pool_config->max_connections_per_database > 0 &&
+			 database_slot->sessions >= pool_config->max_connections_per_database)
+	{
+		limit_name = "max_connections_per_database";
+		limit = pool_config->max_connections_per_database;
+	}
+	else
+	{
+		user_slot->sessions++;
+		database_slot->sessions++;
+		pi->limit_user_slot = user_slot - user_slots;
+		pi->limit_database_slot = database_slot - database_slots;
+		pi->limit_query_active = false;
+	}
+
+	pool_semaphore_unlock(CONN_COUNTER_SEM);
+	POOL_SETMASK(&oldmask);
+
+	if (limit_name)
+	{
+		pool_send_fatal_message(frontend, frontend->protoVersion, "53300",
+								"too many connections for user or database",
+								"",
+								"",
+								__FILE__, __LINE__);
+		ereport(ERROR,
+				(errcode(ERRCODE_TOO_MANY_CONNECTIONS),
+				 errmsg("too many connections for user \"%s\" database \"%s\"",
+						frontend->username, frontend->database),
+				 errdetail("%s (%d) exceeded", limit_name, limit)));
+	}
+}
+
+/*
+ * Forget the client of this process.  The caller must hold
+ * CONN_COUNTER_SEM.
+ */
+void
+pool_client_limit_release(void)
+{
+	release_counts(pool_get_my_process_info());
+}
+
+/*
+ * Called before a query of the client is sent to backends.  Count the
+ * query against max_queries_per_second_per_user/database and, unless it
+ * is already counted since the last ReadyForQuery,
+ * max_active_queries_per_user/database.
+ *
+ * If a limit is reached, wait until the query fits in, or return false if
+ * query_limit_action is reject and the caller can reject the query.  A
+ * query in a transaction block never waits for max_active_queries_* since
+ * the running queries it would wait for may be waiting for its locks.
+ */
+bool
+pool_client_limit_begin_query(POOL_CONNECTION_POOL * backend, bool can_reject)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	ClientLimitSlot *my_user_slot;
+	ClientLimitSlot *my_database_slot;
+	bool		count_active = !pi->limit_query_active;
+
+	if (pi->limit_user_slot < 0)
+		return true;
+
+	my_user_slot = &user_slots[pi->limit_user_slot];
+	my_database_slot = &database_slots[pi->limit_database_slot];
+
+	for (;;)
+	{
+		uint32		now = (uint32) time(NULL);
+		bool		in_transaction = TSTATE(backend, MAIN_NODE_ID) != 'I';
+
+		if (count_active)
+		{
+			if (!acquire_active(my_user_slot, pool_config->max_active_queries_per_user))
+			{
+				if (!in_transaction)
+					goto limited;
+				pool_atomic_fetch_add_u32(&my_user_slot->active, 1);
+			}
+
+			if (!acquire_active(my_database_slot, pool_config->max_active_queries_per_database))
+			{
+				if (!in_transaction)
+				{
+					pool_atomic_fetch_sub_u32(&my_user_slot->active, 1);
+					goto limited;
+				}
+				pool_atomic_fetch_add_u32(&my_database_slot->active, 1);
+			}
+		}
+
+		if (acquire_rate(my_user_slot, pool_config->max_queries_per_second_per_user, now) &&
+			acquire_rate(my_database_slot, pool_config->max_queries_per_second_per_database, now))
+		{
+			if (count_active)
+				pi->limit_query_active = true;
+			return true;
+		}
+
+		if (count_active)
+		{
+			pool_atomic_fetch_sub_u32(&my_user_slot->active, 1);
+			pool_atomic_fetch_sub_u32(&my_database_slot->active, 1);
+		}
+
+limited:
+		if (pool_config->query_limit_action == QLA_REJECT && can_reject)
+			return false;
+
+		usleep(QUERY_LIMIT_WAIT_INTERVAL);
+	}
+}
+
+/*
+ * Called when ReadyForQuery is received.
+ */
+void
+pool_client_limit_end_query(void)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	int			i;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		if (pi->limit_node_query_active[i])
+		{
+			pool_atomic_fetch_sub_u32(&node_queries[i], 1);
+			pi->limit_node_query_active[i] = false;
+		}
+	}
+
+	if (pi->limit_heavy_query_active)
+	{
+		pool_atomic_fetch_sub_u32(heavy_queries, 1);
+		pi->limit_heavy_query_active = false;
+	}
+
+	if (!pi->limit_query_active)
+		return;
+
+	pool_atomic_fetch_sub_u32(&user_slots[pi->limit_user_slot].active, 1);
+	pool_atomic_fetch_sub_u32(&database_slots[pi->limit_database_slot].active, 1);
+	pi->limit_query_active = false;
+}
+
+/*
+ * Called before a heavy query, one routed to heavy_query_nodes, is sent.
+ * Wait until it fits in max_heavy_queries.  The query is counted until
+ * the next ReadyForQuery.
+ */
+void
+pool_client_limit_begin_heavy_query(void)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+
+	if (pi->limit_heavy_query_active || pool_config->max_heavy_queries <= 0)
+		return;
+
+	while (!acquire_count(heavy_queries, pool_config->max_heavy_queries))
+		usleep(QUERY_LIMIT_WAIT_INTERVAL);
+
+	pi->limit_heavy_query_active = true;
+}
+
+/*
+ * Called before a query is sent to the backend node.  Wait until it fits
+ * in max_active_queries_per_node, and add the time waited to the queue
+ * wait histogram of the node.  The query is counted until the next
+ * ReadyForQuery.
+ *
+ * Since the running queries may be waiting for locks of our transaction,
+ * a query in a transaction block is counted but does not wait.  Neither
+ * does a query while we hold a node of a higher or the same id, so that
+ * two processes sending to several nodes never wait for each other.
+ */
+void
+pool_client_limit_begin_node_query(POOL_CONNECTION_POOL * backend, int node_id)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	struct timeval start;
+	struct timeval now;
+	int64		elapsed;
+	int			limit = pool_config->max_active_queries_per_node;
+	int			i;
+
+	if (pi->limit_node_query_active[node_id] || limit <= 0)
+		return;
+
+	if (TSTATE(backend, node_id) != 'I')
+		limit = 0;
+	for (i = node_id + 1; i < MAX_NUM_BACKENDS; i++)
+	{
+		if (pi->limit_node_query_active[i])
+			limit = 0;
+	}
+
+	gettimeofday(&start, NULL);
+	while (!acquire_count(&node_queries[node_id], limit))
+		usleep(QUERY_LIMIT_WAIT_INTERVAL);
+	gettimeofday(&now, NULL);
+
+	elapsed = (int64) (now.tv_sec - start.tv_sec) * 1000000 +
+		(now.tv_usec - start.tv_usec);
+	stat_queue_wait(node_id, elapsed < 0 ? 0 : elapsed);
+	pi->limit_node_query_active[node_id] = true;
+}
+
+/*
+ * Like pool_client_limit_begin_node_query() but return false instead of
+ * waiting if the node is at max_active_queries_per_node.
+ */
+bool
+pool_client_limit_try_node_query(int node_id)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+
+	if (pi->limit_node_query_active[node_id] || pool_config->max_active_queries_per_node <= 0)
+		return true;
+
+	if (!acquire_count(&node_queries[node_id], pool_config->max_active_queries_per_node))
+		return false;
+
+	stat_queue_wait(node_id, 0);
+	pi->limit_node_query_active[node_id] = true;
+	return true;
+}
+
+/*
+ * Called before a cached connection expired by connection_life_time is
+ * closed.  Returns false if max_connection_recycles_per_second connections
+ * have already been closed in this second, in which case the connection
+ * should be kept until later.
+ */
+bool
+pool_client_limit_try_recycle(void)
+{
+	return acquire_rate_count(recycle_rate, pool_config->max_connection_recycles_per_second,
+							  (uint32) time(NULL));
+}
+
+/*
+ * Find the slot of the name, or take a free one.  There is always a free
+ * slot since a table has as many slots as the clients.  The caller must
+ * hold CONN_COUNTER_SEM.
+ */
+static ClientLimitSlot *
+get_slot(ClientLimitSlot * slots, char *name)
+{
+	ClientLimitSlot *free_slot = NULL;
+	int			i;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (slots[i].sessions <= 0)
+		{
+			if (free_slot == NULL)
+				free_slot = &slots[i];
+		}
+		else if (strncmp(slots[i].name, name, sizeof(slots[i].name) - 1) == 0)
+			return &slots[i];
+	}
+
+	if (free_slot == NULL)
+		ereport(ERROR,
+				(errmsg("unable to find a free client limit slot")));
+
+	strlcpy(free_slot->name, name, sizeof(free_slot->name));
+	free_slot->sessions = 0;
+	pool_atomic_write_u32(&free_slot->active, 0);
+	pool_atomic_write_u64(&free_slot->rate, 0);
+	return free_slot;
+}
+
+/*
+ * Take back all the counts recorded in the process_info entry.  The caller
+ * must hold CONN_COUNTER_SEM.
+ */
+static void
+release_counts(ProcessInfo * pi)
+{
+	int			i;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		if (pi->limit_node_query_active[i])
+			pool_atomic_fetch_sub_u32(&node_queries[i], 1);
+	}
+	if (pi->limit_heavy_query_active)
+		pool_atomic_fetch_sub_u32(heavy_queries, 1);
+
+	if (pi->limit_user_slot >= 0)
+	{
+		ClientLimitSlot *user_slot = &user_slots[pi->limit_user_slot];
+		ClientLimitSlot *database_slot = &database_slots[pi->limit_database_slot];
+
+		if (pi->limit_query_active)
+		{
+			pool_atomic_fetch_sub_u32(&user_slot->active, 1);
+			pool_atomic_fetch_sub_u32(&database_slot->active, 1);
+		}
+		user_slot->sessions--;
+		database_slot->sessions--;
+	}
+
+	pool_client_limit_init_process(pi);
+}
+
+/*
+ * Count a running query in the slot unless it would exceed the limit.
+ */
+static bool
+acquire_active(ClientLimitSlot * slot, int limit)
+{
+	return acquire_count(&slot->active, limit);
+}
+
+/*
+ * Count one more in the counter unless it would exceed the limit.
+ */
+static bool
+acquire_count(pool_atomic_uint32 * count, int limit)
+{
+	uint32		value = pool_atomic_fetch_add_u32(count, 1);
+
+	if (limit > 0 && value >= limit)
+	{
+		pool_atomic_fetch_sub_u32(count, 1);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Count a query started in second "now" in the slot unless it would exceed
+ * the limit.
+ */
+static bool
+acquire_rate(ClientLimitSlot * slot, int limit, uint32 now)
+{
+	return acquire_rate_count(&slot->rate, limit, now);
+}
+
+/*
+ * Count one more in the per second counter, the second in the upper 32
+ * bits and the count in the lower 32, unless it would exceed the limit.
+ */
+static bool
+acquire_rate_count(pool_atomic_uint64 * count, int limit, uint32 now)
+{
+	uint64		rate;
+	uint64		new_rate;
+
+	if (limit <= 0)
+		return true;
+
+	rate = pool_atomic_read_u64(count);
+	for (;;)
+	{
+		if ((uint32) (rate >> 32) != now)
+			new_rate = ((uint64) now << 32) | 1;
+		else if ((uint32) rate >= limit)
+			return false;
+		else
+			new_rate = rate + 1;
+
+		if (pool_atomic_compare_exchange_u64(count, &rate, new_rate))
+			return true;
+	}
+}
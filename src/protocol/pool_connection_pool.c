@@ -44,7 +44,9 @@
 
 #include "pool.h"
 #include "context/pool_query_context.h"
+#include "context/pool_session_context.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_ssl.h"
 #include "utils/palloc.h"
 #include "pool_config.h"
 #include "utils/elog.h"
@@ -52,24 +54,53 @@
 #include "protocol/pool_connection_pool.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_prepared_statement.h"
+#include "protocol/pool_client_limit.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
+#include "auth/pool_auth.h"
+#include "auth/pool_passwd.h"
+#include "utils/xxhash.h"
+#include "utils/pool_trace.h"
+#include "utils/pool_timer.h"
+#include "utils/pool_ip.h"
 
 
 #include "context/pool_process_context.h"
 
 static int	pool_index;			/* Active pool index */
+
+static bool prepare_session_reattach(POOL_CONNECTION_POOL * backend, int lb_node);
+static bool replay_parse(POOL_CONNECTION_POOL * backend, int node, POOL_SENT_MESSAGE * msg);
+
+/*
+ * Whether the host name of each backend is an address of this host.  Cached
+ * by the process since finding out costs a DNS lookup.
+ */
+static struct
+{
+	char		hostname[MAX_DB_HOST_NAMELEN];	/* host name checked */
+	bool		local;
+}			local_backends[MAX_NUM_BACKENDS];
 POOL_CONNECTION_POOL *pool_connection_pool; /* connection pool */
-volatile sig_atomic_t backend_timer_expired = 0;	/* flag for connection
-													 * closed timer is expired */
 volatile sig_atomic_t health_check_timer_expired;	/* non 0 if health check
 													 * timer expired */
-static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int slot);
+static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int slot, int fd);
+static int	start_inet_connect(struct addrinfo **addr);
 static POOL_CONNECTION_POOL * new_connection(POOL_CONNECTION_POOL * p);
 static int	check_socket_status(int fd);
 static bool connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool retry);
+static bool prewarm_cp(char *user, char *database);
+static StartupPacket *make_prewarm_startup_packet(char *user, char *database);
+static uint32 pool_cp_hashkey(char *user, char *database, int protoMajor);
 
 #define TMINTMAX 0x7fffffff
 
+/* seconds between checks of prewarm_connections by an idle child */
+#define PREWARM_CHECK_INTERVAL 1
+/* seconds to wait before retrying prewarm_connections after a failure */
+#define PREWARM_RETRY_INTERVAL 10
+
 /*
 * initialize connection pools. this should be called once at the startup.
 */
@@ -104,6 +135,7 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 	ConnectionInfo *info;
 
 	POOL_CONNECTION_POOL *connection_pool = pool_connection_pool;
+	uint32		hashkey;
 
 	if (connection_pool == NULL)
 	{
@@ -114,11 +146,30 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 				 errdetail("connection pool is not initialized")));
 	}
 
+	TRACE_PGPOOL_POOL_GET_START(user, database);
+
+	hashkey = pool_cp_hashkey(user, database, protoMajor);
+
 	POOL_SETMASK2(&BlockSig, &oldmask);
 
 	for (i = 0; i < pool_config->max_pool; i++)
 	{
-		if (MAIN_CONNECTION(connection_pool) &&
+		/*
+		 * Compute the hash of the pool lazily: the startup packet is filled
+		 * in after the pool was created.  Every place that releases a pool
+		 * clears the whole struct, which resets hashkey as well.
+		 */
+		if (connection_pool->hashkey == 0 &&
+			MAIN_CONNECTION(connection_pool) &&
+			MAIN_CONNECTION(connection_pool)->sp &&
+			MAIN_CONNECTION(connection_pool)->sp->user != NULL)
+			connection_pool->hashkey =
+				pool_cp_hashkey(MAIN_CONNECTION(connection_pool)->sp->user,
+								MAIN_CONNECTION(connection_pool)->sp->database,
+								MAIN_CONNECTION(connection_pool)->sp->major);
+
+		if (connection_pool->hashkey == hashkey &&
+			MAIN_CONNECTION(connection_pool) &&
 			MAIN_CONNECTION(connection_pool)->sp &&
 			MAIN_CONNECTION(connection_pool)->sp->major == protoMajor &&
 			MAIN_CONNECTION(connection_pool)->sp->user != NULL &&
@@ -191,17 +242,20 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 					info->swallow_termination = 0;
 					memset(connection_pool->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
 					POOL_SETMASK(&oldmask);
+					TRACE_PGPOOL_POOL_GET_DONE(0);
 					return NULL;
 				}
 			}
 			POOL_SETMASK(&oldmask);
 			pool_index = i;
+			TRACE_PGPOOL_POOL_GET_DONE(1);
 			return connection_pool;
 		}
 		connection_pool++;
 	}
 
 	POOL_SETMASK(&oldmask);
+	TRACE_PGPOOL_POOL_GET_DONE(0);
 	return NULL;
 }
 
@@ -318,6 +372,7 @@ pool_create_cp(void)
 	if (main_node_id < 0)
 		elog(ERROR, "no in use backend found");	/* this should not happen */
 	pool_send_frontend_exits(p);
+	pool_get_my_process_info()->pool_evictions++;
 
 	ereport(DEBUG1,
 			(errmsg("creating connection pool"),
@@ -358,52 +413,54 @@ pool_create_cp(void)
 void
 pool_connection_pool_timer(POOL_CONNECTION_POOL * backend)
 {
-	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	time_t		closetime = time(NULL);
+	int			life_time = pool_config->connection_life_time;
+	int64		timeout;
 	int			i;
 
+	/*
+	 * Take a random part of connection_life_time_jitter off the life time of
+	 * the connection by moving its close time back, so that the connections
+	 * of children started together do not expire together.
+	 */
+	if (life_time > 0 && pool_config->connection_life_time_jitter > 0)
+	{
+		int			jitter = (int) ((int64) life_time * pool_config->connection_life_time_jitter / 100);
+
+		if (jitter > 0)
+		{
+			jitter = random() % (jitter + 1);
+			closetime -= jitter;
+			life_time -= jitter;
+		}
+	}
+
 	ereport(DEBUG1,
 			(errmsg("setting backend connection close timer"),
-			 errdetail("close time %ld", time(NULL))));
+			 errdetail("close time %ld", closetime)));
 
 	/* Set connection close time */
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		if (CONNECTION_SLOT(backend, i))
-			CONNECTION_SLOT(backend, i)->closetime = time(NULL);
+			CONNECTION_SLOT(backend, i)->closetime = closetime;
 	}
 
 	if (pool_config->connection_life_time == 0)
 		return;
 
-	/* look for any other timeout */
-	for (i = 0; i < pool_config->max_pool; i++, p++)
-	{
-		if (!MAIN_CONNECTION(p))
-			continue;
-		if (!MAIN_CONNECTION(p)->sp)
-			continue;
-		if (MAIN_CONNECTION(p)->sp->user == NULL)
-			continue;
-
-		if (p != backend && MAIN_CONNECTION(p)->closetime)
-			return;
-	}
+	/* keep the timer of another connection expiring earlier */
+	if (life_time <= 0)
+		life_time = 1;
+	timeout = pool_timer_remaining(POOL_TIMER_CONNECTION_LIFE_TIME);
+	if (timeout >= 0 && timeout <= (int64) life_time * 1000)
+		return;
 
-	/* no other timer found. set my timer */
 	ereport(DEBUG1,
 			(errmsg("setting backend connection close timer"),
-			 errdetail("setting alarm after %d seconds", pool_config->connection_life_time)));
+			 errdetail("setting timer after %d seconds", life_time)));
 
-	pool_alarm(pool_backend_timer_handler, pool_config->connection_life_time);
-}
-
-/*
- * backend connection close timer handler
- */
-RETSIGTYPE
-pool_backend_timer_handler(int sig)
-{
-	backend_timer_expired = 1;
+	pool_timer_set(POOL_TIMER_CONNECTION_LIFE_TIME, (int64) life_time * 1000, pool_backend_timer);
 }
 
 void
@@ -442,7 +499,12 @@ pool_backend_timer(void)
 					 errdetail("expire time: %ld",
 							   MAIN_CONNECTION(p)->closetime + pool_config->connection_life_time)));
 
-			if (now >= (MAIN_CONNECTION(p)->closetime + pool_config->connection_life_time))
+			/*
+			 * An expired connection over max_connection_recycles_per_second
+			 * is kept until the next round a second later.
+			 */
+			if (now >= (MAIN_CONNECTION(p)->closetime + pool_config->connection_life_time) &&
+				pool_client_limit_try_recycle())
 			{
 				/* discard expired connection */
 				ereport(DEBUG1,
@@ -485,14 +547,16 @@ pool_backend_timer(void)
 		nearest = pool_config->connection_life_time - (now - nearest);
 		if (nearest <= 0)
 			nearest = 1;
-		pool_alarm(pool_backend_timer_handler, nearest);
+		pool_timer_set(POOL_TIMER_CONNECTION_LIFE_TIME, (int64) nearest * 1000, pool_backend_timer);
 	}
 	update_pooled_connection_count();
 	POOL_SETMASK(&UnBlockSig);
 }
 
 /*
- * connect to postmaster through INET domain socket
+ * connect to postmaster through INET domain socket.  If the backend runs on
+ * this host and backend_local_socket_dir is set, try its UNIX domain socket
+ * first.
  */
 int
 connect_inet_domain_socket(int slot, bool retry)
@@ -503,9 +567,127 @@ connect_inet_domain_socket(int slot, bool retry)
 	host = pool_config->backend_desc->backend_info[slot].backend_hostname;
 	port = pool_config->backend_desc->backend_info[slot].backend_port;
 
+	if (pool_backend_is_local(slot))
+	{
+		int			fd;
+
+		fd = connect_unix_domain_socket_by_port(port, pool_config->backend_local_socket_dir, retry);
+		if (fd >= 0)
+			return fd;
+		ereport(LOG,
+				(errmsg("falling back to connect to local backend %d by INET domain socket", slot)));
+	}
+
 	return connect_inet_domain_socket_by_port(host, port, retry);
 }
 
+/*
+ * pg_foreach_ifaddr() callback: set *cb_data to true if the address is the
+ * one looked for.
+ */
+static void
+local_address_callback(struct sockaddr *addr, struct sockaddr *netmask, void *cb_data)
+{
+	struct addrinfo *target = *(struct addrinfo **) cb_data;
+
+	if (addr->sa_family != target->ai_family)
+		return;
+
+	if ((addr->sa_family == AF_INET &&
+		 memcmp(&((struct sockaddr_in *) addr)->sin_addr,
+				&((struct sockaddr_in *) target->ai_addr)->sin_addr,
+				sizeof(struct in_addr)) == 0) ||
+		(addr->sa_family == AF_INET6 &&
+		 memcmp(&((struct sockaddr_in6 *) addr)->sin6_addr,
+				&((struct sockaddr_in6 *) target->ai_addr)->sin6_addr,
+				sizeof(struct in6_addr)) == 0))
+		*(struct addrinfo **) cb_data = NULL;
+}
+
+/*
+ * Returns true if backend_local_socket_dir is set and the host name of the
+ * backend resolves to a loopback address or an address of a network
+ * interface of this host, so that the backend can be connected to by its
+ * UNIX domain socket rather than through the TCP stack.
+ */
+bool
+pool_backend_is_local(int slot)
+{
+	char	   *host = pool_config->backend_desc->backend_info[slot].backend_hostname;
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *walk;
+	bool		local = false;
+
+	if (pool_config->backend_local_socket_dir == NULL ||
+		*pool_config->backend_local_socket_dir == '\0' ||
+		*host == '/' || *host == '\0')
+		return false;
+
+	if (strcmp(local_backends[slot].hostname, host) == 0)
+		return local_backends[slot].local;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, NULL, &hints, &res) != 0)
+		return false;
+
+	for (walk = res; walk != NULL && !local; walk = walk->ai_next)
+	{
+		struct addrinfo *target = walk;
+
+		if ((walk->ai_family == AF_INET &&
+			 (ntohl(((struct sockaddr_in *) walk->ai_addr)->sin_addr.s_addr) >> 24) == 127) ||
+			(walk->ai_family == AF_INET6 &&
+			 IN6_IS_ADDR_LOOPBACK(&((struct sockaddr_in6 *) walk->ai_addr)->sin6_addr)))
+			local = true;
+		else if (pg_foreach_ifaddr(local_address_callback, &target) == 0 && target == NULL)
+			local = true;
+	}
+	freeaddrinfo(res);
+
+	strlcpy(local_backends[slot].hostname, host, sizeof(local_backends[slot].hostname));
+	local_backends[slot].local = local;
+
+	if (local)
+		ereport(LOG,
+				(errmsg("backend %d on \"%s\" runs on this host, connecting by UNIX domain socket in \"%s\"",
+						slot, host, pool_config->backend_local_socket_dir)));
+
+	return local;
+}
+
+/*
+ * Set the options of a TCP socket connected to a backend.  Returns false if
+ * setting TCP_NODELAY failed.
+ */
+static bool
+set_backend_socket_options(int fd)
+{
+	int			on = 1;
+
+	/* set nodelay */
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &on, sizeof(on)) < 0)
+		return false;
+
+#ifdef SO_BUSY_POLL
+	if (pool_config->backend_busy_poll > 0)
+	{
+		int			usec = pool_config->backend_busy_poll;
+
+		/* needs CAP_NET_ADMIN beyond the system default, so just try */
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, (char *) &usec, sizeof(usec)) < 0)
+			ereport(DEBUG1,
+					(errmsg("setsockopt(SO_BUSY_POLL) failed"),
+					 errdetail("%m")));
+	}
+#endif
+
+	return true;
+}
+
 /*
  * connect to postmaster through UNIX domain socket
  */
@@ -586,10 +768,8 @@ connect_unix_domain_socket_by_port(int port, char *socket_dir, bool retry)
 static bool
 connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool retry)
 {
-	struct timeval *tm;
-	struct timeval timeout;
-	fd_set		rset,
-				wset;
+	struct pollfd pfd;
+	int			timeout;
 	int			sts;
 	int			error;
 	socklen_t	socklen;
@@ -640,30 +820,18 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 			}
 
 			if (pool_config->connect_timeout == 0)
-				tm = NULL;
+				timeout = -1;
 			else
-			{
-				tm = &timeout;
-				timeout.tv_sec = pool_config->connect_timeout / 1000;
-				if (timeout.tv_sec == 0)
-				{
-					timeout.tv_usec = pool_config->connect_timeout * 1000;
-				}
-				else
-				{
-					timeout.tv_usec = (pool_config->connect_timeout - timeout.tv_sec * 1000) * 1000;
-				}
-			}
+				timeout = pool_config->connect_timeout;
 
-			FD_ZERO(&rset);
-			FD_SET(fd, &rset);
-			FD_ZERO(&wset);
-			FD_SET(fd, &wset);
-			sts = select(fd + 1, &rset, &wset, NULL, tm);
+			pfd.fd = fd;
+			pfd.events = POLLIN | POLLOUT;
+			pfd.revents = 0;
+			sts = poll(&pfd, 1, timeout);
 
 			if (sts == 0)
 			{
-				/* select timeout */
+				/* poll timeout */
 				if (retry)
 				{
 					ereport(LOG,
@@ -687,7 +855,7 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 				 * Richard Stevens's "UNIX Network Programming: Volume 1,
 				 * Second Edition" section 15.4.
 				 */
-				if (FD_ISSET(fd, &rset) || FD_ISSET(fd, &wset))
+				if (pfd.revents & (POLLIN | POLLOUT | POLLHUP | POLLERR))
 				{
 					error = 0;
 					socklen = sizeof(error);
@@ -718,18 +886,18 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 					return false;
 				}
 			}
-			else				/* select returns error */
+			else				/* poll returns error */
 			{
 				if ((errno == EINTR && retry) || errno == EAGAIN)
 				{
 					ereport(LOG,
 							(errmsg("trying to connect to PostgreSQL server on \"%s:%d\" using INET socket", host, port),
-							 errdetail("select() interrupted. retrying...")));
+							 errdetail("poll() interrupted. retrying...")));
 					continue;
 				}
 
 				/*
-				 * select(2) was interrupted by certain signal and we guess it
+				 * poll(2) was interrupted by certain signal and we guess it
 				 * was not SIGALRM because health_check_timer_expired was not
 				 * set (if the variable was set, we can assume that SIGALRM
 				 * handler was called). Surely this is not a health check time
@@ -739,7 +907,7 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 				if (health_check_timer_expired == 0 && errno == EINTR)
 				{
 					ereport(LOG,
-							(errmsg("connect_inet_domain_socket: select() interrupted by certain signal. retrying...")));
+							(errmsg("connect_inet_domain_socket: poll() interrupted by certain signal. retrying...")));
 					continue;
 				}
 
@@ -753,7 +921,7 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 				{
 					ereport(LOG,
 							(errmsg("failed to connect to PostgreSQL server on \"%s:%d\" using INET socket", host, port),
-							 errdetail("select() system call failed with error \"%m\"")));
+							 errdetail("poll() system call failed with error \"%m\"")));
 				}
 				close(fd);
 				return false;
@@ -774,7 +942,6 @@ int
 connect_inet_domain_socket_by_port(char *host, int port, bool retry)
 {
 	int			fd = -1;
-	int			on = 1;
 	char	   *portstr;
 	int			ret;
 	struct addrinfo *res;
@@ -820,10 +987,7 @@ connect_inet_domain_socket_by_port(char *host, int port, bool retry)
 			continue;
 		}
 
-		/* set nodelay */
-		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
-					   (char *) &on,
-					   sizeof(on)) < 0)
+		if (!set_backend_socket_options(fd))
 		{
 			ereport(WARNING,
 					(errmsg("failed to connect to PostgreSQL server, setsockopt() failed"),
@@ -849,24 +1013,240 @@ connect_inet_domain_socket_by_port(char *host, int port, bool retry)
 }
 
 /*
- * create connection pool
+ * Start a non blocking connect(2) to the first address of the list *addr
+ * that accepts it, and advance *addr past that address so that the next
+ * call tries the following one.  Returns the socket, or -1 if no address
+ * is left.
  */
-static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int slot)
+static int
+start_inet_connect(struct addrinfo **addr)
 {
-	BackendInfo *b = &pool_config->backend_desc->backend_info[slot];
-	int			fd;
+	struct addrinfo *walk;
 
-	if (*b->backend_hostname == '/')
+	for (walk = *addr; walk != NULL; walk = walk->ai_next)
 	{
-		fd = connect_unix_domain_socket(slot, TRUE);
+		int			fd;
+
+		fd = socket(walk->ai_family, walk->ai_socktype, walk->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		if (!set_backend_socket_options(fd))
+		{
+			close(fd);
+			continue;
+		}
+
+		socket_set_nonblock(fd);
+
+		if (connect(fd, walk->ai_addr, walk->ai_addrlen) < 0 && errno != EINPROGRESS)
+		{
+			close(fd);
+			continue;
+		}
+
+		*addr = walk->ai_next;
+		return fd;
 	}
-	else
+
+	*addr = NULL;
+	return -1;
+}
+
+/*
+ * Connect to all the valid backends using INET domain sockets at the same
+ * time, so that establishing a session costs the round trip time to the
+ * farthest backend rather than the sum of them.  The connected socket of
+ * each backend is stored into fds, or -1 if the backend has to be connected
+ * by create_cp() as usual: it is not an INET backend, the connection
+ * timed out, or it could not be started or was refused on every address
+ * of the host.  In the latter cases create_cp() reports the error and
+ * retries as needed.
+ *
+ * If tried is not NULL, tried[i] is set to true for each backend that was
+ * actually attempted here, so that callers which do not want to wait for
+ * connect_timeout again can skip backends which failed.
+ */
+void
+pool_connect_backends_in_parallel(int *fds, bool *tried)
+{
+	struct pollfd pfds[MAX_NUM_BACKENDS];
+	int			slots[MAX_NUM_BACKENDS];
+	struct addrinfo *addrs[MAX_NUM_BACKENDS];
+	struct addrinfo *next_addrs[MAX_NUM_BACKENDS];
+	int			npending = 0;
+	int			i;
+	struct timeval start;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		fds[i] = -1;
+
+		if (!VALID_BACKEND(i) ||
+			(BACKEND_INFO(i).backend_status != CON_UP &&
+			 BACKEND_INFO(i).backend_status != CON_CONNECT_WAIT) ||
+			*BACKEND_INFO(i).backend_hostname == '/' ||
+			pool_backend_is_local(i))
+			continue;
+
+		slots[npending] = i;
+		pfds[npending].fd = -1;
+		npending++;
+	}
+
+	if (tried)
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+			tried[i] = false;
+	}
+
+	/* nothing to gain with only one backend */
+	if (npending < 2)
+		return;
+
+	for (i = 0; i < npending; i++)
 	{
-		fd = connect_inet_domain_socket(slot, TRUE);
+		char		portstr[16];
+		struct addrinfo hints;
+
+		snprintf(portstr, sizeof(portstr), "%d", BACKEND_INFO(slots[i]).backend_port);
+		memset(&hints, 0, sizeof(struct addrinfo));
+		hints.ai_family = PF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo(BACKEND_INFO(slots[i]).backend_hostname, portstr, &hints, &addrs[i]) != 0)
+			addrs[i] = NULL;
+		next_addrs[i] = addrs[i];
+
+		pfds[i].fd = start_inet_connect(&next_addrs[i]);
+		pfds[i].events = POLLOUT;
+		pfds[i].revents = 0;
+		if (tried && pfds[i].fd >= 0)
+			tried[slots[i]] = true;
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (;;)
+	{
+		int			timeout = -1;
+		int			nwait = 0;
+		int			sts;
+
+		for (i = 0; i < npending; i++)
+		{
+			if (pfds[i].fd >= 0)
+				nwait++;
+		}
+		if (nwait == 0)
+			break;
+
+		if (pool_config->connect_timeout > 0)
+		{
+			struct timeval now;
+
+			gettimeofday(&now, NULL);
+			timeout = pool_config->connect_timeout -
+				((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000);
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		/* poll(2) ignores negative descriptors, which are already done */
+		sts = poll(pfds, npending, timeout);
+
+		if (sts < 0)
+		{
+			if (errno == EINTR && !exit_request && !health_check_timer_expired)
+				continue;
+
+			/* let create_cp() deal with it */
+			for (i = 0; i < npending; i++)
+			{
+				if (pfds[i].fd >= 0)
+					close(pfds[i].fd);
+			}
+			break;
+		}
+
+		if (sts == 0)
+		{
+			/* timed out.  create_cp() retries as it always did. */
+			for (i = 0; i < npending; i++)
+			{
+				if (pfds[i].fd < 0)
+					continue;
+
+				ereport(DEBUG1,
+						(errmsg("connecting to PostgreSQL server on \"%s:%d\" in parallel timed out",
+								BACKEND_INFO(slots[i]).backend_hostname,
+								BACKEND_INFO(slots[i]).backend_port)));
+				close(pfds[i].fd);
+				pfds[i].fd = -1;
+			}
+			break;
+		}
+
+		for (i = 0; i < npending; i++)
+		{
+			int			error = 0;
+			socklen_t	socklen = sizeof(error);
+
+			if (pfds[i].fd < 0 || pfds[i].revents == 0)
+				continue;
+
+			if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &error, &socklen) < 0 ||
+				error != 0)
+			{
+				/*
+				 * Refused or the like.  Try the next address of the host, if
+				 * any, within the same connect_timeout.  Otherwise
+				 * create_cp() will retry and report.
+				 */
+				close(pfds[i].fd);
+				pfds[i].fd = start_inet_connect(&next_addrs[i]);
+				continue;
+			}
+
+			socket_unset_nonblock(pfds[i].fd);
+			fds[slots[i]] = pfds[i].fd;
+			pfds[i].fd = -1;
+		}
+	}
+
+	for (i = 0; i < npending; i++)
+	{
+		if (addrs[i])
+			freeaddrinfo(addrs[i]);
+	}
+}
+
+/*
+ * create connection pool.  fd is the socket already connected to the
+ * backend, or -1 to connect here.
+ */
+static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int slot, int fd)
+{
+	BackendInfo *b = &pool_config->backend_desc->backend_info[slot];
+
+	if (fd < 0)
+	{
+		if (*b->backend_hostname == '/')
+		{
+			fd = connect_unix_domain_socket(slot, TRUE);
+		}
+		else
+		{
+			fd = connect_inet_domain_socket(slot, TRUE);
+		}
 	}
 
 	if (fd < 0)
+	{
+		if (processType == PT_CHILD)
+			health_check_count_backend_error(slot, true);
 		return NULL;
+	}
 
 	cp->sp = NULL;
 	cp->con = pool_open(fd, true);
@@ -885,127 +1265,157 @@ static POOL_CONNECTION_POOL * new_connection(POOL_CONNECTION_POOL * p)
 	int			i;
 	bool		status_changed = false;
 	volatile BACKEND_STATUS	status;
+	int			fds[MAX_NUM_BACKENDS];
+	int			fd;
 
 	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
-	for (i = 0; i < NUM_BACKENDS; i++)
-	{
-		ereport(DEBUG1,
-				(errmsg("creating new connection to backend"),
-				 errdetail("connecting %d backend", i)));
+	TRACE_PGPOOL_CONNECTION_NEW_START();
 
-		if (!VALID_BACKEND(i))
-		{
-			ereport(DEBUG1,
-					(errmsg("creating new connection to backend"),
-					 errdetail("skipping backend slot %d because backend_status = %d",
-							   i, BACKEND_INFO(i).backend_status)));
-			continue;
-		}
+	pool_connect_backends_in_parallel(fds, NULL);
 
-		/*
-		 * Make sure that the global backend status in the shared memory
-		 * agrees the local status checked by VALID_BACKEND. It is possible
-		 * that the local status is up, while the global status has been
-		 * changed to down by failover.
-		 */
-		status = BACKEND_INFO(i).backend_status;
-		if (status != CON_UP && status != CON_CONNECT_WAIT)
+	/*
+	 * Close the sockets opened in parallel for the following backends if
+	 * connecting to a backend throws.
+	 */
+	PG_TRY();
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
 		{
 			ereport(DEBUG1,
 					(errmsg("creating new connection to backend"),
-					 errdetail("skipping backend slot %d because global backend_status = %d",
-							   i, BACKEND_INFO(i).backend_status)));
-
-			/* sync local status with global status */
-			*(my_backend_status[i]) = status;
-			my_main_node_id = Req_info->main_node_id;
-			continue;
-		}
-
-		s = palloc(sizeof(POOL_CONNECTION_POOL_SLOT));
+					 errdetail("connecting %d backend", i)));
 
-		if (create_cp(s, i) == NULL)
-		{
-			pfree(s);
+			if (!VALID_BACKEND(i))
+			{
+				ereport(DEBUG1,
+						(errmsg("creating new connection to backend"),
+						 errdetail("skipping backend slot %d because backend_status = %d",
+								   i, BACKEND_INFO(i).backend_status)));
+				continue;
+			}
 
 			/*
-			 * If failover_on_backend_error is true, do failover. Otherwise,
-			 * just exit this session or skip next health node.
+			 * Make sure that the global backend status in the shared memory
+			 * agrees the local status checked by VALID_BACKEND. It is possible
+			 * that the local status is up, while the global status has been
+			 * changed to down by failover.
 			 */
-			if (pool_config->failover_on_backend_error)
+			status = BACKEND_INFO(i).backend_status;
+			if (status != CON_UP && status != CON_CONNECT_WAIT)
 			{
-				notice_backend_error(i, REQ_DETAIL_SWITCHOVER);
-				ereport(FATAL,
-						(errmsg("failed to create a backend connection"),
-						 errdetail("executing failover on backend")));
+				ereport(DEBUG1,
+						(errmsg("creating new connection to backend"),
+						 errdetail("skipping backend slot %d because global backend_status = %d",
+								   i, BACKEND_INFO(i).backend_status)));
+
+				/* sync local status with global status */
+				*(my_backend_status[i]) = status;
+				my_main_node_id = Req_info->main_node_id;
+				if (fds[i] >= 0)
+					close(fds[i]);
+				fds[i] = -1;
+				continue;
 			}
-			else
+
+			s = palloc(sizeof(POOL_CONNECTION_POOL_SLOT));
+
+			fd = fds[i];
+			fds[i] = -1;
+			if (create_cp(s, i, fd) == NULL)
 			{
+				pfree(s);
+
 				/*
-				 * If we are in streaming replication mode and the node is a
-				 * standby node, then we skip this node to avoid fail over.
+				 * If failover_on_backend_error is true, do failover. Otherwise,
+				 * just exit this session or skip next health node.
 				 */
-				if (SL_MODE && !IS_PRIMARY_NODE_ID(i))
+				if (pool_config->failover_on_backend_error)
 				{
-					ereport(LOG,
-							(errmsg("failed to create a backend %d connection", i),
-							 errdetail("skip this backend because because failover_on_backend_error is off and we are in streaming replication mode and node is standby node")));
+					notice_backend_error(i, REQ_DETAIL_SWITCHOVER);
+					ereport(FATAL,
+							(errmsg("failed to create a backend connection"),
+							 errdetail("executing failover on backend")));
+				}
+				else
+				{
+					/*
+					 * If we are in streaming replication mode and the node is a
+					 * standby node, then we skip this node to avoid fail over.
+					 */
+					if (SL_MODE && !IS_PRIMARY_NODE_ID(i))
+					{
+						ereport(LOG,
+								(errmsg("failed to create a backend %d connection", i),
+								 errdetail("skip this backend because because failover_on_backend_error is off and we are in streaming replication mode and node is standby node")));
 
-					/* set down status to local status area */
-					*(my_backend_status[i]) = CON_DOWN;
+						/* set down status to local status area */
+						*(my_backend_status[i]) = CON_DOWN;
 
-					/* if main_node_id is not updated, then update it */
-					if (Req_info->main_node_id == i)
-					{
-						int			old_main = Req_info->main_node_id;
+						/* if main_node_id is not updated, then update it */
+						if (Req_info->main_node_id == i)
+						{
+							int			old_main = Req_info->main_node_id;
 
-						Req_info->main_node_id = get_next_main_node();
+							Req_info->main_node_id = get_next_main_node();
 
-						ereport(LOG,
-								(errmsg("main node %d is down. Update main node to %d",
-										old_main, Req_info->main_node_id)));
-					}
+							ereport(LOG,
+									(errmsg("main node %d is down. Update main node to %d",
+											old_main, Req_info->main_node_id)));
+						}
 
-					/*
-					 * make sure that we need to restart the process after
-					 * finishing this session
-					 */
-					pool_get_my_process_info()->need_to_restart = 1;
-					continue;
+						/*
+						 * make sure that we need to restart the process after
+						 * finishing this session
+						 */
+						pool_get_my_process_info()->need_to_restart = 1;
+						continue;
+					}
+					else
+					{
+						ereport(FATAL,
+								(errmsg("failed to create a backend %d connection", i),
+								 errdetail("not executing failover because failover_on_backend_error is off")));
+					}
 				}
-				else
+				child_exit(POOL_EXIT_AND_RESTART);
+			}
+			else
+			{
+				p->info[i].create_time = time(NULL);
+				p->info[i].client_idle_duration = 0;
+				p->slots[i] = s;
+
+				pool_init_params(&s->con->params);
+
+				if (BACKEND_INFO(i).backend_status != CON_UP)
 				{
-					ereport(FATAL,
-							(errmsg("failed to create a backend %d connection", i),
-							 errdetail("not executing failover because failover_on_backend_error is off")));
+					BACKEND_INFO(i).backend_status = CON_UP;
+					pool_set_backend_status_changed_time(i);
+					status_changed = true;
 				}
+				active_backend_count++;
 			}
-			child_exit(POOL_EXIT_AND_RESTART);
 		}
-		else
+	}
+	PG_CATCH();
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
 		{
-			p->info[i].create_time = time(NULL);
-			p->info[i].client_idle_duration = 0;
-			p->slots[i] = s;
-
-			pool_init_params(&s->con->params);
-
-			if (BACKEND_INFO(i).backend_status != CON_UP)
-			{
-				BACKEND_INFO(i).backend_status = CON_UP;
-				pool_set_backend_status_changed_time(i);
-				status_changed = true;
-			}
-			active_backend_count++;
+			if (fds[i] >= 0)
+				close(fds[i]);
 		}
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
 
 	if (status_changed)
 		(void) write_status_file();
 
 	MemoryContextSwitchTo(oldContext);
 
+	TRACE_PGPOOL_CONNECTION_NEW_DONE(active_backend_count);
+
 	if (active_backend_count > 0)
 	{
 		return p;
@@ -1021,18 +1431,16 @@ static POOL_CONNECTION_POOL * new_connection(POOL_CONNECTION_POOL * p)
 static int
 check_socket_status(int fd)
 {
-	fd_set		rfds;
+	struct pollfd pfd;
 	int			result;
-	struct timeval t;
 
 	for (;;)
 	{
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-
-		t.tv_sec = t.tv_usec = 0;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
 
-		result = select(fd + 1, &rfds, NULL, NULL, &t);
+		result = poll(&pfd, 1, 0);
 		if (result < 0 && errno == EINTR)
 		{
 			continue;
@@ -1085,6 +1493,309 @@ close_all_backend_connections(void)
 	POOL_SETMASK(&oldmask);
 }
 
+/*
+ * Close connections to backend nodes which went down, without touching
+ * connections to the other nodes.  This lets sessions on unaffected nodes
+ * survive a standby failure when failover_keep_sessions is enabled.
+ *
+ * "active" is the connection pool used by the current session, or NULL if
+ * called between sessions.  The load balance node and the main node of
+ * the active session cannot be removed under the session's feet; if one
+ * of them went down the session keeps the slot and the process restarts
+ * after the session ends, as before.  (Normally the main process has
+ * already terminated such a session.)  If failover_reattach_timeout is
+ * set, the session is instead reattached to the remaining nodes, see
+ * prepare_session_reattach().
+ *
+ * Returns true if any connection was closed.
+ */
+bool
+pool_discard_down_node_connections(POOL_CONNECTION_POOL * active)
+{
+	int			i,
+				node;
+	bool		discarded = false;
+	bool		reattach = false;
+	bool		keep;
+	int			lb_node = -1;
+	POOL_CONNECTION_POOL *p;
+	POOL_SESSION_CONTEXT *session_context;
+	pool_sigset_t oldmask;
+
+	if (!pool_config->failover_keep_sessions || !STREAM || Req_info->switching)
+		return false;
+
+	/*
+	 * During a session we are called for every message, so check cheaply
+	 * first that a node the session still regards as up went down, before
+	 * masking signals and scanning the pool.
+	 */
+	if (active)
+	{
+		for (node = 0; node < NUM_BACKENDS; node++)
+		{
+			if (BACKEND_INFO(node).backend_status == CON_DOWN &&
+				private_backend_status[node] != CON_DOWN)
+				break;
+		}
+		if (node >= NUM_BACKENDS)
+			return false;
+	}
+
+	session_context = pool_get_session_context(true);
+	if (active && session_context)
+		lb_node = session_context->load_balance_node_id;
+
+	if (active && session_context && pool_config->failover_reattach_timeout > 0)
+		reattach = prepare_session_reattach(active, lb_node);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+
+	for (node = 0; node < NUM_BACKENDS; node++)
+	{
+		if (BACKEND_INFO(node).backend_status != CON_DOWN)
+			continue;
+
+		keep = active && !reattach && (node == lb_node || node == my_main_node_id);
+
+		if (keep && CONNECTION_SLOT(active, node))
+			pool_get_my_process_info()->need_to_restart = 1;
+
+		for (i = 0, p = pool_connection_pool; i < pool_config->max_pool; i++, p++)
+		{
+			if (CONNECTION_SLOT(p, node) == NULL)
+				continue;
+			if (p == active && keep)
+				continue;
+
+			ereport(LOG,
+					(errmsg("closing connection to backend %d which is down", node),
+					 errdetail("keeping connections to other backends")));
+
+			/* the startup packet is shared with the other slots */
+			CONNECTION_SLOT(p, node)->sp = NULL;
+			pool_close(CONNECTION(p, node));
+			pfree(CONNECTION_SLOT(p, node));
+			CONNECTION_SLOT(p, node) = NULL;
+			memset(&p->info[node], 0, sizeof(ConnectionInfo));
+			discarded = true;
+		}
+
+		if (!keep)
+			private_backend_status[node] = CON_DOWN;
+	}
+
+	/* between sessions we can also pick up the new main node */
+	if (!active || reattach)
+		my_main_node_id = REAL_MAIN_NODE_ID;
+
+	if (reattach)
+	{
+		if (!RAW_MODE && pool_config->load_balance_mode)
+			lb_node = select_load_balancing_node();
+		else
+			lb_node = PRIMARY_NODE_ID;
+
+		session_context->load_balance_node_id = lb_node;
+		for (node = 0; node < NUM_BACKENDS; node++)
+			pool_coninfo(session_context->process_context->proc_id,
+						 pool_pool_index(), node)->load_balancing_node = lb_node;
+
+		ereport(LOG,
+				(errmsg("session reattached to new primary node %d", PRIMARY_NODE_ID),
+				 errdetail("main node is %d, load balance node is %d", my_main_node_id, lb_node)));
+	}
+
+	POOL_SETMASK(&oldmask);
+
+	return discarded;
+}
+
+/*
+ * Can the session be moved off a failed node?  It must not be inside a
+ * transaction or in the middle of a query, and must not have created
+ * temporary tables, which only exist on the failed node.  If not, *reason
+ * (if not NULL) is set to why.
+ */
+bool
+pool_session_reattachable(POOL_CONNECTION_POOL * backend, const char **reason)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+	const char *why = NULL;
+	int			i;
+
+	if (!session_context)
+		why = "there is no session";
+	else if (pool_is_query_in_progress() ||
+			 pool_is_doing_extended_query_message() ||
+			 pool_pending_message_exists())
+		why = "a query is in progress";
+	else if (session_context->temp_tables != NIL)
+		why = "the session has temporary tables";
+	else
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (CONNECTION_SLOT(backend, i) && TSTATE(backend, i) != 'I')
+			{
+				why = "the session is inside a transaction";
+				break;
+			}
+		}
+	}
+
+	if (reason)
+		*reason = why;
+	return why == NULL;
+}
+
+/*
+ * Called by pool_discard_down_node_connections() before closing the
+ * connections to down nodes.  If the main node or the load balance node of
+ * the session went down, check that the session can live on the remaining
+ * nodes and prepare its statements again on the new primary, so that the
+ * connections to the failed node can be closed.  Returns true if so, false
+ * if the session does not use a failed node.  A session which cannot be
+ * reattached is terminated.
+ *
+ * Parameters changed by SET need not be restored, since SET is sent to all
+ * nodes.  Portals do not survive the end of a transaction anyway.
+ */
+static bool
+prepare_session_reattach(POOL_CONNECTION_POOL * backend, int lb_node)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	POOL_SENT_MESSAGE_LIST *list = &session_context->message_list;
+	const char *reason;
+	int			primary;
+	int			node;
+	int			i;
+	bool		failed = false;
+
+	for (node = 0; node < NUM_BACKENDS; node++)
+	{
+		if (BACKEND_INFO(node).backend_status == CON_DOWN &&
+			(node == lb_node || node == my_main_node_id) &&
+			CONNECTION_SLOT(backend, node))
+			break;
+	}
+	if (node == NUM_BACKENDS)
+		return false;
+
+	primary = Req_info->primary_node_id;
+
+	if (!pool_session_reattachable(backend, &reason))
+		ereport(FATAL,
+				(errmsg("terminating session because DB node %d went down", node),
+				 errdetail("session cannot be reattached because %s", reason)));
+
+	if (primary < 0 || BACKEND_INFO(primary).backend_status == CON_DOWN ||
+		!CONNECTION_SLOT(backend, primary) ||
+		BACKEND_INFO(REAL_MAIN_NODE_ID).backend_status == CON_DOWN ||
+		!CONNECTION_SLOT(backend, REAL_MAIN_NODE_ID))
+		ereport(FATAL,
+				(errmsg("terminating session because DB node %d went down", node),
+				 errdetail("session cannot be reattached because there is no connection to the new primary node")));
+
+	for (i = 0; i < list->size; i++)
+	{
+		POOL_SENT_MESSAGE *msg = list->sent_messages[i];
+		POOL_QUERY_CONTEXT *qc = msg->query_context;
+
+		if (msg->state != POOL_SENT_MESSAGE_CREATED || !qc ||
+			qc->where_to_send[primary])
+			continue;
+
+		if (msg->kind == 'P')
+			failed = !replay_parse(backend, primary, msg);
+		else if (msg->kind == 'Q' && qc->parse_tree && IsA(qc->parse_tree, PrepareStmt))
+		{
+			POOL_SELECT_RESULT *res;
+
+			do_query(CONNECTION(backend, primary), nodeToString(qc->parse_tree),
+					 &res, MAJOR(backend));
+			free_select_result(res);
+		}
+		else
+			continue;
+
+		if (failed)
+			ereport(FATAL,
+					(errmsg("terminating session because DB node %d went down", node),
+					 errdetail("failed to prepare statement \"%s\" on the new primary node %d",
+							   msg->name, primary)));
+
+		qc->where_to_send[primary] = true;
+		if (qc->virtual_main_node_id == node)
+			qc->virtual_main_node_id = primary;
+		if (qc->load_balance_node_id == node)
+			qc->load_balance_node_id = primary;
+	}
+
+	return true;
+}
+
+/*
+ * Send the Parse message of a statement to one node followed by Sync, and
+ * wait for ReadyForQuery.  Pooled prepared statements are parsed under
+ * their server side name unless the node has it already.  Returns false if
+ * the node reported an error.
+ */
+static bool
+replay_parse(POOL_CONNECTION_POOL * backend, int node, POOL_SENT_MESSAGE * msg)
+{
+	POOL_CONNECTION *cp = CONNECTION(backend, node);
+	bool		nodes[MAX_NUM_BACKENDS];
+	char	   *contents = msg->contents;
+	int			len = msg->len;
+	int			sendlen;
+	char		kind;
+	bool		error = false;
+
+	memset(nodes, 0, sizeof(nodes));
+	nodes[node] = true;
+
+	if (msg->server_statement[0] != '\0')
+	{
+		if (pool_ps_lookup(backend, nodes, msg->server_statement) != POOL_PS_ABSENT)
+			return true;
+		pool_ps_register(backend, nodes, msg->server_statement, true);
+		contents = pool_ps_rewrite_message('P', msg->len, msg->contents,
+										   msg->server_statement, &len);
+	}
+
+	ereport(DEBUG1,
+			(errmsg("reattaching session"),
+			 errdetail("preparing statement \"%s\" on DB node %d", msg->name, node)));
+
+	pool_write(cp, "P", 1);
+	sendlen = htonl(len + 4);
+	pool_write(cp, &sendlen, sizeof(sendlen));
+	pool_write(cp, contents, len);
+	pool_write(cp, "S", 1);
+	sendlen = htonl(4);
+	pool_write_and_flush(cp, &sendlen, sizeof(sendlen));
+
+	if (contents != msg->contents)
+		pfree(contents);
+
+	do
+	{
+		pool_read_with_error(cp, &kind, sizeof(kind), "reattaching session");
+		pool_read_with_error(cp, &sendlen, sizeof(sendlen), "reattaching session");
+		sendlen = ntohl(sendlen) - 4;
+		if (sendlen > 0)
+			pool_read2(cp, sendlen);
+		if (kind == 'E')
+			error = true;
+	} while (kind != 'Z');
+
+	if (!error && msg->server_statement[0] != '\0')
+		pool_ps_confirm(backend, nodes, msg->server_statement);
+
+	return !error;
+}
+
 /*
  * Return number of established connections in the connection pool.
  * This is called when a client disconnects to pgpool.
@@ -1103,6 +1814,298 @@ update_pooled_connection_count(void)
 	pool_get_my_process_info()->pooled_connections = count;
 }
 
+/*
+ * Record the memory used by the buffers of the frontend connection, if
+ * any, and of all pooled backend connections for SHOW POOL_PROCESSES.
+ */
+void
+update_buffer_memory(POOL_CONNECTION * frontend)
+{
+	int			i,
+				j;
+	int			total = 0;
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+
+	if (frontend)
+		total += pool_buffer_memory(frontend);
+
+	for (i = 0; i < pool_config->max_pool; i++, p++)
+	{
+		for (j = 0; j < NUM_BACKENDS; j++)
+		{
+			if (CONNECTION_SLOT(p, j) && CONNECTION(p, j))
+				total += pool_buffer_memory(CONNECTION(p, j));
+		}
+	}
+	pool_get_my_process_info()->buffer_memory = total;
+}
+
+/*
+ * Record the memory held by the memory contexts of this process for SHOW
+ * POOL_MEMORY.  Called whenever ReadyForQuery is sent and after a session
+ * ends.  The session and query parts are only counted while a session is
+ * active, since QueryContext is deleted with ProcessLoopContext between
+ * sessions.
+ */
+void
+update_memory_usage(void)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+
+	pi->memory_allocated = MemoryContextMemAllocated(TopMemoryContext, true);
+	if (session_context)
+	{
+		pi->session_memory = MemoryContextMemAllocated(session_context->memory_context, true);
+		pi->query_memory = QueryContext ? MemoryContextMemAllocated(QueryContext, true) : 0;
+	}
+	else
+	{
+		pi->session_memory = 0;
+		pi->query_memory = 0;
+	}
+	if (pi->memory_allocated > pi->peak_memory)
+		pi->peak_memory = pi->memory_allocated;
+}
+
+/*
+ * Open connections listed in prewarm_connections, so that the first client
+ * connecting as one of the users/databases does not have to wait for
+ * connecting to and authenticating with all backends.  Called by an idle
+ * child before waiting for a new client.  Entries are of the form
+ * user:database:count and each of the first count child processes keeps
+ * one such connection in its pool.  The password is taken from pool_passwd.
+ */
+void
+pool_prewarm_connections(void)
+{
+	static time_t next_time = 0;
+	MemoryContext oldContext = CurrentMemoryContext;
+	time_t		now;
+	int			i;
+
+	if (pool_config->num_prewarm_connections == 0 ||
+		!pool_config->connection_cache ||
+		pool_connection_pool == NULL)
+		return;
+
+	now = time(NULL);
+	if (now < next_time)
+		return;
+	next_time = now + PREWARM_CHECK_INTERVAL;
+
+	for (i = 0; i < pool_config->num_prewarm_connections; i++)
+	{
+		char	   *entry;
+		char	   *database;
+		char	   *count;
+		char	   *endptr;
+		long		num_children;
+		bool		created = false;
+
+		entry = pstrdup(pool_config->prewarm_connections[i]);
+		database = strchr(entry, ':');
+		count = strrchr(entry, ':');
+		if (database == NULL || database == count)
+		{
+			if (my_proc_id == 0)
+				ereport(WARNING,
+						(errmsg("invalid prewarm_connections entry \"%s\"", pool_config->prewarm_connections[i]),
+						 errhint("entries must be of the form user:database:count")));
+			next_time = time(NULL) + PREWARM_RETRY_INTERVAL;
+			pfree(entry);
+			continue;
+		}
+		*database++ = '\0';
+		*count++ = '\0';
+
+		num_children = strtol(count, &endptr, 10);
+		if (*entry == '\0' || *database == '\0' || *endptr != '\0' || num_children <= 0)
+		{
+			if (my_proc_id == 0)
+				ereport(WARNING,
+						(errmsg("invalid prewarm_connections entry \"%s\"", pool_config->prewarm_connections[i]),
+						 errhint("entries must be of the form user:database:count")));
+			next_time = time(NULL) + PREWARM_RETRY_INTERVAL;
+			pfree(entry);
+			continue;
+		}
+
+		if (my_proc_id >= num_children)
+		{
+			pfree(entry);
+			continue;
+		}
+
+		PG_TRY();
+		{
+			created = prewarm_cp(entry, database);
+		}
+		PG_CATCH();
+		{
+			MemoryContextSwitchTo(oldContext);
+			EmitErrorReport();
+			FlushErrorState();
+			pool_discard_cp(entry, database, PROTO_MAJOR_V3);
+			next_time = time(NULL) + PREWARM_RETRY_INTERVAL;
+		}
+		PG_END_TRY();
+
+		if (created)
+			ereport(DEBUG1,
+					(errmsg("prewarmed backend connection for user: \"%s\" database: \"%s\"", entry, database)));
+
+		pfree(entry);
+	}
+
+	update_pooled_connection_count();
+}
+
+/*
+ * Open and authenticate a connection pool for user and database in an
+ * empty pool slot.  Nothing is done if there already is a pool for them or
+ * if all the slots are in use: an existing pool is never evicted for
+ * prewarming.  Returns true if a pool was created.
+ */
+static bool
+prewarm_cp(char *user, char *database)
+{
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	POOL_CONNECTION_POOL *empty = NULL;
+	StartupPacket *sp;
+	char	   *password;
+	int			i;
+
+	/* these databases are never cached.  See backend_cleanup(). */
+	if (!strcmp(database, "template0") ||
+		!strcmp(database, "template1") ||
+		!strcmp(database, "postgres") ||
+		!strcmp(database, "regression"))
+		return false;
+
+	for (i = 0; i < pool_config->max_pool; i++, p++)
+	{
+		if (in_use_backend_id(p) < 0)
+		{
+			if (empty == NULL)
+				empty = p;
+			continue;
+		}
+
+		if (MAIN_CONNECTION(p) &&
+			MAIN_CONNECTION(p)->sp &&
+			MAIN_CONNECTION(p)->sp->major == PROTO_MAJOR_V3 &&
+			MAIN_CONNECTION(p)->sp->user != NULL &&
+			strcmp(MAIN_CONNECTION(p)->sp->user, user) == 0 &&
+			strcmp(MAIN_CONNECTION(p)->sp->database, database) == 0)
+			return false;
+	}
+
+	if (empty == NULL)
+		return false;
+
+	sp = make_prewarm_startup_packet(user, database);
+
+	if (new_connection(empty) == NULL)
+	{
+		pool_free_startup_packet(sp);
+		return false;
+	}
+	p = empty;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i) && CONNECTION_SLOT(p, i))
+			CONNECTION_SLOT(p, i)->sp = sp;
+	}
+
+	password = get_pgpool_config_user_password(user, "");
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i) || !CONNECTION_SLOT(p, i))
+			continue;
+
+		pool_set_db_node_id(CONNECTION(p, i), i);
+		CONNECTION(p, i)->isbackend = 1;
+		pool_ssl_negotiate_clientserver(CONNECTION(p, i));
+
+		send_startup_packet(CONNECTION_SLOT(p, i));
+		prewarm_connection_do_auth(CONNECTION_SLOT(p, i), password ? password : "");
+
+		/* see pool_do_auth() */
+		p->info[i].pid = CONNECTION_SLOT(p, i)->pid;
+		p->info[i].key = CONNECTION_SLOT(p, i)->key;
+		p->info[i].major = sp->major;
+		p->info[i].minor = sp->minor;
+		strlcpy(p->info[i].database, sp->database, sizeof(p->info[i].database));
+		strlcpy(p->info[i].user, sp->user, sizeof(p->info[i].user));
+		p->info[i].counter = 0;
+		p->info[i].swallow_termination = 0;
+		CONNECTION(p, i)->con_info = &p->info[i];
+	}
+
+	if (password)
+		pfree(password);
+
+	p->prewarmed = true;
+
+	/* the pool is idle until a client picks it up */
+	pool_connection_pool_timer(p);
+
+	return true;
+}
+
+/*
+ * Build a V3 startup packet carrying only user and database, which is
+ * what libpq sends unless other options are given.
+ */
+static StartupPacket *
+make_prewarm_startup_packet(char *user, char *database)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	StartupPacket *sp;
+	int			protov = htonl(0x00030000);
+	char	   *p;
+
+	sp = palloc0(sizeof(StartupPacket));
+	sp->len = sizeof(protov) +
+		strlen("database") + 1 + strlen(database) + 1 +
+		strlen("user") + 1 + strlen(user) + 1 + 1;
+
+	if (sp->len >= MAX_STARTUP_PACKET_LENGTH)
+	{
+		pfree(sp);
+		MemoryContextSwitchTo(oldContext);
+		ereport(ERROR,
+				(errmsg("failed to prewarm connection"),
+				 errdetail("user name or database name is too long")));
+	}
+
+	sp->startup_packet = palloc0(sp->len);
+
+	/* options are sorted by name like read_startup_packet() does */
+	p = sp->startup_packet;
+	memcpy(p, &protov, sizeof(protov));
+	p += sizeof(protov);
+	strcpy(p, "database");
+	p += strlen(p) + 1;
+	strcpy(p, database);
+	p += strlen(p) + 1;
+	strcpy(p, "user");
+	p += strlen(p) + 1;
+	strcpy(p, user);
+
+	sp->major = PROTO_MAJOR_V3;
+	sp->minor = 0;
+	sp->database = pstrdup(database);
+	sp->user = pstrdup(user);
+	sp->application_name = NULL;
+
+	MemoryContextSwitchTo(oldContext);
+	return sp;
+}
+
 /*
  * Return the first node id in use.
  * If no node is in use, return -1.
@@ -1120,3 +2123,19 @@ in_use_backend_id(POOL_CONNECTION_POOL *pool)
 
 	return -1;
 }
+
+/*
+ * Compute the lookup key of a connection pool from user name, database
+ * name and protocol major version.  Never returns 0, which is reserved
+ * for "not computed yet".
+ */
+static uint32
+pool_cp_hashkey(char *user, char *database, int protoMajor)
+{
+	uint64		h;
+
+	h = pool_xxh64(user, strlen(user), (uint64) protoMajor);
+	h = pool_xxh64(database, strlen(database), h);
+
+	return (uint32) (h ^ (h >> 32)) | 1;
+}
@@ -0,0 +1,1121 @@
+/* -*-pgsql-c-*- */
+/*
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_notify_hub.c: LISTEN/NOTIFY multiplexing through a notification hub
+ * process.
+ *
+ * Every PostgreSQL backend listening on a channel is signaled and has to
+ * read the notification queue whenever a notification is sent in its
+ * database, so thousands of sessions listening on a few channels make each
+ * NOTIFY expensive.  If listen_multiplexing_max_subscriptions is set, a
+ * LISTEN sent by a client as a simple query outside of a transaction block
+ * is not sent to the backends.  Instead the child process registers a
+ * subscription in shared memory and the notification hub process issues
+ * the LISTEN, once per database and channel, on its own connection to the
+ * primary node.  The hub copies the NotificationResponse messages it
+ * receives into a ring buffer in shared memory and wakes up the children
+ * listening on the channel with SIGUSR2, which forward them to their
+ * clients while the session is idle, as PostgreSQL would.
+ *
+ * A child waits for the hub to confirm the LISTEN before answering the
+ * client, so that no notification sent after LISTEN completes is missed.
+ * If the subscription table is full or the hub cannot LISTEN, the
+ * statement is sent to the backends as usual.  The subscriptions of a
+ * session are removed when it ends, or by UNLISTEN and DISCARD ALL.  The
+ * subscriptions of a child process which died are removed by the hub.
+ *
+ * The hub connects to each database as sr_check_user.  Notifications sent
+ * while the hub is reconnecting, e.g. after failover, are lost.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <arpa/inet.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "protocol/pool_notify_hub.h"
+#include "protocol/pool_client_limit.h"
+#include "protocol/pool_process_query.h"
+#include "protocol/pool_proto_modules.h"
+#include "protocol/pool_pg_utils.h"
+#include "context/pool_session_context.h"
+#include "context/pool_process_context.h"
+#include "auth/pool_passwd.h"
+#include "parser/parsenodes.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/ps_status.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_ipc.h"
+#include "utils/pool_stream.h"
+#include "utils/pool_process_reporting.h"
+
+/* number of notifications kept in shared memory */
+#define NOTIFY_HUB_RING_SIZE	1024
+
+/* max length of a notification payload, as in PostgreSQL */
+#define NOTIFY_PAYLOAD_MAX		8000
+
+/* max time in milliseconds a child waits for the hub to LISTEN */
+#define NOTIFY_HUB_LISTEN_TIMEOUT	10000
+
+typedef enum
+{
+	SUBSCRIPTION_FREE = 0,
+	SUBSCRIPTION_PENDING,		/* waiting for the hub to LISTEN */
+	SUBSCRIPTION_ACTIVE,		/* the hub is listening */
+	SUBSCRIPTION_FAILED			/* the hub could not LISTEN */
+}			SubscriptionState;
+
+typedef struct
+{
+	SubscriptionState state;
+	pid_t		pid;			/* child process listening */
+	int			child_id;		/* index of the child in process_info */
+	char		dbname[SM_DATABASE];
+	char		channel[NAMEDATALEN];
+}			NotifyHubSubscription;
+
+typedef struct
+{
+	uint64		seq;			/* sequence number */
+	int32		be_pid;			/* pid of the notifying backend */
+	char		dbname[SM_DATABASE];
+	char		channel[NAMEDATALEN];
+	char		payload[NOTIFY_PAYLOAD_MAX];
+}			NotifyHubMessage;
+
+/*
+ * Shared memory of the hub, protected by NOTIFY_HUB_SEM.
+ */
+typedef struct
+{
+	pid_t		hub_pid;		/* pid of the hub process */
+	uint32		generation;		/* bumped when subscriptions are added or
+								 * removed */
+	uint64		next_seq;		/* sequence number of the next notification */
+	NotifyHubMessage ring[NOTIFY_HUB_RING_SIZE];
+	NotifyHubSubscription subs[FLEXIBLE_ARRAY_MEMBER];
+}			NotifyHubShared;
+
+static NotifyHubShared *notify_hub;
+
+/*
+ * Channels the session of this child listens on through the hub.
+ */
+typedef struct
+{
+	char		channel[NAMEDATALEN];
+	uint64		since;			/* first notification to deliver */
+}			MyChannel;
+
+static MyChannel *my_channels;
+static int	my_num_channels;
+static int	my_max_channels;
+static char my_dbname[SM_DATABASE];
+static uint64 my_next_seq;		/* next notification to look at */
+
+/*
+ * State of the hub process
+ */
+typedef struct
+{
+	char		channel[NAMEDATALEN];
+	bool		requested;		/* LISTEN has been sent */
+	bool		listening;		/* LISTEN has completed */
+	bool		wanted;			/* some session listens on it */
+}			HubChannel;
+
+typedef struct
+{
+	char		kind;			/* 'L': LISTEN, 'U': UNLISTEN */
+	char		channel[NAMEDATALEN];
+}			HubCommand;
+
+typedef struct
+{
+	char		dbname[SM_DATABASE];
+	POOL_CONNECTION_POOL_SLOT *slot;
+	List	   *channels;		/* list of HubChannel */
+	List	   *commands;		/* commands waiting for ReadyForQuery */
+	bool		failed;			/* the current command failed */
+}			HubDatabase;
+
+static List *hub_databases;
+static int	hub_node_id = -1;
+static bool *hub_wakeup;		/* children to wake up, by child id */
+static volatile sig_atomic_t sync_request = 0;
+static volatile sig_atomic_t reload_config_request = 0;
+
+static void lock_notify_hub(pool_sigset_t *oldmask);
+static void unlock_notify_hub(pool_sigset_t *oldmask);
+static bool hub_listen(const char *channel);
+static void hub_unlisten(const char *channel);
+static MyChannel *find_my_channel(const char *channel);
+static void sync_subscriptions(void);
+static void set_subscriptions_state(HubDatabase *db, const char *channel,
+									SubscriptionState from, SubscriptionState to);
+static HubDatabase *find_hub_database(const char *dbname, bool create);
+static HubChannel *find_hub_channel(HubDatabase *db, const char *channel);
+static bool connect_hub_database(HubDatabase *db);
+static void disconnect_hub_database(HubDatabase *db);
+static void disconnect_all_hub_databases(void);
+static void send_hub_command(HubDatabase *db, char kind, const char *channel);
+static void read_hub_messages(HubDatabase *db);
+static void publish_notification(HubDatabase *db, char *body, int len);
+static void wake_up_listeners(void);
+static RETSIGTYPE my_signal_handler(int sig);
+static RETSIGTYPE sync_request_handler(int sig);
+static RETSIGTYPE reload_config_handler(int sig);
+static void reload_config(void);
+
+/*
+ * Size of shared memory needed by the notification hub.
+ */
+size_t
+pool_notify_hub_shmem_size(void)
+{
+	return MAXALIGN(offsetof(NotifyHubShared, subs) +
+					sizeof(NotifyHubSubscription) * pool_config->listen_multiplexing_max_subscriptions);
+}
+
+/*
+ * Allocate and initialize the shared memory of the notification hub.  This
+ * should be called only once from pgpool main process at the process
+ * starting up time.
+ */
+void
+pool_init_notify_hub(void)
+{
+	notify_hub = pool_shared_memory_segment_get_chunk(pool_notify_hub_shmem_size());
+	memset(notify_hub, 0, pool_notify_hub_shmem_size());
+}
+
+static void
+lock_notify_hub(pool_sigset_t *oldmask)
+{
+	POOL_SETMASK2(&BlockSig, oldmask);
+	pool_semaphore_lock(NOTIFY_HUB_SEM);
+}
+
+static void
+unlock_notify_hub(pool_sigset_t *oldmask)
+{
+	pool_semaphore_unlock(NOTIFY_HUB_SEM);
+	POOL_SETMASK(oldmask);
+}
+
+/*
+ * Called by SimpleQuery() before a statement is sent to the backends.
+ * Returns true if the statement has been served through the hub and the
+ * reply has been sent to the frontend.  UNLISTEN * and DISCARD ALL remove
+ * the subscriptions of the session but are sent to the backends anyway.
+ */
+bool
+pool_notify_hub_statement(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+						  Node *node, bool is_multi_statement)
+{
+	bool		idle;
+
+	if (notify_hub == NULL || frontend == NULL || node == NULL)
+		return false;
+
+	if (IsA(node, DiscardStmt))
+	{
+		if (((DiscardStmt *) node)->target == DISCARD_ALL)
+			pool_notify_hub_unlisten_all();
+		return false;
+	}
+
+	if (!IsA(node, ListenStmt) && !IsA(node, UnlistenStmt))
+		return false;
+
+	idle = !is_multi_statement && MAJOR(backend) == PROTO_MAJOR_V3 &&
+		TSTATE(backend, MAIN_NODE_ID) == 'I';
+
+	if (IsA(node, UnlistenStmt))
+	{
+		UnlistenStmt *stmt = (UnlistenStmt *) node;
+
+		if (stmt->conditionname == NULL)
+		{
+			pool_notify_hub_unlisten_all();
+			return false;
+		}
+		if (!find_my_channel(stmt->conditionname))
+			return false;
+
+		hub_unlisten(stmt->conditionname);
+		if (!idle)
+			return false;
+		pool_client_limit_end_query();
+		send_complete_and_ready(frontend, backend, "UNLISTEN", -1);
+		return true;
+	}
+
+	if (!idle)
+		return false;
+
+	if (my_num_channels == 0)
+		StrNCpy(my_dbname, MAIN_CONNECTION(backend)->sp->database, sizeof(my_dbname));
+
+	if (!hub_listen(((ListenStmt *) node)->conditionname))
+		return false;
+
+	pool_client_limit_end_query();
+	send_complete_and_ready(frontend, backend, "LISTEN", -1);
+	return true;
+}
+
+static MyChannel *
+find_my_channel(const char *channel)
+{
+	int			i;
+
+	for (i = 0; i < my_num_channels; i++)
+	{
+		if (strncmp(my_channels[i].channel, channel, NAMEDATALEN - 1) == 0)
+			return &my_channels[i];
+	}
+	return NULL;
+}
+
+/*
+ * Subscribe the session to a channel and wait for the hub to listen on it.
+ * Returns false if it cannot be done, in which case the LISTEN should be
+ * sent to the backends.
+ */
+static bool
+hub_listen(const char *channel)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	pool_sigset_t oldmask;
+	NotifyHubSubscription *sub = NULL;
+	SubscriptionState state = SUBSCRIPTION_PENDING;
+	uint64		since;
+	pid_t		hub_pid;
+	int			waited;
+	int			i;
+
+	if (find_my_channel(channel))
+		return true;
+
+	lock_notify_hub(&oldmask);
+
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+
+		if (s->state == SUBSCRIPTION_FREE)
+		{
+			if (sub == NULL)
+				sub = s;
+		}
+		else if (s->state == SUBSCRIPTION_ACTIVE &&
+				 strcmp(s->dbname, my_dbname) == 0 &&
+				 strncmp(s->channel, channel, NAMEDATALEN - 1) == 0)
+			state = SUBSCRIPTION_ACTIVE;	/* the hub listens already */
+	}
+
+	if (sub)
+	{
+		sub->state = state;
+		sub->pid = getpid();
+		sub->child_id = pi - process_info;
+		StrNCpy(sub->dbname, my_dbname, sizeof(sub->dbname));
+		StrNCpy(sub->channel, channel, sizeof(sub->channel));
+		notify_hub->generation++;
+	}
+	since = notify_hub->next_seq;
+	hub_pid = notify_hub->hub_pid;
+
+	unlock_notify_hub(&oldmask);
+
+	if (sub == NULL)
+	{
+		ereport(LOG,
+				(errmsg("cannot listen on channel \"%s\" through notification hub", channel),
+				 errdetail("listen_multiplexing_max_subscriptions is reached")));
+		return false;
+	}
+
+	if (state == SUBSCRIPTION_PENDING)
+	{
+		if (hub_pid > 0)
+			kill(hub_pid, SIGUSR1);
+
+		for (waited = 0; waited < NOTIFY_HUB_LISTEN_TIMEOUT; waited += 10)
+		{
+			state = sub->state;
+			if (state != SUBSCRIPTION_PENDING)
+				break;
+			usleep(10 * 1000);
+		}
+
+		if (state != SUBSCRIPTION_ACTIVE)
+		{
+			lock_notify_hub(&oldmask);
+			sub->state = SUBSCRIPTION_FREE;
+			notify_hub->generation++;
+			unlock_notify_hub(&oldmask);
+
+			ereport(LOG,
+					(errmsg("cannot listen on channel \"%s\" through notification hub", channel),
+					 errdetail("%s", state == SUBSCRIPTION_FAILED ?
+							   "notification hub failed to listen" :
+							   "timed out waiting for notification hub")));
+			return false;
+		}
+	}
+
+	if (my_num_channels >= my_max_channels)
+	{
+		my_max_channels = my_max_channels ? my_max_channels * 2 : 8;
+		if (my_channels)
+			my_channels = repalloc(my_channels, sizeof(MyChannel) * my_max_channels);
+		else
+			my_channels = MemoryContextAlloc(TopMemoryContext, sizeof(MyChannel) * my_max_channels);
+	}
+	if (my_num_channels == 0)
+		my_next_seq = since;
+	StrNCpy(my_channels[my_num_channels].channel, channel, NAMEDATALEN);
+	my_channels[my_num_channels].since = since;
+	my_num_channels++;
+
+	ereport(DEBUG1,
+			(errmsg("listening on channel \"%s\" through notification hub", channel)));
+
+	return true;
+}
+
+/*
+ * Remove the subscription of the session to a channel.
+ */
+static void
+hub_unlisten(const char *channel)
+{
+	MyChannel  *mc = find_my_channel(channel);
+	pool_sigset_t oldmask;
+	pid_t		mypid = getpid();
+	int			i;
+
+	if (mc == NULL)
+		return;
+
+	lock_notify_hub(&oldmask);
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+
+		if (s->state != SUBSCRIPTION_FREE && s->pid == mypid &&
+			strncmp(s->channel, channel, NAMEDATALEN - 1) == 0)
+		{
+			s->state = SUBSCRIPTION_FREE;
+			notify_hub->generation++;
+		}
+	}
+	unlock_notify_hub(&oldmask);
+
+	*mc = my_channels[--my_num_channels];
+}
+
+/*
+ * Remove all the subscriptions of the session.  Called when the session
+ * ends.
+ */
+void
+pool_notify_hub_unlisten_all(void)
+{
+	pool_sigset_t oldmask;
+	pid_t		mypid = getpid();
+	int			i;
+
+	if (notify_hub == NULL || my_num_channels == 0)
+		return;
+
+	lock_notify_hub(&oldmask);
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+
+		if (s->state != SUBSCRIPTION_FREE && s->pid == mypid)
+			s->state = SUBSCRIPTION_FREE;
+	}
+	notify_hub->generation++;
+	unlock_notify_hub(&oldmask);
+
+	my_num_channels = 0;
+}
+
+/*
+ * Returns true if the session listens on any channel through the hub.
+ */
+bool
+pool_notify_hub_listening(void)
+{
+	return my_num_channels > 0;
+}
+
+/*
+ * Forward the notifications on the channels the session listens on to the
+ * frontend.  As PostgreSQL does, this is done only while the session is
+ * idle outside of a transaction block.
+ */
+void
+pool_notify_hub_deliver(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	pool_sigset_t oldmask;
+	NotifyHubMessage *msgs = NULL;
+	int			nmsgs = 0;
+	uint64		seq;
+	uint64		next_seq;
+	int			i;
+
+	if (my_num_channels == 0 || notify_hub->next_seq == my_next_seq)
+		return;
+
+	if (pool_is_query_in_progress() || pool_is_doing_extended_query_message() ||
+		pool_pending_message_exists() || TSTATE(backend, MAIN_NODE_ID) != 'I')
+		return;
+
+	lock_notify_hub(&oldmask);
+
+	next_seq = notify_hub->next_seq;
+	seq = my_next_seq;
+	if (next_seq - seq > NOTIFY_HUB_RING_SIZE)
+	{
+		ereport(LOG,
+				(errmsg("%llu notifications were lost because the session did not read them in time",
+						(unsigned long long) (next_seq - seq - NOTIFY_HUB_RING_SIZE))));
+		seq = next_seq - NOTIFY_HUB_RING_SIZE;
+	}
+
+	for (; seq < next_seq; seq++)
+	{
+		NotifyHubMessage *m = &notify_hub->ring[seq % NOTIFY_HUB_RING_SIZE];
+		MyChannel  *mc;
+
+		if (strcmp(m->dbname, my_dbname) != 0)
+			continue;
+		mc = find_my_channel(m->channel);
+		if (mc == NULL || seq < mc->since)
+			continue;
+
+		if (msgs == NULL)
+			msgs = palloc(sizeof(NotifyHubMessage) * (next_seq - seq));
+		memcpy(&msgs[nmsgs++], m, sizeof(NotifyHubMessage));
+	}
+
+	unlock_notify_hub(&oldmask);
+
+	my_next_seq = next_seq;
+
+	for (i = 0; i < nmsgs; i++)
+	{
+		int			clen = strlen(msgs[i].channel) + 1;
+		int			plen = strlen(msgs[i].payload) + 1;
+		int			len = htonl(4 + 4 + clen + plen);
+		int32		be_pid = htonl(msgs[i].be_pid);
+
+		pool_write(frontend, "A", 1);
+		pool_write(frontend, &len, sizeof(len));
+		pool_write(frontend, &be_pid, sizeof(be_pid));
+		pool_write(frontend, msgs[i].channel, clen);
+		pool_write(frontend, msgs[i].payload, plen);
+	}
+
+	if (nmsgs > 0)
+	{
+		pool_flush(frontend);
+		pfree(msgs);
+	}
+}
+
+/*
+ * Bring the LISTENs of the hub in line with the subscriptions.
+ */
+static void
+sync_subscriptions(void)
+{
+	pool_sigset_t oldmask;
+	ListCell   *dcell;
+	ListCell   *ccell;
+	int			i;
+
+	sync_request = 0;
+
+	lock_notify_hub(&oldmask);
+
+	foreach(dcell, hub_databases)
+	{
+		HubDatabase *db = lfirst(dcell);
+
+		foreach(ccell, db->channels)
+			((HubChannel *) lfirst(ccell))->wanted = false;
+	}
+
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+		HubDatabase *db;
+		HubChannel *ch;
+
+		if (s->state == SUBSCRIPTION_FREE || s->state == SUBSCRIPTION_FAILED)
+			continue;
+
+		/* the child died without removing its subscriptions */
+		if (process_info[s->child_id].pid != s->pid)
+		{
+			s->state = SUBSCRIPTION_FREE;
+			continue;
+		}
+
+		db = find_hub_database(s->dbname, true);
+		ch = find_hub_channel(db, s->channel);
+		if (ch == NULL)
+		{
+			ch = MemoryContextAllocZero(TopMemoryContext, sizeof(HubChannel));
+			StrNCpy(ch->channel, s->channel, sizeof(ch->channel));
+			db->channels = lappend(db->channels, ch);
+		}
+		ch->wanted = true;
+
+		if (ch->listening && s->state == SUBSCRIPTION_PENDING)
+			s->state = SUBSCRIPTION_ACTIVE;
+	}
+
+	unlock_notify_hub(&oldmask);
+
+	foreach(dcell, hub_databases)
+	{
+		HubDatabase *db = lfirst(dcell);
+		bool		wanted = false;
+
+		foreach(ccell, db->channels)
+		{
+			if (((HubChannel *) lfirst(ccell))->wanted)
+				wanted = true;
+		}
+
+		if (wanted && db->slot == NULL && !connect_hub_database(db))
+		{
+			set_subscriptions_state(db, NULL, SUBSCRIPTION_PENDING, SUBSCRIPTION_FAILED);
+			list_free_deep(db->channels);
+			db->channels = NIL;
+			continue;
+		}
+
+		foreach(ccell, db->channels)
+		{
+			HubChannel *ch = lfirst(ccell);
+
+			if (ch->wanted && !ch->requested)
+			{
+				send_hub_command(db, 'L', ch->channel);
+				ch->requested = true;
+			}
+			else if (!ch->wanted && ch->listening)
+			{
+				send_hub_command(db, 'U', ch->channel);
+				db->channels = foreach_delete_current(db->channels, ccell);
+				pfree(ch);
+			}
+		}
+
+		if (db->channels == NIL && db->commands == NIL)
+			disconnect_hub_database(db);
+	}
+}
+
+/*
+ * Change the state of the subscriptions to a channel, or to all channels
+ * if channel is NULL, of a database.
+ */
+static void
+set_subscriptions_state(HubDatabase *db, const char *channel,
+						SubscriptionState from, SubscriptionState to)
+{
+	pool_sigset_t oldmask;
+	int			i;
+
+	lock_notify_hub(&oldmask);
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+
+		if (s->state == from && strcmp(s->dbname, db->dbname) == 0 &&
+			(channel == NULL || strcmp(s->channel, channel) == 0))
+			s->state = to;
+	}
+	unlock_notify_hub(&oldmask);
+}
+
+static HubDatabase *
+find_hub_database(const char *dbname, bool create)
+{
+	HubDatabase *db;
+	ListCell   *cell;
+
+	foreach(cell, hub_databases)
+	{
+		db = lfirst(cell);
+		if (strcmp(db->dbname, dbname) == 0)
+			return db;
+	}
+
+	if (!create)
+		return NULL;
+
+	db = MemoryContextAllocZero(TopMemoryContext, sizeof(HubDatabase));
+	StrNCpy(db->dbname, dbname, sizeof(db->dbname));
+	hub_databases = lappend(hub_databases, db);
+	return db;
+}
+
+static HubChannel *
+find_hub_channel(HubDatabase *db, const char *channel)
+{
+	ListCell   *cell;
+
+	foreach(cell, db->channels)
+	{
+		HubChannel *ch = lfirst(cell);
+
+		if (strcmp(ch->channel, channel) == 0)
+			return ch;
+	}
+	return NULL;
+}
+
+/*
+ * Connect to the database on the primary node.  Returns false if it failed.
+ */
+static bool
+connect_hub_database(HubDatabase *db)
+{
+	MemoryContext oldContext;
+	BackendInfo *bkinfo;
+	char	   *password;
+
+	if (hub_node_id < 0)
+		return false;
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+	bkinfo = pool_get_node_info(hub_node_id);
+	db->slot = make_persistent_db_connection_noerror(hub_node_id,
+													 bkinfo->backend_hostname,
+													 bkinfo->backend_port,
+													 db->dbname,
+													 pool_config->sr_check_user,
+													 password ? password : "", false);
+	if (password)
+		pfree(password);
+	MemoryContextSwitchTo(oldContext);
+
+	if (db->slot == NULL)
+	{
+		ereport(LOG,
+				(errmsg("notification hub: could not connect to database \"%s\" on node %d",
+						db->dbname, hub_node_id)));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Close the connection to the database.  The channels are listened on
+ * again at the next sync_subscriptions().
+ */
+static void
+disconnect_hub_database(HubDatabase *db)
+{
+	ListCell   *cell;
+
+	if (db->slot)
+		discard_persistent_db_connection(db->slot);
+	db->slot = NULL;
+
+	foreach(cell, db->channels)
+	{
+		HubChannel *ch = lfirst(cell);
+
+		ch->requested = false;
+		ch->listening = false;
+	}
+	list_free_deep(db->commands);
+	db->commands = NIL;
+	db->failed = false;
+}
+
+static void
+disconnect_all_hub_databases(void)
+{
+	ListCell   *cell;
+
+	foreach(cell, hub_databases)
+		disconnect_hub_database(lfirst(cell));
+}
+
+/*
+ * Send LISTEN or UNLISTEN without waiting for the result, which is read
+ * by read_hub_messages() along with the notifications.
+ */
+static void
+send_hub_command(HubDatabase *db, char kind, const char *channel)
+{
+	HubCommand *cmd;
+	char		query[NAMEDATALEN * 2 + 32];
+	char	   *p;
+	const char *c;
+
+	p = query + snprintf(query, sizeof(query), "%s \"", kind == 'L' ? "LISTEN" : "UNLISTEN");
+	for (c = channel; *c; c++)
+	{
+		if (*c == '"')
+			*p++ = '"';
+		*p++ = *c;
+	}
+	*p++ = '"';
+	*p = '\0';
+
+	send_simplequery_message(db->slot->con, strlen(query) + 1, query, PROTO_MAJOR_V3);
+
+	cmd = MemoryContextAlloc(TopMemoryContext, sizeof(HubCommand));
+	cmd->kind = kind;
+	StrNCpy(cmd->channel, channel, sizeof(cmd->channel));
+	db->commands = lappend(db->commands, cmd);
+}
+
+/*
+ * Read the messages which have arrived on the connection to the database.
+ */
+static void
+read_hub_messages(HubDatabase *db)
+{
+	POOL_CONNECTION *con = db->slot->con;
+
+	if (pool_read_ahead_noerror(con) == 0)
+	{
+		ereport(LOG,
+				(errmsg("notification hub: lost connection to database \"%s\"", db->dbname)));
+		disconnect_hub_database(db);
+		sync_request = 1;
+		return;
+	}
+
+	while (!pool_read_buffer_is_empty(con))
+	{
+		char		kind;
+		int			len;
+		char	   *body = NULL;
+
+		pool_read_with_error(con, &kind, sizeof(kind), "notification hub");
+		pool_read_with_error(con, &len, sizeof(len), "notification hub");
+		len = ntohl(len) - 4;
+		if (len > 0)
+			body = pool_read2(con, len);
+
+		switch (kind)
+		{
+			case 'A':			/* NotificationResponse */
+				publish_notification(db, body, len);
+				break;
+
+			case 'E':			/* ErrorResponse */
+				db->failed = true;
+				break;
+
+			case 'Z':			/* ReadyForQuery */
+				if (db->commands != NIL)
+				{
+					HubCommand *cmd = linitial(db->commands);
+					HubChannel *ch = find_hub_channel(db, cmd->channel);
+
+					if (cmd->kind == 'L' && ch)
+					{
+						if (db->failed)
+						{
+							ereport(LOG,
+									(errmsg("notification hub: failed to listen on channel \"%s\" of database \"%s\"",
+											cmd->channel, db->dbname)));
+							set_subscriptions_state(db, cmd->channel,
+													SUBSCRIPTION_PENDING, SUBSCRIPTION_FAILED);
+							db->channels = list_delete_ptr(db->channels, ch);
+							pfree(ch);
+						}
+						else
+						{
+							ch->listening = true;
+							set_subscriptions_state(db, cmd->channel,
+													SUBSCRIPTION_PENDING, SUBSCRIPTION_ACTIVE);
+						}
+					}
+					db->commands = list_delete_first(db->commands);
+					pfree(cmd);
+				}
+				db->failed = false;
+				sync_request = 1;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	wake_up_listeners();
+}
+
+/*
+ * Put a NotificationResponse into the ring and remember to wake up the
+ * children listening on the channel.
+ */
+static void
+publish_notification(HubDatabase *db, char *body, int len)
+{
+	pool_sigset_t oldmask;
+	NotifyHubMessage *m;
+	int32		be_pid;
+	char	   *channel;
+	char	   *payload;
+	int			i;
+
+	if (len < 6)
+		return;
+
+	memcpy(&be_pid, body, sizeof(be_pid));
+	channel = body + 4;
+	payload = channel + strnlen(channel, len - 4) + 1;
+	if (payload >= body + len)
+		return;
+
+	lock_notify_hub(&oldmask);
+
+	m = &notify_hub->ring[notify_hub->next_seq % NOTIFY_HUB_RING_SIZE];
+	m->seq = notify_hub->next_seq;
+	m->be_pid = ntohl(be_pid);
+	StrNCpy(m->dbname, db->dbname, sizeof(m->dbname));
+	StrNCpy(m->channel, channel, sizeof(m->channel));
+	StrNCpy(m->payload, payload, sizeof(m->payload));
+	notify_hub->next_seq++;
+
+	for (i = 0; i < pool_config->listen_multiplexing_max_subscriptions; i++)
+	{
+		NotifyHubSubscription *s = &notify_hub->subs[i];
+
+		if (s->state == SUBSCRIPTION_ACTIVE &&
+			strcmp(s->dbname, m->dbname) == 0 &&
+			strcmp(s->channel, m->channel) == 0)
+			hub_wakeup[s->child_id] = true;
+	}
+
+	unlock_notify_hub(&oldmask);
+}
+
+static void
+wake_up_listeners(void)
+{
+	int			i;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (hub_wakeup[i])
+		{
+			if (process_info[i].pid > 0)
+				kill(process_info[i].pid, SIGUSR2);
+			hub_wakeup[i] = false;
+		}
+	}
+}
+
+/*
+ * notification hub main loop
+ */
+void
+do_notify_hub_child(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext HubMemoryContext;
+	struct pollfd *pfds;
+	HubDatabase **pdbs;
+
+	ereport(DEBUG1,
+			(errmsg("I am notification hub pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("notification hub", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, sync_request_handler);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Create per loop iteration memory context */
+	HubMemoryContext = AllocSetContextCreate(TopMemoryContext,
+											 "notify_hub_main_loop",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	/* Initialize per process context */
+	pool_init_process_context();
+
+	hub_wakeup = palloc0(sizeof(bool) * pool_config->num_init_children);
+
+	/* children whose LISTEN is pending may have missed the pid */
+	notify_hub->hub_pid = getpid();
+	sync_request = 1;
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+		POOL_SETMASK(&UnBlockSig);
+		disconnect_all_hub_databases();
+		sync_request = 1;
+		sleep(1);
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	for (;;)
+	{
+		static uint32 generation;
+		ListCell   *cell;
+		int			node_id;
+		int			nfds = 0;
+		int			i;
+
+		MemoryContextResetAndDeleteChildren(HubMemoryContext);
+
+		if (reload_config_request)
+			reload_config();
+
+		/* follow the primary node */
+		node_id = STREAM ? REAL_PRIMARY_NODE_ID : REAL_MAIN_NODE_ID;
+		if (Req_info->switching || node_id < 0 || !VALID_BACKEND(node_id))
+			node_id = -1;
+		if (node_id != hub_node_id)
+		{
+			if (hub_node_id >= 0)
+				ereport(LOG,
+						(errmsg("notification hub: primary node changed from %d to %d",
+								hub_node_id, node_id)));
+			disconnect_all_hub_databases();
+			hub_node_id = node_id;
+			sync_request = 1;
+		}
+
+		if (sync_request || generation != notify_hub->generation)
+		{
+			generation = notify_hub->generation;
+			sync_subscriptions();
+		}
+
+		/* the state of the hub lives in TopMemoryContext */
+		pfds = MemoryContextAlloc(HubMemoryContext,
+								  sizeof(struct pollfd) * (list_length(hub_databases) + 1));
+		pdbs = MemoryContextAlloc(HubMemoryContext,
+								  sizeof(HubDatabase *) * (list_length(hub_databases) + 1));
+		foreach(cell, hub_databases)
+		{
+			HubDatabase *db = lfirst(cell);
+
+			if (db->slot == NULL)
+				continue;
+			pfds[nfds].fd = db->slot->con->fd;
+			pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			pdbs[nfds] = db;
+			nfds++;
+		}
+
+		if (poll(pfds, nfds, 1000) <= 0)
+			continue;
+
+		for (i = 0; i < nfds; i++)
+		{
+			if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				read_hub_messages(pdbs[i]);
+		}
+	}
+}
+
+static RETSIGTYPE my_signal_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+
+	switch (sig)
+	{
+		case SIGTERM:
+		case SIGINT:
+		case SIGQUIT:
+			exit(0);
+			break;
+
+		default:
+			exit(1);
+			break;
+	}
+}
+
+static RETSIGTYPE sync_request_handler(int sig)
+{
+	sync_request = 1;
+}
+
+static RETSIGTYPE reload_config_handler(int sig)
+{
+	reload_config_request = 1;
+}
+
+static void
+reload_config(void)
+{
+	MemoryContext oldContext;
+
+	ereport(LOG,
+			(errmsg("reloading config file")));
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
+	MemoryContextSwitchTo(oldContext);
+	reload_config_request = 0;
+}
@@ -26,6 +26,7 @@
 
 #include "protocol/pool_pg_utils.h"
 #include "protocol/pool_connection_pool.h"
+#include "protocol/pool_process_query.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/pool_ipc.h"
@@ -33,6 +34,8 @@
 #include "utils/pool_ssl.h"
 #include "utils/elog.h"
 #include "utils/pool_relcache.h"
+#include "utils/pool_shared_relcache.h"
+#include "utils/statistics.h"
 #include "auth/pool_auth.h"
 #include "context/pool_session_context.h"
 
@@ -40,9 +43,14 @@
 #include "pool_config_variables.h"
 
 static int	choose_db_node_id(char *str);
+static int	choose_weighted_random_node(bool exclude_primary, int exclude_node_id);
+static double node_load_score(int node_id);
+static int	choose_least_loaded_node(bool exclude_primary, int exclude_node_id);
 static void free_persistent_db_connection_memory(POOL_CONNECTION_POOL_SLOT * cp);
-static void si_enter_critical_region(void);
-static void si_leave_critical_region(void);
+static POOL_CONNECTION_POOL_SLOT *make_persistent_db_connection_internal(int fd,
+																		 int db_node_id, char *hostname, int port, char *dbname, char *user, char *password, bool retry);
+static void si_join_group(bool commit);
+static void si_leave_group(bool commit);
 
 /*
  * create a persistent connection
@@ -50,9 +58,21 @@ static void si_leave_critical_region(void);
 POOL_CONNECTION_POOL_SLOT *
 make_persistent_db_connection(
 							  int db_node_id, char *hostname, int port, char *dbname, char *user, char *password, bool retry)
+{
+	return make_persistent_db_connection_internal(-1, db_node_id, hostname, port,
+												  dbname, user, password, retry);
+}
+
+/*
+ * Workhorse of make_persistent_db_connection().  If fd is not -1, it is a
+ * socket already connected to the backend and is used instead of opening a
+ * new one.
+ */
+static POOL_CONNECTION_POOL_SLOT *
+make_persistent_db_connection_internal(int fd,
+									   int db_node_id, char *hostname, int port, char *dbname, char *user, char *password, bool retry)
 {
 	POOL_CONNECTION_POOL_SLOT *cp;
-	int			fd;
 
 #define MAX_USER_AND_DATABASE	1024
 
@@ -75,13 +95,12 @@ make_persistent_db_connection(
 	/*
 	 * create socket
 	 */
-	if (*hostname == '/')
-	{
-		fd = connect_unix_domain_socket_by_port(port, hostname, retry);
-	}
-	else
+	if (fd < 0)
 	{
-		fd = connect_inet_domain_socket_by_port(hostname, port, retry);
+		if (*hostname == '/')
+			fd = connect_unix_domain_socket_by_port(port, hostname, retry);
+		else
+			fd = connect_inet_domain_socket_by_port(hostname, port, retry);
 	}
 
 	if (fd < 0)
@@ -213,6 +232,63 @@ make_persistent_db_connection_noerror(
 	return slot;
 }
 
+/*
+ * Make persistent connections to all valid backends at once.  TCP
+ * connections are established in parallel so that unreachable backends
+ * cost one connect_timeout in total rather than one per backend; the
+ * startup and authentication then proceed on each connected socket.
+ * slots[i] is set to the connection to backend i, or NULL if the backend
+ * is not valid or the connection failed.  Does not ereport in case of an
+ * error.
+ */
+void
+make_persistent_db_connections_noerror(POOL_CONNECTION_POOL_SLOT * *slots,
+									   char *dbname, char *user, char *password)
+{
+	int			fds[MAX_NUM_BACKENDS];
+	bool		tried[MAX_NUM_BACKENDS];
+	int			i;
+
+	pool_connect_backends_in_parallel(fds, tried);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		BackendInfo *bkinfo;
+		MemoryContext oldContext = CurrentMemoryContext;
+
+		slots[i] = NULL;
+
+		if (!VALID_BACKEND(i))
+		{
+			if (fds[i] >= 0)
+				close(fds[i]);
+			continue;
+		}
+
+		/* already failed or timed out in parallel.  Don't wait again. */
+		if (fds[i] < 0 && tried[i])
+			continue;
+
+		bkinfo = pool_get_node_info(i);
+
+		PG_TRY();
+		{
+			slots[i] = make_persistent_db_connection_internal(fds[i], i,
+															  bkinfo->backend_hostname,
+															  bkinfo->backend_port,
+															  dbname, user, password, false);
+		}
+		PG_CATCH();
+		{
+			/* see make_persistent_db_connection_noerror() */
+			MemoryContextSwitchTo(oldContext);
+			FlushErrorState();
+			slots[i] = NULL;
+		}
+		PG_END_TRY();
+	}
+}
+
 /*
  * Free memory of POOL_CONNECTION_POOL_SLOT.  Should only be used in
  * make_persistent_db_connection and discard_persistent_db_connection.
@@ -296,6 +372,168 @@ pool_free_startup_packet(StartupPacket *sp)
 	sp = NULL;
 }
 
+/*
+ * Compute the weight each node is actually load balanced with into
+ * weights[].  Without adaptive_weight this is just backend_weight.  With
+ * it, backend_weight is scaled by how fast the node has been compared with
+ * the average of the load balancing candidates, judged by query latency
+ * plus the round trip time of the worker process's probe queries.  The
+ * scale is limited to between adaptive_weight_floor and
+ * adaptive_weight_ceiling percent.  Nodes with no measurement yet keep
+ * backend_weight.
+ */
+void
+pool_get_effective_weights(double *weights)
+{
+	uint64		cost[MAX_NUM_BACKENDS];
+	double		total_cost = 0.0;
+	int			num_costs = 0;
+	double		mean_cost;
+	double		scale;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		weights[i] = BACKEND_INFO(i).backend_weight;
+		cost[i] = 0;
+
+		if (!pool_config->adaptive_weight || !VALID_BACKEND_RAW(i) ||
+			weights[i] <= 0.0)
+			continue;
+
+		cost[i] = stat_get_latency(i) + stat_get_probe_latency(i);
+		if (cost[i] > 0)
+		{
+			total_cost += cost[i];
+			num_costs++;
+		}
+	}
+
+	if (num_costs < 2)
+		return;
+
+	mean_cost = total_cost / num_costs;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (cost[i] == 0)
+			continue;
+
+		scale = mean_cost / cost[i];
+		if (scale < pool_config->adaptive_weight_floor / 100.0)
+			scale = pool_config->adaptive_weight_floor / 100.0;
+		else if (scale > pool_config->adaptive_weight_ceiling / 100.0)
+			scale = pool_config->adaptive_weight_ceiling / 100.0;
+
+		weights[i] *= scale;
+	}
+}
+
+/*
+ * Choose a node randomly in proportion to the effective weight.  If
+ * exclude_primary is true, the primary node is not a candidate.  Neither is
+ * exclude_node_id.  Returns MAIN_NODE_ID if there's no candidate.
+ */
+static int
+choose_weighted_random_node(bool exclude_primary, int exclude_node_id)
+{
+	int			selected_slot = MAIN_NODE_ID;
+	double		weights[MAX_NUM_BACKENDS];
+	double		total_weight = 0.0;
+	double		r;
+	int			i;
+
+	pool_get_effective_weights(weights);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND_RAW(i))
+		{
+			if (i == exclude_node_id)
+				continue;
+			if (exclude_primary)
+			{
+				if (i != PRIMARY_NODE_ID)
+					total_weight += weights[i];
+			}
+			else
+				total_weight += weights[i];
+		}
+	}
+
+#if defined(sun) || defined(__sun)
+	r = (((double) rand()) / RAND_MAX) * total_weight;
+#else
+	r = (((double) random()) / RAND_MAX) * total_weight;
+#endif
+
+	total_weight = 0.0;
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if ((exclude_primary && i == PRIMARY_NODE_ID) || i == exclude_node_id)
+			continue;
+
+		if (VALID_BACKEND_RAW(i) && weights[i] > 0.0)
+		{
+			if (r >= total_weight)
+				selected_slot = i;
+			else
+				break;
+			total_weight += weights[i];
+		}
+	}
+
+	return selected_slot;
+}
+
+/*
+ * Cost of sending one more query to the node: queries already in flight
+ * times recent latency, relative to backend_weight.  A node which has not
+ * answered any query yet is assumed to be fast.
+ */
+static double
+node_load_score(int node_id)
+{
+	double		inflight = stat_get_inflight_count(node_id);
+	double		latency = stat_get_latency(node_id);
+
+	return (inflight + 1) * (latency + 1) / BACKEND_INFO(node_id).backend_weight;
+}
+
+/*
+ * Choose a node for load_balance_algorithm = least_loaded.  This is "power
+ * of two choices": two nodes are drawn at random in proportion to
+ * backend_weight, and the one with the lower node_load_score() wins.
+ * Comparing only a random pair, rather than taking the best node of all,
+ * keeps sessions which start at the same time from all piling on the
+ * same node, while slow or busy nodes still get much less traffic than
+ * their weight alone would give them.
+ */
+static int
+choose_least_loaded_node(bool exclude_primary, int exclude_node_id)
+{
+	int			node1;
+	int			node2;
+
+	node1 = choose_weighted_random_node(exclude_primary, exclude_node_id);
+	node2 = choose_weighted_random_node(exclude_primary, exclude_node_id);
+
+	if (node1 == node2 || BACKEND_INFO(node2).backend_weight <= 0.0)
+		return node1;
+	if (BACKEND_INFO(node1).backend_weight <= 0.0)
+		return node2;
+
+	ereport(DEBUG1,
+			(errmsg("selecting load balance node"),
+			 errdetail("node %d: in flight %u latency %llu us, node %d: in flight %u latency %llu us",
+					   node1, stat_get_inflight_count(node1),
+					   (unsigned long long) stat_get_latency(node1),
+					   node2, stat_get_inflight_count(node2),
+					   (unsigned long long) stat_get_latency(node2))));
+
+	return node_load_score(node2) < node_load_score(node1) ? node2 : node1;
+}
+
 /*
  * Select load balancing node. This function is called when:
  * 1) client connects
@@ -554,46 +792,12 @@ select_load_balancing_node(void)
 	}
 
 	/* Choose a backend in random manner with weight */
-	selected_slot = MAIN_NODE_ID;
-	total_weight = 0.0;
-
-	for (i = 0; i < NUM_BACKENDS; i++)
-	{
-		if (VALID_BACKEND_RAW(i))
-		{
-			if (i == no_load_balance_node_id)
-				continue;
-			if (suggested_node_id == -1)
-			{
-				if (i != PRIMARY_NODE_ID)
-					total_weight += BACKEND_INFO(i).backend_weight;
-			}
-			else
-				total_weight += BACKEND_INFO(i).backend_weight;
-		}
-	}
-
-#if defined(sun) || defined(__sun)
-	r = (((double) rand()) / RAND_MAX) * total_weight;
-#else
-	r = (((double) random()) / RAND_MAX) * total_weight;
-#endif
-
-	total_weight = 0.0;
-	for (i = 0; i < NUM_BACKENDS; i++)
-	{
-		if ((suggested_node_id == -1 && i == PRIMARY_NODE_ID) || i == no_load_balance_node_id)
-			continue;
-
-		if (VALID_BACKEND_RAW(i) && BACKEND_INFO(i).backend_weight > 0.0)
-		{
-			if (r >= total_weight)
-				selected_slot = i;
-			else
-				break;
-			total_weight += BACKEND_INFO(i).backend_weight;
-		}
-	}
+	if (pool_config->load_balance_algorithm == LB_ALGORITHM_LEAST_LOADED)
+		selected_slot = choose_least_loaded_node(suggested_node_id == -1,
+												 no_load_balance_node_id);
+	else
+		selected_slot = choose_weighted_random_node(suggested_node_id == -1,
+													no_load_balance_node_id);
 
 	/*
 	 * If Streaming Replication mode and delay_threshold and
@@ -693,6 +897,8 @@ Pgversion(POOL_CONNECTION_POOL * backend)
 	static	PGVersion	pgversion;
 	static	POOL_RELCACHE *relcache;
 	char	*result;
+	char	shared_version[MAX_PG_VERSION_STRING + 1];
+	int		node_id;
 	char	*p;
 	char	buf[VERSION_BUF_SIZE];
 	int		i;
@@ -710,32 +916,47 @@ Pgversion(POOL_CONNECTION_POOL * backend)
 		return &pgversion;
 	}
 
-	if (!relcache)
+	/*
+	 * The relcache refresh worker may have fetched the version of the node
+	 * already.
+	 */
+	node_id = (STREAM && PRIMARY_NODE_ID >= 0) ? PRIMARY_NODE_ID : MAIN_NODE_ID;
+	if (pool_shared_relcache_server_version(node_id, shared_version, sizeof(shared_version)))
 	{
+		ereport(DEBUG5,
+				(errmsg("Pgversion: shared memory returned")));
+
+		result = shared_version;
+	}
+	else
+	{
+		if (!relcache)
+		{
+			/*
+			 * Create relcache.
+			 */
+			relcache = pool_create_relcache(pool_config->relcache_size, PGVERSION_QUERY,
+											string_register_func, string_unregister_func, false);
+			if (relcache == NULL)
+			{
+				ereport(FATAL,
+						(errmsg("Pgversion: unable to create relcache while getting PostgreSQL version.")));
+				return NULL;
+			}
+		}
+
 		/*
-		 * Create relcache.
+		 * Search relcache.
 		 */
-		relcache = pool_create_relcache(pool_config->relcache_size, "SELECT pg_catalog.version()",
-										string_register_func, string_unregister_func, false);
-		if (relcache == NULL)
+		result = (char *)pool_search_relcache(relcache, backend, "version");
+		if (result == 0)
 		{
 			ereport(FATAL,
-					(errmsg("Pgversion: unable to create relcache while getting PostgreSQL version.")));
+					(errmsg("Pgversion: unable to search relcache while getting PostgreSQL version.")));
 			return NULL;
 		}
 	}
 
-	/*
-	 * Search relcache.
-	 */
-	result = (char *)pool_search_relcache(relcache, backend, "version");
-	if (result == 0)
-	{
-		ereport(FATAL,
-				(errmsg("Pgversion: unable to search relcache while getting PostgreSQL version.")));
-		return NULL;
-	}
-
 	ereport(DEBUG5,
 			(errmsg("Pgversion: version string: %s", result)));
 
@@ -906,23 +1127,102 @@ choose_db_node_id(char *str)
 #endif
 
 /*
- * Enter critical region. All SI operations must be protected by this.
+ * Snapshot acquisitions and commits must not overlap: any number of
+ * children may acquire snapshots at the same time, and any number of
+ * children may commit at the same time, but a child wanting to acquire a
+ * snapshot waits while commits are in progress and vice versa.  Both
+ * counts live in one word of shmem, so joining or leaving a group is a
+ * single atomic operation and children of the same group never wait for
+ * each other.
+ */
+#define SI_SNAPSHOT_ONE			1
+#define SI_COMMIT_ONE			(1 << 16)
+#define SI_SNAPSHOT_COUNT(s)	((s) & 0xffff)
+#define SI_COMMIT_COUNT(s)		((s) >> 16)
+
+/*
+ * Join the snapshot acquiring group or, if commit is true, the committing
+ * group.  Waits until the other group becomes empty.
  */
 static void
-si_enter_critical_region(void)
+si_join_group(bool commit)
 {
-	elog(SI_DEBUG_LOG_LEVEL, "si_enter_critical_region called");
-	pool_semaphore_lock(SI_CRITICAL_REGION_SEM);
+	uint32		one = commit ? SI_COMMIT_ONE : SI_SNAPSHOT_ONE;
+	volatile pid_t *waiting = commit ? si_manage_info->snapshot_waiting_children :
+		si_manage_info->commit_waiting_children;
+	uint32		state;
+	bool		registered = false;
+
+	state = pool_atomic_read_u32(&si_manage_info->state);
+	for (;;)
+	{
+		bool		blocked = commit ? SI_SNAPSHOT_COUNT(state) > 0 : SI_COMMIT_COUNT(state) > 0;
+
+		if (!blocked)
+		{
+			if (pool_atomic_compare_exchange_u32(&si_manage_info->state, &state, state + one))
+				break;
+			continue;
+		}
+
+		/*
+		 * Ask the last child leaving the other group to wake us up, then
+		 * check again in case it left before seeing the request.
+		 */
+		if (!registered)
+		{
+			waiting[my_proc_id] = getpid();
+			pool_memory_barrier();
+			registered = true;
+			state = pool_atomic_read_u32(&si_manage_info->state);
+			continue;
+		}
+
+		elog(SI_DEBUG_LOG_LEVEL, "si_join_group: waiting: commit: %d state: %x", commit, state);
+		sleep(1);
+		waiting[my_proc_id] = getpid();
+		pool_memory_barrier();
+		state = pool_atomic_read_u32(&si_manage_info->state);
+	}
+
+	if (registered)
+		waiting[my_proc_id] = 0;
+
+	elog(SI_DEBUG_LOG_LEVEL, "si_join_group: joined: commit: %d state: %x", commit, state + one);
 }
 
 /*
- * Leave critical region.
+ * Leave the group joined by si_join_group().  The last child leaving
+ * wakes up the children waiting for the group to become empty.
  */
 static void
-si_leave_critical_region(void)
+si_leave_group(bool commit)
 {
-	elog(SI_DEBUG_LOG_LEVEL, "si_leave_critical_region called");
-	pool_semaphore_unlock(SI_CRITICAL_REGION_SEM);
+	uint32		one = commit ? SI_COMMIT_ONE : SI_SNAPSHOT_ONE;
+	volatile pid_t *waiting = commit ? si_manage_info->commit_waiting_children :
+		si_manage_info->snapshot_waiting_children;
+	uint32		state;
+	int			i;
+
+	state = pool_atomic_fetch_sub_u32(&si_manage_info->state, one) - one;
+
+	elog(SI_DEBUG_LOG_LEVEL, "si_leave_group: commit: %d state: %x", commit, state);
+
+	if ((commit ? SI_COMMIT_COUNT(state) : SI_SNAPSHOT_COUNT(state)) > 0)
+		return;
+
+	/* wakeup all waiting children */
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		pid_t		pid = waiting[i];
+
+		if (pid > 0)
+		{
+			elog(SI_DEBUG_LOG_LEVEL, "si_leave_group: send SIGUSR2 to %d", pid);
+			kill(pid, SIGUSR2);
+			waiting[i] = 0;
+		}
+	}
 }
 
 /*
@@ -959,26 +1259,7 @@ si_acquire_snapshot(void)
 	session = pool_get_session_context(true);
 
 	if (session->si_state == SI_NO_SNAPSHOT)
-	{
-		for (;;)
-		{
-			si_enter_critical_region();
-			elog(SI_DEBUG_LOG_LEVEL, "si_acquire_snapshot called: counter: %d", si_manage_info->snapshot_counter);
-
-			if (si_manage_info->commit_counter > 0)
-			{
-				si_manage_info->commit_waiting_children[my_proc_id] = getpid();
-				si_leave_critical_region();
-				elog(SI_DEBUG_LOG_LEVEL, "si_acquire_snapshot left critical region");
-				sleep(1);
-			}
-			else
-				break;
-		}
-		si_manage_info->snapshot_counter++;
-
-		si_leave_critical_region();
-	}
+		si_join_group(false);
 }
 
 /*
@@ -988,34 +1269,12 @@ void
 si_snapshot_acquired(void)
 {
 	POOL_SESSION_CONTEXT *session;
-	int		i;
 
 	session = pool_get_session_context(true);
 
 	if (session->si_state == SI_NO_SNAPSHOT)
 	{
-		si_enter_critical_region();
-
-		elog(SI_DEBUG_LOG_LEVEL, "si_snapshot_acquired called: counter: %d", si_manage_info->snapshot_counter);
-
-		si_manage_info->snapshot_counter--;
-
-		if (si_manage_info->snapshot_counter == 0)
-		{
-			/* wakeup all waiting children */
-			for (i = 0; i < pool_config->num_init_children ; i++)
-			{
-				pid_t pid = si_manage_info->snapshot_waiting_children[i];
-				if (pid > 0)
-				{
-					elog(SI_DEBUG_LOG_LEVEL, "si_snapshot_acquired: send SIGUSR2 to %d", pid);
-					kill(pid, SIGUSR2);
-					si_manage_info->snapshot_waiting_children[i] = 0;
-				}
-			}
-		}
-
-		si_leave_critical_region();
+		si_leave_group(false);
 		session->si_state = SI_SNAPSHOT_PREPARED;
 	}
 }
@@ -1033,25 +1292,7 @@ si_commit_request(void)
 	elog(SI_DEBUG_LOG_LEVEL, "si_commit_request called");
 
 	if (session->si_state == SI_SNAPSHOT_PREPARED)
-	{
-		for (;;)
-		{
-			si_enter_critical_region();
-			if (si_manage_info->snapshot_counter > 0)
-			{
-				si_manage_info->snapshot_waiting_children[my_proc_id] = getpid();
-				si_leave_critical_region();
-				sleep(1);
-			}
-			else
-				break;
-		}
-
-		elog(SI_DEBUG_LOG_LEVEL, "si_commit_request: commit_counter: %d", si_manage_info->commit_counter);
-		si_manage_info->commit_counter++;
-
-		si_leave_critical_region();
-	}
+		si_join_group(true);
 }
 
 /*
@@ -1061,7 +1302,6 @@ void
 si_commit_done(void)
 {
 	POOL_SESSION_CONTEXT *session;
-	int		i;
 
 	session = pool_get_session_context(true);
 
@@ -1069,27 +1309,7 @@ si_commit_done(void)
 
 	if (session->si_state == SI_SNAPSHOT_PREPARED)
 	{
-		si_enter_critical_region();
-
-		elog(SI_DEBUG_LOG_LEVEL, "si_commit_done: commit_counter: %d", si_manage_info->commit_counter);
-		si_manage_info->commit_counter--;
-
-		if (si_manage_info->commit_counter == 0)
-		{
-			/* wakeup all waiting children */
-			for (i = 0; i < pool_config->num_init_children ; i++)
-			{
-				pid_t pid = si_manage_info->commit_waiting_children[i];
-				if (pid > 0)
-				{
-					elog(SI_DEBUG_LOG_LEVEL, "si_commit_done: send SIGUSR2 to %d", pid);
-					kill(pid, SIGUSR2);
-					si_manage_info->commit_waiting_children[i] = 0;
-				}
-			}
-		}
-
-		si_leave_critical_region();
+		si_leave_group(true);
 		session->si_state = SI_NO_SNAPSHOT;
 	}
 }
@@ -1130,3 +1350,77 @@ int	check_replication_delay(int node_id)
 	return 0;
 }
 
+
+/*
+ * Convert text form of a WAL location, e.g. "0/16B3D48", to 64bit
+ * integer.  Returns 0 if the text is not a WAL location.
+ */
+uint64
+pool_parse_wal_location(const char *text)
+{
+	unsigned int hi;
+	unsigned int lo;
+
+	if (text == NULL || sscanf(text, "%X/%X", &hi, &lo) != 2)
+		return 0;
+	return ((uint64) hi << 32) | lo;
+}
+
+/*
+ * Check whether a read query in this session can be sent to the node
+ * without breaking causal_reads, i.e. whether the node has already
+ * replayed the WAL of the last write done in this session.
+ *
+ * The WAL location of the write is not fetched from the primary at the
+ * time of the write but upon the first read which follows it, so that a
+ * series of writes costs a single extra query.  While the session is in
+ * a transaction on the primary the write may not be committed yet, in
+ * which case false is returned so that the read goes to the primary.
+ */
+bool
+check_causal_read(int node_id)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_CONNECTION_POOL *backend;
+	POOL_SELECT_RESULT *res;
+
+	if (!STREAM || !pool_config->causal_reads || node_id == PRIMARY_NODE_ID)
+		return true;
+
+	session_context = pool_get_session_context(true);
+	if (!session_context)
+		return true;
+
+	if (session_context->causal_lsn_needed)
+	{
+		backend = session_context->backend;
+
+		if (!VALID_BACKEND(PRIMARY_NODE_ID) ||
+			TSTATE(backend, PRIMARY_NODE_ID) != 'I')
+			return false;
+
+		if (Pgversion(backend)->major >= 100)
+			do_query(CONNECTION(backend, PRIMARY_NODE_ID),
+					 "SELECT pg_catalog.pg_current_wal_insert_lsn()",
+					 &res, MAJOR(backend));
+		else
+			do_query(CONNECTION(backend, PRIMARY_NODE_ID),
+					 "SELECT pg_catalog.pg_current_xlog_insert_location()",
+					 &res, MAJOR(backend));
+
+		if (res->numrows > 0 && res->nullflags[0] != -1)
+			session_context->causal_lsn = pool_parse_wal_location(res->data[0]);
+		free_select_result(res);
+		session_context->causal_lsn_needed = false;
+
+		ereport(DEBUG1,
+				(errmsg("causal reads: WAL location of the last write is %X/%X",
+						(uint32) (session_context->causal_lsn >> 32),
+						(uint32) session_context->causal_lsn)));
+	}
+
+	if (session_context->causal_lsn == 0)
+		return true;
+
+	return pool_get_node_info(node_id)->wal_location >= session_context->causal_lsn;
+}
@@ -0,0 +1,385 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_prepared_statement.c: prepared statements kept on pooled backend
+ * connections.
+ *
+ * When max_pooled_prepared_statements is set, a Parse message for a plain
+ * SELECT/INSERT/UPDATE/DELETE is sent to backends under a name derived
+ * from the query text (see pool_ps_statement_name()) instead of the name
+ * given by the client, and the name is remembered in the registry of each
+ * backend connection.  A later Parse of the same text is answered by
+ * pgpool itself as long as the statement exists on all the target nodes,
+ * so the backends neither parse nor plan it again.  Bind, Describe and
+ * Close messages referring to such a statement are translated when they
+ * are sent to backends.  Close does not deallocate the statement on the
+ * backends, so it can be reused by later Parse messages, and by later
+ * sessions unless the reset queries deallocate all statements.
+ */
+#include <ctype.h>
+#include <string.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "auth/md5.h"
+#include "protocol/pool_prepared_statement.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+
+#define PS_REGISTRY_INITIAL_SIZE	16
+
+static POOL_PS_REGISTRY *get_registry(POOL_CONNECTION_POOL * backend, int node_id);
+static POOL_PS_ENTRY *find_entry(POOL_PS_REGISTRY * registry, const char *server_name);
+static bool query_matches(const char *query, const char *pattern);
+
+/*
+ * Returns true if the statement of the Parse message may be shared with
+ * other Parse messages of the same text.  Statements with side effects at
+ * parse time or on the session are excluded.
+ */
+bool
+pool_ps_is_reusable(POOL_QUERY_CONTEXT * query_context)
+{
+	Node	   *node = query_context->parse_tree;
+
+	if (pool_config->max_pooled_prepared_statements <= 0 || !SL_MODE)
+		return false;
+
+	if (query_context->is_parse_error || query_context->rewritten_query)
+		return false;
+
+	if (IsA(node, SelectStmt))
+		return ((SelectStmt *) node)->intoClause == NULL;
+
+	return IsA(node, InsertStmt) || IsA(node, UpdateStmt) || IsA(node, DeleteStmt);
+}
+
+/*
+ * Compute the server side statement name of a Parse message.  The hash
+ * covers the query text and the parameter types following it, so two
+ * Parse messages share a statement only if the backend would plan them
+ * the same way.  server_name must be POOL_PS_NAME_LEN bytes long.
+ */
+void
+pool_ps_statement_name(int len, char *contents, char *server_name)
+{
+	int			offset = strlen(contents) + 1;
+	char		hexsum[33];
+
+	pool_md5_hash(contents + offset, len - offset, hexsum);
+	snprintf(server_name, POOL_PS_NAME_LEN, "%s%s", POOL_PS_NAME_PREFIX, hexsum);
+}
+
+/*
+ * Look up a statement in the registries of the nodes flagged in "nodes".
+ */
+POOL_PS_STATE
+pool_ps_lookup(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name)
+{
+	int			i;
+	int			num_nodes = 0;
+	int			num_found = 0;
+	int			num_prepared = 0;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_PS_REGISTRY *registry;
+		POOL_PS_ENTRY *entry;
+
+		if (!nodes[i] || !VALID_BACKEND_RAW(i) || !CONNECTION_SLOT(backend, i))
+			continue;
+
+		num_nodes++;
+		registry = get_registry(backend, i);
+		entry = find_entry(registry, server_name);
+		if (entry)
+		{
+			num_found++;
+			if (entry->prepared)
+				num_prepared++;
+		}
+	}
+
+	if (num_nodes > 0 && num_found == 0)
+		return POOL_PS_ABSENT;
+	if (num_nodes > 0 && num_prepared == num_nodes)
+		return POOL_PS_PREPARED;
+	return POOL_PS_UNKNOWN;
+}
+
+/*
+ * Register a statement which is about to be prepared on the nodes flagged
+ * in "nodes".  Returns false without registering anything if the registry
+ * of any of the nodes is full, unless "force" is true.
+ */
+bool
+pool_ps_register(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name, bool force)
+{
+	int			i;
+
+	if (!force)
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			POOL_PS_REGISTRY *registry;
+
+			if (!nodes[i] || !VALID_BACKEND_RAW(i) || !CONNECTION_SLOT(backend, i))
+				continue;
+
+			registry = get_registry(backend, i);
+			if (registry->size >= pool_config->max_pooled_prepared_statements)
+				return false;
+		}
+	}
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_CONNECTION *cp;
+		POOL_PS_REGISTRY *registry;
+		POOL_PS_ENTRY *entry;
+
+		if (!nodes[i] || !VALID_BACKEND_RAW(i) || !CONNECTION_SLOT(backend, i))
+			continue;
+
+		cp = CONNECTION(backend, i);
+		registry = get_registry(backend, i);
+		if (find_entry(registry, server_name))
+			continue;
+
+		if (registry->size >= registry->capacity)
+		{
+			registry->capacity *= 2;
+			registry = repalloc(registry, offsetof(POOL_PS_REGISTRY, entries) +
+								sizeof(POOL_PS_ENTRY) * registry->capacity);
+			cp->ps_registry = registry;
+		}
+
+		entry = &registry->entries[registry->size++];
+		StrNCpy(entry->name, server_name, sizeof(entry->name));
+		entry->prepared = false;
+	}
+
+	return true;
+}
+
+/*
+ * Mark a statement as prepared on the nodes flagged in "nodes".  Called
+ * when ParseComplete is received.
+ */
+void
+pool_ps_confirm(POOL_CONNECTION_POOL * backend, bool *nodes, const char *server_name)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_PS_ENTRY *entry;
+
+		if (!nodes[i] || !CONNECTION_SLOT(backend, i))
+			continue;
+
+		entry = find_entry(CONNECTION(backend, i)->ps_registry, server_name);
+		if (entry)
+			entry->prepared = true;
+	}
+}
+
+/*
+ * Remove the statements whose Parse did not complete.  Must be called only
+ * when no message is pending on the backends, i.e. every Parse sent has
+ * either completed or failed.
+ */
+void
+pool_ps_forget_unconfirmed(POOL_CONNECTION_POOL * backend)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_PS_REGISTRY *registry;
+		int			j;
+		int			k;
+
+		if (!CONNECTION_SLOT(backend, i) || !CONNECTION(backend, i)->ps_registry)
+			continue;
+
+		registry = CONNECTION(backend, i)->ps_registry;
+		for (j = 0, k = 0; j < registry->size; j++)
+		{
+			if (registry->entries[j].prepared)
+				registry->entries[k++] = registry->entries[j];
+		}
+		registry->size = k;
+	}
+}
+
+/*
+ * Forget all the statements.  Called when the backends deallocate all
+ * prepared statements.
+ */
+void
+pool_ps_clear(POOL_CONNECTION_POOL * backend)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (CONNECTION_SLOT(backend, i) && CONNECTION(backend, i)->ps_registry)
+			CONNECTION(backend, i)->ps_registry->size = 0;
+	}
+}
+
+/*
+ * Build a copy of a Parse, Bind, Describe or Close message referring to
+ * statement server_name instead of the statement named by the client.
+ * Describe and Close messages must be for a statement, not a portal.
+ *
+ * Close messages are given the bare name prefix, which never names a
+ * statement: the backend replies with CloseComplete as usual, but keeps
+ * the statement for later Parse messages.
+ *
+ * The result is palloc'd in the current memory context.
+ */
+char *
+pool_ps_rewrite_message(char kind, int len, char *contents, const char *server_name, int *new_len)
+{
+	char	   *msg;
+	int			head;			/* bytes kept before the statement name */
+	int			tail;			/* offset of the bytes kept after it */
+	int			name_len;
+
+	switch (kind)
+	{
+		case 'P':
+			head = 0;
+			break;
+		case 'B':
+			head = strlen(contents) + 1;
+			break;
+		case 'D':
+		case 'C':
+			head = 1;
+			break;
+		default:
+			ereport(ERROR,
+					(errmsg("unable to rewrite prepared statement name"),
+					 errdetail("unexpected message kind '%c'", kind)));
+			return NULL;		/* keep compiler quiet */
+	}
+
+	if (kind == 'C')
+		server_name = POOL_PS_NAME_PREFIX;
+
+	tail = head + strlen(contents + head) + 1;
+	name_len = strlen(server_name) + 1;
+	*new_len = head + name_len + (len - tail);
+
+	msg = palloc(*new_len);
+	memcpy(msg, contents, head);
+	memcpy(msg + head, server_name, name_len);
+	memcpy(msg + head + name_len, contents + tail, len - tail);
+
+	return msg;
+}
+
+/*
+ * Returns true if the query deallocates all prepared statements, like
+ * "DISCARD ALL" does.  Used for reset queries which are sent without
+ * being parsed.
+ */
+bool
+pool_ps_query_drops_statements(const char *query)
+{
+	return query_matches(query, "DISCARD ALL") ||
+		query_matches(query, "DEALLOCATE ALL") ||
+		query_matches(query, "DEALLOCATE PREPARE ALL");
+}
+
+static POOL_PS_REGISTRY *
+get_registry(POOL_CONNECTION_POOL * backend, int node_id)
+{
+	POOL_CONNECTION *cp = CONNECTION(backend, node_id);
+
+	if (cp->ps_registry == NULL)
+	{
+		cp->ps_registry = MemoryContextAlloc(TopMemoryContext,
+											 offsetof(POOL_PS_REGISTRY, entries) +
+											 sizeof(POOL_PS_ENTRY) * PS_REGISTRY_INITIAL_SIZE);
+		cp->ps_registry->size = 0;
+		cp->ps_registry->capacity = PS_REGISTRY_INITIAL_SIZE;
+	}
+	return cp->ps_registry;
+}
+
+/*
+ * The registry is searched linearly.  It is small and the names differ
+ * within the first few bytes after the prefix.
+ */
+static POOL_PS_ENTRY *
+find_entry(POOL_PS_REGISTRY * registry, const char *server_name)
+{
+	int			i;
+
+	if (registry == NULL)
+		return NULL;
+
+	for (i = 0; i < registry->size; i++)
+	{
+		if (!strcmp(registry->entries[i].name, server_name))
+			return &registry->entries[i];
+	}
+	return NULL;
+}
+
+/*
+ * Case insensitive comparison of a query with a pattern, where each space
+ * in the pattern matches any run of white space.  Surrounding white space
+ * and a trailing semicolon are ignored.
+ */
+static bool
+query_matches(const char *query, const char *pattern)
+{
+	const char *q = query;
+	const char *p = pattern;
+
+	while (isspace((unsigned char) *q))
+		q++;
+
+	while (*p)
+	{
+		if (*p == ' ')
+		{
+			if (!isspace((unsigned char) *q))
+				return false;
+			while (isspace((unsigned char) *q))
+				q++;
+		}
+		else if (toupper((unsigned char) *q) != *p)
+			return false;
+		else
+			q++;
+		p++;
+	}
+
+	while (isspace((unsigned char) *q) || *q == ';')
+		q++;
+
+	return *q == '\0';
+}
@@ -45,10 +45,13 @@
 #include "parser/pg_config_manual.h"
 #include "rewrite/pool_timestamp.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_connection_pool.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_prepared_statement.h"
+#include "protocol/pool_notify_hub.h"
 #include "protocol/protocol_defs.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
@@ -59,7 +62,10 @@
 #include "utils/pool_select_walker.h"
 #include "utils/pool_relcache.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_msgbuf.h"
+#include "utils/pool_stage.h"
 #include "utils/statistics.h"
+#include "utils/pool_trace.h"
 #include "context/pool_session_context.h"
 #include "context/pool_query_context.h"
 #include "query_cache/pool_memqcache.h"
@@ -81,6 +87,8 @@
 #define IDLE_SESSION_TIMEOUT_ERROR_CODE "57P05"
 
 static int	reset_backend(POOL_CONNECTION_POOL * backend, int qcnt);
+static bool reset_backend_pipelined(POOL_CONNECTION_POOL * backend);
+static bool reset_query_is_needed(POOL_CONNECTION_POOL * backend, char *query);
 static char *get_insert_command_table_name(InsertStmt *node);
 static bool is_cache_empty(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 static bool is_panic_or_fatal_error(char *message, int major);
@@ -92,8 +100,12 @@ static POOL_STATUS add_lock_target(POOL_CONNECTION * frontend, POOL_CONNECTION_P
 static bool has_lock_target(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *table, bool for_update);
 static POOL_STATUS insert_oid_into_insert_lock(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *table);
 static POOL_STATUS read_packets_and_process(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int reset_request, int *state, short *num_fields, bool *cont);
+static bool wait_for_primary_failover(POOL_CONNECTION_POOL * backend, int node_id);
 static bool is_all_standbys_command_complete(unsigned char *kind_list, int num_backends, int main_node);
 static bool pool_process_notice_message_from_one_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int backend_idx, char kind);
+static int	wait_for_any_backend(POOL_CONNECTION_POOL * backend, bool *pending);
+static unsigned char read_kind_or_forward_async_message(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int i);
+static void do_read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *decided_kind);
 
 /*
  * Main module for query processing
@@ -127,11 +139,10 @@ pool_process_query(POOL_CONNECTION * frontend,
 	state = 0;
 
 
-	/* Try to connect memcached */
-	if ((pool_config->memory_cache_enabled || pool_config->enable_shared_relcache)
-		&& !pool_is_shmem_cache())
+	/* Try to connect memcached or redis */
+	if (pool_config->memory_cache_enabled && !pool_is_shmem_cache())
 	{
-		memcached_connect();
+		pool_cache_storage_connect();
 	}
 
 	/*
@@ -153,9 +164,13 @@ pool_process_query(POOL_CONNECTION * frontend,
 
 			/*
 			 * send query for resetting connection such as "ROLLBACK" "RESET
-			 * ALL"...
+			 * ALL"...  Send all of them at once if we can, otherwise one by
+			 * one.
 			 */
-			st = reset_backend(backend, qcnt);
+			if (qcnt == 0 && reset_backend_pipelined(backend))
+				st = 2;
+			else
+				st = reset_backend(backend, qcnt);
 
 			if (st < 0)			/* error? */
 			{
@@ -196,6 +211,9 @@ pool_process_query(POOL_CONNECTION * frontend,
 
 		check_stop_request();
 
+		/* drop connections to standbys which went down, if any */
+		pool_discard_down_node_connections(backend);
+
 		/*
 		 * If we are in recovery and client_idle_limit_in_recovery is -1, then
 		 * exit immediately.
@@ -456,16 +474,7 @@ pool_process_query(POOL_CONNECTION * frontend,
 		}
 
 		/* reload config file */
-		if (got_sighup)
-		{
-			MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
-
-			pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
-			MemoryContextSwitchTo(oldContext);
-			if (pool_config->enable_pool_hba)
-				load_hba(get_hba_file_name());
-			got_sighup = 0;
-		}
+		check_config_reload();
 	}
 }
 
@@ -638,12 +647,39 @@ send_extended_protocol_message(POOL_CONNECTION_POOL * backend,
 		sendlen = htonl(4);
 		pool_write_and_flush(cp, &sendlen, sizeof(sendlen));
 	}
-	else
+	else if (!pool_backend_flush_deferrable())
 		pool_flush(cp);
 
 	return POOL_CONTINUE;
 }
 
+/*
+ * Return true if flushing extended query messages to backends can be put
+ * off because the frontend has already sent more data, which we are going
+ * to forward right away.  This way a pipelined batch (e.g. a JDBC batch of
+ * Bind/Execute pairs followed by a Sync) reaches the backend in a few large
+ * writes instead of one write(2) per message.  This is only done in
+ * streaming/logical replication mode, where we do not wait for the
+ * response of each message.  Anything left in the write buffer is flushed
+ * before we read from or wait for the backend.
+ */
+bool
+pool_backend_flush_deferrable(void)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_CONNECTION *frontend;
+
+	if (!SL_MODE)
+		return false;
+
+	session_context = pool_get_session_context(true);
+	if (!session_context || !session_context->frontend)
+		return false;
+
+	frontend = session_context->frontend;
+	return pool_ssl_pending(frontend) || !pool_read_buffer_is_empty(frontend);
+}
+
 /*
  * wait until read data is ready
  */
@@ -712,11 +748,29 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 	char	   *p1 = NULL;
 	int			sendlen;
 	int			i;
+	bool		read_others = false;
 	POOL_SESSION_CONTEXT *session_context;
 
 	/* Get session context */
 	session_context = pool_get_session_context(false);
 
+	/*
+	 * If we received a notification message in native replication mode, other
+	 * backends will not receive the message. So we should skip other nodes
+	 * otherwise we will hang in pool_read.
+	 */
+	if (!MAIN_REPLICA || kind != 'A')
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (VALID_BACKEND(i) && !IS_MAIN_NODE_ID(i))
+			{
+				read_others = true;
+				break;
+			}
+		}
+	}
+
 	pool_read(MAIN(backend), &len, sizeof(len));
 
 	len = ntohl(len);
@@ -728,15 +782,23 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 		ereport(ERROR,
 				(errmsg("unable to forward message to frontend"),
 				 errdetail("read from backend failed")));
-	p1 = palloc(len);
-	memcpy(p1, p, len);
 
 	/*
-	 * If we received a notification message in native replication mode, other
-	 * backends will not receive the message. So we should skip other nodes
-	 * otherwise we will hang in pool_read.
+	 * The buffer returned by pool_read2() is only valid until the next read
+	 * from the same connection.  We only need our own copy if the messages of
+	 * the other backends are going to be read, which is not the case in the
+	 * common streaming replication setup.  This saves a copy of every 'D'
+	 * message forwarded to the frontend.
 	 */
-	if (!MAIN_REPLICA || kind != 'A')
+	if (read_others)
+	{
+		p1 = palloc(len);
+		memcpy(p1, p, len);
+	}
+	else
+		p1 = p;
+
+	if (read_others)
 	{
 		for (i = 0; i < NUM_BACKENDS; i++)
 		{
@@ -792,8 +854,16 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 	 * Same thing can be said to CopyData message. Tremendous number of
 	 * CopyData messages are sent to frontend (typical use case is pg_dump).
 	 * So eliminating per CopyData flush significantly enhances performance.
+	 *
+	 * If ReadyForQuery has already arrived after the message, we do not
+	 * flush either, since ReadyForQuery() flushes right away.  This way
+	 * "Command Complete" and "Ready For query" go out in one packet.
 	 */
-	if (kind == 'C' || kind == 'Z' || kind == 'E' || kind == 'N' || kind == 'A' || kind == 'T' || kind == 'n' ||
+	if (kind != 'E' && kind != 'A' && pool_next_buffered_kind(MAIN(backend)) == 'Z')
+	{
+		pool_write(frontend, p1, len1);
+	}
+	else if (kind == 'C' || kind == 'Z' || kind == 'E' || kind == 'N' || kind == 'A' || kind == 'T' || kind == 'n' ||
 		kind == '3')
 	{
 		pool_write_and_flush(frontend, p1, len1);
@@ -841,10 +911,81 @@ SimpleForwardToFrontend(char kind, POOL_CONNECTION * frontend,
 					 errdetail("FATAL error occurred on backend")));
 	}
 
-	pfree(p1);
+	if (read_others)
+		pfree(p1);
 	return POOL_CONTINUE;
 }
 
+/*
+ * Fast path for rows.  Forward the DataRow messages which have already
+ * been received to the frontend as they are, without going through
+ * read_kind_from_backend() and ProcessBackendResponse() for each of them.
+ * Must be called right after a DataRow message has been forwarded.  The
+ * first message of another kind, or one not received completely yet, is
+ * left to the usual path.
+ *
+ * The run of messages in the read buffer of the main node is forwarded,
+ * and added to the query cache, with one copy each.  In native replication
+ * mode the other nodes must have returned as many rows, which are
+ * discarded like SimpleForwardToFrontend() does; all the messages being
+ * DataRow, they need no kind comparison.
+ */
+void
+forward_buffered_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	char	   *p;
+	int			len;
+	int			i;
+	int			nrows;
+	int			n;
+	bool		cache = false;
+
+	if (pool_config->memory_cache_enabled)
+	{
+		/* the temp query cache must exist for the rows to be added */
+		if (pool_is_cache_safe() && !pool_is_cache_exceeded())
+		{
+			if (pool_get_current_cache() == NULL)
+				return;
+			cache = true;
+		}
+	}
+
+	nrows = pool_count_buffered_messages(MAIN(backend), 'D', -1);
+
+	for (i = 0; i < NUM_BACKENDS && nrows > 0; i++)
+	{
+		if (VALID_BACKEND(i) && !IS_MAIN_NODE_ID(i))
+			nrows = pool_count_buffered_messages(CONNECTION(backend, i), 'D', nrows);
+	}
+
+	if (nrows == 0)
+		return;
+
+	p = pool_read_buffered_messages(MAIN(backend), 'D', nrows, &n, &len);
+	pool_write(frontend, p, len);
+	if (cache)
+		memqcache_register_messages(p, len);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i) && !IS_MAIN_NODE_ID(i))
+			pool_read_buffered_messages(CONNECTION(backend, i), 'D', nrows, &n, &len);
+	}
+
+	/* honor a Flush message sent by the frontend like the usual path does */
+	if (SL_MODE && pool_is_doing_extended_query_message())
+	{
+		POOL_PENDING_MESSAGE *msg = pool_pending_message_head_message();
+
+		if (msg && msg->flush_pending)
+			pool_flush(frontend);
+	}
+
+	ereport(DEBUG5,
+			(errmsg("forward_buffered_data_rows: forwarded %d rows", nrows)));
+}
+
 POOL_STATUS
 SimpleForwardToBackend(char kind, POOL_CONNECTION * frontend,
 					   POOL_CONNECTION_POOL * backend,
@@ -1036,8 +1177,6 @@ reset_backend(POOL_CONNECTION_POOL * backend, int qcnt)
 {
 	char	   *query;
 	int			qn;
-	int			i;
-	bool		need_to_abort;
 	POOL_SESSION_CONTEXT *session_context;
 
 	/* Get session context */
@@ -1067,20 +1206,8 @@ reset_backend(POOL_CONNECTION_POOL * backend, int qcnt)
 	}
 
 	query = pool_config->reset_query_list[qcnt];
-	if (!strcmp("ABORT", query))
-	{
-		/* If transaction state are all idle, we don't need to issue ABORT */
-		need_to_abort = false;
-
-		for (i = 0; i < NUM_BACKENDS; i++)
-		{
-			if (VALID_BACKEND(i) && TSTATE(backend, i) != 'I')
-				need_to_abort = true;
-		}
-
-		if (!need_to_abort)
-			return 0;
-	}
+	if (!reset_query_is_needed(backend, query))
+		return 0;
 
 	pool_set_timeout(10);
 
@@ -1105,6 +1232,202 @@ reset_backend(POOL_CONNECTION_POOL * backend, int qcnt)
 	return 1;
 }
 
+/*
+ * Returns true if the reset query has to be issued.  If transaction state
+ * are all idle, we don't need to issue ABORT.  Other queries are not
+ * needed if skip_reset_on_clean_session is on and the client did nothing
+ * which changes the state of the backend sessions.
+ */
+static bool
+reset_query_is_needed(POOL_CONNECTION_POOL * backend, char *query)
+{
+	int			i;
+
+	if (!strcmp("ABORT", query))
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (VALID_BACKEND(i) && TSTATE(backend, i) != 'I')
+				return true;
+		}
+		return false;
+	}
+
+	if (pool_config->skip_reset_on_clean_session && !pool_is_session_state_changed())
+		return false;
+
+	return true;
+}
+
+/*
+ * Send all the queries in reset_query_list to all backends at once and then
+ * read the results, instead of waiting for each query on each backend in
+ * turn.  The queries are sent as separate simple query messages, not
+ * concatenated, since statements like DISCARD ALL refuse to run in the
+ * implicit transaction block of a multi-statement query.
+ *
+ * Returns false without sending anything if the connection is not in a
+ * clean state, e.g. unread data remains from the last query of the client,
+ * or the protocol is not V3.  The caller then falls back to reset_backend().
+ * Errors reported by backends set reset_query_error so that the connection
+ * is not cached.
+ */
+static bool
+reset_backend_pipelined(POOL_CONNECTION_POOL * backend)
+{
+	char	  **queries;
+	int			nqueries = 0;
+	int			i;
+	int			j;
+
+	if (MAJOR(backend) != PROTO_MAJOR_V3)
+		return false;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i) && pool_stacklen(CONNECTION(backend, i)) > 0)
+			return false;
+	}
+	if (!is_backend_cache_empty(backend))
+		return false;
+
+	pool_unset_doing_extended_query_message();
+	reset_variables();
+
+	queries = palloc(sizeof(char *) * (pool_config->num_reset_queries + 1));
+	for (j = 0; j < pool_config->num_reset_queries; j++)
+	{
+		char	   *query = pool_config->reset_query_list[j];
+
+		if (reset_query_is_needed(backend, query))
+			queries[nqueries++] = query;
+	}
+
+	if (nqueries == 0)
+	{
+		pfree(queries);
+		return true;
+	}
+
+	pool_set_timeout(10);
+
+	/* send all the queries to all the backends first */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_CONNECTION *con;
+
+		if (!VALID_BACKEND(i))
+			continue;
+
+		con = CONNECTION(backend, i);
+		for (j = 0; j < nqueries; j++)
+		{
+			int			len = strlen(queries[j]) + 1;
+			int			sendlen = htonl(len + 4);
+
+			pool_write(con, "Q", 1);
+			pool_write(con, &sendlen, sizeof(sendlen));
+			pool_write(con, queries[j], len);
+		}
+		pool_flush(con);
+	}
+
+	/* then collect one ReadyForQuery per query from each backend */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_CONNECTION *con;
+		int			nready = 0;
+
+		if (!VALID_BACKEND(i))
+			continue;
+
+		con = CONNECTION(backend, i);
+		while (nready < nqueries)
+		{
+			char		kind;
+			int			len;
+			char	   *p = NULL;
+
+			pool_read(con, &kind, sizeof(kind));
+			pool_read(con, &len, sizeof(len));
+			len = ntohl(len) - 4;
+			if (len < 0)
+				ereport(ERROR,
+						(errmsg("unable to reset backend status"),
+						 errdetail("invalid message length %d from DB node %d", len, i)));
+			if (len > 0)
+			{
+				p = pool_read2(con, len);
+				if (p == NULL)
+					ereport(ERROR,
+							(errmsg("unable to reset backend status"),
+							 errdetail("could not read from DB node %d", i)));
+			}
+
+			switch (kind)
+			{
+				case 'Z':		/* ReadyForQuery */
+					if (p)
+						con->tstate = *p;
+					nready++;
+					break;
+
+				case 'E':		/* ErrorResponse */
+					if (p && is_panic_or_fatal_error(p, PROTO_MAJOR_V3))
+						ereport(ERROR,
+								(errmsg("unable to reset backend status"),
+								 errdetail("DB node %d reported a fatal error", i)));
+					reset_query_error = true;
+					break;
+
+				case 'S':		/* ParameterStatus */
+					if (p && IS_MAIN_NODE_ID(i))
+					{
+						char	   *name = p;
+						char	   *value = p + strlen(name) + 1;
+						int			pos;
+
+						pool_add_param(&con->params, name, value);
+						if (!strcmp("application_name", name))
+							set_application_name_with_string(pool_find_name(&con->params, name, &pos));
+					}
+					break;
+
+				case 'C':		/* CommandComplete */
+				case 'N':		/* NoticeResponse */
+				case 'A':		/* NotificationResponse */
+					break;
+
+				default:
+					ereport(ERROR,
+							(errmsg("unable to reset backend status"),
+							 errdetail("unexpected message kind '%c' from DB node %d", kind, i)));
+			}
+		}
+	}
+
+	pool_set_timeout(-1);
+
+	/*
+	 * The queries are not processed by handle_query_context(), so check
+	 * ourselves whether they dropped the pooled prepared statements.
+	 */
+	for (j = 0; j < nqueries; j++)
+	{
+		if (pool_ps_query_drops_statements(queries[j]))
+		{
+			pool_ps_clear(backend);
+			break;
+		}
+	}
+	pfree(queries);
+
+	if (pool_config->memory_cache_enabled)
+		pool_discard_current_temp_query_cache();
+
+	return true;
+}
+
 /*
  * Returns true if the SQL statement is regarded as read SELECT from syntax's
  * point of view. However callers need to do additional checking such as if the
@@ -1360,15 +1683,9 @@ pool_send_severity_message(POOL_CONNECTION * frontend, int protoMajor,
 						   int line)
 {
 /*
- * Buffer length for each message part
+ * Max length of each message part, including the field type
  */
-#define MAXMSGBUF 256
-/*
- * Buffer length for result message buffer.
- * Since msg is consisted of 7 parts, msg buffer should be large
- * enough to hold those message parts
-*/
-#define MAXDATA	(MAXMSGBUF+1)*7+1
+#define MAXMSGBUF 255
 
 	socket_set_nonblock(frontend->fd);
 
@@ -1379,73 +1696,52 @@ pool_send_severity_message(POOL_CONNECTION * frontend, int protoMajor,
 	}
 	else if (protoMajor == PROTO_MAJOR_V3)
 	{
-		char		data[MAXDATA];
-		char		msgbuf[MAXMSGBUF + 1];
-		int			len;
-		int			thislen;
-		int			sendlen;
+		POOL_MSGBUF buf;
 
-		len = 0;
-		memset(data, 0, MAXDATA);
-
-		pool_write(frontend, "E", 1);
+		pool_msgbuf_init(&buf);
+		pool_msgbuf_begin(&buf, 'E');
 
 		/* error level */
-		thislen = snprintf(msgbuf, MAXMSGBUF, "S%s", severity);
-		thislen = Min(thislen, MAXMSGBUF);
-		memcpy(data + len, msgbuf, thislen + 1);
-		len += thislen + 1;
+		pool_msgbuf_byte(&buf, 'S');
+		pool_msgbuf_string_max(&buf, severity, MAXMSGBUF - 1);
 
 		/* code */
-		thislen = snprintf(msgbuf, MAXMSGBUF, "C%s", code);
-		thislen = Min(thislen, MAXMSGBUF);
-		memcpy(data + len, msgbuf, thislen + 1);
-		len += thislen + 1;
+		pool_msgbuf_byte(&buf, 'C');
+		pool_msgbuf_string_max(&buf, code, MAXMSGBUF - 1);
 
 		/* message */
-		thislen = snprintf(msgbuf, MAXMSGBUF, "M%s", message);
-		thislen = Min(thislen, MAXMSGBUF);
-		memcpy(data + len, msgbuf, thislen + 1);
-		len += thislen + 1;
+		pool_msgbuf_byte(&buf, 'M');
+		pool_msgbuf_string_max(&buf, message, MAXMSGBUF - 1);
 
 		/* detail */
 		if (detail && *detail != '\0')
 		{
-			thislen = snprintf(msgbuf, MAXMSGBUF, "D%s", detail);
-			thislen = Min(thislen, MAXMSGBUF);
-			memcpy(data + len, msgbuf, thislen + 1);
-			len += thislen + 1;
+			pool_msgbuf_byte(&buf, 'D');
+			pool_msgbuf_string_max(&buf, detail, MAXMSGBUF - 1);
 		}
 
 		/* hint */
 		if (hint && *hint != '\0')
 		{
-			thislen = snprintf(msgbuf, MAXMSGBUF, "H%s", hint);
-			thislen = Min(thislen, MAXMSGBUF);
-			memcpy(data + len, msgbuf, thislen + 1);
-			len += thislen + 1;
+			pool_msgbuf_byte(&buf, 'H');
+			pool_msgbuf_string_max(&buf, hint, MAXMSGBUF - 1);
 		}
 
 		/* file */
-		thislen = snprintf(msgbuf, MAXMSGBUF, "F%s", file);
-		thislen = Min(thislen, MAXMSGBUF);
-		memcpy(data + len, msgbuf, thislen + 1);
-		len += thislen + 1;
+		pool_msgbuf_byte(&buf, 'F');
+		pool_msgbuf_string_max(&buf, file, MAXMSGBUF - 1);
 
 		/* line */
-		thislen = snprintf(msgbuf, MAXMSGBUF, "L%d", line);
-		thislen = Min(thislen, MAXMSGBUF);
-		memcpy(data + len, msgbuf, thislen + 1);
-		len += thislen + 1;
+		pool_msgbuf_byte(&buf, 'L');
+		pool_msgbuf_int_text(&buf, line);
+		pool_msgbuf_byte(&buf, '\0');
 
 		/* stop null */
-		len++;
-		*(data + len - 1) = '\0';
+		pool_msgbuf_byte(&buf, '\0');
 
-		sendlen = len;
-		len = htonl(len + 4);
-		pool_write(frontend, &len, sizeof(len));
-		pool_write_and_flush(frontend, data, sendlen);
+		pool_msgbuf_end(&buf);
+		pool_msgbuf_write(frontend, &buf);
+		pool_flush(frontend);
 	}
 	else
 		ereport(ERROR,
@@ -1457,13 +1753,9 @@ pool_send_severity_message(POOL_CONNECTION * frontend, int protoMajor,
 void
 pool_send_readyforquery(POOL_CONNECTION * frontend)
 {
-	int			len;
+	static const char msg[] = {'Z', 0, 0, 0, 5, 'I'};
 
-	pool_write(frontend, "Z", 1);
-	len = 5;
-	len = htonl(len);
-	pool_write(frontend, &len, sizeof(len));
-	pool_write(frontend, "I", 1);
+	pool_write(frontend, (void *) msg, sizeof(msg));
 	pool_flush(frontend);
 }
 
@@ -2491,6 +2783,7 @@ do_query(POOL_CONNECTION * backend, char *query, POOL_SELECT_RESULT * *result, i
  * 1: table lock is required
  * 2: row lock against sequence table is required
  * 3: row lock against insert_lock table is required
+ * 4: advisory lock on the table oid is required
  */
 int
 need_insert_lock(POOL_CONNECTION_POOL * backend, char *query, Node *node)
@@ -2590,6 +2883,10 @@ need_insert_lock(POOL_CONNECTION_POOL * backend, char *query, Node *node)
 	/*
 	 * Search relcache.
 	 */
+	if (pool_config->insert_lock_method == ILM_ADVISORY_LOCK &&
+		Pgversion(backend)->major >= 91)
+		return pool_search_relcache(relcache, backend, table) == 0 ? 0 : 4;
+
 #ifdef USE_TABLE_LOCK
 	result = pool_search_relcache(relcache, backend, table) == 0 ? 0 : 1;
 #elif USE_SEQUENCE_LOCK
@@ -2606,6 +2903,7 @@ need_insert_lock(POOL_CONNECTION_POOL * backend, char *query, Node *node)
  * 1: Issue LOCK TABLE IN SHARE ROW EXCLUSIVE MODE
  * 2: Issue row lock against sequence table
  * 3: Issue row lock against pgpool_catalog.insert_lock table
+ * 4: Issue pg_advisory_xact_lock() on the table oid
  * "lock_kind == 2" is deprecated because PostgreSQL disallows
  * SELECT FOR UPDATE/SHARE on sequence tables since 2011/06/03.
  * See following threads for more details:
@@ -2729,6 +3027,24 @@ insert_lock(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *qu
 				 errdetail("seq rel name: %s", seq_rel_name)));
 		snprintf(qbuf, sizeof(qbuf), "SELECT 1 FROM %s FOR UPDATE", seq_rel_name);
 	}
+
+	/*
+	 * advisory lock on the table oid?  Unlike the row lock, this needs
+	 * neither the insert_lock table nor a row for the table in it, and
+	 * writes nothing.
+	 */
+	else if (lock_kind == 4)
+	{
+		if (pool_has_to_regclass())
+			snprintf(qbuf, sizeof(qbuf), ADVISORYLOCKQUERY3, INSERT_LOCK_ADVISORY_KEY, table);
+		else if (pool_has_pgpool_regclass())
+			snprintf(qbuf, sizeof(qbuf), ADVISORYLOCKQUERY2, INSERT_LOCK_ADVISORY_KEY, table);
+		else
+		{
+			table = remove_quotes_and_schema_from_relname(table);
+			snprintf(qbuf, sizeof(qbuf), ADVISORYLOCKQUERY, INSERT_LOCK_ADVISORY_KEY, table);
+		}
+	}
 	/* row lock for insert_lock table? */
 	else
 	{
@@ -2770,6 +3086,13 @@ insert_lock(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *qu
 	{
 		do_query(MAIN(backend), qbuf, &result, MAJOR(backend));
 	}
+	else if (lock_kind == 4)
+	{
+		/* taken on the main node only, like the row lock */
+		do_query(MAIN(backend), qbuf, &result, MAJOR(backend));
+		if (result)
+			free_select_result(result);
+	}
 	else
 	{
 		POOL_SELECT_RESULT *result;
@@ -3258,6 +3581,157 @@ is_all_standbys_command_complete(unsigned char *kind_list, int num_backends, int
 	return ok;
 }
 
+/*
+ * Wait until one of the backends marked in "pending" has data to read and
+ * return its node id.  A backend having data in its read buffer is returned
+ * right away.  On poll(2) timeout or error, the first pending node is
+ * returned and pool_read() reports the problem.
+ */
+static int
+wait_for_any_backend(POOL_CONNECTION_POOL * backend, bool *pending)
+{
+	struct pollfd pfds[MAX_NUM_BACKENDS];
+	int			node_ids[MAX_NUM_BACKENDS];
+	int			nfds = 0;
+	int			timeout;
+	int			fds;
+	int			i;
+	PoolStage	stage;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		POOL_CONNECTION *cp;
+
+		if (!pending[i])
+			continue;
+
+		cp = CONNECTION(backend, i);
+		if (pool_ssl_pending(cp) || !pool_read_buffer_is_empty(cp))
+			return i;
+
+		/* make sure that the backend has got everything we sent */
+		if (cp->wbufpo > 0)
+			pool_flush(cp);
+
+		pfds[nfds].fd = cp->fd;
+		pfds[nfds].events = POLLIN | POLLPRI;
+		pfds[nfds].revents = 0;
+		node_ids[nfds] = i;
+		nfds++;
+	}
+
+	if (nfds == 1)
+		return node_ids[0];
+
+	timeout = pool_get_timeout() >= 0 ? pool_get_timeout() * 1000 : -1;
+
+	stage = pool_stage_enter(POOL_STAGE_BACKEND_WAIT);
+	for (;;)
+	{
+		fds = poll(pfds, nfds, timeout);
+		if (fds == -1 && errno == EINTR)
+			continue;
+		break;
+	}
+	pool_stage_leave(stage);
+
+	for (i = 0; fds > 0 && i < nfds; i++)
+	{
+		if (pfds[i].revents)
+			return node_ids[i];
+	}
+
+	return node_ids[0];
+}
+
+/*
+ * Read a message kind from the backend.  If it is a Notice or a
+ * ParameterStatus message, the message is forwarded to the frontend and
+ * the kind is returned so that the caller reads the next kind.
+ */
+static unsigned char
+read_kind_or_forward_async_message(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int i)
+{
+	unsigned char kind;
+	char	   *p,
+			   *value;
+	int			len;
+
+	kind = 0;
+	if (pool_read(CONNECTION(backend, i), &kind, 1))
+	{
+		ereport(FATAL,
+				(return_code(2),
+				 errmsg("failed to read kind from backend %d", i),
+				 errdetail("pool_read returns error")));
+	}
+
+	if (kind == 0)
+	{
+		ereport(FATAL,
+				(return_code(2),
+				 errmsg("failed to read kind from backend %d", i),
+				 errdetail("kind == 0")));
+	}
+
+	ereport(DEBUG5,
+			(errmsg("reading backend data packet kind"),
+			 errdetail("backend:%d kind:'%c'", i, kind)));
+
+	/*
+	 * Read and forward notice messages to frontend
+	 */
+	if (kind == 'N')
+	{
+		ereport(DEBUG5,
+				(errmsg("received log message from backend %d while reading packet kind", i)));
+		pool_process_notice_message_from_one_backend(frontend, backend, i, kind);
+	}
+
+	/*
+	 * Read and forward ParameterStatus messages to frontend
+	 */
+	else if (kind == 'S')
+	{
+		int		len2;
+
+		pool_read(CONNECTION(backend, i), &len, sizeof(len));
+		len2 = len;
+		len = htonl(len) - 4;
+		p = pool_read2(CONNECTION(backend, i), len);
+		if (p)
+		{
+			value = p + strlen(p) + 1;
+			ereport(DEBUG5,
+					(errmsg("ParameterStatus message from backend: %d", i),
+					 errdetail("parameter name: \"%s\" value: \"%s\"", p, value)));
+
+			if (IS_MAIN_NODE_ID(i))
+			{
+				int		pos;
+				pool_add_param(&CONNECTION(backend, i)->params, p, value);
+
+				if (!strcmp("application_name", p))
+				{
+					set_application_name_with_string(pool_find_name(&CONNECTION(backend, i)->params, p, &pos));
+				}
+			}
+			/* forward to frontend */
+			pool_write(frontend, &kind, 1);
+			pool_write(frontend, &len2, sizeof(len2));
+			pool_write_and_flush(frontend, p, len);
+		}
+		else
+		{
+			ereport(WARNING,
+					(errmsg("failed to read parameter status packet from backend %d", i),
+					 errdetail("read from backend failed")));
+		}
+	}
+
+	return kind;
+}
+
 /*
  * read_kind_from_backend: read kind from backends.
  * the "frontend" parameter is used to send "kind mismatch" error message to the frontend.
@@ -3266,6 +3740,14 @@ is_all_standbys_command_complete(unsigned char *kind_list, int num_backends, int
  */
 void
 read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *decided_kind)
+{
+	TRACE_PGPOOL_BACKEND_READ_START();
+	do_read_kind_from_backend(frontend, backend, decided_kind);
+	TRACE_PGPOOL_BACKEND_READ_DONE(*decided_kind);
+}
+
+static void
+do_read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *decided_kind)
 {
 	int			i;
 	unsigned char kind_list[MAX_NUM_BACKENDS];	/* records each backend's kind */
@@ -3287,6 +3769,8 @@ read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backen
 
 	int			num_executed_nodes = 0;
 	int			first_node = -1;
+	bool		pending[MAX_NUM_BACKENDS];	/* kind not read yet */
+	int			num_pending = 0;
 
 	memset(kind_map, 0, sizeof(kind_map));
 
@@ -3392,6 +3876,7 @@ read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backen
 		/* initialize degenerate record */
 		degenerate_node[i] = 0;
 		kind_list[i] = 0;
+		pending[i] = false;
 
 		if (VALID_BACKEND(i))
 		{
@@ -3400,108 +3885,55 @@ read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backen
 			if (first_node < 0)
 				first_node = i;
 
-			do
-			{
-				char	   *p,
-						   *value;
-				int			len;
-
-				kind = 0;
-				if (pool_read(CONNECTION(backend, i), &kind, 1))
-				{
-					ereport(FATAL,
-							(return_code(2),
-							 errmsg("failed to read kind from backend %d", i),
-							 errdetail("pool_read returns error")));
-				}
-
-				if (kind == 0)
-				{
-					ereport(FATAL,
-							(return_code(2),
-							 errmsg("failed to read kind from backend %d", i),
-							 errdetail("kind == 0")));
-				}
-
-				ereport(DEBUG5,
-						(errmsg("reading backend data packet kind"),
-						 errdetail("backend:%d kind:'%c'", i, kind)));
-
-				/*
-				 * Read and forward notice messages to frontend
-				 */
-				if (kind == 'N')
-				{
-					ereport(DEBUG5,
-							(errmsg("received log message from backend %d while reading packet kind", i)));
-					pool_process_notice_message_from_one_backend(frontend, backend, i, kind);
-				}
-
-				/*
-				 * Read and forward ParameterStatus messages to frontend
-				 */
-				else if (kind == 'S')
-				{
-					int		len2;
-
-					pool_read(CONNECTION(backend, i), &len, sizeof(len));
-					len2 = len;
-					len = htonl(len) - 4;
-					p = pool_read2(CONNECTION(backend, i), len);
-					if (p)
-					{
-						value = p + strlen(p) + 1;
-						ereport(DEBUG5,
-								(errmsg("ParameterStatus message from backend: %d", i),
-								 errdetail("parameter name: \"%s\" value: \"%s\"", p, value)));
+			pending[i] = true;
+			num_pending++;
+		}
+	}
 
-						if (IS_MAIN_NODE_ID(i))
-						{
-							int		pos;
-							pool_add_param(&CONNECTION(backend, i)->params, p, value);
+	/*
+	 * Read the kind from whichever backend answers first rather than
+	 * waiting for each node in turn, so that the total wait is that of the
+	 * slowest node.  Notice and ParameterStatus messages are forwarded to
+	 * the frontend as they arrive.
+	 */
+	while (num_pending > 0)
+	{
+		i = wait_for_any_backend(backend, pending);
 
-							if (!strcmp("application_name", p))
-							{
-								set_application_name_with_string(pool_find_name(&CONNECTION(backend, i)->params, p, &pos));
-							}
-						}
-						/* forward to frontend */
-						pool_write(frontend, &kind, 1);
-						pool_write(frontend, &len2, sizeof(len2));
-						pool_write_and_flush(frontend, p, len);
-					}
-					else
-					{
-						ereport(WARNING,
-								(errmsg("failed to read parameter status packet from backend %d", i),
-								 errdetail("read from backend failed")));
-					}
-				}
-			} while (kind == 'S' || kind == 'N');
+		kind = read_kind_or_forward_async_message(frontend, backend, i);
+		if (kind == 'S' || kind == 'N')
+			continue;
 
 #ifdef DEALLOCATE_ERROR_TEST
-			if (i == 1 && kind == 'C' &&
-				pending_function && pending_prepared_portal &&
-				IsA(pending_prepared_portal->stmt, DeallocateStmt))
-				kind = 'E';
+		if (i == 1 && kind == 'C' &&
+			pending_function && pending_prepared_portal &&
+			IsA(pending_prepared_portal->stmt, DeallocateStmt))
+			kind = 'E';
 #endif
 
-			kind_list[i] = kind;
+		kind_list[i] = kind;
+		pending[i] = false;
+		num_pending--;
 
-			ereport(DEBUG5,
-					(errmsg("reading backend data packet kind"),
-					 errdetail("backend:%d of %d kind = '%c'", i, NUM_BACKENDS, kind_list[i])));
+		ereport(DEBUG5,
+				(errmsg("reading backend data packet kind"),
+				 errdetail("backend:%d of %d kind = '%c'", i, NUM_BACKENDS, kind_list[i])));
+	}
 
-			kind_map[kind]++;
+	/* Now that every node has answered, compare the kinds in node order */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
 
-			if (kind_map[kind] > max_count)
-			{
-				max_kind = kind_list[i];
-				max_count = kind_map[kind];
-			}
+		kind = kind_list[i];
+		kind_map[kind]++;
+
+		if (kind_map[kind] > max_count)
+		{
+			max_kind = kind_list[i];
+			max_count = kind_map[kind];
 		}
-		else
-			kind_list[i] = 0;
 	}
 
 	ereport(DEBUG5,
@@ -3814,6 +4246,17 @@ read_kind_from_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backen
 			}
 		}
 
+		/*
+		 * Shards of a statement sent to all of them hold different rows, so
+		 * a statement failing on some shards only says nothing about the
+		 * consistency of the nodes.  Do not degenerate any of them.
+		 */
+		if (query_context && query_context->is_shard_broadcast)
+			ereport(FATAL,
+					(return_code(retcode),
+					 errmsg("statement on sharded table did not succeed on all shards"),
+					 errdetail("%s", msg.data)));
+
 		if (pool_config->replication_stop_on_mismatch)
 		{
 			degenerate_backend_set(degenerate_node, degenerate_node_num, REQ_DETAIL_CONFIRMED);
@@ -4376,6 +4819,7 @@ detect_postmaster_down_error(POOL_CONNECTION * backend, int major)
 		ereport(DEBUG1,
 				(errmsg("detecting postmaster down error"),
 				 errdetail("receive admin shutdown error from a node")));
+		health_check_count_backend_error(backend->db_node_id, false);
 		return r;
 	}
 
@@ -4390,6 +4834,7 @@ detect_postmaster_down_error(POOL_CONNECTION * backend, int major)
 	{
 		ereport(DEBUG1,
 				(errmsg("detect_postmaster_down_error: receive crash shutdown error from a node.")));
+		health_check_count_backend_error(backend->db_node_id, false);
 	}
 	return r;
 }
@@ -4816,41 +5261,57 @@ pool_discard_packet_contents(POOL_CONNECTION_POOL * cp)
 	return POOL_CONTINUE;
 }
 
+/*
+ * Return the events poll(2) reported for fd, or 0 if fd was not polled.
+ */
+static short
+poll_revents(struct pollfd *pfds, int nfds, int fd)
+{
+	int			i;
+
+	for (i = 0; i < nfds; i++)
+	{
+		if (pfds[i].fd == fd)
+			return pfds[i].revents;
+	}
+	return 0;
+}
+
 /*
  * Read packet from either frontend or backend and process it.
  */
 static POOL_STATUS read_packets_and_process(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int reset_request, int *state, short *num_fields, bool *cont)
 {
-	fd_set		readmask;
-	fd_set		writemask;
-	fd_set		exceptmask;
+	struct pollfd pfds[MAX_NUM_BACKENDS + 1];
+	short		revents;
 	int			fds;
-	struct timeval timeoutdata;
-	struct timeval *timeout;
+	int			timeout;
 	int			num_fds,
 				was_error = 0;
 	POOL_STATUS status;
 	int			i;
+	POOL_SESSION_CONTEXT *session_context;
+	PoolStage	stage;
 
 	/*
-	 * frontend idle counters. depends on the following select(2) call's time
+	 * frontend idle counters. depends on the following poll(2) call's time
 	 * out is 1 second.
 	 */
 	int			idle_count = 0; /* for other than in recovery */
 	int			idle_count_in_recovery = 0; /* for in recovery */
 
 SELECT_RETRY:
-	FD_ZERO(&readmask);
-	FD_ZERO(&writemask);
-	FD_ZERO(&exceptmask);
-
 	num_fds = 0;
 
 	if (!reset_request)
 	{
-		FD_SET(frontend->fd, &readmask);
-		FD_SET(frontend->fd, &exceptmask);
-		num_fds = Max(frontend->fd + 1, num_fds);
+		/* forward notifications received by the notification hub */
+		pool_notify_hub_deliver(frontend, backend);
+
+		pfds[num_fds].fd = frontend->fd;
+		pfds[num_fds].events = POLLIN | POLLPRI;
+		pfds[num_fds].revents = 0;
+		num_fds++;
 	}
 
 	/*
@@ -4863,7 +5324,6 @@ SELECT_RETRY:
 		BACKEND_INFO(backend->info->load_balancing_node).backend_status == CON_DOWN)
 	{
 		/* select load balancing node */
-		POOL_SESSION_CONTEXT *session_context;
 		int			node_id;
 
 		session_context = pool_get_session_context(false);
@@ -4880,9 +5340,14 @@ SELECT_RETRY:
 	{
 		if (VALID_BACKEND(i))
 		{
-			num_fds = Max(CONNECTION(backend, i)->fd + 1, num_fds);
-			FD_SET(CONNECTION(backend, i)->fd, &readmask);
-			FD_SET(CONNECTION(backend, i)->fd, &exceptmask);
+			/* send out messages deferred while pipelining */
+			if (CONNECTION(backend, i)->wbufpo > 0)
+				pool_flush(CONNECTION(backend, i));
+
+			pfds[num_fds].fd = CONNECTION(backend, i)->fd;
+			pfds[num_fds].events = POLLIN | POLLPRI;
+			pfds[num_fds].revents = 0;
+			num_fds++;
 		}
 	}
 
@@ -4892,15 +5357,26 @@ SELECT_RETRY:
 	if (pool_config->client_idle_limit > 0 ||
 		pool_config->client_idle_limit_in_recovery > 0 ||
 		pool_config->client_idle_limit_in_recovery == -1)
-	{
-		timeoutdata.tv_sec = 1;
-		timeoutdata.tv_usec = 0;
-		timeout = &timeoutdata;
-	}
+		timeout = 1000;
 	else
-		timeout = NULL;
+		timeout = -1;
 
-	fds = select(num_fds, &readmask, &writemask, &exceptmask, timeout);
+	/* in case the wakeup signal of the notification hub is missed */
+	if (!reset_request && pool_notify_hub_listening())
+		timeout = 1000;
+
+	/*
+	 * With a query in progress we are waiting for the backends, otherwise
+	 * for the client to send the next query.
+	 */
+	session_context = pool_get_session_context(true);
+	if (reset_request || (session_context && session_context->in_progress))
+		stage = pool_stage_enter(POOL_STAGE_BACKEND_WAIT);
+	else
+		stage = pool_stage_enter(POOL_STAGE_CLIENT_READ);
+
+	fds = poll(pfds, num_fds, timeout);
+	pool_stage_leave(stage);
 
 	if (fds == -1)
 	{
@@ -4909,10 +5385,10 @@ SELECT_RETRY:
 
 		ereport(FATAL,
 				(errmsg("unable to read data"),
-				 errdetail("select() system call failed with reason \"%m\"")));
+				 errdetail("poll() system call failed with reason \"%m\"")));
 	}
 
-	/* select timeout */
+	/* poll timeout */
 	if (fds == 0)
 	{
 		backend->info->client_idle_duration++;
@@ -4972,10 +5448,17 @@ SELECT_RETRY:
 				break;
 			}
 
-			if (FD_ISSET(CONNECTION(backend, i)->fd, &readmask))
+			if (poll_revents(pfds, num_fds, CONNECTION(backend, i)->fd) & POOL_POLL_READ_EVENTS)
 			{
 				int			r;
 
+				/*
+				 * the primary of an idle session went away. go back to
+				 * pool_process_query() to reattach the session.
+				 */
+				if (wait_for_primary_failover(backend, i))
+					return POOL_CONTINUE;
+
 				/*
 				 * connection was terminated due to conflict with recovery
 				 */
@@ -5107,12 +5590,14 @@ SELECT_RETRY:
 
 	if (!reset_request)
 	{
-		if (FD_ISSET(frontend->fd, &exceptmask))
+		revents = poll_revents(pfds, num_fds, frontend->fd);
+
+		if (revents & POOL_POLL_EXCEPT_EVENTS)
 			ereport(ERROR,
 					(errmsg("unable to read from frontend socket"),
 					 errdetail("exception occurred on frontend socket")));
 
-		else if (FD_ISSET(frontend->fd, &readmask))
+		else if (revents & POOL_POLL_READ_EVENTS)
 		{
 			status = ProcessFrontendResponse(frontend, backend);
 			if (status != POOL_CONTINUE)
@@ -5120,12 +5605,14 @@ SELECT_RETRY:
 		}
 	}
 
-	if (FD_ISSET(MAIN(backend)->fd, &exceptmask))
+	revents = poll_revents(pfds, num_fds, MAIN(backend)->fd);
+
+	if (revents & POOL_POLL_EXCEPT_EVENTS)
 		ereport(FATAL,
 				(errmsg("unable to read from backend socket"),
 				 errdetail("exception occurred on backend socket")));
 
-	else if (FD_ISSET(MAIN(backend)->fd, &readmask))
+	else if (revents & POOL_POLL_READ_EVENTS)
 	{
 		status = ProcessBackendResponse(frontend, backend, state, num_fields);
 		if (status != POOL_CONTINUE)
@@ -5134,6 +5621,57 @@ SELECT_RETRY:
 	return POOL_CONTINUE;
 }
 
+/*
+ * Called when the connection to a backend becomes readable while waiting
+ * for data.  If the node is the primary, the session is idle and
+ * failover_reattach_timeout is set, check whether the primary has gone
+ * away, and if so wait up to failover_reattach_timeout seconds for the
+ * failover to finish, so that pool_discard_down_node_connections() can
+ * reattach the session to the new primary instead of the session being
+ * terminated.  Returns true if the failover is done, false if the data
+ * should be processed as usual.
+ */
+static bool
+wait_for_primary_failover(POOL_CONNECTION_POOL * backend, int node_id)
+{
+	POOL_CONNECTION *cp = CONNECTION(backend, node_id);
+	int			waited;
+
+	if (pool_config->failover_reattach_timeout <= 0 ||
+		!pool_config->failover_keep_sessions || !STREAM ||
+		node_id != PRIMARY_NODE_ID || !pool_session_reattachable(backend, NULL))
+		return false;
+
+	if (cp->con_info && cp->con_info->swallow_termination == 1)
+		return false;
+
+	if (pool_read_ahead_noerror(cp) > 0)
+	{
+		/* anything but a shutdown notice is processed as usual */
+		if (detect_postmaster_down_error(cp, MAJOR(backend)) != SPECIFIED_ERROR)
+			return false;
+
+		pool_discard_read_buffer(cp);
+		if (pool_config->failover_on_backend_shutdown)
+			notice_backend_error(node_id, REQ_DETAIL_SWITCHOVER);
+	}
+
+	ereport(LOG,
+			(errmsg("lost connection to primary node %d of idle session", node_id),
+			 errdetail("waiting for failover to reattach the session")));
+
+	for (waited = 0; waited < pool_config->failover_reattach_timeout; waited++)
+	{
+		if (BACKEND_INFO(node_id).backend_status == CON_DOWN && !Req_info->switching)
+			return true;
+
+		sleep(1);
+		check_stop_request();
+	}
+
+	return BACKEND_INFO(node_id).backend_status == CON_DOWN && !Req_info->switching;
+}
+
 /*
  * Debugging aid for VALID_BACKEND macro.
  */
@@ -40,6 +40,7 @@
 #include <string.h>
 #include <netinet/in.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "pool.h"
 #include "rewrite/pool_timestamp.h"
@@ -47,13 +48,23 @@
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_connection_pool.h"
+#include "protocol/pool_prepared_statement.h"
+#include "protocol/pool_client_limit.h"
+#include "protocol/pool_notify_hub.h"
 #include "pool_config.h"
 #include "context/pool_session_context.h"
 #include "context/pool_query_context.h"
 #include "utils/elog.h"
 #include "utils/pool_select_walker.h"
 #include "utils/pool_relcache.h"
+#include "utils/pool_shared_relcache.h"
+#include "utils/pool_statement_stats.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_msgbuf.h"
+#include "utils/pool_parse_cache.h"
+#include "utils/statistics.h"
+#include "utils/pool_trace.h"
 #include "utils/ps_status.h"
 #include "utils/pool_signal.h"
 #include "utils/pool_ssl.h"
@@ -81,6 +92,8 @@ int			is_select_pgcatalog = 0;
 int			is_select_for_update = 0;	/* 1 if SELECT INTO or SELECT FOR
 										 * UPDATE */
 
+bool		statement_log_sampled = true;
+
 /*
  * last query string sent to simpleQuery()
  */
@@ -107,12 +120,21 @@ static void pool_discard_except_sync_and_ready_for_query(POOL_CONNECTION * front
 static void si_get_snapshot(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node *node, bool tstate_check);
 
 static bool check_transaction_state_and_abort(char *query, Node *node, POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+static void send_query_limit_error(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+static void send_error_and_ready(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+								 char *code, char *message, char *detail, char *hint);
+static char *normalize_bind_params(char *params, int len, int *result_len);
 
 static bool multi_statement_query(char *buf);
 
 static void check_prepare(List *parse_tree_list, int len, char *contents);
 
 static POOL_QUERY_CONTEXT *create_dummy_query_context(void);
+static void forward_copy_data_to_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int len, char *contents);
+static void sample_statement_log(void);
+static void log_slow_statement(POOL_CONNECTION_POOL * backend, int node_id, int64 elapsed);
+static bool in_failed_transaction(POOL_CONNECTION_POOL * backend, bool *nodes);
+static bool compare_message_length(void);
 
 /*
  * This is the workhorse of processing the pg_terminate_backend function to
@@ -189,18 +211,25 @@ SimpleQuery(POOL_CONNECTION * frontend,
 {
 	static char *sq_config = "pool_status";
 	static char *sq_pools = "pool_pools";
+	static char *sq_pools_active = "pool_pools_active";
+	static char *sq_pools_summary = "pool_pools_summary";
 	static char *sq_processes = "pool_processes";
 	static char *sq_nodes = "pool_nodes";
 	static char *sq_version = "pool_version";
 	static char *sq_cache = "pool_cache";
 	static char *sq_health_check_stats = "pool_health_check_stats";
 	static char *sq_backend_stats = "pool_backend_stats";
+	static char *sq_process_management_stats = "pool_process_management_stats";
+	static char *sq_statements = "pool_statements";
+	static char *sq_memory = "pool_memory";
 	int			commit;
 	List	   *parse_tree_list;
 	Node	   *node = NULL;
 	POOL_STATUS status;
 	int			lock_kind;
+	bool		insert_locked = false;
 	bool		is_likely_select = false;
+	bool		cache_missed = false;
 	int			specific_error = 0;
 
 	POOL_SESSION_CONTEXT *session_context;
@@ -242,7 +271,7 @@ SimpleQuery(POOL_CONNECTION * frontend,
 	query_ps_status(contents, backend);
 
 	/* log query to log file if necessary */
-	if (pool_config->log_statement)
+	if (pool_log_statement_enabled())
 		ereport(LOG, (errmsg("statement: %s", contents)));
 
 	/*
@@ -283,12 +312,14 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			pool_ps_idle_display(backend);
 			pool_set_skip_reading_from_backends();
 			pool_stats_count_up_num_cache_hits();
+			pool_statement_stats_count_cache(pool_statement_stats_slot(contents), true);
 			return POOL_CONTINUE;
 		}
+		cache_missed = true;
 	}
 
 	/* Create query context */
-	query_context = pool_init_query_context();
+	query_context = pool_init_simple_query_context();
 	MemoryContext old_context = MemoryContextSwitchTo(query_context->memory_context);
 
 	/* Is query string long? */
@@ -322,7 +353,7 @@ SimpleQuery(POOL_CONNECTION * frontend,
 	}
 
 	/* Parse SQL string */
-	parse_tree_list = raw_parser(contents, RAW_PARSE_DEFAULT, len, &error, use_minimal);
+	parse_tree_list = pool_parse_cache_raw_parser(contents, len, &error, use_minimal);
 
 	if (len <= LENGTHY_QUERY_STRING)
 	{
@@ -382,6 +413,34 @@ SimpleQuery(POOL_CONNECTION * frontend,
 		 * first parse tree, it will be processed subsequent code path.
 		 */
 		check_prepare(parse_tree_list, len, contents);
+
+		query_context->is_read_only_multi_statement =
+			!query_context->is_parse_error &&
+			pool_multi_statement_is_read_only(parse_tree_list, contents);
+	}
+
+	/*
+	 * Remember if the query may change the state of the backend sessions,
+	 * so that reset_query_list can be skipped otherwise.  We do not know
+	 * what a query we could not parse does.
+	 */
+	if (!pool_is_session_state_changed())
+	{
+		if (query_context->is_parse_error)
+			pool_set_session_state_changed();
+		else
+		{
+			ListCell   *cell;
+
+			foreach(cell, parse_tree_list)
+			{
+				if (pool_changes_session_state(((RawStmt *) lfirst(cell))->stmt))
+				{
+					pool_set_session_state_changed();
+					break;
+				}
+			}
+		}
 	}
 
 	MemoryContextSwitchTo(old_context);
@@ -408,6 +467,19 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			return POOL_CONTINUE;
 		}
 
+		/*
+		 * Apply the per user and per database query limits.  Queries issued
+		 * by pgpool itself, such as reset queries, are not limited.
+		 */
+		if (frontend != NULL && !pool_client_limit_begin_query(backend, true))
+		{
+			send_query_limit_error(frontend, backend);
+			pool_ps_idle_display(backend);
+			pool_query_context_destroy(query_context);
+			pool_set_skip_reading_from_backends();
+			return POOL_CONTINUE;
+		}
+
 		/*
 		 * Create PostgreSQL version cache.  Since the provided query might
 		 * cause a syntax error, we want to issue "SELECT version()" which is
@@ -473,6 +545,16 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			return POOL_CONTINUE;
 		}
 
+		/* LISTEN served by the notification hub? */
+		if (pool_notify_hub_statement(frontend, backend, node,
+									  query_context->is_multi_statement))
+		{
+			pool_ps_idle_display(backend);
+			pool_query_context_destroy(query_context);
+			pool_set_skip_reading_from_backends();
+			return POOL_CONTINUE;
+		}
+
 		/* status reporting? */
 		if (IsA(node, VariableShowStmt))
 		{
@@ -494,7 +576,25 @@ SimpleQuery(POOL_CONNECTION * frontend,
 						(errmsg("SimpleQuery"),
 						 errdetail("pools reporting")));
 
-				pools_reporting(frontend, backend);
+				pools_reporting(frontend, backend, false);
+			}
+			else if (!strcmp(sq_pools_active, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("active pools reporting")));
+
+				pools_reporting(frontend, backend, true);
+			}
+			else if (!strcmp(sq_pools_summary, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("pools summary reporting")));
+
+				pools_summary_reporting(frontend, backend);
 			}
 			else if (!strcmp(sq_processes, vnode->name))
 			{
@@ -546,6 +646,33 @@ SimpleQuery(POOL_CONNECTION * frontend,
 				show_backend_stats(frontend, backend);
 			}
 
+			else if (!strcmp(sq_process_management_stats, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("process management stats")));
+				show_process_management_stats(frontend, backend);
+			}
+
+			else if (!strcmp(sq_statements, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("statement stats")));
+				show_statement_stats(frontend, backend);
+			}
+
+			else if (!strcmp(sq_memory, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("memory usage")));
+				show_memory_usage(frontend, backend);
+			}
+
 			if (is_valid_show_command)
 			{
 				pool_ps_idle_display(backend);
@@ -555,6 +682,10 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			}
 		}
 
+		query_context->statement_stats_slot = pool_statement_stats_slot(contents);
+		if (cache_missed)
+			pool_statement_stats_count_cache(query_context->statement_stats_slot, false);
+
 		/*
 		 * If the table is to be cached, set is_cache_safe TRUE and register
 		 * table oids.
@@ -586,9 +717,11 @@ SimpleQuery(POOL_CONNECTION * frontend,
 
 			/*
 			 * If table is to be cached and the query is DML, save the table
-			 * oid
+			 * oid.  The oids are only used to invalidate the query cache
+			 * automatically.
 			 */
-			if (!query_context->is_parse_error)
+			if (pool_config->memqcache_auto_cache_invalidation &&
+				!query_context->is_parse_error)
 			{
 				num_oids = pool_extract_table_oids(node, &oids);
 
@@ -637,6 +770,58 @@ SimpleQuery(POOL_CONNECTION * frontend,
 							   query_context->parse_tree);
 		}
 
+		/* no single node can answer the statement on sharded tables */
+		if (query_context->shard_error && frontend)
+		{
+			send_error_and_ready(frontend, backend, "0A000",
+								 "cannot route statement on sharded tables",
+								 (char *) query_context->shard_error, "");
+			pool_client_limit_end_query();
+			pool_release_cache_inflight();
+			pool_ps_idle_display(backend);
+			pool_query_context_destroy(query_context);
+			pool_set_skip_reading_from_backends();
+			return POOL_CONTINUE;
+		}
+
+		/*
+		 * A paginated SELECT which missed the cache may be answered from the
+		 * cached result of the same SELECT without LIMIT and OFFSET.
+		 */
+		if (cache_missed && pool_is_cache_safe() && !query_context->is_multi_statement)
+		{
+			bool		foundp;
+			int			node_id = -1;
+			int			i;
+
+			if (!pool_multi_node_to_be_sent(query_context))
+			{
+				for (i = 0; i < NUM_BACKENDS; i++)
+				{
+					if (pool_is_node_to_be_sent(query_context, i))
+					{
+						node_id = i;
+						break;
+					}
+				}
+			}
+
+			status = pool_fetch_paginated_from_memory_cache(frontend, backend, node,
+															node_id, &foundp);
+			if (status != POOL_CONTINUE)
+				return status;
+
+			if (foundp)
+			{
+				pool_client_limit_end_query();
+				pool_release_cache_inflight();
+				pool_ps_idle_display(backend);
+				pool_query_context_destroy(query_context);
+				pool_set_skip_reading_from_backends();
+				return POOL_CONTINUE;
+			}
+		}
+
 		/*
 		 * if this is DROP DATABASE command, send USR1 signal to parent and
 		 * ask it to close all idle connections. XXX This is overkill. It
@@ -712,6 +897,7 @@ SimpleQuery(POOL_CONNECTION * frontend,
 						pool_query_context_destroy(query_context);
 						return status;
 					}
+					insert_locked = true;
 				}
 			}
 		}
@@ -820,12 +1006,19 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			/*
 			 * Optimization effort: If there's only one session, we do not
 			 * need to wait for the main node's response, and could execute
-			 * the query concurrently.  In snapshot isolation mode we cannot
-			 * do this optimization because we need to wait for main node's
-			 * response first.
+			 * the query concurrently.  The same holds for statements which
+			 * cannot get into a deadlock with other sessions: an INSERT
+			 * serialized by insert_lock, which we already hold, and
+			 * statements not taking any lock such as BEGIN or SET.  This is
+			 * controlled by replication_concurrent_dispatch.  In snapshot
+			 * isolation mode we cannot do this optimization because we need
+			 * to wait for main node's response first.
 			 */
-			if (pool_config->num_init_children == 1 &&
-				pool_config->backend_clustering_mode != CM_SNAPSHOT_ISOLATION)
+			if (pool_config->backend_clustering_mode != CM_SNAPSHOT_ISOLATION &&
+				(pool_config->num_init_children == 1 ||
+				 (REPLICATION && pool_config->replication_concurrent_dispatch &&
+				  (insert_locked || is_start_transaction_query(node) ||
+				   (node && IsA(node, VariableSetStmt))))))
 			{
 				/* Send query to all DB nodes at once */
 				status = pool_send_and_wait(query_context, 0, 0);
@@ -968,7 +1161,7 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 							TSTATE(backend, MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID))));
 
 	/* log query to log file if necessary */
-	if (pool_config->log_statement)
+	if (pool_log_statement_enabled())
 		ereport(LOG, (errmsg("statement: %s", query)));
 
 	/*
@@ -976,7 +1169,7 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	 */
 	if (pool_config->memory_cache_enabled && !pool_is_writing_transaction() &&
 		(TSTATE(backend, MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID) != 'E')
-		&& pool_is_likely_select(query))
+		&& pool_query_context_is_likely_select(query_context))
 	{
 		POOL_STATUS status;
 		char	   *search_query = NULL;
@@ -997,30 +1190,44 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		 */
 		if (query_context->is_cache_safe && bind_msg->param_offset && bind_msg->contents)
 		{
-			/* Extract binary contents from bind message */
+			/*
+			 * Extract binary contents from bind message.  Format codes are
+			 * normalized so that equivalent bind messages built differently
+			 * by drivers share the cache entry.
+			 */
 			char	   *query_in_bind_msg = bind_msg->contents + bind_msg->param_offset;
-			char		hex_str[4]; /* 02X chars + white space + null end */
+			static const char hex_digits[] = "0123456789ABCDEF";
+			int			nbytes = bind_msg->len - bind_msg->param_offset;
 			int			i;
+			char	   *normalized;
+
+			normalized = normalize_bind_params(query_in_bind_msg, nbytes, &nbytes);
+			if (normalized)
+				query_in_bind_msg = normalized;
 			int			alloc_len;
+			char	   *p;
 
-			alloc_len = (len / STR_ALLOC_SIZE + 1) * STR_ALLOC_SIZE;
+			/*
+			 * Make room for " " followed by two hex digits per byte at once
+			 * and write them directly to the end of the string.
+			 */
+			alloc_len = ((len + 1 + nbytes * 2) / STR_ALLOC_SIZE + 1) * STR_ALLOC_SIZE;
 			search_query = repalloc(search_query, alloc_len);
+			p = search_query + len - 1;
 
-			for (i = 0; i < bind_msg->len - bind_msg->param_offset; i++)
+			if (nbytes > 0)
+				*p++ = ' ';
+			for (i = 0; i < nbytes; i++)
 			{
-				int			hexlen;
-
-				snprintf(hex_str, sizeof(hex_str), (i == 0) ? " %02X" : "%02X", 0xff & query_in_bind_msg[i]);
-				hexlen = strlen(hex_str);
+				unsigned char c = query_in_bind_msg[i];
 
-				if ((len + hexlen) >= alloc_len)
-				{
-					alloc_len += STR_ALLOC_SIZE;
-					search_query = repalloc(search_query, alloc_len);
-				}
-				strcat(search_query, hex_str);
-				len += hexlen;
+				*p++ = hex_digits[c >> 4];
+				*p++ = hex_digits[c & 0x0f];
 			}
+			*p = '\0';
+			len = p - search_query + 1;
+			if (normalized)
+				pfree(normalized);
 
 			/*
 			 * If bind message is sent again to an existing prepared statement,
@@ -1063,6 +1270,8 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		if (status != POOL_CONTINUE)
 			return status;
 
+		pool_statement_stats_count_cache(query_context->statement_stats_slot, foundp);
+
 		if (foundp)
 		{
 #ifdef DEBUG
@@ -1086,6 +1295,13 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			query_context->skip_cache_commit = false;
 	}
 
+	/*
+	 * Apply the per user and per database query limits.  An Execute message
+	 * cannot be rejected without discarding the messages up to Sync, so it
+	 * always waits.
+	 */
+	pool_client_limit_begin_query(backend, false);
+
 	/* show ps status */
 	query_ps_status(query, backend);
 
@@ -1230,7 +1446,7 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	char	   *stmt;
 	List	   *parse_tree_list;
 	Node	   *node = NULL;
-	POOL_SENT_MESSAGE *msg;
+	POOL_SENT_MESSAGE *msg = NULL;
 	POOL_STATUS status;
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_QUERY_CONTEXT *query_context;
@@ -1257,7 +1473,7 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	/* parse SQL string */
 	MemoryContext old_context = MemoryContextSwitchTo(query_context->memory_context);
 
-	parse_tree_list = raw_parser(stmt, RAW_PARSE_DEFAULT, strlen(stmt),&error,!REPLICATION);
+	parse_tree_list = pool_parse_cache_raw_parser(stmt, strlen(stmt), &error, !REPLICATION);
 
 	if (parse_tree_list == NIL)
 	{
@@ -1298,6 +1514,15 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	}
 	MemoryContextSwitchTo(old_context);
 
+	/*
+	 * A named statement lives until the end of the session, so it has to be
+	 * reset as well as a query changing the session state.
+	 */
+	if (!pool_is_session_state_changed() &&
+		(*name != '\0' || query_context->is_parse_error ||
+		 pool_changes_session_state(((RawStmt *) linitial(parse_tree_list))->stmt)))
+		pool_set_session_state_changed();
+
 	if (parse_tree_list != NIL)
 	{
 		/* Save last query string for logging purpose */
@@ -1316,6 +1541,7 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		 * Start query context
 		 */
 		pool_start_query(query_context, stmt, strlen(stmt) + 1, node);
+		query_context->statement_stats_slot = pool_statement_stats_slot(stmt);
 
 		/*
 		 * Create PostgreSQL version cache.  Since the provided query might
@@ -1341,7 +1567,7 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			int			i;
 
 			/* Check if the query is actually SELECT */
-			is_likely_select = pool_is_likely_select(query_context->original_query);
+			is_likely_select = pool_query_context_is_likely_select(query_context);
 			if (is_likely_select && IsA(node, SelectStmt))
 			{
 				is_select_query = true;
@@ -1361,9 +1587,11 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 
 			/*
 			 * If table is to be cached and the query is DML, save the table
-			 * oid
+			 * oid.  The oids are only used to invalidate the query cache
+			 * automatically.
 			 */
-			if (!is_select_query && !query_context->is_parse_error)
+			if (pool_config->memqcache_auto_cache_invalidation &&
+				!is_select_query && !query_context->is_parse_error)
 			{
 				num_oids = pool_extract_table_oids(node, &oids);
 
@@ -1398,6 +1626,25 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		pool_where_to_send(query_context, query_context->original_query,
 						   query_context->parse_tree);
 
+		/*
+		 * No single node can answer the statement on sharded tables.  Reply
+		 * with an error and skip the messages up to the next Sync, as
+		 * PostgreSQL does for a failed Parse.
+		 */
+		if (query_context->shard_error)
+		{
+			pool_send_error_message(frontend, MAJOR(backend), "0A000",
+									"cannot route statement on sharded tables",
+									(char *) query_context->shard_error, "",
+									__FILE__, __LINE__);
+			pool_flush(frontend);
+			session_context->uncompleted_message = NULL;
+			pool_sent_message_destroy(msg);
+			pool_set_ignore_till_sync();
+			pool_unset_query_in_progress();
+			return POOL_CONTINUE;
+		}
+
 		if (pool_config->disable_load_balance_on_write == DLBOW_DML_ADAPTIVE && strlen(name) != 0)
 			pool_setall_node_to_be_sent(query_context);
 
@@ -1573,21 +1820,79 @@ Parse(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	else if (SL_MODE)
 	{
 		POOL_PENDING_MESSAGE *pmsg;
+		char		server_name[POOL_PS_NAME_LEN];
+		char	   *send_contents = contents;
+		int			send_len = len;
+
+		/*
+		 * Only unnamed statements are shared.  A named statement must exist
+		 * on the backends under its own name, since it can be used by
+		 * EXECUTE and DEALLOCATE, and parsing a name in use must fail.
+		 */
+		server_name[0] = '\0';
+		if (*name == '\0' && pool_ps_is_reusable(query_context))
+		{
+			pool_ps_statement_name(len, contents, server_name);
+
+			switch (pool_ps_lookup(backend, query_context->where_to_send, server_name))
+			{
+				case POOL_PS_PREPARED:
+
+					/*
+					 * The statement exists on all the target nodes.  Reply
+					 * ParseComplete ourselves, which keeps the order of
+					 * responses only if nothing is pending and the backends
+					 * are not skipping messages after an error.
+					 */
+					if (msg != NULL && !pool_pending_message_exists() &&
+						!pool_is_ignore_till_sync() &&
+						!in_failed_transaction(backend, query_context->where_to_send))
+					{
+						static const char parse_complete[] = {'1', 0, 0, 0, 4};
+
+						StrNCpy(msg->server_statement, server_name, sizeof(msg->server_statement));
+						pool_add_sent_message(msg);
+
+						pool_write_and_flush(frontend, (void *) parse_complete, sizeof(parse_complete));
+						return POOL_CONTINUE;
+					}
+					server_name[0] = '\0';
+					break;
+
+				case POOL_PS_ABSENT:
+					if (pool_ps_register(backend, query_context->where_to_send, server_name, false))
+						send_contents = pool_ps_rewrite_message('P', len, contents, server_name, &send_len);
+					else
+						server_name[0] = '\0';
+					break;
+
+				default:
+					/* being prepared or prepared only on some nodes */
+					server_name[0] = '\0';
+					break;
+			}
+		}
 
 		/*
 		 * XXX fix me:even with streaming replication mode, couldn't we have a
 		 * deadlock
 		 */
 		pool_set_query_in_progress();
-		pool_extended_send_and_wait(query_context, "P", len, contents, 1, MAIN_NODE_ID, true);
-		pool_extended_send_and_wait(query_context, "P", len, contents, -1, MAIN_NODE_ID, true);
+		pool_extended_send_and_wait(query_context, "P", send_len, send_contents, 1, MAIN_NODE_ID, true);
+		pool_extended_send_and_wait(query_context, "P", send_len, send_contents, -1, MAIN_NODE_ID, true);
+		if (msg != NULL)
+			StrNCpy(msg->server_statement, server_name, sizeof(msg->server_statement));
 		pool_add_sent_message(session_context->uncompleted_message);
 
 		/* Add pending message */
 		pmsg = pool_pending_message_create('P', len, contents);
 		pool_pending_message_dest_set(pmsg, query_context);
+		StrNCpy(pmsg->server_statement, server_name, sizeof(pmsg->server_statement));
 		pool_pending_message_add(pmsg);
 
+		if (send_contents != contents)
+			pfree(send_contents);
+
 		pool_unset_query_in_progress();
 	}
 	else
@@ -1606,6 +1911,8 @@ Bind(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	char	   *pstmt_name;
 	char	   *portal_name;
 	char	   *rewrite_msg = NULL;
+	char	   *send_contents;
+	int			send_len;
 	POOL_SENT_MESSAGE *parse_msg;
 	POOL_SENT_MESSAGE *bind_msg;
 	POOL_SESSION_CONTEXT *session_context;
@@ -1739,8 +2046,18 @@ Bind(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	else
 		nowait = false;
 
-	pool_extended_send_and_wait(query_context, "B", len, contents, 1, MAIN_NODE_ID, nowait);
-	pool_extended_send_and_wait(query_context, "B", len, contents, -1, MAIN_NODE_ID, nowait);
+	/* refer to the pooled prepared statement on backends */
+	send_contents = contents;
+	send_len = len;
+	if (parse_msg->server_statement[0] != '\0')
+		send_contents = pool_ps_rewrite_message('B', len, contents,
+												parse_msg->server_statement, &send_len);
+
+	pool_extended_send_and_wait(query_context, "B", send_len, send_contents, 1, MAIN_NODE_ID, nowait);
+	pool_extended_send_and_wait(query_context, "B", send_len, send_contents, -1, MAIN_NODE_ID, nowait);
+
+	if (send_contents != contents)
+		pfree(send_contents);
 
 	if (SL_MODE)
 	{
@@ -1768,6 +2085,8 @@ Describe(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	POOL_SENT_MESSAGE *msg;
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_QUERY_CONTEXT *query_context;
+	char	   *send_contents;
+	int			send_len;
 
 	bool		nowait;
 
@@ -1833,9 +2152,19 @@ Describe(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 
 	nowait = SL_MODE;
 
+	/* refer to the pooled prepared statement on backends */
+	send_contents = contents;
+	send_len = len;
+	if (*contents == 'S' && msg->server_statement[0] != '\0')
+		send_contents = pool_ps_rewrite_message('D', len, contents,
+												msg->server_statement, &send_len);
+
 	pool_set_query_in_progress();
-	pool_extended_send_and_wait(query_context, "D", len, contents, 1, MAIN_NODE_ID, nowait);
-	pool_extended_send_and_wait(query_context, "D", len, contents, -1, MAIN_NODE_ID, nowait);
+	pool_extended_send_and_wait(query_context, "D", send_len, send_contents, 1, MAIN_NODE_ID, nowait);
+	pool_extended_send_and_wait(query_context, "D", send_len, send_contents, -1, MAIN_NODE_ID, nowait);
+
+	if (send_contents != contents)
+		pfree(send_contents);
 
 	if (SL_MODE)
 	{
@@ -1861,6 +2190,8 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	POOL_SENT_MESSAGE *msg;
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_QUERY_CONTEXT *query_context;
+	char	   *send_contents;
+	int			send_len;
 
 	/* Get session context */
 	session_context = pool_get_session_context(false);
@@ -1898,13 +2229,12 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	 */
 	if (!msg)
 	{
-		int			len = htonl(4);
+		static const char close_complete[] = {'3', 0, 0, 0, 4};
 
 		pool_set_command_success();
 		pool_unset_query_in_progress();
 
-		pool_write(frontend, "3", 1);
-		pool_write_and_flush(frontend, &len, sizeof(len));
+		pool_write_and_flush(frontend, (void *) close_complete, sizeof(close_complete));
 
 		return POOL_CONTINUE;
 	}
@@ -1928,12 +2258,22 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	ereport(DEBUG1,
 			(errmsg("Close: waiting for main node completing the query")));
 
+	/*
+	 * A pooled prepared statement is kept on backends for later Parse
+	 * messages.  The Close sent instead only produces CloseComplete.
+	 */
+	send_contents = contents;
+	send_len = len;
+	if (*contents == 'S' && msg->server_statement[0] != '\0')
+		send_contents = pool_ps_rewrite_message('C', len, contents,
+												msg->server_statement, &send_len);
+
 	pool_set_query_in_progress();
 
 	if (!SL_MODE)
 	{
-		pool_extended_send_and_wait(query_context, "C", len, contents, 1, MAIN_NODE_ID, false);
-		pool_extended_send_and_wait(query_context, "C", len, contents, -1, MAIN_NODE_ID, false);
+		pool_extended_send_and_wait(query_context, "C", send_len, send_contents, 1, MAIN_NODE_ID, false);
+		pool_extended_send_and_wait(query_context, "C", send_len, send_contents, -1, MAIN_NODE_ID, false);
 	}
 	else
 	{
@@ -1956,8 +2296,8 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			query_context->where_to_send[session_context->load_balance_node_id] = true;
 		}
 
-		pool_extended_send_and_wait(query_context, "C", len, contents, 1, MAIN_NODE_ID, true);
-		pool_extended_send_and_wait(query_context, "C", len, contents, -1, MAIN_NODE_ID, true);
+		pool_extended_send_and_wait(query_context, "C", send_len, send_contents, 1, MAIN_NODE_ID, true);
+		pool_extended_send_and_wait(query_context, "C", send_len, send_contents, -1, MAIN_NODE_ID, true);
 
 		/* Add pending message */
 		pmsg = pool_pending_message_create('C', len, contents);
@@ -1981,6 +2321,9 @@ Close(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 		pool_set_sent_message_state(msg);
 	}
 
+	if (send_contents != contents)
+		pfree(send_contents);
+
 	return POOL_CONTINUE;
 }
 
@@ -2028,6 +2371,7 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 	Node	   *node = NULL;
 	char	   *query = NULL;
 	bool		got_estate = false;
+	int64		elapsed;
 
 	/*
 	 * It is possible that the "ignore until sync is received" flag was set if
@@ -2209,6 +2553,10 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 				return POOL_END;
 
 			TSTATE(backend, i) = kind;
+			elapsed = stat_query_end(i);
+			if (elapsed >= 0 && pool_config->log_min_duration_statement >= 0 &&
+				elapsed >= (int64) pool_config->log_min_duration_statement * 1000)
+				log_slow_statement(backend, i, elapsed);
 			ereport(DEBUG5,
 					(errmsg("processing ReadyForQuery"),
 					 errdetail("transaction state of node %d '%c'(%02x)", i, kind , kind)));
@@ -2254,19 +2602,32 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 
 	if (send_ready)
 	{
-		pool_write(frontend, "Z", 1);
+		/*
+		 * The backends are done with the query.  Don't let the client hold
+		 * the query limits while it reads the rest of a spooled result.
+		 */
+		pool_client_limit_end_query();
 
 		if (MAJOR(backend) == PROTO_MAJOR_V3)
 		{
-			len = htonl(len);
-			pool_write(frontend, &len, sizeof(len));
-			if (got_estate)
-				state = 'E';
-			pool_write(frontend, &state, 1);
+			char		msg[] = {'Z', 0, 0, 0, 5, 0};
+
+			msg[5] = got_estate ? 'E' : state;
+			pool_write(frontend, msg, sizeof(msg));
 		}
+		else
+			pool_write(frontend, "Z", 1);
+		pool_flush(frontend);
+	}
+	else if (frontend)
+	{
+		/* send out the messages SimpleForwardToFrontend() left for us */
 		pool_flush(frontend);
 	}
 
+	/* The client has its answer, now discard the loser of a hedged read */
+	pool_finish_hedged_read(backend);
+
 	if (pool_is_query_in_progress())
 	{
 		node = pool_get_parse_tree();
@@ -2335,6 +2696,10 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 
 		pool_unset_query_in_progress();
 	}
+
+	/* Let the children waiting for our SELECT result to be cached go */
+	pool_release_cache_inflight();
+
 	if (!pool_is_doing_extended_query_message())
 	{
 		if (!(node && IsA(node, PrepareStmt)))
@@ -2343,6 +2708,22 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 		}
 	}
 
+	/*
+	 * Out of transaction.  Give back the memory of buffers a large message
+	 * has enlarged.
+	 */
+	if (state == 'I')
+	{
+		pool_shrink_buffers(frontend);
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (CONNECTION_SLOT(backend, i))
+				pool_shrink_buffers(CONNECTION(backend, i));
+		}
+		update_buffer_memory(frontend);
+	}
+	update_memory_usage();
+
 	/*
 	 * Show ps idle status
 	 */
@@ -2508,12 +2889,11 @@ ParameterDescription(POOL_CONNECTION * frontend,
 				len1 = 0;
 	char	   *p = NULL;
 	char	   *p1 = NULL;
-	int			sendlen;
 	int			i;
+	POOL_MSGBUF buf;
 
 	POOL_SESSION_CONTEXT *session_context;
 	int			num_params,
-				send_num_params,
 				num_dmy;
 	char		kind = 't';
 
@@ -2568,17 +2948,15 @@ ParameterDescription(POOL_CONNECTION * frontend,
 		}
 	}
 
-	pool_write(frontend, &kind, 1);
-
 	/* send back OIDs of parameters in original query and left are discarded */
-	len = sizeof(int16) + num_params * sizeof(int32);
-	sendlen = htonl(len + sizeof(int32));
-	pool_write(frontend, &sendlen, sizeof(int32));
-
-	send_num_params = htons(num_params);
-	pool_write(frontend, &send_num_params, sizeof(int16));
-
-	pool_write_and_flush(frontend, p1, num_params * sizeof(int32));
+	pool_msgbuf_init(&buf);
+	pool_msgbuf_begin(&buf, kind);
+	pool_msgbuf_int16(&buf, num_params);
+	pool_msgbuf_bytes(&buf, p1, num_params * sizeof(int32));
+	pool_msgbuf_end(&buf);
+	pool_msgbuf_write(frontend, &buf);
+	pool_msgbuf_free(&buf);
+	pool_flush(frontend);
 
 	pfree(p1);
 	return POOL_CONTINUE;
@@ -2760,6 +3138,16 @@ ProcessFrontendResponse(POOL_CONNECTION * frontend,
 		return POOL_CONTINUE;
 	}
 
+	TRACE_PGPOOL_FRONTEND_MESSAGE_START(fkind, len);
+
+	/*
+	 * A simple query, and a Parse or Bind message of an extended query each
+	 * start a statement whose logging is sampled.  Execute follows the
+	 * decision made at Bind.
+	 */
+	if (fkind == 'Q' || fkind == 'P' || fkind == 'B')
+		sample_statement_log();
+
 	pool_unset_doing_extended_query_message();
 
 	/*
@@ -2870,6 +3258,8 @@ ProcessFrontendResponse(POOL_CONNECTION * frontend,
 			break;
 
 		case 'F':				/* FunctionCall */
+			/* we cannot tell what the function does to the session */
+			pool_set_session_state_changed();
 			if (pool_config->log_client_messages)
 			{
 				int			oid;
@@ -2945,6 +3335,8 @@ ProcessFrontendResponse(POOL_CONNECTION * frontend,
 				(return_code(2),
 				 errmsg("unable to process frontend response")));
 
+	TRACE_PGPOOL_FRONTEND_MESSAGE_DONE(fkind, status);
+
 	return status;
 }
 
@@ -3016,6 +3408,14 @@ ProcessBackendResponse(POOL_CONNECTION * frontend,
 						 errdetail("Ready For Query received")));
 				pool_unset_suspend_reading_from_frontend();
 				status = ReadyForQuery(frontend, backend, true, true);
+				pool_client_limit_end_query();
+
+				/*
+				 * Every Parse sent has completed or failed by now unless the
+				 * client has sent more messages after Sync.
+				 */
+				if (SL_MODE && !pool_pending_message_exists())
+					pool_ps_forget_unconfirmed(backend);
 #ifdef DEBUG
 				extern bool stop_now;
 
@@ -3030,6 +3430,9 @@ ProcessBackendResponse(POOL_CONNECTION * frontend,
 					POOL_PENDING_MESSAGE *pmsg;
 
 					pmsg = pool_pending_message_get_previous_message();
+					if (pmsg && pmsg->server_statement[0] != '\0')
+						pool_ps_confirm(backend, pmsg->node_ids, pmsg->server_statement);
+
 					if (pmsg && pmsg->not_forward_to_frontend)
 					{
 						/*
@@ -3176,6 +3579,11 @@ ProcessBackendResponse(POOL_CONNECTION * frontend,
 					pool_unset_query_in_progress();
 				break;
 
+			case 'D':			/* DataRow */
+				status = SimpleForwardToFrontend(kind, frontend, backend);
+				forward_buffered_data_rows(frontend, backend);
+				break;
+
 			default:
 				status = SimpleForwardToFrontend(kind, frontend, backend);
 				break;
@@ -3242,6 +3650,7 @@ ProcessBackendResponse(POOL_CONNECTION * frontend,
 
 			case 'Z':			/* ReadyForQuery */
 				status = ReadyForQuery(frontend, backend, true, true);
+				pool_client_limit_end_query();
 				break;
 
 			default:
@@ -3337,19 +3746,24 @@ CopyDataRows(POOL_CONNECTION * frontend,
 
 				pool_read(frontend, &len, sizeof(len));
 				len = ntohl(len) - 4;
+				if (len < 0)
+					ereport(ERROR,
+							(errmsg("unable to forward message to backend"),
+							 errdetail("invalid message length:%d for message:%c", len, kind)));
 				if (len > 0)
 					contents = pool_read2(frontend, len);
 
-				SimpleForwardToBackend(kind, frontend, backend, len, contents);
-
 				/* CopyData? */
 				if (kind == 'd')
 				{
+					forward_copy_data_to_backend(frontend, backend, len, contents);
 					copy_count++;
 					continue;
 				}
 				else
 				{
+					SimpleForwardToBackend(kind, frontend, backend, len, contents);
+
 					if (pool_config->log_client_messages && copy_count != 0)
 						ereport(LOG,
 								(errmsg("CopyData message from frontend."),
@@ -3468,6 +3882,40 @@ CopyDataRows(POOL_CONNECTION * frontend,
 	return POOL_CONTINUE;
 }
 
+/*
+ * Forward a CopyData message to backends.  Unlike SimpleForwardToBackend(),
+ * the message is only flushed once the frontend has no more data in its
+ * read buffer, i.e. just before we would wait for the frontend.  This way
+ * rows of a bulk load go out to each backend in large writes rather than
+ * one write(2) per row.
+ */
+static void
+forward_copy_data_to_backend(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+							 int len, char *contents)
+{
+	int			sendlen;
+	int			i;
+	bool		flush;
+
+	sendlen = htonl(len + 4);
+	flush = !pool_ssl_pending(frontend) && pool_read_buffer_is_empty(frontend);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND(i))
+		{
+			POOL_CONNECTION *cp = CONNECTION(backend, i);
+
+			pool_write(cp, "d", 1);
+			pool_write(cp, &sendlen, sizeof(sendlen));
+			if (len > 0)
+				pool_write(cp, contents, len);
+			if (flush)
+				pool_flush(cp);
+		}
+	}
+}
+
 /*
  * This function raises intentional error to make backends the same
  * transaction state.
@@ -3658,11 +4106,70 @@ per_node_statement_log(POOL_CONNECTION_POOL * backend, int node_id, char *query)
 {
 	POOL_CONNECTION_POOL_SLOT *slot = backend->slots[node_id];
 
-	if (pool_config->log_per_node_statement)
+	if (pool_log_per_node_statement_enabled())
 		ereport(LOG,
 				(errmsg("DB node id: %d backend pid: %d statement: %s", node_id, ntohl(slot->pid), query)));
 }
 
+/*
+ * Decide whether the statements of the frontend message about to be
+ * processed are logged by log_statement and log_per_node_statement.  One in
+ * log_statement_sample_interval messages is chosen at random, and at most
+ * log_statement_rate_limit of them are logged per second.  Since this is
+ * decided before anything is formatted, statements which are not logged
+ * cost nothing.
+ */
+static void
+sample_statement_log(void)
+{
+	static time_t rate_limit_second = 0;
+	static int	rate_limit_count = 0;
+
+	statement_log_sampled = false;
+
+	if (!pool_config->log_statement && !pool_config->log_per_node_statement)
+		return;
+
+	if (pool_config->log_statement_sample_interval > 1 &&
+		random() % pool_config->log_statement_sample_interval != 0)
+		return;
+
+	if (pool_config->log_statement_rate_limit > 0)
+	{
+		time_t		now = time(NULL);
+
+		if (now != rate_limit_second)
+		{
+			rate_limit_second = now;
+			rate_limit_count = 0;
+		}
+		if (rate_limit_count >= pool_config->log_statement_rate_limit)
+			return;
+		rate_limit_count++;
+	}
+
+	statement_log_sampled = true;
+}
+
+/*
+ * Log a statement which took longer than log_min_duration_statement on a
+ * backend node, from sending it until ReadyForQuery.  Sampling does not
+ * apply to this.
+ */
+static void
+log_slow_statement(POOL_CONNECTION_POOL * backend, int node_id, int64 elapsed)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+	POOL_QUERY_CONTEXT *query_context = session_context ? session_context->query_context : NULL;
+	POOL_CONNECTION_POOL_SLOT *slot = backend->slots[node_id];
+
+	ereport(LOG,
+			(errmsg("DB node id: %d backend pid: %d duration: %.3f ms statement: %s",
+					node_id, ntohl(slot->pid), (double) elapsed / 1000.0,
+					(query_context && query_context->original_query) ?
+					query_context->original_query : "[unknown]")));
+}
+
 /*
  * Make per DB node statement notice message
  */
@@ -3746,6 +4253,39 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION * frontend,
 			new_qc->virtual_main_node_id = PRIMARY_NODE_ID;
 			new_qc->load_balance_node_id = PRIMARY_NODE_ID;
 
+			/*
+			 * A pooled prepared statement has its own name on backends, so
+			 * there is nothing to close and it needs to be prepared on the
+			 * primary only if it is not there yet.
+			 */
+			if (message->server_statement[0] != '\0')
+			{
+				if (pool_ps_lookup(backend, new_qc->where_to_send,
+								   message->server_statement) == POOL_PS_ABSENT)
+				{
+					char	   *ps_contents;
+					int			ps_len;
+
+					pool_ps_register(backend, new_qc->where_to_send,
+									 message->server_statement, true);
+					ps_contents = pool_ps_rewrite_message('P', len, contents,
+														  message->server_statement, &ps_len);
+					pool_extended_send_and_wait(qc, "P", ps_len, ps_contents, 1, PRIMARY_NODE_ID, false);
+					pfree(ps_contents);
+
+					pmsg = pool_pending_message_create('P', len, contents);
+					pmsg->not_forward_to_frontend = true;
+					pool_pending_message_dest_set(pmsg, new_qc);
+					StrNCpy(pmsg->server_statement, message->server_statement,
+							sizeof(pmsg->server_statement));
+					pool_pending_message_add(pmsg);
+				}
+
+				bind_message->query_context = new_qc;
+				message->query_context = new_qc;
+				return POOL_CONTINUE;
+			}
+
 			/*
 			 * Before sending the parse message to the primary, we need to
 			 * close the named statement. Otherwise we will get an error from
@@ -4394,6 +4934,12 @@ pool_at_command_success(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 
 		pool_unset_failed_transaction();
 		pool_unset_transaction_isolation();
+
+		if (pool_get_session_context(false)->shared_relcache_invalidation_pending)
+		{
+			pool_shared_relcache_invalidate();
+			pool_get_session_context(false)->shared_relcache_invalidation_pending = false;
+		}
 	}
 
 	/*
@@ -4439,6 +4985,30 @@ pool_at_command_success(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 			}
 		}
 
+		/*
+		 * With causal_reads, reads following this query must see its
+		 * result.  Remember that the WAL location of the primary has to be
+		 * checked upon the next read.  Session level SET, DISCARD and the
+		 * like do not write WAL, so we do not care about them.
+		 */
+		if (STREAM && pool_config->causal_reads &&
+			!IsA(node, VariableSetStmt) && !IsA(node, DiscardStmt) &&
+			!IsA(node, TransactionStmt))
+			pool_get_session_context(false)->causal_lsn_needed = true;
+
+		/*
+		 * DDL may have changed what relcaches know about tables.  Invalidate
+		 * the shared relcache, which makes all child processes discard
+		 * their local relcaches too.  COPY is not interesting here although
+		 * it is counted as DDL.
+		 */
+		if (pool_is_shared_relcache() && stat_is_ddl(node) && !IsA(node, CopyStmt))
+		{
+			pool_shared_relcache_invalidate();
+			if (TSTATE(backend, MAIN_REPLICA ? PRIMARY_NODE_ID : REAL_MAIN_NODE_ID) == 'T')
+				pool_get_session_context(false)->shared_relcache_invalidation_pending = true;
+		}
+
 		/*
 		 * If the query was CREATE TEMP TABLE, discard temp table relcache
 		 * because we might have had persistent table relation cache which has
@@ -4454,6 +5024,19 @@ pool_at_command_success(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 	}
 }
 
+/*
+ * Returns true if the message lengths of the nodes should be compared.
+ * Only in native replication and snapshot isolation mode all the nodes
+ * are expected to return the same message.  In other modes nodes may
+ * differ legitimately (e.g. ParameterStatus of a standby), and there is
+ * nothing to compare with if there is only one node.
+ */
+static bool
+compare_message_length(void)
+{
+	return REPLICATION && NUM_BACKENDS > 1;
+}
+
 /*
  * read message length (V3 only)
  */
@@ -4472,6 +5055,10 @@ pool_read_message_length(POOL_CONNECTION_POOL * cp)
 			(errmsg("reading message length"),
 			 errdetail("slot: %d length: %d", MAIN_NODE_ID, length0)));
 
+	/*
+	 * The lengths of the other nodes are always compared: the caller reads
+	 * length0 bytes from every node, so a difference would desync them.
+	 */
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		if (!VALID_BACKEND(i) || IS_MAIN_NODE_ID(i))
@@ -4499,7 +5086,7 @@ pool_read_message_length(POOL_CONNECTION_POOL * cp)
 	if (length0 < 0)
 		ereport(ERROR,
 				(errmsg("unable to read message length"),
-				 errdetail("invalid message length (%d)", length)));
+				 errdetail("invalid message length (%d)", length0)));
 
 	return length0;
 }
@@ -4537,7 +5124,7 @@ pool_read_message_length2(POOL_CONNECTION_POOL * cp)
 					(errmsg("reading message length"),
 					 errdetail("main slot: %d length: %d", i, length)));
 
-			if (length != length0)
+			if (length != length0 && compare_message_length())
 			{
 				ereport(DEBUG1,
 						(errmsg("reading message length"),
@@ -4570,6 +5157,9 @@ pool_emit_log_for_message_length_diff(int *length_array, char *name)
 				length;
 	int			i;
 
+	if (!compare_message_length())
+		return;
+
 	length0 = length_array[MAIN_NODE_ID];
 
 	for (i = 0; i < NUM_BACKENDS; i++)
@@ -4754,7 +5344,7 @@ static bool
 check_transaction_state_and_abort(char *query, Node *node, POOL_CONNECTION * frontend,
 								  POOL_CONNECTION_POOL * backend)
 {
-	int		len;
+	static const char ready_for_query_e[] = {'Z', 0, 0, 0, 5, 'E'};
 
 	if (TSTATE(backend, MAIN_NODE_ID) != 'E')
 		return true;
@@ -4784,11 +5374,7 @@ check_transaction_state_and_abort(char *query, Node *node, POOL_CONNECTION * fro
 		pfree(buf.data);
 
 		/* send ready for query to frontend */
-		pool_write(frontend, "Z", 1);
-		len = 5;
-		len = htonl(len);
-		pool_write(frontend, &len, sizeof(len));
-		pool_write(frontend, "E", 1);
+		pool_write(frontend, (void *) ready_for_query_e, sizeof(ready_for_query_e));
 		pool_flush(frontend);
 
 		return false;
@@ -4796,10 +5382,186 @@ check_transaction_state_and_abort(char *query, Node *node, POOL_CONNECTION * fro
 	return true;
 }
 
+/*
+ * Tell the frontend that the query was rejected because of the per user or
+ * per database query limits, and that it can send the next query.
+ */
+static void
+send_query_limit_error(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	send_error_and_ready(frontend, backend, "53400",
+						 "too many queries for user or database",
+						 "",
+						 "query_limit_action is set to reject");
+}
+
+/*
+ * Reply to a simple query rejected by pgpool with an error and tell the
+ * frontend that it can send the next query.
+ */
+static void
+send_error_and_ready(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+					 char *code, char *message, char *detail, char *hint)
+{
+	pool_send_error_message(frontend, MAJOR(backend), code, message,
+							detail, hint, __FILE__, __LINE__);
+
+	if (MAJOR(backend) == PROTO_MAJOR_V3)
+	{
+		char		msg[] = {'Z', 0, 0, 0, 5, 0};
+
+		msg[5] = TSTATE(backend, MAIN_NODE_ID);
+		pool_write(frontend, msg, sizeof(msg));
+	}
+	else
+		pool_write(frontend, "Z", 1);
+	pool_flush(frontend);
+}
+
+/*
+ * Build the query cache key data of the parameters of a Bind message, which
+ * start at "params" (the parameter format codes) and are "len" bytes long.
+ *
+ * The format codes of the parameters and of the result columns can be sent
+ * in more than one way with the same meaning: no code means text, one code
+ * applies to all.  Drivers differ in this, so the codes are normalized to
+ * one code per parameter, and one code for the result columns if they all
+ * share it.  Parameter values are kept as sent since converting text values
+ * to binary would require their data types.
+ *
+ * Returns palloc'd data and its length in *result_len, or NULL if the
+ * message is malformed, in which case the caller uses the raw parameters.
+ */
+static char *
+normalize_bind_params(char *params, int len, int *result_len)
+{
+	char	   *end = params + len;
+	char	   *p = params;
+	int16		num_formats;
+	int16	   *formats;
+	int16		num_params;
+	int16		num_result_formats;
+	int16		n16;
+	int32		n32;
+	char	   *buf;
+	char	   *q;
+	int			i;
+	bool		same_result_format = true;
+
+#define READ_INT16(v) \
+	do { \
+		if (end - p < sizeof(int16)) \
+			return NULL; \
+		memcpy(&n16, p, sizeof(int16)); \
+		v = ntohs(n16); \
+		p += sizeof(int16); \
+	} while (0)
+
+	READ_INT16(num_formats);
+	if (num_formats < 0 || end - p < num_formats * sizeof(int16))
+		return NULL;
+	formats = (int16 *) p;
+	p += num_formats * sizeof(int16);
+
+	READ_INT16(num_params);
+	if (num_params < 0 || (num_formats > 1 && num_formats != num_params))
+		return NULL;
+
+	/*
+	 * The result is never longer than the input plus one format code per
+	 * parameter.
+	 */
+	buf = palloc(len + num_params * sizeof(int16) + sizeof(int16) * 2);
+	q = buf;
+
+	memcpy(q, &n16, sizeof(int16));
+	q += sizeof(int16);
+
+	for (i = 0; i < num_params; i++)
+	{
+		int16		format = 0;
+
+		if (num_formats == 1)
+			memcpy(&format, formats, sizeof(int16));
+		else if (num_formats > 1)
+			memcpy(&format, formats + i, sizeof(int16));
+		format = ntohs(format) ? htons(1) : 0;
+		memcpy(q, &format, sizeof(int16));
+		q += sizeof(int16);
+
+		if (end - p < sizeof(int32))
+		{
+			pfree(buf);
+			return NULL;
+		}
+		memcpy(&n32, p, sizeof(int32));
+		n32 = ntohl(n32);
+		if (n32 > 0 && end - p - sizeof(int32) < n32)
+		{
+			pfree(buf);
+			return NULL;
+		}
+		if (n32 < 0)
+			n32 = 0;			/* NULL */
+		memcpy(q, p, sizeof(int32) + n32);
+		p += sizeof(int32) + n32;
+		q += sizeof(int32) + n32;
+	}
+
+	if (end - p < sizeof(int16))
+	{
+		pfree(buf);
+		return NULL;
+	}
+	memcpy(&n16, p, sizeof(int16));
+	num_result_formats = ntohs(n16);
+	p += sizeof(int16);
+	if (num_result_formats < 0 || end - p < num_result_formats * sizeof(int16))
+	{
+		pfree(buf);
+		return NULL;
+	}
+
+	for (i = 1; i < num_result_formats; i++)
+	{
+		if ((ntohs(((int16 *) p)[i]) != 0) != (ntohs(((int16 *) p)[0]) != 0))
+			same_result_format = false;
+	}
+
+	if (same_result_format)
+	{
+		int16		format = 0;
+
+		if (num_result_formats > 0)
+			memcpy(&format, p, sizeof(int16));
+		n16 = htons(1);
+		memcpy(q, &n16, sizeof(int16));
+		q += sizeof(int16);
+		format = ntohs(format) ? htons(1) : 0;
+		memcpy(q, &format, sizeof(int16));
+		q += sizeof(int16);
+	}
+	else
+	{
+		memcpy(q, p - sizeof(int16), sizeof(int16) * (num_result_formats + 1));
+		q += sizeof(int16) * (num_result_formats + 1);
+	}
+
+#undef READ_INT16
+
+	*result_len = q - buf;
+	return buf;
+}
+
 /*
  * Return true if query in buf is multi statement query.
  * We import PostgreSQL's psqlscan() for the purpose.
  * As far as I know this is the most accurate and cheap way.
+ *
+ * Before running the scanner, look for ';' with memchr().  A query without
+ * any ';' except a trailing one cannot contain multiple statements, which
+ * is the usual case of a lengthy query (e.g. INSERT with many VALUES
+ * lists), and spares lexing the whole string twice.
  */
 static
 bool multi_statement_query(char *queries)
@@ -4810,6 +5572,19 @@ bool multi_statement_query(char *queries)
 	PQExpBufferData lbuf;
 	int		num_semicolons = 0;
 	bool	done = false;
+	size_t	len = strlen(queries);
+	char   *p;
+
+	p = memchr(queries, ';', len);
+	if (p == NULL)
+		return false;
+	for (p++; *p != '\0'; p++)
+	{
+		if (!isspace((unsigned char) *p))
+			break;
+	}
+	if (*p == '\0')
+		return false;
 
 	/*
 	 * callback functions for our flex lexer.  need this to prevent crash when
@@ -4824,7 +5599,7 @@ bool multi_statement_query(char *queries)
 	sstate = psql_scan_create(&psqlscan_callbacks);	/* create scan state */
 
 	/* add the query string to the scan state */
-	psql_scan_setup(sstate, queries, strlen(queries), 0, true);
+	psql_scan_setup(sstate, queries, len, 0, true);
 
 	for (;;)
 	{
@@ -4835,6 +5610,9 @@ bool multi_statement_query(char *queries)
 		{
 			case PSCAN_SEMICOLON:	/* found command-ending semicolon */
 				num_semicolons++;
+				/* no need to scan the rest once we know the answer */
+				if (num_semicolons > 1)
+					done = true;
 				break;
 			case PSCAN_BACKSLASH:	/* found backslash command */
 				break;
@@ -4935,3 +5713,20 @@ POOL_QUERY_CONTEXT *create_dummy_query_context(void)
 
 	return query_context;
 }
+
+/*
+ * Returns true if any of the nodes flagged in "nodes" was in a failed
+ * transaction block when the last ReadyForQuery was received.
+ */
+static bool
+in_failed_transaction(POOL_CONNECTION_POOL * backend, bool *nodes)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (nodes[i] && VALID_BACKEND_RAW(i) && TSTATE(backend, i) == 'E')
+			return true;
+	}
+	return false;
+}
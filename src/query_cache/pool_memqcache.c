@@ -16,7 +16,7 @@
  * suitability of this software for any purpose.  It is provided "as
  * is" without express or implied warranty.
  *
- * pool_memqcache.c: query cache on shmem or memcached
+ * pool_memqcache.c: query cache on shmem, memcached or redis
  *
  */
 #define DATABASE_TO_OID_QUERY "SELECT oid FROM pg_catalog.pg_database WHERE datname = '%s'"
@@ -26,9 +26,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -38,58 +38,75 @@
 #include <arpa/inet.h>
 #include <dirent.h>
 
-#ifdef USE_MEMCACHED
-#include <libmemcached/memcached.h>
+#ifdef USE_LZ4
+#include <lz4.h>
 #endif
 
 #include "auth/md5.h"
+#include "utils/xxhash.h"
 #include "pool_config.h"
 #include "protocol/pool_proto_modules.h"
 #include "protocol/pool_process_query.h"
 #include "parser/parsenodes.h"
+#include "parser/parser.h"
 #include "context/pool_session_context.h"
 #include "query_cache/pool_memqcache.h"
+#include "query_cache/pool_memqcache_storage.h"
 #include "utils/pool_ssl.h"
 #include "utils/pool_relcache.h"
 #include "utils/pool_select_walker.h"
 #include "utils/pool_stream.h"
-#include "utils/pool_stream.h"
+#include "utils/pool_msgbuf.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/pool_ipc.h"
-
-#ifdef USE_MEMCACHED
-memcached_st *memc;
-#endif
-
-static char *encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend);
+#include "utils/pool_atomic.h"
+#include "utils/pool_numa.h"
+#include "utils/pool_stage.h"
+#include "utils/pool_trace.h"
+
+static char *encode_key(const char *s, char *buf, POOL_QUERY_HASH * query_hash, POOL_CONNECTION_POOL * backend);
+static char *add_cache_key_prefix(const char *key, char *data, size_t *len);
+static char *check_cache_key_prefix(const char *key, char *data, size_t *len);
 #ifdef DEBUG
 static void dump_cache_data(const char *data, size_t len);
 #endif
-static int	pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids);
-static int	send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen);
+static int	pool_cache_expire(SelectContext * ctx, int num_oids);
+static int	pool_fetch_cache_any(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len);
+static bool pool_wait_for_cache_inflight(POOL_CONNECTION_POOL * backend, const char *query);
+static char *pool_paginated_whole_query(SelectStmt * stmt, int *offset, int *limit);
+static bool pool_run_paginated_whole_query(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+										   int node_id, Node *node, char *query, char **buf, size_t *len);
+static bool pool_cache_item_needs_refresh(POOL_CACHE_ITEM_HEADER * cih, time_t now);
+static int	pool_fetch_cache_nolock(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len);
+static int	send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen, int offset, int limit);
 static void send_message(POOL_CONNECTION * conn, char kind, int len, const char *data);
-#ifdef USE_MEMCACHED
-static int	delete_cache_on_memcached(const char *key);
-#endif
+static POOL_CACHE_STORAGE * pool_cache_storage(void);
 static int	pool_get_dml_table_oid(int **oid);
 static int	pool_get_dropdb_table_oids(int **oids, int dboid);
 static void pool_discard_dml_table_oid(void);
 static void pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlink, int dboid);
+static void pool_invalidate_query_cache_files(int num_table_oids, int *table_oid, bool unlinkp, int dboid);
+static bool pool_queue_query_cache_invalidation(int num_table_oids, int *table_oids);
 static int	pool_get_database_oid(void);
 static void pool_add_table_oid_map(POOL_CACHEKEY * cachkey, int num_table_oids, int *table_oids);
 static void pool_reset_memqcache_buffer(bool reset_dml_oids);
-static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire);
+static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, unsigned char codec, time_t expire, int partition);
 static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash);
-static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts);
+static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, unsigned char *codec, int *sts);
+static char *pool_compress_cache_data(char *data, int size, int *compressed_size, unsigned char *codec);
+static char *pool_decompress_cache_data(char *data, int *size, unsigned char codec);
 static POOL_QUERY_CACHE_ARRAY * pool_add_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array, POOL_TEMP_QUERY_CACHE * cache);
 static void pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *data, int data_len);
+static bool pool_reserve_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, size_t len);
 static void pool_add_oids_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, int num_oids, int *oids);
 static POOL_INTERNAL_BUFFER * pool_create_buffer(void);
 static void pool_discard_buffer(POOL_INTERNAL_BUFFER * buffer);
 static void pool_add_buffer(POOL_INTERNAL_BUFFER * buffer, void *data, size_t len);
 static void *pool_get_buffer(POOL_INTERNAL_BUFFER * buffer, size_t *len);
+static void *pool_take_buffer(POOL_INTERNAL_BUFFER * buffer, size_t *len);
+static void pool_reset_buffer(POOL_INTERNAL_BUFFER * buffer);
 #ifdef NOT_USED
 static char *pool_get_buffer_pointer(POOL_INTERNAL_BUFFER * buffer);
 #endif
@@ -110,10 +127,18 @@ static int	pool_init_cache_block(POOL_CACHE_BLOCKID blockid);
 static void pool_wipe_out_cache_block(POOL_CACHE_BLOCKID blockid);
 #endif
 static int	pool_delete_item_shmem_cache(POOL_CACHEID * cacheid);
+static void pool_reset_oid_map(void);
+static int	pool_oid_map_add(int dboid, int tableoid, POOL_CACHEID * cacheid);
+static void pool_oid_map_remove_item(POOL_CACHE_ITEM_POINTER * cip);
+static void pool_oid_map_invalidate(int dboid, int tableoid);
+static void pool_oid_map_invalidate_db(int dboid);
 static char *block_address(int blockid);
 static POOL_CACHE_ITEM_POINTER * item_pointer(char *block, int i);
 static POOL_CACHE_ITEM_HEADER * item_header(char *block, int i);
 static POOL_CACHE_BLOCKID pool_reuse_block(void);
+static POOL_CACHE_BLOCKID pool_evict_cache_items(size_t free_space, bool need_hash_element);
+static void pool_compact_cache_block(POOL_CACHE_BLOCKID blockid);
+static void pool_stats_count_up_num_evicted_entries(int num);
 #ifdef SHMEMCACHE_DEBUG
 static void dump_shmem_cache(POOL_CACHE_BLOCKID blockid);
 #endif
@@ -121,10 +146,34 @@ static void dump_shmem_cache(POOL_CACHE_BLOCKID blockid);
 static int	pool_hash_reset(int nelements);
 static int	pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update);
 static uint32 create_hash_key(POOL_QUERY_HASH * key);
+static void pool_hash_begin_update(uint32 hash_key);
+static void pool_hash_end_update(uint32 hash_key);
+static volatile POOL_HASH_ELEMENT *pool_hash_search_element(POOL_QUERY_HASH * key);
+static void pool_hash_touch_element(volatile POOL_HASH_ELEMENT * element);
+static bool pool_hash_age_element(volatile POOL_HASH_ELEMENT * element);
+static int	pool_get_item_shmem_cache_nolock(POOL_QUERY_HASH * query_hash, char **buf, int *size, unsigned char *codec);
 static volatile POOL_HASH_ELEMENT *get_new_hash_element(void);
 static void put_back_hash_element(volatile POOL_HASH_ELEMENT * element);
 static bool is_free_hash_element(void);
 static void inject_cached_message(POOL_CONNECTION * backend, char *qcache, int qcachelen);
+static void pool_sketch_increment(POOL_QUERY_HASH * key);
+static int	pool_sketch_estimate(POOL_QUERY_HASH * key);
+static bool pool_cache_admit(POOL_QUERY_HASH * key, size_t size);
+static void pool_sketch_index(POOL_QUERY_HASH * key, uint32 *index);
+static uint32 pool_cache_epoch(void);
+static void pool_advance_cache_epoch(void);
+static time_t pool_local_cache_expire(POOL_CACHE_ITEM_HEADER * cih);
+static bool pool_local_cache_get(const char *strkey, POOL_QUERY_HASH * query_hash, char **buf, size_t *len);
+static void pool_local_cache_put(const char *strkey, POOL_QUERY_HASH * query_hash, const char *data, size_t len, uint32 epoch);
+static void pool_local_cache_reset(void);
+static uint32 pool_local_cache_bucket(POOL_QUERY_HASH * query_hash);
+static int	pool_cache_partition(const char *database);
+static int	pool_cache_partition_locked(const char *database);
+static POOL_CACHE_PARTITION * pool_session_cache_partition(void);
+static long pool_cache_database_quota(const char *database);
+static bool pool_cache_partition_make_room(int partition, int size);
+static void pool_cache_partition_account(POOL_CACHE_ITEM_HEADER * cih, long size);
+static void pool_cache_partition_reset_usage(void);
 
 /*
  * if true, shared memory is locked in this process now.
@@ -132,70 +181,33 @@ static void inject_cached_message(POOL_CONNECTION * backend, char *qcache, int q
 static int is_shmem_locked;
 
 /*
- * Connect to Memcached
+ * Return the query cache storage other than shmem.
  */
-int
-memcached_connect(void)
+static POOL_CACHE_STORAGE *
+pool_cache_storage(void)
 {
-	char	   *memqcache_memcached_host;
-	int			memqcache_memcached_port;
-#ifdef USE_MEMCACHED
-	memcached_server_st *servers;
-	memcached_return rc;
-
-	/* Already connected? */
-	if (memc)
-	{
-		return 0;
-	}
-#endif
-
-	memqcache_memcached_host = pool_config->memqcache_memcached_host;
-	memqcache_memcached_port = pool_config->memqcache_memcached_port;
-
-	ereport(DEBUG1,
-			(errmsg("connecting to memcached on Host:\"%s:%d\"", memqcache_memcached_host, memqcache_memcached_port)));
-
-#ifdef USE_MEMCACHED
-	memc = memcached_create(NULL);
-	servers = memcached_server_list_append(NULL,
-										   memqcache_memcached_host,
-										   memqcache_memcached_port,
-										   &rc);
+	if (pool_config->memqcache_method == REDIS_CACHE)
+		return &pool_redis_storage;
+	return &pool_memcached_storage;
+}
 
-	rc = memcached_server_push(memc, servers);
-	if (rc != MEMCACHED_SUCCESS)
-	{
-		ereport(WARNING,
-				(errmsg("failed to connect to memcached, server push error:\"%s\"\n", memcached_strerror(memc, rc))));
-		memc = (memcached_st *) - 1;
-		return -1;
-	}
-	memcached_server_list_free(servers);
-#else
-	ereport(WARNING,
-			(errmsg("failed to connect to memcached, memcached support is not enabled")));
-	return -1;
-#endif
-	return 0;
+/*
+ * Connect to the query cache storage other than shmem.  The connection is
+ * kept until the child process exits.
+ */
+int
+pool_cache_storage_connect(void)
+{
+	return pool_cache_storage()->connect();
 }
 
 /*
- * Disconnect to Memcached
+ * Disconnect from the query cache storage other than shmem.
  */
 void
-memcached_disconnect(void)
+pool_cache_storage_disconnect(void)
 {
-#ifdef USE_MEMCACHED
-	if (!memc)
-	{
-		return;
-	}
-	memcached_free(memc);
-#else
-	ereport(WARNING,
-			(errmsg("failed to disconnect from memcached, memcached support is not enabled")));
-#endif
+	pool_cache_storage()->disconnect();
 }
 
 /*
@@ -232,17 +244,37 @@ memqcache_register(char kind,
 }
 
 /*
- * Commit SELECT results to cache storage.
+ * Register a run of whole DataRow messages, kind bytes and lengths
+ * included, as they were received from backend.  This is the format the
+ * temp query cache keeps them in, so they are added in one copy.  The temp
+ * query cache must have been created already.
  */
-static int
-pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids)
+void
+memqcache_register_messages(char *data, int data_len)
+{
+	POOL_TEMP_QUERY_CACHE *cache = pool_get_current_cache();
+
+	if (!pool_reserve_temp_query_cache(cache, data_len))
+		return;
+
+	pool_add_buffer(cache->buffer, data, data_len);
+}
+
+/*
+ * Commit SELECT results to cache storage.  The entry expires in "expire"
+ * seconds, or never if it is 0.  The caller must hold the query cache
+ * lock in exclusive mode.
+ */
+int
+pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int expire)
 {
-#ifdef USE_MEMCACHED
-	memcached_return rc;
-#endif
 	POOL_CACHEKEY cachekey;
+	POOL_QUERY_HASH query_hash;
 	char		tmpkey[MAX_KEY];
+	char	   *strkey;
+	char	   *orig_data = data;
 	time_t		memqcache_expire;
+	int			ret = 0;
 
 	/*
 	 * get_buflen() will return -1 if query result exceeds memqcache_maxcache
@@ -265,15 +297,18 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 #endif
 
 
-	/* encode md5key for memcached */
-	encode_key(query, tmpkey, backend);
+	/* encode hash key for shmem and memcached */
+	strkey = encode_key(query, tmpkey, &query_hash, backend);
 	ereport(DEBUG2,
 			(errmsg("committing SELECT results to cache storage"),
 			 errdetail("search key : \"%s\"", tmpkey)));
 
 	memcpy(cachekey.hashkey, tmpkey, 32);
 
-	memqcache_expire = pool_config->memqcache_expire;
+	/* prepend the cache key to the data if required */
+	data = add_cache_key_prefix(strkey, data, &datalen);
+
+	memqcache_expire = expire;
 	ereport(DEBUG1,
 			(errmsg("committing SELECT results to cache storage"),
 			 errdetail("memqcache_expire = %ld", memqcache_expire)));
@@ -281,28 +316,70 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	if (pool_is_shmem_cache())
 	{
 		POOL_CACHEID *cacheid;
-		POOL_QUERY_HASH query_hash;
-
-		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
 		cacheid = pool_hash_search(&query_hash);
 
+		/*
+		 * If we have been refreshing the item within
+		 * memqcache_stale_while_revalidate, replace it.
+		 */
+		if (cacheid != NULL &&
+			pool_atomic_read_u32(&pool_cache_item_header(cacheid)->refresh_claimed) != 0)
+		{
+			ereport(DEBUG1,
+					(errmsg("committing SELECT results to cache storage"),
+					 errdetail("replacing the item being refreshed")));
+			pool_delete_item_shmem_cache(cacheid);
+			cacheid = NULL;
+		}
+
 		if (cacheid != NULL)
 		{
 			ereport(DEBUG1,
 					(errmsg("committing SELECT results to cache storage"),
 					 errdetail("item already exists")));
 
-			return 0;
+			goto done;
 		}
 		else
 		{
-			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen,memqcache_expire);
+			char	   *cdata;
+			int			clen;
+			unsigned char codec;
+
+			int			partition;
+
+			cdata = pool_compress_cache_data(data, datalen, &clen, &codec);
+			if (!pool_cache_admit(&query_hash, clen))
+			{
+				ereport(DEBUG1,
+						(errmsg("committing SELECT results to cache storage"),
+						 errdetail("not admitted by memqcache_admission_filter")));
+				if (cdata != data)
+					pfree(cdata);
+				goto done;
+			}
+
+			partition = pool_cache_partition(backend->info->database);
+			if (!pool_cache_partition_make_room(partition, clen))
+			{
+				ereport(DEBUG1,
+						(errmsg("committing SELECT results to cache storage"),
+						 errdetail("result does not fit in memqcache_database_quota of database \"%s\"",
+								   backend->info->database)));
+				if (cdata != data)
+					pfree(cdata);
+				goto done;
+			}
+			cacheid = pool_add_item_shmem_cache(&query_hash, cdata, clen, codec, memqcache_expire, partition);
+			if (cdata != data)
+				pfree(cdata);
 			if (cacheid == NULL)
 			{
 				ereport(LOG,
 						(errmsg("failed to add item to shmem cache")));
-				return -1;
+				ret = -1;
+				goto done;
 			}
 			else
 			{
@@ -316,29 +393,44 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 		}
 	}
 
-#ifdef USE_MEMCACHED
 	else
 	{
-		rc = memcached_set(memc, tmpkey, 32,
-						   data, datalen, (time_t) memqcache_expire, 0);
-		if (rc != MEMCACHED_SUCCESS)
+		POOL_CACHE_STORAGE *storage = pool_cache_storage();
+		int			dboid = 0;
+
+		/* the storage keeping tags needs the database of the tables */
+		if (storage->delete_by_tag && num_oids > 0)
 		{
-			ereport(WARNING,
-					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
-			return -1;
+			dboid = pool_get_database_oid();
+			if (dboid <= 0)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: committing SELECT results, failed to get database OID")));
+				ret = -1;
+				goto done;
+			}
+		}
+
+		if (!storage->put(tmpkey, data, datalen, memqcache_expire, dboid, num_oids, oids))
+		{
+			ret = -1;
+			goto done;
 		}
 		ereport(DEBUG1,
 				(errmsg("committing SELECT results to cache storage"),
 				 errdetail("set cache succeeded")));
 	}
-#endif
 
 /*
  * Register cache id to oid map
  */
 	pool_add_table_oid_map(&cachekey, num_oids, oids);
 
-	return 0;
+done:
+	if (data != orig_data)
+		pfree(data);
+	pfree(strkey);
+	return ret;
 }
 
 /*
@@ -347,12 +439,13 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 int
 pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen)
 {
-#ifdef USE_MEMCACHED
-	memcached_return rc;
-#endif
 	POOL_CACHEKEY cachekey;
+	POOL_QUERY_HASH query_hash;
 	char		tmpkey[MAX_KEY];
+	char	   *strkey;
+	char	   *orig_data = data;
 	time_t		memqcache_expire;
+	int			ret = 0;
 
 	/*
 	 * get_buflen() will return -1 if query result exceeds memqcache_maxcache
@@ -375,14 +468,17 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 	dump_cache_data(data, datalen);
 #endif
 
-	/* encode md5key for memcached */
-	encode_key(query, tmpkey, backend);
+	/* encode hash key for shmem and memcached */
+	strkey = encode_key(query, tmpkey, &query_hash, backend);
 	ereport(DEBUG2,
 			(errmsg("committing relation cache to cache storage"),
 			 errdetail("search key : \"%s\"", tmpkey)));
 
 	memcpy(cachekey.hashkey, tmpkey, 32);
 
+	/* prepend the cache key to the data if required */
+	data = add_cache_key_prefix(strkey, data, &datalen);
+
 	memqcache_expire = pool_config->relcache_expire;
 	ereport(DEBUG1,
 			(errmsg("committing relation cache to cache storage"),
@@ -391,9 +487,6 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 	if (pool_is_shmem_cache())
 	{
 		POOL_CACHEID *cacheid;
-		POOL_QUERY_HASH query_hash;
-
-		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
 		cacheid = pool_hash_search(&query_hash);
 
@@ -403,16 +496,24 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 					(errmsg("committing relation cache to cache storage"),
 					 errdetail("item already exists")));
 
-			return 0;
+			goto done;
 		}
 		else
 		{
-			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen, memqcache_expire);
+			char	   *cdata;
+			int			clen;
+			unsigned char codec;
+
+			cdata = pool_compress_cache_data(data, datalen, &clen, &codec);
+			cacheid = pool_add_item_shmem_cache(&query_hash, cdata, clen, codec, memqcache_expire, -1);
+			if (cdata != data)
+				pfree(cdata);
 			if (cacheid == NULL)
 			{
 				ereport(LOG,
 						(errmsg("failed to add item to shmem cache")));
-				return -1;
+				ret = -1;
+				goto done;
 			}
 			else
 			{
@@ -426,23 +527,23 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 		}
 	}
 
-#ifdef USE_MEMCACHED
 	else
 	{
-		rc = memcached_set(memc, tmpkey, 32,
-						   data, datalen, (time_t) memqcache_expire, 0);
-		if (rc != MEMCACHED_SUCCESS)
+		if (!pool_cache_storage()->put(tmpkey, data, datalen, memqcache_expire, 0, 0, NULL))
 		{
-			ereport(WARNING,
-					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
-			return -1;
+			ret = -1;
+			goto done;
 		}
 		ereport(DEBUG1,
 				(errmsg("committing relation cache to cache storage"),
 				 errdetail("set cache succeeded")));
 	}
-#endif
-	return 0;
+
+done:
+	if (data != orig_data)
+		pfree(data);
+	pfree(strkey);
+	return ret;
 }
 
 
@@ -456,7 +557,11 @@ int
 pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len)
 {
 	char	   *ptr;
+	char	   *payload;
+	char	   *decompressed = NULL;
 	char		tmpkey[MAX_KEY];
+	char	   *strkey;
+	POOL_QUERY_HASH query_hash;
 	int			sts;
 	char	   *p;
 
@@ -464,8 +569,8 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 		ereport(ERROR,
 				(errmsg("fetching from cache storage, no query")));
 
-	/* encode md5key for memcached */
-	encode_key(query, tmpkey, backend);
+	/* encode hash key for shmem and memcached */
+	strkey = encode_key(query, tmpkey, &query_hash, backend);
 	ereport(DEBUG1,
 			(errmsg("fetching from cache storage"),
 			 errdetail("search key \"%s\"", tmpkey)));
@@ -473,70 +578,77 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 
 	if (pool_is_shmem_cache())
 	{
-		POOL_QUERY_HASH query_hash;
 		int			mylen;
+		unsigned char codec;
 
-		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
-
-		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &sts);
+		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &codec, &sts);
 		if (ptr == NULL)
 		{
 			ereport(DEBUG1,
 					(errmsg("fetching from cache storage"),
 					 errdetail("cache not found on shared memory")));
 
+			pfree(strkey);
 			return 1;
 		}
+
+		if (codec != POOL_CACHE_CODEC_NONE)
+		{
+			decompressed = pool_decompress_cache_data(ptr, &mylen, codec);
+			if (decompressed == NULL)
+			{
+				/* Behave as if cache not found */
+				pfree(strkey);
+				return 1;
+			}
+			ptr = decompressed;
+		}
 		*len = mylen;
 	}
-#ifdef USE_MEMCACHED
 	else
 	{
-		memcached_return rc;
-		unsigned int flags;
+		bool		error;
 
-		ptr = memcached_get(memc, tmpkey, strlen(tmpkey), len, &flags, &rc);
+		ptr = pool_cache_storage()->get(tmpkey, len, &error);
 
-		if (rc != MEMCACHED_SUCCESS)
+		if (ptr == NULL)
 		{
-			if (rc != MEMCACHED_NOTFOUND)
-			{
-				ereport(LOG,
-						(errmsg("fetching from cache storage, memcached_get failed with error: \"%s\"", memcached_strerror(memc, rc))));
-
-				/*
-				 * Turn off memory cache support to prevent future errors.
-				 */
-				pool_config->memory_cache_enabled = 0;
-				/* Behave as if cache not found */
-				return 1;
-			}
-			else
-			{
-				/* Not found */
+			/* Behave as if cache not found if the storage failed */
+			if (!error)
 				ereport(DEBUG1,
 						(errmsg("fetching from cache storage"),
 						 errdetail("cache item not found for key: \"%s\" and query:\"%s\"", tmpkey, query)));
-				return 1;
-			}
+			pfree(strkey);
+			return 1;
 		}
 	}
-#else
-	else
+
+	/* make sure that the item is really for this query */
+	payload = check_cache_key_prefix(strkey, ptr, len);
+	pfree(strkey);
+	if (payload == NULL)
 	{
-		ereport(ERROR,
-				(errmsg("memcached support is not enabled")));
+		if (!pool_is_shmem_cache())
+			pfree(ptr);
+		if (decompressed)
+			pfree(decompressed);
+
+		ereport(DEBUG1,
+				(errmsg("fetching from cache storage"),
+				 errdetail("cache item found but its key does not match")));
+		return 1;
 	}
-#endif
 
 	p = palloc(*len);
 
-	memcpy(p, ptr, *len);
+	memcpy(p, payload, *len);
 
 	if (!pool_is_shmem_cache())
 	{
-		free(ptr);
+		pfree(ptr);
 	}
+	if (decompressed)
+		pfree(decompressed);
 
 	ereport(DEBUG1,
 			(errmsg("fetching from cache storage"),
@@ -550,12 +662,90 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 	return 0;
 }
 
+/*
+ * Fetch from shared memory cache without acquiring the query cache lock.
+ * Return:
+ * 0: fetch success,
+ * 1: not found
+ * -1: could not get a consistent result or the cache entry has expired.
+ *     Caller should use pool_fetch_cache() with the lock held.
+ */
+static int
+pool_fetch_cache_nolock(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len)
+{
+	char		tmpkey[MAX_KEY];
+	char	   *strkey;
+	POOL_QUERY_HASH query_hash;
+	char	   *p;
+	char	   *payload;
+	int			mylen;
+	size_t		payload_len;
+	unsigned char codec;
+	int			sts;
+
+	if (strlen(query) <= 0)
+		return -1;
+
+	strkey = encode_key(query, tmpkey, &query_hash, backend);
+
+	sts = pool_get_item_shmem_cache_nolock(&query_hash, &p, &mylen, &codec);
+	if (sts != 0)
+	{
+		ereport(DEBUG1,
+				(errmsg("fetching from cache storage without lock"),
+				 errdetail("%s", sts > 0 ? "cache not found on shared memory" : "retrying with lock")));
+		pfree(strkey);
+		return sts;
+	}
+
+	if (codec != POOL_CACHE_CODEC_NONE)
+	{
+		char	   *decompressed;
+
+		decompressed = pool_decompress_cache_data(p, &mylen, codec);
+		pfree(p);
+		if (decompressed == NULL)
+		{
+			pfree(strkey);
+			return 1;
+		}
+		p = decompressed;
+	}
+
+	/* make sure that the item is really for this query */
+	payload_len = mylen;
+	payload = check_cache_key_prefix(strkey, p, &payload_len);
+	pfree(strkey);
+	if (payload == NULL)
+	{
+		pfree(p);
+		ereport(DEBUG1,
+				(errmsg("fetching from cache storage without lock"),
+				 errdetail("cache item found but its key does not match")));
+		return 1;
+	}
+	if (payload != p)
+		memmove(p, payload, payload_len);
+	mylen = payload_len;
+
+	ereport(DEBUG1,
+			(errmsg("fetching from cache storage without lock"),
+			 errdetail("query=\"%s\" len:%d", query, mylen)));
+
+	*buf = p;
+	*len = mylen;
+	return 0;
+}
+
 /*
  * encode key.
- * create cache key as md5(username + query string + database name)
+ * create cache key as hash(username + query string + database name).
+ * The binary hash value is stored into "query_hash" and its hex string
+ * representation, which is used as the memcached key, into "buf".
+ * Returns the palloc'd cache key string itself.
  */
 static char *
-encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend)
+encode_key(const char *s, char *buf, POOL_QUERY_HASH * query_hash, POOL_CONNECTION_POOL * backend)
 {
 	char	   *strkey;
 	int			u_length;
@@ -581,12 +771,176 @@ encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend)
 
 	snprintf(strkey, length, "%s%s%s", backend->info->user, s, backend->info->database);
 
-	pool_md5_hash(strkey, strlen(strkey), buf);
+	if (pool_config->memqcache_hash_method == MEMQCACHE_HASH_MD5)
+	{
+		pool_md5_binary(strkey, length - 1, query_hash->query_hash);
+	}
+	else
+	{
+		uint64		hash;
+		uint64		keylen = length - 1;
+
+		/*
+		 * XXH64 is much faster than MD5 but only gives 64 bits.  Put the key
+		 * length in the rest of the signature so that keys of different
+		 * length never collide.  Collisions which still happen are detected
+		 * by check_cache_key_prefix().
+		 */
+		hash = pool_xxh64(strkey, keylen, 0);
+		memcpy(query_hash->query_hash, &hash, sizeof(hash));
+		memcpy(query_hash->query_hash + sizeof(hash), &keylen, sizeof(keylen));
+	}
+
+	bytesToHex(query_hash->query_hash, POOL_QUERY_HASH_LEN, buf);
 	ereport(DEBUG1,
 			(errmsg("memcache encode key"),
 			 errdetail("`%s' -> `%s'", strkey, buf)));
-	pfree(strkey);
-	return buf;
+	return strkey;
+}
+
+/*
+ * When memqcache_hash_method is 'xxhash', different cache keys could be
+ * mapped to the same query signature.  To detect such a collision the
+ * cache key itself is stored in front of the cached data in the form of
+ * int32 key length followed by the key.  Returns the data to be cached,
+ * which is palloc'd if different from "data".  "len" is updated
+ * accordingly.
+ */
+static char *
+add_cache_key_prefix(const char *key, char *data, size_t *len)
+{
+	int32		keylen;
+	char	   *p;
+
+	if (pool_config->memqcache_hash_method == MEMQCACHE_HASH_MD5)
+		return data;
+
+	keylen = strlen(key);
+	p = palloc(sizeof(keylen) + keylen + *len);
+	memcpy(p, &keylen, sizeof(keylen));
+	memcpy(p + sizeof(keylen), key, keylen);
+	memcpy(p + sizeof(keylen) + keylen, data, *len);
+	*len += sizeof(keylen) + keylen;
+	return p;
+}
+
+/*
+ * Check the cache key stored by add_cache_key_prefix() against "key".
+ * Returns the pointer to the cached data following the key, or NULL if
+ * the key does not match.  "len" is updated to the length of the cached
+ * data.
+ */
+static char *
+check_cache_key_prefix(const char *key, char *data, size_t *len)
+{
+	int32		keylen;
+
+	if (pool_config->memqcache_hash_method == MEMQCACHE_HASH_MD5)
+		return data;
+
+	if (*len < sizeof(keylen))
+		return NULL;
+	memcpy(&keylen, data, sizeof(keylen));
+	if (keylen < 0 || (size_t) keylen != strlen(key) ||
+		*len < sizeof(keylen) + keylen ||
+		memcmp(data + sizeof(keylen), key, keylen) != 0)
+		return NULL;
+
+	*len -= sizeof(keylen) + keylen;
+	return data + sizeof(keylen) + keylen;
+}
+
+/*
+ * Compress cache data according to memqcache_compression.  Returns
+ * palloc'd compressed data and sets its length to *compressed_size and
+ * the codec to *codec.  If compression is disabled or the data does not
+ * become smaller, returns "data" itself with POOL_CACHE_CODEC_NONE.
+ */
+#define POOL_CACHE_COMPRESS_MIN_SIZE	128
+
+static char *
+pool_compress_cache_data(char *data, int size, int *compressed_size, unsigned char *codec)
+{
+	*compressed_size = size;
+	*codec = POOL_CACHE_CODEC_NONE;
+
+	if (pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_NONE ||
+		size < POOL_CACHE_COMPRESS_MIN_SIZE)
+		return data;
+
+#ifdef USE_LZ4
+	if (pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_LZ4)
+	{
+		char	   *p;
+		uint32		raw_size = size;
+		int			len;
+
+		/*
+		 * Give up if the compressed data would not be smaller than the
+		 * original one anyway.
+		 */
+		p = palloc(sizeof(raw_size) + size);
+		len = LZ4_compress_default(data, p + sizeof(raw_size), size,
+								   size - sizeof(raw_size));
+		if (len <= 0)
+		{
+			pfree(p);
+			return data;
+		}
+		memcpy(p, &raw_size, sizeof(raw_size));
+		*compressed_size = sizeof(raw_size) + len;
+		*codec = POOL_CACHE_CODEC_LZ4;
+
+		ereport(DEBUG2,
+				(errmsg("memcache: compressed cache data"),
+				 errdetail("%d bytes -> %d bytes", size, *compressed_size)));
+		return p;
+	}
+#endif
+
+	return data;
+}
+
+/*
+ * Decompress cache data compressed by pool_compress_cache_data().  Returns
+ * palloc'd decompressed data and sets its length to *size.  On error
+ * returns NULL.
+ */
+static char *
+pool_decompress_cache_data(char *data, int *size, unsigned char codec)
+{
+	uint32		raw_size;
+
+	if (*size < sizeof(raw_size))
+		return NULL;
+	memcpy(&raw_size, data, sizeof(raw_size));
+	if (raw_size == 0 || !AllocSizeIsValid(raw_size))
+		return NULL;
+
+#ifdef USE_LZ4
+	if (codec == POOL_CACHE_CODEC_LZ4)
+	{
+		char	   *p;
+		int			len;
+
+		p = palloc(raw_size);
+		len = LZ4_decompress_safe(data + sizeof(raw_size), p,
+								  *size - sizeof(raw_size), raw_size);
+		if (len != raw_size)
+		{
+			ereport(LOG,
+					(errmsg("memcache: failed to decompress cache data")));
+			pfree(p);
+			return NULL;
+		}
+		*size = raw_size;
+		return p;
+	}
+#endif
+
+	ereport(LOG,
+			(errmsg("memcache: unknown cache data codec: %d", codec)));
+	return NULL;
 }
 
 #ifdef DEBUG
@@ -625,21 +979,24 @@ dump_cache_data(const char *data, size_t len)
 #endif
 
 /*
- * send cached messages
+ * send cached messages.  If limit >= 0, only DataRows from the offset'th
+ * to offset+limit'th are sent and CommandComplete is adjusted to them.
  */
 static int
-send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen)
+send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen, int offset, int limit)
 {
 	int			msg = 0;
 	int			i = 0;
 	int			is_prepared_stmt = 0;
 	int			len;
-	const char *p;
+	int			nrows = 0;
+	int			nsent = 0;
 
 	while (i < qcachelen)
 	{
 		char		tmpkind;
 		int			tmplen;
+		int			start = i;
 
 		tmpkind = qcache[i];
 		i++;
@@ -647,7 +1004,6 @@ send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachel
 		memcpy(&tmplen, qcache + i, sizeof(tmplen));
 		i += sizeof(tmplen);
 		len = ntohl(tmplen);
-		p = qcache + i;
 		i += len - sizeof(tmplen);
 
 		/* No need to cache PARSE and BIND responses */
@@ -666,10 +1022,34 @@ send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachel
 			continue;
 		}
 
+		if (limit >= 0 && tmpkind == 'D')
+		{
+			nrows++;
+			if (nrows <= offset || nrows > offset + limit)
+				continue;
+			nsent++;
+		}
+		else if (limit >= 0 && tmpkind == 'C')
+		{
+			POOL_MSGBUF buf;
+
+			pool_msgbuf_init(&buf);
+			pool_msgbuf_begin(&buf, 'C');
+			pool_msgbuf_bytes(&buf, "SELECT ", 7);
+			pool_msgbuf_int_text(&buf, nsent);
+			pool_msgbuf_byte(&buf, '\0');
+			pool_msgbuf_end(&buf);
+			pool_msgbuf_write(frontend, &buf);
+			msg++;
+			continue;
+		}
+
 		/* send message to frontend */
 		ereport(DEBUG1,
 				(errmsg("memcache: sending cached messages: '%c' len: %d", tmpkind, len)));
-		send_message(frontend, tmpkind, len, p);
+
+		/* the cached message is sent as is, kind and length included */
+		pool_write(frontend, (void *) (qcache + start), 1 + len);
 
 		msg++;
 	}
@@ -686,83 +1066,64 @@ send_message(POOL_CONNECTION * conn, char kind, int len, const char *data)
 	ereport(DEBUG2,
 			(errmsg("memcache: sending messages: kind '%c', len=%d, data=%p", kind, len, data)));
 
-	pool_write(conn, &kind, 1);
+	char		header[1 + sizeof(int32)];
+	int32		nlen = htonl(len);
 
-	len = htonl(len);
-	pool_write(conn, &len, sizeof(len));
+	header[0] = kind;
+	memcpy(header + 1, &nlen, sizeof(nlen));
+	pool_write(conn, header, sizeof(header));
 
-	len = ntohl(len);
-	pool_write(conn, (void *) data, len - sizeof(len));
+	/*
+	 * The data is not copied after the header to write the message at once,
+	 * since it can be a large row.
+	 */
+	pool_write(conn, (void *) data, len - sizeof(nlen));
 }
 
-#ifdef USE_MEMCACHED
 /*
- * delete query cache on memcached
+ * Fetch SELECT data from cache if possible.
  */
-static int
-delete_cache_on_memcached(const char *key)
+POOL_STATUS
+pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
+							 POOL_CONNECTION_POOL * backend,
+							 char *contents, bool *foundp)
 {
+	char	   *qcache;
+	size_t		qcachelen;
+	int			sts;
 
-	memcached_return rc;
-
-	ereport(DEBUG2,
-			(errmsg("memcache: deleting cache on memcached with key: \"%s\"", key)));
-
-
-	/* delete cache data on memcached. key is md5 hash query */
-	rc = memcached_delete(memc, key, 32, (time_t) 0);
-
-	/* delete cache data on memcached is failed */
-	if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
-	{
-		ereport(LOG,
-				(errmsg("failed to delete cache on memcached, error:\"%s\"", memcached_strerror(memc, rc))));
-		return 0;
-	}
-	return 1;
-
-}
-#endif
-
-/*
- * Fetch SELECT data from cache if possible.
- */
-POOL_STATUS
-pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
-							 POOL_CONNECTION_POOL * backend,
-							 char *contents, bool *foundp)
-{
-	char	   *qcache;
-	size_t		qcachelen;
-	volatile int	sts;
-	pool_sigset_t oldmask;
-
-	ereport(DEBUG1,
-			(errmsg("pool_fetch_from_memory_cache called")));
+	ereport(DEBUG1,
+			(errmsg("pool_fetch_from_memory_cache called")));
 
 	*foundp = false;
 
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
+	TRACE_PGPOOL_CACHE_FETCH_START(contents);
 
-	PG_TRY();
-	{
-		sts = pool_fetch_cache(backend, contents, &qcache, &qcachelen);
-	}
-	PG_CATCH();
+	/*
+	 * In strict invalidation mode, make sure that our own writes have been
+	 * reflected to the cache.
+	 */
+	if (!pool_wait_for_query_cache_invalidation())
 	{
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
-		PG_RE_THROW();
+		TRACE_PGPOOL_CACHE_FETCH_DONE(0);
+		return POOL_CONTINUE;
 	}
-	PG_END_TRY();
 
-	pool_shmem_unlock();
-	POOL_SETMASK(&oldmask);
+	sts = pool_fetch_cache_any(backend, contents, &qcache, &qcachelen);
+
+	/*
+	 * If another child is running the same query, wait for its result to be
+	 * cached.
+	 */
+	if (sts > 0 && pool_wait_for_cache_inflight(backend, contents))
+		sts = pool_fetch_cache_any(backend, contents, &qcache, &qcachelen);
 
 	if (sts != 0)
+	{
 		/* Cache not found */
+		TRACE_PGPOOL_CACHE_FETCH_DONE(0);
 		return POOL_CONTINUE;
+	}
 
 	/*
 	 * Cache found. If we are doing extended query and in streaming
@@ -786,7 +1147,7 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 		/*
 		 * Send each messages to frontend
 		 */
-		send_cached_messages(frontend, qcache, qcachelen);
+		send_cached_messages(frontend, qcache, qcachelen, 0, -1);
 	}
 
 	pfree(qcache);
@@ -815,7 +1176,7 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 
 	*foundp = true;
 
-	if (pool_config->log_per_node_statement)
+	if (pool_log_per_node_statement_enabled())
 		ereport(LOG,
 				(errmsg("fetch from memory cache"),
 				 errdetail("query result fetched from cache. statement: %s", contents)));
@@ -824,3171 +1185,5223 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 			(errmsg("fetch from memory cache"),
 			 errdetail("query result found in the query cache, %s", contents)));
 
+	TRACE_PGPOOL_CACHE_FETCH_DONE(1);
+
 	return POOL_CONTINUE;
 }
 
 /*
- * Simple and rough (thus unreliable) check if the query is likely
- * SELECT. Just check if the query starts with SELECT or WITH. This
- * can be used before parse tree is available.
+ * Fetch from the cache.  Try to fetch from shmem cache without locking
+ * first.  If we failed to get a consistent result, fall back to fetching
+ * under the lock.  Returns 0 if found, 1 if not found.
  */
-bool
-pool_is_likely_select(char *query)
+static int
+pool_fetch_cache_any(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len)
 {
-	bool		do_continue = false;
-
-	if (query == NULL)
-		return false;
-
-	if (pool_config->ignore_leading_white_space)
-	{
-		/* Ignore leading white spaces */
-		while (*query && isspace(*query))
-			query++;
-	}
-	if (!*query)
-	{
-		return false;
-	}
+	volatile int sts;
+	pool_sigset_t oldmask;
+	char		tmpkey[MAX_KEY];
+	char	   *strkey = NULL;
+	POOL_QUERY_HASH query_hash;
+	uint32		epoch = 0;
 
-	/*
-	 * Get rid of head comment. It is sure that the query is in correct
-	 * format, because the parser has rejected bad queries such as the one
-	 * with not-ended comment.
-	 */
-	while (*query)
+	if (pool_is_shmem_cache() && pool_config->memqcache_local_cache_size > 0)
 	{
-		/* Ignore spaces and return marks */
-		do_continue = false;
-		while (*query && isspace(*query))
-		{
-			query++;
-			do_continue = true;
-		}
-		if (do_continue)
+		strkey = encode_key(query, tmpkey, &query_hash, backend);
+		if (pool_local_cache_get(strkey, &query_hash, buf, len))
 		{
-			continue;
+			pfree(strkey);
+			return 0;
 		}
 
-		while (*query && !strncmp(query, "\n", 2))
-		{
-			query++;
-			do_continue = true;
-		}
-		if (do_continue)
-		{
-			query += 2;
-			continue;
-		}
+		/*
+		 * Remember the epoch before looking into the shmem cache, so that
+		 * the item is not kept if it is invalidated after we have read it.
+		 */
+		epoch = pool_cache_epoch();
+	}
 
-		/* Ignore comments like C */
-		if (!strncmp(query, "/*", 2))
-		{
-			while (*query && strncmp(query, "*/", 2))
-				query++;
+	sts = -1;
+	if (pool_is_shmem_cache())
+		sts = pool_fetch_cache_nolock(backend, query, buf, len);
 
-			query += 2;
-			continue;
-		}
+	if (sts < 0)
+	{
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
 
-		/* Ignore SQL comments */
-		if (!strncmp(query, "--", 2))
+		PG_TRY();
 		{
-			while (*query && strncmp(query, "\n", 2))
-				query++;
-
-			query += 2;
-			continue;
+			sts = pool_fetch_cache(backend, query, buf, len);
 		}
-
-		if (!strncasecmp(query, "SELECT", 6) || !strncasecmp(query, "WITH", 4))
+		PG_CATCH();
 		{
-			return true;
+			pool_shmem_unlock();
+			POOL_SETMASK(&oldmask);
+			PG_RE_THROW();
 		}
+		PG_END_TRY();
 
-		query++;
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
 	}
 
-	return false;
+	if (strkey)
+	{
+		if (sts == 0)
+			pool_local_cache_put(strkey, &query_hash, *buf, *len, epoch);
+		pfree(strkey);
+	}
+
+	return sts;
 }
 
 /*
- * Return true if SELECT can be cached.  "node" is the parse tree for
- * the query and "query" is the query string.
- * The query must be SELECT or WITH.
+ * Per child local cache in front of the shmem cache
+ * (memqcache_local_cache_size).  Results fetched from shmem are kept in the
+ * private memory of the child, so that a hot query run again by the same
+ * child is answered without the query cache lock or copying out of shmem.
+ *
+ * Each entry remembers the epoch in the hash header when it was read from
+ * shmem.  Since the epoch is advanced by every invalidation, an entry whose
+ * epoch differs from the current one may be stale.  The epoch is not per
+ * table, so all the entries are discarded then.  The least recently used
+ * entries are removed when the total size exceeds the limit.
  */
-bool
-pool_is_allow_to_cache(Node *node, char *query)
+#define POOL_LOCAL_CACHE_NBUCKETS	256	/* must be power of 2 */
+
+typedef struct POOL_LOCAL_CACHE_ENTRY
 {
-	int			i = 0;
-	int			num_oids = -1;
-	SelectContext ctx;
+	struct POOL_LOCAL_CACHE_ENTRY *hnext;	/* hash chain */
+	struct POOL_LOCAL_CACHE_ENTRY *prev;	/* LRU list, most recent first */
+	struct POOL_LOCAL_CACHE_ENTRY *next;
+	POOL_QUERY_HASH query_hash;
+	uint32		epoch;			/* epoch when read from shmem */
+	time_t		expire;			/* when the entry expires. 0: never */
+	size_t		size;			/* allocated size of this entry */
+	size_t		len;			/* length of the result */
+	char	   *data;			/* result */
+	char		key[1];			/* cache key string follows */
+}			POOL_LOCAL_CACHE_ENTRY;
+
+static POOL_LOCAL_CACHE_ENTRY * local_cache_buckets[POOL_LOCAL_CACHE_NBUCKETS];
+static POOL_LOCAL_CACHE_ENTRY * local_cache_head;
+static POOL_LOCAL_CACHE_ENTRY * local_cache_tail;
+static size_t local_cache_total_size;
 
-	/*
-	 * If NO QUERY CACHE comment exists, do not cache.
-	 */
-	if (!strncasecmp(query, NO_QUERY_CACHE, NO_QUERY_CACHE_COMMENT_SZ))
-		return false;
+/*
+ * Expiration time of the shmem cache item last fetched, computed by
+ * pool_local_cache_expire().
+ */
+static time_t fetched_item_expire;
 
-	/*
-	 * Check cache unsafe table list first.
-	 */
-	if (pool_config->num_cache_unsafe_memqcache_table_list > 0)
+/*
+ * Remove an entry from the local cache.
+ */
+static void
+pool_local_cache_remove(POOL_LOCAL_CACHE_ENTRY * entry)
+{
+	POOL_LOCAL_CACHE_ENTRY **p;
+
+	for (p = &local_cache_buckets[pool_local_cache_bucket(&entry->query_hash)]; *p; p = &(*p)->hnext)
 	{
-		/*
-		 * Extract oids in from clause of SELECT, and check if SELECT to them
-		 * could be cached.
-		 */
-		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
-		if (num_oids > 0)
+		if (*p == entry)
 		{
-			for (i = 0; i < num_oids; i++)
-			{
-				ereport(DEBUG1,
-						(errmsg("memcache: checking if node is allowed to cache: check table_names[%d] = \"%s\"", i, ctx.table_names[i])));
-				if (pool_is_table_in_unsafe_list(ctx.table_names[i]) == true)
-				{
-					ereport(DEBUG1,
-							(errmsg("memcache: node is not allowed to cache")));
-					return false;
-				}
-			}
+			*p = entry->hnext;
+			break;
 		}
 	}
 
-	/* SELECT INTO or SELECT FOR SHARE or UPDATE cannot be cached */
-	if (pool_has_insertinto_or_locking_clause(node))
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		local_cache_head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		local_cache_tail = entry->prev;
+
+	local_cache_total_size -= entry->size;
+	pfree(entry);
+}
+
+/*
+ * Discard all the local cache entries.
+ */
+static void
+pool_local_cache_reset(void)
+{
+	while (local_cache_head)
+		pool_local_cache_remove(local_cache_head);
+}
+
+/*
+ * Return the time when a local cache entry for the shmem cache item should
+ * expire, or 0 if never.  The entry expires memqcache_stale_while_revalidate
+ * seconds earlier than the item so that the item is refreshed in time.
+ */
+static time_t
+pool_local_cache_expire(POOL_CACHE_ITEM_HEADER * cih)
+{
+	if (cih->expire <= 0)
+		return 0;
+
+	return cih->timestamp + cih->expire - Max(pool_config->memqcache_stale_while_revalidate, 0);
+}
+
+static uint32
+pool_local_cache_bucket(POOL_QUERY_HASH * query_hash)
+{
+	uint32		v;
+
+	memcpy(&v, query_hash->query_hash, sizeof(v));
+	return v & (POOL_LOCAL_CACHE_NBUCKETS - 1);
+}
+
+/*
+ * Look up the local cache.  If found, set palloc'd copy of the result to
+ * *buf and its length to *len, and return true.
+ */
+static bool
+pool_local_cache_get(const char *strkey, POOL_QUERY_HASH * query_hash, char **buf, size_t *len)
+{
+	POOL_LOCAL_CACHE_ENTRY *entry;
+
+	if (local_cache_head == NULL)
 		return false;
 
-	/*
-	 * If SELECT uses non immutable functions, it's not allowed to cache.
-	 */
-	if (pool_has_non_immutable_function_call(node))
+	/* Any invalidation since the entries were made? */
+	if (local_cache_head->epoch != pool_cache_epoch())
+	{
+		ereport(DEBUG1,
+				(errmsg("fetching from local cache"),
+				 errdetail("query cache has been invalidated, discarding local cache")));
+		pool_local_cache_reset();
 		return false;
+	}
 
-	/*
-	 * If SELECT uses temporary tables it's not allowed to cache.
-	 */
-	if (pool_config->check_temp_table && pool_has_temp_table(node))
+	for (entry = local_cache_buckets[pool_local_cache_bucket(query_hash)]; entry; entry = entry->hnext)
+	{
+		if (memcmp(entry->query_hash.query_hash, query_hash->query_hash, POOL_QUERY_HASH_LEN) == 0 &&
+			strcmp(entry->key, strkey) == 0)
+			break;
+	}
+
+	if (entry == NULL)
 		return false;
 
-	/*
-	 * If SELECT uses system catalogs, it's not allowed to cache.
-	 */
-	if (pool_has_system_catalog(node))
+	if (entry->expire > 0 && time(NULL) >= entry->expire)
+	{
+		pool_local_cache_remove(entry);
 		return false;
+	}
 
-	/*
-	 * TABLESAMPLE is not allowed to cache.
-	 */
-	if (IsA(node, SelectStmt) &&((SelectStmt *) node)->fromClause)
+	/* Move to the head of the LRU list */
+	if (entry != local_cache_head)
 	{
-		List	   *tbl_list = ((SelectStmt *) node)->fromClause;
-		ListCell   *tbl;
+		entry->prev->next = entry->next;
+		if (entry->next)
+			entry->next->prev = entry->prev;
+		else
+			local_cache_tail = entry->prev;
+		entry->prev = NULL;
+		entry->next = local_cache_head;
+		local_cache_head->prev = entry;
+		local_cache_head = entry;
+	}
 
-		foreach(tbl, tbl_list)
+	*buf = palloc(entry->len);
+	memcpy(*buf, entry->data, entry->len);
+	*len = entry->len;
+
+	ereport(DEBUG1,
+			(errmsg("fetching from local cache"),
+			 errdetail("len:%zd", *len)));
+
+	return true;
+}
+
+/*
+ * Add the result fetched from shmem to the local cache.  "epoch" is the
+ * cache epoch before the result was fetched.
+ */
+static void
+pool_local_cache_put(const char *strkey, POOL_QUERY_HASH * query_hash, const char *data, size_t len, uint32 epoch)
+{
+	POOL_LOCAL_CACHE_ENTRY *entry;
+	size_t		keylen = strlen(strkey) + 1;
+	size_t		size = offsetof(POOL_LOCAL_CACHE_ENTRY, key) + keylen + len;
+	uint32		bucket;
+
+	if (size > pool_config->memqcache_local_cache_size)
+		return;
+
+	if (fetched_item_expire > 0 && time(NULL) >= fetched_item_expire)
+		return;
+
+	/* Entries of an older epoch are stale */
+	if (local_cache_head && local_cache_head->epoch != epoch)
+		pool_local_cache_reset();
+
+	/* Remove the entry for the same key, if any */
+	bucket = pool_local_cache_bucket(query_hash);
+	for (entry = local_cache_buckets[bucket]; entry; entry = entry->hnext)
+	{
+		if (strcmp(entry->key, strkey) == 0)
 		{
-			if (IsA(lfirst(tbl), RangeTableSample))
-				return false;
+			pool_local_cache_remove(entry);
+			break;
 		}
 	}
 
+	while (local_cache_total_size + size > pool_config->memqcache_local_cache_size)
+		pool_local_cache_remove(local_cache_tail);
 
-	/*
-	 * If the table is in the while list, allow to cache even if it is VIEW or
-	 * unlogged table.
-	 */
-	if (pool_config->num_cache_safe_memqcache_table_list > 0)
-	{
-		if (num_oids < 0)
-			num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
+	entry = MemoryContextAlloc(TopMemoryContext, size);
+	entry->query_hash = *query_hash;
+	entry->epoch = epoch;
+	entry->expire = fetched_item_expire;
+	entry->size = size;
+	entry->len = len;
+	memcpy(entry->key, strkey, keylen);
+	entry->data = entry->key + keylen;
+	memcpy(entry->data, data, len);
 
-		if (num_oids > 0)
-		{
-			for (i = 0; i < num_oids; i++)
-			{
-				char	   *table = ctx.table_names[i];
+	entry->hnext = local_cache_buckets[bucket];
+	local_cache_buckets[bucket] = entry;
 
-				ereport(DEBUG1,
-						(errmsg("memcache: checking if node is allowed to cache: check table_names[%d] = \"%s\"", i, table)));
-				if (is_view(table) || is_unlogged_table(table))
-				{
-					if (pool_is_table_in_safe_list(table) == false)
-					{
-						ereport(DEBUG1,
-								(errmsg("memcache: node is not allowed to cache")));
-						return false;
-					}
-				}
-			}
-		}
-	}
+	entry->prev = NULL;
+	entry->next = local_cache_head;
+	if (local_cache_head)
+		local_cache_head->prev = entry;
 	else
-	{
-		/*
-		 * If SELECT uses views, it's not allowed to cache.
-		 */
-		if (pool_has_view(node))
-			return false;
+		local_cache_tail = entry;
+	local_cache_head = entry;
 
-		/*
-		 * If SELECT uses unlogged tables, it's not allowed to cache.
-		 */
-		if (pool_has_unlogged_table(node))
-			return false;
-	}
+	local_cache_total_size += size;
+}
+
+/*
+ * In flight SELECTs on shmem.
+ */
+static POOL_CACHE_INFLIGHT * cache_inflight = NULL;
+
+/*
+ * Return byte size of the in flight SELECT table.
+ */
+size_t
+pool_cache_inflight_size(void)
+{
+	return sizeof(POOL_CACHE_INFLIGHT) * pool_config->num_init_children;
+}
+
+/*
+ * Allocate and initialize the in flight SELECT table on shmem.  This
+ * should be called only once from pgpool main process at the process
+ * staring up time.
+ */
+void
+pool_init_cache_inflight(void)
+{
+	int			i;
+
+	cache_inflight = pool_shared_memory_segment_get_chunk(pool_cache_inflight_size());
+	for (i = 0; i < pool_config->num_init_children; i++)
+		pool_atomic_init_u32(&cache_inflight[i].active, 0);
+}
+
+/*
+ * Called after the result of the SELECT of this child has been cached, or
+ * the SELECT has ended without it.  Children waiting for the result stop
+ * waiting.
+ */
+void
+pool_release_cache_inflight(void)
+{
+	if (cache_inflight == NULL || my_proc_id < 0 ||
+		my_proc_id >= pool_config->num_init_children)
+		return;
+
+	if (pool_atomic_read_u32(&cache_inflight[my_proc_id].active))
+		pool_atomic_write_u32(&cache_inflight[my_proc_id].active, 0);
+}
+
+/*
+ * Called when the query missed the cache.  If another child is running the
+ * same query, wait until its result is cached or memqcache_coalesce_timeout
+ * passes, and return true so that the caller looks up the cache again.
+ * Otherwise register the query as in flight and return false.
+ *
+ * Registering and then looking for the others makes sure that of two
+ * children missing at the same time at least one sees the other.  If both
+ * do, both give up waiting at once and run the query.
+ */
+static bool
+pool_wait_for_cache_inflight(POOL_CONNECTION_POOL * backend, const char *query)
+{
+	POOL_CACHE_INFLIGHT *me;
+	POOL_CACHE_INFLIGHT *owner = NULL;
+	POOL_QUERY_HASH query_hash;
+	char		tmpkey[MAX_KEY];
+	char	   *strkey;
+	time_t		now;
+	int			timeout = pool_config->memqcache_coalesce_timeout;
+	int			waited;
+	int			i;
+
+	if (timeout <= 0 || cache_inflight == NULL || !pool_is_shmem_cache() ||
+		my_proc_id < 0 || my_proc_id >= pool_config->num_init_children ||
+		strlen(query) <= 0)
+		return false;
+
+	strkey = encode_key(query, tmpkey, &query_hash, backend);
+	pfree(strkey);
+
+	/* register ourselves */
+	me = &cache_inflight[my_proc_id];
+	pool_atomic_write_u32(&me->active, 0);
+	now = time(NULL);
+	me->started = now;
+	memcpy(&me->query_hash, &query_hash, sizeof(query_hash));
+	pool_atomic_exchange_u32(&me->active, 1);
 
 	/*
-	 * If Data-modifying statements in WITH clause, it's not allowed to cache.
+	 * Find the child running the same query.  Ignore a registration which
+	 * is older than the timeout, since its owner may have died.
 	 */
-	if(IsA(node, SelectStmt) && ((SelectStmt *) node)->withClause)
+	for (i = 0; i < pool_config->num_init_children; i++)
 	{
-		ListCell	*lc;
-		WithClause	*withClause = ((SelectStmt *) node)->withClause;
+		POOL_CACHE_INFLIGHT *e = &cache_inflight[i];
 
-		foreach(lc, withClause->ctes)
+		if (e == me)
+			continue;
+		if (pool_atomic_read_u32(&e->active) &&
+			difftime(now, e->started) <= timeout / 1000 + 1 &&
+			memcmp(&e->query_hash, &query_hash, sizeof(query_hash)) == 0)
 		{
-			CommonTableExpr *cte = (CommonTableExpr *)lfirst(lc);
-			if(IsA(cte->ctequery, InsertStmt) ||
-			   IsA(cte->ctequery, DeleteStmt) ||
-			   IsA(cte->ctequery, UpdateStmt))
-			{
-				return false;
-			}
+			owner = e;
+			break;
 		}
 	}
 
+	if (owner == NULL)
+		return false;
+
+	/* leave the query to the owner and wait */
+	pool_atomic_write_u32(&me->active, 0);
+
+	ereport(DEBUG1,
+			(errmsg("memcache: waiting for the same query running in child %d",
+					(int) (owner - cache_inflight))));
+
+	for (waited = 0; waited < timeout; waited++)
+	{
+		if (!pool_atomic_read_u32(&owner->active) ||
+			memcmp(&owner->query_hash, &query_hash, sizeof(query_hash)) != 0)
+			break;
+		usleep(1000);
+	}
 	return true;
 }
 
-
 /*
- * Return true If the SELECTed table is in back list.
+ * Paginated SELECT cache.  A SELECT with ORDER BY and constant LIMIT and
+ * OFFSET is answered by slicing the cached result of the "whole query",
+ * the same SELECT without OFFSET and with LIMIT
+ * memqcache_paginated_cache_rows + 1, so that all the pages share one cache
+ * entry and one sort on backend.  The extra row tells that the whole query
+ * has been truncated, in which case only pages within
+ * memqcache_paginated_cache_rows can be served.
+ *
+ * Called for a cache safe SELECT after it has missed the cache.  If the
+ * whole query is not cached either, it is run on node_id, the only node the
+ * query would have been sent to, and its result is cached.  node_id is -1
+ * if the query goes to more than one node.  Sets *foundp to true if the
+ * query has been answered including ReadyForQuery.
  */
-bool
-pool_is_table_in_unsafe_list(const char *table_name)
+POOL_STATUS
+pool_fetch_paginated_from_memory_cache(POOL_CONNECTION * frontend,
+									   POOL_CONNECTION_POOL * backend,
+									   Node *node, int node_id,
+									   bool *foundp)
 {
+	char	   *whole_query;
+	char	   *qcache = NULL;
+	size_t		qcachelen = 0;
+	int			offset;
+	int			limit;
+	signed char state;
 
-	if (pool_config->num_cache_unsafe_memqcache_table_list > 0 &&
-		pattern_compare((char *) table_name, WRITELIST, "cache_unsafe_memqcache_table_list") == 1)
+	*foundp = false;
+
+	if (pool_config->memqcache_paginated_cache_rows <= 0 ||
+		MAJOR(backend) != PROTO_MAJOR_V3 || !node || !IsA(node, SelectStmt))
+		return POOL_CONTINUE;
+
+	whole_query = pool_paginated_whole_query((SelectStmt *) node, &offset, &limit);
+	if (whole_query == NULL)
+		return POOL_CONTINUE;
+
+	if (pool_fetch_cache_any(backend, whole_query, &qcache, &qcachelen) != 0)
 	{
-		return true;
+		/*
+		 * Run the whole query only outside of a transaction block, so that
+		 * we leave the backend as the query would have.
+		 */
+		if (node_id < 0 || TSTATE(backend, node_id) != 'I')
+		{
+			pfree(whole_query);
+			return POOL_CONTINUE;
+		}
+
+		if (!pool_run_paginated_whole_query(frontend, backend, node_id, node, whole_query,
+											&qcache, &qcachelen))
+			qcache = NULL;		/* error has been forwarded */
+		pool_stats_count_up_num_selects(1);
 	}
+	else
+		pool_stats_count_up_num_cache_hits();
 
-	return false;
+	if (qcache)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: sending rows %d to %d of paginated query", offset + 1, offset + limit),
+				 errdetail("%s", whole_query)));
+		send_cached_messages(frontend, qcache, qcachelen, offset, limit);
+		pfree(qcache);
+	}
+	pfree(whole_query);
+
+	state = MAIN(backend)->tstate;
+	send_message(frontend, 'Z', 5, (char *) &state);
+	if (pool_flush(frontend))
+		return POOL_END;
+
+	*foundp = true;
+	return POOL_CONTINUE;
 }
 
 /*
- * Return true If the SELECTed table is in cache_safe list.
+ * If the SELECT is paginated, return its whole query and set its OFFSET and
+ * LIMIT.  Otherwise return NULL.
  */
-bool
-pool_is_table_in_safe_list(const char *table_name)
+static char *
+pool_paginated_whole_query(SelectStmt * stmt, int *offset, int *limit)
 {
-	if (pool_config->num_cache_safe_memqcache_table_list > 0 &&
-		pattern_compare((char *) table_name, READONLYLIST, "cache_safe_memqcache_table_list") == 1)
-	{
-		return true;
-	}
+	int			max_rows = pool_config->memqcache_paginated_cache_rows;
+	Node	   *limit_offset = stmt->limitOffset;
+	Node	   *limit_count = stmt->limitCount;
+	char	   *whole_query;
+
+	if (stmt->op != SETOP_NONE || stmt->sortClause == NIL ||
+		stmt->lockingClause != NIL || stmt->intoClause != NULL ||
+		stmt->limitOption != LIMIT_OPTION_COUNT || limit_count == NULL)
+		return NULL;
 
-	return false;
+#define IS_INT_CONST(n) \
+	(IsA((n), A_Const) && !((A_Const *) (n))->isnull && \
+	 nodeTag(&((A_Const *) (n))->val) == T_Integer)
+
+	if (!IS_INT_CONST(limit_count) ||
+		(limit_offset != NULL && !IS_INT_CONST(limit_offset)))
+		return NULL;
+
+	*limit = intVal(&((A_Const *) limit_count)->val);
+	*offset = limit_offset ? intVal(&((A_Const *) limit_offset)->val) : 0;
+
+#undef IS_INT_CONST
+
+	if (*limit < 0 || *offset < 0 || *offset > max_rows - *limit)
+		return NULL;
+
+	stmt->limitOffset = NULL;
+	stmt->limitCount = makeIntConst(max_rows + 1, -1);
+	whole_query = nodeToString(stmt);
+	stmt->limitOffset = limit_offset;
+	stmt->limitCount = limit_count;
+
+	return whole_query;
 }
 
 /*
- * Extract table oid from INSERT/UPDATE/DELETE/TRUNCATE/
- * DROP TABLE/ALTER TABLE/COPY FROM statement.
- * For SELECT, if Data-modifying statements in its WITH clause,
- * extract table oid from Data-modifying statements too.
- * Returns number of oids.
- * In case of error, returns 0 (InvalidOid).
- * oids buffer (oidsp) will be discarded by subsequent call.
+ * Run the whole query of a paginated SELECT on the node, and return its
+ * RowDescription, DataRows and CommandComplete in the cache format.  The
+ * result is also committed to the cache.  Other messages are forwarded to
+ * the frontend.  Returns false if the query failed.
  */
-int
-pool_extract_table_oids(Node *node, int **oidsp)
+static bool
+pool_run_paginated_whole_query(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+							   int node_id, Node *node, char *query, char **buf, size_t *len)
 {
-#define POOL_MAX_DML_OIDS 128
-	char	   *table;
-	static int	oids[POOL_MAX_DML_OIDS];
-	int			num_oids;
-	int			oid;
-
-	if (node == NULL)
-	{
-		ereport(LOG,
-				(errmsg("memcache: error while extracting table oids. statement is NULL")));
-		return 0;
-	}
+	POOL_CONNECTION *con = CONNECTION(backend, node_id);
+	POOL_INTERNAL_BUFFER *result = pool_create_buffer();
+	bool		error = false;
 
-	num_oids = 0;
-	*oidsp = oids;
+	send_simplequery_message(con, strlen(query) + 1, query, MAJOR(backend));
 
-	if (IsA(node, InsertStmt))
+	for (;;)
 	{
-		InsertStmt *stmt = (InsertStmt *) node;
+		char		kind;
+		int			msglen;
+		int			nlen;
+		char	   *p;
 
-		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
-		table = make_table_name_from_rangevar(stmt->relation);
-	}
-	else if (IsA(node, UpdateStmt))
-	{
-		UpdateStmt *stmt = (UpdateStmt *) node;
+		pool_read(con, &kind, sizeof(kind));
+		pool_read(con, &nlen, sizeof(nlen));
+		msglen = ntohl(nlen);
+		if (msglen < (int) sizeof(nlen))
+			ereport(ERROR,
+					(errmsg("invalid message length %d of kind '%c' from backend %d",
+							msglen, kind, node_id)));
+		p = pool_read2(con, msglen - sizeof(nlen));
 
-		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
-		table = make_table_name_from_rangevar(stmt->relation);
-	}
-	else if (IsA(node, DeleteStmt))
-	{
-		DeleteStmt *stmt = (DeleteStmt *) node;
+		switch (kind)
+		{
+			case 'T':
+			case 'D':
+			case 'C':
+				pool_add_buffer(result, &kind, sizeof(kind));
+				pool_add_buffer(result, &nlen, sizeof(nlen));
+				pool_add_buffer(result, p, msglen - sizeof(nlen));
+				break;
 
-		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
-		table = make_table_name_from_rangevar(stmt->relation);
-	}
-	else if(IsA(node, SelectStmt))
-	{
-		SelectStmt *stmt = (SelectStmt *) node;
-		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
-		table = NULL;
-	}
-#ifdef NOT_USED
+			case 'Z':
+				con->tstate = *p;
+				goto done;
 
-	/*
-	 * We do not handle CREATE TABLE here.  It is possible that
-	 * pool_extract_table_oids() is called before CREATE TABLE gets executed.
-	 */
-	else if (IsA(node, CreateStmt))
-	{
-		CreateStmt *stmt = (CreateStmt *) node;
+			case 'E':
+				error = true;
+				/* fall through */
 
-		table = make_table_name_from_rangevar(stmt->relation);
+			default:
+				send_message(frontend, kind, msglen, p);
+				break;
+		}
 	}
-#endif
 
-	else if (IsA(node, AlterTableStmt))
-	{
-		AlterTableStmt *stmt = (AlterTableStmt *) node;
+done:
+	*buf = pool_take_buffer(result, len);
+	pool_discard_buffer(result);
 
-		table = make_table_name_from_rangevar(stmt->relation);
+	if (error || *buf == NULL)
+	{
+		if (*buf)
+			pfree(*buf);
+		*buf = NULL;
+		return false;
 	}
 
-	else if (IsA(node, CopyStmt))
+	if (*len <= pool_config->memqcache_maxcache)
 	{
-		CopyStmt   *stmt = (CopyStmt *) node;
+		SelectContext ctx;
+		int			num_oids;
+		pool_sigset_t oldmask;
 
-		if (stmt->is_from)		/* COPY FROM? */
+		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
+
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+		PG_TRY();
 		{
-			table = make_table_name_from_rangevar(stmt->relation);
+			if (pool_commit_cache(backend, query, *buf, *len, num_oids, ctx.table_oids,
+								  pool_cache_expire(&ctx, num_oids)) != 0)
+				ereport(WARNING,
+						(errmsg("paginated query: pool_commit_cache failed")));
 		}
-		else
+		PG_CATCH();
 		{
-			return 0;
+			pool_shmem_unlock();
+			POOL_SETMASK(&oldmask);
+			PG_RE_THROW();
 		}
+		PG_END_TRY();
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
 	}
 
-	else if (IsA(node, DropStmt))
-	{
-		ListCell   *cell;
+	return true;
+}
 
-		DropStmt   *stmt = (DropStmt *) node;
+/*
+ * Simple and rough (thus unreliable) check if the query is likely
+ * SELECT. Just check if the query starts with SELECT or WITH. This
+ * can be used before parse tree is available.
+ */
+bool
+pool_is_likely_select(char *query)
+{
+	bool		do_continue = false;
 
-		if (stmt->removeType != OBJECT_TABLE)
-		{
-			return 0;
-		}
+	if (query == NULL)
+		return false;
 
-		/*
-		 * Here, stmt->objects is list of target relation info.  The first
-		 * cell of target relation info is a list (possibly) consists of
-		 * database, schema and relation.  We need to call
-		 * makeRangeVarFromNameList() before passing to
-		 * make_table_name_from_rangevar. Otherwise we get weird excessively
-		 * decorated relation name (''table_name'').
-		 */
-		foreach(cell, stmt->objects)
-		{
-			if (num_oids >= POOL_MAX_DML_OIDS)
-			{
-				ereport(LOG,
-						(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
-				return 0;
-			}
-
-			table = make_table_name_from_rangevar(makeRangeVarFromNameList(lfirst(cell)));
-			oid = pool_table_name_to_oid(table);
-			if (oid > 0)
-			{
-				oids[num_oids++] = pool_table_name_to_oid(table);
-				ereport(DEBUG1,
-						(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oids[num_oids - 1])));
-			}
-		}
-		return num_oids;
+	if (pool_config->ignore_leading_white_space)
+	{
+		/* Ignore leading white spaces */
+		while (*query && isspace(*query))
+			query++;
 	}
-	else if (IsA(node, TruncateStmt))
+	if (!*query)
 	{
-		ListCell   *cell;
-
-		TruncateStmt *stmt = (TruncateStmt *) node;
+		return false;
+	}
 
-		foreach(cell, stmt->relations)
+	/*
+	 * Get rid of head comment. It is sure that the query is in correct
+	 * format, because the parser has rejected bad queries such as the one
+	 * with not-ended comment.
+	 */
+	while (*query)
+	{
+		/* Ignore spaces and return marks */
+		do_continue = false;
+		while (*query && isspace(*query))
 		{
-			if (num_oids >= POOL_MAX_DML_OIDS)
-			{
-				ereport(LOG,
-						(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
-				return 0;
-			}
+			query++;
+			do_continue = true;
+		}
+		if (do_continue)
+		{
+			continue;
+		}
 
-			table = make_table_name_from_rangevar(lfirst(cell));
-			oid = pool_table_name_to_oid(table);
-			if (oid > 0)
-			{
-				oids[num_oids++] = pool_table_name_to_oid(table);
-				ereport(DEBUG1,
-						(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oids[num_oids - 1])));
-			}
+		while (*query && !strncmp(query, "\n", 2))
+		{
+			query++;
+			do_continue = true;
+		}
+		if (do_continue)
+		{
+			query += 2;
+			continue;
 		}
-		return num_oids;
-	}
-	else if (IsA(node, ExplainStmt))
-	{
-		ListCell	*cell;
-		DefElem		*def;
-		ExplainStmt *stmt = (ExplainStmt *) node;
 
-		foreach(cell, stmt->options)
+		/* Ignore comments like C */
+		if (!strncmp(query, "/*", 2))
 		{
-			def = lfirst(cell);
-			if (strncmp("analyze", def->defname, 7) == 0)
-			{
-				return pool_extract_table_oids(stmt->query, oidsp);
-			}
+			while (*query && strncmp(query, "*/", 2))
+				query++;
+
+			query += 2;
+			continue;
 		}
 
-		table = NULL;
-	}
-	else
-	{
-		ereport(DEBUG1,
-				(errmsg("memcache: extracting table oids: statement is different from INSERT/UPDATE/DELETE/TRUNCATE/DROP TABLE/ALTER TABLE")));
-		return 0;
-	}
+		/* Ignore SQL comments */
+		if (!strncmp(query, "--", 2))
+		{
+			while (*query && strncmp(query, "\n", 2))
+				query++;
 
-	oid = pool_table_name_to_oid(table);
-	if (oid > 0)
-	{
-		if (num_oids >= POOL_MAX_DML_OIDS)
+			query += 2;
+			continue;
+		}
+
+		if (!strncasecmp(query, "SELECT", 6) || !strncasecmp(query, "WITH", 4))
 		{
-			ereport(LOG,
-					(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
-			return 0;
+			return true;
 		}
 
-		oids[num_oids++] = pool_table_name_to_oid(table);
-		ereport(DEBUG1,
-				(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oid)));
+		query++;
 	}
-	return num_oids;
+
+	return false;
 }
 
 /*
- * Extract table oid from INSERT/UPDATE/DELETE
- * FROM statement in WITH clause.
- * Returns number of oids.
- * oids buffer (oidsp) will be discarded by subsequent call.
+ * Return true if SELECT can be cached.  "node" is the parse tree for
+ * the query and "query" is the query string.
+ * The query must be SELECT or WITH.
  */
-int
-pool_extract_withclause_oids(Node *node, int *oidsp)
+bool
+pool_is_allow_to_cache(Node *node, char *query)
 {
-	int			num_oids = 0;
-	int			oid;
-	char	   *table;
-	ListCell   *lc;
-	WithClause *with;
+	int			i = 0;
+	int			num_oids = -1;
+	SelectContext ctx;
+	SelectProperties props;
 
-	if(oidsp == NULL)
-	{
-		return 0;
-	}
+	pool_init_select_properties(&props, node);
 
-	if(!node || !IsA(node, WithClause))
-	{
-		return 0;
-	}
+	/*
+	 * If NO QUERY CACHE comment exists, do not cache.
+	 */
+	if (!strncasecmp(query, NO_QUERY_CACHE, NO_QUERY_CACHE_COMMENT_SZ))
+		return false;
 
-	with = (WithClause *) node;
-	foreach(lc, with->ctes)
+	/*
+	 * Check cache unsafe table list first.
+	 */
+	if (pool_config->num_cache_unsafe_memqcache_table_list > 0)
 	{
-		CommonTableExpr *cte = (CommonTableExpr *)lfirst(lc);
-		if(IsA(cte->ctequery, InsertStmt))
-		{
-			InsertStmt *stmt = (InsertStmt *) cte->ctequery;
-			table = make_table_name_from_rangevar(stmt->relation);
-		}
-		else if(IsA(cte->ctequery, DeleteStmt))
-		{
-			DeleteStmt *stmt = (DeleteStmt *) cte->ctequery;
-			table = make_table_name_from_rangevar(stmt->relation);
-		}
-		else if(IsA(cte->ctequery, UpdateStmt))
-		{
-			UpdateStmt *stmt = (UpdateStmt *) cte->ctequery;
-			table = make_table_name_from_rangevar(stmt->relation);
-		}
-		else
-		{
-			/* only check INSERT/DELETE/UPDATE in WITH clause */
-			table = NULL;
-		}
-
-		oid = pool_table_name_to_oid(table);
-		if (oid > 0)
+		/*
+		 * Extract oids in from clause of SELECT, and check if SELECT to them
+		 * could be cached.
+		 */
+		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
+		if (num_oids > 0)
 		{
-			if (num_oids >= POOL_MAX_DML_OIDS)
+			for (i = 0; i < num_oids; i++)
 			{
-				break;
+				ereport(DEBUG1,
+						(errmsg("memcache: checking if node is allowed to cache: check table_names[%d] = \"%s\"", i, ctx.table_names[i])));
+				if (pool_is_table_in_unsafe_list(ctx.table_names[i]) == true)
+				{
+					ereport(DEBUG1,
+							(errmsg("memcache: node is not allowed to cache")));
+					return false;
+				}
 			}
-
-			oidsp[num_oids++] = pool_table_name_to_oid(table);
-			ereport(DEBUG1,
-					(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oidsp[num_oids - 1])));
 		}
 	}
 
-	return num_oids;
-}
+	/* SELECT INTO or SELECT FOR SHARE or UPDATE cannot be cached */
+	if (pool_select_has_property(&props, SELECT_PROP_INSERTINTO_OR_LOCKING))
+		return false;
 
-#define POOL_OIDBUF_SIZE 1024
-static int *oidbuf;
-static int	oidbufp;
-static int	oidbuf_size;
+	/*
+	 * If SELECT uses non immutable functions, it's not allowed to cache.
+	 */
+	if (pool_select_has_property(&props, SELECT_PROP_NON_IMMUTABLE_FUNCTION))
+		return false;
 
-/*
- * Add table oid to internal buffer
- */
-void
-pool_add_dml_table_oid(int oid)
-{
-	int			i;
-	int		   *tmp;
+	/*
+	 * If SELECT uses temporary tables it's not allowed to cache.
+	 */
+	if (pool_config->check_temp_table && pool_select_has_property(&props, SELECT_PROP_TEMP_TABLE))
+		return false;
 
-	if (oid == 0)
-		return;
+	/*
+	 * If SELECT uses system catalogs, it's not allowed to cache.
+	 */
+	if (pool_select_has_property(&props, SELECT_PROP_SYSTEM_CATALOG))
+		return false;
 
-	if (oidbufp >= oidbuf_size)
+	/*
+	 * TABLESAMPLE is not allowed to cache.
+	 */
+	if (IsA(node, SelectStmt) &&((SelectStmt *) node)->fromClause)
 	{
-		MemoryContext oldcxt;
+		List	   *tbl_list = ((SelectStmt *) node)->fromClause;
+		ListCell   *tbl;
 
-		oidbuf_size += POOL_OIDBUF_SIZE;
+		foreach(tbl, tbl_list)
+		{
+			if (IsA(lfirst(tbl), RangeTableSample))
+				return false;
+		}
+	}
 
-		/*
-		 * This need to live throughout the life of child so home it in
-		 * TopMemoryContext
-		 */
-		oldcxt = MemoryContextSwitchTo(TopMemoryContext);
-		tmp = repalloc(oidbuf, sizeof(int) * oidbuf_size);
-		MemoryContextSwitchTo(oldcxt);
-		if (tmp == NULL)
-			return;
-
-		oidbuf = tmp;
-	}
 
-	for (i = 0; i < oidbufp; i++)
+	/*
+	 * If the table is in the while list, allow to cache even if it is VIEW or
+	 * unlogged table.
+	 */
+	if (pool_config->num_cache_safe_memqcache_table_list > 0)
 	{
-		if (oidbuf[i] == oid)
-			/* Already same oid exists */
-			return;
-	}
-	oidbuf[oidbufp++] = oid;
-}
-
-
-/*
- * Get table oid buffer
- */
-static int
-pool_get_dml_table_oid(int **oid)
-{
-	*oid = oidbuf;
-	return oidbufp;
-}
-
-static int
-pool_get_dropdb_table_oids(int **oids, int dboid)
-{
-	int		   *rtn = 0;
-	int			oids_size = 0;
-	int		   *tmp;
+		if (num_oids < 0)
+			num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
 
-	int			num_oids = 0;
-	DIR		   *dir;
-	struct dirent *dp;
-	char		path[1024];
+		if (num_oids > 0)
+		{
+			for (i = 0; i < num_oids; i++)
+			{
+				char	   *table = ctx.table_names[i];
 
-	snprintf(path, sizeof(path), "%s/%d", pool_config->memqcache_oiddir, dboid);
-	if ((dir = opendir(path)) == NULL)
+				ereport(DEBUG1,
+						(errmsg("memcache: checking if node is allowed to cache: check table_names[%d] = \"%s\"", i, table)));
+				if (is_view(table) || is_unlogged_table(table))
+				{
+					if (pool_is_table_in_safe_list(table) == false)
+					{
+						ereport(DEBUG1,
+								(errmsg("memcache: node is not allowed to cache")));
+						return false;
+					}
+				}
+			}
+		}
+	}
+	else
 	{
-		ereport(DEBUG1,
-				(errmsg("memcache: getting drop table oids"),
-				 errdetail("Failed to open dir: %s", path)));
-		return 0;
+		/*
+		 * If SELECT uses views, it's not allowed to cache.
+		 */
+		if (pool_select_has_property(&props, SELECT_PROP_VIEW))
+			return false;
+
+		/*
+		 * If SELECT uses unlogged tables, it's not allowed to cache.
+		 */
+		if (pool_select_has_property(&props, SELECT_PROP_UNLOGGED_TABLE))
+			return false;
 	}
 
-	while ((dp = readdir(dir)) != NULL)
+	/*
+	 * If Data-modifying statements in WITH clause, it's not allowed to cache.
+	 */
+	if(IsA(node, SelectStmt) && ((SelectStmt *) node)->withClause)
 	{
-		if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
-			continue;
+		ListCell	*lc;
+		WithClause	*withClause = ((SelectStmt *) node)->withClause;
 
-		if (num_oids >= oids_size)
+		foreach(lc, withClause->ctes)
 		{
-			oids_size += POOL_OIDBUF_SIZE;
-			tmp = repalloc(rtn, sizeof(int) * oids_size);
-			if (tmp == NULL)
+			CommonTableExpr *cte = (CommonTableExpr *)lfirst(lc);
+			if(IsA(cte->ctequery, InsertStmt) ||
+			   IsA(cte->ctequery, DeleteStmt) ||
+			   IsA(cte->ctequery, UpdateStmt))
 			{
-				closedir(dir);
-				return 0;
+				return false;
 			}
-			rtn = tmp;
 		}
-
-		rtn[num_oids] = atol(dp->d_name);
-		num_oids++;
 	}
 
-	closedir(dir);
-	*oids = rtn;
-
-	return num_oids;
-}
-
-/* Discard oid internal buffer */
-static void
-pool_discard_dml_table_oid(void)
-{
-	oidbufp = 0;
+	return true;
 }
 
-/*
- * Management modules for oid map.  When caching SELECT results, we
- * record table oids to file, which has following structure.
- *
- * memqcache_oiddir -+- database_oid -+-table_oid_file1
- *                                    |
- *                                    +-table_oid_file2
- *                                    |
- *                                    +-table_oid_file3...
- *
- * table_oid_file's name is table oid, which was used by the SELECT
- * statement. The file has 1 or more cacheid(s). When SELECT result is
- * cached, the file is created and cache id is appended. Later SELECT
- * using same table oid will add to the same file. If the SELECT uses
- * multiple tables, multiple table_oid_file will be created. When
- * INSERT/UPDATE/DELETE is executed, corresponding caches must be
- * deleted (cache invalidation) (when DROP TABLE, ALTER TABLE is
- * executed, the caches must be deleted as well). When database is
- * dropped, all caches belonging to the database must be deleted.
- */
 
 /*
- * Get oid of current database
+ * Return true If the SELECTed table is in back list.
  */
-static int
-pool_get_database_oid(void)
+bool
+pool_is_table_in_unsafe_list(const char *table_name)
 {
-/*
- * Query to convert table name to oid
- */
-	int			oid = 0;
-	static POOL_RELCACHE * relcache;
-	POOL_CONNECTION_POOL *backend;
-
-	backend = pool_get_session_context(false)->backend;
 
-	/*
-	 * If relcache does not exist, create it.
-	 */
-	if (!relcache)
+	if (pool_config->num_cache_unsafe_memqcache_table_list > 0 &&
+		pattern_compare((char *) table_name, WRITELIST, "cache_unsafe_memqcache_table_list") == 1)
 	{
-		relcache = pool_create_relcache(pool_config->relcache_size, DATABASE_TO_OID_QUERY,
-										int_register_func, int_unregister_func,
-										false);
-		if (relcache == NULL)
-		{
-			ereport(LOG,
-					(errmsg("memcache: error creating relcache while getting database OID")));
-			return oid;
-		}
+		return true;
 	}
 
-	/*
-	 * Search relcache.
-	 */
-	oid = (int) (intptr_t) pool_search_relcache(relcache, backend,
-												MAIN_CONNECTION(backend)->sp->database);
-	return oid;
+	return false;
 }
 
 /*
- * Get oid of current database for discarding cache files
- * after executing DROP DATABASE
+ * Return true If the SELECTed table is in cache_safe list.
  */
-int
-pool_get_database_oid_from_dbname(char *dbname)
+bool
+pool_is_table_in_safe_list(const char *table_name)
 {
-	int			dboid = 0;
-	POOL_SELECT_RESULT *res;
-	char		query[1024];
-
-	POOL_CONNECTION_POOL *backend;
-
-	backend = pool_get_session_context(false)->backend;
-
-	snprintf(query, sizeof(query), DATABASE_TO_OID_QUERY, dbname);
-	do_query(MAIN(backend), query, &res, MAJOR(backend));
-
-	if (res->numrows != 1)
+	if (pool_config->num_cache_safe_memqcache_table_list > 0 &&
+		pattern_compare((char *) table_name, READONLYLIST, "cache_safe_memqcache_table_list") == 1)
 	{
-		ereport(DEBUG1,
-				(errmsg("memcache: getting oid of current database"),
-				 errdetail("received %d rows", res->numrows)));
-		free_select_result(res);
-		return 0;
+		return true;
 	}
 
-	dboid = atol(res->data[0]);
-	free_select_result(res);
-
-	return dboid;
+	return false;
 }
 
 /*
- * Add cache id (shmem case) or hash key (memcached case) to table oid
- * map file.  Caller must hold shmem lock before calling this function
- * to avoid file extension conflict among different pgpool child
- * process.
- * As of pgpool-II 3.2, pool_handle_query_cache is responsible for that.
- * (pool_handle_query_cache -> pool_commit_cache -> pool_add_table_oid_map)
+ * Extract table oid from INSERT/UPDATE/DELETE/TRUNCATE/
+ * DROP TABLE/ALTER TABLE/COPY FROM statement.
+ * For SELECT, if Data-modifying statements in its WITH clause,
+ * extract table oid from Data-modifying statements too.
+ * Returns number of oids.
+ * In case of error, returns 0 (InvalidOid).
+ * oids buffer (oidsp) will be discarded by subsequent call.
  */
-static void
-pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_oids)
+int
+pool_extract_table_oids(Node *node, int **oidsp)
 {
-	char	   *dir;
-	int			dboid;
-	char		path[1024];
-	int			i;
-	int			len;
-
-	/*
-	 * Create memqcache_oiddir
-	 */
-	dir = pool_config->memqcache_oiddir;
+#define POOL_MAX_DML_OIDS 128
+	char	   *table;
+	static int	oids[POOL_MAX_DML_OIDS];
+	int			num_oids;
+	int			oid;
 
-	if (mkdir(dir, S_IREAD | S_IWRITE | S_IEXEC) == -1)
+	if (node == NULL)
 	{
-		if (errno != EEXIST)
-		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", dir),
-					 errdetail("%m")));
-			return;
-		}
+		ereport(LOG,
+				(errmsg("memcache: error while extracting table oids. statement is NULL")));
+		return 0;
 	}
 
-	/*
-	 * Create memqcache_oiddir/database_oid
-	 */
-	dboid = pool_get_database_oid();
-	ereport(DEBUG1,
-			(errmsg("memcache: adding table oid maps"),
-			 errdetail("dboid %d", dboid)));
+	num_oids = 0;
+	*oidsp = oids;
 
-	if (dboid <= 0)
+	if (IsA(node, InsertStmt))
 	{
-		ereport(WARNING,
-				(errmsg("memcache: adding table oid maps, failed to get database OID")));
-		return;
+		InsertStmt *stmt = (InsertStmt *) node;
+
+		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
+		table = make_table_name_from_rangevar(stmt->relation);
 	}
+	else if (IsA(node, UpdateStmt))
+	{
+		UpdateStmt *stmt = (UpdateStmt *) node;
 
-	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
-	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
+		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
+		table = make_table_name_from_rangevar(stmt->relation);
+	}
+	else if (IsA(node, DeleteStmt))
 	{
-		if (errno != EEXIST)
-		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", path),
-					 errdetail("%m")));
-			return;
-		}
+		DeleteStmt *stmt = (DeleteStmt *) node;
+
+		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
+		table = make_table_name_from_rangevar(stmt->relation);
+	}
+	else if(IsA(node, SelectStmt))
+	{
+		SelectStmt *stmt = (SelectStmt *) node;
+		num_oids = pool_extract_withclause_oids((Node *) stmt->withClause, *oidsp);
+		table = NULL;
 	}
+#ifdef NOT_USED
 
-	if (pool_is_shmem_cache())
+	/*
+	 * We do not handle CREATE TABLE here.  It is possible that
+	 * pool_extract_table_oids() is called before CREATE TABLE gets executed.
+	 */
+	else if (IsA(node, CreateStmt))
 	{
-		len = sizeof(cachekey->cacheid);
+		CreateStmt *stmt = (CreateStmt *) node;
+
+		table = make_table_name_from_rangevar(stmt->relation);
 	}
-	else
+#endif
+
+	else if (IsA(node, AlterTableStmt))
 	{
-		len = sizeof(cachekey->hashkey);
+		AlterTableStmt *stmt = (AlterTableStmt *) node;
+
+		table = make_table_name_from_rangevar(stmt->relation);
 	}
 
-	for (i = 0; i < num_table_oids; i++)
+	else if (IsA(node, CopyStmt))
 	{
-		int			fd;
-		int			oid = table_oids[i];
-		int			sts;
-		struct flock fl;
+		CopyStmt   *stmt = (CopyStmt *) node;
 
-		/*
-		 * Create or open each memqcache_oiddir/database_oid/table_oid
-		 */
-		snprintf(path, sizeof(path), "%s/%d/%d", dir, dboid, oid);
-		if ((fd = open(path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR)) == -1)
+		if (stmt->is_from)		/* COPY FROM? */
 		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed to open file:\"%s\"", path),
-					 errdetail("%m")));
-			return;
+			table = make_table_name_from_rangevar(stmt->relation);
+		}
+		else
+		{
+			return 0;
 		}
+	}
 
-		fl.l_type = F_WRLCK;
-		fl.l_whence = SEEK_SET;
-		fl.l_start = 0;			/* Offset from l_whence         */
-		fl.l_len = 0;			/* length, 0 = to EOF           */
+	else if (IsA(node, DropStmt))
+	{
+		ListCell   *cell;
 
-		sts = fcntl(fd, F_SETLKW, &fl);
-		if (sts == -1)
-		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed to lock file:\"%s\"", path),
-					 errdetail("%m")));
+		DropStmt   *stmt = (DropStmt *) node;
 
-			close(fd);
-			return;
+		if (stmt->removeType != OBJECT_TABLE)
+		{
+			return 0;
 		}
 
 		/*
-		 * Below was ifdef-out because of a performance reason. Looking for
-		 * duplicate cache entries in a file needed unacceptably high cost. So
-		 * we gave up this and decided not to care about duplicate entries in
-		 * the file.
+		 * Here, stmt->objects is list of target relation info.  The first
+		 * cell of target relation info is a list (possibly) consists of
+		 * database, schema and relation.  We need to call
+		 * makeRangeVarFromNameList() before passing to
+		 * make_table_name_from_rangevar. Otherwise we get weird excessively
+		 * decorated relation name (''table_name'').
 		 */
-#ifdef NOT_USED
-		for (;;)
+		foreach(cell, stmt->objects)
 		{
-			sts = read(fd, (char *) &buf, len);
-			if (sts == -1)
+			if (num_oids >= POOL_MAX_DML_OIDS)
 			{
-				ereport(WARNING,
-						(errmsg("memcache: adding table oid maps, failed to read file:\"%s\"", path),
-						 errdetail("%m")));
-				close(fd);
-				return;
+				ereport(LOG,
+						(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
+				return 0;
 			}
-			else if (sts == len)
+
+			table = make_table_name_from_rangevar(makeRangeVarFromNameList(lfirst(cell)));
+			oid = pool_table_name_to_oid(table);
+			if (oid > 0)
 			{
-				if (memcmp(cachekey, &buf, len) == 0)
-				{
-					/* Same key found. Skip this */
-					close(fd);
-					return;
-				}
-				continue;
+				oids[num_oids++] = pool_table_name_to_oid(table);
+				ereport(DEBUG1,
+						(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oids[num_oids - 1])));
 			}
+		}
+		return num_oids;
+	}
+	else if (IsA(node, TruncateStmt))
+	{
+		ListCell   *cell;
 
-			/*
-			 * Must be EOF
-			 */
-			if (sts != 0)
+		TruncateStmt *stmt = (TruncateStmt *) node;
+
+		foreach(cell, stmt->relations)
+		{
+			if (num_oids >= POOL_MAX_DML_OIDS)
 			{
-				ereport(WARNING,
-						(errmsg("memcache: adding table oid maps, invalid data length:%d in file:\"%s\". error:\"%s\"", sts, path)));
-				close(fd);
-				return;
+				ereport(LOG,
+						(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
+				return 0;
+			}
+
+			table = make_table_name_from_rangevar(lfirst(cell));
+			oid = pool_table_name_to_oid(table);
+			if (oid > 0)
+			{
+				oids[num_oids++] = pool_table_name_to_oid(table);
+				ereport(DEBUG1,
+						(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oids[num_oids - 1])));
 			}
-			break;
 		}
-#endif
+		return num_oids;
+	}
+	else if (IsA(node, ExplainStmt))
+	{
+		ListCell	*cell;
+		DefElem		*def;
+		ExplainStmt *stmt = (ExplainStmt *) node;
 
-		if (lseek(fd, 0, SEEK_END) == -1)
+		foreach(cell, stmt->options)
 		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed seek on file:\"%s\"", path),
-					 errdetail("%m")));
-			close(fd);
-			return;
+			def = lfirst(cell);
+			if (strncmp("analyze", def->defname, 7) == 0)
+			{
+				return pool_extract_table_oids(stmt->query, oidsp);
+			}
 		}
 
-		/*
-		 * Write cache_id or cache key at the end of file
-		 */
-		sts = write(fd, (char *) cachekey, len);
-		if (sts == -1 || sts != len)
+		table = NULL;
+	}
+	else
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: extracting table oids: statement is different from INSERT/UPDATE/DELETE/TRUNCATE/DROP TABLE/ALTER TABLE")));
+		return 0;
+	}
+
+	oid = pool_table_name_to_oid(table);
+	if (oid > 0)
+	{
+		if (num_oids >= POOL_MAX_DML_OIDS)
 		{
-			ereport(WARNING,
-					(errmsg("memcache: adding table oid maps, failed to write file:\"%s\"", path),
-					 errdetail("%m")));
-			close(fd);
-			return;
+			ereport(LOG,
+					(errmsg("memcache: error while extracting table oids. too many oids:%d", num_oids)));
+			return 0;
 		}
-		close(fd);
+
+		oids[num_oids++] = pool_table_name_to_oid(table);
+		ereport(DEBUG1,
+				(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oid)));
 	}
+	return num_oids;
 }
 
 /*
- * Discard all oid maps at pgpool-II startup.
- * This is necessary for shmem case.
+ * Extract table oid from INSERT/UPDATE/DELETE
+ * FROM statement in WITH clause.
+ * Returns number of oids.
+ * oids buffer (oidsp) will be discarded by subsequent call.
  */
-void
-pool_discard_oid_maps(void)
-{
-	char		command[1024];
-
-	snprintf(command, sizeof(command), "/bin/rm -fr %s/[0-9]*",
-			 pool_config->memqcache_oiddir);
-	if (system(command) == -1)
-		ereport(WARNING,
-				(errmsg("unable to execute command \"%s\"", command),
-				 errdetail("system() command failed with error \"%m\"")));
-
-
-}
-
-void
-pool_discard_oid_maps_by_db(int dboid)
+int
+pool_extract_withclause_oids(Node *node, int *oidsp)
 {
-	char		command[1024];
+	int			num_oids = 0;
+	int			oid;
+	char	   *table;
+	ListCell   *lc;
+	WithClause *with;
 
-	if (pool_is_shmem_cache())
+	if(oidsp == NULL)
 	{
-		snprintf(command, sizeof(command), "/bin/rm -fr %s/%d/",
-				 pool_config->memqcache_oiddir, dboid);
-
-		ereport(DEBUG1,
-				(errmsg("memcache: discarding oid maps by db"),
-				 errdetail("command: '%s\'", command)));
-
-		if (system(command) == -1)
-			ereport(WARNING,
-					(errmsg("unable to execute command \"%s\"", command),
-					 errdetail("system() command failed with error \"%m\"")));
+		return 0;
 	}
-}
 
-/*
- * Read cache id (shmem case) or hash key (memcached case) from table
- * oid map file according to table_oids and discard cache entries.  If
- * unlink is true, the file will be unlinked after successful cache
- * removal.
- */
-static void
-pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, int dboid)
-{
-	char	   *dir;
-	char		path[1024];
-	int			i;
-	int			len;
-	POOL_CACHEKEY buf;
-
-	/*
-	 * Create memqcache_oiddir
-	 */
-	dir = pool_config->memqcache_oiddir;
-	if (mkdir(dir, S_IREAD | S_IWRITE | S_IEXEC) == -1)
+	if(!node || !IsA(node, WithClause))
 	{
-		if (errno != EEXIST)
-		{
-			ereport(WARNING,
-					(errmsg("memcache: invalidating query cache, failed to create directory:\"%s\"", dir),
-					 errdetail("%m")));
-			return;
-		}
+		return 0;
 	}
 
-	/*
-	 * Create memqcache_oiddir/database_oid
-	 */
-	if (dboid == 0)
+	with = (WithClause *) node;
+	foreach(lc, with->ctes)
 	{
-		dboid = pool_get_database_oid();
-		ereport(DEBUG1,
-				(errmsg("memcache invalidating query cache"),
-				 errdetail("dboid %d", dboid)));
-
-		if (dboid <= 0)
+		CommonTableExpr *cte = (CommonTableExpr *)lfirst(lc);
+		if(IsA(cte->ctequery, InsertStmt))
 		{
-			ereport(WARNING,
-					(errmsg("memcache: invalidating query cache, could not get database OID")));
-			return;
+			InsertStmt *stmt = (InsertStmt *) cte->ctequery;
+			table = make_table_name_from_rangevar(stmt->relation);
 		}
-	}
-
-	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
-	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
-	{
-		if (errno != EEXIST)
+		else if(IsA(cte->ctequery, DeleteStmt))
 		{
-			ereport(WARNING,
-					(errmsg("memcache: invalidating query cache, failed to create directory:\"%s\"", path),
-					 errdetail("%m")));
-			return;
+			DeleteStmt *stmt = (DeleteStmt *) cte->ctequery;
+			table = make_table_name_from_rangevar(stmt->relation);
 		}
-	}
-
-	if (pool_is_shmem_cache())
-	{
-		len = sizeof(buf.cacheid);
-	}
-	else
-	{
-		len = sizeof(buf.hashkey);
-	}
-
-	for (i = 0; i < num_table_oids; i++)
-	{
-		int			fd;
-		int			oid = table_oid[i];
-		int			sts;
-		struct flock fl;
-
-		/*
-		 * Open each memqcache_oiddir/database_oid/table_oid
-		 */
-		snprintf(path, sizeof(path), "%s/%d/%d", dir, dboid, oid);
-		if ((fd = open(path, O_RDONLY)) == -1)
+		else if(IsA(cte->ctequery, UpdateStmt))
 		{
-			/*
-			 * This may be normal. It is possible that no SELECT has been
-			 * issued since the table has been created or since pgpool-II
-			 * started up.
-			 */
-			ereport(DEBUG1,
-					(errmsg("memcache invalidating query cache"),
-					 errdetail("failed to open \"%s\". reason:\"%m\"", path)));
-			continue;
+			UpdateStmt *stmt = (UpdateStmt *) cte->ctequery;
+			table = make_table_name_from_rangevar(stmt->relation);
 		}
-
-		fl.l_type = F_RDLCK;
-		fl.l_whence = SEEK_SET;
-		fl.l_start = 0;			/* Offset from l_whence         */
-		fl.l_len = 0;			/* length, 0 = to EOF           */
-
-		sts = fcntl(fd, F_SETLKW, &fl);
-		if (sts == -1)
+		else
 		{
-			ereport(WARNING,
-					(errmsg("memcache: invalidating query cache, failed to lock file:\"%s\"", path),
-					 errdetail("%m")));
-			close(fd);
-			return;
+			/* only check INSERT/DELETE/UPDATE in WITH clause */
+			table = NULL;
 		}
-		for (;;)
-		{
-			sts = read(fd, (char *) &buf, len);
-			if (sts == -1)
-			{
-				ereport(WARNING,
-						(errmsg("memcache: invalidating query cache, failed to read file:\"%s\"", path),
-						 errdetail("%m")));
-
-				close(fd);
-				return;
-			}
-			else if (sts == len)
-			{
-				if (pool_is_shmem_cache())
-				{
-					ereport(DEBUG1,
-							(errmsg("memcache invalidating query cache"),
-							 errdetail("deleting cacheid:%d itemid:%d",
-									   buf.cacheid.blockid, buf.cacheid.itemid)));
-					pool_delete_item_shmem_cache(&buf.cacheid);
-				}
-#ifdef USE_MEMCACHED
-				else
-				{
-					char		delbuf[33];
-
-					memcpy(delbuf, buf.hashkey, 32);
-					delbuf[32] = 0;
-					ereport(DEBUG1,
-							(errmsg("memcache invalidating query cache"),
-							 errdetail("deleting %s", delbuf)));
-
-					delete_cache_on_memcached(delbuf);
-				}
-#endif
-				continue;
-			}
 
-			/*
-			 * Must be EOF
-			 */
-			if (sts != 0)
+		oid = pool_table_name_to_oid(table);
+		if (oid > 0)
+		{
+			if (num_oids >= POOL_MAX_DML_OIDS)
 			{
-				ereport(WARNING,
-						(errmsg("memcache: invalidating query cache, invalid data length:%d in file:\"%s\"", sts, path)));
-				close(fd);
-				return;
+				break;
 			}
-			break;
-		}
 
-		if (unlinkp)
-		{
-			unlink(path);
+			oidsp[num_oids++] = pool_table_name_to_oid(table);
+			ereport(DEBUG1,
+					(errmsg("memcache: extracting table oids: table: \"%s\" oid:%d", table, oidsp[num_oids - 1])));
 		}
-		close(fd);
 	}
-#ifdef SHMEMCACHE_DEBUG
-	dump_shmem_cache(0);
-#endif
+
+	return num_oids;
 }
 
+#define POOL_OIDBUF_SIZE 1024
+static int *oidbuf;
+static int	oidbufp;
+static int	oidbuf_size;
+
 /*
- * Reset SELECT data buffers.  If reset_dml_oids is true, call
- * pool_discard_dml_table_oid() to reset table oids used in DML statements.
+ * Add table oid to internal buffer
  */
-static void
-pool_reset_memqcache_buffer(bool reset_dml_oids)
+void
+pool_add_dml_table_oid(int oid)
 {
-	POOL_SESSION_CONTEXT *session_context;
+	int			i;
+	int		   *tmp;
 
-	session_context = pool_get_session_context(true);
+	if (oid == 0)
+		return;
 
-	if (session_context && session_context->query_cache_array)
+	if (oidbufp >= oidbuf_size)
 	{
-		POOL_TEMP_QUERY_CACHE *cache;
-
-		ereport(DEBUG1,
-				(errmsg("memcache reset buffer"),
-				 errdetail("discard: %p", session_context->query_cache_array)));
-
-		pool_discard_query_cache_array(session_context->query_cache_array);
-		session_context->query_cache_array = pool_create_query_cache_array();
+		MemoryContext oldcxt;
 
-		ereport(DEBUG1,
-				(errmsg("memcache reset buffer"),
-				 errdetail("create: %p", session_context->query_cache_array)));
+		oidbuf_size += POOL_OIDBUF_SIZE;
 
 		/*
-		 * if the query context is still under use, we cannot discard
-		 * temporary cache.
+		 * This need to live throughout the life of child so home it in
+		 * TopMemoryContext
 		 */
-		if ((SL_MODE && pool_is_doing_extended_query_message()) ||
-			can_query_context_destroy(session_context->query_context))
-		{
-			ereport(DEBUG1,
-					(errmsg("memcache reset buffer"),
-					 errdetail("discard temp buffer of %p (%s)",
-							   session_context->query_context, session_context->query_context->original_query)));
-
-			cache = pool_get_current_cache();
-			pool_discard_temp_query_cache(cache);
+		oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+		tmp = repalloc(oidbuf, sizeof(int) * oidbuf_size);
+		MemoryContextSwitchTo(oldcxt);
+		if (tmp == NULL)
+			return;
 
-			/*
-			 * Reset temp_cache pointer in the current query context so that
-			 * we don't double free memory.
-			 */
-			session_context->query_context->temp_cache = NULL;
-		}
+		oidbuf = tmp;
 	}
 
-	if (reset_dml_oids)
-		pool_discard_dml_table_oid();
-
-	pool_tmp_stats_reset_num_selects();
+	for (i = 0; i < oidbufp; i++)
+	{
+		if (oidbuf[i] == oid)
+			/* Already same oid exists */
+			return;
+	}
+	oidbuf[oidbufp++] = oid;
 }
 
-/*
- * Return true if memory cache method is "shmem".  The purpose of this
- * function is to cache the result of strcmp and to save a few cycle.
- */
-bool
-pool_is_shmem_cache(void)
-{
-	return pool_config->memqcache_method == SHMEM_CACHE;
-}
 
 /*
- * Remember memory cache number of blocks.
+ * Get table oid buffer
  */
-static int	memqcache_num_blocks;
-static void
-pool_set_memqcache_blocks(int num_blocks)
+static int
+pool_get_dml_table_oid(int **oid)
 {
-	memqcache_num_blocks = num_blocks;
+	*oid = oidbuf;
+	return oidbufp;
 }
 
-/*
- * Return memory cache number of blocks.
- */
 static int
-pool_get_memqcache_blocks(void)
+pool_get_dropdb_table_oids(int **oids, int dboid)
 {
-	return memqcache_num_blocks;
-}
-
-/*
- * Query cache on shared memory management modules.
- */
+	int		   *rtn = 0;
+	int			oids_size = 0;
+	int		   *tmp;
 
-/*
- * Calculate necessary shared memory size.
- */
-size_t
-pool_shared_memory_cache_size(void)
-{
-	int64		num_blocks;
-	size_t		size;
+	int			num_oids = 0;
+	DIR		   *dir;
+	struct dirent *dp;
+	char		path[1024];
 
-	if (pool_config->memqcache_maxcache > pool_config->memqcache_cache_block_size)
-		ereport(FATAL,
-				(errmsg("invalid memory cache configuration"),
-				 errdetail("memqcache_cache_block_size %d should be greater or equal to memqcache_maxcache %d",
-						   pool_config->memqcache_cache_block_size,
-						   pool_config->memqcache_maxcache)));
+	snprintf(path, sizeof(path), "%s/%d", pool_config->memqcache_oiddir, dboid);
+	if ((dir = opendir(path)) == NULL)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: getting drop table oids"),
+				 errdetail("Failed to open dir: %s", path)));
+		return 0;
+	}
 
+	while ((dp = readdir(dir)) != NULL)
+	{
+		if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+			continue;
 
-	num_blocks = pool_config->memqcache_total_size /
-		pool_config->memqcache_cache_block_size;
-	if (num_blocks == 0)
-		ereport(FATAL,
-				(errmsg("invalid memory cache configuration"),
-				 errdetail("memqcache_total_size %ld should be greater or equal to memqcache_cache_block_size %d",
-						   pool_config->memqcache_total_size,
-						   pool_config->memqcache_cache_block_size)));
+		if (num_oids >= oids_size)
+		{
+			oids_size += POOL_OIDBUF_SIZE;
+			tmp = repalloc(rtn, sizeof(int) * oids_size);
+			if (tmp == NULL)
+			{
+				closedir(dir);
+				return 0;
+			}
+			rtn = tmp;
+		}
 
-	ereport(LOG,
-			(errmsg("memory cache initialized"),
-			 errdetail("memcache blocks :%ld", num_blocks)));
-	/* Remember # of blocks */
-	pool_set_memqcache_blocks(num_blocks);
-	size = pool_config->memqcache_cache_block_size * num_blocks;
-	elog(DEBUG1, "shared_memory_cache_size: %zu", size);
-	return size;
+		rtn[num_oids] = atol(dp->d_name);
+		num_oids++;
+	}
+
+	closedir(dir);
+	*oids = rtn;
+
+	return num_oids;
 }
 
-/*
- * Acquire and initialize shared memory cache. This should be called
- * only once from pgpool main process at the process staring up time.
- */
-static void *shmem;
-int
-pool_init_memory_cache(size_t size)
+/* Discard oid internal buffer */
+static void
+pool_discard_dml_table_oid(void)
 {
-	ereport(DEBUG1,
-			(errmsg("memory cache request size : %zd", size)));
-
-	shmem = pool_shared_memory_segment_get_chunk(size);
-	return 0;
+	oidbufp = 0;
 }
 
 /*
- * Clear all the shared memory cache and reset FSMM and hash table.
+ * Management modules for oid map.  When caching SELECT results, we
+ * record which tables are used by the cache entry so that the entry
+ * can be invalidated when the tables are modified.
+ *
+ * For shmem cache the map is kept on the shared memory (see "On shared
+ * memory table oid map implementation" below).  The shmem cache does
+ * not survive pgpool-II restart, nor does the map.
+ *
+ * For memcached, we record table oids to file, which has following
+ * structure.
+ *
+ * memqcache_oiddir -+- database_oid -+-table_oid_file1
+ *                                    |
+ *                                    +-table_oid_file2
+ *                                    |
+ *                                    +-table_oid_file3...
+ *
+ * table_oid_file's name is table oid, which was used by the SELECT
+ * statement. The file has 1 or more cacheid(s). When SELECT result is
+ * cached, the file is created and cache id is appended. Later SELECT
+ * using same table oid will add to the same file. If the SELECT uses
+ * multiple tables, multiple table_oid_file will be created. When
+ * INSERT/UPDATE/DELETE is executed, corresponding caches must be
+ * deleted (cache invalidation) (when DROP TABLE, ALTER TABLE is
+ * executed, the caches must be deleted as well). When database is
+ * dropped, all caches belonging to the database must be deleted.
  */
-void
-pool_clear_memory_cache(void)
-{
-	size_t		size;
-	pool_sigset_t oldmask;
-
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-
-	PG_TRY();
-	{
-		size = pool_shared_memory_cache_size();
-		memset(shmem, 0, size);
-
-		size = pool_shared_memory_fsmm_size();
-		pool_reset_fsmm(size);
 
-		pool_discard_oid_maps();
+/*
+ * Get oid of current database
+ */
+static int
+pool_get_database_oid(void)
+{
+/*
+ * Query to convert table name to oid
+ */
+	int			oid = 0;
+	static POOL_RELCACHE * relcache;
+	POOL_CONNECTION_POOL *backend;
 
-		pool_hash_reset(pool_config->memqcache_max_num_cache);
+	backend = pool_get_session_context(false)->backend;
 
-		pool_init_whole_cache_blocks();
-	}
-	PG_CATCH();
+	/*
+	 * If relcache does not exist, create it.
+	 */
+	if (!relcache)
 	{
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
-		PG_RE_THROW();
+		relcache = pool_create_relcache(pool_config->relcache_size, DATABASE_TO_OID_QUERY,
+										int_register_func, int_unregister_func,
+										false);
+		if (relcache == NULL)
+		{
+			ereport(LOG,
+					(errmsg("memcache: error creating relcache while getting database OID")));
+			return oid;
+		}
 	}
-	PG_END_TRY();
 
-	pool_shmem_unlock();
-	POOL_SETMASK(&oldmask);
+	/*
+	 * Search relcache.
+	 */
+	oid = (int) (intptr_t) pool_search_relcache(relcache, backend,
+												MAIN_CONNECTION(backend)->sp->database);
+	return oid;
 }
 
 /*
- * Return shared memory cache address
+ * Get oid of current database for discarding cache files
+ * after executing DROP DATABASE
  */
-static void *
-pool_memory_cache_address(void)
+int
+pool_get_database_oid_from_dbname(char *dbname)
 {
-	return shmem;
-}
+	int			dboid = 0;
+	POOL_SELECT_RESULT *res;
+	char		query[1024];
 
-/*
- * Initialize whole cache blocks
- */
-void
-pool_init_whole_cache_blocks(void)
-{
-	int		blocks = pool_get_memqcache_blocks();
-	int		i;
+	POOL_CONNECTION_POOL *backend;
 
-	for (i = 0; i < blocks; i++)
+	backend = pool_get_session_context(false)->backend;
+
+	snprintf(query, sizeof(query), DATABASE_TO_OID_QUERY, dbname);
+	do_query(MAIN(backend), query, &res, MAJOR(backend));
+
+	if (res->numrows != 1)
 	{
-		pool_init_cache_block(i);
+		ereport(DEBUG1,
+				(errmsg("memcache: getting oid of current database"),
+				 errdetail("received %d rows", res->numrows)));
+		free_select_result(res);
+		return 0;
 	}
-}
-
-/*
- * Free space management map
- *
- * Free space management map (FSMM) consists of bytes. Each byte
- * corresponds to block id. For example, if you have 1GB cache and
- * block size is 8Kb, number of blocks = 131,072, thus total size of
- * FSMM is 128Kb.  Each FSMM entry has value from 0 to 255. Those
- * values describes total free space in each block.
- * For example, if the value is 2, the free space can be between 64
- * bytes and 95 bytes.
- *
- * value free space (in bytes)
- * 0     0-31
- * 1     32-63
- * 2     64-95
- * 3     96-127
- * :
- * 255   8160-8192
- */
 
-/*
- * Calculate necessary shared memory size for FSMM. Should be called after
- * pool_shared_memory_cache_size.
- */
-size_t
-pool_shared_memory_fsmm_size(void)
-{
-	size_t		size;
+	dboid = atol(res->data[0]);
+	free_select_result(res);
 
-	size = pool_get_memqcache_blocks() * sizeof(char);
-	elog(DEBUG1, "shared_memory_fsmm_size: %zu", size);
-	return size;
+	return dboid;
 }
 
 /*
- * Acquire and initialize shared memory cache for FSMM. This should be
- * called after pool_shared_memory_cache_size only once from pgpool
- * main process at the process staring up time.
+ * Add cache id (shmem case) or hash key (memcached case) to table oid
+ * map file.  Caller must hold shmem lock before calling this function
+ * to avoid file extension conflict among different pgpool child
+ * process.
+ * As of pgpool-II 3.2, pool_handle_query_cache is responsible for that.
+ * (pool_handle_query_cache -> pool_commit_cache -> pool_add_table_oid_map)
  */
-static void *fsmm;
-int
-pool_init_fsmm(size_t size)
+static void
+pool_add_table_oid_map(POOL_CACHEKEY * cachekey, int num_table_oids, int *table_oids)
 {
-	int			maxblock = pool_get_memqcache_blocks();
-	int			encode_value;
+	char	   *dir;
+	int			dboid;
+	char		path[1024];
+	int			i;
+	int			len;
 
-	fsmm = pool_shared_memory_segment_get_chunk(size);
-	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
-	memset(fsmm, encode_value, maxblock);
-	return 0;
-}
-
-/*
- * Return shared memory fsmm address
- */
-static void *
-pool_fsmm_address(void)
-{
-	return fsmm;
-}
-
-/*
- * Clock algorithm shared query cache management modules.
- */
-
-/*
- * Clock hand pointing to next victim block
- */
-static int *pool_fsmm_clock_hand;
-
-/*
- * Allocate and initialize clock hand on shmem
- */
-void
-pool_allocate_fsmm_clock_hand(void)
-{
-	pool_fsmm_clock_hand = pool_shared_memory_segment_get_chunk(sizeof(*pool_fsmm_clock_hand));
-	*pool_fsmm_clock_hand = 0;
-}
-
-/*
- * Reset FSMM.
- */
-static void
-pool_reset_fsmm(size_t size)
-{
-	int			encode_value;
-
-	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
-	memset(fsmm, encode_value, size);
-
-	*pool_fsmm_clock_hand = 0;
-}
-
-/*
- * Find victim block using clock algorithm and make it free.
- * Returns new free block id.
- * XXX actually this is not a clock algorithm because it does not have "reference" bit.
- * It's like a simple FIFO.
- * See https://en.wikipedia.org/wiki/Page_replacement_algorithm#Clock for more details.
- * It would be nice if we could use true clock algorithm someday.
- */
-static POOL_CACHE_BLOCKID pool_reuse_block(void)
-{
-	int			maxblock = pool_get_memqcache_blocks();
-	char	   *block = block_address(*pool_fsmm_clock_hand);
-	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) block;
-	POOL_CACHE_BLOCKID reused_block;
-	POOL_CACHE_ITEM_POINTER *cip;
-	char	   *p;
-	int			i;
-
-	bh->flags = 0;
-	reused_block = *pool_fsmm_clock_hand;
-	p = block_address(reused_block);
-
-	/* Remove all items in this block from hash table */
-	for (i = 0; i < bh->num_items; i++)
+	if (pool_is_shmem_cache())
 	{
-		cip = item_pointer(p, i);
+		dboid = pool_get_database_oid();
+		ereport(DEBUG1,
+				(errmsg("memcache: adding table oid maps"),
+				 errdetail("dboid %d", dboid)));
 
-		if (!(POOL_ITEM_DELETED & cip->flags))
+		if (dboid <= 0)
 		{
-			pool_hash_delete(&cip->query_hash);
-			ereport(DEBUG1,
-					(errmsg("pool_reuse_block: blockid: %d item: %d", reused_block, i)));
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed to get database OID")));
+			return;
 		}
-	}
-
-	pool_init_cache_block(reused_block);
-	pool_update_fsmm(reused_block, POOL_MAX_FREE_SPACE);
-
-	(*pool_fsmm_clock_hand)++;
-	if (*pool_fsmm_clock_hand >= maxblock)
-		*pool_fsmm_clock_hand = 0;
-
-	ereport(LOG,
-			(errmsg("pool_reuse_block: blockid: %d", reused_block)));
-
-	return reused_block;
-}
-
-/*
- * Get block id which has enough space
- */
-static POOL_CACHE_BLOCKID pool_get_block(size_t free_space)
-{
-	int			encode_value;
-	unsigned char *p = pool_fsmm_address();
-	int			i;
-	int			maxblock = pool_get_memqcache_blocks();
-	POOL_CACHE_BLOCK_HEADER *bh;
-
-	if (p == NULL)
-	{
-		ereport(WARNING,
-				(errmsg("memcache: getting block: FSMM is not initialized")));
-		return -1;
-	}
-
-	if (free_space > POOL_MAX_FREE_SPACE)
-	{
-		ereport(WARNING,
-				(errmsg("memcache: getting block: invalid free space:%zd", free_space),
-				 errdetail("requested free space: %zd is more than maximum allowed space:%lu", free_space, POOL_MAX_FREE_SPACE)));
-		return -1;
-	}
 
-	encode_value = free_space / POOL_FSMM_RATIO;
-
-	for (i = 0; i < maxblock; i++)
-	{
-		if (p[i] >= encode_value)
+		for (i = 0; i < num_table_oids; i++)
 		{
-			/*
-			 * This block may not have enough space. We need to make sure it
-			 * actually has enough space.
-			 */
-			bh = (POOL_CACHE_BLOCK_HEADER *) block_address(i);
-			if (bh->free_bytes >= free_space)
+			if (pool_oid_map_add(dboid, table_oids[i], &cachekey->cacheid) < 0)
 			{
-				return (POOL_CACHE_BLOCKID) i;
+				/*
+				 * We cannot remember that the cache entry uses the table.
+				 * Remove the entry, otherwise it would never be invalidated.
+				 */
+				ereport(DEBUG1,
+						(errmsg("memcache: adding table oid maps, no free oid map entry"),
+						 errdetail("deleting cacheid:%d itemid:%d",
+								   cachekey->cacheid.blockid, cachekey->cacheid.itemid)));
+				pool_delete_item_shmem_cache(&cachekey->cacheid);
+				pool_advance_cache_epoch();
+				return;
 			}
 		}
+		return;
 	}
 
+	/* the storage keeps the tables of the entries by itself */
+	if (pool_cache_storage()->delete_by_tag)
+		return;
+
 	/*
-	 * No enough space found. Reuse victim block
+	 * Create memqcache_oiddir
 	 */
-	return pool_reuse_block();
-}
-
-/*
- * Update free space info for specified block
- */
-static void
-pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space)
-{
-	int			encode_value;
-	char	   *p = pool_fsmm_address();
+	dir = pool_config->memqcache_oiddir;
 
-	if (p == NULL)
+	if (mkdir(dir, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
-		ereport(WARNING,
-				(errmsg("memcache: updating free space in block: FSMM is not initialized")));
-		return;
+		if (errno != EEXIST)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", dir),
+					 errdetail("%m")));
+			return;
+		}
 	}
 
-	if (blockid >= pool_get_memqcache_blocks())
+	/*
+	 * Create memqcache_oiddir/database_oid
+	 */
+	dboid = pool_get_database_oid();
+	ereport(DEBUG1,
+			(errmsg("memcache: adding table oid maps"),
+			 errdetail("dboid %d", dboid)));
+
+	if (dboid <= 0)
 	{
 		ereport(WARNING,
-				(errmsg("memcache: updating free space in block: block id:%d in invalid", blockid)));
+				(errmsg("memcache: adding table oid maps, failed to get database OID")));
 		return;
 	}
 
-	if (free_space > POOL_MAX_FREE_SPACE)
+	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
+	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
-		ereport(WARNING,
-				(errmsg("memcache: updating free space in block: invalid free space:%zd", free_space),
-				 errdetail("requested free space: %zd is more than maximum allowed space:%lu", free_space, POOL_MAX_FREE_SPACE)));
-
-		return;
+		if (errno != EEXIST)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed to create directory:\"%s\"", path),
+					 errdetail("%m")));
+			return;
+		}
 	}
 
-	encode_value = free_space / POOL_FSMM_RATIO;
-
-	p[blockid] = encode_value;
-
-	return;
-}
-
-/*
- * Add item data to shared memory cache.
- * On successful registration, returns cache id.
- * The cache id is overwritten by the subsequent call to this function.
- * On error returns NULL.
- */
-static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire)
-{
-	static POOL_CACHEID cacheid;
-	POOL_CACHE_BLOCKID blockid;
-	POOL_CACHE_BLOCK_HEADER *bh;
-	POOL_CACHE_ITEM_POINTER *cip;
-
-	POOL_CACHE_ITEM ci;
-	POOL_CACHE_ITEM_POINTER cip_body;
-	char	   *item;
-
-	int			request_size;
-	char	   *p;
-	int			i;
-	char	   *src;
-	char	   *dst;
-	int			num_deleted;
-	char	   *dcip;
-	char	   *dci;
-	bool		need_pack;
-	char	   *work_buffer;
-	int			index;
-
-	if (query_hash == NULL)
+	if (pool_is_shmem_cache())
 	{
-		ereport(LOG,
-				(errmsg("error while adding item to shmem cache, query hash is NULL")));
-		return NULL;
+		len = sizeof(cachekey->cacheid);
 	}
-
-	if (data == NULL)
+	else
 	{
-		ereport(LOG,
-				(errmsg("error while adding item to shmem cache, data is NULL")));
-		return NULL;
+		len = sizeof(cachekey->hashkey);
 	}
 
-	if (size <= 0)
+	for (i = 0; i < num_table_oids; i++)
 	{
-		ereport(LOG,
-				(errmsg("error while adding item to shmem cache, invalid request size: %d", size)));
-		return NULL;
-	}
+		int			fd;
+		int			oid = table_oids[i];
+		int			sts;
+		struct flock fl;
 
-	/* Add overhead */
-	request_size = size + sizeof(POOL_CACHE_ITEM_POINTER) + sizeof(POOL_CACHE_ITEM_HEADER);
+		/*
+		 * Create or open each memqcache_oiddir/database_oid/table_oid
+		 */
+		snprintf(path, sizeof(path), "%s/%d/%d", dir, dboid, oid);
+		if ((fd = open(path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR)) == -1)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed to open file:\"%s\"", path),
+					 errdetail("%m")));
+			return;
+		}
 
-	/* Get cache block which has enough space */
-	blockid = pool_get_block(request_size);
+		fl.l_type = F_WRLCK;
+		fl.l_whence = SEEK_SET;
+		fl.l_start = 0;			/* Offset from l_whence         */
+		fl.l_len = 0;			/* length, 0 = to EOF           */
 
-	if (blockid == -1)
-	{
-		return NULL;
-	}
-
-	/*
-	 * Initialize the block if necessary. If no live items are remained, we
-	 * also initialize the block. If there's contiguous deleted items, we turn
-	 * them into free space as well.
-	 */
-	pool_init_cache_block(blockid);
-
-	/*
-	 * Make sure that we have at least one free hash element.
-	 */
-	while (!is_free_hash_element())
-	{
-		/* If not, reuse next victim block */
-		blockid = pool_reuse_block();
-	}
-
-	/* Get block address on shmem */
-	p = block_address(blockid);
-	bh = (POOL_CACHE_BLOCK_HEADER *) p;
-
-	/*
-	 * Create contiguous free space. We assume that item bodies are ordered
-	 * from bottom to top of the block, and corresponding item pointers are
-	 * ordered from the youngest to the oldest in the beginning of the block.
-	 */
+		sts = fcntl(fd, F_SETLKW, &fl);
+		if (sts == -1)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed to lock file:\"%s\"", path),
+					 errdetail("%m")));
 
-	/*
-	 * Optimization. If there's no deleted items, we don't need to pack it to
-	 * create contiguous free space.
-	 */
-	need_pack = false;
-	for (i = 0; i < bh->num_items; i++)
-	{
-		cip = item_pointer(p, i);
+			close(fd);
+			return;
+		}
 
-		if (POOL_ITEM_DELETED & cip->flags) /* Deleted item? */
+		/*
+		 * Below was ifdef-out because of a performance reason. Looking for
+		 * duplicate cache entries in a file needed unacceptably high cost. So
+		 * we gave up this and decided not to care about duplicate entries in
+		 * the file.
+		 */
+#ifdef NOT_USED
+		for (;;)
 		{
-			need_pack = true;
-			ereport(DEBUG1,
-					(errmsg("memcache adding item"),
-					 errdetail("start creating contiguous space")));
+			sts = read(fd, (char *) &buf, len);
+			if (sts == -1)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: adding table oid maps, failed to read file:\"%s\"", path),
+						 errdetail("%m")));
+				close(fd);
+				return;
+			}
+			else if (sts == len)
+			{
+				if (memcmp(cachekey, &buf, len) == 0)
+				{
+					/* Same key found. Skip this */
+					close(fd);
+					return;
+				}
+				continue;
+			}
+
+			/*
+			 * Must be EOF
+			 */
+			if (sts != 0)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: adding table oid maps, invalid data length:%d in file:\"%s\". error:\"%s\"", sts, path)));
+				close(fd);
+				return;
+			}
 			break;
 		}
-	}
+#endif
 
-	/*
-	 * We disable packing for now. Revisit and remove following code fragment
-	 * later.
-	 */
-	need_pack = false;
+		if (lseek(fd, 0, SEEK_END) == -1)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: adding table oid maps, failed seek on file:\"%s\"", path),
+					 errdetail("%m")));
+			close(fd);
+			return;
+		}
 
-	if (need_pack)
-	{
 		/*
-		 * Pack and create contiguous free space.
+		 * Write cache_id or cache key at the end of file
 		 */
-		dcip = calloc(1, pool_config->memqcache_cache_block_size);
-		if (!dcip)
+		sts = write(fd, (char *) cachekey, len);
+		if (sts == -1 || sts != len)
 		{
 			ereport(WARNING,
-					(errmsg("memcache: adding item to cache: calloc failed")));
-			return NULL;
+					(errmsg("memcache: adding table oid maps, failed to write file:\"%s\"", path),
+					 errdetail("%m")));
+			close(fd);
+			return;
 		}
+		close(fd);
+	}
+}
 
-		work_buffer = dcip;
-		dci = dcip + pool_config->memqcache_cache_block_size;
-		num_deleted = 0;
-		index = 0;
-
-		for (i = 0; i < bh->num_items; i++)
-		{
-			int			total_length;
-			POOL_CACHEID cid;
+/*
+ * Discard all oid map files.  This is used at pgpool-II startup for
+ * memcached case if requested by -C option.
+ */
+void
+pool_discard_oid_maps(void)
+{
+	char		command[1024];
 
-			cip = item_pointer(p, i);
+	snprintf(command, sizeof(command), "/bin/rm -fr %s/[0-9]*",
+			 pool_config->memqcache_oiddir);
+	if (system(command) == -1)
+		ereport(WARNING,
+				(errmsg("unable to execute command \"%s\"", command),
+				 errdetail("system() command failed with error \"%m\"")));
 
-			if (POOL_ITEM_DELETED & cip->flags) /* Deleted item? */
-			{
-				num_deleted++;
-				continue;
-			}
 
-			/* Copy item body */
-			src = p + cip->offset;
-			total_length = item_header(p, i)->total_length;
-			dst = dci - total_length;
-			cip->offset = dst - work_buffer;
-			memcpy(dst, src, total_length);
+}
 
-			dci -= total_length;
+/*
+ * Discard all cache entries and oid maps belonging to the database.  This
+ * is only meaningful for shmem case.  Caller must hold exclusive shmem
+ * lock.
+ */
+void
+pool_discard_oid_maps_by_db(int dboid)
+{
+	if (pool_is_shmem_cache())
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: discarding oid maps by db"),
+				 errdetail("dboid: %d", dboid)));
 
-			/* Copy item pointer */
-			src = (char *) cip;
-			dst = (char *) item_pointer(dcip, index);
-			memcpy(dst, src, sizeof(POOL_CACHE_ITEM_POINTER));
+		pool_oid_map_invalidate_db(dboid);
+	}
+}
 
-			/* Update hash index */
-			cid.blockid = blockid;
-			cid.itemid = index;
-			pool_hash_insert(&cip->query_hash, &cid, true);
-			ereport(DEBUG1,
-					(errmsg("memcache adding item"),
-					 errdetail("item cid updated. old:%d %d new:%d %d",
-							   blockid, i, blockid, index)));
-			index++;
-		}
+/*
+ * Look up cache ids (shmem case) or hash keys (memcached case) according
+ * to table_oids and discard cache entries.  For memcached case, they are
+ * read from table oid map file and if unlink is true, the file will be
+ * unlinked after successful cache removal.  For shmem case, caller must
+ * hold exclusive shmem lock.
+ */
+static void
+pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, int dboid)
+{
+	POOL_CACHE_STORAGE *storage;
+	int			i;
 
-		/* All items deleted? */
-		if (num_deleted > 0 && num_deleted == bh->num_items)
+	if (pool_is_shmem_cache())
+	{
+		if (dboid == 0)
 		{
+			dboid = pool_get_database_oid();
 			ereport(DEBUG1,
-					(errmsg("memcache adding item"),
-					 errdetail("all items deleted, total deleted:%d", num_deleted)));
-			bh->flags = 0;
-			pool_init_cache_block(blockid);
-			pool_update_fsmm(blockid, POOL_MAX_FREE_SPACE);
+					(errmsg("memcache invalidating query cache"),
+					 errdetail("dboid %d", dboid)));
+
+			if (dboid <= 0)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: invalidating query cache, could not get database OID")));
+				return;
+			}
 		}
-		else
-		{
-			/* Update number of items */
-			bh->num_items -= num_deleted;
 
-			/* Copy back the packed block except block header */
-			memcpy(p + sizeof(POOL_CACHE_BLOCK_HEADER),
-				   work_buffer + sizeof(POOL_CACHE_BLOCK_HEADER),
-				   pool_config->memqcache_cache_block_size - sizeof(POOL_CACHE_BLOCK_HEADER));
+		for (i = 0; i < num_table_oids; i++)
+			pool_oid_map_invalidate(dboid, table_oid[i]);
+
+#ifdef SHMEMCACHE_DEBUG
+		dump_shmem_cache(0);
+#endif
+		return;
+	}
+
+	storage = pool_cache_storage();
+	if (storage->delete_by_tag)
+	{
+		if (dboid == 0)
+		{
+			dboid = pool_get_database_oid();
+			if (dboid <= 0)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: invalidating query cache, could not get database OID")));
+				return;
+			}
 		}
-		free(work_buffer);
+		storage->delete_by_tag(dboid, num_table_oids, table_oid);
+		return;
 	}
 
+	if (storage->begin_batch)
+		storage->begin_batch();
+
+	pool_invalidate_query_cache_files(num_table_oids, table_oid, unlinkp, dboid);
+
+	if (storage->end_batch)
+		storage->end_batch();
+}
+
+/*
+ * Read hash keys from table oid map files according to table_oids and
+ * discard cache entries on memcached.  If unlink is true, the file will be
+ * unlinked after successful cache removal.
+ */
+static void
+pool_invalidate_query_cache_files(int num_table_oids, int *table_oid, bool unlinkp, int dboid)
+{
+	char	   *dir;
+	char		path[1024];
+	int			i;
+	int			len;
+	POOL_CACHEKEY buf;
+
 	/*
-	 * Make sure that we have enough free space
+	 * Create memqcache_oiddir
 	 */
-	if (bh->free_bytes < request_size)
+	dir = pool_config->memqcache_oiddir;
+	if (mkdir(dir, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
-		/* This should not happen */
-		ereport(WARNING,
-				(errmsg("memcache: adding item to cache: not enough space"),
-				 errdetail("free space: %d required: %d block id:%d",
-						   bh->free_bytes, request_size, blockid)));
-		return NULL;
+		if (errno != EEXIST)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: invalidating query cache, failed to create directory:\"%s\"", dir),
+					 errdetail("%m")));
+			return;
+		}
 	}
 
 	/*
-	 * At this point, new item can be located at block_header->num_items
+	 * Create memqcache_oiddir/database_oid
 	 */
-
-	/* Fill in cache item header */
-	ci.header.timestamp = time(NULL);
-	ci.header.expire = expire;
-	ci.header.total_length = sizeof(POOL_CACHE_ITEM_HEADER) + size;
-
-	/* Calculate item body address */
-	if (bh->num_items == 0)
+	if (dboid == 0)
 	{
-		/*
-		 * This is the #0 item. So address is block_bottom - data_length
-		 */
-		item = p + pool_config->memqcache_cache_block_size - ci.header.total_length;
+		dboid = pool_get_database_oid();
+		ereport(DEBUG1,
+				(errmsg("memcache invalidating query cache"),
+				 errdetail("dboid %d", dboid)));
 
-		/* Mark this block used */
-		bh->flags = POOL_BLOCK_USED;
+		if (dboid <= 0)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: invalidating query cache, could not get database OID")));
+			return;
+		}
 	}
-	else
+
+	snprintf(path, sizeof(path), "%s/%d", dir, dboid);
+	if (mkdir(path, S_IREAD | S_IWRITE | S_IEXEC) == -1)
 	{
-		cip = item_pointer(p, bh->num_items - 1);
-		item = p + cip->offset - ci.header.total_length;
+		if (errno != EEXIST)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: invalidating query cache, failed to create directory:\"%s\"", path),
+					 errdetail("%m")));
+			return;
+		}
 	}
 
-	/* Copy item header */
-	memcpy(item, &ci, sizeof(POOL_CACHE_ITEM_HEADER));
-	bh->free_bytes -= sizeof(POOL_CACHE_ITEM_HEADER);
-
-	/* Copy item body */
-	memcpy(item + sizeof(POOL_CACHE_ITEM_HEADER), data, size);
-	bh->free_bytes -= size;
+	len = sizeof(buf.hashkey);
 
-	/* Copy cache item pointer */
-	memcpy(&cip_body.query_hash, query_hash, sizeof(POOL_QUERY_HASH));
-	memset(&cip_body.next, 0, sizeof(POOL_CACHEID));
-	cip_body.offset = item - p;
-	cip_body.flags = POOL_ITEM_USED;
-	memcpy(item_pointer(p, bh->num_items), &cip_body, sizeof(POOL_CACHE_ITEM_POINTER));
-	bh->free_bytes -= sizeof(POOL_CACHE_ITEM_POINTER);
+	for (i = 0; i < num_table_oids; i++)
+	{
+		int			fd;
+		int			oid = table_oid[i];
+		int			sts;
+		struct flock fl;
 
-	/* Update FSMM */
-	pool_update_fsmm(blockid, bh->free_bytes);
+		/*
+		 * Open each memqcache_oiddir/database_oid/table_oid
+		 */
+		snprintf(path, sizeof(path), "%s/%d/%d", dir, dboid, oid);
+		if ((fd = open(path, O_RDONLY)) == -1)
+		{
+			/*
+			 * This may be normal. It is possible that no SELECT has been
+			 * issued since the table has been created or since pgpool-II
+			 * started up.
+			 */
+			ereport(DEBUG1,
+					(errmsg("memcache invalidating query cache"),
+					 errdetail("failed to open \"%s\". reason:\"%m\"", path)));
+			continue;
+		}
 
-	cacheid.blockid = blockid;
-	cacheid.itemid = bh->num_items;
-	ereport(DEBUG1,
-			(errmsg("memcache adding item"),
-			 errdetail("new item inserted. blockid: %d itemid:%d",
-					   cacheid.blockid, cacheid.itemid)));
+		fl.l_type = F_RDLCK;
+		fl.l_whence = SEEK_SET;
+		fl.l_start = 0;			/* Offset from l_whence         */
+		fl.l_len = 0;			/* length, 0 = to EOF           */
 
-	/* Add up number of items */
-	bh->num_items++;
+		sts = fcntl(fd, F_SETLKW, &fl);
+		if (sts == -1)
+		{
+			ereport(WARNING,
+					(errmsg("memcache: invalidating query cache, failed to lock file:\"%s\"", path),
+					 errdetail("%m")));
+			close(fd);
+			return;
+		}
+		for (;;)
+		{
+			sts = read(fd, (char *) &buf, len);
+			if (sts == -1)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: invalidating query cache, failed to read file:\"%s\"", path),
+						 errdetail("%m")));
 
-	/* Update hash table */
-	if (pool_hash_insert(query_hash, &cacheid, false) < 0)
-	{
-		ereport(LOG,
-				(errmsg("error while adding item to shmem cache, hash insert failed")));
+				close(fd);
+				return;
+			}
+			else if (sts == len)
+			{
+				char		delbuf[33];
 
-		/*
-		 * Since we have failed to insert hash index entry, we need to undo
-		 * the addition of cache entry.
-		 */
-		pool_delete_item_shmem_cache(&cacheid);
-		return NULL;
-	}
-	ereport(DEBUG1,
-			(errmsg("memcache adding item"),
-			 errdetail("block: %d item: %d", cacheid.blockid, cacheid.itemid)));
+				memcpy(delbuf, buf.hashkey, 32);
+				delbuf[32] = 0;
+				ereport(DEBUG1,
+						(errmsg("memcache invalidating query cache"),
+						 errdetail("deleting %s", delbuf)));
 
-#ifdef SHMEMCACHE_DEBUG
-	dump_shmem_cache(blockid);
-#endif
-	return &cacheid;
+				pool_cache_storage()->delete(delbuf);
+				continue;
+			}
+
+			/*
+			 * Must be EOF
+			 */
+			if (sts != 0)
+			{
+				ereport(WARNING,
+						(errmsg("memcache: invalidating query cache, invalid data length:%d in file:\"%s\"", sts, path)));
+				close(fd);
+				return;
+			}
+			break;
+		}
+
+		if (unlinkp)
+		{
+			unlink(path);
+		}
+		close(fd);
+	}
 }
 
 /*
- * Returns item data address on shared memory cache specified by query hash.
- * Also data length is set to *size.
- * On error or data not found case returns NULL.
- * Detail is set to *sts. (0: success, 1: not found, -1: error)
+ * Queue invalidation of query cache of the tables to the query cache
+ * invalidation worker if memqcache_invalidation_mode is async or strict.
+ * Returns false if the caller needs to invalidate the query cache by
+ * itself.  If memqcache_watchdog_invalidation is on, the invalidation is
+ * queued to be sent to the other pgpool nodes as well.
  */
-static char *
-pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
+static bool
+pool_queue_query_cache_invalidation(int num_table_oids, int *table_oids)
 {
-	POOL_CACHEID *cacheid;
-	POOL_CACHE_ITEM_HEADER *cih;
-
-	if (sts == NULL)
-	{
-		ereport(LOG,
-				(errmsg("error while getting item from shmem cache, sts is NULL")));
-		return NULL;
-	}
-
-	*sts = -1;
+	pool_sigset_t oldmask;
+	int			dboid;
+	bool		queued = false;
 
-	if (query_hash == NULL)
-	{
-		ereport(LOG,
-				(errmsg("error while getting item from shmem cache, query hash is NULL")));
-		return NULL;
-	}
+	if (!pool_is_async_invalidation() && !pool_is_remote_invalidation())
+		return false;
 
-	if (size == NULL)
-	{
-		ereport(LOG,
-				(errmsg("error while getting item from shmem cache, size is NULL")));
-		return NULL;
-	}
+	dboid = pool_get_database_oid();
+	if (dboid <= 0)
+		return false;
 
-	/*
-	 * Find cache header by using hash table
-	 */
-	cacheid = pool_find_item_on_shmem_cache(query_hash);
-	if (cacheid == NULL)
-	{
-		/* Not found */
-		*sts = 1;
-		return NULL;
-	}
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	if (pool_is_remote_invalidation())
+		pool_enqueue_remote_invalidation(dboid, num_table_oids, table_oids);
+	if (pool_is_async_invalidation())
+		queued = pool_enqueue_query_cache_invalidation(dboid, num_table_oids, table_oids);
+	POOL_SETMASK(&oldmask);
 
-	cih = pool_cache_item_header(cacheid);
+	return queued;
+}
 
-	*size = cih->total_length - sizeof(POOL_CACHE_ITEM_HEADER);
-	return (char *) cih + sizeof(POOL_CACHE_ITEM_HEADER);
+/*
+ * Invalidate query cache of the table.  This is used by the query cache
+ * invalidation worker.  Caller must hold exclusive shmem lock.
+ */
+void
+pool_invalidate_query_cache_by_table(int dboid, int tableoid)
+{
+	pool_oid_map_invalidate(dboid, tableoid);
 }
 
 /*
- * Find data on shared memory cache specified query hash.
- * On success returns cache id.
- * The cache id is overwritten by the subsequent call to this function.
+ * Reset SELECT data buffers.  If reset_dml_oids is true, call
+ * pool_discard_dml_table_oid() to reset table oids used in DML statements.
  */
-static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash)
+static void
+pool_reset_memqcache_buffer(bool reset_dml_oids)
 {
-	static POOL_CACHEID cacheid;
-	POOL_CACHEID *c;
-	POOL_CACHE_ITEM_HEADER *cih;
-	time_t		now;
+	POOL_SESSION_CONTEXT *session_context;
 
-	c = pool_hash_search(query_hash);
-	if (!c)
+	session_context = pool_get_session_context(true);
+
+	if (session_context && session_context->query_cache_array)
 	{
-		return NULL;
-	}
+		POOL_TEMP_QUERY_CACHE *cache;
 
-	cih = item_header(block_address(c->blockid), c->itemid);
+		ereport(DEBUG1,
+				(errmsg("memcache reset buffer"),
+				 errdetail("discard: %p", session_context->query_cache_array)));
 
-	/* Check cache expiration */
-	if (cih->expire > 0)
-	{
-		now = time(NULL);
-		if (difftime(now, cih->timestamp) > cih->expire)
+		pool_discard_query_cache_array(session_context->query_cache_array);
+		session_context->query_cache_array = pool_create_query_cache_array();
+
+		ereport(DEBUG1,
+				(errmsg("memcache reset buffer"),
+				 errdetail("create: %p", session_context->query_cache_array)));
+
+		/*
+		 * if the query context is still under use, we cannot discard
+		 * temporary cache.
+		 */
+		if ((SL_MODE && pool_is_doing_extended_query_message()) ||
+			can_query_context_destroy(session_context->query_context))
 		{
+			ereport(DEBUG1,
+					(errmsg("memcache reset buffer"),
+					 errdetail("discard temp buffer of %p (%s)",
+							   session_context->query_context, session_context->query_context->original_query)));
+
+			cache = pool_get_current_cache();
+			pool_discard_temp_query_cache(cache);
+
 			/*
-			 * We need to acquire an exclusive lock before removing the cache
-			 * entry.  Since a lock escalation from shared lock to exclusive
-			 * lock is not supported, we need to release the lock then acquire
-			 * an exclusive lock.
-			 */
-			pool_shmem_unlock();
-			pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-			/*
-			 * There is a window between pool_shmem_unlock() and
-			 * pool_shmem_lock().  We need to get POOL_CACHEID and
-			 * POOL_CACHE_ITEM_HEADER again because they could have been
-			 * modified by someone else.
+			 * Reset temp_cache pointer in the current query context so that
+			 * we don't double free memory.
 			 */
-			c = pool_hash_search(query_hash);
-			if (!c)
-			{
-				return NULL;
-			}
-
-			cih = item_header(block_address(c->blockid), c->itemid);
-			now = time(NULL);
-			if (now > (cih->timestamp + cih->expire))
-			{
-				ereport(DEBUG1,
-						(errmsg("memcache finding item"),
-						 errdetail("cache expired: now: %ld timestamp: %ld",
-								   now, cih->timestamp + cih->expire)));
-				pool_delete_item_shmem_cache(c);
-				return NULL;
-			}
+			session_context->query_context->temp_cache = NULL;
 		}
 	}
 
-	cacheid.blockid = c->blockid;
-	cacheid.itemid = c->itemid;
-	return &cacheid;
+	if (reset_dml_oids)
+		pool_discard_dml_table_oid();
+
+	pool_tmp_stats_reset_num_selects();
 }
 
 /*
- * Delete item data specified cache id from shmem.
- * On successful deletion, returns 0.
- * Other wise return -1.
- * FSMM is also updated.
+ * Return true if memory cache method is "shmem".  The purpose of this
+ * function is to cache the result of strcmp and to save a few cycle.
  */
-static int
-pool_delete_item_shmem_cache(POOL_CACHEID * cacheid)
+bool
+pool_is_shmem_cache(void)
 {
-	POOL_CACHE_BLOCK_HEADER *bh;
-	POOL_CACHE_ITEM_POINTER *cip;
-	POOL_CACHE_ITEM_HEADER *cih;
-	POOL_QUERY_HASH key;
-	int			size;
-
-	ereport(DEBUG1,
-			(errmsg("memcache deleting item data"),
-			 errdetail("cacheid:%d itemid:%d", cacheid->blockid, cacheid->itemid)));
+	return pool_config->memqcache_method == SHMEM_CACHE;
+}
 
-	if (cacheid->blockid >= pool_get_memqcache_blocks())
-	{
-		ereport(LOG,
-				(errmsg("error while deleting item from shmem cache, invalid block: %d",
-						cacheid->blockid)));
-		return -1;
-	}
-
-	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid->blockid);
-	if (!(bh->flags & POOL_BLOCK_USED))
-	{
-		ereport(LOG,
-				(errmsg("error while deleting item from shmem cache, block: %d is not used",
-						cacheid->blockid)));
-		return -1;
-	}
-
-	if (cacheid->itemid >= bh->num_items)
-	{
-		/*
-		 * This could happen if the block is reused.  Since contents of oid
-		 * map file is not updated when the block is reused.
-		 */
-		ereport(DEBUG1,
-				(errmsg("memcache error deleting item data"),
-				 errdetail("invalid item id %d in block:%d",
-						   cacheid->itemid, cacheid->blockid)));
-
-		return -1;
-	}
-
-	cip = item_pointer(block_address(cacheid->blockid), cacheid->itemid);
-	if (!(cip->flags & POOL_ITEM_USED))
-	{
-		ereport(LOG,
-				(errmsg("error while deleting item from shmem cache, item: %d was not used",
-						cacheid->itemid)));
-		return -1;
-	}
-
-	if (cip->flags & POOL_ITEM_DELETED)
-	{
-		ereport(LOG,
-				(errmsg("error while deleting item from shmem cache, item: %d was already deleted",
-						cacheid->itemid)));
-		return -1;
-	}
+/*
+ * Remember memory cache number of blocks.
+ */
+static int	memqcache_num_blocks;
+static void
+pool_set_memqcache_blocks(int num_blocks)
+{
+	memqcache_num_blocks = num_blocks;
+}
 
-	/* Save cache key */
-	memcpy(&key, &cip->query_hash, sizeof(POOL_QUERY_HASH));
+/*
+ * Return memory cache number of blocks.
+ */
+static int
+pool_get_memqcache_blocks(void)
+{
+	return memqcache_num_blocks;
+}
 
-	cih = pool_cache_item_header(cacheid);
-	size = cih->total_length + sizeof(POOL_CACHE_ITEM_POINTER);
+/*
+ * Query cache on shared memory management modules.
+ */
 
-	/* Delete item pointer */
-	cip->flags |= POOL_ITEM_DELETED;
+/*
+ * Calculate necessary shared memory size.
+ */
+size_t
+pool_shared_memory_cache_size(void)
+{
+	int64		num_blocks;
+	size_t		size;
 
 	/*
-	 * We do NOT count down bh->num_items here. The deleted space will be
-	 * recycled by pool_add_item_shmem_cache(). However, if this is the last
-	 * item, we can recycle whole block.
-	 *
-	 * 2012/4/1: Now we do not pack data in pool_add_item_shmem_cache() for
-	 * performance reason. Also we count down num_items if it is the last one.
+	 * With compression, what has to fit in a block is the compressed data.
 	 */
-	if ((bh->num_items - 1) == 0)
-	{
-		ereport(DEBUG1,
-				(errmsg("memcache deleting item data"),
-				 errdetail("no item remains. initialize block")));
-		bh->flags = 0;
-		pool_init_cache_block(cacheid->blockid);
-	}
+	if (pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_NONE &&
+		pool_config->memqcache_maxcache > pool_config->memqcache_cache_block_size)
+		ereport(FATAL,
+				(errmsg("invalid memory cache configuration"),
+				 errdetail("memqcache_cache_block_size %d should be greater or equal to memqcache_maxcache %d",
+						   pool_config->memqcache_cache_block_size,
+						   pool_config->memqcache_maxcache)));
 
-	/* Remove hash index */
-	pool_hash_delete(&key);
 
-	/*
-	 * If the deleted item is the last one in the block, we add it to the free
-	 * space.
-	 */
-	if (cacheid->itemid == (bh->num_items - 1))
-	{
-		bh->free_bytes += size;
-		ereport(DEBUG1,
-				(errmsg("memcache deleting item data"),
-				 errdetail("deleted %d bytes, freebytes is %d",
-						   size, bh->free_bytes)));
+	num_blocks = pool_config->memqcache_total_size /
+		pool_config->memqcache_cache_block_size;
+	if (num_blocks == 0)
+		ereport(FATAL,
+				(errmsg("invalid memory cache configuration"),
+				 errdetail("memqcache_total_size %ld should be greater or equal to memqcache_cache_block_size %d",
+						   pool_config->memqcache_total_size,
+						   pool_config->memqcache_cache_block_size)));
 
-		bh->num_items--;
-	}
+	ereport(LOG,
+			(errmsg("memory cache initialized"),
+			 errdetail("memcache blocks :%ld", num_blocks)));
+	/* Remember # of blocks */
+	pool_set_memqcache_blocks(num_blocks);
+	size = pool_config->memqcache_cache_block_size * num_blocks;
+	elog(DEBUG1, "shared_memory_cache_size: %zu", size);
+	return size;
+}
 
-	/* Update FSMM */
-	pool_update_fsmm(cacheid->blockid, bh->free_bytes);
+/*
+ * Acquire and initialize shared memory cache. This should be called
+ * only once from pgpool main process at the process staring up time.
+ */
+static void *shmem;
+int
+pool_init_memory_cache(size_t size)
+{
+	ereport(DEBUG1,
+			(errmsg("memory cache request size : %zd", size)));
 
+	shmem = pool_shared_memory_segment_get_chunk(size);
 	return 0;
 }
 
 /*
- * Returns item header specified by cache id.
+ * Clear all the shared memory cache and reset FSMM and hash table.
  */
-static POOL_CACHE_ITEM_HEADER * pool_cache_item_header(POOL_CACHEID * cacheid)
+void
+pool_clear_memory_cache(void)
 {
-	POOL_CACHE_BLOCK_HEADER *bh;
+	size_t		size;
+	pool_sigset_t oldmask;
 
-	if (cacheid->blockid >= pool_get_memqcache_blocks())
-	{
-		ereport(WARNING,
-				(errmsg("error while getting cache item header, invalid block id: %d", cacheid->blockid)));
-		return NULL;
-	}
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
-	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid->blockid);
-	if (cacheid->itemid >= bh->num_items)
+	PG_TRY();
 	{
-		ereport(WARNING,
-				(errmsg("error while getting cache item header, invalid item id: %d", cacheid->itemid)));
-		return NULL;
-	}
+		/*
+		 * Reset hash table first so that lock-free readers notice that the
+		 * cache blocks are about to be cleared.
+		 */
+		pool_hash_reset(pool_config->memqcache_max_num_cache);
 
-	return item_header((char *) bh, cacheid->itemid);
-}
+		size = pool_shared_memory_cache_size();
+		memset(shmem, 0, size);
 
-/*
- * Initialize specified block.
- */
-static int
-pool_init_cache_block(POOL_CACHE_BLOCKID blockid)
-{
-	char	   *p;
-	POOL_CACHE_BLOCK_HEADER *bh;
+		size = pool_shared_memory_fsmm_size();
+		pool_reset_fsmm(size);
 
-	if (blockid >= pool_get_memqcache_blocks())
-	{
-		ereport(WARNING,
-				(errmsg("error while initializing cache block, invalid block id: %d", blockid)));
-		return -1;
-	}
+		pool_reset_oid_map();
 
-	p = block_address(blockid);
-	bh = (POOL_CACHE_BLOCK_HEADER *) p;
+		pool_init_whole_cache_blocks();
 
-	/* Is this block used? */
-	if (!(bh->flags & POOL_BLOCK_USED))
+		pool_cache_partition_reset_usage();
+
+		pool_advance_cache_epoch();
+	}
+	PG_CATCH();
 	{
-		/* Initialize empty block */
-		memset(p, 0, pool_config->memqcache_cache_block_size);
-		bh->free_bytes = pool_config->memqcache_cache_block_size -
-			sizeof(POOL_CACHE_BLOCK_HEADER);
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
 	}
-	return 0;
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
 }
 
-#if NOT_USED
 /*
- * Delete all items in the block.
+ * Return shared memory cache address
  */
-static void
-pool_wipe_out_cache_block(POOL_CACHE_BLOCKID blockid)
+static void *
+pool_memory_cache_address(void)
 {
-	char	   *p;
-	POOL_CACHE_BLOCK_HEADER *bh;
-	POOL_CACHE_ITEM_POINTER *cip;
-	POOL_CACHEID cacheid;
-	int			i;
-
-	/* Get block address on shmem */
-	p = block_address(blockid);
-	bh = (POOL_CACHE_BLOCK_HEADER *) p;
-	cacheid.blockid = blockid;
-
-	for (i = 0; i < bh->num_items; i++)
-	{
-		cip = item_pointer(p, i);
-
-		if ((POOL_ITEM_DELETED & cip->flags) == 0)	/* Not deleted item? */
-		{
-			cacheid.itemid = i;
-			pool_delete_item_shmem_cache(&cacheid);
-		}
-	}
-
-	bh->flags = 0;
-	pool_init_cache_block(blockid);
-	pool_update_fsmm(blockid, POOL_MAX_FREE_SPACE);
+	return shmem;
 }
-#endif
-
-#undef LOCK_TRACE
-
-static int memq_lock_fd = 0;
 
 /*
- * Acquire lock: XXX giant lock
+ * Initialize whole cache blocks
  */
 void
-pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type)
+pool_init_whole_cache_blocks(void)
 {
-	if (memq_lock_fd == 0)
+	int		blocks = pool_get_memqcache_blocks();
+	int		i;
+
+	for (i = 0; i < blocks; i++)
 	{
-		char path[1024];
-
-		snprintf(path, sizeof(path), "%s/%s", pool_config->logdir, QUERY_CACHE_LOCK_FILE);
-		memq_lock_fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-		if (memq_lock_fd == -1)
-		{
-			ereport(FATAL,
-					(errmsg("Failed to open lock file for query cache \"%s\"", path),
-					 errdetail("%m")));
-		}
-	}
-
-#ifdef LOCK_TRACE
-		elog(LOG, "LOCK TRACE: try to acquire lock %s", type == POOL_MEMQ_EXCLUSIVE_LOCK? "LOCK_EX" : "LOCK_SH");
-#endif
-	if (pool_is_shmem_cache() && !is_shmem_locked)
-	{
-		if (flock(memq_lock_fd, type == POOL_MEMQ_EXCLUSIVE_LOCK? LOCK_EX : LOCK_SH))
-		{
-			ereport(FATAL,
-					(errmsg("Failed to lock file for query cache"),
-					 errdetail("%m")));
-
-		}
-
-#ifdef LOCK_TRACE
-		elog(LOG, "LOCK TRACE: acquire lock %s", type == POOL_MEMQ_EXCLUSIVE_LOCK? "LOCK_EX" : "LOCK_SH");
-#endif
-		is_shmem_locked = true;
-	}
-}
+		pool_init_cache_block(i);
+	}
+}
 
 /*
- * Release lock
+ * Free space management map
+ *
+ * Free space management map (FSMM) consists of bytes. Each byte
+ * corresponds to block id. For example, if you have 1GB cache and
+ * block size is 8Kb, number of blocks = 131,072, thus total size of
+ * FSMM is 128Kb.  Each FSMM entry has value from 0 to 255. Those
+ * values describes total free space in each block.
+ * For example, if the value is 2, the free space can be between 64
+ * bytes and 95 bytes.
+ *
+ * value free space (in bytes)
+ * 0     0-31
+ * 1     32-63
+ * 2     64-95
+ * 3     96-127
+ * :
+ * 255   8160-8192
  */
-void
-pool_shmem_unlock(void)
-{
-	if (pool_is_shmem_cache() && is_shmem_locked)
-	{
-		if (flock(memq_lock_fd, LOCK_UN))
-		{
-			ereport(FATAL,
-					(errmsg("Failed to unlock file for query cache"),
-					 errdetail("%m")));
-		}
-#ifdef LOCK_TRACE
-		elog(LOG, "LOCK TRACE: unlock");
-#endif
-		is_shmem_locked = false;
-	}
-}
 
 /*
- * check lock
+ * Calculate necessary shared memory size for FSMM. Should be called after
+ * pool_shared_memory_cache_size.
  */
-bool
-pool_is_shmem_lock(void)
+size_t
+pool_shared_memory_fsmm_size(void)
 {
-	return is_shmem_locked;
+	size_t		size;
+
+	size = pool_get_memqcache_blocks() * sizeof(char);
+	elog(DEBUG1, "shared_memory_fsmm_size: %zu", size);
+	return size;
 }
 
 /*
- * Returns cache block address specified by block id
+ * Acquire and initialize shared memory cache for FSMM. This should be
+ * called after pool_shared_memory_cache_size only once from pgpool
+ * main process at the process staring up time.
  */
-static char *
-block_address(int blockid)
+static void *fsmm;
+int
+pool_init_fsmm(size_t size)
 {
-	char	   *p;
+	int			maxblock = pool_get_memqcache_blocks();
+	int			encode_value;
 
-	p = pool_memory_cache_address() +
-		(uint64)blockid * pool_config->memqcache_cache_block_size;
-	return p;
+	fsmm = pool_shared_memory_segment_get_chunk(size);
+	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
+	memset(fsmm, encode_value, maxblock);
+	return 0;
 }
 
 /*
- * Returns i th item pointer in block address block
+ * Return shared memory fsmm address
  */
-static POOL_CACHE_ITEM_POINTER * item_pointer(char *block, int i)
+static void *
+pool_fsmm_address(void)
 {
-	return (POOL_CACHE_ITEM_POINTER *) (block + sizeof(POOL_CACHE_BLOCK_HEADER) +
-										sizeof(POOL_CACHE_ITEM_POINTER) * i);
+	return fsmm;
 }
 
 /*
- * Returns i th item header in block address block
+ * Clock algorithm shared query cache management modules.
  */
-static POOL_CACHE_ITEM_HEADER * item_header(char *block, int i)
-{
-	POOL_CACHE_ITEM_POINTER *cip;
 
-	cip = item_pointer(block, i);
-	return (POOL_CACHE_ITEM_HEADER *) (block + cip->offset);
-}
+/*
+ * Clock hand pointing to next victim block
+ */
+static int *pool_fsmm_clock_hand;
 
-#ifdef SHMEMCACHE_DEBUG
 /*
- * Dump shmem cache block
+ * Allocate and initialize clock hand on shmem
  */
-static void
-dump_shmem_cache(POOL_CACHE_BLOCKID blockid)
+void
+pool_allocate_fsmm_clock_hand(void)
 {
-	POOL_CACHE_BLOCK_HEADER *bh;
-	POOL_CACHE_ITEM_POINTER *cip;
-	POOL_CACHE_ITEM_HEADER *cih;
-	int			i;
-
-	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(blockid);
-	fprintf(stderr, "shmem: block header(%lu bytes): flags:%x num_items:%d free_bytes:%d\n",
-			sizeof(*bh), bh->flags, bh->num_items, bh->free_bytes);
-	for (i = 0; i < bh->num_items; i++)
-	{
-		cip = item_pointer((char *) bh, i);
-		fprintf(stderr, "shmem: block: %d %d th item pointer(%lu bytes): offset:%d flags:%x\n",
-				blockid, i, sizeof(*cip), cip->offset, cip->flags);
-		cih = item_header((char *) bh, i);
-		fprintf(stderr, "shmem: block: %d %d th item header(%lu bytes): timestamp:%ld length:%d\n",
-				blockid, i, sizeof(*cih), cih->timestamp, cih->total_length);
-	}
+	pool_fsmm_clock_hand = pool_shared_memory_segment_get_chunk(sizeof(*pool_fsmm_clock_hand));
+	*pool_fsmm_clock_hand = 0;
 }
-#endif
 
 /*
- * SELECT query result array modules
+ * Reset FSMM.
  */
-POOL_QUERY_CACHE_ARRAY *
-pool_create_query_cache_array(void)
+static void
+pool_reset_fsmm(size_t size)
 {
-#define POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM 128
-#define POOL_QUERY_CACHE_ARRAY_HEADER_SIZE (sizeof(int)+sizeof(int))
+	int			encode_value;
 
-	size_t		size;
-	POOL_QUERY_CACHE_ARRAY *p;
-	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
-	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
+	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
+	memset(fsmm, encode_value, size);
 
-	size = POOL_QUERY_CACHE_ARRAY_HEADER_SIZE + POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM *
-		sizeof(POOL_TEMP_QUERY_CACHE *);
-	p = palloc(size);
-	p->num_caches = 0;
-	p->array_size = POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM;
-	MemoryContextSwitchTo(old_context);
-	return p;
+	*pool_fsmm_clock_hand = 0;
 }
 
 /*
- * Discard query cache array
+ * Find victim block using clock hand and make it free.
+ * Returns new free block id.
+ * This throws away all the items in the block regardless of how often they
+ * are used, so it is only used as the last resort when
+ * pool_evict_cache_items() could not make enough room.
  */
-void
-pool_discard_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array)
+static POOL_CACHE_BLOCKID pool_reuse_block(void)
 {
+	int			maxblock = pool_get_memqcache_blocks();
+	char	   *block = block_address(*pool_fsmm_clock_hand);
+	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) block;
+	POOL_CACHE_BLOCKID reused_block;
+	POOL_CACHE_ITEM_POINTER *cip;
+	char	   *p;
 	int			i;
+	int			num_evicted = 0;
 
-	if (!cache_array)
-		return;
-
-	ereport(DEBUG1,
-			(errmsg("memcache discarding query cache array"),
-			 errdetail("num_caches: %d", cache_array->num_caches)));
+	bh->flags = 0;
+	reused_block = *pool_fsmm_clock_hand;
+	p = block_address(reused_block);
 
-	for (i = 0; i < cache_array->num_caches; i++)
+	/* Remove all items in this block from hash table */
+	for (i = 0; i < bh->num_items; i++)
 	{
-		ereport(DEBUG2,
-				(errmsg("memcache discarding query cache array"),
-				 errdetail("cache no: %d cache: %p", i, cache_array->caches[i])));
-		pool_discard_temp_query_cache(cache_array->caches[i]);
+		cip = item_pointer(p, i);
+
+		if (!(POOL_ITEM_DELETED & cip->flags))
+		{
+			POOL_CACHE_ITEM_HEADER *cih = item_header(p, i);
+
+			pool_hash_delete(&cip->query_hash);
+			pool_oid_map_remove_item(cip);
+			pool_cache_partition_account(cih, -(long) (cih->total_length + sizeof(POOL_CACHE_ITEM_POINTER)));
+			num_evicted++;
+			ereport(DEBUG1,
+					(errmsg("pool_reuse_block: blockid: %d item: %d", reused_block, i)));
+		}
 	}
-	pfree(cache_array);
-}
+	pool_stats_count_up_num_evicted_entries(num_evicted);
 
-/*
- * Add query cache array
- */
-static POOL_QUERY_CACHE_ARRAY * pool_add_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array, POOL_TEMP_QUERY_CACHE * cache)
-{
-	size_t		size;
-	POOL_QUERY_CACHE_ARRAY *cp = cache_array;
+	pool_init_cache_block(reused_block);
+	pool_update_fsmm(reused_block, POOL_MAX_FREE_SPACE);
 
-	if (!cache_array)
-		return cp;
+	(*pool_fsmm_clock_hand)++;
+	if (*pool_fsmm_clock_hand >= maxblock)
+		*pool_fsmm_clock_hand = 0;
 
-	ereport(DEBUG2,
-			(errmsg("memcache adding query cache array"),
-			 errdetail("num_caches: %d cache: %p", cache_array->num_caches, cache)));
-	if (cache_array->num_caches >= cache_array->array_size)
-	{
-		cache_array->array_size += POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM;
-		size = POOL_QUERY_CACHE_ARRAY_HEADER_SIZE + cache_array->array_size *
-			sizeof(POOL_TEMP_QUERY_CACHE *);
-		cache_array = repalloc(cache_array, size);
-	}
-	cache_array->caches[cache_array->num_caches++] = cache;
-	return cache_array;
+	ereport(LOG,
+			(errmsg("pool_reuse_block: blockid: %d", reused_block)));
+
+	return reused_block;
 }
 
 /*
- * SELECT query result temporary cache modules
+ * Maximum usage count of cache items.  See pool_evict_cache_items().
  */
+#define POOL_MAX_USAGE_COUNT	5
 
 /*
- * Create SELECT result temporary cache
+ * Make room for a new item by evicting individual cache items.
+ *
+ * This is a CLOCK algorithm with usage counts (the same idea as the buffer
+ * replacement of PostgreSQL).  Each cache item has a usage count, which is
+ * incremented up to POOL_MAX_USAGE_COUNT whenever the item is hit.  The clock
+ * hand sweeps blocks.  In each block, items whose usage count is 0 are
+ * evicted and others get their usage count decremented, then the block is
+ * compacted.  This way frequently used items survive several sweeps while a
+ * large result which is never used again goes away soon.
+ *
+ * Returns id of a block which has at least "free_space" bytes.  If
+ * "need_hash_element" is true, a free hash element must exist as well.
+ * Falls back to pool_reuse_block() if it cannot make enough room after
+ * sweeping all blocks POOL_MAX_USAGE_COUNT + 1 times.
  */
-POOL_TEMP_QUERY_CACHE *
-pool_create_temp_query_cache(char *query)
+static POOL_CACHE_BLOCKID
+pool_evict_cache_items(size_t free_space, bool need_hash_element)
 {
-	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
-	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
-	POOL_TEMP_QUERY_CACHE *p;
+	int			maxblock = pool_get_memqcache_blocks();
+	int			nscan = maxblock * (POOL_MAX_USAGE_COUNT + 1);
+	int			n;
 
-	p = palloc(sizeof(*p));
-	p->query = pstrdup(query);
+	for (n = 0; n < nscan; n++)
+	{
+		POOL_CACHE_BLOCKID blockid;
+		POOL_CACHE_BLOCK_HEADER *bh;
+		POOL_CACHE_ITEM_POINTER *cip;
+		POOL_CACHEID cacheid;
+		char	   *p;
+		int			num_evicted = 0;
+		int			i;
 
-	p->buffer = pool_create_buffer();
-	p->oids = pool_create_buffer();
-	p->num_oids = 0;
-	p->is_exceeded = false;
-	p->is_discarded = false;
+		blockid = *pool_fsmm_clock_hand;
+		(*pool_fsmm_clock_hand)++;
+		if (*pool_fsmm_clock_hand >= maxblock)
+			*pool_fsmm_clock_hand = 0;
 
-	MemoryContextSwitchTo(old_context);
+		p = block_address(blockid);
+		bh = (POOL_CACHE_BLOCK_HEADER *) p;
 
-	ereport(DEBUG1,
-			(errmsg("pool_create_temp_query_cache: cache created: %p", p)));
+		if (bh->flags & POOL_BLOCK_USED)
+		{
+			/* Reclaim space of deleted items first */
+			pool_compact_cache_block(blockid);
 
-	return p;
-}
+			if (bh->free_bytes < free_space ||
+				(need_hash_element && !is_free_hash_element()))
+			{
+				cacheid.blockid = blockid;
 
-/*
- * Discard temp query cache
- */
-void
-pool_discard_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache)
+				for (i = 0; i < bh->num_items; i++)
+				{
+					volatile	POOL_HASH_ELEMENT *element;
+
+					cip = item_pointer(p, i);
+					if (cip->flags & POOL_ITEM_DELETED)
+						continue;
+
+					/* Give recently used items another chance */
+					element = pool_hash_search_element(&cip->query_hash);
+					if (element && pool_hash_age_element(element))
+						continue;
+
+					cacheid.itemid = i;
+					if (pool_delete_item_shmem_cache(&cacheid) == 0)
+						num_evicted++;
+				}
+
+				if (num_evicted > 0)
+				{
+					ereport(DEBUG1,
+							(errmsg("memcache: evicted %d items from block: %d",
+									num_evicted, blockid)));
+					pool_stats_count_up_num_evicted_entries(num_evicted);
+					pool_compact_cache_block(blockid);
+				}
+			}
+		}
+		else
+			pool_init_cache_block(blockid);
+
+		if (bh->free_bytes >= free_space &&
+			(!need_hash_element || is_free_hash_element()))
+			return blockid;
+	}
+
+	/*
+	 * Could not make enough room.  Reuse victim block.
+	 */
+	return pool_reuse_block();
+}
+
+/*
+ * Compact the specified block.  Bodies of the live items are moved toward
+ * the bottom of the block to turn the space occupied by deleted items into
+ * contiguous free space.  Item ids, i.e. the location of item pointers, are
+ * never changed since they are recorded in the hash table and in the table
+ * oid maps.  Deleted item pointers at the end of the item pointer array are
+ * removed, others are kept with POOL_ITEM_PACKED flag, which means that the
+ * item has no body.  Caller must hold the exclusive query cache lock.
+ */
+static void
+pool_compact_cache_block(POOL_CACHE_BLOCKID blockid)
 {
-	if (!temp_cache)
+	char	   *p = block_address(blockid);
+	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) p;
+	POOL_CACHE_ITEM_POINTER *cip;
+	unsigned int dst;
+	unsigned int used;
+	bool		need_pack = false;
+	int			i;
+
+	if (!(bh->flags & POOL_BLOCK_USED))
 		return;
 
-	if (temp_cache->query)
-		pfree(temp_cache->query);
-	if (temp_cache->buffer)
-		pool_discard_buffer(temp_cache->buffer);
-	if (temp_cache->oids)
-		pool_discard_buffer(temp_cache->oids);
+	for (i = 0; i < bh->num_items; i++)
+	{
+		cip = item_pointer(p, i);
+		if ((cip->flags & POOL_ITEM_DELETED) && !(cip->flags & POOL_ITEM_PACKED))
+		{
+			need_pack = true;
+			break;
+		}
+	}
+
+	if (!need_pack)
+		return;
+
+	/* Tell lock-free readers that item bodies are moving */
+	pool_atomic_fetch_add_u32(&bh->version, 1);
+
+	dst = pool_config->memqcache_cache_block_size;
+	used = 0;
+	for (i = 0; i < bh->num_items; i++)
+	{
+		unsigned int total_length;
+
+		cip = item_pointer(p, i);
+
+		if (cip->flags & POOL_ITEM_DELETED)
+		{
+			cip->flags |= POOL_ITEM_PACKED;
+			cip->offset = dst;
+			continue;
+		}
+
+		total_length = item_header(p, i)->total_length;
+		dst -= total_length;
+		if (dst != cip->offset)
+		{
+			memmove(p + dst, p + cip->offset, total_length);
+			cip->offset = dst;
+		}
+		used += total_length;
+	}
+
+	/* Remove deleted item pointers at the end */
+	while (bh->num_items > 0 &&
+		   (item_pointer(p, bh->num_items - 1)->flags & POOL_ITEM_DELETED))
+		bh->num_items--;
+
+	pool_atomic_fetch_add_u32(&bh->version, 1);
+
+	if (bh->num_items == 0)
+	{
+		bh->flags = 0;
+		pool_init_cache_block(blockid);
+	}
+	else
+		bh->free_bytes = pool_config->memqcache_cache_block_size -
+			sizeof(POOL_CACHE_BLOCK_HEADER) -
+			sizeof(POOL_CACHE_ITEM_POINTER) * bh->num_items - used;
+
+	pool_update_fsmm(blockid, bh->free_bytes);
+
+	ereport(DEBUG1,
+			(errmsg("memcache: compacted block: %d", blockid),
+			 errdetail("items: %d free bytes: %d", bh->num_items, bh->free_bytes)));
+}
+
+/*
+ * Get block id which has enough space
+ *
+ * If children are bound to NUMA nodes, the blocks are divided into one
+ * partition per node and the search starts at the partition of our own
+ * node, so that blocks are first touched, and thus placed, on the node
+ * that fills them.
+ */
+static POOL_CACHE_BLOCKID pool_get_block(size_t free_space)
+{
+	int			encode_value;
+	unsigned char *p = pool_fsmm_address();
+	int			n;
+	int			i;
+	int			start = 0;
+	int			maxblock = pool_get_memqcache_blocks();
+	int			numa_nodes = pool_numa_num_nodes();
+	POOL_CACHE_BLOCK_HEADER *bh;
+
+	if (p == NULL)
+	{
+		ereport(WARNING,
+				(errmsg("memcache: getting block: FSMM is not initialized")));
+		return -1;
+	}
+
+	if (free_space > POOL_MAX_FREE_SPACE)
+	{
+		ereport(WARNING,
+				(errmsg("memcache: getting block: invalid free space:%zd", free_space),
+				 errdetail("requested free space: %zd is more than maximum allowed space:%lu", free_space, POOL_MAX_FREE_SPACE)));
+		return -1;
+	}
+
+	encode_value = free_space / POOL_FSMM_RATIO;
+
+	if (numa_nodes > 0 && pool_numa_my_node() >= 0)
+		start = (int) ((int64) maxblock * pool_numa_my_node() / numa_nodes);
+
+	for (n = 0; n < maxblock; n++)
+	{
+		i = (start + n) % maxblock;
+		if (p[i] >= encode_value)
+		{
+			/*
+			 * This block may not have enough space. We need to make sure it
+			 * actually has enough space.
+			 */
+			bh = (POOL_CACHE_BLOCK_HEADER *) block_address(i);
+
+			/*
+			 * Blocks are not initialized at startup.  A block that has
+			 * never been used is still all zero, so set it up now.
+			 */
+			if (!(bh->flags & POOL_BLOCK_USED) && bh->free_bytes == 0)
+				pool_init_cache_block(i);
+
+			if (bh->free_bytes >= free_space)
+			{
+				return (POOL_CACHE_BLOCKID) i;
+			}
+		}
+	}
+
+	/*
+	 * No enough space found. Evict cold items.
+	 */
+	return pool_evict_cache_items(free_space, false);
+}
+
+/*
+ * Update free space info for specified block
+ */
+static void
+pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space)
+{
+	int			encode_value;
+	char	   *p = pool_fsmm_address();
+
+	if (p == NULL)
+	{
+		ereport(WARNING,
+				(errmsg("memcache: updating free space in block: FSMM is not initialized")));
+		return;
+	}
+
+	if (blockid >= pool_get_memqcache_blocks())
+	{
+		ereport(WARNING,
+				(errmsg("memcache: updating free space in block: block id:%d in invalid", blockid)));
+		return;
+	}
+
+	if (free_space > POOL_MAX_FREE_SPACE)
+	{
+		ereport(WARNING,
+				(errmsg("memcache: updating free space in block: invalid free space:%zd", free_space),
+				 errdetail("requested free space: %zd is more than maximum allowed space:%lu", free_space, POOL_MAX_FREE_SPACE)));
+
+		return;
+	}
+
+	encode_value = free_space / POOL_FSMM_RATIO;
+
+	p[blockid] = encode_value;
+
+	return;
+}
+
+/*
+ * Add item data to shared memory cache.
+ * On successful registration, returns cache id.
+ * The cache id is overwritten by the subsequent call to this function.
+ * On error returns NULL.
+ */
+static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, unsigned char codec, time_t expire, int partition)
+{
+	static POOL_CACHEID cacheid;
+	POOL_CACHE_BLOCKID blockid;
+	POOL_CACHE_BLOCK_HEADER *bh;
+	POOL_CACHE_ITEM_POINTER *cip;
+
+	POOL_CACHE_ITEM ci;
+	POOL_CACHE_ITEM_POINTER cip_body;
+	char	   *item;
+
+	int			request_size;
+	char	   *p;
+
+	if (query_hash == NULL)
+	{
+		ereport(LOG,
+				(errmsg("error while adding item to shmem cache, query hash is NULL")));
+		return NULL;
+	}
+
+	if (data == NULL)
+	{
+		ereport(LOG,
+				(errmsg("error while adding item to shmem cache, data is NULL")));
+		return NULL;
+	}
+
+	if (size <= 0)
+	{
+		ereport(LOG,
+				(errmsg("error while adding item to shmem cache, invalid request size: %d", size)));
+		return NULL;
+	}
+
+	/* Add overhead */
+	request_size = size + sizeof(POOL_CACHE_ITEM_POINTER) + sizeof(POOL_CACHE_ITEM_HEADER);
+
+	/*
+	 * This could happen if memqcache_maxcache is larger than the block size
+	 * because compression is enabled, and the data did not compress well.
+	 */
+	if (request_size > POOL_MAX_FREE_SPACE)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache adding item"),
+				 errdetail("item size %d is larger than the block size", request_size)));
+		return NULL;
+	}
+
+	/* Get cache block which has enough space */
+	blockid = pool_get_block(request_size);
+
+	if (blockid == -1)
+	{
+		return NULL;
+	}
+
+	/*
+	 * Initialize the block if necessary. If no live items are remained, we
+	 * also initialize the block. If there's contiguous deleted items, we turn
+	 * them into free space as well.
+	 */
+	pool_init_cache_block(blockid);
+
+	/*
+	 * Make sure that we have at least one free hash element.
+	 */
+	while (!is_free_hash_element())
+	{
+		/* If not, evict items */
+		blockid = pool_evict_cache_items(request_size, true);
+	}
+
+	/* Get block address on shmem */
+	p = block_address(blockid);
+	bh = (POOL_CACHE_BLOCK_HEADER *) p;
+
+	/*
+	 * Space occupied by deleted items is turned into contiguous free space
+	 * by pool_compact_cache_block() when items are evicted, so the free
+	 * space is always contiguous here.  We assume that item bodies are
+	 * ordered from bottom to top of the block, and corresponding item
+	 * pointers are ordered from the oldest to the youngest in the beginning
+	 * of the block.
+	 */
+
+	/*
+	 * Make sure that we have enough free space
+	 */
+	if (bh->free_bytes < request_size)
+	{
+		/* This should not happen */
+		ereport(WARNING,
+				(errmsg("memcache: adding item to cache: not enough space"),
+				 errdetail("free space: %d required: %d block id:%d",
+						   bh->free_bytes, request_size, blockid)));
+		return NULL;
+	}
+
+	/*
+	 * At this point, new item can be located at block_header->num_items
+	 */
+
+	/* Fill in cache item header */
+	memset(&ci.header, 0, sizeof(ci.header));
+	ci.header.timestamp = time(NULL);
+	ci.header.expire = expire;
+	ci.header.total_length = sizeof(POOL_CACHE_ITEM_HEADER) + size;
+	ci.header.codec = codec;
+	ci.header.partition = partition + 1;
+
+	/* Calculate item body address */
+	if (bh->num_items == 0)
+	{
+		/*
+		 * This is the #0 item. So address is block_bottom - data_length
+		 */
+		item = p + pool_config->memqcache_cache_block_size - ci.header.total_length;
+
+		/* Mark this block used */
+		bh->flags = POOL_BLOCK_USED;
+	}
+	else
+	{
+		cip = item_pointer(p, bh->num_items - 1);
+		item = p + cip->offset - ci.header.total_length;
+	}
+
+	/* Copy item header */
+	memcpy(item, &ci, sizeof(POOL_CACHE_ITEM_HEADER));
+	bh->free_bytes -= sizeof(POOL_CACHE_ITEM_HEADER);
+
+	/* Copy item body */
+	memcpy(item + sizeof(POOL_CACHE_ITEM_HEADER), data, size);
+	bh->free_bytes -= size;
+
+	/* Copy cache item pointer */
+	memcpy(&cip_body.query_hash, query_hash, sizeof(POOL_QUERY_HASH));
+	cip_body.oid_map = -1;
+	cip_body.offset = item - p;
+	cip_body.flags = POOL_ITEM_USED;
+	memcpy(item_pointer(p, bh->num_items), &cip_body, sizeof(POOL_CACHE_ITEM_POINTER));
+	bh->free_bytes -= sizeof(POOL_CACHE_ITEM_POINTER);
+
+	pool_cache_partition_account(&ci.header, request_size);
+
+	/* Update FSMM */
+	pool_update_fsmm(blockid, bh->free_bytes);
+
+	cacheid.blockid = blockid;
+	cacheid.itemid = bh->num_items;
+	ereport(DEBUG1,
+			(errmsg("memcache adding item"),
+			 errdetail("new item inserted. blockid: %d itemid:%d",
+					   cacheid.blockid, cacheid.itemid)));
+
+	/* Add up number of items */
+	bh->num_items++;
+
+	/* Update hash table */
+	if (pool_hash_insert(query_hash, &cacheid, false) < 0)
+	{
+		ereport(LOG,
+				(errmsg("error while adding item to shmem cache, hash insert failed")));
+
+		/*
+		 * Since we have failed to insert hash index entry, we need to undo
+		 * the addition of cache entry.
+		 */
+		pool_delete_item_shmem_cache(&cacheid);
+		return NULL;
+	}
+	ereport(DEBUG1,
+			(errmsg("memcache adding item"),
+			 errdetail("block: %d item: %d", cacheid.blockid, cacheid.itemid)));
+
+#ifdef SHMEMCACHE_DEBUG
+	dump_shmem_cache(blockid);
+#endif
+	return &cacheid;
+}
+
+/*
+ * Returns item data address on shared memory cache specified by query hash.
+ * Also data length is set to *size.
+ * On error or data not found case returns NULL.
+ * Detail is set to *sts. (0: success, 1: not found, -1: error)
+ */
+static char *
+pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, unsigned char *codec, int *sts)
+{
+	POOL_CACHEID *cacheid;
+	POOL_CACHE_ITEM_HEADER *cih;
+	uint32		claimed;
+	time_t		now;
+
+	if (sts == NULL)
+	{
+		ereport(LOG,
+				(errmsg("error while getting item from shmem cache, sts is NULL")));
+		return NULL;
+	}
+
+	*sts = -1;
+
+	if (query_hash == NULL)
+	{
+		ereport(LOG,
+				(errmsg("error while getting item from shmem cache, query hash is NULL")));
+		return NULL;
+	}
+
+	if (size == NULL)
+	{
+		ereport(LOG,
+				(errmsg("error while getting item from shmem cache, size is NULL")));
+		return NULL;
+	}
+
+	/*
+	 * Find cache header by using hash table
+	 */
+	cacheid = pool_find_item_on_shmem_cache(query_hash);
+	if (cacheid == NULL)
+	{
+		/* Not found */
+		*sts = 1;
+		return NULL;
+	}
+
+	cih = pool_cache_item_header(cacheid);
+
+	/*
+	 * If the item is about to expire and nobody is refreshing it, take the
+	 * refresh on ourselves by pretending that it is not found.  The query
+	 * goes to the backend and its result replaces the item, while the
+	 * others keep using the item.
+	 */
+	claimed = pool_atomic_read_u32(&cih->refresh_claimed);
+	now = time(NULL);
+	if (pool_cache_item_needs_refresh(cih, now) &&
+		pool_atomic_compare_exchange_u32(&cih->refresh_claimed, &claimed, (uint32) now))
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache getting item"),
+				 errdetail("refreshing the item before it expires")));
+		*sts = 1;
+		return NULL;
+	}
+
+	*size = cih->total_length - sizeof(POOL_CACHE_ITEM_HEADER);
+	*codec = cih->codec;
+	fetched_item_expire = pool_local_cache_expire(cih);
+	return (char *) cih + sizeof(POOL_CACHE_ITEM_HEADER);
+}
+
+/*
+ * Return true if the item is within memqcache_stale_while_revalidate
+ * seconds of its expiry and nobody has started to refresh it, or the
+ * refresh seems to have been given up.
+ */
+static bool
+pool_cache_item_needs_refresh(POOL_CACHE_ITEM_HEADER * cih, time_t now)
+{
+	int			window = pool_config->memqcache_stale_while_revalidate;
+	uint32		claimed;
+
+	if (window <= 0 || cih->expire <= 0)
+		return false;
+
+	if (now < cih->timestamp + cih->expire - window)
+		return false;
+
+	claimed = pool_atomic_read_u32(&cih->refresh_claimed);
+	return claimed == 0 || now - (time_t) claimed >= window;
+}
+
+/*
+ * Find data on shared memory cache specified query hash.
+ * On success returns cache id.
+ * The cache id is overwritten by the subsequent call to this function.
+ */
+static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash)
+{
+	static POOL_CACHEID cacheid;
+	volatile	POOL_HASH_ELEMENT *element;
+	POOL_CACHEID *c;
+	POOL_CACHE_ITEM_HEADER *cih;
+	time_t		now;
+
+	element = pool_hash_search_element(query_hash);
+	if (!element)
+	{
+		return NULL;
+	}
+	c = (POOL_CACHEID *) & element->cacheid;
+
+	cih = item_header(block_address(c->blockid), c->itemid);
+
+	/* Check cache expiration */
+	if (cih->expire > 0)
+	{
+		now = time(NULL);
+		if (difftime(now, cih->timestamp) > cih->expire)
+		{
+			/*
+			 * We need to acquire an exclusive lock before removing the cache
+			 * entry.  Since a lock escalation from shared lock to exclusive
+			 * lock is not supported, we need to release the lock then acquire
+			 * an exclusive lock.
+			 */
+			pool_shmem_unlock();
+			pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+			/*
+			 * There is a window between pool_shmem_unlock() and
+			 * pool_shmem_lock().  We need to get POOL_CACHEID and
+			 * POOL_CACHE_ITEM_HEADER again because they could have been
+			 * modified by someone else.
+			 */
+			element = pool_hash_search_element(query_hash);
+			if (!element)
+			{
+				return NULL;
+			}
+			c = (POOL_CACHEID *) & element->cacheid;
+
+			cih = item_header(block_address(c->blockid), c->itemid);
+			now = time(NULL);
+			if (now > (cih->timestamp + cih->expire))
+			{
+				ereport(DEBUG1,
+						(errmsg("memcache finding item"),
+						 errdetail("cache expired: now: %ld timestamp: %ld",
+								   now, cih->timestamp + cih->expire)));
+				pool_delete_item_shmem_cache(c);
+				return NULL;
+			}
+		}
+	}
+
+	pool_hash_touch_element(element);
+	pool_sketch_increment(query_hash);
+
+	cacheid.blockid = c->blockid;
+	cacheid.itemid = c->itemid;
+	return &cacheid;
+}
+
+/*
+ * Delete item data specified cache id from shmem.
+ * On successful deletion, returns 0.
+ * Other wise return -1.
+ * FSMM is also updated.
+ */
+static int
+pool_delete_item_shmem_cache(POOL_CACHEID * cacheid)
+{
+	POOL_CACHE_BLOCK_HEADER *bh;
+	POOL_CACHE_ITEM_POINTER *cip;
+	POOL_CACHE_ITEM_HEADER *cih;
+	POOL_QUERY_HASH key;
+	int			size;
+
+	ereport(DEBUG1,
+			(errmsg("memcache deleting item data"),
+			 errdetail("cacheid:%d itemid:%d", cacheid->blockid, cacheid->itemid)));
+
+	if (cacheid->blockid >= pool_get_memqcache_blocks())
+	{
+		ereport(LOG,
+				(errmsg("error while deleting item from shmem cache, invalid block: %d",
+						cacheid->blockid)));
+		return -1;
+	}
+
+	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid->blockid);
+	if (!(bh->flags & POOL_BLOCK_USED))
+	{
+		ereport(LOG,
+				(errmsg("error while deleting item from shmem cache, block: %d is not used",
+						cacheid->blockid)));
+		return -1;
+	}
+
+	if (cacheid->itemid >= bh->num_items)
+	{
+		/*
+		 * This could happen if the block is reused.  Since contents of oid
+		 * map file is not updated when the block is reused.
+		 */
+		ereport(DEBUG1,
+				(errmsg("memcache error deleting item data"),
+				 errdetail("invalid item id %d in block:%d",
+						   cacheid->itemid, cacheid->blockid)));
+
+		return -1;
+	}
+
+	cip = item_pointer(block_address(cacheid->blockid), cacheid->itemid);
+	if (!(cip->flags & POOL_ITEM_USED))
+	{
+		ereport(LOG,
+				(errmsg("error while deleting item from shmem cache, item: %d was not used",
+						cacheid->itemid)));
+		return -1;
+	}
+
+	if (cip->flags & POOL_ITEM_DELETED)
+	{
+		ereport(LOG,
+				(errmsg("error while deleting item from shmem cache, item: %d was already deleted",
+						cacheid->itemid)));
+		return -1;
+	}
+
+	/* Save cache key */
+	memcpy(&key, &cip->query_hash, sizeof(POOL_QUERY_HASH));
+
+	/*
+	 * Remove hash index. This must be done before touching the item so that
+	 * lock-free readers notice the modification.
+	 */
+	pool_hash_delete(&key);
+
+	/* Forget tables used by the item */
+	pool_oid_map_remove_item(cip);
+
+	cih = pool_cache_item_header(cacheid);
+	size = cih->total_length + sizeof(POOL_CACHE_ITEM_POINTER);
+	pool_cache_partition_account(cih, -size);
+
+	/* Delete item pointer */
+	cip->flags |= POOL_ITEM_DELETED;
+
+	/*
+	 * We do NOT count down bh->num_items here. The deleted space will be
+	 * recycled by pool_add_item_shmem_cache(). However, if this is the last
+	 * item, we can recycle whole block.
+	 *
+	 * 2012/4/1: Now we do not pack data in pool_add_item_shmem_cache() for
+	 * performance reason. Also we count down num_items if it is the last one.
+	 */
+	if ((bh->num_items - 1) == 0)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache deleting item data"),
+				 errdetail("no item remains. initialize block")));
+		bh->flags = 0;
+		pool_init_cache_block(cacheid->blockid);
+	}
+
+	/*
+	 * If the deleted item is the last one in the block, we add it to the free
+	 * space.
+	 */
+	if (cacheid->itemid == (bh->num_items - 1))
+	{
+		bh->free_bytes += size;
+		ereport(DEBUG1,
+				(errmsg("memcache deleting item data"),
+				 errdetail("deleted %d bytes, freebytes is %d",
+						   size, bh->free_bytes)));
+
+		bh->num_items--;
+	}
+
+	/* Update FSMM */
+	pool_update_fsmm(cacheid->blockid, bh->free_bytes);
+
+	return 0;
+}
+
+/*
+ * Returns item header specified by cache id.
+ */
+static POOL_CACHE_ITEM_HEADER * pool_cache_item_header(POOL_CACHEID * cacheid)
+{
+	POOL_CACHE_BLOCK_HEADER *bh;
+
+	if (cacheid->blockid >= pool_get_memqcache_blocks())
+	{
+		ereport(WARNING,
+				(errmsg("error while getting cache item header, invalid block id: %d", cacheid->blockid)));
+		return NULL;
+	}
+
+	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid->blockid);
+	if (cacheid->itemid >= bh->num_items)
+	{
+		ereport(WARNING,
+				(errmsg("error while getting cache item header, invalid item id: %d", cacheid->itemid)));
+		return NULL;
+	}
+
+	return item_header((char *) bh, cacheid->itemid);
+}
+
+/*
+ * Initialize specified block.
+ */
+static int
+pool_init_cache_block(POOL_CACHE_BLOCKID blockid)
+{
+	char	   *p;
+	POOL_CACHE_BLOCK_HEADER *bh;
+
+	if (blockid >= pool_get_memqcache_blocks())
+	{
+		ereport(WARNING,
+				(errmsg("error while initializing cache block, invalid block id: %d", blockid)));
+		return -1;
+	}
+
+	p = block_address(blockid);
+	bh = (POOL_CACHE_BLOCK_HEADER *) p;
+
+	/* Is this block used? */
+	if (!(bh->flags & POOL_BLOCK_USED))
+	{
+		uint32		version = pool_atomic_read_u32(&bh->version);
+
+		/* Initialize empty block */
+		memset(p, 0, pool_config->memqcache_cache_block_size);
+		bh->free_bytes = pool_config->memqcache_cache_block_size -
+			sizeof(POOL_CACHE_BLOCK_HEADER);
+		/* Keep the version for lock-free readers */
+		pool_atomic_init_u32(&bh->version, version);
+	}
+	return 0;
+}
+
+#if NOT_USED
+/*
+ * Delete all items in the block.
+ */
+static void
+pool_wipe_out_cache_block(POOL_CACHE_BLOCKID blockid)
+{
+	char	   *p;
+	POOL_CACHE_BLOCK_HEADER *bh;
+	POOL_CACHE_ITEM_POINTER *cip;
+	POOL_CACHEID cacheid;
+	int			i;
+
+	/* Get block address on shmem */
+	p = block_address(blockid);
+	bh = (POOL_CACHE_BLOCK_HEADER *) p;
+	cacheid.blockid = blockid;
+
+	for (i = 0; i < bh->num_items; i++)
+	{
+		cip = item_pointer(p, i);
+
+		if ((POOL_ITEM_DELETED & cip->flags) == 0)	/* Not deleted item? */
+		{
+			cacheid.itemid = i;
+			pool_delete_item_shmem_cache(&cacheid);
+		}
+	}
+
+	bh->flags = 0;
+	pool_init_cache_block(blockid);
+	pool_update_fsmm(blockid, POOL_MAX_FREE_SPACE);
+}
+#endif
+
+#undef LOCK_TRACE
+
+/*
+ * Query cache lock.
+ *
+ * We used to serialize access to the shared memory query cache by using
+ * flock() on a lock file.  That made every cache lookup issue two system
+ * calls and made all the processes contend on a single kernel lock.  Now the
+ * lock lives in the shared memory and is a "big reader" lock: each process
+ * registers its shared lock in a stripe of its own (a child process uses the
+ * stripe corresponding to its process table slot, other processes take one
+ * of the auxiliary stripes), so that acquiring a shared lock touches only a
+ * cache line nobody else touches and requires no system call.  An exclusive
+ * locker first advertises itself in the "writer" field, then waits until
+ * all the stripes are drained.
+ *
+ * The owner of an auxiliary stripe is recorded so that the shared lock of a
+ * process which died holding it can be released: by pgpool main process
+ * for the processes it reaps, and by an exclusive locker or a process
+ * looking for a stripe for the others, e.g. PCP worker processes.  A stripe
+ * is recovered by first taking it over with compare-and-swap of its owner,
+ * so that only one process resets it.
+ *
+ * Waiters spin for a while, then sleep with exponential back off.
+ */
+#define MEMQ_LOCK_MAX_SPINS			100
+#define MEMQ_LOCK_MIN_DELAY_USEC	10
+#define MEMQ_LOCK_MAX_DELAY_USEC	1000
+
+static POOL_MEMQ_LOCK *memq_lock = NULL;
+static POOL_MEMQ_LOCK_TYPE memq_lock_type;
+
+static volatile POOL_MEMQ_LOCK_STRIPE *memq_lock_stripe(void);
+static int	memq_lock_claim_aux_stripe(void);
+static bool memq_lock_recover_aux_stripe(int i, uint32 owner);
+static void memq_lock_delay(int *spins, int *delay);
+
+/*
+ * Calculate necessary shared memory size for the query cache lock.
+ */
+size_t
+pool_shmem_lock_size(void)
+{
+	POOL_MEMQ_LOCK	ml;
+	size_t		size;
+
+	/* auxiliary stripes plus one stripe per child process */
+	size = (char *) &ml.stripes - (char *) &ml +
+		sizeof(POOL_MEMQ_LOCK_STRIPE) *
+		(pool_config->num_init_children + POOL_MEMQ_LOCK_AUX_STRIPES);
+
+	/* room for aligning the lock to a cache line boundary */
+	size += POOL_CACHE_LINE_SIZE;
+
+	elog(DEBUG1, "pool_shmem_lock_size: %zu", size);
+	return size;
+}
+
+/*
+ * Allocate and initialize the query cache lock on shmem. This should be
+ * called only once from pgpool main process at the process staring up time.
+ */
+void
+pool_init_shmem_lock(void)
+{
+	char	   *p;
+	int			i;
+
+	p = pool_shared_memory_segment_get_chunk(pool_shmem_lock_size());
+	memq_lock = (POOL_MEMQ_LOCK *) TYPEALIGN(POOL_CACHE_LINE_SIZE, p);
+
+	memq_lock->nstripes = pool_config->num_init_children + POOL_MEMQ_LOCK_AUX_STRIPES;
+	pool_atomic_init_u32(&memq_lock->writer, 0);
+	for (i = 0; i < memq_lock->nstripes; i++)
+	{
+		pool_atomic_init_u32(&memq_lock->stripes[i].nreaders, 0);
+		pool_atomic_init_u32(&memq_lock->stripes[i].owner, 0);
+	}
+}
+
+/*
+ * Acquire lock
+ */
+void
+pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type)
+{
+	int			spins = 0;
+	int			delay = 0;
+	PoolStage	stage;
+
+#ifdef LOCK_TRACE
+		elog(LOG, "LOCK TRACE: try to acquire lock %s", type == POOL_MEMQ_EXCLUSIVE_LOCK? "LOCK_EX" : "LOCK_SH");
+#endif
+	if (pool_is_shmem_cache() && !is_shmem_locked && memq_lock)
+	{
+		stage = pool_stage_enter(POOL_STAGE_CACHE_LOCK);
+
+		if (type == POOL_MEMQ_EXCLUSIVE_LOCK)
+		{
+			uint32		expected;
+			int			i;
+
+			/* Advertise that we want the lock to block out new readers */
+			for (;;)
+			{
+				expected = 0;
+				if (pool_atomic_compare_exchange_u32(&memq_lock->writer,
+													 &expected, myProcPid))
+					break;
+				memq_lock_delay(&spins, &delay);
+			}
+
+			/*
+			 * Wait for existing readers to go away.  Once we have to sleep,
+			 * check whether the owner of an auxiliary stripe has died.
+			 */
+			for (i = 0; i < memq_lock->nstripes; i++)
+			{
+				while (pool_atomic_read_u32(&memq_lock->stripes[i].nreaders) != 0)
+				{
+					if (i < POOL_MEMQ_LOCK_AUX_STRIPES && delay > 0 &&
+						memq_lock_recover_aux_stripe(i, pool_atomic_read_u32(&memq_lock->stripes[i].owner)))
+						break;
+					memq_lock_delay(&spins, &delay);
+				}
+			}
+		}
+		else
+		{
+			volatile POOL_MEMQ_LOCK_STRIPE *stripe = memq_lock_stripe();
+
+			for (;;)
+			{
+				pool_atomic_fetch_add_u32(&stripe->nreaders, 1);
+				if (pool_atomic_read_u32(&memq_lock->writer) == 0)
+					break;
+
+				/* Someone holds or is waiting for exclusive lock. Back off. */
+				pool_atomic_fetch_sub_u32(&stripe->nreaders, 1);
+				while (pool_atomic_read_u32(&memq_lock->writer) != 0)
+					memq_lock_delay(&spins, &delay);
+			}
+		}
+
+#ifdef LOCK_TRACE
+		elog(LOG, "LOCK TRACE: acquire lock %s", type == POOL_MEMQ_EXCLUSIVE_LOCK? "LOCK_EX" : "LOCK_SH");
+#endif
+		pool_stage_leave(stage);
+		memq_lock_type = type;
+		is_shmem_locked = true;
+	}
+}
+
+/*
+ * Release lock
+ */
+void
+pool_shmem_unlock(void)
+{
+	if (pool_is_shmem_cache() && is_shmem_locked && memq_lock)
+	{
+		if (memq_lock_type == POOL_MEMQ_EXCLUSIVE_LOCK)
+			pool_atomic_write_u32(&memq_lock->writer, 0);
+		else
+			pool_atomic_fetch_sub_u32(&memq_lock_stripe()->nreaders, 1);
+#ifdef LOCK_TRACE
+		elog(LOG, "LOCK TRACE: unlock");
+#endif
+		is_shmem_locked = false;
+	}
+}
+
+/*
+ * Release the query cache lock held by a process which has gone away
+ * without releasing it, like flock() does for us when a process dies.
+ * child_id is the process table slot of the process if it was a child
+ * process, otherwise -1.  This should be called only from pgpool main
+ * process.
+ */
+void
+pool_shmem_lock_release_dead_process(int child_id, pid_t pid)
+{
+	uint32		expected;
+	int			i;
+
+	if (!memq_lock)
+		return;
+
+	if (child_id >= 0 && child_id < memq_lock->nstripes - POOL_MEMQ_LOCK_AUX_STRIPES)
+	{
+		volatile POOL_MEMQ_LOCK_STRIPE *stripe = &memq_lock->stripes[child_id + POOL_MEMQ_LOCK_AUX_STRIPES];
+
+		if (pool_atomic_read_u32(&stripe->nreaders) != 0)
+		{
+			ereport(LOG,
+					(errmsg("releasing query cache shared lock held by exited process %d", pid)));
+			pool_atomic_write_u32(&stripe->nreaders, 0);
+		}
+	}
+	else
+	{
+		for (i = 0; i < POOL_MEMQ_LOCK_AUX_STRIPES; i++)
+		{
+			if (pool_atomic_read_u32(&memq_lock->stripes[i].owner) == (uint32) pid)
+				memq_lock_recover_aux_stripe(i, pid);
+		}
+	}
+
+	expected = pid;
+	if (pool_atomic_compare_exchange_u32(&memq_lock->writer, &expected, 0))
+		ereport(LOG,
+				(errmsg("releasing query cache exclusive lock held by exited process %d", pid)));
+}
+
+/*
+ * Returns the lock stripe which this process uses for shared locks.
+ */
+static volatile POOL_MEMQ_LOCK_STRIPE *
+memq_lock_stripe(void)
+{
+	static int	aux_stripe = -1;
+	static pid_t aux_stripe_pid = 0;
+
+	if (processType == PT_CHILD && my_proc_id >= 0 &&
+		my_proc_id < memq_lock->nstripes - POOL_MEMQ_LOCK_AUX_STRIPES)
+		return &memq_lock->stripes[my_proc_id + POOL_MEMQ_LOCK_AUX_STRIPES];
+
+	/* the stripe is not inherited by forked processes */
+	if (aux_stripe < 0 || aux_stripe_pid != myProcPid)
+	{
+		aux_stripe = memq_lock_claim_aux_stripe();
+		aux_stripe_pid = myProcPid;
+	}
+	return &memq_lock->stripes[aux_stripe];
+}
+
+/*
+ * Take an auxiliary stripe for this process: a free one, or one whose owner
+ * has gone away.  Waits if all of them are in use.
+ */
+static int
+memq_lock_claim_aux_stripe(void)
+{
+	int			spins = 0;
+	int			delay = 0;
+	uint32		owner;
+	int			i;
+
+	for (;;)
+	{
+		for (i = 0; i < POOL_MEMQ_LOCK_AUX_STRIPES; i++)
+		{
+			owner = 0;
+			if (pool_atomic_compare_exchange_u32(&memq_lock->stripes[i].owner,
+												 &owner, myProcPid))
+				return i;
+		}
+
+		for (i = 0; i < POOL_MEMQ_LOCK_AUX_STRIPES; i++)
+		{
+			owner = pool_atomic_read_u32(&memq_lock->stripes[i].owner);
+			if (owner != 0 && kill((pid_t) owner, 0) != 0 && errno == ESRCH &&
+				pool_atomic_compare_exchange_u32(&memq_lock->stripes[i].owner,
+												 &owner, myProcPid))
+			{
+				if (pool_atomic_read_u32(&memq_lock->stripes[i].nreaders) != 0)
+				{
+					ereport(LOG,
+							(errmsg("releasing query cache shared lock held by exited process %d", owner)));
+					pool_atomic_write_u32(&memq_lock->stripes[i].nreaders, 0);
+				}
+				return i;
+			}
+		}
+
+		memq_lock_delay(&spins, &delay);
+	}
+}
+
+/*
+ * Release the auxiliary stripe i if its owner has gone away.  owner is the
+ * owner we saw.  Returns true if the stripe was released.
+ */
+static bool
+memq_lock_recover_aux_stripe(int i, uint32 owner)
+{
+	volatile POOL_MEMQ_LOCK_STRIPE *stripe = &memq_lock->stripes[i];
+
+	if (owner == 0 || owner == (uint32) myProcPid)
+		return false;
+
+	if (kill((pid_t) owner, 0) == 0 || errno != ESRCH)
+		return false;
+
+	if (!pool_atomic_compare_exchange_u32(&stripe->owner, &owner, myProcPid))
+		return false;
+
+	if (pool_atomic_read_u32(&stripe->nreaders) != 0)
+	{
+		ereport(LOG,
+				(errmsg("releasing query cache shared lock held by exited process %d", owner)));
+		pool_atomic_write_u32(&stripe->nreaders, 0);
+	}
+	pool_atomic_write_u32(&stripe->owner, 0);
+	return true;
+}
+
+/*
+ * Wait a while before retrying to acquire the lock.
+ */
+static void
+memq_lock_delay(int *spins, int *delay)
+{
+	if (*spins < MEMQ_LOCK_MAX_SPINS)
+	{
+		(*spins)++;
+		pool_spin_delay();
+		return;
+	}
+
+	if (*delay == 0)
+		*delay = MEMQ_LOCK_MIN_DELAY_USEC;
+
+	usleep(*delay);
+
+	*delay *= 2;
+	if (*delay > MEMQ_LOCK_MAX_DELAY_USEC)
+		*delay = MEMQ_LOCK_MAX_DELAY_USEC;
+}
+
+/*
+ * check lock
+ */
+bool
+pool_is_shmem_lock(void)
+{
+	return is_shmem_locked;
+}
+
+/*
+ * Returns cache block address specified by block id
+ */
+static char *
+block_address(int blockid)
+{
+	char	   *p;
+
+	p = pool_memory_cache_address() +
+		(uint64)blockid * pool_config->memqcache_cache_block_size;
+	return p;
+}
+
+/*
+ * Returns i th item pointer in block address block
+ */
+static POOL_CACHE_ITEM_POINTER * item_pointer(char *block, int i)
+{
+	return (POOL_CACHE_ITEM_POINTER *) (block + sizeof(POOL_CACHE_BLOCK_HEADER) +
+										sizeof(POOL_CACHE_ITEM_POINTER) * i);
+}
+
+/*
+ * Returns i th item header in block address block
+ */
+static POOL_CACHE_ITEM_HEADER * item_header(char *block, int i)
+{
+	POOL_CACHE_ITEM_POINTER *cip;
+
+	cip = item_pointer(block, i);
+	return (POOL_CACHE_ITEM_HEADER *) (block + cip->offset);
+}
+
+#ifdef SHMEMCACHE_DEBUG
+/*
+ * Dump shmem cache block
+ */
+static void
+dump_shmem_cache(POOL_CACHE_BLOCKID blockid)
+{
+	POOL_CACHE_BLOCK_HEADER *bh;
+	POOL_CACHE_ITEM_POINTER *cip;
+	POOL_CACHE_ITEM_HEADER *cih;
+	int			i;
+
+	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(blockid);
+	fprintf(stderr, "shmem: block header(%lu bytes): flags:%x num_items:%d free_bytes:%d\n",
+			sizeof(*bh), bh->flags, bh->num_items, bh->free_bytes);
+	for (i = 0; i < bh->num_items; i++)
+	{
+		cip = item_pointer((char *) bh, i);
+		fprintf(stderr, "shmem: block: %d %d th item pointer(%lu bytes): offset:%d flags:%x\n",
+				blockid, i, sizeof(*cip), cip->offset, cip->flags);
+		if (cip->flags & POOL_ITEM_PACKED)
+			continue;
+		cih = item_header((char *) bh, i);
+		fprintf(stderr, "shmem: block: %d %d th item header(%lu bytes): timestamp:%ld length:%d\n",
+				blockid, i, sizeof(*cih), cih->timestamp, cih->total_length);
+	}
+}
+#endif
+
+/*
+ * SELECT query result array modules
+ */
+POOL_QUERY_CACHE_ARRAY *
+pool_create_query_cache_array(void)
+{
+#define POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM 128
+#define POOL_QUERY_CACHE_ARRAY_HEADER_SIZE (sizeof(int)+sizeof(int))
+
+	size_t		size;
+	POOL_QUERY_CACHE_ARRAY *p;
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
+
+	size = POOL_QUERY_CACHE_ARRAY_HEADER_SIZE + POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM *
+		sizeof(POOL_TEMP_QUERY_CACHE *);
+	p = palloc(size);
+	p->num_caches = 0;
+	p->array_size = POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM;
+	MemoryContextSwitchTo(old_context);
+	return p;
+}
+
+/*
+ * Discard query cache array
+ */
+void
+pool_discard_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array)
+{
+	int			i;
+
+	if (!cache_array)
+		return;
+
+	ereport(DEBUG1,
+			(errmsg("memcache discarding query cache array"),
+			 errdetail("num_caches: %d", cache_array->num_caches)));
+
+	for (i = 0; i < cache_array->num_caches; i++)
+	{
+		ereport(DEBUG2,
+				(errmsg("memcache discarding query cache array"),
+				 errdetail("cache no: %d cache: %p", i, cache_array->caches[i])));
+		pool_discard_temp_query_cache(cache_array->caches[i]);
+	}
+	pfree(cache_array);
+}
+
+/*
+ * Add query cache array
+ */
+static POOL_QUERY_CACHE_ARRAY * pool_add_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array, POOL_TEMP_QUERY_CACHE * cache)
+{
+	size_t		size;
+	POOL_QUERY_CACHE_ARRAY *cp = cache_array;
+
+	if (!cache_array)
+		return cp;
+
+	ereport(DEBUG2,
+			(errmsg("memcache adding query cache array"),
+			 errdetail("num_caches: %d cache: %p", cache_array->num_caches, cache)));
+	if (cache_array->num_caches >= cache_array->array_size)
+	{
+		cache_array->array_size += POOL_QUERY_CACHE_ARRAY_ALLOCATE_NUM;
+		size = POOL_QUERY_CACHE_ARRAY_HEADER_SIZE + cache_array->array_size *
+			sizeof(POOL_TEMP_QUERY_CACHE *);
+		cache_array = repalloc(cache_array, size);
+	}
+	cache_array->caches[cache_array->num_caches++] = cache;
+	return cache_array;
+}
+
+/*
+ * SELECT query result temporary cache modules
+ */
+
+/*
+ * Create SELECT result temporary cache
+ */
+POOL_TEMP_QUERY_CACHE *
+pool_create_temp_query_cache(char *query)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
+	POOL_TEMP_QUERY_CACHE *p;
+
+	p = palloc(sizeof(*p));
+	p->query = pstrdup(query);
+	p->expire = pool_config->memqcache_expire;
+
+	p->buffer = pool_create_buffer();
+	p->oids = pool_create_buffer();
+	p->num_oids = 0;
+	p->is_exceeded = false;
+	p->is_discarded = false;
+
+	MemoryContextSwitchTo(old_context);
+
+	ereport(DEBUG1,
+			(errmsg("pool_create_temp_query_cache: cache created: %p", p)));
+
+	return p;
+}
+
+/*
+ * Discard temp query cache
+ */
+void
+pool_discard_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache)
+{
+	if (!temp_cache)
+		return;
+
+	if (temp_cache->query)
+		pfree(temp_cache->query);
+	if (temp_cache->buffer)
+		pool_discard_buffer(temp_cache->buffer);
+	if (temp_cache->oids)
+		pool_discard_buffer(temp_cache->oids);
+
+	ereport(DEBUG1,
+			(errmsg("pool_discard_temp_query_cache: cache discarded: %p", temp_cache)));
+
+	pfree(temp_cache);
+}
+
+/*
+ * Discard temp query cache in the current query context
+ */
+void
+pool_discard_current_temp_query_cache(void)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_QUERY_CONTEXT *query_context;
+	POOL_TEMP_QUERY_CACHE * temp_cache;
+
+	session_context = pool_get_session_context(true);
+	query_context = session_context->query_context;
+	if (query_context)
+	{
+		temp_cache = query_context->temp_cache;
+		if (temp_cache)
+		{
+			pool_discard_temp_query_cache(temp_cache);
+			query_context->temp_cache = NULL;
+		}
+	}
+}
+
+/*
+ * Add data to temp query cache.
+ * Data must be FE/BE protocol packet.
+ */
+static void
+pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *data, int data_len)
+{
+	int			send_len;
+
+	/*
+	 * We only store T(Table Description), D(Data row), C(Command Complete),
+	 * 1(ParseComplete), 2(BindComplete)
+	 */
+	if (kind != 'T' && kind != 'D' && kind != 'C' && kind != '1' && kind != '2')
+	{
+		return;
+	}
+
+	if (!pool_reserve_temp_query_cache(temp_cache, data_len + sizeof(int) + 1))
+		return;
+
+	pool_add_buffer(temp_cache->buffer, &kind, 1);
+	send_len = htonl(data_len + sizeof(int));
+	pool_add_buffer(temp_cache->buffer, (char *) &send_len, sizeof(int));
+	pool_add_buffer(temp_cache->buffer, data, data_len);
+
+	return;
+}
+
+/*
+ * Check that len more bytes can be added to temp query cache.  If they
+ * would make it exceed memqcache_maxcache, mark it exceeded and release
+ * what it holds.
+ */
+static bool
+pool_reserve_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, size_t len)
+{
+	POOL_INTERNAL_BUFFER *buffer;
+	size_t		buflen;
+
+	if (temp_cache == NULL)
+	{
+		/*
+		 * This could happen if cache exceeded in previous query execution in
+		 * the same unnamed portal.
+		 */
+		ereport(DEBUG1,
+				(errmsg("memcache adding temporary query cache"),
+				 errdetail("POOL_TEMP_QUERY_CACHE is NULL")));
+		return false;
+	}
+
+	if (temp_cache->is_exceeded)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache adding temporary query cache"),
+				 errdetail("memqcache_maxcache exceeds")));
+		return false;
+	}
+
+	/* Check data limit */
+	buffer = temp_cache->buffer;
+	buflen = pool_get_buffer_length(buffer);
+
+	if ((buflen + len) > pool_config->memqcache_maxcache)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache adding temporary query cache"),
+				 errdetail("data size exceeds memqcache_maxcache. current:%zd requested:%zd memq_maxcache:%d",
+						   buflen, len, pool_config->memqcache_maxcache)));
+		temp_cache->is_exceeded = true;
+
+		/*
+		 * The data will never be cached.  Release the memory now rather
+		 * than keeping it until the end of the query.
+		 */
+		pool_reset_buffer(buffer);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Add table oids used by SELECT to temp query cache.
+ */
+static void
+pool_add_oids_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, int num_oids, int *oids)
+{
+	POOL_INTERNAL_BUFFER *buffer;
+
+	if (!temp_cache || num_oids <= 0)
+		return;
+
+	buffer = temp_cache->oids;
+	pool_add_buffer(buffer, oids, num_oids * sizeof(int));
+	temp_cache->num_oids = num_oids;
+}
+
+/*
+ * Internal buffer management modules.
+ * Usage:
+ * 1) Create buffer using pool_create_buffer().
+ * 2) Add data to buffer using pool_add_buffer().
+ * 3) Extract (copied) data from buffer using pool_get_buffer(), or
+ *	  take the data out of the buffer without copying using
+ *	  pool_take_buffer().
+ * 4) Optionally you can:
+ *		Obtain buffer length by using pool_get_buffer_length().
+ *		Obtain buffer pointer by using pool_get_buffer_pointer().
+ * 5) Discard buffer using pool_discard_buffer().
+ */
+
+/*
+ * Create and return internal buffer
+ */
+static POOL_INTERNAL_BUFFER * pool_create_buffer(void)
+{
+	POOL_INTERNAL_BUFFER *p;
+
+	p = palloc0(sizeof(*p));
+	return p;
+}
+
+/*
+ * Discard internal buffer
+ */
+static void
+pool_discard_buffer(POOL_INTERNAL_BUFFER * buffer)
+{
+	if (buffer)
+	{
+		if (buffer->buf)
+			pfree(buffer->buf);
+		pfree(buffer);
+	}
+}
+
+/*
+ * Add data to internal buffer
+ */
+static void
+pool_add_buffer(POOL_INTERNAL_BUFFER * buffer, void *data, size_t len)
+{
+#define POOL_ALLOCATE_UNIT 8192
+
+	/* Sanity check */
+	if (!buffer || !data || len == 0)
+		return;
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
+
+	/*
+	 * Check if we need to increase the buffer size.  The buffer is doubled
+	 * so that growing it to large SELECT results does not copy the data
+	 * over and over again.  Since data for query cache never exceeds
+	 * memqcache_maxcache, we do not allocate more than that unless
+	 * requested.
+	 */
+	if ((buffer->buflen + len) > buffer->bufsize)
+	{
+		size_t		allocate_size = buffer->bufsize * 2;
+
+		if (allocate_size > pool_config->memqcache_maxcache)
+			allocate_size = pool_config->memqcache_maxcache;
+		if (allocate_size < buffer->buflen + len)
+			allocate_size = ((buffer->buflen + len) / POOL_ALLOCATE_UNIT + 1) * POOL_ALLOCATE_UNIT;
+
+		ereport(DEBUG2,
+				(errmsg("memcache adding data to internal buffer"),
+				 errdetail("realloc old size:%zd new size:%zd",
+						   buffer->bufsize, allocate_size)));
+		buffer->bufsize = allocate_size;
+		buffer->buf = (char *) repalloc(buffer->buf, buffer->bufsize);
+	}
+	/* Add data to buffer */
+	memcpy(buffer->buf + buffer->buflen, data, len);
+	buffer->buflen += len;
+	ereport(DEBUG2,
+			(errmsg("memcache adding data to internal buffer"),
+			 errdetail("len:%zd, total:%zd bufsize:%zd",
+					   len, buffer->buflen, buffer->bufsize)));
+	MemoryContextSwitchTo(old_context);
+	return;
+}
+
+/*
+ * Get data from internal buffer.
+ * Data is stored in newly malloc memory.
+ * Data length is returned to len.
+ */
+static void *
+pool_get_buffer(POOL_INTERNAL_BUFFER * buffer, size_t *len)
+{
+	void	   *p;
+
+	if (buffer->bufsize == 0 || buffer->buflen == 0 ||
+		buffer->buf == NULL)
+	{
+		*len = 0;
+		return NULL;
+	}
+
+	p = palloc(buffer->buflen);
+	memcpy(p, buffer->buf, buffer->buflen);
+	*len = buffer->buflen;
+	return p;
+}
+
+/*
+ * Take data out of internal buffer without copying.  The buffer becomes
+ * empty and the caller is responsible for pfree'ing the data.
+ * Data length is returned to len.
+ */
+static void *
+pool_take_buffer(POOL_INTERNAL_BUFFER * buffer, size_t *len)
+{
+	void	   *p;
+
+	if (buffer->bufsize == 0 || buffer->buflen == 0 ||
+		buffer->buf == NULL)
+	{
+		*len = 0;
+		return NULL;
+	}
+
+	p = buffer->buf;
+	*len = buffer->buflen;
+	buffer->buf = NULL;
+	buffer->buflen = 0;
+	buffer->bufsize = 0;
+	return p;
+}
+
+/*
+ * Discard data in internal buffer.
+ */
+static void
+pool_reset_buffer(POOL_INTERNAL_BUFFER * buffer)
+{
+	if (buffer->buf)
+		pfree(buffer->buf);
+	buffer->buf = NULL;
+	buffer->buflen = 0;
+	buffer->bufsize = 0;
+}
+
+/*
+ * Get internal buffer length.
+ */
+static size_t
+pool_get_buffer_length(POOL_INTERNAL_BUFFER * buffer)
+{
+	if (buffer == NULL)
+		return 0;
+
+	return buffer->buflen;
+}
+
+#ifdef NOT_USED
+/*
+ * Get internal buffer pointer.
+ */
+static char *
+pool_get_buffer_pointer(POOL_INTERNAL_BUFFER * buffer)
+{
+	if (buffer == NULL)
+		return NULL;
+	return buffer->buf;
+}
+#endif
+/*
+ * Get query cache buffer struct of current query context
+ */
+POOL_TEMP_QUERY_CACHE *
+pool_get_current_cache(void)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_QUERY_CONTEXT *query_context;
+	POOL_TEMP_QUERY_CACHE *p = NULL;
+
+	session_context = pool_get_session_context(true);
+	if (session_context)
+	{
+		query_context = session_context->query_context;
+		if (query_context)
+		{
+			p = query_context->temp_cache;
+		}
+	}
+	return p;
+}
+
+/*
+ * Take query cache buffer out of current query context.  The buffer in the
+ * query context becomes empty.
+ */
+static char *
+pool_get_current_cache_buffer(size_t *len)
+{
+	char	   *p = NULL;
+
+	*len = 0;
+	POOL_TEMP_QUERY_CACHE *cache;
+
+	cache = pool_get_current_cache();
+	if (cache)
+	{
+		p = pool_take_buffer(cache->buffer, len);
+	}
+	return p;
+}
+
+/*
+ * Mark this temporary query cache buffer discarded if the SELECT
+ * uses the table oid specified by oids.
+ */
+static void
+pool_check_and_discard_cache_buffer(int num_oids, int *oids)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_TEMP_QUERY_CACHE *cache;
+	int			num_caches;
+	size_t		len;
+	int		   *soids;
+	int			i,
+				j,
+				k;
+
+	session_context = pool_get_session_context(true);
+
+	if (!session_context || !session_context->query_cache_array)
+		return;
+
+	num_caches = session_context->query_cache_array->num_caches;
+
+	for (i = 0; i < num_caches; i++)
+	{
+		cache = session_context->query_cache_array->caches[i];
+		if (!cache || cache->is_discarded)
+			continue;
+
+		soids = (int *) pool_get_buffer(cache->oids, &len);
+		if (!soids || !len)
+			continue;
+
+		for (j = 0; j < cache->num_oids; j++)
+		{
+			if (cache->is_discarded)
+				break;
+
+			for (k = 0; k < num_oids; k++)
+			{
+				if (soids[j] == oids[k])
+				{
+					ereport(DEBUG1,
+							(errmsg("discard cache for \"%s\"", cache->query)));
+					cache->is_discarded = true;
+					break;
+				}
+			}
+		}
+		pfree(soids);
+	}
+}
+
+/*
+ * Return the life time of the cache entry of a SELECT using the tables in
+ * ctx: the shortest "table:ttl" of cache_safe_memqcache_table_list matching
+ * the tables, or memqcache_expire.
+ */
+static int
+pool_cache_expire(SelectContext * ctx, int num_oids)
+{
+	int			expire = pool_config->memqcache_expire;
+	int			i;
+
+	for (i = 0; i < num_oids; i++)
+	{
+		int			ttl = memqcache_table_ttl(ctx->table_names[i]);
+
+		if (ttl > 0 && (expire == 0 || ttl < expire))
+			expire = ttl;
+	}
+	return expire;
+}
+
+/*
+ * At Ready for Query or Command Complete handle query cache.  For streaming
+ * replication mode and extended query at Command Complete handle query cache.
+ * For other case At Ready for Query handle query cache.
+ */
+void
+pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node, char state)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	pool_sigset_t oldmask;
+	char	   *cache_buffer;
+	size_t		len;
+	int			num_oids = 0;
+	int		   *oids = NULL;
+	int			i;
+
+	session_context = pool_get_session_context(true);
+
+	/* Ok to cache SELECT result? */
+	if (pool_is_cache_safe())
+	{
+		SelectContext ctx;
+		MemoryContext old_context;
+
+		old_context = MemoryContextSwitchTo(session_context->memory_context);
+		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
+		MemoryContextSwitchTo(old_context);
+		oids = ctx.table_oids;
+		ereport(DEBUG2,
+				(errmsg("query cache handler for ReadyForQuery"),
+				 errdetail("num_oids: %d oid: %d", num_oids, *oids)));
+
+		if (state == 'I')		/* Not inside a transaction? */
+		{
+			/*
+			 * Make sure that temporary cache is not exceeded.
+			 */
+			if (!pool_is_cache_exceeded())
+			{
+				POOL_TEMP_QUERY_CACHE *cache;
+
+				/*
+				 * If we are not inside a transaction, we can immediately
+				 * register to cache storage.
+				 */
+				/* Register to memcached or shmem */
+				POOL_SETMASK2(&BlockSig, &oldmask);
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+				cache_buffer = pool_get_current_cache_buffer(&len);
+				if (cache_buffer)
+				{
+					if (session_context->query_context->skip_cache_commit == false)
+					{
+						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids,
+											  pool_cache_expire(&ctx, num_oids)) != 0)
+						{
+							ereport(WARNING,
+									(errmsg("ReadyForQuery: pool_commit_cache failed")));
+						}
+					}
+
+					/*
+					 * Reset temporary query cache buffer. This is necessary
+					 * if extended query protocol is used and a bind/execute
+					 * message arrives which uses a statement created by prior
+					 * parse message. In this case since the temp_cache is not
+					 * initialized by a parse message, messages are added to
+					 * pre existing temp cache buffer. The problem was found
+					 * in bug#152.
+					 * http://www.pgpool.net/mantisbt/view.php?id=152
+					 */
+					cache = pool_get_current_cache();
+					ereport(DEBUG1,
+							(errmsg("pool_handle_query_cache: temp_cache: %p", cache)));
+					pool_discard_temp_query_cache(cache);
+
+					if (SL_MODE && pool_is_doing_extended_query_message())
+						session_context->query_context->temp_cache = NULL;
+					else
+						session_context->query_context->temp_cache = pool_create_temp_query_cache(query);
+					pfree(cache_buffer);
+				}
+				pool_shmem_unlock();
+				POOL_SETMASK(&oldmask);
+			}
+
+			/* Count up SELECT stats */
+			pool_stats_count_up_num_selects(1);
+
+			/* Reset temp buffer */
+			pool_reset_memqcache_buffer(true);
+		}
+		else
+		{
+			POOL_TEMP_QUERY_CACHE *cache = pool_get_current_cache();
+
+			/* In transaction. Keep to temp query cache array */
+			pool_add_oids_temp_query_cache(cache, num_oids, oids);
+			if (cache)
+				cache->expire = pool_cache_expire(&ctx, num_oids);
+
+			/*
+			 * If temp cache has been overflowed, just trash the half baked
+			 * temp cache.
+			 */
+			if (pool_is_cache_exceeded())
+			{
+				pool_discard_current_temp_query_cache();
+			}
+
+			/*
+			 * Otherwise add to the temp cache array.
+			 */
+			else
+			{
+				session_context->query_cache_array =
+					pool_add_query_cache_array(session_context->query_cache_array, cache);
+
+				/*
+				 * Reset temp_cache pointer in the current query context so
+				 * that we don't add the same temp cache to the cache array.
+				 * This is necessary such that case when next query is just a
+				 * "bind message", without "parse message". In the case the
+				 * query context is reused and same cache pointer will be
+				 * added to the query_cache_array which we do not want.
+				 */
+				session_context->query_context->temp_cache = NULL;
+			}
+
+			/* Count up temporary SELECT stats */
+			pool_tmp_stats_count_up_num_selects();
+		}
+	}
+	else if (is_rollback_query(node))	/* Rollback? */
+	{
+		/* Discard buffered data */
+		pool_reset_memqcache_buffer(true);
+	}
+	else if (is_commit_query(node)) /* Commit? */
+	{
+		int			num_caches;
+		bool		queued = false;
+
+		if (pool_config->memqcache_auto_cache_invalidation)
+		{
+			num_oids = pool_get_dml_table_oid(&oids);
+			queued = pool_queue_query_cache_invalidation(num_oids, oids);
+		}
+
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+		/* Invalidate query cache */
+		if (pool_config->memqcache_auto_cache_invalidation && !queued)
+			pool_invalidate_query_cache(num_oids, oids, true, 0);
+
+		/*--------------------------------------------------------------------
+		 * If we have something in the query cache buffer, that means either:
+		 * - We only had SELECTs in the transaction
+		 * - We had only SELECTs after the last DML
+		 * Thus we can register SELECT results to cache storage.
+		 *--------------------------------------------------------------------
+		 */
+		num_caches = session_context->query_cache_array->num_caches;
+		for (i = 0; i < num_caches; i++)
+		{
+			POOL_TEMP_QUERY_CACHE *cache;
+
+			cache = session_context->query_cache_array->caches[i];
+			if (!cache || cache->is_discarded)
+				continue;
+
+			num_oids = cache->num_oids;
+			oids = pool_get_buffer(cache->oids, &len);
+			cache_buffer = pool_take_buffer(cache->buffer, &len);
+
+			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids,
+								  cache->expire) != 0)
+			{
+				ereport(WARNING,
+						(errmsg("ReadyForQuery: pool_commit_cache failed")));
+			}
+			if (oids)
+				pfree(oids);
+			if (cache_buffer)
+				pfree(cache_buffer);
+		}
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+
+		/* Count up number of SELECT stats */
+		pool_stats_count_up_num_selects(pool_tmp_stats_get_num_selects());
+
+		pool_reset_memqcache_buffer(true);
+	}
+	else						/* Non cache safe queries */
+	{
+		/* Non cacheable SELECT */
+		if (node && IsA(node, SelectStmt))
+		{
+			/* Extract table oids from buffer */
+			num_oids = pool_get_dml_table_oid(&oids);
+
+			if (state == 'I')
+			{
+				/*
+				 * If Data-modifying statements in SELECT's WITH clause,
+				 * invalidate query cache.
+				 */
+				if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation &&
+					!pool_queue_query_cache_invalidation(num_oids, oids))
+				{
+					POOL_SETMASK2(&BlockSig, &oldmask);
+					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+					pool_invalidate_query_cache(num_oids, oids, true, 0);
+					pool_shmem_unlock();
+					POOL_SETMASK(&oldmask);
+				}
+
+				/* Count up SELECT stats */
+				pool_stats_count_up_num_selects(1);
+				pool_reset_memqcache_buffer(true);
+			}
+			else
+			{
+				/*
+				 * If we are inside a transaction, we cannot invalidate
+				 * query cache yet. However we can clear cache buffer, if
+				 * DML/DDL modifies the TABLE which SELECT uses.
+				 */
+				if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
+				{
+					pool_check_and_discard_cache_buffer(num_oids, oids);
+					pool_reset_memqcache_buffer(false);
+				}
+
+				/* Count up temporary SELECT stats */
+				pool_tmp_stats_count_up_num_selects();
+			}
+		}
+
+		/*
+		 * If the query is DROP DATABASE, discard both of caches in
+		 * shmem/memcached and oidmap in memqcache_oiddir.
+		 */
+		else if (is_drop_database(node) && session_context->query_context->dboid != 0)
+		{
+			int			dboid = session_context->query_context->dboid;
+
+			if (pool_is_shmem_cache())
+			{
+				if (pool_config->memqcache_auto_cache_invalidation)
+				{
+					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+					pool_discard_oid_maps_by_db(dboid);
+					pool_shmem_unlock();
+					pool_reset_memqcache_buffer(true);
+
+					ereport(DEBUG2,
+							(errmsg("query cache handler for ReadyForQuery"),
+							 errdetail("deleted all caches for the DROPped DB")));
+				}
+				num_oids = 0;
+			}
+			else if (pool_cache_storage()->delete_by_tag)
+			{
+				if (pool_config->memqcache_auto_cache_invalidation)
+				{
+					pool_cache_storage()->delete_by_tag(dboid, -1, NULL);
+					pool_reset_memqcache_buffer(true);
+				}
+				num_oids = 0;
+			}
+			else
+				num_oids = pool_get_dropdb_table_oids(&oids, dboid);
+
+			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
+			{
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+				pool_invalidate_query_cache(num_oids, oids, true, dboid);
+				pool_discard_oid_maps_by_db(dboid);
+				pool_shmem_unlock();
+				pool_reset_memqcache_buffer(true);
+
+				pfree(oids);
+				ereport(DEBUG2,
+						(errmsg("query cache handler for ReadyForQuery"),
+						 errdetail("deleted all cache files for the DROPped DB")));
+			}
+		}
+		else
+		{
+			/*
+			 * DML/DCL/DDL case
+			 */
+
+			/* Extract table oids from buffer */
+			num_oids = pool_get_dml_table_oid(&oids);
+			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
+			{
+				/*
+				 * If we are not inside a transaction, we can immediately
+				 * invalidate query cache.
+				 */
+				if (state == 'I')
+				{
+					if (!pool_queue_query_cache_invalidation(num_oids, oids))
+					{
+						POOL_SETMASK2(&BlockSig, &oldmask);
+						pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+						pool_invalidate_query_cache(num_oids, oids, true, 0);
+						pool_shmem_unlock();
+						POOL_SETMASK(&oldmask);
+					}
+					pool_reset_memqcache_buffer(true);
+				}
+				else
+				{
+					/*
+					 * If we are inside a transaction, we cannot invalidate
+					 * query cache yet. However we can clear cache buffer, if
+					 * DML/DDL modifies the TABLE which SELECT uses.
+					 */
+					pool_check_and_discard_cache_buffer(num_oids, oids);
+					pool_reset_memqcache_buffer(false);
+				}
+			}
+			else if (num_oids == 0)
+			{
+				/*
+				 * It is also necessary to clear cache buffers in case of no
+				 * oid queries (like BEGIN, CHECKPOINT, VACUUM, etc) too.
+				 */
+				pool_reset_memqcache_buffer(true);
+			}
+		}
+	}
+}
+
+/*
+ * Create and initialize query cache stats
+ */
+static POOL_QUERY_CACHE_STATS * stats;
+static POOL_CACHE_PARTITION_TABLE * cache_partitions;
 
-	ereport(DEBUG1,
-			(errmsg("pool_discard_temp_query_cache: cache discarded: %p", temp_cache)));
+int
+pool_init_memqcache_stats(void)
+{
+	stats = pool_shared_memory_segment_get_chunk(sizeof(POOL_QUERY_CACHE_STATS));
+	pool_reset_memqcache_stats();
 
-	pfree(temp_cache);
+	cache_partitions = pool_shared_memory_segment_get_chunk(sizeof(POOL_CACHE_PARTITION_TABLE));
+	memset(cache_partitions, 0, sizeof(POOL_CACHE_PARTITION_TABLE));
+	return 0;
 }
 
 /*
- * Discard temp query cache in the current query context
+ * Return byte size of the query cache stats area.
  */
-void
-pool_discard_current_temp_query_cache(void)
+size_t
+pool_memqcache_stats_size(void)
 {
-	POOL_SESSION_CONTEXT *session_context;
-	POOL_QUERY_CONTEXT *query_context;
-	POOL_TEMP_QUERY_CACHE * temp_cache;
-
-	session_context = pool_get_session_context(true);
-	query_context = session_context->query_context;
-	if (query_context)
-	{
-		temp_cache = query_context->temp_cache;
-		if (temp_cache)
-		{
-			pool_discard_temp_query_cache(temp_cache);
-			query_context->temp_cache = NULL;
-		}
-	}
+	return MAXALIGN(sizeof(POOL_QUERY_CACHE_STATS)) + MAXALIGN(sizeof(POOL_CACHE_PARTITION_TABLE));
 }
 
 /*
- * Add data to temp query cache.
- * Data must be FE/BE protocol packet.
+ * Returns copy of stats area. The copy is in static area and will be
+ * overwritten by next call to this function.
  */
-static void
-pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *data, int data_len)
+POOL_QUERY_CACHE_STATS *
+pool_get_memqcache_stats(void)
 {
-	POOL_INTERNAL_BUFFER *buffer;
-	size_t		buflen;
-	int			send_len;
-
-	if (temp_cache == NULL)
-	{
-		/*
-		 * This could happen if cache exceeded in previous query execution in
-		 * the same unnamed portal.
-		 */
-		ereport(DEBUG1,
-				(errmsg("memcache adding temporary query cache"),
-				 errdetail("POOL_TEMP_QUERY_CACHE is NULL")));
-		return;
-	}
+	static POOL_QUERY_CACHE_STATS mystats;
+	pool_sigset_t oldmask;
 
-	if (temp_cache->is_exceeded)
-	{
-		ereport(DEBUG1,
-				(errmsg("memcache adding temporary query cache"),
-				 errdetail("memqcache_maxcache exceeds")));
-		return;
-	}
+	memset(&mystats, 0, sizeof(POOL_QUERY_CACHE_STATS));
 
-	/*
-	 * We only store T(Table Description), D(Data row), C(Command Complete),
-	 * 1(ParseComplete), 2(BindComplete)
-	 */
-	if (kind != 'T' && kind != 'D' && kind != 'C' && kind != '1' && kind != '2')
+	if (stats)
 	{
-		return;
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+		memcpy(&mystats, stats, sizeof(POOL_QUERY_CACHE_STATS));
+		pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+		POOL_SETMASK(&oldmask);
 	}
 
-	/* Check data limit */
-	buffer = temp_cache->buffer;
-	buflen = pool_get_buffer_length(buffer);
+	return &mystats;
+}
 
-	if ((buflen + data_len + sizeof(int) + 1) > pool_config->memqcache_maxcache)
-	{
-		ereport(DEBUG1,
-				(errmsg("memcache adding temporary query cache"),
-				 errdetail("data size exceeds memqcache_maxcache. current:%zd requested:%zd memq_maxcache:%d",
-						   buflen, data_len + sizeof(int) + 1, pool_config->memqcache_maxcache)));
-		temp_cache->is_exceeded = true;
-		return;
-	}
+/*
+ * Reset query cache stats. Caller must lock QUERY_CACHE_STATS_SEM if
+ * necessary.
+ */
+void
+pool_reset_memqcache_stats(void)
+{
+	memset(stats, 0, sizeof(POOL_QUERY_CACHE_STATS));
+	stats->start_time = time(NULL);
+}
 
-	pool_add_buffer(buffer, &kind, 1);
-	send_len = htonl(data_len + sizeof(int));
-	pool_add_buffer(buffer, (char *) &send_len, sizeof(int));
-	pool_add_buffer(buffer, data, data_len);
+/*
+ * Count up number of successful SELECTs and returns the number.
+ * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ */
+long long int
+pool_stats_count_up_num_selects(long long int num)
+{
+	pool_sigset_t oldmask;
+	POOL_CACHE_PARTITION *part;
 
-	return;
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+	stats->num_selects += num;
+	part = pool_session_cache_partition();
+	if (part)
+		part->num_selects += num;
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+	return stats->num_selects;
 }
 
 /*
- * Add table oids used by SELECT to temp query cache.
+ * Count up number of successful SELECTs in temporary area and returns
+ * the number.
  */
-static void
-pool_add_oids_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, int num_oids, int *oids)
+long long int
+pool_tmp_stats_count_up_num_selects(void)
 {
-	POOL_INTERNAL_BUFFER *buffer;
-
-	if (!temp_cache || num_oids <= 0)
-		return;
+	POOL_SESSION_CONTEXT *session_context;
 
-	buffer = temp_cache->oids;
-	pool_add_buffer(buffer, oids, num_oids * sizeof(int));
-	temp_cache->num_oids = num_oids;
+	session_context = pool_get_session_context(false);
+	session_context->num_selects++;
+	return session_context->num_selects;
 }
 
 /*
- * Internal buffer management modules.
- * Usage:
- * 1) Create buffer using pool_create_buffer().
- * 2) Add data to buffer using pool_add_buffer().
- * 3) Extract (copied) data from buffer using pool_get_buffer().
- * 4) Optionally you can:
- *		Obtain buffer length by using pool_get_buffer_length().
- *		Obtain buffer pointer by using pool_get_buffer_pointer().
- * 5) Discard buffer using pool_discard_buffer().
+ * Return number of successful SELECTs in temporary area.
  */
+long long int
+pool_tmp_stats_get_num_selects(void)
+{
+	POOL_SESSION_CONTEXT *session_context;
+
+	session_context = pool_get_session_context(false);
+	return session_context->num_selects;
+}
 
 /*
- * Create and return internal buffer
+ * Reset number of successful SELECTs in temporary area.
  */
-static POOL_INTERNAL_BUFFER * pool_create_buffer(void)
+void
+pool_tmp_stats_reset_num_selects(void)
 {
-	POOL_INTERNAL_BUFFER *p;
+	POOL_SESSION_CONTEXT *session_context;
 
-	p = palloc0(sizeof(*p));
-	return p;
+	session_context = pool_get_session_context(false);
+	session_context->num_selects = 0;
 }
 
 /*
- * Discard internal buffer
+ * Count up number of SELECTs extracted from cache returns the number.
+ * QUERY_CACHE_STATS_SEM lock is acquired in this function.
  */
-static void
-pool_discard_buffer(POOL_INTERNAL_BUFFER * buffer)
+long long int
+pool_stats_count_up_num_cache_hits(void)
 {
-	if (buffer)
-	{
-		if (buffer->buf)
-			pfree(buffer->buf);
-		pfree(buffer);
-	}
+	pool_sigset_t oldmask;
+	POOL_CACHE_PARTITION *part;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+	stats->num_cache_hits++;
+	part = pool_session_cache_partition();
+	if (part)
+		part->num_cache_hits++;
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+	return stats->num_cache_hits;
 }
 
 /*
- * Add data to internal buffer
+ * Count up number of cache entries evicted to make room for new ones.
+ * QUERY_CACHE_STATS_SEM lock is acquired in this function.
  */
 static void
-pool_add_buffer(POOL_INTERNAL_BUFFER * buffer, void *data, size_t len)
+pool_stats_count_up_num_evicted_entries(int num)
 {
-#define POOL_ALLOCATE_UNIT 8192
+	pool_sigset_t oldmask;
 
-	/* Sanity check */
-	if (!buffer || !data || len == 0)
+	if (num <= 0)
 		return;
-	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
-	MemoryContext old_context = MemoryContextSwitchTo(session_context->memory_context);
-
-	/* Check if we need to increase the buffer size */
-	if ((buffer->buflen + len) > buffer->bufsize)
-	{
-		size_t		allocate_size = ((buffer->buflen + len) / POOL_ALLOCATE_UNIT + 1) * POOL_ALLOCATE_UNIT;
 
-		ereport(DEBUG2,
-				(errmsg("memcache adding data to internal buffer"),
-				 errdetail("realloc old size:%zd new size:%zd",
-						   buffer->bufsize, allocate_size)));
-		buffer->bufsize = allocate_size;
-		buffer->buf = (char *) repalloc(buffer->buf, buffer->bufsize);
-	}
-	/* Add data to buffer */
-	memcpy(buffer->buf + buffer->buflen, data, len);
-	buffer->buflen += len;
-	ereport(DEBUG2,
-			(errmsg("memcache adding data to internal buffer"),
-			 errdetail("len:%zd, total:%zd bufsize:%zd",
-					   len, buffer->buflen, buffer->bufsize)));
-	MemoryContextSwitchTo(old_context);
-	return;
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+	stats->num_evicted_entries += num;
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
 }
 
 /*
- * Get data from internal buffer.
- * Data is stored in newly malloc memory.
- * Data length is returned to len.
+ * Return the index of the database in the cache partition table.  The
+ * database is added to the table if it is not there yet.  Returns -1 if
+ * the table is full, in which case the database has neither quota nor
+ * statistics of its own.
  */
-static void *
-pool_get_buffer(POOL_INTERNAL_BUFFER * buffer, size_t *len)
+static int
+pool_cache_partition(const char *database)
 {
-	void	   *p;
+	pool_sigset_t oldmask;
+	int			partition;
 
-	if (buffer->bufsize == 0 || buffer->buflen == 0 ||
-		buffer->buf == NULL)
-	{
-		*len = 0;
-		return NULL;
-	}
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+	partition = pool_cache_partition_locked(database);
+	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	POOL_SETMASK(&oldmask);
 
-	p = palloc(buffer->buflen);
-	memcpy(p, buffer->buf, buffer->buflen);
-	*len = buffer->buflen;
-	return p;
+	return partition;
 }
 
 /*
- * Get internal buffer length.
+ * Same as pool_cache_partition() but the caller must hold
+ * QUERY_CACHE_STATS_SEM.
  */
-static size_t
-pool_get_buffer_length(POOL_INTERNAL_BUFFER * buffer)
+static int
+pool_cache_partition_locked(const char *database)
 {
-	if (buffer == NULL)
-		return 0;
+	static char last_database[SM_DATABASE];
+	static int	last_partition = -1;
+	POOL_CACHE_PARTITION *part;
+	int			i;
 
-	return buffer->buflen;
+	if (cache_partitions == NULL || database == NULL)
+		return -1;
+
+	/* Partitions are never removed, so remember the last one */
+	if (last_partition >= 0 && strcmp(last_database, database) == 0)
+		return last_partition;
+
+	for (i = 0; i < cache_partitions->num_partitions; i++)
+	{
+		if (strcmp(cache_partitions->partitions[i].database, database) == 0)
+			break;
+	}
+
+	if (i == cache_partitions->num_partitions)
+	{
+		if (i >= POOL_CACHE_MAX_PARTITIONS)
+			return -1;
+
+		part = &cache_partitions->partitions[i];
+		memset(part, 0, sizeof(*part));
+		StrNCpy(part->database, database, SM_DATABASE);
+		part->quota = pool_cache_database_quota(database);
+		cache_partitions->num_partitions++;
+
+		ereport(DEBUG1,
+				(errmsg("memcache: added cache partition for database \"%s\"", database),
+				 errdetail("quota: %ld bytes", part->quota)));
+	}
+
+	StrNCpy(last_database, database, SM_DATABASE);
+	last_partition = i;
+	return i;
 }
 
-#ifdef NOT_USED
 /*
- * Get internal buffer pointer.
+ * Return the cache partition of the database of the current session, or
+ * NULL if none.  Caller must hold QUERY_CACHE_STATS_SEM.
  */
-static char *
-pool_get_buffer_pointer(POOL_INTERNAL_BUFFER * buffer)
+static POOL_CACHE_PARTITION *
+pool_session_cache_partition(void)
 {
-	if (buffer == NULL)
+	POOL_SESSION_CONTEXT *session_context;
+	int			partition;
+
+	session_context = pool_get_session_context(true);
+	if (session_context == NULL || session_context->backend == NULL ||
+		session_context->backend->info == NULL)
 		return NULL;
-	return buffer->buf;
+
+	partition = pool_cache_partition_locked(session_context->backend->info->database);
+	if (partition < 0)
+		return NULL;
+	return &cache_partitions->partitions[partition];
 }
-#endif
+
 /*
- * Get query cache buffer struct of current query context
+ * Return the quota in bytes of the database given by
+ * memqcache_database_quota, or 0 if none.
  */
-POOL_TEMP_QUERY_CACHE *
-pool_get_current_cache(void)
+static long
+pool_cache_database_quota(const char *database)
 {
-	POOL_SESSION_CONTEXT *session_context;
-	POOL_QUERY_CONTEXT *query_context;
-	POOL_TEMP_QUERY_CACHE *p = NULL;
+	Left_right_tokens *tokens = pool_config->memqcache_quota_tokens;
+	int			percent = 0;
+	int			i;
 
-	session_context = pool_get_session_context(true);
-	if (session_context)
+	if (tokens == NULL || !pool_is_shmem_cache())
+		return 0;
+
+	for (i = 0; i < tokens->pos; i++)
 	{
-		query_context = session_context->query_context;
-		if (query_context)
+		if (strcmp(tokens->token[i].left_token, database) == 0)
 		{
-			p = query_context->temp_cache;
+			percent = atoi(tokens->token[i].right_token);
+			break;
 		}
+		if (strcmp(tokens->token[i].left_token, "*") == 0)
+			percent = atoi(tokens->token[i].right_token);
 	}
-	return p;
+
+	return (long) (pool_config->memqcache_total_size * percent / 100);
 }
 
 /*
- * Get query cache buffer of current query context
+ * Make room for an item of "size" bytes within the quota of the partition
+ * by evicting items of the partition.  Like pool_evict_cache_items(), this
+ * sweeps blocks by the CLOCK algorithm, but with the clock hand of the
+ * partition and looking at the items of the partition only.  Returns false
+ * if the item cannot fit in the quota.  Caller must hold the exclusive
+ * query cache lock.
  */
-static char *
-pool_get_current_cache_buffer(size_t *len)
+static bool
+pool_cache_partition_make_room(int partition, int size)
 {
-	char	   *p = NULL;
+	POOL_CACHE_PARTITION *part;
+	int			maxblock = pool_get_memqcache_blocks();
+	int			nscan = maxblock * (POOL_MAX_USAGE_COUNT + 1);
+	long		request_size;
+	int			total_evicted = 0;
+	int			n;
 
-	*len = 0;
-	POOL_TEMP_QUERY_CACHE *cache;
+	if (partition < 0)
+		return true;
 
-	cache = pool_get_current_cache();
-	if (cache)
+	part = &cache_partitions->partitions[partition];
+	if (part->quota <= 0)
+		return true;
+
+	request_size = size + sizeof(POOL_CACHE_ITEM_POINTER) + sizeof(POOL_CACHE_ITEM_HEADER);
+	if (request_size > part->quota)
+		return false;
+
+	for (n = 0; n < nscan && part->used_size + request_size > part->quota; n++)
 	{
-		p = pool_get_buffer(cache->buffer, len);
+		POOL_CACHE_BLOCKID blockid;
+		POOL_CACHE_BLOCK_HEADER *bh;
+		POOL_CACHEID cacheid;
+		char	   *p;
+		int			num_evicted = 0;
+		int			i;
+
+		if (part->clock_hand >= maxblock)
+			part->clock_hand = 0;
+		blockid = part->clock_hand++;
+
+		p = block_address(blockid);
+		bh = (POOL_CACHE_BLOCK_HEADER *) p;
+		if (!(bh->flags & POOL_BLOCK_USED))
+			continue;
+
+		cacheid.blockid = blockid;
+		for (i = 0; i < bh->num_items && part->used_size + request_size > part->quota; i++)
+		{
+			POOL_CACHE_ITEM_POINTER *cip = item_pointer(p, i);
+			volatile	POOL_HASH_ELEMENT *element;
+
+			if (cip->flags & POOL_ITEM_DELETED)
+				continue;
+
+			if (item_header(p, i)->partition != partition + 1)
+				continue;
+
+			/* Give recently used items another chance */
+			element = pool_hash_search_element(&cip->query_hash);
+			if (element && pool_hash_age_element(element))
+				continue;
+
+			cacheid.itemid = i;
+			if (pool_delete_item_shmem_cache(&cacheid) == 0)
+				num_evicted++;
+		}
+
+		if (num_evicted > 0)
+		{
+			pool_compact_cache_block(blockid);
+			total_evicted += num_evicted;
+		}
 	}
-	return p;
+
+	if (total_evicted > 0)
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: evicted %d items of database \"%s\" to keep its quota",
+						total_evicted, part->database)));
+		pool_stats_count_up_num_evicted_entries(total_evicted);
+	}
+
+	return part->used_size + request_size <= part->quota;
 }
 
 /*
- * Mark this temporary query cache buffer discarded if the SELECT
- * uses the table oid specified by oids.
+ * Add "size" bytes of a cache item to the usage of its partition, or
+ * subtract if negative.  Caller must hold the exclusive query cache lock.
  */
 static void
-pool_check_and_discard_cache_buffer(int num_oids, int *oids)
+pool_cache_partition_account(POOL_CACHE_ITEM_HEADER * cih, long size)
 {
-	POOL_SESSION_CONTEXT *session_context;
-	POOL_TEMP_QUERY_CACHE *cache;
-	int			num_caches;
-	size_t		len;
-	int		   *soids;
-	int			i,
-				j,
-				k;
+	POOL_CACHE_PARTITION *part;
 
-	session_context = pool_get_session_context(true);
-
-	if (!session_context || !session_context->query_cache_array)
+	if (cache_partitions == NULL || cih->partition == 0 ||
+		cih->partition > POOL_CACHE_MAX_PARTITIONS)
 		return;
 
-	num_caches = session_context->query_cache_array->num_caches;
-
-	for (i = 0; i < num_caches; i++)
-	{
-		cache = session_context->query_cache_array->caches[i];
-		if (!cache || cache->is_discarded)
-			continue;
+	part = &cache_partitions->partitions[cih->partition - 1];
+	part->used_size += size;
+	part->num_cache_entries += size > 0 ? 1 : -1;
+}
 
-		soids = (int *) pool_get_buffer(cache->oids, &len);
-		if (!soids || !len)
-			continue;
+/*
+ * Reset the usage of all partitions after the shmem cache is cleared.
+ * Caller must hold the exclusive query cache lock.
+ */
+static void
+pool_cache_partition_reset_usage(void)
+{
+	int			i;
 
-		for (j = 0; j < cache->num_oids; j++)
-		{
-			if (cache->is_discarded)
-				break;
+	if (cache_partitions == NULL)
+		return;
 
-			for (k = 0; k < num_oids; k++)
-			{
-				if (soids[j] == oids[k])
-				{
-					ereport(DEBUG1,
-							(errmsg("discard cache for \"%s\"", cache->query)));
-					cache->is_discarded = true;
-					break;
-				}
-			}
-		}
-		pfree(soids);
+	for (i = 0; i < POOL_CACHE_MAX_PARTITIONS; i++)
+	{
+		cache_partitions->partitions[i].used_size = 0;
+		cache_partitions->partitions[i].num_cache_entries = 0;
 	}
 }
 
 /*
- * At Ready for Query or Command Complete handle query cache.  For streaming
- * replication mode and extended query at Command Complete handle query cache.
- * For other case At Ready for Query handle query cache.
+ * Return palloc'd copy of the cache partitions in use, and set their number
+ * to *num_partitions.  To see consistent usage, caller should hold the
+ * query cache lock.
  */
-void
-pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node, char state)
+POOL_CACHE_PARTITION *
+pool_get_cache_partitions(int *num_partitions)
 {
-	POOL_SESSION_CONTEXT *session_context;
+	POOL_CACHE_PARTITION *partitions;
 	pool_sigset_t oldmask;
-	char	   *cache_buffer;
-	size_t		len;
-	int			num_oids;
-	int		   *oids;
-	int			i;
+	int			n = 0;
 
-	session_context = pool_get_session_context(true);
+	partitions = palloc(sizeof(POOL_CACHE_PARTITION) * POOL_CACHE_MAX_PARTITIONS);
 
-	/* Ok to cache SELECT result? */
-	if (pool_is_cache_safe())
+	if (cache_partitions)
 	{
-		SelectContext ctx;
-		MemoryContext old_context;
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
+		n = cache_partitions->num_partitions;
+		memcpy(partitions, cache_partitions->partitions, sizeof(POOL_CACHE_PARTITION) * n);
+		pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+		POOL_SETMASK(&oldmask);
+	}
 
-		old_context = MemoryContextSwitchTo(session_context->memory_context);
-		num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
-		MemoryContextSwitchTo(old_context);
-		oids = ctx.table_oids;
-		ereport(DEBUG2,
-				(errmsg("query cache handler for ReadyForQuery"),
-				 errdetail("num_oids: %d oid: %d", num_oids, *oids)));
+	*num_partitions = n;
+	return partitions;
+}
 
-		if (state == 'I')		/* Not inside a transaction? */
-		{
-			/*
-			 * Make sure that temporary cache is not exceeded.
-			 */
-			if (!pool_is_cache_exceeded())
-			{
-				POOL_TEMP_QUERY_CACHE *cache;
+/*
+ * On shared memory table oid map implementation.  For each table (a pair of
+ * database oid and table oid) used by cache entries, we keep a list of
+ * entries each of which points to a cache item using the table.  Entries
+ * belonging to the same cache item are also linked in a circular list
+ * starting from oid_map of the cache item pointer (POOL_CACHE_ITEM_POINTER)
+ * so that they can be removed when the item is deleted.  All the functions
+ * below must be called while holding exclusive shmem lock.
+ */
+static volatile POOL_OID_MAP_HEADER *oid_map_header;
+static volatile POOL_OID_MAP_TABLE *oid_map_tables;
+static volatile POOL_OID_MAP_ENTRY *oid_map_entries;
 
-				/*
-				 * If we are not inside a transaction, we can immediately
-				 * register to cache storage.
-				 */
-				/* Register to memcached or shmem */
-				POOL_SETMASK2(&BlockSig, &oldmask);
-				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+/*
+ * Number of oid map entries.  We assume that a cache entry uses two tables
+ * in average.
+ */
+static int
+pool_oid_map_num_entries(void)
+{
+	return pool_config->memqcache_max_num_cache * 2;
+}
 
-				cache_buffer = pool_get_current_cache_buffer(&len);
-				if (cache_buffer)
-				{
-					if (session_context->query_context->skip_cache_commit == false)
-					{
-						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids) != 0)
-						{
-							ereport(WARNING,
-									(errmsg("ReadyForQuery: pool_commit_cache failed")));
-						}
-					}
+/*
+ * Number of oid map tables.
+ */
+static int
+pool_oid_map_num_tables(void)
+{
+	return Max(1024, pool_config->memqcache_max_num_cache / 4);
+}
 
-					/*
-					 * Reset temporary query cache buffer. This is necessary
-					 * if extended query protocol is used and a bind/execute
-					 * message arrives which uses a statement created by prior
-					 * parse message. In this case since the temp_cache is not
-					 * initialized by a parse message, messages are added to
-					 * pre existing temp cache buffer. The problem was found
-					 * in bug#152.
-					 * http://www.pgpool.net/mantisbt/view.php?id=152
-					 */
-					cache = pool_get_current_cache();
-					ereport(DEBUG1,
-							(errmsg("pool_handle_query_cache: temp_cache: %p", cache)));
-					pool_discard_temp_query_cache(cache);
+/*
+ * Number of oid map hash buckets, rounded up to power of 2.
+ */
+static int
+pool_oid_map_num_buckets(void)
+{
+	int			nbuckets = 1;
 
-					if (SL_MODE && pool_is_doing_extended_query_message())
-						session_context->query_context->temp_cache = NULL;
-					else
-						session_context->query_context->temp_cache = pool_create_temp_query_cache(query);
-					pfree(cache_buffer);
-				}
-				pool_shmem_unlock();
-				POOL_SETMASK(&oldmask);
-			}
+	while (nbuckets < pool_oid_map_num_tables())
+		nbuckets <<= 1;
+	return nbuckets;
+}
 
-			/* Count up SELECT stats */
-			pool_stats_count_up_num_selects(1);
+static size_t
+pool_oid_map_header_size(void)
+{
+	return MAXALIGN(offsetof(POOL_OID_MAP_HEADER, buckets) +
+					sizeof(int32) * pool_oid_map_num_buckets());
+}
 
-			/* Reset temp buffer */
-			pool_reset_memqcache_buffer(true);
-		}
-		else
-		{
-			POOL_TEMP_QUERY_CACHE *cache = pool_get_current_cache();
+/*
+ * Return shared memory size for table oid map.
+ */
+size_t
+pool_oid_map_size(void)
+{
+	size_t		size;
 
-			/* In transaction. Keep to temp query cache array */
-			pool_add_oids_temp_query_cache(cache, num_oids, oids);
+	size = pool_oid_map_header_size();
+	size += MAXALIGN(sizeof(POOL_OID_MAP_TABLE) * pool_oid_map_num_tables());
+	size += sizeof(POOL_OID_MAP_ENTRY) * pool_oid_map_num_entries();
 
-			/*
-			 * If temp cache has been overflowed, just trash the half baked
-			 * temp cache.
-			 */
-			if (pool_is_cache_exceeded())
-			{
-				pool_discard_current_temp_query_cache();
-			}
+	elog(DEBUG1, "pool_oid_map_size: %zu", size);
 
-			/*
-			 * Otherwise add to the temp cache array.
-			 */
-			else
-			{
-				session_context->query_cache_array =
-					pool_add_query_cache_array(session_context->query_cache_array, cache);
+	return size;
+}
+
+/*
+ * Allocate table oid map on shared memory and initialize it.
+ */
+void
+pool_init_oid_map(void)
+{
+	oid_map_header = pool_shared_memory_segment_get_chunk(pool_oid_map_header_size());
+	oid_map_tables = pool_shared_memory_segment_get_chunk(
+														  MAXALIGN(sizeof(POOL_OID_MAP_TABLE) * pool_oid_map_num_tables()));
+	oid_map_entries = pool_shared_memory_segment_get_chunk(
+														   sizeof(POOL_OID_MAP_ENTRY) * pool_oid_map_num_entries());
+	pool_reset_oid_map();
+}
+
+/*
+ * Empty table oid map.
+ */
+static void
+pool_reset_oid_map(void)
+{
+	int			nentries = pool_oid_map_num_entries();
+	int			ntables = pool_oid_map_num_tables();
+	int			nbuckets = pool_oid_map_num_buckets();
+	int			i;
 
-				/*
-				 * Reset temp_cache pointer in the current query context so
-				 * that we don't add the same temp cache to the cache array.
-				 * This is necessary such that case when next query is just a
-				 * "bind message", without "parse message". In the case the
-				 * query context is reused and same cache pointer will be
-				 * added to the query_cache_array which we do not want.
-				 */
-				session_context->query_context->temp_cache = NULL;
-			}
+	oid_map_header->nentries = nentries;
+	oid_map_header->ntables = ntables;
+	oid_map_header->mask = nbuckets - 1;
 
-			/* Count up temporary SELECT stats */
-			pool_tmp_stats_count_up_num_selects();
-		}
+	for (i = 0; i < nbuckets; i++)
+		oid_map_header->buckets[i] = -1;
+
+	for (i = 0; i < ntables; i++)
+	{
+		oid_map_tables[i].dboid = 0;
+		oid_map_tables[i].tableoid = 0;
+		oid_map_tables[i].head = -1;
+		oid_map_tables[i].next = i + 1 < ntables ? i + 1 : -1;
 	}
-	else if (is_rollback_query(node))	/* Rollback? */
+	oid_map_header->free_table = 0;
+
+	for (i = 0; i < nentries; i++)
 	{
-		/* Discard buffered data */
-		pool_reset_memqcache_buffer(true);
+		oid_map_entries[i].table = -1;
+		oid_map_entries[i].prev = -1;
+		oid_map_entries[i].next = i + 1 < nentries ? i + 1 : -1;
+		oid_map_entries[i].item_next = -1;
 	}
-	else if (is_commit_query(node)) /* Commit? */
+	oid_map_header->free_entry = 0;
+}
+
+static uint32
+pool_oid_map_hash(int dboid, int tableoid)
+{
+	return (((uint32) dboid * 2654435761U) ^ ((uint32) tableoid * 2246822519U)) &
+		oid_map_header->mask;
+}
+
+/*
+ * Find the table.  Returns index of the table or -1 if not found.
+ */
+static int
+pool_oid_map_find_table(int dboid, int tableoid)
+{
+	int			t;
+
+	for (t = oid_map_header->buckets[pool_oid_map_hash(dboid, tableoid)]; t >= 0;
+		 t = oid_map_tables[t].next)
 	{
-		int			num_caches;
+		if (oid_map_tables[t].dboid == dboid && oid_map_tables[t].tableoid == tableoid)
+			return t;
+	}
+	return -1;
+}
 
-		POOL_SETMASK2(&BlockSig, &oldmask);
-		pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+/*
+ * Record that the cache item specified by cacheid uses the table.  Returns
+ * 0 on success, -1 if there's no room in the map.
+ */
+static int
+pool_oid_map_add(int dboid, int tableoid, POOL_CACHEID * cacheid)
+{
+	POOL_CACHE_ITEM_POINTER *cip;
+	int			t;
+	int			e;
 
-		/* Invalidate query cache */
-		if (pool_config->memqcache_auto_cache_invalidation)
-		{
-			num_oids = pool_get_dml_table_oid(&oids);
-			pool_invalidate_query_cache(num_oids, oids, true, 0);
-		}
+	if (oid_map_header->free_entry < 0)
+		return -1;
 
-		/*--------------------------------------------------------------------
-		 * If we have something in the query cache buffer, that means either:
-		 * - We only had SELECTs in the transaction
-		 * - We had only SELECTs after the last DML
-		 * Thus we can register SELECT results to cache storage.
-		 *--------------------------------------------------------------------
-		 */
-		num_caches = session_context->query_cache_array->num_caches;
-		for (i = 0; i < num_caches; i++)
-		{
-			POOL_TEMP_QUERY_CACHE *cache;
+	t = pool_oid_map_find_table(dboid, tableoid);
+	if (t < 0)
+	{
+		uint32		bucket;
 
-			cache = session_context->query_cache_array->caches[i];
-			if (!cache || cache->is_discarded)
-				continue;
+		t = oid_map_header->free_table;
+		if (t < 0)
+			return -1;
+		oid_map_header->free_table = oid_map_tables[t].next;
 
-			num_oids = cache->num_oids;
-			oids = pool_get_buffer(cache->oids, &len);
-			cache_buffer = pool_get_buffer(cache->buffer, &len);
+		bucket = pool_oid_map_hash(dboid, tableoid);
+		oid_map_tables[t].dboid = dboid;
+		oid_map_tables[t].tableoid = tableoid;
+		oid_map_tables[t].head = -1;
+		oid_map_tables[t].next = oid_map_header->buckets[bucket];
+		oid_map_header->buckets[bucket] = t;
+	}
 
-			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids) != 0)
-			{
-				ereport(WARNING,
-						(errmsg("ReadyForQuery: pool_commit_cache failed")));
-			}
-			if (oids)
-				pfree(oids);
-			if (cache_buffer)
-				pfree(cache_buffer);
-		}
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
+	e = oid_map_header->free_entry;
+	oid_map_header->free_entry = oid_map_entries[e].next;
 
-		/* Count up number of SELECT stats */
-		pool_stats_count_up_num_selects(pool_tmp_stats_get_num_selects());
+	/* Link to the head of the table's list */
+	oid_map_entries[e].table = t;
+	oid_map_entries[e].prev = -1;
+	oid_map_entries[e].next = oid_map_tables[t].head;
+	if (oid_map_tables[t].head >= 0)
+		oid_map_entries[oid_map_tables[t].head].prev = e;
+	oid_map_tables[t].head = e;
+	oid_map_entries[e].cacheid = *cacheid;
 
-		pool_reset_memqcache_buffer(true);
+	/* Link to the item's circular list */
+	cip = item_pointer(block_address(cacheid->blockid), cacheid->itemid);
+	if (cip->oid_map < 0)
+	{
+		oid_map_entries[e].item_next = e;
+		cip->oid_map = e;
 	}
-	else						/* Non cache safe queries */
+	else
 	{
-		/* Non cacheable SELECT */
-		if (node && IsA(node, SelectStmt))
-		{
-			/* Extract table oids from buffer */
-			num_oids = pool_get_dml_table_oid(&oids);
-
-			if (state == 'I')
-			{
-				/*
-				 * If Data-modifying statements in SELECT's WITH clause,
-				 * invalidate query cache.
-				 */
-				if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
-				{
-					POOL_SETMASK2(&BlockSig, &oldmask);
-					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-					pool_invalidate_query_cache(num_oids, oids, true, 0);
-					pool_shmem_unlock();
-					POOL_SETMASK(&oldmask);
-				}
+		oid_map_entries[e].item_next = oid_map_entries[cip->oid_map].item_next;
+		oid_map_entries[cip->oid_map].item_next = e;
+	}
 
-				/* Count up SELECT stats */
-				pool_stats_count_up_num_selects(1);
-				pool_reset_memqcache_buffer(true);
-			}
-			else
-			{
-				/*
-				 * If we are inside a transaction, we cannot invalidate
-				 * query cache yet. However we can clear cache buffer, if
-				 * DML/DDL modifies the TABLE which SELECT uses.
-				 */
-				if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
-				{
-					pool_check_and_discard_cache_buffer(num_oids, oids);
-					pool_reset_memqcache_buffer(false);
-				}
+	return 0;
+}
 
-				/* Count up temporary SELECT stats */
-				pool_tmp_stats_count_up_num_selects();
-			}
-		}
+/*
+ * Unlink the entry from the table's list and return it to the free list.
+ * The table is also freed if it has no entry anymore.  The item's list is
+ * not touched.
+ */
+static void
+pool_oid_map_remove_entry(int e)
+{
+	int			t = oid_map_entries[e].table;
+	int			prev = oid_map_entries[e].prev;
+	int			next = oid_map_entries[e].next;
 
-		/*
-		 * If the query is DROP DATABASE, discard both of caches in
-		 * shmem/memcached and oidmap in memqcache_oiddir.
-		 */
-		else if (is_drop_database(node) && session_context->query_context->dboid != 0)
-		{
-			int			dboid = session_context->query_context->dboid;
+	if (prev >= 0)
+		oid_map_entries[prev].next = next;
+	else
+		oid_map_tables[t].head = next;
+	if (next >= 0)
+		oid_map_entries[next].prev = prev;
 
-			num_oids = pool_get_dropdb_table_oids(&oids, dboid);
+	oid_map_entries[e].table = -1;
+	oid_map_entries[e].prev = -1;
+	oid_map_entries[e].item_next = -1;
+	oid_map_entries[e].next = oid_map_header->free_entry;
+	oid_map_header->free_entry = e;
 
-			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
-			{
-				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-				pool_invalidate_query_cache(num_oids, oids, true, dboid);
-				pool_discard_oid_maps_by_db(dboid);
-				pool_shmem_unlock();
-				pool_reset_memqcache_buffer(true);
+	if (oid_map_tables[t].head < 0)
+	{
+		uint32		bucket;
+		volatile int32 *tp;
 
-				pfree(oids);
-				ereport(DEBUG2,
-						(errmsg("query cache handler for ReadyForQuery"),
-						 errdetail("deleted all cache files for the DROPped DB")));
-			}
-		}
-		else
+		bucket = pool_oid_map_hash(oid_map_tables[t].dboid, oid_map_tables[t].tableoid);
+		for (tp = &oid_map_header->buckets[bucket]; *tp >= 0;
+			 tp = &oid_map_tables[*tp].next)
 		{
-			/*
-			 * DML/DCL/DDL case
-			 */
-
-			/* Extract table oids from buffer */
-			num_oids = pool_get_dml_table_oid(&oids);
-			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
-			{
-				/*
-				 * If we are not inside a transaction, we can immediately
-				 * invalidate query cache.
-				 */
-				if (state == 'I')
-				{
-					POOL_SETMASK2(&BlockSig, &oldmask);
-					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-					pool_invalidate_query_cache(num_oids, oids, true, 0);
-					pool_shmem_unlock();
-					POOL_SETMASK(&oldmask);
-					pool_reset_memqcache_buffer(true);
-				}
-				else
-				{
-					/*
-					 * If we are inside a transaction, we cannot invalidate
-					 * query cache yet. However we can clear cache buffer, if
-					 * DML/DDL modifies the TABLE which SELECT uses.
-					 */
-					pool_check_and_discard_cache_buffer(num_oids, oids);
-					pool_reset_memqcache_buffer(false);
-				}
-			}
-			else if (num_oids == 0)
+			if (*tp == t)
 			{
-				/*
-				 * It is also necessary to clear cache buffers in case of no
-				 * oid queries (like BEGIN, CHECKPOINT, VACUUM, etc) too.
-				 */
-				pool_reset_memqcache_buffer(true);
+				*tp = oid_map_tables[t].next;
+				break;
 			}
 		}
+		oid_map_tables[t].dboid = 0;
+		oid_map_tables[t].tableoid = 0;
+		oid_map_tables[t].next = oid_map_header->free_table;
+		oid_map_header->free_table = t;
 	}
 }
 
 /*
- * Create and initialize query cache stats
- */
-static POOL_QUERY_CACHE_STATS * stats;
-int
-pool_init_memqcache_stats(void)
-{
-	stats = pool_shared_memory_segment_get_chunk(sizeof(POOL_QUERY_CACHE_STATS));
-	pool_reset_memqcache_stats();
-	return 0;
-}
-
-/*
- * Returns copy of stats area. The copy is in static area and will be
- * overwritten by next call to this function.
+ * Remove all entries in the item's circular list starting from "first".
  */
-POOL_QUERY_CACHE_STATS *
-pool_get_memqcache_stats(void)
+static void
+pool_oid_map_remove_item_list(int first)
 {
-	static POOL_QUERY_CACHE_STATS mystats;
-	pool_sigset_t oldmask;
-
-	memset(&mystats, 0, sizeof(POOL_QUERY_CACHE_STATS));
+	int			e = first;
 
-	if (stats)
+	do
 	{
-		POOL_SETMASK2(&BlockSig, &oldmask);
-		pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-		memcpy(&mystats, stats, sizeof(POOL_QUERY_CACHE_STATS));
-		pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-		POOL_SETMASK(&oldmask);
-	}
+		int			next = oid_map_entries[e].item_next;
 
-	return &mystats;
+		pool_oid_map_remove_entry(e);
+		e = next;
+	} while (e >= 0 && e != first);
 }
 
 /*
- * Reset query cache stats. Caller must lock QUERY_CACHE_STATS_SEM if
- * necessary.
+ * Forget all tables used by the cache item.  Called when the item is
+ * deleted.
  */
-void
-pool_reset_memqcache_stats(void)
+static void
+pool_oid_map_remove_item(POOL_CACHE_ITEM_POINTER * cip)
 {
-	memset(stats, 0, sizeof(POOL_QUERY_CACHE_STATS));
-	stats->start_time = time(NULL);
+	if (cip->oid_map < 0)
+		return;
+
+	pool_oid_map_remove_item_list(cip->oid_map);
+	cip->oid_map = -1;
 }
 
 /*
- * Count up number of successful SELECTs and returns the number.
- * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ * Delete all cache entries using the table.
  */
-long long int
-pool_stats_count_up_num_selects(long long int num)
+static void
+pool_oid_map_invalidate(int dboid, int tableoid)
 {
-	pool_sigset_t oldmask;
+	int			t;
+	int			e;
+	POOL_CACHEID cacheid;
 
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-	stats->num_selects += num;
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-	POOL_SETMASK(&oldmask);
-	return stats->num_selects;
+	while ((t = pool_oid_map_find_table(dboid, tableoid)) >= 0)
+	{
+		e = oid_map_tables[t].head;
+		cacheid = oid_map_entries[e].cacheid;
+
+		ereport(DEBUG1,
+				(errmsg("memcache invalidating query cache"),
+				 errdetail("deleting cacheid:%d itemid:%d",
+						   cacheid.blockid, cacheid.itemid)));
+
+		/*
+		 * This removes the entry and other entries of the item as well, and
+		 * the table if it becomes empty.
+		 */
+		pool_delete_item_shmem_cache(&cacheid);
+
+		/*
+		 * If the item could not be deleted, the entry is stale (should not
+		 * happen).  Remove the entries by ourselves to make progress.
+		 */
+		if (oid_map_entries[e].table == t)
+			pool_oid_map_remove_item_list(e);
+	}
+
+	/*
+	 * The local caches of children may have entries which are no longer on
+	 * shmem but use the table.
+	 */
+	pool_advance_cache_epoch();
 }
 
 /*
- * Count up number of successful SELECTs in temporary area and returns
- * the number.
+ * Delete all cache entries using tables in the database.
  */
-long long int
-pool_tmp_stats_count_up_num_selects(void)
+static void
+pool_oid_map_invalidate_db(int dboid)
 {
-	POOL_SESSION_CONTEXT *session_context;
+	int			t;
 
-	session_context = pool_get_session_context(false);
-	session_context->num_selects++;
-	return session_context->num_selects;
+	for (t = 0; t < oid_map_header->ntables; t++)
+	{
+		if (oid_map_tables[t].head >= 0 && oid_map_tables[t].dboid == dboid)
+			pool_oid_map_invalidate(dboid, oid_map_tables[t].tableoid);
+	}
 }
 
 /*
- * Return number of successful SELECTs in temporary area.
+ * On shared memory hash table implementation.  We use sub part of the
+ * query signature (md5 or xxhash) as hash function.  The experiment has
+ * shown that has_any() of PostgreSQL is a little bit better than the
+ * method using part of md5 hash value, but it seems adding some cpu
+ * cycles to call hash_any() is not worth the trouble.
  */
-long long int
-pool_tmp_stats_get_num_selects(void)
-{
-	POOL_SESSION_CONTEXT *session_context;
 
-	session_context = pool_get_session_context(false);
-	return session_context->num_selects;
-}
+static volatile POOL_HASH_HEADER *hash_header;
+static volatile POOL_HASH_ELEMENT *hash_elements;
+static volatile POOL_HASH_ELEMENT *hash_free;
 
 /*
- * Reset number of successful SELECTs in temporary area.
+ * Usage counts of cache items, indexed by the position of the hash element
+ * for the item.  They are kept out of cache blocks so that they can be
+ * updated while holding only a shared lock (or no lock at all); it does not
+ * matter if an increment is occasionally lost.
  */
-void
-pool_tmp_stats_reset_num_selects(void)
+static volatile unsigned char *hash_usage;
+
+/*
+ * Frequency sketch of the admission filter (TinyLFU).  A count-min sketch
+ * of POOL_SKETCH_DEPTH rows of 4 bit counters, one byte each for
+ * simplicity, as many per row as the hash elements.  A query is counted
+ * when its cache item is hit or when its result is about to be cached.
+ * All the counters are halved when the sketch has counted ten times as
+ * many queries as the counters in a row, so that the frequency of old
+ * accesses fades out.  Like the usage counts, the counters are updated
+ * without lock and lost increments do not matter.
+ */
+#define POOL_SKETCH_DEPTH		4
+#define POOL_SKETCH_MAX_COUNT	15
+#define POOL_SKETCH_SAMPLE		10
+
+typedef struct
 {
-	POOL_SESSION_CONTEXT *session_context;
+	pool_atomic_uint32 additions;	/* # of queries counted since the last
+									 * halving */
+	uint32		width;			/* # of counters per row, power of 2 */
+	unsigned char counters[1];	/* actual counters follow */
+}			POOL_FREQ_SKETCH;
 
-	session_context = pool_get_session_context(false);
-	session_context->num_selects = 0;
-}
+static volatile POOL_FREQ_SKETCH *hash_sketch;
 
 /*
- * Count up number of SELECTs extracted from cache returns the number.
- * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ * Return the current cache epoch.
  */
-long long int
-pool_stats_count_up_num_cache_hits(void)
+static uint32
+pool_cache_epoch(void)
 {
-	pool_sigset_t oldmask;
-
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-	stats->num_cache_hits++;
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-	POOL_SETMASK(&oldmask);
-	return stats->num_cache_hits;
+	return pool_atomic_read_u32(&hash_header->epoch);
 }
 
 /*
- * On shared memory hash table implementation.  We use sub part of md5
- * hash key as hash function.  The experiment has shown that has_any()
- * of PostgreSQL is a little bit better than the method using part of
- * md5 hash value, but it seems adding some cpu cycles to call
- * hash_any() is not worth the trouble.
+ * Advance the cache epoch so that the local caches of all children are
+ * discarded.  Must be called after the invalidated items have been removed
+ * from shmem.
  */
-
-static volatile POOL_HASH_HEADER *hash_header;
-static volatile POOL_HASH_ELEMENT *hash_elements;
-static volatile POOL_HASH_ELEMENT *hash_free;
+static void
+pool_advance_cache_epoch(void)
+{
+	if (hash_header)
+		pool_atomic_fetch_add_u32(&hash_header->epoch, 1);
+}
 
 /*
  * Initialize hash table on shared memory "nelements" is max number of
@@ -4026,6 +6439,7 @@ pool_hash_init(int nelements)
 	hash_header = pool_shared_memory_segment_get_chunk(size);
 	hash_header->nhash = nelements2;
 	hash_header->mask = mask;
+	pool_atomic_init_u32(&hash_header->epoch, 0);
 
 #ifdef POOL_HASH_DEBUG
 	ereport(LOG,
@@ -4043,6 +6457,17 @@ pool_hash_init(int nelements)
 			 errdetail("size:%zd nelements2:%d", size, nelements2)));
 #endif
 
+	hash_usage = pool_shared_memory_segment_get_chunk(nelements2);
+	memset((void *) hash_usage, 0, nelements2);
+
+	if (pool_config->memqcache_admission_filter)
+	{
+		size = offsetof(POOL_FREQ_SKETCH, counters) + POOL_SKETCH_DEPTH * nelements2;
+		hash_sketch = pool_shared_memory_segment_get_chunk(size);
+		memset((void *) hash_sketch, 0, size);
+		hash_sketch->width = nelements2;
+	}
+
 	for (i = 0; i < nelements2 - 1; i++)
 	{
 		hash_elements[i].next = (POOL_HASH_ELEMENT *) & hash_elements[i + 1];
@@ -4075,6 +6500,13 @@ pool_hash_size(int nelements)
 
 	size += sizeof(POOL_HASH_ELEMENT) * nelements2;
 
+	/* usage counts */
+	size += MAXALIGN(nelements2);
+
+	/* frequency sketch */
+	if (pool_config->memqcache_admission_filter)
+		size += MAXALIGN(offsetof(POOL_FREQ_SKETCH, counters) + POOL_SKETCH_DEPTH * nelements2);
+
 	elog(DEBUG1, "pool_hash_size: %zu", size);
 
 	return size;
@@ -4091,7 +6523,6 @@ pool_hash_reset(int nelements)
 	int			nelements2;		/* number of rounded up hash keys */
 	int			shift;
 	uint32		mask;
-	POOL_HASH_HEADER hh;
 	int			i;
 
 	if (nelements <= 0)
@@ -4110,14 +6541,28 @@ pool_hash_reset(int nelements)
 	mask = ~0;
 	mask >>= shift;
 
-	size = (char *) &hh.elements - (char *) &hh + sizeof(POOL_HEADER_ELEMENT) * nelements2;
-	memset((void *) hash_header, 0, size);
+	/*
+	 * We cannot just zero clear the hash header because lock-free readers
+	 * rely on the chain versions.  Advance them instead.
+	 */
+	for (i = 0; i < hash_header->nhash; i++)
+	{
+		pool_hash_begin_update(i);
+		hash_header->elements[i].element = NULL;
+		pool_hash_end_update(i);
+	}
 
 	hash_header->nhash = nelements2;
 	hash_header->mask = mask;
 
 	size = sizeof(POOL_HASH_ELEMENT) * nelements2;
 	memset((void *) hash_elements, 0, size);
+	memset((void *) hash_usage, 0, nelements2);
+	if (hash_sketch)
+	{
+		pool_atomic_write_u32(&hash_sketch->additions, 0);
+		memset((void *) hash_sketch->counters, 0, POOL_SKETCH_DEPTH * hash_sketch->width);
+	}
 
 	for (i = 0; i < nelements2 - 1; i++)
 	{
@@ -4130,7 +6575,7 @@ pool_hash_reset(int nelements)
 }
 
 /*
- * Search cacheid by MD5 hash key string
+ * Search cacheid by query signature
  * If found, returns cache id, otherwise NULL.
  */
 POOL_CACHEID *
@@ -4138,6 +6583,21 @@ pool_hash_search(POOL_QUERY_HASH * key)
 {
 	volatile	POOL_HASH_ELEMENT *element;
 
+	element = pool_hash_search_element(key);
+	if (element == NULL)
+		return NULL;
+	return (POOL_CACHEID *) & element->cacheid;
+}
+
+/*
+ * Search hash element by query signature.
+ * If found, returns the element, otherwise NULL.
+ */
+static volatile POOL_HASH_ELEMENT *
+pool_hash_search_element(POOL_QUERY_HASH * key)
+{
+	volatile	POOL_HASH_ELEMENT *element;
+
 	uint32		hash_key = create_hash_key(key);
 
 	if (hash_key >= hash_header->nhash)
@@ -4149,37 +6609,35 @@ pool_hash_search(POOL_QUERY_HASH * key)
 		return NULL;
 	}
 
+#ifdef POOL_HASH_DEBUG
 	{
-		char		md5[POOL_MD5_HASHKEYLEN + 1];
+		char		hex[POOL_QUERY_HASH_LEN * 2 + 1];
 
-		memcpy(md5, key->query_hash, POOL_MD5_HASHKEYLEN);
-		md5[POOL_MD5_HASHKEYLEN] = '\0';
-#ifdef POOL_HASH_DEBUG
+		bytesToHex(key->query_hash, POOL_QUERY_HASH_LEN, hex);
 		ereport(LOG,
 				(errmsg("searching hash table"),
-				 errdetail("hash_key:%d md5:%s", hash_key, md5)));
-#endif
+				 errdetail("hash_key:%d key:%s", hash_key, hex)));
 	}
+#endif
 
 	element = hash_header->elements[hash_key].element;
 	while (element)
 	{
+#ifdef POOL_HASH_DEBUG
 		{
-			char		md5[POOL_MD5_HASHKEYLEN + 1];
+			char		hex[POOL_QUERY_HASH_LEN * 2 + 1];
 
-			memcpy(md5, key->query_hash, POOL_MD5_HASHKEYLEN);
-			md5[POOL_MD5_HASHKEYLEN] = '\0';
-#ifdef POOL_HASH_DEBUG
+			bytesToHex((char *) element->hashkey.query_hash, POOL_QUERY_HASH_LEN, hex);
 			ereport(LOG,
 					(errmsg("searching hash table"),
-					 errdetail("element md5:%s", md5)));
-#endif
+					 errdetail("element key:%s", hex)));
 		}
+#endif
 
 		if (memcmp((const void *) element->hashkey.query_hash,
 				   (const void *) key->query_hash, sizeof(key->query_hash)) == 0)
 		{
-			return (POOL_CACHEID *) & element->cacheid;
+			return element;
 		}
 		element = element->next;
 	}
@@ -4187,8 +6645,8 @@ pool_hash_search(POOL_QUERY_HASH * key)
 }
 
 /*
- * Insert MD5 key and associated cache id into shmem hash table.  If
- * "update" is true, replace cacheid associated with the MD5 key,
+ * Insert query signature and associated cache id into shmem hash table.
+ * If "update" is true, replace cacheid associated with the signature,
  * rather than throw an error.
  */
 static int
@@ -4208,17 +6666,16 @@ pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update)
 		return -1;
 	}
 
+#ifdef POOL_HASH_DEBUG
 	{
-		char		md5[POOL_MD5_HASHKEYLEN + 1];
+		char		hex[POOL_QUERY_HASH_LEN * 2 + 1];
 
-		memcpy(md5, key->query_hash, POOL_MD5_HASHKEYLEN);
-		md5[POOL_MD5_HASHKEYLEN] = '\0';
-#ifdef POOL_HASH_DEBUG
+		bytesToHex(key->query_hash, POOL_QUERY_HASH_LEN, hex);
 		ereport(LOG,
 				(errmsg("searching hash table"),
-				 errdetail("hash_key:%d md5:%s block:%d item:%d", hash_key, md5, cacheid->blockid, cacheid->itemid)));
-#endif
+				 errdetail("hash_key:%d key:%s block:%d item:%d", hash_key, hex, cacheid->blockid, cacheid->itemid)));
 	}
+#endif
 
 	/*
 	 * Look for hash key.
@@ -4231,20 +6688,21 @@ pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update)
 				   (const void *) key->query_hash, sizeof(key->query_hash)) == 0)
 		{
 			/* Hash key found. If "update" is false, just throw an error. */
-			char		md5[POOL_MD5_HASHKEYLEN + 1];
+			char		hex[POOL_QUERY_HASH_LEN * 2 + 1];
 
 			if (!update)
 			{
-				memcpy(md5, key->query_hash, POOL_MD5_HASHKEYLEN);
-				md5[POOL_MD5_HASHKEYLEN] = '\0';
+				bytesToHex(key->query_hash, POOL_QUERY_HASH_LEN, hex);
 				ereport(LOG,
-						(errmsg("memcache: adding cacheid to hash. hash key:\"%s\" already exists", md5)));
+						(errmsg("memcache: adding cacheid to hash. hash key:\"%s\" already exists", hex)));
 				return -1;
 			}
 			else
 			{
 				/* Update cache id */
+				pool_hash_begin_update(hash_key);
 				memcpy((void *) &element->cacheid, cacheid, sizeof(POOL_CACHEID));
+				pool_hash_end_update(hash_key);
 				return 0;
 			}
 		}
@@ -4262,19 +6720,24 @@ pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update)
 		return -1;
 	}
 
+	pool_hash_begin_update(hash_key);
+
 	element = hash_header->elements[hash_key].element;
 
-	hash_header->elements[hash_key].element = new_element;
+	memcpy((void *) new_element->hashkey.query_hash, key->query_hash, POOL_QUERY_HASH_LEN);
+	memcpy((void *) &new_element->cacheid, cacheid, sizeof(POOL_CACHEID));
 	new_element->next = element;
+	hash_usage[new_element - hash_elements] = 1;
 
-	memcpy((void *) new_element->hashkey.query_hash, key->query_hash, POOL_MD5_HASHKEYLEN);
-	memcpy((void *) &new_element->cacheid, cacheid, sizeof(POOL_CACHEID));
+	hash_header->elements[hash_key].element = new_element;
+
+	pool_hash_end_update(hash_key);
 
 	return 0;
 }
 
 /*
- * Delete MD5 key and associated cache id from shmem hash table.
+ * Delete query signature and associated cache id from shmem hash table.
  */
 int
 pool_hash_delete(POOL_QUERY_HASH * key)
@@ -4314,41 +6777,369 @@ pool_hash_delete(POOL_QUERY_HASH * key)
 
 	if (!found)
 	{
-		char		md5[POOL_MD5_HASHKEYLEN + 1];
+		char		hex[POOL_QUERY_HASH_LEN * 2 + 1];
 
-		memcpy(md5, key->query_hash, POOL_MD5_HASHKEYLEN);
-		md5[POOL_MD5_HASHKEYLEN] = '\0';
+		bytesToHex(key->query_hash, POOL_QUERY_HASH_LEN, hex);
 		ereport(LOG,
-				(errmsg("memcache: deleting key from hash. key:\"%s\" not found", md5)));
+				(errmsg("memcache: deleting key from hash. key:\"%s\" not found", hex)));
 		return -1;
 	}
 
 	/*
 	 * Put back the element to free list
 	 */
+	pool_hash_begin_update(hash_key);
 	*delete_point = element->next;
 	put_back_hash_element(element);
+	pool_hash_end_update(hash_key);
 
 	return 0;
 }
 
-/*
- * Calculate 32bit binary hash key (i.e. location in hash header) from MD5
- * string. We use top most 8 characters of MD5 string for calculation.
-*/
-static uint32
-create_hash_key(POOL_QUERY_HASH * key)
-{
-#define POOL_HASH_NCHARS 8
+/*
+ * Calculate 32bit binary hash key (i.e. location in hash header) from
+ * the query signature. We use the first 4 bytes of the signature, which
+ * are part of the MD5 digest or the XXH64 hash value.
+*/
+static uint32
+create_hash_key(POOL_QUERY_HASH * key)
+{
+	uint32		mask;
+
+	memcpy(&mask, key->query_hash, sizeof(mask));
+	mask &= hash_header->mask;
+	return mask;
+}
+
+/*
+ * Mark the beginning and the end of modification of the hash chain
+ * specified by hash_key, or the cache items linked from it.  Caller must
+ * hold the exclusive query cache lock.
+ */
+static void
+pool_hash_begin_update(uint32 hash_key)
+{
+	pool_atomic_fetch_add_u32(&hash_header->elements[hash_key].version, 1);
+}
+
+static void
+pool_hash_end_update(uint32 hash_key)
+{
+	pool_atomic_fetch_add_u32(&hash_header->elements[hash_key].version, 1);
+}
+
+/*
+ * Count up usage count of the cache item associated with the hash
+ * element.  Called when the item is hit.
+ */
+static void
+pool_hash_touch_element(volatile POOL_HASH_ELEMENT * element)
+{
+	int			i = element - hash_elements;
+
+	if (hash_usage[i] < POOL_MAX_USAGE_COUNT)
+		hash_usage[i]++;
+}
+
+/*
+ * Count down usage count of the cache item associated with the hash
+ * element.  Returns false if it was already 0, i.e. the item has not been
+ * used since the last visit of the clock hand.  Caller must hold the
+ * exclusive query cache lock.
+ */
+static bool
+pool_hash_age_element(volatile POOL_HASH_ELEMENT * element)
+{
+	int			i = element - hash_elements;
+
+	if (hash_usage[i] == 0)
+		return false;
+	hash_usage[i]--;
+	return true;
+}
+
+/*
+ * Return the index of the counter of the query in each row of the frequency
+ * sketch.  The query hash is already a hash value, so its first two words
+ * are used for double hashing.
+ */
+static void
+pool_sketch_index(POOL_QUERY_HASH * key, uint32 *index)
+{
+	uint32		h1;
+	uint32		h2;
+	int			i;
+
+	memcpy(&h1, key->query_hash, sizeof(h1));
+	memcpy(&h2, key->query_hash + sizeof(h1), sizeof(h2));
+	h2 |= 1;
+
+	for (i = 0; i < POOL_SKETCH_DEPTH; i++)
+		index[i] = i * hash_sketch->width + ((h1 + i * h2) & (hash_sketch->width - 1));
+}
+
+/*
+ * Count an access to the query in the frequency sketch.  Only the smallest
+ * counters are incremented (conservative update), which keeps the estimate
+ * of rare queries from being inflated by collisions.
+ */
+static void
+pool_sketch_increment(POOL_QUERY_HASH * key)
+{
+	uint32		index[POOL_SKETCH_DEPTH];
+	uint32		additions;
+	int			min;
+	int			i;
+
+	if (hash_sketch == NULL)
+		return;
+
+	pool_sketch_index(key, index);
+
+	min = POOL_SKETCH_MAX_COUNT;
+	for (i = 0; i < POOL_SKETCH_DEPTH; i++)
+		min = Min(min, hash_sketch->counters[index[i]]);
+	if (min >= POOL_SKETCH_MAX_COUNT)
+		return;
+
+	for (i = 0; i < POOL_SKETCH_DEPTH; i++)
+	{
+		if (hash_sketch->counters[index[i]] == min)
+			hash_sketch->counters[index[i]] = min + 1;
+	}
+
+	/* Halve all the counters once per sample period */
+	additions = pool_atomic_fetch_add_u32(&hash_sketch->additions, 1) + 1;
+	if (additions >= POOL_SKETCH_SAMPLE * hash_sketch->width &&
+		pool_atomic_compare_exchange_u32(&hash_sketch->additions, &additions, 0))
+	{
+		for (i = 0; i < POOL_SKETCH_DEPTH * hash_sketch->width; i++)
+			hash_sketch->counters[i] >>= 1;
+	}
+}
+
+/*
+ * Estimate how many times the query has been accessed recently.
+ */
+static int
+pool_sketch_estimate(POOL_QUERY_HASH * key)
+{
+	uint32		index[POOL_SKETCH_DEPTH];
+	int			min;
+	int			i;
+
+	pool_sketch_index(key, index);
+
+	min = POOL_SKETCH_MAX_COUNT;
+	for (i = 0; i < POOL_SKETCH_DEPTH; i++)
+		min = Min(min, hash_sketch->counters[index[i]]);
+	return min;
+}
+
+/*
+ * Decide whether a new cache item of "size" bytes for the query should be
+ * added (TinyLFU admission).  The item is admitted if the query has been
+ * seen before, if it fits without evicting anything, or if the query is
+ * more frequent than the first live item at the clock hand, which would
+ * be evicted first.  Thus queries run only once do not push out repeated
+ * ones.  Always true if memqcache_admission_filter is off.  Caller must
+ * hold the exclusive query cache lock.
+ */
+static bool
+pool_cache_admit(POOL_QUERY_HASH * key, size_t size)
+{
+	unsigned char *fsmm = pool_fsmm_address();
+	int			maxblock = pool_get_memqcache_blocks();
+	int			encode_value;
+	int			freq;
+	char	   *p;
+	POOL_CACHE_BLOCK_HEADER *bh;
+	int			i;
+
+	if (hash_sketch == NULL)
+		return true;
+
+	pool_sketch_increment(key);
+	freq = pool_sketch_estimate(key);
+	if (freq > 1)
+		return true;
+
+	/* Is there room without eviction? */
+	if (is_free_hash_element() && size <= POOL_MAX_FREE_SPACE)
+	{
+		encode_value = size / POOL_FSMM_RATIO;
+		for (i = 0; i < maxblock; i++)
+		{
+			if (fsmm[i] > encode_value)
+				return true;
+		}
+	}
+
+	p = block_address(*pool_fsmm_clock_hand);
+	bh = (POOL_CACHE_BLOCK_HEADER *) p;
+	if (!(bh->flags & POOL_BLOCK_USED))
+		return true;
+
+	for (i = 0; i < bh->num_items; i++)
+	{
+		POOL_CACHE_ITEM_POINTER *cip = item_pointer(p, i);
+
+		if (cip->flags & POOL_ITEM_DELETED)
+			continue;
+		return freq > pool_sketch_estimate(&cip->query_hash);
+	}
+	return true;
+}
+
+/*
+ * Look for cache item specified by query hash and copy it into palloc'd
+ * memory without acquiring the query cache lock.  The hash chain version
+ * is checked before and after reading the chain and the item, and the
+ * result is discarded if they differ, i.e. a writer touched them while we
+ * were reading.  Since what we read may be inconsistent until the version
+ * is confirmed, all the pointers and offsets are validated before being
+ * followed.
+ * Return:
+ * 0: found. *buf and *size are set.
+ * 1: not found.
+ * -1: gave up because of concurrent modifications, or the item needs to be
+ *     expired.  Caller should retry holding the lock.
+ */
+#define POOL_HASH_NOLOCK_RETRY	3
+
+static int
+pool_get_item_shmem_cache_nolock(POOL_QUERY_HASH * query_hash, char **buf, int *size, unsigned char *codec)
+{
+	uint32		hash_key = create_hash_key(query_hash);
+	volatile	pool_atomic_uint32 *version;
+	int			nelements = hash_header->nhash;
+	int			nblocks = pool_get_memqcache_blocks();
+	int			block_size = pool_config->memqcache_cache_block_size;
+	int			retry;
+	char	   *p = NULL;
+	int			bufsize = 0;
+
+	if (hash_key >= nelements)
+		return -1;
+
+	version = &hash_header->elements[hash_key].version;
+
+	for (retry = 0; retry < POOL_HASH_NOLOCK_RETRY; retry++)
+	{
+		volatile	POOL_HASH_ELEMENT *element;
+		POOL_CACHEID cacheid;
+		POOL_CACHE_BLOCK_HEADER *bh = NULL;
+		POOL_CACHE_ITEM_POINTER *cip;
+		POOL_CACHE_ITEM_HEADER *cih;
+		uint32		v1;
+		uint32		bv1 = 0;
+		int			len;
+		int			n;
+		bool		found = false;
+		bool		expired = false;
+		unsigned char mycodec = POOL_CACHE_CODEC_NONE;
+		time_t		myexpire = 0;
+
+		v1 = pool_atomic_read_u32(version);
+		if (v1 & 1)
+		{
+			/* writer in progress */
+			pool_spin_delay();
+			continue;
+		}
+
+		element = hash_header->elements[hash_key].element;
+		for (n = 0; element && n < nelements; n++)
+		{
+			if (element < hash_elements || element >= hash_elements + nelements)
+				break;
+
+			if (memcmp((const void *) element->hashkey.query_hash,
+					   (const void *) query_hash->query_hash, sizeof(query_hash->query_hash)) == 0)
+			{
+				cacheid = element->cacheid;
+				found = true;
+				break;
+			}
+			element = element->next;
+		}
+
+		len = -1;
+		if (found && cacheid.blockid < nblocks)
+		{
+			bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid.blockid);
+			bv1 = pool_atomic_read_u32(&bh->version);
+			if (bv1 & 1)
+			{
+				/* compaction in progress */
+				pool_spin_delay();
+				continue;
+			}
+			if ((bh->flags & POOL_BLOCK_USED) && cacheid.itemid < bh->num_items &&
+				sizeof(POOL_CACHE_BLOCK_HEADER) + sizeof(POOL_CACHE_ITEM_POINTER) * (cacheid.itemid + 1) <= block_size)
+			{
+				cip = item_pointer((char *) bh, cacheid.itemid);
+				if (cip->offset < block_size - sizeof(POOL_CACHE_ITEM_HEADER))
+				{
+					cih = (POOL_CACHE_ITEM_HEADER *) ((char *) bh + cip->offset);
+					len = cih->total_length - sizeof(POOL_CACHE_ITEM_HEADER);
+					if (len <= 0 || cip->offset + cih->total_length > block_size)
+						len = -1;
+					else if (cih->expire > 0 &&
+							 difftime(time(NULL), cih->timestamp) > cih->expire)
+						expired = true;
+					else if (pool_cache_item_needs_refresh(cih, time(NULL)))
+						expired = true; /* claim the refresh under the lock */
+					else
+					{
+						if (p == NULL)
+						{
+							p = palloc(len);
+							bufsize = len;
+						}
+						else if (bufsize < len)
+						{
+							p = repalloc(p, len);
+							bufsize = len;
+						}
+						memcpy(p, (char *) cih + sizeof(POOL_CACHE_ITEM_HEADER), len);
+						mycodec = cih->codec;
+						myexpire = pool_local_cache_expire(cih);
+					}
+				}
+			}
+		}
+
+		pool_read_barrier();
+		if (pool_atomic_read_u32(version) != v1)
+			continue;
+		if (bh && pool_atomic_read_u32(&bh->version) != bv1)
+			continue;
+
+		/* We have seen a consistent state */
+		if (!found)
+		{
+			if (p)
+				pfree(p);
+			return 1;
+		}
+
+		if (expired || len < 0)
+			break;
 
-	char		md5[POOL_HASH_NCHARS + 1];
-	uint32		mask;
+		pool_hash_touch_element(element);
+		pool_sketch_increment(query_hash);
 
-	memcpy(md5, key->query_hash, POOL_HASH_NCHARS);
-	md5[POOL_HASH_NCHARS] = '\0';
-	mask = strtoul(md5, NULL, 16);
-	mask &= hash_header->mask;
-	return mask;
+		*buf = p;
+		*size = len;
+		*codec = mycodec;
+		fetched_item_expire = myexpire;
+		return 0;
+	}
+
+	if (p)
+		pfree(p);
+	return -1;
 }
 
 /*
@@ -4466,16 +7257,29 @@ pool_get_shmem_storage_stats(void)
 			for (j = 0; j < bh->num_items; j++)
 			{
 				cip = item_pointer(p, j);
-				if (POOL_ITEM_DELETED & cip->flags)
+				if (POOL_ITEM_PACKED & cip->flags)
+				{
+					mystats.fragment_cache_entries_size += sizeof(POOL_CACHE_ITEM_POINTER);
+				}
+				else if (POOL_ITEM_DELETED & cip->flags)
 				{
 					mystats.fragment_cache_entries_size += item_header(p, j)->total_length;
 				}
 				else
 				{
+					POOL_CACHE_ITEM_HEADER *cih = item_header(p, j);
+					uint32		data_size = cih->total_length - sizeof(POOL_CACHE_ITEM_HEADER);
+					uint32		raw_size = data_size;
+
 					/* number of used cache entries */
 					mystats.num_cache_entries++;
 					/* total size of used cache entries */
-					mystats.used_cache_entries_size += (item_header(p, j)->total_length + sizeof(POOL_CACHE_ITEM_POINTER));
+					mystats.used_cache_entries_size += (cih->total_length + sizeof(POOL_CACHE_ITEM_POINTER));
+					/* data size before and after compression */
+					if (cih->codec != POOL_CACHE_CODEC_NONE && data_size >= sizeof(raw_size))
+						memcpy(&raw_size, (char *) cih + sizeof(POOL_CACHE_ITEM_HEADER), sizeof(raw_size));
+					mystats.raw_cache_data_size += raw_size;
+					mystats.stored_cache_data_size += data_size;
 				}
 			}
 			mystats.used_cache_entries_size += sizeof(POOL_CACHE_BLOCK_HEADER);
@@ -4638,6 +7442,512 @@ InvalidateQueryCache(int tableoid, int dboid)
 	/* Invalidate query cache */
 	pool_invalidate_query_cache(1, &tableoid, true, dboid);
 
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Query cache snapshot.  The whole cache blocks are saved to
+ * memqcache_snapshot_file at shutdown and loaded at startup so that the
+ * cache survives restarts.  Snapshots taken on request by
+ * pcp_snapshot_query_cache while pgpool is running are saved to a separate
+ * file with POOL_CACHE_SNAPSHOT_PCP_SUFFIX appended, which is never loaded
+ * automatically: tables may be updated after it is taken.  The hash table and the table oid map are not saved
+ * as they are, since the hash table is linked by addresses which are only
+ * valid in the current shared memory segment.  Instead, the hash table is
+ * rebuilt from the query hash of the item pointers and the table oid map
+ * is rebuilt from the list of (database oid, table oid, cache id) saved
+ * after the cache blocks.
+ *
+ * File layout:
+ *
+ * POOL_CACHE_SNAPSHOT_HEADER
+ * cache blocks (num_blocks * block_size bytes)
+ * POOL_CACHE_SNAPSHOT_OID * num_oids
+ */
+#define POOL_CACHE_SNAPSHOT_MAGIC	0x50514353	/* "PQCS" */
+#define POOL_CACHE_SNAPSHOT_VERSION	2
+#define POOL_CACHE_SNAPSHOT_OID_BUFSIZE	1024
+#define POOL_CACHE_SNAPSHOT_PCP_SUFFIX	".pcp"
+
+typedef struct
+{
+	uint32		magic;			/* POOL_CACHE_SNAPSHOT_MAGIC */
+	uint32		version;		/* POOL_CACHE_SNAPSHOT_VERSION */
+	int			block_size;		/* memqcache_cache_block_size */
+	int			num_blocks;		/* number of cache blocks */
+	int			max_num_cache;	/* memqcache_max_num_cache */
+	int			hash_method;	/* memqcache_hash_method */
+	int			num_oids;		/* number of table oid map entries */
+	time_t		timestamp;		/* time when the snapshot was taken */
+}			POOL_CACHE_SNAPSHOT_HEADER;
+
+typedef struct
+{
+	int			dboid;			/* database oid */
+	int			tableoid;		/* table oid */
+	POOL_CACHEID cacheid;		/* cache item using the table */
+}			POOL_CACHE_SNAPSHOT_OID;
+
+static bool pool_write_snapshot_file(int fd, char *path);
+static bool pool_snapshot_write(int fd, const void *buf, size_t len);
+static int	pool_restore_cache_block(POOL_CACHE_BLOCKID blockid, time_t now);
+static bool pool_is_live_cache_item(POOL_CACHEID * cacheid);
+
+/*
+ * Return true if the query cache snapshot is enabled.
+ */
+bool
+pool_is_memory_cache_snapshot(void)
+{
+	return pool_is_shmem_cache() && shmem != NULL &&
+		pool_config->memqcache_snapshot_file != NULL &&
+		*pool_config->memqcache_snapshot_file != '\0';
+}
+
+/*
+ * Save the shmem query cache to memqcache_snapshot_file.  The snapshot is
+ * first written to a temporary file which is renamed after it is completely
+ * written, so that a half written snapshot is never loaded.  at_shutdown
+ * should be true if called from pgpool main process after all the child
+ * processes have exited.  Otherwise the snapshot is saved to the file for
+ * on demand snapshots.  Returns true on success.
+ */
+bool
+pool_save_memory_cache_snapshot(bool at_shutdown)
+{
+	char		tmppath[POOLMAXPATHLEN];
+	char		pcppath[POOLMAXPATHLEN];
+	char	   *path;
+	int			fd;
+	bool		ok;
+	pool_sigset_t oldmask;
+
+	if (!pool_is_memory_cache_snapshot())
+	{
+		ereport(LOG,
+				(errmsg("query cache snapshot is not enabled"),
+				 errhint("set memqcache_snapshot_file and use memqcache_method = 'shmem'")));
+		return false;
+	}
+
+	/*
+	 * If a process has exited while modifying the cache, the cache could be
+	 * inconsistent.  Do not save it.
+	 */
+	if (at_shutdown && pool_atomic_read_u32(&memq_lock->writer) != 0)
+	{
+		ereport(LOG,
+				(errmsg("skipped saving query cache snapshot"),
+				 errdetail("query cache lock is held by exited process %d",
+						   pool_atomic_read_u32(&memq_lock->writer))));
+		return false;
+	}
+
+	/*
+	 * Invalidation requests queued but not applied by the query cache
+	 * invalidation worker before it exited must be applied, or their
+	 * entries would be saved as live ones.
+	 */
+	if (at_shutdown && !pool_apply_pending_query_cache_invalidation())
+	{
+		ereport(LOG,
+				(errmsg("skipped saving query cache snapshot"),
+				 errdetail("query cache invalidation requests are left unapplied")));
+		return false;
+	}
+
+	if (at_shutdown)
+		path = pool_config->memqcache_snapshot_file;
+	else
+	{
+		snprintf(pcppath, sizeof(pcppath), "%s%s",
+				 pool_config->memqcache_snapshot_file, POOL_CACHE_SNAPSHOT_PCP_SUFFIX);
+		path = pcppath;
+	}
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not create file \"%s\": %m", tmppath)));
+		return false;
+	}
+
+	/*
+	 * Shared lock is enough since it prevents writers from modifying the
+	 * cache while we are writing it.
+	 */
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
+	ok = pool_write_snapshot_file(fd, tmppath);
+	pool_shmem_unlock();
 	POOL_SETMASK(&oldmask);
+
+	if (ok && fsync(fd) != 0)
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not fsync file \"%s\": %m", tmppath)));
+		ok = false;
+	}
+
+	if (close(fd) != 0 && ok)
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not close file \"%s\": %m", tmppath)));
+		ok = false;
+	}
+
+	if (ok && rename(tmppath, path) != 0)
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not rename file \"%s\" to \"%s\": %m", tmppath, path)));
+		ok = false;
+	}
+
+	if (!ok)
+	{
+		unlink(tmppath);
+		return false;
+	}
+
+	ereport(LOG,
+			(errmsg("saved query cache snapshot to \"%s\"", path)));
+	return true;
+}
+
+/*
+ * Write the snapshot to fd.  Caller must hold the query cache lock.
+ */
+static bool
+pool_write_snapshot_file(int fd, char *path)
+{
+	POOL_CACHE_SNAPSHOT_HEADER header;
+	POOL_CACHE_SNAPSHOT_OID *oids;
+	int			nentries = oid_map_header->nentries;
+	int			n;
+	int			e;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = POOL_CACHE_SNAPSHOT_MAGIC;
+	header.version = POOL_CACHE_SNAPSHOT_VERSION;
+	header.block_size = pool_config->memqcache_cache_block_size;
+	header.num_blocks = pool_get_memqcache_blocks();
+	header.max_num_cache = pool_config->memqcache_max_num_cache;
+	header.hash_method = pool_config->memqcache_hash_method;
+	header.timestamp = time(NULL);
+
+	for (e = 0; e < nentries; e++)
+	{
+		if (oid_map_entries[e].table >= 0)
+			header.num_oids++;
+	}
+
+	if (!pool_snapshot_write(fd, &header, sizeof(header)) ||
+		!pool_snapshot_write(fd, shmem,
+							 (size_t) header.num_blocks * header.block_size))
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not write to file \"%s\": %m", path)));
+		return false;
+	}
+
+	oids = palloc(sizeof(POOL_CACHE_SNAPSHOT_OID) * POOL_CACHE_SNAPSHOT_OID_BUFSIZE);
+	n = 0;
+	for (e = 0; e < nentries; e++)
+	{
+		int			t = oid_map_entries[e].table;
+
+		if (t < 0)
+			continue;
+
+		oids[n].dboid = oid_map_tables[t].dboid;
+		oids[n].tableoid = oid_map_tables[t].tableoid;
+		oids[n].cacheid = oid_map_entries[e].cacheid;
+		n++;
+
+		if (n == POOL_CACHE_SNAPSHOT_OID_BUFSIZE)
+		{
+			if (!pool_snapshot_write(fd, oids, sizeof(POOL_CACHE_SNAPSHOT_OID) * n))
+			{
+				ereport(LOG,
+						(errmsg("failed to save query cache snapshot"),
+						 errdetail("could not write to file \"%s\": %m", path)));
+				pfree(oids);
+				return false;
+			}
+			n = 0;
+		}
+	}
+
+	if (n > 0 && !pool_snapshot_write(fd, oids, sizeof(POOL_CACHE_SNAPSHOT_OID) * n))
+	{
+		ereport(LOG,
+				(errmsg("failed to save query cache snapshot"),
+				 errdetail("could not write to file \"%s\": %m", path)));
+		pfree(oids);
+		return false;
+	}
+
+	pfree(oids);
+	return true;
+}
+
+/*
+ * Write len bytes of buf to fd.  Returns false on error.
+ */
+static bool
+pool_snapshot_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0)
+	{
+		ssize_t		rtn = write(fd, p, len);
+
+		if (rtn < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += rtn;
+		len -= rtn;
+	}
+	return true;
+}
+
+/*
+ * Load the query cache snapshot saved by pool_save_memory_cache_snapshot()
+ * at shutdown into the shmem query cache.  This should be called only from
+ * pgpool main process after the shmem query cache has been initialized and
+ * before any child process is forked.  Items which have expired are
+ * discarded.  The snapshot file is removed after being read, and only the
+ * shutdown snapshot is ever written to it, so that an old snapshot is never
+ * loaded after a crash.
+ */
+void
+pool_load_memory_cache_snapshot(void)
+{
+	char	   *path;
+	int			fd;
+	struct stat st;
+	char	   *p;
+	POOL_CACHE_SNAPSHOT_HEADER header;
+	size_t		blocks_size;
+	time_t		now;
+	int			nitems = 0;
+	int			i;
+
+	if (!pool_is_memory_cache_snapshot())
+		return;
+
+	path = pool_config->memqcache_snapshot_file;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errmsg("failed to load query cache snapshot"),
+					 errdetail("could not open file \"%s\": %m", path)));
+		return;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(header))
+	{
+		ereport(LOG,
+				(errmsg("failed to load query cache snapshot"),
+				 errdetail("file \"%s\" is too short", path)));
+		goto done;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		ereport(LOG,
+				(errmsg("failed to load query cache snapshot"),
+				 errdetail("could not mmap file \"%s\": %m", path)));
+		goto done;
+	}
+
+	memcpy(&header, p, sizeof(header));
+	blocks_size = (size_t) pool_get_memqcache_blocks() *
+		pool_config->memqcache_cache_block_size;
+
+	if (header.magic != POOL_CACHE_SNAPSHOT_MAGIC ||
+		header.version != POOL_CACHE_SNAPSHOT_VERSION)
+	{
+		ereport(LOG,
+				(errmsg("failed to load query cache snapshot"),
+				 errdetail("file \"%s\" is not a query cache snapshot", path)));
+		munmap(p, st.st_size);
+		goto done;
+	}
+
+	if (header.block_size != pool_config->memqcache_cache_block_size ||
+		header.num_blocks != pool_get_memqcache_blocks() ||
+		header.max_num_cache != pool_config->memqcache_max_num_cache ||
+		header.hash_method != pool_config->memqcache_hash_method)
+	{
+		ereport(LOG,
+				(errmsg("discarded query cache snapshot"),
+				 errdetail("query cache configuration has been changed since the snapshot was taken")));
+		munmap(p, st.st_size);
+		goto done;
+	}
+
+	if (header.num_oids < 0 ||
+		st.st_size != sizeof(header) + blocks_size +
+		sizeof(POOL_CACHE_SNAPSHOT_OID) * header.num_oids)
+	{
+		ereport(LOG,
+				(errmsg("failed to load query cache snapshot"),
+				 errdetail("file \"%s\" has invalid size", path)));
+		munmap(p, st.st_size);
+		goto done;
+	}
+
+	memcpy(shmem, p + sizeof(header), blocks_size);
+
+	/* Rebuild hash table and FSMM, dropping expired items */
+	now = time(NULL);
+	for (i = 0; i < header.num_blocks; i++)
+		nitems += pool_restore_cache_block(i, now);
+
+	/* Rebuild table oid map */
+	for (i = 0; i < header.num_oids; i++)
+	{
+		POOL_CACHE_SNAPSHOT_OID oid;
+
+		memcpy(&oid, p + sizeof(header) + blocks_size +
+			   sizeof(POOL_CACHE_SNAPSHOT_OID) * i, sizeof(oid));
+
+		if (!pool_is_live_cache_item(&oid.cacheid))
+			continue;
+
+		/* Without the oid map the item could not be invalidated */
+		if (pool_oid_map_add(oid.dboid, oid.tableoid, &oid.cacheid) != 0)
+		{
+			if (pool_delete_item_shmem_cache(&oid.cacheid) == 0)
+				nitems--;
+		}
+	}
+
+	munmap(p, st.st_size);
+
+	ereport(LOG,
+			(errmsg("loaded query cache snapshot from \"%s\"", path),
+			 errdetail("%d cache entries restored. snapshot was taken at %s",
+					   nitems, ctime(&header.timestamp))));
+
+done:
+	close(fd);
+	unlink(path);
+}
+
+/*
+ * Validate the block loaded from snapshot and register its items to the
+ * hash table.  Items which have expired or look broken are deleted.
+ * Returns the number of items restored.
+ */
+static int
+pool_restore_cache_block(POOL_CACHE_BLOCKID blockid, time_t now)
+{
+	char	   *p = block_address(blockid);
+	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) p;
+	unsigned int block_size = pool_config->memqcache_cache_block_size;
+	unsigned int max_items;
+	POOL_CACHEID cacheid;
+	int			nitems = 0;
+	int			i;
+
+	pool_atomic_init_u32(&bh->version, 0);
+
+	max_items = (block_size - sizeof(POOL_CACHE_BLOCK_HEADER)) /
+		sizeof(POOL_CACHE_ITEM_POINTER);
+	if (!(bh->flags & POOL_BLOCK_USED) || bh->num_items > max_items ||
+		bh->free_bytes > POOL_MAX_FREE_SPACE)
+	{
+		bh->flags = 0;
+		pool_init_cache_block(blockid);
+		return 0;
+	}
+
+	cacheid.blockid = blockid;
+	for (i = 0; i < bh->num_items; i++)
+	{
+		POOL_CACHE_ITEM_POINTER *cip = item_pointer(p, i);
+		POOL_CACHE_ITEM_HEADER *cih;
+
+		cip->oid_map = -1;
+
+		if (cip->flags & POOL_ITEM_DELETED)
+			continue;
+
+		if (!(cip->flags & POOL_ITEM_USED) ||
+			cip->offset < sizeof(POOL_CACHE_BLOCK_HEADER) +
+			sizeof(POOL_CACHE_ITEM_POINTER) * bh->num_items ||
+			cip->offset > block_size - sizeof(POOL_CACHE_ITEM_HEADER))
+		{
+			cip->flags |= POOL_ITEM_DELETED;
+			continue;
+		}
+
+		cih = item_header(p, i);
+		if (cih->total_length < sizeof(POOL_CACHE_ITEM_HEADER) ||
+			cih->total_length > block_size - cip->offset)
+		{
+			cip->flags |= POOL_ITEM_DELETED;
+			continue;
+		}
+
+		if (cih->expire > 0 && difftime(now, cih->timestamp) > cih->expire)
+		{
+			cip->flags |= POOL_ITEM_DELETED;
+			continue;
+		}
+
+		/* The partition table is not saved */
+		cih->partition = 0;
+
+		cacheid.itemid = i;
+		if (pool_hash_insert(&cip->query_hash, &cacheid, false) != 0)
+		{
+			cip->flags |= POOL_ITEM_DELETED;
+			continue;
+		}
+		nitems++;
+	}
+
+	/* Reclaim space of the deleted items */
+	pool_compact_cache_block(blockid);
+	pool_update_fsmm(blockid, bh->free_bytes);
+
+	return nitems;
+}
+
+/*
+ * Return true if the cache id points to a live item.
+ */
+static bool
+pool_is_live_cache_item(POOL_CACHEID * cacheid)
+{
+	POOL_CACHE_BLOCK_HEADER *bh;
+	POOL_CACHE_ITEM_POINTER *cip;
+
+	if (cacheid->blockid >= pool_get_memqcache_blocks())
+		return false;
+
+	bh = (POOL_CACHE_BLOCK_HEADER *) block_address(cacheid->blockid);
+	if (!(bh->flags & POOL_BLOCK_USED) || cacheid->itemid >= bh->num_items)
+		return false;
+
+	cip = item_pointer((char *) bh, cacheid->itemid);
+	return (cip->flags & POOL_ITEM_USED) && !(cip->flags & POOL_ITEM_DELETED);
 }
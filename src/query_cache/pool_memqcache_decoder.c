@@ -0,0 +1,416 @@
+/* -*-pgsql-c-*- */
+/*
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_memqcache_decoder.c: query cache invalidation by logical decoding
+ *
+ * Child processes invalidate the query cache of the tables written through
+ * them, but writes made through another pgpool, by clients connecting to
+ * PostgreSQL directly or by triggers are not noticed until memqcache_expire.
+ * If memqcache_logical_slot is set, the query cache logical decoding worker
+ * reads the changes of memqcache_logical_database from the logical
+ * replication slot on the primary node every memqcache_logical_interval
+ * milliseconds and invalidates the query cache of the tables changed.
+ *
+ * The changes are read with pg_logical_slot_get_changes() of the
+ * test_decoding plugin, and the table names it prints are turned into oids
+ * on the server in the same query, so that a batch of changes results in
+ * one row per table.  If the slot does not exist, it is created.  Since the
+ * changes made before then cannot be read, the whole query cache is cleared
+ * at that time, as well as when the primary node changes.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "query_cache/pool_memqcache.h"
+#include "protocol/pool_process_query.h"
+#include "protocol/pool_pg_utils.h"
+#include "auth/pool_passwd.h"
+#include "context/pool_process_context.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/ps_status.h"
+#include "utils/pool_signal.h"
+
+/* Maximum number of changes read from the slot at once */
+#define DECODER_BATCH_SIZE	1000
+
+/*
+ * Create the slot unless it exists.  Returns a row if it has been created.
+ */
+#define DECODER_CREATE_SLOT_QUERY \
+"SELECT pg_catalog.pg_create_logical_replication_slot('%s', 'test_decoding') \
+WHERE NOT EXISTS (SELECT 1 FROM pg_catalog.pg_replication_slots WHERE slot_name = '%s')"
+
+#define DECODER_DATABASE_OID_QUERY \
+"SELECT oid FROM pg_catalog.pg_database WHERE datname = pg_catalog.current_database()"
+
+/*
+ * Consume up to DECODER_BATCH_SIZE changes.  The first row holds the number
+ * of changes consumed, and the rest the oids of the tables changed.
+ * test_decoding prints a change as "table <qualified name>: <ACTION>: ...".
+ */
+#define DECODER_GET_CHANGES_QUERY \
+"WITH l AS (SELECT data FROM pg_catalog.pg_logical_slot_get_changes('%s', NULL, %d, 'include-xids', '0', 'skip-empty-xacts', '1')), \
+t AS (SELECT DISTINCT pg_catalog.to_regclass(substring(data from '^table (.+?): [A-Z]+:'))::oid AS oid FROM l) \
+SELECT 0, count(*) FROM l UNION ALL SELECT 1, oid FROM t WHERE oid IS NOT NULL ORDER BY 1"
+
+static POOL_CONNECTION_POOL_SLOT *decoder_slot = NULL;
+static int	decoder_node_id = -1;
+static int	decoder_dboid = 0;
+
+static volatile sig_atomic_t reload_config_request = 0;
+
+static int	consume_changes(void);
+static bool connect_decoder_node(int node_id);
+static void disconnect_decoder_node(void);
+static RETSIGTYPE my_signal_handler(int sig);
+static RETSIGTYPE reload_config_handler(int sig);
+static void reload_config(void);
+
+#define CHECK_REQUEST \
+	do { \
+		if (reload_config_request) \
+		{ \
+			reload_config(); \
+			reload_config_request = 0; \
+		} \
+	} while (0)
+
+/*
+ * Returns true if the query cache is invalidated by the changes read from
+ * memqcache_logical_slot.
+ */
+bool
+pool_is_logical_invalidation(void)
+{
+	return pool_config->memory_cache_enabled && pool_is_shmem_cache() &&
+		pool_config->memqcache_logical_slot &&
+		*pool_config->memqcache_logical_slot != '\0';
+}
+
+/*
+ * Connect to the database of the slot on the node, creating the slot if
+ * needed.  Returns false if it failed.
+ */
+static bool
+connect_decoder_node(int node_id)
+{
+	MemoryContext oldContext;
+	POOL_SELECT_RESULT *res = NULL;
+	BackendInfo *bkinfo;
+	char	   *password;
+	char		query[1024];
+	bool		created = false;
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+	bkinfo = pool_get_node_info(node_id);
+	decoder_slot = make_persistent_db_connection_noerror(node_id,
+														 bkinfo->backend_hostname,
+														 bkinfo->backend_port,
+														 pool_config->memqcache_logical_database,
+														 pool_config->sr_check_user,
+														 password ? password : "", false);
+	if (password)
+		pfree(password);
+	MemoryContextSwitchTo(oldContext);
+
+	if (decoder_slot == NULL)
+		return false;
+
+	PG_TRY();
+	{
+		snprintf(query, sizeof(query), DECODER_CREATE_SLOT_QUERY,
+				 pool_config->memqcache_logical_slot, pool_config->memqcache_logical_slot);
+		do_query(decoder_slot->con, query, &res, PROTO_MAJOR_V3);
+		created = res->numrows > 0;
+		free_select_result(res);
+
+		do_query(decoder_slot->con, DECODER_DATABASE_OID_QUERY, &res, PROTO_MAJOR_V3);
+		decoder_dboid = (res->numrows == 1 && res->data[0]) ? atoi(res->data[0]) : 0;
+		free_select_result(res);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldContext);
+		EmitErrorReport();
+		FlushErrorState();
+		disconnect_decoder_node();
+		return false;
+	}
+	PG_END_TRY();
+
+	if (decoder_dboid <= 0)
+	{
+		disconnect_decoder_node();
+		return false;
+	}
+
+	decoder_node_id = node_id;
+
+	if (created)
+		ereport(LOG,
+				(errmsg("query cache logical decoding worker: created replication slot \"%s\"",
+						pool_config->memqcache_logical_slot),
+				 errdetail("node id: %d database: %s", node_id,
+						   pool_config->memqcache_logical_database)));
+
+	/* the changes made before the slot was created have been missed */
+	if (created)
+		pool_clear_memory_cache();
+
+	return true;
+}
+
+static void
+disconnect_decoder_node(void)
+{
+	if (decoder_slot)
+		discard_persistent_db_connection(decoder_slot);
+	decoder_slot = NULL;
+}
+
+/*
+ * Read a batch of changes from the slot and invalidate the query cache of
+ * the tables changed.  Returns number of changes read.
+ */
+static int
+consume_changes(void)
+{
+	static int	last_node_id = -1;
+	MemoryContext oldContext = CurrentMemoryContext;
+	POOL_SELECT_RESULT *res = NULL;
+	pool_sigset_t oldmask;
+	char		query[2048];
+	int			node_id;
+	int			nchanges = 0;
+	int			ntables = 0;
+	int			i;
+
+	if (Req_info->switching)
+		return 0;
+
+	node_id = STREAM ? REAL_PRIMARY_NODE_ID : REAL_MAIN_NODE_ID;
+	if (node_id < 0 || !VALID_BACKEND(node_id))
+	{
+		disconnect_decoder_node();
+		return 0;
+	}
+
+	if (decoder_slot && decoder_node_id != node_id)
+		disconnect_decoder_node();
+
+	if (decoder_slot == NULL)
+	{
+		if (!connect_decoder_node(node_id))
+			return 0;
+
+		/*
+		 * The changes made on the old primary after they were last read are
+		 * lost.
+		 */
+		if (last_node_id >= 0 && last_node_id != node_id)
+		{
+			ereport(LOG,
+					(errmsg("query cache logical decoding worker: primary node changed from %d to %d",
+							last_node_id, node_id),
+					 errdetail("clearing whole query cache")));
+			pool_clear_memory_cache();
+		}
+		last_node_id = node_id;
+	}
+
+	snprintf(query, sizeof(query), DECODER_GET_CHANGES_QUERY,
+			 pool_config->memqcache_logical_slot, DECODER_BATCH_SIZE);
+
+	PG_TRY();
+	{
+		do_query(decoder_slot->con, query, &res, PROTO_MAJOR_V3);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldContext);
+		EmitErrorReport();
+		FlushErrorState();
+		disconnect_decoder_node();
+		return 0;
+	}
+	PG_END_TRY();
+
+	if (res->numrows < 1)
+	{
+		free_select_result(res);
+		return 0;
+	}
+
+	nchanges = atoi(res->data[1]);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+	PG_TRY();
+	{
+		for (i = 1; i < res->numrows; i++)
+		{
+			if (res->data[i * 2 + 1] == NULL)
+				continue;
+			pool_invalidate_query_cache_by_table(decoder_dboid, atoi(res->data[i * 2 + 1]));
+			ntables++;
+		}
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	free_select_result(res);
+
+	if (nchanges > 0)
+		ereport(DEBUG1,
+				(errmsg("query cache logical decoding worker: applied changes"),
+				 errdetail("changes: %d tables: %d", nchanges, ntables)));
+
+	return nchanges;
+}
+
+/*
+ * query cache logical decoding worker main loop
+ */
+void
+do_memqcache_decoder_child(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext DecoderMemoryContext;
+
+	ereport(DEBUG1,
+			(errmsg("I am query cache logical decoding worker pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("query cache logical decoding worker", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Create per loop iteration memory context */
+	DecoderMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "memqcache_decoder_main_loop",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	/* Initialize per process context */
+	pool_init_process_context();
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+		POOL_SETMASK(&UnBlockSig);
+		disconnect_decoder_node();
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	for (;;)
+	{
+		MemoryContextSwitchTo(DecoderMemoryContext);
+		MemoryContextResetAndDeleteChildren(DecoderMemoryContext);
+
+		CHECK_REQUEST;
+
+		/* more changes are likely to be waiting if the batch was full */
+		if (consume_changes() >= DECODER_BATCH_SIZE)
+			continue;
+
+		{
+			struct timespec timeout;
+
+			timeout.tv_sec = pool_config->memqcache_logical_interval / 1000;
+			timeout.tv_nsec = (pool_config->memqcache_logical_interval % 1000) * 1000 * 1000;
+			pselect(0, NULL, NULL, NULL, &timeout, &UnBlockSig);
+		}
+	}
+}
+
+static RETSIGTYPE my_signal_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+
+	switch (sig)
+	{
+		case SIGTERM:
+		case SIGINT:
+		case SIGQUIT:
+			exit(0);
+			break;
+
+		default:
+			exit(1);
+			break;
+	}
+}
+
+static RETSIGTYPE reload_config_handler(int sig)
+{
+	reload_config_request = 1;
+}
+
+static void
+reload_config(void)
+{
+	ereport(LOG,
+			(errmsg("reloading config file")));
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
+	MemoryContextSwitchTo(oldContext);
+	reload_config_request = 0;
+}
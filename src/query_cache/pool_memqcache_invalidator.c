@@ -0,0 +1,705 @@
+/* -*-pgsql-c-*- */
+/*
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_memqcache_invalidator.c: asynchronous query cache invalidation
+ *
+ * When memqcache_invalidation_mode is "async" or "strict", child processes
+ * do not invalidate the shmem query cache by themselves after a DML
+ * commits.  Instead they queue (database oid, table oid) pairs into a ring
+ * buffer on shared memory and the query cache invalidation worker process
+ * applies them in batches, so that the client does not have to wait for
+ * the exclusive query cache lock.  In "strict" mode, a child process waits
+ * until its own requests have been applied before it looks up the cache.
+ *
+ * If memqcache_watchdog_invalidation is on, the requests are also queued
+ * for the watchdog process, which sends them to the other pgpool nodes in
+ * batches.  The requests received from them are applied like the local
+ * ones.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#include <signal.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "query_cache/pool_memqcache.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/ps_status.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_atomic.h"
+#include "utils/pool_ipc.h"
+
+/* How long a reader waits for its own requests in strict mode */
+#define POOL_INVALIDATION_WAIT_TIMEOUT_USEC	1000000
+
+/* How long a claimed but unpublished request is waited for */
+#define POOL_INVALIDATION_STUCK_TIMEOUT		5
+
+#define POOL_INVALIDATION_MAX_SPINS			100
+#define POOL_INVALIDATION_MIN_DELAY_USEC	10
+#define POOL_INVALIDATION_MAX_DELAY_USEC	1000
+
+static volatile POOL_INVALIDATION_QUEUE *invalidation_queue = NULL;
+static POOL_REMOTE_INVALIDATION_QUEUE *remote_invalidation_queue = NULL;
+
+/* Ticket number following the last request queued by this process */
+static uint64 my_last_ticket = 0;
+
+static volatile sig_atomic_t reload_config_request = 0;
+
+static int	apply_invalidation_requests(void);
+static bool invalidation_request_published(void);
+static RETSIGTYPE my_signal_handler(int sig);
+static RETSIGTYPE reload_config_handler(int sig);
+static RETSIGTYPE wakeup_handler(int sig);
+static void reload_config(void);
+
+#define CHECK_REQUEST \
+	do { \
+		if (reload_config_request) \
+		{ \
+			reload_config(); \
+			reload_config_request = 0; \
+		} \
+	} while (0)
+
+/*
+ * Returns true if query cache invalidation is performed by the query cache
+ * invalidation worker.
+ */
+bool
+pool_is_async_invalidation(void)
+{
+	return pool_config->memory_cache_enabled && pool_is_shmem_cache() &&
+		pool_config->memqcache_invalidation_mode != MEMQCACHE_INVALIDATION_SYNC;
+}
+
+/*
+ * Calculate necessary shared memory size for the invalidation queue.
+ */
+size_t
+pool_invalidation_queue_size(void)
+{
+	return sizeof(POOL_INVALIDATION_QUEUE);
+}
+
+/*
+ * Allocate and initialize the invalidation queue on shmem. This should be
+ * called only once from pgpool main process at the process staring up time.
+ */
+void
+pool_init_invalidation_queue(void)
+{
+	int			i;
+
+	invalidation_queue = pool_shared_memory_segment_get_chunk(pool_invalidation_queue_size());
+
+	pool_atomic_init_u64(&invalidation_queue->tail, 0);
+	pool_atomic_init_u64(&invalidation_queue->head, 0);
+	pool_atomic_init_u64(&invalidation_queue->applied, 0);
+	pool_atomic_init_u32(&invalidation_queue->worker_pid, 0);
+	pool_atomic_init_u32(&invalidation_queue->sleeping, 0);
+	for (i = 0; i < POOL_INVALIDATION_QUEUE_SIZE; i++)
+		pool_atomic_init_u64(&invalidation_queue->requests[i].seq, 0);
+}
+
+/*
+ * Queue invalidation requests of the tables.  Returns false if the queue
+ * does not have enough room, in which case the caller should invalidate
+ * the query cache by itself.  Caller must block signals.
+ */
+bool
+pool_enqueue_query_cache_invalidation(int dboid, int num_table_oids, int *table_oids)
+{
+	uint64		tail;
+	uint64		head;
+	uint32		sleeping;
+	int			i;
+
+	if (invalidation_queue == NULL)
+		return false;
+
+	if (num_table_oids <= 0)
+		return true;
+
+	if (num_table_oids > POOL_INVALIDATION_QUEUE_SIZE)
+		return false;
+
+	/* Claim tickets */
+	tail = pool_atomic_read_u64(&invalidation_queue->tail);
+	for (;;)
+	{
+		head = pool_atomic_read_u64(&invalidation_queue->head);
+		if (tail + num_table_oids - head > POOL_INVALIDATION_QUEUE_SIZE)
+		{
+			ereport(DEBUG1,
+					(errmsg("memcache: query cache invalidation queue is full")));
+			return false;
+		}
+		if (pool_atomic_compare_exchange_u64(&invalidation_queue->tail,
+											 &tail, tail + num_table_oids))
+			break;
+	}
+
+	/* Fill in and publish the requests */
+	for (i = 0; i < num_table_oids; i++)
+	{
+		volatile POOL_INVALIDATION_REQUEST *req;
+
+		req = &invalidation_queue->requests[(tail + i) & (POOL_INVALIDATION_QUEUE_SIZE - 1)];
+		req->dboid = dboid;
+		req->tableoid = table_oids[i];
+		pool_atomic_write_u64(&req->seq, tail + i + 1);
+	}
+
+	my_last_ticket = tail + num_table_oids;
+
+	ereport(DEBUG1,
+			(errmsg("memcache: queued query cache invalidation"),
+			 errdetail("dboid: %d num_oids: %d ticket: %llu",
+					   dboid, num_table_oids, (unsigned long long) tail)));
+
+	/* Wake up the worker if it is sleeping */
+	sleeping = 1;
+	if (pool_atomic_compare_exchange_u32(&invalidation_queue->sleeping, &sleeping, 0))
+	{
+		pid_t		pid = (pid_t) pool_atomic_read_u32(&invalidation_queue->worker_pid);
+
+		if (pid > 0)
+			kill(pid, SIGUSR2);
+	}
+
+	return true;
+}
+
+/*
+ * In strict mode, wait until all the invalidation requests queued by this
+ * process have been applied.  Returns false if they have not been applied
+ * in time, in which case the caller must not use the query cache.
+ */
+bool
+pool_wait_for_query_cache_invalidation(void)
+{
+	int			spins = 0;
+	int			delay = 0;
+	long		waited = 0;
+
+	if (pool_config->memqcache_invalidation_mode != MEMQCACHE_INVALIDATION_STRICT ||
+		invalidation_queue == NULL)
+		return true;
+
+	for (;;)
+	{
+		if (pool_atomic_read_u64(&invalidation_queue->applied) >= my_last_ticket)
+			return true;
+
+		if (pool_atomic_read_u32(&invalidation_queue->worker_pid) == 0 ||
+			waited >= POOL_INVALIDATION_WAIT_TIMEOUT_USEC)
+		{
+			ereport(DEBUG1,
+					(errmsg("memcache: query cache invalidation has not been applied in time"),
+					 errdetail("skipping query cache lookup")));
+			return false;
+		}
+
+		if (spins < POOL_INVALIDATION_MAX_SPINS)
+		{
+			spins++;
+			pool_spin_delay();
+			continue;
+		}
+
+		if (delay == 0)
+			delay = POOL_INVALIDATION_MIN_DELAY_USEC;
+
+		usleep(delay);
+		waited += delay;
+
+		delay *= 2;
+		if (delay > POOL_INVALIDATION_MAX_DELAY_USEC)
+			delay = POOL_INVALIDATION_MAX_DELAY_USEC;
+	}
+}
+
+/*
+ * Returns true if query cache invalidation is sent to and received from the
+ * other pgpool nodes through the watchdog.
+ */
+bool
+pool_is_remote_invalidation(void)
+{
+	return pool_config->memory_cache_enabled && pool_is_shmem_cache() &&
+		pool_config->use_watchdog && pool_config->memqcache_watchdog_invalidation;
+}
+
+/*
+ * Calculate necessary shared memory size for the queue of the requests to
+ * be sent to the other pgpool nodes.
+ */
+size_t
+pool_remote_invalidation_queue_size(void)
+{
+	return sizeof(POOL_REMOTE_INVALIDATION_QUEUE);
+}
+
+/*
+ * Allocate and initialize the queue of the requests to be sent to the other
+ * pgpool nodes.  This should be called only once from pgpool main process
+ * at the process staring up time.
+ */
+void
+pool_init_remote_invalidation_queue(void)
+{
+	remote_invalidation_queue = pool_shared_memory_segment_get_chunk(pool_remote_invalidation_queue_size());
+	remote_invalidation_queue->overflow = false;
+	remote_invalidation_queue->num_requests = 0;
+}
+
+/*
+ * Queue invalidation requests of the tables to be sent to the other pgpool
+ * nodes.  If the queue is full, the requests are dropped and the other
+ * nodes will clear their whole query cache instead.  Caller must block
+ * signals.
+ */
+void
+pool_enqueue_remote_invalidation(int dboid, int num_table_oids, int *table_oids)
+{
+	POOL_REMOTE_INVALIDATION_QUEUE *q = remote_invalidation_queue;
+	int			i;
+
+	if (q == NULL || num_table_oids <= 0)
+		return;
+
+	pool_semaphore_lock(WD_QCACHE_INVALIDATION_SEM);
+
+	if (q->num_requests + num_table_oids > POOL_REMOTE_INVALIDATION_QUEUE_SIZE)
+		q->overflow = true;
+	else
+	{
+		for (i = 0; i < num_table_oids; i++)
+		{
+			q->dboids[q->num_requests] = dboid;
+			q->tableoids[q->num_requests] = table_oids[i];
+			q->num_requests++;
+		}
+	}
+
+	pool_semaphore_unlock(WD_QCACHE_INVALIDATION_SEM);
+}
+
+/*
+ * Take up to max requests out of the queue of the requests to be sent to
+ * the other pgpool nodes.  *overflow is set to true if requests have been
+ * dropped since the last call.  Called from the watchdog process.
+ */
+int
+pool_dequeue_remote_invalidation(int *dboids, int *tableoids, int max, bool *overflow)
+{
+	POOL_REMOTE_INVALIDATION_QUEUE *q = remote_invalidation_queue;
+	pool_sigset_t oldmask;
+	int			n;
+
+	*overflow = false;
+	if (q == NULL)
+		return 0;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(WD_QCACHE_INVALIDATION_SEM);
+
+	n = Min(q->num_requests, max);
+	memcpy(dboids, q->dboids, sizeof(int) * n);
+	memcpy(tableoids, q->tableoids, sizeof(int) * n);
+	q->num_requests -= n;
+	memmove(q->dboids, q->dboids + n, sizeof(int) * q->num_requests);
+	memmove(q->tableoids, q->tableoids + n, sizeof(int) * q->num_requests);
+
+	*overflow = q->overflow;
+	q->overflow = false;
+
+	pool_semaphore_unlock(WD_QCACHE_INVALIDATION_SEM);
+	POOL_SETMASK(&oldmask);
+
+	return n;
+}
+
+/*
+ * Apply invalidation requests received from another pgpool node.  They are
+ * handed to the query cache invalidation worker if it is running.  Called
+ * from the watchdog process.
+ */
+void
+pool_apply_remote_invalidation(int num, int *dboids, int *tableoids)
+{
+	pool_sigset_t oldmask;
+	int			i;
+	int			j;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+
+	if (pool_is_async_invalidation())
+	{
+		/* queue the requests of the same database at once */
+		for (i = 0; i < num; i = j)
+		{
+			for (j = i + 1; j < num && dboids[j] == dboids[i]; j++)
+				;
+			if (!pool_enqueue_query_cache_invalidation(dboids[i], j - i, tableoids + i))
+				break;
+		}
+		if (i >= num)
+		{
+			POOL_SETMASK(&oldmask);
+			return;
+		}
+	}
+	else
+		i = 0;
+
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+	PG_TRY();
+	{
+		for (; i < num; i++)
+			pool_invalidate_query_cache_by_table(dboids[i], tableoids[i]);
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Tell that the query cache invalidation worker has gone away so that
+ * strict mode readers do not wait for it.  Called from pgpool main process.
+ */
+void
+pool_invalidation_worker_exited(void)
+{
+	if (invalidation_queue)
+		pool_atomic_write_u32(&invalidation_queue->worker_pid, 0);
+}
+
+/*
+ * Apply the invalidation requests left in the queue when the query cache
+ * invalidation worker exited.  Called from pgpool main process at shutdown
+ * after all the other processes have exited.  Returns false if some
+ * requests could not be applied because the processes which claimed them
+ * died before publishing them, in which case the query cache may hold
+ * stale entries.
+ */
+bool
+pool_apply_pending_query_cache_invalidation(void)
+{
+	if (invalidation_queue == NULL)
+		return true;
+
+	while (apply_invalidation_requests() > 0)
+		;
+
+	return pool_atomic_read_u64(&invalidation_queue->applied) ==
+		pool_atomic_read_u64(&invalidation_queue->tail);
+}
+
+/*
+ * Returns true if the request at the head of the queue has been published.
+ */
+static bool
+invalidation_request_published(void)
+{
+	uint64		head = pool_atomic_read_u64(&invalidation_queue->head);
+	volatile POOL_INVALIDATION_REQUEST *req;
+
+	req = &invalidation_queue->requests[head & (POOL_INVALIDATION_QUEUE_SIZE - 1)];
+	return pool_atomic_read_u64(&req->seq) == head + 1;
+}
+
+/*
+ * Apply a batch of published invalidation requests.  Returns number of
+ * requests consumed.
+ */
+static int
+apply_invalidation_requests(void)
+{
+	static time_t stuck_since = 0;
+	POOL_INVALIDATION_REQUEST reqs[POOL_INVALIDATION_BATCH_SIZE];
+	MemoryContext oldContext = CurrentMemoryContext;
+	pool_sigset_t oldmask;
+	uint64		head;
+	int			n = 0;
+	int			nreqs;
+	int			i;
+	int			j;
+
+	head = pool_atomic_read_u64(&invalidation_queue->head);
+
+	while (n < POOL_INVALIDATION_BATCH_SIZE)
+	{
+		volatile POOL_INVALIDATION_REQUEST *req;
+
+		req = &invalidation_queue->requests[(head + n) & (POOL_INVALIDATION_QUEUE_SIZE - 1)];
+		if (pool_atomic_read_u64(&req->seq) != head + n + 1)
+			break;
+		reqs[n].dboid = req->dboid;
+		reqs[n].tableoid = req->tableoid;
+		n++;
+	}
+
+	if (n == 0)
+	{
+		time_t		now;
+
+		if (pool_atomic_read_u64(&invalidation_queue->tail) == head)
+		{
+			stuck_since = 0;
+			return 0;
+		}
+
+		/*
+		 * The ticket has been claimed but the request has not been published
+		 * yet.  This should not last long unless the process which claimed
+		 * it has died.  Since we cannot know which table should be
+		 * invalidated, clear whole query cache and skip the request.
+		 */
+		now = time(NULL);
+		if (stuck_since == 0)
+			stuck_since = now;
+		if (now - stuck_since < POOL_INVALIDATION_STUCK_TIMEOUT)
+			return 0;
+
+		ereport(WARNING,
+				(errmsg("memcache: query cache invalidation request was not published in time"),
+				 errdetail("ticket: %llu. clearing whole query cache", (unsigned long long) head)));
+		pool_clear_memory_cache();
+		pool_atomic_write_u64(&invalidation_queue->head, head + 1);
+		pool_atomic_write_u64(&invalidation_queue->applied, head + 1);
+		stuck_since = 0;
+		return 1;
+	}
+	stuck_since = 0;
+
+	nreqs = n;
+	if (pool_config->memqcache_invalidation_coalesce)
+	{
+		nreqs = 0;
+		for (i = 0; i < n; i++)
+		{
+			for (j = 0; j < nreqs; j++)
+			{
+				if (reqs[j].dboid == reqs[i].dboid && reqs[j].tableoid == reqs[i].tableoid)
+					break;
+			}
+			if (j == nreqs)
+				reqs[nreqs++] = reqs[i];
+		}
+	}
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+	PG_TRY();
+	{
+		for (i = 0; i < nreqs; i++)
+			pool_invalidate_query_cache_by_table(reqs[i].dboid, reqs[i].tableoid);
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		MemoryContextSwitchTo(oldContext);
+		EmitErrorReport();
+		FlushErrorState();
+
+		/*
+		 * Some of the requests may not have been applied.  Clear whole query
+		 * cache rather than leaving stale entries behind.
+		 */
+		ereport(WARNING,
+				(errmsg("memcache: failed to apply query cache invalidation"),
+				 errdetail("ticket: %llu. clearing whole query cache", (unsigned long long) head)));
+		pool_clear_memory_cache();
+		pool_atomic_write_u64(&invalidation_queue->head, head + n);
+		pool_atomic_write_u64(&invalidation_queue->applied, head + n);
+		return n;
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	/* The slots can be reused now */
+	pool_atomic_write_u64(&invalidation_queue->head, head + n);
+	pool_atomic_write_u64(&invalidation_queue->applied, head + n);
+
+	ereport(DEBUG1,
+			(errmsg("memcache: applied query cache invalidation"),
+			 errdetail("requests: %d tables: %d", n, nreqs)));
+
+	return n;
+}
+
+/*
+ * query cache invalidation worker main loop
+ */
+void
+do_memqcache_invalidator_child(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext InvalidatorMemoryContext;
+	pool_sigset_t run_mask;
+	pool_sigset_t sleep_mask;
+
+	ereport(DEBUG1,
+			(errmsg("I am query cache invalidation worker pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("query cache invalidation worker", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, wakeup_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	/*
+	 * SIGUSR2 is blocked except while sleeping so that a wake up request
+	 * sent just before going to sleep is not lost.
+	 */
+	sleep_mask = UnBlockSig;
+	run_mask = UnBlockSig;
+	sigaddset(&run_mask, SIGUSR2);
+	POOL_SETMASK(&run_mask);
+
+	/* Create per loop iteration memory context */
+	InvalidatorMemoryContext = AllocSetContextCreate(TopMemoryContext,
+													 "memqcache_invalidator_main_loop",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+		POOL_SETMASK(&run_mask);
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	pool_atomic_write_u32(&invalidation_queue->worker_pid, (uint32) getpid());
+
+	for (;;)
+	{
+		MemoryContextSwitchTo(InvalidatorMemoryContext);
+		MemoryContextResetAndDeleteChildren(InvalidatorMemoryContext);
+
+		CHECK_REQUEST;
+
+		if (apply_invalidation_requests() > 0)
+			continue;
+
+		/*
+		 * Nothing to do.  Sleep until a child process wakes us up.  If a
+		 * ticket has been claimed but not published yet, wake up soon.
+		 */
+		pool_atomic_write_u32(&invalidation_queue->sleeping, 1);
+		if (!invalidation_request_published())
+		{
+			struct timespec timeout;
+
+			timeout.tv_sec = 1;
+			timeout.tv_nsec = 0;
+			if (pool_atomic_read_u64(&invalidation_queue->tail) !=
+				pool_atomic_read_u64(&invalidation_queue->head))
+			{
+				timeout.tv_sec = 0;
+				timeout.tv_nsec = 10 * 1000 * 1000;
+			}
+			pselect(0, NULL, NULL, NULL, &timeout, &sleep_mask);
+		}
+		pool_atomic_write_u32(&invalidation_queue->sleeping, 0);
+	}
+}
+
+static RETSIGTYPE my_signal_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+
+	switch (sig)
+	{
+		case SIGTERM:
+		case SIGINT:
+		case SIGQUIT:
+			exit(0);
+			break;
+
+		default:
+			exit(1);
+			break;
+	}
+}
+
+static RETSIGTYPE reload_config_handler(int sig)
+{
+	reload_config_request = 1;
+}
+
+static RETSIGTYPE wakeup_handler(int sig)
+{
+	/* nothing to do. just interrupt pselect() */
+}
+
+static void
+reload_config(void)
+{
+	ereport(LOG,
+			(errmsg("reloading config file")));
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
+	MemoryContextSwitchTo(oldContext);
+	reload_config_request = 0;
+}
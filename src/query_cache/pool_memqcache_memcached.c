@@ -0,0 +1,281 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_memqcache_memcached.c: query cache storage on memcached.
+ *
+ * Memcached has no way to find the entries of a table, so the hash keys of
+ * the entries of each table are remembered in the files under
+ * memqcache_oiddir by pool_memqcache.c.
+ */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_MEMCACHED
+#include <libmemcached/memcached.h>
+#endif
+
+#include "pool.h"
+#include "pool_config.h"
+#include "query_cache/pool_memqcache_storage.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+#ifdef USE_MEMCACHED
+static memcached_st *memc;
+#endif
+
+static int	memcached_connect(void);
+static void memcached_disconnect(void);
+static char *memcached_get_item(const char *key, size_t *len, bool *error);
+static bool memcached_put_item(const char *key, const char *data, size_t len, int expire,
+							   int dboid, int num_oids, int *oids);
+static void memcached_delete_item(const char *key);
+static void memcached_begin_batch(void);
+static void memcached_end_batch(void);
+
+POOL_CACHE_STORAGE pool_memcached_storage = {
+	"memcached",
+	memcached_connect,
+	memcached_disconnect,
+	memcached_get_item,
+	memcached_put_item,
+	memcached_delete_item,
+	memcached_begin_batch,
+	memcached_end_batch,
+	NULL
+};
+
+/*
+ * Connect to Memcached.  memqcache_memcached_host may be a comma separated
+ * list of "host[:port]".  If port is omitted, memqcache_memcached_port is
+ * used.  The connection is kept until the child process exits.
+ */
+static int
+memcached_connect(void)
+{
+	char	   *memqcache_memcached_host;
+	int			memqcache_memcached_port;
+#ifdef USE_MEMCACHED
+	memcached_server_st *servers = NULL;
+	memcached_return rc;
+	char	   *hosts;
+	char	   *host;
+	char	   *saveptr;
+	int			num_servers = 0;
+
+	/* Already connected? */
+	if (memc)
+	{
+		return 0;
+	}
+#endif
+
+	memqcache_memcached_host = pool_config->memqcache_memcached_host;
+	memqcache_memcached_port = pool_config->memqcache_memcached_port;
+
+	ereport(DEBUG1,
+			(errmsg("connecting to memcached on Host:\"%s:%d\"", memqcache_memcached_host, memqcache_memcached_port)));
+
+#ifdef USE_MEMCACHED
+	memc = memcached_create(NULL);
+
+	hosts = pstrdup(memqcache_memcached_host);
+	for (host = strtok_r(hosts, ",", &saveptr); host; host = strtok_r(NULL, ",", &saveptr))
+	{
+		char	   *colon;
+		int			port = memqcache_memcached_port;
+
+		while (isspace((unsigned char) *host))
+			host++;
+		if (*host == '\0')
+			continue;
+
+		/* "host:port" but not an IPv6 address */
+		colon = strrchr(host, ':');
+		if (colon && colon == strchr(host, ':'))
+		{
+			*colon = '\0';
+			port = atoi(colon + 1);
+		}
+
+		servers = memcached_server_list_append(servers, host, port, &rc);
+		if (servers == NULL)
+			break;
+		num_servers++;
+	}
+	pfree(hosts);
+
+	if (servers == NULL)
+	{
+		ereport(WARNING,
+				(errmsg("failed to connect to memcached, invalid memqcache_memcached_host:\"%s\"",
+						memqcache_memcached_host)));
+		memcached_free(memc);
+		memc = (memcached_st *) - 1;
+		return -1;
+	}
+
+	/*
+	 * Distribute keys by consistent hashing so that adding or removing a
+	 * server does not invalidate most of the keys.
+	 */
+	if (num_servers > 1)
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_KETAMA, 1);
+
+	rc = memcached_server_push(memc, servers);
+	memcached_server_list_free(servers);
+	if (rc != MEMCACHED_SUCCESS)
+	{
+		ereport(WARNING,
+				(errmsg("failed to connect to memcached, server push error:\"%s\"\n", memcached_strerror(memc, rc))));
+		memc = (memcached_st *) - 1;
+		return -1;
+	}
+#else
+	ereport(WARNING,
+			(errmsg("failed to connect to memcached, memcached support is not enabled")));
+	return -1;
+#endif
+	return 0;
+}
+
+/*
+ * Disconnect to Memcached
+ */
+static void
+memcached_disconnect(void)
+{
+#ifdef USE_MEMCACHED
+	if (!memc)
+	{
+		return;
+	}
+	memcached_free(memc);
+#else
+	ereport(WARNING,
+			(errmsg("failed to disconnect from memcached, memcached support is not enabled")));
+#endif
+}
+
+static char *
+memcached_get_item(const char *key, size_t *len, bool *error)
+{
+#ifdef USE_MEMCACHED
+	memcached_return rc;
+	unsigned int flags;
+	char	   *ptr;
+	char	   *p;
+
+	*error = false;
+	ptr = memcached_get(memc, key, strlen(key), len, &flags, &rc);
+
+	if (rc != MEMCACHED_SUCCESS)
+	{
+		if (rc != MEMCACHED_NOTFOUND)
+		{
+			ereport(LOG,
+					(errmsg("fetching from cache storage, memcached_get failed with error: \"%s\"", memcached_strerror(memc, rc))));
+
+			/*
+			 * Turn off memory cache support to prevent future errors.
+			 */
+			pool_config->memory_cache_enabled = 0;
+			*error = true;
+		}
+		return NULL;
+	}
+
+	p = palloc(*len);
+	memcpy(p, ptr, *len);
+	free(ptr);
+	return p;
+#else
+	ereport(ERROR,
+			(errmsg("memcached support is not enabled")));
+	return NULL;
+#endif
+}
+
+static bool
+memcached_put_item(const char *key, const char *data, size_t len, int expire,
+				   int dboid, int num_oids, int *oids)
+{
+#ifdef USE_MEMCACHED
+	memcached_return rc;
+
+	rc = memcached_set(memc, key, 32, data, len, (time_t) expire, 0);
+	if (rc != MEMCACHED_SUCCESS)
+	{
+		ereport(WARNING,
+				(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * delete query cache on memcached
+ */
+static void
+memcached_delete_item(const char *key)
+{
+#ifdef USE_MEMCACHED
+	memcached_return rc;
+
+	ereport(DEBUG2,
+			(errmsg("memcache: deleting cache on memcached with key: \"%s\"", key)));
+
+	/* delete cache data on memcached. key is hashed query */
+	rc = memcached_delete(memc, key, 32, (time_t) 0);
+
+	/* delete cache data on memcached is failed */
+	if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
+	{
+		ereport(LOG,
+				(errmsg("failed to delete cache on memcached, error:\"%s\"", memcached_strerror(memc, rc))));
+	}
+#endif
+}
+
+/*
+ * A table may be used by many cache entries.  Rather than waiting for the
+ * reply of each delete command, buffer the commands and send them at once.
+ */
+static void
+memcached_begin_batch(void)
+{
+#ifdef USE_MEMCACHED
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_NOREPLY, 1);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+#endif
+}
+
+static void
+memcached_end_batch(void)
+{
+#ifdef USE_MEMCACHED
+	memcached_flush_buffers(memc);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 0);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_NOREPLY, 0);
+#endif
+}
@@ -0,0 +1,701 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_memqcache_redis.c: query cache storage on Redis or Valkey.
+ *
+ * A cache entry is stored in key "pgpool:qc:<hash key>".  The keys of the
+ * entries using a table are kept in set "pgpool:qt:<database oid>:<table
+ * oid>", which expires with the last entry in it, so that all the pgpool
+ * nodes sharing the server can invalidate the entries of a table with a
+ * script in one round trip.  The commands of an operation are pipelined.
+ *
+ * The server is spoken to by the RESP protocol directly.
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "parser/stringinfo.h"
+#include "query_cache/pool_memqcache_storage.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+
+#define REDIS_IO_TIMEOUT			5	/* seconds to wait for the server */
+#define REDIS_RECONNECT_INTERVAL	5	/* seconds before retrying to
+										 * connect after a failure */
+#define REDIS_ENTRY_KEY_FORMAT		"pgpool:qc:%.32s"
+#define REDIS_TAG_KEY_FORMAT		"pgpool:qt:%d:%d"
+#define REDIS_MAX_KEY				64
+
+/*
+ * Add entry ARGV[1] to the tags in KEYS.  A tag lives as long as the entry
+ * living longest in it: its TTL is raised to ARGV[2] seconds, and it is
+ * made persistent if ARGV[2] is 0, which means the entry never expires.
+ * A tag that is already persistent stays so.
+ */
+#define REDIS_ADD_TAG_SCRIPT \
+	"local ttl = tonumber(ARGV[2]) " \
+	"for _, tag in ipairs(KEYS) do " \
+	"  local cur = redis.call('TTL', tag) " \
+	"  redis.call('SADD', tag, ARGV[1]) " \
+	"  if ttl == 0 then " \
+	"    redis.call('PERSIST', tag) " \
+	"  elseif cur == -2 or (cur >= 0 and cur < ttl) then " \
+	"    redis.call('EXPIRE', tag, ttl) " \
+	"  end " \
+	"end " \
+	"return #KEYS"
+
+/*
+ * Delete the entries of the tags in KEYS and the tags.
+ */
+#define REDIS_INVALIDATE_SCRIPT \
+	"local n = 0 " \
+	"for _, tag in ipairs(KEYS) do " \
+	"  local keys = redis.call('SMEMBERS', tag) " \
+	"  for i = 1, #keys, 1000 do " \
+	"    n = n + redis.call('DEL', unpack(keys, i, math.min(i + 999, #keys))) " \
+	"  end " \
+	"  redis.call('DEL', tag) " \
+	"end " \
+	"return n"
+
+/*
+ * Delete the entries of the tags matching ARGV[1] and the tags.
+ */
+#define REDIS_INVALIDATE_DB_SCRIPT \
+	"local n = 0 " \
+	"local cursor = '0' " \
+	"repeat " \
+	"  local r = redis.call('SCAN', cursor, 'MATCH', ARGV[1], 'COUNT', 1000) " \
+	"  cursor = r[1] " \
+	"  for _, tag in ipairs(r[2]) do " \
+	"    local keys = redis.call('SMEMBERS', tag) " \
+	"    for i = 1, #keys, 1000 do " \
+	"      n = n + redis.call('DEL', unpack(keys, i, math.min(i + 999, #keys))) " \
+	"    end " \
+	"    redis.call('DEL', tag) " \
+	"  end " \
+	"until cursor == '0' " \
+	"return n"
+
+typedef struct RedisReply
+{
+	char		type;			/* '+', '-', ':', '$', '*' or 'n' for nil */
+	int64		integer;
+	char	   *str;			/* status, error or bulk string */
+	size_t		len;
+	int			nelements;
+	struct RedisReply *elements;
+}			RedisReply;
+
+static int	redis_fd = -1;
+static time_t redis_failed_time;
+
+/* receive buffer */
+static char redis_buf[8192];
+static int	redis_buf_pos;
+static int	redis_buf_len;
+
+static int	redis_connect(void);
+static void redis_disconnect(void);
+static char *redis_get_item(const char *key, size_t *len, bool *error);
+static bool redis_put_item(const char *key, const char *data, size_t len, int expire,
+						   int dboid, int num_oids, int *oids);
+static void redis_delete_item(const char *key);
+static void redis_delete_by_tag(int dboid, int num_oids, int *oids);
+
+static void redis_close(void);
+static void redis_append_command(StringInfo buf, int argc, const char **argv, const size_t *argvlen);
+static bool redis_send(StringInfo buf);
+static bool redis_read_bytes(char *p, size_t len);
+static char *redis_read_line(void);
+static bool redis_read_reply(RedisReply * reply);
+static bool redis_check_reply(RedisReply * reply, const char *command);
+
+POOL_CACHE_STORAGE pool_redis_storage = {
+	"redis",
+	redis_connect,
+	redis_disconnect,
+	redis_get_item,
+	redis_put_item,
+	redis_delete_item,
+	NULL,
+	NULL,
+	redis_delete_by_tag
+};
+
+/*
+ * Connect to the server of memqcache_redis_host and memqcache_redis_port,
+ * and authenticate if memqcache_redis_password is set.  If the last attempt
+ * failed recently, fail without trying so that queries are not delayed by
+ * the connection timeout each time while the server is down.
+ */
+static int
+redis_connect(void)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *walk;
+	struct timeval timeout;
+	char		portstr[16];
+	int			on = 1;
+	int			ret;
+
+	if (redis_fd >= 0)
+		return 0;
+
+	if (redis_failed_time != 0 && time(NULL) - redis_failed_time < REDIS_RECONNECT_INTERVAL)
+		return -1;
+
+	ereport(DEBUG1,
+			(errmsg("connecting to redis on Host:\"%s:%d\"",
+					pool_config->memqcache_redis_host, pool_config->memqcache_redis_port)));
+
+	snprintf(portstr, sizeof(portstr), "%d", pool_config->memqcache_redis_port);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if ((ret = getaddrinfo(pool_config->memqcache_redis_host, portstr, &hints, &res)) != 0)
+	{
+		ereport(WARNING,
+				(errmsg("failed to connect to redis, getaddrinfo() failed with error \"%s\"", gai_strerror(ret))));
+		redis_failed_time = time(NULL);
+		return -1;
+	}
+
+	timeout.tv_sec = REDIS_IO_TIMEOUT;
+	timeout.tv_usec = 0;
+
+	for (walk = res; walk != NULL; walk = walk->ai_next)
+	{
+		redis_fd = socket(walk->ai_family, walk->ai_socktype, walk->ai_protocol);
+		if (redis_fd < 0)
+			continue;
+
+		/* the timeouts apply to connect() as well */
+		setsockopt(redis_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(redis_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		setsockopt(redis_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		if (connect(redis_fd, walk->ai_addr, walk->ai_addrlen) == 0)
+			break;
+
+		close(redis_fd);
+		redis_fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (redis_fd < 0)
+	{
+		ereport(WARNING,
+				(errmsg("failed to connect to redis on Host:\"%s:%d\"",
+						pool_config->memqcache_redis_host, pool_config->memqcache_redis_port),
+				 errdetail("%m")));
+		redis_failed_time = time(NULL);
+		return -1;
+	}
+
+	redis_buf_pos = redis_buf_len = 0;
+
+	if (*pool_config->memqcache_redis_password != '\0')
+	{
+		StringInfoData buf;
+		RedisReply	reply;
+		const char *argv[2];
+		size_t		argvlen[2];
+
+		argv[0] = "AUTH";
+		argvlen[0] = 4;
+		argv[1] = pool_config->memqcache_redis_password;
+		argvlen[1] = strlen(argv[1]);
+
+		initStringInfo(&buf);
+		redis_append_command(&buf, 2, argv, argvlen);
+		if (!redis_send(&buf) || !redis_read_reply(&reply) ||
+			!redis_check_reply(&reply, "AUTH"))
+		{
+			pfree(buf.data);
+			redis_close();
+			redis_failed_time = time(NULL);
+			return -1;
+		}
+		pfree(buf.data);
+	}
+
+	redis_failed_time = 0;
+	return 0;
+}
+
+static void
+redis_disconnect(void)
+{
+	redis_close();
+}
+
+static char *
+redis_get_item(const char *key, size_t *len, bool *error)
+{
+	StringInfoData buf;
+	RedisReply	reply;
+	char		rkey[REDIS_MAX_KEY];
+	const char *argv[2];
+	size_t		argvlen[2];
+
+	*error = false;
+	if (redis_connect() < 0)
+	{
+		*error = true;
+		return NULL;
+	}
+
+	snprintf(rkey, sizeof(rkey), REDIS_ENTRY_KEY_FORMAT, key);
+	argv[0] = "GET";
+	argvlen[0] = 3;
+	argv[1] = rkey;
+	argvlen[1] = strlen(rkey);
+
+	initStringInfo(&buf);
+	redis_append_command(&buf, 2, argv, argvlen);
+	if (!redis_send(&buf) || !redis_read_reply(&reply) ||
+		!redis_check_reply(&reply, "GET"))
+	{
+		pfree(buf.data);
+		*error = true;
+		return NULL;
+	}
+	pfree(buf.data);
+
+	if (reply.type != '$')
+		return NULL;
+
+	*len = reply.len;
+	return reply.str;
+}
+
+/*
+ * Store the entry and add its key to the tags of the tables in a
+ * transaction, so that no invalidation can come in between.
+ */
+static bool
+redis_put_item(const char *key, const char *data, size_t len, int expire,
+			   int dboid, int num_oids, int *oids)
+{
+	StringInfoData buf;
+	RedisReply	reply;
+	char		rkey[REDIS_MAX_KEY];
+	char		ttl[16];
+	char		numkeys[16];
+	const char **argv;
+	size_t	   *argvlen;
+	int			num_tags = dboid > 0 ? num_oids : 0;
+	int			num_commands = 0;
+	bool		ok = true;
+	int			i;
+
+	if (redis_connect() < 0)
+		return false;
+
+	snprintf(rkey, sizeof(rkey), REDIS_ENTRY_KEY_FORMAT, key);
+	snprintf(ttl, sizeof(ttl), "%d", expire > 0 ? expire : 0);
+
+	argv = palloc(sizeof(char *) * (5 + num_tags));
+	argvlen = palloc(sizeof(size_t) * (5 + num_tags));
+
+	initStringInfo(&buf);
+
+	argv[0] = "MULTI";
+	argvlen[0] = 5;
+	redis_append_command(&buf, 1, argv, argvlen);
+
+	argv[0] = "SET";
+	argvlen[0] = 3;
+	argv[1] = rkey;
+	argvlen[1] = strlen(rkey);
+	argv[2] = data;
+	argvlen[2] = len;
+	argv[3] = "EX";
+	argvlen[3] = 2;
+	argv[4] = ttl;
+	argvlen[4] = strlen(ttl);
+	redis_append_command(&buf, expire > 0 ? 5 : 3, argv, argvlen);
+	num_commands++;
+
+	if (num_tags > 0)
+	{
+		/* add the key to the tags and adjust their TTL atomically */
+		snprintf(numkeys, sizeof(numkeys), "%d", num_tags);
+		argv[0] = "EVAL";
+		argv[1] = REDIS_ADD_TAG_SCRIPT;
+		argv[2] = numkeys;
+		for (i = 0; i < num_tags; i++)
+			argv[3 + i] = psprintf(REDIS_TAG_KEY_FORMAT, dboid, oids[i]);
+		argv[3 + num_tags] = rkey;
+		argv[4 + num_tags] = ttl;
+		for (i = 0; i < 5 + num_tags; i++)
+			argvlen[i] = strlen(argv[i]);
+		redis_append_command(&buf, 5 + num_tags, argv, argvlen);
+		num_commands++;
+
+		for (i = 0; i < num_tags; i++)
+			pfree((char *) argv[3 + i]);
+	}
+
+	argv[0] = "EXEC";
+	argvlen[0] = 4;
+	redis_append_command(&buf, 1, argv, argvlen);
+
+	pfree(argv);
+	pfree(argvlen);
+
+	if (!redis_send(&buf))
+	{
+		pfree(buf.data);
+		return false;
+	}
+	pfree(buf.data);
+
+	/* replies of MULTI and the queued commands */
+	for (i = 0; i < num_commands + 1; i++)
+	{
+		if (!redis_read_reply(&reply))
+			return false;
+		if (!redis_check_reply(&reply, "MULTI"))
+			ok = false;
+	}
+
+	/* reply of EXEC */
+	if (!redis_read_reply(&reply))
+		return false;
+	if (!redis_check_reply(&reply, "EXEC") || reply.type != '*')
+		return false;
+
+	for (i = 0; i < reply.nelements; i++)
+	{
+		if (!redis_check_reply(&reply.elements[i], i == 0 ? "SET" : "EVAL"))
+			ok = false;
+	}
+
+	return ok;
+}
+
+static void
+redis_delete_item(const char *key)
+{
+	StringInfoData buf;
+	RedisReply	reply;
+	char		rkey[REDIS_MAX_KEY];
+	const char *argv[2];
+	size_t		argvlen[2];
+
+	if (redis_connect() < 0)
+		return;
+
+	snprintf(rkey, sizeof(rkey), REDIS_ENTRY_KEY_FORMAT, key);
+	argv[0] = "DEL";
+	argvlen[0] = 3;
+	argv[1] = rkey;
+	argvlen[1] = strlen(rkey);
+
+	initStringInfo(&buf);
+	redis_append_command(&buf, 2, argv, argvlen);
+	if (redis_send(&buf) && redis_read_reply(&reply))
+		redis_check_reply(&reply, "DEL");
+	pfree(buf.data);
+}
+
+/*
+ * Delete the entries of the tables, or of the database if num_oids is -1.
+ */
+static void
+redis_delete_by_tag(int dboid, int num_oids, int *oids)
+{
+	StringInfoData buf;
+	RedisReply	reply;
+	const char **argv;
+	size_t	   *argvlen;
+	char		numkeys[16];
+	int			argc;
+	int			i;
+
+	if (num_oids == 0 || redis_connect() < 0)
+		return;
+
+	argc = 3 + (num_oids > 0 ? num_oids : 1);
+	argv = palloc(sizeof(char *) * argc);
+	argvlen = palloc(sizeof(size_t) * argc);
+
+	argv[0] = "EVAL";
+	if (num_oids > 0)
+	{
+		argv[1] = REDIS_INVALIDATE_SCRIPT;
+		snprintf(numkeys, sizeof(numkeys), "%d", num_oids);
+		for (i = 0; i < num_oids; i++)
+			argv[3 + i] = psprintf(REDIS_TAG_KEY_FORMAT, dboid, oids[i]);
+	}
+	else
+	{
+		argv[1] = REDIS_INVALIDATE_DB_SCRIPT;
+		strcpy(numkeys, "0");
+		argv[3] = psprintf("pgpool:qt:%d:*", dboid);
+	}
+	argv[2] = numkeys;
+	for (i = 0; i < argc; i++)
+		argvlen[i] = strlen(argv[i]);
+
+	initStringInfo(&buf);
+	redis_append_command(&buf, argc, argv, argvlen);
+	if (redis_send(&buf) && redis_read_reply(&reply) &&
+		redis_check_reply(&reply, "EVAL"))
+	{
+		ereport(DEBUG1,
+				(errmsg("memcache: invalidating query cache on redis"),
+				 errdetail("deleted %lld entries", (long long) reply.integer)));
+	}
+
+	for (i = 3; i < argc; i++)
+		pfree((char *) argv[i]);
+	pfree(argv);
+	pfree(argvlen);
+	pfree(buf.data);
+}
+
+static void
+redis_close(void)
+{
+	if (redis_fd >= 0)
+		close(redis_fd);
+	redis_fd = -1;
+	redis_buf_pos = redis_buf_len = 0;
+}
+
+/*
+ * Append a command in RESP format to buf.
+ */
+static void
+redis_append_command(StringInfo buf, int argc, const char **argv, const size_t *argvlen)
+{
+	int			i;
+
+	appendStringInfo(buf, "*%d\r\n", argc);
+	for (i = 0; i < argc; i++)
+	{
+		appendStringInfo(buf, "$%zu\r\n", argvlen[i]);
+		appendBinaryStringInfo(buf, argv[i], argvlen[i]);
+		appendBinaryStringInfo(buf, "\r\n", 2);
+	}
+}
+
+/*
+ * Send the commands in buf.  The connection is closed on failure.
+ */
+static bool
+redis_send(StringInfo buf)
+{
+	int			sent = 0;
+
+	while (sent < buf->len)
+	{
+		ssize_t		n = write(redis_fd, buf->data + sent, buf->len - sent);
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(WARNING,
+					(errmsg("failed to send command to redis"),
+					 errdetail("%m")));
+			redis_close();
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+static bool
+redis_read_bytes(char *p, size_t len)
+{
+	while (len > 0)
+	{
+		size_t		n;
+
+		if (redis_buf_pos >= redis_buf_len)
+		{
+			ssize_t		r = read(redis_fd, redis_buf, sizeof(redis_buf));
+
+			if (r <= 0)
+			{
+				if (r < 0 && errno == EINTR)
+					continue;
+				if (r == 0)
+					ereport(WARNING,
+							(errmsg("failed to read reply from redis"),
+							 errdetail("connection closed by the server")));
+				else
+					ereport(WARNING,
+							(errmsg("failed to read reply from redis"),
+							 errdetail("%m")));
+				redis_close();
+				return false;
+			}
+			redis_buf_pos = 0;
+			redis_buf_len = r;
+		}
+
+		n = Min(len, redis_buf_len - redis_buf_pos);
+		memcpy(p, redis_buf + redis_buf_pos, n);
+		redis_buf_pos += n;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/*
+ * Read a line terminated by CRLF.  Returns palloc'd line without CRLF or
+ * NULL on failure.
+ */
+static char *
+redis_read_line(void)
+{
+	StringInfoData line;
+	char		c;
+
+	initStringInfo(&line);
+	for (;;)
+	{
+		if (!redis_read_bytes(&c, 1))
+		{
+			pfree(line.data);
+			return NULL;
+		}
+		if (c == '\n' && line.len > 0 && line.data[line.len - 1] == '\r')
+		{
+			line.data[--line.len] = '\0';
+			return line.data;
+		}
+		appendStringInfoChar(&line, c);
+	}
+}
+
+/*
+ * Read a reply.  The strings and elements of the reply are palloc'd.  The
+ * connection is closed on failure.
+ */
+static bool
+redis_read_reply(RedisReply * reply)
+{
+	char	   *line = redis_read_line();
+	long long	n;
+	int			i;
+
+	if (line == NULL)
+		return false;
+
+	memset(reply, 0, sizeof(*reply));
+	reply->type = line[0];
+
+	switch (reply->type)
+	{
+		case '+':
+		case '-':
+			reply->str = pstrdup(line + 1);
+			reply->len = strlen(reply->str);
+			break;
+
+		case ':':
+			reply->integer = strtoll(line + 1, NULL, 10);
+			break;
+
+		case '$':
+			n = strtoll(line + 1, NULL, 10);
+			if (n < 0)
+			{
+				reply->type = 'n';
+				break;
+			}
+			reply->str = palloc(n + 2);
+			if (!redis_read_bytes(reply->str, n + 2))
+			{
+				pfree(line);
+				return false;
+			}
+			reply->str[n] = '\0';
+			reply->len = n;
+			break;
+
+		case '*':
+			n = strtoll(line + 1, NULL, 10);
+			if (n < 0)
+			{
+				reply->type = 'n';
+				break;
+			}
+			reply->nelements = n;
+			reply->elements = palloc0(sizeof(RedisReply) * (n + 1));
+			for (i = 0; i < n; i++)
+			{
+				if (!redis_read_reply(&reply->elements[i]))
+				{
+					pfree(line);
+					return false;
+				}
+			}
+			break;
+
+		default:
+			ereport(WARNING,
+					(errmsg("invalid reply from redis"),
+					 errdetail("reply starts with \"%c\"", line[0])));
+			pfree(line);
+			redis_close();
+			return false;
+	}
+
+	pfree(line);
+	return true;
+}
+
+/*
+ * Report an error reply of the command.
+ */
+static bool
+redis_check_reply(RedisReply * reply, const char *command)
+{
+	if (reply->type != '-')
+		return true;
+
+	ereport(WARNING,
+			(errmsg("redis %s command failed", command),
+			 errdetail("%s", reply->str)));
+	return false;
+}
@@ -23,6 +23,7 @@
  * lo_create anyway.
  */
 #include "config.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -34,6 +35,45 @@
 #include "protocol/pool_process_query.h"
 #include "utils/elog.h"
 #include "pool_config.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_ipc.h"
+
+/*
+ * Range of large object ids reserved by lobj_oid_batch_size, shared among
+ * child processes and protected by LOBJ_OID_SEM.
+ */
+typedef struct
+{
+	int			next;			/* next large object id to hand out */
+	int			end;			/* end of the range, exclusive */
+}			LobjOidRange;
+
+static LobjOidRange *lobj_oid_range;
+
+static bool allocate_lobj_key(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int *lobjid);
+static bool get_max_lobj_key(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int *lobjid);
+
+/*
+ * Size of shared memory needed by the large object id range.
+ */
+size_t
+pool_lobj_shmem_size(void)
+{
+	return MAXALIGN(sizeof(LobjOidRange));
+}
+
+/*
+ * Allocate and initialize the large object id range.  This should be
+ * called only once from pgpool main process at the process starting up
+ * time.
+ */
+void
+pool_init_lobj_oid_range(void)
+{
+	lobj_oid_range = pool_shared_memory_segment_get_chunk(pool_lobj_shmem_size());
+	lobj_oid_range->next = 0;
+	lobj_oid_range->end = 0;
+}
 
 /*
  * Rewrite lo_creat call to lo_create call if:
@@ -43,7 +83,9 @@
  * 4) lobj_lock_table exists and writable to everyone
  *
  * The argument for lo_create is created by fetching max(loid)+1 from
- * pg_largeobject. To avoid race condition, we lock lobj_lock_table.
+ * pg_largeobject. To avoid race condition, we lock lobj_lock_table.  With
+ * lobj_oid_batch_size, the ids are instead handed out from a range
+ * reserved that way (see allocate_lobj_key()).
  *
  * Caller should call this only if protocol is V3 or higher(for
  * now. There's no reason for this function not working with V2
@@ -61,10 +103,6 @@ pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 
 #define LO_CREATE_PACKET_LENGTH sizeof(int32)*3+sizeof(int16)*4
 
-#define LOCK_QUERY "LOCK TABLE %s IN SHARE ROW EXCLUSIVE MODE"
-
-#define GET_MAX_LOBJ_KEY "SELECT coalesce(max(loid)::INTEGER, 0)+1 FROM pg_catalog.pg_largeobject"
-
 	static char rewritten_packet[LO_CREATE_PACKET_LENGTH];
 
 	static POOL_RELCACHE * relcache_lo_creat;
@@ -73,10 +111,7 @@ pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 	int			lo_creat_oid;
 	int			lo_create_oid;
 	int			orig_fcall_oid;
-	POOL_STATUS status;
-	char		qbuf[1024];
 	char	   *p;
-	POOL_SELECT_RESULT *result;
 	int			lobjid;
 	int32		int32val;
 	int16		int16val;
@@ -167,50 +202,8 @@ pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 			(errmsg("rewriting LO CREATE"),
 			 errdetail("return format code: %d", int16val)));
 
-	/*
-	 * Ok, do it...
-	 */
-	/* issue lock table command to lob_lock_table */
-	snprintf(qbuf, sizeof(qbuf), "LOCK TABLE %s IN SHARE ROW EXCLUSIVE MODE", pool_config->lobj_lock_table);
-	per_node_statement_log(backend, MAIN_NODE_ID, qbuf);
-	status = do_command(frontend, MAIN(backend), qbuf, MAJOR(backend), MAIN_CONNECTION(backend)->pid,
-						MAIN_CONNECTION(backend)->key, 0);
-	if (status == POOL_END)
-	{
-		ereport(WARNING,
-				(errmsg("rewriting LO CREATE, failed to execute LOCK")));
-		return NULL;
-	}
-
-	/*
-	 * If transaction state is E, do_command failed to execute command
-	 */
-	if (TSTATE(backend, MAIN_NODE_ID) == 'E')
-	{
-		ereport(LOG,
-				(errmsg("failed while rewriting LO CREATE"),
-				 errdetail("failed to execute: %s", qbuf)));
-		return NULL;
-	}
-
-	/* get max lobj id */
-	per_node_statement_log(backend, MAIN_NODE_ID, GET_MAX_LOBJ_KEY);
-	do_query(MAIN(backend), GET_MAX_LOBJ_KEY, &result, MAJOR(backend));
-
-	if (!result)
-	{
-		ereport(LOG,
-				(errmsg("failed while rewriting LO CREATE"),
-				 errdetail("failed to execute: %s", GET_MAX_LOBJ_KEY)));
+	if (!allocate_lobj_key(frontend, backend, &lobjid))
 		return NULL;
-	}
-
-	lobjid = atoi(result->data[0]);
-	ereport(DEBUG1,
-			(errmsg("rewriting LO CREATE"),
-			 errdetail("lobjid:%d", lobjid)));
-
-	free_select_result(result);
 
 	/* sanity check */
 	if (lobjid <= 0)
@@ -256,3 +249,127 @@ pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 
 	return rewritten_packet;
 }
+
+/*
+ * Get a large object id to create into *lobjid.  Returns false if the
+ * queries failed.  Without lobj_oid_batch_size, it is max(loid)+1 of pg_largeobject looked
+ * up under the lock of lobj_lock_table.  Otherwise ids are handed out from
+ * the range shared among children, and only when it runs out is
+ * pg_largeobject looked up, reserving the next lobj_oid_batch_size ids.
+ */
+static bool
+allocate_lobj_key(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int *lobjid)
+{
+	pool_sigset_t oldmask;
+	int			key;
+
+	if (lobj_oid_range == NULL)
+		return get_max_lobj_key(frontend, backend, lobjid);
+
+	*lobjid = 0;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(LOBJ_OID_SEM);
+	if (lobj_oid_range->next < lobj_oid_range->end)
+		*lobjid = lobj_oid_range->next++;
+	pool_semaphore_unlock(LOBJ_OID_SEM);
+	POOL_SETMASK(&oldmask);
+
+	if (*lobjid > 0)
+		return true;
+
+	/* the range ran out, reserve the next one */
+	if (!get_max_lobj_key(frontend, backend, &key))
+		return false;
+	if (key <= 0)
+	{
+		*lobjid = key;
+		return true;
+	}
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(LOBJ_OID_SEM);
+
+	/* another child may have reserved one meanwhile */
+	if (lobj_oid_range->next >= lobj_oid_range->end)
+	{
+		/*
+		 * Ids handed out already are not in pg_largeobject until their
+		 * transactions commit, so never go back below the old range.
+		 */
+		lobj_oid_range->next = Max(key, lobj_oid_range->end);
+		if (lobj_oid_range->next > INT_MAX - pool_config->lobj_oid_batch_size)
+			lobj_oid_range->end = INT_MAX;
+		else
+			lobj_oid_range->end = lobj_oid_range->next + pool_config->lobj_oid_batch_size;
+
+		ereport(DEBUG1,
+				(errmsg("rewriting LO CREATE"),
+				 errdetail("reserved lobj ids %d to %d", lobj_oid_range->next, lobj_oid_range->end - 1)));
+	}
+	if (lobj_oid_range->next < lobj_oid_range->end)
+		*lobjid = lobj_oid_range->next++;
+
+	pool_semaphore_unlock(LOBJ_OID_SEM);
+	POOL_SETMASK(&oldmask);
+
+	return true;
+}
+
+/*
+ * Lock lobj_lock_table and get max(loid)+1 of pg_largeobject on the main
+ * node into *lobjid.  Returns false on failure.
+ */
+static bool
+get_max_lobj_key(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, int *lobjid)
+{
+#define GET_MAX_LOBJ_KEY "SELECT coalesce(max(loid)::INTEGER, 0)+1 FROM pg_catalog.pg_largeobject"
+
+	POOL_STATUS status;
+	char		qbuf[1024];
+	POOL_SELECT_RESULT *result;
+
+	/* issue lock table command to lob_lock_table */
+	snprintf(qbuf, sizeof(qbuf), "LOCK TABLE %s IN SHARE ROW EXCLUSIVE MODE", pool_config->lobj_lock_table);
+	per_node_statement_log(backend, MAIN_NODE_ID, qbuf);
+	status = do_command(frontend, MAIN(backend), qbuf, MAJOR(backend), MAIN_CONNECTION(backend)->pid,
+						MAIN_CONNECTION(backend)->key, 0);
+	if (status == POOL_END)
+	{
+		ereport(WARNING,
+				(errmsg("rewriting LO CREATE, failed to execute LOCK")));
+		return false;
+	}
+
+	/*
+	 * If transaction state is E, do_command failed to execute command
+	 */
+	if (TSTATE(backend, MAIN_NODE_ID) == 'E')
+	{
+		ereport(LOG,
+				(errmsg("failed while rewriting LO CREATE"),
+				 errdetail("failed to execute: %s", qbuf)));
+		return false;
+	}
+
+	/* get max lobj id */
+	per_node_statement_log(backend, MAIN_NODE_ID, GET_MAX_LOBJ_KEY);
+	do_query(MAIN(backend), GET_MAX_LOBJ_KEY, &result, MAJOR(backend));
+
+	if (!result)
+	{
+		ereport(LOG,
+				(errmsg("failed while rewriting LO CREATE"),
+				 errdetail("failed to execute: %s", GET_MAX_LOBJ_KEY)));
+		return false;
+	}
+
+	*lobjid = atoi(result->data[0]);
+	ereport(DEBUG1,
+			(errmsg("rewriting LO CREATE"),
+			 errdetail("lobjid:%d", *lobjid)));
+
+	free_select_result(result);
+
+	return true;
+}
@@ -20,17 +20,21 @@
  *
  */
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "pool.h"
 #include "rewrite/pool_timestamp.h"
 #include "utils/elog.h"
 #include "utils/pool_relcache.h"
 #include "utils/pool_select_walker.h"
+#include "utils/pool_shared_relcache.h"
 #include "pool_config.h"
 #include "parser/parsenodes.h"
 #include "parser/parser.h"
+#include "parser/stringinfo.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "context/pool_session_context.h"
@@ -61,13 +65,86 @@ typedef struct
 									 * instead of const */
 	bool		rewrite;		/* has rewritten? */
 	List	   *params;			/* list of additional params */
+	const char *source;			/* original query text, or NULL if the
+								 * rewritten query cannot be spliced from it */
+	List	   *edits;			/* list of TSEdit */
 }			TSRewriteContext;
 
+/*
+ * A rewritten subtree whose text spans [start, end) of the original query.
+ * If every rewrite is of this kind, the rewritten query is made by copying
+ * the original query and deparsing only these subtrees, which is much
+ * cheaper than deparsing the whole statement.
+ */
+typedef struct
+{
+	int			start;
+	int			end;
+	Node	   *node;
+	bool		parenthesize;	/* wrap the deparsed subtree in parentheses */
+}			TSEdit;
+
+/*
+ * Cache of rewritten query text for simple queries.  Rewriting the same
+ * query text always gives the same result, except for the timestamp
+ * literal.  So we keep the rewritten text with TS_PLACEHOLDER in place of
+ * the timestamp, and later only the timestamp needs to be substituted.
+ * The cache is per process and direct mapped by the hash of the database
+ * name and the query.  An entry expires like the relation cache it was
+ * built from (relcache_expire), and when the shared relation cache is
+ * invalidated by DDL.
+ */
+#define TS_TEMPLATE_CACHE_SIZE		128 /* number of cached queries */
+#define TS_TEMPLATE_MAX_QUERY_LEN	8192	/* longer queries are not cached */
+#define TS_PLACEHOLDER				"\001ts\001"
+
+typedef struct
+{
+	char	   *dbname;			/* database name */
+	char	   *query;			/* original query. NULL if unused */
+	char	   *template;		/* rewritten query with TS_PLACEHOLDER. NULL
+								 * if the query need not to be rewritten */
+	time_t		expire;			/* cache expiration time. 0 means never */
+	uint32		generation;		/* shared relcache generation */
+}			TSTemplate;
+
+static TSTemplate ts_templates[TS_TEMPLATE_CACHE_SIZE];
+
+/*
+ * Clock of the main node estimated locally.  If timestamp_sync_interval
+ * is set, we ask the main node for clock_timestamp() and its time zone
+ * offset once per interval, and in between derive the current time from
+ * the local monotonic clock.  The estimation is discarded when the
+ * backend connection or its TimeZone parameter changes.
+ */
+typedef struct
+{
+	int			backend_pid;	/* main backend pid at synchronization */
+	char		timezone[64];	/* TimeZone parameter at synchronization */
+	double		epoch;			/* main node clock at synchronization */
+	int			tz_offset;		/* time zone offset in seconds east of UTC */
+	struct timespec synced;		/* local monotonic clock at synchronization */
+}			TSClock;
+
+static TSClock ts_clock;
+
+static TSTemplate * ts_template_slot(char *dbname, char *query);
+static bool ts_template_valid(TSTemplate * tmpl, char *dbname, char *query);
+static void ts_template_store(TSTemplate * tmpl, char *dbname, char *query,
+							  char *template, uint32 generation);
+static char *ts_template_expand(char *template, char *timestamp);
+static bool get_local_timestamp(POOL_CONNECTION_POOL * backend, char *buf, size_t len);
+static bool sync_ts_clock(POOL_CONNECTION_POOL * backend, char *timezone);
 static void *ts_register_func(POOL_SELECT_RESULT * res);
 static void *ts_unregister_func(void *data);
 static TSRel * relcache_lookup(TSRewriteContext * ctx);
 static bool isStringConst(Node *node, const char *str);
 static bool rewrite_timestamp_walker(Node *node, void *context);
+static void ts_add_edit(TSRewriteContext * ctx, Node *node, int start, int end,
+						bool parenthesize);
+static int	ts_now_end(const char *query, int location);
+static int	ts_keyword_end(const char *query, int location, bool precision);
+static char *ts_splice(TSRewriteContext * ctx);
 static bool rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx);
 static bool rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext * ctx);
 static char *get_current_timestamp(POOL_CONNECTION_POOL * backend);
@@ -378,6 +455,10 @@ rewrite_timestamp_walker(Node *node, void *context)
 				{
 					TypeCast   *tc = makeNode(TypeCast);
 
+					if (ctx->source)
+						ts_add_edit(ctx, node, fcall->location,
+									ts_now_end(ctx->source, fcall->location), false);
+
 					tc->arg = makeTsExpr(ctx);
 					tc->typeName = SystemTypeName("text");
 
@@ -413,6 +494,11 @@ rewrite_timestamp_walker(Node *node, void *context)
 					TypeCast   *tc,
 							   *tc1;
 
+					if (ctx->source)
+						ts_add_edit(ctx, node, svf->location,
+									ts_keyword_end(ctx->source, svf->location, svf->typmod >= 0),
+									true);
+
 					tc1 = makeTypeCastFromSvfOp(svf->op);
 
 					tc = (TypeCast *) node;
@@ -458,6 +544,7 @@ rewrite_timestamp_walker(Node *node, void *context)
 					{
 						tc->arg = (Node *) makeTsExpr(ctx);
 						ctx->rewrite = true;
+						ctx->source = NULL;
 					}
 				}
 			}
@@ -488,6 +575,16 @@ get_current_timestamp(POOL_CONNECTION_POOL * backend)
 	POOL_SELECT_RESULT *res;
 	static char timestamp[64];
 
+	/*
+	 * Outside of explicit transactions now() is the time the statement
+	 * starts, which we can estimate without asking the main node.  Inside a
+	 * transaction now() is the transaction start time, so ask the node.
+	 */
+	if (pool_config->timestamp_sync_interval > 0 &&
+		TSTATE(backend, MAIN_NODE_ID) == 'I' &&
+		get_local_timestamp(backend, timestamp, sizeof(timestamp)))
+		return timestamp;
+
 	do_query(MAIN(backend), "SELECT pg_catalog.now()", &res, MAJOR(backend));
 
 	if (res->numrows != 1)
@@ -503,6 +600,108 @@ get_current_timestamp(POOL_CONNECTION_POOL * backend)
 }
 
 
+static double
+ts_elapsed(struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * Ask the main node for its clock and time zone offset.  The network
+ * delay is compensated assuming the both directions take the same time.
+ */
+static bool
+sync_ts_clock(POOL_CONNECTION_POOL * backend, char *timezone)
+{
+	POOL_SELECT_RESULT *res;
+	struct timespec start;
+	double		rtt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do_query(MAIN(backend),
+			 "SELECT pg_catalog.date_part('epoch', t), pg_catalog.date_part('timezone', t) FROM (SELECT pg_catalog.clock_timestamp() AS t) AS s",
+			 &res, MAJOR(backend));
+	rtt = ts_elapsed(&start);
+
+	if (res->numrows != 1 || res->data[0] == NULL || res->data[1] == NULL)
+	{
+		free_select_result(res);
+		ts_clock.backend_pid = 0;
+		return false;
+	}
+
+	ts_clock.backend_pid = MAIN_CONNECTION(backend)->pid;
+	strlcpy(ts_clock.timezone, timezone, sizeof(ts_clock.timezone));
+	ts_clock.epoch = atof(res->data[0]);
+	ts_clock.tz_offset = atoi(res->data[1]);
+	clock_gettime(CLOCK_MONOTONIC, &ts_clock.synced);
+	ts_clock.epoch += rtt / 2;
+
+	free_select_result(res);
+
+	ereport(DEBUG1,
+			(errmsg("synchronized timestamp clock with main node"),
+			 errdetail("epoch: %f time zone offset: %d round trip: %f sec",
+					   ts_clock.epoch, ts_clock.tz_offset, rtt)));
+	return true;
+}
+
+/*
+ * Format the current time of the main node estimated from the local
+ * clock, in ISO style with the session's time zone offset.  Returns false
+ * if the estimation is not available.
+ */
+static bool
+get_local_timestamp(POOL_CONNECTION_POOL * backend, char *buf, size_t len)
+{
+	char	   *timezone;
+	int			pos;
+	double		now;
+	time_t		secs;
+	int			usecs;
+	int			offset;
+	struct tm	tm;
+	char	   *p;
+	size_t		n;
+
+	timezone = pool_find_name(&MAIN(backend)->params, "TimeZone", &pos);
+	if (timezone == NULL)
+		return false;
+
+	if (ts_clock.backend_pid != MAIN_CONNECTION(backend)->pid ||
+		strcmp(ts_clock.timezone, timezone) != 0 ||
+		ts_elapsed(&ts_clock.synced) >= pool_config->timestamp_sync_interval)
+	{
+		if (!sync_ts_clock(backend, timezone))
+			return false;
+	}
+
+	now = ts_clock.epoch + ts_elapsed(&ts_clock.synced) + ts_clock.tz_offset;
+	secs = (time_t) now;
+	usecs = (int) ((now - secs) * 1000000);
+	if (gmtime_r(&secs, &tm) == NULL)
+		return false;
+
+	n = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+	if (n == 0)
+		return false;
+	p = buf + n;
+
+	offset = abs(ts_clock.tz_offset);
+	n = snprintf(p, len - n, ".%06d%c%02d", usecs,
+				 ts_clock.tz_offset < 0 ? '-' : '+', offset / 3600);
+	p += n;
+	if (offset % 3600 != 0)
+		p += snprintf(p, len - (p - buf), ":%02d", offset % 3600 / 60);
+	if (offset % 60 != 0)
+		snprintf(p, len - (p - buf), ":%02d", offset % 60);
+
+	return true;
+}
+
 /*
  * rewrite InsertStmt
  */
@@ -545,6 +744,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 			if (relcache->attr[i].use_timestamp)
 			{
 				rewrite = true;
+				ctx->source = NULL;
 				if (ctx->rewrite_to_params)
 					values = lappend(values, makeTsExpr(ctx));
 				else
@@ -607,6 +807,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 					if (relcache->attr[i].use_timestamp == true && IsA(lfirst(lc_val), SetToDefault))
 					{
 						rewrite = true;
+						ctx->source = NULL;
 						if (ctx->rewrite_to_params)
 							lfirst(lc_val) = makeTsExpr(ctx);
 						else
@@ -621,6 +822,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 					if (relcache->attr[i].use_timestamp == true)
 					{
 						rewrite = true;
+						ctx->source = NULL;
 						if (ctx->rewrite_to_params)
 							values = lappend(values, makeTsExpr(ctx));
 						else
@@ -663,6 +865,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 				if (lc_col == NULL)
 				{
 					rewrite = true;
+					ctx->source = NULL;
 					col = makeNode(ResTarget);
 					col->name = relcache->attr[i].attrname;
 					col->indirection = NIL;
@@ -689,6 +892,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 					if (relcache->attr[i].use_timestamp == true && IsA(lfirst(lc_val), SetToDefault))
 					{
 						rewrite = true;
+						ctx->source = NULL;
 						if (ctx->rewrite_to_params)
 							lfirst(lc_val) = makeTsExpr(ctx);
 						else
@@ -770,6 +974,7 @@ rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext * ctx)
 						else
 							res->val = (Node *) makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
 						rewrite = true;
+						ctx->source = NULL;
 					}
 					break;
 				}
@@ -794,6 +999,11 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 	bool		rewrite = false;
 	char	   *timestamp;
 	char	   *rewrite_query;
+	POOL_SESSION_CONTEXT *session_context;
+	TSTemplate *tmpl = NULL;
+	char	   *dbname = NULL;
+	char	   *query = NULL;
+	uint32		generation = 0;
 
 	if (node == NULL)
 		return NULL;
@@ -801,6 +1011,41 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 	if (!REPLICATION)
 		return NULL;
 
+	/*
+	 * Look for the rewritten query in the template cache if this is a simple
+	 * query.  Queries containing the placeholder can't be cached.
+	 */
+	session_context = pool_get_session_context(true);
+	if (message == NULL && session_context && session_context->query_context &&
+		session_context->query_context->parse_tree == node &&
+		session_context->query_context->original_query)
+	{
+		query = session_context->query_context->original_query;
+		dbname = MAIN_CONNECTION(backend)->sp->database;
+
+		if (strlen(query) <= TS_TEMPLATE_MAX_QUERY_LEN &&
+			strstr(query, TS_PLACEHOLDER) == NULL)
+		{
+			generation = pool_shared_relcache_generation();
+			tmpl = ts_template_slot(dbname, query);
+
+			if (ts_template_valid(tmpl, dbname, query))
+			{
+				if (tmpl->template == NULL)
+					return NULL;
+
+				timestamp = get_current_timestamp(backend);
+				if (timestamp == NULL)
+				{
+					ereport(WARNING,
+							(errmsg("rewrite timestamp failed, unable to get current timestamp")));
+					return NULL;
+				}
+				return ts_template_expand(tmpl->template, timestamp);
+			}
+		}
+	}
+
 	/* init context */
 	ctx.ts_const = makeNode(A_Const);
 	ctx.ts_const->val.sval.type = T_String;
@@ -809,6 +1054,17 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 	ctx.num_params = 0;
 	ctx.rewrite = false;
 	ctx.params = NIL;
+	ctx.edits = NIL;
+
+	/*
+	 * The rewritten query can be spliced from the original query text only
+	 * if the text is that of this very statement.
+	 */
+	ctx.source = NULL;
+	if (message == NULL && session_context && session_context->query_context &&
+		session_context->query_context->parse_tree == node &&
+		!session_context->query_context->is_multi_statement)
+		ctx.source = session_context->query_context->original_query;
 
 	/*
 	 * Prepare?
@@ -959,6 +1215,7 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 			{
 				e_stmt->params = lappend(e_stmt->params, ctx.ts_const);
 				rewrite = true;
+				ctx.source = NULL;
 			}
 		}
 	}
@@ -1014,11 +1271,19 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 
 	/* don't rewrite the query if not necessary */
 	if (!rewrite)
+	{
+		if (tmpl)
+			ts_template_store(tmpl, dbname, query, NULL, generation);
 		return NULL;
+	}
 
 	/*
 	 * PREPARE or Parse: handle additional parameters for timestamps
 	 */
+	/* timestamps rewritten to params are not spliced */
+	if (ctx.rewrite_to_params)
+		ctx.source = NULL;
+
 	if (ctx.rewrite_to_params && message)
 	{
 		ListCell   *lc;
@@ -1056,13 +1321,271 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 			return NULL;
 		}
 
+		if (tmpl)
+		{
+			char	   *template;
+
+			ctx.ts_const->val.sval.sval = TS_PLACEHOLDER;
+			template = ctx.source ? ts_splice(&ctx) : NULL;
+			if (template == NULL)
+				template = nodeToString(node);
+			ts_template_store(tmpl, dbname, query, template, generation);
+			rewrite_query = ts_template_expand(template, timestamp);
+			pfree(template);
+			return rewrite_query;
+		}
+
 		ctx.ts_const->val.sval.sval = timestamp;
+
+		if (ctx.source && (rewrite_query = ts_splice(&ctx)) != NULL)
+			return rewrite_query;
 	}
 	rewrite_query = nodeToString(node);
 
 	return rewrite_query;
 }
 
+/*
+ * Remember that the rewritten subtree "node" replaces [start, end) of the
+ * original query text.  If the span is unknown, splicing is given up.
+ */
+static void
+ts_add_edit(TSRewriteContext * ctx, Node *node, int start, int end,
+			bool parenthesize)
+{
+	TSEdit	   *edit;
+
+	if (start < 0 || end <= start)
+	{
+		ctx->source = NULL;
+		return;
+	}
+
+	edit = palloc(sizeof(TSEdit));
+	edit->start = start;
+	edit->end = end;
+	edit->node = node;
+	edit->parenthesize = parenthesize;
+	ctx->edits = lappend(ctx->edits, edit);
+}
+
+/*
+ * Returns the end location of the `now()' call starting at "location" in
+ * the query text, or -1 if it cannot be told, e.g. because of a comment.
+ */
+static int
+ts_now_end(const char *query, int location)
+{
+	const char *p = query + location;
+
+	/* function name, possibly qualified and quoted */
+	while (isalnum((unsigned char) *p) || *p == '_' || *p == '.' ||
+		   *p == '"' || isspace((unsigned char) *p))
+		p++;
+	if (*p++ != '(')
+		return -1;
+	while (isspace((unsigned char) *p))
+		p++;
+	if (*p++ != ')')
+		return -1;
+	return p - query;
+}
+
+/*
+ * Returns the end location of CURRENT_TIMESTAMP and the like starting at
+ * "location" in the query text, including the precision if any, or -1 if
+ * it cannot be told.
+ */
+static int
+ts_keyword_end(const char *query, int location, bool precision)
+{
+	const char *p = query + location;
+
+	while (isalpha((unsigned char) *p) || *p == '_')
+		p++;
+	if (p == query + location)
+		return -1;
+
+	if (precision)
+	{
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p++ != '(')
+			return -1;
+		while (isspace((unsigned char) *p) || isdigit((unsigned char) *p))
+			p++;
+		if (*p++ != ')')
+			return -1;
+	}
+	return p - query;
+}
+
+static int
+ts_edit_cmp(const void *a, const void *b)
+{
+	const TSEdit *ea = *(const TSEdit * const *) a;
+	const TSEdit *eb = *(const TSEdit * const *) b;
+
+	return ea->start - eb->start;
+}
+
+/*
+ * Make the rewritten query from the original query text, deparsing only
+ * the rewritten subtrees.  The result is built in a buffer allocated at
+ * its final size.  Returns NULL if the edits overlap.
+ */
+static char *
+ts_splice(TSRewriteContext * ctx)
+{
+	int			nedits = list_length(ctx->edits);
+	TSEdit	  **edits;
+	char	  **texts;
+	int			len;
+	int			pos;
+	int			i;
+	char	   *result;
+	char	   *p;
+	ListCell   *lc;
+
+	edits = palloc(nedits * sizeof(TSEdit *));
+	texts = palloc(nedits * sizeof(char *));
+
+	i = 0;
+	foreach(lc, ctx->edits)
+		edits[i++] = (TSEdit *) lfirst(lc);
+	qsort(edits, nedits, sizeof(TSEdit *), ts_edit_cmp);
+
+	len = strlen(ctx->source);
+	pos = 0;
+	for (i = 0; i < nedits; i++)
+	{
+		if (edits[i]->start < pos || edits[i]->end > strlen(ctx->source))
+		{
+			for (i--; i >= 0; i--)
+				pfree(texts[i]);
+			pfree(texts);
+			pfree(edits);
+			return NULL;
+		}
+		pos = edits[i]->end;
+
+		texts[i] = nodeToString(edits[i]->node);
+		len += strlen(texts[i]) - (edits[i]->end - edits[i]->start);
+		if (edits[i]->parenthesize)
+			len += 2;
+	}
+
+	result = p = palloc(len + 1);
+	pos = 0;
+	for (i = 0; i < nedits; i++)
+	{
+		int			n;
+
+		memcpy(p, ctx->source + pos, edits[i]->start - pos);
+		p += edits[i]->start - pos;
+		if (edits[i]->parenthesize)
+			*p++ = '(';
+		n = strlen(texts[i]);
+		memcpy(p, texts[i], n);
+		p += n;
+		if (edits[i]->parenthesize)
+			*p++ = ')';
+		pos = edits[i]->end;
+		pfree(texts[i]);
+	}
+	strcpy(p, ctx->source + pos);
+
+	pfree(texts);
+	pfree(edits);
+	return result;
+}
+
+/*
+ * Returns the template cache slot for the query.
+ */
+static TSTemplate *
+ts_template_slot(char *dbname, char *query)
+{
+	uint32		hash = 5381;
+	char	   *p;
+
+	for (p = dbname; *p; p++)
+		hash = hash * 33 + (unsigned char) *p;
+	for (p = query; *p; p++)
+		hash = hash * 33 + (unsigned char) *p;
+
+	return &ts_templates[hash % TS_TEMPLATE_CACHE_SIZE];
+}
+
+/*
+ * Returns true if the template cache slot holds a live entry for the query.
+ */
+static bool
+ts_template_valid(TSTemplate * tmpl, char *dbname, char *query)
+{
+	if (tmpl->query == NULL)
+		return false;
+
+	if (strcmp(tmpl->query, query) != 0 || strcmp(tmpl->dbname, dbname) != 0)
+		return false;
+
+	if (tmpl->expire != 0 && tmpl->expire < time(NULL))
+		return false;
+
+	if (tmpl->generation != pool_shared_relcache_generation())
+		return false;
+
+	return true;
+}
+
+/*
+ * Store the rewritten query into the template cache slot, replacing the
+ * entry already there.
+ */
+static void
+ts_template_store(TSTemplate * tmpl, char *dbname, char *query,
+				  char *template, uint32 generation)
+{
+	if (tmpl->dbname)
+		pfree(tmpl->dbname);
+	if (tmpl->query)
+		pfree(tmpl->query);
+	if (tmpl->template)
+		pfree(tmpl->template);
+
+	tmpl->dbname = MemoryContextStrdup(TopMemoryContext, dbname);
+	tmpl->query = MemoryContextStrdup(TopMemoryContext, query);
+	tmpl->template = template ? MemoryContextStrdup(TopMemoryContext, template) : NULL;
+	tmpl->expire = pool_config->relcache_expire ? time(NULL) + pool_config->relcache_expire : 0;
+	tmpl->generation = generation;
+}
+
+/*
+ * Returns palloced rewritten query with the timestamp substituted for
+ * TS_PLACEHOLDER.  The timestamp never contains a quote or a backslash, so
+ * it needs no escaping.
+ */
+static char *
+ts_template_expand(char *template, char *timestamp)
+{
+	StringInfoData buf;
+	char	   *p = template;
+	char	   *q;
+	int			plen = strlen(TS_PLACEHOLDER);
+
+	initStringInfo(&buf);
+
+	while ((q = strstr(p, TS_PLACEHOLDER)) != NULL)
+	{
+		appendBinaryStringInfo(&buf, p, q - p);
+		appendStringInfoString(&buf, timestamp);
+		p = q + plen;
+	}
+	appendStringInfoString(&buf, p);
+
+	return buf.data;
+}
+
 
 /*
  * rewrite Bind message to add parameter values
@@ -1281,9 +1804,9 @@ makeStringConstFromQuery(POOL_CONNECTION_POOL * backend, char *expression)
 static TypeCast *
 makeTypeCastFromSvfOp(SQLValueFunctionOp op)
 {
-	TypeName   *typename;
+	TypeName   *typename = NULL;
 	Node	   *n;
-	int			location;
+	int			location = 0;
 
 	switch (op)
 	{
@@ -1336,6 +1859,9 @@ makeTypeCastFromSvfOp(SQLValueFunctionOp op)
 			typename = SystemTypeName("name");
 			location = 0;
 			break;
+		default:
+			elog(ERROR, "unrecognized SQLValueFunction op: %d", (int) op);
+			break;
 	}
 
 	n = makeStringConstCast("now", -1, SystemTypeName("text"));
@@ -0,0 +1,20 @@
+/* contrib/pgpool_adm/pgpool_adm--1.5--1.6.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pgpool_adm UPDATE TO '1.6'" to load this file. \quit
+
+/**
+ * input parameters: host, port, username, password
+ */
+CREATE FUNCTION pcp_node_info_all(IN host text, IN port integer, IN username text, IN password text, OUT node_id integer, OUT host text, OUT port integer, OUT status text, OUT pg_status text, OUT weight float4, OUT role text, OUT pg_role text, OUT replication_delay bigint, OUT replication_state text, OUT replication_sync_state text, OUT last_status_change timestamp)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', '_pcp_node_info_all'
+LANGUAGE C VOLATILE STRICT;
+
+/**
+ * input parameters: pcp_server
+ */
+CREATE FUNCTION pcp_node_info_all(IN pcp_server text, OUT node_id integer, OUT host text, OUT port integer, OUT status text, OUT pg_status text, OUT weight float4, OUT role text, OUT pg_role text, OUT replication_delay bigint, OUT replication_state text, OUT replication_sync_state text, OUT last_status_change timestamp)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', '_pcp_node_info_all'
+LANGUAGE C VOLATILE STRICT;
@@ -16,7 +16,10 @@
 #include "miscadmin.h"
 #include "utils/builtins.h"
 #include "foreign/foreign.h"
+#include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/timestamp.h"
 
 /*
@@ -36,10 +39,57 @@
 #include "pgpool_adm.h"
 
 
+/*
+ * Result of a PCP request cached for pgpool_adm.cache_ttl milliseconds, so
+ * that dashboards calling the functions every second do not make pgpool-II
+ * fork a PCP process each time.  The cache is per PostgreSQL backend.
+ */
+typedef struct
+{
+	char	   *key;			/* request, user, and server to connect to */
+	TimestampTz fetched;		/* when the result was received */
+	int			nrows;
+	char	   *rows;			/* nrows records of the request's row size */
+}			PCPCacheEntry;
+
+/*
+ * Rows returned by a set returning function, kept across its calls.
+ */
+typedef struct
+{
+	int			nrows;
+	char	   *rows;
+}			PCPRows;
+
+static int	pcp_cache_ttl = 0;
+static List *pcp_cache = NIL;
+
+void		_PG_init(void);
+
 static PCPConnInfo * connect_to_server(char *host, int port, char *user, char *pass);
 static PCPConnInfo * connect_to_server_from_foreign_server(char *name);
+static char *fetch_pcp_rows(FunctionCallInfo fcinfo, char request, Size rowsize, int *nrows);
+static TupleDesc node_info_tupledesc(bool with_node_id);
+static void node_info_values(BackendInfo * backend_info, Datum *values);
 static Timestamp	str2timestamp(char *str);
 
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("pgpool_adm.cache_ttl",
+							"Time in milliseconds to reuse the result of pcp_pool_status and pcp_node_info_all.",
+							"0 disables the cache.",
+							&pcp_cache_ttl,
+							0,
+							0, INT_MAX,
+							PGC_USERSET,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+}
+
 /**
  * Wrapper around pcp_connect
  * pcp_conninfo: pcpConninfo structure having pcp connection properties
@@ -113,46 +163,66 @@ connect_to_server_from_foreign_server(char *name)
 	return connect_to_server(host, port, user, pass);
 }
 
-/**
- * nodeID: the node id to get info from
- * host_or_srv: server name or ip address of the pgpool server
- * port: pcp port number
- * user: user to connect with
- * pass: password
- **/
-Datum
-_pcp_node_info(PG_FUNCTION_ARGS)
+/*
+ * Send the PCP request, 'B' for pool status or 'I' for the information of
+ * all nodes, to the server given by the arguments of the function, which
+ * are either the foreign server name, or the host, port, user and
+ * password.  Returns the records of the result, each rowsize bytes long,
+ * in the current memory context.
+ *
+ * If pgpool_adm.cache_ttl is set, a result received in the last
+ * pgpool_adm.cache_ttl milliseconds for the same request, server and user
+ * is returned instead.
+ */
+static char *
+fetch_pcp_rows(FunctionCallInfo fcinfo, char request, Size rowsize, int *nrows)
 {
-	int16		nodeID = PG_GETARG_INT16(0);
-	char	   *host_or_srv = text_to_cstring(PG_GETARG_TEXT_PP(1));
-
+	char	   *host_or_srv = text_to_cstring(PG_GETARG_TEXT_PP(0));
 	PCPConnInfo *pcpConnInfo;
 	PCPResultInfo *pcpResInfo;
-
-	BackendInfo *backend_info = NULL;
-	Datum		values[11];		/* values to build the returned tuple from */
-	bool		nulls[] = {false, false, false, false, false, false, false, false, false, false, false};
-	TupleDesc	tupledesc;
-	HeapTuple	tuple;
-	struct tm	tm;
-	char		datebuf[20];
+	PCPCacheEntry *entry = NULL;
+	StringInfoData key;
+	ListCell   *cell;
+	char	   *rows;
 	int			i;
 
-	if (nodeID < 0 || nodeID >= MAX_NUM_BACKENDS)
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("NodeID is out of range.")));
+	initStringInfo(&key);
+	appendStringInfo(&key, "%c %u %s", request, GetUserId(), host_or_srv);
+	if (PG_NARGS() == 4)
+		appendStringInfo(&key, " %d %s %s", PG_GETARG_INT16(1),
+						 text_to_cstring(PG_GETARG_TEXT_PP(2)),
+						 text_to_cstring(PG_GETARG_TEXT_PP(3)));
 
-	if (PG_NARGS() == 5)
+	foreach(cell, pcp_cache)
+	{
+		if (strcmp(((PCPCacheEntry *) lfirst(cell))->key, key.data) == 0)
+		{
+			entry = lfirst(cell);
+			break;
+		}
+	}
+
+	if (pcp_cache_ttl > 0 && entry != NULL &&
+		!TimestampDifferenceExceeds(entry->fetched, GetCurrentTimestamp(), pcp_cache_ttl))
+	{
+		*nrows = entry->nrows;
+		rows = palloc(entry->nrows * rowsize + 1);
+		memcpy(rows, entry->rows, entry->nrows * rowsize);
+		return rows;
+	}
+
+	if (PG_NARGS() == 4)
 	{
 		char	   *user,
 				   *pass;
 		int			port;
 
-		port = PG_GETARG_INT16(2);
-		user = text_to_cstring(PG_GETARG_TEXT_PP(3));
-		pass = text_to_cstring(PG_GETARG_TEXT_PP(4));
+		port = PG_GETARG_INT16(1);
+		user = text_to_cstring(PG_GETARG_TEXT_PP(2));
+		pass = text_to_cstring(PG_GETARG_TEXT_PP(3));
 		pcpConnInfo = connect_to_server(host_or_srv, port, user, pass);
 	}
-	else if (PG_NARGS() == 2)
+	else if (PG_NARGS() == 1)
 	{
 		pcpConnInfo = connect_to_server_from_foreign_server(host_or_srv);
 	}
@@ -161,7 +231,11 @@ _pcp_node_info(PG_FUNCTION_ARGS)
 		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("Wrong number of argument.")));
 	}
 
-	pcpResInfo = pcp_node_info(pcpConnInfo, nodeID);
+	if (request == 'B')
+		pcpResInfo = pcp_pool_status(pcpConnInfo);
+	else
+		pcpResInfo = pcp_node_info(pcpConnInfo, -1);
+
 	if (pcpResInfo == NULL || PCPResultStatus(pcpResInfo) != PCP_RES_COMMAND_OK)
 	{
 		char	   *error = pcp_get_last_error(pcpConnInfo) ? pstrdup(pcp_get_last_error(pcpConnInfo)) : NULL;
@@ -169,40 +243,96 @@ _pcp_node_info(PG_FUNCTION_ARGS)
 		pcp_disconnect(pcpConnInfo);
 		pcp_free_connection(pcpConnInfo);
 		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
-						errmsg("failed to get node information"),
+						errmsg("failed to get %s", (request == 'B') ? "pool status" : "node information"),
 						errdetail("%s\n", error ? error : "unknown reason")));
 	}
 
-	/**
-	 * Construct a tuple descriptor for the result rows.
-	 **/
+	*nrows = pcp_result_slot_count(pcpResInfo);
+	rows = palloc(*nrows * rowsize + 1);
+	for (i = 0; i < *nrows; i++)
+	{
+		void	   *row = pcp_get_binary_data(pcpResInfo, i);
+
+		if (row)
+			memcpy(rows + i * rowsize, row, rowsize);
+		else
+			memset(rows + i * rowsize, 0, rowsize);
+	}
+
+	pcp_disconnect(pcpConnInfo);
+	pcp_free_connection(pcpConnInfo);
+
+	if (pcp_cache_ttl > 0)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+		if (entry == NULL)
+		{
+			entry = palloc0(sizeof(PCPCacheEntry));
+			entry->key = pstrdup(key.data);
+			pcp_cache = lappend(pcp_cache, entry);
+		}
+		else
+			pfree(entry->rows);
+
+		entry->rows = palloc(*nrows * rowsize + 1);
+		memcpy(entry->rows, rows, *nrows * rowsize);
+		entry->nrows = *nrows;
+		entry->fetched = GetCurrentTimestamp();
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	return rows;
+}
+
+/*
+ * Construct a tuple descriptor for the node information, optionally
+ * starting with the node id.
+ */
+static TupleDesc
+node_info_tupledesc(bool with_node_id)
+{
+	TupleDesc	tupledesc;
+	AttrNumber	an = 1;
+	int			natts = with_node_id ? 12 : 11;
+
 #if defined(PG_VERSION_NUM) && (PG_VERSION_NUM >= 120000)
-	tupledesc = CreateTemplateTupleDesc(11);
+	tupledesc = CreateTemplateTupleDesc(natts);
 #else
-	tupledesc = CreateTemplateTupleDesc(11, false);
+	tupledesc = CreateTemplateTupleDesc(natts, false);
 #endif
-	TupleDescInitEntry(tupledesc, (AttrNumber) 1, "hostname", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 2, "port", INT4OID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 3, "status", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 4, "pg_status", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 5, "weight", FLOAT4OID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 6, "role", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 7, "pg_role", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 8, "replication_delay", INT8OID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 9, "replication_state", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 10, "replication_sync_state", TEXTOID, -1, 0);
-	TupleDescInitEntry(tupledesc, (AttrNumber) 11, "last_status_change", TIMESTAMPOID, -1, 0);
-	tupledesc = BlessTupleDesc(tupledesc);
+	if (with_node_id)
+		TupleDescInitEntry(tupledesc, an++, "node_id", INT4OID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "hostname", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "port", INT4OID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "status", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "pg_status", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "weight", FLOAT4OID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "role", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "pg_role", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "replication_delay", INT8OID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "replication_state", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "replication_sync_state", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupledesc, an++, "last_status_change", TIMESTAMPOID, -1, 0);
 
-	backend_info = (BackendInfo *) pcp_get_binary_data(pcpResInfo, 0);
+	return BlessTupleDesc(tupledesc);
+}
+
+/*
+ * Set the 11 values of the node information from backend_info.
+ */
+static void
+node_info_values(BackendInfo * backend_info, Datum *values)
+{
+	struct tm	tm;
+	char		datebuf[20];
+	int			i;
 
-	/* set values */
 	i = 0;
 	values[i] = CStringGetTextDatum(backend_info->backend_hostname);
-	nulls[i] = false;
 	i++;
 	values[i] = Int16GetDatum(backend_info->backend_port);
-	nulls[i] = false;
 
 	i++;
 	switch (backend_info->backend_status)
@@ -220,44 +350,100 @@ _pcp_node_info(PG_FUNCTION_ARGS)
 			values[i] = CStringGetTextDatum("Disconnected");
 			break;
 	}
-	nulls[i] = false;
 
 	i++;
-	nulls[i] = false;
 	values[i] = CStringGetTextDatum(backend_info->pg_backend_status);
 
 	i++;
 	values[i] = Float4GetDatum(backend_info->backend_weight / RAND_MAX);
-	nulls[i] = false;
 
 	i++;
-	nulls[i] = false;
 	values[i] = backend_info->role == ROLE_PRIMARY ? CStringGetTextDatum("Primary") : CStringGetTextDatum("Standby");
 
 	i++;
-	nulls[i] = false;
 	values[i] = CStringGetTextDatum(backend_info->pg_role);
 
 	i++;
-	nulls[i] = false;
 	values[i] = Int64GetDatum(backend_info->standby_delay);
 
 	i++;
-	nulls[i] = false;
 	values[i] = CStringGetTextDatum(backend_info->replication_state);
 
 	i++;
-	nulls[i] = false;
 	values[i] = CStringGetTextDatum(backend_info->replication_sync_state);
 
 	i++;
-	nulls[i] = false;
 	localtime_r(&backend_info->status_changed_time, &tm);
 	strftime(datebuf, sizeof(datebuf), "%F %T", &tm);
 	values[i] = DatumGetTimestamp(DirectFunctionCall3(timestamp_in,
 													  CStringGetDatum(datebuf),
 													  ObjectIdGetDatum(InvalidOid),
 													  Int32GetDatum(-1)));
+}
+
+/**
+ * nodeID: the node id to get info from
+ * host_or_srv: server name or ip address of the pgpool server
+ * port: pcp port number
+ * user: user to connect with
+ * pass: password
+ **/
+Datum
+_pcp_node_info(PG_FUNCTION_ARGS)
+{
+	int16		nodeID = PG_GETARG_INT16(0);
+	char	   *host_or_srv = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	PCPConnInfo *pcpConnInfo;
+	PCPResultInfo *pcpResInfo;
+
+	BackendInfo *backend_info = NULL;
+	Datum		values[11];		/* values to build the returned tuple from */
+	bool		nulls[] = {false, false, false, false, false, false, false, false, false, false, false};
+	TupleDesc	tupledesc;
+	HeapTuple	tuple;
+
+	if (nodeID < 0 || nodeID >= MAX_NUM_BACKENDS)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("NodeID is out of range.")));
+
+	if (PG_NARGS() == 5)
+	{
+		char	   *user,
+				   *pass;
+		int			port;
+
+		port = PG_GETARG_INT16(2);
+		user = text_to_cstring(PG_GETARG_TEXT_PP(3));
+		pass = text_to_cstring(PG_GETARG_TEXT_PP(4));
+		pcpConnInfo = connect_to_server(host_or_srv, port, user, pass);
+	}
+	else if (PG_NARGS() == 2)
+	{
+		pcpConnInfo = connect_to_server_from_foreign_server(host_or_srv);
+	}
+	else
+	{
+		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("Wrong number of argument.")));
+	}
+
+	pcpResInfo = pcp_node_info(pcpConnInfo, nodeID);
+	if (pcpResInfo == NULL || PCPResultStatus(pcpResInfo) != PCP_RES_COMMAND_OK)
+	{
+		char	   *error = pcp_get_last_error(pcpConnInfo) ? pstrdup(pcp_get_last_error(pcpConnInfo)) : NULL;
+
+		pcp_disconnect(pcpConnInfo);
+		pcp_free_connection(pcpConnInfo);
+		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
+						errmsg("failed to get node information"),
+						errdetail("%s\n", error ? error : "unknown reason")));
+	}
+
+	tupledesc = node_info_tupledesc(false);
+
+	backend_info = (BackendInfo *) pcp_get_binary_data(pcpResInfo, 0);
+
+	/* set values */
+	node_info_values(backend_info, values);
 
 	pcp_disconnect(pcpConnInfo);
 	pcp_free_connection(pcpConnInfo);
@@ -281,18 +467,15 @@ _pcp_pool_status(PG_FUNCTION_ARGS)
 {
 	MemoryContext oldcontext;
 	FuncCallContext *funcctx;
-	int32		nrows;
 	int32		call_cntr;
 	int32		max_calls;
 	AttInMetadata *attinmeta;
-	PCPConnInfo *pcpConnInfo;
-	PCPResultInfo *pcpResInfo;
+	PCPRows    *result;
 
 	/* stuff done only on the first call of the function */
 	if (SRF_IS_FIRSTCALL())
 	{
 		TupleDesc	tupdesc;
-		char	   *host_or_srv = text_to_cstring(PG_GETARG_TEXT_PP(0));
 
 		/* create a function context for cross-call persistence */
 		funcctx = SRF_FIRSTCALL_INIT();
@@ -300,44 +483,9 @@ _pcp_pool_status(PG_FUNCTION_ARGS)
 		/* switch to memory context appropriate for multiple function calls */
 		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-		if (PG_NARGS() == 4)
-		{
-			char	   *user,
-					   *pass;
-			int			port;
-
-			port = PG_GETARG_INT16(1);
-			user = text_to_cstring(PG_GETARG_TEXT_PP(2));
-			pass = text_to_cstring(PG_GETARG_TEXT_PP(3));
-			pcpConnInfo = connect_to_server(host_or_srv, port, user, pass);
+		result = palloc(sizeof(PCPRows));
+		result->rows = fetch_pcp_rows(fcinfo, 'B', sizeof(POOL_REPORT_CONFIG), &result->nrows);
 
-		}
-		else if (PG_NARGS() == 1)
-		{
-			pcpConnInfo = connect_to_server_from_foreign_server(host_or_srv);
-		}
-		else
-		{
-			MemoryContextSwitchTo(oldcontext);
-			ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("Wrong number of argument.")));
-		}
-
-		pcpResInfo = pcp_pool_status(pcpConnInfo);
-		if (pcpResInfo == NULL || PCPResultStatus(pcpResInfo) != PCP_RES_COMMAND_OK)
-		{
-			char	   *error = pcp_get_last_error(pcpConnInfo) ? pstrdup(pcp_get_last_error(pcpConnInfo)) : NULL;
-
-			pcp_disconnect(pcpConnInfo);
-			pcp_free_connection(pcpConnInfo);
-
-			MemoryContextSwitchTo(oldcontext);
-			ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
-							errmsg("failed to get pool status"),
-							errdetail("%s\n", error ? error : "unknown reason")));
-		}
-
-		nrows = pcp_result_slot_count(pcpResInfo);
-		pcp_disconnect(pcpConnInfo);
 		/* Construct a tuple descriptor for the result rows */
 #if defined(PG_VERSION_NUM) && (PG_VERSION_NUM >= 120000)
 		tupdesc = CreateTemplateTupleDesc(3);
@@ -355,12 +503,12 @@ _pcp_pool_status(PG_FUNCTION_ARGS)
 		attinmeta = TupleDescGetAttInMetadata(tupdesc);
 		funcctx->attinmeta = attinmeta;
 
-		if (nrows > 0)
+		if (result->nrows > 0)
 		{
-			funcctx->max_calls = nrows;
+			funcctx->max_calls = result->nrows;
 
 			/* got results, keep track of them */
-			funcctx->user_fctx = pcpConnInfo;
+			funcctx->user_fctx = result;
 		}
 		else
 		{
@@ -379,16 +527,15 @@ _pcp_pool_status(PG_FUNCTION_ARGS)
 	call_cntr = funcctx->call_cntr;
 	max_calls = funcctx->max_calls;
 
-	pcpConnInfo = (PCPConnInfo *) funcctx->user_fctx;
-	pcpResInfo = (PCPResultInfo *) pcpConnInfo->pcpResInfo;
+	result = (PCPRows *) funcctx->user_fctx;
 	attinmeta = funcctx->attinmeta;
 
 	if (call_cntr < max_calls)	/* executed while there is more left to send */
 	{
 		char	   *values[3];
 		HeapTuple	tuple;
-		Datum		result;
-		POOL_REPORT_CONFIG *status = (POOL_REPORT_CONFIG *) pcp_get_binary_data(pcpResInfo, call_cntr);
+		Datum		datum;
+		POOL_REPORT_CONFIG *status = (POOL_REPORT_CONFIG *) result->rows + call_cntr;
 
 		values[0] = pstrdup(status->name);
 		values[1] = pstrdup(status->value);
@@ -398,18 +545,76 @@ _pcp_pool_status(PG_FUNCTION_ARGS)
 		tuple = BuildTupleFromCStrings(attinmeta, values);
 
 		/* make the tuple into a datum */
-		result = HeapTupleGetDatum(tuple);
+		datum = HeapTupleGetDatum(tuple);
 
-		SRF_RETURN_NEXT(funcctx, result);
+		SRF_RETURN_NEXT(funcctx, datum);
 	}
 	else
 	{
 		/* do when there is no more left */
-		pcp_free_connection(pcpConnInfo);
 		SRF_RETURN_DONE(funcctx);
 	}
 }
 
+/**
+ * Returns the information of all the nodes with one PCP request.
+ * host_or_srv: server name or ip address of the pgpool server
+ * port: pcp port number
+ * user: user to connect with
+ * pass: password
+ **/
+Datum
+_pcp_node_info_all(PG_FUNCTION_ARGS)
+{
+	MemoryContext oldcontext;
+	FuncCallContext *funcctx;
+	PCPRows    *result;
+
+	/* stuff done only on the first call of the function */
+	if (SRF_IS_FIRSTCALL())
+	{
+		/* create a function context for cross-call persistence */
+		funcctx = SRF_FIRSTCALL_INIT();
+
+		/* switch to memory context appropriate for multiple function calls */
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		result = palloc(sizeof(PCPRows));
+		result->rows = fetch_pcp_rows(fcinfo, 'I', sizeof(BackendInfo), &result->nrows);
+
+		funcctx->tuple_desc = node_info_tupledesc(true);
+		funcctx->max_calls = result->nrows;
+		funcctx->user_fctx = result;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	/* stuff done on every call of the function */
+	funcctx = SRF_PERCALL_SETUP();
+	result = (PCPRows *) funcctx->user_fctx;
+
+	/* skip the slots of nodes not configured */
+	while (funcctx->call_cntr < funcctx->max_calls &&
+		   ((BackendInfo *) result->rows + funcctx->call_cntr)->backend_hostname[0] == '\0')
+		funcctx->call_cntr++;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		Datum		values[12];
+		bool		nulls[12] = {false};
+		HeapTuple	tuple;
+
+		values[0] = Int32GetDatum(funcctx->call_cntr);
+		node_info_values((BackendInfo *) result->rows + funcctx->call_cntr, values + 1);
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+	else
+		SRF_RETURN_DONE(funcctx);
+}
+
 /**
  * nodeID: the node id to get info from
  * host_or_srv: server name or ip address of the pgpool server
@@ -43,6 +43,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #ifdef HAVE_CRYPT_H
 #include <crypt.h>
@@ -57,12 +58,14 @@
 #include "utils/pool_ip.h"
 #include "utils/ps_status.h"
 #include "utils/pool_stream.h"
+#include "utils/statistics.h"
 
 #include "context/pool_process_context.h"
 #include "context/pool_session_context.h"
 #include "protocol/pool_process_query.h"
 #include "protocol/pool_pg_utils.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
 #include "auth/md5.h"
 #include "auth/pool_hba.h"
 
@@ -70,13 +73,28 @@
 #include "watchdog/watchdog.h"
 
 static POOL_CONNECTION_POOL_SLOT * slots[MAX_NUM_BACKENDS];
+
+/*
+ * Connection to the primary used for sampling replication lag with
+ * sr_lag_check_interval.  Unlike "slots" this is kept across the main loop
+ * iterations.  Only the element of the primary node is used.
+ */
+static POOL_CONNECTION_POOL_SLOT * lag_check_slots[MAX_NUM_BACKENDS];
+static int	lag_check_node_id = -1;
+
+/* backend server version cache */
+static int	server_version[MAX_NUM_BACKENDS];
 static volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t restart_request = 0;
 
 static void establish_persistent_connection(void);
 static void discard_persistent_connection(void);
 static void check_replication_time_lag(void);
+static POOL_NODE_STATUS *check_replication_by_samples(void);
 static void CheckReplicationTimeLagErrorCb(void *arg);
+static void sr_check_sleep(void);
+static void sample_replication_lag(void);
+static void discard_lag_check_connection(void);
 static unsigned long long int text_to_lsn(char *text);
 static RETSIGTYPE my_signal_handler(int sig);
 static RETSIGTYPE reload_config_handler(int sig);
@@ -97,6 +115,10 @@ static void sr_check_will_die(int code, Datum arg);
     } while (0)
 
 
+/* use the samples taken by the health check instead of own connections */
+#define SR_CHECK_BY_HEALTH_CHECK \
+	(pool_config->health_check_multiplexed && pool_config->sr_check_by_health_check)
+
 #define PG10_SERVER_VERSION	100000	/* PostgreSQL 10 server version num */
 #define PG91_SERVER_VERSION	90100	/* PostgreSQL 9.1 server version num */
 
@@ -241,17 +263,23 @@ do_worker_child(void)
 			{
 				follow_primary_lock_acquired = true;
 
-				establish_persistent_connection();
+				if (!SR_CHECK_BY_HEALTH_CHECK)
+					establish_persistent_connection();
 				PG_TRY();
 				{
 					POOL_NODE_STATUS *node_status;
 					int			i;
 
-					/* Do replication time lag checking */
-					check_replication_time_lag();
+					if (SR_CHECK_BY_HEALTH_CHECK)
+						node_status = check_replication_by_samples();
+					else
+					{
+						/* Do replication time lag checking */
+						check_replication_time_lag();
 
-					/* Check node status */
-					node_status = verify_backend_node_status(slots);
+						/* Check node status */
+						node_status = verify_backend_node_status(slots);
+					}
 
 
 					for (i = 0; i < NUM_BACKENDS; i++)
@@ -307,7 +335,7 @@ do_worker_child(void)
 					discard_persistent_connection();
 					pool_release_follow_primary_lock(false);
 					follow_primary_lock_acquired = false;
-					sleep(pool_config->sr_check_period);
+					sr_check_sleep();
 					PG_RE_THROW();
 				}
 				PG_END_TRY();
@@ -321,11 +349,169 @@ do_worker_child(void)
 				}
 			}
 		}
-		sleep(pool_config->sr_check_period);
+		sr_check_sleep();
 	}
 	exit(0);
 }
 
+/*
+ * Sleep for sr_check_period seconds.  If sr_lag_check_interval is set,
+ * wake up every sr_lag_check_interval milliseconds meanwhile to refresh
+ * the replication lag so that the load balancing decisions based on it
+ * are not up to sr_check_period old.
+ */
+static void
+sr_check_sleep(void)
+{
+	struct timeval start_time;
+	struct timeval now;
+	long		elapsed;
+
+	if (pool_config->sr_lag_check_interval <= 0 ||
+		pool_config->sr_check_period <= 0 || !STREAM ||
+		SR_CHECK_BY_HEALTH_CHECK)
+	{
+		discard_lag_check_connection();
+		sleep(pool_config->sr_check_period);
+		return;
+	}
+
+	gettimeofday(&start_time, NULL);
+
+	for (;;)
+	{
+		usleep(pool_config->sr_lag_check_interval * 1000);
+
+		CHECK_REQUEST;
+
+		gettimeofday(&now, NULL);
+		elapsed = (now.tv_sec - start_time.tv_sec) * 1000 +
+			(now.tv_usec - start_time.tv_usec) / 1000;
+		if (elapsed >= pool_config->sr_check_period * 1000L)
+			break;
+
+		if (Req_info->switching == false)
+			sample_replication_lag();
+	}
+}
+
+/*
+ * Refresh the replication lag of the standby nodes by a single query to
+ * pg_stat_replication on the primary.  This requires PostgreSQL 10 or later
+ * and backend_application_name to be set.  The full check done every
+ * sr_check_period, which also takes care of the node status and logging of
+ * the delay, is not affected.
+ */
+static void
+sample_replication_lag(void)
+{
+	int			primary = REAL_PRIMARY_NODE_ID;
+	int			i;
+	int			j;
+	int			status;
+	POOL_SELECT_RESULT *res;
+	BackendInfo *bkinfo;
+	char	   *query;
+
+#define	LAG_NUM_COLS 4
+
+	if (NUM_BACKENDS <= 1 || primary < 0 || !VALID_BACKEND(primary) ||
+		server_version[primary] < PG10_SERVER_VERSION)
+	{
+		discard_lag_check_connection();
+		return;
+	}
+
+	if (lag_check_node_id != primary)
+		discard_lag_check_connection();
+
+	if (lag_check_slots[primary] == NULL)
+	{
+		MemoryContext oldContext;
+		char	   *password;
+
+		oldContext = MemoryContextSwitchTo(TopMemoryContext);
+		password = get_pgpool_config_user_password(pool_config->sr_check_user,
+												   pool_config->sr_check_password);
+		bkinfo = pool_get_node_info(primary);
+		lag_check_slots[primary] = make_persistent_db_connection_noerror(primary,
+																		 bkinfo->backend_hostname,
+																		 bkinfo->backend_port,
+																		 pool_config->sr_check_database,
+																		 pool_config->sr_check_user,
+																		 password ? password : "", false);
+		if (password)
+			pfree(password);
+		MemoryContextSwitchTo(oldContext);
+
+		if (lag_check_slots[primary] == NULL)
+			return;
+		lag_check_node_id = primary;
+	}
+
+	query = "SELECT application_name, pg_catalog.pg_current_wal_lsn(), replay_lsn, (EXTRACT(EPOCH FROM replay_lag)*1000000)::BIGINT FROM pg_catalog.pg_stat_replication";
+
+	status = get_query_result(lag_check_slots, primary, query, &res);
+	if (status == -1)
+	{
+		/* the connection may be broken */
+		discard_lag_check_connection();
+		return;
+	}
+	if (status != 0)
+		return;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i == primary || !VALID_BACKEND(i))
+			continue;
+
+		bkinfo = pool_get_node_info(i);
+
+		for (j = 0; j < res->numrows; j++)
+		{
+			char	   *current_lsn = res->data[j * LAG_NUM_COLS + 1];
+			char	   *replay_lsn = res->data[j * LAG_NUM_COLS + 2];
+			char	   *replay_lag = res->data[j * LAG_NUM_COLS + 3];
+			uint64		current;
+			uint64		replayed;
+
+			if (res->data[j * LAG_NUM_COLS] == NULL ||
+				strcmp(res->data[j * LAG_NUM_COLS], bkinfo->backend_application_name) != 0)
+				continue;
+
+			/* sr_check_user does not have enough privilege */
+			if (current_lsn == NULL || replay_lsn == NULL)
+				break;
+
+			bkinfo->wal_location = pool_parse_wal_location(replay_lsn);
+
+			if (bkinfo->standby_delay_by_time)
+				bkinfo->standby_delay = replay_lag ? atol(replay_lag) : 0;
+			else
+			{
+				current = text_to_lsn(current_lsn);
+				replayed = text_to_lsn(replay_lsn);
+				bkinfo->standby_delay = (current > replayed) ? current - replayed : 0;
+			}
+			break;
+		}
+	}
+
+	free_select_result(res);
+}
+
+static void
+discard_lag_check_connection(void)
+{
+	if (lag_check_node_id < 0)
+		return;
+
+	discard_persistent_db_connection(lag_check_slots[lag_check_node_id]);
+	lag_check_slots[lag_check_node_id] = NULL;
+	lag_check_node_id = -1;
+}
+
 /*
  * Establish persistent connection to backend
  */
@@ -382,9 +568,6 @@ discard_persistent_connection(void)
 static void
 check_replication_time_lag(void)
 {
-	/* backend server version cache */
-	static int	server_version[MAX_NUM_BACKENDS];
-
 	int			i;
 	POOL_SELECT_RESULT *res;
 	POOL_SELECT_RESULT *res_rep;	/* query results of pg_stat_replication */
@@ -397,6 +580,9 @@ check_replication_time_lag(void)
 	ErrorContextCallback callback;
 	int		active_standby_node;
 	bool	replication_delay_by_time;
+	int		probe_status;
+	struct timeval probe_start;
+	struct timeval probe_end;
 
 	/* clear replication state */
 	for (i = 0; i < NUM_BACKENDS; i++)
@@ -505,9 +691,19 @@ check_replication_time_lag(void)
 			active_standby_node++;
 		}
 
-		if (get_query_result(slots, i, query, &res) == 0 && res->nullflags[0] != -1)
+		gettimeofday(&probe_start, NULL);
+		probe_status = get_query_result(slots, i, query, &res);
+		gettimeofday(&probe_end, NULL);
+
+		/* the round trip time tells us how responsive the node is */
+		if (probe_status == 0)
+			stat_probe_latency(i, (uint64) ((probe_end.tv_sec - probe_start.tv_sec) * 1000000 +
+											(probe_end.tv_usec - probe_start.tv_usec)));
+
+		if (probe_status == 0 && res->nullflags[0] != -1)
 		{
 			lsn[i] = text_to_lsn(res->data[0]);
+			pool_get_node_info(i)->wal_location = pool_parse_wal_location(res->data[0]);
 			free_select_result(res);
 		}
 	}
@@ -644,6 +840,81 @@ check_replication_time_lag(void)
 	error_context_stack = callback.previous;
 }
 
+/*
+ * Streaming replication check with sr_check_by_health_check: compute the
+ * replication delay of the standby nodes and look for false primaries using
+ * the role and WAL location sampled by the health check process, without
+ * connecting to the nodes.  Samples older than two health check periods
+ * are not used.
+ */
+static POOL_NODE_STATUS *
+check_replication_by_samples(void)
+{
+	static POOL_NODE_STATUS node_status[MAX_NUM_BACKENDS];
+	bool		sampled[MAX_NUM_BACKENDS];
+	int			primary = REAL_PRIMARY_NODE_ID;
+	time_t		now = time(NULL);
+	BackendInfo *bkinfo;
+	uint64		lag;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		int			period = pool_config->health_check_params[i].health_check_period;
+
+		bkinfo = pool_get_node_info(i);
+		*bkinfo->replication_state = '\0';
+		*bkinfo->replication_sync_state = '\0';
+
+		node_status[i] = POOL_NODE_STATUS_UNUSED;
+		sampled[i] = VALID_BACKEND(i) && period > 0 &&
+			health_check_stats[i].last_sample > 0 &&
+			now - health_check_stats[i].last_sample <= 2 * period;
+	}
+
+	if (primary < 0 || !sampled[primary] ||
+		health_check_stats[primary].sample_in_recovery)
+	{
+		/* do not judge the other nodes without a confirmed primary */
+		ereport(DEBUG1,
+				(errmsg("check_replication_by_samples: no sample of the primary node")));
+		return node_status;
+	}
+	node_status[primary] = POOL_NODE_STATUS_PRIMARY;
+	pool_get_node_info(primary)->standby_delay = 0;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i == primary || !sampled[i])
+			continue;
+
+		if (!health_check_stats[i].sample_in_recovery)
+		{
+			node_status[i] = POOL_NODE_STATUS_INVALID;
+			continue;
+		}
+		node_status[i] = POOL_NODE_STATUS_STANDBY;
+
+		bkinfo = pool_get_node_info(i);
+		lag = BACKEND_INFO(primary).wal_location > bkinfo->wal_location ?
+			BACKEND_INFO(primary).wal_location - bkinfo->wal_location : 0;
+		bkinfo->standby_delay = lag;
+		bkinfo->standby_delay_by_time = false;
+
+		if ((pool_config->log_standby_delay == LSD_ALWAYS && lag > 0) ||
+			(pool_config->delay_threshold &&
+			 pool_config->log_standby_delay == LSD_OVER_THRESHOLD &&
+			 lag > pool_config->delay_threshold))
+		{
+			ereport(LOG,
+					(errmsg("Replication of node: %d is behind " UINT64_FORMAT " bytes from the primary server (node: %d)",
+							i, lag, primary)));
+		}
+	}
+
+	return node_status;
+}
+
 static void
 CheckReplicationTimeLagErrorCb(void *arg)
 {
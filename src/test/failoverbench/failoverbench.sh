@@ -0,0 +1,409 @@
+#!/usr/bin/env bash
+#
+# pgpool-II failover and failback timing benchmark.
+#
+# usage: failoverbench.sh [options] [scenario...]
+# -i install directory of pgpool
+# -p installation path of Postgres
+# -b pgbench path
+# -s unix socket directory
+# -c number of pgbench clients
+# -T seconds of load before the event
+# -A seconds of load after the event
+# -W seconds after the event in which latencies are counted as the spike
+# -e extra configuration file appended to pgpool.conf
+# -o result file
+# -B baseline result file to compare with
+#
+# Each scenario creates a 3 node streaming replication cluster with
+# pgpool_setup, drives select only load through pgpool with pgbench,
+# makes a node go down (or come back) and measures how long it takes
+# pgpool to notice and to serve the clients again.  See README.
+
+dir=`pwd`
+PG_INSTALL_DIR=/usr/local/pgsql/bin
+PGPOOL_PATH=/usr/local
+PGSOCKET_DIR=/tmp
+CLIENTS=8
+BEFORE=10
+AFTER=20
+WINDOW=10
+EXTRA_CONF=
+RESULT=$dir/failoverbench.out
+BASELINE=
+WORKDIR=$dir/work
+SCENARIOS="standby_down primary_down standby_detach primary_detach standby_failback"
+
+# order of the metrics in the result file
+METRICS="detection_ms failover_cmd_ms failover_ms restart_ms outage_ms base_p99_ms spike_p99_ms spike_max_ms base_tps"
+
+function print_usage
+{
+	printf "Usage:\n"
+	printf "  %s: [Options]... [scenario...]\n" $(basename $0) >&2
+	printf "\nOptions:\n"
+	printf "  -p   DIRECTORY           Postgres installed directory\n" >&2
+	printf "  -b   PATH                pgbench installed path, if different from Postgres installed directory\n" >&2
+	printf "  -i   DIRECTORY           pgpool installed directory\n" >&2
+	printf "  -s   DIRECTORY           unix socket directory\n" >&2
+	printf "  -c   NUM                 number of pgbench clients [Default: $CLIENTS]\n" >&2
+	printf "  -T   SECONDS             load before the event [Default: $BEFORE]\n" >&2
+	printf "  -A   SECONDS             load after the event [Default: $AFTER]\n" >&2
+	printf "  -W   SECONDS             latency spike window after the event [Default: $WINDOW]\n" >&2
+	printf "  -e   FILE                configuration appended to pgpool.conf\n" >&2
+	printf "  -o   FILE                result file [Default: failoverbench.out]\n" >&2
+	printf "  -B   FILE                baseline result file to compare with\n" >&2
+	printf "  -?                       print this help and then exit\n\n" >&2
+	printf "Scenarios: $SCENARIOS\n" >&2
+}
+
+function export_env_vars
+{
+	PGBIN=`$PG_INSTALL_DIR/pg_config --bindir`
+	if [ -z "$PGBIN" ]; then
+		echo "$0: cannot locate pg_config"
+		exit 1
+	fi
+	PGLIB=`$PG_INSTALL_DIR/pg_config --libdir`
+
+	if [[ -z "$PGBENCH_PATH" ]]; then
+		PGBENCH_PATH=$PGBIN/pgbench
+	fi
+	if [ ! -x $PGBENCH_PATH ]; then
+		echo "$0: cannot locate pgbench"
+		exit 1
+	fi
+
+	export PGPOOL_INSTALL_DIR=$PGPOOL_PATH
+	export PGPOOLDIR=${PGPOOLDIR:-"$PGPOOL_INSTALL_DIR/etc"}
+	export PGPOOL_SETUP=$PGPOOL_INSTALL_DIR/bin/pgpool_setup
+	if [ ! -x $PGPOOL_SETUP ]; then
+		echo "$0: cannot locate pgpool_setup"
+		exit 1
+	fi
+
+	if [ -z "$LD_LIBRARY_PATH" ];then
+		export LD_LIBRARY_PATH=$PGPOOL_INSTALL_DIR/lib:$PGLIB
+	else
+		export LD_LIBRARY_PATH=$PGPOOL_INSTALL_DIR/lib:$PGLIB:$LD_LIBRARY_PATH
+	fi
+	export PATH=$PGPOOL_INSTALL_DIR/bin:$PGBIN:$PATH
+	export PGBIN
+	export PGSOCKET_DIR
+	export LANG=C
+}
+
+#-------------------------------------------
+# current time in seconds since epoch, in milliseconds precision
+#-------------------------------------------
+function now {
+	date +%s.%3N
+}
+
+#-------------------------------------------
+# time of the first line of pgpool.log matching the pattern at or
+# after the given time.  Prints nothing if there is no such line.
+#-------------------------------------------
+function log_time {
+	pattern=$1
+	after=$2
+
+	grep -E "$pattern" $WORKDIR/log/pgpool.log | while read d t rest
+	do
+		t=`date -d "$d ${t%:}" +%s.%3N`
+		if awk -v t=$t -v a=$after 'BEGIN { exit !(t >= a) }';then
+			echo $t
+			break
+		fi
+	done
+}
+
+#-------------------------------------------
+# difference of two times in milliseconds, or "-" if either is unknown
+#-------------------------------------------
+function msec {
+	if [ -z "$1" -o -z "$2" ];then
+		echo "-"
+	else
+		awk -v a=$1 -v b=$2 'BEGIN { printf "%d\n", (b - a) * 1000 }'
+	fi
+}
+
+#-------------------------------------------
+# wait for pgpool comes up
+#-------------------------------------------
+function wait_for_pgpool_startup {
+	timeout=20
+
+	while [ $timeout -gt 0 ]
+	do
+		$PGBIN/psql -p $PGPOOL_PORT -c "show pool_nodes" test >/dev/null 2>&1
+		if [ $? = 0 ];then
+			break;
+		fi
+		timeout=`expr $timeout - 1`
+		sleep 1
+	done
+}
+
+#-------------------------------------------
+# create the cluster and customize pgpool.conf
+#-------------------------------------------
+function setup_cluster {
+	rm -fr $WORKDIR
+	mkdir $WORKDIR
+	cd $WORKDIR
+
+	echo -n "creating test environment..."
+	$PGPOOL_SETUP -m s -n 3 -s >setup.log 2>&1 || { echo "pgpool_setup failed. see $WORKDIR/setup.log"; exit 1; }
+	echo "done."
+
+	source ./bashrc.ports
+
+	# Record when failover_command starts and ends.
+	cat > etc/failover_timed.sh <<EOF
+#!/bin/sh
+echo "start \`date +%s.%3N\`" >> $WORKDIR/log/failover_timing
+$WORKDIR/etc/failover.sh "\$@"
+r=\$?
+echo "end \`date +%s.%3N\`" >> $WORKDIR/log/failover_timing
+exit \$r
+EOF
+	chmod 755 etc/failover_timed.sh
+
+	# Detect a node down within a second and do not let
+	# follow_primary_command rebuild standbys while measuring.
+	cat >> etc/pgpool.conf <<EOF
+failover_command = '$WORKDIR/etc/failover_timed.sh %d %h %p %D %m %H %M %P %r %R %N %S'
+follow_primary_command = ''
+log_per_node_statement = off
+health_check_period0 = 1
+health_check_max_retries0 = 0
+health_check_period1 = 1
+health_check_max_retries1 = 0
+health_check_period2 = 1
+health_check_max_retries2 = 0
+EOF
+	if [ -n "$EXTRA_CONF" ];then
+		cat $EXTRA_CONF >> etc/pgpool.conf
+	fi
+
+	./startall >/dev/null 2>&1
+	export PGPORT=$PGPOOL_PORT
+	export PGDATABASE=test
+	wait_for_pgpool_startup
+
+	$PGBENCH_PATH -i -q >/dev/null 2>&1
+}
+
+#-------------------------------------------
+# run one pgbench client until the given time, restarting it whenever
+# its session is terminated
+#-------------------------------------------
+function client_loop {
+	id=$1
+	end=$2
+	run=0
+
+	while true
+	do
+		remain=`awk -v e=$end -v n=$(now) 'BEGIN { printf "%d\n", e - n }'`
+		if [ $remain -lt 1 ];then
+			break
+		fi
+		$PGBENCH_PATH -n -S -c 1 -T $remain -l --log-prefix=$WORKDIR/bench/c$id.$run >/dev/null 2>&1
+		if [ $? != 0 ];then
+			# do not spin while pgpool refuses connections
+			sleep 0.1
+		fi
+		run=`expr $run + 1`
+	done
+}
+
+#-------------------------------------------
+# make the event of the scenario happen
+#-------------------------------------------
+function event {
+	PCP_OPTS="-w -h localhost -p $PCP_PORT"
+
+	case $1 in
+		standby_down)		$PGBIN/pg_ctl -D data2 -m immediate stop >/dev/null 2>&1;;
+		primary_down)		$PGBIN/pg_ctl -D data0 -m immediate stop >/dev/null 2>&1;;
+		standby_detach)		pcp_detach_node $PCP_OPTS 2 >/dev/null 2>&1;;
+		primary_detach)		pcp_detach_node $PCP_OPTS 0 >/dev/null 2>&1;;
+		standby_failback)	pcp_attach_node $PCP_OPTS 2 >/dev/null 2>&1;;
+	esac
+}
+
+#-------------------------------------------
+# latency percentile in milliseconds of the latencies (us) on stdin
+#-------------------------------------------
+function percentile {
+	sort -n | awk -v p=$1 '{ a[NR] = $1 }
+		END {
+			if (NR == 0) { print "-"; exit }
+			i = int(NR * p / 100 + 0.999999)
+			if (i < 1) i = 1
+			printf "%.1f\n", a[i] / 1000
+		}'
+}
+
+#-------------------------------------------
+# run a scenario and append its result
+#-------------------------------------------
+function run_scenario {
+	s=$1
+
+	echo "=== $s"
+	setup_cluster
+
+	if [ $s = standby_failback ];then
+		pcp_detach_node -w -h localhost -p $PCP_PORT 2 >/dev/null 2>&1
+		sleep 2
+	fi
+
+	mkdir bench
+	start=`now`
+	end=`awk -v s=$start -v t=$((BEFORE + AFTER)) 'BEGIN { printf "%.3f\n", s + t }'`
+	i=0
+	while [ $i -lt $CLIENTS ]
+	do
+		client_loop $i $end &
+		i=`expr $i + 1`
+	done
+
+	sleep $BEFORE
+	t0=`now`
+	event $s
+	wait
+
+	./shutdownall >/dev/null 2>&1
+
+	# completion time and latency (us) of each transaction
+	cat bench/c* 2>/dev/null | awk '$3 ~ /^[0-9]+$/ { printf "%.6f %d\n", $5 + $6 / 1000000, $3 }' | sort -n > bench/all
+
+	detect=`log_time "health check failed on node|=== Starting" $t0`
+	begin=`log_time "=== Starting" $t0`
+	done_at=`log_time "=== .* done\." $t0`
+	cmd_start=`awk '$1 == "start" { print $2; exit }' log/failover_timing 2>/dev/null`
+	cmd_end=`awk '$1 == "end" { print $2; exit }' log/failover_timing 2>/dev/null`
+
+	detection_ms=`msec "$t0" "$detect"`
+	failover_cmd_ms=`msec "$cmd_start" "$cmd_end"`
+	failover_ms=`msec "$begin" "$done_at"`
+
+	# the longest time after the event in which no transaction completed
+	outage_ms=`awk -v t0=$t0 -v end=$end '$1 >= t0 {
+			if ($1 - prev > max) max = $1 - prev
+			prev = $1
+		}
+		BEGIN { prev = t0 }
+		END { if (end - prev > max) max = end - prev; printf "%d\n", max * 1000 }' bench/all`
+
+	base_tps=`awk -v s=$start -v t0=$t0 '$1 >= s + 1 && $1 < t0 { n++ }
+		END { d = t0 - s - 1; if (d <= 0) d = 1; printf "%.0f\n", n / d }' bench/all`
+
+	# time from the end of failover until the throughput gets back to
+	# 90% of the one before the event, in 100ms steps
+	if [ -n "$done_at" ];then
+		restart_ms=`awk -v d=$done_at -v tps=$base_tps -v end=$end '$1 >= d {
+				b = int(($1 - d) * 10)
+				n[b]++
+				if (b > last) last = b
+			}
+			END {
+				for (i = 0; i <= last; i++)
+					if (n[i] >= tps / 10 * 0.9) { print (i + 1) * 100; exit }
+				print "-"
+			}' bench/all`
+	else
+		restart_ms="-"
+	fi
+
+	base_p99_ms=`awk -v s=$start -v t0=$t0 '$1 >= s + 1 && $1 < t0 { print $2 }' bench/all | percentile 99`
+	spike_p99_ms=`awk -v t0=$t0 -v w=$WINDOW '$1 >= t0 && $1 < t0 + w { print $2 }' bench/all | percentile 99`
+	spike_max_ms=`awk -v t0=$t0 -v w=$WINDOW '$1 >= t0 && $1 < t0 + w { print $2 }' bench/all | percentile 100`
+
+	cd $dir
+
+	line="$s"
+	for m in $METRICS
+	do
+		eval v=\$$m
+		printf "  %-16s %s\n" $m "$v"
+		line="$line $v"
+	done
+	echo "$line" >> $RESULT
+}
+
+#-------------------------------------------
+# compare the latest results with the baseline
+#-------------------------------------------
+function compare_baseline {
+	echo "=== comparison with $BASELINE"
+	awk -v metrics="$METRICS" '
+		BEGIN { nm = split(metrics, m, " ") }
+		/^#/ { next }
+		FNR == NR { for (i = 2; i <= NF; i++) base[$1, i] = $i; next }
+		{ for (i = 2; i <= NF; i++) cur[$1, i] = $i; seen[$1] = 1 }
+		END {
+			for (s in seen) {
+				print s
+				for (i = 2; i <= nm + 1; i++) {
+					b = base[s, i]; c = cur[s, i]
+					if (b == "" || b == "-" || c == "-" || b == 0)
+						printf "  %-16s %10s %10s\n", m[i - 1], c, b
+					else
+						printf "  %-16s %10s %10s %+7.1f%%\n", m[i - 1], c, b, (c - b) * 100 / b
+				}
+			}
+		}' $BASELINE $RESULT
+}
+
+trap "cd $dir; test -x $WORKDIR/shutdownall && $WORKDIR/shutdownall >/dev/null 2>&1; echo ; exit 0" SIGINT SIGQUIT
+
+while getopts "p:i:b:s:c:T:A:W:e:o:B:?" OPTION
+do
+  case $OPTION in
+    p)  PG_INSTALL_DIR="$OPTARG";;
+    i)  PGPOOL_PATH="$OPTARG";;
+    b)  PGBENCH_PATH="$OPTARG";;
+    s)  PGSOCKET_DIR="$OPTARG";;
+    c)  CLIENTS="$OPTARG";;
+    T)  BEFORE="$OPTARG";;
+    A)  AFTER="$OPTARG";;
+    W)  WINDOW="$OPTARG";;
+    e)  EXTRA_CONF=`realpath "$OPTARG"`;;
+    o)  RESULT=`realpath "$OPTARG"`;;
+    B)  BASELINE=`realpath "$OPTARG"`;;
+    ?)  print_usage
+        exit 2;;
+  esac
+done
+
+shift $(($OPTIND - 1))
+if [ $# -gt 0 ];then
+	SCENARIOS="$*"
+fi
+
+export_env_vars
+
+rm -f $RESULT
+echo "# scenario $METRICS" > $RESULT
+
+for s in $SCENARIOS
+do
+	case $s in
+		standby_down|primary_down|standby_detach|primary_detach|standby_failback)
+			run_scenario $s;;
+		*)
+			echo "$s: unknown scenario"
+			exit 2;;
+	esac
+done
+
+if [ -n "$BASELINE" ];then
+	compare_baseline
+fi
+
+exit 0
@@ -0,0 +1,372 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * bench_env.c: child process environment shared by microbench and
+ * cachesim.
+ *
+ * setup_child() sets up a child process (configuration, shared memory,
+ * process and session contexts) without any backend.  Queries to backends,
+ * which the relation caches send, are answered by the mock do_query()
+ * below.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "pool_config_variables.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/statistics.h"
+#include "utils/pool_ipc.h"
+#include "context/pool_process_context.h"
+#include "context/pool_session_context.h"
+#include "protocol/pool_client_limit.h"
+#include "protocol/pool_process_query.h"
+#include "query_cache/pool_memqcache.h"
+#include "bench_env.h"
+
+/* oids the mocked backend returns for tables are from this */
+#define MOCK_TABLE_OID		16384
+
+/* oid the mocked backend returns for the database */
+#define MOCK_DATABASE_OID	"1"
+
+/* version string the mocked backend returns */
+#define MOCK_VERSION		"PostgreSQL 17.0 on x86_64-pc-linux-gnu"
+
+/* Variables and functions of main/main.c, which is not linked */
+char	   *pcp_conf_file = NULL;
+char	   *conf_file = NULL;
+char	   *hba_file = NULL;
+char	   *base_dir = NULL;
+int			stop_sig = SIGTERM;
+int			myargc;
+char	  **myargv;
+int			assert_enabled = 0;
+char	   *pool_key = NULL;
+
+POOL_CONNECTION_POOL *bench_backend;
+
+static void setup_shared_memory(void);
+static void setup_session(void);
+static char *mock_table_oid(const char *name);
+static POOL_SELECT_RESULT * make_select_result(int nrows, int ncols, const char *value);
+
+/*
+ * Set up what a child process has when it starts to process queries.
+ * options are "name=value" settings which override conf_file.
+ */
+void
+setup_child(int noptions, char **options)
+{
+	int			i;
+
+	mypid = getpid();
+	SetProcessGlobalVariables(PT_MAIN);
+
+	pool_init_config();
+	pool_get_config(conf_file, CFGCXT_INIT);
+
+	for (i = 0; i < noptions; i++)
+	{
+		char	   *name = pstrdup(options[i]);
+		char	   *value = strchr(name, '=');
+
+		if (value == NULL)
+			ereport(FATAL,
+					(errmsg("invalid option \"%s\"", options[i]),
+					 errhint("Options must be given as name=value.")));
+		*value++ = '\0';
+		if (!set_one_config_option(name, value, CFGCXT_INIT, PGC_S_ARGV, WARNING))
+			ereport(FATAL,
+					(errmsg("could not set \"%s\" to \"%s\"", name, value)));
+		pfree(name);
+	}
+
+	setup_shared_memory();
+
+	SetProcessGlobalVariables(PT_CHILD);
+	my_proc_id = 0;
+
+	ProcessLoopContext = AllocSetContextCreate(TopMemoryContext,
+											   "microbench_main_loop",
+											   ALLOCSET_DEFAULT_SIZES);
+	QueryContext = AllocSetContextCreate(ProcessLoopContext,
+										 "microbench_query",
+										 ALLOCSET_DEFAULT_SIZES);
+
+	pool_init_process_context();
+	setup_session();
+}
+
+/*
+ * Allocate the part of the shared memory a child uses for query
+ * processing, the same way as initialize_shared_mem_objects() does.
+ */
+static void
+setup_shared_memory(void)
+{
+	BackendDesc *backend_desc;
+	size_t		size;
+	int			i;
+
+	size = 256;
+	size += MAXALIGN(sizeof(BackendDesc));
+	size += MAXALIGN(pool_coninfo_size());
+	size += MAXALIGN(pool_config->num_init_children * (sizeof(ProcessInfo)) + POOL_CACHE_LINE_SIZE);
+	size += MAXALIGN(sizeof(POOL_REQUEST_INFO));
+	size += MAXALIGN(stat_shared_memory_size());
+	if (pool_config->memory_cache_enabled && pool_is_shmem_cache())
+	{
+		size += MAXALIGN(pool_shared_memory_cache_size());
+		size += MAXALIGN(pool_shared_memory_fsmm_size());
+		size += MAXALIGN(pool_hash_size(pool_config->memqcache_max_num_cache));
+		size += MAXALIGN(pool_oid_map_size());
+		size += MAXALIGN(pool_shmem_lock_size());
+	}
+	if (pool_config->memory_cache_enabled)
+		size += MAXALIGN(pool_memqcache_stats_size());
+
+	initialize_shared_memory_main_segment(size);
+
+	/* the query cache statistics are protected by a semaphore */
+	pool_semaphore_create(MAX_NUM_SEMAPHORES);
+
+	backend_desc = pool_shared_memory_segment_get_chunk(sizeof(BackendDesc));
+	memcpy(backend_desc, pool_config->backend_desc, sizeof(BackendDesc));
+	pfree(pool_config->backend_desc);
+	pool_config->backend_desc = backend_desc;
+
+	pool_coninfo_init(pool_shared_memory_segment_get_chunk(pool_coninfo_size()));
+	process_info = (ProcessInfo *) TYPEALIGN(POOL_CACHE_LINE_SIZE,
+											 pool_shared_memory_segment_get_chunk(pool_config->num_init_children * (sizeof(ProcessInfo)) + POOL_CACHE_LINE_SIZE));
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		process_info[i].connection_info = pool_coninfo(i, 0, 0);
+		pool_client_limit_init_process(&process_info[i]);
+	}
+
+	Req_info = pool_shared_memory_segment_get_chunk(sizeof(POOL_REQUEST_INFO));
+
+	stat_set_stat_area(pool_shared_memory_segment_get_chunk(stat_shared_memory_size()));
+	stat_init_stat_area();
+
+	/* all backends are up; node 0 is the primary */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		BACKEND_INFO(i).backend_status = CON_UP;
+		BACKEND_INFO(i).role = i == 0 ? ROLE_PRIMARY : ROLE_STANDBY;
+		my_backend_status[i] = &(BACKEND_INFO(i).backend_status);
+	}
+	Req_info->main_node_id = 0;
+	Req_info->primary_node_id = 0;
+	Req_info->request_queue_head = Req_info->request_queue_tail = -1;
+
+	if (pool_config->memory_cache_enabled)
+	{
+		if (pool_is_shmem_cache())
+		{
+			pool_init_memory_cache(pool_shared_memory_cache_size());
+			pool_init_fsmm(pool_shared_memory_fsmm_size());
+			pool_allocate_fsmm_clock_hand();
+			pool_init_oid_map();
+			pool_hash_init(pool_config->memqcache_max_num_cache);
+			pool_init_whole_cache_blocks();
+			pool_init_shmem_lock();
+		}
+		pool_init_memqcache_stats();
+	}
+}
+
+/*
+ * Create a session with a connection pool whose connections are never
+ * read or written.
+ */
+static void
+setup_session(void)
+{
+	POOL_CONNECTION *frontend;
+	ConnectionInfo *info;
+	StartupPacket *sp;
+	int			i;
+
+	sp = palloc0(sizeof(StartupPacket));
+	sp->major = PROTO_MAJOR_V3;
+	sp->database = pstrdup("postgres");
+	sp->user = pstrdup("postgres");
+	sp->application_name = "microbench";
+
+	frontend = palloc0(sizeof(POOL_CONNECTION));
+	frontend->protoVersion = PROTO_MAJOR_V3;
+
+	bench_backend = palloc0(sizeof(POOL_CONNECTION_POOL));
+	bench_backend->info = pool_coninfo(my_proc_id, 0, 0);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		bench_backend->slots[i] = palloc0(sizeof(POOL_CONNECTION_POOL_SLOT));
+		bench_backend->slots[i]->sp = sp;
+		bench_backend->slots[i]->con = palloc0(sizeof(POOL_CONNECTION));
+		bench_backend->slots[i]->con->tstate = 'I';
+		bench_backend->slots[i]->con->db_node_id = i;
+
+		info = pool_coninfo(my_proc_id, 0, i);
+		StrNCpy(info->database, sp->database, sizeof(info->database));
+		StrNCpy(info->user, sp->user, sizeof(info->user));
+		info->major = sp->major;
+	}
+
+	pool_init_session_context(frontend, bench_backend);
+	pool_set_major_version(PROTO_MAJOR_V3);
+}
+
+/*
+ * Mock of do_query().  Answers the queries the relation caches and
+ * Pgversion() send with one row, so that every table exists, is an
+ * ordinary table and no function is volatile.  Each table name gets its
+ * own oid, so that invalidation by table works as with a real backend.
+ * pool_prefetch_relcache() gets one row of four columns per table.
+ */
+void
+__wrap_do_query(POOL_CONNECTION * backend, char *query, POOL_SELECT_RESULT * *result, int major)
+{
+	POOL_SELECT_RESULT *res;
+	char	   *p;
+	int			i;
+
+	if (strstr(query, "version()"))
+	{
+		*result = make_select_result(1, 1, MOCK_VERSION);
+		return;
+	}
+
+	if ((p = strstr(query, "FROM (VALUES ")) != NULL)
+	{
+		int			ntables = 0;
+
+		/* count "(i, 'name', 'relname')" */
+		while ((p = strstr(p, ", '")) != NULL)
+		{
+			ntables++;
+			p += 3;
+		}
+		res = make_select_result(ntables / 2, 4, "0");
+
+		/* the oid of each row comes from 'name' */
+		p = strstr(query, "FROM (VALUES ");
+		for (i = 0; i < res->numrows; i++)
+		{
+			p = strstr(p, ", '") + 2;
+			pfree(res->data[i * 4]);
+			res->data[i * 4] = mock_table_oid(p);
+			res->nullflags[i * 4] = strlen(res->data[i * 4]);
+			p = strstr(p + 1, ", '") + 3;
+		}
+		*result = res;
+		return;
+	}
+
+	if (strncmp(query, "SELECT oid FROM pg_catalog.pg_database", 38) == 0)
+	{
+		*result = make_select_result(1, 1, MOCK_DATABASE_OID);
+		return;
+	}
+
+	if (strncmp(query, "SELECT count(*)", 15) != 0 &&
+		((p = strstr(query, "regclass(")) != NULL ||
+		 (strncmp(query, "SELECT oid FROM", 15) == 0 && (p = strstr(query, "relname = ")) != NULL)))
+	{
+		res = make_select_result(1, 1, "0");
+		pfree(res->data[0]);
+		res->data[0] = mock_table_oid(strchr(p, '\''));
+		res->nullflags[0] = strlen(res->data[0]);
+		*result = res;
+		return;
+	}
+
+	*result = make_select_result(1, 1, "0");
+}
+
+/*
+ * oid of the table whose name is the string literal at name
+ */
+static char *
+mock_table_oid(const char *name)
+{
+	const char *end;
+	uint32		hash = 2166136261U;
+
+	if (name == NULL || *name != '\'')
+		return psprintf("%d", MOCK_TABLE_OID);
+
+	end = strchr(name + 1, '\'');
+	if (end == NULL)
+		end = name + strlen(name);
+
+	/* FNV-1a */
+	for (name++; name < end; name++)
+		hash = (hash ^ (unsigned char) *name) * 16777619U;
+
+	return psprintf("%u", MOCK_TABLE_OID + hash % 1000000);
+}
+
+static POOL_SELECT_RESULT *
+make_select_result(int nrows, int ncols, const char *value)
+{
+	POOL_SELECT_RESULT *res;
+	int			i;
+
+	res = palloc0(sizeof(POOL_SELECT_RESULT));
+	res->rowdesc = palloc0(sizeof(RowDesc));
+	res->rowdesc->num_attrs = ncols;
+	res->rowdesc->attrinfo = palloc0(sizeof(AttrInfo) * ncols);
+	for (i = 0; i < ncols; i++)
+		res->rowdesc->attrinfo[i].attrname = pstrdup("?column?");
+	res->numrows = nrows;
+	res->nullflags = palloc(sizeof(int) * (nrows * ncols + 1));
+	res->data = palloc0(sizeof(char *) * (nrows * ncols + 1));
+	for (i = 0; i < nrows * ncols; i++)
+	{
+		res->data[i] = pstrdup(value);
+		res->nullflags[i] = strlen(value);
+	}
+	return res;
+}
+
+char *
+get_pool_key(void)
+{
+	return pool_key;
+}
+
+char *
+get_config_file_name(void)
+{
+	return conf_file;
+}
+
+char *
+get_hba_file_name(void)
+{
+	return hba_file;
+}
@@ -0,0 +1,40 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * bench_env.h: child process environment shared by microbench and
+ * cachesim.
+ *
+ */
+#ifndef BENCH_ENV_H
+#define BENCH_ENV_H
+
+#include "pool.h"
+
+/* variables of main/main.c, which is not linked */
+extern char *conf_file;
+extern char *base_dir;
+extern int	myargc;
+extern char **myargv;
+
+/* connection pool of the session, whose connections are never used */
+extern POOL_CONNECTION_POOL *bench_backend;
+
+extern void setup_child(int noptions, char **options);
+
+#endif							/* BENCH_ENV_H */
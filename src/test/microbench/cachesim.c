@@ -0,0 +1,629 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * cachesim.c: query cache simulator driven by statement logs.
+ *
+ * The program replays the statements of pgpool logs, written with
+ * log_client_messages or log_statement, through the shared memory query
+ * cache of pool_memqcache.c as a child process would: a cacheable SELECT
+ * is looked up in the cache and on a miss, a result of a made up size is
+ * stored, which may evict other entries.  INSERT, UPDATE, DELETE and the
+ * like invalidate the entries of their tables.  At the end, it reports the
+ * hit ratio, the evictions, the free and fragmented space of the cache
+ * blocks and how long the query cache lock was held.
+ *
+ * The query cache settings come from the configuration file and "-c
+ * name=value" options, so alternative settings can be compared by running
+ * the program with the same logs.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/pool_path.h"
+#include "utils/pool_select_walker.h"
+#include "query_cache/pool_memqcache.h"
+#include "parser/parser.h"
+#include "parser/pg_list.h"
+#include "bench_env.h"
+
+/* default size of the result of a SELECT, in bytes */
+#define DEFAULT_RESULT_SIZE	1024
+
+/* maximum number of "-c name=value" */
+#define MAX_OPTIONS			64
+
+/* lock hold times of one kind */
+typedef struct
+{
+	char	   *name;
+	int			count;
+	int			size;
+	uint32	   *ns;				/* hold time of each */
+}			LockTimes;
+
+/* counters of the simulation */
+typedef struct
+{
+	uint64		statements;		/* statements replayed */
+	uint64		selects;		/* SELECTs */
+	uint64		uncacheable;	/* SELECTs pool_is_allow_to_cache() rejects */
+	uint64		hits;			/* SELECTs found in the cache */
+	uint64		misses;			/* SELECTs not found in the cache */
+	uint64		too_large;		/* misses larger than memqcache_maxcache */
+	uint64		inserts;		/* results committed to the cache */
+	uint64		writes;			/* statements invalidating tables */
+	uint64		invalidated;	/* tables invalidated */
+	uint64		unparsed;		/* statements which cannot be parsed */
+}			SimCounters;
+
+static SimCounters counters;
+static long long int evicted_at_start;
+
+static LockTimes shared_lock = {"shared"};
+static LockTimes insert_lock = {"exclusive (insert)"};
+static LockTimes invalidate_lock = {"exclusive (invalidate)"};
+
+/* statements to replay before counting */
+static uint64 warmup = 0;
+
+static int	result_min = DEFAULT_RESULT_SIZE;
+static int	result_max = DEFAULT_RESULT_SIZE;
+
+static MemoryContext SimContext;
+
+static void usage(void);
+static void replay_file(FILE *fp, uint64 interval);
+static char *log_message(char *line);
+static char *log_statement(char *entry);
+static void replay_statement(char *query);
+static void replay_select(Node *node, char *query);
+static void replay_write(Node *node);
+static char *make_result(const char *query, int *size);
+static void reset_counters(void);
+static void record_lock_time(LockTimes * lt, uint64 ns);
+static void print_progress(void);
+static void print_report(void);
+static void print_lock_times(LockTimes * lt);
+static int	cmp_uint32(const void *a, const void *b);
+static uint64 now_ns(void);
+
+int
+main(int argc, char **argv)
+{
+	char	   *conf = "microbench.conf";
+	char	   *options[MAX_OPTIONS];
+	int			noptions = 0;
+	uint64		interval = 0;
+	int			opt;
+	int			i;
+
+	myargc = argc;
+	myargv = argv;
+
+	while ((opt = getopt(argc, argv, "c:f:i:r:w:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c':
+				if (noptions == MAX_OPTIONS)
+				{
+					fprintf(stderr, "too many -c options\n");
+					exit(1);
+				}
+				options[noptions++] = optarg;
+				break;
+
+			case 'f':
+				conf = optarg;
+				break;
+
+			case 'i':
+				interval = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'r':
+				if (sscanf(optarg, "%d:%d", &result_min, &result_max) == 1)
+					result_max = result_min;
+				if (result_min <= 0 || result_max < result_min)
+				{
+					usage();
+					exit(1);
+				}
+				break;
+
+			case 'w':
+				warmup = strtoull(optarg, NULL, 10);
+				break;
+
+			default:
+				usage();
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	MemoryContextInit();
+
+	base_dir = get_current_working_dir();
+	conf_file = make_absolute_path(conf, base_dir);
+
+	setup_child(noptions, options);
+
+	if (!pool_config->memory_cache_enabled || !pool_is_shmem_cache())
+		ereport(FATAL,
+				(errmsg("cachesim needs memory_cache_enabled = on and memqcache_method = 'shmem'")));
+
+	SimContext = AllocSetContextCreate(TopMemoryContext,
+									   "cachesim",
+									   ALLOCSET_DEFAULT_SIZES);
+
+	reset_counters();
+
+	if (optind >= argc)
+		replay_file(stdin, interval);
+
+	for (i = optind; i < argc; i++)
+	{
+		FILE	   *fp;
+
+		fp = fopen(argv[i], "r");
+		if (fp == NULL)
+			ereport(FATAL,
+					(errmsg("could not open log file \"%s\"", argv[i]),
+					 errdetail("%m")));
+		replay_file(fp, interval);
+		fclose(fp);
+	}
+
+	print_report();
+
+	exit(0);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "cachesim - query cache simulator driven by statement logs\n\n");
+	fprintf(stderr, "Usage: cachesim [OPTION]... [LOGFILE]...\n");
+	fprintf(stderr, "  -c NAME=VALUE  override a setting of the configuration file\n");
+	fprintf(stderr, "  -f CONFIG      pgpool.conf to use (default: microbench.conf)\n");
+	fprintf(stderr, "  -i NUM         print progress every NUM statements\n");
+	fprintf(stderr, "  -r MIN[:MAX]   size of SELECT results in bytes (default: %d)\n",
+			DEFAULT_RESULT_SIZE);
+	fprintf(stderr, "  -w NUM         count nothing for the first NUM statements\n");
+	fprintf(stderr, "  -h             print this help\n");
+	fprintf(stderr, "\nLog files are read from the standard input if none is given.\n");
+}
+
+/*
+ * Replay the statements of a log file.  A log entry starts with a line
+ * having a message level ("LOG:  ", "DETAIL:  " and so on).  Other lines
+ * continue the previous entry, as a statement may span lines.
+ */
+static void
+replay_file(FILE *fp, uint64 interval)
+{
+	StringInfoData entry;
+	char	   *line = NULL;
+	size_t		linesize = 0;
+	ssize_t		len;
+	bool		eof = false;
+
+	initStringInfo(&entry);
+
+	while (!eof)
+	{
+		char	   *msg = NULL;
+		char	   *query;
+
+		len = getline(&line, &linesize, fp);
+		if (len == -1)
+			eof = true;
+		else
+		{
+			while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+				line[--len] = '\0';
+
+			msg = log_message(line);
+			if (msg == NULL)
+			{
+				/* continuation line */
+				if (entry.len > 0)
+				{
+					appendStringInfoChar(&entry, '\n');
+					appendStringInfoString(&entry, line);
+				}
+				continue;
+			}
+		}
+
+		/* the previous entry is complete */
+		query = log_statement(entry.data);
+		if (query)
+		{
+			MemoryContext old_context = MemoryContextSwitchTo(SimContext);
+
+			replay_statement(query);
+			MemoryContextSwitchTo(old_context);
+			MemoryContextReset(SimContext);
+
+			if (warmup > 0 && counters.statements == warmup)
+			{
+				reset_counters();
+				warmup = 0;
+			}
+			else if (interval > 0 && counters.statements % interval == 0)
+				print_progress();
+		}
+
+		resetStringInfo(&entry);
+		if (msg)
+			appendStringInfoString(&entry, msg);
+	}
+
+	free(line);
+	pfree(entry.data);
+}
+
+/*
+ * If the line starts a log entry, returns the message following the
+ * message level, otherwise NULL.
+ */
+static char *
+log_message(char *line)
+{
+	static const char *levels[] = {
+		"LOG:  ", "DETAIL:  ", "HINT:  ", "WARNING:  ", "ERROR:  ",
+		"FATAL:  ", "NOTICE:  ", "INFO:  ", "LOCATION:  ", "DEBUG", NULL
+	};
+	int			i;
+
+	for (i = 0; levels[i]; i++)
+	{
+		char	   *p = strstr(line, levels[i]);
+
+		if (p)
+		{
+			if (strncmp(p, "DEBUG", 5) == 0)
+			{
+				p = strstr(p, ":  ");
+				return p ? p + 3 : line + strlen(line);
+			}
+			return p + strlen(levels[i]);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns the statement a log entry records, or NULL.  Recognized are the
+ * entries of log_statement ("statement: ...") and the details of Query and
+ * Parse messages logged by log_client_messages ("query: \"...\"").
+ */
+static char *
+log_statement(char *entry)
+{
+	char	   *p;
+	int			len;
+
+	if (strncmp(entry, "statement: ", 11) == 0)
+		return entry + 11;
+
+	if (strncmp(entry, "query: \"", 8) == 0)
+		p = entry + 8;
+	else if (strncmp(entry, "statement: \"", 12) == 0 &&
+			 (p = strstr(entry, ", query: \"")) != NULL)
+		p += 10;
+	else
+		return NULL;
+
+	len = strlen(p);
+	if (len == 0 || p[len - 1] != '"')
+		return NULL;
+	p[len - 1] = '\0';
+	return p;
+}
+
+/*
+ * Replay a statement.  Like pgpool, multi-statement queries are never
+ * cached, but they invalidate the tables they write.
+ */
+static void
+replay_statement(char *query)
+{
+	List	   *parse_tree_list;
+	ListCell   *cell;
+	bool		error;
+
+	counters.statements++;
+
+	parse_tree_list = raw_parser(query, RAW_PARSE_DEFAULT, strlen(query), &error, false);
+	if (parse_tree_list == NIL || error)
+	{
+		counters.unparsed++;
+		return;
+	}
+
+	foreach(cell, parse_tree_list)
+	{
+		Node	   *node = ((RawStmt *) lfirst(cell))->stmt;
+
+		if (IsA(node, SelectStmt))
+		{
+			counters.selects++;
+			if (list_length(parse_tree_list) > 1)
+				counters.uncacheable++;
+			else
+				replay_select(node, query);
+		}
+		else
+			replay_write(node);
+	}
+}
+
+/*
+ * Look up a SELECT in the cache, and store a result on a miss, holding the
+ * lock as pool_fetch_from_memory_cache() and pool_handle_query_cache() do.
+ */
+static void
+replay_select(Node *node, char *query)
+{
+	SelectContext ctx;
+	char	   *buf;
+	size_t		len;
+	int			num_oids;
+	int			size;
+	int			ret;
+	uint64		start;
+
+	if (!pool_is_allow_to_cache(node, query))
+	{
+		counters.uncacheable++;
+		return;
+	}
+
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
+	start = now_ns();
+	ret = pool_fetch_cache(bench_backend, query, &buf, &len);
+	record_lock_time(&shared_lock, now_ns() - start);
+	pool_shmem_unlock();
+
+	if (ret == 0)
+	{
+		counters.hits++;
+		return;
+	}
+	counters.misses++;
+
+	buf = make_result(query, &size);
+	if (size > pool_config->memqcache_maxcache)
+	{
+		counters.too_large++;
+		return;
+	}
+
+	num_oids = pool_extract_table_oids_from_select_stmt(node, &ctx);
+
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+	start = now_ns();
+	pool_commit_cache(bench_backend, query, buf, size, num_oids, ctx.table_oids,
+					  pool_config->memqcache_expire);
+	record_lock_time(&insert_lock, now_ns() - start);
+	pool_shmem_unlock();
+
+	counters.inserts++;
+}
+
+/*
+ * Invalidate the cache entries of the tables a statement writes.
+ * InvalidateQueryCache() takes the lock by itself, so the hold time is
+ * that of the call.
+ */
+static void
+replay_write(Node *node)
+{
+	int		   *oids;
+	int			num_oids;
+	int			i;
+	uint64		start;
+
+	if (!pool_config->memqcache_auto_cache_invalidation)
+		return;
+
+	if (!IsA(node, InsertStmt) && !IsA(node, UpdateStmt) &&
+		!IsA(node, DeleteStmt) && !IsA(node, TruncateStmt) &&
+		!IsA(node, DropStmt) && !IsA(node, AlterTableStmt))
+		return;
+
+	num_oids = pool_extract_table_oids(node, &oids);
+	if (num_oids <= 0)
+		return;
+
+	counters.writes++;
+	for (i = 0; i < num_oids; i++)
+	{
+		start = now_ns();
+		InvalidateQueryCache(oids[i], 0);
+		record_lock_time(&invalidate_lock, now_ns() - start);
+		counters.invalidated++;
+	}
+}
+
+/*
+ * Make up the result of a query.  The size is between result_min and
+ * result_max, and always the same for the same query.  The data look like
+ * rows of numbers so that compression behaves somewhat like with real
+ * results.
+ */
+static char *
+make_result(const char *query, int *size)
+{
+	uint32		hash = 2166136261U;
+	const char *p;
+	char	   *buf;
+	int			i;
+
+	/* FNV-1a */
+	for (p = query; *p; p++)
+		hash = (hash ^ (unsigned char) *p) * 16777619U;
+
+	*size = result_min + hash % (result_max - result_min + 1);
+	buf = palloc(*size);
+	for (i = 0; i < *size; i++)
+	{
+		hash = hash * 1103515245 + 12345;
+		buf[i] = (i % 16 == 15) ? '\t' : '0' + (hash >> 16) % 10;
+	}
+	return buf;
+}
+
+/*
+ * Start counting from now on.
+ */
+static void
+reset_counters(void)
+{
+	memset(&counters, 0, sizeof(counters));
+	evicted_at_start = pool_get_memqcache_stats()->num_evicted_entries;
+	shared_lock.count = insert_lock.count = invalidate_lock.count = 0;
+}
+
+static void
+record_lock_time(LockTimes * lt, uint64 ns)
+{
+	if (lt->count == lt->size)
+	{
+		if (lt->ns == NULL)
+		{
+			lt->size = 1024;
+			lt->ns = MemoryContextAllocHuge(TopMemoryContext, sizeof(uint32) * lt->size);
+		}
+		else
+		{
+			lt->size *= 2;
+			lt->ns = repalloc_huge(lt->ns, sizeof(uint32) * lt->size);
+		}
+	}
+	lt->ns[lt->count++] = ns > PG_UINT32_MAX ? PG_UINT32_MAX : (uint32) ns;
+}
+
+static void
+print_progress(void)
+{
+	long long int evicted = pool_get_memqcache_stats()->num_evicted_entries - evicted_at_start;
+
+	printf("statements %llu hits %llu misses %llu hit ratio %.2f%% evicted %lld\n",
+		   (unsigned long long) counters.statements,
+		   (unsigned long long) counters.hits,
+		   (unsigned long long) counters.misses,
+		   counters.hits + counters.misses > 0 ?
+		   100.0 * counters.hits / (counters.hits + counters.misses) : 0.0,
+		   evicted);
+	fflush(stdout);
+}
+
+static void
+print_report(void)
+{
+	POOL_SHMEM_STATS *stats = pool_get_shmem_storage_stats();
+	long long int evicted = stats->cache_stats.num_evicted_entries - evicted_at_start;
+	uint64		lookups = counters.hits + counters.misses;
+
+	printf("memqcache_total_size        %lld\n", (long long int) pool_config->memqcache_total_size);
+	printf("memqcache_cache_block_size  %d\n", pool_config->memqcache_cache_block_size);
+	printf("memqcache_max_num_cache     %d\n", pool_config->memqcache_max_num_cache);
+	printf("memqcache_maxcache          %d\n", pool_config->memqcache_maxcache);
+	printf("memqcache_admission_filter  %s\n", pool_config->memqcache_admission_filter ? "on" : "off");
+	printf("\n");
+	printf("statements                  %llu\n", (unsigned long long) counters.statements);
+	printf("  not parsed                %llu\n", (unsigned long long) counters.unparsed);
+	printf("  SELECTs                   %llu\n", (unsigned long long) counters.selects);
+	printf("  not cacheable SELECTs     %llu\n", (unsigned long long) counters.uncacheable);
+	printf("  writes                    %llu (%llu tables invalidated)\n",
+		   (unsigned long long) counters.writes, (unsigned long long) counters.invalidated);
+	printf("cache lookups               %llu\n", (unsigned long long) lookups);
+	printf("  hits                      %llu (%.2f%%)\n", (unsigned long long) counters.hits,
+		   lookups > 0 ? 100.0 * counters.hits / lookups : 0.0);
+	printf("  misses                    %llu\n", (unsigned long long) counters.misses);
+	printf("  larger than maxcache      %llu\n", (unsigned long long) counters.too_large);
+	printf("inserts                     %llu\n", (unsigned long long) counters.inserts);
+	printf("evicted entries             %lld (%.2f per insert)\n", evicted,
+		   counters.inserts > 0 ? (double) evicted / counters.inserts : 0.0);
+	printf("\n");
+	printf("cache entries               %d\n", stats->num_cache_entries);
+	printf("hash entries used           %d of %d\n", stats->used_hash_entries, stats->num_hash_entries);
+	printf("used bytes                  %ld\n", stats->used_cache_entries_size);
+	printf("free bytes                  %ld\n", stats->free_cache_entries_size);
+	printf("fragmented bytes            %ld\n", stats->fragment_cache_entries_size);
+	printf("\n");
+	printf("%-24s %10s %10s %10s %10s %10s\n",
+		   "lock hold (ns)", "count", "mean", "p50", "p99", "max");
+	print_lock_times(&shared_lock);
+	print_lock_times(&insert_lock);
+	print_lock_times(&invalidate_lock);
+}
+
+static void
+print_lock_times(LockTimes * lt)
+{
+	uint64		total = 0;
+	int			i;
+
+	if (lt->count == 0)
+	{
+		printf("%-24s %10d\n", lt->name, 0);
+		return;
+	}
+
+	qsort(lt->ns, lt->count, sizeof(uint32), cmp_uint32);
+	for (i = 0; i < lt->count; i++)
+		total += lt->ns[i];
+
+	printf("%-24s %10d %10llu %10u %10u %10u\n",
+		   lt->name, lt->count, (unsigned long long) (total / lt->count),
+		   lt->ns[(lt->count - 1) / 2],
+		   lt->ns[(int) ((lt->count - 1) * 0.99)],
+		   lt->ns[lt->count - 1]);
+}
+
+static int
+cmp_uint32(const void *a, const void *b)
+{
+	uint32		x = *(const uint32 *) a;
+	uint32		y = *(const uint32 *) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint64
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
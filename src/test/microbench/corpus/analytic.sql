@@ -0,0 +1,43 @@
+-- Reporting queries: aggregates, window functions, CTEs and subqueries.
+SELECT date_trunc('day', o.created_at) AS day, count(*) AS orders, sum(o.total) AS revenue
+  FROM orders o
+ WHERE o.created_at >= '2026-01-01' AND o.created_at < '2026-02-01'
+ GROUP BY 1
+ ORDER BY 1;
+SELECT c.name, sum(i.quantity * i.price) AS sales,
+       rank() OVER (ORDER BY sum(i.quantity * i.price) DESC) AS rank
+  FROM order_items i
+  JOIN products p ON p.id = i.product_id
+  JOIN categories c ON c.id = p.category_id
+ GROUP BY c.name
+HAVING sum(i.quantity * i.price) > 1000;
+WITH monthly AS (
+  SELECT user_id, date_trunc('month', created_at) AS month, sum(total) AS total
+    FROM orders
+   GROUP BY user_id, date_trunc('month', created_at)
+)
+SELECT month, avg(total) AS avg_total, percentile_cont(0.5) WITHIN GROUP (ORDER BY total) AS median
+  FROM monthly
+ GROUP BY month
+ ORDER BY month;
+SELECT u.id, u.name,
+       (SELECT count(*) FROM orders o WHERE o.user_id = u.id) AS order_count,
+       (SELECT max(o.created_at) FROM orders o WHERE o.user_id = u.id) AS last_order
+  FROM users u
+ WHERE EXISTS (SELECT 1 FROM orders o WHERE o.user_id = u.id AND o.total > 500)
+ ORDER BY order_count DESC
+ LIMIT 100;
+SELECT p.id, p.name, s.stock, coalesce(r.reserved, 0) AS reserved
+  FROM products p
+  JOIN stock s ON s.product_id = p.id
+  LEFT JOIN (SELECT product_id, sum(quantity) AS reserved FROM order_items WHERE shipped = false GROUP BY product_id) r
+    ON r.product_id = p.id
+ WHERE s.stock - coalesce(r.reserved, 0) < 10;
+SELECT region, product_line, sum(amount) FROM sales GROUP BY ROLLUP (region, product_line);
+SELECT user_id, created_at, total,
+       sum(total) OVER (PARTITION BY user_id ORDER BY created_at ROWS BETWEEN UNBOUNDED PRECEDING AND CURRENT ROW) AS running_total,
+       lag(total) OVER (PARTITION BY user_id ORDER BY created_at) AS previous_total
+  FROM orders
+ WHERE created_at >= '2026-01-01';
+SELECT a.id FROM accounts a UNION SELECT b.account_id FROM archived_accounts b EXCEPT SELECT c.account_id FROM closed_accounts c;
+SELECT relname, n_live_tup FROM pg_catalog.pg_stat_user_tables ORDER BY n_live_tup DESC LIMIT 10;
@@ -0,0 +1,16 @@
+-- Schema changes and maintenance commands.
+CREATE TABLE IF NOT EXISTS audit_log (id bigserial PRIMARY KEY, user_id integer NOT NULL REFERENCES users(id), action text NOT NULL, payload jsonb, created_at timestamptz NOT NULL DEFAULT now());
+CREATE INDEX CONCURRENTLY IF NOT EXISTS audit_log_user_id_idx ON audit_log (user_id, created_at DESC);
+ALTER TABLE orders ADD COLUMN IF NOT EXISTS coupon_code varchar(32);
+ALTER TABLE orders ALTER COLUMN status SET DEFAULT 'new';
+ALTER TABLE order_items ADD CONSTRAINT order_items_quantity_check CHECK (quantity > 0);
+CREATE VIEW active_users AS SELECT id, name, email FROM users WHERE deleted_at IS NULL;
+CREATE TEMPORARY TABLE tmp_import (id integer, name text) ON COMMIT DROP;
+CREATE UNLOGGED TABLE cache_entries (key text PRIMARY KEY, value bytea, expires_at timestamptz);
+DROP INDEX IF EXISTS audit_log_user_id_idx;
+DROP TABLE IF EXISTS tmp_import;
+TRUNCATE TABLE cache_entries;
+COMMENT ON TABLE audit_log IS 'user actions';
+GRANT SELECT, INSERT ON audit_log TO app_user;
+VACUUM ANALYZE orders;
+CREATE SEQUENCE IF NOT EXISTS invoice_no_seq START 1000;
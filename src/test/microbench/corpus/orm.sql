@@ -0,0 +1,23 @@
+-- Queries typical of ORMs: primary key lookups, joins of a few tables,
+-- pagination and DML with RETURNING.
+SELECT "users"."id", "users"."email", "users"."name", "users"."created_at" FROM "users" WHERE "users"."id" = 42 LIMIT 1;
+SELECT users.id AS users_id, users.email AS users_email, users.name AS users_name FROM users WHERE users.email = 'alice@example.com';
+SELECT "orders".* FROM "orders" WHERE "orders"."user_id" = 42 ORDER BY "orders"."created_at" DESC LIMIT 20 OFFSET 40;
+SELECT COUNT(*) FROM "orders" WHERE "orders"."user_id" = 42 AND "orders"."status" IN ('paid', 'shipped');
+SELECT o.id, o.total, i.product_id, i.quantity, p.name
+  FROM orders o
+  JOIN order_items i ON i.order_id = o.id
+  JOIN products p ON p.id = i.product_id
+ WHERE o.id = 1001;
+SELECT t0.id, t0.title, t0.body, t1.id, t1.name FROM posts t0 LEFT OUTER JOIN authors t1 ON t1.id = t0.author_id WHERE t0.published = true ORDER BY t0.published_at DESC LIMIT 10;
+SELECT 1 AS one FROM "sessions" WHERE "sessions"."token" = 'd41d8cd98f00b204e9800998ecf8427e' LIMIT 1;
+SELECT "products"."id", "products"."name", "products"."price" FROM "products" WHERE "products"."category_id" IN (3, 5, 8, 13, 21) AND "products"."deleted_at" IS NULL;
+INSERT INTO "orders" ("user_id", "total", "status", "created_at") VALUES (42, 99.50, 'new', '2026-01-01 10:00:00') RETURNING "id";
+UPDATE "users" SET "last_login_at" = '2026-01-01 10:00:00', "login_count" = "login_count" + 1 WHERE "users"."id" = 42;
+DELETE FROM "sessions" WHERE "sessions"."expires_at" < '2026-01-01 00:00:00';
+BEGIN;
+SELECT "accounts"."id", "accounts"."balance" FROM "accounts" WHERE "accounts"."id" = 7 FOR UPDATE;
+COMMIT;
+SET search_path TO public;
+SELECT nextval('orders_id_seq');
+SELECT now();
@@ -0,0 +1,519 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * main.c: microbenchmark of the parser, the query router and the query
+ * cache.
+ *
+ * The program sets up a child process environment (configuration, shared
+ * memory, process and session contexts) without any backend, then feeds
+ * the queries of each corpus file through the functions a child calls for
+ * every query: raw_parser(), the parse cache, the select walkers,
+ * pool_where_to_send(), pool_is_allow_to_cache() and the shared memory
+ * query cache.  For each benchmark and corpus, it reports the time and the
+ * number of memory allocations per query.
+ *
+ * Queries to backends, which the relation caches send, are answered by
+ * the mock do_query() in bench_env.c.  The relation caches are warmed up
+ * before measuring, so the numbers are those of the steady state of a
+ * child.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/pool_path.h"
+#include "utils/statistics.h"
+#include "utils/pool_select_walker.h"
+#include "utils/pool_parse_cache.h"
+#include "context/pool_process_context.h"
+#include "context/pool_session_context.h"
+#include "context/pool_query_context.h"
+#include "protocol/pool_process_query.h"
+#include "protocol/pool_proto_modules.h"
+#include "query_cache/pool_memqcache.h"
+#include "parser/parser.h"
+#include "parser/pg_list.h"
+#include "bench_env.h"
+
+/* default minimum duration of each benchmark and corpus, in milliseconds */
+#define DEFAULT_DURATION	1000
+
+typedef struct
+{
+	char	   *name;			/* file name */
+	int			nqueries;
+	char	  **queries;
+	int		   *lens;
+	Node	  **nodes;			/* parse trees of the queries */
+}			Corpus;
+
+typedef struct
+{
+	char	   *name;
+	void		(*setup) (Corpus * corpus);	/* called before warming up, or
+											 * NULL */
+	void		(*run) (Corpus * corpus, int i);	/* processes one query */
+}			Benchmark;
+
+static void bench_parse(Corpus * corpus, int i);
+static void bench_parse_minimal(Corpus * corpus, int i);
+static void bench_parse_cached(Corpus * corpus, int i);
+static void bench_walkers(Corpus * corpus, int i);
+static void bench_where_to_send(Corpus * corpus, int i);
+static void bench_allow_to_cache(Corpus * corpus, int i);
+static void bench_cache_fetch(Corpus * corpus, int i);
+static void setup_cache_hit(Corpus * corpus);
+
+static Benchmark benchmarks[] = {
+	{"parse", NULL, bench_parse},
+	{"parse_minimal", NULL, bench_parse_minimal},
+	{"parse_cached", NULL, bench_parse_cached},
+	{"select_walkers", NULL, bench_walkers},
+	{"where_to_send", NULL, bench_where_to_send},
+	{"allow_to_cache", NULL, bench_allow_to_cache},
+	/* cache_miss must come first since cache_hit fills the cache */
+	{"cache_miss", NULL, bench_cache_fetch},
+	{"cache_hit", setup_cache_hit, bench_cache_fetch},
+	{NULL, NULL, NULL}
+};
+
+static MemoryContext BenchContext;
+
+/* number of memory allocations so far */
+static uint64 nallocs = 0;
+
+static void usage(void);
+static Corpus * load_corpus(char *path);
+static void run_benchmark(Benchmark * bench, Corpus * corpus, int duration);
+static uint64 now_ns(void);
+
+int
+main(int argc, char **argv)
+{
+	char	   *conf = "microbench.conf";
+	char	   *only = NULL;
+	int			duration = DEFAULT_DURATION;
+	Corpus	  **corpora;
+	int			ncorpora;
+	Benchmark  *bench;
+	int			opt;
+	int			i;
+
+	myargc = argc;
+	myargv = argv;
+
+	while ((opt = getopt(argc, argv, "b:f:t:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b':
+				only = optarg;
+				break;
+
+			case 'f':
+				conf = optarg;
+				break;
+
+			case 't':
+				duration = atoi(optarg);
+				if (duration <= 0)
+				{
+					usage();
+					exit(1);
+				}
+				break;
+
+			default:
+				usage();
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (optind >= argc)
+	{
+		usage();
+		exit(1);
+	}
+
+	MemoryContextInit();
+
+	base_dir = get_current_working_dir();
+	conf_file = make_absolute_path(conf, base_dir);
+
+	setup_child(0, NULL);
+	BenchContext = AllocSetContextCreate(TopMemoryContext,
+										 "microbench",
+										 ALLOCSET_DEFAULT_SIZES);
+
+	ncorpora = argc - optind;
+	corpora = palloc(sizeof(Corpus *) * ncorpora);
+	for (i = 0; i < ncorpora; i++)
+		corpora[i] = load_corpus(argv[optind + i]);
+
+	printf("%-16s %-16s %7s %10s %12s %10s\n",
+		   "benchmark", "corpus", "queries", "ops", "ns/op", "allocs/op");
+
+	for (bench = benchmarks; bench->name; bench++)
+	{
+		if (only && strcmp(only, bench->name) != 0)
+			continue;
+
+		for (i = 0; i < ncorpora; i++)
+			run_benchmark(bench, corpora[i], duration);
+	}
+
+	exit(0);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "microbench - microbenchmark of the parser, the query router and the query cache\n\n");
+	fprintf(stderr, "Usage: microbench [OPTION]... CORPUS...\n");
+	fprintf(stderr, "  -b BENCHMARK  run only the given benchmark\n");
+	fprintf(stderr, "  -f CONFIG     pgpool.conf to use (default: microbench.conf)\n");
+	fprintf(stderr, "  -t MSEC       minimum duration of each benchmark per corpus (default: %d)\n",
+			DEFAULT_DURATION);
+	fprintf(stderr, "  -h            print this help\n");
+}
+
+/*
+ * Read queries from a corpus file.  Each query ends with a line ending
+ * with a semicolon.  Lines starting with "--" outside of a query are
+ * ignored.  Queries which cannot be parsed are skipped.
+ */
+static Corpus *
+load_corpus(char *path)
+{
+	Corpus	   *corpus;
+	FILE	   *fp;
+	StringInfoData query;
+	char	   *line = NULL;
+	size_t		linesize = 0;
+	ssize_t		len;
+	int			max = 64;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		ereport(FATAL,
+				(errmsg("could not open corpus file \"%s\"", path),
+				 errdetail("%m")));
+
+	corpus = palloc0(sizeof(Corpus));
+	corpus->name = pstrdup(strrchr(path, '/') ? strrchr(path, '/') + 1 : path);
+	corpus->queries = palloc(sizeof(char *) * max);
+	corpus->lens = palloc(sizeof(int) * max);
+	corpus->nodes = palloc(sizeof(Node *) * max);
+
+	initStringInfo(&query);
+
+	while ((len = getline(&line, &linesize, fp)) != -1)
+	{
+		List	   *parse_tree_list;
+		bool		error;
+
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+						   line[len - 1] == ' ' || line[len - 1] == '\t'))
+			line[--len] = '\0';
+
+		if (query.len == 0 && (len == 0 || strncmp(line, "--", 2) == 0))
+			continue;
+
+		if (query.len > 0)
+			appendStringInfoChar(&query, '\n');
+		appendStringInfoString(&query, line);
+
+		if (len == 0 || line[len - 1] != ';')
+			continue;
+
+		parse_tree_list = raw_parser(query.data, RAW_PARSE_DEFAULT, query.len, &error, false);
+		if (parse_tree_list == NIL || error)
+		{
+			ereport(WARNING,
+					(errmsg("skipping query in \"%s\" which cannot be parsed", path),
+					 errdetail("query: \"%s\"", query.data)));
+			resetStringInfo(&query);
+			continue;
+		}
+
+		if (corpus->nqueries == max)
+		{
+			max *= 2;
+			corpus->queries = repalloc(corpus->queries, sizeof(char *) * max);
+			corpus->lens = repalloc(corpus->lens, sizeof(int) * max);
+			corpus->nodes = repalloc(corpus->nodes, sizeof(Node *) * max);
+		}
+		corpus->queries[corpus->nqueries] = pstrdup(query.data);
+		corpus->lens[corpus->nqueries] = query.len;
+		corpus->nodes[corpus->nqueries] = raw_parser2(parse_tree_list);
+		corpus->nqueries++;
+
+		resetStringInfo(&query);
+	}
+
+	free(line);
+	fclose(fp);
+	pfree(query.data);
+
+	if (corpus->nqueries == 0)
+		ereport(FATAL,
+				(errmsg("no query found in corpus file \"%s\"", path)));
+
+	return corpus;
+}
+
+/*
+ * Run a benchmark over all queries of a corpus, once to warm up the
+ * caches and then repeatedly until the duration has passed, and print the
+ * result.  The memory allocated while processing a query is freed after
+ * each query, which is included in the time.
+ */
+static void
+run_benchmark(Benchmark * bench, Corpus * corpus, int duration)
+{
+	MemoryContext old_context;
+	uint64		start;
+	uint64		elapsed;
+	uint64		allocs;
+	uint64		ops = 0;
+	int			i;
+
+	old_context = MemoryContextSwitchTo(BenchContext);
+
+	if (bench->setup)
+		bench->setup(corpus);
+
+	for (i = 0; i < corpus->nqueries; i++)
+	{
+		bench->run(corpus, i);
+		MemoryContextReset(BenchContext);
+	}
+
+	allocs = nallocs;
+	start = now_ns();
+	do
+	{
+		for (i = 0; i < corpus->nqueries; i++)
+		{
+			bench->run(corpus, i);
+			MemoryContextReset(BenchContext);
+		}
+		ops += corpus->nqueries;
+		elapsed = now_ns() - start;
+	} while (elapsed < (uint64) duration * 1000000);
+	allocs = nallocs - allocs;
+
+	MemoryContextSwitchTo(old_context);
+
+	printf("%-16s %-16s %7d %10llu %12.1f %10.1f\n",
+		   bench->name, corpus->name, corpus->nqueries, (unsigned long long) ops,
+		   (double) elapsed / ops, (double) allocs / ops);
+	fflush(stdout);
+}
+
+static uint64
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+bench_parse(Corpus * corpus, int i)
+{
+	bool		error;
+
+	raw_parser(corpus->queries[i], RAW_PARSE_DEFAULT, corpus->lens[i], &error, false);
+}
+
+static void
+bench_parse_minimal(Corpus * corpus, int i)
+{
+	bool		error;
+
+	raw_parser(corpus->queries[i], RAW_PARSE_DEFAULT, corpus->lens[i], &error, true);
+}
+
+static void
+bench_parse_cached(Corpus * corpus, int i)
+{
+	bool		error;
+
+	pool_parse_cache_raw_parser(corpus->queries[i], corpus->lens[i], &error, false);
+}
+
+/*
+ * The walkers SimpleQuery() and the query cache run on a parse tree.
+ */
+static void
+bench_walkers(Corpus * corpus, int i)
+{
+	Node	   *node = corpus->nodes[i];
+
+	is_select_query(node, corpus->queries[i]);
+	pool_has_function_call(node);
+	pool_has_system_catalog(node);
+	pool_has_temp_table(node);
+	pool_has_unlogged_table(node);
+	pool_has_view(node);
+	pool_has_insertinto_or_locking_clause(node);
+}
+
+static void
+bench_where_to_send(Corpus * corpus, int i)
+{
+	POOL_QUERY_CONTEXT *query_context;
+
+	query_context = pool_init_simple_query_context();
+	pool_start_query(query_context, corpus->queries[i], corpus->lens[i], corpus->nodes[i]);
+	pool_where_to_send(query_context, corpus->queries[i], corpus->nodes[i]);
+	pool_query_context_destroy(query_context);
+}
+
+static void
+bench_allow_to_cache(Corpus * corpus, int i)
+{
+	pool_is_allow_to_cache(corpus->nodes[i], corpus->queries[i]);
+}
+
+/*
+ * Look up the query cache: encoding the cache key, searching the shared
+ * memory hash and copying out the cached data if found.
+ */
+static void
+bench_cache_fetch(Corpus * corpus, int i)
+{
+	char	   *buf = NULL;
+	size_t		len;
+
+	if (pool_fetch_cache(bench_backend, corpus->queries[i], &buf, &len) == 0)
+		pfree(buf);
+}
+
+static void
+setup_cache_hit(Corpus * corpus)
+{
+	char		data[] = "microbench";
+	int			i;
+
+	for (i = 0; i < corpus->nqueries; i++)
+		pool_catalog_commit_cache(bench_backend, corpus->queries[i], data, sizeof(data));
+}
+
+/*
+ * Count the memory allocations.
+ */
+void	   *__real_palloc(Size size);
+void	   *__real_palloc0(Size size);
+void	   *__real_palloc_extended(Size size, int flags);
+void	   *__real_repalloc(void *pointer, Size size);
+void	   *__real_MemoryContextAlloc(MemoryContext context, Size size);
+void	   *__real_MemoryContextAllocZero(MemoryContext context, Size size);
+void	   *__real_MemoryContextAllocZeroAligned(MemoryContext context, Size size);
+void	   *__real_MemoryContextAllocExtended(MemoryContext context, Size size, int flags);
+char	   *__real_MemoryContextStrdup(MemoryContext context, const char *string);
+char	   *__real_pstrdup(const char *in);
+char	   *__real_pnstrdup(const char *in, Size len);
+
+void *
+__wrap_palloc(Size size)
+{
+	nallocs++;
+	return __real_palloc(size);
+}
+
+void *
+__wrap_palloc0(Size size)
+{
+	nallocs++;
+	return __real_palloc0(size);
+}
+
+void *
+__wrap_palloc_extended(Size size, int flags)
+{
+	nallocs++;
+	return __real_palloc_extended(size, flags);
+}
+
+void *
+__wrap_repalloc(void *pointer, Size size)
+{
+	nallocs++;
+	return __real_repalloc(pointer, size);
+}
+
+void *
+__wrap_MemoryContextAlloc(MemoryContext context, Size size)
+{
+	nallocs++;
+	return __real_MemoryContextAlloc(context, size);
+}
+
+void *
+__wrap_MemoryContextAllocZero(MemoryContext context, Size size)
+{
+	nallocs++;
+	return __real_MemoryContextAllocZero(context, size);
+}
+
+void *
+__wrap_MemoryContextAllocZeroAligned(MemoryContext context, Size size)
+{
+	nallocs++;
+	return __real_MemoryContextAllocZeroAligned(context, size);
+}
+
+void *
+__wrap_MemoryContextAllocExtended(MemoryContext context, Size size, int flags)
+{
+	nallocs++;
+	return __real_MemoryContextAllocExtended(context, size, flags);
+}
+
+char *
+__wrap_MemoryContextStrdup(MemoryContext context, const char *string)
+{
+	nallocs++;
+	return __real_MemoryContextStrdup(context, string);
+}
+
+char *
+__wrap_pstrdup(const char *in)
+{
+	nallocs++;
+	return __real_pstrdup(in);
+}
+
+char *
+__wrap_pnstrdup(const char *in, Size len)
+{
+	nallocs++;
+	return __real_pnstrdup(in, len);
+}
@@ -0,0 +1,9 @@
+SELECT now()
+UPDATE rel2 SET c1 = now(), c2 = CURRENT_DATE, c3 = now() WHERE c4 < CURRENT_TIMESTAMP
+DELETE FROM rel1 WHERE c1 < LOCALTIMESTAMP(0) AND c2 > pg_catalog.now ( )
+UPDATE rel2 SET c1 = now()::date, c2 = CURRENT_DATE::text, c3 = CAST(CURRENT_TIME AS text)
+UPDATE rel2 SET c1 = /* now() */ now(), c2 = 'CURRENT_DATE' -- LOCALTIME
+INSERT INTO rel2 VALUES (1, now()), (2, CURRENT_TIMESTAMP)
+UPDATE rel2 SET c1 = now(/* */)
+UPDATE rel2 SET c1 = 'now'::timestamp, c2 = now()
+UPDATE rel2 SET c1 = now(); DELETE FROM rel2 WHERE c2 = CURRENT_DATE
@@ -17,6 +17,13 @@ POOL_REQUEST_INFO *Req_info = &_req_info;
 POOL_CONFIG _pool_config;
 POOL_CONFIG *pool_config = &_pool_config;
 bool redirection_done = false;
+
+/*
+ * Session context of a simple query, returned by pool_get_session_context()
+ * with -s option.  The rewritten query is then spliced from the query text.
+ */
+static POOL_SESSION_CONTEXT session_context;
+static bool simple_query = false;
 typedef struct
 {
 	char	   *attrname;		/* attribute name */
@@ -52,6 +59,18 @@ pool_virtual_main_db_node_id(void)
 	return 0;
 }
 
+char *
+pool_find_name(ParamStatus * params, char *name, int *pos)
+{
+	return NULL;
+}
+
+uint32
+pool_shared_relcache_generation(void)
+{
+	return 0;
+}
+
 bool
 pool_has_pgpool_regclass(void)
 {
@@ -141,15 +160,24 @@ main(int argc, char **argv)
 
 	backend.slots[0] = &slot;
 	slot.sp = &sp;
+	sp.database = "test";
 	bool		error;
 
 	MemoryContextInit();
 
 	pool_config->backend_clustering_mode = CM_NATIVE_REPLICATION;
 
+	/* -s: rewrite as a simple query, whose text is at hand */
+	if (argc == 3 && strcmp(argv[1], "-s") == 0)
+	{
+		simple_query = true;
+		argc--;
+		argv++;
+	}
+
 	if (argc != 2)
 	{
-		fprintf(stderr, "./timestamp-test query\n");
+		fprintf(stderr, "./timestamp-test [-s] query\n");
 		exit(1);
 	}
 
@@ -166,7 +194,21 @@ main(int argc, char **argv)
 			msg.query_context = &ctx;
 			Node	   *node = (Node *) lfirst(l);
 
-			query = rewrite_timestamp(&backend, ((RawStmt *) node)->stmt, false, &msg);
+			if (simple_query)
+			{
+				/* like pgpool, keep the parse tree of the first statement */
+				if (l == list_head(tree))
+				{
+					memset(&ctx, 0, sizeof(ctx));
+					ctx.original_query = argv[1];
+					ctx.parse_tree = ((RawStmt *) node)->stmt;
+					ctx.is_multi_statement = list_length(tree) > 1;
+					session_context.query_context = &ctx;
+				}
+				query = rewrite_timestamp(&backend, ((RawStmt *) node)->stmt, false, NULL);
+			}
+			else
+				query = rewrite_timestamp(&backend, ((RawStmt *) node)->stmt, false, &msg);
 			if (query)
 				printf("%s\n", query);
 			else
@@ -184,7 +226,7 @@ free_select_result(POOL_SELECT_RESULT * result)
 POOL_SESSION_CONTEXT *
 pool_get_session_context(bool noerror)
 {
-	return NULL;
+	return simple_query ? &session_context : NULL;
 }
 int
 pg_frontend_exists(void)
@@ -0,0 +1,138 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for statements on sharded tables (shard_key_list).
+# This test is for native replication mode only.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create native replication, 2-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m r -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# orders is sharded by customer_id.  Stop on mismatch so that a row count
+# difference wrongly taken for a replication error degenerates a node.
+cat >> etc/pgpool.conf <<EOF
+shard_key_list = 'orders:customer_id'
+replication_stop_on_mismatch = on
+failover_if_affected_tuples_mismatch = on
+EOF
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+$PSQL -c "CREATE TABLE orders(customer_id int, v int)"
+
+# each row goes to the shard of its key only
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+    $PSQL -c "INSERT INTO orders(customer_id, v) VALUES ($i, 0)"
+done
+
+echo "=== test1: rows are spread over the shards"
+PGPORT0=`expr $PGPOOL_PORT + 2`
+PGPORT1=`expr $PGPOOL_PORT + 3`
+n0=`$PSQL -p $PGPORT0 -t -A -c "SELECT count(*) FROM orders"`
+n1=`$PSQL -p $PGPORT1 -t -A -c "SELECT count(*) FROM orders"`
+echo "node 0: $n0 rows, node 1: $n1 rows"
+if [ "$n0" = 0 -o "$n1" = 0 -o `expr $n0 + $n1` != 10 ];then
+    echo "test1 failed."
+    ./shutdownall
+    exit 1
+fi
+echo "test1 ok."
+
+echo "=== test2: UPDATE and DELETE without the shard key"
+# They are broadcast to all shards.  Each shard reports its own number of
+# rows; pgpool-II must add them up instead of treating the difference as
+# a replication mismatch, in and out of an explicit transaction.
+$PSQL -a > results2.txt 2>&1 <<EOF
+UPDATE orders SET v = v + 1;
+BEGIN;
+UPDATE orders SET v = v + 1;
+DELETE FROM orders WHERE v = 2 AND customer_id > 5;
+COMMIT;
+SELECT count(*) FROM orders WHERE customer_id = 1 AND v = 2;
+EOF
+
+cat > expected2.txt <<EOF
+UPDATE orders SET v = v + 1;
+UPDATE 10
+BEGIN;
+BEGIN
+UPDATE orders SET v = v + 1;
+UPDATE 10
+DELETE FROM orders WHERE v = 2 AND customer_id > 5;
+DELETE 5
+COMMIT;
+COMMIT
+SELECT count(*) FROM orders WHERE customer_id = 1 AND v = 2;
+ count
+-------
+     1
+(1 row)
+
+EOF
+
+cmp expected2.txt results2.txt
+if [ $? != 0 ];then
+    echo "test2 failed."
+    diff expected2.txt results2.txt
+    ./shutdownall
+    exit 1
+fi
+
+# no node must have been degenerated
+n=`$PSQL -t -A -c "SHOW pool_nodes" | grep -c '|up|'`
+if [ "$n" != 2 ];then
+    echo "test2 failed: a node was degenerated."
+    ./shutdownall
+    exit 1
+fi
+echo "test2 ok."
+
+echo "=== test3: statements spanning shards are rejected"
+# A keyless SELECT cannot be answered by one shard.
+$PSQL -c "SELECT sum(v) FROM orders" > results3.txt 2>&1
+grep "cannot route statement on sharded tables" results3.txt
+if [ $? != 0 ];then
+    echo "test3 failed."
+    cat results3.txt
+    ./shutdownall
+    exit 1
+fi
+echo "test3 ok."
+
+echo "=== test4: backend nodes cannot be added by reload"
+# Adding a node would change the shard of most keys.
+cat >> etc/pgpool.conf <<EOF
+backend_hostname2 = 'localhost'
+backend_port2 = `expr $PGPOOL_PORT + 4`
+backend_weight2 = 1
+EOF
+./pgpool_reload
+sleep 1
+n=`$PSQL -t -A -c "SHOW pool_nodes" | wc -l`
+n1=`$PSQL -t -A -c "SELECT count(*) FROM orders WHERE customer_id = 1"`
+grep "backend nodes cannot be added once shard_key_list is set" log/pgpool.log > /dev/null
+if [ $? != 0 -o "$n" != 2 -o "$n1" != 1 ];then
+    echo "test4 failed."
+    $PSQL -c "SHOW pool_nodes"
+    ./shutdownall
+    exit 1
+fi
+echo "test4 ok."
+
+./shutdownall
+
+exit 0
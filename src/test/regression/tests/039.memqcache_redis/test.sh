@@ -0,0 +1,124 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache with redis.
+# requires redis-server and redis-cli (or the valkey ones) in the path.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+REDIS_SERVER=`which redis-server valkey-server 2>/dev/null | head -1`
+REDIS_CLI=`which redis-cli valkey-cli 2>/dev/null | head -1`
+if [ -z "$REDIS_SERVER" -o -z "$REDIS_CLI" ];then
+	echo "redis-server or redis-cli not found. skip the test."
+	exit 0
+fi
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+REDIS_PORT=`expr $PGPOOL_PORT + 10`
+REDIS="$REDIS_CLI -p $REDIS_PORT"
+
+# entries never expire
+cat >> etc/pgpool.conf <<EOF
+memory_cache_enabled = on
+memqcache_method = 'redis'
+memqcache_redis_host = 'localhost'
+memqcache_redis_port = $REDIS_PORT
+memqcache_expire = 0
+EOF
+
+$REDIS_SERVER --port $REDIS_PORT --save "" --appendonly no --daemonize yes \
+	--dir `pwd` --logfile `pwd`/log/redis.log
+sleep 1
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+$PSQL <<EOF
+CREATE TABLE t1 (i int);
+INSERT INTO t1 VALUES (1);
+CREATE TABLE t2 (i int);
+INSERT INTO t2 VALUES (1);
+SELECT pg_sleep(2);
+EOF
+
+# the tag of a table is its set of entry keys
+PG_PORT0=`expr $PGPOOL_PORT + 2`
+DBOID=`$PSQL -p $PG_PORT0 -t -A -c "SELECT oid FROM pg_database WHERE datname = 'test'"`
+T1OID=`$PSQL -p $PG_PORT0 -t -A -c "SELECT 't1'::regclass::oid"`
+T2OID=`$PSQL -p $PG_PORT0 -t -A -c "SELECT 't2'::regclass::oid"`
+TAG1="pgpool:qt:$DBOID:$T1OID"
+TAG2="pgpool:qt:$DBOID:$T2OID"
+
+success=true
+
+echo "=== test1: entries are cached and fetched from redis"
+$PSQL -c "SELECT * FROM t1" > /dev/null
+$PSQL -c "SELECT * FROM t1" > /dev/null
+grep "fetched from cache" log/pgpool.log | grep t1 > /dev/null || success=false
+if [ `$REDIS SCARD $TAG1` != 1 ];then
+	echo "test1: entry is not in tag $TAG1"
+	success=false
+fi
+
+echo "=== test2: tag holding never expiring entries never expires"
+# A tag given a TTL by an earlier entry must be made persistent when an
+# entry that never expires is added, or the entry outlives its tag and
+# is not invalidated any more.
+$PSQL -c "SELECT * FROM t2" > /dev/null
+$REDIS EXPIRE $TAG2 2 > /dev/null
+$PSQL -c "SELECT i FROM t2" > /dev/null
+ttl=`$REDIS TTL $TAG2`
+if [ "$ttl" != -1 ];then
+	echo "test2: TTL of $TAG2 is $ttl, expected -1"
+	success=false
+fi
+sleep 3
+if [ `$REDIS SCARD $TAG2` != 2 ];then
+	echo "test2: tag $TAG2 expired"
+	success=false
+fi
+
+echo "=== test3: writing a table invalidates its entries"
+$PSQL -c "UPDATE t2 SET i = 2" > /dev/null
+result=`$PSQL -t -A -c "SELECT i FROM t2"`
+if [ "$result" != 2 ];then
+	echo "test3: stale result $result"
+	success=false
+fi
+if [ `$REDIS EXISTS $TAG2` != 0 ];then
+	# the tag is there again only if the SELECT above was cached anew
+	if [ `$REDIS SCARD $TAG2` != 1 ];then
+		echo "test3: entries of $TAG2 were not invalidated"
+		success=false
+	fi
+fi
+
+echo "=== test4: queries are executed without the cache if redis is down"
+$REDIS SHUTDOWN NOSAVE > /dev/null 2>&1
+result=`$PSQL -t -A -c "SELECT i FROM t1"`
+if [ "$result" != 1 ];then
+	echo "test4: query failed while redis is down: $result"
+	success=false
+fi
+grep "failed to connect to redis\|failed to read reply from redis\|failed to send command to redis" log/pgpool.log > /dev/null || success=false
+
+./shutdownall
+
+if [ $success = false ];then
+	exit 1
+fi
+
+exit 0
@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for hedged_reads.
+# This test is for streaming replication mode only.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create streaming replication, 3-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# SELECTs of application "hedge" go to node 1 first.  The query below
+# sleeps on node 1 only, so node 2 must answer it if it is hedged.
+PGPORT1=`expr $PGPOOL_PORT + 3`
+SLOW_QUERY="SELECT pg_sleep(CASE WHEN inet_server_port() = $PGPORT1 THEN 5 ELSE 0 END)"
+
+cat >> etc/pgpool.conf <<EOF
+delay_threshold = 0
+statement_level_load_balance = on
+app_name_redirect_preference_list = 'hedge:1'
+read_only_function_list = 'pg_sleep,inet_server_port'
+hedged_reads = on
+hedged_read_min_delay = 100
+log_min_messages = debug1
+EOF
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+export PGAPPNAME=hedge
+success=true
+
+echo "=== test1: a slow SELECT is answered by another standby"
+start=`date +%s`
+$PSQL > results1.txt 2>&1 <<EOF
+$SLOW_QUERY;
+SELECT 1;
+EOF
+elapsed=`expr \`date +%s\` - $start`
+echo "elapsed: $elapsed seconds"
+if [ $elapsed -ge 4 ];then
+    echo "test1 failed: the query was not hedged."
+    success=false
+fi
+grep "node 1 did not answer within" log/pgpool.log > /dev/null || success=false
+grep "node 2 answered first, canceling the query on node 1" log/pgpool.log > /dev/null || success=false
+# the answer of node 1 must be discarded before the next query
+grep "discarded the answer of node 1" log/pgpool.log > /dev/null || success=false
+grep ERROR results1.txt && success=false
+if [ $success = true ];then
+    echo "test1 ok."
+fi
+
+echo "=== test2: a SELECT in a transaction is not hedged"
+# A transaction has to stay on its load balance node.
+grep -c "did not answer within" log/pgpool.log > hedged_before.txt
+start=`date +%s`
+$PSQL > results2.txt 2>&1 <<EOF
+BEGIN;
+$SLOW_QUERY;
+COMMIT;
+EOF
+elapsed=`expr \`date +%s\` - $start`
+echo "elapsed: $elapsed seconds"
+grep -c "did not answer within" log/pgpool.log > hedged_after.txt
+if [ $elapsed -lt 5 ];then
+    echo "test2 failed: the query did not wait for node 1."
+    success=false
+elif ! cmp hedged_before.txt hedged_after.txt;then
+    echo "test2 failed: the query was hedged."
+    success=false
+else
+    echo "test2 ok."
+fi
+grep ERROR results2.txt && success=false
+
+./shutdownall
+
+if [ $success = false ];then
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for retry_reads_on_standby_failure.
+# This test is for streaming replication mode only.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create streaming replication, 3-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# SELECTs of application "retry" go to node 1.  Keep node 1 attached
+# when it fails, so that the test only depends on the retry.
+PGPORT1=`expr $PGPOOL_PORT + 3`
+SLOW_QUERY="SELECT pg_sleep(3)"
+
+cat >> etc/pgpool.conf <<EOF
+delay_threshold = 0
+app_name_redirect_preference_list = 'retry:1'
+read_only_function_list = 'pg_sleep'
+retry_reads_on_standby_failure = on
+failover_on_backend_error = off
+health_check_period = 0
+EOF
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+export PGAPPNAME=retry
+
+# Kill the backend of node 1 executing the query.  SIGKILL makes sure the
+# backend does not send anything before its connection is closed.
+function kill_node1_backend()
+{
+	sleep 1
+	pid=`$PSQL -p $PGPORT1 -t -A -c "SELECT pid FROM pg_stat_activity WHERE query = '$SLOW_QUERY'"`
+	echo "killing backend $pid of node 1"
+	kill -9 $pid
+}
+
+# Wait for node 1 to finish its crash recovery.
+function wait_for_node1()
+{
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		$PSQL -p $PGPORT1 -c "SELECT 1" > /dev/null 2>&1 && return
+		sleep 1
+	done
+}
+
+success=true
+
+echo "=== test1: a SELECT whose standby fails is answered by another node"
+kill_node1_backend &
+$PSQL -t -A > results1.txt 2>&1 <<EOF
+$SLOW_QUERY;
+SELECT 'alive';
+EOF
+wait
+cat results1.txt
+grep "retrying query on DB node" log/pgpool.log > /dev/null || success=false
+grep "DB node 1 failed before answering" log/pgpool.log > /dev/null || success=false
+grep "alive" results1.txt > /dev/null || success=false
+grep "ERROR\|FATAL\|server closed" results1.txt && success=false
+if [ $success = true ];then
+	echo "test1 ok."
+else
+	echo "test1 failed."
+fi
+
+wait_for_node1
+
+echo "=== test2: the client gets the error without retry_reads_on_standby_failure"
+echo "retry_reads_on_standby_failure = off" >> etc/pgpool.conf
+./pgpool_reload
+sleep 1
+grep -c "retrying query on DB node" log/pgpool.log > retried_before.txt
+kill_node1_backend &
+$PSQL -t -A > results2.txt 2>&1 <<EOF
+$SLOW_QUERY;
+EOF
+wait
+cat results2.txt
+grep -c "retrying query on DB node" log/pgpool.log > retried_after.txt
+if ! cmp retried_before.txt retried_after.txt;then
+	echo "test2 failed: the query was retried."
+	success=false
+elif ! grep "ERROR\|FATAL\|server closed" results2.txt > /dev/null;then
+	echo "test2 failed: the failure was not reported."
+	success=false
+else
+	echo "test2 ok."
+fi
+
+./shutdownall
+
+if [ $success = false ];then
+	exit 1
+fi
+
+exit 0
@@ -0,0 +1,102 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for failover_reattach_timeout.
+# This test is for streaming replication mode only.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create streaming replication, 2-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+PCP_DETACH_NODE="$PGPOOL_INSTALL_DIR/bin/pcp_detach_node -w -h localhost -p $PCP_PORT"
+
+cat >> etc/pgpool.conf <<EOF
+failover_keep_sessions = on
+failover_reattach_timeout = 30
+EOF
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+$PSQL -c "CREATE TABLE t1(i int)"
+$PSQL -c "INSERT INTO t1 VALUES (1)"
+
+echo "=== test1: sessions survive primary failover unless in a transaction"
+# Session 1 is idle and has a prepared statement when the primary fails.
+# It must be reattached to the new primary, with the statement prepared
+# there again.  Session 2 is inside a transaction and must be terminated.
+(
+	echo "PREPARE p AS INSERT INTO t1 VALUES (2);"
+	sleep 15
+	echo "EXECUTE p;"
+	echo "SELECT count(*) FROM t1;"
+) | $PSQL -t -A > results1.txt 2>&1 &
+pid1=$!
+
+(
+	echo "BEGIN;"
+	echo "SELECT 1;"
+	sleep 15
+	echo "SELECT 'still alive';"
+	echo "COMMIT;"
+) | $PSQL -t -A > results2.txt 2>&1 &
+pid2=$!
+
+sleep 3
+$PCP_DETACH_NODE 0
+wait $pid1 $pid2
+
+echo "session 1:"
+cat results1.txt
+echo "session 2:"
+cat results2.txt
+
+success=true
+
+$PSQL -c "SHOW pool_nodes" > pool_nodes.txt
+primary_node=`grep primary pool_nodes.txt | grep -v standby | awk '{print $1}'`
+if [ "$primary_node" != 1 ];then
+	echo "test1 failed: node 1 was not promoted."
+	cat pool_nodes.txt
+	./shutdownall
+	exit 1
+fi
+
+grep "Restart only busy children" log/pgpool.log > /dev/null || success=false
+
+# session 1 went on with the new primary
+grep "session reattached to new primary node 1" log/pgpool.log > /dev/null || success=false
+grep "preparing statement \"p\" on DB node 1" log/pgpool.log > /dev/null || success=false
+grep "INSERT 0 1" results1.txt > /dev/null || success=false
+grep "^2$" results1.txt > /dev/null || success=false
+grep "ERROR\|FATAL\|server closed" results1.txt && success=false
+
+# session 2 could not be moved
+grep "still alive" results2.txt && success=false
+grep "FATAL\|server closed\|connection to server was lost" results2.txt > /dev/null || success=false
+
+if [ $success = true ];then
+	echo "test1 ok."
+else
+	echo "test1 failed."
+fi
+
+./shutdownall
+
+if [ $success = false ];then
+	exit 1
+fi
+
+exit 0
@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for listen_multiplexing_max_subscriptions.
+# This test is for streaming replication mode only.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create streaming replication, 2-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# The notification hub serves two LISTENs at most.
+cat >> etc/pgpool.conf <<EOF
+listen_multiplexing_max_subscriptions = 2
+EOF
+
+./startall
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+# LISTEN, report whether the backend of the session listens itself, and
+# poll for notifications after NOTIFY has been sent.
+function listen_session()
+{
+	(
+		echo "LISTEN ch;"
+		echo "SELECT 'backend channels: ' || count(*) FROM pg_listening_channels();"
+		sleep 6
+		echo "SELECT 'done';"
+	) | $PSQL -t -A > results$1.txt 2>&1
+}
+
+echo "=== test1: LISTENs are served by the notification hub up to the limit"
+listen_session 1 &
+sleep 1
+listen_session 2 &
+sleep 1
+# no room left in the hub: this LISTEN goes to the backends as before
+listen_session 3 &
+sleep 2
+$PSQL -c "NOTIFY ch, 'hello'"
+wait
+
+success=true
+
+for i in 1 2 3
+do
+	echo "session $i:"
+	cat results$i.txt
+	grep "Asynchronous notification \"ch\" with payload \"hello\" received" results$i.txt > /dev/null || success=false
+	grep "ERROR\|FATAL" results$i.txt && success=false
+done
+
+# the backends of sessions 1 and 2 never received the LISTEN
+grep "backend channels: 0" results1.txt > /dev/null || success=false
+grep "backend channels: 0" results2.txt > /dev/null || success=false
+
+# session 3 fell back to LISTEN on its own backend
+grep "backend channels: 1" results3.txt > /dev/null || success=false
+grep "listen_multiplexing_max_subscriptions is reached" log/pgpool.log > /dev/null || success=false
+
+if [ $success = true ];then
+	echo "test1 ok."
+else
+	echo "test1 failed."
+fi
+
+./shutdownall
+
+if [ $success = false ];then
+	exit 1
+fi
+
+exit 0
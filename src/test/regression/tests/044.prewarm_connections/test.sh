@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# Test script for prewarm_connections.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL=$PGBIN/psql
+export PGDATABASE=test
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create streaming replication, 2-node test environment.
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+# One child which prewarms a connection to database test.  Queries go
+# to node 0 only so that pg_backend_pid() tells which connection is used.
+cat >> etc/pgpool.conf <<EOF
+num_init_children = 1
+prewarm_connections = '`whoami`:test:1'
+backend_weight1 = 0
+EOF
+
+PGPORT0=`expr $PGPOOL_PORT + 2`
+
+./startall
+
+# wait for the child to open the prewarmed connection
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+do
+	pid=`$PSQL -p $PGPORT0 -t -A -c "SELECT pid FROM pg_stat_activity WHERE datname = 'test'" postgres 2>/dev/null`
+	if [ -n "$pid" ];then
+		break
+	fi
+	sleep 1
+done
+
+echo "=== test1: the prewarmed connection is opened before any client connects"
+if [ -z "$pid" ];then
+	echo "test1 failed: no prewarmed connection."
+	./shutdownall
+	exit 1
+fi
+echo "prewarmed backend pid: $pid"
+echo "test1 ok."
+
+export PGPORT=$PGPOOL_PORT
+wait_for_pgpool_startup
+
+success=true
+
+echo "=== test2: a client connecting as the same user and database reuses it"
+result=`$PSQL -t -A -c "SELECT pg_backend_pid()"`
+echo "backend pid of the client: $result"
+if [ "$result" != "$pid" ];then
+	echo "test2 failed."
+	success=false
+else
+	echo "test2 ok."
+fi
+
+echo "=== test3: a client with other startup options does not reuse it"
+result=`PGOPTIONS="-c work_mem=8MB" $PSQL -t -A -c "SELECT pg_backend_pid()"`
+echo "backend pid of the client: $result"
+if [ -z "$result" -o "$result" = "$pid" ];then
+	echo "test3 failed."
+	success=false
+else
+	echo "test3 ok."
+fi
+
+./shutdownall
+
+if [ $success = false ];then
+	exit 1
+fi
+
+exit 0
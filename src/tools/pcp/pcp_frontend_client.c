@@ -26,6 +26,9 @@
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 #include "utils/fe_ports.h"
 #include "utils/pool_path.h"
@@ -41,6 +44,45 @@ const char *progname = NULL;
 const char *get_progname(const char *argv0);
 char	   *last_dir_separator(const char *filename);
 
+/*
+ * Options of the command, which are the same for all the pgpool-II hosts the
+ * command is run against.
+ */
+typedef struct
+{
+	char	   *user;
+	char	   *pass;
+	int			nodeID;
+	int			processID;
+	char		shutdown_mode;
+	char		command_scope;
+	bool		all;
+	bool		debug;
+	bool		gracefully;
+	bool		switchover;
+	bool		background;
+	bool		verbose;
+}			PCPCommandOptions;
+
+/* A pgpool-II host given by -h, and the output of the command run there */
+typedef struct
+{
+	char	   *host;
+	int			port;
+	pid_t		pid;
+	char	   *output;
+	int			output_len;
+	int			output_size;
+}			PCPTarget;
+
+/* Results of run_command(), which are the exit status of its process */
+#define PCP_TARGET_OK				0
+#define PCP_TARGET_CONNECT_FAILED	1
+#define PCP_TARGET_COMMAND_FAILED	2
+
+static int	parse_targets(char *hosts, int port, PCPTarget * *targets);
+static int	run_command(char *host, int port, PCPCommandOptions * opts);
+static int	run_on_targets(PCPTarget * targets, int ntargets, PCPCommandOptions * opts);
 static void usage(void);
 static inline bool app_require_nodeID(void);
 static inline bool app_support_cluster_mode(void);
@@ -50,7 +92,11 @@ static void output_proccount_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_poolstatus_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodeinfo_result(PCPResultInfo * pcpResInfo, bool all,  bool verbose);
 static void output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_backend_stats_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_memory_info_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodecount_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_events(PCPConnInfo * pcpConn, bool verbose);
+static void output_recovery_status_result(PCPResultInfo * pcpResInfo, bool verbose);
 static char *backend_status_to_string(BackendInfo * bi);
 static char *format_titles(const char **titles, const char **types, int ntitles);
 
@@ -61,14 +107,20 @@ typedef enum
 	PCP_NODE_COUNT,
 	PCP_NODE_INFO,
 	PCP_HEALTH_CHECK_STATS,
+	PCP_BACKEND_STATS,
 	PCP_POOL_STATUS,
 	PCP_PROC_COUNT,
 	PCP_PROC_INFO,
+	PCP_MEMORY_INFO,
 	PCP_PROMOTE_NODE,
 	PCP_RECOVERY_NODE,
 	PCP_STOP_PGPOOL,
 	PCP_WATCHDOG_INFO,
 	PCP_RELOAD_CONFIG,
+	PCP_SNAPSHOT_QUERY_CACHE,
+	PCP_RESET_STATEMENT_STATS,
+	PCP_SUBSCRIBE,
+	PCP_RECOVERY_STATUS,
 	UNKNOWN,
 }			PCP_UTILITIES;
 
@@ -87,14 +139,20 @@ struct AppTypes AllAppTypes[] =
 	{"pcp_node_count", PCP_NODE_COUNT, "h:p:U:wWvd", "display the total number of nodes under pgpool-II's control"},
 	{"pcp_node_info", PCP_NODE_INFO, "n:h:p:U:awWvd", "display a pgpool-II node's information"},
 	{"pcp_health_check_stats", PCP_HEALTH_CHECK_STATS, "n:h:p:U:wWvd", "display a pgpool-II health check stats data"},
+	{"pcp_backend_stats", PCP_BACKEND_STATS, "n:h:p:U:wWvd", "display a pgpool-II backend query stats data"},
 	{"pcp_pool_status", PCP_POOL_STATUS, "h:p:U:wWvd", "display pgpool configuration and status"},
 	{"pcp_proc_count", PCP_PROC_COUNT, "h:p:U:wWvd", "display the list of pgpool-II child process PIDs"},
 	{"pcp_proc_info", PCP_PROC_INFO, "h:p:P:U:awWvd", "display a pgpool-II child process' information"},
+	{"pcp_memory_info", PCP_MEMORY_INFO, "h:p:U:wWvd", "display the memory usage of pgpool-II child processes"},
 	{"pcp_promote_node", PCP_PROMOTE_NODE, "n:h:p:U:gswWvd", "promote a node as new main from pgpool-II"},
-	{"pcp_recovery_node", PCP_RECOVERY_NODE, "n:h:p:U:wWvd", "recover a node"},
+	{"pcp_recovery_node", PCP_RECOVERY_NODE, "n:h:p:U:bwWvd", "recover a node"},
 	{"pcp_stop_pgpool", PCP_STOP_PGPOOL, "m:h:p:U:s:wWvda", "terminate pgpool-II"},
 	{"pcp_watchdog_info", PCP_WATCHDOG_INFO, "n:h:p:U:wWvd", "display a pgpool-II watchdog's information"},
 	{"pcp_reload_config",PCP_RELOAD_CONFIG,"h:p:U:s:wWvd", "reload a pgpool-II config file"},
+	{"pcp_snapshot_query_cache", PCP_SNAPSHOT_QUERY_CACHE, "h:p:U:wWvd", "save pgpool-II query cache to the snapshot file"},
+	{"pcp_reset_statement_stats", PCP_RESET_STATEMENT_STATS, "h:p:U:wWvd", "reset pgpool-II statement statistics"},
+	{"pcp_subscribe", PCP_SUBSCRIBE, "h:p:U:wWvd", "display pgpool-II state change events as they happen"},
+	{"pcp_recovery_status", PCP_RECOVERY_STATUS, "h:p:U:wWvd", "display the progress of online recovery"},
 	{NULL, UNKNOWN, NULL, NULL},
 };
 struct AppTypes *current_app_type;
@@ -118,9 +176,11 @@ main(int argc, char **argv)
 	bool		need_password = false;
 	bool		gracefully = false;
 	bool		switchover = false;
+	bool		background = false;
 	bool		verbose = false;
-	PCPConnInfo *pcpConn;
-	PCPResultInfo *pcpResInfo;
+	PCPCommandOptions opts;
+	PCPTarget  *targets;
+	int			ntargets;
 
 	/* here we put all the allowed long options for all utilities */
 	static struct option long_options[] = {
@@ -137,6 +197,7 @@ main(int argc, char **argv)
 		{"scope", required_argument, NULL, 's'},
 		{"gracefully", no_argument, NULL, 'g'},
 		{"switchover", no_argument, NULL, 's'},
+		{"background", no_argument, NULL, 'b'},
 		{"verbose", no_argument, NULL, 'v'},
 		{"all", no_argument, NULL, 'a'},
 		{"node-id", required_argument, NULL, 'n'},
@@ -200,6 +261,10 @@ main(int argc, char **argv)
 				gracefully = true;
 				break;
 
+			case 'b':
+				background = true;
+				break;
+
 			case 's':
 				if (app_support_cluster_mode())
 				{
@@ -370,11 +435,119 @@ main(int argc, char **argv)
 		need_password = false;
 	}
 
-	pcpConn = pcp_connect(host, port, user, pass, debug ? stdout : NULL);
+	opts.user = user;
+	opts.pass = pass;
+	opts.nodeID = nodeID;
+	opts.processID = processID;
+	opts.shutdown_mode = shutdown_mode;
+	opts.command_scope = command_scope;
+	opts.all = all;
+	opts.debug = debug;
+	opts.gracefully = gracefully;
+	opts.switchover = switchover;
+	opts.background = background;
+	opts.verbose = verbose;
+
+	ntargets = parse_targets(host, port, &targets);
+	if (ntargets > 1)
+	{
+		/*
+		 * Events are printed until the connection is lost, and a node must
+		 * not be recovered by several pgpool-II at once.
+		 */
+		if (current_app_type->app_type == PCP_SUBSCRIBE ||
+			current_app_type->app_type == PCP_RECOVERY_NODE)
+		{
+			fprintf(stderr, "%s: only one pgpool-II host can be given\n", progname);
+			exit(1);
+		}
+		return run_on_targets(targets, ntargets, &opts);
+	}
+
+	if (run_command(targets[0].host, targets[0].port, &opts) == PCP_TARGET_CONNECT_FAILED)
+		exit(1);
+
+	return 0;
+}
+
+/*
+ * Split the comma separated list of hosts given by -h.  Each host can be
+ * followed by ":port" to use other port than the one given by -p.  Returns
+ * the number of hosts, which is 1 if -h is not given.
+ */
+static int
+parse_targets(char *hosts, int port, PCPTarget * *targets)
+{
+	PCPTarget  *result;
+	char	   *tok;
+	char	   *saveptr;
+	int			n = 1;
+	char	   *p;
+
+	if (hosts != NULL)
+		for (p = hosts; *p; p++)
+			if (*p == ',')
+				n++;
+
+	result = palloc0(sizeof(PCPTarget) * n);
+
+	if (hosts == NULL)
+	{
+		result[0].port = port;
+		*targets = result;
+		return 1;
+	}
+
+	n = 0;
+	for (tok = strtok_r(hosts, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr))
+	{
+		result[n].host = tok;
+		result[n].port = port;
+
+		/*
+		 * A Unix-domain socket directory and an IPv6 address have no port
+		 * suffix
+		 */
+		p = strchr(tok, ':');
+		if (*tok != '/' && p != NULL && strchr(p + 1, ':') == NULL)
+		{
+			*p = '\0';
+			result[n].port = atoi(p + 1);
+			if (result[n].port <= 1024 || result[n].port > 65535)
+			{
+				fprintf(stderr, "%s: Invalid port number \"%s\" of host \"%s\", must be between 1024 and 65535\n", progname, p + 1, tok);
+				exit(1);
+			}
+		}
+		n++;
+	}
+
+	if (n == 0)
+	{
+		fprintf(stderr, "%s: no host in \"-h\"\n", progname);
+		exit(1);
+	}
+
+	*targets = result;
+	return n;
+}
+
+/*
+ * Run the command against a pgpool-II and print its result.
+ */
+static int
+run_command(char *host, int port, PCPCommandOptions * opts)
+{
+	PCPConnInfo *pcpConn;
+	PCPResultInfo *pcpResInfo;
+	int			status = PCP_TARGET_OK;
+
+	pcpConn = pcp_connect(host, port, opts->user, opts->pass, opts->debug ? stdout : NULL);
 	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
 	{
 		fprintf(stderr, "%s\n", pcp_get_last_error(pcpConn) ? pcp_get_last_error(pcpConn) : "Unknown Error");
-		exit(1);
+		pcp_free_connection(pcpConn);
+		return PCP_TARGET_CONNECT_FAILED;
 	}
 
 	/*
@@ -382,15 +555,15 @@ main(int argc, char **argv)
 	 */
 	if (current_app_type->app_type == PCP_ATTACH_NODE)
 	{
-		pcpResInfo = pcp_attach_node(pcpConn, nodeID);
+		pcpResInfo = pcp_attach_node(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_DETACH_NODE)
 	{
-		if (gracefully)
-			pcpResInfo = pcp_detach_node_gracefully(pcpConn, nodeID);
+		if (opts->gracefully)
+			pcpResInfo = pcp_detach_node_gracefully(pcpConn, opts->nodeID);
 		else
-			pcpResInfo = pcp_detach_node(pcpConn, nodeID);
+			pcpResInfo = pcp_detach_node(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_NODE_COUNT)
@@ -400,12 +573,17 @@ main(int argc, char **argv)
 
 	else if (current_app_type->app_type == PCP_NODE_INFO)
 	{
-		pcpResInfo = pcp_node_info(pcpConn, nodeID);
+		pcpResInfo = pcp_node_info(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_HEALTH_CHECK_STATS)
 	{
-		pcpResInfo = pcp_health_check_stats(pcpConn, nodeID);
+		pcpResInfo = pcp_health_check_stats(pcpConn, opts->nodeID);
+	}
+
+	else if (current_app_type->app_type == PCP_BACKEND_STATS)
+	{
+		pcpResInfo = pcp_backend_stats(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_POOL_STATUS)
@@ -420,47 +598,83 @@ main(int argc, char **argv)
 
 	else if (current_app_type->app_type == PCP_PROC_INFO)
 	{
-		pcpResInfo = pcp_process_info(pcpConn, processID);
+		pcpResInfo = pcp_process_info(pcpConn, opts->processID);
+	}
+
+	else if (current_app_type->app_type == PCP_MEMORY_INFO)
+	{
+		pcpResInfo = pcp_memory_info(pcpConn);
 	}
 
 	else if (current_app_type->app_type == PCP_PROMOTE_NODE)
 	{
-		if (gracefully)
-			pcpResInfo = pcp_promote_node_gracefully(pcpConn, nodeID, switchover);
+		if (opts->gracefully)
+			pcpResInfo = pcp_promote_node_gracefully(pcpConn, opts->nodeID, opts->switchover);
 		else
-			pcpResInfo = pcp_promote_node(pcpConn, nodeID, switchover);
+			pcpResInfo = pcp_promote_node(pcpConn, opts->nodeID, opts->switchover);
 	}
 
 	else if (current_app_type->app_type == PCP_RECOVERY_NODE)
 	{
-		pcpResInfo = pcp_recovery_node(pcpConn, nodeID);
+		if (opts->background)
+			pcpResInfo = pcp_recovery_node_async(pcpConn, opts->nodeID);
+		else
+			pcpResInfo = pcp_recovery_node(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_STOP_PGPOOL)
 	{
-		pcpResInfo = pcp_terminate_pgpool(pcpConn, shutdown_mode, command_scope);
+		pcpResInfo = pcp_terminate_pgpool(pcpConn, opts->shutdown_mode, opts->command_scope);
 	}
 
 	else if (current_app_type->app_type == PCP_WATCHDOG_INFO)
 	{
-		pcpResInfo = pcp_watchdog_info(pcpConn, nodeID);
+		pcpResInfo = pcp_watchdog_info(pcpConn, opts->nodeID);
 	}
 
 	else if (current_app_type->app_type == PCP_RELOAD_CONFIG)
 	{
-		pcpResInfo = pcp_reload_config(pcpConn,command_scope);
+		pcpResInfo = pcp_reload_config(pcpConn,opts->command_scope);
+	}
+
+	else if (current_app_type->app_type == PCP_SNAPSHOT_QUERY_CACHE)
+	{
+		pcpResInfo = pcp_snapshot_query_cache(pcpConn);
+	}
+
+	else if (current_app_type->app_type == PCP_RESET_STATEMENT_STATS)
+	{
+		pcpResInfo = pcp_reset_statement_stats(pcpConn);
+	}
+
+	else if (current_app_type->app_type == PCP_SUBSCRIBE)
+	{
+		pcpResInfo = pcp_subscribe(pcpConn);
+	}
+
+	else if (current_app_type->app_type == PCP_RECOVERY_STATUS)
+	{
+		pcpResInfo = pcp_recovery_status(pcpConn);
 	}
 
 	else
 	{
 		/* should never happen */
 		fprintf(stderr, "%s: Invalid pcp process\n", progname);
+		status = PCP_TARGET_COMMAND_FAILED;
 		goto DISCONNECT_AND_EXIT;
 	}
 
 	if (pcpResInfo == NULL || PCPResultStatus(pcpResInfo) != PCP_RES_COMMAND_OK)
 	{
 		fprintf(stderr, "%s\n", pcp_get_last_error(pcpConn) ? pcp_get_last_error(pcpConn) : "Unknown Error");
+		status = PCP_TARGET_COMMAND_FAILED;
+		goto DISCONNECT_AND_EXIT;
+	}
+
+	if (current_app_type->app_type == PCP_SUBSCRIBE)
+	{
+		output_events(pcpConn, opts->verbose);
 		goto DISCONNECT_AND_EXIT;
 	}
 
@@ -471,25 +685,34 @@ main(int argc, char **argv)
 	else
 	{
 		if (current_app_type->app_type == PCP_NODE_COUNT)
-			output_nodecount_result(pcpResInfo, verbose);
+			output_nodecount_result(pcpResInfo, opts->verbose);
 
 		if (current_app_type->app_type == PCP_NODE_INFO)
-			output_nodeinfo_result(pcpResInfo, all, verbose);
+			output_nodeinfo_result(pcpResInfo, opts->all, opts->verbose);
 
 		if (current_app_type->app_type == PCP_HEALTH_CHECK_STATS)
-			output_health_check_stats_result(pcpResInfo, verbose);
+			output_health_check_stats_result(pcpResInfo, opts->verbose);
+
+		if (current_app_type->app_type == PCP_BACKEND_STATS)
+			output_backend_stats_result(pcpResInfo, opts->verbose);
 
 		if (current_app_type->app_type == PCP_POOL_STATUS)
-			output_poolstatus_result(pcpResInfo, verbose);
+			output_poolstatus_result(pcpResInfo, opts->verbose);
 
 		if (current_app_type->app_type == PCP_PROC_COUNT)
-			output_proccount_result(pcpResInfo, verbose);
+			output_proccount_result(pcpResInfo, opts->verbose);
 
 		if (current_app_type->app_type == PCP_PROC_INFO)
-			output_procinfo_result(pcpResInfo, all, verbose);
+			output_procinfo_result(pcpResInfo, opts->all, opts->verbose);
+
+		else if (current_app_type->app_type == PCP_MEMORY_INFO)
+			output_memory_info_result(pcpResInfo, opts->verbose);
 
 		else if (current_app_type->app_type == PCP_WATCHDOG_INFO)
-			output_watchdog_info_result(pcpResInfo, verbose);
+			output_watchdog_info_result(pcpResInfo, opts->verbose);
+
+		else if (current_app_type->app_type == PCP_RECOVERY_STATUS)
+			output_recovery_status_result(pcpResInfo, opts->verbose);
 	}
 
 DISCONNECT_AND_EXIT:
@@ -497,6 +720,122 @@ DISCONNECT_AND_EXIT:
 	pcp_disconnect(pcpConn);
 	pcp_free_connection(pcpConn);
 
+	return status;
+}
+
+/*
+ * Run the command against several pgpool-II at once.  A child process is
+ * forked for each host, whose output is collected through a pipe, and the
+ * outputs are printed in the order of the hosts after all of them finish.
+ * Returns 0 if the command succeeded on all the hosts.
+ */
+static int
+run_on_targets(PCPTarget * targets, int ntargets, PCPCommandOptions * opts)
+{
+	struct pollfd *fds = palloc0(sizeof(struct pollfd) * ntargets);
+	int			nopen = 0;
+	int			nfailed = 0;
+	int			i;
+
+	/* don't let the children print what is buffered */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < ntargets; i++)
+	{
+		int			pipefd[2];
+
+		if (pipe(pipefd) < 0)
+		{
+			fprintf(stderr, "%s: could not create pipe: %s\n", progname, strerror(errno));
+			exit(1);
+		}
+
+		targets[i].pid = fork();
+		if (targets[i].pid < 0)
+		{
+			fprintf(stderr, "%s: could not fork: %s\n", progname, strerror(errno));
+			exit(1);
+		}
+		if (targets[i].pid == 0)
+		{
+			close(pipefd[0]);
+			dup2(pipefd[1], STDOUT_FILENO);
+			dup2(pipefd[1], STDERR_FILENO);
+			close(pipefd[1]);
+			exit(run_command(targets[i].host, targets[i].port, opts));
+		}
+
+		close(pipefd[1]);
+		fds[i].fd = pipefd[0];
+		fds[i].events = POLLIN;
+		nopen++;
+	}
+
+	/* read all the pipes until the children close them */
+	while (nopen > 0)
+	{
+		if (poll(fds, ntargets, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "%s: poll failed: %s\n", progname, strerror(errno));
+			exit(1);
+		}
+
+		for (i = 0; i < ntargets; i++)
+		{
+			PCPTarget  *target = &targets[i];
+			char		buf[8192];
+			ssize_t		n;
+
+			if (fds[i].fd < 0 || fds[i].revents == 0)
+				continue;
+
+			n = read(fds[i].fd, buf, sizeof(buf));
+			if (n > 0)
+			{
+				if (target->output_len + n > target->output_size)
+				{
+					target->output_size = Max(target->output_size * 2, target->output_len + n);
+					if (target->output == NULL)
+						target->output = palloc(target->output_size);
+					else
+						target->output = repalloc(target->output, target->output_size);
+				}
+				memcpy(target->output + target->output_len, buf, n);
+				target->output_len += n;
+			}
+			else if (n == 0 || errno != EINTR)
+			{
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				nopen--;
+			}
+		}
+	}
+
+	for (i = 0; i < ntargets; i++)
+	{
+		PCPTarget  *target = &targets[i];
+		int			status;
+		bool		ok;
+
+		ok = (waitpid(target->pid, &status, 0) == target->pid &&
+			  WIFEXITED(status) && WEXITSTATUS(status) == PCP_TARGET_OK);
+		if (!ok)
+			nfailed++;
+
+		printf("=== %s:%d%s ===\n", target->host, target->port, ok ? "" : " (failed)");
+		if (target->output_len > 0)
+			fwrite(target->output, 1, target->output_len, stdout);
+	}
+
+	if (nfailed > 0)
+	{
+		fprintf(stderr, "%s: failed on %d of %d pgpool-II hosts\n", progname, nfailed, ntargets);
+		return 1;
+	}
 	return 0;
 }
 
@@ -513,6 +852,93 @@ output_nodecount_result(PCPResultInfo * pcpResInfo, bool verbose)
 		printf("%d\n", pcp_get_int_data(pcpResInfo, 0));
 }
 
+/*
+ * Print events until the connection is lost.
+ */
+static void
+output_events(PCPConnInfo * pcpConn, bool verbose)
+{
+	PCPResultInfo *pcpResInfo;
+
+	for (;;)
+	{
+		POOL_EVENT_INFO *event;
+
+		pcpResInfo = pcp_next_event(pcpConn);
+		if (pcpResInfo == NULL || PCPResultStatus(pcpResInfo) != PCP_RES_COMMAND_OK)
+		{
+			fprintf(stderr, "%s\n", pcp_get_last_error(pcpConn) ? pcp_get_last_error(pcpConn) : "Unknown Error");
+			return;
+		}
+
+		event = (POOL_EVENT_INFO *) pcp_get_binary_data(pcpResInfo, 0);
+
+		if (verbose)
+		{
+			const char *titles[] = {"Timestamp", "Event Type", "Node Id", "Detail"};
+			const char *types[] = {"s", "s", "s", "s"};
+
+			printf(format_titles(titles, types, sizeof(titles)/sizeof(char *)),
+				   event->timestamp,
+				   event->event_type,
+				   *event->node_id ? event->node_id : "-",
+				   event->detail);
+		}
+		else
+			printf("%s %s %s %s\n",
+				   event->timestamp,
+				   event->event_type,
+				   *event->node_id ? event->node_id : "-",
+				   event->detail);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Format and output the progress of online recovery
+ */
+static void
+output_recovery_status_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	POOL_RECOVERY_STATUS *status = (POOL_RECOVERY_STATUS *) pcp_get_binary_data(pcpResInfo, 0);
+
+	if (verbose)
+	{
+		const char *titles[] = {"Node Id", "Stage", "Start Time", "Stage Start Time", "End Time",
+								"Base Backup Streams", "Base Backup Streamed", "Base Backup Total",
+								"Start WAL LSN", "Current WAL LSN", "Client Pause Time (ms)", "Message"};
+		const char *types[] = {"s", "s", "s", "s", "s", "s", "s", "s", "s", "s", "s", "s"};
+
+		printf(format_titles(titles, types, sizeof(titles)/sizeof(char *)),
+			   status->node_id,
+			   status->stage,
+			   status->start_time,
+			   status->stage_start_time,
+			   status->end_time,
+			   status->backup_streams,
+			   status->backup_streamed,
+			   status->backup_total,
+			   status->start_lsn,
+			   status->current_lsn,
+			   status->pause_time,
+			   status->message);
+	}
+	else
+		printf("%s %s \"%s\" \"%s\" \"%s\" %s %s %s %s %s %s %s\n",
+			   *status->node_id ? status->node_id : "-",
+			   status->stage,
+			   status->start_time,
+			   status->stage_start_time,
+			   status->end_time,
+			   status->backup_streams,
+			   status->backup_streamed,
+			   status->backup_total,
+			   *status->start_lsn ? status->start_lsn : "-",
+			   *status->current_lsn ? status->current_lsn : "-",
+			   status->pause_time,
+			   status->message);
+}
+
 static void
 output_nodeinfo_result(PCPResultInfo * pcpResInfo, bool all, bool verbose)
 {
@@ -600,9 +1026,12 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 								"Average Retry Count", "Max Retry Count", "Max Health Check Duration",
 								"Minimum Health Check Duration", "Average Health Check Duration",
 								"Last Health Check", "Last Successful Health Check",
-								"Last Skip Health Check", "Last Failed Health Check"};
+								"Last Skip Health Check", "Last Failed Health Check",
+								"P50 Health Check Duration", "P99 Health Check Duration",
+								"Health Check Duration Trend", "Recent Fail Count"};
 		const char *types[] = {"s", "s", "s", "s", "s", "s", "s", "s", "s", "s",
-							   "s", "s", "s", "s", "s", "s", "s", "s", "s", "s"};
+							   "s", "s", "s", "s", "s", "s", "s", "s", "s", "s",
+							   "s", "s", "s", "s"};
 		char *format_string;
 
 		format_string = format_titles(titles, types, sizeof(titles)/sizeof(char *));
@@ -626,11 +1055,15 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 			   stats->last_health_check,
 			   stats->last_successful_health_check,
 			   stats->last_skip_health_check,
-			   stats->last_failed_health_check);
+			   stats->last_failed_health_check,
+			   stats->p50_health_check_duration,
+			   stats->p99_health_check_duration,
+			   stats->health_check_duration_trend,
+			   stats->recent_fail_count);
 	}
 	else
 	{
-		printf("%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
+		printf("%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
 			   stats->node_id,
 			   stats->hostname,
 			   stats->port,
@@ -650,7 +1083,96 @@ output_health_check_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
 			   stats->last_health_check,
 			   stats->last_successful_health_check,
 			   stats->last_skip_health_check,
-			   stats->last_failed_health_check);
+			   stats->last_failed_health_check,
+			   stats->p50_health_check_duration,
+			   stats->p99_health_check_duration,
+			   stats->health_check_duration_trend,
+			   stats->recent_fail_count);
+	}
+}
+
+/*
+ * Format and output backend stats.  Latencies are in milliseconds.
+ */
+static void
+output_backend_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	POOL_BACKEND_STATS *stats = (POOL_BACKEND_STATS *)pcp_get_binary_data(pcpResInfo, 0);
+	const char *titles[] = {"Node Id", "Host Name", "Port", "Status", "Role",
+							"Select Count", "Insert Count", "Update Count", "Delete Count",
+							"DDL Count", "Other Count", "Panic Count", "Fatal Count", "Error Count",
+							"Latency p50", "Latency p95", "Latency p99",
+							"Select Latency p50", "Select Latency p95", "Select Latency p99",
+							"Insert Latency p50", "Insert Latency p95", "Insert Latency p99",
+							"Update Latency p50", "Update Latency p95", "Update Latency p99",
+							"Delete Latency p50", "Delete Latency p95", "Delete Latency p99",
+							"DDL Latency p50", "DDL Latency p95", "DDL Latency p99",
+							"Other Latency p50", "Other Latency p95", "Other Latency p99"};
+	int		   *offsets;
+	int			n;
+	int			i;
+	int			maxlen = 0;
+
+	offsets = pool_backend_stats_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		int			l = strlen(titles[i]);
+
+		maxlen = (l > maxlen) ? l : maxlen;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (verbose)
+			printf("%-*s : %s\n", maxlen, titles[i], (char *)stats + offsets[i]);
+		else
+			printf("%s%s", (char *)stats + offsets[i], i == n - 1 ? "\n" : " ");
+	}
+	if (verbose)
+		printf("\n");
+}
+
+static void
+output_memory_info_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	const char *titles[] = {"Pool PID", "Status", "Allocated", "Session", "Query",
+							"Buffers", "Peak"};
+	int		   *offsets;
+	int			n;
+	int			i;
+	int			row;
+	int			maxlen = 0;
+	int			array_size = pcp_result_slot_count(pcpResInfo);
+
+	offsets = pool_report_memory_offsets(&n);
+
+	for (i = 0; i < n; i++)
+	{
+		int			l = strlen(titles[i]);
+
+		maxlen = (l > maxlen) ? l : maxlen;
+	}
+
+	for (row = 0; row < array_size; row++)
+	{
+		POOL_REPORT_MEMORY *memory = (POOL_REPORT_MEMORY *) pcp_get_binary_data(pcpResInfo, row);
+
+		if (memory == NULL)
+		{
+			printf("****Data at %d slot is NULL\n", row);
+			continue;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			if (verbose)
+				printf("%-*s : %s\n", maxlen, titles[i], (char *) memory + offsets[i]);
+			else
+				printf("%s%s", (char *) memory + offsets[i], i == n - 1 ? "\n" : " ");
+		}
+		if (verbose)
+			printf("\n");
 	}
 }
 
@@ -721,14 +1243,18 @@ output_procinfo_result(PCPResultInfo * pcpResInfo, bool all, bool verbose)
 		"Database", "Username", "Start time", "Client connection count",
 		"Major", "Minor", "Backend connection time", "Client connection time",
 		"Client idle duration", "Client disconnection time", "Pool Counter", "Backend PID",
-		"Connected", "PID", "Backend ID", "Status", "Load balance node"
+		"Connected", "PID", "Backend ID", "Status", "Load balance node",
+		"Pool evictions", "Wait state", "Client read time", "Parse time", "Route time",
+		"Relcache time", "Cache lock time", "Backend wait time", "Client write time"
 	};
 	const char *types[] = {
 		"s", "s", "s", "s",
 		"s", "s", "s", "s",
 		"s", "s", "s", "s",
 		"s", "s", "s", "s",
-		"s"
+		"s", "s", "s", "s",
+		"s", "s", "s", "s",
+		"s", "s"
 	};
 
 
@@ -736,7 +1262,7 @@ output_procinfo_result(PCPResultInfo * pcpResInfo, bool all, bool verbose)
 		format = format_titles(titles, types, sizeof(titles)/sizeof(char *));
 	else
 	{
-		format = "%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n";
+		format = "%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n";
 	}
 
 	for (i = 0; i < array_size; i++)
@@ -766,7 +1292,16 @@ output_procinfo_result(PCPResultInfo * pcpResInfo, bool all, bool verbose)
 			   pools->pool_pid,
 			   pools->backend_id,
 			   pools->status,
-			   pools->load_balance_node);
+			   pools->load_balance_node,
+			   pools->pool_evictions,
+			   pools->wait_state,
+			   pools->client_read_time,
+			   pools->parse_time,
+			   pools->route_time,
+			   pools->relcache_time,
+			   pools->cache_lock_time,
+			   pools->backend_wait_time,
+			   pools->client_write_time);
 	}
 	if (printed == false)
 		printf("No process information available\n\n");
@@ -853,6 +1388,7 @@ app_require_nodeID(void)
 	return (current_app_type->app_type == PCP_ATTACH_NODE ||
 			current_app_type->app_type == PCP_DETACH_NODE ||
 			current_app_type->app_type == PCP_HEALTH_CHECK_STATS ||
+			current_app_type->app_type == PCP_BACKEND_STATS ||
 			current_app_type->app_type == PCP_PROMOTE_NODE ||
 			current_app_type->app_type == PCP_RECOVERY_NODE);
 }
@@ -880,7 +1416,7 @@ usage(void)
 	 * print the command options
 	 */
 	fprintf(stderr, "  -U, --username=NAME    username for PCP authentication\n");
-	fprintf(stderr, "  -h, --host=HOSTNAME    pgpool-II host\n");
+	fprintf(stderr, "  -h, --host=HOSTNAME    pgpool-II host, or comma separated HOST[:PORT] list\n");
 	fprintf(stderr, "  -p, --port=PORT        PCP port number\n");
 	fprintf(stderr, "  -w, --no-password      never prompt for password\n");
 	fprintf(stderr, "  -W, --password         force password prompt (should happen automatically)\n");
@@ -916,6 +1452,11 @@ usage(void)
 		fprintf(stderr, "  -g, --gracefully       promote gracefully (optional)\n");
 	}
 
+	if (current_app_type->app_type == PCP_RECOVERY_NODE)
+	{
+		fprintf(stderr, "  -b, --background       return as soon as the recovery starts (optional)\n");
+	}
+
 	if (current_app_type->app_type == PCP_PROMOTE_NODE)
 	{
 		fprintf(stderr, "  -s, --switchover       switchover primary to specified node (optional)\n");
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * Benchmark mode: run the protocol data file over and over on a number of
+ * concurrent connections and report throughput and latency.
+ *
+ * Each client is a forked process which replays the data file until the
+ * benchmark time is over, timing each run of the whole file.  Runs are
+ * counted in a histogram of latencies with 16 buckets per power of two,
+ * which keeps percentiles within about 6% of the real value.  When done, a
+ * client writes its result to a pipe read by the parent, which adds up the
+ * results of all clients and prints the report.
+ */
+
+#include "../../include/config.h"
+#include "pgproto/pgproto.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "pgproto/fe_memutils.h"
+#include <libpq-fe.h>
+#include "pgproto/send.h"
+#include "pgproto/bench.h"
+
+/* latencies below this number of micro seconds have a bucket each */
+#define BENCH_LINEAR_BUCKETS	16
+/* latencies up to 2^(BENCH_MAX_SHIFT + 5) micro seconds can be told apart */
+#define BENCH_MAX_SHIFT			36
+#define BENCH_NBUCKETS	(BENCH_LINEAR_BUCKETS * (BENCH_MAX_SHIFT + 2))
+
+typedef struct
+{
+	uint64_t	runs;			/* completed runs of the data file */
+	uint64_t	total_usec;		/* sum of latencies */
+	uint64_t	max_usec;		/* largest latency */
+	uint64_t	hist[BENCH_NBUCKETS];	/* runs per latency bucket */
+}			BENCH_RESULT;
+
+static void run_client(char *data_file, char *host, char *port, char *user, char *database,
+					   int duration, int reconnect, int debug, int outfd);
+static uint64_t now_usec(void);
+static int	bucket_of(uint64_t usec);
+static uint64_t bucket_value(int bucket);
+static double percentile(BENCH_RESULT * result, double pct);
+
+void
+run_benchmark(char *data_file, char *host, char *port, char *user, char *database,
+			  int clients, int duration, int reconnect, int debug)
+{
+	BENCH_RESULT total;
+	BENCH_RESULT result;
+	pid_t	   *pids;
+	int		   *fds;
+	int			failed = 0;
+	uint64_t	start;
+	double		elapsed;
+	int			i;
+	int			j;
+
+	/* make sure that the data file can be read before forking */
+	fclose(openfile(data_file));
+
+	pids = pg_malloc(sizeof(pid_t) * clients);
+	fds = pg_malloc(sizeof(int) * clients);
+
+	start = now_usec();
+
+	for (i = 0; i < clients; i++)
+	{
+		int			pipefd[2];
+
+		if (pipe(pipefd) < 0)
+		{
+			fprintf(stderr, "pipe failed (%s)\n", strerror(errno));
+			exit(1);
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0)
+		{
+			fprintf(stderr, "fork failed (%s)\n", strerror(errno));
+			exit(1);
+		}
+		else if (pids[i] == 0)
+		{
+			close(pipefd[0]);
+			run_client(data_file, host, port, user, database,
+					   duration, reconnect, debug, pipefd[1]);
+			exit(0);
+		}
+		close(pipefd[1]);
+		fds[i] = pipefd[0];
+	}
+
+	memset(&total, 0, sizeof(total));
+
+	for (i = 0; i < clients; i++)
+	{
+		char	   *p = (char *) &result;
+		size_t		left = sizeof(result);
+		ssize_t		sts;
+
+		/* a client which failed exits without writing its result */
+		while (left > 0)
+		{
+			sts = read(fds[i], p, left);
+			if (sts < 0 && errno == EINTR)
+				continue;
+			if (sts <= 0)
+				break;
+			p += sts;
+			left -= sts;
+		}
+		close(fds[i]);
+
+		if (left > 0)
+		{
+			failed++;
+			continue;
+		}
+
+		total.runs += result.runs;
+		total.total_usec += result.total_usec;
+		if (result.max_usec > total.max_usec)
+			total.max_usec = result.max_usec;
+		for (j = 0; j < BENCH_NBUCKETS; j++)
+			total.hist[j] += result.hist[j];
+	}
+
+	for (i = 0; i < clients; i++)
+		waitpid(pids[i], NULL, 0);
+
+	elapsed = (now_usec() - start) / 1000000.0;
+
+	printf("clients: %d\n", clients);
+	printf("failed clients: %d\n", failed);
+	printf("duration: %.3f s\n", elapsed);
+	printf("runs: %llu\n", (unsigned long long) total.runs);
+	printf("throughput: %.1f runs/s\n", total.runs / elapsed);
+	if (total.runs > 0)
+		printf("latency (ms): avg %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f\n",
+			   total.total_usec / 1000.0 / total.runs,
+			   percentile(&total, 50.0) / 1000.0,
+			   percentile(&total, 90.0) / 1000.0,
+			   percentile(&total, 99.0) / 1000.0,
+			   percentile(&total, 99.9) / 1000.0,
+			   total.max_usec / 1000.0);
+
+	pg_free(pids);
+	pg_free(fds);
+
+	if (failed > 0)
+		exit(1);
+}
+
+/*
+ * Body of a client process.  Messages of the data file are buffered and
+ * sent when a response is waited for, and the trace of messages is thrown
+ * away unless debugging.
+ */
+static void
+run_client(char *data_file, char *host, char *port, char *user, char *database,
+		   int duration, int reconnect, int debug, int outfd)
+{
+	BENCH_RESULT result;
+	PGconn	   *conn = NULL;
+	FILE	   *fd;
+	uint64_t	end;
+	char	   *p;
+	size_t		left;
+
+	if (!debug)
+	{
+		if (freopen("/dev/null", "w", stderr) == NULL)
+			exit(1);
+		setvbuf(stderr, NULL, _IOFBF, 65536);
+	}
+
+	send_buffering = 1;
+	memset(&result, 0, sizeof(result));
+	fd = openfile(data_file);
+
+	end = now_usec() + (uint64_t) duration * 1000000;
+
+	while (now_usec() < end)
+	{
+		uint64_t	start = now_usec();
+		uint64_t	usec;
+
+		if (conn == NULL)
+			conn = connect_db(host, port, user, database);
+
+		rewind(fd);
+		read_and_process(fd, conn);
+		send_flush(conn);
+
+		if (reconnect)
+		{
+			PQfinish(conn);
+			conn = NULL;
+		}
+
+		usec = now_usec() - start;
+		result.runs++;
+		result.total_usec += usec;
+		if (usec > result.max_usec)
+			result.max_usec = usec;
+		result.hist[bucket_of(usec)]++;
+	}
+
+	if (conn)
+		PQfinish(conn);
+	fclose(fd);
+
+	p = (char *) &result;
+	left = sizeof(result);
+	while (left > 0)
+	{
+		ssize_t		sts = write(outfd, p, left);
+
+		if (sts < 0 && errno == EINTR)
+			continue;
+		if (sts <= 0)
+			exit(1);
+		p += sts;
+		left -= sts;
+	}
+	close(outfd);
+}
+
+static uint64_t
+now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Latencies below BENCH_LINEAR_BUCKETS micro seconds have a bucket each.
+ * Above, each power of two is split into BENCH_LINEAR_BUCKETS buckets.
+ */
+static int
+bucket_of(uint64_t usec)
+{
+	int			exponent = 0;
+	int			bucket;
+
+	if (usec < BENCH_LINEAR_BUCKETS)
+		return (int) usec;
+
+	while ((usec >> exponent) >= 2 * BENCH_LINEAR_BUCKETS)
+		exponent++;
+
+	bucket = BENCH_LINEAR_BUCKETS * (exponent + 1) +
+		(int) ((usec >> exponent) - BENCH_LINEAR_BUCKETS);
+
+	return bucket < BENCH_NBUCKETS ? bucket : BENCH_NBUCKETS - 1;
+}
+
+/*
+ * Middle of the range of latencies counted in the bucket.
+ */
+static uint64_t
+bucket_value(int bucket)
+{
+	int			exponent;
+	uint64_t	low;
+
+	if (bucket < BENCH_LINEAR_BUCKETS)
+		return bucket;
+
+	exponent = bucket / BENCH_LINEAR_BUCKETS - 1;
+	low = (uint64_t) (BENCH_LINEAR_BUCKETS + bucket % BENCH_LINEAR_BUCKETS) << exponent;
+	return low + ((uint64_t) 1 << exponent) / 2;
+}
+
+/*
+ * Latency in micro seconds below which pct percent of the runs finished.
+ */
+static double
+percentile(BENCH_RESULT * result, double pct)
+{
+	uint64_t	target;
+	uint64_t	count = 0;
+	int			i;
+
+	target = (uint64_t) (result->runs * pct / 100.0);
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < BENCH_NBUCKETS; i++)
+	{
+		count += result->hist[i];
+		if (count >= target)
+		{
+			uint64_t	value = bucket_value(i);
+
+			return value < result->max_usec ? value : result->max_usec;
+		}
+	}
+	return result->max_usec;
+}
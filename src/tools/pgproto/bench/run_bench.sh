@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2026 PgPool Global Development Group
+#
+# Permission to use, copy, modify, and distribute this software and
+# its documentation for any purpose and without fee is hereby
+# granted, provided that the above copyright notice appear in all
+# copies and that both that copyright notice and this permission
+# notice appear in supporting documentation, and that the name of the
+# author not be used in advertising or publicity pertaining to
+# distribution of the software without specific, written prior
+# permission. The author makes no representations about the
+# suitability of this software for any purpose.  It is provided "as
+# is" without express or implied warranty.
+#-------------------------------------------------------------------
+# Run a benchmark scenario with pgproto against a cluster created by
+# pgpool_setup in directory "benchdir" under the current directory.
+# Any previous benchdir is removed.
+#
+# usage: run_bench.sh scenario [clients [seconds]]
+#
+# scenario is one of:
+# cache_hit: query cache hits
+# lb_select: load balanced SELECT, extended query protocol
+# lb_select_pipelined: ten load balanced SELECTs before each Sync
+# insert_lock: INSERT in native replication mode with insert_lock
+# connection_storm: a new connection for each query
+# failover: lb_select while standby node 1 goes down
+#
+# PGBIN is the PostgreSQL bin directory.  PGPOOL_SETUP and PGPROTO can
+# point to pgpool_setup and pgproto if they are not in the PATH.
+#-------------------------------------------------------------------
+dir=$(cd $(dirname $0); pwd)
+PGPOOL_SETUP=${PGPOOL_SETUP:-pgpool_setup}
+PGPROTO=${PGPROTO:-pgproto}
+PSQL="$PGBIN/psql -X"
+PG_CTL=$PGBIN/pg_ctl
+
+function usage
+{
+	echo "usage: $0 cache_hit|lb_select|lb_select_pipelined|insert_lock|connection_storm|failover [clients [seconds]]"
+	exit 1
+}
+
+scenario=$1
+clients=${2:-8}
+seconds=${3:-10}
+mode=s
+conf=
+data=$scenario.data
+opts=
+
+case $scenario in
+	cache_hit)
+		conf="memory_cache_enabled = on"
+		;;
+	lb_select|lb_select_pipelined)
+		;;
+	insert_lock)
+		mode=r
+		conf="insert_lock = on"
+		;;
+	connection_storm)
+		opts=-C
+		;;
+	failover)
+		data=lb_select.data
+		;;
+	*)
+		usage
+		;;
+esac
+
+if [ -z "$PGBIN" ];then
+	echo "$0: PGBIN is not set"
+	exit 1
+fi
+
+rm -fr benchdir
+mkdir benchdir
+cd benchdir
+
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m $mode -n 2 > pgpool_setup.log 2>&1 || exit 1
+echo "done."
+
+if [ -n "$conf" ];then
+	echo "$conf" >> etc/pgpool.conf
+fi
+
+./startall
+source ./bashrc.ports
+
+# wait for pgpool to accept connections
+for i in $(seq 1 60)
+do
+	$PSQL -p $PGPOOL_PORT -c "SELECT 1" test > /dev/null 2>&1 && break
+	sleep 1
+done
+
+$PSQL -q -p $PGPOOL_PORT -f $dir/setup.sql test || { ./shutdownall; exit 1; }
+
+# stop the standby a third into the run
+if [ $scenario = failover ];then
+	(sleep $((seconds / 3)); $PG_CTL -D data1 -m f stop > /dev/null 2>&1) &
+fi
+
+$PGPROTO -p $PGPOOL_PORT -d test -f $dir/$data -c $clients -t $seconds $opts
+status=$?
+
+wait
+./shutdownall
+exit $status
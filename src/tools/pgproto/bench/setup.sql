@@ -0,0 +1,6 @@
+-- Tables used by the benchmark data files
+DROP TABLE IF EXISTS bench_t;
+DROP TABLE IF EXISTS bench_log;
+CREATE TABLE bench_t(id int PRIMARY KEY, v text);
+INSERT INTO bench_t SELECT i, 'value ' || i FROM generate_series(1, 1000) i;
+CREATE TABLE bench_log(id serial, v text);
@@ -29,14 +29,12 @@
 #include "pgproto/send.h"
 #include "pgproto/buffer.h"
 #include "pgproto/extended_query.h"
+#include "pgproto/bench.h"
 
 #undef DEBUG
 
 static void show_version(void);
 static void usage(void);
-static FILE *openfile(char *filename);
-static PGconn *connect_db(char *host, char *port, char *user, char *database);
-static void read_and_process(FILE *fd, PGconn *conn);
 static int	process_a_line(char *buf, PGconn *con);
 static int	process_message_type(int kind, char *buf, PGconn *conn);
 static void process_function_call(char *buf, PGconn *conn);
@@ -55,9 +53,11 @@ main(int argc, char **argv)
 	char	   *database = "";
 	char	   *data_file = PGPROTODATA;
 	int			debug = 0;
+	int			clients = 0;
+	int			duration = 10;
+	int			reconnect = 0;
 	FILE	   *fd;
 	PGconn	   *con;
-	int			var;
 
 	static struct option long_options[] = {
 		{"host", optional_argument, NULL, 'h'},
@@ -69,6 +69,9 @@ main(int argc, char **argv)
 		{"help", no_argument, NULL, '?'},
 		{"version", no_argument, NULL, 'v'},
 		{"read-nap", optional_argument, NULL, 'r'},
+		{"clients", required_argument, NULL, 'c'},
+		{"time", required_argument, NULL, 't'},
+		{"connect", no_argument, NULL, 'C'},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -81,7 +84,7 @@ main(int argc, char **argv)
 	if ((env = getenv("PGUSER")) != NULL && *env != '\0')
 		user = env;
 
-	while ((opt = getopt_long(argc, argv, "v?Dh:p:u:d:f:r:", long_options, &optindex)) != -1)
+	while ((opt = getopt_long(argc, argv, "v?Dh:p:u:d:f:r:c:t:C", long_options, &optindex)) != -1)
 	{
 		switch (opt)
 		{
@@ -123,29 +126,43 @@ main(int argc, char **argv)
 				read_nap = atoi(optarg);
 				break;
 
+			case 'c':
+				clients = atoi(optarg);
+				if (clients <= 0)
+				{
+					fprintf(stderr, "number of clients must be positive\n");
+					exit(1);
+				}
+				break;
+
+			case 't':
+				duration = atoi(optarg);
+				if (duration <= 0)
+				{
+					fprintf(stderr, "benchmark time must be positive\n");
+					exit(1);
+				}
+				break;
+
+			case 'C':
+				reconnect = 1;
+				break;
+
 			default:
 				usage();
 				exit(1);
 		}
 	}
 
-	fd = openfile(data_file);
-	con = connect_db(host, port, user, database);
-	var = fcntl(PQsocket(con), F_GETFL, 0);
-	if (var == -1)
+	if (clients > 0)
 	{
-		fprintf(stderr, "fcntl failed (%s)\n", strerror(errno));
-		exit(1);
+		run_benchmark(data_file, host, port, user, database,
+					  clients, duration, reconnect, debug);
+		return 0;
 	}
 
-	/*
-	 * Set the socket to non block.
-	 */
-	if (fcntl(PQsocket(con), F_SETFL, var & ~O_NONBLOCK) == -1)
-	{
-		fprintf(stderr, "fcntl failed (%s)\n", strerror(errno));
-		exit(1);
-	}
+	fd = openfile(data_file);
+	con = connect_db(host, port, user, database);
 
 	read_and_process(fd, con);
 
@@ -168,6 +185,9 @@ usage(void)
 		   "-d, --database DATABASENAME (default: same as user)\n"
 		   "-f, --proto-data-file FILENAME (default: pgproto.data)\n"
 		   "-r, --read-nap NAPTIME (in micro seconds. default: 0)\n"
+		   "-c, --clients NUM (benchmark with NUM concurrent connections)\n"
+		   "-t, --time SECONDS (benchmark duration. default: 10)\n"
+		   "-C, --connect (benchmark: connect for each run of the data file)\n"
 		   "-D, --debug\n"
 		   "-?, --help\n"
 		   "-v, --version\n",
@@ -178,7 +198,7 @@ usage(void)
  * Open protocol data and return the file descriptor.  If failed to open the
  * file, do not return and exit within this function.
  */
-static FILE *
+FILE *
 openfile(char *filename)
 {
 	FILE	   *fd = fopen(filename, "r");
@@ -195,12 +215,13 @@ openfile(char *filename)
  * Connect to the specified PostgreSQL. If failed, do not return and exit
  * within this function.
  */
-static PGconn *
+PGconn *
 connect_db(char *host, char *port, char *user, char *database)
 {
 	char		conninfo[1024];
 	PGconn	   *conn;
 	size_t		n;
+	int			var;
 	char	*app_name_str = " application_name=pgproto";
 
 	conninfo[0] = '\0';
@@ -249,13 +270,30 @@ connect_db(char *host, char *port, char *user, char *database)
 		exit(1);
 	}
 
+	var = fcntl(PQsocket(conn), F_GETFL, 0);
+	if (var == -1)
+	{
+		fprintf(stderr, "fcntl failed (%s)\n", strerror(errno));
+		exit(1);
+	}
+
+	/*
+	 * Set the socket to non block.
+	 */
+	if (fcntl(PQsocket(conn), F_SETFL, var & ~O_NONBLOCK) == -1)
+	{
+		fprintf(stderr, "fcntl failed (%s)\n", strerror(errno));
+		exit(1);
+	}
+
 	return conn;
 }
 
 /*
- * Read the protocol data file and process it.
+ * Read the protocol data file and process it.  Returns at the end of the
+ * file.
  */
-static void
+void
 read_and_process(FILE *fd, PGconn *conn)
 {
 #define PGPROTO_READBUF_LENGTH 8192
@@ -278,7 +316,8 @@ read_and_process(FILE *fd, PGconn *conn)
 			if (p == NULL)
 			{
 				/* EOF detected */
-				exit(0);
+				pg_free(buf);
+				return;
 			}
 
 			/*
@@ -28,6 +28,7 @@
 #include "pgproto/fe_memutils.h"
 #include <libpq-fe.h>
 #include "pgproto/read.h"
+#include "pgproto/send.h"
 
 static char read_char(PGconn *conn);
 static int	read_int32(PGconn *conn);
@@ -55,6 +56,9 @@ read_until_ready_for_query(PGconn *conn, int timeout, int wait_for_ready_for_que
 	fd_set		readmask;
 	int			fds;
 
+	/* the messages to be answered may still be buffered */
+	send_flush(conn);
+
 	cont = 1;
 
 	while (cont)
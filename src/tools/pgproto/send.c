@@ -30,6 +30,19 @@
 #include "pgproto/send.h"
 
 static	void write_it(int fd, void *buf, int len);
+static	void write_all(int fd, char *buf, int len);
+
+/*
+ * If non 0, data is collected in send_buf until send_flush() is called
+ * instead of being written to the connection piece by piece.  Used by the
+ * benchmark mode so that each message costs one write(2) rather than one
+ * per field.
+ */
+int			send_buffering = 0;
+
+static char *send_buf = NULL;
+static int	send_buf_len = 0;
+static int	send_buf_size = 0;
 
 /*
  * Send a character to the connection.
@@ -80,6 +93,18 @@ send_byte(char *buf, int len, PGconn *conn)
 	write_it(PQsocket(conn), buf, len);
 }
 
+/*
+ * Write out data buffered by send_buffering.
+ */
+void
+send_flush(PGconn *conn)
+{
+	if (send_buf_len == 0)
+		return;
+	write_all(PQsocket(conn), send_buf, send_buf_len);
+	send_buf_len = 0;
+}
+
 /*
  * Wrapper for write(2).
  */
@@ -87,6 +112,19 @@ static
 void write_it(int fd, void *buf, int len)
 {
 	int errsave = errno;
+
+	if (send_buffering)
+	{
+		if (send_buf_len + len > send_buf_size)
+		{
+			send_buf_size = (send_buf_len + len) * 2;
+			send_buf = pg_realloc(send_buf, send_buf_size);
+		}
+		memcpy(send_buf + send_buf_len, buf, len);
+		send_buf_len += len;
+		return;
+	}
+
 	errno = 0;
 	if (write(fd, buf, len) < 0)
 	{
@@ -95,3 +133,30 @@ void write_it(int fd, void *buf, int len)
 	errno = errsave;
 }
 
+/*
+ * write(2) all of buf, which may take more than one call for large data.
+ */
+static
+void write_all(int fd, char *buf, int len)
+{
+	int errsave = errno;
+
+	while (len > 0)
+	{
+		int			sts;
+
+		errno = 0;
+		sts = write(fd, buf, len);
+		if (sts < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "write_all: warning write(2) failed: %s\n", strerror(errno));
+			break;
+		}
+		buf += sts;
+		len -= sts;
+	}
+	errno = errsave;
+}
+
@@ -75,6 +75,7 @@
 #include "pool_config.h"
 #include "utils/pool_stream.h"
 #include "context/pool_session_context.h"
+#include "utils/pool_log_ring.h"
 #include "pool.h"
 
 #define MAX_ON_EXITS 64
@@ -151,7 +152,13 @@ static void send_message_to_frontend(ErrorData *edata);
 static void write_pipe_chunks(char *data, int len, int dest);
 static void write_console(const char *line, int len);
 static void log_line_prefix(StringInfo buf, const char *line_prefix, ErrorData *edata);
+static bool log_line_prefix_is_constant(const char *line_prefix);
+static void append_log_line_prefix(StringInfo buf, StringInfo prefix, ErrorData *edata);
 static const char *process_log_prefix_padding(const char *p, int *ppadding);
+static const char *get_formatted_log_time(bool with_ms);
+static void write_jsonlog(ErrorData *edata);
+static void append_json_field(StringInfo buf, const char *key, const char *value);
+static void append_json_int_field(StringInfo buf, const char *key, int value);
 #ifdef WIN32
 extern char *event_source;
 static void write_eventlog(int level, const char *line, int len);
@@ -1862,7 +1869,8 @@ write_pipe_chunks(char *data, int len, int dest)
 	/* write all but the last chunk */
 	while (len > PIPE_MAX_PAYLOAD)
 	{
-		p.proto.is_last = (dest == LOG_DESTINATION_CSVLOG ? 'F' : 'f');
+		p.proto.is_last = (dest == LOG_DESTINATION_CSVLOG ? 'F' :
+						   dest == LOG_DESTINATION_JSONLOG ? 'j' : 'f');
 		p.proto.len = PIPE_MAX_PAYLOAD;
 		memcpy(p.proto.data, data, PIPE_MAX_PAYLOAD);
 		rc = write(fd, &p, PIPE_HEADER_SIZE + PIPE_MAX_PAYLOAD);
@@ -1872,7 +1880,8 @@ write_pipe_chunks(char *data, int len, int dest)
 	}
 
 	/* write the last chunk */
-	p.proto.is_last = (dest == LOG_DESTINATION_CSVLOG ? 'T' : 't');
+	p.proto.is_last = (dest == LOG_DESTINATION_CSVLOG ? 'T' :
+					   dest == LOG_DESTINATION_JSONLOG ? 'J' : 't');
 	p.proto.len = len;
 	memcpy(p.proto.data, data, len);
 	rc = write(fd, &p, PIPE_HEADER_SIZE + len);
@@ -2078,8 +2087,6 @@ log_line_prefix(StringInfo buf, const char *line_prefix, ErrorData *edata)
 	POOL_CONNECTION *frontend = NULL;
 	POOL_SESSION_CONTEXT *session = pool_get_session_context(true);
 
-	char		strbuf[129];
-
 	if (session)
 		frontend = session->frontend;
 
@@ -2201,35 +2208,14 @@ log_line_prefix(StringInfo buf, const char *line_prefix, ErrorData *edata)
 					appendStringInfo(buf, "%ld", log_line_number);
 				break;
 			case 't':
-				{
-					time_t		now = time(NULL);
-
-					strftime(strbuf, sizeof(strbuf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-					if (padding != 0)
-						appendStringInfo(buf, "%*s", padding, strbuf);
-					else
-						appendStringInfoString(buf, strbuf);
-				}
-				break;
 			case 'm':
 				{
-					struct timeval timeval;
-					time_t seconds;
-					struct tm *now;
-					char		msbuf[13];
-
-					gettimeofday(&timeval, NULL);
-					seconds = timeval.tv_sec;
-					now = localtime(&seconds);
-					strftime(strbuf, sizeof(strbuf), "%Y-%m-%d %H:%M:%S", now);
-					snprintf(msbuf, sizeof(msbuf), ".%03d", (int) (timeval.tv_usec / 1000));
-					memcpy(strbuf + 19, msbuf, 5);
+					const char *timestr = get_formatted_log_time(*p == 'm');
 
 					if (padding != 0)
-						appendStringInfo(buf, "%*s", padding, strbuf);
+						appendStringInfo(buf, "%*s", padding, timestr);
 					else
-						appendStringInfoString(buf, strbuf);
+						appendStringInfoString(buf, timestr);
 				}
 				break;
 			default:
@@ -2239,6 +2225,202 @@ log_line_prefix(StringInfo buf, const char *line_prefix, ErrorData *edata)
 	}
 }
 
+/*
+ * Returns true if log_line_prefix expands to the same string for all lines
+ * of a message, that is unless it contains %l.  Then the prefix is
+ * expanded only once per message.
+ */
+static bool
+log_line_prefix_is_constant(const char *line_prefix)
+{
+	const char *p;
+	int			padding;
+
+	if (line_prefix == NULL)
+		return true;
+
+	for (p = line_prefix; *p != '\0'; p++)
+	{
+		if (*p != '%')
+			continue;
+		p++;
+		if (*p == '\0')
+			break;
+		if (*p == '%')
+			continue;
+		if (*p <= '9' && (p = process_log_prefix_padding(p, &padding)) == NULL)
+			break;
+		if (*p == 'l')
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Append the log line prefix for a line of the current message.  "prefix"
+ * is empty for the first line, and keeps the expanded prefix for the
+ * following lines if it is the same for all of them.
+ */
+static void
+append_log_line_prefix(StringInfo buf, StringInfo prefix, ErrorData *edata)
+{
+	if (prefix->len > 0)
+	{
+		appendBinaryStringInfo(buf, prefix->data, prefix->len);
+		return;
+	}
+
+	if (!log_line_prefix_is_constant(pool_config->log_line_prefix))
+	{
+		log_line_prefix(buf, pool_config->log_line_prefix, edata);
+		return;
+	}
+
+	log_line_prefix(prefix, pool_config->log_line_prefix, edata);
+	appendBinaryStringInfo(buf, prefix->data, prefix->len);
+}
+
+/*
+ * Returns the current time formatted as "%Y-%m-%d %H:%M:%S", optionally
+ * followed by milliseconds.  localtime() and strftime() are called only
+ * when the second changes; a busy process logs many lines per second.
+ * The result is valid until the next call.
+ */
+static const char *
+get_formatted_log_time(bool with_ms)
+{
+	static time_t cached_sec = -1;
+	static char cached_str[32];
+	static char ms_str[48];
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	if (tv.tv_sec != cached_sec)
+	{
+		time_t		seconds = tv.tv_sec;
+
+		strftime(cached_str, sizeof(cached_str), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+		cached_sec = tv.tv_sec;
+	}
+
+	if (!with_ms)
+		return cached_str;
+
+	snprintf(ms_str, sizeof(ms_str), "%s.%03d", cached_str, (int) (tv.tv_usec / 1000));
+	return ms_str;
+}
+
+/*
+ * Append a "key":"value" pair to a JSON object being built.  NULL values
+ * are skipped.
+ */
+static void
+append_json_field(StringInfo buf, const char *key, const char *value)
+{
+	const char *p;
+
+	if (value == NULL)
+		return;
+
+	if (buf->len > 1)
+		appendStringInfoChar(buf, ',');
+	appendStringInfo(buf, "\"%s\":\"", key);
+
+	for (p = value; *p; p++)
+	{
+		switch (*p)
+		{
+			case '\b':
+				appendStringInfoString(buf, "\\b");
+				break;
+			case '\f':
+				appendStringInfoString(buf, "\\f");
+				break;
+			case '\n':
+				appendStringInfoString(buf, "\\n");
+				break;
+			case '\r':
+				appendStringInfoString(buf, "\\r");
+				break;
+			case '\t':
+				appendStringInfoString(buf, "\\t");
+				break;
+			case '"':
+				appendStringInfoString(buf, "\\\"");
+				break;
+			case '\\':
+				appendStringInfoString(buf, "\\\\");
+				break;
+			default:
+				if ((unsigned char) *p < ' ')
+					appendStringInfo(buf, "\\u%04x", (int) *p);
+				else
+					appendStringInfoCharMacro(buf, *p);
+				break;
+		}
+	}
+	appendStringInfoChar(buf, '"');
+}
+
+/*
+ * Append a "key":value pair with an integer value to a JSON object.
+ */
+static void
+append_json_int_field(StringInfo buf, const char *key, int value)
+{
+	if (buf->len > 1)
+		appendStringInfoChar(buf, ',');
+	appendStringInfo(buf, "\"%s\":%d", key, value);
+}
+
+/*
+ * Write error report to the JSON log, one JSON object per line.  The fields
+ * are taken from the ErrorData directly instead of being formatted with
+ * log_line_prefix, so that log shippers need not parse the text.
+ */
+static void
+write_jsonlog(ErrorData *edata)
+{
+	StringInfoData buf;
+	POOL_SESSION_CONTEXT *session = pool_get_session_context(true);
+	POOL_CONNECTION *frontend = session ? session->frontend : NULL;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+
+	append_json_field(&buf, "timestamp", get_formatted_log_time(true));
+	append_json_int_field(&buf, "pid", myProcPid);
+	append_json_field(&buf, "process", process_name());
+	if (frontend)
+	{
+		append_json_field(&buf, "user", frontend->username);
+		append_json_field(&buf, "dbname", frontend->database);
+	}
+	append_json_field(&buf, "application_name", get_application_name());
+	append_json_field(&buf, "error_severity", error_severity(edata->elevel, false));
+	append_json_field(&buf, "message", edata->message ? edata->message : _("missing error text"));
+	append_json_field(&buf, "detail", edata->detail_log ? edata->detail_log : edata->detail);
+	append_json_field(&buf, "hint", edata->hint);
+	append_json_field(&buf, "internal_query", edata->internalquery);
+	append_json_field(&buf, "context", edata->context);
+	append_json_field(&buf, "func_name", edata->funcname);
+	if (edata->filename)
+	{
+		append_json_field(&buf, "file_name", edata->filename);
+		append_json_int_field(&buf, "file_line_num", edata->lineno);
+	}
+
+	appendStringInfoString(&buf, "}\n");
+
+	if (processType == PT_LOGGER)
+		write_syslogger_file(buf.data, buf.len, LOG_DESTINATION_JSONLOG);
+	else
+		write_pipe_chunks(buf.data, buf.len, LOG_DESTINATION_JSONLOG);
+
+	pfree(buf.data);
+}
+
 /*
  * Write error report to server's log
  */
@@ -2246,10 +2428,29 @@ static void
 send_message_to_server_log(ErrorData *edata)
 {
 	StringInfoData buf;
+	StringInfoData prefix;
+	bool		fallback_to_stderr = false;
+
+	/*
+	 * The JSON log is written by the logging collector.  Without it, write
+	 * the message to stderr in text format instead.
+	 */
+	if (pool_config->log_destination & LOG_DESTINATION_JSONLOG)
+	{
+		if (redirection_done || processType == PT_LOGGER)
+			write_jsonlog(edata);
+		else
+			fallback_to_stderr = true;
+	}
+
+	if (!(pool_config->log_destination & (LOG_DESTINATION_STDERR | LOG_DESTINATION_SYSLOG)) &&
+		!fallback_to_stderr)
+		return;
 
 	initStringInfo(&buf);
+	initStringInfo(&prefix);
 
-	log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+	append_log_line_prefix(&buf, &prefix, edata);
 	appendStringInfo(&buf, "%s:  ", error_severity(edata->elevel, false));
 
 
@@ -2271,35 +2472,35 @@ send_message_to_server_log(ErrorData *edata)
 	{
 		if (edata->detail_log)
 		{
-			log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+			append_log_line_prefix(&buf, &prefix, edata);
 			appendStringInfoString(&buf, _("DETAIL:  "));
 			append_with_tabs(&buf, edata->detail_log);
 			appendStringInfoChar(&buf, '\n');
 		}
 		else if (edata->detail)
 		{
-			log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+			append_log_line_prefix(&buf, &prefix, edata);
 			appendStringInfoString(&buf, _("DETAIL:  "));
 			append_with_tabs(&buf, edata->detail);
 			appendStringInfoChar(&buf, '\n');
 		}
 		if (edata->hint)
 		{
-			log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+			append_log_line_prefix(&buf, &prefix, edata);
 			appendStringInfoString(&buf, _("HINT:  "));
 			append_with_tabs(&buf, edata->hint);
 			appendStringInfoChar(&buf, '\n');
 		}
 		if (edata->internalquery)
 		{
-			log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+			append_log_line_prefix(&buf, &prefix, edata);
 			appendStringInfoString(&buf, _("QUERY:  "));
 			append_with_tabs(&buf, edata->internalquery);
 			appendStringInfoChar(&buf, '\n');
 		}
 		if (edata->context)
 		{
-			log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+			append_log_line_prefix(&buf, &prefix, edata);
 			appendStringInfoString(&buf, _("CONTEXT:  "));
 			append_with_tabs(&buf, edata->context);
 			appendStringInfoChar(&buf, '\n');
@@ -2309,14 +2510,14 @@ send_message_to_server_log(ErrorData *edata)
 			/* assume no newlines in funcname or filename... */
 			if (edata->funcname && edata->filename)
 			{
-				log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+				append_log_line_prefix(&buf, &prefix, edata);
 				appendStringInfo(&buf, _("LOCATION:  %s, %s:%d\n"),
 								 edata->funcname, edata->filename,
 								 edata->lineno);
 			}
 			else if (edata->filename)
 			{
-				log_line_prefix(&buf, pool_config->log_line_prefix, edata);
+				append_log_line_prefix(&buf, &prefix, edata);
 				appendStringInfo(&buf, _("LOCATION:  %s:%d\n"),
 								 edata->filename, edata->lineno);
 			}
@@ -2365,20 +2566,28 @@ send_message_to_server_log(ErrorData *edata)
 	}
 #endif							/* HAVE_SYSLOG */
 
-	if (pool_config->log_destination & LOG_DESTINATION_STDERR)
+	if ((pool_config->log_destination & LOG_DESTINATION_STDERR) || fallback_to_stderr)
 	{
 		/*
 		 * Use the chunking protocol if we know the syslogger should be
 		 * catching stderr output, and we are not ourselves the syslogger.
-		 * Otherwise, just do a vanilla write to stderr.
+		 * Child processes put the message in their log ring instead, if
+		 * they have one.  The syslogger writes its own messages to the log
+		 * file directly.  Otherwise, just do a vanilla write to stderr.
 		 */
 
 		if (redirection_done && processType != PT_LOGGER)
-			write_pipe_chunks(buf.data, buf.len, LOG_DESTINATION_STDERR);
+		{
+			if (!pool_log_ring_write(buf.data, buf.len))
+				write_pipe_chunks(buf.data, buf.len, LOG_DESTINATION_STDERR);
+		}
+		else if (processType == PT_LOGGER)
+			write_syslogger_file(buf.data, buf.len, LOG_DESTINATION_STDERR);
 		else
 			write_console(buf.data, buf.len);
 	}
 	pfree(buf.data);
+	pfree(prefix.data);
 }
 
 
@@ -2587,6 +2796,21 @@ process_name(void)
 		case PT_FOLLOWCHILD:
 			prefix = _("UTILITY");
 			break;
+		case PT_MEMQCACHE_INVALIDATOR:
+			prefix = _("MEMQCACHE INVALIDATOR");
+			break;
+		case PT_RELCACHE_REFRESHER:
+			prefix = _("RELCACHE REFRESHER");
+			break;
+		case PT_METRICS:
+			prefix = _("METRICS");
+			break;
+		case PT_MEMQCACHE_DECODER:
+			prefix = _("MEMQCACHE DECODER");
+			break;
+		case PT_NOTIFY_HUB:
+			prefix = _("NOTIFY HUB");
+			break;
 		default:
 			prefix = "";
 			break;
@@ -50,6 +50,10 @@
  */
 
 #include "utils/json.h"
+#ifndef POOL_PRIVATE
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#endif
 
 #ifdef _MSC_VER
 #ifndef _CRT_SECURE_NO_WARNINGS
@@ -1056,12 +1060,51 @@ e_failed:
 	return 0;
 }
 
+#ifndef POOL_PRIVATE
+/*
+ * pgpool extension:
+ * json_parse() builds the whole tree in a bump memory context of its own,
+ * so parsing needs no per-node bookkeeping and json_value_free() releases
+ * the tree by deleting that context instead of walking every node.
+ */
+#define JSON_ARENA_NAME		"JSON parse arena"
+
+static void *
+arena_alloc(size_t size, int zero, void *user_data)
+{
+	MemoryContext arena = (MemoryContext) user_data;
+
+	return zero ? MemoryContextAllocZero(arena, size) : MemoryContextAlloc(arena, size);
+}
+
+static void
+arena_free(void *ptr, void *user_data)
+{
+	/* released together with the arena */
+}
+#endif
+
 json_value *
 json_parse(const json_char * json, size_t length)
 {
 	json_settings settings = {0};
-
+#ifndef POOL_PRIVATE
+	MemoryContext arena;
+	json_value *root;
+
+	arena = BumpContextCreate(CurrentMemoryContext, JSON_ARENA_NAME,
+							  ALLOCSET_SMALL_INITSIZE, ALLOCSET_DEFAULT_INITSIZE);
+	settings.mem_alloc = arena_alloc;
+	settings.mem_free = arena_free;
+	settings.user_data = arena;
+
+	root = json_parse_ex(&settings, json, length, 0);
+	if (root == NULL)
+		MemoryContextDelete(arena);
+	return root;
+#else
 	return json_parse_ex(&settings, json, length, 0);
+#endif
 }
 
 void
@@ -1120,6 +1163,20 @@ json_value_free(json_value * value)
 {
 	json_settings settings = {0};
 
+#ifndef POOL_PRIVATE
+	/* tree built by json_parse() in an arena */
+	if (value)
+	{
+		MemoryContext cxt = GetMemoryChunkContext(value);
+
+		if (strcmp(cxt->name, JSON_ARENA_NAME) == 0)
+		{
+			MemoryContextDelete(cxt);
+			return;
+		}
+	}
+#endif
+
 	settings.mem_free = default_free;
 	json_value_free_ex(&settings, value);
 }
@@ -1129,18 +1186,37 @@ json_value_free(json_value * value)
 /*
  * pgpool extension:
  * search node with key from json object
+ *
+ * Callers such as get_pool_config_from_json() look up the keys of an object
+ * in the order they were written, so the search starts right after the key
+ * found last time in the same object and wraps around.  This makes reading
+ * a whole object linear instead of quadratic in the number of keys.
  */
 json_value *
 json_get_value_for_key(json_value * source, const char *key)
 {
+	static json_value *last_object = NULL;
+	static unsigned int last_index = 0;
+
 	if (source->type == json_object)
 	{
-		int			x;
+		unsigned int length = source->u.object.length;
+		unsigned int start = 0;
+		unsigned int n;
 
-		for (x = 0; x < source->u.object.length; x++)
+		if (source == last_object && last_index < length)
+			start = last_index;
+
+		for (n = 0; n < length; n++)
 		{
+			unsigned int x = (start + n) % length;
+
 			if (strcasecmp(source->u.object.values[x].name, key) == 0)
+			{
+				last_object = source;
+				last_index = x + 1;
 				return source->u.object.values[x].value;
+			}
 		}
 	}
 	else
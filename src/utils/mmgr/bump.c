@@ -0,0 +1,589 @@
+/*-------------------------------------------------------------------------
+ *
+ * bump.c
+ *	  Bump allocator definitions.
+ *
+ * Bump is a MemoryContext implementation for short-lived contexts whose
+ * memory is released all at once, such as the memory holding the parse
+ * tree and the rewritten query of a single simple query.  Allocation just
+ * advances a pointer in the current block, and there are no freelists.
+ * Memory is given back only when the context is reset or deleted, apart
+ * from two cheap special cases in BumpFree: the most recently allocated
+ * chunk gives its space back to the block, and chunks too large for the
+ * blocks, which get a dedicated malloc()'d block as in aset.c, are
+ * returned to malloc() right away.
+ *
+ * Since pfree() of other chunks does not reclaim anything, a bump context
+ * must not be used for memory which is allocated and freed repeatedly
+ * during a long lifetime.
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "pool_type.h"
+#include "utils/palloc.h"
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include <string.h>
+#include <stdint.h>
+
+#define BUMP_BLOCKHDRSZ	MAXALIGN(sizeof(BumpBlockData))
+#define BUMP_CHUNKHDRSZ	sizeof(struct BumpChunkData)
+
+/* We allow chunks to be at most 1/4 of maxBlockSize */
+#define BUMP_CHUNK_FRACTION	4
+
+typedef struct BumpBlockData *BumpBlock;	/* forward reference */
+typedef struct BumpChunkData *BumpChunk;
+
+/*
+ * BumpContext
+ *
+ * blocks is the list of blocks; its head is the block new chunks are
+ * carved from.  Dedicated blocks of large chunks are linked behind it.
+ */
+typedef struct BumpContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	BumpBlock	blocks;			/* head of list of blocks in this context */
+	/* Allocation parameters for this context: */
+	Size		initBlockSize;	/* initial block size */
+	Size		maxBlockSize;	/* maximum block size */
+	Size		nextBlockSize;	/* next block size to allocate */
+	Size		allocChunkLimit;	/* larger chunks get their own block */
+	BumpBlock	keeper;			/* if not NULL, keep this block over resets */
+} BumpContext;
+
+typedef BumpContext *Bump;
+
+/*
+ * BumpBlock
+ *		A block obtained from malloc().  Chunks are allocated from freeptr
+ *		upwards until endptr is reached.
+ */
+typedef struct BumpBlockData
+{
+	Bump		bump;			/* context that owns this block */
+	BumpBlock	prev;			/* prev block in list, if any */
+	BumpBlock	next;			/* next block in list, if any */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+}			BumpBlockData;
+
+/*
+ * BumpChunk
+ *		The prefix of each piece of memory in a BumpBlock
+ */
+typedef struct BumpChunkData
+{
+	/* size is always the size of the usable space in the chunk */
+	Size		size;
+	/* owning context, must be right before the chunk data */
+	void	   *bump;
+}			BumpChunkData;
+
+#define BumpPointerGetChunk(ptr)	\
+					((BumpChunk)(((char *)(ptr)) - BUMP_CHUNKHDRSZ))
+#define BumpChunkGetPointer(chk)	\
+					((void *)(((char *)(chk)) + BUMP_CHUNKHDRSZ))
+
+/*
+ * These functions implement the MemoryContext API for Bump contexts.
+ */
+static void *BumpAlloc(MemoryContext context, Size size);
+static void BumpFree(MemoryContext context, void *pointer);
+static void *BumpRealloc(MemoryContext context, void *pointer, Size size);
+static void BumpInit(MemoryContext context);
+static void BumpReset(MemoryContext context);
+static void BumpDelete(MemoryContext context);
+static Size BumpGetChunkSpace(MemoryContext context, void *pointer);
+static bool BumpIsEmpty(MemoryContext context);
+static void BumpStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void BumpCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Bump contexts.
+ */
+static MemoryContextMethods BumpMethods = {
+	BumpAlloc,
+	BumpFree,
+	BumpRealloc,
+	BumpInit,
+	BumpReset,
+	BumpDelete,
+	BumpGetChunkSpace,
+	BumpIsEmpty,
+	BumpStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,BumpCheck
+#endif
+};
+
+/*
+ * BumpContextCreate
+ *		Create a new Bump context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging only, need not be unique)
+ * initBlockSize: initial allocation block size
+ * maxBlockSize: maximum allocation block size
+ *
+ * The first block is kept over resets, so that a context which is reset
+ * after every query does not go back to malloc() each time.
+ */
+MemoryContext
+BumpContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size initBlockSize,
+				  Size maxBlockSize)
+{
+	Bump		set;
+
+	StaticAssertStmt(offsetof(BumpChunkData, bump) + sizeof(MemoryContext) ==
+					 MAXALIGN(sizeof(BumpChunkData)),
+					 "padding calculation in BumpChunkData is wrong");
+
+	if (initBlockSize != MAXALIGN(initBlockSize) ||
+		initBlockSize < 1024)
+		elog(ERROR, "invalid initBlockSize for memory context: %zu",
+			 initBlockSize);
+	if (maxBlockSize != MAXALIGN(maxBlockSize) ||
+		maxBlockSize < initBlockSize ||
+		!AllocHugeSizeIsValid(maxBlockSize))	/* must be safe to double */
+		elog(ERROR, "invalid maxBlockSize for memory context: %zu",
+			 maxBlockSize);
+
+	/* Do the type-independent part of context creation */
+	set = (Bump) MemoryContextCreate(T_BumpContext,
+									 sizeof(BumpContext),
+									 &BumpMethods,
+									 parent,
+									 name);
+
+	set->initBlockSize = initBlockSize;
+	set->maxBlockSize = maxBlockSize;
+	set->nextBlockSize = initBlockSize;
+	set->allocChunkLimit = ((maxBlockSize - BUMP_BLOCKHDRSZ) / BUMP_CHUNK_FRACTION -
+							BUMP_CHUNKHDRSZ) & ~((Size) (MAXIMUM_ALIGNOF - 1));
+
+	return (MemoryContext) set;
+}
+
+/*
+ * BumpInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+BumpInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * BumpReset
+ *		Frees all memory which is allocated in the given context.  All
+ *		blocks but the keeper are released; the keeper is just rewound.
+ */
+static void
+BumpReset(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block = set->blocks;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	BumpCheck(context);
+#endif
+
+	set->blocks = set->keeper;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		if (block == set->keeper)
+		{
+			char	   *datastart = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(datastart, block->freeptr - datastart);
+#else
+			VALGRIND_MAKE_MEM_NOACCESS(datastart, block->freeptr - datastart);
+#endif
+			block->freeptr = datastart;
+			block->prev = NULL;
+			block->next = NULL;
+		}
+		else
+		{
+			set->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+			free(block);
+		}
+		block = next;
+	}
+
+	set->nextBlockSize = set->initBlockSize;
+}
+
+/*
+ * BumpDelete
+ *		Frees all memory which is allocated in the given context, in
+ *		preparation for deletion of the context.
+ */
+static void
+BumpDelete(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block = set->blocks;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	BumpCheck(context);
+#endif
+
+	set->blocks = NULL;
+	set->keeper = NULL;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		set->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+/*
+ * BumpAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed.
+ */
+static void *
+BumpAlloc(MemoryContext context, Size size)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block;
+	BumpChunk	chunk;
+	Size		chunk_size = MAXALIGN(size);
+	Size		blksize;
+
+	/*
+	 * If requested size exceeds maximum for chunks, allocate an entire block
+	 * for this request and link it behind the active block.
+	 */
+	if (chunk_size > set->allocChunkLimit)
+	{
+		blksize = chunk_size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ;
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		set->header.mem_allocated += blksize;
+		block->bump = set;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+
+		if (set->blocks != NULL)
+		{
+			block->prev = set->blocks;
+			block->next = set->blocks->next;
+			if (block->next)
+				block->next->prev = block;
+			set->blocks->next = block;
+		}
+		else
+		{
+			block->prev = NULL;
+			block->next = NULL;
+			set->blocks = block;
+		}
+
+		chunk = (BumpChunk) (((char *) block) + BUMP_BLOCKHDRSZ);
+		chunk->bump = set;
+		chunk->size = chunk_size;
+
+		return BumpChunkGetPointer(chunk);
+	}
+
+	block = set->blocks;
+	if (block == NULL ||
+		(Size) (block->endptr - block->freeptr) < chunk_size + BUMP_CHUNKHDRSZ)
+	{
+		/*
+		 * Start a new block.  Whatever is left in the active one is simply
+		 * abandoned until the next reset.
+		 */
+		Size		required_size = chunk_size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ;
+
+		blksize = set->nextBlockSize;
+		set->nextBlockSize <<= 1;
+		if (set->nextBlockSize > set->maxBlockSize)
+			set->nextBlockSize = set->maxBlockSize;
+
+		/* initBlockSize may be smaller than the chunk limit */
+		while (blksize < required_size)
+			blksize <<= 1;
+
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		set->header.mem_allocated += blksize;
+		block->bump = set;
+		block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+		block->endptr = ((char *) block) + blksize;
+
+		block->prev = NULL;
+		block->next = set->blocks;
+		if (block->next)
+			block->next->prev = block;
+		set->blocks = block;
+
+		/* the first block is kept over resets */
+		if (set->keeper == NULL)
+			set->keeper = block;
+	}
+
+	chunk = (BumpChunk) block->freeptr;
+	block->freeptr += chunk_size + BUMP_CHUNKHDRSZ;
+	Assert(block->freeptr <= block->endptr);
+
+	chunk->bump = set;
+	chunk->size = chunk_size;
+
+	return BumpChunkGetPointer(chunk);
+}
+
+/*
+ * BumpFree
+ *		Frees allocated memory.  Only large chunks and the last chunk of the
+ *		active block are actually given back; other chunks stay allocated
+ *		until the context is reset.
+ */
+static void
+BumpFree(MemoryContext context, void *pointer)
+{
+	Bump		set = (Bump) context;
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+	BumpBlock	block;
+
+	if (chunk->size > set->allocChunkLimit)
+	{
+		block = (BumpBlock) (((char *) chunk) - BUMP_BLOCKHDRSZ);
+
+		if (block->bump != set ||
+			block->freeptr != block->endptr ||
+			block->freeptr != ((char *) block) +
+			(chunk->size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ))
+			elog(ERROR, "could not find block containing chunk %p", chunk);
+
+		if (block->prev)
+			block->prev->next = block->next;
+		else
+			set->blocks = block->next;
+		if (block->next)
+			block->next->prev = block->prev;
+		set->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		return;
+	}
+
+	block = set->blocks;
+	if (block != NULL &&
+		(char *) pointer + chunk->size == block->freeptr)
+		block->freeptr = (char *) chunk;
+#ifdef CLOBBER_FREED_MEMORY
+	else
+		wipe_mem(pointer, chunk->size);
+#endif
+}
+
+/*
+ * BumpRealloc
+ *		Returns new pointer to allocated memory of given size or NULL if
+ *		request could not be completed.  Memory associated with given
+ *		pointer is copied into the new memory, and the old memory is freed.
+ */
+static void *
+BumpRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Bump		set = (Bump) context;
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+	Size		oldsize = chunk->size;
+	Size		chunk_size = MAXALIGN(size);
+	BumpBlock	block;
+	void	   *newpointer;
+
+	/* Shrinking, or growing within the alignment padding, is free */
+	if (chunk_size <= oldsize)
+		return pointer;
+
+	if (oldsize > set->allocChunkLimit)
+	{
+		/*
+		 * The chunk has its own block.  Just realloc() the block, as aset.c
+		 * does.
+		 */
+		BumpBlock	newblock;
+		Size		blksize = chunk_size + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ;
+
+		block = (BumpBlock) (((char *) chunk) - BUMP_BLOCKHDRSZ);
+		if (block->bump != set ||
+			block->freeptr != block->endptr ||
+			block->freeptr != ((char *) block) +
+			(oldsize + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ))
+			elog(ERROR, "could not find block containing chunk %p", chunk);
+
+		newblock = (BumpBlock) realloc(block, blksize);
+		if (newblock == NULL)
+			return NULL;
+		set->header.mem_allocated += blksize - (oldsize + BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ);
+		newblock->freeptr = newblock->endptr = ((char *) newblock) + blksize;
+
+		if (newblock->prev)
+			newblock->prev->next = newblock;
+		else
+			set->blocks = newblock;
+		if (newblock->next)
+			newblock->next->prev = newblock;
+
+		chunk = (BumpChunk) (((char *) newblock) + BUMP_BLOCKHDRSZ);
+		chunk->size = chunk_size;
+		return BumpChunkGetPointer(chunk);
+	}
+
+	/*
+	 * The last chunk of the active block can grow in place if there is room
+	 * left.  This is the common case of a StringInfo being appended to.
+	 */
+	block = set->blocks;
+	if (chunk_size <= set->allocChunkLimit &&
+		block != NULL &&
+		(char *) pointer + oldsize == block->freeptr &&
+		(Size) (block->endptr - (char *) pointer) >= chunk_size)
+	{
+		block->freeptr = (char *) pointer + chunk_size;
+		chunk->size = chunk_size;
+		return pointer;
+	}
+
+	newpointer = BumpAlloc(context, size);
+	if (newpointer == NULL)
+		return NULL;
+	memcpy(newpointer, pointer, oldsize);
+	BumpFree(context, pointer);
+
+	return newpointer;
+}
+
+/*
+ * BumpGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+BumpGetChunkSpace(MemoryContext context, void *pointer)
+{
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+
+	return chunk->size + BUMP_CHUNKHDRSZ;
+}
+
+/*
+ * BumpIsEmpty
+ *		Is a bump context empty of any allocated space?
+ */
+static bool
+BumpIsEmpty(MemoryContext context)
+{
+	if (context->isReset)
+		return true;
+	return false;
+}
+
+/*
+ * BumpStats
+ *		Compute stats about memory consumption of a bump context.
+ */
+static void
+BumpStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals)
+{
+	Bump		set = (Bump) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	BumpBlock	block;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+
+	if (print)
+	{
+		int			i;
+
+		for (i = 0; i < level; i++)
+			fprintf(stderr, "  ");
+		fprintf(stderr,
+				"%s: %zu total in %zd blocks; %zu free; %zu used\n",
+				set->header.name, totalspace, nblocks, freespace,
+				totalspace - freespace);
+	}
+
+	if (totals)
+	{
+		totals->nblocks += nblocks;
+		totals->totalspace += totalspace;
+		totals->freespace += freespace;
+	}
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * BumpCheck
+ *		Walk through blocks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.
+ */
+static void
+BumpCheck(MemoryContext context)
+{
+	Bump		set = (Bump) context;
+	BumpBlock	block;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		char	   *datastart = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+		if (block->bump != set)
+			elog(WARNING, "problem in bump context %s: bogus block link in block %p",
+				 set->header.name, block);
+		if (block->freeptr < datastart || block->freeptr > block->endptr)
+			elog(WARNING, "problem in bump context %s: bogus free pointer in block %p",
+				 set->header.name, block);
+	}
+}
+
+#endif							/* MEMORY_CONTEXT_CHECKING */
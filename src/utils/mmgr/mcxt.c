@@ -428,6 +428,35 @@ MemoryContextIsEmpty(MemoryContext context)
 	return (*context->methods->is_empty) (context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Return the amount of memory allocated to the context, and to its
+ *		descendants if recurse is true.
+ *
+ * Each context type keeps mem_allocated up to date whenever it obtains a
+ * block from malloc() or gives one back, so this costs a walk over the
+ * contexts only, not over their blocks.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total = context->mem_allocated;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
@@ -0,0 +1,519 @@
+/*-------------------------------------------------------------------------
+ *
+ * slab.c
+ *	  Slab allocator definitions.
+ *
+ * Slab is a MemoryContext implementation for objects of one fixed size
+ * which are allocated and freed one by one over a long lifetime, such as
+ * the sent and pending messages of a session.  Unlike aset.c, which rounds
+ * requests up to a power of two and keeps freed chunks on per size
+ * freelists shared by all sizes, every chunk of a slab context has the
+ * same size, so both allocation and pfree() are a few pointer operations
+ * and freed chunks are always reused exactly.
+ *
+ * Memory is obtained from malloc() in blocks of blockSize bytes, each
+ * holding chunksPerBlock chunks.  Every block has its own freelist; chunks
+ * which have never been used are carved from the end of the block lazily.
+ * A block is on one of two lists: the partial list if it has free chunks,
+ * or the full list otherwise.  Chunks are allocated from the head of the
+ * partial list.  A block whose chunks are all freed is given back to
+ * malloc(), except that one such block is kept to avoid malloc()/free()
+ * cycles when a single object is allocated and freed repeatedly.
+ *
+ * Requests larger than the chunk size are rejected, so palloc() callers
+ * must only allocate objects of the type the context was created for.
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "pool_type.h"
+#include "utils/palloc.h"
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include <string.h>
+#include <stdint.h>
+
+#define SLAB_BLOCKHDRSZ	MAXALIGN(sizeof(SlabBlockData))
+#define SLAB_CHUNKHDRSZ	sizeof(struct SlabChunkData)
+
+typedef struct SlabBlockData *SlabBlock;	/* forward reference */
+typedef struct SlabChunkData *SlabChunk;
+
+/*
+ * SlabContext
+ */
+typedef struct SlabContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Allocation parameters for this context: */
+	Size		chunkSize;		/* usable space of a chunk */
+	Size		fullChunkSize;	/* chunk size including header */
+	Size		blockSize;		/* block size */
+	int			chunksPerBlock; /* number of chunks per block */
+	/* Info about storage allocated in this context: */
+	SlabBlock	partial;		/* blocks having free chunks */
+	SlabBlock	full;			/* blocks having no free chunk */
+	SlabBlock	emptyBlock;		/* a completely free block kept for reuse,
+								 * or NULL */
+} SlabContext;
+
+typedef SlabContext *Slab;
+
+/*
+ * SlabBlock
+ *		A block obtained from malloc(), followed by chunksPerBlock chunks.
+ */
+typedef struct SlabBlockData
+{
+	Slab		slab;			/* context that owns this block */
+	SlabBlock	prev;			/* prev block in list, if any */
+	SlabBlock	next;			/* next block in list, if any */
+	int			nfree;			/* number of free chunks */
+	int			nunused;		/* number of never used chunks at the end */
+	SlabChunk	freelist;		/* freed chunks of this block */
+}			SlabBlockData;
+
+/*
+ * SlabChunk
+ *		The prefix of each piece of memory in a SlabBlock.  While a chunk is
+ *		free, its data area holds the pointer to the next free chunk.
+ */
+typedef struct SlabChunkData
+{
+	/* block the chunk belongs to */
+	SlabBlock	block;
+	/* owning context, must be right before the chunk data */
+	void	   *slab;
+}			SlabChunkData;
+
+#define SlabPointerGetChunk(ptr)	\
+					((SlabChunk)(((char *)(ptr)) - SLAB_CHUNKHDRSZ))
+#define SlabChunkGetPointer(chk)	\
+					((void *)(((char *)(chk)) + SLAB_CHUNKHDRSZ))
+#define SlabChunkNextFree(chk)	\
+					(*(SlabChunk *) SlabChunkGetPointer(chk))
+
+/*
+ * These functions implement the MemoryContext API for Slab contexts.
+ */
+static void *SlabAlloc(MemoryContext context, Size size);
+static void SlabFree(MemoryContext context, void *pointer);
+static void *SlabRealloc(MemoryContext context, void *pointer, Size size);
+static void SlabInit(MemoryContext context);
+static void SlabReset(MemoryContext context);
+static void SlabDelete(MemoryContext context);
+static Size SlabGetChunkSpace(MemoryContext context, void *pointer);
+static bool SlabIsEmpty(MemoryContext context);
+static void SlabStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void SlabCheck(MemoryContext context);
+#endif
+
+static void slab_list_push(SlabBlock *head, SlabBlock block);
+static void slab_list_remove(SlabBlock *head, SlabBlock block);
+static void slab_free_blocks(SlabBlock block);
+
+/*
+ * This is the virtual function table for Slab contexts.
+ */
+static MemoryContextMethods SlabMethods = {
+	SlabAlloc,
+	SlabFree,
+	SlabRealloc,
+	SlabInit,
+	SlabReset,
+	SlabDelete,
+	SlabGetChunkSpace,
+	SlabIsEmpty,
+	SlabStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,SlabCheck
+#endif
+};
+
+/*
+ * SlabContextCreate
+ *		Create a new Slab context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging only, need not be unique)
+ * blockSize: allocation block size
+ * chunkSize: size of the objects allocated in the context
+ *
+ * blockSize must be large enough to hold at least one chunk.
+ */
+MemoryContext
+SlabContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size blockSize,
+				  Size chunkSize)
+{
+	Slab		set;
+	Size		fullChunkSize;
+
+	StaticAssertStmt(offsetof(SlabChunkData, slab) + sizeof(MemoryContext) ==
+					 MAXALIGN(sizeof(SlabChunkData)),
+					 "padding calculation in SlabChunkData is wrong");
+
+	/* a free chunk holds the link to the next free chunk */
+	if (chunkSize < sizeof(SlabChunk))
+		chunkSize = sizeof(SlabChunk);
+	chunkSize = MAXALIGN(chunkSize);
+	fullChunkSize = SLAB_CHUNKHDRSZ + chunkSize;
+
+	if (blockSize < SLAB_BLOCKHDRSZ + fullChunkSize ||
+		!AllocSizeIsValid(blockSize))
+		elog(ERROR, "block size %zu for slab is too small for %zu chunks",
+			 blockSize, chunkSize);
+
+	/* Do the type-independent part of context creation */
+	set = (Slab) MemoryContextCreate(T_SlabContext,
+									 sizeof(SlabContext),
+									 &SlabMethods,
+									 parent,
+									 name);
+
+	set->chunkSize = chunkSize;
+	set->fullChunkSize = fullChunkSize;
+	set->blockSize = blockSize;
+	set->chunksPerBlock = (blockSize - SLAB_BLOCKHDRSZ) / fullChunkSize;
+
+	return (MemoryContext) set;
+}
+
+/*
+ * SlabInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+SlabInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * SlabReset
+ *		Frees all memory which is allocated in the given context.
+ */
+static void
+SlabReset(MemoryContext context)
+{
+	Slab		set = (Slab) context;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	SlabCheck(context);
+#endif
+
+	slab_free_blocks(set->partial);
+	slab_free_blocks(set->full);
+	slab_free_blocks(set->emptyBlock);
+
+	set->partial = NULL;
+	set->full = NULL;
+	set->emptyBlock = NULL;
+}
+
+/*
+ * SlabDelete
+ *		Frees all memory which is allocated in the given context, in
+ *		preparation for deletion of the context.
+ */
+static void
+SlabDelete(MemoryContext context)
+{
+	SlabReset(context);
+}
+
+/*
+ * SlabAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed.
+ */
+static void *
+SlabAlloc(MemoryContext context, Size size)
+{
+	Slab		set = (Slab) context;
+	SlabBlock	block;
+	SlabChunk	chunk;
+
+	if (size > set->chunkSize)
+		elog(ERROR, "unexpected allocation size %zu in slab context \"%s\" of %zu byte chunks",
+			 size, set->header.name, set->chunkSize);
+
+	block = set->partial;
+	if (block == NULL)
+	{
+		if (set->emptyBlock != NULL)
+		{
+			block = set->emptyBlock;
+			set->emptyBlock = NULL;
+		}
+		else
+		{
+			block = (SlabBlock) malloc(set->blockSize);
+			if (block == NULL)
+				return NULL;
+			set->header.mem_allocated += set->blockSize;
+			block->slab = set;
+			block->nfree = set->chunksPerBlock;
+			block->nunused = set->chunksPerBlock;
+			block->freelist = NULL;
+		}
+		slab_list_push(&set->partial, block);
+	}
+
+	if (block->freelist != NULL)
+	{
+		chunk = block->freelist;
+		VALGRIND_MAKE_MEM_DEFINED(SlabChunkGetPointer(chunk), sizeof(SlabChunk));
+		block->freelist = SlabChunkNextFree(chunk);
+	}
+	else
+	{
+		Assert(block->nunused > 0);
+		chunk = (SlabChunk) (((char *) block) + SLAB_BLOCKHDRSZ +
+							 (set->chunksPerBlock - block->nunused) * set->fullChunkSize);
+		block->nunused--;
+	}
+
+	block->nfree--;
+	if (block->nfree == 0)
+	{
+		slab_list_remove(&set->partial, block);
+		slab_list_push(&set->full, block);
+	}
+
+	chunk->block = block;
+	chunk->slab = set;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(SlabChunkGetPointer(chunk), size);
+
+	return SlabChunkGetPointer(chunk);
+}
+
+/*
+ * SlabFree
+ *		Frees allocated memory; the chunk goes to the freelist of its block.
+ */
+static void
+SlabFree(MemoryContext context, void *pointer)
+{
+	Slab		set = (Slab) context;
+	SlabChunk	chunk = SlabPointerGetChunk(pointer);
+	SlabBlock	block = chunk->block;
+
+	if (block == NULL || block->slab != set)
+		elog(ERROR, "could not find block containing chunk %p", chunk);
+
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, set->chunkSize);
+#endif
+
+	SlabChunkNextFree(chunk) = block->freelist;
+	block->freelist = chunk;
+	chunk->block = NULL;
+	block->nfree++;
+
+	if (block->nfree == 1)
+	{
+		/* the block was full */
+		slab_list_remove(&set->full, block);
+		slab_list_push(&set->partial, block);
+	}
+
+	if (block->nfree == set->chunksPerBlock)
+	{
+		/* the block is completely free; keep one, release the others */
+		slab_list_remove(&set->partial, block);
+		if (set->emptyBlock == NULL)
+			set->emptyBlock = block;
+		else
+		{
+			set->header.mem_allocated -= set->blockSize;
+			free(block);
+		}
+	}
+}
+
+/*
+ * SlabRealloc
+ *		Chunks cannot grow, so this only succeeds if the chunk is already
+ *		large enough.
+ */
+static void *
+SlabRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Slab		set = (Slab) context;
+
+	if (size <= set->chunkSize)
+		return pointer;
+
+	elog(ERROR, "slab context \"%s\" of %zu byte chunks cannot reallocate to %zu bytes",
+		 set->header.name, set->chunkSize, size);
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * SlabGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+SlabGetChunkSpace(MemoryContext context, void *pointer)
+{
+	Slab		set = (Slab) context;
+
+	return set->fullChunkSize;
+}
+
+/*
+ * SlabIsEmpty
+ *		Is a slab context empty of any allocated space?
+ */
+static bool
+SlabIsEmpty(MemoryContext context)
+{
+	Slab		set = (Slab) context;
+
+	return set->partial == NULL && set->full == NULL;
+}
+
+/*
+ * SlabStats
+ *		Compute stats about memory consumption of a slab context.
+ */
+static void
+SlabStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals)
+{
+	Slab		set = (Slab) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	SlabBlock	block;
+
+	for (block = set->partial; block != NULL; block = block->next)
+	{
+		nblocks++;
+		freespace += block->nfree * set->fullChunkSize;
+	}
+	for (block = set->full; block != NULL; block = block->next)
+		nblocks++;
+	if (set->emptyBlock != NULL)
+	{
+		nblocks++;
+		freespace += set->chunksPerBlock * set->fullChunkSize;
+	}
+	totalspace = nblocks * set->blockSize;
+
+	if (print)
+	{
+		int			i;
+
+		for (i = 0; i < level; i++)
+			fprintf(stderr, "  ");
+		fprintf(stderr,
+				"%s: %zu total in %zu blocks; %zu free; %zu used\n",
+				set->header.name, totalspace, nblocks, freespace,
+				totalspace - freespace);
+	}
+
+	if (totals)
+	{
+		totals->nblocks += nblocks;
+		totals->totalspace += totalspace;
+		totals->freespace += freespace;
+	}
+}
+
+/*
+ * Push a block to the head of a block list.
+ */
+static void
+slab_list_push(SlabBlock *head, SlabBlock block)
+{
+	block->prev = NULL;
+	block->next = *head;
+	if (block->next)
+		block->next->prev = block;
+	*head = block;
+}
+
+/*
+ * Remove a block from a block list.
+ */
+static void
+slab_list_remove(SlabBlock *head, SlabBlock block)
+{
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		*head = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	block->prev = block->next = NULL;
+}
+
+/*
+ * Release a list of blocks to malloc().
+ */
+static void
+slab_free_blocks(SlabBlock block)
+{
+	while (block != NULL)
+	{
+		SlabBlock	next = block->next;
+
+		block->slab->header.mem_allocated -= block->slab->blockSize;
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->slab->blockSize);
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * SlabCheck
+ *		Walk through blocks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.
+ */
+static void
+SlabCheck(MemoryContext context)
+{
+	Slab		set = (Slab) context;
+	SlabBlock	block;
+
+	for (block = set->partial; block != NULL; block = block->next)
+	{
+		if (block->slab != set)
+			elog(WARNING, "problem in slab context %s: bogus block link in block %p",
+				 set->header.name, block);
+		if (block->nfree <= 0 || block->nfree >= set->chunksPerBlock)
+			elog(WARNING, "problem in slab context %s: partial block %p has %d free chunks",
+				 set->header.name, block, block->nfree);
+	}
+	for (block = set->full; block != NULL; block = block->next)
+	{
+		if (block->slab != set)
+			elog(WARNING, "problem in slab context %s: bogus block link in block %p",
+				 set->header.name, block);
+		if (block->nfree != 0)
+			elog(WARNING, "problem in slab context %s: full block %p has %d free chunks",
+				 set->header.name, block, block->nfree);
+	}
+}
+
+#endif							/* MEMORY_CONTEXT_CHECKING */
@@ -0,0 +1,222 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_dns_cache.c: host names of client addresses shared among child
+ * processes.
+ *
+ * Host name based pool_hba.conf lines and log_hostname make a child look
+ * up the host name of each client address, and verify it by looking up the
+ * addresses of the host name.  These blocking lookups are remembered in
+ * shared memory for dns_cache_ttl seconds, or dns_cache_negative_ttl
+ * seconds if they failed, so that a storm of connections from the same
+ * hosts does not wait for DNS each time.
+ *
+ * The cache is a set associative table of dns_cache_size entries.  An
+ * address can only be stored in the DNS_CACHE_WAYS entries of its set, and
+ * replaces the one expiring first.  The table is protected by DNS_CACHE_SEM.
+ */
+#include "config.h"
+
+#include <netdb.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/elog.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_ipc.h"
+#include "utils/xxhash.h"
+#include "utils/pool_dns_cache.h"
+
+/* number of entries an address can be stored in */
+#define DNS_CACHE_WAYS	4
+
+typedef struct
+{
+	time_t		expire;			/* expiration absolute time, 0 if unused */
+	int			family;			/* AF_INET or AF_INET6 */
+	unsigned char addr[16];		/* IPv4 or IPv6 address */
+	int			resolv;			/* see pool_dns_cache_lookup() */
+	char		hostname[NI_MAXHOST];	/* "" if the lookup failed */
+}			DnsCacheEntry;
+
+static DnsCacheEntry *dns_cache;
+static int	dns_cache_num_sets;
+
+static bool dns_cache_key(SockAddr *raddr, int *family, unsigned char *addr);
+static DnsCacheEntry *dns_cache_set(int family, unsigned char *addr);
+
+/*
+ * Size of shared memory needed by the DNS cache.
+ */
+size_t
+pool_dns_cache_shmem_size(void)
+{
+	int			num_sets = (pool_config->dns_cache_size + DNS_CACHE_WAYS - 1) / DNS_CACHE_WAYS;
+
+	return MAXALIGN(sizeof(DnsCacheEntry) * num_sets * DNS_CACHE_WAYS);
+}
+
+/*
+ * Allocate and initialize the DNS cache.  This should be called only once
+ * from pgpool main process at the process starting up time.
+ */
+void
+pool_init_dns_cache(void)
+{
+	dns_cache = pool_shared_memory_segment_get_chunk(pool_dns_cache_shmem_size());
+	dns_cache_num_sets = (pool_config->dns_cache_size + DNS_CACHE_WAYS - 1) / DNS_CACHE_WAYS;
+	memset(dns_cache, 0, pool_dns_cache_shmem_size());
+}
+
+/*
+ * Look up the client address in the cache.  If found, copy the host name
+ * into hostname, which is "" if the host name lookup failed, and return
+ * true.  *resolv is set to what the caller stored with it: 0 if only the
+ * host name has been looked up, +1 or -1 if the addresses of the host name
+ * did or did not include the client address, and -2 if a lookup failed.
+ */
+bool
+pool_dns_cache_lookup(SockAddr *raddr, char *hostname, int size, int *resolv)
+{
+	pool_sigset_t oldmask;
+	DnsCacheEntry *set;
+	unsigned char addr[16];
+	int			family;
+	time_t		now;
+	bool		found = false;
+	int			i;
+
+	if (dns_cache == NULL || !dns_cache_key(raddr, &family, addr))
+		return false;
+
+	now = time(NULL);
+	set = dns_cache_set(family, addr);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(DNS_CACHE_SEM);
+
+	for (i = 0; i < DNS_CACHE_WAYS; i++)
+	{
+		if (set[i].expire > now && set[i].family == family &&
+			memcmp(set[i].addr, addr, sizeof(addr)) == 0)
+		{
+			strlcpy(hostname, set[i].hostname, size);
+			*resolv = set[i].resolv;
+			found = true;
+			break;
+		}
+	}
+
+	pool_semaphore_unlock(DNS_CACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	ereport(DEBUG2,
+			(errmsg("DNS cache %s for client address", found ? "hit" : "miss")));
+
+	return found;
+}
+
+/*
+ * Remember the result of the lookups for the client address.  hostname is
+ * "" or NULL if the host name lookup failed.  Failed lookups (resolv < 0)
+ * are kept for dns_cache_negative_ttl seconds, others for dns_cache_ttl
+ * seconds.
+ */
+void
+pool_dns_cache_store(SockAddr *raddr, const char *hostname, int resolv)
+{
+	pool_sigset_t oldmask;
+	DnsCacheEntry *set;
+	DnsCacheEntry *victim;
+	unsigned char addr[16];
+	int			family;
+	int			ttl;
+	time_t		now;
+	int			i;
+
+	if (dns_cache == NULL || !dns_cache_key(raddr, &family, addr))
+		return;
+
+	ttl = resolv < 0 ? pool_config->dns_cache_negative_ttl : pool_config->dns_cache_ttl;
+	if (ttl <= 0)
+		return;
+
+	now = time(NULL);
+	set = dns_cache_set(family, addr);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(DNS_CACHE_SEM);
+
+	/* the entry of the address, or else the one expiring first */
+	victim = &set[0];
+	for (i = 0; i < DNS_CACHE_WAYS; i++)
+	{
+		if (set[i].expire > 0 && set[i].family == family &&
+			memcmp(set[i].addr, addr, sizeof(addr)) == 0)
+		{
+			victim = &set[i];
+			break;
+		}
+		if (set[i].expire < victim->expire)
+			victim = &set[i];
+	}
+
+	victim->expire = now + ttl;
+	victim->family = family;
+	memcpy(victim->addr, addr, sizeof(addr));
+	victim->resolv = resolv;
+	strlcpy(victim->hostname, hostname ? hostname : "", sizeof(victim->hostname));
+
+	pool_semaphore_unlock(DNS_CACHE_SEM);
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Extract the family and the address of an IPv4 or IPv6 client address.
+ * Returns false for other addresses, which are not cached.
+ */
+static bool
+dns_cache_key(SockAddr *raddr, int *family, unsigned char *addr)
+{
+	memset(addr, 0, 16);
+	*family = raddr->addr.ss_family;
+
+	if (*family == AF_INET)
+		memcpy(addr, &((struct sockaddr_in *) &raddr->addr)->sin_addr, 4);
+	else if (*family == AF_INET6)
+		memcpy(addr, &((struct sockaddr_in6 *) &raddr->addr)->sin6_addr, 16);
+	else
+		return false;
+
+	return dns_cache_num_sets > 0;
+}
+
+/*
+ * Returns the first entry of the set the address belongs to.
+ */
+static DnsCacheEntry *
+dns_cache_set(int family, unsigned char *addr)
+{
+	uint64		h = pool_xxh64(addr, 16, family);
+
+	return &dns_cache[(h % dns_cache_num_sets) * DNS_CACHE_WAYS];
+}
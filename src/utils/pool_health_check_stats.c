@@ -52,6 +52,10 @@ int * pool_health_check_stats_offsets(int *n)
 		offsetof(POOL_HEALTH_CHECK_STATS, last_successful_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_skip_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_health_check),
+		offsetof(POOL_HEALTH_CHECK_STATS, p50_health_check_duration),
+		offsetof(POOL_HEALTH_CHECK_STATS, p99_health_check_duration),
+		offsetof(POOL_HEALTH_CHECK_STATS, health_check_duration_trend),
+		offsetof(POOL_HEALTH_CHECK_STATS, recent_fail_count),
 	};
 
 	*n = sizeof(offsettbl)/sizeof(int);
@@ -85,7 +89,88 @@ int * pool_report_pools_offsets(int *n)
 		offsetof(POOL_REPORT_POOLS, pool_backendpid),
 		offsetof(POOL_REPORT_POOLS, pool_connected),
 		offsetof(POOL_REPORT_POOLS, status),
-		offsetof(POOL_REPORT_POOLS, load_balance_node)
+		offsetof(POOL_REPORT_POOLS, load_balance_node),
+		offsetof(POOL_REPORT_POOLS, pool_evictions),
+		offsetof(POOL_REPORT_POOLS, wait_state),
+		offsetof(POOL_REPORT_POOLS, client_read_time),
+		offsetof(POOL_REPORT_POOLS, parse_time),
+		offsetof(POOL_REPORT_POOLS, route_time),
+		offsetof(POOL_REPORT_POOLS, relcache_time),
+		offsetof(POOL_REPORT_POOLS, cache_lock_time),
+		offsetof(POOL_REPORT_POOLS, backend_wait_time),
+		offsetof(POOL_REPORT_POOLS, client_write_time)
+	};
+
+	*n = sizeof(offsettbl)/sizeof(int);
+	return offsettbl;
+}
+
+/*
+ * Returns an array consisting of POOL_BACKEND_STATS struct member offsets.
+ * The reason why we have this as a function is the table data needs to be
+ * shared by both PCP server and clients.  Number of struct members will be
+ * stored in *n.
+ */
+int * pool_backend_stats_offsets(int *n)
+{
+	static int offsettbl[] = {
+		offsetof(POOL_BACKEND_STATS, node_id),
+		offsetof(POOL_BACKEND_STATS, hostname),
+		offsetof(POOL_BACKEND_STATS, port),
+		offsetof(POOL_BACKEND_STATS, status),
+		offsetof(POOL_BACKEND_STATS, role),
+		offsetof(POOL_BACKEND_STATS, select_cnt),
+		offsetof(POOL_BACKEND_STATS, insert_cnt),
+		offsetof(POOL_BACKEND_STATS, update_cnt),
+		offsetof(POOL_BACKEND_STATS, delete_cnt),
+		offsetof(POOL_BACKEND_STATS, ddl_cnt),
+		offsetof(POOL_BACKEND_STATS, other_cnt),
+		offsetof(POOL_BACKEND_STATS, panic_cnt),
+		offsetof(POOL_BACKEND_STATS, fatal_cnt),
+		offsetof(POOL_BACKEND_STATS, error_cnt),
+		offsetof(POOL_BACKEND_STATS, latency_p50),
+		offsetof(POOL_BACKEND_STATS, latency_p95),
+		offsetof(POOL_BACKEND_STATS, latency_p99),
+		offsetof(POOL_BACKEND_STATS, select_latency_p50),
+		offsetof(POOL_BACKEND_STATS, select_latency_p95),
+		offsetof(POOL_BACKEND_STATS, select_latency_p99),
+		offsetof(POOL_BACKEND_STATS, insert_latency_p50),
+		offsetof(POOL_BACKEND_STATS, insert_latency_p95),
+		offsetof(POOL_BACKEND_STATS, insert_latency_p99),
+		offsetof(POOL_BACKEND_STATS, update_latency_p50),
+		offsetof(POOL_BACKEND_STATS, update_latency_p95),
+		offsetof(POOL_BACKEND_STATS, update_latency_p99),
+		offsetof(POOL_BACKEND_STATS, delete_latency_p50),
+		offsetof(POOL_BACKEND_STATS, delete_latency_p95),
+		offsetof(POOL_BACKEND_STATS, delete_latency_p99),
+		offsetof(POOL_BACKEND_STATS, ddl_latency_p50),
+		offsetof(POOL_BACKEND_STATS, ddl_latency_p95),
+		offsetof(POOL_BACKEND_STATS, ddl_latency_p99),
+		offsetof(POOL_BACKEND_STATS, other_latency_p50),
+		offsetof(POOL_BACKEND_STATS, other_latency_p95),
+		offsetof(POOL_BACKEND_STATS, other_latency_p99),
+	};
+
+	*n = sizeof(offsettbl)/sizeof(int);
+	return offsettbl;
+}
+
+/*
+ * Returns an array consisting of POOL_REPORT_MEMORY struct member offsets.
+ * The reason why we have this as a function is the table data needs to be
+ * shared by both PCP server and clients.  Number of struct members will be
+ * stored in *n.
+ */
+int * pool_report_memory_offsets(int *n)
+{
+	static int offsettbl[] = {
+		offsetof(POOL_REPORT_MEMORY, pool_pid),
+		offsetof(POOL_REPORT_MEMORY, status),
+		offsetof(POOL_REPORT_MEMORY, allocated),
+		offsetof(POOL_REPORT_MEMORY, session),
+		offsetof(POOL_REPORT_MEMORY, query),
+		offsetof(POOL_REPORT_MEMORY, buffers),
+		offsetof(POOL_REPORT_MEMORY, peak),
 	};
 
 	*n = sizeof(offsettbl)/sizeof(int);
@@ -50,6 +50,7 @@
 
 #include "pool.h"
 #include "utils/pool_ip.h"
+#include "utils/pool_dns_cache.h"
 #include "pool_config.h"
 #include "utils/elog.h"
 static int rangeSockAddrAF_INET(const struct sockaddr_in *addr,
@@ -76,23 +77,45 @@ static int getnameinfo_unix(const struct sockaddr_un *sa, int salen,
 void
 pool_getnameinfo_all(SockAddr *saddr, char *remote_host, char *remote_port)
 {
+	char		hostname[NI_MAXHOST];
+	int			resolv;
+	int			ret;
+
 	remote_host[0] = '\0';
 	remote_port[0] = '\0';
 
-	if (getnameinfo_all(&saddr->addr, saddr->salen,
-						remote_host, NI_MAXHOST,
-						remote_port, NI_MAXSERV,
-						(pool_config->log_hostname ? 0 : NI_NUMERICHOST) | NI_NUMERICSERV))
+	ret = getnameinfo_all(&saddr->addr, saddr->salen,
+						  remote_host, NI_MAXHOST,
+						  remote_port, NI_MAXSERV,
+						  NI_NUMERICHOST | NI_NUMERICSERV);
+	if (ret)
+	{
+		ereport(WARNING,
+				(errmsg("getnameinfo failed with error: \"%s\"", gai_strerror(ret))));
+		return;
+	}
+
+	if (!pool_config->log_hostname || saddr->addr.ss_family == AF_UNIX)
+		return;
+
+	/* look up the host name unless another child has done so recently */
+	if (!pool_dns_cache_lookup(saddr, hostname, sizeof(hostname), &resolv))
 	{
-		int			ret = getnameinfo_all(&saddr->addr, saddr->salen,
-										  remote_host, NI_MAXHOST,
-										  remote_port, NI_MAXSERV,
-										  NI_NUMERICHOST | NI_NUMERICSERV);
-
-		if (ret)
-			ereport(WARNING,
-					(errmsg("getnameinfo failed with error: \"%s\"", gai_strerror(ret))));
+		if (getnameinfo_all(&saddr->addr, saddr->salen,
+							hostname, sizeof(hostname),
+							NULL, 0,
+							NI_NAMEREQD) == 0)
+			pool_dns_cache_store(saddr, hostname, 0);
+		else
+		{
+			hostname[0] = '\0';
+			pool_dns_cache_store(saddr, NULL, -2);
+		}
 	}
+
+	/* fall back to the numeric address if the host name is unknown */
+	if (hostname[0] != '\0')
+		strlcpy(remote_host, hostname, NI_MAXHOST);
 }
 
 /*
@@ -0,0 +1,286 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_log_ring.c: per child log rings drained by the logger process.
+ *
+ * When logging_collector is on and log_ring_size is set, each child process
+ * owns a ring buffer of log_ring_size kilobytes in shared memory.  Instead
+ * of writing each log message to the logger pipe, which blocks the child
+ * whenever the pipe is full, the child copies the message into its ring.
+ * The logger process drains all rings every LOG_RING_DRAIN_INTERVAL
+ * milliseconds and after each read from the pipe, writing out the whole
+ * content of a ring with at most two writes.
+ *
+ * Each ring has exactly one writer, the child process, and one reader, the
+ * logger process, so no lock is needed: the child advances "head" after
+ * copying a message and the logger advances "tail" after writing it out.
+ * Both are byte positions which only grow; the offset in the ring is the
+ * position modulo the ring size.  Since a message is published only once
+ * it is copied completely, the logger never sees a partial message.
+ *
+ * If a message does not fit in the free space of the ring,
+ * log_ring_overflow decides what happens.  With "drop" the message is
+ * thrown away and counted in the "dropped" counter of the ring, which the
+ * logger reports.  With "block" the child waits for the logger to make room.
+ * A message larger than the whole ring is written to the pipe as before; in
+ * "block" mode the child first waits for its ring to become empty so that
+ * its messages stay in order.
+ *
+ * Messages of processes other than child processes always go through the
+ * pipe, so the order of messages of different processes in the log file may
+ * differ slightly from the order in which they were issued.
+ */
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/elog.h"
+#include "utils/pool_atomic.h"
+#include "utils/pool_log_ring.h"
+#include "main/pgpool_logger.h"
+
+/* How long a child sleeps while waiting for room in "block" mode */
+#define LOG_RING_WAIT_USEC	1000
+
+typedef struct
+{
+	/* written by the child only */
+	pool_atomic_uint64 head;	/* bytes written into the ring */
+	pool_atomic_uint64 dropped;	/* messages dropped because the ring was
+								 * full */
+	char		pad1[POOL_CACHE_LINE_SIZE - 2 * sizeof(pool_atomic_uint64)];
+
+	/* written by the logger only */
+	pool_atomic_uint64 tail;	/* bytes written out to the log file */
+	uint64		dropped_reported;	/* dropped messages already reported */
+	char		pad2[POOL_CACHE_LINE_SIZE - sizeof(pool_atomic_uint64) - sizeof(uint64)];
+}			LogRingHeader;
+
+static char *log_rings = NULL;
+static size_t log_ring_size;	/* data bytes of a ring */
+
+/* ring of this child process, NULL if not a child or rings are disabled */
+static LogRingHeader *my_log_ring = NULL;
+
+/* true while this process is writing into its ring */
+static volatile bool in_log_ring_write = false;
+
+static size_t log_ring_stride(void);
+static LogRingHeader *log_ring(int child_id);
+static char *log_ring_data(LogRingHeader *ring);
+static void wait_for_log_ring(LogRingHeader *ring, uint64 head, size_t len);
+
+/*
+ * Allocate and initialize the log rings.  This should be called only once
+ * from pgpool main process at the process starting up time, before the
+ * logger process is forked.  That is before the main shared memory segment
+ * is created, so the rings get a segment of their own.
+ */
+void
+pool_init_log_rings(void)
+{
+	size_t		size;
+	int			i;
+
+	size = log_ring_stride() * pool_config->num_init_children;
+	ereport(DEBUG1,
+			(errmsg("log rings: %zu bytes requested for shared memory", size)));
+
+	log_ring_size = (size_t) pool_config->log_ring_size * 1024;
+	log_rings = pool_shared_memory_create(size);
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		LogRingHeader *ring = log_ring(i);
+
+		pool_atomic_init_u64(&ring->head, 0);
+		pool_atomic_init_u64(&ring->dropped, 0);
+		pool_atomic_init_u64(&ring->tail, 0);
+		ring->dropped_reported = 0;
+	}
+}
+
+/*
+ * Make the child process with the given process table id the writer of its
+ * ring.  Called in a newly forked child process.  The previous writer of
+ * the ring, if any, has exited already; what it left in the ring is still
+ * drained by the logger.
+ */
+void
+pool_log_ring_attach(int child_id)
+{
+	if (log_rings == NULL || child_id < 0 ||
+		child_id >= pool_config->num_init_children)
+		return;
+
+	my_log_ring = log_ring(child_id);
+}
+
+/*
+ * Put a log message into the ring of this process.  Returns false if the
+ * message has to be written to the logger pipe instead, which is the case
+ * if this process has no ring, the message is larger than the ring or we
+ * are called while already writing into the ring, e.g. from a signal
+ * handler.  Returns true if the message was put into the ring or dropped.
+ *
+ * This is called by the error reporting code, so it must not raise errors.
+ */
+bool
+pool_log_ring_write(const char *data, int len)
+{
+	LogRingHeader *ring = my_log_ring;
+	char	   *buf;
+	uint64		head;
+	size_t		offset;
+	size_t		first;
+
+	if (ring == NULL || in_log_ring_write || len <= 0)
+		return false;
+
+	in_log_ring_write = true;
+
+	/* nobody else writes head, so a plain read is current */
+	head = pool_atomic_read_u64(&ring->head);
+
+	if ((size_t) len > log_ring_size)
+	{
+		if (pool_config->log_ring_overflow == LOG_RING_OVERFLOW_BLOCK)
+			wait_for_log_ring(ring, head, log_ring_size);
+		in_log_ring_write = false;
+		return false;
+	}
+
+	if (log_ring_size - (head - pool_atomic_read_u64(&ring->tail)) < (size_t) len)
+	{
+		if (pool_config->log_ring_overflow == LOG_RING_OVERFLOW_DROP)
+		{
+			pool_atomic_fetch_add_u64(&ring->dropped, 1);
+			in_log_ring_write = false;
+			return true;
+		}
+		wait_for_log_ring(ring, head, len);
+	}
+
+	buf = log_ring_data(ring);
+	offset = head % log_ring_size;
+	first = Min((size_t) len, log_ring_size - offset);
+	memcpy(buf + offset, data, first);
+	if (first < (size_t) len)
+		memcpy(buf, data + first, len - first);
+
+	/* publish the message; the atomic store orders the copy before it */
+	pool_atomic_write_u64(&ring->head, head + len);
+
+	in_log_ring_write = false;
+	return true;
+}
+
+/*
+ * Write out everything the child processes have put into their rings, and
+ * report messages dropped since the last call.  Called in the logger
+ * process.
+ */
+void
+pool_log_ring_drain(void)
+{
+	int			i;
+
+	if (log_rings == NULL)
+		return;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		LogRingHeader *ring = log_ring(i);
+		char	   *buf = log_ring_data(ring);
+		uint64		head = pool_atomic_read_u64(&ring->head);
+		uint64		tail = pool_atomic_read_u64(&ring->tail);
+		uint64		dropped;
+
+		if (head != tail)
+		{
+			size_t		offset = tail % log_ring_size;
+			size_t		len = head - tail;
+			size_t		first = Min(len, log_ring_size - offset);
+
+			write_syslogger_file(buf + offset, first, LOG_DESTINATION_STDERR);
+			if (first < len)
+				write_syslogger_file(buf, len - first, LOG_DESTINATION_STDERR);
+
+			pool_atomic_write_u64(&ring->tail, head);
+		}
+
+		dropped = pool_atomic_read_u64(&ring->dropped);
+		if (dropped != ring->dropped_reported)
+		{
+			ereport(LOG,
+					(errmsg(UINT64_FORMAT " log messages of child process %d were dropped because its log ring was full",
+							dropped - ring->dropped_reported, i),
+					 errhint("Consider increasing log_ring_size or setting log_ring_overflow to block.")));
+			ring->dropped_reported = dropped;
+		}
+	}
+}
+
+/*
+ * Total number of log messages dropped by all child processes.
+ */
+uint64
+pool_log_ring_dropped(void)
+{
+	uint64		dropped = 0;
+	int			i;
+
+	if (log_rings == NULL)
+		return 0;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+		dropped += pool_atomic_read_u64(&log_ring(i)->dropped);
+	return dropped;
+}
+
+static size_t
+log_ring_stride(void)
+{
+	return MAXALIGN(sizeof(LogRingHeader)) +
+		MAXALIGN((size_t) pool_config->log_ring_size * 1024);
+}
+
+static LogRingHeader *
+log_ring(int child_id)
+{
+	return (LogRingHeader *) (log_rings + log_ring_stride() * child_id);
+}
+
+static char *
+log_ring_data(LogRingHeader *ring)
+{
+	return (char *) ring + MAXALIGN(sizeof(LogRingHeader));
+}
+
+/*
+ * Wait until the ring has room for len bytes.  If the logger process is
+ * being restarted, this waits until the new logger drains the ring.
+ */
+static void
+wait_for_log_ring(LogRingHeader *ring, uint64 head, size_t len)
+{
+	while (log_ring_size - (head - pool_atomic_read_u64(&ring->tail)) < len)
+		usleep(LOG_RING_WAIT_USEC);
+}
@@ -0,0 +1,255 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_msgbuf.c: builder of protocol messages sent to frontend
+ *
+ * Messages pgpool makes up itself used to be sent a field at a time, each
+ * field going through pool_write() and integers through snprintf().  Here
+ * whole messages are assembled in a buffer and handed to pool_write() at
+ * once.
+ *
+ */
+#include "pool.h"
+#include "utils/palloc.h"
+#include "utils/pool_stream.h"
+#include "utils/pool_msgbuf.h"
+
+/* "00" to "99", to convert two digits at a time */
+static const char digit_pairs[201] =
+"00010203040506070809"
+"10111213141516171819"
+"20212223242526272829"
+"30313233343536373839"
+"40414243444546474849"
+"50515253545556575859"
+"60616263646566676869"
+"70717273747576777879"
+"80818283848586878889"
+"90919293949596979899";
+
+static const uint64 powers_of_ten[] = {
+	10ULL,
+	100ULL,
+	1000ULL,
+	10000ULL,
+	100000ULL,
+	1000000ULL,
+	10000000ULL,
+	100000000ULL,
+	1000000000ULL,
+	10000000000ULL,
+	100000000000ULL,
+	1000000000000ULL,
+	10000000000000ULL,
+	100000000000000ULL,
+	1000000000000000ULL,
+	10000000000000000ULL,
+	100000000000000000ULL,
+	1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static inline int decimal_length(uint64 value);
+
+void
+pool_msgbuf_init(POOL_MSGBUF * buf)
+{
+	buf->data = buf->inline_data;
+	buf->len = 0;
+	buf->maxlen = POOL_MSGBUF_INLINE_SIZE;
+	buf->msgstart = -1;
+}
+
+void
+pool_msgbuf_free(POOL_MSGBUF * buf)
+{
+	if (buf->data != buf->inline_data)
+		pfree(buf->data);
+	pool_msgbuf_init(buf);
+}
+
+/*
+ * Enlarge the buffer so that needed more bytes fit.  Called by
+ * pool_msgbuf_reserve() when the buffer is full.
+ */
+void
+pool_msgbuf_enlarge(POOL_MSGBUF * buf, int needed)
+{
+	int			newlen = buf->maxlen;
+
+	while (buf->len + needed > newlen)
+		newlen *= 2;
+
+	if (buf->data == buf->inline_data)
+	{
+		buf->data = palloc(newlen);
+		memcpy(buf->data, buf->inline_data, buf->len);
+	}
+	else
+		buf->data = repalloc(buf->data, newlen);
+	buf->maxlen = newlen;
+}
+
+/*
+ * Start a protocol V3 message of the kind.
+ */
+void
+pool_msgbuf_begin(POOL_MSGBUF * buf, char kind)
+{
+	Assert(buf->msgstart < 0);
+
+	pool_msgbuf_reserve(buf, 1 + sizeof(int32));
+	buf->data[buf->len++] = kind;
+	buf->msgstart = buf->len;
+	buf->len += sizeof(int32);
+}
+
+/*
+ * Finish the message started by pool_msgbuf_begin(), filling in its length.
+ */
+void
+pool_msgbuf_end(POOL_MSGBUF * buf)
+{
+	uint32		len;
+
+	Assert(buf->msgstart >= 0);
+
+	len = htonl(buf->len - buf->msgstart);
+	memcpy(buf->data + buf->msgstart, &len, sizeof(len));
+	buf->msgstart = -1;
+}
+
+/*
+ * Put a null terminated string.
+ */
+void
+pool_msgbuf_string(POOL_MSGBUF * buf, const char *str)
+{
+	pool_msgbuf_bytes(buf, str, strlen(str) + 1);
+}
+
+/*
+ * Put a null terminated string, truncated to maxlen bytes.
+ */
+void
+pool_msgbuf_string_max(POOL_MSGBUF * buf, const char *str, int maxlen)
+{
+	int			len = strnlen(str, maxlen);
+
+	pool_msgbuf_reserve(buf, len + 1);
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len++] = '\0';
+}
+
+/*
+ * Put a text field of a DataRow message: its length followed by the string
+ * without null terminator.
+ */
+void
+pool_msgbuf_field(POOL_MSGBUF * buf, const char *str)
+{
+	int			len = strlen(str);
+
+	pool_msgbuf_reserve(buf, sizeof(int32) + len);
+	pool_msgbuf_int32(buf, len);
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+}
+
+/*
+ * Put the decimal text of an integer, without null terminator.
+ */
+void
+pool_msgbuf_int_text(POOL_MSGBUF * buf, int64 value)
+{
+	pool_msgbuf_reserve(buf, POOL_INT64_TEXT_SIZE);
+	buf->len += pool_int64_to_text(value, buf->data + buf->len);
+}
+
+/*
+ * Give the contents of the buffer to pool_write() and empty the buffer.
+ * Like pool_write(), this does not flush.
+ */
+void
+pool_msgbuf_write(POOL_CONNECTION * cp, POOL_MSGBUF * buf)
+{
+	Assert(buf->msgstart < 0);
+
+	if (buf->len > 0)
+		pool_write(cp, buf->data, buf->len);
+	buf->len = 0;
+}
+
+/*
+ * Number of decimal digits of value.  The comparisons are added up rather
+ * than branched on, so that the result costs the same for any value.
+ */
+static inline int
+decimal_length(uint64 value)
+{
+	int			len = 1;
+	int			i;
+
+	for (i = 0; i < sizeof(powers_of_ten) / sizeof(powers_of_ten[0]); i++)
+		len += (value >= powers_of_ten[i]);
+	return len;
+}
+
+/*
+ * Write the decimal text of value into out, which must have room for
+ * POOL_INT64_TEXT_SIZE bytes, and null terminate it.  Returns the length
+ * of the text.  This is what snprintf("%lld") does, without parsing the
+ * format and with two digits converted per division.
+ */
+int
+pool_int64_to_text(int64 value, char *out)
+{
+	uint64		uvalue;
+	int			neg = (value < 0);
+	int			len;
+	char	   *p;
+
+	/* negate in unsigned arithmetic so that INT64_MIN works */
+	uvalue = neg ? (uint64) 0 - (uint64) value : (uint64) value;
+	*out = '-';
+	len = neg + decimal_length(uvalue);
+
+	p = out + len;
+	*p = '\0';
+	while (uvalue >= 100)
+	{
+		int			i = (int) (uvalue % 100) * 2;
+
+		uvalue /= 100;
+		*--p = digit_pairs[i + 1];
+		*--p = digit_pairs[i];
+	}
+	if (uvalue >= 10)
+	{
+		int			i = (int) uvalue * 2;
+
+		*--p = digit_pairs[i + 1];
+		*--p = digit_pairs[i];
+	}
+	else
+		*--p = '0' + (int) uvalue;
+
+	return len;
+}
@@ -0,0 +1,178 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_numa.c: placement of child processes on NUMA nodes.
+ *
+ * The NUMA topology is read from sysfs by the main process at startup,
+ * so no NUMA library is needed.  Children are bound round robin to the
+ * CPUs of one node each.  Since shared memory pages are placed on the
+ * node of the process that first touches them, a child that allocates
+ * query cache blocks from the partition of its own node gets local
+ * memory for them (see pool_get_block()).
+ */
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/elog.h"
+#include "utils/pool_numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define NUMA_SYSFS_NODE_DIR	"/sys/devices/system/node"
+#define NUMA_MAX_NODES		64
+
+#ifdef __linux__
+static cpu_set_t numa_node_cpus[NUMA_MAX_NODES];
+static bool parse_cpu_list(const char *list, cpu_set_t *set);
+#endif
+
+static int	numa_nodes = 0;		/* number of usable nodes, 0 if unknown */
+static int	my_numa_node = -1;	/* node this process is bound to */
+
+/*
+ * Discover the NUMA nodes and their CPUs.  Called once by the main
+ * process; children inherit the result.
+ */
+void
+pool_numa_init(void)
+{
+#ifdef __linux__
+	int			node;
+
+	numa_nodes = 0;
+	for (node = 0; node < NUMA_MAX_NODES; node++)
+	{
+		char		path[POOLMAXPATHLEN];
+		char		buf[4096];
+		FILE	   *fd;
+
+		snprintf(path, sizeof(path), "%s/node%d/cpulist", NUMA_SYSFS_NODE_DIR, node);
+		fd = fopen(path, "r");
+		if (fd == NULL)
+			break;
+		if (fgets(buf, sizeof(buf), fd) == NULL)
+			buf[0] = '\0';
+		fclose(fd);
+
+		/* nodes without CPUs (memory only nodes) end the list */
+		if (!parse_cpu_list(buf, &numa_node_cpus[node]) ||
+			CPU_COUNT(&numa_node_cpus[node]) == 0)
+			break;
+		numa_nodes++;
+	}
+
+	if (numa_nodes > 1)
+		ereport(LOG,
+				(errmsg("binding child processes to %d NUMA nodes", numa_nodes)));
+	else
+		ereport(LOG,
+				(errmsg("no NUMA topology found, child processes are not bound to nodes")));
+#else
+	ereport(LOG,
+			(errmsg("numa_child_affinity is not supported on this platform")));
+#endif
+}
+
+/*
+ * Bind the calling child to a node chosen from its child id.  Does
+ * nothing unless more than one node was found.
+ */
+void
+pool_numa_bind_child(int id)
+{
+#ifdef __linux__
+	int			node;
+
+	if (numa_nodes <= 1)
+		return;
+
+	node = id % numa_nodes;
+	if (sched_setaffinity(0, sizeof(cpu_set_t), &numa_node_cpus[node]) < 0)
+	{
+		ereport(WARNING,
+				(errmsg("could not bind child process to NUMA node %d", node),
+				 errdetail("sched_setaffinity failed with error \"%m\"")));
+		return;
+	}
+	my_numa_node = node;
+#endif
+}
+
+/*
+ * Return the number of NUMA nodes children are spread over, or 0 if
+ * children are not bound.
+ */
+int
+pool_numa_num_nodes(void)
+{
+	return numa_nodes > 1 ? numa_nodes : 0;
+}
+
+/*
+ * Return the node the calling process is bound to, or -1.
+ */
+int
+pool_numa_my_node(void)
+{
+	return my_numa_node;
+}
+
+#ifdef __linux__
+/*
+ * Parse a sysfs CPU list such as "0-7,16-23".
+ */
+static bool
+parse_cpu_list(const char *list, cpu_set_t *set)
+{
+	const char *p = list;
+
+	CPU_ZERO(set);
+	while (*p && *p != '\n')
+	{
+		char	   *end;
+		long		first;
+		long		last;
+		long		cpu;
+
+		first = strtol(p, &end, 10);
+		if (end == p)
+			return false;
+		last = first;
+		p = end;
+		if (*p == '-')
+		{
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				return false;
+			p = end;
+		}
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, set);
+		if (*p == ',')
+			p++;
+	}
+	return true;
+}
+#endif
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <arpa/inet.h>
 #include <string.h>
 #include "utils/elog.h"
 #include "utils/pool_params.h"
@@ -46,6 +47,8 @@ pool_init_params(ParamStatus * params)
 	params->num = 0;
 	params->names = palloc(MAX_PARAM_ITEMS * sizeof(char *));
 	params->values = palloc(MAX_PARAM_ITEMS * sizeof(char *));
+	params->messages = NULL;
+	params->messages_len = 0;
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -69,9 +72,13 @@ pool_discard_params(ParamStatus * params)
 		pfree(params->names);
 	if (params->values)
 		pfree(params->values);
+	if (params->messages)
+		pfree(params->messages);
 	params->num = 0;
 	params->names = NULL;
 	params->values = NULL;
+	params->messages = NULL;
+	params->messages_len = 0;
 
 }
 
@@ -120,6 +127,13 @@ pool_add_param(ParamStatus * params, char *name, char *value)
 	int			pos;
 	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
+	if (params->messages)
+	{
+		pfree(params->messages);
+		params->messages = NULL;
+		params->messages_len = 0;
+	}
+
 	if (pool_find_name(params, name, &pos))
 	{
 		/* name already exists */
@@ -162,3 +176,45 @@ pool_param_debug_print(ParamStatus * params)
 				(errmsg("No.%d: name: %s value: %s", i, params->names[i], params->values[i])));
 	}
 }
+
+/*
+ * Return all the parameters as a series of ParameterStatus messages, ready
+ * to be sent to a frontend.  The messages are built on the first call and
+ * kept until a parameter is added or changed.
+ */
+char *
+pool_get_param_messages(ParamStatus * params, int *len)
+{
+	int			i;
+	char	   *p;
+
+	if (params->messages == NULL)
+	{
+		int			total = 0;
+
+		for (i = 0; i < params->num; i++)
+			total += 1 + sizeof(int32) + strlen(params->names[i]) + 1 + strlen(params->values[i]) + 1;
+
+		params->messages = MemoryContextAlloc(TopMemoryContext, total > 0 ? total : 1);
+		params->messages_len = total;
+
+		p = params->messages;
+		for (i = 0; i < params->num; i++)
+		{
+			int			namelen = strlen(params->names[i]) + 1;
+			int			valuelen = strlen(params->values[i]) + 1;
+			int32		msglen = htonl(sizeof(int32) + namelen + valuelen);
+
+			*p++ = 'S';
+			memcpy(p, &msglen, sizeof(msglen));
+			p += sizeof(msglen);
+			memcpy(p, params->names[i], namelen);
+			p += namelen;
+			memcpy(p, params->values[i], valuelen);
+			p += valuelen;
+		}
+	}
+
+	*len = params->messages_len;
+	return params->messages;
+}
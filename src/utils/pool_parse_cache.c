@@ -0,0 +1,300 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_parse_cache.c: per process parse tree cache.
+ *
+ * Applications tend to send the same statements over and over again.
+ * This module remembers the raw parse trees of recently parsed query
+ * strings so that raw_parser() (i.e. bison) does not need to run for them
+ * again.  The cache is looked up by the exact query string, because the
+ * parse tree contains the literals as well.  Callers get a fresh copy of
+ * the cached tree, which they are free to modify.
+ *
+ * The number of entries is limited by parse_cache_size.  When the cache
+ * is full, the least recently used entry is discarded.
+ */
+#include <string.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/palloc.h"
+#include "utils/memutils.h"
+#include "utils/elog.h"
+#include "utils/xxhash.h"
+#include "utils/pool_parse_cache.h"
+#include "utils/pool_stage.h"
+#include "parser/parser.h"
+#include "parser/pg_wchar.h"
+
+/*
+ * Query strings longer than this are not cached.  They are mostly bulk
+ * INSERTs which are unlikely to be seen twice.  Same as
+ * LENGTHY_QUERY_STRING in pool_proto_modules.c.
+ */
+#define PARSE_CACHE_MAX_QUERY_LEN	(1024*10)
+
+typedef struct ParseCacheEntry
+{
+	uint64		hashval;
+	int			flags;			/* parser settings the tree depends on */
+	int			len;			/* length of query */
+	char	   *query;
+	List	   *parse_tree_list;
+	MemoryContext context;		/* holds query and parse_tree_list */
+	struct ParseCacheEntry *hash_next;
+	struct ParseCacheEntry *lru_prev;	/* more recently used */
+	struct ParseCacheEntry *lru_next;	/* less recently used */
+}			ParseCacheEntry;
+
+typedef struct
+{
+	int			nentries;
+	int			nbuckets;		/* power of 2 */
+	ParseCacheEntry **buckets;
+	ParseCacheEntry *lru_head;	/* most recently used */
+	ParseCacheEntry *lru_tail;	/* least recently used */
+	uint64		hits;
+	uint64		misses;
+}			ParseCache;
+
+static ParseCache *parse_cache = NULL;
+static MemoryContext ParseCacheContext = NULL;
+
+static List *parse_cache_raw_parser(const char *str, int len, bool *error, bool use_minimal);
+static void parse_cache_init(void);
+static int	parser_flags(bool use_minimal);
+static ParseCacheEntry * parse_cache_lookup(uint64 hashval, int flags, const char *str, int len);
+static void parse_cache_add(uint64 hashval, int flags, const char *str, int len, List *parse_tree_list);
+static void parse_cache_remove(ParseCacheEntry * entry);
+static void lru_unlink(ParseCacheEntry * entry);
+static void lru_push_head(ParseCacheEntry * entry);
+
+/*
+ * Drop-in replacement of raw_parser(str, RAW_PARSE_DEFAULT, len, error,
+ * use_minimal) which consults the parse tree cache first.  The returned
+ * tree is allocated in the current memory context either way.
+ */
+List *
+pool_parse_cache_raw_parser(const char *str, int len, bool *error, bool use_minimal)
+{
+	PoolStage	stage;
+	List	   *parse_tree_list;
+
+	stage = pool_stage_enter(POOL_STAGE_PARSE);
+	parse_tree_list = parse_cache_raw_parser(str, len, error, use_minimal);
+	pool_stage_leave(stage);
+
+	return parse_tree_list;
+}
+
+static List *
+parse_cache_raw_parser(const char *str, int len, bool *error, bool use_minimal)
+{
+	ParseCacheEntry *entry;
+	List	   *parse_tree_list;
+	uint64		hashval;
+	int			flags;
+
+	if (pool_config->parse_cache_size <= 0 || len > PARSE_CACHE_MAX_QUERY_LEN)
+		return raw_parser(str, RAW_PARSE_DEFAULT, len, error, use_minimal);
+
+	if (parse_cache == NULL)
+		parse_cache_init();
+
+	flags = parser_flags(use_minimal);
+	hashval = pool_xxh64(str, len, (uint64) flags);
+
+	entry = parse_cache_lookup(hashval, flags, str, len);
+	if (entry)
+	{
+		parse_cache->hits++;
+		lru_unlink(entry);
+		lru_push_head(entry);
+		*error = false;
+		return copyObject(entry->parse_tree_list);
+	}
+
+	parse_cache->misses++;
+
+	parse_tree_list = raw_parser(str, RAW_PARSE_DEFAULT, len, error, use_minimal);
+
+	/* do not remember syntax errors */
+	if (parse_tree_list != NIL && !*error)
+		parse_cache_add(hashval, flags, str, len, parse_tree_list);
+
+	return parse_tree_list;
+}
+
+static void
+parse_cache_init(void)
+{
+	MemoryContext old_context;
+	int			nbuckets;
+
+	ParseCacheContext = AllocSetContextCreate(TopMemoryContext,
+											  "ParseCacheContext",
+											  ALLOCSET_SMALL_SIZES);
+
+	old_context = MemoryContextSwitchTo(ParseCacheContext);
+
+	for (nbuckets = 16; nbuckets < pool_config->parse_cache_size; nbuckets *= 2)
+		;
+
+	parse_cache = palloc0(sizeof(ParseCache));
+	parse_cache->nbuckets = nbuckets;
+	parse_cache->buckets = palloc0(sizeof(ParseCacheEntry *) * nbuckets);
+
+	MemoryContextSwitchTo(old_context);
+}
+
+/*
+ * The same string may be parsed differently depending on the parser
+ * settings taken from the backend and on the parser in use.
+ */
+static int
+parser_flags(bool use_minimal)
+{
+	return (use_minimal ? 1 : 0) |
+		(standard_conforming_strings ? 2 : 0) |
+		(GetDatabaseEncoding() << 2);
+}
+
+static ParseCacheEntry *
+parse_cache_lookup(uint64 hashval, int flags, const char *str, int len)
+{
+	ParseCacheEntry *entry;
+
+	for (entry = parse_cache->buckets[hashval & (parse_cache->nbuckets - 1)];
+		 entry; entry = entry->hash_next)
+	{
+		if (entry->hashval == hashval && entry->flags == flags &&
+			entry->len == len && memcmp(entry->query, str, len) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+parse_cache_add(uint64 hashval, int flags, const char *str, int len, List *parse_tree_list)
+{
+	ParseCacheEntry *entry;
+	ParseCacheEntry **bucket;
+	MemoryContext context;
+	MemoryContext old_context;
+	List	   *copied;
+
+	if (parse_cache->nentries >= pool_config->parse_cache_size)
+	{
+		ereport(DEBUG1,
+				(errmsg("parse cache replacement happened"),
+				 errdetail("hits: %llu misses: %llu",
+						   (unsigned long long) parse_cache->hits,
+						   (unsigned long long) parse_cache->misses)));
+		parse_cache_remove(parse_cache->lru_tail);
+	}
+
+	context = AllocSetContextCreate(ParseCacheContext,
+									"ParseCacheEntry",
+									ALLOCSET_SMALL_SIZES);
+	old_context = MemoryContextSwitchTo(context);
+
+	/*
+	 * copyObject() throws an error for node types it does not know.  Such
+	 * a tree is simply not cached.
+	 */
+	PG_TRY();
+	{
+		copied = copyObject(parse_tree_list);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(old_context);
+		FlushErrorState();
+		MemoryContextDelete(context);
+		return;
+	}
+	PG_END_TRY();
+
+	entry = palloc(sizeof(ParseCacheEntry));
+	entry->hashval = hashval;
+	entry->flags = flags;
+	entry->len = len;
+	entry->query = palloc(len);
+	memcpy(entry->query, str, len);
+	entry->parse_tree_list = copied;
+	entry->context = context;
+
+	MemoryContextSwitchTo(old_context);
+
+	bucket = &parse_cache->buckets[hashval & (parse_cache->nbuckets - 1)];
+	entry->hash_next = *bucket;
+	*bucket = entry;
+	lru_push_head(entry);
+	parse_cache->nentries++;
+}
+
+static void
+parse_cache_remove(ParseCacheEntry * entry)
+{
+	ParseCacheEntry **p;
+
+	for (p = &parse_cache->buckets[entry->hashval & (parse_cache->nbuckets - 1)];
+		 *p; p = &(*p)->hash_next)
+	{
+		if (*p == entry)
+		{
+			*p = entry->hash_next;
+			break;
+		}
+	}
+
+	lru_unlink(entry);
+	parse_cache->nentries--;
+
+	/* the entry itself lives in the context */
+	MemoryContextDelete(entry->context);
+}
+
+static void
+lru_unlink(ParseCacheEntry * entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		parse_cache->lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		parse_cache->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void
+lru_push_head(ParseCacheEntry * entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = parse_cache->lru_head;
+	if (parse_cache->lru_head)
+		parse_cache->lru_head->lru_prev = entry;
+	parse_cache->lru_head = entry;
+	if (parse_cache->lru_tail == NULL)
+		parse_cache->lru_tail = entry;
+}
@@ -26,7 +26,10 @@
 #include "protocol/pool_process_query.h"
 #include "utils/elog.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_msgbuf.h"
 #include "utils/statistics.h"
+#include "utils/pool_statement_stats.h"
+#include "utils/pool_stage.h"
 #include "pool_config.h"
 #include "query_cache/pool_memqcache.h"
 #include "version.h"
@@ -40,80 +43,84 @@
 static void send_row_description_and_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 											   short num_fields, char **field_names, int *offsettbl,
 											   char *data, int row_size, int nrows);
-static void write_one_field(POOL_CONNECTION * frontend, char *field);
-static void write_one_field_v2(POOL_CONNECTION * frontend, char *field);
+static void send_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+						   short num_fields, int *offsettbl, char *data, int row_size, int nrows);
+static void send_data_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+						  short num_fields, char **values);
+static int	get_pools_of_child(int child, POOL_REPORT_POOLS * pools, bool active_only);
+static void get_process_of_child(int child, POOL_REPORT_PROCESSES * process);
 static char *db_node_status(int node);
 static char *db_node_role(int node);
+static void set_backend_stats_latency(int node_id, STAT_QUERY_TYPE type, char *p50, char *p95, char *p99);
+static const char *process_status_string(ProcessStatus status);
+static void format_stage_time(char *buf, ProcessInfo * pi, PoolStage stage);
+
+/*
+ * Fill the wait_state and the stage time columns of a POOL_REPORT_PROCESSES
+ * or POOL_REPORT_POOLS row.
+ */
+#define SET_STAGE_COLUMNS(row, pi) \
+	do { \
+		StrNCpy((row)->wait_state, pool_stage_name((PoolStage) (pi)->stage), POOLCONFIG_MAXPROCESSSTATUSLEN); \
+		format_stage_time((row)->client_read_time, (pi), POOL_STAGE_CLIENT_READ); \
+		format_stage_time((row)->parse_time, (pi), POOL_STAGE_PARSE); \
+		format_stage_time((row)->route_time, (pi), POOL_STAGE_ROUTE); \
+		format_stage_time((row)->relcache_time, (pi), POOL_STAGE_RELCACHE); \
+		format_stage_time((row)->cache_lock_time, (pi), POOL_STAGE_CACHE_LOCK); \
+		format_stage_time((row)->backend_wait_time, (pi), POOL_STAGE_BACKEND_WAIT); \
+		format_stage_time((row)->client_write_time, (pi), POOL_STAGE_CLIENT_WRITE); \
+	} while (0)
 
 void
 send_row_description(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 					 short num_fields, char **field_names)
 {
 	static char *cursorname = "blank";
-	static int	oid = 0;
-	static short fsize = -1;
-	static int	mod = 0;
-	short		n;
+	POOL_MSGBUF buf;
 	int			i;
-	short		s;
-	int			len;
-	short		colnum;
+
+	pool_msgbuf_init(&buf);
 
 	if (MAJOR(backend) == PROTO_MAJOR_V2)
 	{
 		/* cursor response */
-		pool_write(frontend, "P", 1);
-		pool_write(frontend, cursorname, strlen(cursorname) + 1);
-	}
-
-	/* row description */
-	pool_write(frontend, "T", 1);
+		pool_msgbuf_byte(&buf, 'P');
+		pool_msgbuf_string(&buf, cursorname);
 
-	if (MAJOR(backend) == PROTO_MAJOR_V3)
+		/* row description */
+		pool_msgbuf_byte(&buf, 'T');
+		pool_msgbuf_int16(&buf, num_fields);
+		for (i = 0; i < num_fields; i++)
+		{
+			pool_msgbuf_string(&buf, field_names[i]);	/* field name */
+			pool_msgbuf_int32(&buf, 0); /* data type oid */
+			pool_msgbuf_int16(&buf, -1);	/* field size */
+			pool_msgbuf_int32(&buf, 0); /* modifier */
+		}
+	}
+	else
 	{
 		/*
-		 * information about computed byte in section "RowDescription (B)"
-		 * here:
+		 * See "RowDescription (B)" here:
 		 * http://www.postgresql.org/docs/current/static/protocol-message-formats.html
 		 */
-
-		len = 6;				/* int32 + int16 */
-
+		pool_msgbuf_begin(&buf, 'T');
+		pool_msgbuf_int16(&buf, num_fields);
 		for (i = 0; i < num_fields; i++)
 		{
-			/* String + '\0' + 3* int32 + 3* int16 */
-			len += strlen(field_names[i]) + 1 + 18;
+			pool_msgbuf_string(&buf, field_names[i]);	/* field name */
+			pool_msgbuf_int32(&buf, 0); /* table oid */
+			pool_msgbuf_int16(&buf, i); /* column number */
+			pool_msgbuf_int32(&buf, 0); /* data type oid */
+			pool_msgbuf_int16(&buf, -1);	/* field size */
+			pool_msgbuf_int32(&buf, 0); /* modifier */
+			pool_msgbuf_int16(&buf, 0); /* field format (text) */
 		}
-
-		len = htonl(len);
-		pool_write(frontend, &len, sizeof(len));
+		pool_msgbuf_end(&buf);
 	}
 
-	n = htons(num_fields);
-	pool_write(frontend, &n, sizeof(short));
-
-	for (i = 0; i < num_fields; i++)
-	{
-		pool_write(frontend, field_names[i], strlen(field_names[i]) + 1);	/* field name */
-
-		if (MAJOR(backend) == PROTO_MAJOR_V3)
-		{
-			pool_write(frontend, &oid, sizeof(oid));	/* table oid */
-			colnum = htons(i);
-			pool_write(frontend, &colnum, sizeof(colnum));	/* column number */
-		}
-
-		pool_write(frontend, &oid, sizeof(oid));	/* data type oid */
-		s = htons(fsize);
-		pool_write(frontend, &s, sizeof(fsize));	/* field size */
-		pool_write(frontend, &mod, sizeof(mod));	/* modifier */
-
-		if (MAJOR(backend) == PROTO_MAJOR_V3)
-		{
-			s = htons(0);
-			pool_write(frontend, &s, sizeof(fsize));	/* field format (text) */
-		}
-	}
+	pool_msgbuf_write(frontend, &buf);
+	pool_msgbuf_free(&buf);
 	pool_flush(frontend);
 }
 
@@ -126,33 +133,38 @@ send_row_description(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 void
 send_complete_and_ready(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *message, const int num_rows)
 {
-	int			len;
-	int			msg_len;
-	char		msg[64];
+	POOL_MSGBUF buf;
+	bool		v3 = (MAJOR(backend) == PROTO_MAJOR_V3);
 
-	if (num_rows >= 0)
-		msg_len = snprintf(msg, sizeof(msg), "%s %d", message, num_rows);
-	else
-		msg_len = snprintf(msg, sizeof(msg), "%s", message);
+	pool_msgbuf_init(&buf);
 
 	/* complete command response */
-	pool_write(frontend, "C", 1);
-	if (MAJOR(backend) == PROTO_MAJOR_V3)
+	if (v3)
+		pool_msgbuf_begin(&buf, 'C');
+	else
+		pool_msgbuf_byte(&buf, 'C');
+	pool_msgbuf_bytes(&buf, message, strlen(message));
+	if (num_rows >= 0)
 	{
-		len = htonl(4 + msg_len + 1);
-		pool_write(frontend, &len, sizeof(len));
+		pool_msgbuf_byte(&buf, ' ');
+		pool_msgbuf_int_text(&buf, num_rows);
 	}
-	pool_write(frontend, msg, msg_len + 1);
+	pool_msgbuf_byte(&buf, '\0');
+	if (v3)
+		pool_msgbuf_end(&buf);
 
 	/* ready for query */
-	pool_write(frontend, "Z", 1);
-	if (MAJOR(backend) == PROTO_MAJOR_V3)
+	if (v3)
 	{
-		len = htonl(5);
-		pool_write(frontend, &len, sizeof(len));
-		pool_write(frontend, "I", 1);
+		pool_msgbuf_begin(&buf, 'Z');
+		pool_msgbuf_byte(&buf, 'I');
+		pool_msgbuf_end(&buf);
 	}
+	else
+		pool_msgbuf_byte(&buf, 'Z');
 
+	pool_msgbuf_write(frontend, &buf);
+	pool_msgbuf_free(&buf);
 	pool_flush(frontend);
 }
 
@@ -165,11 +177,12 @@ get_config(int *nrows)
 
 /*
  * Report data buffer.
- * 128 is the max number of configuration items.
+ * 384 is the max number of configuration items.
  * In addition, we need MAX_NUM_BACKENDS*4
- * for backend descriptions.
+ * for backend descriptions and MAX_WATCHDOG_NUM*3
+ * for watchdog node descriptions.
  */
-#define MAXITEMS (256 + MAX_NUM_BACKENDS*4)
+#define MAXITEMS (384 + MAX_NUM_BACKENDS*4 + MAX_WATCHDOG_NUM*3)
 
 	POOL_REPORT_CONFIG *status = palloc0(MAXITEMS * sizeof(POOL_REPORT_CONFIG));
 
@@ -250,6 +263,24 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "PCP port # to bind", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "metrics_listen_addresses", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_metrics_listen_addresses; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->metrics_listen_addresses[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_metrics_listen_addresses - 1)
+			strncat(status[i].value, ",", len);
+	}
+	StrNCpy(status[i].desc, "host name(s) or IP address(es) for metrics process to listen on", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "metrics_port", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->metrics_port);
+	StrNCpy(status[i].desc, "metrics port # to bind", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "pcp_socket_dir", POOLCONFIG_MAXNAMELEN);
 	*(status[i].value) = '\0';
 	for (j = 0; j < pool_config->num_pcp_socket_directories; j++)
@@ -279,6 +310,31 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "maximum time in seconds to complete client authentication", POOLCONFIG_MAXNAMELEN);
 	i++;
 
+	StrNCpy(status[i].name, "dns_cache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->dns_cache_size);
+	StrNCpy(status[i].desc, "number of client host names cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "dns_cache_ttl", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->dns_cache_ttl);
+	StrNCpy(status[i].desc, "seconds a client host name is cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "dns_cache_negative_ttl", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->dns_cache_negative_ttl);
+	StrNCpy(status[i].desc, "seconds a failed client host name lookup is cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "ldap_auth_cache_ttl", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ldap_auth_cache_ttl);
+	StrNCpy(status[i].desc, "seconds a successful LDAP authentication is cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "scram_key_cache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->scram_key_cache_size);
+	StrNCpy(status[i].desc, "number of SCRAM keys shared among children", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "allow_clear_text_frontend_auth", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->allow_clear_text_frontend_auth);
 	StrNCpy(status[i].desc, "allow to use clear text password auth when pool_passwd does not contain password", POOLCONFIG_MAXDESCLEN);
@@ -325,6 +381,21 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Use server's SSL cipher preferences", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "ssl_session_tickets", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ssl_session_tickets);
+	StrNCpy(status[i].desc, "allow SSL session resumption with session tickets", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "ssl_session_ticket_lifetime", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ssl_session_ticket_lifetime);
+	StrNCpy(status[i].desc, "rotation interval of SSL session ticket keys", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "ssl_ktls", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ssl_ktls);
+	StrNCpy(status[i].desc, "offload SSL encryption to the kernel", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "ssl_ecdh_curve", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->ssl_ecdh_curve);
 	StrNCpy(status[i].desc, "the curve to use in ECDH key exchange", POOLCONFIG_MAXDESCLEN);
@@ -359,11 +430,87 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "number of reserved connections", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "max_connections_per_user", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_connections_per_user);
+	StrNCpy(status[i].desc, "max number of connections from clients of a user", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_connections_per_database", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_connections_per_database);
+	StrNCpy(status[i].desc, "max number of connections from clients to a database", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_active_queries_per_user", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_active_queries_per_user);
+	StrNCpy(status[i].desc, "max number of running queries of a user", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_active_queries_per_database", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_active_queries_per_database);
+	StrNCpy(status[i].desc, "max number of running queries on a database", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_active_queries_per_node", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_active_queries_per_node);
+	StrNCpy(status[i].desc, "max number of running queries on a backend node", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_queries_per_second_per_user", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_queries_per_second_per_user);
+	StrNCpy(status[i].desc, "max number of queries a user starts per second", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_queries_per_second_per_database", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_queries_per_second_per_database);
+	StrNCpy(status[i].desc, "max number of queries started per second on a database", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "query_limit_action", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s",
+			 pool_config->query_limit_action == QLA_REJECT ? "reject" : "wait");
+	StrNCpy(status[i].desc, "what to do with a query over the limits", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "max_pool", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_pool);
 	StrNCpy(status[i].desc, "max # of connection pool per child", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "read_buffer_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->read_buffer_size);
+	StrNCpy(status[i].desc, "max bytes read from a socket at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "write_buffer_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->write_buffer_size);
+	StrNCpy(status[i].desc, "bytes buffered before writing to a socket", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "backend_local_socket_dir", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->backend_local_socket_dir);
+	StrNCpy(status[i].desc, "UNIX domain socket directory of backends on this host", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "backend_busy_poll", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->backend_busy_poll);
+	StrNCpy(status[i].desc, "microseconds to busy poll on backend sockets", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "result_spool_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->result_spool_size);
+	StrNCpy(status[i].desc, "max bytes of a result buffered for a slow client", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "huge_pages", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->huge_pages);
+	StrNCpy(status[i].desc, "use huge pages for the shared memory", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "numa_child_affinity", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->numa_child_affinity);
+	StrNCpy(status[i].desc, "bind child processes to NUMA nodes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "process_management_mode", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->process_management);
 	StrNCpy(status[i].desc, "process management mode", POOLCONFIG_MAXDESCLEN);
@@ -400,11 +547,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "if max_connections received, child exits", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "child_memory_limit", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->child_memory_limit);
+	StrNCpy(status[i].desc, "if memory exceeds this many kB, child exits after the session", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "connection_life_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->connection_life_time);
 	StrNCpy(status[i].desc, "if idle for this seconds, connection closes", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "connection_life_time_jitter", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->connection_life_time_jitter);
+	StrNCpy(status[i].desc, "percentage of connection_life_time randomly taken off", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_connection_recycles_per_second", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_connection_recycles_per_second);
+	StrNCpy(status[i].desc, "max # of expired connections closed per second", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "client_idle_limit", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->client_idle_limit);
 	StrNCpy(status[i].desc, "if idle for this seconds, child connection closes", POOLCONFIG_MAXDESCLEN);
@@ -479,6 +641,36 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "if non 0, logs any client messages", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "log_statement_sample_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_statement_sample_interval);
+	StrNCpy(status[i].desc, "logs one in this many statements", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "log_statement_rate_limit", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_statement_rate_limit);
+	StrNCpy(status[i].desc, "max statements logged per second by a child", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "log_min_duration_statement", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_min_duration_statement);
+	StrNCpy(status[i].desc, "logs statements slower than this (msec)", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "statement_stats_max", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->statement_stats_max);
+	StrNCpy(status[i].desc, "max number of statements in SHOW POOL_STATEMENTS", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "log_ring_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_ring_size);
+	StrNCpy(status[i].desc, "size of the log ring of each child in kilobytes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "log_ring_overflow", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_ring_overflow);
+	StrNCpy(status[i].desc, "what to do when a log ring is full", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "log_standby_delay", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_standby_delay);
 	StrNCpy(status[i].desc, "how to log standby delay", POOLCONFIG_MAXDESCLEN);
@@ -527,6 +719,34 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "queries issued at the end of session", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "skip_reset_on_clean_session", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->skip_reset_on_clean_session);
+	StrNCpy(status[i].desc, "skip reset queries if session state is unchanged", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_pooled_prepared_statements", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_pooled_prepared_statements);
+	StrNCpy(status[i].desc, "max prepared statements shared on a backend connection", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "prewarm_connections", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_prewarm_connections; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->prewarm_connections[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_prewarm_connections - 1)
+			strncat(status[i].value, ",", len);
+	}
+	StrNCpy(status[i].desc, "connections opened in advance", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "listen_multiplexing_max_subscriptions", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->listen_multiplexing_max_subscriptions);
+	StrNCpy(status[i].desc, "max LISTENs served by the notification hub", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* REPLICATION MODE */
 
 	StrNCpy(status[i].name, "replicate_select", POOLCONFIG_MAXNAMELEN);
@@ -534,16 +754,41 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "non 0 if SELECT statement is replicated", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "shard_key_list", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->shard_key_list ? pool_config->shard_key_list : "");
+	StrNCpy(status[i].desc, "list of table:column of sharded tables", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "insert_lock", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->insert_lock);
 	StrNCpy(status[i].desc, "insert lock", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "insert_lock_method", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->insert_lock_method);
+	StrNCpy(status[i].desc, "1: row lock on insert_lock table 2: advisory lock", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "replication_concurrent_dispatch", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replication_concurrent_dispatch);
+	StrNCpy(status[i].desc, "send statements which cannot deadlock to all nodes at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "lobj_lock_table", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->lobj_lock_table);
 	StrNCpy(status[i].desc, "table name used for large object replication control", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "lobj_oid_batch_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->lobj_oid_batch_size);
+	StrNCpy(status[i].desc, "number of large object ids reserved at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "timestamp_sync_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->timestamp_sync_interval);
+	StrNCpy(status[i].desc, "interval to synchronize clock for rewriting timestamps", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Degenerate handling - */
 	StrNCpy(status[i].name, "replication_stop_on_mismatch", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replication_stop_on_mismatch);
@@ -616,17 +861,82 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "list of relationships between objects", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "dml_adaptive_write_window", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->dml_adaptive_write_window);
+	StrNCpy(status[i].desc, "time reads on written tables are not load balanced", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "statement_level_load_balance", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->statement_level_load_balance);
 	StrNCpy(status[i].desc, "statement level load balancing", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "load_balance_algorithm", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->load_balance_algorithm);
+	StrNCpy(status[i].desc, "how to choose load balancing node", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "adaptive_weight", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->adaptive_weight);
+	StrNCpy(status[i].desc, "adjust backend weights by measured latency", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "adaptive_weight_floor", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->adaptive_weight_floor);
+	StrNCpy(status[i].desc, "lower limit of effective weight in percent", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "adaptive_weight_ceiling", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->adaptive_weight_ceiling);
+	StrNCpy(status[i].desc, "upper limit of effective weight in percent", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "hedged_reads", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->hedged_reads);
+	StrNCpy(status[i].desc, "resend slow SELECTs to another standby", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "hedged_read_percentile", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->hedged_read_percentile);
+	StrNCpy(status[i].desc, "latency percentile after which a SELECT is resent", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "hedged_read_min_delay", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->hedged_read_min_delay);
+	StrNCpy(status[i].desc, "minimum delay before a SELECT is resent", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "retry_reads_on_standby_failure", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->retry_reads_on_standby_failure);
+	StrNCpy(status[i].desc, "resend SELECTs whose standby fails before answering", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "heavy_query_nodes", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->heavy_query_nodes);
+	StrNCpy(status[i].desc, "node ids heavy queries are sent to", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "heavy_query_min_weight", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->heavy_query_min_weight);
+	StrNCpy(status[i].desc, "estimated weight of a heavy query", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_heavy_queries", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_heavy_queries);
+	StrNCpy(status[i].desc, "max number of heavy queries running at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Streaming - */
 	StrNCpy(status[i].name, "sr_check_period", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sr_check_period);
 	StrNCpy(status[i].desc, "sr check period", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "sr_lag_check_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sr_lag_check_interval);
+	StrNCpy(status[i].desc, "replication lag sampling interval", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "sr_check_user", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->sr_check_user);
 	StrNCpy(status[i].desc, "sr check user", POOLCONFIG_MAXDESCLEN);
@@ -657,12 +967,22 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "load balancing considering streaming delay", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "causal_reads", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->causal_reads);
+	StrNCpy(status[i].desc, "load balance reads only to standbys which replayed the session's writes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Special commands - */
 	StrNCpy(status[i].name, "follow_primary_command", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->follow_primary_command);
 	StrNCpy(status[i].desc, "follow primary command", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "follow_primary_command_parallelism", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->follow_primary_command_parallelism);
+	StrNCpy(status[i].desc, "max number of follow primary commands run concurrently", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "user_redirect_preference_list", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->user_redirect_preference_list);
 	StrNCpy(status[i].desc, "redirect by user name", POOLCONFIG_MAXDESCLEN);
@@ -725,6 +1045,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "connect timeout", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "health_check_error_threshold", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_error_threshold);
+	StrNCpy(status[i].desc, "backend errors per second triggering health check", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "health_check_probe_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_probe_interval);
+	StrNCpy(status[i].desc, "health check probe interval in milliseconds", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "health_check_multiplexed", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_multiplexed);
+	StrNCpy(status[i].desc, "check all backends from one process", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "sr_check_by_health_check", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sr_check_by_health_check);
+	StrNCpy(status[i].desc, "streaming replication check by health check", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* FAILOVER AND FAILBACK */
 
 	StrNCpy(status[i].name, "failover_command", POOLCONFIG_MAXNAMELEN);
@@ -747,6 +1087,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "failover on backend shutdown", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "failover_keep_sessions", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->failover_keep_sessions);
+	StrNCpy(status[i].desc, "keep sessions not using failed standby", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "failover_reattach_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->failover_reattach_timeout);
+	StrNCpy(status[i].desc, "max time to reattach idle sessions to new primary", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "detach_false_primary", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->detach_false_primary);
 	StrNCpy(status[i].desc, "detach false primary", POOLCONFIG_MAXDESCLEN);
@@ -762,6 +1112,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "auto_failback_interval", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "auto_attach_new_backends", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->auto_attach_new_backends);
+	StrNCpy(status[i].desc, "attach backends added by reload", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* ONLINE RECOVERY */
 
 	StrNCpy(status[i].name, "recovery_user", POOLCONFIG_MAXNAMELEN);
@@ -779,6 +1134,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "execute a command in second stage.", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "recovery_catchup_command", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->recovery_catchup_command);
+	StrNCpy(status[i].desc, "execute a command before second stage while accepting clients", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "recovery_catchup_rounds", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->recovery_catchup_rounds);
+	StrNCpy(status[i].desc, "number of times to execute recovery_catchup_command", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "recovery_timeout", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->recovery_timeout);
 	StrNCpy(status[i].desc, "max time in seconds to wait for the recovering node's postmaster", POOLCONFIG_MAXDESCLEN);
@@ -806,6 +1171,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "number of relation cache entry", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "parse_cache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->parse_cache_size);
+	StrNCpy(status[i].desc, "number of parse tree cache entry", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "check_temp_table", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->check_temp_table);
 	StrNCpy(status[i].desc, "enable temporary table check", POOLCONFIG_MAXDESCLEN);
@@ -818,7 +1188,22 @@ get_config(int *nrows)
 
 	StrNCpy(status[i].name, "enable_shared_relcache", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->enable_shared_relcache);
-	StrNCpy(status[i].desc, "If true, relation cache stored in memory cache", POOLCONFIG_MAXDESCLEN);
+	StrNCpy(status[i].desc, "If true, relation cache is shared among child processes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "shared_relcache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->shared_relcache_size);
+	StrNCpy(status[i].desc, "number of shared relation cache entry", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "relcache_background_refresh", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->relcache_background_refresh);
+	StrNCpy(status[i].desc, "if true, refresh expired shared relation cache entries in background", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "relcache_prefetch", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->relcache_prefetch);
+	StrNCpy(status[i].desc, "if true, fetch session independent catalog information in background", POOLCONFIG_MAXDESCLEN);
 	i++;
 
 	StrNCpy(status[i].name, "relcache_query_target", POOLCONFIG_MAXNAMELEN);
@@ -859,6 +1244,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "command executed when leader pgpool resigns occurs", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "wd_parallel_escalation", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->wd_parallel_escalation);
+	StrNCpy(status[i].desc, "run escalation command and delegate IP commands concurrently", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "trusted_servers", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->trusted_servers);
 	StrNCpy(status[i].desc, "upper server list to observe connection", POOLCONFIG_MAXDESCLEN);
@@ -869,6 +1259,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "command executed when upper servers are observed", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "trusted_server_use_icmp", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->trusted_server_use_icmp);
+	StrNCpy(status[i].desc, "ping upper servers with ICMP sockets", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "delegate_ip", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->delegate_ip);
 	StrNCpy(status[i].desc, "delegate IP address of leader pgpool", POOLCONFIG_MAXDESCLEN);
@@ -919,6 +1314,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "interval time of sending heartbeat signal (sec)", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "wd_heartbeat_single_process", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->wd_heartbeat_single_process);
+	StrNCpy(status[i].desc, "use one heartbeat process for all destinations", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "wd_heartbeat_deadtime", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->wd_heartbeat_deadtime);
 	StrNCpy(status[i].desc, "deadtime interval for heartbeat signal (sec)", POOLCONFIG_MAXDESCLEN);
@@ -934,6 +1334,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "lifecheck query to pgpool from watchdog", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "wd_lifecheck_persistent_connection", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->wd_lifecheck_persistent_connection);
+	StrNCpy(status[i].desc, "keep lifecheck connections open between checks", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "wd_lifecheck_dbname", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->wd_lifecheck_dbname);
 	StrNCpy(status[i].desc, "database name connected for lifecheck", POOLCONFIG_MAXDESCLEN);
@@ -1060,9 +1465,19 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Cache store method. either shmem(shared memory) or Memcached. shmem by default", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_hash_method", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_hash_method);
+	StrNCpy(status[i].desc, "Hash function used to build query cache keys. either xxhash or md5. xxhash by default", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_compression", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_compression);
+	StrNCpy(status[i].desc, "Compression method of shmem query cache items. either none or lz4. none by default", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_memcached_host", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_memcached_host);
-	StrNCpy(status[i].desc, "Memcached host name. Mandatory if memqcache_method=memcached", POOLCONFIG_MAXDESCLEN);
+	StrNCpy(status[i].desc, "Memcached host name(s). Mandatory if memqcache_method=memcached", POOLCONFIG_MAXDESCLEN);
 	i++;
 
 	StrNCpy(status[i].name, "memqcache_memcached_port", POOLCONFIG_MAXNAMELEN);
@@ -1070,6 +1485,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Memcached port number. Mandatory if memqcache_method=memcached", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_redis_host", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_redis_host);
+	StrNCpy(status[i].desc, "Redis host name. Used if memqcache_method=redis", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_redis_port", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_redis_port);
+	StrNCpy(status[i].desc, "Redis port number. Used if memqcache_method=redis", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_total_size", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%ld", pool_config->memqcache_total_size);
 	StrNCpy(status[i].desc, "Total memory size in bytes for storing memory cache. Mandatory if memqcache_method=shmem", POOLCONFIG_MAXDESCLEN);
@@ -1085,16 +1510,76 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Memory cache entry life time specified in seconds. 60 by default", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_stale_while_revalidate", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_stale_while_revalidate);
+	StrNCpy(status[i].desc, "seconds before expiry in which a cache entry is refreshed", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_paginated_cache_rows", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_paginated_cache_rows);
+	StrNCpy(status[i].desc, "maximum number of rows of an ORDER BY query cached to serve its LIMIT/OFFSET variants", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_coalesce_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_coalesce_timeout);
+	StrNCpy(status[i].desc, "milliseconds to wait for the same query in another child to be cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_auto_cache_invalidation", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_auto_cache_invalidation);
 	StrNCpy(status[i].desc, "If true, invalidation of query cache is triggered by corresponding DDL/DML/DCL(and memqcache_expire).  If false, it is only triggered  by memqcache_expire.  True by default.", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_invalidation_mode", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_invalidation_mode);
+	StrNCpy(status[i].desc, "How query cache invalidation is performed. either sync, async or strict. sync by default", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_invalidation_coalesce", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_invalidation_coalesce);
+	StrNCpy(status[i].desc, "If true, invalidation of the same table is applied only once in a batch", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_admission_filter", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_admission_filter);
+	StrNCpy(status[i].desc, "If true, new shmem cache items are admitted by their access frequency", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_watchdog_invalidation", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_watchdog_invalidation);
+	StrNCpy(status[i].desc, "If true, query cache invalidation is sent to the other pgpool nodes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_logical_slot", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_logical_slot);
+	StrNCpy(status[i].desc, "Logical replication slot to read table changes for query cache invalidation from", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_logical_database", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_logical_database);
+	StrNCpy(status[i].desc, "Database of the logical replication slot", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_logical_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_logical_interval);
+	StrNCpy(status[i].desc, "Milliseconds between reads of the logical replication slot", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_maxcache", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_maxcache);
 	StrNCpy(status[i].desc, "Maximum SELECT result size in bytes", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_local_cache_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_local_cache_size);
+	StrNCpy(status[i].desc, "Size of the per child local query cache in bytes", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_database_quota", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_database_quota);
+	StrNCpy(status[i].desc, "Limits of the shmem query cache used by each database", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_cache_block_size", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_cache_block_size);
 	StrNCpy(status[i].desc, "Cache block size in bytes. 8192 by default", POOLCONFIG_MAXDESCLEN);
@@ -1105,6 +1590,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Temporary work directory to record table oids", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_snapshot_file", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_snapshot_file);
+	StrNCpy(status[i].desc, "File to save the shmem query cache at shutdown and to load it at startup", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_stats_start_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", ctime(&pool_get_memqcache_stats()->start_time));
 	StrNCpy(status[i].desc, "Start time of query cache stats", POOLCONFIG_MAXDESCLEN);
@@ -1201,177 +1691,42 @@ get_config(int *nrows)
 void
 send_config_var_detail_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *name, const char *value, const char *description)
 {
-	int			size;
-	int			hsize;
-	static short num_fields = 3;
-
-	if (MAJOR(backend) == PROTO_MAJOR_V2)
-	{
+	char	   *values[3];
 
-		int			nbytes = (num_fields + 7) / 8;
-		static unsigned char nullmap[2] = {0xff, 0xff};
-
-		/* ascii row */
-		pool_write(frontend, "D", 1);
-		pool_write_and_flush(frontend, nullmap, nbytes);
-
-		size = strlen(name);
-		hsize = htonl(size + 4);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) name, size);
-
-		size = strlen(value);
-		hsize = htonl(size + 4);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) value, size);
-
-		size = strlen(description);
-		hsize = htonl(size + 4);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) description, size);
-	}
-	else
-	{
-		short		s;
-
-		pool_write(frontend, "D", 1);
-		size = 6;				/* int32 + int16; */
-		size += 4 + strlen(name);	/* int32 + data; */
-		size += 4 + strlen(value);	/* int32 + data; */
-		size += 4 + strlen(description);	/* int32 + data; */
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		s = htons(num_fields);
-		pool_write(frontend, &s, sizeof(s));
-
-		size = strlen(name);
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) name, size);
-
-		size = strlen(value);
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) value, size);
-
-		size = strlen(description);
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) description, size);
-	}
+	values[0] = (char *) name;
+	values[1] = (char *) value;
+	values[2] = (char *) description;
+	send_data_row(frontend, backend, 3, values);
 }
 
 void
 send_config_var_value_only_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *value)
 {
-	int			size;
-	int			hsize;
-	static short num_fields = 1;
-
-	if (MAJOR(backend) == PROTO_MAJOR_V2)
-	{
-
-		int			nbytes = (num_fields + 7) / 8;
-		static unsigned char nullmap[2] = {0xff, 0xff};
-
-		/* ascii row */
-		pool_write(frontend, "D", 1);
-		pool_write_and_flush(frontend, nullmap, nbytes);
-
-		size = strlen(value);
-		hsize = htonl(size + 4);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) value, size);
+	char	   *values[1];
 
-	}
-	else
-	{
-		short		s;
-
-		pool_write(frontend, "D", 1);
-		size = 6;				/* int32 + int16; */
-		size += 4 + strlen(value);	/* int32 + data; */
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		s = htons(num_fields);
-		pool_write(frontend, &s, sizeof(s));
-
-		size = strlen(value);
-		hsize = htonl(size);
-		pool_write(frontend, &hsize, sizeof(hsize));
-		pool_write(frontend, (void *) value, size);
-	}
+	values[0] = (char *) value;
+	send_data_row(frontend, backend, 1, values);
 }
 
 void
 config_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
 	static char *field_names[] = {"item", "value", "description"};
-	static unsigned char nullmap[2] = {0xff, 0xff};
 	static short num_fields = 3;
-	short		s;
-	int			nbytes = (num_fields + 7) / 8;
-	int			len;
+	char	   *values[3];
 	int			nrows;
-	int			size;
-	int			hsize;
 	int			i;
 
 	POOL_REPORT_CONFIG *status = get_config(&nrows);
 
 	send_row_description(frontend, backend, num_fields, field_names);
 
-	if (MAJOR(backend) == PROTO_MAJOR_V2)
+	for (i = 0; i < nrows; i++)
 	{
-		/* ascii row */
-		for (i = 0; i < nrows; i++)
-		{
-			pool_write(frontend, "D", 1);
-			pool_write_and_flush(frontend, nullmap, nbytes);
-
-			size = strlen(status[i].name);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, status[i].name, size);
-
-			size = strlen(status[i].value);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, status[i].value, size);
-
-			size = strlen(status[i].desc);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, status[i].desc, size);
-		}
-	}
-	else
-	{
-		/* data row */
-		for (i = 0; i < nrows; i++)
-		{
-			pool_write(frontend, "D", 1);
-			len = 6;			/* int32 + int16; */
-			len += 4 + strlen(status[i].name);	/* int32 + data; */
-			len += 4 + strlen(status[i].value); /* int32 + data; */
-			len += 4 + strlen(status[i].desc);	/* int32 + data; */
-			len = htonl(len);
-			pool_write(frontend, &len, sizeof(len));
-			s = htons(num_fields);
-			pool_write(frontend, &s, sizeof(s));
-
-			len = htonl(strlen(status[i].name));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, status[i].name, strlen(status[i].name));
-
-			len = htonl(strlen(status[i].value));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, status[i].value, strlen(status[i].value));
-
-			len = htonl(strlen(status[i].desc));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, status[i].desc, strlen(status[i].desc));
-		}
+		values[0] = status[i].name;
+		values[1] = status[i].value;
+		values[2] = status[i].desc;
+		send_data_row(frontend, backend, num_fields, values);
 	}
 
 	send_complete_and_ready(frontend, backend, "SELECT", nrows);
@@ -1391,6 +1746,9 @@ get_nodes(int *nrows, int node_id)
 	BackendInfo *bi = NULL;
 	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
 	struct tm	tm;
+	double		weights[MAX_NUM_BACKENDS];
+
+	pool_get_effective_weights(weights);
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
@@ -1404,6 +1762,7 @@ get_nodes(int *nrows, int node_id)
 		snprintf(nodes[i].port, POOLCONFIG_MAXPORTLEN, "%d", bi->backend_port);
 		snprintf(nodes[i].status, POOLCONFIG_MAXSTATLEN, "%s", backend_status_to_str(bi));
 		snprintf(nodes[i].lb_weight, POOLCONFIG_MAXWEIGHTLEN, "%f", bi->backend_weight / RAND_MAX);
+		snprintf(nodes[i].effective_weight, POOLCONFIG_MAXWEIGHTLEN, "%f", weights[i] / RAND_MAX);
 		snprintf(nodes[i].select, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_select_count(i));
 		if (session_context)
 			snprintf(nodes[i].load_balance_node, POOLCONFIG_MAXWEIGHTLEN, "%s",
@@ -1478,7 +1837,8 @@ nodes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
 	static char *field_names[] = {"node_id", "hostname", "port", "status", "pg_status", "lb_weight", "role",
 								  "pg_role", "select_cnt", "load_balance_node", "replication_delay",
-								  "replication_state", "replication_sync_state", "last_status_change"};
+								  "replication_state", "replication_sync_state", "last_status_change",
+								  "effective_weight"};
 
 	static int offsettbl[] = {
 		offsetof(POOL_REPORT_NODES, node_id),
@@ -1494,7 +1854,8 @@ nodes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		offsetof(POOL_REPORT_NODES, delay),
 		offsetof(POOL_REPORT_NODES, rep_state),
 		offsetof(POOL_REPORT_NODES, rep_sync_state),
-		offsetof(POOL_REPORT_NODES, last_status_change)
+		offsetof(POOL_REPORT_NODES, last_status_change),
+		offsetof(POOL_REPORT_NODES, effective_weight)
 	};
 
 	int	nrows;
@@ -1517,8 +1878,30 @@ nodes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 POOL_REPORT_POOLS *
 get_pools(int *nrows)
 {
-	int			child,
-				pool,
+	int			child;
+	int			lines = 0;
+
+	POOL_REPORT_POOLS *pools = palloc0(
+		pool_config->num_init_children * pool_config->max_pool * NUM_BACKENDS * sizeof(POOL_REPORT_POOLS)
+	);
+
+	for (child = 0; child < pool_config->num_init_children; child++)
+		lines += get_pools_of_child(child, pools + lines, false);
+
+	*nrows = lines;
+	return pools;
+}
+
+/*
+ * Fill "pools" with the rows of the pool slots of a child process and
+ * return the number of rows.  "pools" must have room for max_pool *
+ * NUM_BACKENDS rows.  If active_only is true, only the slots holding a
+ * backend connection are returned.
+ */
+static int
+get_pools_of_child(int child, POOL_REPORT_POOLS * pools, bool active_only)
+{
+	int			pool,
 				poolBE,
 				backend_id;
 
@@ -1526,292 +1909,409 @@ get_pools(int *nrows)
 	int			proc_id;
 
 	int			lines = 0;
+	int			exist_live_connection = 0;
 
-	POOL_REPORT_POOLS *pools = palloc0(
-		pool_config->num_init_children * pool_config->max_pool * NUM_BACKENDS * sizeof(POOL_REPORT_POOLS)
-	);
+	pi = &process_info[child];
+	proc_id = pi->pid;
 
-	for (child = 0; child < pool_config->num_init_children; child++)
+	for (pool = 0; pool < pool_config->max_pool; pool++)
 	{
-		int exist_live_connection = 0;
+		poolBE = pool * MAX_NUM_BACKENDS;
+		if (pi->connection_info[poolBE].connected)
+		{
+			exist_live_connection = 1;
+			break;
+		}
+	}
 
-		pi = &process_info[child];
-		proc_id = pi->pid;
 
-		for (pool = 0; pool < pool_config->max_pool; pool++)
+	for (pool = 0; pool < pool_config->max_pool; pool++)
+	{
+		int idle_duration = pi->connection_info[pool * MAX_NUM_BACKENDS].client_idle_duration;
+		int load_balancing_node_id = pi->connection_info[pool * MAX_NUM_BACKENDS].load_balancing_node;
+		int client_idle_time = pool_config->client_idle_limit;
+
+		if (pool_config->client_idle_limit > 0)
 		{
-			poolBE = pool * MAX_NUM_BACKENDS;
-			if (pi->connection_info[poolBE].connected)
-			{
-				exist_live_connection = 1;
-				break;
-			}
+			client_idle_time = pool_config->client_idle_limit - idle_duration;
 		}
 
-
-		for (pool = 0; pool < pool_config->max_pool; pool++)
+		for (backend_id = 0; backend_id < NUM_BACKENDS; backend_id++)
 		{
-			int idle_duration = pi->connection_info[pool * MAX_NUM_BACKENDS].client_idle_duration;
-			int load_balancing_node_id = pi->connection_info[pool * MAX_NUM_BACKENDS].load_balancing_node;
-			int client_idle_time = pool_config->client_idle_limit;
+			poolBE = pool * MAX_NUM_BACKENDS + backend_id;
+			if (active_only && *pi->connection_info[poolBE].database == '\0')
+				continue;
 
-			if (pool_config->client_idle_limit > 0)
-			{
-				client_idle_time = pool_config->client_idle_limit - idle_duration;
-			}
+			snprintf(pools[lines].pool_pid, sizeof(pools[lines].pool_pid), "%d", proc_id);
 
-			for (backend_id = 0; backend_id < NUM_BACKENDS; backend_id++)
+			if (pi->start_time)
 			{
-				poolBE = pool * MAX_NUM_BACKENDS + backend_id;
-				snprintf(pools[lines].pool_pid, sizeof(pools[lines].pool_pid), "%d", proc_id);
-
-				if (pi->start_time)
+				if ((pool_config->child_life_time > 0)
+					&& (pi->connected)
+					&& (!exist_live_connection))
 				{
-					if ((pool_config->child_life_time > 0)
-						&& (pi->connected)
-						&& (!exist_live_connection))
-					{
-						char proc_start_time[POOLCONFIG_MAXDATELEN + 1];
-						int wait_for_connect_time = pool_config->child_life_time - pi->wait_for_connect;
-
-						strftime(proc_start_time, sizeof(proc_start_time),
-								 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
-						snprintf(pools[lines].process_start_time, sizeof(pools[lines].process_start_time),
-								 "%s (%d:%02d before process restarting)", proc_start_time,
-								 wait_for_connect_time / 60,
-								 wait_for_connect_time % 60);
-					}
-					else
-					{
-						strftime(pools[lines].process_start_time, sizeof(pools[lines].process_start_time),
-								 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
-					}
+					char proc_start_time[POOLCONFIG_MAXDATELEN + 1];
+					int wait_for_connect_time = pool_config->child_life_time - pi->wait_for_connect;
+
+					strftime(proc_start_time, sizeof(proc_start_time),
+							 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+					snprintf(pools[lines].process_start_time, sizeof(pools[lines].process_start_time),
+							 "%s (%d:%02d before process restarting)", proc_start_time,
+							 wait_for_connect_time / 60,
+							 wait_for_connect_time % 60);
 				}
 				else
-					*(pools[lines].process_start_time) = '\0';
+				{
+					strftime(pools[lines].process_start_time, sizeof(pools[lines].process_start_time),
+							 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+				}
+			}
+			else
+				*(pools[lines].process_start_time) = '\0';
 
-				snprintf(pools[lines].pool_id, sizeof(pools[lines].pool_id), "%d", pool);
+			snprintf(pools[lines].pool_id, sizeof(pools[lines].pool_id), "%d", pool);
 
-				snprintf(pools[lines].backend_id, sizeof(pools[lines].backend_id), "%d", backend_id);
+			snprintf(pools[lines].backend_id, sizeof(pools[lines].backend_id), "%d", backend_id);
 
-				snprintf(pools[lines].client_connection_count, sizeof(pools[lines].client_connection_count),
-						 "%d", pi->client_connection_count);
+			snprintf(pools[lines].client_connection_count, sizeof(pools[lines].client_connection_count),
+					 "%d", pi->client_connection_count);
 
-				if (pi->connection_info[poolBE].client_connection_time == 0)
-				{
-					*(pools[lines].client_connection_time) = '\0';
-				}
-				else
-				{
-					strftime(pools[lines].client_connection_time, sizeof(pools[lines].client_connection_time),
-						 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].client_connection_time));
-				}
-
-				if (pi->connection_info[poolBE].client_disconnection_time == 0)
-				{
-					*(pools[lines].client_disconnection_time) = '\0';
-				}
-				else
-				{
-					strftime(pools[lines].client_disconnection_time, sizeof(pools[lines].client_disconnection_time),
-						 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].client_disconnection_time));
-				}
+			if (pi->connection_info[poolBE].client_connection_time == 0)
+			{
+				*(pools[lines].client_connection_time) = '\0';
+			}
+			else
+			{
+				strftime(pools[lines].client_connection_time, sizeof(pools[lines].client_connection_time),
+					 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].client_connection_time));
+			}
 
-				if ((pool_config->client_idle_limit > 0)
-					&& (pi->connection_info[poolBE].connected))
-				{
-					snprintf(pools[lines].client_idle_duration, sizeof(pools[lines].client_idle_duration),
-							 "%d (%d:%02d before client disconnected)", idle_duration,
-							 client_idle_time / 60,
-							 client_idle_time % 60);
-				}
-				else
-					snprintf(pools[lines].client_idle_duration, sizeof(pools[lines].client_idle_duration),
-							 "%d", idle_duration);
+			if (pi->connection_info[poolBE].client_disconnection_time == 0)
+			{
+				*(pools[lines].client_disconnection_time) = '\0';
+			}
+			else
+			{
+				strftime(pools[lines].client_disconnection_time, sizeof(pools[lines].client_disconnection_time),
+					 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].client_disconnection_time));
+			}
 
-				if (strlen(pi->connection_info[poolBE].database) == 0)
-				{
-					StrNCpy(pools[lines].database, "", POOLCONFIG_MAXIDENTLEN);
-					StrNCpy(pools[lines].username, "", POOLCONFIG_MAXIDENTLEN);
-					*(pools[lines].backend_connection_time) = '\0';
-					snprintf(pools[lines].pool_majorversion, sizeof(pools[lines].pool_majorversion), "%d", 0);
-					snprintf(pools[lines].pool_minorversion, sizeof(pools[lines].pool_minorversion), "%d", 0);
-				}
-				else
-				{
-					StrNCpy(pools[lines].database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
-					StrNCpy(pools[lines].username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
-					strftime(pools[lines].backend_connection_time, sizeof(pools[lines].backend_connection_time),
-							 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
-					snprintf(pools[lines].pool_majorversion, sizeof(pools[lines].pool_majorversion), "%d",
-							 pi->connection_info[poolBE].major);
-					snprintf(pools[lines].pool_minorversion, sizeof(pools[lines].pool_minorversion), "%d",
-							 pi->connection_info[poolBE].minor);
-				}
-				snprintf(pools[lines].pool_counter, sizeof(pools[lines].pool_counter), "%d",
-						 pi->connection_info[poolBE].counter);
-				snprintf(pools[lines].pool_backendpid, sizeof(pools[lines].pool_backendpid), "%d",
-						 ntohl(pi->connection_info[poolBE].pid));
-				snprintf(pools[lines].pool_connected, sizeof(pools[lines].pool_connected), "%d",
-						 pi->connection_info[poolBE].connected);
-
-				switch(pi->status)
-				{
-					case WAIT_FOR_CONNECT:
-						StrNCpy(pools[lines].status, "Wait for connection", POOLCONFIG_MAXPROCESSSTATUSLEN);
-						break;
-					case COMMAND_EXECUTE:
-						StrNCpy(pools[lines].status, "Execute command", POOLCONFIG_MAXPROCESSSTATUSLEN);
-						break;
-					case IDLE:
-						StrNCpy(pools[lines].status, "Idle", POOLCONFIG_MAXPROCESSSTATUSLEN);
-						break;
-					case IDLE_IN_TRANS:
-						StrNCpy(pools[lines].status, "Idle in transaction", POOLCONFIG_MAXPROCESSSTATUSLEN);
-						break;
-					case CONNECTING:
-						StrNCpy(pools[lines].status, "Connecting", POOLCONFIG_MAXPROCESSSTATUSLEN);
-						break;
-					default:
-						*(pools[lines].status) = '\0';
-				}
+			if ((pool_config->client_idle_limit > 0)
+				&& (pi->connection_info[poolBE].connected))
+			{
+				snprintf(pools[lines].client_idle_duration, sizeof(pools[lines].client_idle_duration),
+						 "%d (%d:%02d before client disconnected)", idle_duration,
+						 client_idle_time / 60,
+						 client_idle_time % 60);
+			}
+			else
+				snprintf(pools[lines].client_idle_duration, sizeof(pools[lines].client_idle_duration),
+						 "%d", idle_duration);
 
-				if (pi->connection_info[poolBE].connected && backend_id == load_balancing_node_id)
-					StrNCpy(pools[lines].load_balance_node, "1", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				else
-					StrNCpy(pools[lines].load_balance_node, "0", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				lines++;
+			if (strlen(pi->connection_info[poolBE].database) == 0)
+			{
+				StrNCpy(pools[lines].database, "", POOLCONFIG_MAXIDENTLEN);
+				StrNCpy(pools[lines].username, "", POOLCONFIG_MAXIDENTLEN);
+				*(pools[lines].backend_connection_time) = '\0';
+				snprintf(pools[lines].pool_majorversion, sizeof(pools[lines].pool_majorversion), "%d", 0);
+				snprintf(pools[lines].pool_minorversion, sizeof(pools[lines].pool_minorversion), "%d", 0);
+			}
+			else
+			{
+				StrNCpy(pools[lines].database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
+				StrNCpy(pools[lines].username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
+				strftime(pools[lines].backend_connection_time, sizeof(pools[lines].backend_connection_time),
+						 "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
+				snprintf(pools[lines].pool_majorversion, sizeof(pools[lines].pool_majorversion), "%d",
+						 pi->connection_info[poolBE].major);
+				snprintf(pools[lines].pool_minorversion, sizeof(pools[lines].pool_minorversion), "%d",
+						 pi->connection_info[poolBE].minor);
 			}
+			snprintf(pools[lines].pool_counter, sizeof(pools[lines].pool_counter), "%d",
+					 pi->connection_info[poolBE].counter);
+			snprintf(pools[lines].pool_backendpid, sizeof(pools[lines].pool_backendpid), "%d",
+					 ntohl(pi->connection_info[poolBE].pid));
+			snprintf(pools[lines].pool_connected, sizeof(pools[lines].pool_connected), "%d",
+					 pi->connection_info[poolBE].connected);
+
+			switch(pi->status)
+			{
+				case WAIT_FOR_CONNECT:
+					StrNCpy(pools[lines].status, "Wait for connection", POOLCONFIG_MAXPROCESSSTATUSLEN);
+					break;
+				case COMMAND_EXECUTE:
+					StrNCpy(pools[lines].status, "Execute command", POOLCONFIG_MAXPROCESSSTATUSLEN);
+					break;
+				case IDLE:
+					StrNCpy(pools[lines].status, "Idle", POOLCONFIG_MAXPROCESSSTATUSLEN);
+					break;
+				case IDLE_IN_TRANS:
+					StrNCpy(pools[lines].status, "Idle in transaction", POOLCONFIG_MAXPROCESSSTATUSLEN);
+					break;
+				case CONNECTING:
+					StrNCpy(pools[lines].status, "Connecting", POOLCONFIG_MAXPROCESSSTATUSLEN);
+					break;
+				default:
+					*(pools[lines].status) = '\0';
+			}
+
+			if (pi->connection_info[poolBE].connected && backend_id == load_balancing_node_id)
+				StrNCpy(pools[lines].load_balance_node, "1", POOLCONFIG_MAXPROCESSSTATUSLEN);
+			else
+				StrNCpy(pools[lines].load_balance_node, "0", POOLCONFIG_MAXPROCESSSTATUSLEN);
+
+			snprintf(pools[lines].pool_evictions, sizeof(pools[lines].pool_evictions),
+					 "%d", pi->pool_evictions);
+			SET_STAGE_COLUMNS(&pools[lines], pi);
+			lines++;
 		}
 	}
 
-	*nrows = lines;
-	return pools;
+	return lines;
 }
 
 /*
- * SHOW　pool_pools;
+ * SHOW　pool_pools and SHOW pool_pools_active;
+ *
+ * The rows are generated and sent one child process at a time, so that the
+ * memory used does not grow with num_init_children.
  */
 void
-pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, bool active_only)
 {
 	short num_fields;
 	static char *field_names[] = {"pool_pid", "start_time", "client_connection_count", "pool_id",
 								  "backend_id", "database", "username", "backend_connection_time",
 								  "client_connection_time", "client_disconnection_time", "client_idle_duration",
 								  "majorversion", "minorversion", "pool_counter", "pool_backendpid", "pool_connected",
-								  "status", "load_balance_node"};
+								  "status", "load_balance_node", "pool_evictions"};
 	int		n;
 	int		*offsettbl;
-	int		nrows;
+	int		nrows = 0;
+	int		child;
 	POOL_REPORT_POOLS *pools;
 
 	num_fields = sizeof(field_names) / sizeof(char *);
+
+	/*
+	 * The offsets are shared with pcp_proc_info, which also gets the stage
+	 * columns following pool_evictions.  They are left to SHOW
+	 * POOL_PROCESSES here, so only the first num_fields are sent.
+	 */
 	offsettbl = pool_report_pools_offsets(&n);
-	pools = get_pools(&nrows);
+	pools = palloc0(pool_config->max_pool * NUM_BACKENDS * sizeof(POOL_REPORT_POOLS));
 
-	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
-									   (char *)pools, sizeof(POOL_REPORT_POOLS), nrows);
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (child = 0; child < pool_config->num_init_children; child++)
+	{
+		int			lines = get_pools_of_child(child, pools, active_only);
+
+		send_data_rows(frontend, backend, num_fields, offsettbl,
+					   (char *) pools, sizeof(POOL_REPORT_POOLS), lines);
+		nrows += lines;
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
 
 	pfree(pools);
 }
 
 /*
- * Used by SHOW pool_processes
+ * SHOW pool_pools_summary;
+ *
+ * One row per backend node with the number of pool slots connected to it,
+ * instead of one row per slot.
  */
-POOL_REPORT_PROCESSES *
-get_processes(int *nrows)
+void
+pools_summary_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
+	static char *field_names[] = {"backend_id", "pooled_connections", "active_connections",
+								  "idle_connections", "processes_with_connections"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
+	int			pooled[MAX_NUM_BACKENDS];
+	int			active[MAX_NUM_BACKENDS];
+	int			processes[MAX_NUM_BACKENDS];
 	int			child;
 	int			pool;
-	int			poolBE;
-	ProcessInfo *pi = NULL;
-	int			proc_id;
+	int			i;
 
-	POOL_REPORT_PROCESSES *processes = palloc0(pool_config->num_init_children * sizeof(POOL_REPORT_PROCESSES));
+	memset(pooled, 0, sizeof(pooled));
+	memset(active, 0, sizeof(active));
+	memset(processes, 0, sizeof(processes));
 
 	for (child = 0; child < pool_config->num_init_children; child++)
 	{
-		int exist_live_connection = 0;
+		ProcessInfo *pi = &process_info[child];
+		bool		has_connection[MAX_NUM_BACKENDS];
 
-		pi = &process_info[child];
-		proc_id = pi->pid;
+		memset(has_connection, 0, sizeof(has_connection));
 
 		for (pool = 0; pool < pool_config->max_pool; pool++)
 		{
-			poolBE = pool * MAX_NUM_BACKENDS;
-			if (pi->connection_info[poolBE].connected)
+			for (i = 0; i < NUM_BACKENDS; i++)
 			{
-				exist_live_connection = 1;
-				break;
+				ConnectionInfo *con = &pi->connection_info[pool * MAX_NUM_BACKENDS + i];
+
+				if (*con->database == '\0')
+					continue;
+
+				pooled[i]++;
+				if (con->connected)
+					active[i]++;
+				has_connection[i] = true;
 			}
 		}
 
-		snprintf(processes[child].pool_pid, POOLCONFIG_MAXCOUNTLEN, "%d", proc_id);
-		if ((pool_config->child_life_time > 0)
-			&& (pi->connected)
-			&& (!exist_live_connection))
+		for (i = 0; i < NUM_BACKENDS; i++)
 		{
-			char proc_start_time[POOLCONFIG_MAXDATELEN + 1];
-			int wait_for_connect_time = pool_config->child_life_time - pi->wait_for_connect;
-
-			strftime(proc_start_time, sizeof(proc_start_time),
-					 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
-			snprintf(processes[child].process_start_time, sizeof(processes[child].process_start_time),
-					 "%s (%d:%02d before process restarting)", proc_start_time,
-					 wait_for_connect_time / 60,
-					 wait_for_connect_time % 60);
+			if (has_connection[i])
+				processes[i]++;
 		}
-		else
-		{
-			strftime(processes[child].process_start_time, sizeof(processes[child].process_start_time),
-					 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
-		}
-		snprintf(processes[child].client_connection_count, sizeof(processes[child].client_connection_count),
-				 "%d", pi->client_connection_count);
-		StrNCpy(processes[child].database, "", POOLCONFIG_MAXIDENTLEN);
-		StrNCpy(processes[child].username, "", POOLCONFIG_MAXIDENTLEN);
-		StrNCpy(processes[child].backend_connection_time, "", POOLCONFIG_MAXDATELEN);
-		StrNCpy(processes[child].pool_counter, "", POOLCONFIG_MAXCOUNTLEN);
+	}
 
-		for (pool = 0; pool < pool_config->max_pool; pool++)
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		char	   *values[5];
+		int			j;
+
+		values[0] = psprintf("%d", i);
+		values[1] = psprintf("%d", pooled[i]);
+		values[2] = psprintf("%d", active[i]);
+		values[3] = psprintf("%d", pooled[i] - active[i]);
+		values[4] = psprintf("%d", processes[i]);
+
+		send_data_row(frontend, backend, num_fields, values);
+
+		for (j = 0; j < num_fields; j++)
+			pfree(values[j]);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", NUM_BACKENDS);
+}
+
+/*
+ * Returns the name of a child process status shown by SHOW POOL_PROCESSES
+ * and SHOW POOL_MEMORY.
+ */
+static const char *
+process_status_string(ProcessStatus status)
+{
+	switch (status)
+	{
+		case WAIT_FOR_CONNECT:
+			return "Wait for connection";
+		case COMMAND_EXECUTE:
+			return "Execute command";
+		case IDLE:
+			return "Idle";
+		case IDLE_IN_TRANS:
+			return "Idle in transaction";
+		case CONNECTING:
+			return "Connecting";
+		default:
+			return "";
+	}
+}
+
+/*
+ * Used by SHOW pool_processes
+ */
+POOL_REPORT_PROCESSES *
+get_processes(int *nrows)
+{
+	int			child;
+
+	POOL_REPORT_PROCESSES *processes = palloc0(pool_config->num_init_children * sizeof(POOL_REPORT_PROCESSES));
+
+	for (child = 0; child < pool_config->num_init_children; child++)
+		get_process_of_child(child, &processes[child]);
+
+	*nrows = child;
+
+	return processes;
+}
+
+/*
+ * Fill "process" with the row of a child process.
+ */
+static void
+get_process_of_child(int child, POOL_REPORT_PROCESSES * process)
+{
+	int			pool;
+	int			poolBE;
+	ProcessInfo *pi = NULL;
+	int			proc_id;
+	int			exist_live_connection = 0;
+
+	pi = &process_info[child];
+	proc_id = pi->pid;
+
+	for (pool = 0; pool < pool_config->max_pool; pool++)
+	{
+		poolBE = pool * MAX_NUM_BACKENDS;
+		if (pi->connection_info[poolBE].connected)
 		{
-			poolBE = pool * MAX_NUM_BACKENDS;
-			if (pi->connection_info[poolBE].connected &&
-				strlen(pi->connection_info[poolBE].database) > 0 &&
-				strlen(pi->connection_info[poolBE].user) > 0)
-			{
-				StrNCpy(processes[child].database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
-				StrNCpy(processes[child].username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
-				strftime(processes[child].backend_connection_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
-				snprintf(processes[child].pool_counter, POOLCONFIG_MAXCOUNTLEN, "%d", pi->connection_info[poolBE].counter);
-			}
+			exist_live_connection = 1;
+			break;
 		}
-		switch(pi->status)
+	}
+
+	snprintf(process->pool_pid, POOLCONFIG_MAXCOUNTLEN, "%d", proc_id);
+	if ((pool_config->child_life_time > 0)
+		&& (pi->connected)
+		&& (!exist_live_connection))
+	{
+		char proc_start_time[POOLCONFIG_MAXDATELEN + 1];
+		int wait_for_connect_time = pool_config->child_life_time - pi->wait_for_connect;
+
+		strftime(proc_start_time, sizeof(proc_start_time),
+				 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+		snprintf(process->process_start_time, sizeof(process->process_start_time),
+				 "%s (%d:%02d before process restarting)", proc_start_time,
+				 wait_for_connect_time / 60,
+				 wait_for_connect_time % 60);
+	}
+	else
+	{
+		strftime(process->process_start_time, sizeof(process->process_start_time),
+				 "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+	}
+	snprintf(process->client_connection_count, sizeof(process->client_connection_count),
+			 "%d", pi->client_connection_count);
+	StrNCpy(process->database, "", POOLCONFIG_MAXIDENTLEN);
+	StrNCpy(process->username, "", POOLCONFIG_MAXIDENTLEN);
+	StrNCpy(process->backend_connection_time, "", POOLCONFIG_MAXDATELEN);
+	StrNCpy(process->pool_counter, "", POOLCONFIG_MAXCOUNTLEN);
+
+	for (pool = 0; pool < pool_config->max_pool; pool++)
+	{
+		poolBE = pool * MAX_NUM_BACKENDS;
+		if (pi->connection_info[poolBE].connected &&
+			strlen(pi->connection_info[poolBE].database) > 0 &&
+			strlen(pi->connection_info[poolBE].user) > 0)
 		{
-			case WAIT_FOR_CONNECT:
-				StrNCpy(processes[child].status, "Wait for connection", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				break;
-			case COMMAND_EXECUTE:
-				StrNCpy(processes[child].status, "Execute command", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				break;
-			case IDLE:
-				StrNCpy(processes[child].status, "Idle", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				break;
-			case IDLE_IN_TRANS:
-				StrNCpy(processes[child].status, "Idle in transaction", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				break;
-			case CONNECTING:
-				StrNCpy(processes[child].status, "Connecting", POOLCONFIG_MAXPROCESSSTATUSLEN);
-				break;
-			default:
-				*(processes[child].status) = '\0';
+			StrNCpy(process->database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
+			StrNCpy(process->username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
+			strftime(process->backend_connection_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
+			snprintf(process->pool_counter, POOLCONFIG_MAXCOUNTLEN, "%d", pi->connection_info[poolBE].counter);
 		}
 	}
+	StrNCpy(process->status, process_status_string(pi->status), POOLCONFIG_MAXPROCESSSTATUSLEN);
+	snprintf(process->buffer_memory, sizeof(process->buffer_memory),
+			 "%d", pi->buffer_memory);
+	SET_STAGE_COLUMNS(process, pi);
+}
 
-	*nrows = child;
-
-	return processes;
+/*
+ * Format the time a child process has spent in a stage, in milliseconds.
+ */
+static void
+format_stage_time(char *buf, ProcessInfo * pi, PoolStage stage)
+{
+	snprintf(buf, POOLCONFIG_MAXLONGCOUNTLEN + 1, "%.3f", pi->stage_time[stage] / 1000.0);
 }
 
 /*
@@ -1821,7 +2321,10 @@ void
 processes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
 	static char *field_names[] = {"pool_pid", "start_time", "client_connection_count",
-								  "database", "username", "backend_connection_time", "pool_counter", "status"};
+								  "database", "username", "backend_connection_time", "pool_counter", "status",
+								  "buffer_memory", "wait_state", "client_read_time", "parse_time",
+								  "route_time", "relcache_time", "cache_lock_time", "backend_wait_time",
+								  "client_write_time"};
 
 	static int offsettbl[] = {
 		offsetof(POOL_REPORT_PROCESSES, pool_pid),
@@ -1832,17 +2335,36 @@ processes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		offsetof(POOL_REPORT_PROCESSES, backend_connection_time),
 		offsetof(POOL_REPORT_PROCESSES, pool_counter),
 		offsetof(POOL_REPORT_PROCESSES, status),
+		offsetof(POOL_REPORT_PROCESSES, buffer_memory),
+		offsetof(POOL_REPORT_PROCESSES, wait_state),
+		offsetof(POOL_REPORT_PROCESSES, client_read_time),
+		offsetof(POOL_REPORT_PROCESSES, parse_time),
+		offsetof(POOL_REPORT_PROCESSES, route_time),
+		offsetof(POOL_REPORT_PROCESSES, relcache_time),
+		offsetof(POOL_REPORT_PROCESSES, cache_lock_time),
+		offsetof(POOL_REPORT_PROCESSES, backend_wait_time),
+		offsetof(POOL_REPORT_PROCESSES, client_write_time),
 	};
 
-	int	nrows;
+	int			child;
 	short		num_fields;
 	POOL_REPORT_PROCESSES *processes;
 
 	num_fields = sizeof(field_names) / sizeof(char *);
-	processes = get_processes(&nrows);
 
-	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
-									   (char *)processes, sizeof(POOL_REPORT_PROCESSES), nrows);
+	/* send the rows one child process at a time rather than building all */
+	processes = palloc0(sizeof(POOL_REPORT_PROCESSES));
+
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (child = 0; child < pool_config->num_init_children; child++)
+	{
+		get_process_of_child(child, processes);
+		send_data_rows(frontend, backend, num_fields, offsettbl,
+					   (char *) processes, sizeof(POOL_REPORT_PROCESSES), 1);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", child);
 
 	pfree(processes);
 }
@@ -1882,14 +2404,18 @@ version_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 }
 
 /*
- * Show in memory cache reporting
+ * Show in memory cache reporting.  The first row shows the whole cache.  It
+ * is followed by a row for each database, which shows the columns relevant
+ * to the database only.
  */
 void
 cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size"};
+	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size", "num_evicted_entries", "compression_ratio", "database", "cache_quota"};
 	short		num_fields = sizeof(field_names) / sizeof(char *);
 	int			i;
+	int			row;
+	int			nrows;
 	short		s;
 	int			len;
 	int			size;
@@ -1897,10 +2423,12 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	static unsigned char nullmap[2] = {0xff, 0xff};
 	int			nbytes = (num_fields + 7) / 8;
 	volatile	POOL_SHMEM_STATS *mystats;
+	POOL_CACHE_PARTITION *partitions;
+	int			num_partitions;
 	pool_sigset_t oldmask;
 	double		ratio;
 
-#define POOL_CACHE_STATS_MAX_STRING_LEN 32
+#define POOL_CACHE_STATS_MAX_STRING_LEN 64
 	typedef struct
 	{
 		int			len;		/* length of string excluding null terminate */
@@ -1909,8 +2437,6 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 
 	MY_STRING_CACHE_STATS *strp;
 
-	strp = palloc(num_fields * sizeof(MY_STRING_CACHE_STATS));
-
 	/*
 	 * Get raw cache stat data
 	 */
@@ -1920,6 +2446,7 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	PG_TRY();
 	{
 		mystats = pool_get_shmem_storage_stats();
+		partitions = pool_get_cache_partitions(&num_partitions);
 	}
 	PG_CATCH();
 	{
@@ -1931,6 +2458,9 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	pool_shmem_unlock();
 	POOL_SETMASK(&oldmask);
 
+	nrows = 1 + num_partitions;
+	strp = palloc0(nrows * num_fields * sizeof(MY_STRING_CACHE_STATS));
+
 	/*
 	 * Convert to string
 	 */
@@ -1952,59 +2482,161 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->used_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->free_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->fragment_cache_entries_size);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", mystats->cache_stats.num_evicted_entries);
+	if (mystats->stored_cache_data_size == 0)
+	{
+		ratio = 0.0;
+	}
+	else
+	{
+		ratio = (double) mystats->raw_cache_data_size / mystats->stored_cache_data_size;
+	}
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%.2f", ratio);
 
-	/*
-	 * Calculate total data length
-	 */
-	len = 2;					/* number of fields (int16) */
-	for (i = 0; i < num_fields; i++)
+	for (row = 1; row < nrows; row++)
 	{
-		strp[i].len = strlen(strp[i].string);
-		len += 4				/* length of string (int32) */
-			+ strp[i].len;
+		POOL_CACHE_PARTITION *part = &partitions[row - 1];
+		MY_STRING_CACHE_STATS *r = &strp[row * num_fields];
+
+		snprintf(r[0].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", part->num_cache_hits);
+		snprintf(r[1].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", part->num_selects);
+		if ((part->num_cache_hits + part->num_selects) == 0)
+			ratio = 0.0;
+		else
+			ratio = (double) part->num_cache_hits / (part->num_selects + part->num_cache_hits);
+		snprintf(r[2].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%.2f", ratio);
+		snprintf(r[5].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%d", part->num_cache_entries);
+		snprintf(r[6].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", part->used_size);
+		snprintf(r[11].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%s", part->database);
+		snprintf(r[12].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", part->quota);
 	}
+	pfree(partitions);
 
 	/* Send row description */
 	send_row_description(frontend, backend, num_fields, field_names);
 
-	/* Send each field */
-	if (MAJOR(backend) == PROTO_MAJOR_V2)
+	for (row = 0; row < nrows; row++)
 	{
-		pool_write(frontend, "D", 1);
-		pool_write(frontend, nullmap, nbytes);
+		MY_STRING_CACHE_STATS *r = &strp[row * num_fields];
 
+		/*
+		 * Calculate total data length
+		 */
+		len = 2;				/* number of fields (int16) */
 		for (i = 0; i < num_fields; i++)
 		{
-			size = strp[i].len + 1;
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, strp[i].string, size);
+			r[i].len = strlen(r[i].string);
+			len += 4			/* length of string (int32) */
+				+ r[i].len;
 		}
-	}
-	else
-	{
-		/* Kind */
-		pool_write(frontend, "D", 1);
-		/* Packet length */
-		len = htonl(len + sizeof(int32));
-		pool_write(frontend, &len, sizeof(len));
-		/* Number of fields */
-		s = htons(num_fields);
-		pool_write(frontend, &s, sizeof(s));
 
-		for (i = 0; i < num_fields; i++)
+		/* Send each field */
+		if (MAJOR(backend) == PROTO_MAJOR_V2)
 		{
-			hsize = htonl(strp[i].len);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, strp[i].string, strp[i].len);
+			pool_write(frontend, "D", 1);
+			pool_write(frontend, nullmap, nbytes);
+
+			for (i = 0; i < num_fields; i++)
+			{
+				size = r[i].len + 1;
+				hsize = htonl(size + 4);
+				pool_write(frontend, &hsize, sizeof(hsize));
+				pool_write(frontend, r[i].string, size);
+			}
+		}
+		else
+		{
+			/* Kind */
+			pool_write(frontend, "D", 1);
+			/* Packet length */
+			len = htonl(len + sizeof(int32));
+			pool_write(frontend, &len, sizeof(len));
+			/* Number of fields */
+			s = htons(num_fields);
+			pool_write(frontend, &s, sizeof(s));
+
+			for (i = 0; i < num_fields; i++)
+			{
+				hsize = htonl(r[i].len);
+				pool_write(frontend, &hsize, sizeof(hsize));
+				pool_write(frontend, r[i].string, r[i].len);
+			}
 		}
 	}
 
-	send_complete_and_ready(frontend, backend, "SELECT", 1);
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
 
 	pfree(strp);
 }
 
+static int
+compare_duration(const void *a, const void *b)
+{
+	int32		da = *(const int32 *) a;
+	int32		db = *(const int32 *) b;
+
+	return (da > db) - (da < db);
+}
+
+/*
+ * Summarize the recent health checks of the node kept in the history ring:
+ * the 50th and 99th percentiles of the durations of the successful checks,
+ * the number of failed checks, and the trend, which is the average duration
+ * of the newer half of the successful checks minus that of the older half,
+ * in milliseconds.  A positive trend means the node responds slower than it
+ * used to.
+ */
+static void
+set_health_check_history(int node_id, POOL_HEALTH_CHECK_STATS *stats)
+{
+	volatile POOL_HEALTH_CHECK_STATISTICS *st = &health_check_stats[node_id];
+	int32		durations[HEALTH_CHECK_HISTORY_SIZE];
+	int32		sorted[HEALTH_CHECK_HISTORY_SIZE];
+	uint32		count = st->history_count;
+	int			n = Min(count, HEALTH_CHECK_HISTORY_SIZE);
+	int			nok = 0;
+	int			nfail = 0;
+	int			half;
+	double		older = 0;
+	double		newer = 0;
+	int			i;
+
+	/* oldest first */
+	for (i = 0; i < n; i++)
+	{
+		int			slot = (count - n + i) % HEALTH_CHECK_HISTORY_SIZE;
+
+		if (st->history_failed[slot])
+			nfail++;
+		else
+			durations[nok++] = st->history_duration[slot];
+	}
+
+	if (nok > 0)
+	{
+		memcpy(sorted, durations, nok * sizeof(int32));
+		qsort(sorted, nok, sizeof(int32), compare_duration);
+		snprintf(stats->p50_health_check_duration, POOLCONFIG_MAXCOUNTLEN, "%d", sorted[(nok - 1) * 50 / 100]);
+		snprintf(stats->p99_health_check_duration, POOLCONFIG_MAXCOUNTLEN, "%d", sorted[(nok - 1) * 99 / 100]);
+	}
+	else
+	{
+		StrNCpy(stats->p50_health_check_duration, "0", POOLCONFIG_MAXCOUNTLEN);
+		StrNCpy(stats->p99_health_check_duration, "0", POOLCONFIG_MAXCOUNTLEN);
+	}
+
+	half = nok / 2;
+	for (i = 0; i < half; i++)
+	{
+		older += durations[i];
+		newer += durations[nok - half + i];
+	}
+	snprintf(stats->health_check_duration_trend, POOLCONFIG_MAXCOUNTLEN, "%.1f",
+			 half > 0 ? (newer - older) / half : 0.0);
+
+	snprintf(stats->recent_fail_count, POOLCONFIG_MAXCOUNTLEN, "%d", nfail);
+}
+
 /*
  * for SHOW health_check_stats
  */
@@ -2089,6 +2721,8 @@ get_health_check_stats(int *nrows)
 		t = health_check_stats[i].last_failed_health_check;
 		if (t > 0)
 			strftime(stats[i].last_failed_health_check, POOLCONFIG_MAXDATELEN, "%F %T", localtime(&t));
+
+		set_health_check_history(i, &stats[i]);
 	}
 
 	*nrows = i;
@@ -2106,7 +2740,8 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 								  "total_count", "success_count", "fail_count", "skip_count", "retry_count",
 								  "average_retry_count", "max_retry_count", "max_duration", "min_duration",
 								  "average_duration", "last_health_check", "last_successful_health_check",
-								  "last_skip_health_check", "last_failed_health_check"};
+								  "last_skip_health_check", "last_failed_health_check",
+								  "p50_duration", "p99_duration", "duration_trend", "recent_fail_count"};
 	static int offsettbl[] = {
 		offsetof(POOL_HEALTH_CHECK_STATS, node_id),
 		offsetof(POOL_HEALTH_CHECK_STATS, hostname),
@@ -2128,6 +2763,10 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 		offsetof(POOL_HEALTH_CHECK_STATS, last_successful_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_skip_health_check),
 		offsetof(POOL_HEALTH_CHECK_STATS, last_failed_health_check),
+		offsetof(POOL_HEALTH_CHECK_STATS, p50_health_check_duration),
+		offsetof(POOL_HEALTH_CHECK_STATS, p99_health_check_duration),
+		offsetof(POOL_HEALTH_CHECK_STATS, health_check_duration_trend),
+		offsetof(POOL_HEALTH_CHECK_STATS, recent_fail_count),
 	};
 
 	int	nrows;
@@ -2143,6 +2782,23 @@ show_health_check_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 	pfree(stats);
 }
 
+/*
+ * Format the latency percentiles of the node for SHOW backend_stats, in
+ * milliseconds.
+ */
+static void
+set_backend_stats_latency(int node_id, STAT_QUERY_TYPE type, char *p50, char *p95, char *p99)
+{
+	uint64		l50,
+				l95,
+				l99;
+
+	stat_get_latency_percentiles(node_id, type, &l50, &l95, &l99);
+	snprintf(p50, POOLCONFIG_MAXWEIGHTLEN, "%.3f", l50 / 1000.0);
+	snprintf(p95, POOLCONFIG_MAXWEIGHTLEN, "%.3f", l95 / 1000.0);
+	snprintf(p99, POOLCONFIG_MAXWEIGHTLEN, "%.3f", l99 / 1000.0);
+}
+
 /*
  * for SHOW backend_stats
  */
@@ -2153,8 +2809,6 @@ get_backend_stats(int *nrows)
 	POOL_BACKEND_STATS *backend_stats = palloc(NUM_BACKENDS * sizeof(POOL_BACKEND_STATS));
 	BackendInfo *bi = NULL;
 
-	pool_get_session_context(false);
-
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		bi = pool_get_node_info(i);
@@ -2172,6 +2826,20 @@ get_backend_stats(int *nrows)
 		snprintf(backend_stats[i].panic_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_panic_count(i));
 		snprintf(backend_stats[i].fatal_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_fatal_count(i));
 		snprintf(backend_stats[i].error_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_error_count(i));
+		set_backend_stats_latency(i, STAT_QUERY_ALL, backend_stats[i].latency_p50,
+								  backend_stats[i].latency_p95, backend_stats[i].latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_SELECT, backend_stats[i].select_latency_p50,
+								  backend_stats[i].select_latency_p95, backend_stats[i].select_latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_INSERT, backend_stats[i].insert_latency_p50,
+								  backend_stats[i].insert_latency_p95, backend_stats[i].insert_latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_UPDATE, backend_stats[i].update_latency_p50,
+								  backend_stats[i].update_latency_p95, backend_stats[i].update_latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_DELETE, backend_stats[i].delete_latency_p50,
+								  backend_stats[i].delete_latency_p95, backend_stats[i].delete_latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_DDL, backend_stats[i].ddl_latency_p50,
+								  backend_stats[i].ddl_latency_p95, backend_stats[i].ddl_latency_p99);
+		set_backend_stats_latency(i, STAT_QUERY_OTHER, backend_stats[i].other_latency_p50,
+								  backend_stats[i].other_latency_p95, backend_stats[i].other_latency_p99);
 
 		if (STREAM)
 		{
@@ -2206,30 +2874,23 @@ show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
 	static char *field_names[] = {"node_id", "hostname", "port", "status", "role",
 								  "select_cnt", "insert_cnt", "update_cnt", "delete_cnt", "ddl_cnt", "other_cnt",
-								  "panic_cnt", "fatal_cnt", "error_cnt"};
-
-	static int offsettbl[] = {
-		offsetof(POOL_BACKEND_STATS, node_id),
-		offsetof(POOL_BACKEND_STATS, hostname),
-		offsetof(POOL_BACKEND_STATS, port),
-		offsetof(POOL_BACKEND_STATS, status),
-		offsetof(POOL_BACKEND_STATS, role),
-		offsetof(POOL_BACKEND_STATS, select_cnt),
-		offsetof(POOL_BACKEND_STATS, insert_cnt),
-		offsetof(POOL_BACKEND_STATS, update_cnt),
-		offsetof(POOL_BACKEND_STATS, delete_cnt),
-		offsetof(POOL_BACKEND_STATS, ddl_cnt),
-		offsetof(POOL_BACKEND_STATS, other_cnt),
-		offsetof(POOL_BACKEND_STATS, panic_cnt),
-		offsetof(POOL_BACKEND_STATS, fatal_cnt),
-		offsetof(POOL_BACKEND_STATS, error_cnt),
-	};
-
+								  "panic_cnt", "fatal_cnt", "error_cnt",
+								  "latency_p50", "latency_p95", "latency_p99",
+								  "select_latency_p50", "select_latency_p95", "select_latency_p99",
+								  "insert_latency_p50", "insert_latency_p95", "insert_latency_p99",
+								  "update_latency_p50", "update_latency_p95", "update_latency_p99",
+								  "delete_latency_p50", "delete_latency_p95", "delete_latency_p99",
+								  "ddl_latency_p50", "ddl_latency_p95", "ddl_latency_p99",
+								  "other_latency_p50", "other_latency_p95", "other_latency_p99"};
+
+	int		   *offsettbl;
+	int			n;
 	int	nrows;
 	short		num_fields;
 	POOL_BACKEND_STATS *backend_stats;
 
 	num_fields = sizeof(field_names) / sizeof(char *);
+	offsettbl = pool_backend_stats_offsets(&n);
 	backend_stats = get_backend_stats(&nrows);
 
 	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
@@ -2238,6 +2899,174 @@ show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	pfree(backend_stats);
 }
 
+/*
+ * for SHOW pool_process_management_stats
+ */
+POOL_PROCESS_MANAGEMENT_STATS *
+get_process_management_stats(int *nrows)
+{
+	POOL_PROCESS_MANAGEMENT_STATS *stats = palloc0(sizeof(POOL_PROCESS_MANAGEMENT_STATS));
+	volatile POOL_PROCESS_MANAGEMENT_INFO *pm_info = &Req_info->pm_info;
+	struct tm	tm;
+	time_t		t;
+
+	snprintf(stats->current_children, sizeof(stats->current_children), "%d", pm_info->current_children);
+	snprintf(stats->connected_children, sizeof(stats->connected_children), "%d", pm_info->connected_children);
+	snprintf(stats->idle_children, sizeof(stats->idle_children), "%d",
+			 pm_info->current_children - pm_info->connected_children);
+	snprintf(stats->busy_ratio, sizeof(stats->busy_ratio), "%.2f", pm_info->busy_ratio);
+	snprintf(stats->listen_queue_length, sizeof(stats->listen_queue_length), "%d", pm_info->listen_queue_length);
+	snprintf(stats->listen_queue_peak, sizeof(stats->listen_queue_peak), "%d", pm_info->listen_queue_peak);
+	snprintf(stats->accept_rate, sizeof(stats->accept_rate), "%.2f", pm_info->accept_rate);
+	snprintf(stats->estimated_queue_wait, sizeof(stats->estimated_queue_wait), "%.0f", pm_info->estimated_queue_wait);
+	snprintf(stats->total_accepted, sizeof(stats->total_accepted), UINT64_FORMAT, pm_info->total_accepted);
+	snprintf(stats->children_spawned, sizeof(stats->children_spawned), UINT64_FORMAT, pm_info->children_spawned);
+	snprintf(stats->children_retired, sizeof(stats->children_retired), UINT64_FORMAT, pm_info->children_retired);
+
+	t = pm_info->last_scale_up;
+	if (t)
+	{
+		localtime_r(&t, &tm);
+		strftime(stats->last_scale_up, POOLCONFIG_MAXDATELEN, "%F %T", &tm);
+	}
+	t = pm_info->last_scale_down;
+	if (t)
+	{
+		localtime_r(&t, &tm);
+		strftime(stats->last_scale_down, POOLCONFIG_MAXDATELEN, "%F %T", &tm);
+	}
+
+	*nrows = 1;
+	return stats;
+}
+
+/*
+ * SHOW pool_process_management_stats;
+ */
+void
+show_process_management_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"current_children", "connected_children", "idle_children",
+								  "busy_ratio", "listen_queue_length", "listen_queue_peak",
+								  "accept_rate", "estimated_queue_wait", "total_accepted",
+								  "children_spawned", "children_retired",
+								  "last_scale_up", "last_scale_down"};
+
+	static int offsettbl[] = {
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, current_children),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, connected_children),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, idle_children),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, busy_ratio),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, listen_queue_length),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, listen_queue_peak),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, accept_rate),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, estimated_queue_wait),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, total_accepted),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, children_spawned),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, children_retired),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, last_scale_up),
+		offsetof(POOL_PROCESS_MANAGEMENT_STATS, last_scale_down),
+	};
+
+	int	nrows;
+	short		num_fields;
+	POOL_PROCESS_MANAGEMENT_STATS *stats;
+
+	num_fields = sizeof(field_names) / sizeof(char *);
+	stats = get_process_management_stats(&nrows);
+
+	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
+									   (char *)stats, sizeof(POOL_PROCESS_MANAGEMENT_STATS), nrows);
+
+	pfree(stats);
+}
+
+/*
+ * SHOW pool_statements;
+ */
+void
+show_statement_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"queryid", "query", "calls", "total_time", "mean_time",
+								  "max_time", "rows", "cache_hits", "cache_misses", "nodes"};
+
+	static int offsettbl[] = {
+		offsetof(POOL_STATEMENT_STATS, queryid),
+		offsetof(POOL_STATEMENT_STATS, query),
+		offsetof(POOL_STATEMENT_STATS, calls),
+		offsetof(POOL_STATEMENT_STATS, total_time),
+		offsetof(POOL_STATEMENT_STATS, mean_time),
+		offsetof(POOL_STATEMENT_STATS, max_time),
+		offsetof(POOL_STATEMENT_STATS, rows),
+		offsetof(POOL_STATEMENT_STATS, cache_hits),
+		offsetof(POOL_STATEMENT_STATS, cache_misses),
+		offsetof(POOL_STATEMENT_STATS, nodes),
+	};
+
+	int	nrows;
+	short		num_fields;
+	POOL_STATEMENT_STATS *stats;
+
+	num_fields = sizeof(field_names) / sizeof(char *);
+	stats = pool_get_statement_stats(&nrows);
+
+	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
+									   (char *)stats, sizeof(POOL_STATEMENT_STATS), nrows);
+
+	pfree(stats);
+}
+
+/*
+ * Used by SHOW pool_memory and pcp_memory_info
+ */
+POOL_REPORT_MEMORY *
+get_memory_usage(int *nrows)
+{
+	int			child;
+	POOL_REPORT_MEMORY *memory = palloc0(pool_config->num_init_children * sizeof(POOL_REPORT_MEMORY));
+
+	for (child = 0; child < pool_config->num_init_children; child++)
+	{
+		ProcessInfo *pi = &process_info[child];
+
+		snprintf(memory[child].pool_pid, sizeof(memory[child].pool_pid), "%d", pi->pid);
+		StrNCpy(memory[child].status, process_status_string(pi->status), POOLCONFIG_MAXPROCESSSTATUSLEN);
+		snprintf(memory[child].allocated, sizeof(memory[child].allocated), "%zu", pi->memory_allocated);
+		snprintf(memory[child].session, sizeof(memory[child].session), "%zu", pi->session_memory);
+		snprintf(memory[child].query, sizeof(memory[child].query), "%zu", pi->query_memory);
+		snprintf(memory[child].buffers, sizeof(memory[child].buffers), "%d", pi->buffer_memory);
+		snprintf(memory[child].peak, sizeof(memory[child].peak), "%zu", pi->peak_memory);
+	}
+
+	*nrows = child;
+
+	return memory;
+}
+
+/*
+ * SHOW pool_memory
+ */
+void
+show_memory_usage(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"pool_pid", "status", "allocated", "session", "query",
+								  "buffers", "peak"};
+	int			nrows;
+	int			n;
+	short		num_fields;
+	int		   *offsettbl;
+	POOL_REPORT_MEMORY *memory;
+
+	num_fields = sizeof(field_names) / sizeof(char *);
+	offsettbl = pool_report_memory_offsets(&n);
+	memory = get_memory_usage(&nrows);
+
+	send_row_description_and_data_rows(frontend, backend, num_fields, field_names, offsettbl,
+									   (char *)memory, sizeof(POOL_REPORT_MEMORY), nrows);
+
+	pfree(memory);
+}
+
 /*
  * Send row description and data rows.
  *
@@ -2261,82 +3090,77 @@ show_backend_stats(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 static void send_row_description_and_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 											   short num_fields, char **field_names, int *offsettbl,
 											   char *data, int row_size, int nrows)
+{
+	send_row_description(frontend, backend, num_fields, field_names);
+	send_data_rows(frontend, backend, num_fields, offsettbl, data, row_size, nrows);
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
+}
+
+/*
+ * Send data rows only, for reports sent in several batches between
+ * send_row_description() and send_complete_and_ready().  Arguments are the
+ * same as send_row_description_and_data_rows().
+ */
+static void
+send_data_rows(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+			   short num_fields, int *offsettbl, char *data, int row_size, int nrows)
 {
 	int			i, j;
-	short		s;
-	int			len;
-	unsigned char *nullmap;
-	int			nbytes;
+	char	  **values = palloc(sizeof(char *) * num_fields);
 
-	nbytes = (num_fields + 7) / 8;
+	for (i = 0; i < nrows; i++)
+	{
+		for (j = 0; j < num_fields; j++)
+			values[j] = data + i * row_size + offsettbl[j];
 
-	send_row_description(frontend, backend, num_fields, field_names);
+		send_data_row(frontend, backend, num_fields, values);
+	}
+	pfree(values);
+}
+
+/*
+ * Send a data row made of num_fields strings.
+ */
+static void
+send_data_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+			  short num_fields, char **values)
+{
+	POOL_MSGBUF buf;
+	int			j;
+
+	pool_msgbuf_init(&buf);
 
 	if (MAJOR(backend) == PROTO_MAJOR_V2)
 	{
-		nullmap = palloc(nbytes);
-		memset(nullmap, 0xff, nbytes);
+		int			nbytes = (num_fields + 7) / 8;
 
-		/* ascii row */
-		for (i = 0; i < nrows; i++)
+		/* ascii row, with null bitmap saying that all fields are not null */
+		pool_msgbuf_byte(&buf, 'D');
+		pool_msgbuf_reserve(&buf, nbytes);
+		memset(buf.data + buf.len, 0xff, nbytes);
+		buf.len += nbytes;
+
+		for (j = 0; j < num_fields; j++)
 		{
-			pool_write(frontend, "D", 1);
-			pool_write_and_flush(frontend, nullmap, nbytes);
+			int			size = strlen(values[j]);
 
-			for (j = 0; j < num_fields; j++)
-			{
-				write_one_field_v2(frontend, data + i * row_size + offsettbl[j]);
-			}
+			/* V2 field size includes the size itself */
+			pool_msgbuf_int32(&buf, size + 4);
+			pool_msgbuf_bytes(&buf, values[j], size);
 		}
-		pfree(nullmap);
 	}
 	else
 	{
 		/* data row */
-		for (i = 0; i < nrows; i++)
-		{
-			pool_write(frontend, "D", 1);
-			len = 6;			/* int32 + int16; */
-
-			for (j = 0; j < num_fields; j++)
-			{
-				len += 4 + strlen(data + i * row_size + offsettbl[j]);
-			}
-			len = htonl(len);
-			pool_write(frontend, &len, sizeof(len));
-			s = htons(num_fields);
-			pool_write(frontend, &s, sizeof(s));
-
-			for (j = 0; j < num_fields; j++)
-			{
-				write_one_field(frontend, data + i * row_size + offsettbl[j]);
-			}
-		}
+		pool_msgbuf_begin(&buf, 'D');
+		pool_msgbuf_int16(&buf, num_fields);
+		for (j = 0; j < num_fields; j++)
+			pool_msgbuf_field(&buf, values[j]);
+		pool_msgbuf_end(&buf);
 	}
 
-	send_complete_and_ready(frontend, backend, "SELECT", nrows);
-}
-
-/* Write one field to frontend (v3) */
-static void write_one_field(POOL_CONNECTION * frontend, char *field)
-{
-	int	size, hsize;
-
-	size = strlen(field);
-	hsize = htonl(size);
-	pool_write(frontend, &hsize, sizeof(hsize));
-	pool_write(frontend, field, size);
-}
-
-/* Write one field to frontend (v2) */
-static void write_one_field_v2(POOL_CONNECTION * frontend, char *field)
-{
-	int	size, hsize;
-
-	size = strlen(field);
-	hsize = htonl(size + 4);
-	pool_write(frontend, &hsize, sizeof(hsize));
-	pool_write(frontend, field, size);
+	pool_msgbuf_write(frontend, &buf);
+	pool_msgbuf_free(&buf);
 }
 
 /*
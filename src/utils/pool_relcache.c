@@ -24,13 +24,15 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <limits.h>
 #include <time.h>
 
 #include "pool.h"
 #include "utils/pool_relcache.h"
 #include "context/pool_session_context.h"
-#include "query_cache/pool_memqcache.h"
+#include "utils/pool_shared_relcache.h"
+#include "utils/pool_stage.h"
 #include "protocol/pool_process_query.h"
 #include "pool_config.h"
 #include "utils/palloc.h"
@@ -39,8 +41,17 @@
 #include "parser/scansup.h"
 
 static void SearchRelCacheErrorCb(void *arg);
-static POOL_SELECT_RESULT *query_cache_to_relation_cache(char *data, size_t size);
-static char *relation_cache_to_query_cache(POOL_SELECT_RESULT *res,size_t *size);
+static void relcache_check_generation(POOL_RELCACHE * relcache);
+static uint32 relcache_hash(char *dbname, char *relname, int session_id);
+static int	relcache_lookup(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *relname, int session_id);
+static void relcache_index_insert(POOL_RELCACHE * relcache, int entry);
+static void relcache_index_delete(POOL_RELCACHE * relcache, int entry);
+static void relcache_lru_unlink(POOL_RELCACHE * relcache, int entry);
+static void relcache_lru_push_head(POOL_RELCACHE * relcache, int entry);
+static void relcache_lru_push_tail(POOL_RELCACHE * relcache, int entry);
+static int	relcache_target(POOL_CONNECTION_POOL * backend, char **dbname);
+static int	relcache_find(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *table, int session_id, time_t now);
+static void relcache_store(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *table, int session_id, time_t now, void *data);
 
 
 /*
@@ -54,6 +65,8 @@ pool_create_relcache(int cachesize, char *sql,
 	POOL_RELCACHE *p;
 	PoolRelCache *ip;
 	MemoryContext old_context;
+	int			index_size;
+	int			i;
 
 	if (cachesize < 0)
 	{
@@ -68,11 +81,28 @@ pool_create_relcache(int cachesize, char *sql,
 	 */
 	old_context = MemoryContextSwitchTo(TopMemoryContext);
 
+	for (index_size = 8; index_size < cachesize * 2; index_size *= 2)
+		;
+
 	ip = (PoolRelCache *) palloc0(sizeof(PoolRelCache) * cachesize);
 	p = (POOL_RELCACHE *) palloc(sizeof(POOL_RELCACHE));
+	p->index = (int *) palloc(sizeof(int) * index_size);
 
 	MemoryContextSwitchTo(old_context);
 
+	p->index_size = index_size;
+	for (i = 0; i < index_size; i++)
+		p->index[i] = -1;
+
+	/* all entries are unused, chain them in the LRU list in order */
+	for (i = 0; i < cachesize; i++)
+	{
+		ip[i].lru_prev = i - 1;
+		ip[i].lru_next = (i + 1 < cachesize) ? i + 1 : -1;
+	}
+	p->lru_head = (cachesize > 0) ? 0 : -1;
+	p->lru_tail = cachesize - 1;
+
 	p->num = cachesize;
 	strlcpy(p->sql, sql, sizeof(p->sql));
 	p->register_func = register_func;
@@ -80,6 +110,7 @@ pool_create_relcache(int cachesize, char *sql,
 	p->cache_is_session_local = issessionlocal;
 	p->no_cache_if_zero = false;
 	p->cache = ip;
+	p->generation = pool_shared_relcache_generation();
 
 	return p;
 }
@@ -95,8 +126,11 @@ pool_discard_relcache(POOL_RELCACHE * relcache)
 	for (i = 0; i < relcache->num; i++)
 	{
 		(*relcache->unregister_func) (relcache->cache[i].data);
+		if (relcache->cache[i].dbname)
+			pfree(relcache->cache[i].dbname);
 	}
 	pfree(relcache->cache);
+	pfree(relcache->index);
 	pfree(relcache);
 }
 
@@ -108,260 +142,493 @@ void *
 pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table)
 {
 	char	   *dbname;
-	int			i;
-	int			maxrefcnt = INT_MAX;
 	char		query[MAX_QUERY_LENGTH];
 	POOL_SELECT_RESULT *res = NULL;
-	int			index = 0;
+	int			index;
 	int			local_session_id;
+	int			session_id;
+	uint32		hashval;
 	time_t		now;
 	void		*result;
 	ErrorContextCallback callback;
-    pool_sigset_t oldmask;
-	bool locked;
-	int			query_cache_not_found = 1;
-	char		*query_cache_data = NULL;
-	size_t		query_cache_len;
-	POOL_SESSION_CONTEXT *session_context;
+	bool		use_shared;
+	uint32		generation = 0;
 	int			node_id;
-
-	session_context = pool_get_session_context(false);
+	PoolStage	stage;
 
 	local_session_id = pool_get_local_session_id();
 	if (local_session_id < 0)
 		return NULL;
 
-	/*
-	 * Obtain database name and node id to be sent query.  If
-	 * relcache_query_target is RELQTARGET_LOAD_BALANCE_NODE, we consider
-	 * load balance node id to be used to send queries.
-	 * 
-	 * Note that we need to use VALID_BACKEND_RAW, rather than VALID_BACKEND
-	 * since pool_is_node_to_be_sent_in_current_query(being called by
-	 * VALID_BACKEND) assumes that if query context exists, where_to_send map
-	 * is already setup but it's not always the case because
-	 * pool_search_relcache is mostly called *before* the where_to_send map is
-	 * established.
-	 */
-	if (pool_config->relcache_query_target == RELQTARGET_LOAD_BALANCE_NODE &&
-		session_context && VALID_BACKEND_RAW(session_context->load_balance_node_id) &&
-		backend->slots[session_context->load_balance_node_id])
-	{
-		dbname = backend->slots[session_context->load_balance_node_id]->sp->database;
-		node_id = session_context->load_balance_node_id;
-	}
-	else
-	{
-		dbname = MAIN_CONNECTION(backend)->sp->database;
-
-		/*
-		 * If in streaming replication mode, prefer to send query to the
-		 * primary node if it exists.
-		 */
-		if (STREAM && PRIMARY_NODE_ID >= 0)
-			node_id = PRIMARY_NODE_ID;
-		else
-			node_id = MAIN_NODE_ID;
-	}
+	node_id = relcache_target(backend, &dbname);
 
 	now = time(NULL);
 
+	/*
+	 * If cache is session local, entries of other sessions must not match.
+	 * They are never looked up again and get replaced as they become least
+	 * recently used.
+	 */
+	session_id = relcache->cache_is_session_local ? local_session_id : 0;
+	hashval = relcache_hash(dbname, table, session_id);
+
 	/* Look for cache first */
-	for (i = 0; i < relcache->num; i++)
+	index = relcache_find(relcache, hashval, dbname, table, session_id, now);
+	if (index >= 0)
 	{
-		/*
-		 * If cache is session local, we need to check session id
-		 */
-		if (relcache->cache_is_session_local)
-		{
-			if (relcache->cache[i].session_id != local_session_id)
-				continue;
-		}
-
-		if (strcasecmp(relcache->cache[i].dbname, dbname) == 0 &&
-			strcasecmp(relcache->cache[i].relname, table) == 0)
-		{
-			if (relcache->cache[i].expire > 0)
-			{
-				if (now > relcache->cache[i].expire)
-				{
-					ereport(DEBUG1,
-							(errmsg("searching relcache"),
-							 errdetail("relcache for database:%s table:%s expired. now:%ld expiration time:%ld", dbname, table, now, relcache->cache[i].expire)));
-
-					relcache->cache[i].refcnt = 0;
-					break;
-				}
-			}
-
-			/* Found */
-			if (relcache->cache[i].refcnt < INT_MAX)
-				relcache->cache[i].refcnt++;
-
-			ereport(DEBUG1,
-					(errmsg("hit local relation cache"),
-					errdetail("query:%s", relcache->sql)));
+		ereport(DEBUG1,
+				(errmsg("hit local relation cache"),
+				errdetail("query:%s", relcache->sql)));
 
-			return relcache->cache[i].data;
-		}
+		return relcache->cache[index].data;
 	}
 
 	/* Not in cache. Check the system catalog */
 	snprintf(query, sizeof(query), relcache->sql, table);
 
-	per_node_statement_log(backend, node_id, query);
-
 	/*
-	 * Register a error context callback to throw proper context message
+	 * Search the shared relcache.  Session local information is never
+	 * shared.
 	 */
-	callback.callback = SearchRelCacheErrorCb;
-	callback.arg = NULL;
-	callback.previous = error_context_stack;
-	error_context_stack = &callback;
-
-	locked = pool_is_shmem_lock();
-	/*
-	 * if enable_shared_relcache is true, search query cache.
-	 */
-    if (pool_config->enable_shared_relcache)
+	use_shared = pool_is_shared_relcache() && !relcache->cache_is_session_local;
+	if (use_shared)
 	{
-		/* if shmem is not locked by this process, get the lock */
-		if (!locked)
-		{
-			POOL_SETMASK2(&BlockSig, &oldmask);
-			pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
-		}
-	    PG_TRY();
-		{
-			/* search catalog cache in query cache */
-			query_cache_not_found = pool_fetch_cache(backend, query, &query_cache_data, &query_cache_len);
-		}
-	    PG_CATCH();
-		{
-			pool_shmem_unlock();
-			POOL_SETMASK(&oldmask);
-	        PG_RE_THROW();
-		}
-		PG_END_TRY();
+		generation = pool_shared_relcache_generation();
+		res = pool_shared_relcache_search(dbname, query);
 	}
-	/* If not in query cache or not used, send query for backend. */
-	if (query_cache_not_found)
+
+	if (res)
 	{
 		ereport(DEBUG1,
-				(errmsg("not hit local relation cache and query cache"),
+				(errmsg("hit shared relation cache"),
 				errdetail("query:%s", query)));
-
-		do_query(CONNECTION(backend, node_id), query, &res, MAJOR(backend));
-		/* Register cache */
-		result = (*relcache->register_func) (res);
-		/* save local catalog cache in query cache */
-	    if (pool_config->enable_shared_relcache)
-		{
-			query_cache_data = relation_cache_to_query_cache(res, &query_cache_len);
-			/*
-			 * So far, we have already obtained a lock. But to register
-			 * a query cache entry, we need to acquire an exclusive lock.
-			 * Unfortunately:
-			 * (1) we don't know if we already acquired an exclusive or not.
-			 * (2) we cannot escalate a shared lock to an exclusive lock.
-			 * So we release the lock and obtain an exclusive lock.  This may
-			 * create a window and thus we might try to register duplicate
-			 * query cache entry if other process is trying to register the same entry
-			 * in the window. But it should be harmless.
-			 */
-			pool_shmem_unlock();
-			pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
-			pool_catalog_commit_cache(backend, query, query_cache_data, query_cache_len);
-		}
 	}
 	else
 	{
 		ereport(DEBUG1,
-				(errmsg("hit query cache"),
+				(errmsg("not hit local relation cache and shared relation cache"),
 				errdetail("query:%s", query)));
 
-		/* catalog cache found in query_cache, copy local relation cache */
-		res = query_cache_to_relation_cache(query_cache_data,query_cache_len);
-		result = (*relcache->register_func) (res);
+		per_node_statement_log(backend, node_id, query);
+
+		/*
+		 * Register a error context callback to throw proper context message
+		 */
+		callback.callback = SearchRelCacheErrorCb;
+		callback.arg = NULL;
+		callback.previous = error_context_stack;
+		error_context_stack = &callback;
+
+		stage = pool_stage_enter(POOL_STAGE_RELCACHE);
+		do_query(CONNECTION(backend, node_id), query, &res, MAJOR(backend));
+		pool_stage_leave(stage);
+
+		error_context_stack = callback.previous;
+
+		if (use_shared)
+			pool_shared_relcache_add(dbname, query, res, generation);
 	}
-	/* if shmem is locked by this function, unlock it */
-	if (pool_config->enable_shared_relcache && !locked)
+
+	/* Register cache */
+	result = (*relcache->register_func) (res);
+
+	relcache_store(relcache, hashval, dbname, table, session_id, now, result);
+
+	free_select_result(res);
+	return result;
+}
+
+static void
+SearchRelCacheErrorCb(void *arg)
+{
+	errcontext("while searching system catalog, When relcache is missed");
+}
+
+/*
+ * Obtain database name and node id to be sent query.  If
+ * relcache_query_target is RELQTARGET_LOAD_BALANCE_NODE, we consider load
+ * balance node id to be used to send queries.
+ *
+ * Note that we need to use VALID_BACKEND_RAW, rather than VALID_BACKEND
+ * since pool_is_node_to_be_sent_in_current_query(being called by
+ * VALID_BACKEND) assumes that if query context exists, where_to_send map is
+ * already setup but it's not always the case because pool_search_relcache
+ * is mostly called *before* the where_to_send map is established.
+ */
+static int
+relcache_target(POOL_CONNECTION_POOL * backend, char **dbname)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(false);
+
+	if (pool_config->relcache_query_target == RELQTARGET_LOAD_BALANCE_NODE &&
+		session_context && VALID_BACKEND_RAW(session_context->load_balance_node_id) &&
+		backend->slots[session_context->load_balance_node_id])
 	{
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
+		*dbname = backend->slots[session_context->load_balance_node_id]->sp->database;
+		return session_context->load_balance_node_id;
 	}
 
-	error_context_stack = callback.previous;
+	*dbname = MAIN_CONNECTION(backend)->sp->database;
 
 	/*
-	 * Look for replacement in cache
+	 * If in streaming replication mode, prefer to send query to the primary
+	 * node if it exists.
 	 */
+	if (STREAM && PRIMARY_NODE_ID >= 0)
+		return PRIMARY_NODE_ID;
+	return MAIN_NODE_ID;
+}
+
+/*
+ * Return the valid cache entry of the key, or -1.  An expired entry is
+ * invalidated here.
+ */
+static int
+relcache_find(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *table, int session_id, time_t now)
+{
+	int			index;
+
+	relcache_check_generation(relcache);
+
+	index = relcache_lookup(relcache, hashval, dbname, table, session_id);
+	if (index < 0)
+		return -1;
+
+	if (relcache->cache[index].expire > 0 &&
+		now > relcache->cache[index].expire)
+	{
+		ereport(DEBUG1,
+				(errmsg("searching relcache"),
+				 errdetail("relcache for database:%s table:%s expired. now:%ld expiration time:%ld", dbname, table, now, relcache->cache[index].expire)));
+
+		/* make the entry the first one to be reused */
+		relcache_index_delete(relcache, index);
+		relcache->cache[index].valid = false;
+		relcache_lru_unlink(relcache, index);
+		relcache_lru_push_tail(relcache, index);
+		return -1;
+	}
+
+	relcache_lru_unlink(relcache, index);
+	relcache_lru_push_head(relcache, index);
+	return index;
+}
+
+/*
+ * If a DDL has invalidated the shared relcache since the entries were
+ * registered, they may be obsolete.  Invalidate all of them.
+ */
+static void
+relcache_check_generation(POOL_RELCACHE * relcache)
+{
+	uint32		generation;
+	int			i;
+
+	generation = pool_shared_relcache_generation();
+	if (generation == relcache->generation)
+		return;
+
+	ereport(DEBUG1,
+			(errmsg("searching relcache"),
+			 errdetail("shared relcache was invalidated. discarding local relcache for query:%s", relcache->sql)));
+
 	for (i = 0; i < relcache->num; i++)
+	{
+		if (!relcache->cache[i].valid)
+			continue;
+		relcache_index_delete(relcache, i);
+		relcache->cache[i].valid = false;
+		relcache_lru_unlink(relcache, i);
+		relcache_lru_push_tail(relcache, i);
+	}
+	relcache->generation = generation;
+}
+
+/*
+ * Register data of the key, replacing the least recently used entry.
+ */
+static void
+relcache_store(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *table, int session_id, time_t now, void *data)
+{
+	int			index;
+	size_t		dbname_size;
+
+	if (relcache->num <= 0 || pool_is_ignore_till_sync() ||
+		(relcache->no_cache_if_zero && !data))
+		return;
+
+	/*
+	 * Replace the least recently used entry.  Unused entries are always at
+	 * the tail of the LRU list.
+	 */
+	index = relcache->lru_tail;
+
+	if (relcache->cache[index].valid)
 	{
 		/*
-		 * If cache is session local, we can discard old cache immediately
+		 * Entries of other sessions in a session local cache are just
+		 * garbage, no point in logging about them.
 		 */
-		if (relcache->cache_is_session_local)
-		{
-			if (relcache->cache[i].session_id != local_session_id)
-			{
-				index = i;
-				relcache->cache[i].refcnt = 0;
-				break;
-			}
-		}
+		if (!relcache->cache_is_session_local ||
+			relcache->cache[index].session_id == session_id)
+			ereport(LOG,
+					(errmsg("searching relcache. cache replacement occurred")));
 
-		if (relcache->cache[i].refcnt == 0)
-		{
-			/* Found empty slot */
-			index = i;
-			break;
-		}
-		else if (relcache->cache[i].refcnt < maxrefcnt)
-		{
-			maxrefcnt = relcache->cache[i].refcnt;
-			index = i;
-		}
+		relcache_index_delete(relcache, index);
+	}
+
+	if (relcache->cache[index].dbname)
+		pfree(relcache->cache[index].dbname);
+	dbname_size = strlen(dbname) + 1;
+	relcache->cache[index].dbname = MemoryContextAlloc(TopMemoryContext,
+													   dbname_size + strlen(table) + 1);
+	relcache->cache[index].relname = relcache->cache[index].dbname + dbname_size;
+	memcpy(relcache->cache[index].dbname, dbname, dbname_size);
+	strcpy(relcache->cache[index].relname, table);
+	relcache->cache[index].valid = true;
+	relcache->cache[index].hashval = hashval;
+	relcache->cache[index].session_id = session_id;
+	if (pool_config->relcache_expire > 0)
+	{
+		relcache->cache[index].expire = now + pool_config->relcache_expire;
+	}
+	else
+	{
+		relcache->cache[index].expire = 0;
 	}
 
-	if (relcache->cache[index].refcnt != 0)
+	/*
+	 * Call user defined unregister/register function.
+	 */
+	(*relcache->unregister_func) (relcache->cache[index].data);
+	relcache->cache[index].data = data;
+
+	relcache_index_insert(relcache, index);
+	relcache_lru_unlink(relcache, index);
+	relcache_lru_push_head(relcache, index);
+}
+
+/*
+ * Look up relcache without querying the backend.  Returns true and sets
+ * *data if the table is in the cache.
+ */
+bool
+pool_relcache_lookup(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table, void **data)
+{
+	char	   *dbname;
+	int			local_session_id;
+	int			session_id;
+	int			index;
+
+	local_session_id = pool_get_local_session_id();
+	if (local_session_id < 0)
+		return false;
+
+	relcache_target(backend, &dbname);
+	session_id = relcache->cache_is_session_local ? local_session_id : 0;
+	index = relcache_find(relcache, relcache_hash(dbname, table, session_id),
+						  dbname, table, session_id, time(NULL));
+	if (index < 0)
+		return false;
+
+	*data = relcache->cache[index].data;
+	return true;
+}
+
+/*
+ * Register data of the table obtained by the caller, typically from a
+ * query which fetches catalog information for many tables at once (see
+ * pool_relcache_query()).  The data must be what register_func would have
+ * returned for the result of relcache->sql.
+ */
+void
+pool_relcache_add(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table, void *data)
+{
+	char	   *dbname;
+	int			local_session_id;
+	int			session_id;
+	uint32		hashval;
+	time_t		now;
+
+	local_session_id = pool_get_local_session_id();
+	if (local_session_id < 0)
+		return;
+
+	relcache_target(backend, &dbname);
+	session_id = relcache->cache_is_session_local ? local_session_id : 0;
+	hashval = relcache_hash(dbname, table, session_id);
+	now = time(NULL);
+
+	if (relcache_find(relcache, hashval, dbname, table, session_id, now) >= 0)
+		return;
+	relcache_store(relcache, hashval, dbname, table, session_id, now, data);
+}
+
+/*
+ * Send a catalog query to the node pool_search_relcache() would send its
+ * queries to.  Returns false without sending if the node is in a failed
+ * transaction, in which case the query would just fail.
+ */
+bool
+pool_relcache_query(POOL_CONNECTION_POOL * backend, char *query, POOL_SELECT_RESULT * *res)
+{
+	char	   *dbname;
+	int			node_id;
+	ErrorContextCallback callback;
+	PoolStage	stage;
+
+	node_id = relcache_target(backend, &dbname);
+	if (TSTATE(backend, node_id) == 'E')
+		return false;
+
+	per_node_statement_log(backend, node_id, query);
+
+	callback.callback = SearchRelCacheErrorCb;
+	callback.arg = NULL;
+	callback.previous = error_context_stack;
+	error_context_stack = &callback;
+
+	stage = pool_stage_enter(POOL_STAGE_RELCACHE);
+	do_query(CONNECTION(backend, node_id), query, res, MAJOR(backend));
+	pool_stage_leave(stage);
+
+	error_context_stack = callback.previous;
+	return true;
+}
+
+/*
+ * Hash of a relcache key.  Names are compared case insensitively, so they
+ * are hashed case insensitively too, the same way as strcasecmp() folds
+ * case (FNV-1a over lower cased bytes).
+ */
+static uint32
+relcache_hash(char *dbname, char *relname, int session_id)
+{
+	uint32		h = 2166136261U;
+	unsigned char *p;
+
+	for (p = (unsigned char *) dbname; *p; p++)
+		h = (h ^ tolower(*p)) * 16777619U;
+	h = (h ^ '.') * 16777619U;
+	for (p = (unsigned char *) relname; *p; p++)
+		h = (h ^ tolower(*p)) * 16777619U;
+	h = (h ^ (uint32) session_id) * 16777619U;
+
+	return h;
+}
+
+/*
+ * Return the cache entry of the key, or -1 if not found.
+ */
+static int
+relcache_lookup(POOL_RELCACHE * relcache, uint32 hashval, char *dbname, char *relname, int session_id)
+{
+	uint32		mask = relcache->index_size - 1;
+	uint32		pos;
+	int			entry;
+
+	for (pos = hashval & mask; (entry = relcache->index[pos]) >= 0; pos = (pos + 1) & mask)
 	{
-		ereport(LOG,
-				(errmsg("searching relcache. cache replacement occurred")));
+		PoolRelCache *c = &relcache->cache[entry];
+
+		if (c->hashval == hashval && c->session_id == session_id &&
+			strcasecmp(c->dbname, dbname) == 0 &&
+			strcasecmp(c->relname, relname) == 0)
+			return entry;
+	}
+	return -1;
+}
 
+static void
+relcache_index_insert(POOL_RELCACHE * relcache, int entry)
+{
+	uint32		mask = relcache->index_size - 1;
+	uint32		pos;
+
+	for (pos = relcache->cache[entry].hashval & mask; relcache->index[pos] >= 0; pos = (pos + 1) & mask)
+		;
+	relcache->index[pos] = entry;
+}
+
+/*
+ * Remove the entry from the hash index.  The following elements of the
+ * probe sequence are shifted back so that no tombstones are needed.
+ */
+static void
+relcache_index_delete(POOL_RELCACHE * relcache, int entry)
+{
+	uint32		mask = relcache->index_size - 1;
+	uint32		pos;
+	uint32		next;
+	uint32		home;
+
+	for (pos = relcache->cache[entry].hashval & mask; relcache->index[pos] != entry; pos = (pos + 1) & mask)
+	{
+		if (relcache->index[pos] < 0)
+			return;				/* not in the index */
 	}
 
-	if (!pool_is_ignore_till_sync() && (!relcache->no_cache_if_zero || result))
+	for (next = (pos + 1) & mask; relcache->index[next] >= 0; next = (next + 1) & mask)
 	{
-		strlcpy(relcache->cache[index].dbname, dbname, MAX_ITEM_LENGTH);
-		strlcpy(relcache->cache[index].relname, table, MAX_ITEM_LENGTH);
-		relcache->cache[index].refcnt = 1;
-		relcache->cache[index].session_id = local_session_id;
-		if (pool_config->relcache_expire > 0)
-		{
-			relcache->cache[index].expire = now + pool_config->relcache_expire;
-		}
-		else
-		{
-			relcache->cache[index].expire = 0;
-		}
+		home = relcache->cache[relcache->index[next]].hashval & mask;
 
 		/*
-		 * Call user defined unregister/register function.
+		 * The element at next can be moved to pos only if its home position
+		 * is not in the range (pos, next], cyclically.
 		 */
-		(*relcache->unregister_func) (relcache->cache[index].data);
-		relcache->cache[index].data = result;
+		if (((next - home) & mask) >= ((next - pos) & mask))
+		{
+			relcache->index[pos] = relcache->index[next];
+			pos = next;
+		}
 	}
-	free_select_result(res);
-	if (query_cache_data)
-		pfree(query_cache_data);
-	return result;
+	relcache->index[pos] = -1;
 }
 
 static void
-SearchRelCacheErrorCb(void *arg)
+relcache_lru_unlink(POOL_RELCACHE * relcache, int entry)
 {
-	errcontext("while searching system catalog, When relcache is missed");
+	PoolRelCache *c = &relcache->cache[entry];
+
+	if (c->lru_prev >= 0)
+		relcache->cache[c->lru_prev].lru_next = c->lru_next;
+	else
+		relcache->lru_head = c->lru_next;
+
+	if (c->lru_next >= 0)
+		relcache->cache[c->lru_next].lru_prev = c->lru_prev;
+	else
+		relcache->lru_tail = c->lru_prev;
+
+	c->lru_prev = c->lru_next = -1;
+}
+
+static void
+relcache_lru_push_head(POOL_RELCACHE * relcache, int entry)
+{
+	PoolRelCache *c = &relcache->cache[entry];
+
+	c->lru_prev = -1;
+	c->lru_next = relcache->lru_head;
+	if (relcache->lru_head >= 0)
+		relcache->cache[relcache->lru_head].lru_prev = entry;
+	relcache->lru_head = entry;
+	if (relcache->lru_tail < 0)
+		relcache->lru_tail = entry;
+}
+
+static void
+relcache_lru_push_tail(POOL_RELCACHE * relcache, int entry)
+{
+	PoolRelCache *c = &relcache->cache[entry];
+
+	c->lru_next = -1;
+	c->lru_prev = relcache->lru_tail;
+	if (relcache->lru_tail >= 0)
+		relcache->cache[relcache->lru_tail].lru_next = entry;
+	relcache->lru_tail = entry;
+	if (relcache->lru_head < 0)
+		relcache->lru_head = entry;
 }
 
 
@@ -549,107 +816,3 @@ string_unregister_func(void *data)
 		free(data);
 	return (void *) 0;
 }
-
-static POOL_SELECT_RESULT *
-query_cache_to_relation_cache(char *data, size_t size)
-{
-	POOL_SELECT_RESULT *res;
-	char *p;
-	int i;
-	int len;
-
-	p = data;
-
-	res = palloc0(sizeof(*res));
-	res->rowdesc = palloc0(sizeof(RowDesc));
-
-	/* rowdesc */
-	res->rowdesc->num_attrs = *((int *)p);
-	p += sizeof(int);
-
-	/* numrows */
-	res->numrows = *((int *)p);
-	p += sizeof(int);
-
-	len = res->rowdesc->num_attrs * res->numrows;
-
-	res->nullflags = palloc(len * sizeof(int));
-	res->data = palloc0(len * sizeof(char *));
-
-	/* nullflags */
-	for (i = 0; i < len; i++)
-	{
-		res->nullflags[i] = *((int *)p);
-		p += sizeof(int);
-	}
-	/* data */
-	for (i = 0; i < len; i++)
-	{
-		if ( res->nullflags[i] > 0)
-		{
-			res->data[i] = palloc(res->nullflags[i] + 1);
-			memcpy(res->data[i], p, res->nullflags[i]);
-			*(res->data[i] + res->nullflags[i]) = '\0';
-			p += res->nullflags[i];
-		}
-	}
-
-	return res;
-}
-
-static char *
-relation_cache_to_query_cache(POOL_SELECT_RESULT *res,size_t *size)
-{
-	char * data;
-	char * p;
-
-	int i;
-	int array_size;
-	int mysize;
-
-	mysize = 0;
-
-	/* RoeDesc *rowdesc */
-	/* int res->rowdesc->num_attrs;*/
-	mysize += sizeof(int); /* only rodesc->num_attrs */
-	/* int numrows */
-	mysize += sizeof(int);
-	/* int *nullflags  */
-	mysize += sizeof(int) * res->rowdesc->num_attrs * res->numrows;
-	/*  char **data */
-	/* res->rowdesc->num_attrs * res->numrows */
-	for (i = 0; i < res->rowdesc->num_attrs * res->numrows; i++)
-	{
-		if(res->nullflags[i] > 0)
-		{
-			mysize += res->nullflags[i];
-		}
-	}
-
-	/* init array */
-	*size = mysize;
-	data = palloc(mysize + 1);
-
-	/* data copy */
-	p = data;
-	memcpy(p, &res->rowdesc->num_attrs, sizeof(int));
-	p += sizeof(int);
-	memcpy(p, &res->numrows, sizeof(int));
-	p += sizeof(int);
-
-	array_size = res->rowdesc->num_attrs * res->numrows;
-
-	memcpy(p, res->nullflags, sizeof(int) * array_size);
-	p += sizeof(int) * array_size;
-
-	for (i = 0; i < array_size; i++)
-	{
-		if( res->nullflags[i] > 0) /* NOT NULL? */
-		{
-			memcpy(p, res->data[i], res->nullflags[i]);
-			p += res->nullflags[i];
-		}
-	}
-
-	return data;
-}
@@ -17,6 +17,7 @@
  * is" without express or implied warranty.
  *
  */
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -30,6 +31,8 @@
 #include "context/pool_session_context.h"
 #include "rewrite/pool_timestamp.h"
 #include "protocol/pool_pg_utils.h"
+#include "protocol/pool_process_query.h"
+#include "parser/stringinfo.h"
 
 /*
  * Possible argument (property) values for function_volatile_property
@@ -41,17 +44,18 @@ typedef enum {
 } FUNC_VOLATILE_PROPERTY;
 
 static bool function_call_walker(Node *node, void *context);
-static bool system_catalog_walker(Node *node, void *context);
+static bool select_properties_walker(Node *node, void *context);
+static bool evaluate_select_property(SelectProperties * props, int property);
 static bool is_system_catalog(char *table_name);
-static bool temp_table_walker(Node *node, void *context);
-static bool unlogged_table_walker(Node *node, void *context);
-static bool view_walker(Node *node, void *context);
 static bool is_temp_table(char *table_name);
-static bool insertinto_or_locking_clause_walker(Node *node, void *context);
 static bool is_immutable_function(char *fname);
 static bool select_table_walker(Node *node, void *context);
-static bool non_immutable_function_call_walker(Node *node, void *context);
+static bool session_state_walker(Node *node, void *context);
+static bool query_weight_walker(Node *node, void *context);
+static bool is_aggregate_call(FuncCall *fcall);
 static char *strip_quote(char *str);
+static bool match_regex_pattern_set(RegPatternSet * set, char *str);
+static int	pattern_literal_cmp(const void *a, const void *b);
 static bool function_volatile_property(char *fname, FUNC_VOLATILE_PROPERTY property);
 static bool function_has_return_type(char *fname, char *typename);
 
@@ -64,23 +68,290 @@ static bool function_has_return_type(char *fname, char *typename);
 bool
 pool_has_function_call(Node *node)
 {
-	SelectContext ctx;
+	SelectProperties props;
+
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_FUNCTION_CALL);
+}
+
+/*
+ * Prepare to compute the properties of a SELECT.  The parse tree is
+ * walked only once, by the first pool_select_has_property() call, which
+ * collects the referenced relations and function calls.  Each property
+ * is then evaluated from the collected lists on first request, so
+ * callers testing several properties of the same query don't walk the
+ * tree again, and the catalog lookups behind a property are done only
+ * if someone asks for it.  If node is PrepareStmt, only
+ * SELECT_PROP_FUNCTION_CALL is computed, against PrepareStmt->query.
+ */
+void
+pool_init_select_properties(SelectProperties * props, Node *node)
+{
+	memset(props, 0, sizeof(SelectProperties));
+	props->node = node;
+}
 
-	if (IsA(node, PrepareStmt))
+/*
+ * Return true if the SELECT passed to pool_init_select_properties() has
+ * the property (one of SELECT_PROP_*).
+ */
+bool
+pool_select_has_property(SelectProperties * props, int property)
+{
+	if (props->evaluated & property)
+		return (props->found & property) != 0;
+
+	if (!props->walked)
 	{
-		PrepareStmt *prepare_statement = (PrepareStmt *) node;
-		node = (Node *) (prepare_statement->query);
+		Node	   *node = props->node;
+
+		props->walked = true;
+
+		if (node && IsA(node, PrepareStmt))
+		{
+			props->is_prepare = true;
+			node = (Node *) ((PrepareStmt *) node)->query;
+		}
+
+		if (node && IsA(node, SelectStmt))
+		{
+			props->is_select = true;
+			raw_expression_tree_walker(node, select_properties_walker, props);
+		}
 	}
 
-	if (!IsA(node, SelectStmt))
+	props->evaluated |= property;
+	if (props->is_select &&
+		(!props->is_prepare || property == SELECT_PROP_FUNCTION_CALL) &&
+		evaluate_select_property(props, property))
+		props->found |= property;
+
+	return (props->found & property) != 0;
+}
+
+/*
+ * Walker function to collect everything the SELECT_PROP_* properties
+ * are computed from.
+ */
+static bool
+select_properties_walker(Node *node, void *context)
+{
+	SelectProperties *props = (SelectProperties *) context;
+
+	if (node == NULL)
 		return false;
 
-	ctx.has_function_call = false;
-	ctx.pg_terminate_backend_pid = -1;
+	if (IsA(node, RangeVar))
+	{
+		props->rangevars = lappend(props->rangevars, node);
+	}
+	else if (IsA(node, FuncCall))
+	{
+		if (list_length(((FuncCall *) node)->funcname) > 0)
+			props->funccalls = lappend(props->funccalls, node);
+	}
+	else if (IsA(node, IntoClause) ||IsA(node, LockingClause))
+	{
+		props->has_insertinto_or_locking_clause = true;
+	}
+	else if (IsA(node, TypeCast))
+	{
+		/*
+		 * TIMESTAMP WITH TIME ZONE and TIME WITH TIME ZONE should not be
+		 * cached.
+		 */
+		TypeCast   *tc = (TypeCast *) node;
 
-	raw_expression_tree_walker(node, function_call_walker, &ctx);
+		if (isSystemType((Node *) tc->typeName, "timestamptz") ||
+			isSystemType((Node *) tc->typeName, "timetz"))
+			props->has_non_immutable_expr = true;
+	}
+	else if (IsA(node, SQLValueFunction))
+	{
+		/*
+		 * SQLValueFunctions (CURRENT_TIME, CURRENT_USER etc.) are regarded as
+		 * non immutable functions.
+		 */
+		props->has_non_immutable_expr = true;
+	}
+
+	return raw_expression_tree_walker(node, select_properties_walker, context);
+}
+
+/*
+ * Returns true if any function call is supposed to write database.
+ */
+static bool
+has_write_function_call(List *funccalls)
+{
+	ListCell   *lc;
+
+	foreach(lc, funccalls)
+	{
+		FuncCall   *fcall = (FuncCall *) lfirst(lc);
+		char	   *fname = make_function_name_from_funccall(fcall);
+
+		ereport(DEBUG1,
+				(errmsg("function call walker, function name: \"%s\"", fname)));
+
+		check_object_relationship_list(strVal(llast(fcall->funcname)), true);
+
+		/*
+		 * If both read_only_function_list and write_function_list is empty,
+		 * check volatile property of the function in the system catalog.
+		 */
+		if (pool_config->num_read_only_function_list == 0 &&
+			pool_config->num_write_function_list == 0)
+		{
+			if (function_volatile_property(fname, FUNC_VOLATILE))
+				return true;
+			continue;
+		}
+
+		/*
+		 * Check read_only list if any.  If the function is not found in it,
+		 * we have found a writing function.
+		 */
+		if (pool_config->num_read_only_function_list > 0)
+		{
+			if (pattern_compare(fname, READONLYLIST, "read_only_function_list") == 1)
+				continue;
+			return true;
+		}
+
+		/*
+		 * Check write list if any.
+		 */
+		if (pool_config->num_write_function_list > 0 &&
+			pattern_compare(fname, WRITELIST, "write_function_list") == 1)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Returns true if any function call is not immutable or returns
+ * timestamptz or timetz.
+ */
+static bool
+has_non_immutable_function_call(List *funccalls)
+{
+	ListCell   *lc;
+
+	foreach(lc, funccalls)
+	{
+		char	   *fname = make_function_name_from_funccall((FuncCall *) lfirst(lc));
+
+		ereport(DEBUG1,
+				(errmsg("non immutable function walker. checking function \"%s\"", fname)));
+
+		/* Check system catalog if the function is immutable */
+		if (is_immutable_function(fname) == false)
+			return true;
+
+		/* timestamptz and timetz should not be cached */
+		if (function_has_return_type(fname, "timestamptz") ||
+			function_has_return_type(fname, "timetz"))
+			return true;
+	}
+	return false;
+}
+
+static bool
+evaluate_select_property(SelectProperties * props, int property)
+{
+	ListCell   *lc;
+	bool		result = false;
+
+	switch (property)
+	{
+		case SELECT_PROP_FUNCTION_CALL:
+			return has_write_function_call(props->funccalls);
+
+		case SELECT_PROP_INSERTINTO_OR_LOCKING:
+			result = props->has_insertinto_or_locking_clause;
+			ereport(DEBUG1,
+					(errmsg("checking if query has INSERT INTO, FOR SHARE or FOR UPDATE"),
+					 errdetail("result = %d", result)));
+			return result;
+
+		case SELECT_PROP_NON_IMMUTABLE_FUNCTION:
+			result = props->has_non_immutable_expr ||
+				has_non_immutable_function_call(props->funccalls);
+			ereport(DEBUG1,
+					(errmsg("checking if SELECT statement contains the IMMUTABLE function call"),
+					 errdetail("result = %d", result)));
+			return result;
+
+		case SELECT_PROP_TEMP_TABLE:
+
+			/*
+			 * In trace mode only tables created in this session can be temp
+			 * tables, so there is nothing to look up if it created none.
+			 */
+			if (pool_config->check_temp_table == CHECK_TEMP_TRACE)
+			{
+				POOL_SESSION_CONTEXT *session = pool_get_session_context(true);
+
+				if (session == NULL || session->temp_tables == NIL)
+					return false;
+			}
+			break;
+
+		case SELECT_PROP_SYSTEM_CATALOG:
+		case SELECT_PROP_UNLOGGED_TABLE:
+		case SELECT_PROP_VIEW:
+			break;
+
+		default:
+			ereport(WARNING,
+					(errmsg("unknown SELECT property: %d", property)));
+			return false;
+	}
+
+	foreach(lc, props->rangevars)
+	{
+		RangeVar   *rgv = (RangeVar *) lfirst(lc);
+
+		switch (property)
+		{
+			case SELECT_PROP_SYSTEM_CATALOG:
+				ereport(DEBUG1,
+						(errmsg("system catalog walker, checking relation \"%s\"", rgv->relname)));
+				result = is_system_catalog(rgv->relname);
+				break;
+
+			case SELECT_PROP_TEMP_TABLE:
+				ereport(DEBUG1,
+						(errmsg("temporary table walker. checking relation \"%s\"", rgv->relname)));
+				result = is_temp_table(rgv->relname);
+				break;
 
-	return ctx.has_function_call;
+			case SELECT_PROP_UNLOGGED_TABLE:
+				{
+					char	   *relname = make_table_name_from_rangevar(rgv);
+
+					ereport(DEBUG1,
+							(errmsg("unlogged table walker. checking relation \"%s\"", relname)));
+					result = is_unlogged_table(relname);
+					break;
+				}
+
+			case SELECT_PROP_VIEW:
+				{
+					char	   *relname = make_table_name_from_rangevar(rgv);
+
+					ereport(DEBUG1,
+							(errmsg("view walker. checking relation \"%s\"", relname)));
+					result = is_view(relname);
+					break;
+				}
+		}
+
+		if (result)
+			break;
+	}
+	return result;
 }
 
 /*
@@ -109,17 +380,10 @@ pool_get_terminate_backend_pid(Node *node)
 bool
 pool_has_system_catalog(Node *node)
 {
+	SelectProperties props;
 
-	SelectContext ctx;
-
-	if (!IsA(node, SelectStmt))
-		return false;
-
-	ctx.has_system_catalog = false;
-
-	raw_expression_tree_walker(node, system_catalog_walker, &ctx);
-
-	return ctx.has_system_catalog;
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_SYSTEM_CATALOG);
 }
 
 /*
@@ -128,17 +392,10 @@ pool_has_system_catalog(Node *node)
 bool
 pool_has_temp_table(Node *node)
 {
+	SelectProperties props;
 
-	SelectContext ctx;
-
-	if (!IsA(node, SelectStmt))
-		return false;
-
-	ctx.has_temp_table = false;
-
-	raw_expression_tree_walker(node, temp_table_walker, &ctx);
-
-	return ctx.has_temp_table;
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_TEMP_TABLE);
 }
 
 /*
@@ -147,17 +404,10 @@ pool_has_temp_table(Node *node)
 bool
 pool_has_unlogged_table(Node *node)
 {
+	SelectProperties props;
 
-	SelectContext ctx;
-
-	if (!IsA(node, SelectStmt))
-		return false;
-
-	ctx.has_unlogged_table = false;
-
-	raw_expression_tree_walker(node, unlogged_table_walker, &ctx);
-
-	return ctx.has_unlogged_table;
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_UNLOGGED_TABLE);
 }
 
 /*
@@ -166,17 +416,10 @@ pool_has_unlogged_table(Node *node)
 bool
 pool_has_view(Node *node)
 {
+	SelectProperties props;
 
-	SelectContext ctx;
-
-	if (!IsA(node, SelectStmt))
-		return false;
-
-	ctx.has_view = false;
-
-	raw_expression_tree_walker(node, view_walker, &ctx);
-
-	return ctx.has_view;
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_VIEW);
 }
 
 /*
@@ -185,20 +428,10 @@ pool_has_view(Node *node)
 bool
 pool_has_insertinto_or_locking_clause(Node *node)
 {
-	SelectContext ctx;
-
-	if (!IsA(node, SelectStmt))
-		return false;
-
-	ctx.has_insertinto_or_locking_clause = false;
-
-	raw_expression_tree_walker(node, insertinto_or_locking_clause_walker, &ctx);
+	SelectProperties props;
 
-	ereport(DEBUG1,
-			(errmsg("checking if query has INSERT INTO, FOR SHARE or FOR UPDATE"),
-			 errdetail("result = %d", ctx.has_insertinto_or_locking_clause)));
-
-	return ctx.has_insertinto_or_locking_clause;
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_INSERTINTO_OR_LOCKING);
 }
 
 /*
@@ -217,12 +450,14 @@ pattern_compare(char *str, const int type, const char *param_name)
 
 	RegPattern *lists_patterns;
 	int		   *pattc;
+	RegPatternSet *pattern_sets;
 
 	if (strcmp(param_name, "read_only_function_list") == 0 ||
 		strcmp(param_name, "write_function_list") == 0)
 	{
 		lists_patterns = pool_config->lists_patterns;
 		pattc = &pool_config->pattc;
+		pattern_sets = pool_config->function_pattern_sets;
 
 	}
 	else if (strcmp(param_name, "cache_safe_memqcache_table_list") == 0 ||
@@ -230,12 +465,14 @@ pattern_compare(char *str, const int type, const char *param_name)
 	{
 		lists_patterns = pool_config->lists_memqcache_table_patterns;
 		pattc = &pool_config->memqcache_table_pattc;
+		pattern_sets = pool_config->memqcache_table_pattern_sets;
 
 	}
 	else if (strcmp(param_name, "primary_routing_query_pattern_list") == 0)
 	{
 		lists_patterns = pool_config->lists_query_patterns;
 		pattc = &pool_config->query_pattc;
+		pattern_sets = pool_config->query_pattern_sets;
 
 	}
 	else
@@ -252,6 +489,21 @@ pattern_compare(char *str, const int type, const char *param_name)
 		return -1;
 	}
 
+	/*
+	 * Use the combined matcher built at configuration load time if
+	 * available, so that the cost doesn't grow with the number of patterns.
+	 */
+	if ((type == WRITELIST || type == READONLYLIST) && pattern_sets[type].compiled)
+	{
+		result = match_regex_pattern_set(&pattern_sets[type], s) ? 1 : 0;
+		ereport(DEBUG2,
+				(errmsg("comparing string in write/readonly list regex array"),
+				 errdetail("pattern_compare: %s %s: %s",
+						   param_name, result ? "matched" : "not matched", s)));
+		free(s);
+		return result;
+	}
+
 	for (i = 0; i < *pattc; i++)
 	{
 		if (lists_patterns[i].type != type)
@@ -296,6 +548,72 @@ pattern_compare(char *str, const int type, const char *param_name)
 	return result;
 }
 
+/*
+ * Return the cache life time of the table given as "table:ttl" in
+ * cache_safe_memqcache_table_list.  If the table matches more than one
+ * such pattern the shortest is used.  Returns 0 if there is none.
+ */
+int
+memqcache_table_ttl(char *table_name)
+{
+	int			i;
+	int			ttl = 0;
+	char	   *s;
+
+	if (pool_config->num_cache_safe_memqcache_table_list <= 0)
+		return 0;
+
+	s = strip_quote(table_name);
+	if (!s)
+		return 0;
+
+	for (i = 0; i < pool_config->memqcache_table_pattc; i++)
+	{
+		RegPattern *pattern = &pool_config->lists_memqcache_table_patterns[i];
+
+		if (pattern->type != READONLYLIST || pattern->ttl <= 0)
+			continue;
+
+		if ((ttl == 0 || pattern->ttl < ttl) &&
+			regexec(&pattern->regexv, s, 0, 0, 0) == 0)
+			ttl = pattern->ttl;
+	}
+
+	free(s);
+	return ttl;
+}
+
+/*
+ * Returns true if str matches any pattern of the combined matcher.  Note
+ * that str is lower cased in place for the literal pattern lookup.
+ */
+static bool
+match_regex_pattern_set(RegPatternSet * set, char *str)
+{
+	char	   *c;
+
+	if (set->nliterals > 0)
+	{
+		for (c = str; *c; c++)
+			*c = tolower((unsigned char) *c);
+
+		if (bsearch(&str, set->literals, set->nliterals, sizeof(char *),
+					pattern_literal_cmp) != NULL)
+			return true;
+	}
+
+	if (set->has_regex && regexec(&set->regexv, str, 0, 0, 0) == 0)
+		return true;
+
+	return false;
+}
+
+static int
+pattern_literal_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
 /*
  * Returns double quotes stripped version of malloced string.
  * Callers must free() after using it.
@@ -384,172 +702,58 @@ function_call_walker(Node *node, void *context)
 
 			/*
 			 * If both read_only_function_list and write_function_list is empty,
-			 * check volatile property of the function in the system catalog.
-			 */
-			if (pool_config->num_read_only_function_list == 0 &&
-				pool_config->num_write_function_list == 0)
-			{
-				if (function_volatile_property(fname, FUNC_VOLATILE))
-				{
-					ctx->has_function_call = true;
-					return false;
-				}
-				return raw_expression_tree_walker(node, function_call_walker, context);
-			}
-
-			/*
-			 * Check read_only list if any.
-			 */
-			if (pool_config->num_read_only_function_list > 0)
-			{
-				/* Search function in the read_only list regex patterns */
-				if (pattern_compare(fname, READONLYLIST, "read_only_function_list") == 1)
-				{
-					/*
-					 * If the function is found in the read_only list, we can
-					 * ignore it
-					 */
-					return raw_expression_tree_walker(node, function_call_walker, context);
-				}
-
-				/*
-				 * Since the function was not found in read_only list, we have
-				 * found a writing function.
-				 */
-				ctx->has_function_call = true;
-				return false;
-			}
-
-			/*
-			 * Check write list if any.
-			 */
-			if (pool_config->num_write_function_list > 0)
-			{
-				/* Search function in the write list regex patterns */
-				if (pattern_compare(fname, WRITELIST, "write_function_list") == 1)
-				{
-					/* Found. */
-					ctx->has_function_call = true;
-					return false;
-				}
-			}
-		}
-	}
-	return raw_expression_tree_walker(node, function_call_walker, context);
-}
-
-/*
- * Walker function to find a system catalog
- */
-static bool
-system_catalog_walker(Node *node, void *context)
-{
-	SelectContext *ctx = (SelectContext *) context;
-
-	if (node == NULL)
-		return false;
-
-	if (IsA(node, RangeVar))
-	{
-		RangeVar   *rgv = (RangeVar *) node;
-
-		ereport(DEBUG1,
-				(errmsg("system catalog walker, checking relation \"%s\"", rgv->relname)));
-
-		if (is_system_catalog(rgv->relname))
-		{
-			ctx->has_system_catalog = true;
-			return false;
-		}
-	}
-	return raw_expression_tree_walker(node, system_catalog_walker, context);
-}
-
-/*
- * Walker function to find a temp table
- */
-static bool
-temp_table_walker(Node *node, void *context)
-{
-	SelectContext *ctx = (SelectContext *) context;
-
-	if (node == NULL)
-		return false;
-
-	if (IsA(node, RangeVar))
-	{
-		RangeVar   *rgv = (RangeVar *) node;
-
-		ereport(DEBUG1,
-				(errmsg("temporary table walker. checking relation \"%s\"", rgv->relname)));
-
-		if (is_temp_table(rgv->relname))
-		{
-			ctx->has_temp_table = true;
-			return false;
-		}
-	}
-	return raw_expression_tree_walker(node, temp_table_walker, context);
-}
-
-/*
- * Walker function to find a unlogged table
- */
-static bool
-unlogged_table_walker(Node *node, void *context)
-{
-	SelectContext *ctx = (SelectContext *) context;
-	char	   *relname;
-
-	if (node == NULL)
-		return false;
-
-	if (IsA(node, RangeVar))
-	{
-		RangeVar   *rgv = (RangeVar *) node;
-
-		relname = make_table_name_from_rangevar(rgv);
-
-		ereport(DEBUG1,
-				(errmsg("unlogged table walker. checking relation \"%s\"", relname)));
-
-		if (is_unlogged_table(relname))
-		{
-			ctx->has_unlogged_table = true;
-			return false;
-		}
-	}
-	return raw_expression_tree_walker(node, unlogged_table_walker, context);
-}
-
-/*
- * Walker function to find a view
- */
-static bool
-view_walker(Node *node, void *context)
-{
-	SelectContext *ctx = (SelectContext *) context;
-	char	   *relname;
-
-	if (node == NULL)
-		return false;
-
-	if (IsA(node, RangeVar))
-	{
-		RangeVar   *rgv = (RangeVar *) node;
+			 * check volatile property of the function in the system catalog.
+			 */
+			if (pool_config->num_read_only_function_list == 0 &&
+				pool_config->num_write_function_list == 0)
+			{
+				if (function_volatile_property(fname, FUNC_VOLATILE))
+				{
+					ctx->has_function_call = true;
+					return false;
+				}
+				return raw_expression_tree_walker(node, function_call_walker, context);
+			}
 
-		relname = make_table_name_from_rangevar(rgv);
+			/*
+			 * Check read_only list if any.
+			 */
+			if (pool_config->num_read_only_function_list > 0)
+			{
+				/* Search function in the read_only list regex patterns */
+				if (pattern_compare(fname, READONLYLIST, "read_only_function_list") == 1)
+				{
+					/*
+					 * If the function is found in the read_only list, we can
+					 * ignore it
+					 */
+					return raw_expression_tree_walker(node, function_call_walker, context);
+				}
 
-		ereport(DEBUG1,
-				(errmsg("view walker. checking relation \"%s\"", relname)));
+				/*
+				 * Since the function was not found in read_only list, we have
+				 * found a writing function.
+				 */
+				ctx->has_function_call = true;
+				return false;
+			}
 
-		if (is_view(relname))
-		{
-			ctx->has_view = true;
-			return false;
+			/*
+			 * Check write list if any.
+			 */
+			if (pool_config->num_write_function_list > 0)
+			{
+				/* Search function in the write list regex patterns */
+				if (pattern_compare(fname, WRITELIST, "write_function_list") == 1)
+				{
+					/* Found. */
+					ctx->has_function_call = true;
+					return false;
+				}
+			}
 		}
 	}
-	return raw_expression_tree_walker(node, view_walker, context);
+	return raw_expression_tree_walker(node, function_call_walker, context);
 }
 
 /*
@@ -677,8 +881,6 @@ is_temp_table(char *table_name)
 		return false;
 	}
 
-	backend = pool_get_session_context(false)->backend;
-
 	if (pool_config->check_temp_table == CHECK_TEMP_TRACE)
 	{
 		POOL_TEMP_TABLE	*temp_table;
@@ -702,6 +904,7 @@ is_temp_table(char *table_name)
 	/*
 	 * Below is check_temp_table == CHECK_TEMP_CATALOG or CHECK_TEMP_ON case.
 	 */
+	backend = pool_get_session_context(false)->backend;
 
 	/*
 	 * Check backend version.
@@ -757,6 +960,8 @@ discard_temp_table_relcache(void)
 /*
  * Returns true if table_name is an unlogged table.
  */
+static POOL_RELCACHE * unlogged_table_relcache;
+
 bool
 is_unlogged_table(char *table_name)
 {
@@ -776,7 +981,6 @@ is_unlogged_table(char *table_name)
 
 #define ISUNLOGGEDQUERY3 "SELECT count(*) FROM pg_catalog.pg_class AS c WHERE c.oid = pg_catalog.to_regclass('%s') AND c.relpersistence = 'u'"
 
-	static POOL_RELCACHE * relcache;
 	POOL_CONNECTION_POOL *backend;
 	int		major;
 
@@ -817,12 +1021,12 @@ is_unlogged_table(char *table_name)
 		/*
 		 * If relcache does not exist, create it.
 		 */
-		if (!relcache)
+		if (!unlogged_table_relcache)
 		{
-			relcache = pool_create_relcache(pool_config->relcache_size, query,
-											int_register_func, int_unregister_func,
-											false);
-			if (relcache == NULL)
+			unlogged_table_relcache = pool_create_relcache(pool_config->relcache_size, query,
+														   int_register_func, int_unregister_func,
+														   false);
+			if (unlogged_table_relcache == NULL)
 			{
 				ereport(WARNING,
 						(errmsg("unable to create relcache, while checking for unlogged table")));
@@ -833,7 +1037,7 @@ is_unlogged_table(char *table_name)
 		/*
 		 * Search relcache.
 		 */
-		result = pool_search_relcache(relcache, backend, table_name) == 0 ? false : true;
+		result = pool_search_relcache(unlogged_table_relcache, backend, table_name) == 0 ? false : true;
 		return result;
 	}
 	else
@@ -846,6 +1050,8 @@ is_unlogged_table(char *table_name)
  * Returns true if table_name is a view.
  * This function is called by query cache module.
  */
+static POOL_RELCACHE * view_relcache;
+
 bool
 is_view(char *table_name)
 {
@@ -858,7 +1064,6 @@ is_view(char *table_name)
 
 #define ISVIEWQUERY3 "SELECT count(*) FROM pg_catalog.pg_class AS c WHERE c.oid = pg_catalog.to_regclass('%s') AND (c.relkind = 'v' OR c.relkind = 'm')"
 
-	static POOL_RELCACHE * relcache;
 	POOL_CONNECTION_POOL *backend;
 	bool		result;
 	char	   *query;
@@ -888,12 +1093,12 @@ is_view(char *table_name)
 		query = ISVIEWQUERY;
 	}
 
-	if (!relcache)
+	if (!view_relcache)
 	{
-		relcache = pool_create_relcache(pool_config->relcache_size, query,
-										int_register_func, int_unregister_func,
-										false);
-		if (relcache == NULL)
+		view_relcache = pool_create_relcache(pool_config->relcache_size, query,
+											 int_register_func, int_unregister_func,
+											 false);
+		if (view_relcache == NULL)
 		{
 			ereport(WARNING,
 					(errmsg("unable to create relcache, while checking for view")));
@@ -905,7 +1110,7 @@ is_view(char *table_name)
 	/*
 	 * Search relcache.
 	 */
-	result = pool_search_relcache(relcache, backend, table_name) == 0 ? false : true;
+	result = pool_search_relcache(view_relcache, backend, table_name) == 0 ? false : true;
 	return result;
 }
 
@@ -965,120 +1170,217 @@ pool_has_to_regclass(void)
 }
 
 /*
- * Walker function to find intoClause or lockingClause.
+ * Return true if this SELECT has non immutable function calls.
+ */
+bool
+pool_has_non_immutable_function_call(Node *node)
+{
+	SelectProperties props;
+
+	pool_init_select_properties(&props, node);
+	return pool_select_has_property(&props, SELECT_PROP_NON_IMMUTABLE_FUNCTION);
+}
+
+/*
+ * Aggregate functions recognized by pool_select_query_weight().  Without
+ * the catalog an aggregate can only be told from other functions by name,
+ * unless DISTINCT, ORDER BY, FILTER or '*' is given in the call.
  */
+static const char *const aggregate_functions[] = {
+	"count",
+	"sum",
+	"avg",
+	"min",
+	"max",
+	"array_agg",
+	"string_agg",
+	"json_agg",
+	"jsonb_agg",
+	"json_object_agg",
+	"jsonb_object_agg",
+	"bool_and",
+	"bool_or",
+	"every",
+	"stddev",
+	"stddev_pop",
+	"stddev_samp",
+	"variance",
+	"var_pop",
+	"var_samp",
+	"corr",
+	"percentile_cont",
+	"percentile_disc",
+	"mode",
+	NULL
+};
+
+/*
+ * Estimate how heavy a SELECT is to execute from the shape of its parse
+ * tree.  Joins, aggregates, window functions, grouping, subqueries and set
+ * operations add to the weight, and so do a sort or a FROM clause without
+ * WHERE which are not bounded by a LIMIT.  Used with
+ * heavy_query_min_weight to route analytic queries to heavy_query_nodes.
+ */
+int
+pool_select_query_weight(Node *node)
+{
+	int			weight = 0;
+
+	if (node == NULL || !IsA(node, SelectStmt))
+		return 0;
+
+	query_weight_walker(node, &weight);
+	return weight;
+}
+
 static bool
-insertinto_or_locking_clause_walker(Node *node, void *context)
+query_weight_walker(Node *node, void *context)
 {
-	SelectContext *ctx = (SelectContext *) context;
+	int		   *weight = (int *) context;
 
 	if (node == NULL)
 		return false;
 
-	if (IsA(node, IntoClause) ||IsA(node, LockingClause))
+	if (IsA(node, SelectStmt))
 	{
-		ctx->has_insertinto_or_locking_clause = true;
-		return false;
+		SelectStmt *stmt = (SelectStmt *) node;
+
+		if (stmt->op != SETOP_NONE)
+			*weight += 1;
+		else if (stmt->fromClause)
+		{
+			/* each additional FROM item is a join */
+			*weight += 2 * (list_length(stmt->fromClause) - 1);
+			if (stmt->whereClause == NULL && stmt->limitCount == NULL)
+				*weight += 2;
+		}
+
+		if (stmt->groupClause)
+			*weight += 2;
+		if (stmt->distinctClause)
+			*weight += 1;
+		if (stmt->havingClause)
+			*weight += 1;
+		if (stmt->sortClause && stmt->limitCount == NULL)
+			*weight += 2;
 	}
-	return raw_expression_tree_walker(node, insertinto_or_locking_clause_walker, ctx);
-}
+	else if (IsA(node, JoinExpr) || IsA(node, RangeSubselect) || IsA(node, SubLink))
+	{
+		*weight += 2;
+	}
+	else if (IsA(node, CommonTableExpr))
+	{
+		*weight += 1;
+	}
+	else if (IsA(node, FuncCall))
+	{
+		FuncCall   *fcall = (FuncCall *) node;
 
-/*
- * Return true if this SELECT has non immutable function calls.
- */
-bool
-pool_has_non_immutable_function_call(Node *node)
-{
-	SelectContext ctx;
+		if (fcall->over)
+			*weight += 3;
+		else if (is_aggregate_call(fcall))
+			*weight += 2;
+	}
 
-	if (!IsA(node, SelectStmt))
-		return false;
+	return raw_expression_tree_walker(node, query_weight_walker, context);
+}
 
-	ctx.has_non_immutable_function_call = false;
+static bool
+is_aggregate_call(FuncCall *fcall)
+{
+	char	   *fname;
+	int			i;
 
-	raw_expression_tree_walker(node, non_immutable_function_call_walker, &ctx);
+	if (fcall->agg_star || fcall->agg_distinct || fcall->agg_order ||
+		fcall->agg_filter || fcall->agg_within_group)
+		return true;
 
-	ereport(DEBUG1,
-			(errmsg("checking if SELECT statement contains the IMMUTABLE function call"),
-			 errdetail("result = %d", ctx.has_non_immutable_function_call)));
+	if (list_length(fcall->funcname) == 0)
+		return false;
 
-	return ctx.has_non_immutable_function_call;
+	fname = strVal(llast(fcall->funcname));
+	for (i = 0; aggregate_functions[i]; i++)
+	{
+		if (!strcmp(fname, aggregate_functions[i]))
+			return true;
+	}
+	return false;
 }
 
 /*
- * Walker function to find non immutable function call.
+ * Functions which leave state behind in the backend session after the
+ * transaction ends.
  */
-static bool
-non_immutable_function_call_walker(Node *node, void *context)
-{
-	SelectContext *ctx = (SelectContext *) context;
+static const char *const session_state_functions[] = {
+	"set_config",
+	"pg_advisory_lock",
+	"pg_advisory_lock_shared",
+	"pg_try_advisory_lock",
+	"pg_try_advisory_lock_shared",
+	"dblink_connect",
+	"dblink_connect_u",
+	NULL
+};
 
+/*
+ * Return true if the statement may change the state of the backend
+ * session in a way which has to be reset before the connection is used
+ * by another client: SET, PREPARE, LISTEN, temporary tables, cursors WITH
+ * HOLD, advisory locks and so on.  Only SELECT, INSERT, UPDATE, DELETE,
+ * SHOW, EXPLAIN of those and transaction control are regarded as safe,
+ * unless they call one of session_state_functions.  State changed by a
+ * user defined function, e.g. by a SET executed inside of it, cannot be
+ * detected.
+ */
+bool
+pool_changes_session_state(Node *node)
+{
 	if (node == NULL)
 		return false;
 
-	if (IsA(node, FuncCall))
+	switch (nodeTag(node))
 	{
-		FuncCall   *fcall = (FuncCall *) node;
-		char	   *fname;
-		int			length = list_length(fcall->funcname);
-
-		if (length > 0)
-		{
-			fname = make_function_name_from_funccall(fcall);
+		case T_SelectStmt:
+			if (((SelectStmt *) node)->intoClause)
+				return true;
+			return raw_expression_tree_walker(node, session_state_walker, NULL);
 
-			ereport(DEBUG1,
-					(errmsg("non immutable function walker. checking function \"%s\"", fname)));
+		case T_InsertStmt:
+		case T_UpdateStmt:
+		case T_DeleteStmt:
+			return raw_expression_tree_walker(node, session_state_walker, NULL);
 
-			/* Check system catalog if the function is immutable */
-			if (is_immutable_function(fname) == false)
-			{
-				/* Non immutable function call found */
-				ctx->has_non_immutable_function_call = true;
-				return false;
-			}
+		case T_ExplainStmt:
+			return pool_changes_session_state(((ExplainStmt *) node)->query);
 
-			/* check return type is timestamptz */
-			if (function_has_return_type(fname, "timestamptz"))
-			{
-				/* timestamptz should not be cached */
-				ctx->has_non_immutable_function_call = true;
-				return false;
-			}
+		case T_TransactionStmt:
+		case T_VariableShowStmt:
+			return false;
 
-			/* return type is timetz */
-			if (function_has_return_type(fname, "timetz"))
-			{
-				/* timetz should not be cached */
-				ctx->has_non_immutable_function_call = true;
-				return false;
-			}
-		}
+		default:
+			return true;
 	}
+}
 
-	/* Check type cast */
-	else if (IsA(node, TypeCast))
+static bool
+session_state_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, FuncCall))
 	{
-		/* TIMESTAMP WITH TIME ZONE and TIME WITH TIME ZONE should not be cached. */
-		TypeCast   *tc = (TypeCast *) node;
+		FuncCall   *fcall = (FuncCall *) node;
+		char	   *fname = strVal(llast(fcall->funcname));
+		int			i;
 
-		if (isSystemType((Node *) tc->typeName, "timestamptz") ||
-			isSystemType((Node *) tc->typeName, "timetz"))
+		for (i = 0; session_state_functions[i]; i++)
 		{
-			ctx->has_non_immutable_function_call = true;
-			return false;
+			if (!strcmp(fname, session_state_functions[i]))
+				return true;
 		}
 	}
-	else if (IsA(node, SQLValueFunction))
-	{
-		/*
-		 * SQLValueFunctions (CURRENT_TIME, CURRENT_USER etc.) are regarded as
-		 * non immutable functions.
-		 */
-		ctx->has_non_immutable_function_call = true;
-		return false;
-	}
-
-	return raw_expression_tree_walker(node, non_immutable_function_call_walker, context);
+	return raw_expression_tree_walker(node, session_state_walker, context);
 }
 
 /*
@@ -1199,6 +1501,8 @@ bool function_volatile_property(char *fname, FUNC_VOLATILE_PROPERTY property)
 /*
  * Convert table_name(possibly including schema name) to oid
  */
+static POOL_RELCACHE * table_oid_relcache;
+
 int
 pool_table_name_to_oid(char *table_name)
 {
@@ -1210,7 +1514,6 @@ pool_table_name_to_oid(char *table_name)
 #define TABLE_TO_OID_QUERY3 "SELECT COALESCE(pg_catalog.to_regclass('%s')::oid, 0)"
 
 	int			oid = 0;
-	static POOL_RELCACHE * relcache;
 	POOL_CONNECTION_POOL *backend;
 	char	   *query;
 
@@ -1240,12 +1543,12 @@ pool_table_name_to_oid(char *table_name)
 	/*
 	 * If relcache does not exist, create it.
 	 */
-	if (!relcache)
+	if (!table_oid_relcache)
 	{
-		relcache = pool_create_relcache(pool_config->relcache_size, query,
-										int_register_func, int_unregister_func,
-										true);
-		if (relcache == NULL)
+		table_oid_relcache = pool_create_relcache(pool_config->relcache_size, query,
+												  int_register_func, int_unregister_func,
+												  true);
+		if (table_oid_relcache == NULL)
 		{
 			ereport(WARNING,
 					(errmsg("unable to create relcache, getting OID from table name")));
@@ -1257,16 +1560,249 @@ pool_table_name_to_oid(char *table_name)
 		 * there's no such a table. In this case we do not want to cache the
 		 * state because the table might be created later in this session.
 		 */
-		relcache->no_cache_if_zero = true;
+		table_oid_relcache->no_cache_if_zero = true;
 	}
 
 	/*
 	 * Search relcache.
 	 */
-	oid = (int) (intptr_t) pool_search_relcache(relcache, backend, table_name);
+	oid = (int) (intptr_t) pool_search_relcache(table_oid_relcache, backend, table_name);
 	return oid;
 }
 
+/*
+ * Maximum number of tables pool_prefetch_relcache() looks up at once.
+ */
+#define RELCACHE_PREFETCH_MAX	64
+
+typedef struct
+{
+	int			num;
+	char	   *names[RELCACHE_PREFETCH_MAX];	/* possibly qualified name */
+	char	   *relnames[RELCACHE_PREFETCH_MAX];	/* bare name */
+}			PrefetchContext;
+
+static bool prefetch_table_walker(Node *node, void *context);
+
+/*
+ * Look up all tables of a SELECT statement in one catalog query, and
+ * store the results into the relcaches used by is_temp_table(),
+ * is_unlogged_table(), is_view() and pool_table_name_to_oid().  Without
+ * this each of them sends one query per table, which makes the first
+ * execution of a query joining many tables expensive.  Tables already
+ * known to the relcaches are not looked up again.  If prefetching is not
+ * possible, the relcaches are filled by the per table queries as before.
+ */
+void
+pool_prefetch_relcache(Node *node)
+{
+#define PREFETCH_TEMP_QUERY "(SELECT count(*) FROM pg_catalog.pg_class AS t, pg_catalog.pg_namespace AS n WHERE t.relname = v.relname AND t.relnamespace = n.oid AND n.nspname ~ '^pg_temp_')"
+
+	POOL_CONNECTION_POOL *backend;
+	PrefetchContext ctx;
+	POOL_SELECT_RESULT *res;
+	StringInfoData query;
+	bool		need_temp;
+	bool		need_unlogged;
+	bool		need_view;
+	bool		need_oid;
+	void	   *data;
+	int			missing;
+	int			i;
+
+	if (node == NULL || !IsA(node, SelectStmt))
+		return;
+
+	need_temp = pool_config->check_temp_table == CHECK_TEMP_CATALOG ||
+		pool_config->check_temp_table == CHECK_TEMP_ON;
+	need_unlogged = pool_config->check_unlogged_table || pool_config->memory_cache_enabled;
+	need_view = need_oid = pool_config->memory_cache_enabled;
+
+	if (!need_temp && !need_unlogged && !need_view && !need_oid)
+		return;
+
+	backend = pool_get_session_context(false)->backend;
+
+	/* the query below needs to_regclass(text), which appeared in 9.6 */
+	if (Pgversion(backend)->major < 96)
+		return;
+
+	/* create the relcaches the same way as their users do */
+	if (need_temp && !is_temp_table_relcache)
+		is_temp_table_relcache = pool_create_relcache(pool_config->relcache_size, ISTEMPQUERY83,
+													  int_register_func, int_unregister_func,
+													  true);
+	if (need_unlogged && !unlogged_table_relcache)
+		unlogged_table_relcache = pool_create_relcache(pool_config->relcache_size, ISUNLOGGEDQUERY3,
+													   int_register_func, int_unregister_func,
+													   false);
+	if (need_view && !view_relcache)
+		view_relcache = pool_create_relcache(pool_config->relcache_size, ISVIEWQUERY3,
+											 int_register_func, int_unregister_func,
+											 false);
+	if (need_oid && !table_oid_relcache)
+	{
+		table_oid_relcache = pool_create_relcache(pool_config->relcache_size, TABLE_TO_OID_QUERY3,
+												  int_register_func, int_unregister_func,
+												  true);
+		if (table_oid_relcache)
+			table_oid_relcache->no_cache_if_zero = true;
+	}
+
+	need_temp = need_temp && is_temp_table_relcache;
+	need_unlogged = need_unlogged && unlogged_table_relcache;
+	need_view = need_view && view_relcache;
+	need_oid = need_oid && table_oid_relcache;
+
+	ctx.num = 0;
+	raw_expression_tree_walker(node, prefetch_table_walker, &ctx);
+
+	/*
+	 * Remove tables whose information is already cached.  Prefetching is
+	 * worth only if it saves at least one query.
+	 */
+	missing = 0;
+	for (i = 0; i < ctx.num;)
+	{
+		int			n = 0;
+
+		if (need_temp && !pool_relcache_lookup(is_temp_table_relcache, backend, ctx.relnames[i], &data))
+			n++;
+		if (need_unlogged && !pool_relcache_lookup(unlogged_table_relcache, backend, ctx.names[i], &data))
+			n++;
+		if (need_view && !pool_relcache_lookup(view_relcache, backend, ctx.names[i], &data))
+			n++;
+		if (need_oid && !pool_relcache_lookup(table_oid_relcache, backend, ctx.names[i], &data))
+			n++;
+
+		if (n == 0)
+		{
+			ctx.num--;
+			ctx.names[i] = ctx.names[ctx.num];
+			ctx.relnames[i] = ctx.relnames[ctx.num];
+			continue;
+		}
+		missing += n;
+		i++;
+	}
+
+	if (missing < 2)
+		return;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT COALESCE(c.oid, 0), "
+					 "COALESCE((c.relpersistence = 'u')::int, 0), "
+					 "COALESCE((c.relkind IN ('v', 'm'))::int, 0), %s "
+					 "FROM (VALUES ",
+					 need_temp ? PREFETCH_TEMP_QUERY : "0");
+	for (i = 0; i < ctx.num; i++)
+		appendStringInfo(&query, "%s(%d, '%s', '%s')",
+						 i == 0 ? "" : ", ", i, ctx.names[i], ctx.relnames[i]);
+	appendStringInfoString(&query,
+						   ") AS v(i, name, relname) "
+						   "LEFT JOIN pg_catalog.pg_class AS c "
+						   "ON c.oid = pg_catalog.to_regclass(v.name) ORDER BY v.i");
+
+	res = NULL;
+	if (!pool_relcache_query(backend, query.data, &res))
+	{
+		pfree(query.data);
+		return;
+	}
+	pfree(query.data);
+
+	if (res == NULL)
+		return;
+
+	if (res->numrows != ctx.num || res->rowdesc->num_attrs != 4)
+	{
+		ereport(DEBUG1,
+				(errmsg("prefetching relcache"),
+				 errdetail("unexpected result: %d rows for %d tables", res->numrows, ctx.num)));
+		free_select_result(res);
+		return;
+	}
+
+	for (i = 0; i < ctx.num; i++)
+	{
+		char	  **row = &res->data[i * 4];
+
+		if (row[0] == NULL || row[1] == NULL || row[2] == NULL || row[3] == NULL)
+			continue;
+
+		if (need_oid)
+			pool_relcache_add(table_oid_relcache, backend, ctx.names[i], (void *) atol(row[0]));
+		if (need_unlogged)
+			pool_relcache_add(unlogged_table_relcache, backend, ctx.names[i], (void *) atol(row[1]));
+		if (need_view)
+			pool_relcache_add(view_relcache, backend, ctx.names[i], (void *) atol(row[2]));
+		if (need_temp)
+			pool_relcache_add(is_temp_table_relcache, backend, ctx.relnames[i], (void *) atol(row[3]));
+	}
+
+	ereport(DEBUG1,
+			(errmsg("prefetching relcache"),
+			 errdetail("looked up %d tables in one query", ctx.num)));
+
+	free_select_result(res);
+}
+
+/*
+ * Walker function to collect the tables pool_prefetch_relcache() looks
+ * up.  Names which need quoting in a string literal and system catalogs,
+ * which are checked by is_system_catalog() before anything else, are left
+ * to the per table queries.
+ */
+static bool
+prefetch_table_walker(Node *node, void *context)
+{
+	PrefetchContext *ctx = (PrefetchContext *) context;
+
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, RangeVar))
+	{
+		RangeVar   *rgv = (RangeVar *) node;
+		char	   *name;
+		int			i;
+
+		if (ctx->num >= RELCACHE_PREFETCH_MAX)
+			return true;
+
+		if (rgv->relname == NULL ||
+			strncmp(rgv->relname, "pg_", 3) == 0 ||
+			strchr(rgv->relname, '\'') || strchr(rgv->relname, '"') ||
+			(rgv->schemaname &&
+			 (strcmp(rgv->schemaname, "pg_catalog") == 0 ||
+			  strcmp(rgv->schemaname, "information_schema") == 0 ||
+			  strchr(rgv->schemaname, '\'') || strchr(rgv->schemaname, '"'))))
+			return false;
+
+		name = make_table_name_from_rangevar(rgv);
+
+		for (i = 0; i < ctx->num; i++)
+		{
+			if (strcmp(ctx->names[i], name) == 0)
+				return false;
+		}
+
+		ctx->names[ctx->num] = pstrdup(name);
+		ctx->relnames[ctx->num] = rgv->relname;
+		ctx->num++;
+		return false;
+	}
+
+	/* Skip Data-Modifying Statements in SELECT. */
+	else if (IsA(node, InsertStmt) || IsA(node, DeleteStmt) || IsA(node, UpdateStmt))
+	{
+		return false;
+	}
+
+	return raw_expression_tree_walker(node, prefetch_table_walker, context);
+}
+
 /*
  * Extract table oids from SELECT statement. Returns number of oids.
  * Oids are returned as an int array. The contents of oid array are
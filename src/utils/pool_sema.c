@@ -25,6 +25,8 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/sem.h>
+#include <time.h>
+#include <unistd.h>
 #include "utils/elog.h"
 #include "utils/pool_ipc.h"
 
@@ -132,15 +134,16 @@ pool_semaphore_lock(int semNum)
 }
 
 /*
- * Lock a semaphore (decrement count), blocking if count would be < 0.
- * Unlike pool_semaphore_lock, this returns if interrupted.
+ * Lock a semaphore (decrement count), blocking if count would be < 0, but
+ * for no more than msec milliseconds.  If msec < 0, wait forever.  Unlike
+ * pool_semaphore_lock, this also returns if interrupted.
  * Return values:
  * 0: succeeded in acquiring lock.
  * -1: error.
- * -2: interrupted.
+ * -2: timed out or interrupted.
  */
 int
-pool_semaphore_lock_allow_interrupt(int semNum)
+pool_semaphore_lock_timeout(int semNum, int msec)
 {
 	int			errStatus;
 	struct sembuf sops;
@@ -149,18 +152,36 @@ pool_semaphore_lock_allow_interrupt(int semNum)
 	sops.sem_flg = SEM_UNDO;
 	sops.sem_num = semNum;
 
-	/*
-	 * Note: if errStatus is -1 and errno == EINTR then it means we returned
-	 * from the operation prematurely because we were sent a signal.
-	 */
-	errStatus = semop(semId, &sops, 1);
+	if (msec < 0)
+		errStatus = semop(semId, &sops, 1);
+	else
+	{
+#ifdef HAVE_SEMTIMEDOP
+		struct timespec ts;
+
+		ts.tv_sec = msec / 1000;
+		ts.tv_nsec = (long) (msec % 1000) * 1000000;
+		errStatus = semtimedop(semId, &sops, 1, &ts);
+#else
+		/* no timed wait, so poll the semaphore */
+		sops.sem_flg |= IPC_NOWAIT;
+		for (;;)
+		{
+			errStatus = semop(semId, &sops, 1);
+			if (errStatus == 0 || errno != EAGAIN || msec <= 0)
+				break;
+			usleep(Min(msec, 10) * 1000);
+			msec -= Min(msec, 10);
+		}
+#endif
+	}
 
 	if (errStatus < 0)
 	{
-		if (errno == EINTR)
+		if (errno == EINTR || errno == EAGAIN)
 		{
 			ereport(DEBUG1,
-					(errmsg("interrupted while trying to lock semaphore")));
+					(errmsg("timed out or interrupted while trying to lock semaphore")));
 			return -2;
 		}
 		else
@@ -0,0 +1,434 @@
+/* -*-pgsql-c-*- */
+/*
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_shard_routing.c: routing statements on sharded tables by key.
+ *
+ * In native replication mode, the tables listed in shard_key_list are not
+ * replicated.  Each row lives on one backend node only, chosen by the hash
+ * of the value of its key column.  A statement on such tables is sent to
+ * the node holding the rows it touches if that can be told from the
+ * statement text:
+ *
+ * - INSERT ... VALUES with an explicit column list, if all rows have a
+ *   constant key hashing to the same node.
+ *
+ * - SELECT, UPDATE and DELETE whose top level WHERE clause ANDs an
+ *   equality of the key column of every sharded table with a constant, if
+ *   all of them hash to the same node.
+ *
+ * UPDATE and DELETE of a single sharded table whose key is not known are
+ * sent to all nodes, which applies them to every shard.  Any other
+ * statement reading or writing sharded tables cannot be answered by one
+ * node and is rejected.  Statements not involving sharded tables are
+ * handled as usual.
+ *
+ * Keys are hashed by the text of the constant, so 42 and '42' are the same
+ * key, but 042 is not.
+ */
+#include <string.h>
+#include <stdio.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "parser/parsenodes.h"
+#include "utils/palloc.h"
+#include "utils/elog.h"
+#include "utils/xxhash.h"
+#include "utils/pool_select_walker.h"
+#include "utils/pool_shard_routing.h"
+
+/* a sharded table referenced by the statement */
+typedef struct
+{
+	RangeVar   *rv;
+	ShardKey   *key;
+	int			node_id;		/* node of the key found, or -1 */
+}			ShardRef;
+
+typedef struct
+{
+	ShardRef   *refs;
+	int			num_refs;
+	int			max_refs;
+	bool		has_copy;		/* the statement is COPY */
+}			ShardContext;
+
+static ShardKey *find_shard_key(RangeVar *rv);
+static bool shard_table_walker(Node *node, void *context);
+static int	shard_of_const(Node *node);
+static bool column_matches(ColumnRef *cref, ShardRef *ref);
+static void find_keys_in_where(Node *where, ShardContext *ctx);
+static int	route_insert(InsertStmt *stmt, ShardContext *ctx, const char **reason);
+
+/*
+ * Decide where to send a statement.  Returns the node id holding the
+ * shard, SHARD_ROUTE_NONE if no sharded table is involved, SHARD_ROUTE_ALL
+ * if the statement is to be sent to all nodes, or SHARD_ROUTE_REJECT with
+ * *reason set if it cannot be routed.
+ */
+int
+pool_shard_route(Node *node, const char **reason)
+{
+	ShardContext ctx;
+	Node	   *where = NULL;
+	RangeVar   *target = NULL;
+	int			node_id = -1;
+	bool		unknown = false;
+	int			i;
+
+	if (node == NULL || pool_config->parsed_shard_key_list == NULL)
+		return SHARD_ROUTE_NONE;
+
+	memset(&ctx, 0, sizeof(ctx));
+	shard_table_walker(node, &ctx);
+
+	if (ctx.num_refs == 0)
+		return SHARD_ROUTE_NONE;
+
+	if (ctx.has_copy)
+	{
+		*reason = "COPY of a sharded table is not supported";
+		return SHARD_ROUTE_REJECT;
+	}
+
+	if (IsA(node, InsertStmt))
+		return route_insert((InsertStmt *) node, &ctx, reason);
+	else if (IsA(node, SelectStmt))
+		where = ((SelectStmt *) node)->whereClause;
+	else if (IsA(node, UpdateStmt))
+	{
+		UpdateStmt *stmt = (UpdateStmt *) node;
+		ListCell   *cell;
+
+		where = stmt->whereClause;
+		target = stmt->relation;
+
+		/* rows would have to move to another shard */
+		foreach(cell, stmt->targetList)
+		{
+			ResTarget  *res = lfirst(cell);
+			ShardKey   *key = find_shard_key(target);
+
+			if (key && res->name && strcmp(res->name, key->column) == 0)
+			{
+				*reason = "the shard key column cannot be updated";
+				return SHARD_ROUTE_REJECT;
+			}
+		}
+	}
+	else if (IsA(node, DeleteStmt))
+	{
+		where = ((DeleteStmt *) node)->whereClause;
+		target = ((DeleteStmt *) node)->relation;
+	}
+	else
+		return SHARD_ROUTE_NONE;	/* DDL, TRUNCATE etc. go to all nodes */
+
+	find_keys_in_where(where, &ctx);
+
+	for (i = 0; i < ctx.num_refs; i++)
+	{
+		if (ctx.refs[i].node_id < 0)
+			unknown = true;
+		else if (node_id < 0)
+			node_id = ctx.refs[i].node_id;
+		else if (node_id != ctx.refs[i].node_id)
+		{
+			*reason = "the statement spans more than one shard";
+			return SHARD_ROUTE_REJECT;
+		}
+	}
+
+	if (!unknown)
+		return node_id;
+
+	/* UPDATE or DELETE of a single sharded table can be done on each shard */
+	if (target && ctx.num_refs == 1 && ctx.refs[0].rv == target)
+		return SHARD_ROUTE_ALL;
+
+	*reason = "the shard key of a sharded table is not given as a constant in the WHERE clause";
+	return SHARD_ROUTE_REJECT;
+}
+
+/*
+ * Return the shard key of a table, or NULL if it is not sharded.  A table
+ * name of shard_key_list without schema matches the table in any schema.
+ */
+static ShardKey *
+find_shard_key(RangeVar *rv)
+{
+	ShardKey   *key;
+
+	if (rv == NULL || rv->relname == NULL)
+		return NULL;
+
+	for (key = pool_config->parsed_shard_key_list; key->table; key++)
+	{
+		char	   *dot = strchr(key->table, '.');
+
+		if (dot == NULL)
+		{
+			if (strcasecmp(key->table, rv->relname) == 0)
+				return key;
+		}
+		else if (rv->schemaname &&
+				 strlen(rv->schemaname) == dot - key->table &&
+				 strncasecmp(key->table, rv->schemaname, dot - key->table) == 0 &&
+				 strcasecmp(dot + 1, rv->relname) == 0)
+			return key;
+	}
+	return NULL;
+}
+
+/*
+ * Walker function to collect the sharded tables referenced by a statement.
+ */
+static bool
+shard_table_walker(Node *node, void *context)
+{
+	ShardContext *ctx = (ShardContext *) context;
+
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, RangeVar))
+	{
+		RangeVar   *rv = (RangeVar *) node;
+		ShardKey   *key = find_shard_key(rv);
+
+		if (key == NULL)
+			return false;
+
+		if (ctx->num_refs >= ctx->max_refs)
+		{
+			ctx->max_refs = ctx->max_refs ? ctx->max_refs * 2 : 4;
+			if (ctx->refs)
+				ctx->refs = repalloc(ctx->refs, sizeof(ShardRef) * ctx->max_refs);
+			else
+				ctx->refs = palloc(sizeof(ShardRef) * ctx->max_refs);
+		}
+		ctx->refs[ctx->num_refs].rv = rv;
+		ctx->refs[ctx->num_refs].key = key;
+		ctx->refs[ctx->num_refs].node_id = -1;
+		ctx->num_refs++;
+		return false;
+	}
+
+	/* raw_expression_tree_walker() does not look into COPY */
+	if (IsA(node, CopyStmt))
+	{
+		CopyStmt   *stmt = (CopyStmt *) node;
+
+		ctx->has_copy = true;
+		shard_table_walker((Node *) stmt->relation, context);
+		return shard_table_walker(stmt->query, context);
+	}
+
+	return raw_expression_tree_walker(node, shard_table_walker, context);
+}
+
+/*
+ * Return the node holding the shard of a constant key, or -1 if the node
+ * is not a constant.
+ */
+static int
+shard_of_const(Node *node)
+{
+	A_Const    *c;
+	char		buf[32];
+	const char *str;
+
+	if (node && IsA(node, TypeCast))
+		node = ((TypeCast *) node)->arg;
+
+	if (node == NULL || !IsA(node, A_Const))
+		return -1;
+
+	c = (A_Const *) node;
+	if (c->isnull)
+		return -1;
+
+	switch (nodeTag(&c->val))
+	{
+		case T_Integer:
+			snprintf(buf, sizeof(buf), "%d", intVal(&c->val));
+			str = buf;
+			break;
+		case T_Float:
+			str = c->val.fval.fval;
+			break;
+		case T_String:
+			str = c->val.sval.sval;
+			break;
+		case T_Boolean:
+			str = boolVal(&c->val) ? "true" : "false";
+			break;
+		default:
+			return -1;
+	}
+
+	return pool_xxh64(str, strlen(str), 0) % pool_config->backend_desc->shard_count;
+}
+
+/*
+ * Return true if a column reference may name the shard key of ref.
+ */
+static bool
+column_matches(ColumnRef *cref, ShardRef *ref)
+{
+	int			nfields = list_length(cref->fields);
+	Node	   *last;
+	char	   *qualifier;
+
+	if (nfields == 0)
+		return false;
+
+	last = llast(cref->fields);
+	if (!IsA(last, String) || strcmp(strVal(last), ref->key->column) != 0)
+		return false;
+
+	if (nfields == 1)
+		return true;
+
+	qualifier = strVal(list_nth(cref->fields, nfields - 2));
+	if (ref->rv->alias)
+		return strcmp(qualifier, ref->rv->alias->aliasname) == 0;
+	return strcmp(qualifier, ref->rv->relname) == 0;
+}
+
+/*
+ * Look for "key = constant" in the top level AND list of a WHERE clause
+ * for each sharded table.
+ */
+static void
+find_keys_in_where(Node *where, ShardContext *ctx)
+{
+	A_Expr	   *expr;
+	ColumnRef  *cref;
+	Node	   *value;
+	int			i;
+	int			matches = 0;
+	int			match = -1;
+
+	if (where == NULL)
+		return;
+
+	if (IsA(where, BoolExpr))
+	{
+		BoolExpr   *bexpr = (BoolExpr *) where;
+		ListCell   *cell;
+
+		if (bexpr->boolop != AND_EXPR)
+			return;
+		foreach(cell, bexpr->args)
+			find_keys_in_where(lfirst(cell), ctx);
+		return;
+	}
+
+	if (!IsA(where, A_Expr))
+		return;
+
+	expr = (A_Expr *) where;
+	if (expr->kind != AEXPR_OP || list_length(expr->name) != 1 ||
+		strcmp(strVal(linitial(expr->name)), "=") != 0)
+		return;
+
+	if (expr->lexpr && IsA(expr->lexpr, ColumnRef))
+	{
+		cref = (ColumnRef *) expr->lexpr;
+		value = expr->rexpr;
+	}
+	else if (expr->rexpr && IsA(expr->rexpr, ColumnRef))
+	{
+		cref = (ColumnRef *) expr->rexpr;
+		value = expr->lexpr;
+	}
+	else
+		return;
+
+	/* an unqualified column must be the key of exactly one table */
+	for (i = 0; i < ctx->num_refs; i++)
+	{
+		if (column_matches(cref, &ctx->refs[i]))
+		{
+			matches++;
+			match = i;
+		}
+	}
+	if (matches != 1)
+		return;
+
+	ctx->refs[match].node_id = shard_of_const(value);
+}
+
+/*
+ * Route INSERT ... VALUES into a sharded table.
+ */
+static int
+route_insert(InsertStmt *stmt, ShardContext *ctx, const char **reason)
+{
+	ShardKey   *key = find_shard_key(stmt->relation);
+	SelectStmt *values = (SelectStmt *) stmt->selectStmt;
+	ListCell   *cell;
+	int			keypos = -1;
+	int			node_id = -1;
+	int			i = 0;
+
+	if (key == NULL || ctx->num_refs != 1)
+	{
+		*reason = "INSERT reading sharded tables is not supported";
+		return SHARD_ROUTE_REJECT;
+	}
+
+	foreach(cell, stmt->cols)
+	{
+		ResTarget  *res = lfirst(cell);
+
+		if (res->name && strcmp(res->name, key->column) == 0)
+			keypos = i;
+		i++;
+	}
+
+	if (keypos < 0 || values == NULL || !IsA(values, SelectStmt) ||
+		values->valuesLists == NIL)
+	{
+		*reason = "INSERT into a sharded table must give the shard key in its column list and VALUES";
+		return SHARD_ROUTE_REJECT;
+	}
+
+	foreach(cell, values->valuesLists)
+	{
+		List	   *row = lfirst(cell);
+		int			n;
+
+		if (list_length(row) <= keypos ||
+			(n = shard_of_const(list_nth(row, keypos))) < 0)
+		{
+			*reason = "the shard key of INSERT is not a constant";
+			return SHARD_ROUTE_REJECT;
+		}
+		if (node_id >= 0 && n != node_id)
+		{
+			*reason = "the rows of INSERT belong to more than one shard";
+			return SHARD_ROUTE_REJECT;
+		}
+		node_id = n;
+	}
+
+	return node_id;
+}
@@ -0,0 +1,1079 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_shared_relcache.c: relation cache shared among child processes.
+ *
+ * The results of the system catalog queries issued by pool_search_relcache()
+ * are stored in shared memory, so that a lookup done by one child process
+ * saves the query in all the others.  Entries are looked up by the hash of
+ * the database name and the query string.  The number of entries is limited
+ * by shared_relcache_size.  When the cache is full, the least recently used
+ * entry is replaced.  Results too large for an entry are not shared.
+ *
+ * DDL executed through any child process throws away the whole cache and
+ * advances the cache generation.  Each child process compares the
+ * generation with the one its local relcaches have been filled with, and
+ * empties them if the generation has changed.  This way a dropped or
+ * altered table is noticed by every process without waiting for
+ * relcache_expire.
+ *
+ * If relcache_background_refresh is on, an entry which has passed
+ * relcache_expire is still served for another relcache_expire seconds,
+ * while the relcache refresh worker process re-executes its query and
+ * replaces it.  Thus busy tables do not make the clients wait for the
+ * catalog query every time their entries expire.
+ *
+ * If relcache_prefetch is on, the same worker fetches the server version of
+ * each backend node into shared memory, so that the first session of each
+ * child process does not have to ask for it.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/palloc.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/ps_status.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_atomic.h"
+#include "utils/xxhash.h"
+#include "utils/pool_ipc.h"
+#include "utils/pool_relcache.h"
+#include "auth/pool_passwd.h"
+#include "context/pool_process_context.h"
+#include "utils/pool_shared_relcache.h"
+#include "protocol/pool_process_query.h"
+#include "protocol/pool_pg_utils.h"
+
+/* Maximum size of a serialized query result */
+#define SHARED_RELCACHE_DATA_SIZE	128
+
+/* Number of refresh requests which can be queued */
+#define SHARED_RELCACHE_REFRESH_QUEUE_SIZE	64
+
+/* Number of databases the refresh worker keeps connections to */
+#define REFRESH_MAX_CONNECTIONS	4
+
+/* Interval of fetching the prefetched information again, in seconds */
+#define RELCACHE_PREFETCH_INTERVAL	60
+
+typedef struct
+{
+	uint64		key[2];			/* hash of database name and query */
+	bool		used;			/* true if the entry holds data */
+	bool		refreshing;		/* true if refresh has been requested */
+	int			hash_next;		/* next entry in the hash chain or in the
+								 * free list, -1 if none */
+	int			lru_prev;		/* more recently used entry or -1 */
+	int			lru_next;		/* less recently used entry or -1 */
+	time_t		expire;			/* expiration absolute time, 0 if never */
+	int			len;			/* length of data */
+	char		data[SHARED_RELCACHE_DATA_SIZE];	/* serialized query result */
+}			SharedRelCacheEntry;
+
+typedef struct
+{
+	char		dbname[NAMEDATALEN];
+	char		query[MAX_QUERY_LENGTH];
+}			SharedRelCacheRefreshRequest;
+
+typedef struct
+{
+	pool_atomic_uint32 generation;	/* advanced at each invalidation */
+	int			num_entries;
+	int			num_buckets;	/* power of 2 */
+	int			free_list;		/* unused entries */
+	int			lru_head;		/* most recently used entry */
+	int			lru_tail;		/* least recently used entry */
+	uint64		hits;
+	uint64		misses;
+	int		   *buckets;		/* heads of hash chains, -1 if empty */
+	SharedRelCacheEntry *entries;
+	pid_t		refresh_worker_pid; /* 0 if not running */
+	int			refresh_head;	/* oldest request */
+	int			refresh_count;	/* number of queued requests */
+	SharedRelCacheRefreshRequest refresh_queue[SHARED_RELCACHE_REFRESH_QUEUE_SIZE];
+	/* result of version() of each node, empty if unknown */
+	char		server_version[MAX_NUM_BACKENDS][MAX_PG_VERSION_STRING + 1];
+}			SharedRelCache;
+
+static SharedRelCache *shared_relcache = NULL;
+
+/* connections of the refresh worker */
+static struct
+{
+	char		dbname[NAMEDATALEN];
+	int			node_id;
+	POOL_CONNECTION_POOL_SLOT *slot;
+}			refresh_connections[REFRESH_MAX_CONNECTIONS];
+static int	refresh_connection_next = 0;
+
+/* status_changed_time of each node when its server version was fetched */
+static time_t prefetch_status_time[MAX_NUM_BACKENDS];
+static time_t last_prefetch = 0;
+
+static volatile sig_atomic_t reload_config_request = 0;
+
+static int	shared_relcache_num_buckets(void);
+static void shared_relcache_key(char *dbname, char *query, uint64 *key);
+static int	shared_relcache_lookup(uint64 *key);
+static void shared_relcache_remove(int index);
+static void shared_relcache_reset(void);
+static void lru_unlink(int index);
+static void lru_push_head(int index);
+static char *serialize_select_result(POOL_SELECT_RESULT * res, int *len);
+static POOL_SELECT_RESULT * deserialize_select_result(char *data, int len);
+static bool enqueue_refresh_request(char *dbname, char *query);
+static bool dequeue_refresh_request(SharedRelCacheRefreshRequest * req);
+static void refresh_entry(SharedRelCacheRefreshRequest * req);
+static POOL_CONNECTION_POOL_SLOT * get_refresh_connection(char *dbname, int node_id);
+static void discard_refresh_connection(POOL_CONNECTION_POOL_SLOT * slot);
+static void prefetch_server_versions(void);
+static void set_server_version(int node_id, char *version);
+static RETSIGTYPE my_signal_handler(int sig);
+static RETSIGTYPE reload_config_handler(int sig);
+static RETSIGTYPE wakeup_handler(int sig);
+static void reload_config(void);
+
+#define CHECK_REQUEST \
+	do { \
+		if (reload_config_request) \
+		{ \
+			reload_config(); \
+			reload_config_request = 0; \
+		} \
+	} while (0)
+
+/*
+ * Size of shared memory needed by the shared relcache.
+ */
+size_t
+pool_shared_relcache_shmem_size(void)
+{
+	size_t		size;
+
+	size = MAXALIGN(sizeof(SharedRelCache));
+	size += MAXALIGN(sizeof(int) * shared_relcache_num_buckets());
+	size += MAXALIGN(sizeof(SharedRelCacheEntry) * pool_config->shared_relcache_size);
+
+	elog(DEBUG1, "pool_shared_relcache_shmem_size: %zu", size);
+	return size;
+}
+
+/*
+ * Allocate and initialize the shared relcache.  This should be called
+ * only once from pgpool main process at the process starting up time.
+ */
+void
+pool_init_shared_relcache(void)
+{
+	char	   *p;
+
+	p = pool_shared_memory_segment_get_chunk(pool_shared_relcache_shmem_size());
+
+	shared_relcache = (SharedRelCache *) p;
+	p += MAXALIGN(sizeof(SharedRelCache));
+	shared_relcache->num_buckets = shared_relcache_num_buckets();
+	shared_relcache->buckets = (int *) p;
+	p += MAXALIGN(sizeof(int) * shared_relcache->num_buckets);
+	shared_relcache->num_entries = pool_config->shared_relcache_size;
+	shared_relcache->entries = (SharedRelCacheEntry *) p;
+
+	pool_atomic_init_u32(&shared_relcache->generation, 0);
+	shared_relcache->refresh_worker_pid = 0;
+	shared_relcache->refresh_head = 0;
+	shared_relcache->refresh_count = 0;
+	memset(shared_relcache->server_version, 0, sizeof(shared_relcache->server_version));
+	shared_relcache_reset();
+}
+
+/*
+ * Returns true if the shared relcache is available.
+ */
+bool
+pool_is_shared_relcache(void)
+{
+	return pool_config->enable_shared_relcache && shared_relcache != NULL;
+}
+
+/*
+ * Returns true if expired entries are refreshed by the relcache refresh
+ * worker process.
+ */
+bool
+pool_is_relcache_background_refresh(void)
+{
+	return pool_config->enable_shared_relcache &&
+		pool_config->relcache_background_refresh &&
+		pool_config->relcache_expire > 0;
+}
+
+/*
+ * Returns true if the relcache refresh worker process is needed.
+ */
+bool
+pool_need_relcache_refresh_worker(void)
+{
+	return pool_is_relcache_background_refresh() ||
+		(pool_config->enable_shared_relcache && pool_config->relcache_prefetch);
+}
+
+/*
+ * Copy the server version string of the node prefetched by the relcache
+ * refresh worker into buf.  Returns false if it is not available.
+ */
+bool
+pool_shared_relcache_server_version(int node_id, char *buf, int size)
+{
+	pool_sigset_t oldmask;
+
+	if (!pool_is_shared_relcache() || !pool_config->relcache_prefetch ||
+		node_id < 0 || node_id >= MAX_NUM_BACKENDS)
+		return false;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	strlcpy(buf, shared_relcache->server_version[node_id], size);
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	return buf[0] != '\0';
+}
+
+/*
+ * Returns the current generation of the shared relcache.  Local relcaches
+ * filled before the generation changed may hold stale information.
+ */
+uint32
+pool_shared_relcache_generation(void)
+{
+	if (!pool_is_shared_relcache())
+		return 0;
+
+	return pool_atomic_read_u32(&shared_relcache->generation);
+}
+
+/*
+ * Search the result of query issued against database dbname.  Returns a
+ * copy of the result allocated in the current memory context, or NULL if
+ * not found.
+ */
+POOL_SELECT_RESULT *
+pool_shared_relcache_search(char *dbname, char *query)
+{
+	SharedRelCacheEntry *entry;
+	uint64		key[2];
+	char		data[SHARED_RELCACHE_DATA_SIZE];
+	int			len = -1;
+	int			index;
+	time_t		now;
+	pid_t		wakeup_pid = 0;
+	pool_sigset_t oldmask;
+
+	if (!pool_is_shared_relcache())
+		return NULL;
+
+	now = time(NULL);
+
+	shared_relcache_key(dbname, query, key);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	index = shared_relcache_lookup(key);
+	if (index >= 0)
+	{
+		entry = &shared_relcache->entries[index];
+
+		if (entry->expire > 0 && now > entry->expire &&
+			(!pool_is_relcache_background_refresh() ||
+			 shared_relcache->refresh_worker_pid == 0 ||
+			 now > entry->expire + pool_config->relcache_expire))
+		{
+			shared_relcache_remove(index);
+		}
+		else
+		{
+			/* expired but still usable. ask the worker to refresh it */
+			if (entry->expire > 0 && now > entry->expire && !entry->refreshing &&
+				enqueue_refresh_request(dbname, query))
+			{
+				entry->refreshing = true;
+				wakeup_pid = shared_relcache->refresh_worker_pid;
+			}
+
+			len = entry->len;
+			memcpy(data, entry->data, len);
+			lru_unlink(index);
+			lru_push_head(index);
+		}
+	}
+
+	if (len >= 0)
+		shared_relcache->hits++;
+	else
+		shared_relcache->misses++;
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	if (wakeup_pid > 0)
+		kill(wakeup_pid, SIGUSR2);
+
+	if (len < 0)
+		return NULL;
+
+	return deserialize_select_result(data, len);
+}
+
+/*
+ * Register the result of query issued against database dbname.
+ * generation must be the return value of pool_shared_relcache_generation()
+ * obtained before the query was sent.  If the cache has been invalidated
+ * since then, the result may be obsolete already and is not registered.
+ */
+void
+pool_shared_relcache_add(char *dbname, char *query, POOL_SELECT_RESULT * res, uint32 generation)
+{
+	SharedRelCacheEntry *entry;
+	uint64		key[2];
+	char	   *data;
+	int			len;
+	int			index;
+	int		   *bucket;
+	pool_sigset_t oldmask;
+
+	if (!pool_is_shared_relcache() || res == NULL || shared_relcache->num_entries <= 0)
+		return;
+
+	data = serialize_select_result(res, &len);
+	if (data == NULL)
+		return;
+
+	shared_relcache_key(dbname, query, key);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	if (pool_atomic_read_u32(&shared_relcache->generation) != generation)
+	{
+		pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+		POOL_SETMASK(&oldmask);
+		pfree(data);
+		return;
+	}
+
+	/* another process may have registered it in the meantime */
+	index = shared_relcache_lookup(key);
+	if (index >= 0)
+		shared_relcache_remove(index);
+
+	if (shared_relcache->free_list < 0)
+	{
+		ereport(DEBUG1,
+				(errmsg("shared relcache replacement happened"),
+				 errdetail("hits: %llu misses: %llu",
+						   (unsigned long long) shared_relcache->hits,
+						   (unsigned long long) shared_relcache->misses)));
+		shared_relcache_remove(shared_relcache->lru_tail);
+	}
+
+	index = shared_relcache->free_list;
+	entry = &shared_relcache->entries[index];
+	shared_relcache->free_list = entry->hash_next;
+
+	entry->key[0] = key[0];
+	entry->key[1] = key[1];
+	entry->used = true;
+	entry->refreshing = false;
+	if (pool_config->relcache_expire > 0)
+		entry->expire = time(NULL) + pool_config->relcache_expire;
+	else
+		entry->expire = 0;
+	entry->len = len;
+	memcpy(entry->data, data, len);
+
+	bucket = &shared_relcache->buckets[key[0] & (shared_relcache->num_buckets - 1)];
+	entry->hash_next = *bucket;
+	*bucket = index;
+	lru_push_head(index);
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	pfree(data);
+}
+
+/*
+ * Throw away the whole shared relcache and advance its generation, which
+ * lets every child process discard its local relcaches as well.  Called
+ * when a DDL has been executed.
+ */
+void
+pool_shared_relcache_invalidate(void)
+{
+	pool_sigset_t oldmask;
+
+	if (!pool_is_shared_relcache())
+		return;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	shared_relcache_reset();
+	pool_atomic_fetch_add_u32(&shared_relcache->generation, 1);
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	ereport(DEBUG1,
+			(errmsg("shared relcache invalidated")));
+}
+
+/*
+ * Number of hash buckets: a power of 2 not less than the number of entries.
+ */
+static int
+shared_relcache_num_buckets(void)
+{
+	int			nbuckets;
+
+	for (nbuckets = 16; nbuckets < pool_config->shared_relcache_size; nbuckets *= 2)
+		;
+	return nbuckets;
+}
+
+/*
+ * Entries are identified by a 128 bit hash only, like query cache entries.
+ */
+static void
+shared_relcache_key(char *dbname, char *query, uint64 *key)
+{
+	uint64		h;
+
+	h = pool_xxh64(dbname, strlen(dbname), 0);
+	key[0] = pool_xxh64(query, strlen(query), h);
+	key[1] = pool_xxh64(query, strlen(query), ~h);
+}
+
+static int
+shared_relcache_lookup(uint64 *key)
+{
+	int			index;
+
+	for (index = shared_relcache->buckets[key[0] & (shared_relcache->num_buckets - 1)];
+		 index >= 0; index = shared_relcache->entries[index].hash_next)
+	{
+		SharedRelCacheEntry *entry = &shared_relcache->entries[index];
+
+		if (entry->key[0] == key[0] && entry->key[1] == key[1])
+			return index;
+	}
+	return -1;
+}
+
+/*
+ * Unlink the entry from the hash chain and the LRU list and put it on the
+ * free list.
+ */
+static void
+shared_relcache_remove(int index)
+{
+	SharedRelCacheEntry *entry = &shared_relcache->entries[index];
+	int		   *p;
+
+	for (p = &shared_relcache->buckets[entry->key[0] & (shared_relcache->num_buckets - 1)];
+		 *p >= 0; p = &shared_relcache->entries[*p].hash_next)
+	{
+		if (*p == index)
+		{
+			*p = entry->hash_next;
+			break;
+		}
+	}
+
+	lru_unlink(index);
+
+	entry->used = false;
+	entry->hash_next = shared_relcache->free_list;
+	shared_relcache->free_list = index;
+}
+
+/*
+ * Make all entries unused.  The caller must hold SHARED_RELCACHE_SEM
+ * unless the cache is being initialized.
+ */
+static void
+shared_relcache_reset(void)
+{
+	int			i;
+
+	for (i = 0; i < shared_relcache->num_buckets; i++)
+		shared_relcache->buckets[i] = -1;
+
+	for (i = 0; i < shared_relcache->num_entries; i++)
+	{
+		shared_relcache->entries[i].used = false;
+		shared_relcache->entries[i].lru_prev = -1;
+		shared_relcache->entries[i].lru_next = -1;
+		shared_relcache->entries[i].hash_next = (i + 1 < shared_relcache->num_entries) ? i + 1 : -1;
+	}
+	shared_relcache->free_list = (shared_relcache->num_entries > 0) ? 0 : -1;
+	shared_relcache->lru_head = shared_relcache->lru_tail = -1;
+}
+
+static void
+lru_unlink(int index)
+{
+	SharedRelCacheEntry *entry = &shared_relcache->entries[index];
+
+	if (entry->lru_prev >= 0)
+		shared_relcache->entries[entry->lru_prev].lru_next = entry->lru_next;
+	else
+		shared_relcache->lru_head = entry->lru_next;
+
+	if (entry->lru_next >= 0)
+		shared_relcache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+	else
+		shared_relcache->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = -1;
+}
+
+static void
+lru_push_head(int index)
+{
+	SharedRelCacheEntry *entry = &shared_relcache->entries[index];
+
+	entry->lru_prev = -1;
+	entry->lru_next = shared_relcache->lru_head;
+	if (shared_relcache->lru_head >= 0)
+		shared_relcache->entries[shared_relcache->lru_head].lru_prev = index;
+	shared_relcache->lru_head = index;
+	if (shared_relcache->lru_tail < 0)
+		shared_relcache->lru_tail = index;
+}
+
+/*
+ * Serialize a query result: number of attributes, number of rows, null
+ * flags (-1 for NULL, otherwise length) and then the values.  Returns NULL
+ * if it does not fit in an entry.
+ */
+static char *
+serialize_select_result(POOL_SELECT_RESULT * res, int *len)
+{
+	char	   *data;
+	char	   *p;
+	int			nvalues;
+	int			size;
+	int			i;
+
+	nvalues = res->rowdesc->num_attrs * res->numrows;
+
+	size = sizeof(int) * 2 + sizeof(int) * nvalues;
+	for (i = 0; i < nvalues; i++)
+	{
+		if (res->nullflags[i] > 0)
+			size += res->nullflags[i];
+		if (size > SHARED_RELCACHE_DATA_SIZE)
+			return NULL;
+	}
+	if (size > SHARED_RELCACHE_DATA_SIZE)
+		return NULL;
+
+	data = palloc(size);
+	p = data;
+	memcpy(p, &res->rowdesc->num_attrs, sizeof(int));
+	p += sizeof(int);
+	memcpy(p, &res->numrows, sizeof(int));
+	p += sizeof(int);
+	memcpy(p, res->nullflags, sizeof(int) * nvalues);
+	p += sizeof(int) * nvalues;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		if (res->nullflags[i] > 0)
+		{
+			memcpy(p, res->data[i], res->nullflags[i]);
+			p += res->nullflags[i];
+		}
+	}
+
+	*len = size;
+	return data;
+}
+
+static POOL_SELECT_RESULT *
+deserialize_select_result(char *data, int len)
+{
+	POOL_SELECT_RESULT *res;
+	char	   *p = data;
+	int			nvalues;
+	int			i;
+
+	res = palloc0(sizeof(*res));
+	res->rowdesc = palloc0(sizeof(RowDesc));
+
+	memcpy(&res->rowdesc->num_attrs, p, sizeof(int));
+	p += sizeof(int);
+	memcpy(&res->numrows, p, sizeof(int));
+	p += sizeof(int);
+
+	nvalues = res->rowdesc->num_attrs * res->numrows;
+	res->nullflags = palloc(sizeof(int) * (nvalues > 0 ? nvalues : 1));
+	res->data = palloc0(sizeof(char *) * (nvalues > 0 ? nvalues : 1));
+
+	memcpy(res->nullflags, p, sizeof(int) * nvalues);
+	p += sizeof(int) * nvalues;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		if (res->nullflags[i] >= 0)
+		{
+			res->data[i] = palloc(res->nullflags[i] + 1);
+			memcpy(res->data[i], p, res->nullflags[i]);
+			res->data[i][res->nullflags[i]] = '\0';
+			p += res->nullflags[i];
+		}
+	}
+
+	Assert(p - data == len);
+	return res;
+}
+
+/*
+ * Queue a refresh request.  Returns false if the queue is full or the
+ * request does not fit.  Caller must hold SHARED_RELCACHE_SEM.
+ */
+static bool
+enqueue_refresh_request(char *dbname, char *query)
+{
+	SharedRelCacheRefreshRequest *req;
+
+	if (shared_relcache->refresh_count >= SHARED_RELCACHE_REFRESH_QUEUE_SIZE ||
+		strlen(dbname) >= NAMEDATALEN || strlen(query) >= MAX_QUERY_LENGTH)
+		return false;
+
+	req = &shared_relcache->refresh_queue[(shared_relcache->refresh_head +
+										   shared_relcache->refresh_count) %
+										  SHARED_RELCACHE_REFRESH_QUEUE_SIZE];
+	strlcpy(req->dbname, dbname, sizeof(req->dbname));
+	strlcpy(req->query, query, sizeof(req->query));
+	shared_relcache->refresh_count++;
+	return true;
+}
+
+/*
+ * Take the oldest refresh request out of the queue.  Returns false if the
+ * queue is empty.
+ */
+static bool
+dequeue_refresh_request(SharedRelCacheRefreshRequest * req)
+{
+	bool		found = false;
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	if (shared_relcache->refresh_count > 0)
+	{
+		memcpy(req, &shared_relcache->refresh_queue[shared_relcache->refresh_head],
+			   sizeof(*req));
+		shared_relcache->refresh_head = (shared_relcache->refresh_head + 1) %
+			SHARED_RELCACHE_REFRESH_QUEUE_SIZE;
+		shared_relcache->refresh_count--;
+		found = true;
+	}
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+
+	return found;
+}
+
+/*
+ * Re-execute the query of an expired entry and register the result.  If
+ * the query cannot be executed, the entry is dropped when it expires
+ * completely and the next lookup runs the query synchronously as usual.
+ */
+static void
+refresh_entry(SharedRelCacheRefreshRequest * req)
+{
+	POOL_CONNECTION_POOL_SLOT *slot;
+	POOL_SELECT_RESULT *res = NULL;
+	MemoryContext oldContext = CurrentMemoryContext;
+	uint32		generation;
+	int			node_id;
+
+	if (Req_info->switching)
+		return;
+
+	node_id = STREAM ? REAL_PRIMARY_NODE_ID : REAL_MAIN_NODE_ID;
+	if (node_id < 0 || !VALID_BACKEND(node_id))
+		return;
+
+	slot = get_refresh_connection(req->dbname, node_id);
+	if (slot == NULL)
+		return;
+
+	generation = pool_shared_relcache_generation();
+
+	PG_TRY();
+	{
+		do_query(slot->con, req->query, &res, PROTO_MAJOR_V3);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldContext);
+		FlushErrorState();
+		res = NULL;
+		discard_refresh_connection(slot);
+		ereport(LOG,
+				(errmsg("relcache refresh worker: failed to refresh relcache entry"),
+				 errdetail("database: %s query: %s", req->dbname, req->query)));
+	}
+	PG_END_TRY();
+
+	if (res == NULL)
+		return;
+
+	pool_shared_relcache_add(req->dbname, req->query, res, generation);
+	free_select_result(res);
+
+	ereport(DEBUG1,
+			(errmsg("relcache refresh worker: refreshed relcache entry"),
+			 errdetail("database: %s query: %s", req->dbname, req->query)));
+}
+
+/*
+ * Returns a connection to the database on the node, connecting as
+ * sr_check_user if necessary.
+ */
+static POOL_CONNECTION_POOL_SLOT *
+get_refresh_connection(char *dbname, int node_id)
+{
+	MemoryContext oldContext;
+	BackendInfo *bkinfo;
+	char	   *password;
+	int			i;
+
+	for (i = 0; i < REFRESH_MAX_CONNECTIONS; i++)
+	{
+		if (refresh_connections[i].slot &&
+			refresh_connections[i].node_id == node_id &&
+			strcmp(refresh_connections[i].dbname, dbname) == 0)
+			return refresh_connections[i].slot;
+	}
+
+	/* replace connections in round robin */
+	i = refresh_connection_next;
+	refresh_connection_next = (refresh_connection_next + 1) % REFRESH_MAX_CONNECTIONS;
+	if (refresh_connections[i].slot)
+		discard_refresh_connection(refresh_connections[i].slot);
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+	bkinfo = pool_get_node_info(node_id);
+	refresh_connections[i].slot = make_persistent_db_connection_noerror(node_id,
+																		bkinfo->backend_hostname,
+																		bkinfo->backend_port,
+																		dbname,
+																		pool_config->sr_check_user,
+																		password ? password : "", false);
+	if (password)
+		pfree(password);
+	MemoryContextSwitchTo(oldContext);
+
+	strlcpy(refresh_connections[i].dbname, dbname, sizeof(refresh_connections[i].dbname));
+	refresh_connections[i].node_id = node_id;
+	return refresh_connections[i].slot;
+}
+
+static void
+discard_refresh_connection(POOL_CONNECTION_POOL_SLOT * slot)
+{
+	int			i;
+
+	for (i = 0; i < REFRESH_MAX_CONNECTIONS; i++)
+	{
+		if (refresh_connections[i].slot == slot)
+		{
+			discard_persistent_db_connection(slot);
+			refresh_connections[i].slot = NULL;
+		}
+	}
+}
+
+/*
+ * Fetch the server version of each valid node into shared memory.  The
+ * version is fetched again when the status of the node changes, since the
+ * node may have been restarted with another version, and every
+ * RELCACHE_PREFETCH_INTERVAL seconds.  The version of a node which is down
+ * is forgotten.
+ */
+static void
+prefetch_server_versions(void)
+{
+	POOL_CONNECTION_POOL_SLOT *slot;
+	POOL_SELECT_RESULT *res;
+	MemoryContext oldContext = CurrentMemoryContext;
+	BackendInfo *bkinfo;
+	time_t		now;
+	bool		expired;
+	int			i;
+
+	if (Req_info->switching)
+		return;
+
+	now = time(NULL);
+	expired = now >= last_prefetch + RELCACHE_PREFETCH_INTERVAL;
+	if (expired)
+		last_prefetch = now;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		bkinfo = pool_get_node_info(i);
+
+		if (!VALID_BACKEND(i))
+		{
+			if (prefetch_status_time[i] != 0)
+				set_server_version(i, "");
+			prefetch_status_time[i] = 0;
+			continue;
+		}
+
+		if (!expired && prefetch_status_time[i] != 0 &&
+			prefetch_status_time[i] == bkinfo->status_changed_time)
+			continue;
+
+		slot = get_refresh_connection(pool_config->sr_check_database, i);
+		if (slot == NULL)
+			continue;
+
+		res = NULL;
+		PG_TRY();
+		{
+			do_query(slot->con, PGVERSION_QUERY, &res, PROTO_MAJOR_V3);
+		}
+		PG_CATCH();
+		{
+			MemoryContextSwitchTo(oldContext);
+			FlushErrorState();
+			res = NULL;
+			discard_refresh_connection(slot);
+			ereport(LOG,
+					(errmsg("relcache refresh worker: failed to fetch server version"),
+					 errdetail("node id: %d", i)));
+		}
+		PG_END_TRY();
+
+		if (res == NULL)
+			continue;
+
+		if (res->numrows == 1 && res->nullflags[0] > 0)
+		{
+			set_server_version(i, res->data[0]);
+			prefetch_status_time[i] = bkinfo->status_changed_time;
+
+			ereport(DEBUG1,
+					(errmsg("relcache refresh worker: fetched server version"),
+					 errdetail("node id: %d version: %s", i, res->data[0])));
+		}
+		free_select_result(res);
+	}
+}
+
+static void
+set_server_version(int node_id, char *version)
+{
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(SHARED_RELCACHE_SEM);
+
+	strlcpy(shared_relcache->server_version[node_id], version,
+			sizeof(shared_relcache->server_version[node_id]));
+
+	pool_semaphore_unlock(SHARED_RELCACHE_SEM);
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Tell that the relcache refresh worker has gone away so that expired
+ * entries are not served anymore.  Called from pgpool main process.
+ */
+void
+pool_relcache_refresh_worker_exited(void)
+{
+	if (shared_relcache)
+		shared_relcache->refresh_worker_pid = 0;
+}
+
+/*
+ * relcache refresh worker main loop
+ */
+void
+do_relcache_refresh_child(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext RefreshMemoryContext;
+	SharedRelCacheRefreshRequest req;
+	pool_sigset_t run_mask;
+	pool_sigset_t sleep_mask;
+	int			i;
+
+	ereport(DEBUG1,
+			(errmsg("I am relcache refresh worker pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("relcache refresh worker", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, wakeup_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	/*
+	 * SIGUSR2 is blocked except while sleeping so that a wake up request
+	 * sent just before going to sleep is not lost.
+	 */
+	sleep_mask = UnBlockSig;
+	run_mask = UnBlockSig;
+	sigaddset(&run_mask, SIGUSR2);
+	POOL_SETMASK(&run_mask);
+
+	/* Create per loop iteration memory context */
+	RefreshMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "relcache_refresh_main_loop",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	/* Initialize per process context */
+	pool_init_process_context();
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		pool_signal(SIGALRM, SIG_IGN);
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+		POOL_SETMASK(&run_mask);
+
+		for (i = 0; i < REFRESH_MAX_CONNECTIONS; i++)
+		{
+			if (refresh_connections[i].slot)
+				discard_refresh_connection(refresh_connections[i].slot);
+		}
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	shared_relcache->refresh_worker_pid = getpid();
+
+	for (;;)
+	{
+		MemoryContextSwitchTo(RefreshMemoryContext);
+		MemoryContextResetAndDeleteChildren(RefreshMemoryContext);
+
+		CHECK_REQUEST;
+
+		if (pool_config->relcache_prefetch)
+			prefetch_server_versions();
+
+		if (dequeue_refresh_request(&req))
+		{
+			refresh_entry(&req);
+			continue;
+		}
+
+		/* Nothing to do.  Sleep until a child process wakes us up. */
+		{
+			struct timespec timeout;
+
+			timeout.tv_sec = 1;
+			timeout.tv_nsec = 0;
+			pselect(0, NULL, NULL, NULL, &timeout, &sleep_mask);
+		}
+	}
+}
+
+static RETSIGTYPE my_signal_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+
+	switch (sig)
+	{
+		case SIGTERM:
+		case SIGINT:
+		case SIGQUIT:
+			exit(0);
+			break;
+
+		default:
+			exit(1);
+			break;
+	}
+}
+
+static RETSIGTYPE reload_config_handler(int sig)
+{
+	reload_config_request = 1;
+}
+
+static RETSIGTYPE wakeup_handler(int sig)
+{
+	/* nothing to do. just interrupt pselect() */
+}
+
+static void
+reload_config(void)
+{
+	ereport(LOG,
+			(errmsg("reloading config file")));
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	pool_get_config(get_config_file_name(), CFGCXT_RELOAD);
+	MemoryContextSwitchTo(oldContext);
+	reload_config_request = 0;
+}
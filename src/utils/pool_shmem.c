@@ -21,8 +21,10 @@
  *
  */
 #include "pool.h"
+#include "pool_config.h"
 #include "utils/elog.h"
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/shm.h>
 #include <unistd.h>
@@ -40,12 +42,16 @@ static void* shared_mem_chunk = NULL;
 static char* shared_mem_free_pos = NULL;
 static size_t chunk_size = 0;
 
+static void *shared_memory_create(size_t size, HugePages huge_pages, size_t *page_size);
+static size_t get_huge_page_size(void);
 static void IpcMemoryDetach(int status, Datum shmaddr);
 static void IpcMemoryDelete(int status, Datum shmId);
 
 void
 initialize_shared_memory_main_segment(size_t size)
 {
+	size_t		page_size;
+
 	/* only main process is allowed to create the chunk */
 	if (mypid != getpid())
 	{
@@ -60,10 +66,17 @@ initialize_shared_memory_main_segment(size_t size)
 	ereport(LOG,
 			(errmsg("allocating shared memory segment of size: %zu ",size)));
 
-	shared_mem_chunk = pool_shared_memory_create(size);
+	shared_mem_chunk = shared_memory_create(size, pool_config->huge_pages, &page_size);
+	ereport(LOG,
+			(errmsg("shared memory segment uses pages of size %zu kB", page_size / 1024)));
 	shared_mem_free_pos = (char*)shared_mem_chunk;
 	chunk_size = size;
-	memset(shared_mem_chunk, 0, size);
+
+	/*
+	 * A new System V shared memory segment is zero filled by the kernel, so
+	 * there is no need to clear it.  Not touching it here lets the pages be
+	 * faulted in lazily, which matters with a large query cache.
+	 */
 }
 
 void *
@@ -101,11 +114,68 @@ pool_shared_memory_segment_get_chunk(size_t size)
 void *
 pool_shared_memory_create(size_t size)
 {
-	int			shmid;
+	size_t		page_size;
+
+	return shared_memory_create(size, HUGE_PAGES_OFF, &page_size);
+}
+
+/*
+ * Workhorse of pool_shared_memory_create().  If huge_pages is not off, try
+ * to back the segment with huge pages first, which saves TLB misses when a
+ * large segment is accessed by many processes.  If that fails, fall back
+ * to normal pages unless huge_pages is on.  The size of the pages actually
+ * used is returned in *page_size.
+ */
+static void *
+shared_memory_create(size_t size, HugePages huge_pages, size_t *page_size)
+{
+	int			shmid = -1;
 	void	   *memAddress;
 
+#ifdef SHM_HUGETLB
+	if (huge_pages != HUGE_PAGES_OFF)
+	{
+		size_t		huge_page_size = get_huge_page_size();
+
+		if (huge_page_size > 0)
+		{
+			size_t		alloc_size = size;
+
+			/* the size of a huge page segment must be a multiple of its page */
+			if (alloc_size % huge_page_size != 0)
+				alloc_size += huge_page_size - (alloc_size % huge_page_size);
+
+			shmid = shmget(IPC_PRIVATE, alloc_size,
+						   IPC_CREAT | IPC_EXCL | IPCProtection | SHM_HUGETLB);
+			*page_size = huge_page_size;
+		}
+
+		if (shmid < 0)
+		{
+			if (huge_pages == HUGE_PAGES_ON)
+				ereport(FATAL,
+						(errmsg("could not create shared memory with huge pages for request size: %zu", size),
+						 errdetail("shared memory creation failed with error \"%m\""),
+						 errhint("Reserve more huge pages with the vm.nr_hugepages kernel parameter, or set huge_pages to try or off.")));
+
+			ereport(DEBUG1,
+					(errmsg("could not create shared memory with huge pages for request size: %zu", size),
+					 errdetail("falling back to normal pages: \"%m\"")));
+		}
+	}
+#else
+	if (huge_pages == HUGE_PAGES_ON)
+		ereport(FATAL,
+				(errmsg("huge pages are not supported on this platform"),
+				 errhint("Set huge_pages to try or off.")));
+#endif
+
 	/* Try to create new segment */
-	shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | IPC_EXCL | IPCProtection);
+	if (shmid < 0)
+	{
+		*page_size = sysconf(_SC_PAGESIZE);
+		shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | IPC_EXCL | IPCProtection);
+	}
 
 	if (shmid < 0)
 		ereport(FATAL,
@@ -130,6 +200,34 @@ pool_shared_memory_create(size_t size)
 	return memAddress;
 }
 
+/*
+ * Return the default huge page size of the system, or 0 if unknown.
+ */
+static size_t
+get_huge_page_size(void)
+{
+	FILE	   *fp;
+	char		buf[128];
+	unsigned long sz;
+	size_t		page_size = 0;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp == NULL)
+		return 0;
+
+	while (fgets(buf, sizeof(buf), fp))
+	{
+		if (sscanf(buf, "Hugepagesize: %lu kB", &sz) == 1)
+		{
+			page_size = (size_t) sz * 1024;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return page_size;
+}
+
 /*
  * Removes a shared memory segment from process' address space (called as
  * an on_shmem_exit callback, hence funny argument list)
@@ -42,7 +42,35 @@
 
 #ifdef USE_SSL
 
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined (LIBRESSL_VERSION_NUMBER))
+#include <openssl/core_names.h>
+#endif
+
 static SSL_CTX *SSL_frontend_context = NULL;
+
+/*
+ * SSL contexts used by init_ssl_ctx(), one per connection type.  They are
+ * built on first use and then shared by all connections of the process, so
+ * the certificate files are read and parsed only once.  The files are
+ * startup-only parameters, so the contexts never need to be rebuilt.
+ */
+static SSL_CTX *SSL_conn_context[2] = {NULL, NULL};
+
+/*
+ * Session ticket keys.  The keys for each ssl_session_ticket_lifetime
+ * period are derived from a random secret created by the main process
+ * before forking, so every child derives the same keys, and rotation needs
+ * no coordination between processes.
+ */
+#define TICKET_SECRET_LEN	32
+static unsigned char ticket_secret[TICKET_SECRET_LEN];
+static bool ticket_secret_set = false;
+
+/* Sessions established with each backend, for resumption on reconnect */
+static SSL_SESSION *backend_session[MAX_NUM_BACKENDS];
 static bool SSL_initialized = false;
 static bool dummy_ssl_passwd_cb_called = false;
 static int  dummy_ssl_passwd_cb(char *buf, int size, int rwflag, void *userdata);
@@ -86,6 +114,20 @@ enum ssl_conn_type
 
 /* perform per-connection ssl initialization.  returns nonzero on error */
 static int	init_ssl_ctx(POOL_CONNECTION * cp, enum ssl_conn_type conntype);
+static SSL_CTX *create_ssl_ctx(enum ssl_conn_type conntype);
+static int	backend_session_new_cb(SSL *ssl, SSL_SESSION *session);
+static void report_ktls_status(POOL_CONNECTION * cp);
+static bool ticket_derive_keys(uint64 period, unsigned char *key_name,
+				   unsigned char *aes_key, unsigned char *mac_key);
+static int	ticket_lookup_keys(unsigned char *key_name, int enc,
+				   unsigned char *aes_key, unsigned char *mac_key);
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined (LIBRESSL_VERSION_NUMBER))
+static int	ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+			  EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc);
+#else
+static int	ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+			  EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc);
+#endif
 
 /* OpenSSL error message */
 static void perror_ssl(const char *context);
@@ -138,9 +180,26 @@ pool_ssl_negotiate_clientserver(POOL_CONNECTION * cp)
 			}
 
 			SSL_set_fd(cp->ssl, cp->fd);
-			SSL_RETURN_VOID_IF((SSL_connect(cp->ssl) < 0),
-							   "SSL_connect");
+
+			/* offer the session we had with this backend, if any */
+			SSL_set_app_data(cp->ssl, cp);
+			if (cp->db_node_id >= 0 && cp->db_node_id < MAX_NUM_BACKENDS &&
+				backend_session[cp->db_node_id])
+				SSL_set_session(cp->ssl, backend_session[cp->db_node_id]);
+
+			if (SSL_connect(cp->ssl) < 0)
+			{
+				if (cp->db_node_id >= 0 && cp->db_node_id < MAX_NUM_BACKENDS &&
+					backend_session[cp->db_node_id])
+				{
+					SSL_SESSION_free(backend_session[cp->db_node_id]);
+					backend_session[cp->db_node_id] = NULL;
+				}
+				perror_ssl("SSL_connect");
+				return;
+			}
 			cp->ssl_active = 1;
+			report_ktls_status(cp);
 			break;
 		case 'N':
 
@@ -195,6 +254,7 @@ pool_ssl_negotiate_serverclient(POOL_CONNECTION * cp)
 		SSL_set_fd(cp->ssl, cp->fd);
 		SSL_RETURN_VOID_IF((SSL_accept(cp->ssl) < 0), "SSL_accept");
 		cp->ssl_active = 1;
+		report_ktls_status(cp);
 		fetch_pool_ssl_cert(cp);
 	}
 }
@@ -343,10 +403,188 @@ retry:
 
 static int
 init_ssl_ctx(POOL_CONNECTION * cp, enum ssl_conn_type conntype)
+{
+	if (!SSL_conn_context[conntype])
+		SSL_conn_context[conntype] = create_ssl_ctx(conntype);
+
+	if (!SSL_conn_context[conntype])
+		return -1;
+
+	/* the context is shared, pool_ssl_close() must not free it */
+	cp->ssl_ctx = NULL;
+
+	cp->ssl = SSL_new(SSL_conn_context[conntype]);
+	SSL_RETURN_ERROR_IF((!cp->ssl), "SSL_new");
+
+	return 0;
+}
+
+/*
+ * Tell whether OpenSSL managed to hand the connection over to kernel TLS.
+ * With kernel TLS, SSL_read() and SSL_write() still work as before but the
+ * record encryption happens in the kernel.
+ */
+static void
+report_ktls_status(POOL_CONNECTION * cp)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	if (!pool_config->ssl_ktls)
+		return;
+
+	ereport(DEBUG1,
+			(errmsg("SSL connection established"),
+			 errdetail("kernel TLS send: %s, receive: %s",
+					   BIO_get_ktls_send(SSL_get_wbio(cp->ssl)) ? "on" : "off",
+					   BIO_get_ktls_recv(SSL_get_rbio(cp->ssl)) ? "on" : "off")));
+#endif
+}
+
+/*
+ * Called by OpenSSL when a backend hands us a new session.  Keep it for
+ * the next connection to the same backend.  Returning 1 tells OpenSSL that
+ * we took the reference.
+ */
+static int
+backend_session_new_cb(SSL *ssl, SSL_SESSION *session)
+{
+	POOL_CONNECTION *cp = SSL_get_app_data(ssl);
+
+	if (cp == NULL || cp->db_node_id < 0 || cp->db_node_id >= MAX_NUM_BACKENDS)
+		return 0;
+
+	if (backend_session[cp->db_node_id])
+		SSL_SESSION_free(backend_session[cp->db_node_id]);
+	backend_session[cp->db_node_id] = session;
+	return 1;
+}
+
+/*
+ * Derive the name and keys of the session ticket key for the given period.
+ * The name carries the period, followed by a tag proving that we made it.
+ */
+static bool
+ticket_derive_keys(uint64 period, unsigned char *key_name,
+				   unsigned char *aes_key, unsigned char *mac_key)
+{
+	unsigned char data[sizeof(uint64) + 1];
+	unsigned char tag[EVP_MAX_MD_SIZE];
+	unsigned int len;
+
+	memcpy(data, &period, sizeof(uint64));
+
+	data[sizeof(uint64)] = 'n';
+	if (!HMAC(EVP_sha256(), ticket_secret, TICKET_SECRET_LEN, data, sizeof(data), tag, &len))
+		return false;
+	memcpy(key_name, &period, sizeof(uint64));
+	memcpy(key_name + sizeof(uint64), tag, 16 - sizeof(uint64));
+
+	data[sizeof(uint64)] = 'a';
+	if (!HMAC(EVP_sha256(), ticket_secret, TICKET_SECRET_LEN, data, sizeof(data), aes_key, &len))
+		return false;
+
+	data[sizeof(uint64)] = 'm';
+	if (!HMAC(EVP_sha256(), ticket_secret, TICKET_SECRET_LEN, data, sizeof(data), mac_key, &len))
+		return false;
+
+	return true;
+}
+
+/*
+ * Find the ticket keys.  When encrypting, the keys of the current period
+ * are used and key_name is filled in.  When decrypting, key_name must be
+ * one of the current or the previous period.  Returns the value expected
+ * from the ticket key callback: 1 for current keys, 2 for keys that are
+ * still valid but should be replaced by a new ticket, 0 if not found and
+ * -1 on error.
+ */
+static int
+ticket_lookup_keys(unsigned char *key_name, int enc,
+				   unsigned char *aes_key, unsigned char *mac_key)
+{
+	uint64		now = (uint64) time(NULL) / pool_config->ssl_session_ticket_lifetime;
+	uint64		period;
+	unsigned char name[16];
+
+	if (enc)
+	{
+		if (!ticket_derive_keys(now, key_name, aes_key, mac_key))
+			return -1;
+		return 1;
+	}
+
+	memcpy(&period, key_name, sizeof(uint64));
+	if (period != now && period + 1 != now)
+		return 0;
+
+	if (!ticket_derive_keys(period, name, aes_key, mac_key))
+		return -1;
+	if (CRYPTO_memcmp(name, key_name, sizeof(name)) != 0)
+		return 0;
+
+	return period == now ? 1 : 2;
+}
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined (LIBRESSL_VERSION_NUMBER))
+static int
+ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+			  EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+#else
+static int
+ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+			  EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+	unsigned char aes_key[EVP_MAX_MD_SIZE];
+	unsigned char mac_key[EVP_MAX_MD_SIZE];
+	int			rc;
+
+	rc = ticket_lookup_keys(key_name, enc, aes_key, mac_key);
+	if (rc <= 0)
+		return rc;
+
+	if (enc && RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+		return -1;
+
+	if (enc)
+	{
+		if (!EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, aes_key, iv))
+			return -1;
+	}
+	else
+	{
+		if (!EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, aes_key, iv))
+			return -1;
+	}
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined (LIBRESSL_VERSION_NUMBER))
+	{
+		OSSL_PARAM	params[3];
+
+		params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, mac_key, 32);
+		params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+		params[2] = OSSL_PARAM_construct_end();
+		if (!EVP_MAC_CTX_set_params(hctx, params))
+			return -1;
+	}
+#else
+	if (!HMAC_Init_ex(hctx, mac_key, 32, EVP_sha256(), NULL))
+		return -1;
+#endif
+
+	return rc;
+}
+
+/*
+ * Create the SSL context for the given connection type.  Returns NULL on
+ * error.
+ */
+static SSL_CTX *
+create_ssl_ctx(enum ssl_conn_type conntype)
 {
 	int			error = 0;
 	char	   *cacert = NULL,
 			   *cacert_dir = NULL;
+	SSL_CTX    *context;
 
 	char ssl_cert_path[POOLMAXPATHLEN + 1] = "";
 	char ssl_key_path[POOLMAXPATHLEN + 1] = "";
@@ -363,34 +601,61 @@ init_ssl_ctx(POOL_CONNECTION * cp, enum ssl_conn_type conntype)
 
 	/* initialize SSL members */
 #if (OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined (LIBRESSL_VERSION_NUMBER))
-	cp->ssl_ctx = SSL_CTX_new(TLS_method());
+	context = SSL_CTX_new(TLS_method());
 #else
-	cp->ssl_ctx = SSL_CTX_new(SSLv23_method());
+	context = SSL_CTX_new(SSLv23_method());
 #endif
 
-	SSL_RETURN_ERROR_IF((!cp->ssl_ctx), "SSL_CTX_new");
+	if (!context)
+	{
+		perror_ssl("SSL_CTX_new");
+		return NULL;
+	}
 
 	/*
 	 * Disable OpenSSL's moving-write-buffer sanity check, because it causes
 	 * unnecessary failures in nonblocking send cases.
 	 */
-	SSL_CTX_set_mode(cp->ssl_ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	SSL_CTX_set_mode(context, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if (pool_config->ssl_ktls)
+		SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#endif
 
 	if (conntype == ssl_conn_serverclient)
 	{
 		/* between frontend and pgpool */
-		error = SSL_CTX_use_certificate_chain_file(cp->ssl_ctx,
+		error = SSL_CTX_use_certificate_chain_file(context,
 												   ssl_cert_path);
-		SSL_RETURN_ERROR_IF((error != 1), "Loading SSL certificate");
+		if (error != 1)
+		{
+			perror_ssl("Loading SSL certificate");
+			goto error;
+		}
 
-		error = SSL_CTX_use_PrivateKey_file(cp->ssl_ctx,
+		error = SSL_CTX_use_PrivateKey_file(context,
 											ssl_key_path,
 											SSL_FILETYPE_PEM);
-		SSL_RETURN_ERROR_IF((error != 1), "Loading SSL private key");
+		if (error != 1)
+		{
+			perror_ssl("Loading SSL private key");
+			goto error;
+		}
 	}
 	else
 	{
 		/* between pgpool and backend */
+
+		/*
+		 * Remember the sessions the backends give us, so that the next
+		 * connection to the same backend can resume them.
+		 */
+		SSL_CTX_set_session_cache_mode(context,
+									   SSL_SESS_CACHE_CLIENT |
+									   SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(context, backend_session_new_cb);
+
 		/* set extra verification if ssl_ca_cert or ssl_ca_cert_dir are set */
 		if (strlen(ssl_ca_cert_path))
 			cacert = ssl_ca_cert_path;
@@ -399,18 +664,23 @@ init_ssl_ctx(POOL_CONNECTION * cp, enum ssl_conn_type conntype)
 
 		if (cacert || cacert_dir)
 		{
-			error = SSL_CTX_load_verify_locations(cp->ssl_ctx,
+			error = SSL_CTX_load_verify_locations(context,
 												  cacert,
 												  cacert_dir);
-			SSL_RETURN_ERROR_IF((error != 1), "SSL verification setup");
-			SSL_CTX_set_verify(cp->ssl_ctx, SSL_VERIFY_PEER, NULL);
+			if (error != 1)
+			{
+				perror_ssl("SSL verification setup");
+				goto error;
+			}
+			SSL_CTX_set_verify(context, SSL_VERIFY_PEER, NULL);
 		}
 	}
 
-	cp->ssl = SSL_new(cp->ssl_ctx);
-	SSL_RETURN_ERROR_IF((!cp->ssl), "SSL_new");
+	return context;
 
-	return 0;
+error:
+	SSL_CTX_free(context);
+	return NULL;
 }
 
 static void
@@ -720,14 +990,51 @@ SSL_ServerSide_init(void)
 	/* disallow SSL v2/v3 */
 	SSL_CTX_set_options(context, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
 
-	/* disallow SSL session tickets */
+	if (pool_config->ssl_session_tickets)
+	{
+		/*
+		 * Allow session tickets.  The secret is created here, i.e. in the main
+		 * process, so that the children inherit it.
+		 */
+		if (!ticket_secret_set)
+		{
+			if (RAND_bytes(ticket_secret, TICKET_SECRET_LEN) != 1)
+			{
+				ereport(WARNING,
+						(errmsg("could not generate SSL session ticket secret: %s",
+								SSLerrmessage(ERR_get_error()))));
+				goto error;
+			}
+			ticket_secret_set = true;
+		}
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined (LIBRESSL_VERSION_NUMBER))
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(context, ticket_key_cb);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(context, ticket_key_cb);
+#endif
+		SSL_CTX_set_session_id_context(context, (unsigned char *) "pgpool", strlen("pgpool"));
+	}
+	else
+	{
+		/* disallow SSL session tickets */
 #ifdef SSL_OP_NO_TICKET			/* added in openssl 0.9.8f */
-	SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+		SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
 #endif
+	}
 
-	/* disallow SSL session caching, too */
+	/* disallow server side SSL session caching */
 	SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
 
+	if (pool_config->ssl_ktls)
+	{
+#ifdef SSL_OP_ENABLE_KTLS
+		SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#else
+		ereport(LOG,
+				(errmsg("kernel TLS is not supported by this OpenSSL version, ignoring \"ssl_ktls\"")));
+#endif
+	}
+
 	/* set up ephemeral DH and ECDH keys */
 	/* only isServerStart = true */
 	if (!initialize_dh(context))
@@ -0,0 +1,147 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_stage.c: what a child process is doing and the time spent on it.
+ *
+ * Like wait events of PostgreSQL, a child publishes the stage it is in,
+ * waiting for the client, parsing, waiting for a backend and so on, in its
+ * ProcessInfo, together with the time it has spent in each stage since it
+ * was started.  They are shown by SHOW POOL_PROCESSES and pcp_proc_info.
+ *
+ * A stage is entered with pool_stage_enter(), which returns the stage the
+ * process was in, and left by passing that to pool_stage_leave().  Stages
+ * nest, and the time is counted for the innermost one only, except that
+ * waiting for the backend on behalf of a relcache query is counted as
+ * relcache time.  The clock is read only when the stage changes, so
+ * processing outside of any stage costs nothing.
+ *
+ * Processes other than children do not publish their stage.
+ */
+#include <string.h>
+#include <time.h>
+
+#include "pool.h"
+#include "context/pool_process_context.h"
+#include "utils/pool_stage.h"
+
+static ProcessInfo *my_process_info;	/* NULL if not a child process */
+static PoolStage current_stage = POOL_STAGE_NONE;
+static uint64 stage_start;		/* when current_stage was entered, in
+								 * microseconds */
+
+static void stage_switch(PoolStage stage);
+
+/*
+ * Start publishing the stage of this child process.  Should be called
+ * once the process context is initialized.
+ */
+void
+pool_stage_init(void)
+{
+	my_process_info = pool_get_my_process_info();
+	memset(my_process_info->stage_time, 0, sizeof(my_process_info->stage_time));
+	my_process_info->stage = POOL_STAGE_NONE;
+	current_stage = POOL_STAGE_NONE;
+}
+
+/*
+ * Enter a stage and return the stage the process was in.
+ */
+PoolStage
+pool_stage_enter(PoolStage stage)
+{
+	PoolStage	prev = current_stage;
+
+	if (my_process_info == NULL || stage == current_stage)
+		return prev;
+
+	/* relcache queries wait for the backend on behalf of relcache */
+	if (current_stage == POOL_STAGE_RELCACHE && stage == POOL_STAGE_BACKEND_WAIT)
+		return prev;
+
+	stage_switch(stage);
+	return prev;
+}
+
+/*
+ * Leave the current stage and return to prev, as returned by
+ * pool_stage_enter().
+ */
+void
+pool_stage_leave(PoolStage prev)
+{
+	if (my_process_info == NULL || prev == current_stage)
+		return;
+
+	stage_switch(prev);
+}
+
+/*
+ * Leave all stages.  Called on error recovery, since stages entered before
+ * the error are never left otherwise.
+ */
+void
+pool_stage_reset(void)
+{
+	pool_stage_leave(POOL_STAGE_NONE);
+}
+
+/*
+ * Name of a stage shown by SHOW POOL_PROCESSES.
+ */
+const char *
+pool_stage_name(PoolStage stage)
+{
+	switch (stage)
+	{
+		case POOL_STAGE_CLIENT_READ:
+			return "client_read";
+		case POOL_STAGE_PARSE:
+			return "parse";
+		case POOL_STAGE_ROUTE:
+			return "route";
+		case POOL_STAGE_RELCACHE:
+			return "relcache";
+		case POOL_STAGE_CACHE_LOCK:
+			return "cache_lock";
+		case POOL_STAGE_BACKEND_WAIT:
+			return "backend_wait";
+		case POOL_STAGE_CLIENT_WRITE:
+			return "client_write";
+		default:
+			return "";
+	}
+}
+
+static void
+stage_switch(PoolStage stage)
+{
+	struct timespec ts;
+	uint64		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	if (current_stage != POOL_STAGE_NONE)
+		my_process_info->stage_time[current_stage] += now - stage_start;
+
+	stage_start = now;
+	current_stage = stage;
+	my_process_info->stage = stage;
+}
@@ -0,0 +1,400 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_statement_stats.c: per statement statistics.
+ *
+ * Statistics of the queries sent by clients are accumulated per normalized
+ * statement in shared memory, and shown by SHOW pool_statements.  A
+ * statement is identified by the hash of the query text normalized by
+ * raw_normalize_query(), so that queries which differ only in their
+ * constants share an entry.
+ *
+ * The entries form an open addressing hash table with twice as many slots
+ * as statement_stats_max, rounded up to a power of 2.  Entries are never
+ * removed one by one, only all at once by pool_statement_stats_reset(), so
+ * a lookup stops at the first unused slot.  Lookups and counter updates are
+ * lock free.  Only adding an entry and resetting the table take
+ * STATEMENT_STATS_SEM.  Once statement_stats_max statements are tracked,
+ * new statements are not counted until the table is reset.
+ */
+#include <string.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "utils/palloc.h"
+#include "utils/elog.h"
+#include "utils/pool_signal.h"
+#include "utils/pool_atomic.h"
+#include "utils/xxhash.h"
+#include "utils/pool_ipc.h"
+#include "utils/pool_statement_stats.h"
+#include "parser/parser.h"
+
+#define STATEMENT_STATS_NODE_WORDS	((MAX_NUM_BACKENDS + 63) / 64)
+
+typedef struct
+{
+	pool_atomic_uint64 queryid;	/* hash of normalized query, 0 if unused */
+	pool_atomic_uint64 calls;	/* number of executions on backend nodes */
+	pool_atomic_uint64 total_time;	/* total execution time in microseconds */
+	pool_atomic_uint64 max_time;	/* maximum execution time in
+									 * microseconds */
+	pool_atomic_uint64 rows;	/* rows returned or affected */
+	pool_atomic_uint64 cache_hits;	/* answered from the query cache */
+	pool_atomic_uint64 cache_misses;	/* looked up in the query cache but
+										 * not found */
+	pool_atomic_uint64 nodes[STATEMENT_STATS_NODE_WORDS];	/* bitmap of nodes
+															 * the statement
+															 * was sent to */
+	char		query[POOLCONFIG_MAXSTATEMENTLEN];	/* normalized query */
+}			StatementStatsEntry;
+
+typedef struct
+{
+	int			num_slots;		/* power of 2 */
+	int			num_entries;	/* number of used slots. Protected by
+								 * STATEMENT_STATS_SEM */
+	bool		full_logged;	/* true if we have told the table is full */
+	StatementStatsEntry *entries;
+}			StatementStats;
+
+static StatementStats *statement_stats = NULL;
+
+static int	statement_stats_num_slots(void);
+static int	statement_stats_lookup(uint64 queryid);
+static void statement_stats_clear(StatementStatsEntry * entry);
+static void append_nodes(char *buf, int buflen, StatementStatsEntry * entry);
+
+/*
+ * Size of shared memory needed by the statement statistics.
+ */
+size_t
+pool_statement_stats_shmem_size(void)
+{
+	size_t		size;
+
+	size = MAXALIGN(sizeof(StatementStats));
+	size += MAXALIGN(sizeof(StatementStatsEntry) * statement_stats_num_slots());
+
+	elog(DEBUG1, "pool_statement_stats_shmem_size: %zu", size);
+	return size;
+}
+
+/*
+ * Allocate and initialize the statement statistics.  This should be called
+ * only once from pgpool main process at the process starting up time.
+ */
+void
+pool_init_statement_stats(void)
+{
+	char	   *p;
+	int			i;
+
+	p = pool_shared_memory_segment_get_chunk(pool_statement_stats_shmem_size());
+
+	statement_stats = (StatementStats *) p;
+	p += MAXALIGN(sizeof(StatementStats));
+	statement_stats->num_slots = statement_stats_num_slots();
+	statement_stats->num_entries = 0;
+	statement_stats->full_logged = false;
+	statement_stats->entries = (StatementStatsEntry *) p;
+
+	for (i = 0; i < statement_stats->num_slots; i++)
+		statement_stats_clear(&statement_stats->entries[i]);
+}
+
+static int
+statement_stats_num_slots(void)
+{
+	int			n = 1;
+
+	while (n < pool_config->statement_stats_max * 2)
+		n <<= 1;
+	return n;
+}
+
+/*
+ * Returns the slot of the statement, adding an entry for it if this is the
+ * first time it is seen.  Returns -1 if statement statistics are disabled,
+ * the table is full or the query cannot be scanned.
+ */
+int
+pool_statement_stats_slot(const char *query)
+{
+	char	   *normalized;
+	uint64		queryid;
+	int			slot;
+	pool_sigset_t oldmask;
+
+	if (statement_stats == NULL || query == NULL)
+		return -1;
+
+	normalized = raw_normalize_query(query, strlen(query));
+	if (normalized == NULL)
+		return -1;
+
+	queryid = pool_xxh64(normalized, strlen(normalized), 0);
+	if (queryid == 0)
+		queryid = 1;
+
+	slot = statement_stats_lookup(queryid);
+	if (slot >= 0 && pool_atomic_read_u64(&statement_stats->entries[slot].queryid) == queryid)
+	{
+		pfree(normalized);
+		return slot;
+	}
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(STATEMENT_STATS_SEM);
+
+	/* somebody may have added it meanwhile */
+	slot = statement_stats_lookup(queryid);
+	if (slot >= 0 && pool_atomic_read_u64(&statement_stats->entries[slot].queryid) != queryid)
+	{
+		if (statement_stats->num_entries >= pool_config->statement_stats_max)
+		{
+			if (!statement_stats->full_logged)
+			{
+				statement_stats->full_logged = true;
+				ereport(LOG,
+						(errmsg("statement statistics table is full"),
+						 errdetail("new statements are not counted until the statistics are reset"),
+						 errhint("consider increasing statement_stats_max")));
+			}
+			slot = -1;
+		}
+		else
+		{
+			StatementStatsEntry *entry = &statement_stats->entries[slot];
+
+			statement_stats_clear(entry);
+			strlcpy(entry->query, normalized, sizeof(entry->query));
+			/* publish the entry after its contents are in place */
+			pool_atomic_write_u64(&entry->queryid, queryid);
+			statement_stats->num_entries++;
+		}
+	}
+
+	pool_semaphore_unlock(STATEMENT_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+
+	pfree(normalized);
+	return slot;
+}
+
+/*
+ * Returns the slot holding queryid, or the unused slot where it would be
+ * added.  Returns -1 if neither is found.
+ */
+static int
+statement_stats_lookup(uint64 queryid)
+{
+	int			mask = statement_stats->num_slots - 1;
+	int			slot = queryid & mask;
+	int			i;
+
+	for (i = 0; i < statement_stats->num_slots; i++)
+	{
+		uint64		id = pool_atomic_read_u64(&statement_stats->entries[slot].queryid);
+
+		if (id == queryid || id == 0)
+			return slot;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+static void
+statement_stats_clear(StatementStatsEntry * entry)
+{
+	int			i;
+
+	pool_atomic_write_u64(&entry->queryid, 0);
+	pool_atomic_write_u64(&entry->calls, 0);
+	pool_atomic_write_u64(&entry->total_time, 0);
+	pool_atomic_write_u64(&entry->max_time, 0);
+	pool_atomic_write_u64(&entry->rows, 0);
+	pool_atomic_write_u64(&entry->cache_hits, 0);
+	pool_atomic_write_u64(&entry->cache_misses, 0);
+	for (i = 0; i < STATEMENT_STATS_NODE_WORDS; i++)
+		pool_atomic_write_u64(&entry->nodes[i], 0);
+	entry->query[0] = '\0';
+}
+
+/*
+ * Record an execution of the statement on a backend node, which took
+ * elapsed microseconds.
+ */
+void
+pool_statement_stats_record(int slot, int backend_node_id, uint64 elapsed)
+{
+	StatementStatsEntry *entry;
+	volatile pool_atomic_uint64 *word;
+	uint64		bit;
+	uint64		old;
+
+	if (statement_stats == NULL || slot < 0)
+		return;
+
+	entry = &statement_stats->entries[slot];
+	pool_atomic_fetch_add_u64(&entry->calls, 1);
+	pool_atomic_fetch_add_u64(&entry->total_time, elapsed);
+
+	old = pool_atomic_read_u64(&entry->max_time);
+	while (elapsed > old)
+	{
+		if (pool_atomic_compare_exchange_u64(&entry->max_time, &old, elapsed))
+			break;
+	}
+
+	word = &entry->nodes[backend_node_id / 64];
+	bit = (uint64) 1 << (backend_node_id % 64);
+	old = pool_atomic_read_u64(word);
+	while ((old & bit) == 0)
+	{
+		if (pool_atomic_compare_exchange_u64(word, &old, old | bit))
+			break;
+	}
+}
+
+/*
+ * Add the number of rows returned or affected by the statement.
+ */
+void
+pool_statement_stats_add_rows(int slot, uint64 rows)
+{
+	if (statement_stats == NULL || slot < 0 || rows == 0)
+		return;
+
+	pool_atomic_fetch_add_u64(&statement_stats->entries[slot].rows, rows);
+}
+
+/*
+ * Count a query cache lookup of the statement.
+ */
+void
+pool_statement_stats_count_cache(int slot, bool hit)
+{
+	if (statement_stats == NULL || slot < 0)
+		return;
+
+	if (hit)
+		pool_atomic_fetch_add_u64(&statement_stats->entries[slot].cache_hits, 1);
+	else
+		pool_atomic_fetch_add_u64(&statement_stats->entries[slot].cache_misses, 1);
+}
+
+/*
+ * Throw away all statement statistics.  Counters of statements being
+ * executed while resetting may be partially lost.
+ */
+void
+pool_statement_stats_reset(void)
+{
+	pool_sigset_t oldmask;
+	int			i;
+
+	if (statement_stats == NULL)
+		ereport(ERROR,
+				(errmsg("statement statistics are not enabled"),
+				 errhint("set statement_stats_max to a value greater than 0")));
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(STATEMENT_STATS_SEM);
+
+	for (i = 0; i < statement_stats->num_slots; i++)
+		statement_stats_clear(&statement_stats->entries[i]);
+	statement_stats->num_entries = 0;
+	statement_stats->full_logged = false;
+
+	pool_semaphore_unlock(STATEMENT_STATS_SEM);
+	POOL_SETMASK(&oldmask);
+
+	ereport(LOG,
+			(errmsg("statement statistics have been reset")));
+}
+
+/*
+ * Returns the statement statistics for SHOW pool_statements.  Times are in
+ * milliseconds.
+ */
+POOL_STATEMENT_STATS *
+pool_get_statement_stats(int *nrows)
+{
+	POOL_STATEMENT_STATS *stats;
+	int			i;
+	int			n = 0;
+
+	*nrows = 0;
+	if (statement_stats == NULL)
+		return palloc0(sizeof(POOL_STATEMENT_STATS));
+
+	stats = palloc0(sizeof(POOL_STATEMENT_STATS) * (pool_config->statement_stats_max + 1));
+
+	for (i = 0; i < statement_stats->num_slots && n < pool_config->statement_stats_max; i++)
+	{
+		StatementStatsEntry *entry = &statement_stats->entries[i];
+		uint64		queryid = pool_atomic_read_u64(&entry->queryid);
+		uint64		calls;
+		uint64		total_time;
+
+		if (queryid == 0)
+			continue;
+
+		calls = pool_atomic_read_u64(&entry->calls);
+		total_time = pool_atomic_read_u64(&entry->total_time);
+
+		snprintf(stats[n].queryid, sizeof(stats[n].queryid), INT64_FORMAT, (int64) queryid);
+		strlcpy(stats[n].query, entry->query, sizeof(stats[n].query));
+		snprintf(stats[n].calls, sizeof(stats[n].calls), UINT64_FORMAT, calls);
+		snprintf(stats[n].total_time, sizeof(stats[n].total_time), "%.3f", total_time / 1000.0);
+		snprintf(stats[n].mean_time, sizeof(stats[n].mean_time), "%.3f",
+				 calls > 0 ? total_time / 1000.0 / calls : 0.0);
+		snprintf(stats[n].max_time, sizeof(stats[n].max_time), "%.3f",
+				 pool_atomic_read_u64(&entry->max_time) / 1000.0);
+		snprintf(stats[n].rows, sizeof(stats[n].rows), UINT64_FORMAT,
+				 pool_atomic_read_u64(&entry->rows));
+		snprintf(stats[n].cache_hits, sizeof(stats[n].cache_hits), UINT64_FORMAT,
+				 pool_atomic_read_u64(&entry->cache_hits));
+		snprintf(stats[n].cache_misses, sizeof(stats[n].cache_misses), UINT64_FORMAT,
+				 pool_atomic_read_u64(&entry->cache_misses));
+		append_nodes(stats[n].nodes, sizeof(stats[n].nodes), entry);
+		n++;
+	}
+
+	*nrows = n;
+	return stats;
+}
+
+/*
+ * Format the node bitmap of the entry as a comma separated list of node ids.
+ */
+static void
+append_nodes(char *buf, int buflen, StatementStatsEntry * entry)
+{
+	int			len = 0;
+	int			i;
+
+	buf[0] = '\0';
+	for (i = 0; i < MAX_NUM_BACKENDS && len < buflen; i++)
+	{
+		if (pool_atomic_read_u64(&entry->nodes[i / 64]) & ((uint64) 1 << (i % 64)))
+			len += snprintf(buf + len, buflen - len, len > 0 ? ",%d" : "%d", i);
+	}
+}
@@ -31,6 +31,9 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 
 
 #include "pool.h"
@@ -41,7 +44,9 @@
 #include "utils/socket_stream.h"
 #include "utils/pool_stream.h"
 #include "utils/pool_ssl.h"
+#include "utils/pool_stage.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
 
 static int	mystrlen(char *str, int upper, int *flag);
 static int	mystrlinelen(char *str, int upper, int *flag);
@@ -52,6 +57,10 @@ static MemoryContext SwitchToConnectionContext(bool backend_connection);
 static void dump_buffer(char *buf, int len);
 #endif
 static int	pool_write_flush(POOL_CONNECTION * cp, void *buf, int len);
+static int	pool_writev_flush(POOL_CONNECTION * cp, void *buf, int len);
+static bool spool_write_buffer(POOL_CONNECTION * cp, int len);
+static int	prepare_read_ahead(POOL_CONNECTION * cp);
+static void flush_before_read(POOL_CONNECTION * cp);
 
 /* timeout sec for pool_check_fd */
 static int	timeoutsec = -1;
@@ -84,8 +93,8 @@ pool_open(int fd, bool backend_connection)
 	cp = (POOL_CONNECTION *) palloc0(sizeof(POOL_CONNECTION));
 
 	/* initialize write buffer */
-	cp->wbuf = palloc(WRITEBUFSZ);
-	cp->wbufsz = WRITEBUFSZ;
+	cp->wbufsz = Max(pool_config->write_buffer_size, WRITEBUFSZ);
+	cp->wbuf = palloc(cp->wbufsz);
 	cp->wbufpo = 0;
 
 	/* initialize pending data buffer */
@@ -129,6 +138,8 @@ pool_close(POOL_CONNECTION * cp)
 		pfree(cp->buf2);
 	if (cp->buf3)
 		pfree(cp->buf3);
+	if (cp->ps_registry)
+		pfree(cp->ps_registry);
 	pool_discard_params(&cp->params);
 
 	pool_ssl_close(cp);
@@ -155,10 +166,10 @@ pool_read_with_error(POOL_CONNECTION * cp, void *buf, int len,
 int
 pool_read(POOL_CONNECTION * cp, void *buf, int len)
 {
-	static char readbuf[READBUFSZ];
-
 	int			consume_size;
 	int			readlen;
+	int			readsize;
+	PoolStage	stage;
 
 	consume_size = consume_pending_data(cp, buf, len);
 	len -= consume_size;
@@ -166,6 +177,8 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 
 	while (len > 0)
 	{
+		flush_before_read(cp);
+
 		/*
 		 * If select(2) timeout is disabled, there's no need to call
 		 * pool_check_fd().
@@ -187,23 +200,32 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 			}
 		}
 
+		/*
+		 * Read as much as is available, up to read_buffer_size, directly into
+		 * the pending buffer.  Whatever the caller does not consume now is
+		 * served from memory by the following calls.
+		 */
+		readsize = prepare_read_ahead(cp);
+
+		stage = pool_stage_enter(POOL_STAGE_READ(cp));
 		if (cp->ssl_active > 0)
 		{
-			readlen = pool_ssl_read(cp, readbuf, READBUFSZ);
+			readlen = pool_ssl_read(cp, cp->hp, readsize);
 		}
 		else
 		{
-			readlen = read(cp->fd, readbuf, READBUFSZ);
+			readlen = read(cp->fd, cp->hp, readsize);
 			if (cp->isbackend)
 			{
 				ereport(DEBUG5,
 						(errmsg("pool_read: read %d bytes from backend %d",
 								readlen, cp->db_node_id)));
 #ifdef DEBUG
-				dump_buffer(readbuf, readlen);
+				dump_buffer(cp->hp, readlen);
 #endif
 			}
 		}
+		pool_stage_leave(stage);
 
 		if (readlen == -1)
 		{
@@ -225,6 +247,9 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 			cp->socket_state = POOL_SOCKET_ERROR;
 			if (cp->isbackend)
 			{
+				if (processType == PT_CHILD)
+					health_check_count_backend_error(cp->db_node_id, false);
+
 				if (cp->con_info && cp->con_info->swallow_termination == 1)
 				{
 					cp->con_info->swallow_termination = 0;
@@ -266,6 +291,9 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 			cp->socket_state = POOL_SOCKET_EOF;
 			if (cp->isbackend)
 			{
+				if (processType == PT_CHILD)
+					health_check_count_backend_error(cp->db_node_id, false);
+
 				if (processType == PT_MAIN || processType == PT_HEALTH_CHECK)
 					ereport(ERROR,
 							(errmsg("unable to read data from DB node %d", cp->db_node_id),
@@ -287,22 +315,55 @@ pool_read(POOL_CONNECTION * cp, void *buf, int len)
 			}
 		}
 
-		if (len < readlen)
-		{
-			/* overrun. we need to save remaining data to pending buffer */
-			save_pending_data(cp, readbuf + len, readlen - len);
-			memmove(buf, readbuf, len);
-			break;
-		}
-
-		memmove(buf, readbuf, readlen);
-		buf += readlen;
-		len -= readlen;
+		/* the data is in the pending buffer now. take what we need */
+		cp->len = readlen;
+		consume_size = consume_pending_data(cp, buf, len);
+		buf += consume_size;
+		len -= consume_size;
 	}
 
 	return 0;
 }
 
+/*
+ * Read the data available on the connection into the read buffer, without
+ * throwing an error if the connection has failed.  To be called once
+ * poll(2) has reported the connection as readable.  Returns the number of
+ * bytes in the read buffer, or 0 on EOF or error.
+ */
+int
+pool_read_ahead_noerror(POOL_CONNECTION * cp)
+{
+	int			readsize;
+	int			readlen;
+
+	if (!pool_read_buffer_is_empty(cp))
+		return cp->len;
+
+	readsize = prepare_read_ahead(cp);
+
+	for (;;)
+	{
+		if (cp->ssl_active > 0)
+			readlen = pool_ssl_read(cp, cp->hp, readsize);
+		else
+			readlen = read(cp->fd, cp->hp, readsize);
+
+		if (readlen == -1 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		break;
+	}
+
+	if (readlen <= 0)
+	{
+		cp->socket_state = readlen == 0 ? POOL_SOCKET_EOF : POOL_SOCKET_ERROR;
+		return 0;
+	}
+
+	cp->len = readlen;
+	return readlen;
+}
+
 /*
 * read exactly len bytes from cp
 * returns buffer address on success otherwise NULL.
@@ -311,10 +372,13 @@ char *
 pool_read2(POOL_CONNECTION * cp, int len)
 {
 	char	   *buf;
+	char	   *readbuf;
 	int			req_size;
 	int			alloc_size;
 	int			consume_size;
 	int			readlen;
+	int			readsize;
+	PoolStage	stage;
 	MemoryContext oldContext = SwitchToConnectionContext(cp->isbackend);
 
 	req_size = cp->len + len;
@@ -334,6 +398,8 @@ pool_read2(POOL_CONNECTION * cp, int len)
 
 	while (len > 0)
 	{
+		flush_before_read(cp);
+
 		/*
 		 * If select(2) timeout is disabled, there's no need to call
 		 * pool_check_fd().
@@ -355,18 +421,36 @@ pool_read2(POOL_CONNECTION * cp, int len)
 			}
 		}
 
+		/*
+		 * Large requests are read directly into the result buffer.  Small
+		 * ones go through the pending buffer like pool_read() so that the
+		 * following messages can be served without a system call.
+		 */
+		if (len < pool_config->read_buffer_size)
+		{
+			readsize = prepare_read_ahead(cp);
+			readbuf = cp->hp;
+		}
+		else
+		{
+			readsize = len;
+			readbuf = buf;
+		}
+
+		stage = pool_stage_enter(POOL_STAGE_READ(cp));
 		if (cp->ssl_active > 0)
 		{
-			readlen = pool_ssl_read(cp, buf, len);
+			readlen = pool_ssl_read(cp, readbuf, readsize);
 		}
 		else
 		{
-			readlen = read(cp->fd, buf, len);
+			readlen = read(cp->fd, readbuf, readsize);
 			if (cp->isbackend)
 				ereport(DEBUG5,
 						(errmsg("pool_read2: read %d bytes from backend %d",
 								readlen, cp->db_node_id)));
 		}
+		pool_stage_leave(stage);
 
 		if (readlen == -1)
 		{
@@ -381,6 +465,9 @@ pool_read2(POOL_CONNECTION * cp, int len)
 			cp->socket_state = POOL_SOCKET_ERROR;
 			if (cp->isbackend)
 			{
+				if (processType == PT_CHILD)
+					health_check_count_backend_error(cp->db_node_id, false);
+
 				if (cp->con_info && cp->con_info->swallow_termination == 1)
 				{
 					cp->con_info->swallow_termination = 0;
@@ -421,6 +508,9 @@ pool_read2(POOL_CONNECTION * cp, int len)
 			cp->socket_state = POOL_SOCKET_EOF;
 			if (cp->isbackend)
 			{
+				if (processType == PT_CHILD)
+					health_check_count_backend_error(cp->db_node_id, false);
+
 				ereport(ERROR,
 						(errmsg("unable to read data from backend"),
 						 errdetail("EOF read on socket")));
@@ -438,6 +528,11 @@ pool_read2(POOL_CONNECTION * cp, int len)
 			}
 		}
 
+		if (readbuf == cp->hp)
+		{
+			cp->len = readlen;
+			readlen = consume_pending_data(cp, buf, len);
+		}
 		buf += readlen;
 		len -= readlen;
 	}
@@ -445,6 +540,116 @@ pool_read2(POOL_CONNECTION * cp, int len)
 	return cp->buf2;
 }
 
+/*
+ * Count the whole protocol V3 messages of the given kind at the head of the
+ * read buffer of cp, up to maxcount of them if maxcount >= 0, and set *len
+ * to their total length.  Only the length words are looked at, so a run of
+ * messages is delimited without touching their contents.
+ */
+static int
+walk_buffered_messages(POOL_CONNECTION * cp, char kind, int maxcount, int *len)
+{
+	char	   *p = cp->hp + cp->po;
+	int			remaining = cp->len;
+	int			count = 0;
+	int32		msglen;
+
+	*len = 0;
+	while (count != maxcount && remaining >= 1 + (int) sizeof(msglen) && *p == kind)
+	{
+		memcpy(&msglen, p + 1, sizeof(msglen));
+		msglen = ntohl(msglen);
+		if (msglen < (int) sizeof(msglen) || remaining < 1 + msglen)
+			break;
+
+		p += 1 + msglen;
+		remaining -= 1 + msglen;
+		*len += 1 + msglen;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Returns the number of whole protocol V3 messages of the given kind the
+ * read buffer of cp holds in a row, counting up to maxcount of them if
+ * maxcount >= 0.  Nothing is consumed and no system call is made.
+ */
+int
+pool_count_buffered_messages(POOL_CONNECTION * cp, char kind, int maxcount)
+{
+	int			len;
+
+	return walk_buffered_messages(cp, kind, maxcount, &len);
+}
+
+/*
+ * If the read buffer of cp already holds whole protocol V3 messages of the
+ * given kind, consume as many of them in a row as there are, up to maxcount
+ * if maxcount >= 0, and return a pointer to the first one, starting at its
+ * kind byte.  *count is set to the number of messages and *len to their
+ * total length; they are contiguous in the buffer, exactly as received.
+ * Otherwise return NULL without consuming anything.  No system call is
+ * made.  The result is only valid until the next read from cp.
+ */
+char *
+pool_read_buffered_messages(POOL_CONNECTION * cp, char kind, int maxcount,
+							int *count, int *len)
+{
+	char	   *p = cp->hp + cp->po;
+
+	*count = walk_buffered_messages(cp, kind, maxcount, len);
+	if (*count == 0)
+		return NULL;
+
+	cp->len -= *len;
+	if (cp->len <= 0)
+		cp->po = 0;
+	else
+		cp->po += *len;
+
+	return p;
+}
+
+/*
+ * Returns the kind byte of the next message in the read buffer of cp, or
+ * '\0' if the buffer is empty.  The message itself may not have been
+ * received completely yet.  No system call is made.
+ */
+char
+pool_next_buffered_kind(POOL_CONNECTION * cp)
+{
+	if (pool_read_buffer_is_empty(cp))
+		return '\0';
+	return cp->hp[cp->po];
+}
+
+/*
+ * Make the pending buffer, which must be empty, at least read_buffer_size
+ * bytes long so that it can be filled by one read.  Returns the number of
+ * bytes to read.
+ */
+static int
+prepare_read_ahead(POOL_CONNECTION * cp)
+{
+	int			size = Max(pool_config->read_buffer_size, READBUFSZ);
+
+	Assert(cp->len == 0);
+	cp->po = 0;
+
+	if (cp->bufsz < size)
+	{
+		MemoryContext oldContext = SwitchToConnectionContext(cp->isbackend);
+
+		pfree(cp->hp);
+		cp->hp = palloc(size);
+		cp->bufsz = size;
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return cp->bufsz;
+}
+
 /*
  * write len bytes to cp the write buffer.
  * returns 0 on success otherwise -1.
@@ -484,15 +689,23 @@ pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len)
 
 	while (len > 0)
 	{
-		int			remainder = WRITEBUFSZ - cp->wbufpo;
+		int			remainder = cp->wbufsz - cp->wbufpo;
 
 		/*
 		 * If requested data cannot be added to the write buffer, flush the
 		 * buffer and directly write the requested data.  This could avoid
-		 * unwanted write in the middle of message boundary.
+		 * unwanted write in the middle of message boundary.  Without SSL both
+		 * go out in one writev() call, so the requested data is neither
+		 * copied nor written by a separate system call.
 		 */
 		if (remainder < len)
 		{
+			if (spool_write_buffer(cp, len))
+				continue;
+
+			if (cp->ssl_active <= 0)
+				return pool_writev_flush(cp, buf, len);
+
 			if (pool_flush_it(cp) == -1)
 				return -1;
 
@@ -501,7 +714,7 @@ pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len)
 			return 0;
 		}
 
-		if (cp->wbufpo >= WRITEBUFSZ)
+		if (cp->wbufpo >= cp->wbufsz)
 		{
 			/*
 			 * Write buffer is full. so flush buffer. wbufpo is reset in
@@ -509,7 +722,7 @@ pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len)
 			 */
 			if (pool_flush_it(cp) == -1)
 				return -1;
-			remainder = WRITEBUFSZ;
+			remainder = cp->wbufsz;
 		}
 
 		/* check buffer size */
@@ -523,6 +736,63 @@ pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len)
 	return 0;
 }
 
+/*
+ * The write buffer of a frontend connection has no room for len more bytes.
+ * If the client cannot take the buffer right now and result_spool_size
+ * allows, enlarge the buffer instead of waiting for the client, so that the
+ * rest of the result is read from the backend at the backend's speed and
+ * the backend is done with the query early.  The enlarged buffer is written
+ * out by the next flush and shrunk by pool_shrink_buffers().  Returns true
+ * if there is room for len bytes now, false if the caller has to write as
+ * usual.
+ */
+static bool
+spool_write_buffer(POOL_CONNECTION * cp, int len)
+{
+	ssize_t		sts;
+	int			size;
+
+	if (cp->isbackend || cp->ssl_active > 0 || cp->wbufpo == 0 ||
+		pool_config->result_spool_size <= 0 ||
+		cp->wbufpo + len > pool_config->result_spool_size)
+		return false;
+
+	/*
+	 * Not spooling yet.  See if the client keeps up, which is the common
+	 * case, before spooling.
+	 */
+	if (cp->wbufsz <= Max(pool_config->write_buffer_size, WRITEBUFSZ))
+	{
+		sts = send(cp->fd, cp->wbuf, cp->wbufpo, MSG_DONTWAIT);
+		if (sts < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return false;		/* let the usual path report the error */
+
+		if (sts > 0)
+		{
+			memmove(cp->wbuf, cp->wbuf + sts, cp->wbufpo - sts);
+			cp->wbufpo -= sts;
+		}
+
+		if (cp->wbufpo == 0)
+			return len <= cp->wbufsz;
+		if (cp->wbufsz - cp->wbufpo >= len)
+			return true;
+	}
+
+	size = cp->wbufsz;
+	while (size - cp->wbufpo < len)
+		size *= 2;
+	size = Max(Min(size, pool_config->result_spool_size), cp->wbufpo + len);
+
+	ereport(DEBUG5,
+			(errmsg("spooling data to frontend"),
+			 errdetail("write buffer enlarged to %d bytes", size)));
+
+	cp->wbuf = repalloc(cp->wbuf, size);
+	cp->wbufsz = size;
+	return true;
+}
+
 /*
  * write len bytes to cp the write buffer.
  * returns 0 on success otherwise ereport.
@@ -554,6 +824,7 @@ pool_write_flush(POOL_CONNECTION * cp, void *buf, int len)
 	int			sts;
 	int			wlen;
 	int			offset;
+	PoolStage	stage;
 
 	wlen = len;
 
@@ -571,6 +842,7 @@ pool_write_flush(POOL_CONNECTION * cp, void *buf, int len)
 	{
 		errno = 0;
 
+		stage = pool_stage_enter(POOL_STAGE_WRITE(cp));
 		if (cp->ssl_active > 0)
 		{
 			sts = pool_ssl_write(cp, buf + offset, wlen);
@@ -579,6 +851,7 @@ pool_write_flush(POOL_CONNECTION * cp, void *buf, int len)
 		{
 			sts = write(cp->fd, buf + offset, wlen);
 		}
+		pool_stage_leave(stage);
 
 		if (sts >= 0)
 		{
@@ -634,6 +907,99 @@ pool_write_flush(POOL_CONNECTION * cp, void *buf, int len)
 	return 0;
 }
 
+/*
+ * Write the contents of the write buffer followed by buf in one writev()
+ * call and empty the write buffer.  Must not be used for SSL connections.
+ * This function does not throws an ereport in case of an error
+ */
+static int
+pool_writev_flush(POOL_CONNECTION * cp, void *buf, int len)
+{
+	struct iovec iov[2];
+	struct iovec *iovp = iov;
+	int			iovcnt = 0;
+	ssize_t		sts;
+	int			wlen;
+	PoolStage	stage;
+
+	if (cp->wbufpo > 0)
+	{
+		iov[iovcnt].iov_base = cp->wbuf;
+		iov[iovcnt].iov_len = cp->wbufpo;
+		iovcnt++;
+	}
+	iov[iovcnt].iov_base = buf;
+	iov[iovcnt].iov_len = len;
+	iovcnt++;
+
+	wlen = cp->wbufpo + len;
+	cp->wbufpo = 0;
+
+	ereport(DEBUG5,
+			(errmsg("pool_writev_flush: write size: %d", wlen)));
+
+	while (wlen > 0)
+	{
+		errno = 0;
+
+		stage = pool_stage_enter(POOL_STAGE_WRITE(cp));
+		sts = writev(cp->fd, iovp, iovcnt);
+		pool_stage_leave(stage);
+
+		if (sts >= 0)
+		{
+			if (sts > wlen)
+			{
+				ereport(WARNING,
+						(errmsg("pool_writev_flush: invalid write size %zd", sts)));
+				return -1;
+			}
+			wlen -= sts;
+
+			/* skip what has been written and retry the rest */
+			while (iovcnt > 0 && sts >= (ssize_t) iovp->iov_len)
+			{
+				sts -= iovp->iov_len;
+				iovp++;
+				iovcnt--;
+			}
+			if (iovcnt > 0)
+			{
+				iovp->iov_base = (char *) iovp->iov_base + sts;
+				iovp->iov_len -= sts;
+			}
+
+			if (wlen > 0)
+				ereport(DEBUG5,
+						(errmsg("pool_writev_flush: write retry: %d", wlen)));
+		}
+
+		else if (errno == EAGAIN || errno == EINTR)
+		{
+			continue;
+		}
+
+		else
+		{
+			/*
+			 * If this is the backend stream, report error. Otherwise just
+			 * report debug message.
+			 */
+			if (cp->isbackend)
+				ereport(WARNING,
+						(errmsg("write on backend %d failed with error :\"%m\"", cp->db_node_id),
+						 errdetail("while trying to write data wlen: %d", wlen)));
+			else
+				ereport(DEBUG5,
+						(errmsg("write on frontend failed with error :\"%m\""),
+						 errdetail("while trying to write data wlen: %d", wlen)));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /*
  * flush write buffer
  * This function does not throws an ereport in case of an error
@@ -644,6 +1010,7 @@ pool_flush_it(POOL_CONNECTION * cp)
 	int			sts;
 	int			wlen;
 	int			offset;
+	PoolStage	stage;
 
 	wlen = cp->wbufpo;
 
@@ -661,6 +1028,7 @@ pool_flush_it(POOL_CONNECTION * cp)
 	{
 		errno = 0;
 
+		stage = pool_stage_enter(POOL_STAGE_WRITE(cp));
 		if (cp->ssl_active > 0)
 		{
 			sts = pool_ssl_write(cp, cp->wbuf + offset, wlen);
@@ -669,6 +1037,7 @@ pool_flush_it(POOL_CONNECTION * cp)
 		{
 			sts = write(cp->fd, cp->wbuf + offset, wlen);
 		}
+		pool_stage_leave(stage);
 
 		if (sts >= 0)
 		{
@@ -973,6 +1342,9 @@ pool_read_string(POOL_CONNECTION * cp, int *len, int line)
 			cp->socket_state = POOL_SOCKET_ERROR;
 			if (cp->isbackend)
 			{
+				if (processType == PT_CHILD)
+					health_check_count_backend_error(cp->db_node_id, false);
+
 				if (cp->con_info && cp->con_info->swallow_termination == 1)
 				{
 					cp->con_info->swallow_termination = 0;
@@ -1073,20 +1445,21 @@ pool_set_db_node_id(POOL_CONNECTION * con, int db_node_id)
 static int
 mystrlen(char *str, int upper, int *flag)
 {
-	int			len;
-
-	*flag = 0;
+	char	   *p;
 
-	for (len = 0; len < upper; len++, str++)
+	/*
+	 * memchr() is vectorized in any libc worth using, which makes this much
+	 * faster than a byte by byte loop for long query strings.
+	 */
+	p = memchr(str, '\0', upper);
+	if (p == NULL)
 	{
-		if (!*str)
-		{
-			len++;
-			*flag = 1;
-			break;
-		}
+		*flag = 0;
+		return upper;
 	}
-	return len;
+
+	*flag = 1;
+	return p - str + 1;
 }
 
 /*
@@ -1104,20 +1477,23 @@ mystrlen(char *str, int upper, int *flag)
 static int
 mystrlinelen(char *str, int upper, int *flag)
 {
-	int			len;
+	char	   *p;
+	char	   *q;
 
-	*flag = 0;
+	/* look for \n first, then for \0 only in front of it */
+	p = memchr(str, '\n', upper);
+	q = memchr(str, '\0', p ? p - str : upper);
+	if (q)
+		p = q;
 
-	for (len = 0; len < upper; len++, str++)
+	if (p == NULL)
 	{
-		if (!*str || *str == '\n')
-		{
-			len++;
-			*flag = 1;
-			break;
-		}
+		*flag = 0;
+		return upper;
 	}
-	return len;
+
+	*flag = 1;
+	return p - str + 1;
 }
 
 /*
@@ -1180,6 +1556,72 @@ consume_pending_data(POOL_CONNECTION * cp, void *data, int len)
 	return consume_size;
 }
 
+/*
+ * Give back the memory of buffers that were enlarged beyond
+ * POOL_BUFFER_SHRINK_THRESHOLD by a large message.  Called out of
+ * transaction so that one huge row does not inflate the memory of the
+ * process for the rest of its life.  Must not be called while a pointer
+ * returned by pool_read2() or pool_read_string() is in use.
+ */
+void
+pool_shrink_buffers(POOL_CONNECTION * cp)
+{
+	MemoryContext oldContext;
+
+	if (cp == NULL)
+		return;
+
+	oldContext = SwitchToConnectionContext(cp->isbackend);
+
+	if (cp->bufsz2 > POOL_BUFFER_SHRINK_THRESHOLD)
+	{
+		pfree(cp->buf2);
+		cp->buf2 = NULL;
+		cp->bufsz2 = 0;
+	}
+
+	if (cp->sbufsz > POOL_BUFFER_SHRINK_THRESHOLD)
+	{
+		pfree(cp->sbuf);
+		cp->sbuf = NULL;
+		cp->sbufsz = 0;
+	}
+
+	/* a write buffer enlarged by spool_write_buffer() */
+	if (cp->wbufpo == 0 && cp->wbufsz > Max(pool_config->write_buffer_size, WRITEBUFSZ))
+	{
+		pfree(cp->wbuf);
+		cp->wbufsz = Max(pool_config->write_buffer_size, WRITEBUFSZ);
+		cp->wbuf = palloc(cp->wbufsz);
+	}
+
+	/* pending data may hold the next messages; keep it */
+	if (cp->bufsz > POOL_BUFFER_SHRINK_THRESHOLD &&
+		cp->len <= pool_config->read_buffer_size)
+	{
+		int			size = Max(pool_config->read_buffer_size, READBUFSZ);
+		char	   *p = palloc(size);
+
+		if (cp->len > 0)
+			memcpy(p, cp->hp + cp->po, cp->len);
+		pfree(cp->hp);
+		cp->hp = p;
+		cp->bufsz = size;
+		cp->po = 0;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+/*
+ * Returns the number of bytes allocated for the buffers of cp.
+ */
+int
+pool_buffer_memory(POOL_CONNECTION * cp)
+{
+	return cp->wbufsz + cp->bufsz + cp->sbufsz + cp->bufsz2 + cp->bufsz3;
+}
+
 /*
  * pool_unread: Put back data to input buffer
  */
@@ -1327,6 +1769,19 @@ pool_get_timeout(void)
 	return timeoutsec;
 }
 
+/*
+ * Extended query messages forwarded to a backend may be left in the write
+ * buffer while the frontend is still pipelining (see
+ * pool_backend_flush_deferrable()).  Send them out before we start waiting
+ * for the responses, otherwise we would wait forever.
+ */
+static void
+flush_before_read(POOL_CONNECTION * cp)
+{
+	if (cp->isbackend && cp->wbufpo > 0)
+		pool_flush(cp);
+}
+
 /*
  * Wait until read data is ready.
  * return values: 0: normal 1: data is not ready -1: error
@@ -1334,43 +1789,38 @@ pool_get_timeout(void)
 int
 pool_check_fd(POOL_CONNECTION * cp)
 {
-	fd_set		readmask;
-	fd_set		exceptmask;
-	int			fd;
+	struct pollfd pfd;
 	int			fds;
-	struct timeval timeout;
-	struct timeval *timeoutp;
+	int			timeout;
 	int			save_errno;
+	PoolStage	stage;
 
 	/*
 	 * If SSL is enabled, we need to check SSL internal buffer is empty or not
-	 * first. Otherwise select(2) will stuck.
+	 * first. Otherwise poll(2) will stuck.
 	 */
 	if (pool_ssl_pending(cp))
 	{
 		return 0;
 	}
 
-	fd = cp->fd;
+	flush_before_read(cp);
 
 	if (timeoutsec >= 0)
-	{
-		timeout.tv_sec = timeoutsec;
-		timeout.tv_usec = 0;
-		timeoutp = &timeout;
-	}
+		timeout = timeoutsec * 1000;
 	else
-		timeoutp = NULL;
+		timeout = -1;
 
 	for (;;)
 	{
-		FD_ZERO(&readmask);
-		FD_ZERO(&exceptmask);
-		FD_SET(fd, &readmask);
-		FD_SET(fd, &exceptmask);
+		pfd.fd = cp->fd;
+		pfd.events = POLLIN | POLLPRI;
+		pfd.revents = 0;
 
-		fds = select(fd + 1, &readmask, NULL, &exceptmask, timeoutp);
+		stage = pool_stage_enter(POOL_STAGE_READ(cp));
+		fds = poll(&pfd, 1, timeout);
 		save_errno = errno;
+		pool_stage_leave(stage);
 		if (fds == -1)
 		{
 			if (processType == PT_HEALTH_CHECK && errno == EINTR && health_check_timer_expired)
@@ -1385,16 +1835,16 @@ pool_check_fd(POOL_CONNECTION * cp)
 				continue;
 
 			ereport(WARNING,
-					(errmsg("waiting for reading data. select failed with error: \"%m\"")));
+					(errmsg("waiting for reading data. poll failed with error: \"%m\"")));
 			break;
 		}
 		else if (fds == 0)		/* timeout */
 			return 1;
 
-		if (FD_ISSET(fd, &exceptmask))
+		if (pfd.revents & POOL_POLL_EXCEPT_EVENTS)
 		{
 			ereport(WARNING,
-					(errmsg("waiting for reading data. exception occurred in select ")));
+					(errmsg("waiting for reading data. exception occurred in poll ")));
 			break;
 		}
 		errno = save_errno;
@@ -1402,3 +1852,54 @@ pool_check_fd(POOL_CONNECTION * cp)
 	}
 	return -1;
 }
+
+/*
+ * Wait until read data is ready on any of the connections, for at most
+ * msec milliseconds or forever if msec is negative.  Returns the index of
+ * the first connection with data, or -1 on timeout.  A connection with an
+ * error counts as ready, so that the caller gets the error when reading.
+ */
+int
+pool_check_fds(POOL_CONNECTION * *cps, int num, int msec)
+{
+	struct pollfd pfds[MAX_NUM_BACKENDS];
+	int			fds;
+	int			i;
+	PoolStage	stage;
+
+	for (i = 0; i < num; i++)
+	{
+		if (!pool_read_buffer_is_empty(cps[i]) || pool_ssl_pending(cps[i]))
+			return i;
+		flush_before_read(cps[i]);
+		pfds[i].fd = cps[i]->fd;
+		pfds[i].events = POLLIN | POLLPRI;
+	}
+
+	for (;;)
+	{
+		for (i = 0; i < num; i++)
+			pfds[i].revents = 0;
+
+		stage = pool_stage_enter(POOL_STAGE_READ(cps[0]));
+		fds = poll(pfds, num, msec);
+		pool_stage_leave(stage);
+		if (fds == -1)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+
+			ereport(WARNING,
+					(errmsg("waiting for reading data. poll failed with error: \"%m\"")));
+			return 0;
+		}
+		else if (fds == 0)		/* timeout */
+			return -1;
+
+		for (i = 0; i < num; i++)
+		{
+			if (pfds[i].revents != 0)
+				return i;
+		}
+	}
+}
@@ -0,0 +1,138 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_timer.c: timers of a process run from its wait loop.
+ *
+ * Rather than arming alarm(2) and handling SIGALRM, which interrupts
+ * whatever system call the process is in and only has a resolution of
+ * seconds, a timer is a deadline on the monotonic clock.  The wait loop of
+ * the process limits its poll(2) timeout with pool_timer_next_timeout()
+ * and calls pool_timer_run_expired() when it wakes up.  A process has a
+ * handful of timers at most, so they are kept in a fixed array indexed by
+ * PoolTimerId.
+ */
+#include <limits.h>
+#include <time.h>
+
+#include "pool.h"
+#include "utils/elog.h"
+#include "utils/pool_timer.h"
+
+typedef struct
+{
+	uint64		deadline;		/* monotonic msec, 0 if not set */
+	pool_timer_callback callback;
+}			PoolTimer;
+
+static PoolTimer timers[POOL_TIMER_NUM];
+
+/*
+ * Current time of the monotonic clock in milliseconds.
+ */
+uint64
+pool_timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Call the callback msec milliseconds from now.  An already set timer of
+ * the id is replaced.
+ */
+void
+pool_timer_set(PoolTimerId id, int64 msec, pool_timer_callback callback)
+{
+	timers[id].deadline = pool_timer_now() + Max(msec, 0);
+	timers[id].callback = callback;
+
+	/* never mistake the deadline for an unset timer */
+	if (timers[id].deadline == 0)
+		timers[id].deadline = 1;
+
+	ereport(DEBUG2,
+			(errmsg("timer %d set after " INT64_FORMAT " milliseconds", id, msec)));
+}
+
+void
+pool_timer_cancel(PoolTimerId id)
+{
+	timers[id].deadline = 0;
+}
+
+/*
+ * Milliseconds until the timer expires, 0 if already expired, or -1 if not
+ * set.
+ */
+int64
+pool_timer_remaining(PoolTimerId id)
+{
+	uint64		now;
+
+	if (timers[id].deadline == 0)
+		return -1;
+
+	now = pool_timer_now();
+	return timers[id].deadline > now ? (int64) (timers[id].deadline - now) : 0;
+}
+
+/*
+ * Shorten the poll(2) timeout in milliseconds, -1 meaning infinite, so
+ * that the wait ends when the first timer expires.
+ */
+int
+pool_timer_next_timeout(int timeout)
+{
+	int			i;
+
+	for (i = 0; i < POOL_TIMER_NUM; i++)
+	{
+		int64		remaining = pool_timer_remaining(i);
+
+		if (remaining < 0)
+			continue;
+		if (remaining > INT_MAX)
+			remaining = INT_MAX;
+		if (timeout < 0 || remaining < timeout)
+			timeout = (int) remaining;
+	}
+	return timeout;
+}
+
+/*
+ * Call the callbacks of the expired timers.  A callback may set its timer
+ * again.
+ */
+void
+pool_timer_run_expired(void)
+{
+	uint64		now = pool_timer_now();
+	int			i;
+
+	for (i = 0; i < POOL_TIMER_NUM; i++)
+	{
+		if (timers[i].deadline == 0 || timers[i].deadline > now)
+			continue;
+
+		timers[i].deadline = 0;
+		timers[i].callback();
+	}
+}
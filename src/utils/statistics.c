@@ -18,28 +18,100 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "pool.h"
+#include "pool_config.h"
+#include "utils/pool_atomic.h"
 #include "utils/statistics.h"
+#include "utils/pool_statement_stats.h"
 #include "parser/nodes.h"
 
+/*
+ * Weight of a new sample in the moving average of query latency, as a
+ * power of 2: new = old + (sample - old) / 2^LATENCY_EWMA_SHIFT.
+ */
+#define LATENCY_EWMA_SHIFT	3
+
+/*
+ * Query latency histograms.  Bucket widths double with every power of 2 of
+ * the latency in microseconds, and each power of 2 is split into
+ * 2^HIST_SUB_BITS linear sub-buckets, so a percentile read from a histogram
+ * is off by at most 1/2^HIST_SUB_BITS of its value.  Latencies of 2^32
+ * microseconds (about 71 minutes) and more go to the last bucket.
+ */
+#define HIST_SUB_BITS		2
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS		32
+#define HIST_NUM_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/*
+ * Query and error counters.  Every child process owns a slot of counters
+ * for all backend nodes, so that counting up is a store to a cache line no
+ * other process writes.  Slot 0 is shared by all other processes and is
+ * updated atomically.  Readers sum up all slots.
+ */
+typedef enum
+{
+	STAT_SELECT = STAT_QUERY_SELECT,	/* number of read SELECT queries
+										 * issued */
+	STAT_INSERT = STAT_QUERY_INSERT,	/* number of INSERT queries issued */
+	STAT_UPDATE = STAT_QUERY_UPDATE,	/* number of UPDATE queries issued */
+	STAT_DELETE = STAT_QUERY_DELETE,	/* number of DELETE queries issued */
+	STAT_DDL = STAT_QUERY_DDL,	/* number of DDL queries issued */
+	STAT_OTHER = STAT_QUERY_OTHER,	/* number of any other queries issued */
+	STAT_PANIC,					/* number of PANIC messages */
+	STAT_FATAL,					/* number of FATAL messages */
+	STAT_ERROR,					/* number of ERROR messages */
+	STAT_NUM_COUNTERS
+}			STAT_COUNTER;
+
+typedef struct
+{
+	pool_atomic_uint64 counters[MAX_NUM_BACKENDS][STAT_NUM_COUNTERS];
+}			STAT_COUNTER_SLOT;
+
 /*
  * Per backend node stat area in shared memory
  */
 typedef struct
 {
-	uint64		select_cnt;		/* number of read SELECT queries issued */
-	uint64		insert_cnt;		/* number of INSERT queries issued */
-	uint64		update_cnt;		/* number of UPDATE queries issued */
-	uint64		delete_cnt;		/* number of DELETE queries issued */
-	uint64		ddl_cnt;		/* number of DDL queries issued */
-	uint64		other_cnt;		/* number of any other queries issued */
-	uint64		panic_cnt;		/* number of PANIC messages */
-	uint64		fatal_cnt;		/* number of FATAL messages */
-	uint64		error_cnt;		/* number of ERROR messages */
+	pool_atomic_uint32 inflight_cnt;	/* number of queries waiting for
+										 * ReadyForQuery */
+	pool_atomic_uint64 latency;	/* moving average of query latency in
+								 * microseconds */
+	pool_atomic_uint64 probe_latency;	/* moving average of round trip
+										 * time of the worker process's
+										 * queries in microseconds */
+	pool_atomic_uint64 latency_hist[STAT_NUM_QUERY_TYPES][HIST_NUM_BUCKETS];	/* query
+																				 * latency
+																				 * histograms */
+	pool_atomic_uint64 queue_wait_hist[HIST_NUM_BUCKETS];	/* histogram of the
+															 * time waited for
+															 * max_active_queries_per_node */
 }			PER_NODE_STAT;
 
 static volatile PER_NODE_STAT *per_node_stat;
+static volatile STAT_COUNTER_SLOT *stat_slots;
+static int	stat_nslots;
+
+/*
+ * Queries of this process counted in inflight_cnt, when they were sent,
+ * their statement type and their slot in the statement statistics.
+ */
+static bool query_in_flight[MAX_NUM_BACKENDS];
+static struct timeval query_start_time[MAX_NUM_BACKENDS];
+static STAT_QUERY_TYPE query_type[MAX_NUM_BACKENDS];
+static int	query_statement_slot[MAX_NUM_BACKENDS];
+
+static STAT_QUERY_TYPE stat_query_type(Node *parse_tree);
+static void update_latency(volatile pool_atomic_uint64 * average, uint64 elapsed);
+static int	hist_bucket(uint64 elapsed);
+static uint64 hist_bucket_upper(int bucket);
+static uint64 hist_copy(int backend_node_id, STAT_QUERY_TYPE type, uint64 *hist);
+static void hist_percentiles(uint64 *hist, uint64 total, uint64 *p50, uint64 *p95, uint64 *p99);
+static void stat_counter_up(int backend_node_id, STAT_COUNTER counter);
+static uint64 stat_counter_get(int backend_node_id, STAT_COUNTER counter);
 
 /*
  * Return shared memory size necessary for this module
@@ -49,9 +121,17 @@ stat_shared_memory_size(void)
 {
 	size_t		size;
 
-	/* query counter area */
+	/* query latency area */
 	size = MAXALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
 
+	/*
+	 * Counter slot 0 plus one slot per child process, aligned to a cache
+	 * line boundary.
+	 */
+	size += POOL_CACHE_LINE_SIZE;
+	size += TYPEALIGN(POOL_CACHE_LINE_SIZE, sizeof(STAT_COUNTER_SLOT)) *
+		(pool_config->num_init_children + 1);
+
 	return size;
 }
 
@@ -63,6 +143,10 @@ void
 stat_set_stat_area(void *address)
 {
 	per_node_stat = (PER_NODE_STAT *) address;
+	stat_slots = (STAT_COUNTER_SLOT *)
+		TYPEALIGN(POOL_CACHE_LINE_SIZE,
+				  (char *) address + MAXALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT)));
+	stat_nslots = pool_config->num_init_children + 1;
 }
 
 /*
@@ -74,6 +158,56 @@ stat_init_stat_area(void)
 	memset((void *) per_node_stat, 0, stat_shared_memory_size());
 }
 
+/*
+ * Returns the address of a slot in the counter area.  Slots are padded to
+ * a multiple of the cache line size.
+ */
+static inline volatile STAT_COUNTER_SLOT *
+stat_slot(int slot)
+{
+	return (volatile STAT_COUNTER_SLOT *)
+		((char *) stat_slots +
+		 TYPEALIGN(POOL_CACHE_LINE_SIZE, sizeof(STAT_COUNTER_SLOT)) * slot);
+}
+
+/*
+ * Count up a counter of the node.  A child process is the only writer of
+ * its own slot and needs no atomic read-modify-write, everybody else goes
+ * to the shared slot 0.
+ */
+static void
+stat_counter_up(int backend_node_id, STAT_COUNTER counter)
+{
+	volatile pool_atomic_uint64 *p;
+
+	if (processType == PT_CHILD && my_proc_id >= 0 &&
+		my_proc_id < stat_nslots - 1)
+	{
+		p = &stat_slot(my_proc_id + 1)->counters[backend_node_id][counter];
+		pool_atomic_write_u64(p, pool_atomic_read_u64(p) + 1);
+	}
+	else
+	{
+		p = &stat_slot(0)->counters[backend_node_id][counter];
+		pool_atomic_fetch_add_u64(p, 1);
+	}
+}
+
+/*
+ * Returns the sum of a counter of the node over all slots.
+ */
+static uint64
+stat_counter_get(int backend_node_id, STAT_COUNTER counter)
+{
+	uint64		sum = 0;
+	int			i;
+
+	for (i = 0; i < stat_nslots; i++)
+		sum += pool_atomic_read_u64(&stat_slot(i)->counters[backend_node_id][counter]);
+
+	return sum;
+}
+
 /*
  * Update stat counter
  */
@@ -91,51 +225,67 @@ stat_count_up(int backend_node_id, Node *parse_tree)
 		return;
 	}
 
-	if (IsA(parse_tree, SelectStmt))
-	{
-		per_node_stat[backend_node_id].select_cnt++;
-	}
+	stat_counter_up(backend_node_id, (STAT_COUNTER) stat_query_type(parse_tree));
+}
 
+/*
+ * Classify the statement for the query counters and latency histograms.
+ * Queries without a parse tree are counted as others.
+ */
+static STAT_QUERY_TYPE
+stat_query_type(Node *parse_tree)
+{
+	if (parse_tree == NULL)
+		return STAT_QUERY_OTHER;
+	else if (IsA(parse_tree, SelectStmt))
+		return STAT_QUERY_SELECT;
 	else if (IsA(parse_tree, InsertStmt))
-	{
-		per_node_stat[backend_node_id].insert_cnt++;
-	}
-
+		return STAT_QUERY_INSERT;
 	else if (IsA(parse_tree, UpdateStmt))
-	{
-		per_node_stat[backend_node_id].update_cnt++;
-	}
-
+		return STAT_QUERY_UPDATE;
 	else if (IsA(parse_tree, DeleteStmt))
-	{
-		per_node_stat[backend_node_id].delete_cnt++;
-	}
+		return STAT_QUERY_DELETE;
+	else if (stat_is_ddl(parse_tree))
+		return STAT_QUERY_DDL;
+	return STAT_QUERY_OTHER;
+}
 
-	else
+/*
+ * Returns true if the statement is counted as DDL, i.e. it is neither
+ * SELECT/INSERT/UPDATE/DELETE nor one of the other utility statements
+ * listed below.
+ */
+bool
+stat_is_ddl(Node *parse_tree)
+{
+	if (parse_tree == NULL)
+		return false;
+
+	switch(nodeTag(parse_tree))
 	{
-		switch(nodeTag(parse_tree))
-		{
-			case(T_CheckPointStmt):
-			case(T_DeallocateStmt):
-			case(T_DiscardStmt):
-			case(T_ExecuteStmt):
-			case(T_ExplainStmt):
-			case(T_ListenStmt):
-			case(T_LoadStmt):
-			case(T_LockStmt):
-			case(T_NotifyStmt):
-			case(T_PrepareStmt):
-			case(T_TransactionStmt):
-			case(T_UnlistenStmt):
-			case(T_VacuumStmt):
-			case(T_VariableSetStmt):
-			case(T_VariableShowStmt):
-				per_node_stat[backend_node_id].other_cnt++;
-				break;
-
-			default:
-				per_node_stat[backend_node_id].ddl_cnt++;
-		}
+		case(T_SelectStmt):
+		case(T_InsertStmt):
+		case(T_UpdateStmt):
+		case(T_DeleteStmt):
+		case(T_CheckPointStmt):
+		case(T_DeallocateStmt):
+		case(T_DiscardStmt):
+		case(T_ExecuteStmt):
+		case(T_ExplainStmt):
+		case(T_ListenStmt):
+		case(T_LoadStmt):
+		case(T_LockStmt):
+		case(T_NotifyStmt):
+		case(T_PrepareStmt):
+		case(T_TransactionStmt):
+		case(T_UnlistenStmt):
+		case(T_VacuumStmt):
+		case(T_VariableSetStmt):
+		case(T_VariableShowStmt):
+			return false;
+
+		default:
+			return true;
 	}
 }
 
@@ -146,11 +296,179 @@ void
 error_stat_count_up(int backend_node_id, char *str)
 {
 	if (strcasecmp(str, "PANIC") == 0)
-		per_node_stat[backend_node_id].panic_cnt++;
+		stat_counter_up(backend_node_id, STAT_PANIC);
 	else if (strcasecmp(str, "FATAL") == 0)
-		per_node_stat[backend_node_id].fatal_cnt++;
+		stat_counter_up(backend_node_id, STAT_FATAL);
 	else if (strcasecmp(str, "ERROR") == 0)
-		per_node_stat[backend_node_id].error_cnt++;
+		stat_counter_up(backend_node_id, STAT_ERROR);
+}
+
+/*
+ * Remember that a query has been sent to the backend node.  Called when a
+ * simple query or an Execute message is sent.  Sending more messages before
+ * the node answers with ReadyForQuery does not count again, and the latency
+ * is recorded under the statement type and the statement statistics slot
+ * (-1 if none) of the first one.
+ */
+void
+stat_query_start(int backend_node_id, Node *parse_tree, int statement_slot)
+{
+	if (query_in_flight[backend_node_id])
+		return;
+
+	query_in_flight[backend_node_id] = true;
+	query_type[backend_node_id] = stat_query_type(parse_tree);
+	query_statement_slot[backend_node_id] = statement_slot;
+	gettimeofday(&query_start_time[backend_node_id], NULL);
+	pool_atomic_fetch_add_u32(&per_node_stat[backend_node_id].inflight_cnt, 1);
+}
+
+/*
+ * The backend node has returned ReadyForQuery.  Fold the time since
+ * stat_query_start() into the moving average of the node's latency, and
+ * add it to the histogram of the statement type and to the statement
+ * statistics.  Returns the time in microseconds, or -1 if no query was in
+ * flight.
+ */
+int64
+stat_query_end(int backend_node_id)
+{
+	struct timeval now;
+	int64		elapsed;
+
+	if (!query_in_flight[backend_node_id])
+		return -1;
+
+	query_in_flight[backend_node_id] = false;
+	pool_atomic_fetch_sub_u32(&per_node_stat[backend_node_id].inflight_cnt, 1);
+
+	gettimeofday(&now, NULL);
+	elapsed = (int64) (now.tv_sec - query_start_time[backend_node_id].tv_sec) * 1000000 +
+		(now.tv_usec - query_start_time[backend_node_id].tv_usec);
+	if (elapsed < 0)
+		elapsed = 0;
+
+	update_latency(&per_node_stat[backend_node_id].latency, elapsed);
+	pool_atomic_fetch_add_u64(&per_node_stat[backend_node_id].
+							  latency_hist[query_type[backend_node_id]][hist_bucket(elapsed)], 1);
+	pool_statement_stats_record(query_statement_slot[backend_node_id], backend_node_id, elapsed);
+
+	return elapsed;
+}
+
+/*
+ * The query sent to the backend node is given up on, for example because
+ * another node has answered it first.  Unlike stat_query_end() the time is
+ * not recorded.
+ */
+void
+stat_query_abandon(int backend_node_id)
+{
+	if (!query_in_flight[backend_node_id])
+		return;
+
+	query_in_flight[backend_node_id] = false;
+	pool_atomic_fetch_sub_u32(&per_node_stat[backend_node_id].inflight_cnt, 1);
+}
+
+/*
+ * Returns the histogram bucket of a latency in microseconds.  Latencies
+ * below HIST_SUB_BUCKETS get a bucket of their own, above that the bucket is
+ * made up of the position of the highest bit set and the HIST_SUB_BITS bits
+ * below it.
+ */
+static int
+hist_bucket(uint64 elapsed)
+{
+	int			msb;
+
+	if (elapsed < HIST_SUB_BUCKETS)
+		return (int) elapsed;
+	if (elapsed >= ((uint64) 1 << HIST_MAX_BITS))
+		return HIST_NUM_BUCKETS - 1;
+
+	for (msb = HIST_SUB_BITS; (elapsed >> (msb + 1)) != 0; msb++)
+		;
+
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+		(int) ((elapsed >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+/*
+ * Returns the highest latency in microseconds that falls into the bucket.
+ */
+static uint64
+hist_bucket_upper(int bucket)
+{
+	int			shift;
+
+	if (bucket < HIST_SUB_BUCKETS)
+		return bucket;
+
+	shift = bucket / HIST_SUB_BUCKETS - 1;
+	return (((uint64) (HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS + 1)) << shift) - 1;
+}
+
+/*
+ * Add the time in microseconds a query waited before it could be sent to
+ * the backend node because of max_active_queries_per_node to the node's
+ * queue wait histogram.
+ */
+void
+stat_queue_wait(int backend_node_id, uint64 elapsed)
+{
+	pool_atomic_fetch_add_u64(&per_node_stat[backend_node_id].queue_wait_hist[hist_bucket(elapsed)], 1);
+}
+
+/*
+ * Fold the round trip time of a query issued by the worker process into
+ * the moving average of the node's probe latency.  Unlike the query
+ * latency this is kept up to date even when no client query is sent to the
+ * node.
+ */
+void
+stat_probe_latency(int backend_node_id, uint64 elapsed)
+{
+	update_latency(&per_node_stat[backend_node_id].probe_latency, elapsed);
+}
+
+static void
+update_latency(volatile pool_atomic_uint64 * average, uint64 elapsed)
+{
+	uint64		latency;
+
+	/*
+	 * Concurrent updates from other processes may get lost, which does not
+	 * matter for an average.
+	 */
+	latency = pool_atomic_read_u64(average);
+	if (latency == 0)
+		latency = elapsed;
+	else
+		latency = latency - (latency >> LATENCY_EWMA_SHIFT) + (elapsed >> LATENCY_EWMA_SHIFT);
+	pool_atomic_write_u64(average, latency);
+}
+
+/*
+ * Forget all queries of this process still in flight, without touching the
+ * latency.  Called when the session ends.
+ */
+void
+stat_query_end_all(void)
+{
+	int			i;
+
+	if (per_node_stat == NULL)
+		return;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		if (query_in_flight[i])
+		{
+			query_in_flight[i] = false;
+			pool_atomic_fetch_sub_u32(&per_node_stat[i].inflight_cnt, 1);
+		}
+	}
 }
 
 /*
@@ -159,53 +477,202 @@ error_stat_count_up(int backend_node_id, char *str)
 uint64
 stat_get_select_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].select_cnt;
+	return stat_counter_get(backend_node_id, STAT_SELECT);
 }
 
 uint64
 stat_get_insert_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].insert_cnt;
+	return stat_counter_get(backend_node_id, STAT_INSERT);
 }
 
 uint64
 stat_get_update_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].update_cnt;
+	return stat_counter_get(backend_node_id, STAT_UPDATE);
 }
 
 uint64
 stat_get_delete_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].delete_cnt;
+	return stat_counter_get(backend_node_id, STAT_DELETE);
 }
 
 uint64
 stat_get_ddl_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].ddl_cnt;
+	return stat_counter_get(backend_node_id, STAT_DDL);
 }
 
 uint64
 stat_get_other_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].other_cnt;
+	return stat_counter_get(backend_node_id, STAT_OTHER);
 }
 
 uint64
 stat_get_panic_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].panic_cnt;
+	return stat_counter_get(backend_node_id, STAT_PANIC);
 }
 
 uint64
 stat_get_fatal_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].fatal_cnt;
+	return stat_counter_get(backend_node_id, STAT_FATAL);
 }
 
 uint64
 stat_get_error_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].error_cnt;
+	return stat_counter_get(backend_node_id, STAT_ERROR);
+}
+
+uint32
+stat_get_inflight_count(int backend_node_id)
+{
+	return pool_atomic_read_u32(&per_node_stat[backend_node_id].inflight_cnt);
+}
+
+uint64
+stat_get_latency(int backend_node_id)
+{
+	return pool_atomic_read_u64(&per_node_stat[backend_node_id].latency);
+}
+
+uint64
+stat_get_probe_latency(int backend_node_id)
+{
+	return pool_atomic_read_u64(&per_node_stat[backend_node_id].probe_latency);
+}
+
+/*
+ * Returns the median, 95th and 99th percentile of the query latency of the
+ * node in microseconds, for one statement type or STAT_QUERY_ALL.  All of
+ * them are 0 if no query has been recorded yet.
+ */
+void
+stat_get_latency_percentiles(int backend_node_id, STAT_QUERY_TYPE type,
+							 uint64 *p50, uint64 *p95, uint64 *p99)
+{
+	uint64		hist[HIST_NUM_BUCKETS];
+	uint64		total;
+
+	total = hist_copy(backend_node_id, type, hist);
+	hist_percentiles(hist, total, p50, p95, p99);
+}
+
+/*
+ * Returns the median, 95th and 99th percentile of the time queries waited
+ * for max_active_queries_per_node before being sent to the node, in
+ * microseconds.  All of them are 0 if no query has been recorded yet.
+ */
+void
+stat_get_queue_wait_percentiles(int backend_node_id, uint64 *p50, uint64 *p95, uint64 *p99)
+{
+	uint64		hist[HIST_NUM_BUCKETS];
+	uint64		total = 0;
+	int			i;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+		hist[i] = pool_atomic_read_u64(&per_node_stat[backend_node_id].queue_wait_hist[i]);
+		total += hist[i];
+	}
+	hist_percentiles(hist, total, p50, p95, p99);
+}
+
+/*
+ * Find the median, 95th and 99th percentile in a histogram holding total
+ * samples.
+ */
+static void
+hist_percentiles(uint64 *hist, uint64 total, uint64 *p50, uint64 *p95, uint64 *p99)
+{
+	uint64		count = 0;
+	uint64		rank50,
+				rank95,
+				rank99;
+	int			i;
+
+	*p50 = *p95 = *p99 = 0;
+
+	if (total == 0)
+		return;
+
+	/* rank of the sample at the percentile, rounded up */
+	rank50 = (total * 50 + 99) / 100;
+	rank95 = (total * 95 + 99) / 100;
+	rank99 = (total * 99 + 99) / 100;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+		if (hist[i] == 0)
+			continue;
+
+		/* does the bucket hold the sample at the rank? */
+		if (count < rank50 && count + hist[i] >= rank50)
+			*p50 = hist_bucket_upper(i);
+		if (count < rank95 && count + hist[i] >= rank95)
+			*p95 = hist_bucket_upper(i);
+		if (count < rank99 && count + hist[i] >= rank99)
+		{
+			*p99 = hist_bucket_upper(i);
+			break;
+		}
+		count += hist[i];
+	}
+}
+
+/*
+ * Returns the given percentile of the query latency of the node in
+ * microseconds, or 0 if no query has been recorded yet.
+ */
+uint64
+stat_get_latency_percentile(int backend_node_id, STAT_QUERY_TYPE type, int percentile)
+{
+	uint64		hist[HIST_NUM_BUCKETS];
+	uint64		total;
+	uint64		count = 0;
+	uint64		rank;
+	int			i;
+
+	total = hist_copy(backend_node_id, type, hist);
+	if (total == 0)
+		return 0;
+
+	rank = (total * percentile + 99) / 100;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+		count += hist[i];
+		if (count >= rank)
+			return hist_bucket_upper(i);
+	}
+	return hist_bucket_upper(HIST_NUM_BUCKETS - 1);
+}
+
+/*
+ * Copy the latency histogram of the node for one statement type or
+ * STAT_QUERY_ALL, so that the counts do not change under us while walking
+ * the buckets.  Returns the total number of samples.
+ */
+static uint64
+hist_copy(int backend_node_id, STAT_QUERY_TYPE type, uint64 *hist)
+{
+	uint64		total = 0;
+	int			i,
+				t;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++)
+	{
+		hist[i] = 0;
+		for (t = 0; t < STAT_NUM_QUERY_TYPES; t++)
+		{
+			if (type == STAT_QUERY_ALL || type == t)
+				hist[i] += pool_atomic_read_u64(&per_node_stat[backend_node_id].latency_hist[t][i]);
+		}
+		total += hist[i];
+	}
+	return total;
 }
@@ -0,0 +1,155 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2026	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * xxhash.c: XXH64 non-cryptographic hash function.
+ *
+ * This is an implementation of the XXH64 algorithm designed by Yann
+ * Collet (https://github.com/Cyan4973/xxHash).  It is several times
+ * faster than MD5 while having good dispersion, which makes it suitable
+ * for hashing query strings of the query cache.  It must not be used
+ * where resistance against deliberately crafted collisions is required.
+ *
+ */
+#include <string.h>
+
+#include "pool.h"
+#include "utils/xxhash.h"
+
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+/*
+ * Read little endian integers from possibly unaligned address.
+ */
+static inline uint64
+xxh_read64(const unsigned char *p)
+{
+	uint64		v;
+
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32
+xxh_read32(const unsigned char *p)
+{
+	uint32		v;
+
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64
+xxh64_round(uint64 acc, uint64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = XXH_ROTL64(acc, 31);
+	acc *= XXH_PRIME64_1;
+	return acc;
+}
+
+static inline uint64
+xxh64_merge_round(uint64 acc, uint64 val)
+{
+	val = xxh64_round(0, val);
+	acc ^= val;
+	acc = acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+	return acc;
+}
+
+/*
+ * Calculate 64bit XXH64 hash value of "input" of "len" bytes.
+ */
+uint64
+pool_xxh64(const void *input, size_t len, uint64 seed)
+{
+	const unsigned char *p = (const unsigned char *) input;
+	const unsigned char *end = p + len;
+	uint64		h64;
+
+	if (len >= 32)
+	{
+		const unsigned char *limit = end - 32;
+		uint64		v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64		v2 = seed + XXH_PRIME64_2;
+		uint64		v3 = seed;
+		uint64		v4 = seed - XXH_PRIME64_1;
+
+		do
+		{
+			v1 = xxh64_round(v1, xxh_read64(p));
+			v2 = xxh64_round(v2, xxh_read64(p + 8));
+			v3 = xxh64_round(v3, xxh_read64(p + 16));
+			v4 = xxh64_round(v4, xxh_read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h64 = XXH_ROTL64(v1, 1) + XXH_ROTL64(v2, 7) +
+			XXH_ROTL64(v3, 12) + XXH_ROTL64(v4, 18);
+		h64 = xxh64_merge_round(h64, v1);
+		h64 = xxh64_merge_round(h64, v2);
+		h64 = xxh64_merge_round(h64, v3);
+		h64 = xxh64_merge_round(h64, v4);
+	}
+	else
+		h64 = seed + XXH_PRIME64_5;
+
+	h64 += (uint64) len;
+
+	while (p + 8 <= end)
+	{
+		h64 ^= xxh64_round(0, xxh_read64(p));
+		h64 = XXH_ROTL64(h64, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+
+	if (p + 4 <= end)
+	{
+		h64 ^= (uint64) xxh_read32(p) * XXH_PRIME64_1;
+		h64 = XXH_ROTL64(h64, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		h64 ^= (*p) * XXH_PRIME64_5;
+		h64 = XXH_ROTL64(h64, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	/* avalanche */
+	h64 ^= h64 >> 33;
+	h64 *= XXH_PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= XXH_PRIME64_3;
+	h64 ^= h64 >> 32;
+
+	return h64;
+}
@@ -35,6 +35,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
@@ -55,7 +56,9 @@
 #include "utils/pool_signal.h"
 #include "utils/ps_status.h"
 #include "main/pool_internal_comms.h"
+#include "main/health_check.h"
 #include "pcp/recovery.h"
+#include "query_cache/pool_memqcache.h"
 
 #include "watchdog/wd_utils.h"
 #include "watchdog/watchdog.h"
@@ -112,6 +115,10 @@ typedef enum IPC_CMD_PROCESS_RES
 												 * before broadcasting the same cluster
 												 * service message */
 
+#define MAX_QCACHE_INVALIDATIONS_IN_MESSAGE	1024	/* maximum number of tables
+													 * in a query cache
+													 * invalidation message */
+
 /*
  * Packet types. Used in WDPacketData->type.
  */
@@ -142,6 +149,8 @@ typedef enum IPC_CMD_PROCESS_RES
 #define WD_FAILOVER_END						'H'
 #define WD_FAILOVER_WAITING_FOR_CONSENSUS	'K'
 
+#define WD_QUERY_CACHE_INVALIDATION			'T'
+
 /*Cluster Service Message Types */
 #define CLUSTER_QUORUM_LOST					'L'
 #define CLUSTER_QUORUM_FOUND				'F'
@@ -199,6 +208,7 @@ packet_types all_packet_types[] = {
 	{WD_IPC_CMD_RESULT_OK, "IPC RESPONSE GOOD"},
 	{WD_IPC_CMD_TIMEOUT, "IPC TIMEOUT"},
 	{WD_EXECUTE_COMMAND_REQUEST, "WD EXECUTE COMMAND"},
+	{WD_QUERY_CACHE_INVALIDATION, "QUERY CACHE INVALIDATION"},
 	{WD_NO_MESSAGE, ""}
 };
 
@@ -431,6 +441,7 @@ static bool does_int_array_contains_value(int *intArray, int count, int value);
 static void clear_all_failovers(void);
 static void remove_failover_object(WDFailoverObject * failoverObj);
 static void service_expired_failovers(void);
+static void service_query_cache_invalidations(void);
 static WDFailoverObject * add_failover(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count, WatchdogNode * wdNode,
 									   unsigned char flags, bool *duplicate);
 static WDFailoverCMDResults compute_failover_consensus(POOL_REQUEST_KIND reqKind, int *node_id_list,
@@ -464,8 +475,11 @@ static bool is_node_active_and_reachable(WatchdogNode * wdNode);
 static bool is_node_active(WatchdogNode * wdNode);
 static bool is_node_reachable(WatchdogNode * wdNode);
 
-static int	update_successful_outgoing_cons(fd_set *wmask, int pending_fds_count);
-static int	prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask);
+static int	update_successful_outgoing_cons(int pending_fds_count);
+static void prepare_fds(void);
+static void wd_poll_add(int fd, short events);
+static void wd_poll_record_revents(void);
+static bool wd_fd_ready(int fd, short events);
 
 static void set_next_commandID_in_message(WDPacketData * pkt);
 static void set_message_commandID(WDPacketData * pkt, unsigned int commandID);
@@ -479,6 +493,7 @@ static WDPacketData * read_packet(SocketConnection * conn);
 static WDPacketData * get_message_of_type(char type, WDPacketData * replyFor);
 static WDPacketData * get_addnode_message(void);
 static WDPacketData * get_beacon_message(char type, WDPacketData * replyFor);
+static bool cluster_supports_binary_beacon(void);
 static WDPacketData * get_mynode_info_message(WDPacketData * replyFor);
 static WDPacketData * get_minimum_message(char type, WDPacketData * replyFor);
 
@@ -493,11 +508,12 @@ static void service_internal_command(void);
 static unsigned int get_next_commandID(void);
 static WatchdogNode * parse_node_info_message(WDPacketData * pkt, char **authkey);
 static void update_quorum_status(void);
+static void publish_cluster_state(void);
 static int	get_minimum_remote_nodes_required_for_quorum(void);
 static int	get_minimum_votes_to_resolve_consensus(void);
 
 static bool write_packet_to_socket(int sock, WDPacketData * pkt, bool ipcPacket);
-static int	read_sockets(fd_set *rmask, int pending_fds_count);
+static int	read_sockets(int pending_fds_count);
 static void set_timeout(unsigned int sec);
 static int	wd_create_command_server_socket(void);
 static void close_socket_connection(SocketConnection * conn);
@@ -513,7 +529,7 @@ static int	send_message_of_type(WatchdogNode * wdNode, char type, WDPacketData *
 static bool send_cluster_service_message(WatchdogNode * wdNode, WDPacketData * replyFor, char message);
 
 
-static int	accept_incoming_connections(fd_set *rmask, int pending_fds_count);
+static int	accept_incoming_connections(int pending_fds_count);
 
 static int	standard_packet_processor(WatchdogNode * wdNode, WDPacketData * pkt);
 static void cluster_service_message_processor(WatchdogNode * wdNode, WDPacketData * pkt);
@@ -565,6 +581,8 @@ static IPC_CMD_PROCESS_RES process_IPC_failover_indication(WDCommandData * ipcCo
 static IPC_CMD_PROCESS_RES process_IPC_data_request_from_leader(WDCommandData * ipcCommand);
 static IPC_CMD_PROCESS_RES process_IPC_failover_command(WDCommandData * ipcCommand);
 static IPC_CMD_PROCESS_RES process_failover_command_on_coordinator(WDCommandData * ipcCommand);
+static void send_failover_vote_request(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count, unsigned char flags);
+static void request_health_checks(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count);
 static IPC_CMD_PROCESS_RES process_IPC_execute_cluster_command(WDCommandData * ipcCommand);
 
 static bool write_ipc_command_with_result_data(WDCommandData * ipcCommand, char type, char *data, int len);
@@ -612,6 +630,26 @@ static void wd_execute_cluster_command_processor(WatchdogNode * wdNode, WDPacket
 static void	update_failover_timeout(WatchdogNode * wdNode, POOL_CONFIG *pool_config);
 /* global variables */
 wd_cluster	g_cluster;
+
+/*
+ * Descriptors the watchdog main loop waits on.  We use poll(2) instead of
+ * select(2) so that the number of IPC clients is not limited by FD_SETSIZE:
+ * every child process may connect to the watchdog, and with a large
+ * num_init_children descriptor numbers easily go beyond 1024.  revents is
+ * indexed by descriptor so that the handlers can look up the result of a
+ * socket in constant time.
+ */
+typedef struct WDPollSet
+{
+	struct pollfd *pfds;
+	int			nfds;
+	int			pfds_size;
+	short	   *revents;
+	int			revents_size;
+}			WDPollSet;
+
+static WDPollSet wd_poll_set;
+
 struct timeval g_tm_set_time;
 int			g_timeout_sec = 0;
 
@@ -1155,12 +1193,8 @@ fork_watchdog_child(void)
 static int
 watchdog_main(void)
 {
-	fd_set		rmask;
-	fd_set		wmask;
-	fd_set		emask;
 	const int	select_timeout = 1;
-	struct timeval tv,
-				ref_time;
+	struct timeval ref_time;
 
 	volatile int fd;
 	sigjmp_buf	local_sigjmp_buf;
@@ -1238,8 +1272,7 @@ watchdog_main(void)
 	/* watchdog child loop */
 	for (;;)
 	{
-		int			fd_max,
-					select_ret;
+		int			select_ret;
 		bool		timeout_event = false;
 
 		MemoryContextSwitchTo(ProcessLoopContext);
@@ -1252,10 +1285,10 @@ watchdog_main(void)
 		 * Establish all accepting socket descriptors and wait for
 		 * incoming/outcoming events for up to 1 second.
 		 */
-		fd_max = prepare_fds(&rmask, &wmask, &emask);
-		tv.tv_sec = select_timeout;
-		tv.tv_usec = 0;
-		select_ret = select(fd_max + 1, &rmask, &wmask, &emask, &tv);
+		prepare_fds();
+		select_ret = poll(wd_poll_set.pfds, wd_poll_set.nfds, select_timeout * 1000);
+		if (select_ret > 0)
+			wd_poll_record_revents();
 
 		gettimeofday(&ref_time, NULL);
 
@@ -1275,9 +1308,9 @@ watchdog_main(void)
 		{
 			int			processed_fds = 0;
 
-			processed_fds += accept_incoming_connections(&rmask, (select_ret - processed_fds));
-			processed_fds += update_successful_outgoing_cons(&wmask, (select_ret - processed_fds));
-			processed_fds += read_sockets(&rmask, (select_ret - processed_fds));
+			processed_fds += accept_incoming_connections((select_ret - processed_fds));
+			processed_fds += update_successful_outgoing_cons((select_ret - processed_fds));
+			processed_fds += read_sockets((select_ret - processed_fds));
 		}
 
 		/*
@@ -1324,10 +1357,41 @@ watchdog_main(void)
 		 * (FAILOVER_COMMAND_FINISH_TIMEOUT)
 		 */
 		service_expired_failovers();
+
+		/*
+		 * Send the query cache invalidation of this node to the other nodes
+		 */
+		service_query_cache_invalidations();
+
+		publish_cluster_state();
 	}
 	return 0;
 }
 
+/*
+ * Publish the current cluster state in shared memory for the other pgpool
+ * processes.  This also refreshes the publish time the readers use to tell
+ * that the watchdog process is alive.
+ */
+static void
+publish_cluster_state(void)
+{
+	WDSharedClusterState state;
+	WatchdogNode *leader = WD_LEADER_NODE;
+	int			i;
+
+	state.local_state = g_cluster.localNode->state;
+	state.quorum_status = leader ? leader->quorum_status : -2;
+	state.leader_node_id = leader ? leader->pgpool_node_id : -1;
+	state.escalated = g_cluster.localNode->escalated;
+	state.node_states[0] = g_cluster.localNode->state;
+	state.node_count = 1;
+	for (i = 0; i < g_cluster.remoteNodeCount && state.node_count < MAX_WATCHDOG_NUM; i++)
+		state.node_states[state.node_count++] = g_cluster.remoteNodes[i].state;
+
+	wd_publish_shared_cluster_state(&state);
+}
+
 static int
 wd_create_command_server_socket(void)
 {
@@ -1392,39 +1456,104 @@ FileUnlink(int code, Datum path)
 }
 
 
+static void
+wd_poll_add(int fd, short events)
+{
+	if (fd < 0)
+		return;
+
+	if (wd_poll_set.nfds >= wd_poll_set.pfds_size)
+	{
+		MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
+
+		wd_poll_set.pfds_size = wd_poll_set.pfds_size ? wd_poll_set.pfds_size * 2 : 64;
+		if (wd_poll_set.pfds)
+			wd_poll_set.pfds = repalloc(wd_poll_set.pfds, sizeof(struct pollfd) * wd_poll_set.pfds_size);
+		else
+			wd_poll_set.pfds = palloc(sizeof(struct pollfd) * wd_poll_set.pfds_size);
+		MemoryContextSwitchTo(oldCxt);
+	}
+	wd_poll_set.pfds[wd_poll_set.nfds].fd = fd;
+	wd_poll_set.pfds[wd_poll_set.nfds].events = events;
+	wd_poll_set.pfds[wd_poll_set.nfds].revents = 0;
+	wd_poll_set.nfds++;
+}
+
 /*
- * sets all the valid watchdog cluster descriptors to the fd_set.
- returns the fd_max */
-static int
-prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
+ * Scatter the result of poll(2) into the descriptor indexed array.
+ */
+static void
+wd_poll_record_revents(void)
 {
 	int			i;
-	ListCell   *lc;
-	int			fd_max = g_cluster.localNode->server_socket.sock;
 
-	FD_ZERO(rmask);
-	FD_ZERO(wmask);
-	FD_ZERO(emask);
+	for (i = 0; i < wd_poll_set.nfds; i++)
+	{
+		int			fd = wd_poll_set.pfds[i].fd;
 
-	/* local node server socket will set the read and exception fds */
-	FD_SET(g_cluster.localNode->server_socket.sock, rmask);
-	FD_SET(g_cluster.localNode->server_socket.sock, emask);
+		if (fd >= wd_poll_set.revents_size)
+		{
+			MemoryContext oldCxt = MemoryContextSwitchTo(TopMemoryContext);
+			int			old_size = wd_poll_set.revents_size;
+			int			new_size = old_size ? old_size : 1024;
 
-	/* command server socket will set the read and exception fds */
-	FD_SET(g_cluster.command_server_sock, rmask);
-	FD_SET(g_cluster.command_server_sock, emask);
-	if (fd_max < g_cluster.command_server_sock)
-		fd_max = g_cluster.command_server_sock;
+			while (new_size <= fd)
+				new_size *= 2;
+			if (wd_poll_set.revents)
+				wd_poll_set.revents = repalloc(wd_poll_set.revents, sizeof(short) * new_size);
+			else
+				wd_poll_set.revents = palloc(sizeof(short) * new_size);
+			memset(wd_poll_set.revents + old_size, 0, sizeof(short) * (new_size - old_size));
+			wd_poll_set.revents_size = new_size;
+			MemoryContextSwitchTo(oldCxt);
+		}
+		wd_poll_set.revents[fd] |= wd_poll_set.pfds[i].revents;
+	}
+}
 
-	if (g_cluster.network_monitor_sock > 0)
+/*
+ * Returns true if poll(2) reported fd ready for the given events.  Errors and
+ * hang ups count as ready, as select(2) did, so that the handler gets to see
+ * the failure on read, write or getsockopt.
+ */
+static bool
+wd_fd_ready(int fd, short events)
+{
+	if (fd < 0 || fd >= wd_poll_set.revents_size)
+		return false;
+	return (wd_poll_set.revents[fd] & (events | POLLERR | POLLHUP | POLLNVAL)) != 0;
+}
+
+/*
+ * sets all the valid watchdog cluster descriptors to the poll set.
+ */
+static void
+prepare_fds(void)
+{
+	int			i;
+	ListCell   *lc;
+
+	/* forget the result of the previous round */
+	for (i = 0; i < wd_poll_set.nfds; i++)
 	{
-		FD_SET(g_cluster.network_monitor_sock, rmask);
-		if (fd_max < g_cluster.network_monitor_sock)
-			fd_max = g_cluster.network_monitor_sock;
+		int			fd = wd_poll_set.pfds[i].fd;
+
+		if (fd < wd_poll_set.revents_size)
+			wd_poll_set.revents[fd] = 0;
 	}
+	wd_poll_set.nfds = 0;
+
+	/* local node server socket */
+	wd_poll_add(g_cluster.localNode->server_socket.sock, POLLIN);
+
+	/* command server socket */
+	wd_poll_add(g_cluster.command_server_sock, POLLIN);
+
+	if (g_cluster.network_monitor_sock > 0)
+		wd_poll_add(g_cluster.network_monitor_sock, POLLIN);
 
 	/*
-	 * set write fdset for all waiting for connection sockets, while already
+	 * wait for writing on all waiting for connection sockets, while already
 	 * connected will be only be waiting for read
 	 */
 	for (i = 0; i < g_cluster.remoteNodeCount; i++)
@@ -1433,24 +1562,13 @@ prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
 
 		if (wdNode->client_socket.sock > 0)
 		{
-			if (fd_max < wdNode->client_socket.sock)
-				fd_max = wdNode->client_socket.sock;
-
-			FD_SET(wdNode->client_socket.sock, emask);
-
 			if (wdNode->client_socket.sock_state == WD_SOCK_WAITING_FOR_CONNECT)
-				FD_SET(wdNode->client_socket.sock, wmask);
+				wd_poll_add(wdNode->client_socket.sock, POLLOUT);
 			else
-				FD_SET(wdNode->client_socket.sock, rmask);
+				wd_poll_add(wdNode->client_socket.sock, POLLIN);
 		}
 		if (wdNode->server_socket.sock > 0)
-		{
-			if (fd_max < wdNode->server_socket.sock)
-				fd_max = wdNode->server_socket.sock;
-
-			FD_SET(wdNode->server_socket.sock, emask);
-			FD_SET(wdNode->server_socket.sock, rmask);
-		}
+			wd_poll_add(wdNode->server_socket.sock, POLLIN);
 	}
 
 	/*
@@ -1460,15 +1578,9 @@ prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
 	foreach(lc, g_cluster.unidentified_socks)
 	{
 		SocketConnection *conn = lfirst(lc);
-		int			ui_sock = conn->sock;
 
-		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+		if (conn->sock > 0)
+			wd_poll_add(conn->sock, POLLIN);
 	}
 
 	/* Add the notification connected clients */
@@ -1477,12 +1589,7 @@ prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
 		int			ui_sock = lfirst_int(lc);
 
 		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+			wd_poll_add(ui_sock, POLLIN);
 	}
 
 	/* Finally Add the command IPC sockets */
@@ -1491,19 +1598,12 @@ prepare_fds(fd_set *rmask, fd_set *wmask, fd_set *emask)
 		int			ui_sock = lfirst_int(lc);
 
 		if (ui_sock > 0)
-		{
-			FD_SET(ui_sock, rmask);
-			FD_SET(ui_sock, emask);
-			if (fd_max < ui_sock)
-				fd_max = ui_sock;
-		}
+			wd_poll_add(ui_sock, POLLIN);
 	}
-
-	return fd_max;
 }
 
 static int
-read_sockets(fd_set *rmask, int pending_fds_count)
+read_sockets(int pending_fds_count)
 {
 	int			i,
 				count = 0;
@@ -1516,7 +1616,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 
 		if (is_socket_connection_connected(&wdNode->client_socket))
 		{
-			if (FD_ISSET(wdNode->client_socket.sock, rmask))
+			if (wd_fd_ready(wdNode->client_socket.sock, POLLIN))
 			{
 				ereport(DEBUG2,
 						(errmsg("client socket of %s is ready for reading", wdNode->nodeName)));
@@ -1548,7 +1648,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 		}
 		if (is_socket_connection_connected(&wdNode->server_socket))
 		{
-			if (FD_ISSET(wdNode->server_socket.sock, rmask))
+			if (wd_fd_ready(wdNode->server_socket.sock, POLLIN))
 			{
 				ereport(DEBUG2,
 						(errmsg("server socket of %s is ready for reading", wdNode->nodeName)));
@@ -1583,7 +1683,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 	{
 		SocketConnection *conn = lfirst(lc);
 
-		if (conn->sock > 0 && FD_ISSET(conn->sock, rmask))
+		if (conn->sock > 0 && wd_fd_ready(conn->sock, POLLIN))
 		{
 			WDPacketData *pkt;
 
@@ -1762,7 +1862,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 	{
 		int			command_sock = lfirst_int(lc);
 
-		if (command_sock > 0 && FD_ISSET(command_sock, rmask))
+		if (command_sock > 0 && wd_fd_ready(command_sock, POLLIN))
 		{
 			bool		remove_sock = false;
 
@@ -1805,7 +1905,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 	{
 		int			notify_sock = lfirst_int(lc);
 
-		if (notify_sock > 0 && FD_ISSET(notify_sock, rmask))
+		if (notify_sock > 0 && wd_fd_ready(notify_sock, POLLIN))
 		{
 			bool		remove_sock = false;
 
@@ -1831,7 +1931,7 @@ read_sockets(fd_set *rmask, int pending_fds_count)
 
 
 	/* Finally check if something waits us on interface monitoring socket */
-	if (g_cluster.network_monitor_sock > 0 && FD_ISSET(g_cluster.network_monitor_sock, rmask))
+	if (g_cluster.network_monitor_sock > 0 && wd_fd_ready(g_cluster.network_monitor_sock, POLLIN))
 	{
 		bool		deleted;
 		bool		link_event;
@@ -2379,6 +2479,53 @@ clear_all_failovers(void)
 	list_free(failovers_to_del);
 }
 
+/*
+ * Send the query cache invalidation requests queued by the child processes
+ * of this node to all the reachable nodes.  If some requests have been
+ * dropped because the queue was full, ask the nodes to clear their whole
+ * query cache instead.
+ */
+static void
+service_query_cache_invalidations(void)
+{
+	int			dboids[MAX_QCACHE_INVALIDATIONS_IN_MESSAGE];
+	int			tableoids[MAX_QCACHE_INVALIDATIONS_IN_MESSAGE];
+	int			num;
+	bool		overflow;
+
+	if (!pool_is_remote_invalidation())
+		return;
+
+	do
+	{
+		WDPacketData *pkt;
+		char	   *data;
+		int			len;
+
+		num = pool_dequeue_remote_invalidation(dboids, tableoids,
+											   MAX_QCACHE_INVALIDATIONS_IN_MESSAGE,
+											   &overflow);
+		if (num == 0 && !overflow)
+			break;
+
+		if (overflow)
+		{
+			ereport(LOG,
+					(errmsg("query cache invalidation queue overflowed"),
+					 errdetail("asking remote nodes to clear the whole query cache")));
+			num = 0;
+		}
+
+		data = get_query_cache_invalidation_binary(overflow, num, dboids, tableoids, &len);
+		pkt = get_empty_packet();
+		set_message_type(pkt, WD_QUERY_CACHE_INVALIDATION);
+		set_next_commandID_in_message(pkt);
+		set_message_data(pkt, data, len);
+		send_message(NULL, pkt);
+		free_packet(pkt);
+	} while (num == MAX_QCACHE_INVALIDATIONS_IN_MESSAGE);
+}
+
 /* Remove the over stayed failover objects */
 static void
 service_expired_failovers(void)
@@ -2838,22 +2985,73 @@ static IPC_CMD_PROCESS_RES process_failover_command_on_coordinator(WDCommandData
 
 		/*
 		 * Ask all the nodes to re-send the failover request for the
-		 * quarantined nodes.
+		 * quarantined nodes, and to check the backend nodes in question
+		 * right away instead of waiting for their next health check, so
+		 * that the missing votes arrive within a round trip.
 		 */
-		send_message_of_type(NULL, WD_FAILOVER_WAITING_FOR_CONSENSUS, NULL);
+		send_failover_vote_request(reqKind, node_id_list, node_count, flags);
 
 		/*
 		 * Also if the command was originated by remote node, check local
 		 * quarantine space as-well
 		 */
 		if (ipcCommand->commandSource == COMMAND_SOURCE_REMOTE)
+		{
+			request_health_checks(reqKind, node_id_list, node_count);
 			register_inform_quarantine_nodes_req();
+		}
 	}
 
 	reply_to_failover_command(ipcCommand, res, 0);
 	return IPC_CMD_COMPLETE;
 }
 
+/*
+ * Broadcast WD_FAILOVER_WAITING_FOR_CONSENSUS carrying the backend nodes the
+ * pending failover is about.  Nodes before watchdog data version 1.3 ignore
+ * the data and only re-send the requests for their quarantined nodes.
+ */
+static void
+send_failover_vote_request(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count, unsigned char flags)
+{
+	WDPacketData *pkt;
+	char	   *json_data;
+
+	if (reqKind != NODE_DOWN_REQUEST || node_count <= 0)
+	{
+		send_message_of_type(NULL, WD_FAILOVER_WAITING_FOR_CONSENSUS, NULL);
+		return;
+	}
+
+	json_data = get_wd_node_function_json(WD_FUNCTION_DEGENERATE_REQUEST, node_id_list,
+										  node_count, flags, 0, NULL);
+	pkt = get_empty_packet();
+	set_message_type(pkt, WD_FAILOVER_WAITING_FOR_CONSENSUS);
+	set_next_commandID_in_message(pkt);
+	set_message_data(pkt, json_data, strlen(json_data));
+	send_message(NULL, pkt);
+	free_packet(pkt);
+}
+
+/*
+ * Ask the local health check processes to check the backend nodes of a
+ * failover waiting for consensus immediately.
+ */
+static void
+request_health_checks(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count)
+{
+	int			i;
+
+	if (reqKind != NODE_DOWN_REQUEST)
+		return;
+
+	for (i = 0; i < node_count; i++)
+	{
+		if (node_id_list[i] >= 0 && node_id_list[i] < MAX_NUM_BACKENDS)
+			health_check_request(node_id_list[i]);
+	}
+}
+
 static IPC_CMD_PROCESS_RES process_IPC_failover_command(WDCommandData * ipcCommand)
 {
 	if (is_local_node_true_leader())
@@ -3373,12 +3571,12 @@ is_node_active_and_reachable(WatchdogNode * wdNode)
 }
 
 static int
-accept_incoming_connections(fd_set *rmask, int pending_fds_count)
+accept_incoming_connections(int pending_fds_count)
 {
 	int			processed_fds = 0;
 	int			fd;
 
-	if (FD_ISSET(g_cluster.localNode->server_socket.sock, rmask))
+	if (wd_fd_ready(g_cluster.localNode->server_socket.sock, POLLIN))
 	{
 		struct sockaddr_in addr;
 		socklen_t	addrlen = sizeof(struct sockaddr_in);
@@ -3416,7 +3614,7 @@ accept_incoming_connections(fd_set *rmask, int pending_fds_count)
 	if (processed_fds >= pending_fds_count)
 		return processed_fds;
 
-	if (FD_ISSET(g_cluster.command_server_sock, rmask))
+	if (wd_fd_ready(g_cluster.command_server_sock, POLLIN))
 	{
 		struct sockaddr addr;
 		socklen_t	addrlen = sizeof(struct sockaddr);
@@ -3452,7 +3650,7 @@ accept_incoming_connections(fd_set *rmask, int pending_fds_count)
 }
 
 static int
-update_successful_outgoing_cons(fd_set *wmask, int pending_fds_count)
+update_successful_outgoing_cons(int pending_fds_count)
 {
 	int			i;
 	int			count = 0;
@@ -3463,7 +3661,7 @@ update_successful_outgoing_cons(fd_set *wmask, int pending_fds_count)
 
 		if (wdNode->client_socket.sock > 0 && wdNode->client_socket.sock_state == WD_SOCK_WAITING_FOR_CONNECT)
 		{
-			if (FD_ISSET(wdNode->client_socket.sock, wmask))
+			if (wd_fd_ready(wdNode->client_socket.sock, POLLOUT))
 			{
 				socklen_t	lon;
 				int			valopt;
@@ -3720,12 +3918,43 @@ static JsonNode * get_node_list_json(int id)
 	return jNode;
 }
 
+/*
+ * Returns true if every remote node we know of understands the binary
+ * beacon format (watchdog data version 1.3 or later).  Beacons are
+ * broadcast as a single packet, so one older node makes us fall back to
+ * JSON for everyone.
+ */
+static bool
+cluster_supports_binary_beacon(void)
+{
+	int			i;
+
+	for (i = 0; i < g_cluster.remoteNodeCount; i++)
+	{
+		WatchdogNode *wdNode = &(g_cluster.remoteNodes[i]);
+
+		if (wdNode->wd_data_major_version > 1)
+			continue;
+		if (wdNode->wd_data_major_version == 1 && wdNode->wd_data_minor_version >= 3)
+			continue;
+		return false;
+	}
+	return true;
+}
+
 static WDPacketData * get_beacon_message(char type, WDPacketData * replyFor)
 {
 	WDPacketData *message = get_empty_packet();
-	char	   *json_data;
+	char	   *data;
+	int			len;
 
-	json_data = get_beacon_message_json(g_cluster.localNode);
+	if (cluster_supports_binary_beacon())
+		data = get_beacon_message_binary(g_cluster.localNode, &len);
+	else
+	{
+		data = get_beacon_message_json(g_cluster.localNode);
+		len = strlen(data);
+	}
 
 	set_message_type(message, type);
 
@@ -3734,7 +3963,7 @@ static WDPacketData * get_beacon_message(char type, WDPacketData * replyFor)
 	else
 		set_message_commandID(message, replyFor->command_id);
 
-	set_message_data(message, json_data, strlen(json_data));
+	set_message_data(message, data, len);
 	return message;
 }
 
@@ -4205,6 +4434,21 @@ standard_packet_processor(WatchdogNode * wdNode, WDPacketData * pkt)
 		case WD_FAILOVER_WAITING_FOR_CONSENSUS:
 			ereport(LOG,
 					(errmsg("remote node \"%s\" is asking to inform about quarantined backend nodes", wdNode->nodeName)));
+			if (pkt->data && pkt->len > 0)
+			{
+				char	   *func_name;
+				int		   *node_id_list = NULL;
+				int			node_count = 0;
+				unsigned char flags;
+
+				if (parse_wd_node_function_json(pkt->data, pkt->len, &func_name,
+												&node_id_list, &node_count, &flags))
+				{
+					ereport(LOG,
+							(errmsg("checking %d backend node(s) of the failover waiting for consensus", node_count)));
+					request_health_checks(NODE_DOWN_REQUEST, node_id_list, node_count);
+				}
+			}
 			register_inform_quarantine_nodes_req();
 			break;
 
@@ -4239,6 +4483,37 @@ standard_packet_processor(WatchdogNode * wdNode, WDPacketData * pkt)
 			}
 			break;
 
+		case WD_QUERY_CACHE_INVALIDATION:
+			{
+				bool		clear_all;
+				int			num;
+				int		   *dboids;
+				int		   *tableoids;
+
+				if (!pool_is_remote_invalidation())
+					break;
+
+				if (!parse_query_cache_invalidation_binary(pkt->data, pkt->len, &clear_all,
+														   &num, &dboids, &tableoids))
+				{
+					ereport(LOG,
+							(errmsg("node \"%s\" sent an invalid query cache invalidation message", wdNode->nodeName)));
+					break;
+				}
+
+				if (clear_all)
+				{
+					ereport(LOG,
+							(errmsg("clearing query cache as requested by node \"%s\"", wdNode->nodeName)));
+					pool_clear_memory_cache();
+				}
+				else if (num > 0)
+					pool_apply_remote_invalidation(num, dboids, tableoids);
+				pfree(dboids);
+				pfree(tableoids);
+			}
+			break;
+
 		case WD_POOL_CONFIG_DATA:
 			{
 				/* only accept config data if I am the coordinator node */
@@ -6542,13 +6817,24 @@ beacon_message_received_from_node(WatchdogNode * wdNode, WDPacketData * pkt)
 	if (pkt->data == NULL || pkt->len <= 0)
 		return false;
 
-	if (parse_beacon_message_json(pkt->data, pkt->len,
-								  &state,
-								  &seconds_since_node_startup,
-								  &seconds_since_current_state,
-								  &quorum_status,
-								  &standby_nodes_count,
-								  &escalated) == false)
+	if (WD_IS_BINARY_BEACON(pkt->data, pkt->len))
+	{
+		if (parse_beacon_message_binary(pkt->data, pkt->len,
+										&state,
+										&seconds_since_node_startup,
+										&seconds_since_current_state,
+										&quorum_status,
+										&standby_nodes_count,
+										&escalated) == false)
+			return false;
+	}
+	else if (parse_beacon_message_json(pkt->data, pkt->len,
+									   &state,
+									   &seconds_since_node_startup,
+									   &seconds_since_current_state,
+									   &quorum_status,
+									   &standby_nodes_count,
+									   &escalated) == false)
 	{
 		return false;
 	}
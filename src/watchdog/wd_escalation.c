@@ -26,10 +26,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
-
-#ifdef __FreeBSD__
+#include <sys/time.h>
 #include <sys/wait.h>
-#endif
 
 #include "utils/pool_signal.h"
 #include "utils/elog.h"
@@ -41,6 +39,12 @@
 
 #include "query_cache/pool_memqcache.h"
 
+static long elapsed_msec(struct timeval *start);
+static pid_t start_escalation_command(char *command);
+static void report_escalation_command(const char *step, int status);
+static void run_escalation_command(char *command, const char *step, bool parallel,
+								   int (*ip_func) (void), const char *ip_failure);
+
 static void
 wd_exit(int exit_signo)
 {
@@ -63,6 +67,7 @@ pid_t
 fork_escalation_process(void)
 {
 	pid_t		pid;
+	struct timeval start_time;
 
 	pid = fork();
 	if (pid != 0)
@@ -93,54 +98,38 @@ fork_escalation_process(void)
 	ereport(LOG,
 			(errmsg("watchdog: escalation started")));
 
+	gettimeofday(&start_time, NULL);
+
 	/*
 	 * STEP 1 clear shared memory cache
 	 */
 	if (pool_config->memory_cache_enabled && pool_is_shmem_cache() &&
 		pool_config->clear_memqcache_on_escalation)
 	{
+		struct timeval step_time;
+
 		ereport(LOG,
 				(errmsg("watchdog escalation"),
 				 errdetail("clearing all the query cache on shared memory")));
 
+		gettimeofday(&step_time, NULL);
 		pool_clear_memory_cache();
+		ereport(LOG,
+				(errmsg("watchdog escalation: clearing the query cache took %ld ms",
+						elapsed_msec(&step_time))));
 	}
 
 	/*
-	 * STEP 2 execute escalation command provided by user in pgpool conf file
-	 */
-	if (strlen(pool_config->wd_escalation_command))
-	{
-		int			r = system(pool_config->wd_escalation_command);
-
-		if (WIFEXITED(r))
-		{
-			if (WEXITSTATUS(r) == EXIT_SUCCESS)
-				ereport(LOG,
-						(errmsg("watchdog escalation successful")));
-			else
-			{
-				ereport(WARNING,
-						(errmsg("watchdog escalation command failed with exit status: %d", WEXITSTATUS(r))));
-			}
-		}
-		else
-		{
-			ereport(WARNING,
-					(errmsg("watchdog escalation command exit abnormally")));
-		}
-	}
-
-	/*
-	 * STEP 3 bring up the delegate IP
+	 * STEP 2 execute escalation command provided by user in pgpool conf
+	 * file, and STEP 3 bring up the delegate IP.  With
+	 * wd_parallel_escalation the two steps run at the same time.
 	 */
-	if (strlen(pool_config->delegate_ip) != 0)
-	{
-		if (wd_IP_up() != WD_OK)
-			ereport(WARNING,
-					(errmsg("watchdog escalation failed to acquire delegate IP")));
+	run_escalation_command(pool_config->wd_escalation_command, "escalation",
+						   pool_config->wd_parallel_escalation,
+						   wd_IP_up, "watchdog escalation failed to acquire delegate IP");
 
-	}
+	ereport(LOG,
+			(errmsg("watchdog: escalation finished in %ld ms", elapsed_msec(&start_time))));
 	exit(0);
 }
 
@@ -151,6 +140,7 @@ pid_t
 fork_plunging_process(void)
 {
 	pid_t		pid;
+	struct timeval start_time;
 
 	pid = fork();
 	if (pid != 0)
@@ -181,41 +171,127 @@ fork_plunging_process(void)
 	ereport(LOG,
 			(errmsg("watchdog: de-escalation started")));
 
+	gettimeofday(&start_time, NULL);
+
 	/*
 	 * STEP 1 execute de-escalation command provided by user in pgpool conf
-	 * file
+	 * file, and STEP 2 bring down the delegate IP.  With
+	 * wd_parallel_escalation the two steps run at the same time.
 	 */
-	if (strlen(pool_config->wd_de_escalation_command))
+	run_escalation_command(pool_config->wd_de_escalation_command, "de-escalation",
+						   pool_config->wd_parallel_escalation,
+						   wd_IP_down, "watchdog de-escalation failed to bring down delegate IP");
+
+	ereport(LOG,
+			(errmsg("watchdog: de-escalation finished in %ld ms", elapsed_msec(&start_time))));
+	exit(0);
+}
+
+static long
+elapsed_msec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * Start the user's (de-)escalation command in a child process, the same
+ * way system() runs it.  Returns the pid, or -1 if fork failed.
+ */
+static pid_t
+start_escalation_command(char *command)
+{
+	pid_t		pid = fork();
+
+	if (pid == 0)
 	{
-		int			r = system(pool_config->wd_de_escalation_command);
+		on_exit_reset();
+		execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+		_exit(127);
+	}
+	return pid;
+}
 
-		if (WIFEXITED(r))
-		{
-			if (WEXITSTATUS(r) == EXIT_SUCCESS)
-				ereport(LOG,
-						(errmsg("watchdog de-escalation successful")));
-			else
-			{
-				ereport(WARNING,
-						(errmsg("watchdog de-escalation command failed with exit status: %d", WEXITSTATUS(r))));
-			}
-		}
+static void
+report_escalation_command(const char *step, int status)
+{
+	if (WIFEXITED(status))
+	{
+		if (WEXITSTATUS(status) == EXIT_SUCCESS)
+			ereport(LOG,
+					(errmsg("watchdog %s successful", step)));
 		else
 		{
 			ereport(WARNING,
-					(errmsg("watchdog de-escalation command exit abnormally")));
+					(errmsg("watchdog %s command failed with exit status: %d", step, WEXITSTATUS(status))));
 		}
 	}
+	else
+	{
+		ereport(WARNING,
+				(errmsg("watchdog %s command exit abnormally", step)));
+	}
+}
 
-	/*
-	 * STEP 2 bring down the delegate IP
-	 */
+/*
+ * Run the (de-)escalation command and then ip_func to move the delegate IP.
+ * If "parallel" is true and both are configured, the command runs in a
+ * child process while the delegate IP is handled here.  The time taken by
+ * each step is logged.
+ */
+static void
+run_escalation_command(char *command, const char *step, bool parallel,
+					   int (*ip_func) (void), const char *ip_failure)
+{
+	bool		has_command = strlen(command) > 0;
+	bool		has_ip = strlen(pool_config->delegate_ip) != 0;
+	struct timeval cmd_time;
+	struct timeval ip_time;
+	pid_t		cmd_pid = -1;
+	int			status;
 
-	if (strlen(pool_config->delegate_ip) != 0)
+	gettimeofday(&cmd_time, NULL);
+
+	if (has_command)
 	{
-		if (wd_IP_down() != WD_OK)
+		if (parallel && has_ip)
+			cmd_pid = start_escalation_command(command);
+
+		if (cmd_pid < 0)
+		{
+			status = system(command);
+			report_escalation_command(step, status);
+			ereport(LOG,
+					(errmsg("watchdog %s: %s command took %ld ms", step, step, elapsed_msec(&cmd_time))));
+		}
+	}
+
+	if (has_ip)
+	{
+		gettimeofday(&ip_time, NULL);
+		if (ip_func() != WD_OK)
 			ereport(WARNING,
-					(errmsg("watchdog de-escalation failed to bring down delegate IP")));
+					(errmsg("%s", ip_failure)));
+		ereport(LOG,
+				(errmsg("watchdog %s: delegate IP step took %ld ms", step, elapsed_msec(&ip_time))));
+	}
+
+	if (cmd_pid > 0)
+	{
+		while (waitpid(cmd_pid, &status, 0) < 0)
+		{
+			if (errno != EINTR)
+			{
+				ereport(WARNING,
+						(errmsg("watchdog %s command could not be waited for", step),
+						 errdetail("waitpid() failed with reason: \"%m\"")));
+				return;
+			}
+		}
+		report_escalation_command(step, status);
+		ereport(LOG,
+				(errmsg("watchdog %s: %s command took %ld ms", step, step, elapsed_msec(&cmd_time))));
 	}
-	exit(0);
 }
@@ -38,6 +38,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #if defined(SO_BINDTODEVICE)
 #include <net/if.h>
@@ -82,6 +83,12 @@ static int	wd_create_hb_recv_socket(WdHbIf * hb_if);
 static void wd_hb_send(int sock, WdHbPacket * pkt, int len, const char *destination, const int dest_port);
 static void wd_hb_recv(int sock, WdHbPacket * pkt, char *from_addr);
 
+static void wd_hb_fill_packet(WdHbPacket * pkt);
+static bool wd_hb_authenticate(WdHbPacket * pkt);
+static void wd_hb_register_packet(WdHbPacket * pkt, char *from);
+static void wd_hb_send_all(int *socks, int *sock_of_if);
+static void wd_hb_recv_all(int sock);
+
 /* create socket for sending heartbeat */
 static int
 wd_create_hb_send_socket(WdHbIf * hb_if)
@@ -345,12 +352,7 @@ wd_hb_receiver(int fork_wait_time, WdHbIf * hb_if)
 	int			sock;
 	pid_t		pid = 0;
 	WdHbPacket	pkt;
-	struct timeval tv;
 	char		from[WD_MAX_HOST_NAMELEN];
-	int			from_pgpool_port;
-	char		buf[WD_AUTH_HASH_LEN + 1];
-	char		pack_str[WD_MAX_PACKET_STRING];
-	int			pack_str_len;
 	sigjmp_buf	local_sigjmp_buf;
 
 	pid = fork();
@@ -411,67 +413,93 @@ wd_hb_receiver(int fork_wait_time, WdHbIf * hb_if)
 
 	for (;;)
 	{
-		int			i;
-
 		MemoryContextSwitchTo(ProcessLoopContext);
 		MemoryContextResetAndDeleteChildren(ProcessLoopContext);
 
 		/* receive heartbeat signal */
 		wd_hb_recv(sock, &pkt, from);
 		/* authentication */
-		if (strlen(pool_config->wd_authkey))
-		{
-			/* calculate hash from packet */
-			pack_str_len = packet_to_string_hb(&pkt, pack_str, sizeof(pack_str));
-			wd_calc_hash(pack_str, pack_str_len, buf);
+		if (!wd_hb_authenticate(&pkt))
+			ereport(ERROR,
+					(errmsg("watchdog heartbeat receive"),
+					 errdetail("authentication failed")));
 
-			if (buf[0] == '\0')
-				ereport(WARNING,
-						(errmsg("failed to calculate wd_authkey hash from a received heartbeat packet")));
+		wd_hb_register_packet(&pkt, from);
+	}
 
-			if (strcmp(pkt.hash, buf))
-				ereport(ERROR,
-						(errmsg("watchdog heartbeat receive"),
-						 errdetail("authentication failed")));
-		}
+	return pid;
+}
 
-		/* get current time */
-		gettimeofday(&tv, NULL);
+/*
+ * Check the hash of a received heartbeat packet.  Returns true if the
+ * packet is authentic or no wd_authkey is configured.
+ */
+static bool
+wd_hb_authenticate(WdHbPacket * pkt)
+{
+	char		buf[WD_AUTH_HASH_LEN + 1];
+	char		pack_str[WD_MAX_PACKET_STRING];
+	int			pack_str_len;
 
-		/* who send this packet? */
-		from_pgpool_port = pkt.from_pgpool_port;
-		for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
-		{
-			LifeCheckNode *node = &gslifeCheckCluster->lifeCheckNodes[i];
+	if (!strlen(pool_config->wd_authkey))
+		return true;
+
+	/* calculate hash from packet */
+	pack_str_len = packet_to_string_hb(pkt, pack_str, sizeof(pack_str));
+	wd_calc_hash(pack_str, pack_str_len, buf);
+
+	if (buf[0] == '\0')
+		ereport(WARNING,
+				(errmsg("failed to calculate wd_authkey hash from a received heartbeat packet")));
 
-			ereport(DEBUG2,
-					(errmsg("received heartbeat signal from \"%s:%d\" hostname:%s",
-							from, from_pgpool_port, pkt.from)));
+	return strcmp(pkt->hash, buf) == 0;
+}
 
-			if ((!strcmp(node->hostName, pkt.from) || !strcmp(node->hostName, from)) && node->pgpoolPort == from_pgpool_port)
+/*
+ * Record the arrival of a heartbeat packet from the watchdog node that sent
+ * it.  "from" is the address the packet came from.
+ */
+static void
+wd_hb_register_packet(WdHbPacket * pkt, char *from)
+{
+	struct timeval tv;
+	int			from_pgpool_port;
+	int			i;
+
+	/* get current time */
+	gettimeofday(&tv, NULL);
+
+	/* who send this packet? */
+	from_pgpool_port = pkt->from_pgpool_port;
+	for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
+	{
+		LifeCheckNode *node = &gslifeCheckCluster->lifeCheckNodes[i];
+
+		ereport(DEBUG2,
+				(errmsg("received heartbeat signal from \"%s:%d\" hostname:%s",
+						from, from_pgpool_port, pkt->from)));
+
+		if ((!strcmp(node->hostName, pkt->from) || !strcmp(node->hostName, from)) && node->pgpoolPort == from_pgpool_port)
+		{
+			/* this is the first packet or the latest packet */
+			if (!WD_TIME_ISSET(node->hb_send_time) ||
+				WD_TIME_BEFORE(node->hb_send_time, pkt->send_time))
 			{
-				/* this is the first packet or the latest packet */
-				if (!WD_TIME_ISSET(node->hb_send_time) ||
-					WD_TIME_BEFORE(node->hb_send_time, pkt.send_time))
-				{
-					ereport(DEBUG1,
-							(errmsg("received heartbeat signal from \"%s(%s):%d\" node:%s",
-									from, pkt.from, from_pgpool_port, node->nodeName)));
+				ereport(DEBUG1,
+						(errmsg("received heartbeat signal from \"%s(%s):%d\" node:%s",
+								from, pkt->from, from_pgpool_port, node->nodeName)));
 
-					node->hb_send_time = pkt.send_time;
-					node->hb_last_recv_time = tv;
-				}
-				else
-				{
-					ereport(NOTICE,
-							(errmsg("received heartbeat signal is older than the latest, ignored")));
-				}
-				break;
+				node->hb_send_time = pkt->send_time;
+				node->hb_last_recv_time = tv;
 			}
+			else
+			{
+				ereport(NOTICE,
+						(errmsg("received heartbeat signal is older than the latest, ignored")));
+			}
+			break;
 		}
 	}
-
-	return pid;
 }
 
 /* fork heartbeat sender child */
@@ -481,9 +509,6 @@ wd_hb_sender(int fork_wait_time, WdHbIf * hb_if)
 	int			sock;
 	pid_t		pid = 0;
 	WdHbPacket	pkt;
-
-	char		pack_str[WD_MAX_PACKET_STRING];
-	int			pack_str_len;
 	sigjmp_buf	local_sigjmp_buf;
 
 	pid = fork();
@@ -549,21 +574,7 @@ wd_hb_sender(int fork_wait_time, WdHbIf * hb_if)
 		MemoryContextResetAndDeleteChildren(ProcessLoopContext);
 
 		/* contents of packet */
-		gettimeofday(&pkt.send_time, NULL);
-		strlcpy(pkt.from, pool_config->wd_nodes.wd_node_info[pool_config->pgpool_node_id].hostname, sizeof(pkt.from));
-		pkt.from_pgpool_port = pool_config->port;
-
-		/* authentication key */
-		if (strlen(pool_config->wd_authkey))
-		{
-			/* calculate hash from packet */
-			pack_str_len = packet_to_string_hb(&pkt, pack_str, sizeof(pack_str));
-			wd_calc_hash(pack_str, pack_str_len, pkt.hash);
-
-			if (pkt.hash[0] == '\0')
-				ereport(WARNING,
-						(errmsg("failed to calculate wd_authkey hash from a heartbeat packet to be sent")));
-		}
+		wd_hb_fill_packet(&pkt);
 
 		/* send heartbeat signal */
 		wd_hb_send(sock, &pkt, sizeof(pkt), hb_if->addr, hb_if->dest_port);
@@ -575,6 +586,313 @@ wd_hb_sender(int fork_wait_time, WdHbIf * hb_if)
 	return pid;
 }
 
+/* build the heartbeat packet to be sent, in host byte order */
+static void
+wd_hb_fill_packet(WdHbPacket * pkt)
+{
+	char		pack_str[WD_MAX_PACKET_STRING];
+	int			pack_str_len;
+
+	memset(pkt, 0, sizeof(*pkt));
+	gettimeofday(&pkt->send_time, NULL);
+	strlcpy(pkt->from, pool_config->wd_nodes.wd_node_info[pool_config->pgpool_node_id].hostname, sizeof(pkt->from));
+	pkt->from_pgpool_port = pool_config->port;
+
+	/* authentication key */
+	if (strlen(pool_config->wd_authkey))
+	{
+		/* calculate hash from packet */
+		pack_str_len = packet_to_string_hb(pkt, pack_str, sizeof(pack_str));
+		wd_calc_hash(pack_str, pack_str_len, pkt->hash);
+
+		if (pkt->hash[0] == '\0')
+			ereport(WARNING,
+					(errmsg("failed to calculate wd_authkey hash from a heartbeat packet to be sent")));
+	}
+}
+
+/*
+ * Send one heartbeat packet to every destination.  Destinations sharing a
+ * socket (i.e. the same heartbeat_device) are sent with one sendmmsg(2)
+ * call.  socks is indexed by heartbeat interface; sock_of_if[i] is the
+ * index in socks of the socket used for interface i.
+ */
+static void
+wd_hb_send_all(int *socks, int *sock_of_if)
+{
+	WdHbPacket	pkt;
+	WdHbPacket	buf;
+	struct mmsghdr msgs[WD_MAX_IF_NUM];
+	struct iovec iov;
+	struct sockaddr_in addrs[WD_MAX_IF_NUM];
+	int			dest_if[WD_MAX_IF_NUM];
+	int			s,
+				i;
+
+	wd_hb_fill_packet(&pkt);
+	hton_wd_hb_packet(&buf, &pkt);
+	iov.iov_base = &buf;
+	iov.iov_len = sizeof(buf);
+
+	for (s = 0; s < pool_config->num_hb_dest_if; s++)
+	{
+		int			n = 0;
+		int			sent;
+
+		if (sock_of_if[s] != s)
+			continue;			/* socket shared with an earlier interface */
+
+		for (i = s; i < pool_config->num_hb_dest_if; i++)
+		{
+			WdHbIf	   *hb_if = &pool_config->hb_dest_if[i];
+			struct hostent *hp;
+
+			if (sock_of_if[i] != s)
+				continue;
+
+			if (!strlen(hb_if->addr))
+				continue;
+
+			hp = gethostbyname(hb_if->addr);
+			if ((hp == NULL) || (hp->h_addrtype != AF_INET))
+			{
+				ereport(WARNING,
+						(errmsg("failed to send watchdog heartbeat, gethostbyname() failed"),
+						 errdetail("gethostbyname on \"%s\" failed with reason: \"%s\"", hb_if->addr, hstrerror(h_errno))));
+				continue;
+			}
+
+			memset(&addrs[n], 0, sizeof(addrs[n]));
+			memmove((char *) &(addrs[n].sin_addr), (char *) hp->h_addr, hp->h_length);
+			addrs[n].sin_family = AF_INET;
+			addrs[n].sin_port = htons(hb_if->dest_port);
+
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_name = &addrs[n];
+			msgs[n].msg_hdr.msg_namelen = sizeof(addrs[n]);
+			msgs[n].msg_hdr.msg_iov = &iov;
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			dest_if[n] = i;
+			n++;
+		}
+
+		if (n == 0)
+			continue;
+
+		sent = sendmmsg(socks[s], msgs, n, 0);
+		if (sent < 0)
+			sent = 0;
+		for (i = 0; i < n; i++)
+		{
+			WdHbIf	   *hb_if = &pool_config->hb_dest_if[dest_if[i]];
+
+			if (i >= sent)
+				ereport(WARNING,
+						(errmsg("failed to send watchdog heartbeat, sendmmsg failed"),
+						 errdetail("sending packet to \"%s\" failed with reason: \"%m\"", hb_if->addr)));
+			else
+				ereport(DEBUG1,
+						(errmsg("watchdog heartbeat: send heartbeat signal to %s:%d", hb_if->addr, hb_if->dest_port)));
+		}
+	}
+}
+
+/*
+ * Read all heartbeat packets queued on the socket with recvmmsg(2).
+ */
+static void
+wd_hb_recv_all(int sock)
+{
+	struct mmsghdr msgs[WD_MAX_IF_NUM];
+	struct iovec iovs[WD_MAX_IF_NUM];
+	struct sockaddr_in senders[WD_MAX_IF_NUM];
+	WdHbPacket	bufs[WD_MAX_IF_NUM];
+
+	for (;;)
+	{
+		int			n,
+					i;
+
+		for (i = 0; i < WD_MAX_IF_NUM; i++)
+		{
+			iovs[i].iov_base = &bufs[i];
+			iovs[i].iov_len = sizeof(WdHbPacket);
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &senders[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = recvmmsg(sock, msgs, WD_MAX_IF_NUM, MSG_DONTWAIT, NULL);
+		if (n <= 0)
+		{
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				ereport(WARNING,
+						(errmsg("failed to receive heartbeat packet"),
+						 errdetail("recvmmsg failed with reason: \"%m\"")));
+			return;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			WdHbPacket	pkt;
+			char		from[WD_MAX_HOST_NAMELEN];
+
+			if (msgs[i].msg_len != sizeof(WdHbPacket))
+			{
+				ereport(LOG,
+						(errmsg("ignoring heartbeat packet of unexpected length %u", msgs[i].msg_len)));
+				continue;
+			}
+
+			strlcpy(from, inet_ntoa(senders[i].sin_addr), sizeof(from));
+			ntoh_wd_hb_packet(&pkt, &bufs[i]);
+
+			if (!wd_hb_authenticate(&pkt))
+			{
+				ereport(WARNING,
+						(errmsg("watchdog heartbeat receive"),
+						 errdetail("authentication failed for packet from \"%s\"", from)));
+				continue;
+			}
+			wd_hb_register_packet(&pkt, from);
+		}
+
+		if (n < WD_MAX_IF_NUM)
+			return;
+	}
+}
+
+/*
+ * fork the heartbeat child which sends to and receives from all heartbeat
+ * destinations, used with wd_heartbeat_single_process.  One socket is used
+ * for each distinct heartbeat_device.
+ */
+pid_t
+wd_hb_worker(int fork_wait_time)
+{
+	pid_t		pid = 0;
+	int			send_socks[WD_MAX_IF_NUM];
+	int			recv_socks[WD_MAX_IF_NUM];
+	int			sock_of_if[WD_MAX_IF_NUM];
+	struct pollfd pfds[WD_MAX_IF_NUM];
+	int			nrecv = 0;
+	struct timeval next_send;
+	sigjmp_buf	local_sigjmp_buf;
+	int			i,
+				j;
+
+	pid = fork();
+	if (pid != 0)
+	{
+		if (pid == -1)
+			ereport(PANIC,
+					(errmsg("failed to fork a heartbeat child")));
+		return pid;
+	}
+
+	on_exit_reset();
+	SetProcessGlobalVariables(PT_HB_SENDER);
+
+	if (fork_wait_time > 0)
+	{
+		sleep(fork_wait_time);
+	}
+
+	POOL_SETMASK(&UnBlockSig);
+
+	pool_signal(SIGTERM, hb_sender_exit);
+	pool_signal(SIGINT, hb_sender_exit);
+	pool_signal(SIGQUIT, hb_sender_exit);
+	pool_signal(SIGCHLD, SIG_DFL);
+	pool_signal(SIGHUP, SIG_IGN);
+	pool_signal(SIGUSR1, SIG_IGN);
+	pool_signal(SIGUSR2, SIG_IGN);
+	pool_signal(SIGPIPE, SIG_IGN);
+	pool_signal(SIGALRM, SIG_IGN);
+
+	init_ps_display("", "", "", "");
+	/* Create per loop iteration memory context */
+	ProcessLoopContext = AllocSetContextCreate(TopMemoryContext,
+											   "wdhb_worker",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	for (i = 0; i < pool_config->num_hb_dest_if; i++)
+	{
+		WdHbIf	   *hb_if = &pool_config->hb_dest_if[i];
+
+		for (j = 0; j < i; j++)
+		{
+			if (strcmp(pool_config->hb_dest_if[j].if_name, hb_if->if_name) == 0)
+				break;
+		}
+		sock_of_if[i] = j;
+		if (j < i)
+			continue;
+
+		send_socks[i] = wd_create_hb_send_socket(hb_if);
+		recv_socks[i] = wd_create_hb_recv_socket(hb_if);
+		pfds[nrecv].fd = recv_socks[i];
+		pfds[nrecv].events = POLLIN;
+		nrecv++;
+	}
+
+	set_ps_display("heartbeat", false);
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		/* Since not using PG_TRY, must reset error stack by hand */
+		error_context_stack = NULL;
+
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+	}
+
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	gettimeofday(&next_send, NULL);
+
+	for (;;)
+	{
+		struct timeval now;
+		long		timeout;
+
+		MemoryContextSwitchTo(ProcessLoopContext);
+		MemoryContextResetAndDeleteChildren(ProcessLoopContext);
+
+		gettimeofday(&now, NULL);
+		if (!WD_TIME_BEFORE(now, next_send))
+		{
+			wd_hb_send_all(send_socks, sock_of_if);
+			next_send = now;
+			next_send.tv_sec += pool_config->wd_heartbeat_keepalive;
+		}
+
+		timeout = (next_send.tv_sec - now.tv_sec) * 1000 +
+			(next_send.tv_usec - now.tv_usec) / 1000;
+		if (timeout < 0)
+			timeout = 0;
+
+		if (poll(pfds, nrecv, timeout) <= 0)
+			continue;
+
+		for (i = 0; i < nrecv; i++)
+		{
+			if (pfds[i].revents)
+				wd_hb_recv_all(pfds[i].fd);
+		}
+	}
+
+	return pid;
+}
+
 static RETSIGTYPE
 hb_sender_exit(int sig)
 {
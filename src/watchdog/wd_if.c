@@ -30,6 +30,7 @@
 #include <netdb.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <ctype.h>
 #include <errno.h>
 
@@ -65,6 +66,8 @@
 #endif
 
 static int	exec_if_cmd(char *path, char *command);
+static bool is_local_ip(char *ip);
+static long elapsed_msec(struct timeval *start);
 
 
 List *
@@ -99,6 +102,35 @@ get_all_local_ips(void)
 	return local_addresses;
 }
 
+/* true if the address is assigned to one of the local interfaces */
+static bool
+is_local_ip(char *ip)
+{
+	List	   *local_addresses = get_all_local_ips();
+	ListCell   *lc;
+	bool		found = false;
+
+	foreach(lc, local_addresses)
+	{
+		if (strcmp((char *) lfirst(lc), ip) == 0)
+		{
+			found = true;
+			break;
+		}
+	}
+	list_free_deep(local_addresses);
+	return found;
+}
+
+static long
+elapsed_msec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
 #define WD_TRY_PING_AT_IPUP 3
 int
 wd_IP_up(void)
@@ -107,6 +139,10 @@ wd_IP_up(void)
 	char		path[WD_MAX_PATH_LEN];
 	char	   *command;
 	int			i;
+	struct timeval step_time;
+	long		if_up_msec = 0;
+	long		arping_msec = 0;
+	long		verify_msec = 0;
 
 	if (strlen(pool_config->delegate_ip) == 0)
 	{
@@ -125,7 +161,9 @@ wd_IP_up(void)
 		else
 			snprintf(path, sizeof(path), "%s/%s", pool_config->if_cmd_path, command);
 
+		gettimeofday(&step_time, NULL);
 		rtn = exec_if_cmd(path, pool_config->if_up_cmd);
+		if_up_msec = elapsed_msec(&step_time);
 		pfree(command);
 	}
 	else
@@ -147,7 +185,9 @@ wd_IP_up(void)
 			else
 				snprintf(path, sizeof(path), "%s/%s", pool_config->arping_path, command);
 
+			gettimeofday(&step_time, NULL);
 			rtn = exec_if_cmd(path, pool_config->arping_cmd);
+			arping_msec = elapsed_msec(&step_time);
 			pfree(command);
 		}
 		else
@@ -161,19 +201,34 @@ wd_IP_up(void)
 
 	if (rtn == WD_OK)
 	{
-		for (i = 0; i < WD_TRY_PING_AT_IPUP; i++)
+		gettimeofday(&step_time, NULL);
+
+		/*
+		 * A ping to our own address only tells that it is configured on a
+		 * local interface, so look at the interfaces first and fall back to
+		 * ping only if the address is not found there.
+		 */
+		if (!is_local_ip(pool_config->delegate_ip))
 		{
-			if (wd_is_ip_exists(pool_config->delegate_ip) == true)
-				break;
-			ereport(LOG,
-					(errmsg("waiting for the delegate IP address to become active"),
-					 errdetail("waiting... count: %d", i + 1)));
-		}
+			for (i = 0; i < WD_TRY_PING_AT_IPUP; i++)
+			{
+				if (wd_is_ip_exists(pool_config->delegate_ip) == true)
+					break;
+				ereport(LOG,
+						(errmsg("waiting for the delegate IP address to become active"),
+						 errdetail("waiting... count: %d", i + 1)));
+			}
 
-		if (i >= WD_TRY_PING_AT_IPUP)
-			rtn = WD_NG;
+			if (i >= WD_TRY_PING_AT_IPUP)
+				rtn = WD_NG;
+		}
+		verify_msec = elapsed_msec(&step_time);
 	}
 
+	ereport(LOG,
+			(errmsg("delegate IP acquisition timing: if_up_cmd %ld ms, arping_cmd %ld ms, verification %ld ms",
+					if_up_msec, arping_msec, verify_msec)));
+
 	if (rtn == WD_OK)
 		ereport(LOG,
 				(errmsg("successfully acquired the delegate IP:\"%s\"", pool_config->delegate_ip),
@@ -191,6 +246,7 @@ wd_IP_down(void)
 	int			rtn = WD_OK;
 	char		path[WD_MAX_PATH_LEN];
 	char	   *command;
+	struct timeval step_time;
 
 	if (strlen(pool_config->delegate_ip) == 0)
 	{
@@ -208,7 +264,10 @@ wd_IP_down(void)
 		else
 			snprintf(path, sizeof(path), "%s/%s", pool_config->if_cmd_path, command);
 
+		gettimeofday(&step_time, NULL);
 		rtn = exec_if_cmd(path, pool_config->if_down_cmd);
+		ereport(LOG,
+				(errmsg("delegate IP release timing: if_down_cmd %ld ms", elapsed_msec(&step_time))));
 		pfree(command);
 	}
 	else
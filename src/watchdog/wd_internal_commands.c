@@ -65,6 +65,9 @@ bool	   		*watchdog_node_escalated = NULL; /* shared memory variable set to
 												  * performed escalation */
 unsigned int 	*ipc_shared_key = NULL;		/* key lives in shared memory used to
 											 * identify the ipc internal clients */
+WDSharedClusterState *wd_shared_cluster_state = NULL;	/* cluster state
+														 * published by the
+														 * watchdog process */
 
 static char *get_wd_failover_state_json(bool start);
 static WDFailoverCMDResults wd_get_failover_result_from_data(WDIPCCmdResult * result,
@@ -101,6 +104,13 @@ wd_ipc_initialize_data(void)
 		watchdog_node_escalated = pool_shared_memory_segment_get_chunk(sizeof(bool));
 		*watchdog_node_escalated = false;
 	}
+
+	if (wd_shared_cluster_state == NULL)
+	{
+		wd_shared_cluster_state = pool_shared_memory_segment_get_chunk(sizeof(WDSharedClusterState));
+		memset(wd_shared_cluster_state, 0, sizeof(WDSharedClusterState));
+		pool_atomic_init_u32(&wd_shared_cluster_state->seq, 0);
+	}
 }
 
 size_t wd_ipc_get_shared_mem_size(void)
@@ -109,6 +119,7 @@ size_t wd_ipc_get_shared_mem_size(void)
 	size += MAXALIGN(sizeof(unsigned int)); /* ipc_shared_key */
 	size += MAXALIGN(sizeof(bool)); /* watchdog_require_cleanup */
 	size += MAXALIGN(sizeof(bool)); /* watchdog_node_escalated */
+	size += MAXALIGN(sizeof(WDSharedClusterState)); /* wd_shared_cluster_state */
 	size += estimate_ipc_socket_addr_len();
 	return size;
 }
@@ -542,15 +553,110 @@ get_watchdog_node_escalation_state(void)
 	return *watchdog_node_escalated;
 }
 
+/*
+ * Publish the cluster state snapshot. Only the watchdog process calls this,
+ * so there is a single writer.
+ */
+void
+wd_publish_shared_cluster_state(WDSharedClusterState * state)
+{
+	uint32		seq;
+
+	if (wd_shared_cluster_state == NULL)
+		return;
+
+	seq = pool_atomic_read_u32(&wd_shared_cluster_state->seq);
+	pool_atomic_write_u32(&wd_shared_cluster_state->seq, seq + 1);
+	pool_write_barrier();
+
+	wd_shared_cluster_state->valid = true;
+	wd_shared_cluster_state->publish_time = time(NULL);
+	wd_shared_cluster_state->local_state = state->local_state;
+	wd_shared_cluster_state->quorum_status = state->quorum_status;
+	wd_shared_cluster_state->leader_node_id = state->leader_node_id;
+	wd_shared_cluster_state->escalated = state->escalated;
+	wd_shared_cluster_state->node_count = state->node_count;
+	memcpy(wd_shared_cluster_state->node_states, state->node_states,
+		   sizeof(WD_STATES) * state->node_count);
+
+	pool_write_barrier();
+	pool_atomic_write_u32(&wd_shared_cluster_state->seq, seq + 2);
+}
+
+/*
+ * Mark the snapshot invalid. Called by the main process when the watchdog
+ * process exits, so that readers go back to asking the new watchdog process.
+ */
+void
+wd_invalidate_shared_cluster_state(void)
+{
+	uint32		seq;
+
+	if (wd_shared_cluster_state == NULL)
+		return;
+
+	seq = pool_atomic_read_u32(&wd_shared_cluster_state->seq);
+	pool_atomic_write_u32(&wd_shared_cluster_state->seq, seq + 1);
+	pool_write_barrier();
+	wd_shared_cluster_state->valid = false;
+	pool_write_barrier();
+	pool_atomic_write_u32(&wd_shared_cluster_state->seq, seq + 2);
+}
+
+/*
+ * Copy the published cluster state into *state. Returns false if there is
+ * no usable snapshot: the watchdog has not published yet, it has died, or
+ * it has not refreshed the snapshot for WD_SHARED_STATE_MAX_AGE_SEC.
+ */
+bool
+wd_get_shared_cluster_state(WDSharedClusterState * state)
+{
+	if (wd_shared_cluster_state == NULL)
+		return false;
+
+	for (;;)
+	{
+		uint32		seq_before;
+		uint32		seq_after;
+
+		seq_before = pool_atomic_read_u32(&wd_shared_cluster_state->seq);
+		if (seq_before & 1)
+		{
+			pool_spin_delay();
+			continue;
+		}
+		pool_read_barrier();
+		memcpy(state, wd_shared_cluster_state, sizeof(WDSharedClusterState));
+		pool_read_barrier();
+		seq_after = pool_atomic_read_u32(&wd_shared_cluster_state->seq);
+		if (seq_before == seq_after)
+			break;
+	}
+
+	if (!state->valid)
+		return false;
+	if (time(NULL) - state->publish_time > WD_SHARED_STATE_MAX_AGE_SEC)
+		return false;
+	return true;
+}
+
 int
 wd_internal_get_watchdog_quorum_state(void)
 {
+	WDSharedClusterState state;
+
+	if (wd_get_shared_cluster_state(&state))
+		return state.quorum_status;
 	return get_watchdog_quorum_state(pool_config->wd_authkey);
 }
 
 WD_STATES
 wd_internal_get_watchdog_local_node_state(void)
 {
+	WDSharedClusterState state;
+
+	if (wd_get_shared_cluster_state(&state))
+		return state.local_state;
 	return get_watchdog_local_node_state(pool_config->wd_authkey);
 }
 
@@ -22,6 +22,7 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
 
 #include "utils/elog.h"
 #include "utils/json_writer.h"
@@ -367,17 +368,28 @@ parse_data_request_json(char *json_data, int data_len, char **request_type)
 
 /* The function reads the backend node status from shared memory
  * and creates a json packet from it
+ *
+ * The packet also carries a sequence number that is bumped whenever the
+ * reported status differs from the one sent last time, together with the
+ * node's startup time as the epoch of that sequence.  Standby nodes use them
+ * to apply only what changed since their previous sync.
  */
 char *
 get_backend_node_status_json(WatchdogNode * wdNode)
 {
+	static BACKEND_STATUS last_status[MAX_NUM_BACKENDS];
+	static int	last_num_backends = -1;
+	static int	last_primary_node_id = -1;
+	static int	status_seq = 0;
+	BACKEND_STATUS cur_status[MAX_NUM_BACKENDS];
+	int			num_backends = pool_config->backend_desc->num_backends;
 	int			i;
 	char	   *json_str;
 	JsonNode   *jNode = jw_create_with_object(true);
 
 	jw_start_array(jNode, "BackendNodeStatusList");
 
-	for (i = 0; i < pool_config->backend_desc->num_backends; i++)
+	for (i = 0; i < num_backends; i++)
 	{
 		BACKEND_STATUS backend_status = pool_config->backend_desc->backend_info[i].backend_status;
 
@@ -389,12 +401,26 @@ get_backend_node_status_json(WatchdogNode * wdNode)
 			 */
 			backend_status = CON_CONNECT_WAIT;
 		}
+		cur_status[i] = backend_status;
 		jw_put_int_value(jNode, backend_status);
 	}
+
+	if (num_backends != last_num_backends ||
+		Req_info->primary_node_id != last_primary_node_id ||
+		memcmp(cur_status, last_status, sizeof(BACKEND_STATUS) * num_backends) != 0)
+	{
+		memcpy(last_status, cur_status, sizeof(BACKEND_STATUS) * num_backends);
+		last_num_backends = num_backends;
+		last_primary_node_id = Req_info->primary_node_id;
+		status_seq++;
+	}
+
 	/* put the primary node id */
 	jw_end_element(jNode);
 	jw_put_int(jNode, "PrimaryNodeId", Req_info->primary_node_id);
 	jw_put_string(jNode, "NodeName", wdNode->nodeName);
+	jw_put_long(jNode, "StatusEpoch", (long) wdNode->startup_time.tv_sec);
+	jw_put_int(jNode, "StatusSeq", status_seq);
 
 	jw_finish_document(jNode);
 	json_str = pstrdup(jw_get_json_string(jNode));
@@ -449,6 +475,12 @@ get_pg_backend_node_status_from_json(char *json_data, int data_len)
 		backendStatus->nodeName[0] = 0;
 	}
 
+	/* sent only by the nodes supporting incremental sync */
+	if (json_get_long_value_for_key(root, "StatusEpoch", &backendStatus->status_epoch))
+		backendStatus->status_epoch = 0;
+	if (json_get_int_value_for_key(root, "StatusSeq", &backendStatus->status_seq))
+		backendStatus->status_seq = 0;
+
 	return backendStatus;
 }
 
@@ -480,6 +512,161 @@ get_beacon_message_json(WatchdogNode * wdNode)
 	return json_str;
 }
 
+static char *
+put_binary_int32(char *ptr, int32 val)
+{
+	uint32		nval = htonl((uint32) val);
+
+	memcpy(ptr, &nval, sizeof(nval));
+	return ptr + sizeof(nval);
+}
+
+static char *
+put_binary_int64(char *ptr, int64 val)
+{
+	ptr = put_binary_int32(ptr, (int32) ((uint64) val >> 32));
+	return put_binary_int32(ptr, (int32) ((uint64) val & 0xFFFFFFFF));
+}
+
+static char *
+get_binary_int32(char *ptr, int32 *val)
+{
+	uint32		nval;
+
+	memcpy(&nval, ptr, sizeof(nval));
+	*val = (int32) ntohl(nval);
+	return ptr + sizeof(nval);
+}
+
+static char *
+get_binary_int64(char *ptr, int64 *val)
+{
+	int32		hi,
+				lo;
+
+	ptr = get_binary_int32(ptr, &hi);
+	ptr = get_binary_int32(ptr, &lo);
+	*val = (int64) (((uint64) (uint32) hi << 32) | (uint32) lo);
+	return ptr;
+}
+
+/*
+ * Binary counterpart of get_beacon_message_json().  The layout is, in
+ * network byte order: magic (1 byte), format version (1 byte), escalated
+ * (1 byte), state, quorum status and alive node count (int32 each), seconds
+ * since startup and seconds since current state (int64 each).
+ */
+char *
+get_beacon_message_binary(WatchdogNode * wdNode, int *len)
+{
+	char	   *data;
+	char	   *ptr;
+	struct timeval current_time;
+
+	gettimeofday(&current_time, NULL);
+
+	data = palloc(WD_BINARY_BEACON_LEN);
+	ptr = data;
+	*ptr++ = (char) WD_BINARY_BEACON_MAGIC;
+	*ptr++ = (char) WD_BINARY_BEACON_VERSION;
+	*ptr++ = wdNode->escalated ? 1 : 0;
+	ptr = put_binary_int32(ptr, wdNode->state);
+	ptr = put_binary_int32(ptr, wdNode->quorum_status);
+	ptr = put_binary_int32(ptr, wdNode->standby_nodes_count);
+	ptr = put_binary_int64(ptr, WD_TIME_DIFF_SEC(current_time, wdNode->startup_time));
+	ptr = put_binary_int64(ptr, WD_TIME_DIFF_SEC(current_time, wdNode->current_state_time));
+
+	*len = ptr - data;
+	return data;
+}
+
+bool
+parse_beacon_message_binary(char *data, int data_len,
+							int *state,
+							long *seconds_since_node_startup,
+							long *seconds_since_current_state,
+							int *quorumStatus,
+							int *standbyNodesCount,
+							bool *escalated)
+{
+	char	   *ptr = data;
+	int32		val;
+	int64		lval;
+
+	if (data_len < WD_BINARY_BEACON_LEN || !WD_IS_BINARY_BEACON(data, data_len))
+		return false;
+	ptr++;
+	/* newer format versions only append fields */
+	if ((unsigned char) *ptr++ < WD_BINARY_BEACON_VERSION)
+		return false;
+	*escalated = *ptr++ ? true : false;
+	ptr = get_binary_int32(ptr, &val);
+	*state = val;
+	ptr = get_binary_int32(ptr, &val);
+	*quorumStatus = val;
+	ptr = get_binary_int32(ptr, &val);
+	*standbyNodesCount = val;
+	ptr = get_binary_int64(ptr, &lval);
+	*seconds_since_node_startup = (long) lval;
+	ptr = get_binary_int64(ptr, &lval);
+	*seconds_since_current_state = (long) lval;
+
+	return true;
+}
+
+/*
+ * Build the data of WD_QUERY_CACHE_INVALIDATION message.  The layout is, in
+ * network byte order: clear all flag (1 byte), number of tables (int32) and
+ * the pairs of database oid and table oid (int32 each).
+ */
+char *
+get_query_cache_invalidation_binary(bool clear_all, int num, int *dboids, int *tableoids, int *len)
+{
+	char	   *data;
+	char	   *ptr;
+	int			i;
+
+	data = palloc(1 + sizeof(int32) * (1 + num * 2));
+	ptr = data;
+	*ptr++ = clear_all ? 1 : 0;
+	ptr = put_binary_int32(ptr, num);
+	for (i = 0; i < num; i++)
+	{
+		ptr = put_binary_int32(ptr, dboids[i]);
+		ptr = put_binary_int32(ptr, tableoids[i]);
+	}
+
+	*len = ptr - data;
+	return data;
+}
+
+bool
+parse_query_cache_invalidation_binary(char *data, int data_len, bool *clear_all,
+									  int *num, int **dboids, int **tableoids)
+{
+	char	   *ptr = data;
+	int32		val;
+	int			i;
+
+	if (data == NULL || data_len < 1 + sizeof(int32))
+		return false;
+	*clear_all = *ptr++ ? true : false;
+	ptr = get_binary_int32(ptr, &val);
+	if (val < 0 || (data_len - 1 - sizeof(int32)) / (sizeof(int32) * 2) < val)
+		return false;
+
+	*num = val;
+	*dboids = palloc(sizeof(int) * (val + 1));
+	*tableoids = palloc(sizeof(int) * (val + 1));
+	for (i = 0; i < val; i++)
+	{
+		ptr = get_binary_int32(ptr, &(*dboids)[i]);
+		ptr = get_binary_int32(ptr, &(*tableoids)[i]);
+	}
+
+	return true;
+}
+
 char *
 get_watchdog_node_info_json(WatchdogNode * wdNode, char *authkey)
 {
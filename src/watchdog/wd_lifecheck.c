@@ -20,7 +20,6 @@
  * is" without express or implied warranty.
  *
  */
-#include <pthread.h>
 #include <stdio.h>
 #include <errno.h>
 #include <ctype.h>
@@ -29,6 +28,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
 #include "pool.h"
@@ -58,14 +59,28 @@
 											 * process through IPC channel */
 
 /*
- * thread argument for lifecheck of pgpool
+ * State of the lifecheck query to one pgpool.  All the nodes are checked
+ * concurrently from one poll() loop using non-blocking libpq calls.
  */
+typedef enum
+{
+	LC_PING_DONE = 0,
+	LC_PING_CONNECTING,
+	LC_PING_QUERYING
+}			LifeCheckPingState;
+
 typedef struct
 {
-	LifeCheckNode *lifeCheckNode;
-	int			retry;			/* retry times (not used?) */
-	char		*password;
-}			WdPgpoolThreadArg;
+	PGconn	   *conn;			/* kept across rounds with
+								 * wd_lifecheck_persistent_connection */
+	LifeCheckPingState state;
+	PostgresPollingStatusType poll_status;	/* last PQconnectPoll() result */
+	bool		reused;			/* conn was opened in an earlier round */
+	bool		query_failed;	/* lifecheck query returned an error */
+	int			result;			/* WD_OK or WD_NG */
+}			LifeCheckPing;
+
+static LifeCheckPing lifecheck_pings[MAX_WATCHDOG_NUM];
 
 typedef struct WdUpstreamConnectionData
 {
@@ -79,10 +94,15 @@ List	   *g_trusted_server_list = NIL;
 
 static void wd_initialize_trusted_servers_list(void);
 static bool wd_ping_all_server(void);
+static int	wd_icmp_ping_all_server(void);
 static WdUpstreamConnectionData * wd_get_server_from_pid(pid_t pid);
 
-static void *thread_ping_pgpool(void *arg);
+static bool build_conninfo(char *conninfo, size_t len, char *hostname, int port, char *password);
 static PGconn *create_conn(char *hostname, int port, char *password);
+static void lifecheck_ping_start(LifeCheckPing * ping, LifeCheckNode * node, char *password, bool fresh);
+static void lifecheck_ping_fail(LifeCheckPing * ping, LifeCheckNode * node, char *password);
+static void lifecheck_ping_advance(LifeCheckPing * ping, LifeCheckNode * node, char *password);
+static void ping_all_pgpools(char *password);
 
 static pid_t lifecheck_main(void);
 static void check_pgpool_status(void);
@@ -138,7 +158,8 @@ lifecheck_child_name(pid_t pid)
 		if (g_hb_receiver_pid && pid == g_hb_receiver_pid[i])
 			return "heartBeat receiver";
 		else if (g_hb_sender_pid && pid == g_hb_sender_pid[i])
-			return "heartBeat sender";
+			return pool_config->wd_heartbeat_single_process ?
+				"heartBeat worker" : "heartBeat sender";
 	}
 	/* Check if it was a ping to trusted server process */
 	WdUpstreamConnectionData *server = wd_get_server_from_pid(pid);
@@ -231,7 +252,10 @@ wd_reaper_lifecheck(pid_t pid, int status)
 		{
 			if (restart_child)
 			{
-				g_hb_sender_pid[i] = wd_hb_sender(1, &(pool_config->hb_dest_if[i]));
+				if (pool_config->wd_heartbeat_single_process)
+					g_hb_sender_pid[i] = wd_hb_worker(1);
+				else
+					g_hb_sender_pid[i] = wd_hb_sender(1, &(pool_config->hb_dest_if[i]));
 				ereport(LOG,
 						(errmsg("fork a new %s process with pid: %d", proc_name, g_hb_sender_pid[i])));
 			}
@@ -471,6 +495,17 @@ spawn_lifecheck_children(void)
 		g_hb_receiver_pid = palloc0(sizeof(pid_t) * pool_config->num_hb_dest_if);
 		g_hb_sender_pid = palloc0(sizeof(pid_t) * pool_config->num_hb_dest_if);
 
+		/*
+		 * With wd_heartbeat_single_process one process serves all the
+		 * heartbeat destinations.  Its pid is kept in the first sender slot.
+		 */
+		if (pool_config->wd_heartbeat_single_process)
+		{
+			if (pool_config->num_hb_dest_if > 0)
+				g_hb_sender_pid[0] = wd_hb_worker(1);
+			return;
+		}
+
 		for (i = 0; i < pool_config->num_hb_dest_if; i++)
 		{
 			/* heartbeat receiver process */
@@ -811,36 +846,13 @@ check_pgpool_status_by_hb(void)
 static void
 check_pgpool_status_by_query(void)
 {
-	pthread_attr_t attr;
-	pthread_t	thread[MAX_WATCHDOG_NUM];
-	WdPgpoolThreadArg thread_arg[MAX_WATCHDOG_NUM];
 	LifeCheckNode *node;
-	int			rc,
-				i;
+	int			i;
 	char	   *password = get_pgpool_config_user_password(pool_config->wd_lifecheck_user,
 														   pool_config->wd_lifecheck_password);
 
-	/* thread init */
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
-	/* send queries to all pgpools using threads */
-	for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
-	{
-		node = &gslifeCheckCluster->lifeCheckNodes[i];
-		thread_arg[i].lifeCheckNode = node;
-		thread_arg[i].password = password;
-		rc = watchdog_thread_create(&thread[i], &attr, thread_ping_pgpool, (void *) &thread_arg[i]);
-		if (rc)
-		{
-			ereport(WARNING,
-					(errmsg("failed to create thread for checking pgpool status by query for  %d (%s:%d)",
-							i, node->hostName, node->pgpoolPort),
-					 errdetail("pthread_create failed with error code %d: %s",rc, strerror(rc))));
-		}
-	}
-
-	pthread_attr_destroy(&attr);
+	/* send queries to all pgpools at once */
+	ping_all_pgpools(password);
 
 	/* check results of queries */
 	for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
@@ -848,19 +860,13 @@ check_pgpool_status_by_query(void)
 		int			result;
 
 		node = &gslifeCheckCluster->lifeCheckNodes[i];
+		result = lifecheck_pings[i].result;
 
 		ereport(DEBUG1,
 				(errmsg("checking pgpool status by query"),
 				 errdetail("checking pgpool %d (%s:%d)",
 						   i, node->hostName, node->pgpoolPort)));
 
-		rc = pthread_join(thread[i], (void **) &result);
-		if ((rc != 0) && (errno == EINTR))
-		{
-			usleep(100);
-			continue;
-		}
-
 		if (result == WD_OK)
 		{
 			ereport(DEBUG1,
@@ -905,44 +911,259 @@ check_pgpool_status_by_query(void)
 }
 
 /*
- * Thread function to send lifecheck query to pgpool
- * Used in wd_lifecheck.
+ * Start the lifecheck query to one pgpool.  An open connection from the
+ * previous round is reused unless "fresh" is true.
  */
-static void *
-thread_ping_pgpool(void *arg)
+static void
+lifecheck_ping_start(LifeCheckPing * ping, LifeCheckNode * node, char *password, bool fresh)
 {
-	uintptr_t	rtn;
-	WdPgpoolThreadArg *thread_arg = (WdPgpoolThreadArg *) arg;
-	rtn = (uintptr_t) wd_ping_pgpool(thread_arg->lifeCheckNode,thread_arg->password);
+	char		conninfo[1024];
 
-	pthread_exit((void *) rtn);
+	ping->result = WD_NG;
+	ping->query_failed = false;
+
+	if (ping->conn && !fresh && PQstatus(ping->conn) == CONNECTION_OK)
+	{
+		if (PQsendQuery(ping->conn, pool_config->wd_lifecheck_query))
+		{
+			ping->reused = true;
+			ping->state = LC_PING_QUERYING;
+			return;
+		}
+	}
+
+	if (ping->conn)
+	{
+		PQfinish(ping->conn);
+		ping->conn = NULL;
+	}
+	ping->reused = false;
+	ping->state = LC_PING_DONE;
+
+	if (!build_conninfo(conninfo, sizeof(conninfo), node->hostName, node->pgpoolPort, password))
+		return;
+
+	ping->conn = PQconnectStart(conninfo);
+	if (ping->conn == NULL || PQstatus(ping->conn) == CONNECTION_BAD)
+	{
+		ereport(DEBUG1,
+				(errmsg("watchdog life checking"),
+				 errdetail("Connection to database failed: %s",
+						   ping->conn ? PQerrorMessage(ping->conn) : "out of memory")));
+		if (ping->conn)
+			PQfinish(ping->conn);
+		ping->conn = NULL;
+		return;
+	}
+	ping->poll_status = PGRES_POLLING_WRITING;
+	ping->state = LC_PING_CONNECTING;
 }
 
 /*
- * Create connection to pgpool
+ * The lifecheck query to one pgpool failed.  If it went over a connection
+ * kept from an earlier round, the pgpool may just have been restarted, so
+ * retry once with a new connection before reporting the failure.
  */
-static PGconn *
-create_conn(char *hostname, int port, char *password)
+static void
+lifecheck_ping_fail(LifeCheckPing * ping, LifeCheckNode * node, char *password)
 {
-	static char conninfo[1024];
-	PGconn	   *conn;
+	if (ping->reused)
+	{
+		lifecheck_ping_start(ping, node, password, true);
+		return;
+	}
+	if (ping->conn)
+	{
+		ereport(DEBUG1,
+				(errmsg("watchdog life checking"),
+				 errdetail("lifecheck query to \"%s:%d\" failed: %s",
+						   node->hostName, node->pgpoolPort, PQerrorMessage(ping->conn))));
+		PQfinish(ping->conn);
+		ping->conn = NULL;
+	}
+	ping->result = WD_NG;
+	ping->state = LC_PING_DONE;
+}
+
+/* process the socket event of one lifecheck query */
+static void
+lifecheck_ping_advance(LifeCheckPing * ping, LifeCheckNode * node, char *password)
+{
+	if (ping->state == LC_PING_CONNECTING)
+	{
+		ping->poll_status = PQconnectPoll(ping->conn);
+		if (ping->poll_status == PGRES_POLLING_FAILED)
+		{
+			lifecheck_ping_fail(ping, node, password);
+		}
+		else if (ping->poll_status == PGRES_POLLING_OK)
+		{
+			if (PQsendQuery(ping->conn, pool_config->wd_lifecheck_query))
+				ping->state = LC_PING_QUERYING;
+			else
+				lifecheck_ping_fail(ping, node, password);
+		}
+		return;
+	}
+
+	if (ping->state != LC_PING_QUERYING)
+		return;
+
+	if (!PQconsumeInput(ping->conn))
+	{
+		lifecheck_ping_fail(ping, node, password);
+		return;
+	}
 
+	while (!PQisBusy(ping->conn))
+	{
+		PGresult   *res = PQgetResult(ping->conn);
+
+		if (res == NULL)
+		{
+			/* all results of the query are in */
+			if (ping->query_failed || PQstatus(ping->conn) != CONNECTION_OK)
+			{
+				lifecheck_ping_fail(ping, node, password);
+				return;
+			}
+			ping->result = WD_OK;
+			ping->state = LC_PING_DONE;
+			if (!pool_config->wd_lifecheck_persistent_connection)
+			{
+				PQfinish(ping->conn);
+				ping->conn = NULL;
+			}
+			return;
+		}
+
+		if (PQresultStatus(res) == PGRES_NONFATAL_ERROR ||
+			PQresultStatus(res) == PGRES_FATAL_ERROR)
+			ping->query_failed = true;
+		PQclear(res);
+	}
+}
 
+/*
+ * Send the lifecheck query to all pgpools concurrently and wait for the
+ * answers for up to wd_interval / 2 + 1 seconds, the same time the
+ * connection attempts were allowed before.  The result for each node is
+ * left in lifecheck_pings[].result.
+ */
+static void
+ping_all_pgpools(char *password)
+{
+	struct pollfd pfds[MAX_WATCHDOG_NUM];
+	int			ping_of_pfd[MAX_WATCHDOG_NUM];
+	struct timeval deadline;
+	int			i;
+
+	gettimeofday(&deadline, NULL);
+	deadline.tv_sec += pool_config->wd_interval / 2 + 1;
+
+	for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
+		lifecheck_ping_start(&lifecheck_pings[i], &gslifeCheckCluster->lifeCheckNodes[i], password, false);
+
+	for (;;)
+	{
+		struct timeval now;
+		long		timeout;
+		int			nfds = 0;
+		int			rc;
+
+		for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
+		{
+			LifeCheckPing *ping = &lifecheck_pings[i];
+			int			sock;
+
+			if (ping->state == LC_PING_DONE)
+				continue;
+
+			sock = PQsocket(ping->conn);
+			if (sock < 0)
+			{
+				lifecheck_ping_fail(ping, &gslifeCheckCluster->lifeCheckNodes[i], password);
+				if (ping->state == LC_PING_DONE)
+					continue;
+				sock = PQsocket(ping->conn);
+				if (sock < 0)
+					continue;
+			}
+			pfds[nfds].fd = sock;
+			if (ping->state == LC_PING_CONNECTING && ping->poll_status == PGRES_POLLING_WRITING)
+				pfds[nfds].events = POLLOUT;
+			else
+				pfds[nfds].events = POLLIN;
+			pfds[nfds].revents = 0;
+			ping_of_pfd[nfds] = i;
+			nfds++;
+		}
+
+		if (nfds == 0)
+			break;
+
+		gettimeofday(&now, NULL);
+		timeout = (deadline.tv_sec - now.tv_sec) * 1000 +
+			(deadline.tv_usec - now.tv_usec) / 1000;
+		if (timeout <= 0)
+			break;
+
+		rc = poll(pfds, nfds, timeout);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(WARNING,
+					(errmsg("watchdog life checking, poll() failed"),
+					 errdetail("%m")));
+			break;
+		}
+
+		for (i = 0; i < nfds; i++)
+		{
+			if (pfds[i].revents)
+				lifecheck_ping_advance(&lifecheck_pings[ping_of_pfd[i]],
+									   &gslifeCheckCluster->lifeCheckNodes[ping_of_pfd[i]],
+									   password);
+		}
+	}
+
+	/* whatever has not finished in time has failed */
+	for (i = 0; i < gslifeCheckCluster->nodeCount; i++)
+	{
+		LifeCheckPing *ping = &lifecheck_pings[i];
+
+		if (ping->state != LC_PING_DONE)
+		{
+			PQfinish(ping->conn);
+			ping->conn = NULL;
+			ping->state = LC_PING_DONE;
+			ping->result = WD_NG;
+		}
+	}
+}
+
+/*
+ * Build the connection string for the lifecheck connection to pgpool.
+ */
+static bool
+build_conninfo(char *conninfo, size_t len, char *hostname, int port, char *password)
+{
 	if (strlen(pool_config->wd_lifecheck_dbname) == 0)
 	{
 		ereport(WARNING,
 				(errmsg("watchdog life checking, wd_lifecheck_dbname is empty")));
-		return NULL;
+		return false;
 	}
 
 	if (strlen(pool_config->wd_lifecheck_user) == 0)
 	{
 		ereport(WARNING,
 				(errmsg("watchdog life checking, wd_lifecheck_user is empty")));
-		return NULL;
+		return false;
 	}
 
-	snprintf(conninfo, sizeof(conninfo),
+	snprintf(conninfo, len,
 			 "host='%s' port='%d' dbname='%s' user='%s' password='%s' connect_timeout='%d'",
 			 hostname,
 			 port,
@@ -950,6 +1171,21 @@ create_conn(char *hostname, int port, char *password)
 			 pool_config->wd_lifecheck_user,
 			 password ? password : "",
 			 pool_config->wd_interval / 2 + 1);
+	return true;
+}
+
+/*
+ * Create connection to pgpool
+ */
+static PGconn *
+create_conn(char *hostname, int port, char *password)
+{
+	char		conninfo[1024];
+	PGconn	   *conn;
+
+	if (!build_conninfo(conninfo, sizeof(conninfo), hostname, port, password))
+		return NULL;
+
 	conn = PQconnectdb(conninfo);
 
 	if (PQstatus(conn) != CONNECTION_OK)
@@ -1101,6 +1337,60 @@ wd_initialize_trusted_servers_list(void)
 	MemoryContextSwitchTo(oldCxt);
 }
 
+/*
+ * Check the trusted servers with ICMP echo requests sent from this process.
+ * Returns -1 if ICMP sockets can not be used here, in which case
+ * trusted_server_command is used from then on.
+ */
+static int
+wd_icmp_ping_all_server(void)
+{
+	static bool icmp_unavailable = false;
+	char	  **hosts;
+	bool	   *reachable;
+	ListCell   *lc;
+	int			count = list_length(g_trusted_server_list);
+	int			nreachable;
+	int			i = 0;
+
+	if (icmp_unavailable)
+		return -1;
+
+	hosts = palloc(sizeof(char *) * count);
+	reachable = palloc(sizeof(bool) * count);
+	foreach(lc, g_trusted_server_list)
+	{
+		WdUpstreamConnectionData *server = (WdUpstreamConnectionData *) lfirst(lc);
+
+		hosts[i++] = server->hostname;
+	}
+
+	nreachable = wd_icmp_ping_hosts(hosts, count, reachable, true);
+	if (nreachable < 0)
+	{
+		ereport(WARNING,
+				(errmsg("ICMP sockets are not available for checking trusted servers"),
+				 errdetail("using trusted_server_command instead")));
+		icmp_unavailable = true;
+	}
+	else
+	{
+		i = 0;
+		foreach(lc, g_trusted_server_list)
+		{
+			WdUpstreamConnectionData *server = (WdUpstreamConnectionData *) lfirst(lc);
+
+			server->reachable = reachable[i++];
+		}
+		if (nreachable == 0)
+			ereport(WARNING,
+					(errmsg("watchdog failed to ping any of the trusted servers")));
+	}
+	pfree(hosts);
+	pfree(reachable);
+	return nreachable;
+}
+
 static bool
 wd_ping_all_server(void)
 {
@@ -1109,6 +1399,14 @@ wd_ping_all_server(void)
 	int			status;
 	int			ping_process = 0;
 
+	if (pool_config->trusted_server_use_icmp)
+	{
+		int			nreachable = wd_icmp_ping_all_server();
+
+		if (nreachable >= 0)
+			return nreachable > 0;
+	}
+
 	POOL_SETMASK(&BlockSig);
 
 	foreach(lc, g_trusted_server_list)
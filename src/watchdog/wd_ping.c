@@ -31,6 +31,13 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <arpa/inet.h>
+#include <poll.h>
 #include <fcntl.h>
 #include "pool.h"
 #include "utils/elog.h"
@@ -40,7 +47,14 @@
 
 #define WD_MAX_PING_RESULT 256
 
+#define WD_ICMP_PING_COUNT			3	/* echo requests sent to each host */
+#define WD_ICMP_PING_INTERVAL_MSEC	500 /* wait between two rounds of echo
+										 * requests */
+#define WD_ICMP_PACKET_LEN			(sizeof(struct icmphdr) + 16)
+
 static double get_result(char *ping_data);
+static int	wd_open_icmp_socket(bool *raw);
+static uint16 wd_icmp_checksum(void *buf, int len);
 
 /**
  * check if IP address can be pinged.
@@ -360,3 +374,206 @@ get_result(char *ping_data)
 
 	return msec;
 }
+
+/*
+ * Open a socket for sending ICMP echo requests.  An unprivileged ICMP
+ * datagram socket is tried first (allowed by net.ipv4.ping_group_range on
+ * Linux), then a raw socket.  *raw is set to true if a raw socket was
+ * opened.  Returns -1 if neither is allowed.
+ */
+static int
+wd_open_icmp_socket(bool *raw)
+{
+	int			sock;
+
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+	if (sock >= 0)
+	{
+		*raw = false;
+		return sock;
+	}
+	sock = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+	if (sock >= 0)
+	{
+		*raw = true;
+		return sock;
+	}
+	ereport(WARNING,
+			(errmsg("watchdog failed to create ICMP socket"),
+			 errdetail("socket() failed with reason: \"%m\"")));
+	return -1;
+}
+
+static uint16
+wd_icmp_checksum(void *buf, int len)
+{
+	uint16	   *p = buf;
+	uint32		sum = 0;
+
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	if (len == 1)
+		sum += *(unsigned char *) p;
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	return (uint16) ~sum;
+}
+
+/*
+ * Ping the given IPv4 hosts concurrently with ICMP echo requests from
+ * this process, without forking the ping command.  Up to
+ * WD_ICMP_PING_COUNT requests are sent to each host, WD_ICMP_PING_INTERVAL_MSEC
+ * apart, and reachable[i] is set to true for every host that answered.
+ * If stop_at_first is true, the function returns as soon as one host
+ * answered.
+ *
+ * Returns the number of reachable hosts, or -1 if no ICMP socket could be
+ * opened, in which case the caller should fall back to the ping command.
+ */
+int
+wd_icmp_ping_hosts(char **hosts, int count, bool *reachable, bool stop_at_first)
+{
+	struct sockaddr_in *addrs;
+	bool	   *resolved;
+	bool		raw;
+	uint16		ident = (uint16) (getpid() & 0xffff);
+	int			nreachable = 0;
+	int			attempt;
+	int			sock;
+	int			i;
+
+	if (count <= 0)
+		return 0;
+
+	sock = wd_open_icmp_socket(&raw);
+	if (sock < 0)
+		return -1;
+
+	addrs = palloc0(sizeof(struct sockaddr_in) * count);
+	resolved = palloc0(sizeof(bool) * count);
+
+	for (i = 0; i < count; i++)
+	{
+		struct addrinfo hints;
+		struct addrinfo *res = NULL;
+		int			ret;
+
+		reachable[i] = false;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		ret = getaddrinfo(hosts[i], NULL, &hints, &res);
+		if (ret != 0 || res == NULL)
+		{
+			ereport(WARNING,
+					(errmsg("watchdog failed to ping host \"%s\"", hosts[i]),
+					 errdetail("getaddrinfo() failed with error \"%s\"", gai_strerror(ret))));
+			if (res)
+				freeaddrinfo(res);
+			continue;
+		}
+		memcpy(&addrs[i], res->ai_addr, sizeof(struct sockaddr_in));
+		resolved[i] = true;
+		freeaddrinfo(res);
+	}
+
+	for (attempt = 0; attempt < WD_ICMP_PING_COUNT; attempt++)
+	{
+		struct timeval deadline;
+
+		/* send one echo request to each host that has not answered yet */
+		for (i = 0; i < count; i++)
+		{
+			char		packet[WD_ICMP_PACKET_LEN];
+			struct icmphdr *icmp = (struct icmphdr *) packet;
+
+			if (!resolved[i] || reachable[i])
+				continue;
+
+			memset(packet, 0, sizeof(packet));
+			icmp->type = ICMP_ECHO;
+			icmp->code = 0;
+			icmp->un.echo.id = htons(ident);
+			icmp->un.echo.sequence = htons((uint16) (attempt * count + i));
+			icmp->checksum = wd_icmp_checksum(packet, sizeof(packet));
+
+			if (sendto(sock, packet, sizeof(packet), 0,
+					   (struct sockaddr *) &addrs[i], sizeof(addrs[i])) < 0)
+				ereport(DEBUG1,
+						(errmsg("watchdog failed to send ICMP echo request to \"%s\"", hosts[i]),
+						 errdetail("sendto() failed with reason: \"%m\"")));
+		}
+
+		gettimeofday(&deadline, NULL);
+		deadline.tv_usec += WD_ICMP_PING_INTERVAL_MSEC * 1000;
+		deadline.tv_sec += deadline.tv_usec / 1000000;
+		deadline.tv_usec %= 1000000;
+
+		/* collect the replies until the next round is due */
+		for (;;)
+		{
+			struct pollfd pfd;
+			struct timeval now;
+			struct sockaddr_in from;
+			socklen_t	fromlen = sizeof(from);
+			char		buf[1024];
+			struct icmphdr *icmp;
+			long		timeout;
+			ssize_t		len;
+			int			hlen = 0;
+			int			seq;
+
+			gettimeofday(&now, NULL);
+			timeout = (deadline.tv_sec - now.tv_sec) * 1000 +
+				(deadline.tv_usec - now.tv_usec) / 1000;
+			if (timeout <= 0)
+				break;
+
+			pfd.fd = sock;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, timeout) <= 0)
+				continue;		/* timeout is handled at the loop top */
+
+			len = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT,
+						   (struct sockaddr *) &from, &fromlen);
+			if (len <= 0)
+				continue;
+
+			/* raw sockets deliver the IP header as well */
+			if (raw)
+			{
+				struct ip  *iph = (struct ip *) buf;
+
+				hlen = iph->ip_hl << 2;
+			}
+			if (len < hlen + (ssize_t) sizeof(struct icmphdr))
+				continue;
+
+			icmp = (struct icmphdr *) (buf + hlen);
+			if (icmp->type != ICMP_ECHOREPLY)
+				continue;
+
+			/* the kernel picks the identifier of datagram ICMP sockets */
+			if (raw && ntohs(icmp->un.echo.id) != ident)
+				continue;
+
+			seq = ntohs(icmp->un.echo.sequence) % count;
+			if (!resolved[seq] || reachable[seq] ||
+				from.sin_addr.s_addr != addrs[seq].sin_addr.s_addr)
+				continue;
+
+			reachable[seq] = true;
+			nreachable++;
+			ereport(DEBUG1,
+					(errmsg("watchdog succeeded to ping a host \"%s\"", hosts[seq])));
+
+			if (stop_at_first || nreachable == count)
+				goto done;
+		}
+	}
+
+done:
+	close(sock);
+	pfree(addrs);
+	pfree(resolved);
+	return nreachable;
+}
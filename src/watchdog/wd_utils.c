@@ -42,6 +42,7 @@
 #include "utils/ssl_utils.h"
 
 static int	has_setuid_bit(char *path);
+static void check_network_command(const char *param, const char *label, char *cmd, char *dir);
 static void *exec_func(void *arg);
 
 /*
@@ -57,9 +58,6 @@ typedef struct
 void
 wd_check_network_command_configurations(void)
 {
-	char		path[128];
-	char	   *command;
-
 	if (pool_config->use_watchdog == 0)
 		return;
 
@@ -70,73 +68,59 @@ wd_check_network_command_configurations(void)
 	if (strlen(pool_config->delegate_ip) == 0)
 		return;
 
-	/* check setuid bit of ifup command */
-	command = wd_get_cmd(pool_config->if_up_cmd);
+	check_network_command("if_up_cmd", "ifup", pool_config->if_up_cmd, pool_config->if_cmd_path);
+	check_network_command("if_down_cmd", "ifdown", pool_config->if_down_cmd, pool_config->if_cmd_path);
+	check_network_command("arping_cmd", "arping", pool_config->arping_cmd, pool_config->arping_path);
+}
 
-	if (command)
-	{
-		if (command[0] == '/')
-		{
-			pfree(command);
-			return;
-		}
+/*
+ * Validate one of the commands used to move the delegate IP, so that a
+ * broken setting is reported at startup rather than at escalation time.
+ * The command is resolved the same way as in wd_IP_up() and wd_IP_down():
+ * an absolute path is used as is, otherwise it is looked up in "dir".
+ */
+static void
+check_network_command(const char *param, const char *label, char *cmd, char *dir)
+{
+	char		path[WD_MAX_PATH_LEN];
+	char	   *command;
+	bool		absolute;
 
-		snprintf(path, sizeof(path), "%s/%s", pool_config->if_cmd_path, command);
-		pfree(command);
-		if (!has_setuid_bit(path))
-		{
-			ereport(WARNING,
-					(errmsg("checking setuid bit of if_up_cmd"),
-					 errdetail("ifup[%s] doesn't have setuid bit", path)));
-		}
-	}
-	else
+	command = wd_get_cmd(cmd);
+	if (command == NULL)
 	{
 		ereport(FATAL,
-				(errmsg("invalid configuration for if_up_cmd parameter"),
-				 errdetail("unable to get command from \"%s\"", pool_config->if_up_cmd)));
+				(errmsg("invalid configuration for %s parameter", param),
+				 errdetail("unable to get command from \"%s\"", cmd)));
 	}
-	/* check setuid bit of ifdown command */
 
-	command = wd_get_cmd(pool_config->if_down_cmd);
-	if (command)
-	{
-		snprintf(path, sizeof(path), "%s/%s", pool_config->if_cmd_path, command);
-		pfree(command);
-		if (!has_setuid_bit(path))
-		{
-			ereport(WARNING,
-					(errmsg("checking setuid bit of if_down_cmd"),
-					 errdetail("ifdown[%s] doesn't have setuid bit", path)));
-		}
-	}
+	absolute = (command[0] == '/');
+	if (absolute)
+		snprintf(path, sizeof(path), "%s", command);
 	else
-	{
-		ereport(FATAL,
-				(errmsg("invalid configuration for if_down_cmd parameter"),
-				 errdetail("unable to get command from \"%s\"", pool_config->if_down_cmd)));
-	}
+		snprintf(path, sizeof(path), "%s/%s", dir, command);
+	pfree(command);
 
-	/* check setuid bit of arping command */
-	command = wd_get_cmd(pool_config->arping_cmd);
-	if (command)
+	/*
+	 * check setuid bit of the command. Commands given with an absolute path
+	 * are usually run through sudo, so they are not checked.
+	 */
+	if (!absolute)
 	{
-		snprintf(path, sizeof(path), "%s/%s", pool_config->arping_path, command);
-		pfree(command);
 		if (!has_setuid_bit(path))
 		{
 			ereport(WARNING,
-					(errmsg("checking setuid bit of arping command"),
-					 errdetail("arping[%s] doesn't have setuid bit", path)));
+					(errmsg("checking setuid bit of %s", param),
+					 errdetail("%s[%s] doesn't have setuid bit", label, path)));
 		}
 	}
-	else
+
+	if (access(path, X_OK) != 0)
 	{
-		ereport(FATAL,
-				(errmsg("invalid configuration for arping_cmd parameter"),
-				 errdetail("unable to get command from \"%s\"", pool_config->arping_cmd)));
+		ereport(WARNING,
+				(errmsg("checking %s", param),
+				 errdetail("%s[%s] can not be executed: %m", label, path)));
 	}
-
 }
 
 /*